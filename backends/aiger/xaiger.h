@@ -0,0 +1,76 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *                2019  Eddie Hung <eddie@fpgeh.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef XAIGER_H
+#define XAIGER_H
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Converts a module to the XAIGER format used by abc9. The module is only
+// read, so writers for different modules of the same design may be
+// constructed and written concurrently (within IdString::begin_concurrent()
+// and end_concurrent()).
+struct XAigerWriter
+{
+	Design *design;
+	Module *module;
+	SigMap sigmap;
+
+	dict<SigBit, State> init_map;
+	pool<SigBit> input_bits, output_bits;
+	dict<SigBit, SigBit> not_map, alias_map;
+	dict<SigBit, pair<SigBit, SigBit>> and_map;
+	vector<SigBit> ci_bits, co_bits;
+	vector<Cell*> ff_list;
+	dict<SigBit, float> arrival_times;
+
+	vector<pair<int, int>> aig_gates;
+	vector<int> aig_outputs;
+	int aig_m = 0, aig_i = 0, aig_l = 0, aig_o = 0, aig_a = 0;
+
+	dict<SigBit, int> aig_map;
+
+	vector<Cell*> box_list;
+
+	XAigerWriter(Module *module, bool dff_mode);
+
+	void write_aiger(std::ostream &f, bool ascii_mode);
+
+	// Writes the port and box symbols that read_aiger -map uses to connect
+	// the mapped netlist back to the module.
+	void write_map(std::ostream &f);
+
+	// The statistics that write_xaiger stores in the scratchpad.
+	int num_ands() const { return GetSize(and_map); }
+	int num_wires() const { return GetSize(aig_map); }
+	int num_inputs() const { return GetSize(input_bits); }
+	int num_outputs() const { return GetSize(output_bits); }
+
+private:
+	int mkgate(int a0, int a1);
+	int bit2aig(SigBit bit);
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -24,8 +24,9 @@
 #include "kernel/rtlil.h"
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
-#include "kernel/celltypes.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
+#include "backends/blif/blif.h"
 #include <string>
 
 USING_YOSYS_NAMESPACE
@@ -56,18 +57,31 @@ struct BlifDumperConfig
 
 struct BlifDumper
 {
-	std::ostream &f;
+	BlifWriter &f;
 	RTLIL::Module *module;
 	RTLIL::Design *design;
 	BlifDumperConfig *config;
-	CellTypes ct;
 
 	SigMap sigmap;
 	dict<SigBit, int> init_bits;
 
-	BlifDumper(std::ostream &f, RTLIL::Module *module, RTLIL::Design *design, BlifDumperConfig *config) :
-			f(f), module(module), design(design), config(config), ct(design), sigmap(module)
+	// dense ids of the wire bits, followed by the ids of the constant
+	// nets $false, $true and $undef
+	dict<RTLIL::Wire*, int> wire_base;
+	int num_bits;
+	std::vector<bool> bits_seen;
+
+	BlifDumper(BlifWriter &f, RTLIL::Module *module, RTLIL::Design *design, BlifDumperConfig *config) :
+			f(f), module(module), design(design), config(config), sigmap(module), num_bits(0)
 	{
+		for (Wire *wire : module->wires()) {
+			wire_base[wire] = num_bits;
+			num_bits += wire->width;
+		}
+		f.reset_nets(num_bits + 3);
+		if (config->noalias_mode)
+			bits_seen.resize(num_bits);
+
 		for (Wire *wire : module->wires())
 			if (wire->attributes.count(ID::init)) {
 				SigSpec initsig = sigmap(wire);
@@ -86,48 +100,58 @@ struct BlifDumper
 			}
 	}
 
-	pool<SigBit> cstr_bits_seen;
-
-	const std::string str(RTLIL::IdString id)
+	static std::string legalize(std::string str)
 	{
-		std::string str = RTLIL::unescape_id(id);
 		for (size_t i = 0; i < str.size(); i++)
 			if (str[i] == '#' || str[i] == '=' || str[i] == '<' || str[i] == '>')
 				str[i] = '?';
 		return str;
 	}
 
-	const std::string str(RTLIL::SigBit sig)
+	const std::string str(const RTLIL::IdString &id)
 	{
-		cstr_bits_seen.insert(sig);
+		return legalize(RTLIL::unescape_id(id));
+	}
 
-		if (sig.wire == NULL) {
-			if (sig == RTLIL::State::S0) return config->false_type == "-" || config->false_type == "+" ? config->false_out.c_str() : "$false";
-			if (sig == RTLIL::State::S1) return config->true_type == "-" || config->true_type == "+" ? config->true_out.c_str() : "$true";
-			return config->undef_type == "-" || config->undef_type == "+" ? config->undef_out.c_str() : "$undef";
+	const std::string &str(RTLIL::SigBit sig)
+	{
+		int id;
+		if (sig.wire == NULL)
+			id = num_bits + (sig == RTLIL::State::S0 ? 0 : sig == RTLIL::State::S1 ? 1 : 2);
+		else {
+			id = wire_base.at(sig.wire) + sig.offset;
+			if (config->noalias_mode)
+				bits_seen[id] = true;
 		}
 
-		std::string str = RTLIL::unescape_id(sig.wire->name);
-		for (size_t i = 0; i < str.size(); i++)
-			if (str[i] == '#' || str[i] == '=' || str[i] == '<' || str[i] == '>')
-				str[i] = '?';
+		std::string &name = f.net(id);
+		if (!name.empty())
+			return name;
 
-		if (sig.wire->width != 1)
-			str += stringf("[%d]", sig.wire->upto ? sig.wire->start_offset+sig.wire->width-sig.offset-1 : sig.wire->start_offset+sig.offset);
+		if (sig.wire == NULL) {
+			if (sig == RTLIL::State::S0)
+				name = config->false_type == "-" || config->false_type == "+" ? config->false_out : "$false";
+			else if (sig == RTLIL::State::S1)
+				name = config->true_type == "-" || config->true_type == "+" ? config->true_out : "$true";
+			else
+				name = config->undef_type == "-" || config->undef_type == "+" ? config->undef_out : "$undef";
+			return name;
+		}
 
-		return str;
+		name = legalize(RTLIL::unescape_id(sig.wire->name));
+		if (sig.wire->width != 1)
+			name += stringf("[%d]", sig.wire->upto ? sig.wire->start_offset+sig.wire->width-sig.offset-1 : sig.wire->start_offset+sig.offset);
+		return name;
 	}
 
-	const std::string str_init(RTLIL::SigBit sig)
+	const char *str_init(RTLIL::SigBit sig)
 	{
 		sigmap.apply(sig);
 
-		if (init_bits.count(sig) == 0)
+		auto it = init_bits.find(sig);
+		if (it == init_bits.end())
 			return " 2";
-
-		string str = stringf(" %d", init_bits.at(sig));
-
-		return str;
+		return it->second ? " 1" : " 0";
 	}
 
 	const char *subckt_or_gate(std::string cell_type)
@@ -144,27 +168,43 @@ struct BlifDumper
 	void dump_params(const char *command, dict<IdString, Const> &params)
 	{
 		for (auto &param : params) {
-			f << stringf("%s %s ", command, log_id(param.first));
+			f << command << ' ' << RTLIL::unescape_id(param.first) << ' ';
 			if (param.second.flags & RTLIL::CONST_FLAG_STRING) {
 				std::string str = param.second.decode_string();
-				f << stringf("\"");
+				f << '"';
 				for (char ch : str)
 					if (ch == '"' || ch == '\\')
-						f << stringf("\\%c", ch);
+						f << '\\' << ch;
 					else if (ch < 32 || ch >= 127)
 						f << stringf("\\%03o", ch);
 					else
-						f << stringf("%c", ch);
-				f << stringf("\"\n");
+						f << ch;
+				f << "\"\n";
 			} else
-				f << stringf("%s\n", param.second.as_string().c_str());
+				f << param.second.as_string() << '\n';
 		}
 	}
 
+	// Writes a .names statement for a simple gate with output Y.
+	void dump_names(RTLIL::Cell *cell, std::initializer_list<RTLIL::IdString> inputs, const char *cover)
+	{
+		f << ".names";
+		for (auto port : inputs)
+			f << ' ' << str(cell->getPort(port));
+		f << ' ' << str(cell->getPort(ID::Y)) << '\n' << cover;
+	}
+
+	void dump_latch(RTLIL::Cell *cell, const char *type, const RTLIL::IdString &control)
+	{
+		f << ".latch " << str(cell->getPort(ID::D)) << ' ' << str(cell->getPort(ID::Q));
+		if (type != nullptr)
+			f << ' ' << type << ' ' << str(cell->getPort(control));
+		f << str_init(cell->getPort(ID::Q)) << '\n';
+	}
+
 	void dump()
 	{
-		f << stringf("\n");
-		f << stringf(".model %s\n", str(module->name).c_str());
+		f << "\n.model " << str(module->name) << '\n';
 
 		std::map<int, RTLIL::Wire*> inputs, outputs;
 
@@ -175,212 +215,184 @@ struct BlifDumper
 				outputs[wire->port_id] = wire;
 		}
 
-		f << stringf(".inputs");
+		f << ".inputs";
 		for (auto &it : inputs) {
 			RTLIL::Wire *wire = it.second;
 			for (int i = 0; i < wire->width; i++)
-				f << stringf(" %s", str(RTLIL::SigSpec(wire, i)).c_str());
+				f << ' ' << str(RTLIL::SigBit(wire, i));
 		}
-		f << stringf("\n");
+		f << '\n';
 
-		f << stringf(".outputs");
+		f << ".outputs";
 		for (auto &it : outputs) {
 			RTLIL::Wire *wire = it.second;
 			for (int i = 0; i < wire->width; i++)
-				f << stringf(" %s", str(RTLIL::SigSpec(wire, i)).c_str());
+				f << ' ' << str(RTLIL::SigBit(wire, i));
 		}
-		f << stringf("\n");
+		f << '\n';
 
 		if (module->get_blackbox_attribute()) {
-			f << stringf(".blackbox\n");
-			f << stringf(".end\n");
+			f << ".blackbox\n";
+			f << ".end\n";
 			return;
 		}
 
 		if (!config->impltf_mode) {
 			if (!config->false_type.empty()) {
 				if (config->false_type == "+")
-					f << stringf(".names %s\n", config->false_out.c_str());
+					f << ".names " << config->false_out << '\n';
 				else if (config->false_type != "-")
-					f << stringf(".%s %s %s=$false\n", subckt_or_gate(config->false_type),
-							config->false_type.c_str(), config->false_out.c_str());
+					f << '.' << subckt_or_gate(config->false_type) << ' ' << config->false_type << ' ' << config->false_out << "=$false\n";
 			} else
-				f << stringf(".names $false\n");
+				f << ".names $false\n";
 			if (!config->true_type.empty()) {
 				if (config->true_type == "+")
-					f << stringf(".names %s\n1\n", config->true_out.c_str());
+					f << ".names " << config->true_out << "\n1\n";
 				else if (config->true_type != "-")
-					f << stringf(".%s %s %s=$true\n", subckt_or_gate(config->true_type),
-							config->true_type.c_str(), config->true_out.c_str());
+					f << '.' << subckt_or_gate(config->true_type) << ' ' << config->true_type << ' ' << config->true_out << "=$true\n";
 			} else
-				f << stringf(".names $true\n1\n");
+				f << ".names $true\n1\n";
 			if (!config->undef_type.empty()) {
 				if (config->undef_type == "+")
-					f << stringf(".names %s\n", config->undef_out.c_str());
+					f << ".names " << config->undef_out << '\n';
 				else if (config->undef_type != "-")
-					f << stringf(".%s %s %s=$undef\n", subckt_or_gate(config->undef_type),
-							config->undef_type.c_str(), config->undef_out.c_str());
+					f << '.' << subckt_or_gate(config->undef_type) << ' ' << config->undef_type << ' ' << config->undef_out << "=$undef\n";
 			} else
-				f << stringf(".names $undef\n");
+				f << ".names $undef\n";
 		}
 
 		for (auto cell : module->cells())
 		{
 			if (config->unbuf_types.count(cell->type)) {
 				auto portnames = config->unbuf_types.at(cell->type);
-				f << stringf(".names %s %s\n1 1\n",
-						str(cell->getPort(portnames.first)).c_str(), str(cell->getPort(portnames.second)).c_str());
+				f << ".names " << str(cell->getPort(portnames.first)) << ' ' << str(cell->getPort(portnames.second)) << "\n1 1\n";
 				continue;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_NOT_)) {
-				f << stringf(".names %s %s\n0 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A}, "0 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_AND_)) {
-				f << stringf(".names %s %s %s\n11 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "11 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_OR_)) {
-				f << stringf(".names %s %s %s\n1- 1\n-1 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "1- 1\n-1 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_XOR_)) {
-				f << stringf(".names %s %s %s\n10 1\n01 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "10 1\n01 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_NAND_)) {
-				f << stringf(".names %s %s %s\n0- 1\n-0 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "0- 1\n-0 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_NOR_)) {
-				f << stringf(".names %s %s %s\n00 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "00 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_XNOR_)) {
-				f << stringf(".names %s %s %s\n11 1\n00 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "11 1\n00 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_ANDNOT_)) {
-				f << stringf(".names %s %s %s\n10 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "10 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_ORNOT_)) {
-				f << stringf(".names %s %s %s\n1- 1\n-0 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B}, "1- 1\n-0 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_AOI3_)) {
-				f << stringf(".names %s %s %s %s\n-00 1\n0-0 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::C)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::C}, "-00 1\n0-0 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_OAI3_)) {
-				f << stringf(".names %s %s %s %s\n00- 1\n--0 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(), str(cell->getPort(ID::C)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::C}, "00- 1\n--0 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_AOI4_)) {
-				f << stringf(".names %s %s %s %s %s\n-0-0 1\n-00- 1\n0--0 1\n0-0- 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(),
-						str(cell->getPort(ID::C)).c_str(), str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::C, ID::D}, "-0-0 1\n-00- 1\n0--0 1\n0-0- 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_OAI4_)) {
-				f << stringf(".names %s %s %s %s %s\n00-- 1\n--00 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(),
-						str(cell->getPort(ID::C)).c_str(), str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::C, ID::D}, "00-- 1\n--00 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_MUX_)) {
-				f << stringf(".names %s %s %s %s\n1-0 1\n-11 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(),
-						str(cell->getPort(ID::S)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::S}, "1-0 1\n-11 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_NMUX_)) {
-				f << stringf(".names %s %s %s %s\n0-0 1\n-01 1\n",
-						str(cell->getPort(ID::A)).c_str(), str(cell->getPort(ID::B)).c_str(),
-						str(cell->getPort(ID::S)).c_str(), str(cell->getPort(ID::Y)).c_str());
+				dump_names(cell, {ID::A, ID::B, ID::S}, "0-0 1\n-01 1\n");
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_FF_)) {
-				f << stringf(".latch %s %s%s\n", str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Q)).c_str(),
-						str_init(cell->getPort(ID::Q)).c_str());
+				dump_latch(cell, nullptr, RTLIL::IdString());
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_DFF_N_)) {
-				f << stringf(".latch %s %s fe %s%s\n", str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Q)).c_str(),
-						str(cell->getPort(ID::C)).c_str(), str_init(cell->getPort(ID::Q)).c_str());
+				dump_latch(cell, "fe", ID::C);
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_DFF_P_)) {
-				f << stringf(".latch %s %s re %s%s\n", str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Q)).c_str(),
-						str(cell->getPort(ID::C)).c_str(), str_init(cell->getPort(ID::Q)).c_str());
+				dump_latch(cell, "re", ID::C);
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_DLATCH_N_)) {
-				f << stringf(".latch %s %s al %s%s\n", str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Q)).c_str(),
-						str(cell->getPort(ID::E)).c_str(), str_init(cell->getPort(ID::Q)).c_str());
+				dump_latch(cell, "al", ID::E);
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($_DLATCH_P_)) {
-				f << stringf(".latch %s %s ah %s%s\n", str(cell->getPort(ID::D)).c_str(), str(cell->getPort(ID::Q)).c_str(),
-						str(cell->getPort(ID::E)).c_str(), str_init(cell->getPort(ID::Q)).c_str());
+				dump_latch(cell, "ah", ID::E);
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($lut)) {
-				f << stringf(".names");
+				f << ".names";
 				auto &inputs = cell->getPort(ID::A);
 				auto width = cell->parameters.at(ID::WIDTH).as_int();
 				log_assert(inputs.size() == width);
 				for (int i = width-1; i >= 0; i--)
-					f << stringf(" %s", str(inputs.extract(i, 1)).c_str());
+					f << ' ' << str(inputs[i]);
 				auto &output = cell->getPort(ID::Y);
 				log_assert(output.size() == 1);
-				f << stringf(" %s", str(output).c_str());
-				f << stringf("\n");
-				RTLIL::SigSpec mask = cell->parameters.at(ID::LUT);
+				f << ' ' << str(output) << '\n';
+				const RTLIL::Const &mask = cell->parameters.at(ID::LUT);
+				std::string row(width, '0');
+				row += " 1\n";
 				for (int i = 0; i < (1 << width); i++)
-					if (mask[i] == State::S1) {
-						for (int j = width-1; j >= 0; j--) {
-							f << ((i>>j)&1 ? '1' : '0');
-						}
-						f << " 1\n";
+					if (i < GetSize(mask) && mask[i] == State::S1) {
+						for (int j = width-1; j >= 0; j--)
+							row[width-1-j] = (i>>j)&1 ? '1' : '0';
+						f << row;
 					}
 				goto internal_cell;
 			}
 
 			if (!config->icells_mode && cell->type == ID($sop)) {
-				f << stringf(".names");
+				f << ".names";
 				auto &inputs = cell->getPort(ID::A);
 				auto width = cell->parameters.at(ID::WIDTH).as_int();
 				auto depth = cell->parameters.at(ID::DEPTH).as_int();
@@ -389,51 +401,51 @@ struct BlifDumper
 					table.push_back(State::S0);
 				log_assert(inputs.size() == width);
 				for (int i = 0; i < width; i++)
-					f << stringf(" %s", str(inputs.extract(i, 1)).c_str());
+					f << ' ' << str(inputs[i]);
 				auto &output = cell->getPort(ID::Y);
 				log_assert(output.size() == 1);
-				f << stringf(" %s", str(output).c_str());
-				f << stringf("\n");
+				f << ' ' << str(output) << '\n';
+				std::string row(width, '-');
+				row += " 1\n";
 				for (int i = 0; i < depth; i++) {
 					for (int j = 0; j < width; j++) {
 						bool pat0 = table.at(2*width*i + 2*j + 0) == State::S1;
 						bool pat1 = table.at(2*width*i + 2*j + 1) == State::S1;
-						if (pat0 && !pat1) f << "0";
-						else if (!pat0 && pat1) f << "1";
-						else f << "-";
+						row[j] = pat0 && !pat1 ? '0' : !pat0 && pat1 ? '1' : '-';
 					}
-					f << " 1\n";
+					f << row;
 				}
 				goto internal_cell;
 			}
 
-			f << stringf(".%s %s", subckt_or_gate(cell->type.str()), str(cell->type).c_str());
+			f << '.' << subckt_or_gate(cell->type.str()) << ' ' << str(cell->type);
 			for (auto &conn : cell->connections())
 			{
 				if (conn.second.size() == 1) {
-					f << stringf(" %s=%s", str(conn.first).c_str(), str(conn.second[0]).c_str());
+					f << ' ' << str(conn.first) << '=' << str(conn.second[0]);
 					continue;
 				}
 
 				Module *m = design->module(cell->type);
 				Wire *w = m ? m->wire(conn.first) : nullptr;
+				std::string port = str(conn.first);
 
 				if (w == nullptr) {
 					for (int i = 0; i < GetSize(conn.second); i++)
-						f << stringf(" %s[%d]=%s", str(conn.first).c_str(), i, str(conn.second[i]).c_str());
+						f << ' ' << port << '[' << i << "]=" << str(conn.second[i]);
 				} else {
 					for (int i = 0; i < std::min(GetSize(conn.second), GetSize(w)); i++) {
 						SigBit sig(w, i);
-						f << stringf(" %s[%d]=%s", str(conn.first).c_str(), sig.wire->upto ?
+						f << ' ' << port << '[' << (sig.wire->upto ?
 								sig.wire->start_offset+sig.wire->width-sig.offset-1 :
-								sig.wire->start_offset+sig.offset, str(conn.second[i]).c_str());
+								sig.wire->start_offset+sig.offset) << "]=" << str(conn.second[i]);
 					}
 				}
 			}
-			f << stringf("\n");
+			f << '\n';
 
 			if (config->cname_mode)
-				f << stringf(".cname %s\n", str(cell->name).c_str());
+				f << ".cname " << str(cell->name) << '\n';
 			if (config->attr_mode)
 				dump_params(".attr", cell->attributes);
 			if (config->param_mode)
@@ -442,7 +454,7 @@ struct BlifDumper
 			if (0) {
 		internal_cell:
 				if (config->iname_mode)
-					f << stringf(".cname %s\n", str(cell->name).c_str());
+					f << ".cname " << str(cell->name) << '\n';
 				if (config->iattr_mode)
 					dump_params(".attr", cell->attributes);
 			}
@@ -454,22 +466,22 @@ struct BlifDumper
 			SigBit lhs_bit = conn.first[i];
 			SigBit rhs_bit = conn.second[i];
 
-			if (config->noalias_mode && cstr_bits_seen.count(lhs_bit) == 0)
+			if (config->noalias_mode && (lhs_bit.wire == NULL || !bits_seen[wire_base.at(lhs_bit.wire) + lhs_bit.offset]))
 				continue;
 
 			if (config->conn_mode)
-				f << stringf(".conn %s %s\n", str(rhs_bit).c_str(), str(lhs_bit).c_str());
+				f << ".conn " << str(rhs_bit) << ' ' << str(lhs_bit) << '\n';
 			else if (!config->buf_type.empty())
-				f << stringf(".%s %s %s=%s %s=%s\n", subckt_or_gate(config->buf_type), config->buf_type.c_str(),
-						config->buf_in.c_str(), str(rhs_bit).c_str(), config->buf_out.c_str(), str(lhs_bit).c_str());
+				f << '.' << subckt_or_gate(config->buf_type) << ' ' << config->buf_type << ' ' << config->buf_in << '=' << str(rhs_bit) <<
+						' ' << config->buf_out << '=' << str(lhs_bit) << '\n';
 			else
-				f << stringf(".names %s %s\n1 1\n", str(rhs_bit).c_str(), str(lhs_bit).c_str());
+				f << ".names " << str(rhs_bit) << ' ' << str(lhs_bit) << "\n1 1\n";
 		}
 
-		f << stringf(".end\n");
+		f << ".end\n";
 	}
 
-	static void dump(std::ostream &f, RTLIL::Module *module, RTLIL::Design *design, BlifDumperConfig &config)
+	static void dump(BlifWriter &f, RTLIL::Module *module, RTLIL::Design *design, BlifDumperConfig &config)
 	{
 		BlifDumper dumper(f, module, design, &config);
 		dumper.dump();
@@ -667,7 +679,7 @@ struct BlifBackend : public Backend {
 				log_error("Found unmapped memories in module %s: unmapped memories are not supported in BLIF backend!\n", log_id(module->name));
 
 			if (module->name == RTLIL::escape_id(top_module_name)) {
-				BlifDumper::dump(*f, module, design, config);
+				mod_list.insert(mod_list.begin(), module);
 				top_module_name.clear();
 				continue;
 			}
@@ -678,8 +690,22 @@ struct BlifBackend : public Backend {
 		if (!top_module_name.empty())
 			log_error("Can't find top module `%s'!\n", top_module_name.c_str());
 
-		for (auto module : mod_list)
-			BlifDumper::dump(*f, module, design, config);
+		// The modules are dumped into separate buffers in parallel, in
+		// batches of a few modules per thread, and each batch is written in
+		// module order before the next one is started.
+		int batch_size = 4 * yosys_thread_count(GetSize(mod_list));
+		for (int batch_begin = 0; batch_begin < GetSize(mod_list); batch_begin += batch_size)
+		{
+			int batch_end = std::min(batch_begin + batch_size, GetSize(mod_list));
+			std::vector<BlifWriter> buffers(batch_end - batch_begin);
+			auto job = [&](int i) {
+				BlifDumper::dump(buffers[i], mod_list[batch_begin + i], design, config);
+			};
+			ThreadPool::run(GetSize(buffers), job, yosys_thread_count(GetSize(buffers)));
+
+			for (auto &buffer : buffers)
+				buffer.write(*f);
+		}
 	}
 } BlifBackend;
 
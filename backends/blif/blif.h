@@ -0,0 +1,98 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef BLIF_BACKEND_H
+#define BLIF_BACKEND_H
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Collects BLIF text in a buffer that is written out in one piece, together
+// with a cache of the net names by dense net id. Used by write_blif and by
+// abc for the netlists it exchanges with ABC.
+struct BlifWriter
+{
+	std::string buf;
+
+	BlifWriter &operator<<(const std::string &str) { buf += str; return *this; }
+	BlifWriter &operator<<(const char *str) { buf += str; return *this; }
+	BlifWriter &operator<<(char ch) { buf += ch; return *this; }
+
+	BlifWriter &operator<<(int value)
+	{
+		char digits[16];
+		int len = snprintf(digits, sizeof(digits), "%d", value);
+		buf.append(digits, len);
+		return *this;
+	}
+
+	// Clears the net name cache and makes room for the ids 0..num_nets-1.
+	// The cache is not resized afterwards, so references to its entries
+	// stay valid.
+	void reset_nets(int num_nets)
+	{
+		net_names.clear();
+		net_names.resize(num_nets);
+	}
+
+	// Names the nets 0..num_nets-1 "<prefix><id>".
+	void number_nets(const std::string &prefix, int num_nets)
+	{
+		reset_nets(num_nets);
+		for (int id = 0; id < num_nets; id++)
+			net_names[id] = prefix + std::to_string(id);
+	}
+
+	// The cached name of a net, empty if it has not been set yet.
+	std::string &net(int id) { return net_names.at(id); }
+
+	// Writes ".names <inputs> <output>" followed by the cover.
+	void names(const int *inputs, int num_inputs, int output, const char *cover)
+	{
+		buf += ".names";
+		for (int i = 0; i < num_inputs; i++) {
+			buf += ' ';
+			buf += net_names.at(inputs[i]);
+		}
+		buf += ' ';
+		buf += net_names.at(output);
+		buf += '\n';
+		buf += cover;
+	}
+
+	void write(std::ostream &f)
+	{
+		f.write(buf.data(), buf.size());
+		buf.clear();
+	}
+
+	void write(FILE *f)
+	{
+		fwrite(buf.data(), 1, buf.size(), f);
+		buf.clear();
+	}
+
+private:
+	std::vector<std::string> net_names;
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
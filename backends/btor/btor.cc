@@ -69,6 +69,16 @@ struct BtorWorker
 	// nids for constants
 	dict<Const, int> consts;
 
+	// <expression> => <nid>, for sharing identical expression nodes
+	dict<string, int> expr_nids;
+
+	// only export the logic in the cone of influence of the properties
+	bool coi_mode;
+	int num_exported_cells = 0;
+
+	// output is collected here and written in large blocks
+	string outbuf;
+
 	// ff inputs that need to be evaluated (<nid>, <ff_cell>)
 	vector<pair<int, Cell*>> ff_todo;
 	vector<pair<int, Mem*>> mem_todo;
@@ -101,12 +111,58 @@ struct BtorWorker
 
 	PrettyJson ywmap_json;
 
+	void flush_out()
+	{
+		f.write(outbuf.data(), outbuf.size());
+		outbuf.clear();
+	}
+
+	void vappendf(const char *fmt, va_list ap)
+	{
+		char buffer[256];
+		va_list ap_copy;
+		va_copy(ap_copy, ap);
+		int len = vsnprintf(buffer, sizeof(buffer), fmt, ap_copy);
+		va_end(ap_copy);
+		if (len >= 0 && len < int(sizeof(buffer)))
+			outbuf.append(buffer, len);
+		else
+			outbuf += vstringf(fmt, ap);
+		if (GetSize(outbuf) >= (1 << 16))
+			flush_out();
+	}
+
 	void btorf(const char *fmt, ...) YS_ATTRIBUTE(format(printf, 2, 3))
 	{
 		va_list ap;
 		va_start(ap, fmt);
-		f << indent << vstringf(fmt, ap);
+		outbuf += indent;
+		vappendf(fmt, ap);
+		va_end(ap);
+	}
+
+	// Emits "<nid> <expr><info>" for an expression node and returns its nid.
+	// An expression that was emitted before returns the existing nid and the
+	// info of the new node is dropped. Nodes that must be distinct, such as
+	// states and inputs, are emitted with btorf() instead.
+	int btor_expr(const string &info, const char *fmt, ...) YS_ATTRIBUTE(format(printf, 3, 4))
+	{
+		va_list ap;
+		va_start(ap, fmt);
+		string expr = vstringf(fmt, ap);
 		va_end(ap);
+
+		auto it = expr_nids.find(expr);
+		if (it != expr_nids.end()) {
+			if (verbose)
+				btorf("; %d %s (shared)\n", it->second, expr.c_str());
+			return it->second;
+		}
+
+		int nid = next_nid++;
+		btorf("%d %s%s\n", nid, expr.c_str(), info.c_str());
+		expr_nids[expr] = nid;
+		return nid;
 	}
 
 	void infof(const char *fmt, ...) YS_ATTRIBUTE(format(printf, 2, 3))
@@ -191,7 +247,7 @@ struct BtorWorker
 	void btorf_push(const string &id)
 	{
 		if (verbose) {
-			f << indent << stringf("  ; begin %s\n", id.c_str());
+			btorf("  ; begin %s\n", id.c_str());
 			indent += "    ";
 		}
 	}
@@ -200,7 +256,7 @@ struct BtorWorker
 	{
 		if (verbose) {
 			indent = indent.substr(4);
-			f << indent << stringf("  ; end %s\n", id.c_str());
+			btorf("  ; end %s\n", id.c_str());
 		}
 	}
 
@@ -230,7 +286,7 @@ struct BtorWorker
 	void add_nid_sig(int nid, const SigSpec &sig)
 	{
 		if (verbose)
-			f << indent << stringf("; %d %s\n", nid, log_signal(sig));
+			btorf("; %d %s\n", nid, log_signal(sig));
 
 		for (int i = 0; i < GetSize(sig); i++)
 			bit_nid[sig[i]] = make_pair(nid, i);
@@ -296,8 +352,7 @@ struct BtorWorker
 
 				// zero-extend the rest
 				int zeroes = get_sig_nid(Const(0, width-width_ay));
-				nid_a = next_nid++;
-				btorf("%d concat %d %d %d\n", nid_a, sid, zeroes, nid_a_padded);
+				nid_a = btor_expr("", "concat %d %d %d", sid, zeroes, nid_a_padded);
 			} else {
 				nid_a = get_sig_nid(cell->getPort(ID::A), width, a_signed);
 			}
@@ -306,36 +361,26 @@ struct BtorWorker
 
 			if (btor_op == "shift")
 			{
-				int nid_r = next_nid++;
-				btorf("%d srl %d %d %d\n", nid_r, sid, nid_a, nid_b);
-
-				int nid_b_neg = next_nid++;
-				btorf("%d neg %d %d\n", nid_b_neg, sid, nid_b);
-
-				int nid_l = next_nid++;
-				btorf("%d sll %d %d %d\n", nid_l, sid, nid_a, nid_b_neg);
+				int nid_r = btor_expr("", "srl %d %d %d", sid, nid_a, nid_b);
+				int nid_b_neg = btor_expr("", "neg %d %d", sid, nid_b);
+				int nid_l = btor_expr("", "sll %d %d %d", sid, nid_a, nid_b_neg);
 
 				int sid_bit = get_bv_sid(1);
 				int nid_zero = get_sig_nid(Const(0, width));
-				int nid_b_ltz = next_nid++;
-				btorf("%d slt %d %d %d\n", nid_b_ltz, sid_bit, nid_b, nid_zero);
+				int nid_b_ltz = btor_expr("", "slt %d %d %d", sid_bit, nid_b, nid_zero);
 
-				nid = next_nid++;
-				btorf("%d ite %d %d %d %d%s\n", nid, sid, nid_b_ltz, nid_l, nid_r, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "ite %d %d %d %d", sid, nid_b_ltz, nid_l, nid_r);
 			}
 			else
 			{
-				nid = next_nid++;
-				btorf("%d %s %d %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, nid_b, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%s %d %d %d", btor_op.c_str(), sid, nid_a, nid_b);
 			}
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 			if (GetSize(sig) < width) {
 				int sid = get_bv_sid(GetSize(sig));
-				int nid2 = next_nid++;
-				btorf("%d slice %d %d %d 0\n", nid2, sid, nid, GetSize(sig)-1);
-				nid = nid2;
+				nid = btor_expr("", "slice %d %d %d 0", sid, nid, GetSize(sig)-1);
 			}
 
 			add_nid_sig(nid, sig);
@@ -366,16 +411,13 @@ struct BtorWorker
 			int nid_b = get_sig_nid(cell->getPort(ID::B), width, b_signed);
 
 			int sid = get_bv_sid(width);
-			int nid = next_nid++;
-			btorf("%d %c%s %d %d %d%s\n", nid, a_signed || b_signed ? 's' : 'u', btor_op.c_str(), sid, nid_a, nid_b, getinfo(cell).c_str());
+			int nid = btor_expr(getinfo(cell), "%c%s %d %d %d", a_signed || b_signed ? 's' : 'u', btor_op.c_str(), sid, nid_a, nid_b);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 			if (GetSize(sig) < width) {
 				int sid = get_bv_sid(GetSize(sig));
-				int nid2 = next_nid++;
-				btorf("%d slice %d %d %d 0\n", nid2, sid, nid, GetSize(sig)-1);
-				nid = nid2;
+				nid = btor_expr("", "slice %d %d %d 0", sid, nid, GetSize(sig)-1);
 			}
 
 			add_nid_sig(nid, sig);
@@ -388,18 +430,8 @@ struct BtorWorker
 			int nid_a = get_sig_nid(cell->getPort(ID::A));
 			int nid_b = get_sig_nid(cell->getPort(ID::B));
 
-			int nid1 = next_nid++;
-			int nid2 = next_nid++;
-
-			if (cell->type == ID($_ANDNOT_)) {
-				btorf("%d not %d %d\n", nid1, sid, nid_b);
-				btorf("%d and %d %d %d%s\n", nid2, sid, nid_a, nid1, getinfo(cell).c_str());
-			}
-
-			if (cell->type == ID($_ORNOT_)) {
-				btorf("%d not %d %d\n", nid1, sid, nid_b);
-				btorf("%d or %d %d %d%s\n", nid2, sid, nid_a, nid1, getinfo(cell).c_str());
-			}
+			int nid1 = btor_expr("", "not %d %d", sid, nid_b);
+			int nid2 = btor_expr(getinfo(cell), "%s %d %d %d", cell->type == ID($_ANDNOT_) ? "and" : "or", sid, nid_a, nid1);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 			add_nid_sig(nid2, sig);
@@ -413,21 +445,11 @@ struct BtorWorker
 			int nid_b = get_sig_nid(cell->getPort(ID::B));
 			int nid_c = get_sig_nid(cell->getPort(ID::C));
 
-			int nid1 = next_nid++;
-			int nid2 = next_nid++;
-			int nid3 = next_nid++;
-
-			if (cell->type == ID($_OAI3_)) {
-				btorf("%d or %d %d %d\n", nid1, sid, nid_a, nid_b);
-				btorf("%d and %d %d %d\n", nid2, sid, nid1, nid_c);
-				btorf("%d not %d %d%s\n", nid3, sid, nid2, getinfo(cell).c_str());
-			}
-
-			if (cell->type == ID($_AOI3_)) {
-				btorf("%d and %d %d %d\n", nid1, sid, nid_a, nid_b);
-				btorf("%d or %d %d %d\n", nid2, sid, nid1, nid_c);
-				btorf("%d not %d %d%s\n", nid3, sid, nid2, getinfo(cell).c_str());
-			}
+			const char *op1 = cell->type == ID($_OAI3_) ? "or" : "and";
+			const char *op2 = cell->type == ID($_OAI3_) ? "and" : "or";
+			int nid1 = btor_expr("", "%s %d %d %d", op1, sid, nid_a, nid_b);
+			int nid2 = btor_expr("", "%s %d %d %d", op2, sid, nid1, nid_c);
+			int nid3 = btor_expr(getinfo(cell), "not %d %d", sid, nid2);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 			add_nid_sig(nid3, sig);
@@ -442,24 +464,12 @@ struct BtorWorker
 			int nid_c = get_sig_nid(cell->getPort(ID::C));
 			int nid_d = get_sig_nid(cell->getPort(ID::D));
 
-			int nid1 = next_nid++;
-			int nid2 = next_nid++;
-			int nid3 = next_nid++;
-			int nid4 = next_nid++;
-
-			if (cell->type == ID($_OAI4_)) {
-				btorf("%d or %d %d %d\n", nid1, sid, nid_a, nid_b);
-				btorf("%d or %d %d %d\n", nid2, sid, nid_c, nid_d);
-				btorf("%d and %d %d %d\n", nid3, sid, nid1, nid2);
-				btorf("%d not %d %d%s\n", nid4, sid, nid3, getinfo(cell).c_str());
-			}
-
-			if (cell->type == ID($_AOI4_)) {
-				btorf("%d and %d %d %d\n", nid1, sid, nid_a, nid_b);
-				btorf("%d and %d %d %d\n", nid2, sid, nid_c, nid_d);
-				btorf("%d or %d %d %d\n", nid3, sid, nid1, nid2);
-				btorf("%d not %d %d%s\n", nid4, sid, nid3, getinfo(cell).c_str());
-			}
+			const char *op1 = cell->type == ID($_OAI4_) ? "or" : "and";
+			const char *op2 = cell->type == ID($_OAI4_) ? "and" : "or";
+			int nid1 = btor_expr("", "%s %d %d %d", op1, sid, nid_a, nid_b);
+			int nid2 = btor_expr("", "%s %d %d %d", op1, sid, nid_c, nid_d);
+			int nid3 = btor_expr("", "%s %d %d %d", op2, sid, nid1, nid2);
+			int nid4 = btor_expr(getinfo(cell), "not %d %d", sid, nid3);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 			add_nid_sig(nid4, sig);
@@ -488,20 +498,18 @@ struct BtorWorker
 			int nid_a = get_sig_nid(cell->getPort(ID::A), width, a_signed);
 			int nid_b = get_sig_nid(cell->getPort(ID::B), width, b_signed);
 
-			int nid = next_nid++;
+			int nid;
 			if (cell->type.in(ID($lt), ID($le), ID($ge), ID($gt))) {
-				btorf("%d %c%s %d %d %d%s\n", nid, a_signed || b_signed ? 's' : 'u', btor_op.c_str(), sid, nid_a, nid_b, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%c%s %d %d %d", a_signed || b_signed ? 's' : 'u', btor_op.c_str(), sid, nid_a, nid_b);
 			} else {
-				btorf("%d %s %d %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, nid_b, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%s %d %d %d", btor_op.c_str(), sid, nid_a, nid_b);
 			}
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 			if (GetSize(sig) > 1) {
 				int sid = get_bv_sid(GetSize(sig));
-				int nid2 = next_nid++;
-				btorf("%d uext %d %d %d\n", nid2, sid, nid, GetSize(sig) - 1);
-				nid = nid2;
+				nid = btor_expr("", "uext %d %d %d", sid, nid, GetSize(sig) - 1);
 			}
 
 			add_nid_sig(nid, sig);
@@ -526,15 +534,12 @@ struct BtorWorker
 			{
 				log_assert(!btor_op.empty());
 				int sid = get_bv_sid(width);
-				nid = next_nid++;
-				btorf("%d %s %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%s %d %d", btor_op.c_str(), sid, nid_a);
 			}
 
 			if (GetSize(sig) < width) {
 				int sid = get_bv_sid(GetSize(sig));
-				int nid2 = next_nid++;
-				btorf("%d slice %d %d %d 0\n", nid2, sid, nid, GetSize(sig)-1);
-				nid = nid2;
+				nid = btor_expr("", "slice %d %d %d 0", sid, nid, GetSize(sig)-1);
 			}
 
 			add_nid_sig(nid, sig);
@@ -553,32 +558,24 @@ struct BtorWorker
 			int nid_a = get_sig_nid(cell->getPort(ID::A));
 			int nid_b = btor_op != "not" ? get_sig_nid(cell->getPort(ID::B)) : 0;
 
-			if (GetSize(cell->getPort(ID::A)) > 1) {
-				int nid_red_a = next_nid++;
-				btorf("%d redor %d %d\n", nid_red_a, sid, nid_a);
-				nid_a = nid_red_a;
-			}
+			if (GetSize(cell->getPort(ID::A)) > 1)
+				nid_a = btor_expr("", "redor %d %d", sid, nid_a);
 
-			if (btor_op != "not" && GetSize(cell->getPort(ID::B)) > 1) {
-				int nid_red_b = next_nid++;
-				btorf("%d redor %d %d\n", nid_red_b, sid, nid_b);
-				nid_b = nid_red_b;
-			}
+			if (btor_op != "not" && GetSize(cell->getPort(ID::B)) > 1)
+				nid_b = btor_expr("", "redor %d %d", sid, nid_b);
 
-			int nid = next_nid++;
+			int nid;
 			if (btor_op != "not")
-				btorf("%d %s %d %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, nid_b, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%s %d %d %d", btor_op.c_str(), sid, nid_a, nid_b);
 			else
-				btorf("%d %s %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "%s %d %d", btor_op.c_str(), sid, nid_a);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 			if (GetSize(sig) > 1) {
 				int sid = get_bv_sid(GetSize(sig));
 				int zeros_nid = get_sig_nid(Const(0, GetSize(sig)-1));
-				int nid2 = next_nid++;
-				btorf("%d concat %d %d %d\n", nid2, sid, zeros_nid, nid);
-				nid = nid2;
+				nid = btor_expr("", "concat %d %d %d", sid, zeros_nid, nid);
 			}
 
 			add_nid_sig(nid, sig);
@@ -596,25 +593,17 @@ struct BtorWorker
 			int sid = get_bv_sid(1);
 			int nid_a = get_sig_nid(cell->getPort(ID::A));
 
-			int nid = next_nid++;
+			int nid = btor_expr(getinfo(cell), "%s %d %d", btor_op.c_str(), sid, nid_a);
 
-			if (cell->type == ID($reduce_xnor)) {
-				int nid2 = next_nid++;
-				btorf("%d %s %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, getinfo(cell).c_str());
-				btorf("%d not %d %d\n", nid2, sid, nid);
-				nid = nid2;
-			} else {
-				btorf("%d %s %d %d%s\n", nid, btor_op.c_str(), sid, nid_a, getinfo(cell).c_str());
-			}
+			if (cell->type == ID($reduce_xnor))
+				nid = btor_expr("", "not %d %d", sid, nid);
 
 			SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 			if (GetSize(sig) > 1) {
 				int sid = get_bv_sid(GetSize(sig));
 				int zeros_nid = get_sig_nid(Const(0, GetSize(sig)-1));
-				int nid2 = next_nid++;
-				btorf("%d concat %d %d %d\n", nid2, sid, zeros_nid, nid);
-				nid = nid2;
+				nid = btor_expr("", "concat %d %d %d", sid, zeros_nid, nid);
 			}
 
 			add_nid_sig(nid, sig);
@@ -633,15 +622,13 @@ struct BtorWorker
 			int nid_s = get_sig_nid(sig_s);
 
 			int sid = get_bv_sid(GetSize(sig_y));
-			int nid = next_nid++;
+			int nid;
 
 			if (cell->type == ID($_NMUX_)) {
-				int tmp = nid;
-				nid = next_nid++;
-				btorf("%d ite %d %d %d %d\n", tmp, sid, nid_s, nid_b, nid_a);
-				btorf("%d not %d %d%s\n", nid, sid, tmp, getinfo(cell).c_str());
+				int tmp = btor_expr("", "ite %d %d %d %d", sid, nid_s, nid_b, nid_a);
+				nid = btor_expr(getinfo(cell), "not %d %d", sid, tmp);
 			} else {
-				btorf("%d ite %d %d %d %d%s\n", nid, sid, nid_s, nid_b, nid_a, getinfo(cell).c_str());
+				nid = btor_expr(getinfo(cell), "ite %d %d %d %d", sid, nid_s, nid_b, nid_a);
 			}
 
 			add_nid_sig(nid, sig_y);
@@ -662,12 +649,7 @@ struct BtorWorker
 			for (int i = 0; i < GetSize(sig_s); i++) {
 				int nid_b = get_sig_nid(sig_b.extract(i*width, width));
 				int nid_s = get_sig_nid(sig_s.extract(i));
-				int nid2 = next_nid++;
-				if (i == GetSize(sig_s)-1)
-					btorf("%d ite %d %d %d %d%s\n", nid2, sid, nid_s, nid_b, nid, getinfo(cell).c_str());
-				else
-					btorf("%d ite %d %d %d %d\n", nid2, sid, nid_s, nid_b, nid);
-				nid = nid2;
+				nid = btor_expr(i == GetSize(sig_s)-1 ? getinfo(cell) : "", "ite %d %d %d %d", sid, nid_s, nid_b, nid);
 			}
 
 			add_nid_sig(nid, sig_y);
@@ -889,29 +871,14 @@ struct BtorWorker
 					int wd_nid = get_sig_nid(port.data);
 					int we_nid = get_sig_nid(port.en);
 
-					int nid2 = next_nid++;
-					btorf("%d read %d %d %d\n", nid2, data_sid, nid_head, wa_nid);
-
-					int nid3 = next_nid++;
-					btorf("%d not %d %d\n", nid3, data_sid, we_nid);
-
-					int nid4 = next_nid++;
-					btorf("%d and %d %d %d\n", nid4, data_sid, nid2, nid3);
-
-					int nid5 = next_nid++;
-					btorf("%d and %d %d %d\n", nid5, data_sid, wd_nid, we_nid);
-
-					int nid6 = next_nid++;
-					btorf("%d or %d %d %d\n", nid6, data_sid, nid5, nid4);
-
-					int nid7 = next_nid++;
-					btorf("%d write %d %d %d %d\n", nid7, sid, nid_head, wa_nid, nid6);
-
-					int nid8 = next_nid++;
-					btorf("%d redor %d %d\n", nid8, bool_sid, we_nid);
-
-					int nid9 = next_nid++;
-					btorf("%d ite %d %d %d %d\n", nid9, sid, nid8, nid7, nid_head);
+					int nid2 = btor_expr("", "read %d %d %d", data_sid, nid_head, wa_nid);
+					int nid3 = btor_expr("", "not %d %d", data_sid, we_nid);
+					int nid4 = btor_expr("", "and %d %d %d", data_sid, nid2, nid3);
+					int nid5 = btor_expr("", "and %d %d %d", data_sid, wd_nid, we_nid);
+					int nid6 = btor_expr("", "or %d %d %d", data_sid, nid5, nid4);
+					int nid7 = btor_expr("", "write %d %d %d %d", sid, nid_head, wa_nid, nid6);
+					int nid8 = btor_expr("", "redor %d %d", bool_sid, we_nid);
+					int nid9 = btor_expr("", "ite %d %d %d %d", sid, nid8, nid7, nid_head);
 
 					nid_head = nid9;
 				}
@@ -923,9 +890,7 @@ struct BtorWorker
 				ra.extend_u0(abits);
 
 				int ra_nid = get_sig_nid(ra);
-				int rd_nid = next_nid++;
-
-				btorf("%d read %d %d %d\n", rd_nid, data_sid, nid_head, ra_nid);
+				int rd_nid = btor_expr("", "read %d %d %d", data_sid, nid_head, ra_nid);
 
 				add_nid_sig(rd_nid, port.data);
 			}
@@ -961,6 +926,7 @@ struct BtorWorker
 	okay:
 		btorf_pop(log_id(cell));
 		cell_recursion_guard.erase(cell);
+		num_exported_cells++;
 	}
 
 	int get_sig_nid(SigSpec sig, int to_width = -1, bool is_signed = false, bool is_init = false)
@@ -1007,16 +973,14 @@ struct BtorWorker
 					nid_masked_input = nid_input;
 				} else {
 					int nid_mask_undef = get_sig_nid(sig_mask_undef);
-					nid_masked_input = next_nid++;
-					btorf("%d and %d %d %d\n", nid_masked_input, sid, nid_input, nid_mask_undef);
+					nid_masked_input = btor_expr("", "and %d %d %d", sid, nid_input, nid_mask_undef);
 				}
 
 				if (sig_noundef.is_fully_zero()) {
 					nid = nid_masked_input;
 				} else {
 					int nid_noundef = get_sig_nid(sig_noundef);
-					nid = next_nid++;
-					btorf("%d or %d %d %d\n", nid, sid, nid_masked_input, nid_noundef);
+					nid = btor_expr("", "or %d %d %d", sid, nid_masked_input, nid_noundef);
 				}
 
 				goto extend_or_trim;
@@ -1113,16 +1077,14 @@ struct BtorWorker
 
 				if (lower != 0 || upper+1 != nid_width.at(nid2)) {
 					int sid = get_bv_sid(upper-lower+1);
-					nid3 = next_nid++;
-					btorf("%d slice %d %d %d %d\n", nid3, sid, nid2, upper, lower);
+					nid3 = btor_expr("", "slice %d %d %d %d", sid, nid2, upper, lower);
 				}
 
 				int nid4 = nid3;
 
 				if (nid >= 0) {
 					int sid = get_bv_sid(width+upper-lower+1);
-					nid4 = next_nid++;
-					btorf("%d concat %d %d %d\n", nid4, sid, nid3, nid);
+					nid4 = btor_expr("", "concat %d %d %d", sid, nid3, nid);
 				}
 
 				width += upper-lower+1;
@@ -1141,25 +1103,21 @@ struct BtorWorker
 			if (to_width < GetSize(sig))
 			{
 				int sid = get_bv_sid(to_width);
-				int nid2 = next_nid++;
-				btorf("%d slice %d %d %d 0\n", nid2, sid, nid, to_width-1);
-				nid = nid2;
+				nid = btor_expr("", "slice %d %d %d 0", sid, nid, to_width-1);
 			}
 			else
 			{
 				int sid = get_bv_sid(to_width);
-				int nid2 = next_nid++;
-				btorf("%d %s %d %d %d\n", nid2, is_signed ? "sext" : "uext",
+				nid = btor_expr("", "%s %d %d %d", is_signed ? "sext" : "uext",
 						sid, nid, to_width - GetSize(sig));
-				nid = nid2;
 			}
 		}
 
 		return nid;
 	}
 
-	BtorWorker(std::ostream &f, RTLIL::Module *module, bool verbose, bool single_bad, bool cover_mode, bool print_internal_names, string info_filename, string ywmap_filename) :
-			f(f), sigmap(module), module(module), verbose(verbose), single_bad(single_bad), cover_mode(cover_mode), print_internal_names(print_internal_names), info_filename(info_filename)
+	BtorWorker(std::ostream &f, RTLIL::Module *module, bool verbose, bool single_bad, bool cover_mode, bool print_internal_names, bool coi_mode, string info_filename, string ywmap_filename) :
+			f(f), sigmap(module), module(module), verbose(verbose), single_bad(single_bad), cover_mode(cover_mode), print_internal_names(print_internal_names), coi_mode(coi_mode), info_filename(info_filename)
 	{
 		if (!info_filename.empty())
 			infof("name %s\n", log_id(module));
@@ -1247,18 +1205,58 @@ struct BtorWorker
 				bit_cell[bit] = cell;
 		}
 
-		for (auto wire : module->wires())
-		{
-			if (!wire->port_id || !wire->port_output)
-				continue;
+		// In -coi mode outputs and named wires are only exported after all
+		// the logic in the cone of influence of the properties, and only if
+		// that logic drives them.
+		auto in_coi = [&](Wire *wire) {
+			if (!coi_mode)
+				return true;
+			for (auto bit : sigmap(wire))
+				if (bit.wire != nullptr && !bit_nid.count(bit))
+					return false;
+			return true;
+		};
+
+		auto export_outputs = [&]() {
+			for (auto wire : module->wires())
+			{
+				if (!wire->port_id || !wire->port_output || !in_coi(wire))
+					continue;
 
-			btorf_push(stringf("output %s", log_id(wire)));
+				btorf_push(stringf("output %s", log_id(wire)));
 
-			int nid = get_sig_nid(wire);
-			btorf("%d output %d%s\n", next_nid++, nid, getinfo(wire).c_str());
+				int nid = get_sig_nid(wire);
+				btorf("%d output %d%s\n", next_nid++, nid, getinfo(wire).c_str());
 
-			btorf_pop(stringf("output %s", log_id(wire)));
-		}
+				btorf_pop(stringf("output %s", log_id(wire)));
+			}
+		};
+
+		auto export_wires = [&]() {
+			for (auto wire : module->wires())
+			{
+				if (wire->port_id || wire->name[0] == '$' || !in_coi(wire))
+					continue;
+
+				btorf_push(stringf("wire %s", log_id(wire)));
+
+				int sid = get_bv_sid(GetSize(wire));
+				int nid = get_sig_nid(sigmap(wire));
+
+				if (statewires.count(wire))
+					continue;
+
+				int this_nid = next_nid++;
+				btorf("%d uext %d %d %d%s\n", this_nid, sid, nid, 0, getinfo(wire).c_str());
+				if (info_clocks.count(nid))
+					info_clocks[this_nid] |= info_clocks[nid];
+
+				btorf_pop(stringf("wire %s", log_id(wire)));
+			}
+		};
+
+		if (!coi_mode)
+			export_outputs();
 
 		for (auto cell : module->cells())
 		{
@@ -1269,12 +1267,10 @@ struct BtorWorker
 				int sid = get_bv_sid(1);
 				int nid_a = get_sig_nid(cell->getPort(ID::A));
 				int nid_en = get_sig_nid(cell->getPort(ID::EN));
-				int nid_not_en = next_nid++;
-				int nid_a_or_not_en = next_nid++;
+				int nid_not_en = btor_expr("", "not %d %d", sid, nid_en);
+				int nid_a_or_not_en = btor_expr("", "or %d %d %d", sid, nid_a, nid_not_en);
 				int nid = next_nid++;
 
-				btorf("%d not %d %d\n", nid_not_en, sid, nid_en);
-				btorf("%d or %d %d %d\n", nid_a_or_not_en, sid, nid_a, nid_not_en);
 				btorf("%d constraint %d\n", nid, nid_a_or_not_en);
 
 				btorf_pop(log_id(cell));
@@ -1287,11 +1283,8 @@ struct BtorWorker
 				int sid = get_bv_sid(1);
 				int nid_a = get_sig_nid(cell->getPort(ID::A));
 				int nid_en = get_sig_nid(cell->getPort(ID::EN));
-				int nid_not_a = next_nid++;
-				int nid_en_and_not_a = next_nid++;
-
-				btorf("%d not %d %d\n", nid_not_a, sid, nid_a);
-				btorf("%d and %d %d %d\n", nid_en_and_not_a, sid, nid_en, nid_not_a);
+				int nid_not_a = btor_expr("", "not %d %d", sid, nid_a);
+				int nid_en_and_not_a = btor_expr("", "and %d %d %d", sid, nid_en, nid_not_a);
 
 				if (single_bad && !cover_mode) {
 					bad_properties.push_back(nid_en_and_not_a);
@@ -1314,9 +1307,7 @@ struct BtorWorker
 				int sid = get_bv_sid(1);
 				int nid_a = get_sig_nid(cell->getPort(ID::A));
 				int nid_en = get_sig_nid(cell->getPort(ID::EN));
-				int nid_en_and_a = next_nid++;
-
-				btorf("%d and %d %d %d\n", nid_en_and_a, sid, nid_en, nid_a);
+				int nid_en_and_a = btor_expr("", "and %d %d %d", sid, nid_en, nid_a);
 
 				if (single_bad) {
 					bad_properties.push_back(nid_en_and_a);
@@ -1329,27 +1320,8 @@ struct BtorWorker
 			}
 		}
 
-		for (auto wire : module->wires())
-		{
-			if (wire->port_id || wire->name[0] == '$')
-				continue;
-
-			btorf_push(stringf("wire %s", log_id(wire)));
-
-			int sid = get_bv_sid(GetSize(wire));
-			int nid = get_sig_nid(sigmap(wire));
-
-			if (statewires.count(wire))
-				continue;
-
-			int this_nid = next_nid++;
-			btorf("%d uext %d %d %d%s\n", this_nid, sid, nid, 0, getinfo(wire).c_str());
-			if (info_clocks.count(nid))
-				info_clocks[this_nid] |= info_clocks[nid];
-
-			btorf_pop(stringf("wire %s", log_id(wire)));
-			continue;
-		}
+		if (!coi_mode)
+			export_wires();
 
 		while (!ff_todo.empty() || !mem_todo.empty())
 		{
@@ -1397,29 +1369,14 @@ struct BtorWorker
 					int wd_nid = get_sig_nid(port.data);
 					int we_nid = get_sig_nid(port.en);
 
-					int nid2 = next_nid++;
-					btorf("%d read %d %d %d\n", nid2, data_sid, nid_head, wa_nid);
-
-					int nid3 = next_nid++;
-					btorf("%d not %d %d\n", nid3, data_sid, we_nid);
-
-					int nid4 = next_nid++;
-					btorf("%d and %d %d %d\n", nid4, data_sid, nid2, nid3);
-
-					int nid5 = next_nid++;
-					btorf("%d and %d %d %d\n", nid5, data_sid, wd_nid, we_nid);
-
-					int nid6 = next_nid++;
-					btorf("%d or %d %d %d\n", nid6, data_sid, nid5, nid4);
-
-					int nid7 = next_nid++;
-					btorf("%d write %d %d %d %d\n", nid7, sid, nid_head, wa_nid, nid6);
-
-					int nid8 = next_nid++;
-					btorf("%d redor %d %d\n", nid8, bool_sid, we_nid);
-
-					int nid9 = next_nid++;
-					btorf("%d ite %d %d %d %d\n", nid9, sid, nid8, nid7, nid_head);
+					int nid2 = btor_expr("", "read %d %d %d", data_sid, nid_head, wa_nid);
+					int nid3 = btor_expr("", "not %d %d", data_sid, we_nid);
+					int nid4 = btor_expr("", "and %d %d %d", data_sid, nid2, nid3);
+					int nid5 = btor_expr("", "and %d %d %d", data_sid, wd_nid, we_nid);
+					int nid6 = btor_expr("", "or %d %d %d", data_sid, nid5, nid4);
+					int nid7 = btor_expr("", "write %d %d %d %d", sid, nid_head, wa_nid, nid6);
+					int nid8 = btor_expr("", "redor %d %d", bool_sid, we_nid);
+					int nid9 = btor_expr("", "ite %d %d %d %d", sid, nid8, nid7, nid_head);
 
 					nid_head = nid9;
 				}
@@ -1443,10 +1400,7 @@ struct BtorWorker
 			{
 				int nid_a = todo[cursor++];
 				int nid_b = todo[cursor++];
-				int nid = next_nid++;
-
-				bad_properties.push_back(nid);
-				btorf("%d or %d %d %d\n", nid, sid, nid_a, nid_b);
+				bad_properties.push_back(btor_expr("", "or %d %d %d", sid, nid_a, nid_b));
 			}
 
 			if (!bad_properties.empty()) {
@@ -1461,6 +1415,15 @@ struct BtorWorker
 			}
 		}
 
+		if (coi_mode) {
+			export_outputs();
+			export_wires();
+			log("Exported %d of %d cells in the cone of influence of the properties.\n",
+					num_exported_cells, GetSize(module->cells()));
+		}
+
+		flush_out();
+
 		if (!info_filename.empty())
 		{
 			for (auto &it : info_clocks)
@@ -1553,6 +1516,11 @@ struct BtorBackend : public Backend {
 		log("  -x\n");
 		log("    Output symbols for internal netnames (starting with '$')\n");
 		log("\n");
+		log("  -coi\n");
+		log("    Only output the logic in the cone of influence of the asserts, assumes\n");
+		log("    and covers. Outputs and named wires are only output when they are\n");
+		log("    driven by that logic.\n");
+		log("\n");
 		log("  -ywmap <filename>\n");
 		log("    Create a map file for conversion to and from Yosys witness traces\n");
 		log("\n");
@@ -1564,7 +1532,7 @@ struct BtorBackend : public Backend {
 			return;
 		}
 
-		bool verbose = false, single_bad = false, cover_mode = false, print_internal_names = false;
+		bool verbose = false, single_bad = false, cover_mode = false, print_internal_names = false, coi_mode = false;
 		string info_filename;
 		string ywmap_filename;
 
@@ -1599,6 +1567,10 @@ struct BtorBackend : public Backend {
 				print_internal_names = true;
 				continue;
 			}
+			if (args[argidx] == "-coi") {
+				coi_mode = true;
+				continue;
+			}
 			if (args[argidx] == "-ywmap" && argidx+1 < args.size()) {
 				ywmap_filename = args[++argidx];
 				continue;
@@ -1615,7 +1587,7 @@ struct BtorBackend : public Backend {
 		*f << stringf("; BTOR description generated by %s for module %s.\n",
 				yosys_version_str, log_id(topmod));
 
-		BtorWorker(*f, topmod, verbose, single_bad, cover_mode, print_internal_names, info_filename, ywmap_filename);
+		BtorWorker(*f, topmod, verbose, single_bad, cover_mode, print_internal_names, coi_mode, info_filename, ywmap_filename);
 
 		*f << stringf("; end of yosys output\n");
 	}
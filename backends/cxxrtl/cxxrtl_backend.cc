@@ -25,6 +25,9 @@
 #include "kernel/mem.h"
 #include "kernel/log.h"
 #include "kernel/fmt.h"
+#include "kernel/threading.h"
+#include "kernel/netgraph.h"
+#include <queue>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -41,135 +44,144 @@ PRIVATE_NAMESPACE_BEGIN
 // We wish to support designs with such benign SCCs (as well as designs with multiple drivers per wire), so
 // we sort the graph in a way that minimizes feedback arcs. If there are no feedback arcs in the sorted graph,
 // then a more efficient evaluation method is possible, since eval() will always immediately converge.
+//
+// Edges between strongly connected components never have to be feedback arcs, so the components are taken in
+// topological order from the dense netlist graph, and the heuristic only orders the nodes within a component.
 template<class T>
 struct Scheduler {
-	struct Vertex {
-		T *data;
-		Vertex *prev, *next;
-		pool<Vertex*, hash_ptr_ops> preds, succs;
+	std::vector<T*> nodes;
+	NetGraph graph;
 
-		Vertex() : data(NULL), prev(this), next(this) {}
-		Vertex(T *data) : data(data), prev(NULL), next(NULL) {}
+	int add(T *data)
+	{
+		nodes.push_back(data);
+		return graph.add_node();
+	}
 
-		bool empty() const
-		{
-			log_assert(data == NULL);
-			if (next == this) {
-				log_assert(prev == next);
-				return true;
-			}
-			return false;
-		}
+	void add_edge(int from, int to)
+	{
+		graph.add_edge(from, to);
+	}
 
-		void link(Vertex *list)
-		{
-			log_assert(prev == NULL && next == NULL);
-			next = list;
-			prev = list->prev;
-			list->prev->next = this;
-			list->prev = this;
-		}
+	// Orders the nodes of a component by the heuristic of Eades, Lin and Smyth: sinks are moved to the end and
+	// sources to the front of the order, and if there are neither, the node with the largest difference of
+	// outgoing and incoming edges goes to the front. local_index maps the nodes of the component to 0..N-1.
+	void schedule_component(const std::vector<int> &members, const std::vector<int> &component,
+			std::vector<int> &local_index, std::vector<T*> &order)
+	{
+		int num_members = GetSize(members);
+		int comp = component[members.front()];
+		for (int i = 0; i < num_members; i++)
+			local_index[members[i]] = i;
 
-		void unlink()
-		{
-			log_assert(prev->next == this && next->prev == this);
-			prev->next = next;
-			next->prev = prev;
-			next = prev = NULL;
+		// the edges within the component, without self-loops, in both directions
+		std::vector<std::vector<int>> succs(num_members), preds(num_members);
+		for (int i = 0; i < num_members; i++) {
+			int n = members[i];
+			for (int e = graph.edge_begin[n]; e < graph.edge_begin[n+1]; e++) {
+				int m = graph.edge_to[e];
+				if (m == n || component[m] != comp)
+					continue;
+				succs[i].push_back(local_index[m]);
+				preds[local_index[m]].push_back(i);
+			}
 		}
 
-		int delta() const
-		{
-			return succs.size() - preds.size();
+		std::vector<int> outdeg(num_members), indeg(num_members);
+		std::vector<bool> removed(num_members);
+		for (int i = 0; i < num_members; i++) {
+			outdeg[i] = GetSize(succs[i]);
+			indeg[i] = GetSize(preds[i]);
 		}
-	};
 
-	std::vector<Vertex*> vertices;
-	Vertex *sources = new Vertex;
-	Vertex *sinks = new Vertex;
-	dict<int, Vertex*> bins;
+		// A node is added to a list again whenever its edges change, so the lists may contain nodes that were
+		// already removed or that have changed since; these are skipped when they are taken from the list.
+		std::vector<int> sinks, sources;
+		std::priority_queue<std::pair<int, int>> bins;
+		auto relink = [&](int i) {
+			if (outdeg[i] == 0)
+				sinks.push_back(i);
+			else if (indeg[i] == 0)
+				sources.push_back(i);
+			else
+				bins.push({outdeg[i] - indeg[i], -i});
+		};
+		auto remove = [&](int i) {
+			removed[i] = true;
+			for (int j : preds[i])
+				if (!removed[j]) {
+					outdeg[j]--;
+					relink(j);
+				}
+			for (int j : succs[i])
+				if (!removed[j]) {
+					indeg[j]--;
+					relink(j);
+				}
+		};
+		for (int i = 0; i < num_members; i++)
+			relink(i);
+
+		std::vector<int> s1, s2r;
+		int num_removed = 0;
+		while (num_removed < num_members) {
+			while (!sinks.empty()) {
+				int i = sinks.back();
+				sinks.pop_back();
+				if (removed[i])
+					continue;
+				s2r.push_back(i);
+				remove(i);
+				num_removed++;
+			}
+			while (!sources.empty()) {
+				int i = sources.back();
+				sources.pop_back();
+				if (removed[i] || outdeg[i] == 0 || indeg[i] != 0)
+					continue;
+				s1.push_back(i);
+				remove(i);
+				num_removed++;
+			}
+			while (!bins.empty()) {
+				int delta = bins.top().first, i = -bins.top().second;
+				bins.pop();
+				if (removed[i] || outdeg[i] == 0 || indeg[i] == 0 || outdeg[i] - indeg[i] != delta)
+					continue;
+				s1.push_back(i);
+				remove(i);
+				num_removed++;
+				break;
+			}
+		}
 
-	~Scheduler()
-	{
-		delete sources;
-		delete sinks;
-		for (auto bin : bins)
-			delete bin.second;
-		for (auto vertex : vertices)
-			delete vertex;
+		for (int i : s1)
+			order.push_back(nodes[members[i]]);
+		for (auto it = s2r.rbegin(); it != s2r.rend(); ++it)
+			order.push_back(nodes[members[*it]]);
 	}
 
-	Vertex *add(T *data)
+	std::vector<T*> schedule()
 	{
-		Vertex *vertex = new Vertex(data);
-		vertices.push_back(vertex);
-		return vertex;
-	}
+		graph.build();
 
-	void relink(Vertex *vertex)
-	{
-		if (vertex->succs.empty())
-			vertex->link(sinks);
-		else if (vertex->preds.empty())
-			vertex->link(sources);
-		else {
-			int delta = vertex->delta();
-			if (!bins.count(delta))
-				bins[delta] = new Vertex;
-			vertex->link(bins[delta]);
-		}
-	}
+		std::vector<int> component;
+		int num_components = graph.scc(component);
 
-	Vertex *remove(Vertex *vertex)
-	{
-		vertex->unlink();
-		for (auto pred : vertex->preds) {
-			if (pred == vertex)
-				continue;
-			log_assert(pred->succs[vertex]);
-			pred->unlink();
-			pred->succs.erase(vertex);
-			relink(pred);
-		}
-		for (auto succ : vertex->succs) {
-			if (succ == vertex)
-				continue;
-			log_assert(succ->preds[vertex]);
-			succ->unlink();
-			succ->preds.erase(vertex);
-			relink(succ);
-		}
-		vertex->preds.clear();
-		vertex->succs.clear();
-		return vertex;
-	}
-
-	std::vector<Vertex*> schedule()
-	{
-		std::vector<Vertex*> s1, s2r;
-		for (auto vertex : vertices)
-			relink(vertex);
-		bool bins_empty = false;
-		while (!(sinks->empty() && sources->empty() && bins_empty)) {
-			while (!sinks->empty())
-				s2r.push_back(remove(sinks->next));
-			while (!sources->empty())
-				s1.push_back(remove(sources->next));
-			// Choosing u in this implementation isn't O(1), but the paper handwaves which data structure they suggest
-			// using to get O(1) relinking *and* find-max-key ("it is clear"... no it isn't), so this code uses a very
-			// naive implementation of find-max-key.
-			bins_empty = true;
-			bins.template sort<std::greater<int>>();
-			for (auto bin : bins) {
-				if (!bin.second->empty()) {
-					bins_empty = false;
-					s1.push_back(remove(bin.second->next));
-					break;
-				}
-			}
+		// the components are numbered in reverse topological order
+		std::vector<std::vector<int>> members(num_components);
+		for (int n = 0; n < graph.num_nodes(); n++)
+			members[num_components - 1 - component[n]].push_back(n);
+
+		std::vector<T*> order;
+		std::vector<int> local_index(graph.num_nodes());
+		for (auto &comp_members : members) {
+			if (GetSize(comp_members) == 1)
+				order.push_back(nodes[comp_members.front()]);
+			else
+				schedule_component(comp_members, component, local_index, order);
 		}
-		s1.insert(s1.end(), s2r.rbegin(), s2r.rend());
-		return s1;
+		return order;
 	}
 };
 
@@ -703,9 +715,19 @@ bool is_valid_clock(const RTLIL::SigSpec& sig) {
 	return sig.is_chunk() && sig.is_bit() && sig[0].wire;
 }
 
+// The output buffer of CxxrtlWorker. Copies of a worker generate code on different threads, each copy
+// starts with an empty buffer.
+struct CxxrtlOutput : std::ostringstream {
+	CxxrtlOutput() {}
+	CxxrtlOutput(const CxxrtlOutput &) : std::basic_ios<char>(), std::ostringstream() {}
+	CxxrtlOutput &operator=(const CxxrtlOutput &) { str(""); return *this; }
+};
+
 struct CxxrtlWorker {
 	bool split_intf = false;
+	bool split_impl = false;
 	std::string intf_filename;
+	std::string impl_prefix;
 	std::string design_ns = "cxxrtl_design";
 	std::string print_output = "std::cout";
 	std::ostream *impl_f = nullptr;
@@ -717,6 +739,9 @@ struct CxxrtlWorker {
 	bool run_flatten = false;
 	bool run_proc = false;
 
+	bool parallel_eval = false;
+	bool activity_eval = false;
+
 	bool unbuffer_internal = false;
 	bool unbuffer_public = false;
 	bool localize_internal = false;
@@ -729,7 +754,7 @@ struct CxxrtlWorker {
 	bool debug_alias = false;
 	bool debug_eval = false;
 
-	std::ostringstream f;
+	CxxrtlOutput f;
 	std::string indent;
 	int temporary = 0;
 
@@ -741,6 +766,7 @@ struct CxxrtlWorker {
 	dict<RTLIL::SigBit, RTLIL::SyncType> edge_types;
 	dict<const RTLIL::Module*, std::vector<FlowGraph::Node>> schedule, debug_schedule;
 	dict<const RTLIL::Wire*, WireType> wire_types, debug_wire_types;
+	dict<const RTLIL::Module*, bool> activity_modules;
 	dict<RTLIL::SigBit, bool> bit_has_state;
 	dict<const RTLIL::Module*, pool<std::string>> blackbox_specializations;
 	dict<const RTLIL::Module*, bool> eval_converges;
@@ -1520,14 +1546,35 @@ struct CxxrtlWorker {
 		// User cells
 		} else {
 			log_assert(!for_debug);
-			log_assert(cell->known());
-			bool buffered_inputs = false;
-			const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
-			for (auto conn : cell->connections())
-				if (cell->input(conn.first)) {
-					RTLIL::Module *cell_module = cell->module->design->module(cell->type);
-					log_assert(cell_module != nullptr && cell_module->wire(conn.first));
-					RTLIL::Wire *cell_module_wire = cell_module->wire(conn.first);
+			bool buffered_inputs = dump_user_cell_inputs(cell);
+			if (is_activity_cell(cell)) {
+				f << indent << "if (" << mangle_dirty(cell) << ") ";
+				f << mangle_dirty(cell) << " = !" << mangle(cell) << ".eval(performer);\n";
+				dump_user_cell_outputs(cell, buffered_inputs, "!" + mangle_dirty(cell), /*evaluated=*/true);
+			} else {
+				const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+				dump_user_cell_outputs(cell, buffered_inputs, mangle(cell) + access + "eval(performer)", /*evaluated=*/false);
+			}
+		}
+	}
+
+	// Assigns the inputs of a user cell. Returns true if any of the inputs is buffered.
+	bool dump_user_cell_inputs(const RTLIL::Cell *cell)
+	{
+		log_assert(cell->known());
+		bool buffered_inputs = false;
+		const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+		for (auto conn : cell->connections())
+			if (cell->input(conn.first)) {
+				RTLIL::Module *cell_module = cell->module->design->module(cell->type);
+				log_assert(cell_module != nullptr && cell_module->wire(conn.first));
+				RTLIL::Wire *cell_module_wire = cell_module->wire(conn.first);
+				if (is_activity_cell(cell) && !wire_types[cell_module_wire].is_buffered()) {
+					// Changes of buffered inputs are noticed by the commit() method of the cell.
+					f << indent << "if (assign_if_changed(" << mangle(cell) << access << mangle_wire_name(conn.first) << ", ";
+					dump_sigspec_rhs(conn.second);
+					f << ")) " << mangle_dirty(cell) << " = true;\n";
+				} else {
 					f << indent << mangle(cell) << access << mangle_wire_name(conn.first);
 					if (!is_cxxrtl_blackbox_cell(cell) && wire_types[cell_module_wire].is_buffered()) {
 						buffered_inputs = true;
@@ -1536,67 +1583,181 @@ struct CxxrtlWorker {
 					f << " = ";
 					dump_sigspec_rhs(conn.second);
 					f << ";\n";
-					if (getenv("CXXRTL_VOID_MY_WARRANTY") && conn.second.is_wire()) {
-						// Until we have proper clock tree detection, this really awful hack that opportunistically
-						// propagates prev_* values for clocks can be used to estimate how much faster a design could
-						// be if only one clock edge was simulated by replacing:
-						//   top.p_clk = value<1>{0u}; top.step();
-						//   top.p_clk = value<1>{1u}; top.step();
-						// with:
-						//   top.prev_p_clk = value<1>{0u}; top.p_clk = value<1>{1u}; top.step();
-						// Don't rely on this; it will be removed without warning.
-						if (edge_wires[conn.second.as_wire()] && edge_wires[cell_module_wire]) {
-							f << indent << mangle(cell) << access << "prev_" << mangle(cell_module_wire) << " = ";
-							f << "prev_" << mangle(conn.second.as_wire()) << ";\n";
-						}
-					}
 				}
-			auto assign_from_outputs = [&](bool cell_converged) {
-				for (auto conn : cell->connections()) {
-					if (cell->output(conn.first)) {
-						if (conn.second.empty())
-							continue; // ignore disconnected ports
-						if (is_cxxrtl_sync_port(cell, conn.first))
-							continue; // fully sync ports are handled in CELL_SYNC nodes
-						f << indent;
-						dump_sigspec_lhs(conn.second);
-						f << " = " << mangle(cell) << access << mangle_wire_name(conn.first);
-						// Similarly to how there is no purpose to buffering cell inputs, there is also no purpose to buffering
-						// combinatorial cell outputs in case the cell converges within one cycle. (To convince yourself that
-						// this optimization is valid, consider that, since the cell converged within one cycle, it would not
-						// have any buffered wires if they were not output ports. Imagine inlining the cell's eval() function,
-						// and consider the fate of the localized wires that used to be output ports.)
-						//
-						// It is not possible to know apriori whether the cell (which may be late bound) will converge immediately.
-						// Because of this, the choice between using .curr (appropriate for buffered outputs) and .next (appropriate
-						// for unbuffered outputs) is made at runtime.
-						if (cell_converged && is_cxxrtl_comb_port(cell, conn.first))
-							f << ".next;\n";
-						else
-							f << ".curr;\n";
+				if (getenv("CXXRTL_VOID_MY_WARRANTY") && conn.second.is_wire()) {
+					// Until we have proper clock tree detection, this really awful hack that opportunistically
+					// propagates prev_* values for clocks can be used to estimate how much faster a design could
+					// be if only one clock edge was simulated by replacing:
+					//   top.p_clk = value<1>{0u}; top.step();
+					//   top.p_clk = value<1>{1u}; top.step();
+					// with:
+					//   top.prev_p_clk = value<1>{0u}; top.p_clk = value<1>{1u}; top.step();
+					// Don't rely on this; it will be removed without warning.
+					if (edge_wires[conn.second.as_wire()] && edge_wires[cell_module_wire]) {
+						f << indent << mangle(cell) << access << "prev_" << mangle(cell_module_wire) << " = ";
+						f << "prev_" << mangle(conn.second.as_wire()) << ";\n";
 					}
 				}
-			};
-			if (buffered_inputs) {
-				// If we have any buffered inputs, there's no chance of converging immediately.
-				f << indent << mangle(cell) << access << "eval(performer);\n";
+			}
+		return buffered_inputs;
+	}
+
+	// Evaluates a user cell and assigns its outputs. `eval_result` is the expression evaluating the cell, or,
+	// if the cell was already `evaluated`, the variable holding the result of its eval() call.
+	void dump_user_cell_outputs(const RTLIL::Cell *cell, bool buffered_inputs, const std::string &eval_result, bool evaluated)
+	{
+		const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+		auto assign_from_outputs = [&](bool cell_converged) {
+			for (auto conn : cell->connections()) {
+				if (cell->output(conn.first)) {
+					if (conn.second.empty())
+						continue; // ignore disconnected ports
+					if (is_cxxrtl_sync_port(cell, conn.first))
+						continue; // fully sync ports are handled in CELL_SYNC nodes
+					f << indent;
+					dump_sigspec_lhs(conn.second);
+					f << " = " << mangle(cell) << access << mangle_wire_name(conn.first);
+					// Similarly to how there is no purpose to buffering cell inputs, there is also no purpose to buffering
+					// combinatorial cell outputs in case the cell converges within one cycle. (To convince yourself that
+					// this optimization is valid, consider that, since the cell converged within one cycle, it would not
+					// have any buffered wires if they were not output ports. Imagine inlining the cell's eval() function,
+					// and consider the fate of the localized wires that used to be output ports.)
+					//
+					// It is not possible to know apriori whether the cell (which may be late bound) will converge immediately.
+					// Because of this, the choice between using .curr (appropriate for buffered outputs) and .next (appropriate
+					// for unbuffered outputs) is made at runtime.
+					if (cell_converged && is_cxxrtl_comb_port(cell, conn.first))
+						f << ".next;\n";
+					else
+						f << ".curr;\n";
+				}
+			}
+		};
+		if (buffered_inputs) {
+			// If we have any buffered inputs, there's no chance of converging immediately.
+			if (!evaluated)
+				f << indent << eval_result << ";\n";
+			f << indent << "converged = false;\n";
+			assign_from_outputs(/*cell_converged=*/false);
+		} else {
+			f << indent << "if (" << eval_result << ") {\n";
+			inc_indent();
+				assign_from_outputs(/*cell_converged=*/true);
+			dec_indent();
+			f << indent << "} else {\n";
+			inc_indent();
 				f << indent << "converged = false;\n";
 				assign_from_outputs(/*cell_converged=*/false);
-			} else {
-				f << indent << "if (" << mangle(cell) << access << "eval(performer)) {\n";
-				inc_indent();
-					assign_from_outputs(/*cell_converged=*/true);
-				dec_indent();
-				f << indent << "} else {\n";
-				inc_indent();
-					f << indent << "converged = false;\n";
-					assign_from_outputs(/*cell_converged=*/false);
-				dec_indent();
-				f << indent << "}\n";
+			dec_indent();
+			f << indent << "}\n";
+		}
+	}
+
+	// Collects the wires read by an expression, including the wires read by the cells and aliases it inlines.
+	void collect_sigspec_rhs_wires(const RTLIL::SigSpec &sig, pool<const RTLIL::Wire*> &wires)
+	{
+		for (auto chunk : sig.chunks()) {
+			if (!chunk.wire || !wires.insert(chunk.wire).second)
+				continue;
+			const auto &wire_type = wire_types[chunk.wire];
+			switch (wire_type.type) {
+				case WireType::INLINE:
+					if (wire_type.cell_subst != nullptr) {
+						for (auto conn : wire_type.cell_subst->connections())
+							if (wire_type.cell_subst->input(conn.first))
+								collect_sigspec_rhs_wires(conn.second, wires);
+						break;
+					}
+					YS_FALLTHROUGH
+				case WireType::ALIAS:
+					collect_sigspec_rhs_wires(wire_type.sig_subst, wires);
+					break;
+				default:
+					break;
 			}
 		}
 	}
 
+	// Instances of (non black box) submodules may be evaluated in parallel, if none of them reads an output
+	// of another one.
+	bool is_parallel_eval_cell(const RTLIL::Cell *cell)
+	{
+		return !is_internal_cell(cell->type) && !is_cxxrtl_blackbox_cell(cell);
+	}
+
+	// A module may be skipped by activity-driven evaluation if its state is fully described by its inputs and
+	// the wires and memories it commits, which is not the case if it (transitively) includes a black box.
+	bool is_activity_module(RTLIL::Module *module)
+	{
+		auto it = activity_modules.find(module);
+		if (it != activity_modules.end())
+			return it->second;
+		bool result = !module->get_bool_attribute(ID(cxxrtl_blackbox));
+		for (auto cell : module->cells()) {
+			if (!result)
+				break;
+			if (is_internal_cell(cell->type))
+				continue;
+			RTLIL::Module *cell_module = module->design->module(cell->type);
+			log_assert(cell_module != nullptr);
+			result = is_activity_module(cell_module);
+		}
+		activity_modules[module] = result;
+		return result;
+	}
+
+	// With activity-driven evaluation, an instance of a submodule is only evaluated if it is dirty, that is, if
+	// any of its inputs changed or any of its state was committed since it last converged.
+	bool is_activity_cell(const RTLIL::Cell *cell)
+	{
+		if (!activity_eval || is_internal_cell(cell->type))
+			return false;
+		RTLIL::Module *cell_module = cell->module->design->module(cell->type);
+		log_assert(cell_module != nullptr);
+		return is_activity_module(cell_module);
+	}
+
+	std::string mangle_dirty(const RTLIL::Cell *cell)
+	{
+		return "dirty_" + mangle(cell);
+	}
+
+	// Evaluates a group of independent user cells with `parallel_eval()`. The inputs of all cells are assigned
+	// first, then the cells are evaluated on worker threads, and then their outputs are assigned.
+	void dump_user_cells_parallel(const std::vector<const RTLIL::Cell*> &cells)
+	{
+		f << indent << "{\n";
+		inc_indent();
+			std::vector<bool> buffered_inputs;
+			for (auto cell : cells) {
+				std::vector<const RTLIL::Cell*> inlined_cells;
+				collect_cell_eval(cell, /*for_debug=*/false, inlined_cells);
+				dump_inlined_cells(inlined_cells);
+				buffered_inputs.push_back(dump_user_cell_inputs(cell));
+			}
+			f << indent << "bool converged_cells[" << cells.size() << "];\n";
+			f << indent << "parallel_eval(" << cells.size() << ", [&](size_t index) {\n";
+			inc_indent();
+				f << indent << "switch (index) {\n";
+				for (size_t i = 0; i < cells.size(); i++) {
+					f << indent << "\tcase " << i << ": ";
+					if (is_activity_cell(cells[i]))
+						f << "if (" << mangle_dirty(cells[i]) << ") " << mangle_dirty(cells[i]) << " = !"
+						  << mangle(cells[i]) << ".eval(performer); break;\n";
+					else
+						f << "converged_cells[" << i << "] = " << mangle(cells[i]) << ".eval(performer); break;\n";
+				}
+				f << indent << "}\n";
+			dec_indent();
+			f << indent << "});\n";
+			for (size_t i = 0; i < cells.size(); i++) {
+				std::string converged = is_activity_cell(cells[i]) ? "!" + mangle_dirty(cells[i]) : stringf("converged_cells[%zu]", i);
+				dump_user_cell_outputs(cells[i], buffered_inputs[i], converged, /*evaluated=*/true);
+			}
+		dec_indent();
+		f << indent << "}\n";
+	}
+
 	void collect_cell_eval(const RTLIL::Cell *cell, bool for_debug, std::vector<const RTLIL::Cell*> &cells)
 	{
 		cells.push_back(cell);
@@ -2150,6 +2311,8 @@ struct CxxrtlWorker {
 				} else {
 					f << ".reset();\n";
 				}
+				if (is_activity_cell(cell))
+					f << indent << mangle_dirty(cell) << " = true;\n";
 			}
 		dec_indent();
 	}
@@ -2177,7 +2340,42 @@ struct CxxrtlWorker {
 				}
 				for (auto wire : module->wires())
 					dump_wire(wire, /*is_local=*/true);
-				for (auto node : schedule[module]) {
+				const std::vector<FlowGraph::Node> &nodes = schedule[module];
+				for (size_t i = 0; i < nodes.size(); i++) {
+					auto node = nodes[i];
+					if (parallel_eval && node.type == FlowGraph::Node::Type::CELL_EVAL && is_parallel_eval_cell(node.cell)) {
+						// Extend the group with the following submodule instances, as long as they do not read
+						// the outputs of the instances already in the group.
+						std::vector<const RTLIL::Cell*> group = {node.cell};
+						pool<const RTLIL::Wire*> group_outputs;
+						for (; i + 1 < nodes.size(); i++) {
+							for (auto conn : group.back()->connections())
+								if (group.back()->output(conn.first))
+									for (auto chunk : conn.second.chunks())
+										if (chunk.wire)
+											group_outputs.insert(chunk.wire);
+							const FlowGraph::Node &next = nodes[i + 1];
+							if (next.type != FlowGraph::Node::Type::CELL_EVAL || !is_parallel_eval_cell(next.cell))
+								break;
+							pool<const RTLIL::Wire*> next_inputs;
+							for (auto conn : next.cell->connections())
+								if (next.cell->input(conn.first))
+									collect_sigspec_rhs_wires(conn.second, next_inputs);
+							bool independent = true;
+							for (auto wire : next_inputs)
+								if (group_outputs.count(wire)) {
+									independent = false;
+									break;
+								}
+							if (!independent)
+								break;
+							group.push_back(next.cell);
+						}
+						if (group.size() > 1) {
+							dump_user_cells_parallel(group);
+							continue;
+						}
+					}
 					switch (node.type) {
 						case FlowGraph::Node::Type::CONNECT:
 							dump_connect(node.connect);
@@ -2266,7 +2464,10 @@ struct CxxrtlWorker {
 					if (is_internal_cell(cell->type))
 						continue;
 					const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
-					f << indent << "if (" << mangle(cell) << access << "commit(observer)) changed = true;\n";
+					if (is_activity_cell(cell))
+						f << indent << "if (" << mangle(cell) << access << "commit(observer)) changed = " << mangle_dirty(cell) << " = true;\n";
+					else
+						f << indent << "if (" << mangle(cell) << access << "commit(observer)) changed = true;\n";
 				}
 			}
 			f << indent << "return changed;\n";
@@ -2594,6 +2795,8 @@ struct CxxrtlWorker {
 						f << ");\n";
 					} else {
 						f << indent << mangle(cell_module) << " " << mangle(cell) << " {interior()};\n";
+						if (is_activity_cell(cell))
+							f << indent << "bool " << mangle_dirty(cell) << " = true;\n";
 					}
 					has_cells = true;
 				}
@@ -2666,6 +2869,37 @@ struct CxxrtlWorker {
 		f << "\n";
 	}
 
+	// Generates the code of each module with `gen`, and returns it. The modules are split into one group
+	// per thread, and each thread uses its own copy of the worker. Temporaries are numbered per module, so
+	// that the code does not depend on the number of threads.
+	std::vector<std::string> dump_modules(const std::vector<RTLIL::Module*> &modules,
+	                                      const std::function<void(CxxrtlWorker &, RTLIL::Module *)> &gen)
+	{
+		std::vector<std::string> code(modules.size());
+		auto dump_group = [&](CxxrtlWorker &worker, int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				worker.temporary = 0;
+				gen(worker, modules[i]);
+				code[i] = worker.f.str();
+				worker.f.str("");
+			}
+		};
+
+		int num_threads = yosys_thread_count(GetSize(modules));
+		if (num_threads == 1) {
+			dump_group(*this, 0, GetSize(modules));
+			return code;
+		}
+
+		int group_size = (GetSize(modules) + num_threads - 1) / num_threads;
+		ThreadPool::run_captured(num_threads, [&](int i) {
+			CxxrtlWorker worker(*this);
+			dump_group(worker, std::min(i * group_size, GetSize(modules)),
+			                   std::min((i + 1) * group_size, GetSize(modules)));
+		}, num_threads);
+		return code;
+	}
+
 	void dump_design(RTLIL::Design *design)
 	{
 		RTLIL::Module *top_module = nullptr;
@@ -2727,8 +2961,10 @@ struct CxxrtlWorker {
 			f << "\n";
 			f << "namespace " << design_ns << " {\n";
 			f << "\n";
-			for (auto module : modules)
-				dump_module_intf(module);
+			for (auto &code : dump_modules(modules, [](CxxrtlWorker &worker, RTLIL::Module *module) {
+				worker.dump_module_intf(module);
+			}))
+				f << code;
 			f << "} // namespace " << design_ns << "\n";
 			f << "\n";
 			f << "#endif // __cplusplus\n";
@@ -2753,12 +2989,37 @@ struct CxxrtlWorker {
 		f << "\n";
 		f << "using namespace cxxrtl_yosys;\n";
 		f << "\n";
+		std::vector<std::string> module_code = dump_modules(modules, [this](CxxrtlWorker &worker, RTLIL::Module *module) {
+			if (!split_intf)
+				worker.dump_module_intf(module);
+			worker.dump_module_impl(module);
+		});
+
 		f << "namespace " << design_ns << " {\n";
 		f << "\n";
-		for (auto module : modules) {
-			if (!split_intf)
-				dump_module_intf(module);
-			dump_module_impl(module);
+		for (size_t i = 0; i < modules.size(); i++) {
+			if (!split_impl) {
+				f << module_code[i];
+				continue;
+			}
+			if (modules[i]->get_bool_attribute(ID(cxxrtl_blackbox)))
+				continue;
+
+			// One translation unit per module, so that the C++ compiler can build the modules in parallel.
+			std::string module_filename = impl_prefix + "." + mangle(modules[i]) + ".cc";
+			log("Writing implementation of module `%s' to `%s'.\n", log_id(modules[i]), module_filename.c_str());
+			std::ofstream module_f(module_filename, std::ofstream::trunc);
+			if (module_f.fail())
+				log_cmd_error("Can't open file `%s' for writing: %s\n", module_filename.c_str(), strerror(errno));
+			module_f << "#include \"" << basename(intf_filename) << "\"\n";
+			module_f << "\n";
+			module_f << "using namespace cxxrtl_yosys;\n";
+			module_f << "\n";
+			module_f << "namespace " << design_ns << " {\n";
+			module_f << "\n";
+			module_f << module_code[i];
+			module_f << "} // namespace " << design_ns << "\n";
+			module_code[i].clear();
 		}
 		f << "} // namespace " << design_ns << "\n";
 		f << "\n";
@@ -2977,25 +3238,21 @@ struct CxxrtlWorker {
 			// without feedback arcs can generally be evaluated in a single pass, i.e. it always requires only
 			// a single delta cycle.
 			Scheduler<FlowGraph::Node> scheduler;
-			dict<FlowGraph::Node*, Scheduler<FlowGraph::Node>::Vertex*, hash_ptr_ops> node_vertex_map;
+			dict<FlowGraph::Node*, int, hash_ptr_ops> node_ids;
 			for (auto node : flow.nodes)
-				node_vertex_map[node] = scheduler.add(node);
+				node_ids[node] = scheduler.add(node);
 			for (auto node_comb_def : flow.node_comb_defs) {
-				auto vertex = node_vertex_map[node_comb_def.first];
+				int node_id = node_ids.at(node_comb_def.first);
 				for (auto wire : node_comb_def.second)
-					for (auto succ_node : flow.wire_uses[wire]) {
-						auto succ_vertex = node_vertex_map[succ_node];
-						vertex->succs.insert(succ_vertex);
-						succ_vertex->preds.insert(vertex);
-					}
+					for (auto succ_node : flow.wire_uses[wire])
+						scheduler.add_edge(node_id, node_ids.at(succ_node));
 			}
 
 			// Find out whether the order includes any feedback arcs.
 			std::vector<FlowGraph::Node*> node_order;
 			pool<FlowGraph::Node*, hash_ptr_ops> evaluated_nodes;
 			pool<const RTLIL::Wire*> feedback_wires;
-			for (auto vertex : scheduler.schedule()) {
-				auto node = vertex->data;
+			for (auto node : scheduler.schedule()) {
 				node_order.push_back(node);
 				// Any wire that is an output of node vo and input of node vi where vo is scheduled later than vi
 				// is a feedback wire. Feedback wires indicate apparent logic loops in the design, which may be
@@ -3533,6 +3790,31 @@ struct CxxrtlBackend : public Backend {
 		log("        of the interface is derived from filename of the implementation.\n");
 		log("        otherwise, interface and implementation are generated together.\n");
 		log("\n");
+		log("    -split\n");
+		log("        like -header, and in addition the implementation of each module is\n");
+		log("        written to a separate file, named `<filename>.<module>.cc' after the\n");
+		log("        implementation filename without extension and the mangled module name.\n");
+		log("        the implementation file only contains the C API entry point. this\n");
+		log("        allows building the modules in parallel, and caching them separately.\n");
+		log("\n");
+		log("    -threads\n");
+		log("        evaluate independent instances of submodules (that is, instances of which\n");
+		log("        none reads an output of another) on a pool of worker threads. the\n");
+		log("        generated code must be compiled with `-DCXXRTL_THREADS -pthread`, and\n");
+		log("        any performer provided to `eval()` must be thread-safe. the number of\n");
+		log("        threads is taken from the CXXRTL_THREADS environment variable, and\n");
+		log("        defaults to the number of hardware threads. this is only worthwhile\n");
+		log("        for designs with large, non-flattened submodules.\n");
+		log("\n");
+		log("    -activity\n");
+		log("        evaluate instances of submodules only when they are dirty, that is, when\n");
+		log("        any of their inputs changed, or any of their state changed on commit, since\n");
+		log("        they last converged. this speeds up designs with large idle (e.g. clock\n");
+		log("        gated) submodules, at the cost of comparing the inputs on every eval.\n");
+		log("        submodules that include black boxes are always evaluated. the state of\n");
+		log("        a submodule must not be changed through debug items, other than its\n");
+		log("        inputs, without calling `reset()` or `eval()` on the toplevel afterwards.\n");
+		log("\n");
 		log("    -namespace <ns-name>\n");
 		log("        place the generated code into namespace <ns-name>. if not specified,\n");
 		log("        \"cxxrtl_design\" is used.\n");
@@ -3681,6 +3963,19 @@ struct CxxrtlBackend : public Backend {
 				worker.split_intf = true;
 				continue;
 			}
+			if (args[argidx] == "-split") {
+				worker.split_intf = true;
+				worker.split_impl = true;
+				continue;
+			}
+			if (args[argidx] == "-threads") {
+				worker.parallel_eval = true;
+				continue;
+			}
+			if (args[argidx] == "-activity") {
+				worker.activity_eval = true;
+				continue;
+			}
 			if (args[argidx] == "-namespace" && argidx+1 < args.size()) {
 				worker.design_ns = args[++argidx];
 				continue;
@@ -3750,9 +4045,10 @@ struct CxxrtlBackend : public Backend {
 		std::ofstream intf_f;
 		if (worker.split_intf) {
 			if (filename == "<stdout>")
-				log_cmd_error("Option -header must be used with a filename.\n");
+				log_cmd_error("Option %s must be used with a filename.\n", worker.split_impl ? "-split" : "-header");
 
-			worker.intf_filename = filename.substr(0, filename.rfind('.')) + ".h";
+			worker.impl_prefix = filename.substr(0, filename.rfind('.'));
+			worker.intf_filename = worker.impl_prefix + ".h";
 			intf_f.open(worker.intf_filename, std::ofstream::trunc);
 			if (intf_f.fail())
 				log_cmd_error("Can't open file `%s' for writing: %s\n",
@@ -133,3 +133,73 @@ double cxxrtl_attr_get_double(cxxrtl_attr_set attrs_, const char *name) {
 	assert(attrs.count(name) && attrs.at(name).value_type == cxxrtl::metadata::DOUBLE);
 	return attrs[name].as_double();
 }
+
+size_t cxxrtl_read(cxxrtl_handle handle, cxxrtl_object **objects, size_t count, uint32_t *buffer) {
+	(void)handle;
+	size_t offset = 0;
+	cxxrtl_outline evaluated = nullptr;
+	for (size_t index = 0; index < count; index++) {
+		cxxrtl_object *object = objects[index];
+		if (object->outline != nullptr && object->outline != evaluated) {
+			object->outline->eval();
+			evaluated = object->outline;
+		}
+		size_t chunks = cxxrtl_object_chunks(object);
+		std::copy(&object->curr[0], &object->curr[chunks], &buffer[offset]);
+		offset += chunks;
+	}
+	return offset;
+}
+
+size_t cxxrtl_write(cxxrtl_handle handle, cxxrtl_object **objects, size_t count, const uint32_t *buffer) {
+	(void)handle;
+	size_t offset = 0;
+	for (size_t index = 0; index < count; index++) {
+		cxxrtl_object *object = objects[index];
+		assert(object->next != nullptr);
+		size_t chunks = cxxrtl_object_chunks(object);
+		std::copy(&buffer[offset], &buffer[offset + chunks], &object->next[0]);
+		offset += chunks;
+	}
+	return offset;
+}
+
+struct _cxxrtl_subscription {
+	std::vector<cxxrtl_object*> objects;
+	std::vector<uint32_t> bits;
+};
+
+cxxrtl_subscription cxxrtl_subscribe(cxxrtl_handle handle, cxxrtl_object **objects, size_t count) {
+	cxxrtl_subscription subscription = new _cxxrtl_subscription;
+	subscription->objects.assign(&objects[0], &objects[count]);
+	size_t chunks = 0;
+	for (size_t index = 0; index < count; index++)
+		chunks += cxxrtl_object_chunks(objects[index]);
+	subscription->bits.resize(chunks);
+	cxxrtl_read(handle, objects, count, subscription->bits.data());
+	return subscription;
+}
+
+size_t cxxrtl_poll(cxxrtl_subscription subscription, size_t *changed) {
+	size_t count = 0, offset = 0;
+	cxxrtl_outline evaluated = nullptr;
+	for (size_t index = 0; index < subscription->objects.size(); index++) {
+		cxxrtl_object *object = subscription->objects[index];
+		if (object->outline != nullptr && object->outline != evaluated) {
+			object->outline->eval();
+			evaluated = object->outline;
+		}
+		size_t chunks = cxxrtl_object_chunks(object);
+		uint32_t *bits = &subscription->bits[offset];
+		if (!std::equal(&object->curr[0], &object->curr[chunks], bits)) {
+			std::copy(&object->curr[0], &object->curr[chunks], bits);
+			changed[count++] = index;
+		}
+		offset += chunks;
+	}
+	return count;
+}
+
+void cxxrtl_unsubscribe(cxxrtl_subscription subscription) {
+	delete subscription;
+}
@@ -369,6 +369,57 @@ const char *cxxrtl_attr_get_string(cxxrtl_attr_set attrs, const char *name);
 // are disabled, returns NULL if the attribute is missing or has an incorrect type.
 double cxxrtl_attr_get_double(cxxrtl_attr_set attrs, const char *name);
 
+// Number of 32-bit chunks stored in an object, i.e. the length of its `curr` and `next` arrays.
+static inline size_t cxxrtl_object_chunks(const struct cxxrtl_object *object) {
+	return ((object->width + 31) / 32) * object->depth;
+}
+
+// Read the bits of many objects at once.
+//
+// The `curr` bits of the `count` objects in `objects` are copied to `buffer` one after another,
+// each object taking `cxxrtl_object_chunks(object)` chunks. Outlines of outline objects are
+// evaluated before their objects are read; objects of the same outline should be adjacent to
+// avoid evaluating it more than once.
+//
+// Returns the number of chunks written to `buffer`.
+size_t cxxrtl_read(cxxrtl_handle handle, struct cxxrtl_object **objects, size_t count,
+                   uint32_t *buffer);
+
+// Write the bits of many objects at once.
+//
+// The `next` bits of the `count` objects in `objects` are filled from `buffer`, which has the
+// same layout as the buffer filled by `cxxrtl_read`. This function asserts that the `next`
+// pointer of every object is not NULL.
+//
+// Returns the number of chunks read from `buffer`.
+size_t cxxrtl_write(cxxrtl_handle handle, struct cxxrtl_object **objects, size_t count,
+                    const uint32_t *buffer);
+
+// Opaque reference to a subscription.
+//
+// A subscription remembers the bits of a set of objects, so that the objects that changed can be
+// found with a single call after each simulation step.
+typedef struct _cxxrtl_subscription *cxxrtl_subscription;
+
+// Subscribe to changes of the `count` objects in `objects`.
+//
+// The current bits of the objects are recorded. The subscription is valid until it is released
+// with `cxxrtl_unsubscribe`, which must happen before the design is destroyed.
+cxxrtl_subscription cxxrtl_subscribe(cxxrtl_handle handle, struct cxxrtl_object **objects,
+                                     size_t count);
+
+// Find the objects that changed since the subscription was created or last polled.
+//
+// The indices (into the `objects` array passed to `cxxrtl_subscribe`) of the changed objects are
+// written to `changed` in ascending order, which must have room for as many indices as there are
+// objects in the subscription. The recorded bits are updated.
+//
+// Returns the number of changed objects.
+size_t cxxrtl_poll(cxxrtl_subscription subscription, size_t *changed);
+
+// Release all resources used by a subscription.
+void cxxrtl_unsubscribe(cxxrtl_subscription subscription);
+
 #ifdef __cplusplus
 }
 #endif
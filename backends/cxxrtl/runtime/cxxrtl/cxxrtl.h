@@ -41,6 +41,32 @@
 #include <sstream>
 #include <iostream>
 
+// Bitwise operations and comparisons on wide values use vector instructions if the target supports them. Define
+// `CXXRTL_NO_SIMD` to always use scalar code.
+#if !defined(CXXRTL_NO_SIMD)
+#if defined(__AVX2__)
+#define CXXRTL_SIMD
+#define CXXRTL_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define CXXRTL_SIMD
+#define CXXRTL_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define CXXRTL_SIMD
+#define CXXRTL_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(CXXRTL_THREADS)
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
 // `cxxrtl::debug_item` has to inherit from `cxxrtl_object` to satisfy strict aliasing requirements.
 #include <cxxrtl/capi/cxxrtl_capi.h>
 
@@ -106,6 +132,169 @@ struct chunk_traits {
 	static constexpr T mask = std::numeric_limits<T>::max();
 };
 
+// Vector of chunks that fits in a SIMD register. Only the operations used by `chunk_ops` are provided.
+#if defined(CXXRTL_SIMD_AVX2)
+struct chunk_vector {
+	static constexpr size_t chunks = 8;
+	__m256i v;
+
+	static chunk_vector load(const chunk_t *data) { return {_mm256_loadu_si256((const __m256i *)data)}; }
+	void store(chunk_t *data) const { _mm256_storeu_si256((__m256i *)data, v); }
+	static chunk_vector ones() { return {_mm256_set1_epi32(-1)}; }
+	chunk_vector operator&(chunk_vector other) const { return {_mm256_and_si256(v, other.v)}; }
+	chunk_vector operator|(chunk_vector other) const { return {_mm256_or_si256(v, other.v)}; }
+	chunk_vector operator^(chunk_vector other) const { return {_mm256_xor_si256(v, other.v)}; }
+	bool is_zero() const { return _mm256_testz_si256(v, v); }
+};
+#elif defined(CXXRTL_SIMD_SSE2)
+struct chunk_vector {
+	static constexpr size_t chunks = 4;
+	__m128i v;
+
+	static chunk_vector load(const chunk_t *data) { return {_mm_loadu_si128((const __m128i *)data)}; }
+	void store(chunk_t *data) const { _mm_storeu_si128((__m128i *)data, v); }
+	static chunk_vector ones() { return {_mm_set1_epi32(-1)}; }
+	chunk_vector operator&(chunk_vector other) const { return {_mm_and_si128(v, other.v)}; }
+	chunk_vector operator|(chunk_vector other) const { return {_mm_or_si128(v, other.v)}; }
+	chunk_vector operator^(chunk_vector other) const { return {_mm_xor_si128(v, other.v)}; }
+	bool is_zero() const { return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) == 0xffff; }
+};
+#elif defined(CXXRTL_SIMD_NEON)
+struct chunk_vector {
+	static constexpr size_t chunks = 4;
+	uint32x4_t v;
+
+	static chunk_vector load(const chunk_t *data) { return {vld1q_u32(data)}; }
+	void store(chunk_t *data) const { vst1q_u32(data, v); }
+	static chunk_vector ones() { return {vdupq_n_u32(~0u)}; }
+	chunk_vector operator&(chunk_vector other) const { return {vandq_u32(v, other.v)}; }
+	chunk_vector operator|(chunk_vector other) const { return {vorrq_u32(v, other.v)}; }
+	chunk_vector operator^(chunk_vector other) const { return {veorq_u32(v, other.v)}; }
+	bool is_zero() const {
+		uint64x2_t w = vreinterpretq_u64_u32(v);
+		return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) == 0;
+	}
+};
+#else
+struct chunk_vector {
+	// No SIMD support; `chunk_ops` is never specialized for vectors.
+	static constexpr size_t chunks = std::numeric_limits<size_t>::max();
+};
+#endif
+
+// Operations on arrays of `Chunks` chunks. Values at least as wide as a vector register are processed with
+// vector instructions, with the remainder (if any) processed with scalar instructions; narrower values are
+// always processed with scalar instructions, which compilers handle well on their own.
+template<size_t Chunks, bool Vector = (Chunks >= chunk_vector::chunks)>
+struct chunk_ops {
+	CXXRTL_ALWAYS_INLINE
+	static void bit_not(chunk_t *result, const chunk_t *a) {
+		for (size_t n = 0; n < Chunks; n++)
+			result[n] = ~a[n];
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_and(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < Chunks; n++)
+			result[n] = a[n] & b[n];
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_or(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < Chunks; n++)
+			result[n] = a[n] | b[n];
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_xor(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < Chunks; n++)
+			result[n] = a[n] ^ b[n];
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static bool is_zero(const chunk_t *a) {
+		for (size_t n = 0; n < Chunks; n++)
+			if (a[n] != 0)
+				return false;
+		return true;
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static bool equal(const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < Chunks; n++)
+			if (a[n] != b[n])
+				return false;
+		return true;
+	}
+};
+
+#if defined(CXXRTL_SIMD)
+template<size_t Chunks>
+struct chunk_ops<Chunks, /*Vector=*/true> {
+	static constexpr size_t vectors = Chunks / chunk_vector::chunks;
+	static constexpr size_t tail = Chunks % chunk_vector::chunks;
+	using tail_ops = chunk_ops<tail, /*Vector=*/false>;
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_not(chunk_t *result, const chunk_t *a) {
+		for (size_t n = 0; n < vectors; n++) {
+			size_t offset = n * chunk_vector::chunks;
+			(chunk_vector::load(a + offset) ^ chunk_vector::ones()).store(result + offset);
+		}
+		tail_ops::bit_not(result + vectors * chunk_vector::chunks, a + vectors * chunk_vector::chunks);
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_and(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < vectors; n++) {
+			size_t offset = n * chunk_vector::chunks;
+			(chunk_vector::load(a + offset) & chunk_vector::load(b + offset)).store(result + offset);
+		}
+		size_t offset = vectors * chunk_vector::chunks;
+		tail_ops::bit_and(result + offset, a + offset, b + offset);
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_or(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < vectors; n++) {
+			size_t offset = n * chunk_vector::chunks;
+			(chunk_vector::load(a + offset) | chunk_vector::load(b + offset)).store(result + offset);
+		}
+		size_t offset = vectors * chunk_vector::chunks;
+		tail_ops::bit_or(result + offset, a + offset, b + offset);
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static void bit_xor(chunk_t *result, const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < vectors; n++) {
+			size_t offset = n * chunk_vector::chunks;
+			(chunk_vector::load(a + offset) ^ chunk_vector::load(b + offset)).store(result + offset);
+		}
+		size_t offset = vectors * chunk_vector::chunks;
+		tail_ops::bit_xor(result + offset, a + offset, b + offset);
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static bool is_zero(const chunk_t *a) {
+		for (size_t n = 0; n < vectors; n++)
+			if (!chunk_vector::load(a + n * chunk_vector::chunks).is_zero())
+				return false;
+		return tail_ops::is_zero(a + vectors * chunk_vector::chunks);
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	static bool equal(const chunk_t *a, const chunk_t *b) {
+		for (size_t n = 0; n < vectors; n++) {
+			size_t offset = n * chunk_vector::chunks;
+			if (!(chunk_vector::load(a + offset) ^ chunk_vector::load(b + offset)).is_zero())
+				return false;
+		}
+		size_t offset = vectors * chunk_vector::chunks;
+		return tail_ops::equal(a + offset, b + offset);
+	}
+};
+#endif
+
 template<class T>
 struct expr_base;
 
@@ -364,10 +553,7 @@ struct value : public expr_base<value<Bits>> {
 	}
 
 	bool is_zero() const {
-		for (size_t n = 0; n < chunks; n++)
-			if (data[n] != 0)
-				return false;
-		return true;
+		return chunk_ops<chunks>::is_zero(data);
 	}
 
 	bool is_neg() const {
@@ -375,10 +561,7 @@ struct value : public expr_base<value<Bits>> {
 	}
 
 	bool operator ==(const value<Bits> &other) const {
-		for (size_t n = 0; n < chunks; n++)
-			if (data[n] != other.data[n])
-				return false;
-		return true;
+		return chunk_ops<chunks>::equal(data, other.data);
 	}
 
 	bool operator !=(const value<Bits> &other) const {
@@ -387,30 +570,26 @@ struct value : public expr_base<value<Bits>> {
 
 	value<Bits> bit_not() const {
 		value<Bits> result;
-		for (size_t n = 0; n < chunks; n++)
-			result.data[n] = ~data[n];
+		chunk_ops<chunks>::bit_not(result.data, data);
 		result.data[chunks - 1] &= msb_mask;
 		return result;
 	}
 
 	value<Bits> bit_and(const value<Bits> &other) const {
 		value<Bits> result;
-		for (size_t n = 0; n < chunks; n++)
-			result.data[n] = data[n] & other.data[n];
+		chunk_ops<chunks>::bit_and(result.data, data, other.data);
 		return result;
 	}
 
 	value<Bits> bit_or(const value<Bits> &other) const {
 		value<Bits> result;
-		for (size_t n = 0; n < chunks; n++)
-			result.data[n] = data[n] | other.data[n];
+		chunk_ops<chunks>::bit_or(result.data, data, other.data);
 		return result;
 	}
 
 	value<Bits> bit_xor(const value<Bits> &other) const {
 		value<Bits> result;
-		for (size_t n = 0; n < chunks; n++)
-			result.data[n] = data[n] ^ other.data[n];
+		chunk_ops<chunks>::bit_xor(result.data, data, other.data);
 		return result;
 	}
 
@@ -547,7 +726,20 @@ struct value : public expr_base<value<Bits>> {
 	std::pair<value<Bits>, bool /*CarryOut*/> alu(const value<Bits> &other) const {
 		value<Bits> result;
 		bool carry = CarryIn;
-		for (size_t n = 0; n < result.chunks; n++) {
+		size_t n = 0;
+		// The carry chain cannot be vectorized, but it can be shortened by adding two chunks at once. The chunk
+		// with the MSB (which needs masking) is always added by the loop below.
+		for (; n + 2 < result.chunks; n += 2) {
+			wide_chunk_t a = wide_chunk_t(data[n]) | (wide_chunk_t(data[n + 1]) << chunk::bits);
+			wide_chunk_t b = wide_chunk_t(Invert ? ~other.data[n] : other.data[n]) |
+			                 (wide_chunk_t(Invert ? ~other.data[n + 1] : other.data[n + 1]) << chunk::bits);
+			wide_chunk_t sum = a + b + carry;
+			result.data[n] = chunk::type(sum);
+			result.data[n + 1] = chunk::type(sum >> chunk::bits);
+			carry = (sum <  a) ||
+			        (sum == a && carry);
+		}
+		for (; n < result.chunks; n++) {
 			result.data[n] = data[n] + (Invert ? ~other.data[n] : other.data[n]) + carry;
 			if (result.chunks - 1 == n)
 				result.data[result.chunks - 1] &= result.msb_mask;
@@ -634,6 +826,17 @@ struct value : public expr_base<value<Bits>> {
 	}
 };
 
+// Assigns `next` to `lhs`, and returns true if that changed `lhs`. Used by the code generated with
+// `write_cxxrtl -activity` to track which submodule instances have to be evaluated.
+template<size_t Bits>
+CXXRTL_ALWAYS_INLINE
+bool assign_if_changed(value<Bits> &lhs, const value<Bits> &next) {
+	if (lhs == next)
+		return false;
+	lhs = next;
+	return true;
+}
+
 // Expression template for a slice, usable as lvalue or rvalue, and composable with other expression templates here.
 template<class T, size_t Stop, size_t Start>
 struct slice_expr : public expr_base<slice_expr<T, Stop, Start>> {
@@ -1398,6 +1601,135 @@ struct module {
 	}
 };
 
+#if defined(CXXRTL_THREADS)
+// A pool of persistent worker threads used by the code generated with `write_cxxrtl -threads` to evaluate independent
+// submodule instances concurrently. The number of threads (including the calling thread) is taken from the
+// `CXXRTL_THREADS` environment variable, and defaults to the number of hardware threads.
+class thread_pool {
+	std::vector<std::thread> workers;
+	std::mutex mutex, batch_mutex;
+	std::condition_variable wakeup, done;
+	uint64_t generation = 0;
+	const std::function<void(size_t)> *job = nullptr;
+	size_t job_count = 0;
+	size_t active = 0;
+	std::atomic<size_t> next{0};
+	std::atomic<size_t> pending{0};
+	bool stopping = false;
+
+	static bool &in_worker() {
+		static thread_local bool flag = false;
+		return flag;
+	}
+
+	void run_jobs(const std::function<void(size_t)> &fn, size_t count) {
+		size_t index;
+		while ((index = next.fetch_add(1)) < count) {
+			fn(index);
+			if (pending.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(mutex);
+				done.notify_all();
+			}
+		}
+	}
+
+	void worker() {
+		in_worker() = true;
+		uint64_t seen = 0;
+		while (true) {
+			const std::function<void(size_t)> *fn;
+			size_t count;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeup.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+				if (job == nullptr)
+					continue;
+				fn = job;
+				count = job_count;
+				active++;
+			}
+			run_jobs(*fn, count);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				active--;
+			}
+			done.notify_all();
+		}
+	}
+
+public:
+	explicit thread_pool(size_t threads) {
+		for (size_t i = 1; i < threads; i++)
+			workers.emplace_back(&thread_pool::worker, this);
+	}
+
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeup.notify_all();
+		for (auto &thread : workers)
+			thread.join();
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	static thread_pool &global() {
+		static thread_pool pool([] {
+			if (const char *env = std::getenv("CXXRTL_THREADS"))
+				if (int threads = std::atoi(env))
+					return (size_t)std::max(threads, 1);
+			return (size_t)std::max(std::thread::hardware_concurrency(), 1u);
+		}());
+		return pool;
+	}
+
+	// Calls `fn(0)` .. `fn(count - 1)`, in no particular order, and returns once all of the calls have returned.
+	// Nested calls (from within `fn`) as well as calls made while another thread is using the pool are evaluated
+	// on the calling thread.
+	void run(size_t count, const std::function<void(size_t)> &fn) {
+		std::unique_lock<std::mutex> batch_lock(batch_mutex, std::defer_lock);
+		if (workers.empty() || count < 2 || in_worker() || !batch_lock.try_lock()) {
+			for (size_t index = 0; index < count; index++)
+				fn(index);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			next = 0;
+			pending = count;
+			job = &fn;
+			job_count = count;
+			generation++;
+		}
+		wakeup.notify_all();
+		bool was_in_worker = in_worker();
+		in_worker() = true;
+		run_jobs(fn, count);
+		in_worker() = was_in_worker;
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return pending == 0 && active == 0; });
+		job = nullptr;
+	}
+};
+#endif
+
+// Evaluates `fn(0)` .. `fn(count - 1)`; used by the code generated with `write_cxxrtl -threads`. Unless the runtime
+// is built with `CXXRTL_THREADS` defined, the calls are made sequentially.
+inline void parallel_eval(size_t count, const std::function<void(size_t)> &fn) {
+#if defined(CXXRTL_THREADS)
+	thread_pool::global().run(count, fn);
+#else
+	for (size_t index = 0; index < count; index++)
+		fn(index);
+#endif
+}
+
 } // namespace cxxrtl
 
 // Internal structures used to communicate with the implementation of the C interface.
@@ -46,16 +46,30 @@
 // degree of detail see the source code. The format is considered fully internal to CXXRTL and is subject to change
 // without notice.
 //
-// <file>           ::= <file-header> <definitions> <sample>+
+// <file>           ::= <file-header> <definitions> <sample>+ <index>?
 // <file-header>    ::= 0x52585843 0x00004c54
 // <definitions>    ::= <packet-define>* <packet-end>
 // <sample>         ::= <packet-sample> <packet-change>* <packet-end>
+// <index>          ::= <packet-index> <size> <checkpoint>* <position> <packet-index>
 // <packet-define>  ::= 0xc0000000 ...
 // <packet-sample>  ::= 0xc0000001 ...
-// <packet-change>  ::= 0x0??????? <chunk>+ | 0x1??????? <index> <chunk>+ | 0x2??????? | 0x3???????
-// <chunk>, <index> ::= 0x????????
+// <packet-index>   ::= 0xc0000002
+// <packet-change>  ::= 0x0??????? <chunk>+ | 0x1??????? <index> <chunk>+ | 0x2??????? | 0x3??????? |
+//                      0x4??????? <mask>+ <chunk>* | 0x5??????? <index> <mask>+ <chunk>*
+// <checkpoint>     ::= <pointer> <position> <time>
+// <chunk>, <index>, <size>, <mask>, <pointer> ::= 0x????????
+// <position>       ::= 0x???????? 0x????????
+// <time>           ::= 0x???????? 0x???????? 0x????????
 // <packet-end>     ::= 0xFFFFFFFF
 //
+// Change packets 0x4 and 0x5 are _sparse_: they include a bit mask with one bit per chunk, followed by only those
+// chunks whose bit is set. The recorder uses them when they are shorter than the full value, e.g. when a single chunk
+// of a wide register or memory row changes.
+//
+// The index is written once the recording is finished, and lists the position of every complete sample (called
+// a _checkpoint_) in the file. The position of the index itself is stored at the very end of the file, so that it
+// can be found without reading the samples.
+//
 // The replay log contains sample data, however, it does not cover the entire design. Rather, it only contains sample
 // data for the subset of debug items containing _design state_: inputs and registers/latches. This keeps its size to
 // a minimum, and recording speed to a maximum. The player samples any missing data by setting the design state items
@@ -92,6 +106,11 @@
 // During rewinding, the player begins reading at the latest non-incremental sample that still lies before the requested
 // sample time. It continues reading incremental samples after that point until it reaches the requested sample time.
 // This process is very cheap as the design is not evaluated; it is essentially a (convoluted) memory copy operation.
+// If the log includes an index, the positions of all complete samples are known from the start; otherwise, they are
+// discovered while reading, and rewinding to a time that has not been read yet reads the log up to that point.
+//
+// To bound the cost of rewinding, the recorder can be configured to write a complete sample periodically instead of
+// an incremental one (see `recorder::set_checkpoint_interval()`).
 //
 // During replaying, the player evaluates the design at the current time, which causes all debug items to assume
 // the values they had before recording. This process is expensive. Once done, the player advances to the next state
@@ -118,7 +137,7 @@ public:
 	// Numeric identifier assigned to a debug item within a replay log. Range limited to [1, MAXIMUM_IDENT].
 	typedef uint32_t ident_t;
 
-	static constexpr uint16_t VERSION = 0x0400;
+	static constexpr uint16_t VERSION = 0x0500;
 
 	static constexpr uint64_t HEADER_MAGIC = 0x00004c5452585843;
 	static constexpr uint64_t VERSION_MASK = 0xffff000000000000;
@@ -131,21 +150,33 @@ public:
 		INCREMENTAL = 1,
 	};
 
+	static constexpr uint32_t PACKET_INDEX   = 0xc0000002;
+
 	static constexpr uint32_t MAXIMUM_IDENT  = 0x0fffffff;
-	static constexpr uint32_t CHANGE_MASK    = 0x30000000;
+	static constexpr uint32_t CHANGE_MASK    = 0x70000000;
 
 	static constexpr uint32_t PACKET_CHANGE  = 0x00000000/* | ident */;
 	static constexpr uint32_t PACKET_CHANGEI = 0x10000000/* | ident */;
 	static constexpr uint32_t PACKET_CHANGEL = 0x20000000/* | ident */;
 	static constexpr uint32_t PACKET_CHANGEH = 0x30000000/* | ident */;
+	static constexpr uint32_t PACKET_CHANGES = 0x40000000/* | ident */;
+	static constexpr uint32_t PACKET_CHANGESI = 0x50000000/* | ident */;
 
 	static constexpr uint32_t PACKET_END     = 0xffffffff;
 
+	// Position of a complete sample within a replay log, in bytes from the start of the file.
+	struct checkpoint {
+		pointer_t pointer;
+		time timestamp;
+		uint64_t position;
+	};
+
 	// Writing spools.
 
 	class writer {
 		int fd;
 		size_t position;
+		uint64_t flushed = 0; // words written to the file
 		std::vector<uint32_t> buffer;
 
 		// These functions aren't overloaded because of implicit numeric conversions.
@@ -194,6 +225,28 @@ public:
 			emit_word(raw_timestamp.data[2]);
 		}
 
+		// Returns the size, in words, of the mask and data of a sparse change of `data` relative to `prev`.
+		static size_t sparse_size(size_t chunks, const chunk_t *data, const chunk_t *prev) {
+			size_t size = (chunks + 31) / 32;
+			for (size_t offset = 0; offset < chunks; offset++)
+				if (data[offset] != prev[offset])
+					size++;
+			return size;
+		}
+
+		void emit_sparse(size_t chunks, const chunk_t *data, const chunk_t *prev) {
+			for (size_t base = 0; base < chunks; base += 32) {
+				uint32_t mask = 0;
+				for (size_t offset = base; offset < chunks && offset < base + 32; offset++)
+					if (data[offset] != prev[offset])
+						mask |= 1u << (offset - base);
+				emit_word(mask);
+			}
+			for (size_t offset = 0; offset < chunks; offset++)
+				if (data[offset] != prev[offset])
+					emit_word(data[offset]);
+		}
+
 	public:
 		// Creates a writer, and transfers ownership of `fd`, which must be open for appending.
 		//
@@ -210,7 +263,7 @@ public:
 			assert(result == 0);
 		}
 
-		writer(writer &&moved) : fd(moved.fd), position(moved.position), buffer(moved.buffer) {
+		writer(writer &&moved) : fd(moved.fd), position(moved.position), flushed(moved.flushed), buffer(moved.buffer) {
 			moved.fd = -1;
 			moved.position = 0;
 		}
@@ -225,9 +278,15 @@ public:
 			size_t data_size = position * sizeof(uint32_t);
 			size_t data_written = write(fd, buffer.data(), data_size);
 			assert(data_size == data_written);
+			flushed += position;
 			position = 0;
 		}
 
+		// Returns the position, in bytes from the start of the file, at which the next packet will be written.
+		uint64_t offset() const {
+			return (flushed + position) * sizeof(uint32_t);
+		}
+
 		~writer() {
 			if (fd != -1) {
 				flush();
@@ -281,6 +340,43 @@ public:
 				emit_word(data[offset]);
 		}
 
+		// Same as `write_change()`, but only writes the chunks that differ from `prev` if that is shorter.
+		void write_delta(ident_t ident, size_t chunks, const chunk_t *data, const chunk_t *prev) {
+			assert(ident <= MAXIMUM_IDENT);
+
+			if (chunks > 1 && sparse_size(chunks, data, prev) < chunks) {
+				emit_word(PACKET_CHANGES | ident);
+				emit_sparse(chunks, data, prev);
+			} else {
+				write_change(ident, chunks, data);
+			}
+		}
+
+		void write_delta(ident_t ident, size_t chunks, const chunk_t *data, const chunk_t *prev, size_t index) {
+			assert(ident <= MAXIMUM_IDENT);
+
+			if (chunks > 1 && sparse_size(chunks, data, prev) < chunks) {
+				emit_word(PACKET_CHANGESI | ident);
+				emit_index(index);
+				emit_sparse(chunks, data, prev);
+			} else {
+				write_change(ident, chunks, data, index);
+			}
+		}
+
+		void write_index(const std::vector<checkpoint> &checkpoints) {
+			uint64_t index_position = offset();
+			emit_word(PACKET_INDEX);
+			emit_size(checkpoints.size());
+			for (auto &checkpoint : checkpoints) {
+				emit_word(checkpoint.pointer);
+				emit_dword(checkpoint.position);
+				emit_time(checkpoint.timestamp);
+			}
+			emit_dword(index_position);
+			emit_word(PACKET_INDEX);
+		}
+
 		void write_end() {
 			emit_word(PACKET_END);
 		}
@@ -338,6 +434,15 @@ public:
 			return time(raw_timestamp);
 		}
 
+		void absorb_sparse(size_t chunks, chunk_t *data) {
+			std::vector<uint32_t> masks((chunks + 31) / 32);
+			for (auto &mask : masks)
+				mask = absorb_word();
+			for (size_t offset = 0; offset < chunks; offset++)
+				if (masks[offset / 32] & (1u << (offset % 32)))
+					data[offset] = absorb_word();
+		}
+
 	public:
 		typedef uint64_t pos_t;
 
@@ -389,6 +494,11 @@ public:
 			uint32_t header = absorb_word();
 			if (header == PACKET_END)
 				return false;
+			if (header == PACKET_INDEX) {
+				// The index follows the last sample; stay in front of it.
+				rewind(position() - sizeof(uint32_t));
+				return false;
+			}
 			assert(header == PACKET_SAMPLE);
 			uint32_t flags = absorb_word();
 			incremental = (flags & sample_flag::INCREMENTAL);
@@ -421,12 +531,46 @@ public:
 					index = absorb_word();
 					assert(index < depth);
 					break;
+				case PACKET_CHANGES:
+					absorb_sparse(chunks, data);
+					return;
+				case PACKET_CHANGESI:
+					index = absorb_word();
+					assert(index < depth);
+					absorb_sparse(chunks, &data[chunks * index]);
+					return;
 				default:
 					assert(false && "Unrecognized change packet");
 			}
 			for (size_t offset = 0; offset < chunks; offset++)
 				data[chunks * index + offset] = absorb_word();
 		}
+
+		// Reads the index at the end of the file, if there is one, without changing the read position.
+		bool read_index(std::vector<checkpoint> &checkpoints) {
+			pos_t saved_position = position();
+			bool success = false;
+			fseek(f, 0, SEEK_END);
+			pos_t end_position = position();
+			if (end_position >= 5 * sizeof(uint32_t)) {
+				rewind(end_position - 3 * sizeof(uint32_t));
+				pos_t index_position = absorb_dword();
+				if (absorb_word() == PACKET_INDEX && index_position < end_position) {
+					rewind(index_position);
+					if (absorb_word() == PACKET_INDEX) {
+						checkpoints.resize(absorb_size());
+						for (auto &checkpoint : checkpoints) {
+							checkpoint.pointer = absorb_word();
+							checkpoint.position = absorb_dword();
+							checkpoint.timestamp = absorb_time();
+						}
+						success = true;
+					}
+				}
+			}
+			rewind(saved_position);
+			return success;
+		}
 	};
 
 	// Opening spools. For certain uses of the record/replay mechanism, two distinct open files (two open files, i.e.
@@ -482,10 +626,14 @@ class recorder {
 	spool::writer writer;
 	std::vector<variable> variables;
 	std::vector<size_t> inputs; // values of inputs must be recorded explicitly, as their changes are not observed
+	std::vector<std::vector<chunk_t>> recorded_inputs; // values of inputs as of the last sample
 	std::unordered_map<const chunk_t*, spool::ident_t> ident_lookup;
 	bool streaming = false; // whether variable definitions have been written
 	spool::pointer_t pointer = 0;
 	time timestamp;
+	std::vector<spool::checkpoint> checkpoints;
+	size_t checkpoint_interval = 0;
+	size_t samples_since_checkpoint = 0;
 
 public:
 	template<typename ...Args>
@@ -515,8 +663,10 @@ public:
 					ident_lookup[var.curr] = var.ident;
 
 					assert(variables.size() < spool::MAXIMUM_IDENT);
-					if (part.flags & debug_item::INPUT)
+					if (part.flags & debug_item::INPUT) {
 						inputs.push_back(variables.size());
+						recorded_inputs.emplace_back(var.chunks);
+					}
 					variables.push_back(var);
 
 					writer.write_define(var.ident, item.first, part_index, var.chunks, var.depth);
@@ -536,11 +686,25 @@ public:
 		return timestamp;
 	}
 
+	// Makes every `interval`-th sample recorded with `record_incremental()` a complete sample, which bounds the amount
+	// of samples the player has to read when rewinding. If `interval` is zero (the default), only the samples recorded
+	// with `record_complete()` are complete.
+	void set_checkpoint_interval(size_t interval) {
+		checkpoint_interval = interval;
+	}
+
 	void record_complete() {
 		assert(streaming);
 
+		checkpoints.push_back({pointer, timestamp, writer.offset()});
+		samples_since_checkpoint = 0;
+		for (size_t n = 0; n < inputs.size(); n++) {
+			const variable &var = variables.at(inputs[n]);
+			std::copy(var.curr, var.curr + var.chunks, recorded_inputs[n].begin());
+		}
+
 		writer.write_sample(/*incremental=*/false, pointer++, timestamp);
-		for (auto var : variables) {
+		for (auto &var : variables) {
 			assert(var.ident != 0);
 			if (!var.memory)
 				writer.write_change(var.ident, var.chunks, var.curr);
@@ -562,20 +726,32 @@ public:
 
 			CXXRTL_ALWAYS_INLINE
 			void on_update(size_t chunks, const chunk_t *base, const chunk_t *value) {
-				writer->write_change(ident_lookup->at(base), chunks, value);
+				writer->write_delta(ident_lookup->at(base), chunks, value, base);
 			}
 
 			CXXRTL_ALWAYS_INLINE
 			void on_update(size_t chunks, const chunk_t *base, const chunk_t *value, size_t index) {
-				writer->write_change(ident_lookup->at(base), chunks, value, index);
+				writer->write_delta(ident_lookup->at(base), chunks, value, &base[chunks * index], index);
 			}
 		} record_observer = { &ident_lookup, &writer };
 
+		if (checkpoint_interval != 0 && ++samples_since_checkpoint >= checkpoint_interval) {
+			bool changed = module.commit();
+			record_complete();
+			return changed;
+		}
+
 		writer.write_sample(/*incremental=*/true, pointer++, timestamp);
-		for (auto input_index : inputs) {
-			variable &var = variables.at(input_index);
+		// Only the inputs that changed since the last sample are recorded. This relies on the player always reading
+		// samples sequentially, starting from a complete sample.
+		for (size_t n = 0; n < inputs.size(); n++) {
+			variable &var = variables.at(inputs[n]);
 			assert(!var.memory);
-			writer.write_change(var.ident, var.chunks, var.curr);
+			std::vector<chunk_t> &recorded = recorded_inputs[n];
+			if (std::equal(var.curr, var.curr + var.chunks, recorded.begin()))
+				continue;
+			writer.write_delta(var.ident, var.chunks, var.curr, recorded.data());
+			std::copy(var.curr, var.curr + var.chunks, recorded.begin());
 		}
 		bool changed = module.commit(record_observer);
 		writer.write_end();
@@ -585,6 +761,16 @@ public:
 	void flush() {
 		writer.flush();
 	}
+
+	// Writes the index of complete samples, which allows the player to rewind to any sample without reading the log
+	// up to it first. No samples may be recorded afterwards.
+	void finish() {
+		assert(streaming);
+
+		writer.write_index(checkpoints);
+		writer.flush();
+		streaming = false;
+	}
 };
 
 // A CXXRTL player reads samples from a spool, and changes the design state accordingly. To start reading samples,
@@ -653,6 +839,14 @@ public:
 		assert(variables.size() > 0);
 		streaming = true;
 
+		// If the recording has been finished, the positions of all complete samples are known upfront.
+		std::vector<spool::checkpoint> checkpoints;
+		if (reader.read_index(checkpoints))
+			for (auto &checkpoint : checkpoints) {
+				index_by_pointer.emplace(checkpoint.pointer, checkpoint.position);
+				index_by_timestamp.emplace(checkpoint.timestamp, checkpoint.position);
+			}
+
 		// Establish the initial state of the design.
 		initialized = replay();
 		assert(initialized);
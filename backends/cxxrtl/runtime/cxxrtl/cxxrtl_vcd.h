@@ -19,6 +19,9 @@
 #ifndef CXXRTL_VCD_H
 #define CXXRTL_VCD_H
 
+#include <algorithm>
+#include <unordered_map>
+
 #include <cxxrtl/cxxrtl.h>
 
 namespace cxxrtl {
@@ -31,15 +34,24 @@ class vcd_writer {
 		size_t cache_offset;
 		debug_outline *outline;
 		bool *outline_warm;
+		// Wires and memory rows only change on commit, and are only tested when an update has been observed.
+		bool committed;
+		bool dirty;
 	};
 
 	std::vector<std::string> current_scope;
 	std::map<debug_outline*, bool> outlines;
 	std::vector<variable> variables;
 	std::vector<chunk_t> cache;
-	std::map<chunk_t*, size_t> aliases;
+	std::unordered_map<const chunk_t*, size_t> aliases;
 	bool streaming = false;
 
+	// Variables that have to be tested on every sample when tracking changes, and the committed variables that
+	// were updated since the last sample.
+	bool tracking = false;
+	std::vector<size_t> uncommitted;
+	std::vector<size_t> changed;
+
 	void emit_timescale(unsigned number, const std::string &unit) {
 		assert(!streaming);
 		assert(number == 1 || number == 10 || number == 100);
@@ -128,12 +140,20 @@ class vcd_writer {
 		buffer += '\n';
 	}
 
+	void emit_variable(const variable &var) {
+		if (var.width == 1)
+			emit_scalar(var);
+		else
+			emit_vector(var);
+	}
+
 	void reset_outlines() {
 		for (auto &outline_it : outlines)
 			outline_it.second = /*warm=*/(outline_it.first == nullptr);
 	}
 
-	variable &register_variable(size_t width, chunk_t *curr, bool constant = false, debug_outline *outline = nullptr) {
+	variable &register_variable(size_t width, chunk_t *curr, bool constant = false, debug_outline *outline = nullptr,
+	                            bool committed = false) {
 		if (aliases.count(curr)) {
 			return variables[aliases[curr]];
 		} else {
@@ -141,15 +161,30 @@ class vcd_writer {
 			const size_t chunks = (width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
 			aliases[curr] = variables.size();
 			if (constant) {
-				variables.emplace_back(variable { variables.size(), width, curr, (size_t)-1, outline_it->first, &outline_it->second });
+				variables.emplace_back(variable { variables.size(), width, curr, (size_t)-1, outline_it->first, &outline_it->second,
+				                                  /*committed=*/true, /*dirty=*/false });
 			} else {
-				variables.emplace_back(variable { variables.size(), width, curr, cache.size(), outline_it->first, &outline_it->second });
+				if (!committed)
+					uncommitted.push_back(variables.size());
+				variables.emplace_back(variable { variables.size(), width, curr, cache.size(), outline_it->first, &outline_it->second,
+				                                  committed, /*dirty=*/false });
 				cache.insert(cache.end(), &curr[0], &curr[chunks]);
 			}
 			return variables.back();
 		}
 	}
 
+	void mark_changed(const chunk_t *base) {
+		auto it = aliases.find(base);
+		if (it == aliases.end())
+			return; // not added to the writer
+		variable &var = variables[it->second];
+		if (var.committed && !var.dirty) {
+			var.dirty = true;
+			changed.push_back(it->second);
+		}
+	}
+
 	bool test_variable(const variable &var) {
 		if (var.cache_offset == (size_t)-1)
 			return false; // constant
@@ -185,6 +220,31 @@ class vcd_writer {
 public:
 	std::string buffer;
 
+	// An observer that tells the writer which wires and memory rows were updated, see `observer()`.
+	struct change_observer {
+		vcd_writer &writer;
+
+		void on_update(size_t chunks, const chunk_t *base, const chunk_t *value) {
+			(void)chunks, (void)value;
+			writer.mark_changed(base);
+		}
+
+		void on_update(size_t chunks, const chunk_t *base, const chunk_t *value, size_t index) {
+			(void)value;
+			writer.mark_changed(&base[chunks * index]);
+		}
+	};
+
+	// Returns an observer to be passed to the `commit(ObserverT &)` method of the toplevel module. Once it has been
+	// requested, `sample()` only tests the wires and memory rows reported by the observer since the previous sample
+	// (and the values, aliases and outlines, which change without a commit), so that its cost is proportional to
+	// the number of changes rather than to the number of variables. All commits must then go through the observer;
+	// `module::step()` and `module::commit()` without an argument bypass it.
+	change_observer observer() {
+		tracking = true;
+		return change_observer { *this };
+	}
+
 	void timescale(unsigned number, const std::string &unit) {
 		emit_timescale(number, unit);
 	}
@@ -202,7 +262,7 @@ public:
 				         "wire", name, item.lsb_at, multipart);
 				break;
 			case debug_item::WIRE:
-				emit_var(register_variable(item.width, item.curr),
+				emit_var(register_variable(item.width, item.curr, /*constant=*/false, /*outline=*/nullptr, /*committed=*/true),
 				         "reg", name, item.lsb_at, multipart);
 				break;
 			case debug_item::MEMORY: {
@@ -210,7 +270,7 @@ public:
 				for (size_t index = 0; index < item.depth; index++) {
 					chunk_t *nth_curr = &item.curr[stride * index];
 					std::string nth_name = name + '[' + std::to_string(index) + ']';
-					emit_var(register_variable(item.width, nth_curr),
+					emit_var(register_variable(item.width, nth_curr, /*constant=*/false, /*outline=*/nullptr, /*committed=*/true),
 					         "reg", nth_name, item.lsb_at, multipart);
 				}
 				break;
@@ -260,13 +320,30 @@ public:
 		}
 		reset_outlines();
 		emit_time(timestamp);
-		for (auto var : variables)
-			if (test_variable(var) || first_sample) {
-				if (var.width == 1)
-					emit_scalar(var);
+		if (tracking && !first_sample) {
+			// Merge the updated and the uncommitted variables, to emit them in the same order as a full scan does.
+			std::sort(changed.begin(), changed.end());
+			auto changed_it = changed.begin();
+			auto uncommitted_it = uncommitted.begin();
+			while (changed_it != changed.end() || uncommitted_it != uncommitted.end()) {
+				size_t index;
+				if (uncommitted_it == uncommitted.end() || (changed_it != changed.end() && *changed_it < *uncommitted_it))
+					index = *changed_it++;
 				else
-					emit_vector(var);
+					index = *uncommitted_it++;
+				variable &var = variables[index];
+				var.dirty = false;
+				if (test_variable(var))
+					emit_variable(var);
+			}
+		} else {
+			for (auto &var : variables) {
+				var.dirty = false;
+				if (test_variable(var) || first_sample)
+					emit_variable(var);
 			}
+		}
+		changed.clear();
 	}
 };
 
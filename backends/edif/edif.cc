@@ -30,30 +30,38 @@
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
-#define EDIF_DEF(_id) edif_names(RTLIL::unescape_id(_id), true).c_str()
-#define EDIF_DEFR(_id, _ren, _bl, _br) edif_names(RTLIL::unescape_id(_id), true, _ren, _bl, _br).c_str()
-#define EDIF_REF(_id) edif_names(RTLIL::unescape_id(_id), false).c_str()
+#define EDIF_DEF(_id) edif_names.def(_id).c_str()
+#define EDIF_DEFR(_id, _ren, _bl, _br) edif_names.def(_id, _ren, _bl, _br).c_str()
+#define EDIF_REF(_id) edif_names.ref(_id).c_str()
 
 struct EdifNames
 {
 	int counter;
 	char delim_left, delim_right;
-	std::set<std::string> generated_names, used_names;
-	std::map<std::string, std::string> name_map;
+	pool<std::string> generated_names, used_names;
+	dict<std::string, std::string> name_map;
+
+	// legalized names of the IdStrings seen so far, the name of an
+	// identifier never changes once it has been handed out
+	dict<RTLIL::IdString, std::string> id_names;
 
 	EdifNames() : counter(1), delim_left('['), delim_right(']') { }
 
+	std::string rename(const std::string &id, const std::string &new_id, bool port_rename, int range_left, int range_right)
+	{
+		if (port_rename)
+			return stringf("(rename %s \"%s%c%d:%d%c\")", new_id.c_str(), id.c_str(), delim_left, range_left, range_right, delim_right);
+		return new_id != id ? stringf("(rename %s \"%s\")", new_id.c_str(), id.c_str()) : id;
+	}
+
 	std::string operator()(std::string id, bool define, bool port_rename = false, int range_left = 0, int range_right = 0)
 	{
-		if (define) {
-			std::string new_id = operator()(id, false);
-			if (port_rename)
-				return stringf("(rename %s \"%s%c%d:%d%c\")", new_id.c_str(), id.c_str(), delim_left, range_left, range_right, delim_right);
-			return new_id != id ? stringf("(rename %s \"%s\")", new_id.c_str(), id.c_str()) : id;
-		}
+		if (define)
+			return rename(id, operator()(id, false), port_rename, range_left, range_right);
 
-		if (name_map.count(id) > 0)
-			return name_map.at(id);
+		auto it = name_map.find(id);
+		if (it != name_map.end())
+			return it->second;
 		if (generated_names.count(id) > 0)
 			goto do_rename;
 		if (id == "GND" || id == "VCC")
@@ -86,6 +94,32 @@ struct EdifNames
 		name_map[id] = gen_name;
 		return gen_name;
 	}
+
+	std::string ref(const std::string &id)
+	{
+		return operator()(RTLIL::unescape_id(id), false);
+	}
+
+	std::string ref(RTLIL::IdString id)
+	{
+		auto it = id_names.find(id);
+		if (it != id_names.end())
+			return it->second;
+		std::string new_id = operator()(RTLIL::unescape_id(id), false);
+		id_names[id] = new_id;
+		return new_id;
+	}
+
+	std::string def(const std::string &id, bool port_rename = false, int range_left = 0, int range_right = 0)
+	{
+		return operator()(RTLIL::unescape_id(id), true, port_rename, range_left, range_right);
+	}
+
+	std::string def(RTLIL::IdString id, bool port_rename = false, int range_left = 0, int range_right = 0)
+	{
+		std::string new_id = ref(id);
+		return rename(RTLIL::unescape_id(id), new_id, port_rename, range_left, range_right);
+	}
 };
 
 struct EdifBackend : public Backend {
@@ -358,7 +392,6 @@ struct EdifBackend : public Backend {
 				continue;
 
 			SigMap sigmap(module);
-			std::map<RTLIL::SigSpec, std::set<std::pair<std::string, bool>>> net_join_db;
 
 			*f << stringf("    (cell %s\n", EDIF_DEF(module->name));
 			*f << stringf("      (cellType GENERIC)\n");
@@ -430,6 +463,18 @@ struct EdifBackend : public Backend {
 						sigmap.add(b1);
 				}
 
+			// the port references of each net, by the dense id of the
+			// representative bit, or num_bits + state for constants
+			FlatSigMap flatmap(sigmap, module);
+			int num_bits = flatmap.num_bits();
+			std::vector<std::vector<std::pair<std::string, bool>>> net_refs(num_bits + RTLIL::State::Sm + 1);
+			std::vector<RTLIL::SigBit> net_bits(GetSize(net_refs));
+			auto net_id = [&](RTLIL::SigBit bit) {
+				int id = bit.wire ? flatmap.id(flatmap(bit)) : num_bits + bit.data;
+				net_bits[id] = bit;
+				return id;
+			};
+
 			for (auto wire : module->wires()) {
 				if (wire->port_id == 0)
 					continue;
@@ -444,8 +489,7 @@ struct EdifBackend : public Backend {
 						for (auto &p : wire->attributes)
 							add_prop(p.first, p.second);
 					*f << ")\n";
-					RTLIL::SigSpec sig = sigmap(RTLIL::SigSpec(wire));
-					net_join_db[sig].insert(make_pair(stringf("(portRef %s)", EDIF_REF(wire->name)), wire->port_input));
+					net_refs[net_id(flatmap(RTLIL::SigBit(wire)))].push_back(make_pair("(portRef " + edif_names.ref(wire->name) + ")", wire->port_input));
 				} else {
 					int b[2];
 					b[wire->upto ? 0 : 1] = wire->start_offset;
@@ -456,10 +500,9 @@ struct EdifBackend : public Backend {
 							add_prop(p.first, p.second);
 
 					*f << ")\n";
-					for (int i = 0; i < wire->width; i++) {
-						RTLIL::SigSpec sig = sigmap(RTLIL::SigSpec(wire, i));
-						net_join_db[sig].insert(make_pair(stringf("(portRef (member %s %d))", EDIF_REF(wire->name), lsbidx ? i : GetSize(wire)-i-1), wire->port_input));
-					}
+					std::string wire_ref = "(portRef (member " + edif_names.ref(wire->name) + " ";
+					for (int i = 0; i < wire->width; i++)
+						net_refs[net_id(flatmap(RTLIL::SigBit(wire, i)))].push_back(make_pair(wire_ref + std::to_string(lsbidx ? i : GetSize(wire)-i-1) + "))", wire->port_input));
 				}
 			}
 
@@ -482,44 +525,49 @@ struct EdifBackend : public Backend {
 						add_prop(p.first, p.second);
 
 				*f << stringf(")\n");
+				std::string instance_ref = " (instanceRef " + edif_names.ref(cell->name) + "))";
+				auto m = design->module(cell->type);
 				for (auto &p : cell->connections()) {
-					RTLIL::SigSpec sig = sigmap(p.second);
+					RTLIL::SigSpec sig = flatmap(p.second);
+					bool is_output = cell->output(p.first);
+					int width = sig.size();
+					if (m) {
+						auto w = m->wire(p.first);
+						if (w)
+							width = GetSize(w);
+					}
+					std::string port_ref = edif_names.ref(p.first);
 					for (int i = 0; i < GetSize(sig); i++)
 						if (sig[i].wire == NULL && sig[i] != RTLIL::State::S0 && sig[i] != RTLIL::State::S1)
 							log_warning("Bit %d of cell port %s.%s.%s driven by %s will be left unconnected in EDIF output.\n",
 									i, log_id(module), log_id(cell), log_id(p.first), log_signal(sig[i]));
+						else if (width == 1)
+							net_refs[net_id(sig[i])].push_back(make_pair("(portRef " + port_ref + instance_ref, is_output));
 						else {
-							int member_idx = lsbidx ? i : GetSize(sig)-i-1;
-							auto m = design->module(cell->type);
-							int width = sig.size();
-							if (m) {
-								auto w = m->wire(p.first);
-								if (w) {
-									member_idx = lsbidx ? i : GetSize(w)-i-1;
-									width = GetSize(w);
-								}
-							}
-							if (width == 1)
-								net_join_db[sig[i]].insert(make_pair(stringf("(portRef %s (instanceRef %s))", EDIF_REF(p.first), EDIF_REF(cell->name)), cell->output(p.first)));
-							else {
-								net_join_db[sig[i]].insert(make_pair(stringf("(portRef (member %s %d) (instanceRef %s))",
-										EDIF_REF(p.first), member_idx, EDIF_REF(cell->name)), cell->output(p.first)));
-							}
+							int member_idx = lsbidx ? i : width-i-1;
+							net_refs[net_id(sig[i])].push_back(make_pair("(portRef (member " + port_ref + " " +
+									std::to_string(member_idx) + ")" + instance_ref, is_output));
 						}
 				}
 			}
 
-			for (auto &it : net_join_db) {
-				RTLIL::SigBit sig = it.first;
+			for (int id = 0; id < GetSize(net_refs); id++) {
+				auto &refs = net_refs[id];
+				if (refs.empty())
+					continue;
+				std::sort(refs.begin(), refs.end());
+				refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+
+				RTLIL::SigBit sig = net_bits[id];
 				if (sig.wire == NULL && sig != RTLIL::State::S0 && sig != RTLIL::State::S1) {
 					if (sig == RTLIL::State::Sx) {
-						for (auto &ref : it.second)
+						for (auto &ref : refs)
 							log_warning("Exporting x-bit on %s as zero bit.\n", ref.first.c_str());
 						sig = RTLIL::State::S0;
 					} else if (sig == RTLIL::State::Sz) {
 						continue;
 					} else {
-						for (auto &ref : it.second)
+						for (auto &ref : refs)
 							log_error("Don't know how to handle %s on %s.\n", log_signal(sig), ref.first.c_str());
 						log_abort();
 					}
@@ -535,22 +583,22 @@ struct EdifBackend : public Backend {
 						if (netname[i] == ' ' || netname[i] == '\\')
 							netname.erase(netname.begin() + i--);
 				}
-				*f << stringf("          (net %s (joined\n", EDIF_DEF(netname));
-				for (auto &ref : it.second)
-					*f << stringf("              %s\n", ref.first.c_str());
+				*f << "          (net " << edif_names.def(netname) << " (joined\n";
+				for (auto &ref : refs)
+					*f << "              " << ref.first << "\n";
 				if (sig.wire == NULL) {
 					if (nogndvcc)
 						log_error("Design contains constant nodes (map with \"hilomap\" first).\n");
 					if (sig == RTLIL::State::S0)
-						*f << stringf("            (portRef %c (instanceRef GND))\n", gndvccy ? 'Y' : 'G');
+						*f << "            (portRef " << (gndvccy ? 'Y' : 'G') << " (instanceRef GND))\n";
 					if (sig == RTLIL::State::S1)
-						*f << stringf("            (portRef %c (instanceRef VCC))\n", gndvccy ? 'Y' : 'P');
+						*f << "            (portRef " << (gndvccy ? 'Y' : 'P') << " (instanceRef VCC))\n";
 				}
-				*f << stringf("            )");
+				*f << "            )";
 				if (attr_properties && sig.wire != NULL)
 					for (auto &p : sig.wire->attributes)
 						add_prop(p.first, p.second);
-				*f << stringf("\n          )\n");
+				*f << "\n          )\n";
 			}
 
 			for (auto wire : module->wires())
@@ -561,9 +609,9 @@ struct EdifBackend : public Backend {
 				for(int i = 0; i < wire->width; i++)
 				{
 					SigBit raw_sig = RTLIL::SigSpec(wire, i);
-					SigBit mapped_sig = sigmap(raw_sig);
+					SigBit mapped_sig = flatmap(raw_sig);
 
-					if (raw_sig == mapped_sig || net_join_db.count(mapped_sig) == 0)
+					if (raw_sig == mapped_sig || net_refs[net_id(mapped_sig)].empty())
 						continue;
 
 					std::string netname = log_signal(raw_sig);
@@ -575,7 +623,7 @@ struct EdifBackend : public Backend {
 					{
 						*f << stringf("          (net %s (joined\n", EDIF_DEF(netname));
 
-						auto &refs = net_join_db.at(mapped_sig);
+						auto &refs = net_refs[net_id(mapped_sig)];
 						for (auto &ref : refs)
 							if (ref.second)
 								*f << stringf("              %s\n", ref.first.c_str());
@@ -22,6 +22,7 @@
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
 #include "kernel/log.h"
+#include "libs/json11/json11.hpp"
 #include <string>
 #include <algorithm>
 #include <unordered_map>
@@ -117,7 +118,8 @@ struct JnyWriter
         _include_connections(connections), _include_attributes(attributes), _include_properties(properties)
          { }
 
-    void write_metadata(Design *design, uint16_t indent_level = 0, std::string invk = "")
+    // When `changed` is given, only the modules in it are written.
+    void write_metadata(Design *design, uint16_t indent_level = 0, std::string invk = "", const pool<Module*> *changed = nullptr)
     {
         log_assert(design != nullptr);
 
@@ -156,6 +158,8 @@ struct JnyWriter
 
         bool first{true};
         for (auto mod : _use_selection ? design->selected_modules() : design->modules()) {
+            if (changed != nullptr && !changed->count(mod))
+                continue;
             if (!first)
                 f << ",\n";
             write_module(mod, indent_level + 2);
@@ -407,6 +411,77 @@ struct JnyWriter
     }
 };
 
+// The manifest of an incremental export records the content hash of every
+// module together with the features the metadata was written with. Modules
+// whose hash is the same as in the previous manifest are left out of the
+// metadata, the manifest still lists them with "changed": false.
+struct JnyManifest
+{
+    std::string filename;
+    std::string features;
+    dict<std::string, std::string> old_hashes;
+    dict<std::string, std::string> new_hashes;
+    pool<Module*> changed;
+
+    JnyManifest(const std::string &filename, bool connections, bool attributes, bool properties) : filename(filename)
+    {
+        features = stringf("%s%s%s", connections ? "c" : "", attributes ? "a" : "", properties ? "p" : "");
+
+        std::ifstream f(filename);
+        if (f.fail())
+            return;
+        std::stringstream buf;
+        buf << f.rdbuf();
+
+        std::string err;
+        json11::Json json = json11::Json::parse(buf.str(), err);
+        if (!err.empty() || !json.is_object()) {
+            log_warning("Ignoring malformed JNY manifest `%s'.\n", filename.c_str());
+            return;
+        }
+        // metadata written with other features has to be refreshed completely
+        if (json["features"].string_value() != features)
+            return;
+        for (auto &it : json["modules"].object_items())
+            old_hashes[it.first] = it.second["hash"].string_value();
+    }
+
+    void update(Design *design)
+    {
+        for (auto mod : design->modules()) {
+            std::string name = RTLIL::unescape_id(mod->name);
+            std::string hash = stringf("%016llx", (unsigned long long)mod->content_hash());
+            auto it = old_hashes.find(name);
+            if (it == old_hashes.end() || it->second != hash)
+                changed.insert(mod);
+            new_hashes[name] = hash;
+        }
+        log("Exporting %d of %d modules with changed content.\n", GetSize(changed), GetSize(new_hashes));
+    }
+
+    void write(Design *design)
+    {
+        json11::Json::object modules;
+        for (auto mod : design->modules()) {
+            std::string name = RTLIL::unescape_id(mod->name);
+            modules[name] = json11::Json::object {
+                { "hash", new_hashes.at(name) },
+                { "changed", changed.count(mod) != 0 },
+            };
+        }
+        json11::Json json = json11::Json::object {
+            { "generator", yosys_version_str },
+            { "features", features },
+            { "modules", modules },
+        };
+
+        std::ofstream f(filename, std::ofstream::trunc);
+        if (f.fail())
+            log_error("Can't open file `%s' for writing: %s\n", filename.c_str(), strerror(errno));
+        f << json.dump() << "\n";
+    }
+};
+
 struct JnyBackend : public Backend {
     JnyBackend() : Backend("jny", "generate design metadata") { }
     void help() override {
@@ -426,6 +501,12 @@ struct JnyBackend : public Backend {
         log("    -no-properties\n");
         log("        Don't include property information in the netlist output.\n");
         log("\n");
+        log("    -manifest <filename>\n");
+        log("        Incremental export: only write the modules whose content hash differs\n");
+        log("        from the one recorded in the given manifest file, then update the\n");
+        log("        manifest with the hashes of all modules and whether each of them was\n");
+        log("        written. Without an existing manifest all modules are written.\n");
+        log("\n");
         log("The JSON schema for JNY output files is located in the \"jny.schema.json\" file\n");
         log("which is located at \"https://raw.githubusercontent.com/YosysHQ/yosys/master/misc/jny.schema.json\"\n");
         log("\n");
@@ -441,6 +522,7 @@ struct JnyBackend : public Backend {
         bool connections{true};
         bool attributes{true};
         bool properties{true};
+        std::string manifest_file;
 
         size_t argidx{1};
         for (; argidx < args.size(); argidx++) {
@@ -459,6 +541,11 @@ struct JnyBackend : public Backend {
                 continue;
             }
 
+            if (args[argidx] == "-manifest" && argidx+1 < args.size()) {
+                manifest_file = args[++argidx];
+                continue;
+            }
+
             break;
         }
 
@@ -476,7 +563,15 @@ struct JnyBackend : public Backend {
         log_header(design, "Executing jny backend.\n");
 
         JnyWriter jny_writer(*f, false, connections, attributes, properties);
-        jny_writer.write_metadata(design, 0, invk.str());
+        if (manifest_file.empty()) {
+            jny_writer.write_metadata(design, 0, invk.str());
+        } else {
+            rewrite_filename(manifest_file);
+            JnyManifest manifest(manifest_file, connections, attributes, properties);
+            manifest.update(design);
+            jny_writer.write_metadata(design, 0, invk.str(), &manifest.changed);
+            manifest.write(design);
+        }
     }
 
 } JnyBackend;
@@ -504,6 +599,12 @@ struct JnyPass : public Pass {
         log("    -no-properties\n");
         log("        Don't include property information in the netlist output.\n");
         log("\n");
+        log("    -manifest <filename>\n");
+        log("        Incremental export: only write the modules whose content hash differs\n");
+        log("        from the one recorded in the given manifest file, then update the\n");
+        log("        manifest with the hashes of all modules and whether each of them was\n");
+        log("        written. Without an existing manifest all modules are written.\n");
+        log("\n");
         log("See 'help write_jny' for a description of the JSON format used.\n");
         log("\n");
     }
@@ -518,6 +619,7 @@ struct JnyPass : public Pass {
         bool connections{true};
         bool attributes{true};
         bool properties{true};
+        std::string manifest_file;
 
         size_t argidx{1};
         for (; argidx < args.size(); argidx++) {
@@ -541,6 +643,11 @@ struct JnyPass : public Pass {
                 continue;
             }
 
+            if (args[argidx] == "-manifest" && argidx+1 < args.size()) {
+                manifest_file = args[++argidx];
+                continue;
+            }
+
             break;
         }
 
@@ -574,7 +681,15 @@ struct JnyPass : public Pass {
 
 
         JnyWriter jny_writer(*f, false, connections, attributes, properties);
-        jny_writer.write_metadata(design, 0, invk.str());
+        if (manifest_file.empty()) {
+            jny_writer.write_metadata(design, 0, invk.str());
+        } else {
+            rewrite_filename(manifest_file);
+            JnyManifest manifest(manifest_file, connections, attributes, properties);
+            manifest.update(design);
+            jny_writer.write_metadata(design, 0, invk.str(), &manifest.changed);
+            manifest.write(design);
+        }
 
         if (!empty) {
             delete f;
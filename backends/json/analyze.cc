@@ -486,7 +486,6 @@ struct AnlzWriter
 	void dump_port_info(Design *design_)
 	{
 		design = design_;
-		design->sort();
 
                 Module *topmod = design->top_module();
 
@@ -523,27 +522,51 @@ struct AnlzWriter
            return basicType;
         }
 
+        // Modules instantiated by each module, built in one pass over the
+        // cells of the modules reached from the top module. Cell types are
+        // resolved with IdString lookups, only "$array:" types are parsed.
+        //
+        dict<RTLIL::Module*, vector<RTLIL::Module*>> submodules;
+
+        const vector<RTLIL::Module*> &get_submodules(RTLIL::Module *mod)
+        {
+           auto it = submodules.find(mod);
+           if (it != submodules.end())
+                return it->second;
+
+           vector<RTLIL::Module*> subs;
+           for (auto cell : mod->cells()) {
+                RTLIL::Module *sub;
+                if (cell->type.begins_with("$array:"))
+                        sub = design->module(basic_cell_type(cell->type.str()));
+                else
+                        sub = design->module(cell->type);
+                if (sub)
+                        subs.push_back(sub);
+           }
+           return submodules[mod] = std::move(subs);
+        }
+
         void hierarchy_visit(RTLIL::Design *design, std::set<RTLIL::Module*,
                               IdString::compare_ptr_by_name<Module>> &used, RTLIL::Module *mod)
         {
-           if (used.count(mod) > 0)
-                return;
+           log_assert(design == this->design);
 
-           used.insert(mod);
-
-           for (auto cell : mod->cells()) {
-                std::string celltype = cell->type.str();
-                if (celltype.compare(0, strlen("$array:"), "$array:") == 0)
-                        celltype = basic_cell_type(celltype);
-                if (design->module(celltype))
-                        hierarchy_visit(design, used, design->module(celltype));
+           vector<RTLIL::Module*> queue = {mod};
+           while (!queue.empty()) {
+                RTLIL::Module *m = queue.back();
+                queue.pop_back();
+                if (!used.insert(m).second)
+                        continue;
+                for (auto sub : get_submodules(m))
+                        if (used.count(sub) == 0)
+                                queue.push_back(sub);
            }
         }
 
 	void dump_hier_info(Design *design_)
 	{
 		design = design_;
-		design->sort();
 
                 Module *topmod = design->top_module();
 
@@ -583,9 +606,20 @@ struct AnlzPass : public Pass {
 		log("       performs Analyze from the top module with name 'top_module_name'.\n");
 		log("    -auto-top \n");
 		log("       detects automatically the top module. If several tops, it picks up the one with deepest hierarchy. Analyze from this selected top module.\n");
+		log("    -top-ports\n");
+		log("       only write 'port_info.json' with the ports of the top module.\n");
+		log("    -hier\n");
+		log("       only write 'hier_info.json' with the hierarchy of the design.\n");
 		log("\n");
 	}
 
+	bool result_cacheable(const std::vector<std::string> &) const override
+	{
+		// writes port_info.json and hier_info.json, replaying only the log
+		// output of an earlier call would skip writing them
+		return false;
+	}
+
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		if (design->is_protected_rtl()){
@@ -601,6 +635,10 @@ struct AnlzPass : public Pass {
 		bool aig_mode = false;
 		bool compat_int_mode = false;
 
+		bool dump_hier = true;
+		bool dump_ports = true;
+		bool views_selected = false;
+
                 // Parse Analyze command arguments
                 //
 		size_t argidx;
@@ -613,6 +651,18 @@ struct AnlzPass : public Pass {
                    if (args[argidx] == "-auto-top") {
                         continue;
                    }
+                   if (args[argidx] == "-top-ports" || args[argidx] == "-hier") {
+                        // with -top-ports and/or -hier only the requested
+                        // views are written
+                        if (!views_selected)
+                           dump_hier = dump_ports = false;
+                        views_selected = true;
+                        if (args[argidx] == "-hier")
+                           dump_hier = true;
+                        else
+                           dump_ports = true;
+                        continue;
+                   }
                    log_error("Analyze Unknown Option : \"%s\"\n", args[argidx].c_str());
 		}
 		extra_args(args, argidx, design);
@@ -630,47 +680,53 @@ struct AnlzPass : public Pass {
                   run_pass(cmd.c_str());
                 }
 
+		design->sort();
+
 		std::ostream *f;
 
                 // Dumping "hier_info.js" file
                 //
-		std::ofstream *ff = new std::ofstream;
-		ff->open(hier_filename.c_str(), std::ofstream::trunc);
+                if (dump_hier) {
+		   std::ofstream *ff = new std::ofstream;
+		   ff->open(hier_filename.c_str(), std::ofstream::trunc);
 
-		if (ff->fail()) {
-		   delete ff;
-		   log_error("Can't open file `%s' for writing: %s\n", 
-                             hier_filename.c_str(), strerror(errno));
-		}
+		   if (ff->fail()) {
+		      delete ff;
+		      log_error("Can't open file `%s' for writing: %s\n", 
+                                hier_filename.c_str(), strerror(errno));
+		   }
 
-		f = ff;
+		   f = ff;
 
-                log("\nDumping file %s ...\n", hier_filename.c_str());
+                   log("\nDumping file %s ...\n", hier_filename.c_str());
 
-		AnlzWriter anlz_writer(*f, true, aig_mode, compat_int_mode);
-		anlz_writer.dump_hier_info(design);
+		   AnlzWriter anlz_writer(*f, true, aig_mode, compat_int_mode);
+		   anlz_writer.dump_hier_info(design);
 
-		delete f;
+		   delete f;
+                }
 
                 // Dumping "port_info.js" file
                 //
-                ff = new std::ofstream;
-                ff->open(port_filename.c_str(), std::ofstream::trunc);
-
-                if (ff->fail()) {
-                   delete ff;
-                   log_error("Can't open file `%s' for writing: %s\n",
-                             port_filename.c_str(), strerror(errno));
-                }
+                if (dump_ports) {
+                   std::ofstream *ff = new std::ofstream;
+                   ff->open(port_filename.c_str(), std::ofstream::trunc);
+
+                   if (ff->fail()) {
+                      delete ff;
+                      log_error("Can't open file `%s' for writing: %s\n",
+                                port_filename.c_str(), strerror(errno));
+                   }
 
-                f = ff;
+                   f = ff;
 
-                log("Dumping file %s ...\n", port_filename.c_str());
+                   log("Dumping file %s ...\n", port_filename.c_str());
 
-                AnlzWriter anlz_writer_port(*f, true, aig_mode, compat_int_mode);
-                anlz_writer_port.dump_port_info(design);
+                   AnlzWriter anlz_writer_port(*f, true, aig_mode, compat_int_mode);
+                   anlz_writer_port.dump_port_info(design);
 
-                delete f;
+                   delete f;
+                }
 
 	}
 } AnlzPass;
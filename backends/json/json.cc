@@ -23,11 +23,37 @@
 #include "kernel/celltypes.h"
 #include "kernel/cellaigs.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
 #include <string>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// Output buffer of the JSON writer. The text of a module is collected in a
+// string, which is written to the output stream as one block.
+struct JsonBuffer
+{
+	std::string data;
+
+	JsonBuffer &operator<<(const std::string &str) { data += str; return *this; }
+	JsonBuffer &operator<<(const char *str) { data += str; return *this; }
+	JsonBuffer &operator<<(char c) { data += c; return *this; }
+
+	JsonBuffer &operator<<(int value)
+	{
+		char buf[16], *p = buf + sizeof(buf);
+		unsigned int v = value < 0 ? 0u - (unsigned int)value : value;
+		do {
+			*--p = '0' + v % 10;
+			v /= 10;
+		} while (v != 0);
+		if (value < 0)
+			*--p = '-';
+		data.append(p, buf + sizeof(buf) - p);
+		return *this;
+	}
+};
+
 struct JsonWriter
 {
 	std::ostream &f;
@@ -35,252 +61,286 @@ struct JsonWriter
 	bool aig_mode;
 	bool compat_int_mode;
 
+	Pass *pass;
 	Design *design;
-	Module *module;
-
-	SigMap sigmap;
-	int sigidcounter;
-	dict<SigBit, string> sigids;
-	pool<Aig> aig_models;
+	// AIG models by name, in the order of their first use
+	dict<string, const Aig*> aig_models;
 
-	JsonWriter(std::ostream &f, bool use_selection, bool aig_mode, bool compat_int_mode) :
+	JsonWriter(std::ostream &f, bool use_selection, bool aig_mode, bool compat_int_mode, Pass *pass) :
 			f(f), use_selection(use_selection), aig_mode(aig_mode),
-			compat_int_mode(compat_int_mode) { }
+			compat_int_mode(compat_int_mode), pass(pass) { }
 
-	string get_string(string str)
+	static void append_string(JsonBuffer &buf, const string &str)
 	{
-		string newstr = "\"";
+		buf << '"';
 		for (char c : str) {
 			if (c == '\\')
-				newstr += "\\\\";
+				buf << "\\\\";
 			else if (c == '"')
-				newstr += "\\\"";
+				buf << "\\\"";
 			else if (c == '\b')
-				newstr += "\\b";
+				buf << "\\b";
 			else if (c == '\f')
-				newstr += "\\f";
+				buf << "\\f";
 			else if (c == '\n')
-				newstr += "\\n";
+				buf << "\\n";
 			else if (c == '\r')
-				newstr += "\\r";
+				buf << "\\r";
 			else if (c == '\t')
-				newstr += "\\t";
+				buf << "\\t";
 			else if (c < 0x20)
-				newstr += stringf("\\u%04X", c);
+				buf << stringf("\\u%04X", c);
 			else
-				newstr += c;
+				buf << c;
 		}
-		return newstr + "\"";
+		buf << '"';
 	}
 
-	string get_name(IdString name)
+	static string get_string(const string &str)
 	{
-		return get_string(RTLIL::unescape_id(name));
+		JsonBuffer buf;
+		append_string(buf, str);
+		return buf.data;
 	}
 
-	string get_bits(SigSpec sig)
+	// The JSON text of one module. Modules are written independently of
+	// each other, possibly on different threads, and concatenated in order.
+	struct ModuleWriter
 	{
-		bool first = true;
-		string str = "[";
-		for (auto bit : sigmap(sig)) {
-			str += first ? " " : ", ";
-			first = false;
-			if (sigids.count(bit) == 0) {
-				string &s = sigids[bit];
+		const JsonWriter &parent;
+		Module *module;
+		JsonBuffer f;
+
+		SigMap sigmap;
+		int sigidcounter;
+		dict<SigBit, int> sigids;
+		dict<IdString, string> names;
+
+		// AIG models in the order of their first use in this module
+		pool<string> module_aigs;
+		vector<const Aig*> aig_order;
+
+		ModuleWriter(const JsonWriter &parent, Module *module) : parent(parent), module(module) { }
+
+		// names repeat a lot (port names, cell types), their escaped
+		// forms are cached
+		const string &name(IdString id)
+		{
+			auto it = names.find(id);
+			if (it != names.end())
+				return it->second;
+			return names[id] = get_string(RTLIL::unescape_id(id));
+		}
+
+		void write_bits(SigSpec sig)
+		{
+			bool first = true;
+			f << '[';
+			for (auto bit : sigmap(sig)) {
+				f << (first ? " " : ", ");
+				first = false;
 				if (bit.wire == nullptr) {
-					if (bit == State::S0) s = "\"0\"";
-					else if (bit == State::S1) s = "\"1\"";
-					else if (bit == State::Sz) s = "\"z\"";
-					else s = "\"x\"";
-				} else
-					s = stringf("%d", sigidcounter++);
+					if (bit == State::S0) f << "\"0\"";
+					else if (bit == State::S1) f << "\"1\"";
+					else if (bit == State::Sz) f << "\"z\"";
+					else f << "\"x\"";
+					continue;
+				}
+				auto it = sigids.find(bit);
+				if (it == sigids.end())
+					it = sigids.emplace(bit, sigidcounter++).first;
+				f << it->second;
 			}
-			str += sigids[bit];
+			f << " ]";
 		}
-		return str + " ]";
-	}
 
-	void write_parameter_value(const Const &value)
-	{
-		if ((value.flags & RTLIL::ConstFlags::CONST_FLAG_STRING) != 0) {
-			string str = value.decode_string();
-			int state = 0;
-			for (char c : str) {
-				if (state == 0) {
-					if (c == '0' || c == '1' || c == 'x' || c == 'z')
-						state = 0;
-					else if (c == ' ')
-						state = 1;
-					else
+		void write_parameter_value(const Const &value)
+		{
+			if ((value.flags & RTLIL::ConstFlags::CONST_FLAG_STRING) != 0) {
+				string str = value.decode_string();
+				int state = 0;
+				for (char c : str) {
+					if (state == 0) {
+						if (c == '0' || c == '1' || c == 'x' || c == 'z')
+							state = 0;
+						else if (c == ' ')
+							state = 1;
+						else
+							state = 2;
+					} else if (state == 1 && c != ' ')
 						state = 2;
-				} else if (state == 1 && c != ' ')
-					state = 2;
+				}
+				if (state < 2)
+					str += " ";
+				append_string(f, str);
+			} else if (parent.compat_int_mode && GetSize(value) <= 32 && value.is_fully_def()) {
+				if ((value.flags & RTLIL::ConstFlags::CONST_FLAG_SIGNED) != 0)
+					f << value.as_int();
+				else
+					f << stringf("%u", value.as_int());
+			} else {
+				append_string(f, value.as_string());
 			}
-			if (state < 2)
-				str += " ";
-			f << get_string(str);
-		} else if (compat_int_mode && GetSize(value) <= 32 && value.is_fully_def()) {
-			if ((value.flags & RTLIL::ConstFlags::CONST_FLAG_SIGNED) != 0)
-				f << stringf("%d", value.as_int());
-			else
-				f << stringf("%u", value.as_int());
-		} else {
-			f << get_string(value.as_string());
 		}
-	}
 
-	void write_parameters(const dict<IdString, Const> &parameters, bool for_module=false)
-	{
-		bool first = true;
-		for (auto &param : parameters) {
-			f << stringf("%s\n", first ? "" : ",");
-			f << stringf("        %s%s: ", for_module ? "" : "    ", get_name(param.first).c_str());
-			write_parameter_value(param.second);
-			first = false;
+		void write_parameters(const dict<IdString, Const> &parameters, bool for_module=false)
+		{
+			bool first = true;
+			for (auto &param : parameters) {
+				f << (first ? "\n" : ",\n");
+				f << (for_module ? "        " : "            ") << name(param.first) << ": ";
+				write_parameter_value(param.second);
+				first = false;
+			}
 		}
-	}
 
-	void write_module(Module *module_)
-	{
-		module = module_;
-		log_assert(module->design == design);
-		sigmap.set(module);
-		sigids.clear();
+		void write_module()
+		{
+			bool use_selection = parent.use_selection;
 
-		// reserve 0 and 1 to avoid confusion with "0" and "1"
-		sigidcounter = 2;
+			sigmap.set(module);
+			sigids.clear();
 
-		if (module->has_processes()) {
-			log_error("Module %s contains processes, which are not supported by JSON backend (run `proc` first).\n", log_id(module));
-		}
+			// reserve 0 and 1 to avoid confusion with "0" and "1"
+			sigidcounter = 2;
 
-		f << stringf("    %s: {\n", get_name(module->name).c_str());
+			if (module->has_processes()) {
+				log_error("Module %s contains processes, which are not supported by JSON backend (run `proc` first).\n", log_id(module));
+			}
 
-		f << stringf("      \"attributes\": {");
-		write_parameters(module->attributes, /*for_module=*/true);
-		f << stringf("\n      },\n");
+			f << "    " << name(module->name) << ": {\n";
 
-		if (module->parameter_default_values.size()) {
-			f << stringf("      \"parameter_default_values\": {");
-			write_parameters(module->parameter_default_values, /*for_module=*/true);
-			f << stringf("\n      },\n");
-		}
+			f << "      \"attributes\": {";
+			write_parameters(module->attributes, /*for_module=*/true);
+			f << "\n      },\n";
 
-		f << stringf("      \"ports\": {");
-		bool first = true;
-		for (auto n : module->ports) {
-			Wire *w = module->wire(n);
-			if (use_selection && !module->selected(w))
-				continue;
-			f << stringf("%s\n", first ? "" : ",");
-			f << stringf("        %s: {\n", get_name(n).c_str());
-			f << stringf("          \"direction\": \"%s\",\n", w->port_input ? w->port_output ? "inout" : "input" : "output");
-			if (w->start_offset)
-				f << stringf("          \"offset\": %d,\n", w->start_offset);
-			if (w->upto)
-				f << stringf("          \"upto\": 1,\n");
-			if (w->is_signed)
-				f << stringf("          \"signed\": %d,\n", w->is_signed);
-			f << stringf("          \"bits\": %s\n", get_bits(w).c_str());
-			f << stringf("        }");
-			first = false;
-		}
-		f << stringf("\n      },\n");
+			if (module->parameter_default_values.size()) {
+				f << "      \"parameter_default_values\": {";
+				write_parameters(module->parameter_default_values, /*for_module=*/true);
+				f << "\n      },\n";
+			}
 
-		f << stringf("      \"cells\": {");
-		first = true;
-		for (auto c : module->cells()) {
-			if (use_selection && !module->selected(c))
-				continue;
-			f << stringf("%s\n", first ? "" : ",");
-			f << stringf("        %s: {\n", get_name(c->name).c_str());
-			f << stringf("          \"hide_name\": %s,\n", c->name[0] == '$' ? "1" : "0");
-			f << stringf("          \"type\": %s,\n", get_name(c->type).c_str());
-			if (aig_mode) {
-				Aig aig(c);
-				if (!aig.name.empty()) {
-					f << stringf("          \"model\": \"%s\",\n", aig.name.c_str());
-					aig_models.insert(aig);
-				}
+			f << "      \"ports\": {";
+			bool first = true;
+			for (auto n : module->ports) {
+				Wire *w = module->wire(n);
+				if (use_selection && !module->selected(w))
+					continue;
+				f << (first ? "\n" : ",\n");
+				f << "        " << name(n) << ": {\n";
+				f << "          \"direction\": \"" << (w->port_input ? w->port_output ? "inout" : "input" : "output") << "\",\n";
+				if (w->start_offset)
+					f << "          \"offset\": " << w->start_offset << ",\n";
+				if (w->upto)
+					f << "          \"upto\": 1,\n";
+				if (w->is_signed)
+					f << "          \"signed\": " << (int)w->is_signed << ",\n";
+				f << "          \"bits\": ";
+				write_bits(w);
+				f << "\n        }";
+				first = false;
 			}
-			f << stringf("          \"parameters\": {");
-			write_parameters(c->parameters);
-			f << stringf("\n          },\n");
-			f << stringf("          \"attributes\": {");
-			write_parameters(c->attributes);
-			f << stringf("\n          },\n");
-			if (c->known()) {
-				f << stringf("          \"port_directions\": {");
+			f << "\n      },\n";
+
+			f << "      \"cells\": {";
+			first = true;
+			for (auto c : module->cells()) {
+				if (use_selection && !module->selected(c))
+					continue;
+				f << (first ? "\n" : ",\n");
+				f << "        " << name(c->name) << ": {\n";
+				f << "          \"hide_name\": " << (c->name[0] == '$' ? "1" : "0") << ",\n";
+				f << "          \"type\": " << name(c->type) << ",\n";
+				if (parent.aig_mode) {
+					const Aig &aig = Aig::cached(c);
+					if (!aig.name.empty()) {
+						f << "          \"model\": \"" << aig.name << "\",\n";
+						if (module_aigs.insert(aig.name).second)
+							aig_order.push_back(&aig);
+					}
+				}
+				f << "          \"parameters\": {";
+				write_parameters(c->parameters);
+				f << "\n          },\n";
+				f << "          \"attributes\": {";
+				write_parameters(c->attributes);
+				f << "\n          },\n";
+				if (c->known()) {
+					f << "          \"port_directions\": {";
+					bool first2 = true;
+					for (auto &conn : c->connections()) {
+						const char *direction = "output";
+						if (c->input(conn.first))
+							direction = c->output(conn.first) ? "inout" : "input";
+						f << (first2 ? "\n" : ",\n");
+						f << "            " << name(conn.first) << ": \"" << direction << "\"";
+						first2 = false;
+					}
+					f << "\n          },\n";
+				}
+				f << "          \"connections\": {";
 				bool first2 = true;
 				for (auto &conn : c->connections()) {
-					string direction = "output";
-					if (c->input(conn.first))
-						direction = c->output(conn.first) ? "inout" : "input";
-					f << stringf("%s\n", first2 ? "" : ",");
-					f << stringf("            %s: \"%s\"", get_name(conn.first).c_str(), direction.c_str());
+					f << (first2 ? "\n" : ",\n");
+					f << "            " << name(conn.first) << ": ";
+					write_bits(conn.second);
 					first2 = false;
 				}
-				f << stringf("\n          },\n");
+				f << "\n          }\n";
+				f << "        }";
+				first = false;
 			}
-			f << stringf("          \"connections\": {");
-			bool first2 = true;
-			for (auto &conn : c->connections()) {
-				f << stringf("%s\n", first2 ? "" : ",");
-				f << stringf("            %s: %s", get_name(conn.first).c_str(), get_bits(conn.second).c_str());
-				first2 = false;
+			f << "\n      },\n";
+
+			if (!module->memories.empty()) {
+				f << "      \"memories\": {";
+				first = true;
+				for (auto &it : module->memories) {
+					if (use_selection && !module->selected(it.second))
+						continue;
+					f << (first ? "\n" : ",\n");
+					f << "        " << name(it.second->name) << ": {\n";
+					f << "          \"hide_name\": " << (it.second->name[0] == '$' ? "1" : "0") << ",\n";
+					f << "          \"attributes\": {";
+					write_parameters(it.second->attributes);
+					f << "\n          },\n";
+					f << "          \"width\": " << it.second->width << ",\n";
+					f << "          \"start_offset\": " << it.second->start_offset << ",\n";
+					f << "          \"size\": " << it.second->size << "\n";
+					f << "        }";
+					first = false;
+				}
+				f << "\n      },\n";
 			}
-			f << stringf("\n          }\n");
-			f << stringf("        }");
-			first = false;
-		}
-		f << stringf("\n      },\n");
 
-		if (!module->memories.empty()) {
-			f << stringf("      \"memories\": {");
+			f << "      \"netnames\": {";
 			first = true;
-			for (auto &it : module->memories) {
-				if (use_selection && !module->selected(it.second))
+			for (auto w : module->wires()) {
+				if (use_selection && !module->selected(w))
 					continue;
-				f << stringf("%s\n", first ? "" : ",");
-				f << stringf("        %s: {\n", get_name(it.second->name).c_str());
-				f << stringf("          \"hide_name\": %s,\n", it.second->name[0] == '$' ? "1" : "0");
-				f << stringf("          \"attributes\": {");
-				write_parameters(it.second->attributes);
-				f << stringf("\n          },\n");
-				f << stringf("          \"width\": %d,\n", it.second->width);
-				f << stringf("          \"start_offset\": %d,\n", it.second->start_offset);
-				f << stringf("          \"size\": %d\n", it.second->size);
-				f << stringf("        }");
+				f << (first ? "\n" : ",\n");
+				f << "        " << name(w->name) << ": {\n";
+				f << "          \"hide_name\": " << (w->name[0] == '$' ? "1" : "0") << ",\n";
+				f << "          \"bits\": ";
+				write_bits(w);
+				f << ",\n";
+				if (w->start_offset)
+					f << "          \"offset\": " << w->start_offset << ",\n";
+				if (w->upto)
+					f << "          \"upto\": 1,\n";
+				if (w->is_signed)
+					f << "          \"signed\": " << (int)w->is_signed << ",\n";
+				f << "          \"attributes\": {";
+				write_parameters(w->attributes);
+				f << "\n          }\n";
+				f << "        }";
 				first = false;
 			}
-			f << stringf("\n      },\n");
-		}
+			f << "\n      }\n";
 
-		f << stringf("      \"netnames\": {");
-		first = true;
-		for (auto w : module->wires()) {
-			if (use_selection && !module->selected(w))
-				continue;
-			f << stringf("%s\n", first ? "" : ",");
-			f << stringf("        %s: {\n", get_name(w->name).c_str());
-			f << stringf("          \"hide_name\": %s,\n", w->name[0] == '$' ? "1" : "0");
-			f << stringf("          \"bits\": %s,\n", get_bits(w).c_str());
-			if (w->start_offset)
-				f << stringf("          \"offset\": %d,\n", w->start_offset);
-			if (w->upto)
-				f << stringf("          \"upto\": 1,\n");
-			if (w->is_signed)
-				f << stringf("          \"signed\": %d,\n", w->is_signed);
-			f << stringf("          \"attributes\": {");
-			write_parameters(w->attributes);
-			f << stringf("\n          }\n");
-			f << stringf("        }");
-			first = false;
+			f << "    }";
 		}
-		f << stringf("\n      }\n");
-
-		f << stringf("    }");
-	}
+	};
 
 	void write_design(Design *design_)
 	{
@@ -291,18 +351,42 @@ struct JsonWriter
 		f << stringf("  \"creator\": %s,\n", get_string(yosys_version_str).c_str());
 		f << stringf("  \"modules\": {\n");
 		vector<Module*> modules = use_selection ? design->selected_modules() : design->modules();
-		bool first_module = true;
-		for (auto mod : modules) {
-			if (!first_module)
-				f << stringf(",\n");
-			write_module(mod);
-			first_module = false;
+
+		// modules are serialized in parallel, in batches of a few modules
+		// per thread, and written in order
+		int batch_size = 4 * yosys_thread_count(GetSize(modules));
+		for (int batch_begin = 0; batch_begin < GetSize(modules); batch_begin += batch_size)
+		{
+			int batch_end = std::min(batch_begin + batch_size, GetSize(modules));
+			vector<Module*> batch(modules.begin() + batch_begin, modules.begin() + batch_end);
+			std::vector<std::unique_ptr<ModuleWriter>> writers;
+			dict<Module*, ModuleWriter*> module_writers;
+			for (auto mod : batch) {
+				log_assert(mod->design == design);
+				writers.emplace_back(new ModuleWriter(*this, mod));
+				module_writers[mod] = writers.back().get();
+			}
+
+			pass->execute_modules(design, batch, [&](Module *mod) {
+				module_writers.at(mod)->write_module();
+			});
+
+			for (int i = 0; i < GetSize(writers); i++) {
+				if (batch_begin + i != 0)
+					f << stringf(",\n");
+				f << writers[i]->f.data;
+				for (auto aig : writers[i]->aig_order)
+					aig_models.insert(std::make_pair(aig->name, aig));
+				writers[i].reset();
+			}
 		}
+
 		f << stringf("\n  }");
 		if (!aig_models.empty()) {
 			f << stringf(",\n  \"models\": {\n");
 			bool first_model = true;
-			for (auto &aig : aig_models) {
+			for (auto &it : aig_models) {
+				const Aig &aig = *it.second;
 				if (!first_model)
 					f << stringf(",\n");
 				f << stringf("    \"%s\": [\n", aig.name.c_str());
@@ -616,7 +700,7 @@ struct JsonBackend : public Backend {
 
 		log_header(design, "Executing JSON backend.\n");
 
-		JsonWriter json_writer(*f, false, aig_mode, compat_int_mode);
+		JsonWriter json_writer(*f, false, aig_mode, compat_int_mode, this);
 		json_writer.write_design(design);
 	}
 } JsonBackend;
@@ -691,7 +775,7 @@ struct JsonPass : public Pass {
 			f = &buf;
 		}
 
-		JsonWriter json_writer(*f, true, aig_mode, compat_int_mode);
+		JsonWriter json_writer(*f, true, aig_mode, compat_int_mode, this);
 		json_writer.write_design(design);
 
 		if (!empty) {
@@ -93,19 +93,19 @@ void post_msg(std::ofstream& json, int space, std::string string) {
   }
   printf("%s\n", string.c_str());
 #endif
-  json << "    \"";
-  while (space) {
-    json << "  ";
-    space--;
-  }
+  // the message is escaped into one buffer, the stream is only flushed at
+  // the end of the analysis
+  std::string line = "    \"";
+  line.append(2 * space, ' ');
+  line.reserve(line.size() + string.size() + 3);
   for (auto& c : string) {
     if (c == '\\') {
-      json << '\\';
+      line += '\\';
     }
-    json << c;
+    line += c;
   }
-  json << "\",\n";
-  json.flush();
+  line += "\",\n";
+  json << line;
 }
 
 #if USE_LOCAL_GEN_STRING
@@ -668,6 +668,30 @@ struct OCLA_DEBUG_SUBSYSTEM_MODULE : MODULE_IP {
   std::vector<OCLA_SIGNAL> eio_probes_out;
 };
 
+/*
+  Instances of each module type, in the order of design->modules() and
+  module->cells(). It is built once before the design is flattened, so that
+  looking up the instantiators of the IPs does not scan the whole design for
+  each IP and hierarchy level.
+*/
+struct OCLA_INSTANCE_INDEX {
+  OCLA_INSTANCE_INDEX(RTLIL::Design* design) {
+    for (auto m : design->modules()) {
+      for (auto cell : m->cells()) {
+        instances[cell->type].push_back(std::make_pair(m, cell));
+      }
+    }
+  }
+  const std::vector<std::pair<RTLIL::Module*, RTLIL::Cell*>>& get(
+      const std::string& type) const {
+    static const std::vector<std::pair<RTLIL::Module*, RTLIL::Cell*>> none;
+    auto iter = instances.find(RTLIL::IdString(type));
+    return iter != instances.end() ? iter->second : none;
+  }
+  dict<RTLIL::IdString, std::vector<std::pair<RTLIL::Module*, RTLIL::Cell*>>>
+      instances;
+};
+
 class OCLA_Analyzer {
  public:
   /*
@@ -695,6 +719,7 @@ class OCLA_Analyzer {
     std::vector<OCLA_MODULE*> ocla_modules;
     std::vector<OCLA_DEBUG_SUBSYSTEM_MODULE*> ocla_debug_subsystem_modules;
     std::vector<std::string> ocla_instantiator_names;
+    OCLA_INSTANCE_INDEX index(design);
     
 #if DUMP_RTLIL
     cmd = "write_rtlil ocla.pre.rtlil";
@@ -731,7 +756,7 @@ class OCLA_Analyzer {
     // Step 3: Make sure there is only one OCLA Debug Subsystem all the way up
     // to top
     if (!check_unique_ocla_debug_subsystem(
-            design, ocla_debug_subsystem_modules[0]->name,
+            design, index, ocla_debug_subsystem_modules[0]->name,
             ocla_debug_subsystem_instantiator,
             ocla_debug_subsystem_connection_name, json)) {
       JSON_POST_MSG(1,
@@ -742,7 +767,7 @@ class OCLA_Analyzer {
 
     // Step 4: For each OCLA IP, grab all the instantiator (or wrapper)
     for (auto& o : ocla_modules) {
-      get_ocla_instantiator(design, o, ocla_instantiator_names, json);
+      get_ocla_instantiator(index, o, ocla_instantiator_names, json);
     }
 
     // Step 5: Make sure we successfully grab at least 1 instantiator
@@ -1023,13 +1048,16 @@ class OCLA_Analyzer {
       OCLA_SIGNAL s = dump_sigchunk(f, sig.as_chunk(), autoint);
       ss.insert(ss.begin(), s);
     } else {
+      // the chunks are printed MSB first, but stored LSB first in front of
+      // the signals already in ss, with one insertion for all chunks
+      std::vector<OCLA_SIGNAL> chunk_signals;
       f << stringf("{ ");
       for (auto it = sig.chunks().rbegin(); it != sig.chunks().rend(); ++it) {
-        OCLA_SIGNAL s = dump_sigchunk(f, *it, false);
-        ss.insert(ss.begin(), s);
+        chunk_signals.push_back(dump_sigchunk(f, *it, false));
         f << stringf(" ");
       }
       f << stringf("}");
+      ss.insert(ss.begin(), chunk_signals.rbegin(), chunk_signals.rend());
     }
   }
   /*
@@ -1129,6 +1157,7 @@ class OCLA_Analyzer {
     the way up to top
   */
   static bool check_unique_ocla_debug_subsystem(RTLIL::Design* design,
+                                                const OCLA_INSTANCE_INDEX& index,
                                                 std::string module_name,
                                                 std::string& instantiator,
                                                 std::string& connection_name,
@@ -1142,20 +1171,18 @@ class OCLA_Analyzer {
     while (status) {
       JSON_POST_MSG(1, "Module: %s", module_name.c_str());
       std::vector<std::string> module_names;
-      for (auto m : design->modules()) {
-        for (auto cell : m->cells()) {
-          if (std::string(cell->type.c_str()) == module_name) {
-            JSON_POST_MSG(2, "Instantiated by %s as %s", m->name.c_str(),
-                          cell->name.c_str());
-            module_names.push_back(m->name.c_str());
-            if (level) {
-              if (connection_name.size()) {
-                connection_name = gen_string("%s.%s", cell->name.c_str(),
-                                             connection_name.substr(1).c_str());
-              } else {
-                connection_name = cell->name.c_str();
-              }
-            }
+      for (auto& inst : index.get(module_name)) {
+        RTLIL::Module* m = inst.first;
+        RTLIL::Cell* cell = inst.second;
+        JSON_POST_MSG(2, "Instantiated by %s as %s", m->name.c_str(),
+                      cell->name.c_str());
+        module_names.push_back(m->name.c_str());
+        if (level) {
+          if (connection_name.size()) {
+            connection_name = gen_string("%s.%s", cell->name.c_str(),
+                                         connection_name.substr(1).c_str());
+          } else {
+            connection_name = cell->name.c_str();
           }
         }
       }
@@ -1433,20 +1460,17 @@ class OCLA_Analyzer {
       a. This function only get the information name.
       b. This is done before we blackbox the instantiator and flatten the design
   */
-  static void get_ocla_instantiator(RTLIL::Design* design, OCLA_MODULE* module,
+  static void get_ocla_instantiator(const OCLA_INSTANCE_INDEX& index,
+                                    OCLA_MODULE* module,
                                     std::vector<std::string>& instantiators,
                                     std::ofstream& json) {
     bool found = false;
     JSON_POST_MSG(0, "Check instantiator for OCLA module %s",
                   module->name.c_str());
-    for (auto m : design->modules()) {
-      for (auto cell : m->cells()) {
-        if (std::string(cell->type.c_str()) == module->name) {
-          JSON_POST_MSG(1, "Instantiated by %s", m->name.c_str());
-          instantiators.push_back(std::string(m->name.c_str()));
-          found = true;
-        }
-      }
+    for (auto& inst : index.get(module->name)) {
+      JSON_POST_MSG(1, "Instantiated by %s", inst.first->name.c_str());
+      instantiators.push_back(std::string(inst.first->name.c_str()));
+      found = true;
     }
     if (!found) {
       JSON_POST_MSG(1, "Warning: Does not detect any instantiator");
@@ -1475,8 +1499,9 @@ class OCLA_Analyzer {
     }
     log_assert(subsystem_module->eio_probes_in.size() == 0);
     log_assert(subsystem_module->eio_probes_out.size() == 0);
+    RTLIL::IdString instantiator_type = instantiator_module;
     for (auto cell : top_module->cells()) {
-      if (std::string(cell->type.c_str()) == instantiator_module) {
+      if (cell->type == instantiator_type) {
         JSON_POST_MSG(1, "Instantiated as %s", cell->name.c_str());
         for (auto m : modules) {
           if (m->is_axi) {
@@ -1489,22 +1514,19 @@ class OCLA_Analyzer {
                           "OCLA Module at INDEX=%d looking for connection %s",
                           m->index, module_probe_name.c_str());
             bool found = false;
-            for (auto& connection : cell->connections()) {
+            RTLIL::IdString probe_port = module_probe_name;
+            if (cell->hasPort(probe_port)) {
               std::ostringstream wire;
-              std::string connection_name =
-                  std::string(connection.first.c_str());
-              if (connection_name == module_probe_name) {
-                found = true;
-                JSON_POST_MSG(3, "Found potential Probe Connection: %s",
-                              connection_name.c_str());
-                size_t starting_count = m->probes.size();
-                dump_sigspec(wire, m->probes, connection.second);
-                JSON_POST_MSG(4, "Connected to %s", wire.str().c_str());
-                if (m->probes.size() <= starting_count) {
-                  JSON_POST_MSG(4, "Fail to parse connection %s",
-                                module_probe_name.c_str());
-                  status = false;
-                }
+              found = true;
+              JSON_POST_MSG(3, "Found potential Probe Connection: %s",
+                            module_probe_name.c_str());
+              size_t starting_count = m->probes.size();
+              dump_sigspec(wire, m->probes, cell->getPort(probe_port));
+              JSON_POST_MSG(4, "Connected to %s", wire.str().c_str());
+              if (m->probes.size() <= starting_count) {
+                JSON_POST_MSG(4, "Fail to parse connection %s",
+                              module_probe_name.c_str());
+                status = false;
               }
             }
             if (!found) {
@@ -1517,8 +1539,7 @@ class OCLA_Analyzer {
           JSON_POST_MSG(1, "EIO connection");
           for (auto& connection : cell->connections()) {
             std::ostringstream wire;
-            std::string connection_name = std::string(connection.first.c_str());
-            if (connection_name == "\\probes_in") {
+            if (connection.first == ID(probes_in)) {
               JSON_POST_MSG(2, "Found potential EIO \\probes_in connection");
               size_t starting_count = subsystem_module->eio_probes_in.size();
               dump_sigspec(wire, subsystem_module->eio_probes_in,
@@ -1528,7 +1549,7 @@ class OCLA_Analyzer {
                 JSON_POST_MSG(3, "Fail to parse EIO \\probes_in connection");
                 status = false;
               }
-            } else if (connection_name == "\\probes_out") {
+            } else if (connection.first == ID(probes_out)) {
               JSON_POST_MSG(2, "Found potential EIO \\probes_out connection");
               size_t starting_count = subsystem_module->eio_probes_out.size();
               dump_sigspec(wire, subsystem_module->eio_probes_out,
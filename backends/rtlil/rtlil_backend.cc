@@ -24,6 +24,7 @@
 
 #include "rtlil_backend.h"
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
 #include <errno.h>
 
 USING_YOSYS_NAMESPACE
@@ -46,44 +47,40 @@ void RTLIL_BACKEND::dump_const(std::ostream &f, const RTLIL::Const &data, int wi
 				}
 			}
 			if (val >= 0) {
-				f << stringf("%d", val);
+				f << val;
 				return;
 			}
 		}
-		f << stringf("%d'", width);
+		f << width << '\'';
 		if (data.is_fully_undef_x_only()) {
-			f << "x";
+			f << 'x';
 		} else {
-			for (int i = offset+width-1; i >= offset; i--) {
-				log_assert(i < (int)data.bits.size());
-				switch (data.bits[i]) {
-				case State::S0: f << stringf("0"); break;
-				case State::S1: f << stringf("1"); break;
-				case RTLIL::Sx: f << stringf("x"); break;
-				case RTLIL::Sz: f << stringf("z"); break;
-				case RTLIL::Sa: f << stringf("-"); break;
-				case RTLIL::Sm: f << stringf("m"); break;
-				}
-			}
+			log_assert(offset+width <= (int)data.bits.size());
+			std::string str(width, '0');
+			for (int i = 0; i < width; i++)
+				str[width-1-i] = "01xz-m"[data.bits[offset+i]];
+			f << str;
 		}
 	} else {
-		f << stringf("\"");
 		std::string str = data.decode_string();
+		std::string escaped = "\"";
+		escaped.reserve(str.size() + 2);
 		for (size_t i = 0; i < str.size(); i++) {
 			if (str[i] == '\n')
-				f << stringf("\\n");
+				escaped += "\\n";
 			else if (str[i] == '\t')
-				f << stringf("\\t");
+				escaped += "\\t";
 			else if (str[i] < 32)
-				f << stringf("\\%03o", (unsigned char)str[i]);
+				escaped += stringf("\\%03o", (unsigned char)str[i]);
 			else if (str[i] == '"')
-				f << stringf("\\\"");
+				escaped += "\\\"";
 			else if (str[i] == '\\')
-				f << stringf("\\\\");
+				escaped += "\\\\";
 			else
-				f << str[i];
+				escaped += str[i];
 		}
-		f << stringf("\"");
+		escaped += '"';
+		f << escaped;
 	}
 }
 
@@ -92,12 +89,15 @@ void RTLIL_BACKEND::dump_sigchunk(std::ostream &f, const RTLIL::SigChunk &chunk,
 	if (chunk.wire == NULL) {
 		dump_const(f, chunk.data, chunk.width, chunk.offset, autoint);
 	} else {
+		f << chunk.wire->name.c_str();
 		if (chunk.width == chunk.wire->width && chunk.offset == 0)
-			f << stringf("%s", chunk.wire->name.c_str());
-		else if (chunk.width == 1)
-			f << stringf("%s%s[%d]", chunk.wire->name.c_str(), no_space ? "" : " ", chunk.offset);
+			return;
+		if (!no_space)
+			f << ' ';
+		if (chunk.width == 1)
+			f << '[' << chunk.offset << ']';
 		else
-			f << stringf("%s%s[%d:%d]", chunk.wire->name.c_str(), no_space ? "" : " ", chunk.offset+chunk.width-1, chunk.offset);
+			f << '[' << chunk.offset+chunk.width-1 << ':' << chunk.offset << ']';
 	}
 }
 
@@ -106,90 +106,89 @@ void RTLIL_BACKEND::dump_sigspec(std::ostream &f, const RTLIL::SigSpec &sig, boo
 	if (sig.is_chunk()) {
 		dump_sigchunk(f, sig.as_chunk(), autoint, no_space);
 	} else {
-		f << stringf("{ ");
+		f << "{ ";
 		for (auto it = sig.chunks().rbegin(); it != sig.chunks().rend(); ++it) {
 			dump_sigchunk(f, *it, false, no_space);
-			f << stringf(" ");
+			f << ' ';
 		}
-		f << stringf("}");
+		f << '}';
 	}
 }
 
-void RTLIL_BACKEND::dump_wire(std::ostream &f, std::string indent, const RTLIL::Wire *wire)
+static void dump_attributes(std::ostream &f, const std::string &indent, const dict<RTLIL::IdString, RTLIL::Const> &attributes)
 {
-	for (auto &it : wire->attributes) {
-		f << stringf("%s" "attribute %s ", indent.c_str(), it.first.c_str());
+	for (auto &it : attributes) {
+		f << indent << "attribute " << it.first.c_str() << ' ';
 		dump_const(f, it.second);
-		f << stringf("\n");
+		f << '\n';
 	}
-	f << stringf("%s" "wire ", indent.c_str());
+}
+
+void RTLIL_BACKEND::dump_wire(std::ostream &f, std::string indent, const RTLIL::Wire *wire)
+{
+	dump_attributes(f, indent, wire->attributes);
+	f << indent << "wire ";
 	if (wire->width != 1)
-		f << stringf("width %d ", wire->width);
+		f << "width " << wire->width << ' ';
 	if (wire->upto)
-		f << stringf("upto ");
+		f << "upto ";
 	if (wire->start_offset != 0)
-		f << stringf("offset %d ", wire->start_offset);
+		f << "offset " << wire->start_offset << ' ';
 	if (wire->port_input && !wire->port_output)
-		f << stringf("input %d ", wire->port_id);
+		f << "input " << wire->port_id << ' ';
 	if (!wire->port_input && wire->port_output)
-		f << stringf("output %d ", wire->port_id);
+		f << "output " << wire->port_id << ' ';
 	if (wire->port_input && wire->port_output)
-		f << stringf("inout %d ", wire->port_id);
+		f << "inout " << wire->port_id << ' ';
 	if (wire->is_signed)
-		f << stringf("signed ");
-	f << stringf("%s\n", wire->name.c_str());
+		f << "signed ";
+	f << wire->name.c_str() << '\n';
 }
 
 void RTLIL_BACKEND::dump_memory(std::ostream &f, std::string indent, const RTLIL::Memory *memory)
 {
-	for (auto &it : memory->attributes) {
-		f << stringf("%s" "attribute %s ", indent.c_str(), it.first.c_str());
-		dump_const(f, it.second);
-		f << stringf("\n");
-	}
-	f << stringf("%s" "memory ", indent.c_str());
+	dump_attributes(f, indent, memory->attributes);
+	f << indent << "memory ";
 	if (memory->width != 1)
-		f << stringf("width %d ", memory->width);
+		f << "width " << memory->width << ' ';
 	if (memory->size != 0)
-		f << stringf("size %d ", memory->size);
+		f << "size " << memory->size << ' ';
 	if (memory->start_offset != 0)
-		f << stringf("offset %d ", memory->start_offset);
-	f << stringf("%s\n", memory->name.c_str());
+		f << "offset " << memory->start_offset << ' ';
+	f << memory->name.c_str() << '\n';
 }
 
 void RTLIL_BACKEND::dump_cell(std::ostream &f, std::string indent, const RTLIL::Cell *cell)
 {
-	for (auto &it : cell->attributes) {
-		f << stringf("%s" "attribute %s ", indent.c_str(), it.first.c_str());
-		dump_const(f, it.second);
-		f << stringf("\n");
-	}
-	f << stringf("%s" "cell %s %s\n", indent.c_str(), cell->type.c_str(), cell->name.c_str());
+	dump_attributes(f, indent, cell->attributes);
+	f << indent << "cell " << cell->type.c_str() << ' ' << cell->name.c_str() << '\n';
 	for (auto &it : cell->parameters) {
-		f << stringf("%s  parameter%s%s %s ", indent.c_str(),
-				(it.second.flags & RTLIL::CONST_FLAG_SIGNED) != 0 ? " signed" : "",
-				(it.second.flags & RTLIL::CONST_FLAG_REAL) != 0 ? " real" : "",
-				it.first.c_str());
+		f << indent << "  parameter";
+		if ((it.second.flags & RTLIL::CONST_FLAG_SIGNED) != 0)
+			f << " signed";
+		if ((it.second.flags & RTLIL::CONST_FLAG_REAL) != 0)
+			f << " real";
+		f << ' ' << it.first.c_str() << ' ';
 		dump_const(f, it.second);
-		f << stringf("\n");
+		f << '\n';
 	}
 	for (auto &it : cell->connections()) {
-		f << stringf("%s  connect %s ", indent.c_str(), it.first.c_str());
+		f << indent << "  connect " << it.first.c_str() << ' ';
 		dump_sigspec(f, it.second);
-		f << stringf("\n");
+		f << '\n';
 	}
-	f << stringf("%s" "end\n", indent.c_str());
+	f << indent << "end\n";
 }
 
 void RTLIL_BACKEND::dump_proc_case_body(std::ostream &f, std::string indent, const RTLIL::CaseRule *cs)
 {
 	for (auto it = cs->actions.begin(); it != cs->actions.end(); ++it)
 	{
-		f << stringf("%s" "assign ", indent.c_str());
+		f << indent << "assign ";
 		dump_sigspec(f, it->first);
-		f << stringf(" ");
+		f << ' ';
 		dump_sigspec(f, it->second);
-		f << stringf("\n");
+		f << '\n';
 	}
 
 	for (auto it = cs->switches.begin(); it != cs->switches.end(); ++it)
@@ -198,101 +197,85 @@ void RTLIL_BACKEND::dump_proc_case_body(std::ostream &f, std::string indent, con
 
 void RTLIL_BACKEND::dump_proc_switch(std::ostream &f, std::string indent, const RTLIL::SwitchRule *sw)
 {
-	for (auto it = sw->attributes.begin(); it != sw->attributes.end(); ++it) {
-		f << stringf("%s" "attribute %s ", indent.c_str(), it->first.c_str());
-		dump_const(f, it->second);
-		f << stringf("\n");
-	}
+	dump_attributes(f, indent, sw->attributes);
 
-	f << stringf("%s" "switch ", indent.c_str());
+	f << indent << "switch ";
 	dump_sigspec(f, sw->signal);
-	f << stringf("\n");
+	f << '\n';
 
 	for (auto it = sw->cases.begin(); it != sw->cases.end(); ++it)
 	{
-		for (auto ait = (*it)->attributes.begin(); ait != (*it)->attributes.end(); ++ait) {
-			f << stringf("%s  attribute %s ", indent.c_str(), ait->first.c_str());
-			dump_const(f, ait->second);
-			f << stringf("\n");
-		}
-		f << stringf("%s  case ", indent.c_str());
+		dump_attributes(f, indent + "  ", (*it)->attributes);
+		f << indent << "  case ";
 		for (size_t i = 0; i < (*it)->compare.size(); i++) {
 			if (i > 0)
-				f << stringf(" , ");
+				f << " , ";
 			dump_sigspec(f, (*it)->compare[i]);
 		}
-		f << stringf("\n");
+		f << '\n';
 
 		dump_proc_case_body(f, indent + "    ", *it);
 	}
 
-	f << stringf("%s" "end\n", indent.c_str());
+	f << indent << "end\n";
 }
 
 void RTLIL_BACKEND::dump_proc_sync(std::ostream &f, std::string indent, const RTLIL::SyncRule *sy)
 {
-	f << stringf("%s" "sync ", indent.c_str());
+	f << indent << "sync ";
 	switch (sy->type) {
-	case RTLIL::ST0: f << stringf("low ");
-	if (0) case RTLIL::ST1: f << stringf("high ");
-	if (0) case RTLIL::STp: f << stringf("posedge ");
-	if (0) case RTLIL::STn: f << stringf("negedge ");
-	if (0) case RTLIL::STe: f << stringf("edge ");
+	case RTLIL::ST0: f << "low ";
+	if (0) case RTLIL::ST1: f << "high ";
+	if (0) case RTLIL::STp: f << "posedge ";
+	if (0) case RTLIL::STn: f << "negedge ";
+	if (0) case RTLIL::STe: f << "edge ";
 		dump_sigspec(f, sy->signal);
-		f << stringf("\n");
+		f << '\n';
 		break;
-	case RTLIL::STa: f << stringf("always\n"); break;
-	case RTLIL::STg: f << stringf("global\n"); break;
-	case RTLIL::STi: f << stringf("init\n"); break;
+	case RTLIL::STa: f << "always\n"; break;
+	case RTLIL::STg: f << "global\n"; break;
+	case RTLIL::STi: f << "init\n"; break;
 	}
 
 	for (auto &it: sy->actions) {
-		f << stringf("%s  update ", indent.c_str());
+		f << indent << "  update ";
 		dump_sigspec(f, it.first);
-		f << stringf(" ");
+		f << ' ';
 		dump_sigspec(f, it.second);
-		f << stringf("\n");
+		f << '\n';
 	}
 
 	for (auto &it: sy->mem_write_actions) {
-		for (auto it2 = it.attributes.begin(); it2 != it.attributes.end(); ++it2) {
-			f << stringf("%s  attribute %s ", indent.c_str(), it2->first.c_str());
-			dump_const(f, it2->second);
-			f << stringf("\n");
-		}
-		f << stringf("%s  memwr %s ", indent.c_str(), it.memid.c_str());
+		dump_attributes(f, indent + "  ", it.attributes);
+		f << indent << "  memwr " << it.memid.c_str() << ' ';
 		dump_sigspec(f, it.address);
-		f << stringf(" ");
+		f << ' ';
 		dump_sigspec(f, it.data);
-		f << stringf(" ");
+		f << ' ';
 		dump_sigspec(f, it.enable);
-		f << stringf(" ");
+		f << ' ';
 		dump_const(f, it.priority_mask);
-		f << stringf("\n");
+		f << '\n';
 	}
 }
 
 void RTLIL_BACKEND::dump_proc(std::ostream &f, std::string indent, const RTLIL::Process *proc)
 {
-	for (auto it = proc->attributes.begin(); it != proc->attributes.end(); ++it) {
-		f << stringf("%s" "attribute %s ", indent.c_str(), it->first.c_str());
-		dump_const(f, it->second);
-		f << stringf("\n");
-	}
-	f << stringf("%s" "process %s\n", indent.c_str(), proc->name.c_str());
+	dump_attributes(f, indent, proc->attributes);
+	f << indent << "process " << proc->name.c_str() << '\n';
 	dump_proc_case_body(f, indent + "  ", &proc->root_case);
 	for (auto it = proc->syncs.begin(); it != proc->syncs.end(); ++it)
 		dump_proc_sync(f, indent + "  ", *it);
-	f << stringf("%s" "end\n", indent.c_str());
+	f << indent << "end\n";
 }
 
 void RTLIL_BACKEND::dump_conn(std::ostream &f, std::string indent, const RTLIL::SigSpec &left, const RTLIL::SigSpec &right)
 {
-	f << stringf("%s" "connect ", indent.c_str());
+	f << indent << "connect ";
 	dump_sigspec(f, left);
-	f << stringf(" ");
+	f << ' ';
 	dump_sigspec(f, right);
-	f << stringf("\n");
+	f << '\n';
 }
 
 void RTLIL_BACKEND::dump_module(std::ostream &f, std::string indent, RTLIL::Module *module, RTLIL::Design *design, bool only_selected, bool flag_m, bool flag_n)
@@ -302,25 +285,21 @@ void RTLIL_BACKEND::dump_module(std::ostream &f, std::string indent, RTLIL::Modu
 
 	if (print_header)
 	{
-		for (auto it = module->attributes.begin(); it != module->attributes.end(); ++it) {
-			f << stringf("%s" "attribute %s ", indent.c_str(), it->first.c_str());
-			dump_const(f, it->second);
-			f << stringf("\n");
-		}
+		dump_attributes(f, indent, module->attributes);
 
-		f << stringf("%s" "module %s\n", indent.c_str(), module->name.c_str());
+		f << indent << "module " << module->name.c_str() << '\n';
 
 		if (!module->avail_parameters.empty()) {
 			if (only_selected)
-				f << stringf("\n");
+				f << '\n';
 			for (const auto &p : module->avail_parameters) {
 				const auto &it = module->parameter_default_values.find(p);
 				if (it == module->parameter_default_values.end()) {
-					f << stringf("%s" "  parameter %s\n", indent.c_str(), p.c_str());
+					f << indent << "  parameter " << p.c_str() << '\n';
 				} else {
-					f << stringf("%s" "  parameter %s ", indent.c_str(), p.c_str());
+					f << indent << "  parameter " << p.c_str() << ' ';
 					dump_const(f, it->second);
-					f << stringf("\n");
+					f << '\n';
 				}
 			}
 		}
@@ -328,32 +307,34 @@ void RTLIL_BACKEND::dump_module(std::ostream &f, std::string indent, RTLIL::Modu
 
 	if (print_body)
 	{
+		std::string body_indent = indent + "  ";
+
 		for (auto it : module->wires())
 			if (!only_selected || design->selected(module, it)) {
 				if (only_selected)
-					f << stringf("\n");
-				dump_wire(f, indent + "  ", it);
+					f << '\n';
+				dump_wire(f, body_indent, it);
 			}
 
 		for (auto it : module->memories)
 			if (!only_selected || design->selected(module, it.second)) {
 				if (only_selected)
-					f << stringf("\n");
-				dump_memory(f, indent + "  ", it.second);
+					f << '\n';
+				dump_memory(f, body_indent, it.second);
 			}
 
 		for (auto it : module->cells())
 			if (!only_selected || design->selected(module, it)) {
 				if (only_selected)
-					f << stringf("\n");
-				dump_cell(f, indent + "  ", it);
+					f << '\n';
+				dump_cell(f, body_indent, it);
 			}
 
 		for (auto it : module->processes)
 			if (!only_selected || design->selected(module, it.second)) {
 				if (only_selected)
-					f << stringf("\n");
-				dump_proc(f, indent + "  ", it.second);
+					f << '\n';
+				dump_proc(f, body_indent, it.second);
 			}
 
 		bool first_conn_line = true;
@@ -370,15 +351,15 @@ void RTLIL_BACKEND::dump_module(std::ostream &f, std::string indent, RTLIL::Modu
 			}
 			if (show_conn) {
 				if (only_selected && first_conn_line)
-					f << stringf("\n");
-				dump_conn(f, indent + "  ", it->first, it->second);
+					f << '\n';
+				dump_conn(f, body_indent, it->first, it->second);
 				first_conn_line = false;
 			}
 		}
 	}
 
 	if (print_header)
-		f << stringf("%s" "end\n", indent.c_str());
+		f << indent << "end\n";
 }
 
 void RTLIL_BACKEND::dump_design(std::ostream &f, RTLIL::Design *design, bool only_selected, bool flag_m, bool flag_n)
@@ -399,16 +380,31 @@ void RTLIL_BACKEND::dump_design(std::ostream &f, RTLIL::Design *design, bool onl
 
 	if (!only_selected || flag_m) {
 		if (only_selected)
-			f << stringf("\n");
-		f << stringf("autoidx %d\n", autoidx);
+			f << '\n';
+		f << "autoidx " << autoidx << '\n';
 	}
 
-	for (auto module : design->modules()) {
-		if (!only_selected || design->selected(module)) {
+	std::vector<RTLIL::Module*> modules;
+	for (auto module : design->modules())
+		if (!only_selected || design->selected(module))
+			modules.push_back(module);
+
+	// The modules are dumped into separate buffers in parallel, in batches
+	// of a few modules per thread, and each batch is written in module order
+	// before the next one is started.
+	int batch_size = 4 * yosys_thread_count(GetSize(modules));
+	for (int batch_begin = 0; batch_begin < GetSize(modules); batch_begin += batch_size)
+	{
+		int batch_end = std::min(batch_begin + batch_size, GetSize(modules));
+		std::vector<std::ostringstream> buffers(batch_end - batch_begin);
+		ThreadPool::run(GetSize(buffers), [&](int i) {
 			if (only_selected)
-				f << stringf("\n");
-			dump_module(f, "", module, design, only_selected, flag_m, flag_n);
-		}
+				buffers[i] << '\n';
+			dump_module(buffers[i], "", modules[batch_begin + i], design, only_selected, flag_m, flag_n);
+		}, yosys_thread_count(GetSize(buffers)));
+
+		for (auto &buffer : buffers)
+			f << buffer.str();
 	}
 
 	log_assert(init_autoidx == autoidx);
@@ -431,6 +427,12 @@ struct RTLILBackend : public Backend {
 		log("    -selected\n");
 		log("        only write selected parts of the design.\n");
 		log("\n");
+		log("    -binary\n");
+		log("        write a compact binary representation instead of text. This is much\n");
+		log("        faster to write and to read back with 'read_rtlil', e.g. for\n");
+		log("        checkpoints between the stages of a flow. The binary format is not\n");
+		log("        stable between yosys versions.\n");
+		log("\n");
 	}
 	void execute(std::ostream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -440,6 +442,7 @@ struct RTLILBackend : public Backend {
 		}
 
 		bool selected = false;
+		bool binary = false;
 
 		log_header(design, "Executing RTLIL backend.\n");
 
@@ -450,13 +453,23 @@ struct RTLILBackend : public Backend {
 				selected = true;
 				continue;
 			}
+			if (arg == "-binary") {
+				binary = true;
+				continue;
+			}
 			break;
 		}
-		extra_args(f, filename, args, argidx);
+		if (selected && binary)
+			log_cmd_error("Options -selected and -binary are exclusive.\n");
+		extra_args(f, filename, args, argidx, binary);
 
 		design->sort();
 
 		log("Output filename: %s\n", filename.c_str());
+		if (binary) {
+			RTLIL_BACKEND::dump_design_binary(*f, design);
+			return;
+		}
 		*f << stringf("# Generated by %s\n", yosys_version_str);
 		RTLIL_BACKEND::dump_design(*f, design, selected, true, false);
 	}
@@ -30,6 +30,10 @@
 
 YOSYS_NAMESPACE_BEGIN
 
+// see rtlil_binary.cc for a description of the binary format
+#define RTLIL_BINARY_MAGIC "\x89RTLIL\r\n"
+#define RTLIL_BINARY_VERSION 1
+
 namespace RTLIL_BACKEND {
 	void dump_const(std::ostream &f, const RTLIL::Const &data, int width = -1, int offset = 0, bool autoint = true);
 	void dump_sigchunk(std::ostream &f, const RTLIL::SigChunk &chunk, bool autoint = true, bool no_space = false);
@@ -44,6 +48,7 @@ namespace RTLIL_BACKEND {
 	void dump_conn(std::ostream &f, std::string indent, const RTLIL::SigSpec &left, const RTLIL::SigSpec &right);
 	void dump_module(std::ostream &f, std::string indent, RTLIL::Module *module, RTLIL::Design *design, bool only_selected, bool flag_m = true, bool flag_n = false);
 	void dump_design(std::ostream &f, RTLIL::Design *design, bool only_selected, bool flag_m = true, bool flag_n = false);
+	void dump_design_binary(std::ostream &f, RTLIL::Design *design);
 }
 
 YOSYS_NAMESPACE_END
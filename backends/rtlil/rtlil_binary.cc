@@ -0,0 +1,294 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ *  ---
+ *
+ *  A binary representation of RTLIL for fast checkpoints. All integers are
+ *  LEB128 varints, signed integers are zigzag coded. The file consists of:
+ *
+ *    magic "\x89RTLIL\r\n", version, autoidx
+ *    string table: count, then length and bytes of each string
+ *    module directory: count, then name and section size of each module
+ *    module sections, in the order of the directory
+ *
+ *  Names are indices into the string table, so that a module section can be
+ *  decoded (or skipped) without looking at the other sections. Constants are
+ *  coded as number of bits times two plus a mode bit, followed by the bits
+ *  packed eight per byte (mode 0, only 0 and 1 bits) or one byte per bit
+ *  (mode 1). Signals are lists of chunks, each either a wire index plus one,
+ *  offset and width, or zero followed by a constant.
+ *
+ */
+
+#include "rtlil_backend.h"
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+namespace {
+
+// hashlib containers iterate in reverse insertion order, the entries are
+// written in insertion order so that the reader recreates the same order
+template<typename T>
+std::vector<typename T::const_iterator> in_order(const T &container)
+{
+	std::vector<typename T::const_iterator> result;
+	for (auto it = container.begin(); it != container.end(); ++it)
+		result.push_back(it);
+	std::reverse(result.begin(), result.end());
+	return result;
+}
+
+struct BinaryWriter
+{
+	dict<int, int> string_index;
+	vector<RTLIL::IdString> strings;
+
+	std::string buf;
+	dict<const RTLIL::Wire*, int> wire_index;
+
+	void put_uint(uint64_t value)
+	{
+		while (value >= 0x80) {
+			buf += char(value | 0x80);
+			value >>= 7;
+		}
+		buf += char(value);
+	}
+
+	void put_int(int64_t value)
+	{
+		put_uint(value < 0 ? ~(uint64_t(value) << 1) : uint64_t(value) << 1);
+	}
+
+	void put_id(RTLIL::IdString id)
+	{
+		auto it = string_index.find(id.index_);
+		if (it == string_index.end()) {
+			it = string_index.emplace(id.index_, GetSize(strings)).first;
+			strings.push_back(id);
+		}
+		put_uint(it->second);
+	}
+
+	void put_bits(const std::vector<RTLIL::State> &bits)
+	{
+		bool binary = true;
+		for (auto bit : bits)
+			if (bit != RTLIL::S0 && bit != RTLIL::S1) {
+				binary = false;
+				break;
+			}
+
+		put_uint(uint64_t(bits.size()) * 2 + (binary ? 0 : 1));
+		if (binary) {
+			for (size_t i = 0; i < bits.size(); i += 8) {
+				unsigned char byte = 0;
+				for (size_t j = i; j < i + 8 && j < bits.size(); j++)
+					if (bits[j] == RTLIL::S1)
+						byte |= 1 << (j - i);
+				buf += char(byte);
+			}
+		} else {
+			for (auto bit : bits)
+				buf += char(bit);
+		}
+	}
+
+	void put_const(const RTLIL::Const &value)
+	{
+		put_uint(value.flags);
+		put_bits(value.bits);
+	}
+
+	void put_sig(const RTLIL::SigSpec &sig)
+	{
+		put_uint(sig.chunks().size());
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire) {
+				put_uint(wire_index.at(chunk.wire) + 1);
+				put_uint(chunk.offset);
+				put_uint(chunk.width);
+			} else {
+				put_uint(0);
+				put_bits(chunk.data);
+			}
+		}
+	}
+
+	void put_attrs(const RTLIL::AttrObject *obj)
+	{
+		put_uint(obj->attributes.size());
+		for (auto it : in_order(obj->attributes)) {
+			put_id(it->first);
+			put_const(it->second);
+		}
+	}
+
+	void put_actions(const std::vector<RTLIL::SigSig> &actions)
+	{
+		put_uint(actions.size());
+		for (auto &it : actions) {
+			put_sig(it.first);
+			put_sig(it.second);
+		}
+	}
+
+	void put_case(const RTLIL::CaseRule *cs)
+	{
+		put_attrs(cs);
+		put_uint(cs->compare.size());
+		for (auto &sig : cs->compare)
+			put_sig(sig);
+		put_actions(cs->actions);
+		put_uint(cs->switches.size());
+		for (auto sw : cs->switches) {
+			put_attrs(sw);
+			put_sig(sw->signal);
+			put_uint(sw->cases.size());
+			for (auto child : sw->cases)
+				put_case(child);
+		}
+	}
+
+	void put_module(RTLIL::Module *module)
+	{
+		buf.clear();
+		wire_index.clear();
+
+		put_attrs(module);
+
+		put_uint(module->avail_parameters.size());
+		for (auto param : module->avail_parameters) {
+			put_id(param);
+			auto it = module->parameter_default_values.find(param);
+			if (it == module->parameter_default_values.end()) {
+				put_uint(0);
+			} else {
+				put_uint(1);
+				put_const(it->second);
+			}
+		}
+
+		put_uint(module->wires_.size());
+		for (auto it : in_order(module->wires_)) {
+			RTLIL::Wire *wire = it->second;
+			wire_index.emplace(wire, GetSize(wire_index));
+			put_id(wire->name);
+			put_attrs(wire);
+			put_uint(wire->width);
+			put_int(wire->start_offset);
+			put_uint(wire->port_id);
+			put_uint((wire->port_input ? 1 : 0) | (wire->port_output ? 2 : 0) | (wire->upto ? 4 : 0) | (wire->is_signed ? 8 : 0));
+		}
+
+		put_uint(module->memories.size());
+		for (auto it : in_order(module->memories)) {
+			RTLIL::Memory *memory = it->second;
+			put_id(memory->name);
+			put_attrs(memory);
+			put_uint(memory->width);
+			put_int(memory->start_offset);
+			put_uint(memory->size);
+		}
+
+		put_uint(module->cells_.size());
+		for (auto cell_it : in_order(module->cells_)) {
+			RTLIL::Cell *cell = cell_it->second;
+			put_id(cell->name);
+			put_id(cell->type);
+			put_attrs(cell);
+			put_uint(cell->parameters.size());
+			for (auto it : in_order(cell->parameters)) {
+				put_id(it->first);
+				put_const(it->second);
+			}
+			put_uint(cell->connections().size());
+			for (auto it : in_order(cell->connections())) {
+				put_id(it->first);
+				put_sig(it->second);
+			}
+		}
+
+		put_uint(module->processes.size());
+		for (auto it : in_order(module->processes)) {
+			RTLIL::Process *proc = it->second;
+			put_id(proc->name);
+			put_attrs(proc);
+			put_case(&proc->root_case);
+			put_uint(proc->syncs.size());
+			for (auto sync : proc->syncs) {
+				put_uint(sync->type);
+				put_sig(sync->signal);
+				put_actions(sync->actions);
+				put_uint(sync->mem_write_actions.size());
+				for (auto &act : sync->mem_write_actions) {
+					put_attrs(&act);
+					put_id(act.memid);
+					put_sig(act.address);
+					put_sig(act.data);
+					put_sig(act.enable);
+					put_const(act.priority_mask);
+				}
+			}
+		}
+
+		put_actions(module->connections());
+	}
+};
+
+} // namespace
+
+void RTLIL_BACKEND::dump_design_binary(std::ostream &f, RTLIL::Design *design)
+{
+	BinaryWriter writer;
+	vector<RTLIL::Module*> modules;
+	vector<std::string> sections;
+
+	design->load_lazy();
+	for (auto it : in_order(design->modules_))
+		modules.push_back(it->second);
+
+	for (auto module : modules) {
+		writer.put_id(module->name);
+		writer.put_module(module);
+		sections.push_back(std::move(writer.buf));
+	}
+
+	writer.buf.clear();
+	writer.buf.append(RTLIL_BINARY_MAGIC, strlen(RTLIL_BINARY_MAGIC));
+	writer.put_uint(RTLIL_BINARY_VERSION);
+	writer.put_uint(autoidx);
+
+	writer.put_uint(writer.strings.size());
+	for (auto &id : writer.strings) {
+		writer.put_uint(strlen(id.c_str()));
+		writer.buf += id.c_str();
+	}
+
+	writer.put_uint(modules.size());
+	for (int i = 0; i < GetSize(modules); i++) {
+		writer.put_uint(writer.string_index.at(modules[i]->name.index_));
+		writer.put_uint(sections[i].size());
+	}
+
+	f.write(writer.buf.data(), writer.buf.size());
+	for (auto &section : sections)
+		f.write(section.data(), section.size());
+}
+
+YOSYS_NAMESPACE_END
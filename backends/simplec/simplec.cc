@@ -20,6 +20,7 @@
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
 #include "kernel/utils.h"
+#include "kernel/netgraph.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -316,28 +317,52 @@ struct SimplecWorker
 				create_module_struct(design->module(c->type));
 		}
 
-		TopoSort<IdString> topo;
-
-		for (Cell *c : mod->cells())
-		{
-			topo.node(c->name);
+		// The cells are ordered by the strongly connected components of a
+		// graph that links each cell to the other cells reading one of its
+		// input bits. The cells are nodes 0..N-1 and the links go through
+		// a node per input bit, so that a bit with many readers doesn't
+		// need an edge for each pair of them.
+		NetGraph graph;
+		vector<Cell*> cells;
+		dict<Cell*, int> cell_nodes;
+		dict<SigBit, int> bit_nodes;
+
+		for (Cell *c : mod->cells()) {
+			cell_nodes[c] = graph.add_node();
+			cells.push_back(c);
+		}
 
-			for (auto &conn : c->connections())
+		for (int i = 0; i < GetSize(cells); i++)
+			for (auto &conn : cells[i]->connections())
 			{
-				if (!c->input(conn.first))
+				if (!cells[i]->input(conn.first))
 					continue;
 
-				for (auto bit : sigmaps.at(mod)(conn.second))
-				for (auto &it : bit2cell[mod][bit])
-					topo.edge(c->name, std::get<0>(it)->name);
+				for (auto bit : sigmaps.at(mod)(conn.second)) {
+					auto it = bit_nodes.find(bit);
+					if (it == bit_nodes.end()) {
+						int bit_node = graph.add_node();
+						it = bit_nodes.emplace(bit, bit_node).first;
+						for (auto &port : bit2cell[mod][bit])
+							graph.add_edge(bit_node, cell_nodes.at(std::get<0>(port)));
+					}
+					graph.add_edge(i, it->second);
+				}
 			}
-		}
-
-		topo.analyze_loops = false;
-		topo.sort();
 
-		for (int i = 0; i < GetSize(topo.sorted); i++)
-			topoidx[mod->cell(topo.sorted[i])] = i;
+		graph.build();
+		vector<int> component;
+		int num_components = graph.scc(component);
+
+		// components in topological order, and the cells of a component in
+		// module order
+		vector<vector<int>> component_cells(num_components);
+		for (int i = 0; i < GetSize(cells); i++)
+			component_cells[num_components - 1 - component[i]].push_back(i);
+		int idx = 0;
+		for (auto &members : component_cells)
+			for (int i : members)
+				topoidx[cells[i]] = idx++;
 
 		string ifdef_name = stringf("yosys_simplec_%s_state_t", cid(mod->name).c_str());
 
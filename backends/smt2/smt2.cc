@@ -54,7 +54,15 @@ struct Smt2Worker
 	std::map<int, int> bvsizes;
 	dict<IdString, char*> ids;
 
-	bool is_smtlib2_module;
+	// sort and body of every define-fun for a cell output, so that cells
+	// computing the same expression share a single function
+	dict<std::string, RTLIL::SigSpec> expr_cache;
+
+	// when set, decls are written to this stream as soon as possible
+	// instead of being kept until write() is called
+	std::ostream *stream = nullptr;
+
+	bool is_smtlib2_module, coimode = false;
 
 	const char *get_id(IdString n)
 	{
@@ -325,6 +333,41 @@ struct Smt2Worker
 			sigmap.add(sig[i], RTLIL::State::S0);
 	}
 
+	// If an earlier cell output was defined by the same expression, the bits
+	// of sig are mapped to its function and true is returned. Otherwise the
+	// expression is remembered for sig and the caller must define it.
+	bool reuse_expr(const std::string &sort, const std::string &expr, RTLIL::SigSpec sig, bool boolvec = false)
+	{
+		std::string key = sort + " " + expr;
+		auto it = expr_cache.find(key);
+		if (it == expr_cache.end()) {
+			expr_cache[key] = sig;
+			return false;
+		}
+
+		if (verbose) log("%*s-> reuse expression: %s %s\n", 2+2*GetSize(recursive_cells), "",
+				log_signal(sig), log_signal(it->second));
+
+		sigmap.apply(sig);
+		int width = boolvec ? 1 : GetSize(sig);
+		for (int i = 0; i < width; i++) {
+			log_assert(fcache.count(sig[i]) == 0);
+			fcache[sig[i]] = fcache.at(it->second[i]);
+		}
+		for (int i = width; i < GetSize(sig); i++)
+			sigmap.add(sig[i], RTLIL::State::S0);
+		return true;
+	}
+
+	void flush_decls()
+	{
+		if (stream == nullptr)
+			return;
+		for (auto &it : decls)
+			*stream << it;
+		decls.clear();
+	}
+
 	std::string get_bool(RTLIL::SigBit bit, const char *state_name = "state")
 	{
 		sigmap.apply(bit);
@@ -448,9 +491,11 @@ struct Smt2Worker
 		if (verbose)
 			log("%*s-> import cell: %s\n", 2+2*GetSize(recursive_cells), "", log_id(cell));
 
-		decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
-				get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(bit)));
-		register_bool(bit, idcounter++);
+		if (!reuse_expr("Bool", processed_expr, bit)) {
+			decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
+					get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(bit)));
+			register_bool(bit, idcounter++);
+		}
 		recursive_cells.erase(cell);
 	}
 
@@ -499,13 +544,17 @@ struct Smt2Worker
 			log("%*s-> import cell: %s\n", 2+2*GetSize(recursive_cells), "", log_id(cell));
 
 		if (type == 'b') {
-			decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
-					get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(sig_y)));
-			register_boolvec(sig_y, idcounter++);
+			if (!reuse_expr("Bool", processed_expr, sig_y, true)) {
+				decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
+						get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(sig_y)));
+				register_boolvec(sig_y, idcounter++);
+			}
 		} else {
-			decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) (_ BitVec %d) %s) ; %s\n",
-					get_id(module), idcounter, get_id(module), GetSize(sig_y), processed_expr.c_str(), log_signal(sig_y)));
-			register_bv(sig_y, idcounter++);
+			if (!reuse_expr(stringf("(_ BitVec %d)", GetSize(sig_y)), processed_expr, sig_y)) {
+				decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) (_ BitVec %d) %s) ; %s\n",
+						get_id(module), idcounter, get_id(module), GetSize(sig_y), processed_expr.c_str(), log_signal(sig_y)));
+				register_bv(sig_y, idcounter++);
+			}
 		}
 
 		recursive_cells.erase(cell);
@@ -529,9 +578,11 @@ struct Smt2Worker
 		if (verbose)
 			log("%*s-> import cell: %s\n", 2+2*GetSize(recursive_cells), "", log_id(cell));
 
-		decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
-				get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(sig_y)));
-		register_boolvec(sig_y, idcounter++);
+		if (!reuse_expr("Bool", processed_expr, sig_y, true)) {
+			decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) Bool %s) ; %s\n",
+					get_id(module), idcounter, get_id(module), processed_expr.c_str(), log_signal(sig_y)));
+			register_boolvec(sig_y, idcounter++);
+		}
 		recursive_cells.erase(cell);
 	}
 
@@ -751,9 +802,11 @@ struct Smt2Worker
 					log("%*s-> import cell: %s\n", 2+2*GetSize(recursive_cells), "", log_id(cell));
 
 				RTLIL::SigSpec sig = sigmap(cell->getPort(ID::Y));
-				decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) (_ BitVec %d) %s) ; %s\n",
-						get_id(module), idcounter, get_id(module), width, processed_expr.c_str(), log_signal(sig)));
-				register_bv(sig, idcounter++);
+				if (!reuse_expr(stringf("(_ BitVec %d)", width), processed_expr, sig)) {
+					decls.push_back(stringf("(define-fun |%s#%d| ((state |%s_s|)) (_ BitVec %d) %s) ; %s\n",
+							get_id(module), idcounter, get_id(module), width, processed_expr.c_str(), log_signal(sig)));
+					register_bv(sig, idcounter++);
+				}
 				recursive_cells.erase(cell);
 				return;
 			}
@@ -954,6 +1007,11 @@ struct Smt2Worker
 
 	void run()
 	{
+		if (stream != nullptr) {
+			write_header(*stream);
+			flush_decls();
+		}
+
 		if (verbose) log("=> export logic driving outputs\n");
 
 		if (is_smtlib2_module)
@@ -977,126 +1035,155 @@ struct Smt2Worker
 			}
 		}
 
-		for (auto wire : module->wires()) {
-			bool is_register = false;
-			bool contains_clock = false;
-			for (auto bit : SigSpec(wire)) {
-				if (reg_bits.count(bit))
-					is_register = true;
-				auto sig_bit = sigmap(bit);
-				if (clock_posedge.count(sig_bit) || clock_negedge.count(sig_bit))
-					contains_clock = true;
-			}
-			bool is_smtlib2_comb_expr = wire->has_attribute(ID::smtlib2_comb_expr);
-			if (is_smtlib2_comb_expr && !is_smtlib2_module)
-				log_error("smtlib2_comb_expr is only valid in a module with the smtlib2_module attribute: wire %s.%s", log_id(module),
-					  log_id(wire));
-			if (wire->port_id || is_register || contains_clock || wire->get_bool_attribute(ID::keep) || (wiresmode && wire->name.isPublic())) {
-				RTLIL::SigSpec sig = sigmap(wire);
-				std::vector<std::string> comments;
-				if (wire->port_input)
-					comments.push_back(stringf("; yosys-smt2-input %s %d\n", get_id(wire), wire->width));
-				if (wire->port_output)
-					comments.push_back(stringf("; yosys-smt2-output %s %d\n", get_id(wire), wire->width));
-				if (is_register)
-					comments.push_back(stringf("; yosys-smt2-register %s %d\n", get_id(wire), wire->width));
-				if (wire->get_bool_attribute(ID::keep) || (wiresmode && wire->name.isPublic()))
-					comments.push_back(stringf("; yosys-smt2-wire %s %d\n", get_id(wire), wire->width));
-				if (contains_clock && GetSize(wire) == 1 && (clock_posedge.count(sig) || clock_negedge.count(sig)))
-					comments.push_back(stringf("; yosys-smt2-clock %s%s%s\n", get_id(wire),
-							clock_posedge.count(sig) ? " posedge" : "", clock_negedge.count(sig) ? " negedge" : ""));
-				if (wire->port_input && contains_clock) {
-					for (int i = 0; i < GetSize(sig); i++) {
-						bool is_posedge = clock_posedge.count(sig[i]);
-						bool is_negedge = clock_negedge.count(sig[i]);
-						if (is_posedge != is_negedge)
-							comments.push_back(witness_signal(
-									is_posedge ? "posedge" : "negedge", 1, i, get_id(wire), -1, wire));
-					}
-				}
-				if (wire->port_input)
-					comments.push_back(witness_signal("input", wire->width, 0, get_id(wire), -1, wire));
-				std::string smtlib2_comb_expr;
-				if (is_smtlib2_comb_expr) {
-					smtlib2_comb_expr =
-					  "(let (\n" + smtlib2_inputs + ")\n" + wire->get_string_attribute(ID::smtlib2_comb_expr) + "\n)";
-					if (wire->port_input || !wire->port_output)
-						log_error("smtlib2_comb_expr is only valid on output: wire %s.%s", log_id(module), log_id(wire));
-					if (!bvmode && GetSize(sig) > 1)
-						log_error("smtlib2_comb_expr is unsupported on multi-bit wires when -nobv is specified: wire %s.%s",
-							  log_id(module), log_id(wire));
-
-					comments.push_back(witness_signal("blackbox", wire->width, 0, get_id(wire), -1, wire));
+		// In -coi mode the wires are exported after all the logic in the cone
+		// of influence of the properties, and only if that logic drives them.
+		pool<SigBit> input_bits;
+		for (auto wire : module->wires())
+			if (wire->port_input)
+				for (auto bit : sigmap(wire))
+					if (!bit_driver.count(bit))
+						input_bits.insert(bit);
+
+		auto in_coi = [&](RTLIL::Wire *wire) {
+			if (wire->port_input)
+				return true;
+			for (auto bit : sigmap(wire))
+				if (bit.wire != nullptr && !fcache.count(bit) && !input_bits.count(bit))
+					return false;
+			return true;
+		};
+
+		auto export_wires = [&]() {
+			for (auto wire : module->wires()) {
+				if (coimode && !in_coi(wire))
+					continue;
+				bool is_register = false;
+				bool contains_clock = false;
+				for (auto bit : SigSpec(wire)) {
+					if (reg_bits.count(bit))
+						is_register = true;
+					auto sig_bit = sigmap(bit);
+					if (clock_posedge.count(sig_bit) || clock_negedge.count(sig_bit))
+						contains_clock = true;
 				}
-				auto &out_decls = is_smtlib2_comb_expr ? smtlib2_decls : decls;
-				if (bvmode && GetSize(sig) > 1) {
-					std::string sig_bv = is_smtlib2_comb_expr ? smtlib2_comb_expr : get_bv(sig);
-					if (!comments.empty())
-						out_decls.insert(out_decls.end(), comments.begin(), comments.end());
-					out_decls.push_back(stringf("(define-fun |%s_n %s| ((state |%s_s|)) (_ BitVec %d) %s)\n",
-							get_id(module), get_id(wire), get_id(module), GetSize(sig), sig_bv.c_str()));
+				bool is_smtlib2_comb_expr = wire->has_attribute(ID::smtlib2_comb_expr);
+				if (is_smtlib2_comb_expr && !is_smtlib2_module)
+					log_error("smtlib2_comb_expr is only valid in a module with the smtlib2_module attribute: wire %s.%s", log_id(module),
+						  log_id(wire));
+				if (wire->port_id || is_register || contains_clock || wire->get_bool_attribute(ID::keep) || (wiresmode && wire->name.isPublic())) {
+					RTLIL::SigSpec sig = sigmap(wire);
+					std::vector<std::string> comments;
 					if (wire->port_input)
-						ex_input_eq.push_back(stringf("  (= (|%s_n %s| state) (|%s_n %s| other_state))",
-								get_id(module), get_id(wire), get_id(module), get_id(wire)));
-				} else {
-					std::vector<std::string> sig_bool;
-					for (int i = 0; i < GetSize(sig); i++) {
-						sig_bool.push_back(is_smtlib2_comb_expr ? smtlib2_comb_expr : get_bool(sig[i]));
+						comments.push_back(stringf("; yosys-smt2-input %s %d\n", get_id(wire), wire->width));
+					if (wire->port_output)
+						comments.push_back(stringf("; yosys-smt2-output %s %d\n", get_id(wire), wire->width));
+					if (is_register)
+						comments.push_back(stringf("; yosys-smt2-register %s %d\n", get_id(wire), wire->width));
+					if (wire->get_bool_attribute(ID::keep) || (wiresmode && wire->name.isPublic()))
+						comments.push_back(stringf("; yosys-smt2-wire %s %d\n", get_id(wire), wire->width));
+					if (contains_clock && GetSize(wire) == 1 && (clock_posedge.count(sig) || clock_negedge.count(sig)))
+						comments.push_back(stringf("; yosys-smt2-clock %s%s%s\n", get_id(wire),
+								clock_posedge.count(sig) ? " posedge" : "", clock_negedge.count(sig) ? " negedge" : ""));
+					if (wire->port_input && contains_clock) {
+						for (int i = 0; i < GetSize(sig); i++) {
+							bool is_posedge = clock_posedge.count(sig[i]);
+							bool is_negedge = clock_negedge.count(sig[i]);
+							if (is_posedge != is_negedge)
+								comments.push_back(witness_signal(
+										is_posedge ? "posedge" : "negedge", 1, i, get_id(wire), -1, wire));
+						}
 					}
-					if (!comments.empty())
-						out_decls.insert(out_decls.end(), comments.begin(), comments.end());
-					for (int i = 0; i < GetSize(sig); i++) {
-						if (GetSize(sig) > 1) {
-							out_decls.push_back(stringf("(define-fun |%s_n %s %d| ((state |%s_s|)) Bool %s)\n",
-									get_id(module), get_id(wire), i, get_id(module), sig_bool[i].c_str()));
-							if (wire->port_input)
-								ex_input_eq.push_back(stringf("  (= (|%s_n %s %d| state) (|%s_n %s %d| other_state))",
-										get_id(module), get_id(wire), i, get_id(module), get_id(wire), i));
-						} else {
-							out_decls.push_back(stringf("(define-fun |%s_n %s| ((state |%s_s|)) Bool %s)\n",
-									get_id(module), get_id(wire), get_id(module), sig_bool[i].c_str()));
-							if (wire->port_input)
-								ex_input_eq.push_back(stringf("  (= (|%s_n %s| state) (|%s_n %s| other_state))",
-										get_id(module), get_id(wire), get_id(module), get_id(wire)));
+					if (wire->port_input)
+						comments.push_back(witness_signal("input", wire->width, 0, get_id(wire), -1, wire));
+					std::string smtlib2_comb_expr;
+					if (is_smtlib2_comb_expr) {
+						smtlib2_comb_expr =
+						  "(let (\n" + smtlib2_inputs + ")\n" + wire->get_string_attribute(ID::smtlib2_comb_expr) + "\n)";
+						if (wire->port_input || !wire->port_output)
+							log_error("smtlib2_comb_expr is only valid on output: wire %s.%s", log_id(module), log_id(wire));
+						if (!bvmode && GetSize(sig) > 1)
+							log_error("smtlib2_comb_expr is unsupported on multi-bit wires when -nobv is specified: wire %s.%s",
+								  log_id(module), log_id(wire));
+
+						comments.push_back(witness_signal("blackbox", wire->width, 0, get_id(wire), -1, wire));
+					}
+					auto &out_decls = is_smtlib2_comb_expr ? smtlib2_decls : decls;
+					if (bvmode && GetSize(sig) > 1) {
+						std::string sig_bv = is_smtlib2_comb_expr ? smtlib2_comb_expr : get_bv(sig);
+						if (!comments.empty())
+							out_decls.insert(out_decls.end(), comments.begin(), comments.end());
+						out_decls.push_back(stringf("(define-fun |%s_n %s| ((state |%s_s|)) (_ BitVec %d) %s)\n",
+								get_id(module), get_id(wire), get_id(module), GetSize(sig), sig_bv.c_str()));
+						if (wire->port_input)
+							ex_input_eq.push_back(stringf("  (= (|%s_n %s| state) (|%s_n %s| other_state))",
+									get_id(module), get_id(wire), get_id(module), get_id(wire)));
+					} else {
+						std::vector<std::string> sig_bool;
+						for (int i = 0; i < GetSize(sig); i++) {
+							sig_bool.push_back(is_smtlib2_comb_expr ? smtlib2_comb_expr : get_bool(sig[i]));
+						}
+						if (!comments.empty())
+							out_decls.insert(out_decls.end(), comments.begin(), comments.end());
+						for (int i = 0; i < GetSize(sig); i++) {
+							if (GetSize(sig) > 1) {
+								out_decls.push_back(stringf("(define-fun |%s_n %s %d| ((state |%s_s|)) Bool %s)\n",
+										get_id(module), get_id(wire), i, get_id(module), sig_bool[i].c_str()));
+								if (wire->port_input)
+									ex_input_eq.push_back(stringf("  (= (|%s_n %s %d| state) (|%s_n %s %d| other_state))",
+											get_id(module), get_id(wire), i, get_id(module), get_id(wire), i));
+							} else {
+								out_decls.push_back(stringf("(define-fun |%s_n %s| ((state |%s_s|)) Bool %s)\n",
+										get_id(module), get_id(wire), get_id(module), sig_bool[i].c_str()));
+								if (wire->port_input)
+									ex_input_eq.push_back(stringf("  (= (|%s_n %s| state) (|%s_n %s| other_state))",
+											get_id(module), get_id(wire), get_id(module), get_id(wire)));
+							}
 						}
 					}
 				}
+				flush_decls();
 			}
-		}
-
-		decls.insert(decls.end(), smtlib2_decls.begin(), smtlib2_decls.end());
 
-		if (verbose) log("=> export logic associated with the initial state\n");
+			decls.insert(decls.end(), smtlib2_decls.begin(), smtlib2_decls.end());
+		};
 
 		vector<string> init_list;
-		for (auto wire : module->wires())
-			if (wire->attributes.count(ID::init)) {
-				if (is_smtlib2_module)
-					log_error("init attribute not allowed on wires in module with smtlib2_module attribute: wire %s.%s",
-						  log_id(module), log_id(wire));
-
-				RTLIL::SigSpec sig = sigmap(wire);
-				Const val = wire->attributes.at(ID::init);
-				val.bits.resize(GetSize(sig), State::Sx);
-				if (bvmode && GetSize(sig) > 1) {
-					Const mask(State::S1, GetSize(sig));
-					bool use_mask = false;
-					for (int i = 0; i < GetSize(sig); i++)
-						if (val[i] != State::S0 && val[i] != State::S1) {
-							val[i] = State::S0;
-							mask[i] = State::S0;
-							use_mask = true;
-						}
-					if (use_mask)
-						init_list.push_back(stringf("(= (bvand %s #b%s) #b%s) ; %s", get_bv(sig).c_str(), mask.as_string().c_str(), val.as_string().c_str(), get_id(wire)));
-					else
-						init_list.push_back(stringf("(= %s #b%s) ; %s", get_bv(sig).c_str(), val.as_string().c_str(), get_id(wire)));
-				} else {
-					for (int i = 0; i < GetSize(sig); i++)
-						if (val[i] == State::S0 || val[i] == State::S1)
-							init_list.push_back(stringf("(= %s %s) ; %s", get_bool(sig[i]).c_str(), val[i] == State::S1 ? "true" : "false", get_id(wire)));
+		auto export_init = [&]() {
+			if (verbose) log("=> export logic associated with the initial state\n");
+			for (auto wire : module->wires())
+				if (wire->attributes.count(ID::init) && (!coimode || in_coi(wire))) {
+					if (is_smtlib2_module)
+						log_error("init attribute not allowed on wires in module with smtlib2_module attribute: wire %s.%s",
+							  log_id(module), log_id(wire));
+
+					RTLIL::SigSpec sig = sigmap(wire);
+					Const val = wire->attributes.at(ID::init);
+					val.bits.resize(GetSize(sig), State::Sx);
+					if (bvmode && GetSize(sig) > 1) {
+						Const mask(State::S1, GetSize(sig));
+						bool use_mask = false;
+						for (int i = 0; i < GetSize(sig); i++)
+							if (val[i] != State::S0 && val[i] != State::S1) {
+								val[i] = State::S0;
+								mask[i] = State::S0;
+								use_mask = true;
+							}
+						if (use_mask)
+							init_list.push_back(stringf("(= (bvand %s #b%s) #b%s) ; %s", get_bv(sig).c_str(), mask.as_string().c_str(), val.as_string().c_str(), get_id(wire)));
+						else
+							init_list.push_back(stringf("(= %s #b%s) ; %s", get_bv(sig).c_str(), val.as_string().c_str(), get_id(wire)));
+					} else {
+						for (int i = 0; i < GetSize(sig); i++)
+							if (val[i] == State::S0 || val[i] == State::S1)
+								init_list.push_back(stringf("(= %s %s) ; %s", get_bool(sig[i]).c_str(), val[i] == State::S1 ? "true" : "false", get_id(wire)));
+					}
 				}
-			}
+		};
+
+		if (!coimode) {
+			export_wires();
+			export_init();
+		}
 
 		if (verbose) log("=> export logic driving asserts\n");
 
@@ -1135,6 +1222,7 @@ struct Smt2Worker
 					assume_list.push_back(stringf("(|%s_u %d| state)", get_id(module), id));
 
 				id++;
+				flush_decls();
 			}
 		}
 
@@ -1211,6 +1299,8 @@ struct Smt2Worker
 					if (cell->type == ID($anyconst))
 						ex_state_eq.push_back(stringf("(= %s %s)", get_bv(cell->getPort(ID::Y)).c_str(), get_bv(cell->getPort(ID::Y), "other_state").c_str()));
 				}
+
+				flush_decls();
 			}
 
 			std::set<Mem*> this_mems;
@@ -1368,6 +1458,13 @@ struct Smt2Worker
 			}
 		}
 
+		if (coimode) {
+			export_wires();
+			export_init();
+			log("Exported %d of %d cells in the cone of influence of the properties.\n",
+					GetSize(exported_cells), GetSize(module->cells()));
+		}
+
 		if (verbose) log("=> finalizing SMT2 representation of %s.\n", log_id(module));
 
 		for (auto c : hiercells) {
@@ -1450,7 +1547,7 @@ struct Smt2Worker
 				get_id(module), get_id(module), init_expr.c_str()));
 	}
 
-	void write(std::ostream &f)
+	void write_header(std::ostream &f)
 	{
 		f << stringf("; yosys-smt2-module %s\n", get_id(module));
 
@@ -1465,8 +1562,14 @@ struct Smt2Worker
 			f << stringf(")))\n");
 		} else
 			f << stringf("(declare-sort |%s_s| 0)\n", get_id(module));
+	}
 
-		for (auto it : decls)
+	void write(std::ostream &f)
+	{
+		if (stream == nullptr)
+			write_header(f);
+
+		for (auto &it : decls)
 			f << it;
 
 		f << stringf("(define-fun |%s_h| ((state |%s_s|)) Bool ", get_id(module), get_id(module));
@@ -1686,6 +1789,12 @@ struct Smt2Backend : public Backend {
 		log("        create '<mod>_n' functions for all public wires. by default only ports,\n");
 		log("        registers, and wires with the 'keep' attribute are exported.\n");
 		log("\n");
+		log("    -coi\n");
+		log("        in modules that are not instantiated by other modules, only export the\n");
+		log("        logic in the cone of influence of the $assert, $assume and $cover\n");
+		log("        cells and of submodule instances. input ports are always exported,\n");
+		log("        other ports, registers and wires only when they are in that cone.\n");
+		log("\n");
 		log("    -tpl <template_file>\n");
 		log("        use the given template file. the line containing only the token '%%%%'\n");
 		log("        is replaced with the regular output of this command.\n");
@@ -1752,7 +1861,7 @@ struct Smt2Backend : public Backend {
 
 		std::ifstream template_f;
 		bool bvmode = true, memmode = true, wiresmode = false, verbose = false, statebv = false, statedt = false;
-		bool forallmode = false;
+		bool forallmode = false, coimode = false;
 		dict<std::string, std::string> solver_options;
 
 		log_header(design, "Executing SMT2 backend.\n");
@@ -1802,6 +1911,10 @@ struct Smt2Backend : public Backend {
 				verbose = true;
 				continue;
 			}
+			if (args[argidx] == "-coi") {
+				coimode = true;
+				continue;
+			}
 			if (args[argidx] == "-solver-option" && argidx+2 < args.size()) {
 				solver_options.emplace(args[argidx+1], args[argidx+2]);
 				argidx += 2;
@@ -1844,11 +1957,14 @@ struct Smt2Backend : public Backend {
 
 		// extract module dependencies
 		std::map<RTLIL::Module*, std::set<RTLIL::Module*>> module_deps;
+		pool<RTLIL::Module*> instantiated_modules;
 		for (auto mod : design->modules()) {
 			module_deps[mod] = std::set<RTLIL::Module*>();
 			for (auto cell : mod->cells())
-				if (design->has(cell->type))
+				if (design->has(cell->type)) {
 					module_deps[mod].insert(design->module(cell->type));
+					instantiated_modules.insert(design->module(cell->type));
+				}
 		}
 
 		// simple good-enough topological sort
@@ -1897,6 +2013,11 @@ struct Smt2Backend : public Backend {
 			log("Creating SMT-LIBv2 representation of module %s.\n", log_id(module));
 
 			Smt2Worker worker(module, bvmode, memmode, wiresmode, verbose, statebv, statedt, forallmode, mod_stbv_width, mod_clk_cache);
+			// the parent modules refer to all ports of a submodule
+			worker.coimode = coimode && !instantiated_modules.count(module) && !worker.is_smtlib2_module;
+			// the state sort of -stbv and -stdt is only known after run()
+			if (!statebv && !statedt)
+				worker.stream = f;
 			worker.run();
 			worker.write(*f);
 
@@ -56,6 +56,7 @@ binarymode = False
 keep_going = False
 check_witness = False
 detect_loops = False
+bisectmode = False
 incremental = None
 so = SmtOpts()
 
@@ -189,6 +190,12 @@ def help():
     --incremental
         run in incremental mode (experimental)
 
+    --bisect
+        with -g on an exists-forall problem with a single maximized or
+        minimized anyconst, find the optimum with iterated threshold
+        bisection in one solver session. Only the threshold constraint is
+        pushed and popped between the checks.
+
 """ + so.helpmsg())
 
 def usage():
@@ -200,7 +207,7 @@ try:
     opts, args = getopt.getopt(sys.argv[1:], so.shortopts + "t:higcm:", so.longopts +
             ["help", "final-only", "assume-skipped=", "smtc=", "cex=", "aig=", "aig-noheader", "yw=", "btorwit=", "presat",
              "dump-vcd=", "dump-yw=", "dump-vlogtb=", "vlogtb-top=", "dump-smtc=", "dump-all", "noinfo", "append=",
-             "smtc-init", "smtc-top=", "noinit", "binary", "keep-going", "check-witness", "detect-loops", "incremental"])
+             "smtc-init", "smtc-top=", "noinit", "binary", "keep-going", "check-witness", "detect-loops", "incremental", "bisect"])
 except:
     usage()
 
@@ -286,6 +293,8 @@ for o, a in opts:
         check_witness = True
     elif o == "--detect-loops":
         detect_loops = True
+    elif o == "--bisect":
+        bisectmode = True
     elif o == "--incremental":
         from smtbmc_incremental import Incremental
         incremental = Incremental()
@@ -300,6 +309,9 @@ if len(args) != 1:
 if sum([tempind, gentrace, covermode, incremental is not None]) > 1:
     usage()
 
+if bisectmode and not gentrace:
+    usage()
+
 constr_final_start = None
 constr_asserts = defaultdict(list)
 constr_assumes = defaultdict(list)
@@ -1614,6 +1626,9 @@ def smt_forall_assert():
 
     smt.write("".join(assert_expr))
 
+    if bisectmode:
+        return
+
     if len(smt.modinfo[topmod].maximize) > 0:
         for s in states:
             if s in used_states_db:
@@ -1645,6 +1660,70 @@ def smt_check_sat(expected=["sat", "unsat"]):
         smt_forall_assert()
     return smt.check_sat(expected=expected)
 
+def smt_bisect():
+    # The threshold only constrains the existential anyconst value, so it is
+    # asserted directly on s0 instead of being added to the forall expression
+    # that is already asserted in the solver.
+    maximize = smt.modinfo[topmod].maximize
+    minimize = smt.modinfo[topmod].minimize
+    assert len(maximize) + len(minimize) == 1
+    fun = (maximize if maximize else minimize).copy().pop()
+    expr = "(|%s| s0)" % fun
+
+    width = len(smt.bv2bin(smt.get(expr)))
+    success = smt.bv2int(smt.get(expr))
+    model_is_best = True
+    print_msg("Problem is satisfiable with %s = %d." % (fun, success))
+
+    if maximize:
+        failure = None
+        while True:
+            if failure is None:
+                thresh = max(2 * success, 2)
+                if thresh >= 2**width:
+                    failure = 2**width
+            if failure is not None:
+                if failure - success <= 1:
+                    break
+                thresh = (success + failure) // 2
+            print_msg("Trying to solve with %s >= %d." % (fun, thresh))
+            smt.write("(push 1)")
+            smt_assert("(bvuge %s (_ bv%d %d))" % (expr, thresh, width))
+            status = smt_check_sat(expected=["sat", "unsat", "unknown", "timeout", "interrupted"])
+            if status == "sat":
+                success = smt.bv2int(smt.get(expr))
+                model_is_best = True
+                print_msg("Problem is satisfiable with %s = %d." % (fun, success))
+            else:
+                failure = thresh
+                model_is_best = False
+                print_msg("Problem is NOT satisfiable with %s >= %d (%s)." % (fun, thresh, status))
+            smt.write("(pop 1)")
+    else:
+        failure = -1
+        while success - failure > 1:
+            thresh = (success + failure) // 2
+            print_msg("Trying to solve with %s <= %d." % (fun, thresh))
+            smt.write("(push 1)")
+            smt_assert("(bvule %s (_ bv%d %d))" % (expr, thresh, width))
+            status = smt_check_sat(expected=["sat", "unsat", "unknown", "timeout", "interrupted"])
+            if status == "sat":
+                success = smt.bv2int(smt.get(expr))
+                model_is_best = True
+                print_msg("Problem is satisfiable with %s = %d." % (fun, success))
+            else:
+                failure = thresh
+                model_is_best = False
+                print_msg("Problem is NOT satisfiable with %s <= %d (%s)." % (fun, thresh, status))
+            smt.write("(pop 1)")
+
+    print_msg("Bisection finished with optimum %d." % success)
+
+    # the anyconst values are printed from the current model
+    if not model_is_best:
+        smt_assert("(= %s (_ bv%d %d))" % (expr, success, width))
+        assert smt_check_sat() == "sat"
+
 
 if incremental:
     incremental.mainloop()
@@ -1991,6 +2070,9 @@ else:  # not tempind, covermode
                 retstatus = "FAILED"
                 break
 
+            elif bisectmode:
+                smt_bisect()
+
             elif dumpall:
                 print_anyconsts(0)
                 write_trace(0, last_check_step+1, "%d" % step)
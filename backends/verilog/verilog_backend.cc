@@ -28,6 +28,7 @@
 #include "kernel/ff.h"
 #include "kernel/mem.h"
 #include "kernel/fmt.h"
+#include "kernel/threading.h"
 #include <string>
 #include <sstream>
 #include <set>
@@ -44,15 +45,18 @@ USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
 bool verbose, enableopt, norename, noattr, attr2comment, noexpr, nodec, nohex, nostr, extmem, defparam, decimal, siminit, systemverilog, org_name, simple_lhs, noparallelcase;
-int auto_name_counter, auto_name_offset, auto_name_digits, extmem_counter;
-dict<RTLIL::IdString, int> auto_name_map;
-std::set<RTLIL::IdString> reg_wires;
+int extmem_counter;
 std::string auto_prefix, extmem_prefix;
 
-RTLIL::Module *active_module;
-dict<RTLIL::SigBit, RTLIL::State> active_initdata;
-SigMap active_sigmap;
-IdString initial_id;
+// state of the module that is being dumped, modules are dumped in parallel
+thread_local int auto_name_counter, auto_name_offset, auto_name_digits;
+thread_local dict<RTLIL::IdString, int> auto_name_map;
+thread_local std::set<RTLIL::IdString> reg_wires;
+
+thread_local RTLIL::Module *active_module;
+thread_local dict<RTLIL::SigBit, RTLIL::State> active_initdata;
+thread_local SigMap active_sigmap;
+thread_local IdString initial_id;
 
 void reset_auto_counter_id(RTLIL::IdString id, bool may_rename)
 {
@@ -2286,15 +2290,16 @@ void dump_process(std::stringstream &f, std::string indent, RTLIL::Process *proc
 bool enc_verilog_global = false;
 
 #ifdef YOSYS_ENABLE_VERIFIC
-std::istringstream* ss;
+// input of the encryption, the "file name" passed to EncryptVerilogFile() is
+// the text of the design, which is read from memory by this stream
+std::unique_ptr<std::istringstream> enc_input;
 Verific::verific_stream *get_verific_stream(const char* file_name)
 {
 	using namespace Verific;
 	if (!file_name) return 0 ;
 
-	ss = new std::istringstream();
-	ss->str(std::string(file_name));
-	std::istream* is = static_cast<std::istream*>(ss);
+	enc_input.reset(new std::istringstream(std::string(file_name)));
+	std::istream* is = static_cast<std::istream*>(enc_input.get());
 	verific_stream *stream = new verific_istream(is);
 
 	if (stream->fail()) {
@@ -2476,21 +2481,19 @@ void dump_module(std::stringstream &f, std::string indent, RTLIL::Module *module
 }
 
 #ifdef YOSYS_ENABLE_VERIFIC
-void read_file_save_and_delete(std::ostream &f,const char* out_file_name)
+void copy_file_and_delete(std::ostream &f, const std::string &file_name)
 {
-	std::string line;
-	std::ifstream myfile (out_file_name);
-	if (myfile.is_open()) {
-		while (getline (myfile,line)) {
-			f << line << "\n";
-		}
-		myfile.close();
-	} else {
-		log_error("Unable to open file\n");
-	}
+	std::ifstream file(file_name, std::ios::binary);
+	if (!file.is_open())
+		log_error("Can't open encrypted netlist file `%s'.\n", file_name.c_str());
 
-	if (std::remove(out_file_name) != 0)
-		log_error("%s file could not be removed", out_file_name);
+	// one buffered block copy, the file is not split into lines
+	if (file.peek() != std::ifstream::traits_type::eof())
+		f << file.rdbuf();
+	file.close();
+
+	if (std::remove(file_name.c_str()) != 0)
+		log_error("Can't remove encrypted netlist file `%s'.\n", file_name.c_str());
 }
 #endif
 
@@ -2725,7 +2728,7 @@ struct VerilogBackend : public Backend {
 			Pass::call(design, "demuxmap");
 		}
 
-		ss_str << stringf("/* Generated by %s */\n", yosys_version_str);
+		std::vector<RTLIL::Module*> modules;
 		for (auto module : design->modules()) {
 			if (module->get_blackbox_attribute() != blackboxes)
 				continue;
@@ -2734,27 +2737,59 @@ struct VerilogBackend : public Backend {
 					log_cmd_error("Can't handle partially selected module %s!\n", log_id(module->name));
 				continue;
 			}
-			log("Dumping module `%s'.\n", module->name.c_str());
-			dump_module(ss_str, "", module);
+			modules.push_back(module);
+		}
+
+		// Without encryption the output is streamed: the modules are dumped
+		// in batches of a few modules per thread, and each batch is written
+		// before the next one is started. The -extmem file numbering depends
+		// on the module order, so the modules are then dumped one by one.
+#ifdef YOSYS_ENABLE_VERIFIC
+		bool encrypt = enc_verilog_global;
+#else
+		bool encrypt = false;
+#endif
+		std::ostream &out = encrypt ? ss_str : *f;
+		out << stringf("/* Generated by %s */\n", yosys_version_str);
+
+		int batch_size = extmem ? 1 : 4 * yosys_thread_count(GetSize(modules));
+		for (int batch_begin = 0; batch_begin < GetSize(modules); batch_begin += batch_size)
+		{
+			int batch_end = std::min(batch_begin + batch_size, GetSize(modules));
+			std::vector<RTLIL::Module*> batch(modules.begin() + batch_begin, modules.begin() + batch_end);
+			dict<RTLIL::Module*, int> batch_index;
+			for (int i = 0; i < GetSize(batch); i++)
+				batch_index[batch[i]] = i;
+
+			std::vector<std::stringstream> buffers(GetSize(batch));
+			execute_modules(design, batch, [&](RTLIL::Module *module) {
+				log("Dumping module `%s'.\n", module->name.c_str());
+				dump_module(buffers[batch_index.at(module)], "", module);
+			});
+
+			for (auto &buffer : buffers)
+				out << buffer.str();
 		}
 
 #ifdef YOSYS_ENABLE_VERIFIC
-		if (enc_verilog_global) {
+		if (encrypt) {
 			// making new object of ieee_1735
 			Verific::ieee_1735 iee;
-			// name for file encrypted netlist file
-			const char *out_buf = filename.c_str();
-			// saving name in hdl_encrypt settings
-			char *out_file_name = Verific::Strings::save(out_buf, "p");
+			// hdl_encrypt only writes named files, it writes to a temporary
+			// file that is then copied to the output stream as one block
+			std::string out_file_name = make_temp_file(get_base_tmpdir() + "/yosys_enc_XXXXXX");
 			Verific::hdl_encrypt::RegisterFlexStreamCallBack(get_verific_stream);
 
-			Verific::hdl_encrypt::EncryptVerilogFile(ss_str.str().c_str(), out_file_name, &iee);
+			std::string text = ss_str.str();
+			ss_str.str(std::string());
+			Verific::hdl_encrypt::EncryptVerilogFile(text.c_str(), out_file_name.c_str(), &iee);
+			text.clear();
+			text.shrink_to_fit();
+			enc_input.reset();
 
-			read_file_save_and_delete(*f, out_file_name);
-			Verific::Strings::free(out_file_name);
-		} else
+			copy_file_and_delete(*f, out_file_name);
+		}
 #endif
-			*f << ss_str.str();
 
 		enc_verilog_global = false;
 		auto_name_map.clear();
@@ -0,0 +1,23 @@
+#!/usr/bin/python3
+
+from pyosys import libyosys as ys
+
+import numpy as np
+
+design = ys.Design()
+ys.run_pass("read_verilog ../../tests/simple/fiedler-cooley.v", design);
+ys.run_pass("prep", design)
+
+for module in design.selected_whole_modules_warn():
+  netlist = ys.module_netlist(module)
+
+  # cell type histogram, without a wrapper object per cell
+  cell_types = np.asarray(netlist["cell_types"])
+  counts = np.bincount(cell_types, minlength=len(netlist["type_names"]))
+  for name, count in zip(netlist["type_names"], counts):
+    print("%-20s %d" % (name, count))
+
+  # fanout of each wire bit
+  conn_bit = np.asarray(netlist["conn_bit"])
+  fanout = np.bincount(conn_bit[conn_bit >= 0], minlength=netlist["num_bits"])
+  print("max fanout:", fanout.max() if len(fanout) else 0)
@@ -340,25 +340,26 @@ RTLIL::Wire* AigerReader::createWireIfNotExists(RTLIL::Module *module, unsigned
 {
 	const unsigned variable = literal >> 1;
 	const bool invert = literal & 1;
+	if (literal_wires.size() <= (literal | 1))
+		literal_wires.resize((literal | 1) + 1);
+	if (literal_wires[literal])
+		return literal_wires[literal];
 	RTLIL::IdString wire_name(stringf("$aiger%d$%d%s", aiger_autoidx, variable, invert ? "b" : ""));
-	RTLIL::Wire *wire = module->wire(wire_name);
-	if (wire) return wire;
 	log_debug2("Creating %s\n", wire_name.c_str());
-	wire = module->addWire(wire_name);
+	RTLIL::Wire *wire = module->addWire(wire_name);
 	wire->port_input = wire->port_output = false;
+	literal_wires[literal] = wire;
 	if (!invert) return wire;
-	RTLIL::IdString wire_inv_name(stringf("$aiger%d$%d", aiger_autoidx, variable));
-	RTLIL::Wire *wire_inv = module->wire(wire_inv_name);
-	if (wire_inv) {
-		if (module->cell(wire_inv_name)) return wire;
-	}
-	else {
+	RTLIL::Wire *wire_inv = literal_wires[literal ^ 1];
+	if (!wire_inv) {
+		RTLIL::IdString wire_inv_name(stringf("$aiger%d$%d", aiger_autoidx, variable));
 		log_debug2("Creating %s\n", wire_inv_name.c_str());
 		wire_inv = module->addWire(wire_inv_name);
 		wire_inv->port_input = wire_inv->port_output = false;
+		literal_wires[literal ^ 1] = wire_inv;
 	}
 
-	log_debug2("Creating %s = ~%s\n", wire_name.c_str(), wire_inv_name.c_str());
+	log_debug2("Creating %s = ~%s\n", wire_name.c_str(), wire_inv->name.c_str());
 	module->addNotGate(stringf("$not$aiger%d$%d", aiger_autoidx, variable), wire_inv, wire);
 
 	return wire;
@@ -625,27 +626,33 @@ void AigerReader::parse_aiger_ascii()
 		std::getline(f, line); // Ignore up to start of next line
 
 	// Parse AND
+	and_literals.resize(3 * A);
 	for (unsigned i = 0; i < A; ++i) {
 		if (!(f >> l1 >> l2 >> l3))
 			log_error("Line %u cannot be interpreted as an AND!\n", line_count);
 
 		log_debug2("%d %d %d is an AND\n", l1, l2, l3);
 		log_assert(!(l1 & 1));
-		RTLIL::Wire *o_wire = createWireIfNotExists(module, l1);
-		RTLIL::Wire *i1_wire = createWireIfNotExists(module, l2);
-		RTLIL::Wire *i2_wire = createWireIfNotExists(module, l3);
-		module->addAndGate("$and" + o_wire->name.str(), i1_wire, i2_wire, o_wire);
+		and_literals[3 * i] = l1;
+		and_literals[3 * i + 1] = l2;
+		and_literals[3 * i + 2] = l3;
 	}
 	std::getline(f, line); // Ignore up to start of next line
+	create_and_gates();
 }
 
-static unsigned parse_next_delta_literal(std::istream &f, unsigned ref)
+// Decodes the delta-encoded literals directly from the stream buffer,
+// which avoids the overhead of istream::get() for each byte.
+static bool parse_next_delta_literal(std::streambuf *buf, unsigned ref, unsigned &literal)
 {
 	unsigned x = 0, i = 0;
-	unsigned char ch;
-	while ((ch = f.get()) & 0x80)
+	int ch;
+	while ((ch = buf->sbumpc()) != EOF && (ch & 0x80))
 		x |= (ch & 0x7f) << (7 * i++);
-	return ref - (x | (ch << (7 * i)));
+	if (ch == EOF)
+		return false;
+	literal = ref - (x | (ch << (7 * i)));
+	return true;
 }
 
 void AigerReader::parse_aiger_binary()
@@ -750,18 +757,54 @@ void AigerReader::parse_aiger_binary()
 		std::getline(f, line); // Ignore up to start of next line
 
 	// Parse AND
+	std::streambuf *buf = f.rdbuf();
+	and_literals.resize(3 * A);
 	l1 = (I+L+1) << 1;
 	for (unsigned i = 0; i < A; ++i, ++line_count, l1 += 2) {
-		l2 = parse_next_delta_literal(f, l1);
-		l3 = parse_next_delta_literal(f, l2);
+		if (!parse_next_delta_literal(buf, l1, l2) || !parse_next_delta_literal(buf, l2, l3))
+			log_error("Unexpected end of file in AND gate %u!\n", i);
 
 		log_debug2("%d %d %d is an AND\n", l1, l2, l3);
-		log_assert(!(l1 & 1));
-		RTLIL::Wire *o_wire = createWireIfNotExists(module, l1);
-		RTLIL::Wire *i1_wire = createWireIfNotExists(module, l2);
-		RTLIL::Wire *i2_wire = createWireIfNotExists(module, l3);
+		and_literals[3 * i] = l1;
+		and_literals[3 * i + 1] = l2;
+		and_literals[3 * i + 2] = l3;
+	}
+	create_and_gates();
+}
+
+void AigerReader::create_and_gates()
+{
+	// Count the new wires and $_NOT_ cells first, so that the module can
+	// reserve space for all of them
+	int num_wires = 0, num_cells = GetSize(and_literals) / 3;
+	std::vector<bool> seen(literal_wires.size());
+	for (unsigned literal : and_literals) {
+		if (literal >= seen.size())
+			seen.resize((literal | 1) + 1);
+		if (seen[literal] || (literal < literal_wires.size() && literal_wires[literal]))
+			continue;
+		seen[literal] = true;
+		num_wires++;
+		if (literal & 1) {
+			num_cells++;
+			if (!seen[literal ^ 1] && !(literal < literal_wires.size() && literal_wires[literal ^ 1])) {
+				seen[literal ^ 1] = true;
+				num_wires++;
+			}
+		}
+	}
+
+	module->begin_batch(num_cells, num_wires);
+	for (int i = 0; i < GetSize(and_literals); i += 3) {
+		RTLIL::Wire *o_wire = createWireIfNotExists(module, and_literals[i]);
+		RTLIL::Wire *i1_wire = createWireIfNotExists(module, and_literals[i + 1]);
+		RTLIL::Wire *i2_wire = createWireIfNotExists(module, and_literals[i + 2]);
 		module->addAndGate("$and" + o_wire->name.str(), i1_wire, i2_wire, o_wire);
 	}
+	module->commit_batch();
+
+	and_literals.clear();
+	and_literals.shrink_to_fit();
 }
 
 void AigerReader::post_process()
@@ -47,11 +47,18 @@ struct AigerReader
     std::vector<RTLIL::Cell*> boxes;
     std::vector<int> mergeability, initial_state;
 
+    // The wire of each literal created so far, by literal
+    std::vector<RTLIL::Wire*> literal_wires;
+    // The output and input literals of the AND gates, three per gate,
+    // decoded before the gates are created in one batch
+    std::vector<unsigned> and_literals;
+
     AigerReader(RTLIL::Design *design, std::istream &f, RTLIL::IdString module_name, RTLIL::IdString clk_name, std::string map_filename, bool wideports);
     void parse_aiger();
     void parse_xaiger();
     void parse_aiger_ascii();
     void parse_aiger_binary();
+    void create_and_gates();
     void post_process();
 
     RTLIL::Wire* createWireIfNotExists(RTLIL::Module *module, unsigned literal);
@@ -197,6 +197,65 @@ bool AstNode::get_bool_attribute(RTLIL::IdString id)
 	return attr->integer != 0;
 }
 
+// AST nodes are created and deleted in large numbers, e.g. when cloning function
+// bodies and generate blocks, and when the AST is freed after RTLIL generation.
+// they are allocated from chunks that are never returned to the system, and
+// deleted nodes are kept in a per-thread free list for reuse.
+namespace {
+	struct AstNodePool
+	{
+		static const int chunk_size = 1024;
+
+		union slot_t {
+			slot_t *next;
+			alignas(AstNode) char node[sizeof(AstNode)];
+		};
+
+		static std::mutex chunks_mutex;
+		static std::vector<slot_t*> chunks;
+		static thread_local slot_t *free_list;
+
+		static void *allocate()
+		{
+			if (free_list == nullptr) {
+				slot_t *chunk = new slot_t[chunk_size];
+				for (int i = 0; i < chunk_size - 1; i++)
+					chunk[i].next = &chunk[i + 1];
+				chunk[chunk_size - 1].next = nullptr;
+				free_list = chunk;
+				std::lock_guard<std::mutex> lock(chunks_mutex);
+				chunks.push_back(chunk);
+			}
+			slot_t *slot = free_list;
+			free_list = slot->next;
+			return slot;
+		}
+
+		static void release(void *ptr)
+		{
+			slot_t *slot = static_cast<slot_t*>(ptr);
+			slot->next = free_list;
+			free_list = slot;
+		}
+	};
+
+	std::mutex AstNodePool::chunks_mutex;
+	std::vector<AstNodePool::slot_t*> AstNodePool::chunks;
+	thread_local AstNodePool::slot_t *AstNodePool::free_list = nullptr;
+}
+
+void *AstNode::operator new(size_t size)
+{
+	log_assert(size == sizeof(AstNode));
+	return AstNodePool::allocate();
+}
+
+void AstNode::operator delete(void *ptr)
+{
+	if (ptr != nullptr)
+		AstNodePool::release(ptr);
+}
+
 // create new node (AstNode constructor)
 // (the optional child arguments make it easier to create AST trees)
 AstNode::AstNode(AstNodeType type, AstNode *child1, AstNode *child2, AstNode *child3, AstNode *child4)
@@ -249,8 +308,7 @@ AstNode::AstNode(AstNodeType type, AstNode *child1, AstNode *child2, AstNode *ch
 // create a (deep recursive) copy of a node
 AstNode *AstNode::clone() const
 {
-	AstNode *that = new AstNode;
-	*that = *this;
+	AstNode *that = new AstNode(*this);
 	for (auto &it : that->children)
 		it = it->clone();
 	for (auto &it : that->attributes)
@@ -1059,6 +1117,7 @@ static RTLIL::Module *process_module(RTLIL::Design *design, AstNode *ast, bool d
 
 	module->ast = NULL;
 	module->name = ast->str;
+	module->derive_memo = std::make_shared<AstDeriveMemo>();
 	set_src_attr(module, ast);
 	module->set_bool_attribute(ID::cells_not_processed);
 
@@ -1458,6 +1517,12 @@ AstModule::~AstModule()
 		delete ast;
 }
 
+AstDeriveMemo::~AstDeriveMemo()
+{
+	for (auto &it : modules)
+		delete it.second;
+}
+
 
 // An interface port with modport is specified like this:
 //    <interface_name>.<modport_name>
@@ -1676,8 +1741,11 @@ RTLIL::IdString AstModule::derive(RTLIL::Design *design, const dict<RTLIL::IdStr
 			explode_interface_port(new_ast, intfmodule, intfname, modport);
 		}
 
+		int context_lookups = simplify_design_context_lookups;
 		process_module(design, new_ast, false);
 		design->module(modname)->check();
+		if (!has_interfaces)
+			memoize_derived(design->module(modname), context_lookups);
 
 		RTLIL::Module* mod = design->module(modname);
 
@@ -1733,8 +1801,10 @@ RTLIL::IdString AstModule::derive(RTLIL::Design *design, const dict<RTLIL::IdStr
 
 	if (!design->has(modname) && new_ast) {
 		new_ast->str = modname;
+		int context_lookups = simplify_design_context_lookups;
 		process_module(design, new_ast, false, NULL, quiet);
 		design->module(modname)->check();
+		memoize_derived(design->module(modname), context_lookups);
 	} else if (!quiet) {
 		log("Found cached RTLIL representation for module `%s'.\n", modname.c_str());
 	}
@@ -1815,6 +1885,19 @@ std::string AstModule::derive_common(RTLIL::Design *design, const dict<RTLIL::Id
 	if (design->has(modname))
 		return modname;
 
+	if (derive_memo == nullptr)
+		derive_memo = std::make_shared<AstDeriveMemo>();
+	auto memo_it = derive_memo->modules.find(modname);
+	if (memo_it != derive_memo->modules.end()) {
+		if (!quiet)
+			log("Reusing memoized RTLIL representation for module `%s'.\n", modname.c_str());
+		AstModule *mod = static_cast<AstModule*>(memo_it->second->clone());
+		mod->fileID = memo_it->second->fileID;
+		mod->derive_memo = derive_memo;
+		design->add(mod);
+		return modname;
+	}
+
 	if (!quiet)
 		log_header(design, "Executing AST frontend in derive mode using pre-parsed AST for module `%s'.\n", stripped_name.c_str());
 	loadconfig();
@@ -1876,6 +1959,31 @@ std::string AstModule::derive_common(RTLIL::Design *design, const dict<RTLIL::Id
 	return modname;
 }
 
+// Stores a copy of a module that was just derived from this module in the
+// memo. Modules that depend on other modules of the design, i.e. that looked
+// up other modules during simplify or that will be reprocessed once an
+// instantiated module becomes available, are not stored.
+void AstModule::memoize_derived(RTLIL::Module *mod, int context_lookups)
+{
+	AstModule *ast_mod = dynamic_cast<AstModule*>(mod);
+	if (ast_mod == nullptr)
+		return;
+	ast_mod->derive_memo = derive_memo;
+
+	if (context_lookups != simplify_design_context_lookups)
+		return;
+	for (auto cell : mod->cells())
+		if (cell->has_attribute(ID::reprocess_after))
+			return;
+
+	// the copy must not own the memo, that would be a reference cycle
+	AstModule *copy = static_cast<AstModule*>(mod->clone());
+	copy->fileID = mod->fileID;
+	copy->derive_memo = nullptr;
+	delete derive_memo->modules[mod->name.str()];
+	derive_memo->modules[mod->name.str()] = copy;
+}
+
 RTLIL::Module *AstModule::clone() const
 {
 	AstModule *new_mod = new AstModule;
@@ -1894,6 +2002,7 @@ RTLIL::Module *AstModule::clone() const
 	new_mod->icells = icells;
 	new_mod->pwires = pwires;
 	new_mod->autowire = autowire;
+	new_mod->derive_memo = derive_memo;
 
 	return new_mod;
 }
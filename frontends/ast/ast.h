@@ -235,6 +235,10 @@ namespace AST
 		void delete_children();
 		~AstNode();
 
+		// nodes are allocated from a pool, see ast.cc
+		static void *operator new(size_t size);
+		static void operator delete(void *ptr);
+
 		enum mem2reg_flags
 		{
 			/* status flags */
@@ -266,7 +270,7 @@ namespace AST
 		void label_genblks(std::set<std::string>& existing, int &counter);
 		void mem2reg_as_needed_pass1(dict<AstNode*, pool<std::string>> &mem2reg_places,
 				dict<AstNode*, uint32_t> &mem2reg_flags, dict<AstNode*, uint32_t> &proc_flags, uint32_t &status_flags);
-		bool mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod, AstNode *block, AstNode *&async_block);
+		bool mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod, AstNode *block, AstNode *stmt, AstNode *&async_block);
 		bool mem2reg_check(pool<AstNode*> &mem2reg_set);
 		void mem2reg_remove(pool<AstNode*> &mem2reg_set, vector<AstNode*> &delnodes);
 		void meminfo(int &mem_width, int &mem_size, int &addr_bits);
@@ -382,13 +386,25 @@ namespace AST
 
 	// parametric modules are supported directly by the AST library
 	// therefore we need our own derivate of RTLIL::Module with overloaded virtual functions
+	// RTLIL modules derived from an AstModule, keyed by the name of the
+	// derived module (which encodes the parameters). The memo is shared by
+	// the clones of the AstModule and by the modules derived from it, so that
+	// running hierarchy again on a saved copy of the design does not need to
+	// simplify the AST again for parameter sets that were seen before.
+	struct AstDeriveMemo {
+		dict<std::string, RTLIL::Module*> modules;
+		~AstDeriveMemo();
+	};
+
 	struct AstModule : RTLIL::Module {
 		AstNode *ast;
 		bool nolatches, nomeminit, nomem2reg, mem2reg, noblackbox, lib, nowb, noopt, icells, pwires, autowire;
+		std::shared_ptr<AstDeriveMemo> derive_memo;
 		~AstModule() override;
 		RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, bool mayfail) override;
 		RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, const dict<RTLIL::IdString, RTLIL::Module*> &interfaces, const dict<RTLIL::IdString, RTLIL::IdString> &modports, bool mayfail) override;
 		std::string derive_common(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, AstNode **new_ast_out, bool quiet = false);
+		void memoize_derived(RTLIL::Module *mod, int context_lookups);
 		void expand_interfaces(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Module *> &local_interfaces) override;
 		bool reprocess_if_necessary(RTLIL::Design *design) override;
 		RTLIL::Module *clone() const override;
@@ -428,6 +444,10 @@ namespace AST
 	// used to provide simplify() access to the current design for looking up
 	// modules, ports, wires, etc.
 	void set_simplify_design_context(const RTLIL::Design *design);
+
+	// number of successful module lookups in the design context, used to
+	// detect modules that depend on the contents of other modules
+	extern int simplify_design_context_lookups;
 }
 
 namespace AST_INTERNAL
@@ -353,6 +353,9 @@ struct AST_INTERNAL::ProcessGenerator
 	// Buffer for generating the init action
 	RTLIL::SigSpec init_lvalue, init_rvalue;
 
+	// The wires assigned below each completed switch, see recordSwitchLvalueWires()
+	dict<RTLIL::SwitchRule*, pool<RTLIL::Wire*>, hash_ptr_ops> switch_lvalue_wires;
+
 	// The most recently assigned $print or $check cell \PRIORITY.
 	int last_effect_priority;
 
@@ -560,13 +563,61 @@ struct AST_INTERNAL::ProcessGenerator
 	// function is called to clean up the first two assignments as they are overwritten by
 	// the third assignment.
 	void removeSignalFromCaseTree(const RTLIL::SigSpec &pattern, RTLIL::CaseRule *cs)
+	{
+		pool<RTLIL::Wire*> pattern_wires;
+		for (auto &chunk : pattern.chunks())
+			if (chunk.wire)
+				pattern_wires.insert(chunk.wire);
+		if (!pattern_wires.empty())
+			removeSignalFromCaseTree(pattern, pattern_wires, cs);
+	}
+
+	void removeSignalFromCaseTree(const RTLIL::SigSpec &pattern, const pool<RTLIL::Wire*> &pattern_wires, RTLIL::CaseRule *cs)
 	{
 		for (auto it = cs->actions.begin(); it != cs->actions.end(); it++)
-			it->first.remove2(pattern, &it->second);
+			for (auto &chunk : it->first.chunks())
+				if (pattern_wires.count(chunk.wire)) {
+					it->first.remove2(pattern, &it->second);
+					break;
+				}
 
-		for (auto it = cs->switches.begin(); it != cs->switches.end(); it++)
+		for (auto it = cs->switches.begin(); it != cs->switches.end(); it++) {
+			auto found = switch_lvalue_wires.find(*it);
+			if (found != switch_lvalue_wires.end()) {
+				bool overlap = false;
+				for (auto wire : pattern_wires)
+					if (found->second.count(wire)) {
+						overlap = true;
+						break;
+					}
+				if (!overlap)
+					continue;
+			}
 			for (auto it2 = (*it)->cases.begin(); it2 != (*it)->cases.end(); it2++)
-				removeSignalFromCaseTree(pattern, *it2);
+				removeSignalFromCaseTree(pattern, pattern_wires, *it2);
+		}
+	}
+
+	// record the wires assigned anywhere below a switch once it is complete,
+	// so that removeSignalFromCaseTree() can skip switches that can't contain
+	// the pattern. Completed switches only lose actions, so the set stays a
+	// valid over-approximation.
+	void recordSwitchLvalueWires(RTLIL::SwitchRule *sw)
+	{
+		pool<RTLIL::Wire*> &wires = switch_lvalue_wires[sw];
+		for (auto cs : sw->cases) {
+			for (auto &action : cs->actions)
+				for (auto &chunk : action.first.chunks())
+					if (chunk.wire)
+						wires.insert(chunk.wire);
+			for (auto child : cs->switches) {
+				auto found = switch_lvalue_wires.find(child);
+				if (found != switch_lvalue_wires.end()) {
+					for (auto wire : found->second)
+						wires.insert(wire);
+				}
+			}
+		}
 	}
 
 	// add an assignment (aka "action") but split it up in chunks. this way huge assignments
@@ -712,6 +763,8 @@ struct AST_INTERNAL::ProcessGenerator
 					sw->cases.push_back(default_case);
 				}
 
+				recordSwitchLvalueWires(sw);
+
 				for (int i = 0; i < GetSize(this_case_eq_lvalue); i++)
 					subst_rvalue_map.set(this_case_eq_lvalue[i], this_case_eq_ltemp[i]);
 
@@ -612,6 +612,7 @@ static std::string prefix_id(const std::string &prefix, const std::string &str)
 
 // direct access to this global should be limited to the following two functions
 static const RTLIL::Design *simplify_design_context = nullptr;
+int AST::simplify_design_context_lookups = 0;
 
 void AST::set_simplify_design_context(const RTLIL::Design *design)
 {
@@ -685,6 +686,7 @@ const RTLIL::Module* AstNode::lookup_cell_module()
 		reprocess_after(modname);
 		return nullptr;
 	}
+	simplify_design_context_lookups++;
 	return module;
 }
 
@@ -913,6 +915,37 @@ static void check_auto_nosync(AstNode *node)
 static int maxNbSimplifyCalls = 0;
 #define MAX_NB_SIMPLY_CALLS 100000000
 
+// results of constant function calls in the module that is currently being
+// simplified, indexed by the function declaration and the argument values.
+// this avoids evaluating the function body again for each call with the same
+// arguments, e.g. in generate loops or in recursive functions.
+static dict<std::string, AstNode*> const_func_cache;
+
+static void clear_const_func_cache()
+{
+	for (auto &it : const_func_cache)
+		delete it.second;
+	const_func_cache.clear();
+}
+
+// returns an empty string if not all arguments are constant
+static std::string const_func_cache_key(const AstNode *decl, const AstNode *fcall)
+{
+	std::string key = stringf("%p", decl);
+	for (auto child : fcall->children) {
+		if (child->type == AST_REALVALUE) {
+			key += stringf(" r%.17g", child->realvalue);
+			continue;
+		}
+		if (child->type != AST_CONSTANT)
+			return std::string();
+		key += stringf(" %c%c%c", child->is_signed ? 's' : 'u', child->is_string ? 's' : 'b', child->is_unsized ? 'u' : 's');
+		for (auto bit : child->bits)
+			key += char('0' + bit);
+	}
+	return key;
+}
+
 // convert the AST into a simpler AST that has all parameters substituted by their
 // values, unrolled for-loops, expanded generate blocks, etc. when this function
 // is done with an AST it can be converted into RTLIL using genRTLIL().
@@ -955,6 +988,7 @@ bool AstNode::simplify(bool const_fold, int stage, int width_hint, bool sign_hin
 		log_assert(type == AST_MODULE || type == AST_INTERFACE);
 
 		deep_recursion_warning = true;
+		clear_const_func_cache();
 		while (simplify(const_fold, 1, width_hint, sign_hint)) { }
 
 		if (!flag_nomem2reg && !get_bool_attribute(ID::nomem2reg))
@@ -1043,7 +1077,7 @@ bool AstNode::simplify(bool const_fold, int stage, int width_hint, bool sign_hin
 			}
 
 			AstNode *async_block = NULL;
-			while (mem2reg_as_needed_pass2(mem2reg_set, this, NULL, async_block)) { }
+			while (mem2reg_as_needed_pass2(mem2reg_set, this, NULL, NULL, async_block)) { }
 
 			vector<AstNode*> delnodes;
 			mem2reg_remove(mem2reg_set, delnodes);
@@ -1053,6 +1087,7 @@ bool AstNode::simplify(bool const_fold, int stage, int width_hint, bool sign_hin
 		}
 
 		while (simplify(const_fold, 2, width_hint, sign_hint)) { }
+		clear_const_func_cache();
 		recursion_counter--;
 		return false;
 	}
@@ -3937,6 +3972,19 @@ skip_dynamic_range_lvalue_expansion:;
 		AstNode *decl = current_scope[str];
 		if (unevaluated_tern_branch && decl->is_recursive_function())
 			goto replace_fcall_later;
+
+		std::string func_cache_key;
+		if (decl->type == AST_FUNCTION && !decl->attributes.count(ID::via_celltype)) {
+			for (auto child : children)
+				while (child->simplify(true, 1, -1, false)) { }
+			func_cache_key = const_func_cache_key(decl, this);
+			auto it = const_func_cache.find(func_cache_key);
+			if (it != const_func_cache.end()) {
+				newNode = it->second->clone();
+				goto apply_newNode;
+			}
+		}
+
 		decl = decl->clone();
 		decl->replace_result_wire_name_in_function(str, "$result"); // enables recursion
 		decl->expand_genblock(prefix);
@@ -3959,6 +4007,8 @@ skip_dynamic_range_lvalue_expansion:;
 				delete func_workspace;
 				if (newNode) {
 					delete decl;
+					if (!func_cache_key.empty())
+						const_func_cache[func_cache_key] = newNode->clone();
 					goto apply_newNode;
 				}
 			}
@@ -4955,7 +5005,8 @@ void AstNode::mem2reg_remove(pool<AstNode*> &mem2reg_set, vector<AstNode*> &deln
 }
 
 // actually replace memories with registers
-bool AstNode::mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod, AstNode *block, AstNode *&async_block)
+// stmt is the child of block that contains this node
+bool AstNode::mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod, AstNode *block, AstNode *stmt, AstNode *&async_block)
 {
 	bool did_something = false;
 
@@ -5236,7 +5287,7 @@ bool AstNode::mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod,
 			if (block)
 			{
 				size_t assign_idx = 0;
-				while (assign_idx < block->children.size() && !block->children[assign_idx]->contains(this))
+				while (assign_idx < block->children.size() && block->children[assign_idx] != stmt)
 					assign_idx++;
 				log_assert(assign_idx < block->children.size());
 				block->children.insert(block->children.begin()+assign_idx, case_node);
@@ -5268,7 +5319,7 @@ bool AstNode::mem2reg_as_needed_pass2(pool<AstNode*> &mem2reg_set, AstNode *mod,
 
 	auto children_list = children;
 	for (size_t i = 0; i < children_list.size(); i++)
-		if (children_list[i]->mem2reg_as_needed_pass2(mem2reg_set, mod, block, async_block))
+		if (children_list[i]->mem2reg_as_needed_pass2(mem2reg_set, mod, block, type == AST_BLOCK ? children_list[i] : stmt, async_block))
 			did_something = true;
 
 	return did_something;
@@ -18,43 +18,253 @@
  */
 
 #include "blifparse.h"
+#include "kernel/threading.h"
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 YOSYS_NAMESPACE_BEGIN
 
 const int lut_input_plane_limit = 12;
 
-static bool read_next_line(char *&buffer, size_t &buffer_size, int &line_count, std::istream &f)
+namespace {
+	// The contents of a BLIF file, mapped into memory where possible.
+	struct blif_file_t
+	{
+		std::string buffer;
+		const char *data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+
+		bool read(const std::string &filename)
+		{
+			struct stat st;
+			if (stat(filename.c_str(), &st) != 0)
+				return false;
+#ifndef _WIN32
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+			if (st.st_size > 0) {
+				void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					data = (const char*)p;
+					size = st.st_size;
+					mapped = true;
+				}
+			}
+			close(fd);
+			if (mapped || st.st_size == 0)
+				return true;
+#endif
+			std::ifstream f(filename.c_str(), std::ios::binary);
+			if (f.fail())
+				return false;
+			buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			data = buffer.data();
+			size = buffer.size();
+			return true;
+		}
+
+		~blif_file_t()
+		{
+#ifndef _WIN32
+			if (mapped)
+				munmap((void*)data, size);
+#endif
+		}
+	};
+
+	// A logical line, with continued lines joined and trailing whitespace
+	// removed. line_no is the number of its last physical line.
+	struct blif_line_t
+	{
+		const char *begin, *end;
+		int line_no;
+
+		bool is_command() const { return begin[0] == '.'; }
+		bool is_comment() const { return begin[0] == '#'; }
+	};
+
+	// The cover of a .names statement, parsed ahead of creating the cell.
+	// For a constant driver (no inputs) table holds the single value, for
+	// $sop cells the TABLE parameter with depth rows and inverted set if
+	// the rows give the off-set, and for $lut cells the LUT parameter.
+	struct blif_cover_t
+	{
+		int names_line = 0, first_line = 0, end_line = 0;
+		int width = 0;
+		RTLIL::Const table;
+		int depth = 0;
+		bool inverted = false;
+		int error_line_no = 0;
+	};
+}
+
+static inline bool blif_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool next_token(const char *&pos, const char *end, const char *&tok_begin, const char *&tok_end)
 {
-	string strbuf;
-	int buffer_len = 0;
-	buffer[0] = 0;
+	while (pos < end && blif_space(*pos))
+		pos++;
+	if (pos == end)
+		return false;
+	tok_begin = pos;
+	while (pos < end && !blif_space(*pos))
+		pos++;
+	tok_end = pos;
+	return true;
+}
 
-	while (1)
+static std::vector<std::string> split_tokens(const blif_line_t &line)
+{
+	std::vector<std::string> tokens;
+	const char *pos = line.begin, *tok_begin, *tok_end;
+	while (next_token(pos, line.end, tok_begin, tok_end))
+		tokens.emplace_back(tok_begin, tok_end);
+	return tokens;
+}
+
+static void split_lines(const char *data, size_t size, std::vector<blif_line_t> &lines, std::deque<std::string> &joined)
+{
+	const char *pos = data, *end = data + size;
+	std::string continued;
+	bool continuing = false;
+	int line_no = 0;
+
+	while (pos < end)
 	{
-		buffer_len += strlen(buffer + buffer_len);
-		while (buffer_len > 0 && (buffer[buffer_len-1] == ' ' || buffer[buffer_len-1] == '\t' ||
-				buffer[buffer_len-1] == '\r' || buffer[buffer_len-1] == '\n'))
-			buffer[--buffer_len] = 0;
-
-		if (buffer_size-buffer_len < 4096) {
-			buffer_size *= 2;
-			buffer = (char*)realloc(buffer, buffer_size);
+		const char *line_end = (const char*)memchr(pos, '\n', end - pos);
+		if (line_end == nullptr)
+			line_end = end;
+		const char *begin = pos;
+		pos = line_end < end ? line_end + 1 : end;
+		line_no++;
+
+		while (line_end > begin && blif_space(line_end[-1]))
+			line_end--;
+
+		if (line_end > begin && line_end[-1] == '\\') {
+			continued.append(begin, line_end - 1);
+			continuing = true;
+			continue;
 		}
 
-		if (buffer_len == 0 || buffer[buffer_len-1] == '\\') {
-			if (buffer_len > 0 && buffer[buffer_len-1] == '\\')
-				buffer[--buffer_len] = 0;
-			line_count++;
-			if (!std::getline(f, strbuf))
-				return false;
-			while (buffer_size-buffer_len < strbuf.size()+1) {
-				buffer_size *= 2;
-				buffer = (char*)realloc(buffer, buffer_size);
+		if (continuing) {
+			continued.append(begin, line_end);
+			while (!continued.empty() && blif_space(continued.back()))
+				continued.pop_back();
+			continuing = false;
+			if (continued.empty())
+				continue;
+			joined.emplace_back();
+			joined.back().swap(continued);
+			begin = joined.back().data();
+			line_end = begin + joined.back().size();
+		}
+
+		if (line_end > begin)
+			lines.push_back({begin, line_end, line_no});
+	}
+
+	if (continuing && !continued.empty()) {
+		joined.emplace_back();
+		joined.back().swap(continued);
+		lines.push_back({joined.back().data(), joined.back().data() + joined.back().size(), line_no});
+	}
+}
+
+static void parse_cover(const std::vector<blif_line_t> &lines, blif_cover_t &cover, bool sop_mode)
+{
+	if (cover.width == 0)
+	{
+		RTLIL::State state = RTLIL::State::Sa;
+		for (int i = cover.first_line; i < cover.end_line; i++) {
+			const blif_line_t &line = lines[i];
+			if (line.is_comment())
+				continue;
+			for (const char *p = line.begin; p < line.end; p++) {
+				if (*p == ' ' || *p == '\t')
+					continue;
+				if ((*p == '0' && state != RTLIL::State::S1) || (*p == '1' && state != RTLIL::State::S0)) {
+					state = *p == '1' ? RTLIL::State::S1 : RTLIL::State::S0;
+					continue;
+				}
+				cover.error_line_no = line.line_no;
+				return;
 			}
-			strcpy(buffer+buffer_len, strbuf.c_str());
-		} else
-			return true;
+		}
+		cover.table = state == RTLIL::State::Sa ? RTLIL::State::S0 : state;
+		return;
 	}
+
+	if (!sop_mode && cover.width > lut_input_plane_limit)
+		return;
+
+	RTLIL::State lut_default_state = RTLIL::State::Sx;
+	if (!sop_mode)
+		cover.table = RTLIL::Const(RTLIL::State::Sx, 1 << cover.width);
+
+	for (int i = cover.first_line; i < cover.end_line; i++)
+	{
+		const blif_line_t &line = lines[i];
+		if (line.is_comment())
+			continue;
+
+		const char *pos = line.begin, *input, *input_end, *output, *output_end;
+		if (!next_token(pos, line.end, input, input_end) || !next_token(pos, line.end, output, output_end) ||
+				output_end - output != 1 || (*output != '0' && *output != '1') || input_end - input != cover.width) {
+			cover.error_line_no = line.line_no;
+			return;
+		}
+		bool value = *output == '1';
+
+		if (sop_mode)
+		{
+			if (cover.depth == 0)
+				cover.inverted = !value;
+			else if (cover.inverted == value) {
+				cover.error_line_no = line.line_no;
+				return;
+			}
+			cover.depth++;
+
+			for (const char *p = input; p < input_end; p++) {
+				cover.table.bits.push_back(*p == '0' ? State::S1 : State::S0);
+				cover.table.bits.push_back(*p == '1' ? State::S1 : State::S0);
+			}
+			continue;
+		}
+
+		for (int k = 0; k < (1 << cover.width); k++) {
+			for (int j = 0; j < cover.width; j++) {
+				char c1 = input[j];
+				if (c1 != '-') {
+					char c2 = (k & (1 << j)) != 0 ? '1' : '0';
+					if (c1 != c2)
+						goto try_next_value;
+				}
+			}
+			cover.table.bits[k] = value ? RTLIL::State::S1 : RTLIL::State::S0;
+		try_next_value:;
+		}
+
+		lut_default_state = value ? RTLIL::State::S0 : RTLIL::State::S1;
+	}
+
+	if (!sop_mode)
+		for (auto &bit : cover.table.bits)
+			if (bit == RTLIL::State::Sx)
+				bit = lut_default_state;
 }
 
 static std::pair<RTLIL::IdString, int> wideports_split(std::string name)
@@ -84,15 +294,45 @@ failed:
 	return std::pair<RTLIL::IdString, int>(RTLIL::IdString(), 0);
 }
 
-void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool run_clean, bool sop_mode, bool wideports)
+
+void parse_blif(RTLIL::Design *design, const char *data, size_t size, IdString dff_name, bool run_clean, bool sop_mode, bool wideports)
 {
 	RTLIL::Module *module = nullptr;
-	RTLIL::Const *lutptr = NULL;
-	RTLIL::Cell *sopcell = NULL;
 	RTLIL::Cell *lastcell = nullptr;
-	RTLIL::State lut_default_state = RTLIL::State::Sx;
 	std::string err_reason;
-	int blif_maxnum = 0, sopmode = -1;
+	int blif_maxnum = 0;
+	int line_count = 0;
+
+	std::vector<blif_line_t> lines;
+	std::deque<std::string> joined_lines;
+	split_lines(data, size, lines, joined_lines);
+
+	// The covers of the .names statements only depend on the text, so they
+	// are parsed in parallel before creating the cells in file order.
+	std::vector<blif_cover_t> covers;
+	for (int i = 0; i < GetSize(lines); i++) {
+		const blif_line_t &line = lines[i];
+		if (line.end - line.begin < 6 || strncmp(line.begin, ".names", 6) || (line.end - line.begin > 6 && !blif_space(line.begin[6])))
+			continue;
+		blif_cover_t cover;
+		cover.names_line = i;
+		const char *pos = line.begin + 6, *tok_begin, *tok_end;
+		while (next_token(pos, line.end, tok_begin, tok_end))
+			cover.width++;
+		cover.width--;
+		cover.first_line = i + 1;
+		for (cover.end_line = i + 1; cover.end_line < GetSize(lines) && !lines[cover.end_line].is_command(); cover.end_line++) { }
+		covers.push_back(std::move(cover));
+	}
+
+	const int covers_per_job = 1024;
+	int num_jobs = (GetSize(covers) + covers_per_job - 1) / covers_per_job;
+	ThreadPool::run(num_jobs, [&](int job) {
+		int end = std::min(GetSize(covers), (job + 1) * covers_per_job);
+		for (int i = job * covers_per_job; i < end; i++)
+			if (covers[i].width >= 0)
+				parse_cover(lines, covers[i], sop_mode);
+	}, yosys_thread_count(num_jobs));
 
 	auto blif_wire = [&](const std::string &wire_name) -> Wire*
 	{
@@ -129,49 +369,32 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 
 	dict<RTLIL::IdString, std::pair<int, bool>> wideports_cache;
 
-	size_t buffer_size = 4096;
-	char *buffer = (char*)malloc(buffer_size);
-	int line_count = 0;
+	int next_cover = 0;
 
-	while (1)
+	for (int line_idx = 0; line_idx < GetSize(lines); line_idx++)
 	{
-		if (!read_next_line(buffer, buffer_size, line_count, f)) {
-			if (module != nullptr)
-				goto error;
-			free(buffer);
-			return;
-		}
+		const blif_line_t &line = lines[line_idx];
+		line_count = line.line_no;
 
-	continue_without_read:
-		if (buffer[0] == '#')
+		if (line.is_comment())
 			continue;
 
-		if (buffer[0] == '.')
-		{
-			if (lutptr) {
-				for (auto &bit : lutptr->bits)
-					if (bit == RTLIL::State::Sx)
-						bit = lut_default_state;
-				lutptr = NULL;
-				lut_default_state = RTLIL::State::Sx;
-			}
-
-			if (sopcell) {
-				sopcell = NULL;
-				sopmode = -1;
-			}
+		// the rows of the covers are consumed with their .names statement
+		if (!line.is_command())
+			goto error;
 
-			char *cmd = strtok(buffer, " \t\r\n");
+		{
+			std::vector<std::string> tokens = split_tokens(line);
+			const std::string &cmd = tokens[0];
 
-			if (!strcmp(cmd, ".model")) {
+			if (cmd == ".model") {
 				if (module != nullptr)
 					goto error;
 				module = new RTLIL::Module;
 				lastcell = nullptr;
-				char *name = strtok(NULL, " \t\r\n");
-				if (name == nullptr)
+				if (GetSize(tokens) < 2)
 					goto error;
-				module->name = RTLIL::escape_id(name);
+				module->name = RTLIL::escape_id(tokens[1]);
 				obj_attributes = &module->attributes;
 				obj_parameters = nullptr;
 				if (design->module(module->name))
@@ -183,13 +406,13 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 			if (module == nullptr)
 				goto error;
 
-			if (!strcmp(cmd, ".blackbox"))
+			if (cmd == ".blackbox")
 			{
 				module->attributes[ID::blackbox] = RTLIL::Const(1);
 				continue;
 			}
 
-			if (!strcmp(cmd, ".end"))
+			if (cmd == ".end")
 			{
 				for (auto &wp : wideports_cache)
 				{
@@ -256,26 +479,26 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 				continue;
 			}
 
-			if (!strcmp(cmd, ".area") || !strcmp(cmd, ".delay") || !strcmp(cmd, ".wire_load_slope") || !strcmp(cmd, ".wire") ||
-			    !strcmp(cmd, ".input_arrival") || !strcmp(cmd, ".default_input_arrival") || !strcmp(cmd, ".output_required") ||
-			    !strcmp(cmd, ".default_output_required") || !strcmp(cmd, ".input_drive") || !strcmp(cmd, ".default_input_drive") ||
-			    !strcmp(cmd, ".max_input_load") || !strcmp(cmd, ".default_max_input_load") || !strcmp(cmd, ".output_load") ||
-			    !strcmp(cmd, ".default_output_load"))
+			if (cmd == ".area" || cmd == ".delay" || cmd == ".wire_load_slope" || cmd == ".wire" ||
+			    cmd == ".input_arrival" || cmd == ".default_input_arrival" || cmd == ".output_required" ||
+			    cmd == ".default_output_required" || cmd == ".input_drive" || cmd == ".default_input_drive" ||
+			    cmd == ".max_input_load" || cmd == ".default_max_input_load" || cmd == ".output_load" ||
+			    cmd == ".default_output_load")
 			{
-				log_warning("Blif delay constraints (%s) are not supported.", cmd);
+				log_warning("Blif delay constraints (%s) are not supported.", cmd.c_str());
 				continue;
 			}
 
-			if (!strcmp(cmd, ".inputs") || !strcmp(cmd, ".outputs"))
+			if (cmd == ".inputs" || cmd == ".outputs")
 			{
-				char *p;
-				while ((p = strtok(NULL, " \t\r\n")) != NULL)
+				for (int i = 1; i < GetSize(tokens); i++)
 				{
-					RTLIL::IdString wire_name(stringf("\\%s", p));
+					const std::string &p = tokens[i];
+					RTLIL::IdString wire_name(stringf("\\%s", p.c_str()));
 					RTLIL::Wire *wire = module->wire(wire_name);
 					if (wire == nullptr)
 						wire = module->addWire(wire_name);
-					if (!strcmp(cmd, ".inputs"))
+					if (cmd == ".inputs")
 						wire->port_input = true;
 					else
 						wire->port_output = true;
@@ -284,7 +507,7 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 						std::pair<RTLIL::IdString, int> wp = wideports_split(p);
 						if (!wp.first.empty() && wp.second >= 0) {
 							wideports_cache[wp.first].first = std::max(wideports_cache[wp.first].first, wp.second + 1);
-							wideports_cache[wp.first].second = !strcmp(cmd, ".inputs");
+							wideports_cache[wp.first].second = cmd == ".inputs";
 						}
 					}
 				}
@@ -293,39 +516,46 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 				continue;
 			}
 
-			if (!strcmp(cmd, ".cname"))
+			if (cmd == ".cname")
 			{
-				char *p = strtok(NULL, " \t\r\n");
-				if (p == NULL)
+				if (GetSize(tokens) < 2)
 					goto error;
 
 				if(lastcell == nullptr || module == nullptr)
 				{
-					err_reason = stringf("No primitive object to attach .cname %s.", p);
+					err_reason = stringf("No primitive object to attach .cname %s.", tokens[1].c_str());
 					goto error_with_reason;
 				}
 
-				module->rename(lastcell, RTLIL::escape_id(p));
+				module->rename(lastcell, RTLIL::escape_id(tokens[1]));
 				continue;
 			}
 
-			if (!strcmp(cmd, ".attr") || !strcmp(cmd, ".param")) {
-				char *n = strtok(NULL, " \t\r\n");
-				char *v = strtok(NULL, "\r\n");
-				IdString id_n = RTLIL::escape_id(n);
+			if (cmd == ".attr" || cmd == ".param") {
+				// the value is the rest of the line after the name
+				const char *pos = line.begin, *n, *n_end;
+				next_token(pos, line.end, n, n_end);
+				if (!next_token(pos, line.end, n, n_end))
+					goto error;
+				while (pos < line.end && blif_space(*pos))
+					pos++;
+				if (pos == line.end)
+					goto error;
+				IdString id_n = RTLIL::escape_id(std::string(n, n_end));
+				std::string v(pos, line.end);
 				Const const_v;
 				if (v[0] == '"') {
-					std::string str(v+1);
-					if (str.back() == '"')
+					std::string str = v.substr(1);
+					if (!str.empty() && str.back() == '"')
 						str.resize(str.size()-1);
 					const_v = Const(str);
 				} else {
-					int n = strlen(v);
+					int n = GetSize(v);
 					const_v.bits.resize(n);
 					for (int i = 0; i < n; i++)
 						const_v.bits[i] = v[n-i-1] != '0' ? State::S1 : State::S0;
 				}
-				if (!strcmp(cmd, ".attr")) {
+				if (cmd == ".attr") {
 					if (obj_attributes == nullptr) {
 						err_reason = stringf("No object to attach .attr too.");
 						goto error_with_reason;
@@ -341,33 +571,33 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 				continue;
 			}
 
-			if (!strcmp(cmd, ".latch"))
+			if (cmd == ".latch")
 			{
-				char *d = strtok(NULL, " \t\r\n");
-				char *q = strtok(NULL, " \t\r\n");
-				char *edge = strtok(NULL, " \t\r\n");
-				char *clock = strtok(NULL, " \t\r\n");
-				char *init = strtok(NULL, " \t\r\n");
+				if (GetSize(tokens) < 3)
+					goto error;
+				tokens.resize(6);
+				const std::string &d = tokens[1], &q = tokens[2];
+				std::string edge = tokens[3], clock = tokens[4], init = tokens[5];
 				RTLIL::Cell *cell = nullptr;
 
-				if (clock == nullptr && edge != nullptr) {
+				if (clock.empty() && !edge.empty()) {
 					init = edge;
-					edge = nullptr;
+					edge.clear();
 				}
 
-				if (init != nullptr && (init[0] == '0' || init[0] == '1'))
+				if (!init.empty() && (init[0] == '0' || init[0] == '1'))
 					blif_wire(q)->attributes[ID::init] = Const(init[0] == '1' ? 1 : 0, 1);
 
-				if (clock == nullptr)
+				if (clock.empty())
 					goto no_latch_clock;
 
-				if (!strcmp(edge, "re"))
+				if (edge == "re")
 					cell = module->addDff(NEW_ID, blif_wire(clock), blif_wire(d), blif_wire(q));
-				else if (!strcmp(edge, "fe"))
+				else if (edge == "fe")
 					cell = module->addDff(NEW_ID, blif_wire(clock), blif_wire(d), blif_wire(q), false);
-				else if (!strcmp(edge, "ah"))
+				else if (edge == "ah")
 					cell = module->addDlatch(NEW_ID, blif_wire(clock), blif_wire(d), blif_wire(q));
-				else if (!strcmp(edge, "al"))
+				else if (edge == "al")
 					cell = module->addDlatch(NEW_ID, blif_wire(clock), blif_wire(d), blif_wire(q), false);
 				else {
 			no_latch_clock:
@@ -386,33 +616,33 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 				continue;
 			}
 
-			if (!strcmp(cmd, ".gate") || !strcmp(cmd, ".subckt"))
+			if (cmd == ".gate" || cmd == ".subckt")
 			{
-				char *p = strtok(NULL, " \t\r\n");
-				if (p == NULL)
+				if (GetSize(tokens) < 2)
 					goto error;
 
-				IdString celltype = RTLIL::escape_id(p);
+				IdString celltype = RTLIL::escape_id(tokens[1]);
 				RTLIL::Cell *cell = module->addCell(NEW_ID, celltype);
 				RTLIL::Module *cell_mod = design->module(celltype);
 
 				dict<RTLIL::IdString, dict<int, SigBit>> cell_wideports_cache;
 
-				while ((p = strtok(NULL, " \t\r\n")) != NULL)
+				for (int i = 2; i < GetSize(tokens); i++)
 				{
-					char *q = strchr(p, '=');
-					if (q == NULL || !q[0])
+					const std::string &conn = tokens[i];
+					size_t eq = conn.find('=');
+					if (eq == std::string::npos)
 						goto error;
-					*(q++) = 0;
+					std::string p = conn.substr(0, eq), q = conn.substr(eq + 1);
 
 					if (wideports) {
 						std::pair<RTLIL::IdString, int> wp = wideports_split(p);
 						if (wp.first.empty())
-							cell->setPort(RTLIL::escape_id(p), *q ? blif_wire(q) : SigSpec());
+							cell->setPort(RTLIL::escape_id(p), !q.empty() ? blif_wire(q) : SigSpec());
 						else
 							cell_wideports_cache[wp.first][wp.second] = blif_wire(q);
 					} else {
-						cell->setPort(RTLIL::escape_id(p), *q ? blif_wire(q) : SigSpec());
+						cell->setPort(RTLIL::escape_id(p), !q.empty() ? blif_wire(q) : SigSpec());
 					}
 				}
 
@@ -455,164 +685,88 @@ void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool
 			obj_attributes = nullptr;
 			obj_parameters = nullptr;
 
-			if (!strcmp(cmd, ".barbuf") || !strcmp(cmd, ".conn"))
+			if (cmd == ".barbuf" || cmd == ".conn")
 			{
-				char *p = strtok(NULL, " \t\r\n");
-				if (p == NULL)
-					goto error;
-
-				char *q = strtok(NULL, " \t\r\n");
-				if (q == NULL)
+				if (GetSize(tokens) < 3)
 					goto error;
 
-				module->connect(blif_wire(q), blif_wire(p));
+				module->connect(blif_wire(tokens[2]), blif_wire(tokens[1]));
 				continue;
 			}
 
-			if (!strcmp(cmd, ".names"))
+			if (cmd == ".names")
 			{
-				char *p;
+				const blif_cover_t &cover = covers[next_cover++];
+				log_assert(cover.names_line == line_idx);
+				if (cover.width < 0)
+					goto error;
+
 				RTLIL::SigSpec input_sig, output_sig;
-				while ((p = strtok(NULL, " \t\r\n")) != NULL)
-					input_sig.append(blif_wire(p));
+				for (int i = 1; i < GetSize(tokens); i++)
+					input_sig.append(blif_wire(tokens[i]));
 				output_sig = input_sig.extract(input_sig.size()-1, 1);
 				input_sig = input_sig.extract(0, input_sig.size()-1);
 
+				// continue after the rows of the cover
+				line_idx = cover.end_line - 1;
+
 				if (input_sig.size() == 0)
 				{
-					RTLIL::State state = RTLIL::State::Sa;
-					while (1) {
-						if (!read_next_line(buffer, buffer_size, line_count, f))
-							goto error;
-						for (int i = 0; buffer[i]; i++) {
-							if (buffer[i] == ' ' || buffer[i] == '\t')
-								continue;
-							if (i == 0 && buffer[i] == '.')
-								goto finished_parsing_constval;
-							if (buffer[i] == '0') {
-								if (state == RTLIL::State::S1)
-									goto error;
-								state = RTLIL::State::S0;
-								continue;
-							}
-							if (buffer[i] == '1') {
-								if (state == RTLIL::State::S0)
-									goto error;
-								state = RTLIL::State::S1;
-								continue;
-							}
-							goto error;
-						}
+					if (cover.error_line_no) {
+						line_count = cover.error_line_no;
+						goto error;
 					}
-
-				finished_parsing_constval:
-					if (state == RTLIL::State::Sa)
-						state = RTLIL::State::S0;
+					RTLIL::State state = cover.table[0];
 					if (output_sig.as_wire()->name == ID($undef))
 						state = RTLIL::State::Sx;
 					module->connect(RTLIL::SigSig(output_sig, state));
-					goto continue_without_read;
+					continue;
 				}
 
-				if (sop_mode)
-				{
-					sopcell = module->addCell(NEW_ID, ID($sop));
-					sopcell->parameters[ID::WIDTH] = RTLIL::Const(input_sig.size());
-					sopcell->parameters[ID::DEPTH] = 0;
-					sopcell->parameters[ID::TABLE] = RTLIL::Const();
-					sopcell->setPort(ID::A, input_sig);
-					sopcell->setPort(ID::Y, output_sig);
-					sopmode = -1;
-					lastcell = sopcell;
-				}
-				else if (input_sig.size() > lut_input_plane_limit)
+				if (!sop_mode && input_sig.size() > lut_input_plane_limit)
 				{
 					err_reason = stringf("names' input plane must have fewer than %d signals.", lut_input_plane_limit + 1);
 					goto error_with_reason;
 				}
+
+				if (cover.error_line_no) {
+					line_count = cover.error_line_no;
+					goto error;
+				}
+
+				if (sop_mode)
+				{
+					RTLIL::Cell *cell = module->addCell(NEW_ID, ID($sop));
+					cell->parameters[ID::WIDTH] = RTLIL::Const(input_sig.size());
+					cell->parameters[ID::DEPTH] = cover.depth;
+					cell->parameters[ID::TABLE] = cover.table;
+					cell->setPort(ID::A, input_sig);
+					cell->setPort(ID::Y, output_sig);
+					if (cover.inverted) {
+						SigSpec tempnet = module->addWire(NEW_ID);
+						module->addNotGate(NEW_ID, tempnet, output_sig);
+						cell->setPort(ID::Y, tempnet);
+					}
+					lastcell = cell;
+				}
 				else
 				{
 					RTLIL::Cell *cell = module->addCell(NEW_ID, ID($lut));
 					cell->parameters[ID::WIDTH] = RTLIL::Const(input_sig.size());
-					cell->parameters[ID::LUT] = RTLIL::Const(RTLIL::State::Sx, 1 << input_sig.size());
+					cell->parameters[ID::LUT] = cover.table;
 					cell->setPort(ID::A, input_sig);
 					cell->setPort(ID::Y, output_sig);
-					lutptr = &cell->parameters.at(ID::LUT);
-					lut_default_state = RTLIL::State::Sx;
 					lastcell = cell;
 				}
 				continue;
 			}
-
-			goto error;
 		}
 
-		if (lutptr == NULL && sopcell == NULL)
-			goto error;
-
-		char *input = strtok(buffer, " \t\r\n");
-		char *output = strtok(NULL, " \t\r\n");
-
-		if (input == NULL || output == NULL || (strcmp(output, "0") && strcmp(output, "1")))
-			goto error;
-
-		int input_len = strlen(input);
-
-		if (sopcell)
-		{
-			log_assert(sopcell->parameters[ID::WIDTH].as_int() == input_len);
-			sopcell->parameters[ID::DEPTH] = sopcell->parameters[ID::DEPTH].as_int() + 1;
-
-			for (int i = 0; i < input_len; i++)
-				switch (input[i]) {
-					case '0':
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S1);
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S0);
-						break;
-					case '1':
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S0);
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S1);
-						break;
-					default:
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S0);
-						sopcell->parameters[ID::TABLE].bits.push_back(State::S0);
-						break;
-				}
-
-			if (sopmode == -1) {
-				sopmode = (*output == '1');
-				if (!sopmode) {
-					SigSpec outnet = sopcell->getPort(ID::Y);
-					SigSpec tempnet = module->addWire(NEW_ID);
-					module->addNotGate(NEW_ID, tempnet, outnet);
-					sopcell->setPort(ID::Y, tempnet);
-				}
-			} else
-				log_assert(sopmode == (*output == '1'));
-		}
-
-		if (lutptr)
-		{
-			if (input_len > lut_input_plane_limit)
-				goto error;
-
-			for (int i = 0; i < (1 << input_len); i++) {
-				for (int j = 0; j < input_len; j++) {
-					char c1 = input[j];
-					if (c1 != '-') {
-						char c2 = (i & (1 << j)) != 0 ? '1' : '0';
-						if (c1 != c2)
-							goto try_next_value;
-					}
-				}
-				lutptr->bits.at(i) = !strcmp(output, "0") ? RTLIL::State::S0 : RTLIL::State::S1;
-			try_next_value:;
-			}
-
-			lut_default_state = !strcmp(output, "0") ? RTLIL::State::S1 : RTLIL::State::S0;
-		}
+		goto error;
 	}
 
+	if (module != nullptr)
+		goto error;
 	return;
 
 error:
@@ -621,6 +775,22 @@ error_with_reason:
 	log_error("Syntax error in line %d: %s\n", line_count, err_reason.c_str());
 }
 
+void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name, bool run_clean, bool sop_mode, bool wideports)
+{
+	std::string buffer;
+	buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	parse_blif(design, buffer.data(), buffer.size(), dff_name, run_clean, sop_mode, wideports);
+}
+
+bool parse_blif_file(RTLIL::Design *design, const std::string &filename, IdString dff_name, bool run_clean, bool sop_mode, bool wideports)
+{
+	blif_file_t file;
+	if (!file.read(filename))
+		return false;
+	parse_blif(design, file.data, file.size, dff_name, run_clean, sop_mode, wideports);
+	return true;
+}
+
 struct BlifFrontend : public Frontend {
 	BlifFrontend() : Frontend("blif", "read BLIF file") { }
 	void help() override
@@ -661,6 +831,10 @@ struct BlifFrontend : public Frontend {
 		}
 		extra_args(f, filename, args, argidx);
 
+		// map plain files instead of reading them through the stream
+		if (dynamic_cast<std::ifstream*>(f) != nullptr && parse_blif_file(design, filename, "", true, sop_mode, wideports))
+			return;
+
 		parse_blif(design, *f, "", true, sop_mode, wideports);
 	}
 } BlifFrontend;
@@ -26,6 +26,13 @@ YOSYS_NAMESPACE_BEGIN
 
 extern void parse_blif(RTLIL::Design *design, std::istream &f, IdString dff_name,
 		bool run_clean = false, bool sop_mode = false, bool wideports = false);
+extern void parse_blif(RTLIL::Design *design, const char *data, size_t size, IdString dff_name,
+		bool run_clean = false, bool sop_mode = false, bool wideports = false);
+
+// Reads a BLIF file, memory-mapped where possible. Returns false if the
+// file can't be read.
+extern bool parse_blif_file(RTLIL::Design *design, const std::string &filename, IdString dff_name,
+		bool run_clean = false, bool sop_mode = false, bool wideports = false);
 
 YOSYS_NAMESPACE_END
 
@@ -287,337 +287,490 @@ void json_parse_attr_param(dict<IdString, Const> &results, JsonNode *node)
 	}
 }
 
-void json_import(Design *design, string &modname, JsonNode *node)
+// Reads the top-level structure of a JSON file incrementally, so that only
+// the subtree of a single port, netname, cell or memory is held as JsonNode
+// tree at any time.
+struct JsonReader
 {
-	log("Importing module %s from JSON tree.\n", modname.c_str());
+	std::istream &f;
 
-	Module *module = new RTLIL::Module;
-	module->name = RTLIL::escape_id(modname.c_str());
+	JsonReader(std::istream &f) : f(f) { }
 
-	if (design->module(module->name))
-		log_error("Re-definition of module %s.\n", log_id(module->name));
-
-	design->add(module);
-
-	if (node->data_dict.count("attributes"))
-		json_parse_attr_param(module->attributes, node->data_dict.at("attributes"));
-
-	dict<int, SigBit> signal_bits;
+	// skip whitespace and the given separator, return the next character
+	int peek(int separator = 0)
+	{
+		while (1) {
+			int ch = f.peek();
+			if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n' && (ch != separator || ch == 0))
+				return ch;
+			f.get();
+		}
+	}
 
-	if (node->data_dict.count("ports"))
+	void begin_dict(const char *what)
 	{
-		JsonNode *ports_node = node->data_dict.at("ports");
+		if (peek() != '{')
+			log_error("JSON %s node is not a dictionary.\n", what);
+		f.get();
+	}
 
-		if (ports_node->type != 'D')
-			log_error("JSON ports node is not a dictionary.\n");
+	// read the next key of a dict and the separator after it, return false
+	// at the end of the dict
+	bool next_key(string &key)
+	{
+		int ch = peek(',');
 
-		for (int port_id = 1; port_id <= GetSize(ports_node->data_dict_keys); port_id++)
-		{
-			IdString port_name = RTLIL::escape_id(ports_node->data_dict_keys[port_id-1].c_str());
-			JsonNode *port_node = ports_node->data_dict.at(ports_node->data_dict_keys[port_id-1]);
+		if (ch == EOF)
+			log_error("Unexpected EOF in JSON file.\n");
 
-			if (port_node->type != 'D')
-				log_error("JSON port node '%s' is not a dictionary.\n", log_id(port_name));
+		if (ch == '}') {
+			f.get();
+			return false;
+		}
 
-			if (port_node->data_dict.count("direction") == 0)
-				log_error("JSON port node '%s' has no direction attribute.\n", log_id(port_name));
+		JsonNode key_node(f);
+		if (key_node.type != 'S')
+			log_error("Unexpected non-string key in JSON dict.\n");
+		key.swap(key_node.data_string);
 
-			if (port_node->data_dict.count("bits") == 0)
-				log_error("JSON port node '%s' has no bits attribute.\n", log_id(port_name));
+		if (peek(':') == EOF)
+			log_error("Unexpected EOF in JSON file.\n");
+		return true;
+	}
 
-			JsonNode *port_direction_node = port_node->data_dict.at("direction");
-			JsonNode *port_bits_node = port_node->data_dict.at("bits");
+	JsonNode *value()
+	{
+		return new JsonNode(f);
+	}
 
-			if (port_direction_node->type != 'S')
-				log_error("JSON port node '%s' has non-string direction attribute.\n", log_id(port_name));
+	void skip_value()
+	{
+		JsonNode node(f);
+	}
+};
 
-			if (port_bits_node->type != 'A')
-				log_error("JSON port node '%s' has non-array bits attribute.\n", log_id(port_name));
+// Constant bits are coded with values outside of the range of signal bit ids,
+// so that the bits of a port or connection can be stored as a flat vector
+// until they are resolved at the end of the module.
+static const int64_t JSON_CONST_BIT = int64_t(1) << 40;
 
-			Wire *port_wire = module->wire(port_name);
+bool json_parse_bit(JsonNode *bitval_node, int64_t &code)
+{
+	if (bitval_node->type == 'S') {
+		if (bitval_node->data_string == "0")
+			code = JSON_CONST_BIT + State::S0;
+		else if (bitval_node->data_string == "1")
+			code = JSON_CONST_BIT + State::S1;
+		else if (bitval_node->data_string == "x")
+			code = JSON_CONST_BIT + State::Sx;
+		else if (bitval_node->data_string == "z")
+			code = JSON_CONST_BIT + State::Sz;
+		else
+			return false;
+		return true;
+	}
+	if (bitval_node->type == 'N') {
+		code = int(bitval_node->data_number);
+		return true;
+	}
+	return false;
+}
 
-			if (port_wire == nullptr)
-				port_wire = module->addWire(port_name, GetSize(port_bits_node->data_array));
+struct JsonImporter
+{
+	Design *design;
+	Module *module;
 
-			if (port_node->data_dict.count("upto") != 0) {
-				JsonNode *val = port_node->data_dict.at("upto");
-				if (val->type == 'N')
-					port_wire->upto = val->data_number != 0;
-			}
+	// the bits of ports, netnames and cell connections in the order they
+	// were read
+	vector<std::pair<Wire*, vector<int64_t>>> port_bits, net_bits;
+	vector<std::pair<std::pair<Cell*, IdString>, vector<int64_t>>> conn_bits;
 
-			if (port_node->data_dict.count("signed") != 0) {
-				JsonNode *val = port_node->data_dict.at("signed");
-				if (val->type == 'N')
-					port_wire->is_signed = val->data_number != 0;
-			}
+	// signal bit ids are usually dense, ids out of range of the flat array
+	// are kept in a dict
+	vector<SigBit> flat_bits;
+	dict<int, SigBit> sparse_bits;
+	int flat_limit;
 
-			if (port_node->data_dict.count("offset") != 0) {
-				JsonNode *val = port_node->data_dict.at("offset");
-				if (val->type == 'N')
-					port_wire->start_offset = val->data_number;
-			}
+	JsonImporter(Design *design) : design(design), module(nullptr), flat_limit(0) { }
 
-			if (port_direction_node->data_string == "input") {
-				port_wire->port_input = true;
-			} else
-			if (port_direction_node->data_string == "output") {
-				port_wire->port_output = true;
-			} else
-			if (port_direction_node->data_string == "inout") {
-				port_wire->port_input = true;
-				port_wire->port_output = true;
-			} else
-				log_error("JSON port node '%s' has invalid '%s' direction attribute.\n", log_id(port_name), port_direction_node->data_string.c_str());
-
-			port_wire->port_id = port_id;
-
-			for (int i = 0; i < GetSize(port_bits_node->data_array); i++)
-			{
-				JsonNode *bitval_node = port_bits_node->data_array.at(i);
-				SigBit sigbit(port_wire, i);
-
-				if (bitval_node->type == 'S') {
-					if (bitval_node->data_string == "0")
-						module->connect(sigbit, State::S0);
-					else if (bitval_node->data_string == "1")
-						module->connect(sigbit, State::S1);
-					else if (bitval_node->data_string == "x")
-						module->connect(sigbit, State::Sx);
-					else if (bitval_node->data_string == "z")
-						module->connect(sigbit, State::Sz);
-					else
-						log_error("JSON port node '%s' has invalid '%s' bit string value on bit %d.\n",
-								log_id(port_name), bitval_node->data_string.c_str(), i);
-				} else
-				if (bitval_node->type == 'N') {
-					int bitidx = bitval_node->data_number;
-					if (signal_bits.count(bitidx)) {
-						if (port_wire->port_output) {
-							module->connect(sigbit, signal_bits.at(bitidx));
-						} else {
-							module->connect(signal_bits.at(bitidx), sigbit);
-							signal_bits[bitidx] = sigbit;
-						}
-					} else {
-						signal_bits[bitidx] = sigbit;
-					}
-				} else
-					log_error("JSON port node '%s' has invalid bit value on bit %d.\n", log_id(port_name), i);
-			}
+	SigBit *lookup_bit(int bitidx)
+	{
+		if (0 <= bitidx && bitidx < flat_limit) {
+			if (bitidx >= GetSize(flat_bits) || flat_bits[bitidx].wire == nullptr)
+				return nullptr;
+			return &flat_bits[bitidx];
 		}
+		auto it = sparse_bits.find(bitidx);
+		return it == sparse_bits.end() ? nullptr : &it->second;
+	}
 
-		module->fixup_ports();
+	void set_bit(int bitidx, SigBit bit)
+	{
+		if (0 <= bitidx && bitidx < flat_limit) {
+			if (bitidx >= GetSize(flat_bits))
+				flat_bits.resize(bitidx + 1);
+			flat_bits[bitidx] = bit;
+		} else
+			sparse_bits[bitidx] = bit;
 	}
 
-	if (node->data_dict.count("netnames"))
+	vector<int64_t> parse_bits(JsonNode *bits_node, const char *what, IdString name)
 	{
-		JsonNode *netnames_node = node->data_dict.at("netnames");
+		vector<int64_t> bits;
+		bits.reserve(GetSize(bits_node->data_array));
+		for (int i = 0; i < GetSize(bits_node->data_array); i++) {
+			JsonNode *bitval_node = bits_node->data_array.at(i);
+			int64_t code;
+			if (!json_parse_bit(bitval_node, code)) {
+				if (bitval_node->type == 'S')
+					log_error("JSON %s node '%s' has invalid '%s' bit string value on bit %d.\n",
+							what, log_id(name), bitval_node->data_string.c_str(), i);
+				log_error("JSON %s node '%s' has invalid bit value on bit %d.\n", what, log_id(name), i);
+			}
+			bits.push_back(code);
+		}
+		return bits;
+	}
 
-		if (netnames_node->type != 'D')
-			log_error("JSON netnames node is not a dictionary.\n");
+	void parse_port(const string &name, JsonNode *port_node, int port_id)
+	{
+		IdString port_name = RTLIL::escape_id(name.c_str());
 
-		for (auto &net : netnames_node->data_dict)
-		{
-			IdString net_name = RTLIL::escape_id(net.first.c_str());
-			JsonNode *net_node = net.second;
+		if (port_node->type != 'D')
+			log_error("JSON port node '%s' is not a dictionary.\n", log_id(port_name));
 
-			if (net_node->type != 'D')
-				log_error("JSON netname node '%s' is not a dictionary.\n", log_id(net_name));
+		if (port_node->data_dict.count("direction") == 0)
+			log_error("JSON port node '%s' has no direction attribute.\n", log_id(port_name));
 
-			if (net_node->data_dict.count("bits") == 0)
-				log_error("JSON netname node '%s' has no bits attribute.\n", log_id(net_name));
+		if (port_node->data_dict.count("bits") == 0)
+			log_error("JSON port node '%s' has no bits attribute.\n", log_id(port_name));
 
-			JsonNode *bits_node = net_node->data_dict.at("bits");
+		JsonNode *port_direction_node = port_node->data_dict.at("direction");
+		JsonNode *port_bits_node = port_node->data_dict.at("bits");
 
-			if (bits_node->type != 'A')
-				log_error("JSON netname node '%s' has non-array bits attribute.\n", log_id(net_name));
+		if (port_direction_node->type != 'S')
+			log_error("JSON port node '%s' has non-string direction attribute.\n", log_id(port_name));
 
-			Wire *wire = module->wire(net_name);
+		if (port_bits_node->type != 'A')
+			log_error("JSON port node '%s' has non-array bits attribute.\n", log_id(port_name));
 
-			if (wire == nullptr)
-				wire = module->addWire(net_name, GetSize(bits_node->data_array));
+		Wire *port_wire = module->wire(port_name);
 
-			if (net_node->data_dict.count("upto") != 0) {
-				JsonNode *val = net_node->data_dict.at("upto");
-				if (val->type == 'N')
-					wire->upto = val->data_number != 0;
-			}
+		if (port_wire == nullptr)
+			port_wire = module->addWire(port_name, GetSize(port_bits_node->data_array));
 
-			if (net_node->data_dict.count("offset") != 0) {
-				JsonNode *val = net_node->data_dict.at("offset");
-				if (val->type == 'N')
-					wire->start_offset = val->data_number;
-			}
+		if (port_node->data_dict.count("upto") != 0) {
+			JsonNode *val = port_node->data_dict.at("upto");
+			if (val->type == 'N')
+				port_wire->upto = val->data_number != 0;
+		}
 
-			for (int i = 0; i < GetSize(bits_node->data_array); i++)
-			{
-				JsonNode *bitval_node = bits_node->data_array.at(i);
-				SigBit sigbit(wire, i);
-
-				if (bitval_node->type == 'S') {
-					if (bitval_node->data_string == "0")
-						module->connect(sigbit, State::S0);
-					else if (bitval_node->data_string == "1")
-						module->connect(sigbit, State::S1);
-					else if (bitval_node->data_string == "x")
-						module->connect(sigbit, State::Sx);
-					else if (bitval_node->data_string == "z")
-						module->connect(sigbit, State::Sz);
-					else
-						log_error("JSON netname node '%s' has invalid '%s' bit string value on bit %d.\n",
-								log_id(net_name), bitval_node->data_string.c_str(), i);
-				} else
-				if (bitval_node->type == 'N') {
-					int bitidx = bitval_node->data_number;
-					if (signal_bits.count(bitidx)) {
-						if (sigbit != signal_bits.at(bitidx))
-							module->connect(sigbit, signal_bits.at(bitidx));
-					} else {
-						signal_bits[bitidx] = sigbit;
-					}
-				} else
-					log_error("JSON netname node '%s' has invalid bit value on bit %d.\n", log_id(net_name), i);
-			}
+		if (port_node->data_dict.count("signed") != 0) {
+			JsonNode *val = port_node->data_dict.at("signed");
+			if (val->type == 'N')
+				port_wire->is_signed = val->data_number != 0;
+		}
 
-			if (net_node->data_dict.count("attributes"))
-				json_parse_attr_param(wire->attributes, net_node->data_dict.at("attributes"));
+		if (port_node->data_dict.count("offset") != 0) {
+			JsonNode *val = port_node->data_dict.at("offset");
+			if (val->type == 'N')
+				port_wire->start_offset = val->data_number;
 		}
+
+		if (port_direction_node->data_string == "input") {
+			port_wire->port_input = true;
+		} else
+		if (port_direction_node->data_string == "output") {
+			port_wire->port_output = true;
+		} else
+		if (port_direction_node->data_string == "inout") {
+			port_wire->port_input = true;
+			port_wire->port_output = true;
+		} else
+			log_error("JSON port node '%s' has invalid '%s' direction attribute.\n", log_id(port_name), port_direction_node->data_string.c_str());
+
+		port_wire->port_id = port_id;
+		port_bits.push_back(std::make_pair(port_wire, parse_bits(port_bits_node, "port", port_name)));
 	}
 
-	if (node->data_dict.count("cells"))
+	void parse_netname(const string &name, JsonNode *net_node)
 	{
-		JsonNode *cells_node = node->data_dict.at("cells");
+		IdString net_name = RTLIL::escape_id(name.c_str());
 
-		if (cells_node->type != 'D')
-			log_error("JSON cells node is not a dictionary.\n");
+		if (net_node->type != 'D')
+			log_error("JSON netname node '%s' is not a dictionary.\n", log_id(net_name));
 
-		for (auto &cell_node_it : cells_node->data_dict)
-		{
-			IdString cell_name = RTLIL::escape_id(cell_node_it.first.c_str());
-			JsonNode *cell_node = cell_node_it.second;
+		if (net_node->data_dict.count("bits") == 0)
+			log_error("JSON netname node '%s' has no bits attribute.\n", log_id(net_name));
 
-			if (cell_node->type != 'D')
-				log_error("JSON cells node '%s' is not a dictionary.\n", log_id(cell_name));
+		JsonNode *bits_node = net_node->data_dict.at("bits");
 
-			if (cell_node->data_dict.count("type") == 0)
-				log_error("JSON cells node '%s' has no type attribute.\n", log_id(cell_name));
+		if (bits_node->type != 'A')
+			log_error("JSON netname node '%s' has non-array bits attribute.\n", log_id(net_name));
 
-			JsonNode *type_node = cell_node->data_dict.at("type");
+		Wire *wire = module->wire(net_name);
 
-			if (type_node->type != 'S')
-				log_error("JSON cells node '%s' has a non-string type.\n", log_id(cell_name));
+		if (wire == nullptr)
+			wire = module->addWire(net_name, GetSize(bits_node->data_array));
 
-			IdString cell_type = RTLIL::escape_id(type_node->data_string.c_str());
+		if (net_node->data_dict.count("upto") != 0) {
+			JsonNode *val = net_node->data_dict.at("upto");
+			if (val->type == 'N')
+				wire->upto = val->data_number != 0;
+		}
 
-			Cell *cell = module->addCell(cell_name, cell_type);
+		if (net_node->data_dict.count("offset") != 0) {
+			JsonNode *val = net_node->data_dict.at("offset");
+			if (val->type == 'N')
+				wire->start_offset = val->data_number;
+		}
 
-			if (cell_node->data_dict.count("connections") == 0)
-				log_error("JSON cells node '%s' has no connections attribute.\n", log_id(cell_name));
+		net_bits.push_back(std::make_pair(wire, parse_bits(bits_node, "netname", net_name)));
 
-			JsonNode *connections_node = cell_node->data_dict.at("connections");
+		if (net_node->data_dict.count("attributes"))
+			json_parse_attr_param(wire->attributes, net_node->data_dict.at("attributes"));
+	}
 
-			if (connections_node->type != 'D')
-				log_error("JSON cells node '%s' has non-dictionary connections attribute.\n", log_id(cell_name));
+	void parse_cell(const string &name, JsonNode *cell_node)
+	{
+		IdString cell_name = RTLIL::escape_id(name.c_str());
 
-			for (auto &conn_it : connections_node->data_dict)
-			{
-				IdString conn_name = RTLIL::escape_id(conn_it.first.c_str());
-				JsonNode *conn_node = conn_it.second;
+		if (cell_node->type != 'D')
+			log_error("JSON cells node '%s' is not a dictionary.\n", log_id(cell_name));
 
-				if (conn_node->type != 'A')
-					log_error("JSON cells node '%s' connection '%s' is not an array.\n", log_id(cell_name), log_id(conn_name));
+		if (cell_node->data_dict.count("type") == 0)
+			log_error("JSON cells node '%s' has no type attribute.\n", log_id(cell_name));
 
-				SigSpec sig;
+		JsonNode *type_node = cell_node->data_dict.at("type");
 
-				for (int i = 0; i < GetSize(conn_node->data_array); i++)
-				{
-					JsonNode *bitval_node = conn_node->data_array.at(i);
-
-					if (bitval_node->type == 'S') {
-						if (bitval_node->data_string == "0")
-							sig.append(State::S0);
-						else if (bitval_node->data_string == "1")
-							sig.append(State::S1);
-						else if (bitval_node->data_string == "x")
-							sig.append(State::Sx);
-						else if (bitval_node->data_string == "z")
-							sig.append(State::Sz);
-						else
-							log_error("JSON cells node '%s' connection '%s' has invalid '%s' bit string value on bit %d.\n",
-									log_id(cell_name), log_id(conn_name), bitval_node->data_string.c_str(), i);
-					} else
-					if (bitval_node->type == 'N') {
-						int bitidx = bitval_node->data_number;
-						if (signal_bits.count(bitidx) == 0)
-							signal_bits[bitidx] = module->addWire(NEW_ID);
-						sig.append(signal_bits.at(bitidx));
-					} else
-						log_error("JSON cells node '%s' connection '%s' has invalid bit value on bit %d.\n",
-								log_id(cell_name), log_id(conn_name), i);
+		if (type_node->type != 'S')
+			log_error("JSON cells node '%s' has a non-string type.\n", log_id(cell_name));
+
+		IdString cell_type = RTLIL::escape_id(type_node->data_string.c_str());
+
+		Cell *cell = module->addCell(cell_name, cell_type);
+
+		if (cell_node->data_dict.count("connections") == 0)
+			log_error("JSON cells node '%s' has no connections attribute.\n", log_id(cell_name));
 
+		JsonNode *connections_node = cell_node->data_dict.at("connections");
+
+		if (connections_node->type != 'D')
+			log_error("JSON cells node '%s' has non-dictionary connections attribute.\n", log_id(cell_name));
+
+		for (auto &conn_key : connections_node->data_dict_keys)
+		{
+			IdString conn_name = RTLIL::escape_id(conn_key.c_str());
+			JsonNode *conn_node = connections_node->data_dict.at(conn_key);
+
+			if (conn_node->type != 'A')
+				log_error("JSON cells node '%s' connection '%s' is not an array.\n", log_id(cell_name), log_id(conn_name));
+
+			vector<int64_t> bits;
+			for (int i = 0; i < GetSize(conn_node->data_array); i++) {
+				JsonNode *bitval_node = conn_node->data_array.at(i);
+				int64_t code;
+				if (!json_parse_bit(bitval_node, code)) {
+					if (bitval_node->type == 'S')
+						log_error("JSON cells node '%s' connection '%s' has invalid '%s' bit string value on bit %d.\n",
+								log_id(cell_name), log_id(conn_name), bitval_node->data_string.c_str(), i);
+					log_error("JSON cells node '%s' connection '%s' has invalid bit value on bit %d.\n",
+							log_id(cell_name), log_id(conn_name), i);
 				}
+				bits.push_back(code);
+			}
+			conn_bits.push_back(std::make_pair(std::make_pair(cell, conn_name), std::move(bits)));
+		}
+
+		if (cell_node->data_dict.count("attributes"))
+			json_parse_attr_param(cell->attributes, cell_node->data_dict.at("attributes"));
+
+		if (cell_node->data_dict.count("parameters"))
+			json_parse_attr_param(cell->parameters, cell_node->data_dict.at("parameters"));
+	}
+
+	void parse_memory(const string &name, JsonNode *memory_node)
+	{
+		IdString memory_name = RTLIL::escape_id(name.c_str());
+
+		if (memory_node->type != 'D')
+			log_error("JSON memory node '%s' is not a dictionary.\n", log_id(memory_name));
+
+		if (memory_node->data_dict.count("width") == 0)
+			log_error("JSON memory node '%s' has no width attribute.\n", log_id(memory_name));
+		JsonNode *width_node = memory_node->data_dict.at("width");
+		if (width_node->type != 'N')
+			log_error("JSON memory node '%s' has a non-number width.\n", log_id(memory_name));
+
+		if (memory_node->data_dict.count("size") == 0)
+			log_error("JSON memory node '%s' has no size attribute.\n", log_id(memory_name));
+		JsonNode *size_node = memory_node->data_dict.at("size");
+		if (size_node->type != 'N')
+			log_error("JSON memory node '%s' has a non-number size.\n", log_id(memory_name));
+
+		RTLIL::Memory *mem = new RTLIL::Memory;
+		mem->name = memory_name;
+		mem->width = width_node->data_number;
+		mem->size = size_node->data_number;
+
+		mem->start_offset = 0;
+		if (memory_node->data_dict.count("start_offset") != 0) {
+			JsonNode *val = memory_node->data_dict.at("start_offset");
+			if (val->type == 'N')
+				mem->start_offset = val->data_number;
+		}
+
+		if (memory_node->data_dict.count("attributes"))
+			json_parse_attr_param(mem->attributes, memory_node->data_dict.at("attributes"));
+
+		module->memories[mem->name] = mem;
+	}
 
-				cell->setPort(conn_name, sig);
+	// connect the bits of all ports, then netnames, then cells, like the
+	// sections were found in this order
+	void resolve_bits()
+	{
+		int64_t total_bits = 0;
+		for (auto &it : port_bits)
+			total_bits += GetSize(it.second);
+		for (auto &it : net_bits)
+			total_bits += GetSize(it.second);
+		for (auto &it : conn_bits)
+			total_bits += GetSize(it.second);
+		flat_limit = std::min<int64_t>(total_bits + 1024, std::numeric_limits<int>::max());
+
+		for (auto &it : port_bits)
+			for (int i = 0; i < GetSize(it.second); i++)
+			{
+				SigBit sigbit(it.first, i);
+				int64_t code = it.second[i];
+				if (code >= JSON_CONST_BIT) {
+					module->connect(sigbit, State(code - JSON_CONST_BIT));
+					continue;
+				}
+				SigBit *bit = lookup_bit(code);
+				if (bit == nullptr)
+					set_bit(code, sigbit);
+				else if (it.first->port_output)
+					module->connect(sigbit, *bit);
+				else {
+					module->connect(*bit, sigbit);
+					*bit = sigbit;
+				}
 			}
 
-			if (cell_node->data_dict.count("attributes"))
-				json_parse_attr_param(cell->attributes, cell_node->data_dict.at("attributes"));
+		for (auto &it : net_bits)
+			for (int i = 0; i < GetSize(it.second); i++)
+			{
+				SigBit sigbit(it.first, i);
+				int64_t code = it.second[i];
+				if (code >= JSON_CONST_BIT) {
+					module->connect(sigbit, State(code - JSON_CONST_BIT));
+					continue;
+				}
+				SigBit *bit = lookup_bit(code);
+				if (bit == nullptr)
+					set_bit(code, sigbit);
+				else if (sigbit != *bit)
+					module->connect(sigbit, *bit);
+			}
 
-			if (cell_node->data_dict.count("parameters"))
-				json_parse_attr_param(cell->parameters, cell_node->data_dict.at("parameters"));
+		for (auto &it : conn_bits)
+		{
+			SigSpec sig;
+			for (int64_t code : it.second) {
+				if (code >= JSON_CONST_BIT) {
+					sig.append(State(code - JSON_CONST_BIT));
+					continue;
+				}
+				SigBit *bit = lookup_bit(code);
+				if (bit == nullptr) {
+					set_bit(code, module->addWire(NEW_ID));
+					bit = lookup_bit(code);
+				}
+				sig.append(*bit);
+			}
+			it.first.first->setPort(it.first.second, sig);
 		}
+
+		port_bits.clear();
+		net_bits.clear();
+		conn_bits.clear();
+		flat_bits.clear();
+		sparse_bits.clear();
 	}
 
-	if (node->data_dict.count("memories"))
+	void import_module(JsonReader &reader, const string &modname)
 	{
-		JsonNode *memories_node = node->data_dict.at("memories");
+		log("Importing module %s from JSON tree.\n", modname.c_str());
+
+		module = new RTLIL::Module;
+		module->name = RTLIL::escape_id(modname.c_str());
 
-		if (memories_node->type != 'D')
-			log_error("JSON memories node is not a dictionary.\n");
+		if (design->module(module->name))
+			log_error("Re-definition of module %s.\n", log_id(module->name));
 
-		for (auto &memory_node_it : memories_node->data_dict)
+		design->add(module);
+
+		string key, name;
+		reader.begin_dict("module");
+		while (reader.next_key(key))
 		{
-			IdString memory_name = RTLIL::escape_id(memory_node_it.first.c_str());
-			JsonNode *memory_node = memory_node_it.second;
-
-			RTLIL::Memory *mem = new RTLIL::Memory;
-			mem->name = memory_name;
-
-			if (memory_node->type != 'D')
-				log_error("JSON memory node '%s' is not a dictionary.\n", log_id(memory_name));
-
-			if (memory_node->data_dict.count("width") == 0)
-				log_error("JSON memory node '%s' has no width attribute.\n", log_id(memory_name));
-			JsonNode *width_node = memory_node->data_dict.at("width");
-			if (width_node->type != 'N')
-				log_error("JSON memory node '%s' has a non-number width.\n", log_id(memory_name));
-			mem->width = width_node->data_number;
-
-			if (memory_node->data_dict.count("size") == 0)
-				log_error("JSON memory node '%s' has no size attribute.\n", log_id(memory_name));
-			JsonNode *size_node = memory_node->data_dict.at("size");
-			if (size_node->type != 'N')
-				log_error("JSON memory node '%s' has a non-number size.\n", log_id(memory_name));
-			mem->size = size_node->data_number;
-
-			mem->start_offset = 0;
-			if (memory_node->data_dict.count("start_offset") != 0) {
-				JsonNode *val = memory_node->data_dict.at("start_offset");
-				if (val->type == 'N')
-					mem->start_offset = val->data_number;
+			if (key == "attributes") {
+				std::unique_ptr<JsonNode> node(reader.value());
+				json_parse_attr_param(module->attributes, node.get());
+				continue;
+			}
+
+			if (key == "ports") {
+				int port_id = 1;
+				reader.begin_dict("ports");
+				while (reader.next_key(name)) {
+					std::unique_ptr<JsonNode> node(reader.value());
+					parse_port(name, node.get(), port_id++);
+				}
+				continue;
+			}
+
+			if (key == "netnames") {
+				reader.begin_dict("netnames");
+				while (reader.next_key(name)) {
+					std::unique_ptr<JsonNode> node(reader.value());
+					parse_netname(name, node.get());
+				}
+				continue;
 			}
 
-			if (memory_node->data_dict.count("attributes"))
-				json_parse_attr_param(mem->attributes, memory_node->data_dict.at("attributes"));
+			if (key == "cells") {
+				reader.begin_dict("cells");
+				while (reader.next_key(name)) {
+					std::unique_ptr<JsonNode> node(reader.value());
+					parse_cell(name, node.get());
+				}
+				continue;
+			}
 
-			module->memories[mem->name] = mem;
+			if (key == "memories") {
+				reader.begin_dict("memories");
+				while (reader.next_key(name)) {
+					std::unique_ptr<JsonNode> node(reader.value());
+					parse_memory(name, node.get());
+				}
+				continue;
+			}
+
+			reader.skip_value();
 		}
-	}
 
-	// remove duplicates from connections array
-	pool<RTLIL::SigSig> unique_connections(module->connections_.begin(), module->connections_.end());
-	module->connections_ = std::vector<RTLIL::SigSig>(unique_connections.begin(), unique_connections.end());
-}
+		resolve_bits();
+		module->fixup_ports();
+
+		// remove duplicates from connections array
+		pool<RTLIL::SigSig> unique_connections(module->connections_.begin(), module->connections_.end());
+		module->connections_ = std::vector<RTLIL::SigSig>(unique_connections.begin(), unique_connections.end());
+	}
+};
 
 struct JsonFrontend : public Frontend {
 	JsonFrontend() : Frontend("json", "read JSON file") { }
@@ -646,20 +799,21 @@ struct JsonFrontend : public Frontend {
 		}
 		extra_args(f, filename, args, argidx);
 
-		JsonNode root(*f);
-
-		if (root.type != 'D')
-			log_error("JSON root node is not a dictionary.\n");
+		JsonReader reader(*f);
+		JsonImporter importer(design);
+		string key, modname;
 
-		if (root.data_dict.count("modules") != 0)
+		reader.begin_dict("root");
+		while (reader.next_key(key))
 		{
-			JsonNode *modules = root.data_dict.at("modules");
-
-			if (modules->type != 'D')
-				log_error("JSON modules node is not a dictionary.\n");
+			if (key != "modules") {
+				reader.skip_value();
+				continue;
+			}
 
-			for (auto &it : modules->data_dict)
-				json_import(design, it.first, it.second);
+			reader.begin_dict("modules");
+			while (reader.next_key(modname))
+				importer.import_module(reader, modname);
 		}
 	}
 } JsonFrontend;
@@ -28,6 +28,7 @@
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <fcntl.h>
 extern char **environ;
 #endif
 
@@ -72,26 +73,82 @@ using json11::Json;
 
 struct RpcServer {
 	std::string name;
+	// framed messages instead of lines, see the help of connect_rpc
+	bool binary = false;
+	// the number of derive requests that may be sent before their responses are read
+	int pipeline = 1;
+	// responses read ahead by derive_modules(), by derived module name
+	dict<std::string, std::pair<std::string, std::string>> prefetched;
+	// further processes of the same frontend that derive_modules() uses
+	std::vector<std::shared_ptr<RpcServer>> extra_servers;
 
 	RpcServer(const std::string &name) : name(name) { }
 	virtual ~RpcServer() { }
 
+	// write() writes all of the data, read() returns the next non-empty chunk of data
 	virtual void write(const std::string &data) = 0;
 	virtual std::string read() = 0;
 
-	Json call(const Json &json_request) {
+	std::string read_buffer;
+
+	void write_message(const std::string &message) {
+		if (binary) {
+			std::string header(8, 0);
+			uint64_t length = message.size();
+			for (int i = 0; i < 8; i++)
+				header[i] = (length >> (8*i)) & 0xff;
+			write(header + message);
+		} else {
+			log_assert(message.find('\n') == std::string::npos);
+			write(message + '\n');
+		}
+	}
+
+	std::string read_message() {
+		size_t begin = 0, length;
+		if (binary) {
+			while (read_buffer.size() < 8)
+				read_buffer += read();
+			uint64_t frame_length = 0;
+			for (int i = 0; i < 8; i++)
+				frame_length |= uint64_t((unsigned char)read_buffer[i]) << (8*i);
+			if (frame_length > read_buffer.max_size() - 8)
+				log_cmd_error("read failed: frame of %llu bytes\n", (unsigned long long)frame_length);
+			begin = 8;
+			length = frame_length;
+			while (read_buffer.size() < begin + length)
+				read_buffer += read();
+		} else {
+			size_t term_pos;
+			while ((term_pos = read_buffer.find('\n')) == std::string::npos)
+				read_buffer += read();
+			length = term_pos + 1;
+		}
+		std::string message = read_buffer.substr(begin, length);
+		read_buffer.erase(0, begin + length);
+		return message;
+	}
+
+	void send_request(const Json &json_request) {
 		std::string request;
 		json_request.dump(request);
-		request += '\n';
-		log_debug("RPC frontend request: %s", request.c_str());
-		write(request);
+		log_debug("RPC frontend request: %s\n", request.c_str());
+		write_message(request);
+	}
 
-		std::string response = read();
-		log_debug("RPC frontend response: %s", response.c_str());
+	Json receive_response() {
+		std::string response = read_message();
+		log_debug("RPC frontend response: %s%s", response.c_str(), binary ? "\n" : "");
 		std::string error;
 		Json json_response = Json::parse(response, error);
 		if (json_response.is_null())
 			log_cmd_error("parsing JSON failed: %s\n", error.c_str());
+		return json_response;
+	}
+
+	Json call(const Json &json_request) {
+		send_request(json_request);
+		Json json_response = receive_response();
 		if (json_response["error"].is_string())
 			log_cmd_error("RPC frontend returned an error: %s\n", json_response["error"].string_value().c_str());
 		return json_response;
@@ -115,7 +172,7 @@ struct RpcServer {
 		return modules;
 	}
 
-	std::pair<std::string, std::string> derive_module(const std::string &module, const dict<RTLIL::IdString, RTLIL::Const> &parameters) {
+	Json derive_request(const std::string &module, const dict<RTLIL::IdString, RTLIL::Const> &parameters) {
 		Json::object json_parameters;
 		for (auto &param : parameters) {
 			std::string type, value;
@@ -135,55 +192,145 @@ struct RpcServer {
 				{ "value", value },
 			};
 		}
-		Json response = call(Json::object {
+		return Json::object {
 			{ "method", "derive" },
 			{ "module", module },
 			{ "parameters", json_parameters },
-		});
+		};
+	}
+
+	// Reads a derive response, and in binary mode the source frame following it.
+	// Returns the error message instead if there is one.
+	std::string receive_derive_response(std::pair<std::string, std::string> &result) {
+		Json response = receive_response();
+		if (response["error"].is_string())
+			return response["error"].string_value();
 		bool is_valid = true;
-		std::string frontend, source;
 		if (response["frontend"].is_string())
-			frontend = response["frontend"].string_value();
+			result.first = response["frontend"].string_value();
 		else is_valid = false;
 		if (response["source"].is_string())
-			source = response["source"].string_value();
+			result.second = response["source"].string_value();
+		else if (binary && !response.object_items().count("source"))
+			result.second = read_message();
 		else is_valid = false;
 		if (!is_valid)
 			log_cmd_error("RPC frontend returned malformed response: %s\n", response.dump().c_str());
-		return std::make_pair(frontend, source);
+		return "";
+	}
+
+	// Derives several modules, spread over this and the extra servers, with
+	// up to `pipeline` requests on the way to each server at any time. Each
+	// server answers its requests in order.
+	std::vector<std::pair<std::string, std::string>> derive_modules(const std::vector<Json> &requests) {
+		std::vector<RpcServer*> servers = {this};
+		for (auto &server : extra_servers)
+			servers.push_back(server.get());
+
+		std::vector<std::vector<size_t>> queue(servers.size());
+		for (size_t i = 0; i < requests.size(); i++)
+			queue[i % servers.size()].push_back(i);
+
+		std::vector<std::pair<std::string, std::string>> results(requests.size());
+		std::vector<size_t> sent(servers.size()), received(servers.size());
+		std::string first_error;
+		for (size_t done = 0; done < requests.size();) {
+			for (size_t k = 0; k < servers.size(); k++)
+				while (sent[k] < queue[k].size() && sent[k] < received[k] + std::max(pipeline, 1))
+					servers[k]->send_request(requests[queue[k][sent[k]++]]);
+			for (size_t k = 0; k < servers.size(); k++) {
+				if (received[k] == sent[k])
+					continue;
+				// read the remaining responses after an error to keep the connections in sync
+				std::string error = servers[k]->receive_derive_response(results[queue[k][received[k]++]]);
+				if (first_error.empty())
+					first_error = error;
+				done++;
+			}
+		}
+		if (!first_error.empty())
+			log_cmd_error("RPC frontend returned an error: %s\n", first_error.c_str());
+		return results;
 	}
 };
 
 struct RpcModule : RTLIL::Module {
 	std::shared_ptr<RpcServer> server;
 
-	RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, bool /*mayfail*/) override {
+	std::string stripped_name() const {
 		std::string stripped_name = name.str();
 		if (stripped_name.compare(0, 9, "$abstract") == 0)
 			stripped_name = stripped_name.substr(9);
 		log_assert(stripped_name[0] == '\\');
+		return stripped_name;
+	}
 
-		log_header(design, "Executing RPC frontend `%s' for module `%s'.\n", server->name.c_str(), stripped_name.c_str());
-
+	static std::string make_derived_name(const std::string &stripped_name, const dict<RTLIL::IdString, RTLIL::Const> &parameters) {
 		std::string parameter_info;
-		for (auto &param : parameters) {
-			log("Parameter %s = %s\n", param.first.c_str(), log_signal(RTLIL::SigSpec(param.second)));
+		for (auto &param : parameters)
 			parameter_info += stringf("%s=%s", param.first.c_str(), log_signal(RTLIL::SigSpec(param.second)));
-		}
 
-		std::string derived_name;
 		if (parameters.empty())
-			derived_name = stripped_name;
+			return stripped_name;
 		else if (parameter_info.size() > 60)
-			derived_name = "$paramod$" + sha1(parameter_info) + stripped_name;
+			return "$paramod$" + sha1(parameter_info) + stripped_name;
 		else
-			derived_name = "$paramod" + stripped_name + parameter_info;
+			return "$paramod" + stripped_name + parameter_info;
+	}
+
+	// Sends the derive requests of this module together with those for other
+	// cells in the design that need a module from the same server, up to
+	// `pipeline` requests per server process, so that their responses are
+	// ready when hierarchy gets to them.
+	std::pair<std::string, std::string> fetch(RTLIL::Design *design, const std::string &derived_name, const dict<RTLIL::IdString, RTLIL::Const> &parameters) {
+		auto it = server->prefetched.find(derived_name);
+		if (it != server->prefetched.end()) {
+			auto result = std::move(it->second);
+			server->prefetched.erase(it);
+			return result;
+		}
+
+		std::vector<std::string> names = {derived_name};
+		std::vector<Json> requests = {server->derive_request(stripped_name().substr(1), parameters)};
+		pool<std::string> seen = {derived_name};
+		for (auto module : design->modules()) {
+			for (auto cell : module->cells()) {
+				if (GetSize(requests) >= server->pipeline * (1 + GetSize(server->extra_servers)))
+					break;
+				RpcModule *other = dynamic_cast<RpcModule*>(design->module("$abstract" + cell->type.str()));
+				if (other == nullptr || other->server != server)
+					continue;
+				std::string other_name = make_derived_name(other->stripped_name(), cell->parameters);
+				if (design->has(other_name) || server->prefetched.count(other_name) || !seen.insert(other_name).second)
+					continue;
+				names.push_back(other_name);
+				requests.push_back(server->derive_request(other->stripped_name().substr(1), cell->parameters));
+			}
+		}
+
+		if (GetSize(requests) > 1)
+			log("Sending %d derive requests at once.\n", GetSize(requests));
+		auto results = server->derive_modules(requests);
+		for (int i = 1; i < GetSize(results); i++)
+			server->prefetched[names[i]] = std::move(results[i]);
+		return std::move(results[0]);
+	}
+
+	RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, bool /*mayfail*/) override {
+		std::string stripped_name = this->stripped_name();
+
+		log_header(design, "Executing RPC frontend `%s' for module `%s'.\n", server->name.c_str(), stripped_name.c_str());
+
+		for (auto &param : parameters)
+			log("Parameter %s = %s\n", param.first.c_str(), log_signal(RTLIL::SigSpec(param.second)));
+
+		std::string derived_name = make_derived_name(stripped_name, parameters);
 
 		if (design->has(derived_name)) {
 			log("Found cached RTLIL representation for module `%s'.\n", derived_name.c_str());
 		} else {
 			std::string command, input;
-			std::tie(command, input) = server->derive_module(stripped_name.substr(1), parameters);
+			std::tie(command, input) = fetch(design, derived_name, parameters);
 
 			std::istringstream input_stream(input);
 			RTLIL::Design *derived_design = new RTLIL::Design;
@@ -251,30 +398,23 @@ struct HandleRpcServer : RpcServer {
 		: RpcServer(name), hsend(hsend), hrecv(hrecv) { }
 
 	void write(const std::string &data) override {
-		log_assert(data.length() >= 1 && data.find('\n') == data.length() - 1);
 		ssize_t offset = 0;
-		do {
+		while (offset < (ssize_t)data.length()) {
 			DWORD data_written;
 			if (!WriteFile(hsend, &data[offset], data.length() - offset, &data_written, /*lpOverlapped=*/NULL))
 				log_cmd_error("WriteFile failed: %s\n", get_last_error_str().c_str());
 			offset += data_written;
-		} while(offset < (ssize_t)data.length());
+		}
 	}
 
 	std::string read() override {
-		std::string data;
-		ssize_t offset = 0;
-		while (data.length() == 0 || data[data.length() - 1] != '\n') {
-			data.resize(data.length() + 1024);
-			DWORD data_read;
-			if (!ReadFile(hrecv, &data[offset], data.length() - offset, &data_read, /*lpOverlapped=*/NULL))
-				log_cmd_error("ReadFile failed: %s\n", get_last_error_str().c_str());
-			offset += data_read;
-			data.resize(offset);
-			size_t term_pos = data.find('\n', offset);
-			if (term_pos != data.length() - 1 && term_pos != std::string::npos)
-				log_cmd_error("read failed: more than one response\n");
-		}
+		std::string data(65536, 0);
+		DWORD data_read;
+		if (!ReadFile(hrecv, &data[0], data.length(), &data_read, /*lpOverlapped=*/NULL))
+			log_cmd_error("ReadFile failed: %s\n", get_last_error_str().c_str());
+		if (data_read == 0)
+			log_cmd_error("read failed: RPC frontend closed the connection\n");
+		data.resize(data_read);
 		return data;
 	}
 
@@ -305,32 +445,25 @@ struct FdRpcServer : RpcServer {
 	}
 
 	void write(const std::string &data) override {
-		log_assert(data.length() >= 1 && data.find('\n') == data.length() - 1);
 		ssize_t offset = 0;
-		do {
+		while (offset < (ssize_t)data.length()) {
 			check_pid();
 			ssize_t result = ::write(fdsend, &data[offset], data.length() - offset);
 			if (result == -1)
 				log_cmd_error("write failed: %s\n", strerror(errno));
 			offset += result;
-		} while(offset < (ssize_t)data.length());
+		}
 	}
 
 	std::string read() override {
-		std::string data;
-		ssize_t offset = 0;
-		while (data.length() == 0 || data[data.length() - 1] != '\n') {
-			data.resize(data.length() + 1024);
-			check_pid();
-			ssize_t result = ::read(fdrecv, &data[offset], data.length() - offset);
-			if (result == -1)
-				log_cmd_error("read failed: %s\n", strerror(errno));
-			offset += result;
-			data.resize(offset);
-			size_t term_pos = data.find('\n', offset);
-			if (term_pos != data.length() - 1 && term_pos != std::string::npos)
-				log_cmd_error("read failed: more than one response\n");
-		}
+		std::string data(65536, 0);
+		check_pid();
+		ssize_t result = ::read(fdrecv, &data[0], data.length());
+		if (result == -1)
+			log_cmd_error("read failed: %s\n", strerror(errno));
+		if (result == 0)
+			log_cmd_error("read failed: RPC frontend closed the connection\n");
+		data.resize(result);
 		return data;
 	}
 
@@ -343,6 +476,142 @@ struct FdRpcServer : RpcServer {
 
 #endif
 
+// Starts the frontend process and connects to its stdin and stdout.
+static std::shared_ptr<RpcServer> exec_rpc_server(std::vector<std::string> command)
+{
+	std::shared_ptr<RpcServer> server;
+	std::string command_line;
+	bool first = true;
+	for (auto &arg : command) {
+		if (!first) command_line += ' ';
+		command_line += arg;
+		first = false;
+	}
+
+#ifdef _WIN32
+	std::wstring command_w = str2wstr(command[0]);
+	std::wstring command_path_w;
+	std::wstring command_line_w = str2wstr(command_line);
+	DWORD command_path_len_w;
+	SECURITY_ATTRIBUTES pipe_attr = {};
+	HANDLE send_r = NULL, send_w = NULL, recv_r = NULL, recv_w = NULL;
+	STARTUPINFOW startup_info = {};
+	PROCESS_INFORMATION proc_info = {};
+
+	command_path_len_w = SearchPathW(/*lpPath=*/NULL, /*lpFileName=*/command_w.c_str(), /*lpExtension=*/L".exe", /*nBufferLength=*/0, /*lpBuffer=*/NULL, /*lpFilePart=*/NULL);
+	if (command_path_len_w == 0) {
+		log_error("SearchPathW failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+	command_path_w.resize(command_path_len_w - 1);
+	command_path_len_w = SearchPathW(/*lpPath=*/NULL, /*lpFileName=*/command_w.c_str(), /*lpExtension=*/L".exe", /*nBufferLength=*/command_path_len_w, /*lpBuffer=*/&command_path_w[0], /*lpFilePart=*/NULL);
+	log_assert(command_path_len_w == command_path_w.length());
+
+	pipe_attr.nLength = sizeof(pipe_attr);
+	pipe_attr.bInheritHandle = TRUE;
+	pipe_attr.lpSecurityDescriptor = NULL;
+	if (!CreatePipe(&send_r, &send_w, &pipe_attr, /*nSize=*/0)) {
+		log_error("CreatePipe failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+	if (!SetHandleInformation(send_w, HANDLE_FLAG_INHERIT, 0)) {
+		log_error("SetHandleInformation failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+	if (!CreatePipe(&recv_r, &recv_w, &pipe_attr, /*nSize=*/0)) {
+		log_error("CreatePipe failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+	if (!SetHandleInformation(recv_r, HANDLE_FLAG_INHERIT, 0)) {
+		log_error("SetHandleInformation failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+
+	startup_info.cb = sizeof(startup_info);
+	startup_info.hStdInput = send_r;
+	startup_info.hStdOutput = recv_w;
+	startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	startup_info.dwFlags |= STARTF_USESTDHANDLES;
+	if (!CreateProcessW(/*lpApplicationName=*/command_path_w.c_str(), /*lpCommandLine=*/&command_line_w[0], /*lpProcessAttributes=*/NULL, /*lpThreadAttributes=*/NULL, /*bInheritHandles=*/TRUE, /*dwCreationFlags=*/0, /*lpEnvironment=*/NULL, /*lpCurrentDirectory=*/NULL, &startup_info, &proc_info)) {
+		log_error("CreateProcessW failed: %s\n", get_last_error_str().c_str());
+		goto cleanup_exec;
+	}
+	CloseHandle(proc_info.hProcess);
+	CloseHandle(proc_info.hThread);
+
+	server = std::make_shared<HandleRpcServer>(command_line, send_w, recv_r);
+	send_w = NULL;
+	recv_r = NULL;
+
+cleanup_exec:
+	if (send_r != NULL) CloseHandle(send_r);
+	if (send_w != NULL) CloseHandle(send_w);
+	if (recv_r != NULL) CloseHandle(recv_r);
+	if (recv_w != NULL) CloseHandle(recv_w);
+#else
+	std::vector<char *> argv;
+	int send[2] = {-1,-1}, recv[2] = {-1,-1};
+	posix_spawn_file_actions_t file_actions, *file_actions_p = NULL;
+	pid_t pid;
+
+	for (auto &arg : command)
+		argv.push_back(&arg[0]);
+	argv.push_back(nullptr);
+
+	if (pipe(send) != 0) {
+		log_error("pipe failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	if (pipe(recv) != 0) {
+		log_error("pipe failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	// keep our ends out of the processes started later with -jobs
+	fcntl(send[1], F_SETFD, FD_CLOEXEC);
+	fcntl(recv[0], F_SETFD, FD_CLOEXEC);
+
+	if (posix_spawn_file_actions_init(&file_actions) != 0) {
+		log_error("posix_spawn_file_actions_init failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	file_actions_p = &file_actions;
+	if (posix_spawn_file_actions_adddup2(file_actions_p, send[0], STDIN_FILENO) != 0) {
+		log_error("posix_spawn_file_actions_adddup2 failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	if (posix_spawn_file_actions_addclose(file_actions_p, send[1]) != 0) {
+		log_error("posix_spawn_file_actions_addclose failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	if (posix_spawn_file_actions_adddup2(file_actions_p, recv[1], STDOUT_FILENO) != 0) {
+		log_error("posix_spawn_file_actions_adddup2 failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+	if (posix_spawn_file_actions_addclose(file_actions_p, recv[0]) != 0) {
+		log_error("posix_spawn_file_actions_addclose failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+
+	if (posix_spawnp(&pid, argv[0], file_actions_p, /*attrp=*/NULL, argv.data(), environ) != 0) {
+		log_error("posix_spawnp failed: %s\n", strerror(errno));
+		goto cleanup_exec;
+	}
+
+	server = std::make_shared<FdRpcServer>(command_line, send[1], recv[0], pid);
+	send[1] = -1;
+	recv[0] = -1;
+
+cleanup_exec:
+	if (send[0] != -1) close(send[0]);
+	if (send[1] != -1) close(send[1]);
+	if (recv[0] != -1) close(recv[0]);
+	if (recv[1] != -1) close(recv[1]);
+	if (file_actions_p != NULL)
+		posix_spawn_file_actions_destroy(file_actions_p);
+#endif
+	return server;
+}
+
 // RpcFrontend does not inherit from Frontend since it does not read files.
 struct RpcFrontend : public Pass {
 	RpcFrontend() : Pass("connect_rpc", "connect to RPC frontend") { }
@@ -350,11 +619,24 @@ struct RpcFrontend : public Pass {
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
 		log("\n");
-		log("    connect_rpc -exec <command> [args...]\n");
-		log("    connect_rpc -path <path>\n");
+		log("    connect_rpc [options] -exec <command> [args...]\n");
+		log("    connect_rpc [options] -path <path>\n");
 		log("\n");
 		log("Load modules using an out-of-process frontend.\n");
 		log("\n");
+		log("    -binary\n");
+		log("        use length-prefixed frames instead of lines, see below.\n");
+		log("\n");
+		log("    -pipeline <N>\n");
+		log("        when deriving a module, also send the derive requests for up to N-1\n");
+		log("        other cells in the design that use modules of this frontend, without\n");
+		log("        waiting for the responses in between. (default: 1)\n");
+		log("\n");
+		log("    -jobs <N>\n");
+		log("        with -exec, start N processes of the frontend and spread the derive\n");
+		log("        requests sent together over them. the 'modules' request only goes to\n");
+		log("        the first process. (default: 1)\n");
+		log("\n");
 		log("    -exec <command> [args...]\n");
 		log("        run <command> with arguments [args...]. send requests on stdin, read\n");
 		log("        responses from stdout.\n");
@@ -389,6 +671,20 @@ struct RpcFrontend : public Pass {
 		log("        frontend to return anyconvenient representation of the module. the\n");
 		log("        derived module is cached,so the response should be the same whenever the\n");
 		log("        same set of parameters is provided.\n");
+		log("\n");
+		log("The frontend must answer the requests in the order they were sent. With\n");
+		log("-pipeline, several requests may be sent before the first answer is read.\n");
+		log("\n");
+		log("With -binary, each request and response is a frame instead of a line: an\n");
+		log("8-byte little-endian length followed by that many bytes of JSON. A derive\n");
+		log("response may leave out \"source\", in which case the source follows in a\n");
+		log("frame of its own. This avoids escaping large sources as JSON strings, and\n");
+		log("allows binary sources, e.g. from 'write_rtlil -binary' for the rtlil\n");
+		log("frontend:\n");
+		log("\n");
+		log("    <- {\"frontend\": \"rtlil\"}\n");
+		log("    <- <source>\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -396,9 +692,23 @@ struct RpcFrontend : public Pass {
 
 		std::vector<std::string> command;
 		std::string path;
+		bool binary = false;
+		int pipeline = 1, jobs = 1;
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			std::string arg = args[argidx];
+			if (arg == "-binary") {
+				binary = true;
+				continue;
+			}
+			if (arg == "-pipeline" && argidx+1 < args.size()) {
+				pipeline = std::max(atoi(args[++argidx].c_str()), 1);
+				continue;
+			}
+			if (arg == "-jobs" && argidx+1 < args.size()) {
+				jobs = std::max(atoi(args[++argidx].c_str()), 1);
+				continue;
+			}
 			if (arg == "-exec" && argidx+1 < args.size()) {
 				command.insert(command.begin(), args.begin() + argidx + 1, args.end());
 				argidx = args.size()-1;
@@ -417,132 +727,15 @@ struct RpcFrontend : public Pass {
 
 		std::shared_ptr<RpcServer> server;
 		if (!command.empty()) {
-			std::string command_line;
-			bool first = true;
-			for (auto &arg : command) {
-				if (!first) command_line += ' ';
-				command_line += arg;
-				first = false;
-			}
-
-#ifdef _WIN32
-			std::wstring command_w = str2wstr(command[0]);
-			std::wstring command_path_w;
-			std::wstring command_line_w = str2wstr(command_line);
-			DWORD command_path_len_w;
-			SECURITY_ATTRIBUTES pipe_attr = {};
-			HANDLE send_r = NULL, send_w = NULL, recv_r = NULL, recv_w = NULL;
-			STARTUPINFOW startup_info = {};
-			PROCESS_INFORMATION proc_info = {};
-
-			command_path_len_w = SearchPathW(/*lpPath=*/NULL, /*lpFileName=*/command_w.c_str(), /*lpExtension=*/L".exe", /*nBufferLength=*/0, /*lpBuffer=*/NULL, /*lpFilePart=*/NULL);
-			if (command_path_len_w == 0) {
-				log_error("SearchPathW failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-			command_path_w.resize(command_path_len_w - 1);
-			command_path_len_w = SearchPathW(/*lpPath=*/NULL, /*lpFileName=*/command_w.c_str(), /*lpExtension=*/L".exe", /*nBufferLength=*/command_path_len_w, /*lpBuffer=*/&command_path_w[0], /*lpFilePart=*/NULL);
-			log_assert(command_path_len_w == command_path_w.length());
-
-			pipe_attr.nLength = sizeof(pipe_attr);
-			pipe_attr.bInheritHandle = TRUE;
-			pipe_attr.lpSecurityDescriptor = NULL;
-			if (!CreatePipe(&send_r, &send_w, &pipe_attr, /*nSize=*/0)) {
-				log_error("CreatePipe failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-			if (!SetHandleInformation(send_w, HANDLE_FLAG_INHERIT, 0)) {
-				log_error("SetHandleInformation failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-			if (!CreatePipe(&recv_r, &recv_w, &pipe_attr, /*nSize=*/0)) {
-				log_error("CreatePipe failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-			if (!SetHandleInformation(recv_r, HANDLE_FLAG_INHERIT, 0)) {
-				log_error("SetHandleInformation failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-
-			startup_info.cb = sizeof(startup_info);
-			startup_info.hStdInput = send_r;
-			startup_info.hStdOutput = recv_w;
-			startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
-			startup_info.dwFlags |= STARTF_USESTDHANDLES;
-			if (!CreateProcessW(/*lpApplicationName=*/command_path_w.c_str(), /*lpCommandLine=*/&command_line_w[0], /*lpProcessAttributes=*/NULL, /*lpThreadAttributes=*/NULL, /*bInheritHandles=*/TRUE, /*dwCreationFlags=*/0, /*lpEnvironment=*/NULL, /*lpCurrentDirectory=*/NULL, &startup_info, &proc_info)) {
-				log_error("CreateProcessW failed: %s\n", get_last_error_str().c_str());
-				goto cleanup_exec;
-			}
-			CloseHandle(proc_info.hProcess);
-			CloseHandle(proc_info.hThread);
-
-			server = std::make_shared<HandleRpcServer>(path, send_w, recv_r);
-			send_w = NULL;
-			recv_r = NULL;
-
-cleanup_exec:
-			if (send_r != NULL) CloseHandle(send_r);
-			if (send_w != NULL) CloseHandle(send_w);
-			if (recv_r != NULL) CloseHandle(recv_r);
-			if (recv_w != NULL) CloseHandle(recv_w);
-#else
-			std::vector<char *> argv;
-			int send[2] = {-1,-1}, recv[2] = {-1,-1};
-			posix_spawn_file_actions_t file_actions, *file_actions_p = NULL;
-			pid_t pid;
-
-			for (auto &arg : command)
-				argv.push_back(&arg[0]);
-			argv.push_back(nullptr);
-
-			if (pipe(send) != 0) {
-				log_error("pipe failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-			if (pipe(recv) != 0) {
-				log_error("pipe failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-
-			if (posix_spawn_file_actions_init(&file_actions) != 0) {
-				log_error("posix_spawn_file_actions_init failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-			file_actions_p = &file_actions;
-			if (posix_spawn_file_actions_adddup2(file_actions_p, send[0], STDIN_FILENO) != 0) {
-				log_error("posix_spawn_file_actions_adddup2 failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-			if (posix_spawn_file_actions_addclose(file_actions_p, send[1]) != 0) {
-				log_error("posix_spawn_file_actions_addclose failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-			if (posix_spawn_file_actions_adddup2(file_actions_p, recv[1], STDOUT_FILENO) != 0) {
-				log_error("posix_spawn_file_actions_adddup2 failed: %s\n", strerror(errno));
-				goto cleanup_exec;
+			for (int job = 0; job < jobs; job++) {
+				auto job_server = exec_rpc_server(command);
+				if (!job_server)
+					break;
+				if (!server)
+					server = job_server;
+				else
+					server->extra_servers.push_back(job_server);
 			}
-			if (posix_spawn_file_actions_addclose(file_actions_p, recv[0]) != 0) {
-				log_error("posix_spawn_file_actions_addclose failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-
-			if (posix_spawnp(&pid, argv[0], file_actions_p, /*attrp=*/NULL, argv.data(), environ) != 0) {
-				log_error("posix_spawnp failed: %s\n", strerror(errno));
-				goto cleanup_exec;
-			}
-
-			server = std::make_shared<FdRpcServer>(command_line, send[1], recv[0], pid);
-			send[1] = -1;
-			recv[0] = -1;
-
-cleanup_exec:
-			if (send[0] != -1) close(send[0]);
-			if (send[1] != -1) close(send[1]);
-			if (recv[0] != -1) close(recv[0]);
-			if (recv[1] != -1) close(recv[1]);
-			if (file_actions_p != NULL)
-				posix_spawn_file_actions_destroy(file_actions_p);
-#endif
 		} else if (!path.empty()) {
 #ifdef _WIN32
 			std::wstring path_w = str2wstr(path);
@@ -584,6 +777,12 @@ cleanup_path:
 
 		if (!server)
 			log_cmd_error("Failed to connect to RPC frontend.\n");
+		for (auto &extra_server : server->extra_servers) {
+			extra_server->binary = binary;
+			extra_server->pipeline = pipeline;
+		}
+		server->binary = binary;
+		server->pipeline = pipeline;
 
 		for (auto &module_name : server->get_module_names()) {
 			log("Linking module `%s'.\n", module_name.c_str());
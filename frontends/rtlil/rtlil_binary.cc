@@ -0,0 +1,417 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ *  ---
+ *
+ *  The reader for the binary RTLIL format, see backends/rtlil/rtlil_binary.cc
+ *  for a description of the format.
+ *
+ */
+
+#include "rtlil_frontend.h"
+#include "backends/rtlil/rtlil_backend.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+namespace {
+
+struct BinaryReader
+{
+	const char *ptr, *end;
+	const vector<RTLIL::IdString> *strings;
+	vector<RTLIL::Wire*> wires;
+
+	BinaryReader(const char *ptr, const char *end, const vector<RTLIL::IdString> *strings = nullptr) :
+			ptr(ptr), end(end), strings(strings) { }
+
+	void truncated()
+	{
+		log_error("Unexpected end of binary RTLIL data.\n");
+	}
+
+	uint64_t get_uint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (ptr == end)
+				truncated();
+			unsigned char byte = *ptr++;
+			value |= uint64_t(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+		log_error("Invalid varint in binary RTLIL data.\n");
+	}
+
+	int64_t get_int()
+	{
+		uint64_t value = get_uint();
+		return (value & 1) ? ~int64_t(value >> 1) : int64_t(value >> 1);
+	}
+
+	// get a count and check that at least this many bytes follow, so that
+	// corrupt data doesn't cause huge allocations
+	size_t get_count()
+	{
+		uint64_t count = get_uint();
+		if (count > uint64_t(end - ptr))
+			truncated();
+		return count;
+	}
+
+	RTLIL::IdString get_id()
+	{
+		uint64_t idx = get_uint();
+		if (idx >= strings->size())
+			log_error("Invalid string index %llu in binary RTLIL data.\n", (unsigned long long)idx);
+		return strings->at(idx);
+	}
+
+	std::string get_string()
+	{
+		size_t len = get_count();
+		std::string str(ptr, len);
+		ptr += len;
+		return str;
+	}
+
+	void get_bits(std::vector<RTLIL::State> &bits)
+	{
+		uint64_t code = get_uint();
+		uint64_t width = code >> 1;
+		if ((code & 1) == 0) {
+			if ((width + 7) / 8 > uint64_t(end - ptr))
+				truncated();
+			bits.reserve(width);
+			for (uint64_t i = 0; i < width; i++)
+				bits.push_back((ptr[i / 8] >> (i % 8)) & 1 ? RTLIL::S1 : RTLIL::S0);
+			ptr += (width + 7) / 8;
+		} else {
+			if (width > uint64_t(end - ptr))
+				truncated();
+			bits.reserve(width);
+			for (uint64_t i = 0; i < width; i++) {
+				unsigned char bit = ptr[i];
+				if (bit > RTLIL::Sm)
+					log_error("Invalid constant bit in binary RTLIL data.\n");
+				bits.push_back(RTLIL::State(bit));
+			}
+			ptr += width;
+		}
+	}
+
+	RTLIL::Const get_const()
+	{
+		RTLIL::Const value;
+		value.flags = get_uint();
+		get_bits(value.bits);
+		return value;
+	}
+
+	RTLIL::SigSpec get_sig()
+	{
+		RTLIL::SigSpec sig;
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			uint64_t idx = get_uint();
+			if (idx == 0) {
+				RTLIL::Const value;
+				get_bits(value.bits);
+				sig.append(value);
+				continue;
+			}
+			if (idx > wires.size())
+				log_error("Invalid wire index in binary RTLIL data.\n");
+			RTLIL::Wire *wire = wires[idx-1];
+			int offset = get_uint();
+			int width = get_uint();
+			if (offset < 0 || width < 0 || offset + width > wire->width)
+				log_error("Invalid slice of wire %s in binary RTLIL data.\n", log_id(wire));
+			sig.append(RTLIL::SigSpec(wire, offset, width));
+		}
+		return sig;
+	}
+
+	void get_attrs(RTLIL::AttrObject *obj)
+	{
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::IdString name = get_id();
+			obj->attributes[name] = get_const();
+		}
+	}
+
+	void get_actions(std::vector<RTLIL::SigSig> &actions)
+	{
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::SigSpec lhs = get_sig();
+			RTLIL::SigSpec rhs = get_sig();
+			actions.push_back(RTLIL::SigSig(lhs, rhs));
+		}
+	}
+
+	void get_case(RTLIL::CaseRule *cs)
+	{
+		get_attrs(cs);
+		for (size_t i = 0, n = get_count(); i < n; i++)
+			cs->compare.push_back(get_sig());
+		get_actions(cs->actions);
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::SwitchRule *sw = new RTLIL::SwitchRule;
+			cs->switches.push_back(sw);
+			get_attrs(sw);
+			sw->signal = get_sig();
+			for (size_t j = 0, m = get_count(); j < m; j++) {
+				RTLIL::CaseRule *child = new RTLIL::CaseRule;
+				sw->cases.push_back(child);
+				get_case(child);
+			}
+		}
+	}
+
+	void get_module(RTLIL::Module *module)
+	{
+		get_attrs(module);
+		get_module_body(module);
+	}
+
+	void get_params(RTLIL::Module *module)
+	{
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::IdString name = get_id();
+			module->avail_parameters(name);
+			if (get_uint())
+				module->parameter_default_values[name] = get_const();
+		}
+	}
+
+	// returns nullptr for wires that are not ports when ports_only is set
+	RTLIL::Wire *get_wire(RTLIL::Module *module, bool ports_only)
+	{
+		RTLIL::IdString name = get_id();
+		RTLIL::AttrObject attrs;
+		get_attrs(&attrs);
+		int width = get_uint();
+		int start_offset = get_int();
+		int port_id = get_uint();
+		uint64_t flags = get_uint();
+		if (ports_only && (flags & 3) == 0)
+			return nullptr;
+
+		if (module->wire(name) != nullptr)
+			log_error("Redefinition of wire %s in binary RTLIL data.\n", log_id(name));
+		RTLIL::Wire *wire = module->addWire(name, width);
+		wire->attributes.swap(attrs.attributes);
+		wire->start_offset = start_offset;
+		wire->port_id = port_id;
+		wire->port_input = (flags & 1) != 0;
+		wire->port_output = (flags & 2) != 0;
+		wire->upto = (flags & 4) != 0;
+		wire->is_signed = (flags & 8) != 0;
+		return wire;
+	}
+
+	// the parameters and ports, for the stub of a lazy module
+	void get_module_ports(RTLIL::Module *module)
+	{
+		get_params(module);
+		for (size_t i = 0, n = get_count(); i < n; i++)
+			get_wire(module, true);
+	}
+
+	// everything after the module attributes
+	void get_module_body(RTLIL::Module *module)
+	{
+		get_params(module);
+
+		wires.clear();
+		for (size_t i = 0, n = get_count(); i < n; i++)
+			wires.push_back(get_wire(module, false));
+
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::IdString name = get_id();
+			if (module->memories.count(name) != 0)
+				log_error("Redefinition of memory %s in binary RTLIL data.\n", log_id(name));
+			RTLIL::Memory *memory = new RTLIL::Memory;
+			memory->name = name;
+			module->memories[name] = memory;
+			get_attrs(memory);
+			memory->width = get_uint();
+			memory->start_offset = get_int();
+			memory->size = get_uint();
+		}
+
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::IdString name = get_id();
+			RTLIL::IdString type = get_id();
+			if (module->cell(name) != nullptr)
+				log_error("Redefinition of cell %s in binary RTLIL data.\n", log_id(name));
+			RTLIL::Cell *cell = module->addCell(name, type);
+			get_attrs(cell);
+			for (size_t j = 0, m = get_count(); j < m; j++) {
+				RTLIL::IdString param = get_id();
+				cell->parameters[param] = get_const();
+			}
+			for (size_t j = 0, m = get_count(); j < m; j++) {
+				RTLIL::IdString port = get_id();
+				cell->setPort(port, get_sig());
+			}
+		}
+
+		for (size_t i = 0, n = get_count(); i < n; i++) {
+			RTLIL::IdString name = get_id();
+			if (module->processes.count(name) != 0)
+				log_error("Redefinition of process %s in binary RTLIL data.\n", log_id(name));
+			RTLIL::Process *proc = module->addProcess(name);
+			get_attrs(proc);
+			get_case(&proc->root_case);
+			for (size_t j = 0, m = get_count(); j < m; j++) {
+				RTLIL::SyncRule *sync = new RTLIL::SyncRule;
+				proc->syncs.push_back(sync);
+				uint64_t type = get_uint();
+				if (type > RTLIL::STi)
+					log_error("Invalid sync type in binary RTLIL data.\n");
+				sync->type = RTLIL::SyncType(type);
+				sync->signal = get_sig();
+				get_actions(sync->actions);
+				for (size_t k = 0, l = get_count(); k < l; k++) {
+					RTLIL::MemWriteAction act;
+					get_attrs(&act);
+					act.memid = get_id();
+					act.address = get_sig();
+					act.data = get_sig();
+					act.enable = get_sig();
+					act.priority_mask = get_const();
+					sync->mem_write_actions.push_back(std::move(act));
+				}
+			}
+		}
+
+		std::vector<RTLIL::SigSig> connections;
+		get_actions(connections);
+		for (auto &it : connections)
+			module->connect(it);
+
+		if (ptr != end)
+			log_error("Unexpected data after module %s in binary RTLIL data.\n", log_id(module));
+	}
+};
+
+} // namespace
+
+bool RTLIL_FRONTEND::is_binary(std::istream &f)
+{
+	return f.peek() == (unsigned char)RTLIL_BINARY_MAGIC[0];
+}
+
+void RTLIL_FRONTEND::read_binary(std::istream &f, RTLIL::Design *design, bool lazy)
+{
+	// shared with the loaders of lazy modules
+	std::shared_ptr<std::string> data = std::make_shared<std::string>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	std::shared_ptr<vector<RTLIL::IdString>> strings = std::make_shared<vector<RTLIL::IdString>>();
+	const char *begin = data->data(), *end = data->data() + data->size();
+
+	size_t magic_len = strlen(RTLIL_BINARY_MAGIC);
+	if (data->compare(0, magic_len, RTLIL_BINARY_MAGIC) != 0)
+		log_error("Invalid magic in binary RTLIL file.\n");
+
+	BinaryReader header(begin + magic_len, end);
+	uint64_t version = header.get_uint();
+	if (version != RTLIL_BINARY_VERSION)
+		log_error("Unsupported binary RTLIL version %llu.\n", (unsigned long long)version);
+	autoidx = max<int64_t>(autoidx, header.get_uint());
+
+	for (size_t i = 0, n = header.get_count(); i < n; i++)
+		strings->push_back(header.get_string());
+	header.strings = strings.get();
+
+	vector<std::pair<RTLIL::IdString, size_t>> directory;
+	for (size_t i = 0, n = header.get_count(); i < n; i++) {
+		RTLIL::IdString name = header.get_id();
+		directory.push_back(std::make_pair(name, header.get_count()));
+	}
+
+	if (flag_lib)
+		lazy = false;
+
+	// All names were interned from the string table above, the sections only
+	// index it. They are decoded and added in file order, as the handling of
+	// redefinitions and its messages depend on the order, and the modules
+	// must keep the order of the file for the design to dump the same as the
+	// original.
+	const char *ptr = header.ptr;
+	for (auto &it : directory)
+	{
+		RTLIL::IdString name = it.first;
+		BinaryReader reader(ptr, ptr + it.second, strings.get());
+		ptr += it.second;
+		if (ptr > end)
+			reader.truncated();
+
+		RTLIL::Module *module = new RTLIL::Module;
+		module->name = name;
+		const char *body_ptr = nullptr;
+		if (lazy) {
+			reader.get_attrs(module);
+			body_ptr = reader.ptr;
+			reader.get_module_ports(module);
+		} else {
+			reader.get_module(module);
+		}
+
+		if (design->has(name)) {
+			// not design->module(), which would load a lazy module
+			RTLIL::Module *existing_mod = design->modules_.at(name);
+			if (!flag_overwrite && (flag_lib || module->get_bool_attribute(ID::blackbox))) {
+				log("Ignoring blackbox re-definition of module %s.\n", name.c_str());
+				delete module;
+				continue;
+			} else if (!flag_nooverwrite && !flag_overwrite && !existing_mod->get_bool_attribute(ID::blackbox)) {
+				log_error("RTLIL error: redefinition of module %s.\n", name.c_str());
+			} else if (flag_nooverwrite) {
+				log("Ignoring re-definition of module %s.\n", name.c_str());
+				delete module;
+				continue;
+			} else {
+				log("Replacing existing%s module %s.\n", existing_mod->get_bool_attribute(ID::blackbox) ? " blackbox" : "", name.c_str());
+				design->remove(existing_mod);
+			}
+		}
+
+		module->fixup_ports();
+
+		if (lazy) {
+			// the body includes the ports again, the wires of the stub are
+			// replaced so that the wires keep the order of the file
+			size_t body_begin = body_ptr - begin, body_end = reader.end - begin;
+			design->add_lazy(module, [data, strings, body_begin, body_end](RTLIL::Module *module) {
+				module->remove(module->wires().to_pool());
+				BinaryReader body_reader(data->data() + body_begin, data->data() + body_end, strings.get());
+				body_reader.get_module_body(module);
+				module->fixup_ports();
+			});
+			continue;
+		}
+
+		design->add(module);
+		if (flag_lib)
+			module->makeblackbox();
+	}
+
+	if (ptr != end)
+		log_error("Unexpected data at the end of binary RTLIL file.\n");
+}
+
+YOSYS_NAMESPACE_END
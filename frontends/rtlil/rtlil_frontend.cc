@@ -42,7 +42,8 @@ struct RTLILFrontend : public Frontend {
 		log("    read_rtlil [filename]\n");
 		log("\n");
 		log("Load modules from an RTLIL file to the current design. (RTLIL is a text\n");
-		log("representation of a design in yosys's internal format.)\n");
+		log("representation of a design in yosys's internal format.) Files written with\n");
+		log("'write_rtlil -binary' are detected automatically.\n");
 		log("\n");
 		log("    -nooverwrite\n");
 		log("        ignore re-definitions of modules. (the default behavior is to\n");
@@ -55,12 +56,20 @@ struct RTLILFrontend : public Frontend {
 		log("    -lib\n");
 		log("        only create empty blackbox modules\n");
 		log("\n");
+		log("    -lazy\n");
+		log("        only read the names, attributes and ports of the modules of a binary\n");
+		log("        RTLIL file. The rest of a module is read when a command accesses the\n");
+		log("        module, e.g. because it is selected. Selections that only use module\n");
+		log("        names and attributes do not read the contents of a module. Ignored\n");
+		log("        for text RTLIL files and together with -lib.\n");
+		log("\n");
 	}
 	void execute(std::istream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		RTLIL_FRONTEND::flag_nooverwrite = false;
 		RTLIL_FRONTEND::flag_overwrite = false;
 		RTLIL_FRONTEND::flag_lib = false;
+		bool flag_lazy = false;
 
 		log_header(design, "Executing RTLIL frontend.\n");
 
@@ -81,12 +90,22 @@ struct RTLILFrontend : public Frontend {
 				RTLIL_FRONTEND::flag_lib = true;
 				continue;
 			}
+			if (arg == "-lazy") {
+				flag_lazy = true;
+				continue;
+			}
 			break;
 		}
-		extra_args(f, filename, args, argidx);
+		extra_args(f, filename, args, argidx, true);
 
 		log("Input filename: %s\n", filename.c_str());
 
+		if (RTLIL_FRONTEND::is_binary(*f)) {
+			log("Reading binary RTLIL.\n");
+			RTLIL_FRONTEND::read_binary(*f, design, flag_lazy);
+			return;
+		}
+
 		RTLIL_FRONTEND::lexin = f;
 		RTLIL_FRONTEND::current_design = design;
 		rtlil_frontend_yydebug = false;
@@ -35,6 +35,10 @@ namespace RTLIL_FRONTEND {
 	extern bool flag_nooverwrite;
 	extern bool flag_overwrite;
 	extern bool flag_lib;
+
+	// binary RTLIL, see rtlil_binary.cc
+	bool is_binary(std::istream &f);
+	void read_binary(std::istream &f, RTLIL::Design *design, bool lazy = false);
 }
 
 YOSYS_NAMESPACE_END
@@ -21,11 +21,13 @@
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
 #include "libs/sha1/sha1.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <algorithm>
+#include <mutex>
 
 #ifndef _WIN32
 #  include <unistd.h>
@@ -101,6 +103,15 @@ int verific_sva_fsm_limit;
 vector<string> verific_incdirs, verific_libdirs, verific_libexts;
 std::map<IdString, const Map*> moduleToParamsMap;
 
+// The directory set with "verific -cache" and the defines set with
+// -vlog-define and -vlog-undef since the last reset, which are part of the
+// cache keys.
+static string verific_cache_dir, verific_cache_defines;
+
+// Protects the globals above that are written while netlists are imported,
+// which happens on several threads with "verific -import -j".
+static std::mutex verific_import_mutex;
+
 void msg_func(msg_type_t msg_type, const char *message_id, linefile_type linefile, const char *msg, va_list args)
 {
 	string message_prefix = stringf("VERIFIC-%s [%s] ",
@@ -126,8 +137,11 @@ void msg_func(msg_type_t msg_type, const char *message_id, linefile_type linefil
 		else
 			log("%s%s\n", message_prefix.c_str(), message.c_str());
 	}
-	if (verific_error_msg.empty() && (msg_type == VERIFIC_ERROR || msg_type == VERIFIC_PROGRAM_ERROR))
-		verific_error_msg = message;
+	if (msg_type == VERIFIC_ERROR || msg_type == VERIFIC_PROGRAM_ERROR) {
+		std::lock_guard<std::mutex> lock(verific_import_mutex);
+		if (verific_error_msg.empty())
+			verific_error_msg = message;
+	}
 }
 
 void set_verific_logging(void (*cb)(int msg_type, const char *message_id, const char* file_path, unsigned int left_line, unsigned int left_col, unsigned int right_line, unsigned int right_col, const char *msg))
@@ -349,6 +363,18 @@ static const std::string verific_unescape(const char *value)
 	return value;
 }
 
+// Many objects share a source location (e.g. the wires and operators of one
+// expression), so the src strings are formatted once per location. The
+// attribute values are still separate copies.
+const RTLIL::Const &VerificImporter::src_attribute(linefile_type linefile)
+{
+	auto it = src_cache.find(linefile);
+	if (it != src_cache.end())
+		return it->second;
+	return src_cache[linefile] = stringf("%s:%d.%d-%d.%d", LineFile::GetFileName(linefile),
+			linefile->GetLeftLine(), linefile->GetLeftCol(), linefile->GetRightLine(), linefile->GetRightCol());
+}
+
 void VerificImporter::import_attributes(dict<RTLIL::IdString, RTLIL::Const> &attributes, DesignObj *obj, Netlist *nl)
 {
 	if (!obj)
@@ -358,7 +384,7 @@ void VerificImporter::import_attributes(dict<RTLIL::IdString, RTLIL::Const> &att
 	Att *attr;
 
 	if (obj->Linefile())
-		attributes[ID::src] = stringf("%s:%d.%d-%d.%d", LineFile::GetFileName(obj->Linefile()), obj->Linefile()->GetLeftLine(), obj->Linefile()->GetLeftCol(), obj->Linefile()->GetRightLine(), obj->Linefile()->GetRightCol());
+		attributes[ID::src] = src_attribute(obj->Linefile());
 
 	// FIXME: Parse numeric attributes
 	FOREACH_ATTRIBUTE(obj, mi, attr) {
@@ -1430,6 +1456,7 @@ void VerificImporter::import_netlist(RTLIL::Design *design, Netlist *nl, std::ma
 				Instance *inst1 = (Instance*)nl->GetReferences()->GetAt(i);
 				std::string inst_name = inst1->Name();
 				if (params) {
+					std::lock_guard<std::mutex> lock(verific_import_mutex);
 					moduleToParamsMap["\\"+inst_name] = params;
 				}
 			}
@@ -1438,7 +1465,10 @@ void VerificImporter::import_netlist(RTLIL::Design *design, Netlist *nl, std::ma
 			}
 		}else{
 			if (params) {
-				moduleToParamsMap[module->name] = params;
+				{
+					std::lock_guard<std::mutex> lock(verific_import_mutex);
+					moduleToParamsMap[module->name] = params;
+				}
 				set_module_parameters(params, module);
 			}
 		}
@@ -2692,11 +2722,96 @@ struct VerificExtNets
 	}
 };
 
+// Imports the netlists in nl_todo and all netlists instantiated by them.
+// With num_jobs > 1 the netlists are imported in waves: the netlists known at
+// the start of a wave are imported in parallel, each into a staging design of
+// its own, and the new modules are then moved into the design in the order of
+// nl_todo, together with the log output of their import. The netlists found
+// in the instances of a wave make up the next wave.
+static void import_netlists(RTLIL::Design *design, std::map<std::string,Netlist*> &nl_todo, int num_jobs,
+		const std::function<void(RTLIL::Design*, Netlist*, std::map<std::string,Netlist*>&)> &import)
+{
+	std::set<std::string> nl_done;
+
+	if (num_jobs <= 1) {
+		while (!nl_todo.empty()) {
+			auto it = nl_todo.begin();
+			Netlist *nl = it->second;
+			if (nl_done.insert(it->first).second)
+				import(design, nl, nl_todo);
+			nl_todo.erase(it);
+		}
+		return;
+	}
+
+	while (!nl_todo.empty())
+	{
+		std::vector<Netlist*> wave;
+		for (auto &it : nl_todo)
+			if (nl_done.insert(it.first).second)
+				wave.push_back(it.second);
+		nl_todo.clear();
+
+		int num_netlists = GetSize(wave);
+		std::vector<std::unique_ptr<RTLIL::Design>> staging;
+		for (int i = 0; i < num_netlists; i++)
+			staging.emplace_back(new RTLIL::Design);
+
+		std::vector<std::map<std::string,Netlist*>> found(num_netlists);
+		int base_autoidx = autoidx;
+		std::vector<int> netlist_autoidx(num_netlists, base_autoidx);
+		auto restore_autoidx = [&]() {
+			autoidx = base_autoidx;
+			for (int idx : netlist_autoidx)
+				autoidx = std::max(autoidx, idx);
+		};
+
+		try {
+			ThreadPool::run_captured(num_netlists, [&](int i) {
+				autoidx = base_autoidx;
+				try {
+					import(staging[i].get(), wave[i], found[i]);
+				} catch (...) {
+					netlist_autoidx[i] = autoidx;
+					throw;
+				}
+				netlist_autoidx[i] = autoidx;
+			}, std::min(num_jobs, yosys_thread_count(num_netlists)), nullptr, [&](int i) {
+				if (staging[i]->is_protected_rtl())
+					design->set_protcted_rtl();
+
+				std::vector<RTLIL::Module*> modules;
+				for (auto &it : staging[i]->modules_)
+					modules.push_back(it.second);
+
+				for (auto module : modules) {
+					staging[i]->modules_.erase(module->name);
+					// the same checks as in VerificImporter::import_netlist()
+					if (design->has(module->name)) {
+						if (!module->name.begins_with("$verific$") && !module->get_bool_attribute(ID::blackbox))
+							log_cmd_error("Re-definition of module `%s'.\n", log_id(module));
+						delete module;
+						continue;
+					}
+					design->add(module);
+				}
+
+				for (auto &it : found[i])
+					nl_todo[it.first] = it.second;
+			});
+		} catch (...) {
+			restore_autoidx();
+			throw;
+		}
+		restore_autoidx();
+	}
+}
+
 std::string verific_import(Design *design, const std::map<std::string,std::string> &parameters, std::string top)
 {
 	verific_sva_fsm_limit = 16;
 
-	std::map<std::string,Netlist*> nl_todo, nl_done;
+	std::map<std::string,Netlist*> nl_todo;
 
 	VeriLibrary *veri_lib = veri_file::GetLibrary("work", 1);
 	Array *netlists = NULL;
@@ -2804,16 +2919,10 @@ std::string verific_import(Design *design, const std::map<std::string,std::strin
 	for (auto nl : nl_todo)
 		worker.run(nl.second);
 
-	while (!nl_todo.empty()) {
-		auto it = nl_todo.begin();
-		Netlist *nl = it->second;
-		if (nl_done.count(it->first) == 0) {
-			VerificImporter importer(false, false, false, false, false, false, false);
-			nl_done[it->first] = it->second;
-			importer.import_netlist(design, nl, nl_todo, nl->CellBaseName() == cell_name);
-		}
-		nl_todo.erase(it);
-	}
+	import_netlists(design, nl_todo, 1, [&](RTLIL::Design *target, Netlist *nl, std::map<std::string,Netlist*> &todo) {
+		VerificImporter importer(false, false, false, false, false, false, false);
+		importer.import_netlist(target, nl, todo, nl->CellBaseName() == cell_name);
+	});
 
 #ifdef YOSYSHQ_VERIFIC_EXTENSIONS
 	VerificExtensions::Reset();
@@ -2834,6 +2943,7 @@ std::string verific_import(Design *design, const std::map<std::string,std::strin
 	RuntimeFlags::DeleteAllFlags();
 	LineFile::DeleteAllLineFiles();
 	verific_incdirs.clear();
+	verific_cache_defines.clear();
 	verific_libdirs.clear();
 	verific_libexts.clear();
 	verific_import_pending = false;
@@ -2858,6 +2968,99 @@ bool check_noverific_env()
 		return false;
 	return true;
 }
+
+// Cache of analyzed Verilog files, see "verific -cache". An entry is a
+// directory with the parse trees of the modules saved by Verific and a list
+// of the modules, which is written last so that incomplete entries are not
+// used.
+
+static void verific_cache_add_file(std::string &key, const std::string &filename)
+{
+	std::ifstream f(filename, std::ios::binary);
+	std::stringstream buffer;
+	buffer << f.rdbuf();
+	key += stringf("F %s %d\n", filename.c_str(), GetSize(buffer.str()));
+	key += buffer.str();
+}
+
+static void verific_cache_add_dir(std::string &key, const std::string &dirname)
+{
+	key += stringf("D %s\n", dirname.c_str());
+#ifndef _WIN32
+	DIR *dir = opendir(dirname.c_str());
+	if (dir == nullptr)
+		return;
+	std::vector<std::string> names;
+	while (struct dirent *entry = readdir(dir))
+		if (entry->d_name[0] != '.')
+			names.push_back(entry->d_name);
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+	for (auto &name : names)
+		if (!check_directory_exists(dirname + "/" + name))
+			verific_cache_add_file(key, dirname + "/" + name);
+#endif
+}
+
+static bool verific_cache_restore(const std::string &entry, const std::string &work)
+{
+	std::ifstream f(entry + "/modules");
+	if (f.fail())
+		return false;
+
+	std::vector<std::string> names;
+	std::string line;
+	while (std::getline(f, line))
+		if (!line.empty())
+			names.push_back(line);
+
+	veri_file::SetDefaultLibraryPath(entry.c_str());
+	for (auto &name : names)
+		if (!veri_file::Restore(work.c_str(), name.c_str(), 1)) {
+			log_warning("Restoring module %s from the Verific cache failed, analyzing the files again.\n", name.c_str());
+			return false;
+		}
+
+	log("Restored %d modules from Verific cache entry %s.\n", GetSize(names), entry.c_str());
+	return true;
+}
+
+static std::set<std::string> verific_cache_modules(const std::string &work)
+{
+	std::set<std::string> names;
+	VeriLibrary *veri_lib = veri_file::GetLibrary(work.c_str(), 1);
+	MapIter mi;
+	VeriModule *veri_module;
+	FOREACH_VERILOG_MODULE_IN_LIBRARY(veri_lib, mi, veri_module)
+		if (veri_module)
+			names.insert(veri_module->Name());
+	return names;
+}
+
+static void verific_cache_save(const std::string &entry, const std::string &work, const std::set<std::string> &old_modules)
+{
+	std::vector<std::string> names;
+	for (auto &name : verific_cache_modules(work))
+		if (!old_modules.count(name))
+			names.push_back(name);
+
+	if (!check_directory_exists(entry) && !create_directory(entry)) {
+		log_warning("Can't create Verific cache entry %s.\n", entry.c_str());
+		return;
+	}
+
+	veri_file::SetDefaultLibraryPath(entry.c_str());
+	for (auto &name : names)
+		if (!veri_file::Save(work.c_str(), name.c_str())) {
+			log_warning("Saving module %s to the Verific cache failed.\n", name.c_str());
+			return;
+		}
+
+	std::ofstream f(entry + "/modules");
+	for (auto &name : names)
+		f << name << "\n";
+	log("Saved %d modules to Verific cache entry %s.\n", GetSize(names), entry.c_str());
+}
 #endif
 
 struct VerificPass : public Pass {
@@ -2981,6 +3184,17 @@ struct VerificPass : public Pass {
 		log("Remove Verilog defines previously set with -vlog-define.\n");
 		log("\n");
 		log("\n");
+		log("    verific -cache [<directory>]\n");
+		log("\n");
+		log("Save the parse trees of the modules analyzed by the following calls with\n");
+		log("-vlog95, -vlog2k, -sv2005, -sv2009, -sv2012, -sv or -formal in the given\n");
+		log("directory, and restore them from there instead of analyzing the files again\n");
+		log("when a later run reads the same files with the same options. The entries are\n");
+		log("keyed by the contents of the files, the defines and the contents of the\n");
+		log("-vlog-incdir and -vlog-libdir directories. Without a directory the cache is\n");
+		log("disabled again. Elaboration is not cached.\n");
+		log("\n");
+		log("\n");
 		log("    verific -set-error <msg_id>..\n");
 		log("    verific -set-warning <msg_id>..\n");
 		log("    verific -set-info <msg_id>..\n");
@@ -3038,6 +3252,12 @@ struct VerificPass : public Pass {
 		log("  -pp <filename>\n");
 		log("    Pretty print design after elaboration to specified file.\n");
 		log("\n");
+		log("  -j <N>\n");
+		log("    Import up to N netlists at the same time. The netlists are read by\n");
+		log("    several threads, so this needs a Verific build that allows concurrent\n");
+		log("    read access to elaborated netlists. The imported design is the same as\n");
+		log("    with -j 1 (the default), but the modules may be added in a different order.\n");
+		log("\n");
 		log("The following additional import options are useful for debugging the Verific\n");
 		log("bindings (for Yosys and/or Verific developers):\n");
 		log("\n");
@@ -3356,9 +3576,16 @@ struct VerificPass : public Pass {
 			goto check_error;
 		}
 
+		if (GetSize(args) > argidx && args[argidx] == "-cache") {
+			verific_cache_dir = argidx+1 < GetSize(args) ? args[++argidx] : "";
+			argidx++;
+			goto check_error;
+		}
+
 		if (GetSize(args) > argidx && args[argidx] == "-vlog-define") {
 			for (argidx++; argidx < GetSize(args); argidx++) {
 				string name = args[argidx];
+				verific_cache_defines += "define " + name + "\n";
 				size_t equal = name.find('=');
 				if (equal != std::string::npos) {
 					string value = name.substr(equal+1);
@@ -3374,6 +3601,7 @@ struct VerificPass : public Pass {
 		if (GetSize(args) > argidx && args[argidx] == "-vlog-undef") {
 			for (argidx++; argidx < GetSize(args); argidx++) {
 				string name = args[argidx];
+				verific_cache_defines += "undef " + name + "\n";
 				veri_file::UndefineMacro(name.c_str());
 			}
 			goto check_error;
@@ -3503,6 +3731,9 @@ struct VerificPass : public Pass {
 			veri_file::DefineMacro("VERIFIC");
 			veri_file::DefineMacro(args[argidx] == "-formal" ? "FORMAL" : "SYNTHESIS");
 
+			std::string cache_key = stringf("%s %s %s\n", release_str, args[argidx].c_str(), work.c_str());
+			cache_key += verific_cache_defines;
+
 			for (argidx++; argidx < GetSize(args) && GetSize(args[argidx]) >= 2 && args[argidx].compare(0, 2, "-D") == 0; argidx++) {
 				std::string name = args[argidx].substr(2);
 				if (args[argidx] == "-D") {
@@ -3510,6 +3741,7 @@ struct VerificPass : public Pass {
 						break;
 					name = args[argidx];
 				}
+				cache_key += "define " + name + "\n";
 				size_t equal = name.find('=');
 				if (equal != std::string::npos) {
 					string value = name.substr(equal+1);
@@ -3540,12 +3772,33 @@ struct VerificPass : public Pass {
 				}
 				std::string filename = frontent_rewrite(args, argidx, tmp_files);
 				file_names.Insert(strdup(filename.c_str()));
+				if (!verific_cache_dir.empty())
+					verific_cache_add_file(cache_key, filename);
 			}
+
+			std::string cache_entry;
+			if (!verific_cache_dir.empty()) {
+				for (auto &dir : verific_incdirs)
+					verific_cache_add_dir(cache_key, dir);
+				for (auto &dir : verific_libdirs)
+					verific_cache_add_dir(cache_key, dir);
+				for (auto &ext : verific_libexts)
+					cache_key += "libext " + ext + "\n";
+				cache_entry = verific_cache_dir + "/" + sha1(cache_key);
+			}
+
 			Map map(POINTER_HASH);
 			add_modules_to_map(map, work, flag_lib);
-			if (!veri_file::AnalyzeMultipleFiles(&file_names, verilog_mode, work.c_str(), veri_file::MFCU)) {
-					verific_error_msg.clear();
-					log_cmd_error("Reading Verilog/SystemVerilog sources failed.\n");
+			if (cache_entry.empty() || !verific_cache_restore(cache_entry, work)) {
+				std::set<std::string> old_modules;
+				if (!cache_entry.empty())
+					old_modules = verific_cache_modules(work);
+				if (!veri_file::AnalyzeMultipleFiles(&file_names, verilog_mode, work.c_str(), veri_file::MFCU)) {
+						verific_error_msg.clear();
+						log_cmd_error("Reading Verilog/SystemVerilog sources failed.\n");
+				}
+				if (!cache_entry.empty())
+					verific_cache_save(cache_entry, work, old_modules);
 			}
 			set_modules_to_blackbox(map, work, flag_lib);
 			verific_import_pending = true;
@@ -3743,12 +3996,13 @@ struct VerificPass : public Pass {
 
 		if (GetSize(args) > argidx && args[argidx] == "-import")
 		{
-			std::map<std::string,Netlist*> nl_todo, nl_done;
+			std::map<std::string,Netlist*> nl_todo;
 			bool mode_all = false, mode_gates = false, mode_keep = false;
 			bool mode_nosva = false, mode_names = false, mode_verific = false;
 			bool mode_autocover = false, mode_fullinit = false;
 			bool flatten = false, extnets = false, mode_cells = false;
 			bool split_complex_ports = true;
+			int num_jobs = 1;
 			string dumpfile;
 			string ppfile;
 			Map parameters(STRING_HASH);
@@ -3798,6 +4052,10 @@ struct VerificPass : public Pass {
 					mode_fullinit = true;
 					continue;
 				}
+				if (args[argidx] == "-j" && argidx+1 < GetSize(args)) {
+					num_jobs = atoi(args[++argidx].c_str());
+					continue;
+				}
 				if (args[argidx] == "-cells") {
 					mode_cells = true;
 					continue;
@@ -4019,17 +4277,11 @@ struct VerificPass : public Pass {
 				veri_writer.WriteFile(dumpfile.c_str(), Netlist::PresentDesign());
 			}
 
-			while (!nl_todo.empty()) {
-				auto it = nl_todo.begin();
-				Netlist *nl = it->second;
-				if (nl_done.count(it->first) == 0) {
-					VerificImporter importer(mode_gates, mode_keep, mode_nosva,
-							mode_names, mode_verific, mode_autocover, mode_fullinit);
-					nl_done[it->first] = it->second;
-					importer.import_netlist(design, nl, nl_todo, top_mod_names.count(nl->CellBaseName()));
-				}
-				nl_todo.erase(it);
-			}
+			import_netlists(design, nl_todo, num_jobs, [&](RTLIL::Design *target, Netlist *nl, std::map<std::string,Netlist*> &todo) {
+				VerificImporter importer(mode_gates, mode_keep, mode_nosva,
+						mode_names, mode_verific, mode_autocover, mode_fullinit);
+				importer.import_netlist(target, nl, todo, top_mod_names.count(nl->CellBaseName()));
+			});
 
 #ifdef YOSYSHQ_VERIFIC_EXTENSIONS
 			VerificExtensions::Reset();
@@ -4050,6 +4302,7 @@ struct VerificPass : public Pass {
 			RuntimeFlags::DeleteAllFlags();
 			LineFile::DeleteAllLineFiles();
 			verific_incdirs.clear();
+			verific_cache_defines.clear();
 			verific_libdirs.clear();
 			verific_libexts.clear();
 			verific_import_pending = false;
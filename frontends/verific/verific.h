@@ -73,6 +73,9 @@ struct VerificImporter
 	std::map<Verific::Net*, Verific::Net*> sva_posedge_map;
 	pool<Verific::Net*, hash_ptr_ops> any_all_nets;
 
+	// src attributes by source location, see src_attribute()
+	std::map<Verific::linefile_type, RTLIL::Const> src_cache;
+
 	bool mode_gates, mode_keep, mode_nosva, mode_names, mode_verific;
 	bool mode_autocover, mode_fullinit;
 
@@ -81,6 +84,7 @@ struct VerificImporter
 	RTLIL::SigBit net_map_at(Verific::Net *net);
 
 	RTLIL::IdString new_verific_id(Verific::DesignObj *obj);
+	const RTLIL::Const &src_attribute(Verific::linefile_type linefile);
 	void import_attributes(dict<RTLIL::IdString, RTLIL::Const> &attributes, Verific::DesignObj *obj, Verific::Netlist  *nl = nullptr);
 
 	RTLIL::SigBit netToSigBit(Verific::Net *net);
@@ -35,18 +35,24 @@
 #include "preproc.h"
 #include "verilog_frontend.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
 #include <assert.h>
+#include <mutex>
 #include <stack>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+#  include <unistd.h>
+#endif
+
 YOSYS_NAMESPACE_BEGIN
 using namespace VERILOG_FRONTEND;
 
-static std::list<std::string> output_code;
-static std::list<std::string> input_buffer;
-static size_t input_buffer_charp;
+static thread_local std::string output_code;
+static thread_local std::list<std::string> input_buffer;
+static thread_local size_t input_buffer_charp;
 
 static void return_char(char ch)
 {
@@ -108,7 +114,7 @@ static std::string next_token(bool pass_newline = false)
 	token += ch;
 	if (ch == '\n') {
 		if (pass_newline) {
-			output_code.push_back(token);
+			output_code += token;
 			return "";
 		}
 		return token;
@@ -385,20 +391,431 @@ void define_map_t::log() const
 	}
 }
 
-static void input_file(std::istream &f, std::string filename)
+static bool same_define(const define_body_t *a, const define_body_t *b)
+{
+	if (a == nullptr || b == nullptr)
+		return a == b;
+	if (a->body != b->body || a->has_args != b->has_args || GetSize(a->args.args) != GetSize(b->args.args))
+		return false;
+	for (int i = 0; i < GetSize(a->args.args); i++) {
+		const macro_arg_t &arg_a = a->args.args[i], &arg_b = b->args.args[i];
+		if (arg_a.name != arg_b.name || arg_a.has_default != arg_b.has_default || arg_a.default_value != arg_b.default_value)
+			return false;
+	}
+	return true;
+}
+
+// Records how preprocessing part of the input depends on and changes the
+// defines, for files preprocessed in a batch and for cached include files.
+struct define_trace_t
+{
+	// defines looked up before they were changed, with the value they had
+	// at that point (null if undefined)
+	std::map<std::string, std::unique_ptr<define_body_t>> reads;
+	pool<std::string> local_writes, global_writes;
+	bool cleared = false;
+
+	std::vector<std::string> input_files;
+	bool resetall = false;
+};
+
+struct preproc_batch_t::file_t : define_trace_t
+{
+	std::string filename;
+	bool ok = false;
+	std::string code;
+
+	// the global defines after preprocessing the file, starting from the
+	// global defines before the first file of the batch
+	define_map_t global_defines;
+};
+
+// The state of an include file, used to check that the cached result is
+// still current.
+struct file_stamp_t
+{
+	std::string filename;
+	time_t mtime;
+	off_t size;
+
+	bool operator==(const file_stamp_t &other) const {
+		return filename == other.filename && mtime == other.mtime && size == other.size;
+	}
+};
+
+static bool get_file_stamp(const std::string &filename, file_stamp_t &stamp)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+		return false;
+	stamp.filename = filename;
+	stamp.mtime = st.st_mtime;
+	stamp.size = st.st_size;
+	return true;
+}
+
+// An include file that is currently being preprocessed.
+struct include_scope_t : define_trace_t
+{
+	std::string key;
+	// the input chunk with the `file_pop of the include file
+	const std::string *end_marker;
+	size_t output_start, depth, macro_args;
+	int pass_level;
+	std::vector<file_stamp_t> stamps;
+	bool cacheable = true;
+};
+
+// The result of preprocessing an include file, for including it again while
+// the defines it looked up have the same values.
+struct include_result_t
+{
+	std::map<std::string, std::unique_ptr<define_body_t>> reads;
+	std::vector<std::pair<std::string, std::unique_ptr<define_body_t>>> local_defines, global_defines;
+	bool cleared;
+	std::string output;
+	std::vector<std::string> input_files;
+	std::vector<file_stamp_t> stamps;
+	bool resetall;
+};
+
+// Results for all include files read by this process so far, with a few
+// variants per file for different defines.
+static dict<std::string, std::vector<std::shared_ptr<const include_result_t>>> include_cache;
+static std::mutex include_cache_mutex;
+static const int include_cache_variants = 8;
+
+// The batch file that is currently preprocessed by this thread, if any.
+static thread_local preproc_batch_t::file_t *batch_file = nullptr;
+
+// The batch file and the include files that are currently preprocessed,
+// outermost first.
+static thread_local std::vector<define_trace_t*> active_traces;
+static thread_local std::vector<include_scope_t*> include_scopes;
+
+static const define_body_t *find_define(const define_map_t &defines, const std::string &name)
+{
+	const define_body_t *body = defines.find(name);
+	for (auto trace : active_traces)
+		if (!trace->cleared && !trace->local_writes.count(name) && !trace->reads.count(name))
+			trace->reads[name] = std::unique_ptr<define_body_t>(body ? new define_body_t(*body) : nullptr);
+	return body;
+}
+
+static void note_local_define(const std::string &name)
+{
+	for (auto trace : active_traces)
+		trace->local_writes.insert(name);
+}
+
+static void note_global_define(const std::string &name)
+{
+	for (auto trace : active_traces)
+		trace->global_writes.insert(name);
+}
+
+static void note_clear_defines()
+{
+	for (auto trace : active_traces)
+		trace->cleared = true;
+}
+
+static void note_input_file(const std::string &filename)
+{
+	for (auto trace : active_traces)
+		trace->input_files.push_back(filename);
+	file_stamp_t stamp;
+	for (auto scope : include_scopes) {
+		if (get_file_stamp(filename, stamp))
+			scope->stamps.push_back(stamp);
+		else
+			scope->cacheable = false;
+	}
+	if (!batch_file)
+		yosys_input_files.insert(filename);
+}
+
+static void note_resetall()
+{
+	for (auto trace : active_traces)
+		trace->resetall = true;
+	if (!batch_file)
+		default_nettype_wire = true;
+}
+
+static std::string include_cache_key(const std::string &filename, const std::list<std::string> &include_dirs)
+{
+	// the nested include files are searched relative to the working
+	// directory and in the include directories
+	std::string key = filename + "\n" + (sv_mode ? "sv" : "") + "\n";
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) != nullptr)
+		key += cwd;
+	for (auto &dir : include_dirs)
+		key += "\n" + dir;
+	return key;
+}
+
+// Looks for a cached result for the include file that is valid with the
+// current defines, and applies it.
+static bool include_from_cache(const std::string &key, const std::string &filename, define_map_t &defines, define_map_t &global_defines_cache)
+{
+	std::vector<std::shared_ptr<const include_result_t>> variants;
+	{
+		std::lock_guard<std::mutex> lock(include_cache_mutex);
+		auto it = include_cache.find(key);
+		if (it == include_cache.end())
+			return false;
+		variants = it->second;
+	}
+
+	file_stamp_t stamp;
+	if (!get_file_stamp(filename, stamp))
+		return false;
+
+	for (auto &result : variants)
+	{
+		if (!(result->stamps.front() == stamp))
+			continue;
+
+		bool valid = true;
+		for (auto &it : result->reads)
+			if (!same_define(find_define(defines, it.first), it.second.get())) {
+				valid = false;
+				break;
+			}
+		for (size_t i = 1; valid && i < result->stamps.size(); i++) {
+			file_stamp_t nested;
+			if (!get_file_stamp(result->stamps[i].filename, nested) || !(nested == result->stamps[i]))
+				valid = false;
+		}
+		if (!valid)
+			continue;
+
+		if (result->cleared) {
+			defines.clear();
+			global_defines_cache.clear();
+			note_clear_defines();
+		}
+		for (auto &it : result->local_defines) {
+			if (it.second)
+				defines.add(it.first, *it.second);
+			else
+				defines.erase(it.first);
+			note_local_define(it.first);
+		}
+		for (auto &it : result->global_defines) {
+			if (it.second)
+				global_defines_cache.add(it.first, *it.second);
+			else
+				global_defines_cache.erase(it.first);
+			note_global_define(it.first);
+		}
+
+		output_code += result->output;
+		insert_input("\n");
+
+		for (auto scope : include_scopes)
+			scope->stamps.insert(scope->stamps.end(), result->stamps.begin() + 1, result->stamps.end());
+		for (auto &fn : result->input_files) {
+			for (auto trace : active_traces)
+				trace->input_files.push_back(fn);
+			if (!batch_file)
+				yosys_input_files.insert(fn);
+		}
+		if (result->resetall)
+			note_resetall();
+		return true;
+	}
+
+	return false;
+}
+
+static void begin_include_scope(const std::string &key, const std::string &filename, const std::string *end_marker,
+		size_t depth, int pass_level, size_t macro_args)
+{
+	include_scope_t *scope = new include_scope_t;
+	scope->key = key;
+	scope->end_marker = end_marker;
+	scope->output_start = output_code.size();
+	scope->depth = depth;
+	scope->pass_level = pass_level;
+	scope->macro_args = macro_args;
+	file_stamp_t stamp;
+	if (get_file_stamp(filename, stamp))
+		scope->stamps.push_back(stamp);
+	else
+		scope->cacheable = false;
+	include_scopes.push_back(scope);
+	active_traces.push_back(scope);
+}
+
+static void end_include_scope(const define_map_t &defines, const define_map_t &global_defines_cache, bool cacheable)
+{
+	std::unique_ptr<include_scope_t> scope(include_scopes.back());
+	include_scopes.pop_back();
+	log_assert(active_traces.back() == scope.get());
+	active_traces.pop_back();
+
+	if (!cacheable || !scope->cacheable)
+		return;
+
+	std::shared_ptr<include_result_t> result(new include_result_t);
+	result->reads.swap(scope->reads);
+	for (auto &name : scope->local_writes) {
+		const define_body_t *body = defines.find(name);
+		result->local_defines.emplace_back(name, std::unique_ptr<define_body_t>(body ? new define_body_t(*body) : nullptr));
+	}
+	for (auto &name : scope->global_writes) {
+		const define_body_t *body = global_defines_cache.find(name);
+		result->global_defines.emplace_back(name, std::unique_ptr<define_body_t>(body ? new define_body_t(*body) : nullptr));
+	}
+	result->cleared = scope->cleared;
+	result->output = output_code.substr(scope->output_start);
+	result->input_files.swap(scope->input_files);
+	result->stamps.swap(scope->stamps);
+	result->resetall = scope->resetall;
+
+	std::lock_guard<std::mutex> lock(include_cache_mutex);
+	auto &variants = include_cache[scope->key];
+	variants.insert(variants.begin(), result);
+	if (GetSize(variants) > include_cache_variants)
+		variants.pop_back();
+}
+
+static void clear_include_scopes()
+{
+	for (auto scope : include_scopes)
+		delete scope;
+	include_scopes.clear();
+	active_traces.clear();
+}
+
+static std::string read_text(std::istream &f)
 {
 	char buffer[513];
 	int rc;
 
+	std::string text;
+	while ((rc = readsome(f, buffer, sizeof(buffer)-1)) > 0) {
+		buffer[rc] = 0;
+		text += buffer;
+	}
+	return text;
+}
+
+// Returns the input chunk that ends the file, which stays in the same place
+// until the end of the file has been read.
+static const std::string *input_file(const std::string &text, std::string filename)
+{
 	insert_input("");
 	auto it = input_buffer.begin();
 
+	// small chunks keep insert_input() cheap
 	input_buffer.insert(it, "`file_push \"" + filename + "\"\n");
-	while ((rc = readsome(f, buffer, sizeof(buffer)-1)) > 0) {
-		buffer[rc] = 0;
-		input_buffer.insert(it, buffer);
+	for (size_t pos = 0; pos < text.size(); pos += 512)
+		input_buffer.insert(it, text.substr(pos, 512));
+	return &*input_buffer.insert(it, "\n`file_pop\n");
+}
+
+// Preprocesses a file that contains no backticks, i.e. no directives and no
+// macro uses, in a single pass. The result is the same as with the regular
+// path, which for such files only rewrites comments and removes carriage
+// returns. Returns false for inputs where the regular path must be used.
+static bool preproc_plain(const std::string &text, const std::string &filename, std::string &output)
+{
+	if (text.find('`') != std::string::npos || filename.find_first_of("\"\n") != std::string::npos ||
+			(!filename.empty() && filename.back() == '\\'))
+		return false;
+
+	size_t i = 0, n = text.size();
+	auto next = [&]() -> char {
+		while (i < n && text[i] == '\r')
+			i++;
+		return i < n ? text[i++] : 0;
+	};
+
+	output.clear();
+	output.reserve(n + filename.size() + 32);
+	output += "`file_push \"" + filename + "\"\n";
+
+	char ch;
+	while ((ch = next()) != 0)
+	{
+		if (ch == '"') {
+			size_t start = output.size();
+			output += ch;
+			while ((ch = next()) != 0) {
+				output += ch;
+				if (ch == '"')
+					break;
+				if (ch == '\\') {
+					if ((ch = next()) != 0)
+						output += ch;
+				}
+			}
+			if (ch == 0)
+				return false;
+			if (output.size() - start == 2 && (ch = next()) != 0) {
+				if (ch == '"')
+					output += ch;
+				else
+					i--;
+			}
+		} else if (ch == '\\') {
+			output += ch;
+			while ((ch = next()) != 0) {
+				if (ch < 33 || ch > 126) {
+					i--;
+					break;
+				}
+				output += ch;
+			}
+		} else if (ch == '/') {
+			ch = next();
+			if (ch == '/') {
+				output += "/*";
+				char last_ch = 0;
+				while ((ch = next()) != 0) {
+					if (ch == '\n') {
+						i--;
+						break;
+					}
+					if (last_ch != '*' || ch != '/') {
+						output += ch;
+						last_ch = ch;
+					}
+				}
+				output += " */";
+			} else if (ch == '*') {
+				output += "/*";
+				int newline_count = 0;
+				char last_ch = 0;
+				while ((ch = next()) != 0) {
+					if (ch == '\n') {
+						newline_count++;
+						output += ' ';
+					} else
+						output += ch;
+					if (last_ch == '*' && ch == '/')
+						break;
+					last_ch = ch;
+				}
+				if (ch == 0)
+					return false;
+				output.append(newline_count, '\n');
+			} else {
+				output += '/';
+				if (ch != 0)
+					i--;
+			}
+		} else {
+			output += ch;
+		}
 	}
-	input_buffer.insert(it, "\n`file_pop\n");
+
+	output += "\n`file_pop\n";
+	return true;
 }
 
 // Read tokens to get one argument (either a macro argument at a callsite or a default argument in a
@@ -463,6 +880,7 @@ static void restore_macro_arg(define_map_t &defines, macro_arg_stack_t &macro_ar
 	log_assert(!macro_arg_stack.empty());
 	auto &overwritten_arg = macro_arg_stack.top();
 	defines.add(overwritten_arg.first, overwritten_arg.second);
+	note_local_define(overwritten_arg.first);
 	macro_arg_stack.pop();
 }
 
@@ -493,7 +911,7 @@ static bool try_expand_macro(define_map_t &defines, macro_arg_stack_t &macro_arg
 
 	// This token looks like a macro name (`foo).
 	std::string macro_name = tok.substr(1);
-	const define_body_t *body = defines.find(tok.substr(1));
+	const define_body_t *body = find_define(defines, tok.substr(1));
 
 	if (! body) {
 		// Apparently not a name we know.
@@ -521,11 +939,12 @@ static bool try_expand_macro(define_map_t &defines, macro_arg_stack_t &macro_arg
 			args.push_back(arg);
 		}
 		for (const auto &pr : body->args.get_vals(name, args)) {
-			if (const define_body_t *existing = defines.find(pr.first)) {
+			if (const define_body_t *existing = find_define(defines, pr.first)) {
 				macro_arg_stack.push({pr.first, *existing});
 				insert_input("`__restore_macro_arg ");
 			}
 			defines.add(pr.first, pr.second);
+			note_local_define(pr.first);
 		}
 	} else {
 		insert_input(tok);
@@ -739,6 +1158,8 @@ read_define(const std::string &filename,
 		// printf("define: >>%s<< -> >>%s<<\n", name.c_str(), value.c_str());
 		defines_map.add(name, value, (state == 2) ? &args : nullptr);
 		global_defines_cache.add(name, value, (state == 2) ? &args : nullptr);
+		note_local_define(name);
+		note_global_define(name);
 	} else {
 		log_file_error(filename, 0, "Invalid name for macro definition: >>%s<<.\n", name.c_str());
 	}
@@ -769,11 +1190,20 @@ frontend_verilog_preproc(std::istream                 &f,
 	// Meaningless if ifdef_fail_level == 0.
 	bool ifdef_already_satisfied = false;
 
+	std::string text = read_text(f);
+	std::string output;
+	if (preproc_plain(text, filename, output))
+		return output;
+
 	output_code.clear();
 	input_buffer.clear();
 	input_buffer_charp = 0;
 
-	input_file(f, filename);
+	clear_include_scopes();
+	if (batch_file)
+		active_traces.push_back(batch_file);
+
+	input_file(text, filename);
 
 	while (!input_buffer.empty())
 	{
@@ -814,7 +1244,7 @@ frontend_verilog_preproc(std::istream                 &f,
 				ifdef_pass_level--;
 				ifdef_fail_level = 1;
 				ifdef_already_satisfied = true;
-			} else if (ifdef_fail_level == 1 && !ifdef_already_satisfied && defines.find(name)) {
+			} else if (ifdef_fail_level == 1 && !ifdef_already_satisfied && find_define(defines, name)) {
 				ifdef_fail_level = 0;
 				ifdef_pass_level++;
 				ifdef_already_satisfied = true;
@@ -825,7 +1255,7 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (tok == "`ifdef") {
 			skip_spaces();
 			std::string name = next_token(true);
-			if (ifdef_fail_level > 0 || !defines.find(name)) {
+			if (ifdef_fail_level > 0 || !find_define(defines, name)) {
 				ifdef_fail_level++;
 			} else {
 				ifdef_pass_level++;
@@ -839,7 +1269,7 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (tok == "`ifndef") {
 			skip_spaces();
 			std::string name = next_token(true);
-			if (ifdef_fail_level > 0 || defines.find(name)) {
+			if (ifdef_fail_level > 0 || find_define(defines, name)) {
 				ifdef_fail_level++;
 			} else {
 				ifdef_pass_level++;
@@ -852,7 +1282,7 @@ frontend_verilog_preproc(std::istream                 &f,
 
 		if (ifdef_fail_level > 0) {
 			if (tok == "\n")
-				output_code.push_back(tok);
+				output_code += tok;
 			continue;
 		}
 
@@ -910,10 +1340,18 @@ frontend_verilog_preproc(std::istream                 &f,
 				}
 			}
 			if (ff.fail()) {
-				output_code.push_back("`file_notfound " + fn);
+				output_code += "`file_notfound " + fn;
+				// the file may exist the next time
+				for (auto scope : include_scopes)
+					scope->cacheable = false;
 			} else {
-				input_file(ff, fixed_fn);
-				yosys_input_files.insert(fixed_fn);
+				note_input_file(fixed_fn);
+				std::string key = include_cache_key(fixed_fn, include_dirs);
+				if (!include_from_cache(key, fixed_fn, defines, global_defines_cache)) {
+					const std::string *end_marker = input_file(read_text(ff), fixed_fn);
+					begin_include_scope(key, fixed_fn, end_marker, filename_stack.size() + 1,
+							ifdef_pass_level, macro_arg_stack.size());
+				}
 			}
 			continue;
 		}
@@ -923,14 +1361,25 @@ frontend_verilog_preproc(std::istream                 &f,
 			std::string fn = next_token(true);
 			if (!fn.empty() && fn.front() == '"' && fn.back() == '"')
 				fn = fn.substr(1, fn.size()-2);
-			output_code.push_back(tok + " \"" + fn + "\"");
+			output_code += tok + " \"" + fn + "\"";
 			filename_stack.push_back(filename);
 			filename = fn;
 			continue;
 		}
 
 		if (tok == "`file_pop") {
-			output_code.push_back(tok);
+			output_code += tok;
+			while (!include_scopes.empty() && include_scopes.back()->depth > filename_stack.size())
+				end_include_scope(defines, global_defines_cache, false);
+			if (!include_scopes.empty() && include_scopes.back()->depth == filename_stack.size()) {
+				// only cache files that are self-contained, i.e. that end
+				// with all their conditionals and macro uses closed
+				include_scope_t *scope = include_scopes.back();
+				bool complete = &input_buffer.front() == scope->end_marker &&
+						input_buffer_charp + 1 == input_buffer.front().size() &&
+						ifdef_pass_level == scope->pass_level && macro_arg_stack.size() == scope->macro_args;
+				end_include_scope(defines, global_defines_cache, complete);
+			}
 			filename = filename_stack.back();
 			filename_stack.pop_back();
 			continue;
@@ -948,6 +1397,8 @@ frontend_verilog_preproc(std::istream                 &f,
 			// printf("undef: >>%s<<\n", name.c_str());
 			defines.erase(name);
 			global_defines_cache.erase(name);
+			note_local_define(name);
+			note_global_define(name);
 			continue;
 		}
 
@@ -961,13 +1412,14 @@ frontend_verilog_preproc(std::istream                 &f,
 		}
 
 		if (tok == "`resetall") {
-			default_nettype_wire = true;
+			note_resetall();
 			continue;
 		}
 
 		if (tok == "`undefineall" && sv_mode) {
 			defines.clear();
 			global_defines_cache.clear();
+			note_clear_defines();
 			continue;
 		}
 
@@ -979,22 +1431,106 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (try_expand_macro(defines, macro_arg_stack, tok))
 			continue;
 
-		output_code.push_back(tok);
+		output_code += tok;
 	}
 
 	if (ifdef_fail_level > 0 || ifdef_pass_level > 0) {
 		log_error("Unterminated preprocessor conditional!\n");
 	}
 
-	std::string output;
-	for (auto &str : output_code)
-		output += str;
+	output.swap(output_code);
 
 	output_code.clear();
 	input_buffer.clear();
 	input_buffer_charp = 0;
+	clear_include_scopes();
 
 	return output;
 }
 
+preproc_batch_t::preproc_batch_t(const std::vector<std::string> &filenames,
+                                 const define_map_t             &pre_defines,
+                                 const define_map_t             &global_defines_cache,
+                                 const std::list<std::string>   &include_dirs,
+                                 int                             num_threads)
+{
+	for (auto &filename : filenames) {
+		files.emplace_back(new file_t);
+		files.back()->filename = filename;
+		files.back()->global_defines.clear();
+		files.back()->global_defines.merge(global_defines_cache);
+	}
+
+	ThreadPool::run(GetSize(files), [&](int i) {
+		file_t &file = *files[i];
+		std::ifstream f(file.filename);
+		if (f.fail())
+			return;
+		// leave gzip files to the frontend
+		if (f.peek() == 0x1f)
+			return;
+
+		// errors are reported when the file is preprocessed again
+		LogCapture capture;
+		capture.begin();
+		batch_file = &file;
+		try {
+			file.code = frontend_verilog_preproc(f, file.filename, pre_defines, file.global_defines, include_dirs);
+			file.ok = true;
+		} catch (...) {
+		}
+		batch_file = nullptr;
+		capture.end();
+	}, num_threads);
+}
+
+preproc_batch_t::~preproc_batch_t()
+{}
+
+std::string preproc_batch_t::next() const
+{
+	return cursor < GetSize(files) ? files[cursor]->filename : std::string();
+}
+
+void preproc_batch_t::skip()
+{
+	log_assert(cursor < GetSize(files));
+	files[cursor++].reset();
+}
+
+bool preproc_batch_t::take(const define_map_t &pre_defines, define_map_t &global_defines_cache, std::string &code)
+{
+	log_assert(cursor < GetSize(files));
+	std::unique_ptr<file_t> file = std::move(files[cursor++]);
+
+	if (!file->ok)
+		return false;
+
+	for (auto &it : file->reads) {
+		const define_body_t *value = global_defines_cache.find(it.first);
+		if (value == nullptr)
+			value = pre_defines.find(it.first);
+		if (!same_define(value, it.second.get()))
+			return false;
+	}
+
+	if (file->cleared)
+		global_defines_cache.clear();
+	for (auto &name : file->global_writes) {
+		const define_body_t *body = file->global_defines.find(name);
+		if (body)
+			global_defines_cache.add(name, *body);
+		else
+			global_defines_cache.erase(name);
+	}
+
+	for (auto &fn : file->input_files)
+		yosys_input_files.insert(fn);
+	if (file->resetall)
+		default_nettype_wire = true;
+
+	code.swap(file->code);
+	return true;
+}
+
 YOSYS_NAMESPACE_END
@@ -73,6 +73,37 @@ frontend_verilog_preproc(std::istream                 &f,
                          define_map_t                 &global_defines_cache,
                          const std::list<std::string> &include_dirs);
 
+// Preprocesses a sequence of files on several threads, before the frontend
+// reads them one after the other. All files are preprocessed with the global
+// defines from before the first file. The result for a file is only used if
+// the defines it looked up still have the same values when the frontend gets
+// to the file, otherwise the file must be preprocessed again.
+struct preproc_batch_t
+{
+	preproc_batch_t(const std::vector<std::string> &filenames,
+	                const define_map_t             &pre_defines,
+	                const define_map_t             &global_defines_cache,
+	                const std::list<std::string>   &include_dirs,
+	                int                             num_threads);
+	~preproc_batch_t();
+
+	// The name of the file expected next, or an empty string if all files
+	// have been handled.
+	std::string next() const;
+
+	// Moves on to the next file without using its result.
+	void skip();
+
+	// Moves on to the next file. Returns false if its result can't be used.
+	// Otherwise stores the preprocessed code and applies the changes the file
+	// made to the global defines, just like frontend_verilog_preproc().
+	bool take(const define_map_t &pre_defines, define_map_t &global_defines_cache, std::string &code);
+
+	struct file_t;
+	std::vector<std::unique_ptr<file_t>> files;
+	int cursor = 0;
+};
+
 YOSYS_NAMESPACE_END
 
 #endif
@@ -29,8 +29,11 @@
 #include "verilog_frontend.h"
 #include "preproc.h"
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
 #include "libs/sha1/sha1.h"
+#include "backends/rtlil/rtlil_backend.h"
 #include <stdarg.h>
+#include <mutex>
 
 YOSYS_NAMESPACE_BEGIN
 using namespace VERILOG_FRONTEND;
@@ -40,6 +43,20 @@ using namespace VERILOG_FRONTEND;
 static std::vector<std::string> verilog_defaults;
 static std::list<std::vector<std::string>> verilog_defaults_stack;
 
+// files of the current read_verilog command that are preprocessed in advance
+static std::unique_ptr<preproc_batch_t> preproc_batch;
+
+// Drops the preprocessed files when reading a file fails, so that later
+// commands don't use them.
+struct PreprocBatchGuard
+{
+	bool done = false;
+	~PreprocBatchGuard() {
+		if (!done)
+			preproc_batch.reset();
+	}
+};
+
 static void error_on_dpi_function(AST::AstNode *node)
 {
 	if (node->type == AST::AST_DPI_FUNCTION)
@@ -63,6 +80,247 @@ static void add_package_types(dict<std::string, AST::AstNode *> &user_types, std
 	}
 }
 
+// Pre-parsed library images: "read_verilog -lib -write_image" stores the
+// modules read from a library file as RTLIL, with a header recording how they
+// were read. Later "read_verilog -lib" calls with the same options load the
+// image "<file>.il" instead of parsing the file, as long as it is current.
+// Modules loaded from an image parse their source again on demand when they
+// need to be derived with parameters.
+
+struct LibImageModule : RTLIL::Module
+{
+	std::string source;
+	std::vector<std::string> options;
+
+	RTLIL::Module *source_module();
+	RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, bool mayfail) override;
+	RTLIL::IdString derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, const dict<RTLIL::IdString, RTLIL::Module*> &interfaces, const dict<RTLIL::IdString, RTLIL::IdString> &modports, bool mayfail) override;
+	RTLIL::Module *clone() const override;
+};
+
+// library sources parsed for LibImageModule::derive(), kept until exit
+static dict<std::string, RTLIL::Design*> lib_image_sources;
+
+RTLIL::Module *LibImageModule::source_module()
+{
+	std::string key = source;
+	for (auto &opt : options)
+		key += " " + opt;
+
+	if (lib_image_sources.count(key) == 0) {
+		if (current_ast != nullptr)
+			log_error("Can't derive module %s from library image while reading Verilog.\n", log_id(name));
+		log("Parsing `%s' to derive module %s loaded from library image.\n", source.c_str(), log_id(name));
+		std::vector<std::string> args = {"verilog", "-noimage"};
+		args.insert(args.end(), options.begin(), options.end());
+		// the options already include the defaults used for the image
+		std::vector<std::string> bak_defaults;
+		std::swap(bak_defaults, verilog_defaults);
+		RTLIL::Design *parsed = new RTLIL::Design;
+		Frontend::frontend_call(parsed, nullptr, source, args);
+		std::swap(bak_defaults, verilog_defaults);
+		lib_image_sources[key] = parsed;
+	}
+
+	RTLIL::Module *mod = lib_image_sources.at(key)->module(name);
+	if (mod == nullptr)
+		log_error("Module %s from library image not found in `%s'.\n", log_id(name), source.c_str());
+	return mod;
+}
+
+RTLIL::IdString LibImageModule::derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, bool mayfail)
+{
+	return source_module()->derive(design, parameters, mayfail);
+}
+
+RTLIL::IdString LibImageModule::derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, const dict<RTLIL::IdString, RTLIL::Module*> &interfaces, const dict<RTLIL::IdString, RTLIL::IdString> &modports, bool mayfail)
+{
+	return source_module()->derive(design, parameters, interfaces, modports, mayfail);
+}
+
+RTLIL::Module *LibImageModule::clone() const
+{
+	LibImageModule *new_mod = new LibImageModule;
+	new_mod->name = name;
+	cloneInto(new_mod);
+	new_mod->source = source;
+	new_mod->options = options;
+	return new_mod;
+}
+
+static std::vector<std::string> lib_image_header(const std::string &source_hash, const std::vector<std::string> &options)
+{
+	std::string options_str;
+	for (auto &opt : options)
+		options_str += " " + opt;
+	return {
+		"# yosys verilog library image",
+		stringf("# version %s", yosys_version_str),
+		"# source " + source_hash,
+		"# options" + options_str,
+	};
+}
+
+// names of all macros the source could depend on, a superset is fine
+static pool<std::string> lib_image_macros(const std::string &text)
+{
+	pool<std::string> names;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] != '`')
+			continue;
+		size_t j = i+1;
+		while (j < text.size() && (isalnum((unsigned char)text[j]) || text[j] == '_' || text[j] == '$'))
+			j++;
+		std::string word = text.substr(i+1, j-i-1);
+		if (word == "ifdef" || word == "ifndef" || word == "elsif") {
+			while (j < text.size() && isspace((unsigned char)text[j]))
+				j++;
+			size_t k = j;
+			while (k < text.size() && (isalnum((unsigned char)text[k]) || text[k] == '_' || text[k] == '$'))
+				k++;
+			word = text.substr(j, k-j);
+		}
+		if (!word.empty())
+			names.insert(word);
+		i = j-1;
+	}
+	return names;
+}
+
+// same handling of existing modules as in AST::process(), returns false if
+// the new module is to be ignored
+static bool make_room_for_lib_module(RTLIL::Design *design, RTLIL::IdString name, const std::string &origin, bool nooverwrite, bool overwrite)
+{
+	if (!design->has(name))
+		return true;
+	RTLIL::Module *existing_mod = design->module(name);
+	if (!nooverwrite && !overwrite && !existing_mod->get_blackbox_attribute()) {
+		log_error("Re-definition of module `%s' in %s!\n", log_id(name), origin.c_str());
+	} else if (nooverwrite) {
+		log("Ignoring re-definition of module `%s'.\n", log_id(name));
+		return false;
+	}
+	log("Replacing existing%s module `%s'.\n", existing_mod->get_bool_attribute(ID::blackbox) ? " blackbox" : "", log_id(name));
+	design->remove(existing_mod);
+	return true;
+}
+
+static bool read_lib_image(RTLIL::Design *design, const std::string &filename, const std::string &source_hash,
+		const std::vector<std::string> &options, bool nooverwrite, bool overwrite)
+{
+	std::string image_filename = filename + ".il";
+	std::ifstream f(image_filename);
+	if (!f.is_open())
+		return false;
+
+	std::string line;
+	for (auto &expected : lib_image_header(source_hash, options))
+		if (!std::getline(f, line) || line != expected) {
+			log("Not using library image `%s', it was created from a different source or with different options.\n", image_filename.c_str());
+			return false;
+		}
+
+	if (!std::getline(f, line) || line.compare(0, 8, "# macros") != 0) {
+		log_warning("Ignoring malformed library image `%s'.\n", image_filename.c_str());
+		return false;
+	}
+	for (auto &name : split_tokens(line.substr(8)))
+		if (design->verilog_defines->find(name)) {
+			log("Not using library image `%s', macro `%s' is defined.\n", image_filename.c_str(), name.c_str());
+			return false;
+		}
+
+	log("Loading library image `%s'.\n", image_filename.c_str());
+	RTLIL::Design image;
+	Frontend::frontend_call(&image, &f, image_filename, "rtlil");
+
+	for (auto mod : image.modules()) {
+		if (!make_room_for_lib_module(design, mod->name, "library image `" + image_filename + "'", nooverwrite, overwrite))
+			continue;
+		LibImageModule *new_mod = new LibImageModule;
+		new_mod->name = mod->name;
+		mod->cloneInto(new_mod);
+		new_mod->source = filename;
+		new_mod->options = options;
+		design->add(new_mod);
+	}
+	return true;
+}
+
+static void write_lib_image(RTLIL::Design *design, const std::string &image_filename, const std::string &source_text,
+		const std::vector<std::string> &options, const std::vector<RTLIL::Module*> &modules)
+{
+	if (source_text.find("`include") != std::string::npos)
+		log_cmd_error("Can't write library image for a source with `include directives.\n");
+	for (auto mod : modules)
+		if (mod->name.begins_with("$abstract"))
+			log_cmd_error("Can't write library image with deferred module %s.\n", log_id(mod->name.substr(9)));
+
+	std::ofstream f(image_filename);
+	if (f.fail())
+		log_cmd_error("Can't open library image `%s' for writing: %s\n", image_filename.c_str(), strerror(errno));
+	for (auto &line : lib_image_header(sha1(source_text), options))
+		f << line << "\n";
+	f << "# macros";
+	for (auto &name : lib_image_macros(source_text))
+		f << " " << name;
+	f << "\n";
+	for (auto mod : modules)
+		RTLIL_BACKEND::dump_module(f, "", mod, design, false);
+	log("Wrote library image with %d modules to `%s'.\n", GetSize(modules), image_filename.c_str());
+}
+
+// Libraries read with -lib earlier in this process, keyed by the file name,
+// the source hash and the options. Later reads of the same library add clones
+// of the cached modules instead of parsing the source again, under the same
+// conditions as for library images. The cached modules are never modified;
+// clones of AST modules share the AST derive memo with them, so parameter
+// sets derived in one design are reused by the next.
+struct lib_cache_entry_t {
+	RTLIL::Design modules;
+	pool<std::string> macros;
+};
+static dict<std::string, lib_cache_entry_t*> lib_cache;
+static std::mutex lib_cache_mutex;
+
+static std::string lib_cache_key(const std::string &filename, const std::string &source_hash, const std::vector<std::string> &options)
+{
+	std::string key = filename + "\n" + source_hash;
+	for (auto &opt : options)
+		key += " " + opt;
+	return key;
+}
+
+static bool read_lib_cache(RTLIL::Design *design, const std::string &key, const std::string &filename, bool nooverwrite, bool overwrite)
+{
+	std::lock_guard<std::mutex> lock(lib_cache_mutex);
+	auto it = lib_cache.find(key);
+	if (it == lib_cache.end())
+		return false;
+	for (auto &name : it->second->macros)
+		if (design->verilog_defines->find(name))
+			return false;
+
+	log("Using %d modules of `%s' read before.\n", GetSize(it->second->modules.modules()), filename.c_str());
+	for (auto mod : it->second->modules.modules())
+		if (make_room_for_lib_module(design, mod->name, "`" + filename + "'", nooverwrite, overwrite))
+			design->add(mod->clone());
+	return true;
+}
+
+static void write_lib_cache(const std::string &key, const std::string &source_text, const std::vector<RTLIL::Module*> &modules)
+{
+	lib_cache_entry_t *entry = new lib_cache_entry_t;
+	entry->macros = lib_image_macros(source_text);
+	for (auto mod : modules)
+		entry->modules.add(mod->clone());
+
+	std::lock_guard<std::mutex> lock(lib_cache_mutex);
+	if (lib_cache.count(key))
+		delete lib_cache.at(key);
+	lib_cache[key] = entry;
+}
+
 struct VerilogFrontend : public Frontend {
 	VerilogFrontend() : Frontend("verilog", "read modules from Verilog file") { }
 	void help() override
@@ -177,6 +435,21 @@ struct VerilogFrontend : public Frontend {
 		log("        modules with the (* whitebox *) attribute will be preserved.\n");
 		log("        (* lib_whitebox *) will be treated like (* whitebox *).\n");
 		log("\n");
+		log("    -write_image <file>\n");
+		log("        together with -lib, write the modules read from the input file to\n");
+		log("        the given file as a library image. When a file <name>.il created\n");
+		log("        this way exists next to the library file <name>, later calls with\n");
+		log("        -lib and the same options load the image instead of parsing the\n");
+		log("        library, as long as it was created by the same version of yosys\n");
+		log("        from the same source and no macro used by the source is defined.\n");
+		log("        Use with a single input file only.\n");
+		log("\n");
+		log("    -noimage\n");
+		log("        always parse the input file, even if a library image exists.\n");
+		log("        Without this option, a library read with -lib is kept in memory\n");
+		log("        and reading it again with the same options in the same process\n");
+		log("        copies the modules read before instead of parsing it again.\n");
+		log("\n");
 		log("    -nowb\n");
 		log("        delete (* whitebox *) and (* lib_whitebox *) attributes from\n");
 		log("        all modules.\n");
@@ -207,6 +480,13 @@ struct VerilogFrontend : public Frontend {
 		log("        to a later 'hierarchy' command. Useful in cases where the default\n");
 		log("        parameters of modules yield invalid or not synthesizable code.\n");
 		log("\n");
+		log("    -netlist\n");
+		log("        convert modules that only contain wire declarations, assignments of\n");
+		log("        plain signals and module instances directly to RTLIL without\n");
+		log("        creating an AST for them. This speeds up reading large gate-level\n");
+		log("        netlists. All other modules are read as usual. This option has no\n");
+		log("        effect together with -nopp, -lib or -defer.\n");
+		log("\n");
 		log("    -noautowire\n");
 		log("        make the default of `default_nettype be \"none\" instead of \"wire\".\n");
 		log("\n");
@@ -221,6 +501,12 @@ struct VerilogFrontend : public Frontend {
 		log("        add 'dir' to the directories which are used when searching include\n");
 		log("        files\n");
 		log("\n");
+		log("    -j <N>\n");
+		log("        when reading several files, preprocess up to N files at the same\n");
+		log("        time before they are parsed one after the other. The default is the\n");
+		log("        number of threads set with 'yosys -j'. The results do not depend on\n");
+		log("        this setting.\n");
+		log("\n");
 		log("The command 'verilog_defaults' can be used to register default options for\n");
 		log("subsequent calls to 'read_verilog'.\n");
 		log("\n");
@@ -259,10 +545,15 @@ struct VerilogFrontend : public Frontend {
 		bool flag_nooverwrite = false;
 		bool flag_overwrite = false;
 		bool flag_defer = false;
+		bool flag_netlist = false;
 		bool flag_noblackbox = false;
 		bool flag_nowb = false;
 		bool flag_nosynthesis = false;
+		bool flag_noimage = false;
+		std::string image_filename;
+		std::vector<std::string> image_options;
 		define_map_t defines_map;
+		int max_threads = 0;
 
 		std::list<std::string> include_dirs;
 		std::list<std::string> attributes;
@@ -390,6 +681,14 @@ struct VerilogFrontend : public Frontend {
 				defines_map.add("BLACKBOX", "");
 				continue;
 			}
+			if (arg == "-write_image" && argidx+1 < args.size()) {
+				image_filename = args[++argidx];
+				continue;
+			}
+			if (arg == "-noimage") {
+				flag_noimage = true;
+				continue;
+			}
 			if (arg == "-nowb") {
 				flag_nowb = true;
 				continue;
@@ -424,6 +723,10 @@ struct VerilogFrontend : public Frontend {
 				flag_defer = true;
 				continue;
 			}
+			if (arg == "-netlist") {
+				flag_netlist = true;
+				continue;
+			}
 			if (arg == "-noautowire") {
 				default_nettype_wire = false;
 				continue;
@@ -455,6 +758,10 @@ struct VerilogFrontend : public Frontend {
 				include_dirs.push_back(args[++argidx]);
 				continue;
 			}
+			if (arg == "-j" && argidx+1 < args.size()) {
+				max_threads = atoi(args[++argidx].c_str());
+				continue;
+			}
 			if (arg.compare(0, 2, "-I") == 0) {
 				include_dirs.push_back(arg.substr(2));
 				continue;
@@ -465,10 +772,76 @@ struct VerilogFrontend : public Frontend {
 		if (formal_mode || !flag_nosynthesis)
 			defines_map.add(formal_mode ? "FORMAL" : "SYNTHESIS", "1");
 
+		for (size_t i = 1; i < argidx; i++) {
+			if (args[i] == "-write_image" || args[i] == "-j")
+				i++;
+			else if (args[i] != "-noimage")
+				image_options.push_back(args[i]);
+		}
+
 		extra_args(f, filename, args, argidx);
 
+		if (!image_filename.empty() && !lib_mode)
+			log_cmd_error("The -write_image option requires -lib.\n");
+
 		log_header(design, "Executing Verilog-2005 frontend: %s\n", filename.c_str());
 
+		PreprocBatchGuard batch_guard;
+		if (preproc_batch && preproc_batch->next() != filename)
+			preproc_batch.reset();
+		if (!preproc_batch && !flag_nopp) {
+			// the files that the following calls will read
+			std::vector<std::string> filenames = {filename};
+			for (size_t i = argidx; i < next_args.size(); i++) {
+				std::string fn = next_args[i];
+				if (fn.compare(0, 2, "<<") == 0)
+					break;
+				rewrite_filename(fn);
+				for (auto &it : glob_filename(fn))
+					filenames.push_back(it);
+			}
+			int num_threads = max_threads > 0 && !yosys_in_worker_thread() ? max_threads : yosys_thread_count(GetSize(filenames));
+			if (GetSize(filenames) > 1 && num_threads > 1) {
+				log("Preprocessing %d files using %d threads.\n", GetSize(filenames), num_threads);
+				preproc_batch.reset(new preproc_batch_t(filenames, defines_map, *design->verilog_defines, include_dirs, num_threads));
+			}
+		}
+
+		std::istream *in = f;
+		std::string source_text;
+		std::istringstream source_stream;
+		std::string cache_key;
+		if (lib_mode && (!image_filename.empty() || !flag_noimage)) {
+			source_text = std::string(std::istreambuf_iterator<char>(*f), std::istreambuf_iterator<char>());
+			std::string source_hash = sha1(source_text);
+			// modules skipped by -nooverwrite would be missing from the cache,
+			// and the dump options would not dump anything on a cache hit
+			bool flag_dump = flag_dump_ast1 || flag_dump_ast2 || flag_dump_vlog1 || flag_dump_vlog2 || flag_dump_rtlil || flag_ppdump;
+			if (!flag_noimage && !flag_nooverwrite && !flag_dump && source_text.find("`include") == std::string::npos)
+				cache_key = lib_cache_key(filename, source_hash, image_options);
+			if ((image_filename.empty() && read_lib_image(design, filename, source_hash, image_options, flag_nooverwrite, flag_overwrite)) ||
+					(!cache_key.empty() && read_lib_cache(design, cache_key, filename, flag_nooverwrite, flag_overwrite))) {
+				if (preproc_batch)
+					preproc_batch->skip();
+				batch_guard.done = true;
+				log("Successfully finished Verilog frontend.\n");
+				return;
+			}
+			source_stream.str(source_text);
+			in = &source_stream;
+		}
+
+		std::vector<std::string> old_defines;
+		size_t old_globals = design->verilog_globals.size();
+		size_t old_packages = design->verilog_packages.size();
+		pool<RTLIL::Module*> old_modules;
+		if (!image_filename.empty() || !cache_key.empty()) {
+			for (auto &it : design->verilog_defines->defines)
+				old_defines.push_back(it.first);
+			for (auto mod : design->modules())
+				old_modules.insert(mod);
+		}
+
 		log("Parsing %s%s input from `%s' to AST representation.\n",
 				formal_mode ? "formal " : "", sv_mode ? "SystemVerilog" : "Verilog", filename.c_str());
 
@@ -478,13 +851,18 @@ struct VerilogFrontend : public Frontend {
 
 		current_ast = new AST::AstNode(AST::AST_DESIGN);
 
-		lexin = f;
+		lexin = in;
 		std::string code_after_preproc;
 
 		if (!flag_nopp) {
-			code_after_preproc = frontend_verilog_preproc(*f, filename, defines_map, *design->verilog_defines, include_dirs);
+			if (!preproc_batch || !preproc_batch->take(defines_map, *design->verilog_defines, code_after_preproc))
+				code_after_preproc = frontend_verilog_preproc(*in, filename, defines_map, *design->verilog_defines, include_dirs);
+			if (preproc_batch && preproc_batch->next().empty())
+				preproc_batch.reset();
 			if (flag_ppdump)
 				log("-- Verilog code after preprocessor --\n%s-- END OF DUMP --\n", code_after_preproc.c_str());
+			if (flag_netlist && !lib_mode && !flag_defer)
+				code_after_preproc = import_netlist(design, code_after_preproc, filename, flag_icells, attributes);
 			lexin = new std::istringstream(code_after_preproc);
 		}
 
@@ -533,6 +911,28 @@ struct VerilogFrontend : public Frontend {
 		delete current_ast;
 		current_ast = NULL;
 
+		if (!image_filename.empty() || !cache_key.empty()) {
+			std::vector<std::string> new_defines;
+			for (auto &it : design->verilog_defines->defines)
+				new_defines.push_back(it.first);
+			bool has_globals = new_defines != old_defines || design->verilog_globals.size() != old_globals || design->verilog_packages.size() != old_packages;
+			if (has_globals && !image_filename.empty())
+				log_cmd_error("Can't write library image for a source with global definitions.\n");
+			bool uses_defines = false;
+			for (auto &name : lib_image_macros(source_text))
+				if (design->verilog_defines->find(name))
+					uses_defines = true;
+			std::vector<RTLIL::Module*> new_modules;
+			for (auto mod : design->modules())
+				if (!old_modules.count(mod))
+					new_modules.push_back(mod);
+			if (!image_filename.empty())
+				write_lib_image(design, image_filename, source_text, image_options, new_modules);
+			if (!cache_key.empty() && !has_globals && !uses_defines)
+				write_lib_cache(cache_key, source_text, new_modules);
+		}
+
+		batch_guard.done = true;
 		log("Successfully finished Verilog frontend.\n");
 	}
 } VerilogFrontend;
@@ -45,6 +45,11 @@ namespace VERILOG_FRONTEND
 	// this function converts a Verilog constant to an AST_CONSTANT node
 	AST::AstNode *const2ast(std::string code, char case_type = 0, bool warn_z = false);
 
+	// this function adds the structural modules in the preprocessed code to the
+	// design and returns the code with these modules replaced by empty lines
+	std::string import_netlist(RTLIL::Design *design, const std::string &code, const std::string &filename,
+			bool icells, const std::list<std::string> &attributes);
+
 	// names of locally typedef'ed types in a stack
 	typedef std::map<std::string, AST::AstNode*> UserTypeMap;
 	extern std::vector<UserTypeMap> user_type_stack;
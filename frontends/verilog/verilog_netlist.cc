@@ -0,0 +1,860 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ *  ---
+ *
+ *  The Verilog frontend.
+ *
+ *  This file contains the direct import of structural netlists that is used
+ *  with "read_verilog -netlist". Modules that only contain port and wire
+ *  declarations, continuous assignments of plain signals and module
+ *  instances are converted to RTLIL while scanning the preprocessed code,
+ *  without creating an AST for them. The code of all other modules is left
+ *  for the regular parser.
+ *
+ */
+
+#include "verilog_frontend.h"
+#include "kernel/log.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+using namespace VERILOG_FRONTEND;
+
+PRIVATE_NAMESPACE_BEGIN
+
+// words that can't start a module instance
+static const char *netlist_keywords[] = {
+	"always", "and", "assign", "automatic", "begin", "buf", "bufif0", "bufif1", "case", "casex", "casez", "cell",
+	"cmos", "config", "deassign", "default", "defparam", "design", "disable", "edge", "else", "end", "endcase",
+	"endconfig", "endfunction", "endgenerate", "endmodule", "endprimitive", "endspecify", "endtable", "endtask",
+	"event", "for", "force", "forever", "fork", "function", "generate", "genvar", "highz0", "highz1", "if",
+	"ifnone", "incdir", "include", "initial", "inout", "input", "instance", "integer", "join", "large",
+	"liblist", "library", "localparam", "macromodule", "medium", "module", "nand", "negedge", "nmos", "nor",
+	"noshowcancelled", "not", "notif0", "notif1", "or", "output", "parameter", "pmos", "posedge", "primitive",
+	"pull0", "pull1", "pulldown", "pullup", "pulsestyle_ondetect", "pulsestyle_onevent", "rcmos", "real",
+	"realtime", "reg", "release", "repeat", "rnmos", "rpmos", "rtran", "rtranif0", "rtranif1", "scalared",
+	"showcancelled", "signed", "small", "specify", "specparam", "strong0", "strong1", "supply0", "supply1",
+	"table", "task", "time", "tran", "tranif0", "tranif1", "tri", "tri0", "tri1", "triand", "trior", "trireg",
+	"unsigned", "use", "uwire", "vectored", "wait", "wand", "weak0", "weak1", "while", "wire", "wor", "xnor",
+	"xor",
+	// SystemVerilog
+	"always_comb", "always_ff", "always_latch", "assert", "assume", "bind", "bit", "break", "byte", "checker",
+	"class", "const", "continue", "cover", "do", "endinterface", "endpackage", "enum", "export", "final",
+	"foreach", "genvar", "import", "int", "interface", "let", "logic", "longint", "modport", "package",
+	"priority", "property", "restrict", "return", "sequence", "shortint", "static", "string", "struct",
+	"typedef", "union", "unique", "unique0", "var", "void",
+};
+
+struct NetlistToken
+{
+	enum type_t { END, ID, NUMBER, STRING, SYMBOL, DIRECTIVE, OTHER };
+
+	type_t type = END;
+	// the RTLIL name for identifiers, the Verilog code for numbers and
+	// the decoded value for strings
+	std::string text;
+	bool escaped = false;
+	int line = 0, col = 0, end_line = 0, end_col = 0;
+	size_t start_pos = 0, end_pos = 0;
+
+	bool is_sym(const char *sym) const {
+		return type == SYMBOL && text == sym;
+	}
+	bool is_word(const char *word) const {
+		return type == ID && !escaped && text.compare(1, std::string::npos, word) == 0;
+	}
+};
+
+// Splits the preprocessed code into tokens and keeps track of the file name
+// and line number in the same way as the Verilog lexer.
+struct NetlistLexer
+{
+	const std::string *code;
+	size_t pos = 0;
+	int line = 1, col = 1;
+	std::string filename;
+	std::vector<std::pair<std::string, int>> file_stack;
+	NetlistToken tok;
+
+	char peek(size_t offset = 0) const {
+		return pos + offset < code->size() ? (*code)[pos + offset] : 0;
+	}
+
+	void advance() {
+		if ((*code)[pos++] == '\n')
+			line++, col = 1;
+		else
+			col++;
+	}
+
+	void skip_space()
+	{
+		while (pos < code->size()) {
+			char ch = peek();
+			if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\f' || ch == '\v') {
+				advance();
+			} else if (ch == '/' && peek(1) == '*') {
+				advance(), advance();
+				while (pos < code->size() && !(peek() == '*' && peek(1) == '/'))
+					advance();
+				if (pos < code->size())
+					advance(), advance();
+			} else if (ch == '/' && peek(1) == '/') {
+				while (pos < code->size() && peek() != '\n')
+					advance();
+			} else
+				break;
+		}
+	}
+
+	static bool is_id_char(char ch) {
+		return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9') || ch == '_' || ch == '$';
+	}
+
+	static bool is_digit_char(char ch) {
+		return ('0' <= ch && ch <= '9') || ('a' <= ch && ch <= 'f') || ('A' <= ch && ch <= 'F') ||
+				ch == 'x' || ch == 'X' || ch == 'z' || ch == 'Z' || ch == '?' || ch == '_';
+	}
+
+	// reads the "'[sS]?[bodhBODH]<digits>" part of a based constant
+	bool read_based(std::string &text)
+	{
+		text += '\'';
+		advance();
+		if (peek() == 's' || peek() == 'S')
+			text += peek(), advance();
+		if (!strchr("bodhBODH", peek()) || peek() == 0)
+			return false;
+		text += peek(), advance();
+		while (peek() == ' ' || peek() == '\t')
+			advance();
+		if (!is_digit_char(peek()))
+			return false;
+		while (is_digit_char(peek()))
+			text += peek(), advance();
+		return true;
+	}
+
+	void read_directive()
+	{
+		std::string name = "`";
+		advance();
+		while (is_id_char(peek()))
+			name += peek(), advance();
+		tok.text = name;
+
+		if (name != "`file_push" && name != "`file_pop" && name != "`line")
+			return;
+
+		size_t start = pos;
+		while (pos < code->size() && peek() != '\n')
+			advance();
+		std::string rest = code->substr(start, pos - start);
+
+		if (name == "`file_push") {
+			file_stack.push_back({filename, line});
+			size_t first = rest.find('"'), last = rest.rfind('"');
+			if (first != std::string::npos && last > first)
+				filename = rest.substr(first + 1, last - first - 1);
+			line = 0;
+		} else if (name == "`file_pop") {
+			if (pos < code->size())
+				advance();
+			if (!file_stack.empty()) {
+				filename = file_stack.back().first;
+				line = file_stack.back().second;
+				file_stack.pop_back();
+			}
+		} else {
+			// `line <number> "<filename>" <level>
+			if (pos < code->size())
+				advance();
+			line = atoi(rest.c_str());
+			size_t first = rest.find('"'), last = rest.rfind('"');
+			if (first != std::string::npos && last > first)
+				filename = rest.substr(first + 1, last - first - 1);
+		}
+	}
+
+	void next()
+	{
+		skip_space();
+		tok.line = line;
+		tok.col = col;
+		tok.start_pos = pos;
+		tok.text.clear();
+		tok.escaped = false;
+
+		char ch = peek();
+		if (pos >= code->size()) {
+			tok.type = NetlistToken::END;
+		} else if (ch == '`') {
+			tok.type = NetlistToken::DIRECTIVE;
+			read_directive();
+		} else if (('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_') {
+			tok.type = NetlistToken::ID;
+			tok.text = "\\";
+			while (is_id_char(peek()))
+				tok.text += peek(), advance();
+		} else if (ch == '\\') {
+			tok.type = NetlistToken::ID;
+			tok.escaped = true;
+			while (pos < code->size() && !strchr(" \t\r\n", peek()))
+				tok.text += peek(), advance();
+		} else if ('0' <= ch && ch <= '9') {
+			tok.type = NetlistToken::NUMBER;
+			while (('0' <= peek() && peek() <= '9') || peek() == '_')
+				tok.text += peek(), advance();
+			if (peek() == '.' || peek() == 'e' || peek() == 'E') {
+				tok.type = NetlistToken::OTHER;
+			} else {
+				size_t space = 0;
+				while (peek(space) == ' ' || peek(space) == '\t')
+					space++;
+				if (peek(space) == '\'') {
+					while (space-- > 0)
+						advance();
+					if (!read_based(tok.text))
+						tok.type = NetlistToken::OTHER;
+				}
+			}
+		} else if (ch == '\'') {
+			tok.type = NetlistToken::NUMBER;
+			if (strchr("01xzXZ", peek(1)) && peek(1) != 0) {
+				// SystemVerilog fill constant
+				tok.text = code->substr(pos, 2);
+				advance(), advance();
+			} else if (!read_based(tok.text))
+				tok.type = NetlistToken::OTHER;
+		} else if (ch == '"') {
+			tok.type = NetlistToken::STRING;
+			advance();
+			while (1) {
+				ch = peek();
+				if (ch == 0 || ch == '\n') {
+					tok.type = NetlistToken::OTHER;
+					break;
+				}
+				advance();
+				if (ch == '"')
+					break;
+				if (ch == '\\') {
+					ch = peek();
+					if (ch == 'n')
+						tok.text += '\n';
+					else if (ch == 't')
+						tok.text += '\t';
+					else if (ch == '\\' || ch == '"')
+						tok.text += ch;
+					else {
+						tok.type = NetlistToken::OTHER;
+						break;
+					}
+					advance();
+				} else
+					tok.text += ch;
+			}
+		} else {
+			tok.type = NetlistToken::SYMBOL;
+			if ((ch == '(' && peek(1) == '*' && peek(2) != ')') || (ch == '*' && peek(1) == ')')) {
+				tok.text = code->substr(pos, 2);
+				advance(), advance();
+			} else {
+				if (!strchr("()[]{},;:.=#", ch))
+					tok.type = NetlistToken::OTHER;
+				tok.text = ch;
+				advance();
+			}
+		}
+
+		tok.end_line = line;
+		tok.end_col = col;
+		tok.end_pos = pos;
+	}
+};
+
+struct NetlistImporter
+{
+	RTLIL::Design *design;
+	bool icells;
+	NetlistLexer lexer;
+	pool<std::string> keywords;
+
+	struct const_t {
+		bool ok;
+		RTLIL::Const value;
+		bool is_signed;
+	};
+	dict<std::string, const_t> consts;
+
+	RTLIL::Module *module = nullptr;
+	dict<RTLIL::IdString, RTLIL::Const> attributes;
+	size_t module_end = 0;
+
+	struct decl_t {
+		bool input = false, output = false;
+		bool is_signed = false;
+		int left = 0, right = 0;
+	};
+
+	NetlistToken &tok() { return lexer.tok; }
+
+	bool accept(const char *sym) {
+		if (!tok().is_sym(sym))
+			return false;
+		lexer.next();
+		return true;
+	}
+
+	std::string src(int line, int col, int end_line, int end_col) const {
+		return stringf("%s:%d.%d-%d.%d", lexer.filename.c_str(), line, col, end_line, end_col);
+	}
+
+	std::string src(const NetlistToken &t) const {
+		return src(t.line, t.col, t.end_line, t.end_col);
+	}
+
+	const const_t &parse_const(const std::string &code)
+	{
+		auto it = consts.find(code);
+		if (it != consts.end())
+			return it->second;
+
+		const_t &c = consts[code];
+		AST::AstNode *node = const2ast(code);
+		// not supported: unsized fill constants
+		c.ok = node != nullptr && !node->is_unsized;
+		if (node != nullptr) {
+			c.value = node->asAttrConst();
+			c.is_signed = node->is_signed;
+			delete node;
+		}
+		return c;
+	}
+
+	bool parse_int(int &value)
+	{
+		if (tok().type != NetlistToken::NUMBER || tok().text.find('\'') != std::string::npos)
+			return false;
+		const const_t &c = parse_const(tok().text);
+		if (!c.ok || GetSize(c.value) > 32)
+			return false;
+		value = c.value.as_int();
+		lexer.next();
+		return true;
+	}
+
+	bool parse_range(decl_t &decl)
+	{
+		if (!accept("["))
+			return true;
+		return parse_int(decl.left) && accept(":") && parse_int(decl.right) && accept("]");
+	}
+
+	bool parse_attributes()
+	{
+		while (!accept("*)")) {
+			if (tok().type != NetlistToken::ID)
+				return false;
+			RTLIL::IdString name = tok().text;
+			lexer.next();
+			if (accept("=")) {
+				if (tok().type == NetlistToken::STRING) {
+					attributes[name] = RTLIL::Const(tok().text);
+				} else if (tok().type == NetlistToken::NUMBER) {
+					const const_t &c = parse_const(tok().text);
+					if (!c.ok)
+						return false;
+					attributes[name] = c.value;
+				} else
+					return false;
+				lexer.next();
+			} else
+				attributes[name] = RTLIL::Const(1);
+			if (!tok().is_sym("*)") && !accept(","))
+				return false;
+		}
+		return true;
+	}
+
+	// Declares a wire or adds the direction to an earlier declaration.
+	bool declare(const NetlistToken &name_tok, const decl_t &decl)
+	{
+		RTLIL::IdString name = name_tok.text;
+		if (module->cell(name) != nullptr)
+			return false;
+
+		int width = abs(decl.left - decl.right) + 1;
+		int start_offset = std::min(decl.left, decl.right);
+		bool upto = decl.left < decl.right;
+
+		RTLIL::Wire *wire = module->wire(name);
+		if (wire != nullptr) {
+			if (wire->width != width || wire->start_offset != start_offset || wire->upto != upto)
+				return false;
+			if (decl.input || decl.output) {
+				if (wire->port_input || wire->port_output)
+					return false;
+				wire->port_input = decl.input;
+				wire->port_output = decl.output;
+			}
+			wire->is_signed |= decl.is_signed;
+		} else {
+			wire = module->addWire(name, width);
+			wire->attributes[ID::src] = src(name_tok);
+			wire->start_offset = start_offset;
+			wire->upto = upto;
+			wire->is_signed = decl.is_signed;
+			wire->port_input = decl.input;
+			wire->port_output = decl.output;
+		}
+		for (auto &it : attributes)
+			wire->attributes[it.first] = it.second;
+		attributes.clear();
+		return true;
+	}
+
+	// Parses the direction, type and range of a declaration.
+	bool parse_decl_type(decl_t &decl)
+	{
+		decl = decl_t();
+		if (tok().is_word("input"))
+			decl.input = true;
+		else if (tok().is_word("output"))
+			decl.output = true;
+		else if (tok().is_word("inout"))
+			decl.input = decl.output = true;
+		else if (!tok().is_word("wire"))
+			return false;
+		lexer.next();
+		if ((decl.input || decl.output) && tok().is_word("wire"))
+			lexer.next();
+		if (tok().is_word("signed")) {
+			decl.is_signed = true;
+			lexer.next();
+		}
+		return parse_range(decl);
+	}
+
+	static bool bit_offset(RTLIL::Wire *wire, int index, int &offset)
+	{
+		if (index < wire->start_offset || index >= wire->start_offset + wire->width)
+			return false;
+		offset = wire->upto ? wire->start_offset + wire->width - 1 - index : index - wire->start_offset;
+		return true;
+	}
+
+	bool parse_sig(RTLIL::SigSpec &sig, bool &is_signed)
+	{
+		is_signed = false;
+
+		if (tok().type == NetlistToken::ID) {
+			RTLIL::Wire *wire = module->wire(tok().text);
+			if (wire == nullptr)
+				return false;
+			lexer.next();
+			if (!accept("[")) {
+				sig = wire;
+				is_signed = wire->is_signed;
+				return true;
+			}
+			int left, right, left_offset, right_offset;
+			if (!parse_int(left))
+				return false;
+			right = left;
+			if (accept(":") && !parse_int(right))
+				return false;
+			if (!accept("]") || tok().is_sym("["))
+				return false;
+			if (!bit_offset(wire, left, left_offset) || !bit_offset(wire, right, right_offset))
+				return false;
+			if (left != right && (left > right) == wire->upto)
+				return false;
+			sig = RTLIL::SigSpec(wire, std::min(left_offset, right_offset), abs(left - right) + 1);
+			return true;
+		}
+
+		if (tok().type == NetlistToken::NUMBER) {
+			const const_t &c = parse_const(tok().text);
+			if (!c.ok)
+				return false;
+			sig = c.value;
+			is_signed = c.is_signed;
+			lexer.next();
+			return true;
+		}
+
+		if (!accept("{"))
+			return false;
+
+		// replication
+		int count = 0;
+		if (tok().type == NetlistToken::NUMBER) {
+			NetlistLexer saved = lexer;
+			if (parse_int(count) && tok().is_sym("{")) {
+				RTLIL::SigSpec inner;
+				if (!parse_sig(inner, is_signed) || !accept("}") || count < 0)
+					return false;
+				sig = RTLIL::SigSpec();
+				for (int i = 0; i < count; i++)
+					sig.append(inner);
+				is_signed = false;
+				return true;
+			}
+			lexer = saved;
+		}
+
+		std::vector<RTLIL::SigSpec> parts;
+		do {
+			parts.emplace_back();
+			if (!parse_sig(parts.back(), is_signed))
+				return false;
+		} while (accept(","));
+		if (!accept("}"))
+			return false;
+
+		sig = RTLIL::SigSpec();
+		for (auto it = parts.rbegin(); it != parts.rend(); it++)
+			sig.append(*it);
+		is_signed = false;
+		return true;
+	}
+
+	bool parse_assign()
+	{
+		do {
+			RTLIL::SigSpec lhs, rhs;
+			bool lhs_signed, rhs_signed;
+			if (!parse_sig(lhs, lhs_signed) || lhs.has_const() || !accept("=") || !parse_sig(rhs, rhs_signed))
+				return false;
+			rhs.extend_u0(GetSize(lhs), rhs_signed);
+			module->connect(lhs, rhs);
+		} while (accept(","));
+		return accept(";");
+	}
+
+	bool parse_param_value(RTLIL::Const &value)
+	{
+		if (tok().type == NetlistToken::STRING) {
+			value = RTLIL::Const(tok().text);
+		} else if (tok().type == NetlistToken::NUMBER) {
+			const const_t &c = parse_const(tok().text);
+			if (!c.ok)
+				return false;
+			value = c.value;
+			if (c.is_signed)
+				value.flags |= RTLIL::CONST_FLAG_SIGNED;
+		} else
+			return false;
+		lexer.next();
+		return true;
+	}
+
+	bool parse_instances()
+	{
+		RTLIL::IdString type = tok().text;
+		if (icells && type.begins_with("\\$"))
+			type = type.substr(1);
+		lexer.next();
+
+		dict<RTLIL::IdString, RTLIL::Const> parameters;
+		if (accept("#")) {
+			if (!accept("("))
+				return false;
+			int counter = 0;
+			if (!accept(")")) {
+				do {
+					if (accept(".")) {
+						if (tok().type != NetlistToken::ID)
+							return false;
+						RTLIL::IdString name = tok().text;
+						lexer.next();
+						if (!accept("(") || !parse_param_value(parameters[name]) || !accept(")"))
+							return false;
+					} else if (!parse_param_value(parameters[stringf("$%d", ++counter)]))
+						return false;
+				} while (accept(","));
+				if (!accept(")"))
+					return false;
+			}
+		}
+
+		dict<RTLIL::IdString, RTLIL::Const> cell_attributes;
+		cell_attributes.swap(attributes);
+
+		do {
+			NetlistToken name_tok = tok();
+			if (name_tok.type != NetlistToken::ID)
+				return false;
+			RTLIL::IdString name = name_tok.text;
+			if (module->wire(name) != nullptr || module->cell(name) != nullptr)
+				return false;
+			lexer.next();
+			if (!accept("("))
+				return false;
+
+			RTLIL::Cell *cell = module->addCell(name, type);
+			cell->set_bool_attribute(ID::module_not_derived);
+			cell->line = name_tok.line;
+			for (auto &it : cell_attributes)
+				cell->attributes[it.first] = it.second;
+			cell->parameters = parameters;
+
+			bool named = tok().is_sym(".");
+			int counter = 0;
+			if (!tok().is_sym(")")) {
+				do {
+					RTLIL::SigSpec sig;
+					bool is_signed = false;
+					if (named) {
+						if (!accept(".") || tok().type != NetlistToken::ID)
+							return false;
+						RTLIL::IdString port = tok().text;
+						lexer.next();
+						if (!accept("("))
+							return false;
+						if (!tok().is_sym(")") && !parse_sig(sig, is_signed))
+							return false;
+						if (!accept(")") || cell->hasPort(port))
+							return false;
+						cell->setPort(port, sig);
+					} else {
+						if (!tok().is_sym(",") && !tok().is_sym(")") && !parse_sig(sig, is_signed))
+							return false;
+						cell->setPort(stringf("$%d", ++counter), sig);
+					}
+					// the AST frontend connects signed expressions through a
+					// signed wire and delays unsigned slices of signed wires
+					// until the cell's module is known
+					if (sig.is_wire() ? sig.as_wire()->is_signed != is_signed : is_signed)
+						return false;
+				} while (accept(","));
+			}
+
+			if (!tok().is_sym(")"))
+				return false;
+			cell->attributes[ID::src] = src(name_tok.line, name_tok.col, tok().end_line, tok().end_col);
+			lexer.next();
+		} while (accept(","));
+
+		return accept(";");
+	}
+
+	// Parses the module after the "module" keyword. Returns nullptr for
+	// modules that are not structural.
+	RTLIL::Module *parse_module(const NetlistToken &module_tok)
+	{
+		if (tok().type != NetlistToken::ID)
+			return nullptr;
+		RTLIL::IdString name = tok().text;
+		if (icells && name.begins_with("\\$"))
+			name = name.substr(1);
+		if (design->has(name))
+			return nullptr;
+		lexer.next();
+
+		std::unique_ptr<RTLIL::Module> mod(new RTLIL::Module);
+		mod->name = name;
+		module = mod.get();
+		attributes.clear();
+
+		std::vector<RTLIL::IdString> ports;
+		bool ansi = false;
+		if (accept("(") && !accept(")")) {
+			decl_t decl;
+			do {
+				if (tok().is_word("input") || tok().is_word("output") || tok().is_word("inout")) {
+					if (!ansi && !ports.empty())
+						return nullptr;
+					ansi = true;
+					if (!parse_decl_type(decl))
+						return nullptr;
+				}
+				if (tok().type != NetlistToken::ID || keywords.count(tok().text.substr(1)))
+					return nullptr;
+				if (ansi && !declare(tok(), decl))
+					return nullptr;
+				ports.push_back(tok().text);
+				lexer.next();
+			} while (accept(","));
+			if (!accept(")"))
+				return nullptr;
+		}
+		if (!accept(";"))
+			return nullptr;
+
+		while (1)
+		{
+			if (accept("(*")) {
+				if (!parse_attributes())
+					return nullptr;
+				continue;
+			}
+
+			if (tok().type != NetlistToken::ID)
+				return nullptr;
+
+			if (tok().is_word("endmodule")) {
+				if (!attributes.empty())
+					return nullptr;
+				break;
+			}
+
+			if (tok().is_word("input") || tok().is_word("output") || tok().is_word("inout") || tok().is_word("wire")) {
+				decl_t decl;
+				if ((ansi && !tok().is_word("wire")) || !parse_decl_type(decl))
+					return nullptr;
+				do {
+					NetlistToken name_tok = tok();
+					if (name_tok.type != NetlistToken::ID || keywords.count(name_tok.text.substr(1)))
+						return nullptr;
+					lexer.next();
+					// the attributes apply to each declared wire
+					dict<RTLIL::IdString, RTLIL::Const> decl_attributes = attributes;
+					if (!declare(name_tok, decl))
+						return nullptr;
+					attributes = decl_attributes;
+				} while (accept(","));
+				attributes.clear();
+				if (!accept(";"))
+					return nullptr;
+				continue;
+			}
+
+			if (tok().is_word("assign")) {
+				lexer.next();
+				if (!attributes.empty() || !parse_assign())
+					return nullptr;
+				continue;
+			}
+
+			if (!tok().escaped && keywords.count(tok().text.substr(1)))
+				return nullptr;
+			if (!parse_instances())
+				return nullptr;
+		}
+
+		NetlistToken end_tok = tok();
+		module_end = end_tok.end_pos;
+		lexer.next();
+		// leave modules without contents to the AST frontend, which turns
+		// them into black boxes
+		if (tok().is_sym(":") || (module->cells_.empty() && module->connections().empty()))
+			return nullptr;
+
+		int port_id = 0;
+		for (auto &port : ports) {
+			RTLIL::Wire *wire = module->wire(port);
+			if (wire == nullptr || (!wire->port_input && !wire->port_output) || wire->port_id != 0)
+				return nullptr;
+			wire->port_id = ++port_id;
+		}
+		for (auto wire : module->wires())
+			if ((wire->port_input || wire->port_output) && wire->port_id == 0)
+				return nullptr;
+
+		module->attributes[ID::src] = src(module_tok.line, module_tok.col, end_tok.end_line, end_tok.end_col);
+		module->set_bool_attribute(ID::cells_not_processed);
+		module->line = module_tok.line;
+		module->fixup_ports();
+		module = nullptr;
+		return mod.release();
+	}
+
+	std::string import(const std::string &code, const std::string &filename, const std::list<std::string> &module_attributes)
+	{
+		for (auto word : netlist_keywords)
+			keywords.insert(word);
+
+		lexer.code = &code;
+		lexer.filename = filename;
+
+		// the ranges of the code that were imported
+		std::vector<std::pair<size_t, size_t>> imported;
+		int num_modules = 0;
+
+		// pragmas in comments are only handled by the regular lexer
+		bool enabled = code.find("translate_off") == std::string::npos;
+
+		lexer.next();
+		bool after_attributes = false;
+		while (enabled && tok().type != NetlistToken::END)
+		{
+			if (!tok().is_word("module") || after_attributes) {
+				after_attributes = tok().is_sym("*)");
+				lexer.next();
+				continue;
+			}
+
+			NetlistToken module_tok = tok();
+			lexer.next();
+			NetlistLexer saved = lexer;
+
+			RTLIL::Module *mod = parse_module(module_tok);
+			if (mod == nullptr) {
+				lexer = saved;
+				continue;
+			}
+
+			log("Generating RTLIL representation for structural module `%s'.\n", mod->name.c_str());
+			for (auto &attr : module_attributes)
+				if (mod->attributes.count(attr) == 0)
+					mod->attributes[attr] = RTLIL::Const(1);
+
+			// same as process_module() in the AST frontend
+			if (design->rtlFiles.find(lexer.filename) == design->rtlFiles.end()) {
+				design->rtlFiles[lexer.filename] = design->rtlFilesId++;
+				design->rtlFilesNames.push_back(lexer.filename);
+			}
+			mod->fileID = design->rtlFiles[lexer.filename];
+			design->add(mod);
+
+			imported.push_back({module_tok.start_pos, module_end});
+			num_modules++;
+		}
+
+		if (imported.empty())
+			return code;
+
+		// keep the line numbers of the remaining code
+		std::string rest;
+		size_t last = 0;
+		for (auto &range : imported) {
+			rest.append(code, last, range.first - last);
+			rest.append(std::count(code.begin() + range.first, code.begin() + range.second, '\n'), '\n');
+			last = range.second;
+		}
+		rest.append(code, last, std::string::npos);
+
+		log("Imported %d structural module%s directly, parsing the remaining code.\n", num_modules, num_modules == 1 ? "" : "s");
+		return rest;
+	}
+};
+
+PRIVATE_NAMESPACE_END
+
+std::string VERILOG_FRONTEND::import_netlist(RTLIL::Design *design, const std::string &code, const std::string &filename,
+		bool icells, const std::list<std::string> &attributes)
+{
+	NetlistImporter importer;
+	importer.design = design;
+	importer.icells = icells;
+	return importer.import(code, filename, attributes);
+}
+
+YOSYS_NAMESPACE_END
@@ -97,6 +97,45 @@ static RTLIL::Const big2const(const BigInteger &val, int result_len, int undef_b
 	return result;
 }
 
+// Fast paths for fully defined operands that fit into a machine word, the
+// common case in constant folding and simulation. The results of add, sub
+// and mul modulo 2^64 only depend on the lowest 64 bits of the operands, so
+// any operand width works for results of up to 64 bits. Comparisons and
+// division need the exact values, which fit for operands of up to 63 bits.
+
+// The lowest 64 bits of the value, zero or sign extended. Returns false if
+// the constant has undef bits.
+static bool const2word(const RTLIL::Const &val, bool as_signed, uint64_t &word)
+{
+	int width = GetSize(val.bits);
+	word = 0;
+	for (int i = 0; i < width; i++) {
+		if (val.bits[i] == RTLIL::State::S1) {
+			if (i < 64)
+				word |= uint64_t(1) << i;
+		} else if (val.bits[i] != RTLIL::State::S0)
+			return false;
+	}
+	if (as_signed && width > 0 && width < 64 && val.bits[width-1] == RTLIL::State::S1)
+		word |= ~uint64_t(0) << width;
+	return true;
+}
+
+static bool word_exact(const RTLIL::Const &val)
+{
+	return GetSize(val.bits) <= 63;
+}
+
+// Bits above 63 are filled with bit 63.
+static RTLIL::Const word2const(uint64_t word, int result_len)
+{
+	RTLIL::Const result(RTLIL::State::S0, result_len);
+	for (int i = 0; i < result_len; i++)
+		if ((word >> min(i, 63)) & 1)
+			result.bits[i] = RTLIL::State::S1;
+	return result;
+}
+
 static RTLIL::State logic_and(RTLIL::State a, RTLIL::State b)
 {
 	if (a == RTLIL::State::S0) return RTLIL::State::S0;
@@ -282,12 +321,28 @@ RTLIL::Const RTLIL::const_logic_or(const RTLIL::Const &arg1, const RTLIL::Const
 // bounds are filled with the leftmost bit of `arg1` (arithmetic shift).
 static RTLIL::Const const_shift_worker(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool sign_ext, bool signed2, int direction, int result_len, RTLIL::State vacant_bits = RTLIL::State::S0)
 {
-	int undef_bit_pos = -1;
-	BigInteger offset = const2big(arg2, signed2, undef_bit_pos) * direction;
-
 	if (result_len < 0)
 		result_len = arg1.bits.size();
 
+	uint64_t word;
+	if (GetSize(arg2.bits) <= 62 && const2word(arg2, signed2, word)) {
+		int64_t offset = int64_t(word) * direction;
+		RTLIL::Const result(RTLIL::State::Sx, result_len);
+		for (int i = 0; i < result_len; i++) {
+			int64_t pos = i + offset;
+			if (pos < 0)
+				result.bits[i] = vacant_bits;
+			else if (pos >= GetSize(arg1.bits))
+				result.bits[i] = sign_ext ? arg1.bits.back() : vacant_bits;
+			else
+				result.bits[i] = arg1.bits[pos];
+		}
+		return result;
+	}
+
+	int undef_bit_pos = -1;
+	BigInteger offset = const2big(arg2, signed2, undef_bit_pos) * direction;
+
 	RTLIL::Const result(RTLIL::State::Sx, result_len);
 	if (undef_bit_pos >= 0)
 		return result;
@@ -343,6 +398,10 @@ RTLIL::Const RTLIL::const_shiftx(const RTLIL::Const &arg1, const RTLIL::Const &a
 
 RTLIL::Const RTLIL::const_lt(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a, b;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(int64_t(a) < int64_t(b), max(result_len, 1));
+
 	int undef_bit_pos = -1;
 	bool y = const2big(arg1, signed1, undef_bit_pos) < const2big(arg2, signed2, undef_bit_pos);
 	RTLIL::Const result(undef_bit_pos >= 0 ? RTLIL::State::Sx : y ? RTLIL::State::S1 : RTLIL::State::S0);
@@ -354,6 +413,10 @@ RTLIL::Const RTLIL::const_lt(const RTLIL::Const &arg1, const RTLIL::Const &arg2,
 
 RTLIL::Const RTLIL::const_le(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a, b;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(int64_t(a) <= int64_t(b), max(result_len, 1));
+
 	int undef_bit_pos = -1;
 	bool y = const2big(arg1, signed1, undef_bit_pos) <= const2big(arg2, signed2, undef_bit_pos);
 	RTLIL::Const result(undef_bit_pos >= 0 ? RTLIL::State::Sx : y ? RTLIL::State::S1 : RTLIL::State::S0);
@@ -428,6 +491,10 @@ RTLIL::Const RTLIL::const_nex(const RTLIL::Const &arg1, const RTLIL::Const &arg2
 
 RTLIL::Const RTLIL::const_ge(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a, b;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(int64_t(a) >= int64_t(b), max(result_len, 1));
+
 	int undef_bit_pos = -1;
 	bool y = const2big(arg1, signed1, undef_bit_pos) >= const2big(arg2, signed2, undef_bit_pos);
 	RTLIL::Const result(undef_bit_pos >= 0 ? RTLIL::State::Sx : y ? RTLIL::State::S1 : RTLIL::State::S0);
@@ -439,6 +506,10 @@ RTLIL::Const RTLIL::const_ge(const RTLIL::Const &arg1, const RTLIL::Const &arg2,
 
 RTLIL::Const RTLIL::const_gt(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a, b;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(int64_t(a) > int64_t(b), max(result_len, 1));
+
 	int undef_bit_pos = -1;
 	bool y = const2big(arg1, signed1, undef_bit_pos) > const2big(arg2, signed2, undef_bit_pos);
 	RTLIL::Const result(undef_bit_pos >= 0 ? RTLIL::State::Sx : y ? RTLIL::State::S1 : RTLIL::State::S0);
@@ -450,6 +521,11 @@ RTLIL::Const RTLIL::const_gt(const RTLIL::Const &arg1, const RTLIL::Const &arg2,
 
 RTLIL::Const RTLIL::const_add(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	int len = result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size());
+	uint64_t a, b;
+	if (len <= 64 && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(a + b, len);
+
 	int undef_bit_pos = -1;
 	BigInteger y = const2big(arg1, signed1, undef_bit_pos) + const2big(arg2, signed2, undef_bit_pos);
 	return big2const(y, result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size()), undef_bit_pos);
@@ -457,6 +533,11 @@ RTLIL::Const RTLIL::const_add(const RTLIL::Const &arg1, const RTLIL::Const &arg2
 
 RTLIL::Const RTLIL::const_sub(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	int len = result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size());
+	uint64_t a, b;
+	if (len <= 64 && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(a - b, len);
+
 	int undef_bit_pos = -1;
 	BigInteger y = const2big(arg1, signed1, undef_bit_pos) - const2big(arg2, signed2, undef_bit_pos);
 	return big2const(y, result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size()), undef_bit_pos);
@@ -464,6 +545,11 @@ RTLIL::Const RTLIL::const_sub(const RTLIL::Const &arg1, const RTLIL::Const &arg2
 
 RTLIL::Const RTLIL::const_mul(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	int len = result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size());
+	uint64_t a, b;
+	if (len <= 64 && const2word(arg1, signed1, a) && const2word(arg2, signed2, b))
+		return word2const(a * b, len);
+
 	int undef_bit_pos = -1;
 	BigInteger y = const2big(arg1, signed1, undef_bit_pos) * const2big(arg2, signed2, undef_bit_pos);
 	return big2const(y, result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size()), min(undef_bit_pos, 0));
@@ -472,6 +558,13 @@ RTLIL::Const RTLIL::const_mul(const RTLIL::Const &arg1, const RTLIL::Const &arg2
 // truncating division
 RTLIL::Const RTLIL::const_div(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a_word, b_word;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a_word) && const2word(arg2, signed2, b_word)) {
+		if (b_word == 0)
+			return RTLIL::Const(RTLIL::State::Sx, result_len);
+		return word2const(int64_t(a_word) / int64_t(b_word), result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size()));
+	}
+
 	int undef_bit_pos = -1;
 	BigInteger a = const2big(arg1, signed1, undef_bit_pos);
 	BigInteger b = const2big(arg2, signed2, undef_bit_pos);
@@ -486,6 +579,13 @@ RTLIL::Const RTLIL::const_div(const RTLIL::Const &arg1, const RTLIL::Const &arg2
 // truncating modulo
 RTLIL::Const RTLIL::const_mod(const RTLIL::Const &arg1, const RTLIL::Const &arg2, bool signed1, bool signed2, int result_len)
 {
+	uint64_t a_word, b_word;
+	if (word_exact(arg1) && word_exact(arg2) && const2word(arg1, signed1, a_word) && const2word(arg2, signed2, b_word)) {
+		if (b_word == 0)
+			return RTLIL::Const(RTLIL::State::Sx, result_len);
+		return word2const(int64_t(a_word) % int64_t(b_word), result_len >= 0 ? result_len : max(arg1.bits.size(), arg2.bits.size()));
+	}
+
 	int undef_bit_pos = -1;
 	BigInteger a = const2big(arg1, signed1, undef_bit_pos);
 	BigInteger b = const2big(arg2, signed2, undef_bit_pos);
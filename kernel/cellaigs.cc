@@ -59,6 +59,20 @@ unsigned int Aig::hash() const
 	return hash_ops<std::string>::hash(name);
 }
 
+// The models are never removed from the table, their number is bounded by
+// the number of distinct cell signatures.
+static dict<pair<IdString, dict<IdString, Const>>, std::unique_ptr<Aig>> aig_cache;
+static RTLIL::IdString::id_mutex_t aig_cache_mutex;
+
+const Aig &Aig::cached(Cell *cell)
+{
+	RTLIL::IdString::id_lock_t lock(aig_cache_mutex);
+	auto &aig = aig_cache[std::make_pair(cell->type, cell->parameters)];
+	if (aig == nullptr)
+		aig.reset(new Aig(cell));
+	return *aig;
+}
+
 struct AigMaker
 {
 	Aig *aig;
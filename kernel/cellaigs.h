@@ -43,6 +43,11 @@ struct Aig
 	vector<AigNode> nodes;
 	Aig(Cell *cell);
 
+	// Returns the model of the cell from a table shared by all cells with
+	// the same type and parameters, building it on first use. The models
+	// are never changed or freed.
+	static const Aig &cached(Cell *cell);
+
 	bool operator==(const Aig &other) const;
 	unsigned int hash() const;
 };
@@ -33,8 +33,29 @@ struct CellType
 
 struct CellTypes
 {
+	// Use setup_type() and erase_type() to change cell_types, they keep the
+	// lookup tables below in sync.
 	dict<RTLIL::IdString, CellType> cell_types;
 
+	// Direct-indexed lookup tables for the types with small IdString indices,
+	// i.e. the built-in cells, whose names are created at startup. Each type
+	// entry holds its ports as bitmasks over the port bits assigned in
+	// port_bits, so that the queries below are array loads for these types.
+	// Types with larger indices, or with ports that got no bit, are looked up
+	// in cell_types.
+	enum : int { table_index_limit = 1 << 14 };
+	enum : unsigned char { entry_unknown, entry_table, entry_dict };
+
+	struct type_entry_t {
+		uint64_t inputs = 0, outputs = 0;
+		unsigned char state = entry_unknown;
+		bool is_evaluable = false;
+	};
+
+	std::vector<type_entry_t> type_table;
+	std::vector<signed char> port_bits;
+	int num_port_bits = 0;
+
 	CellTypes()
 	{
 	}
@@ -60,6 +81,58 @@ struct CellTypes
 	{
 		CellType ct = {type, inputs, outputs, is_evaluable};
 		cell_types[ct.type] = ct;
+
+		if (type.index_ >= table_index_limit)
+			return;
+		if (type.index_ >= GetSize(type_table))
+			type_table.resize(type.index_ + 1);
+		type_entry_t &entry = type_table[type.index_];
+		entry = type_entry_t();
+		entry.state = entry_table;
+		entry.is_evaluable = is_evaluable;
+		for (auto &port : inputs)
+			if (!add_port_bit(entry.inputs, port))
+				entry.state = entry_dict;
+		for (auto &port : outputs)
+			if (!add_port_bit(entry.outputs, port))
+				entry.state = entry_dict;
+	}
+
+	bool add_port_bit(uint64_t &mask, RTLIL::IdString port)
+	{
+		if (port.index_ >= table_index_limit)
+			return false;
+		if (port.index_ >= GetSize(port_bits))
+			port_bits.resize(port.index_ + 1, -1);
+		signed char &bit = port_bits[port.index_];
+		if (bit < 0) {
+			if (num_port_bits == 64)
+				return false;
+			bit = num_port_bits++;
+		}
+		mask |= uint64_t(1) << bit;
+		return true;
+	}
+
+	void erase_type(RTLIL::IdString type)
+	{
+		cell_types.erase(type);
+		if (type.index_ < GetSize(type_table))
+			type_table[type.index_] = type_entry_t();
+	}
+
+	// the table entry of the type, or nullptr if it must be looked up in cell_types
+	const type_entry_t *table_entry(RTLIL::IdString type) const
+	{
+		if (type.index_ >= GetSize(type_table) || type_table[type.index_].state == entry_dict)
+			return nullptr;
+		return &type_table[type.index_];
+	}
+
+	bool table_port(uint64_t mask, RTLIL::IdString port) const
+	{
+		return port.index_ < GetSize(port_bits) && port_bits[port.index_] >= 0 &&
+				(mask >> port_bits[port.index_] & 1) != 0;
 	}
 
 	void setup_module(RTLIL::Module *module)
@@ -77,8 +150,9 @@ struct CellTypes
 
 	void setup_design(RTLIL::Design *design)
 	{
-		for (auto module : design->modules())
-			setup_module(module);
+		// the stubs of lazy modules have their ports, no need to load them
+		for (auto &it : design->modules_)
+			setup_module(it.second);
 	}
 
 	void setup_internals()
@@ -298,27 +372,38 @@ struct CellTypes
 	void clear()
 	{
 		cell_types.clear();
+		type_table.clear();
+		port_bits.clear();
+		num_port_bits = 0;
 	}
 
 	bool cell_known(RTLIL::IdString type) const
 	{
+		if (auto entry = table_entry(type))
+			return entry->state != entry_unknown;
 		return cell_types.count(type) != 0;
 	}
 
 	bool cell_output(RTLIL::IdString type, RTLIL::IdString port) const
 	{
+		if (auto entry = table_entry(type))
+			return table_port(entry->outputs, port);
 		auto it = cell_types.find(type);
 		return it != cell_types.end() && it->second.outputs.count(port) != 0;
 	}
 
 	bool cell_input(RTLIL::IdString type, RTLIL::IdString port) const
 	{
+		if (auto entry = table_entry(type))
+			return table_port(entry->inputs, port);
 		auto it = cell_types.find(type);
 		return it != cell_types.end() && it->second.inputs.count(port) != 0;
 	}
 
 	bool cell_evaluable(RTLIL::IdString type) const
 	{
+		if (auto entry = table_entry(type))
+			return entry->is_evaluable;
 		auto it = cell_types.find(type);
 		return it != cell_types.end() && it->second.is_evaluable;
 	}
@@ -0,0 +1,430 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/consteval.h"
+
+USING_YOSYS_NAMESPACE
+
+typedef std::vector<const uint64_t*> vec_bits_t;
+
+// The loops over the words of a bit are kept trivial so that the compiler can
+// vectorize them.
+template<typename F>
+static void vec_map(const std::vector<uint64_t*> &y, const vec_bits_t &a, const vec_bits_t &b, int num_words, F f)
+{
+	for (int i = 0; i < GetSize(y); i++) {
+		uint64_t *yi = y[i];
+		const uint64_t *ai = a[i], *bi = b[i];
+		for (int w = 0; w < num_words; w++)
+			yi[w] = f(ai[w], bi[w]);
+	}
+}
+
+// Computes a - b on width bits and returns the words of the most significant
+// bit of the difference in msb, the other bits are written to y if given.
+static void vec_sub(const std::vector<uint64_t*> *y, std::vector<uint64_t> &msb, const vec_bits_t &a, const vec_bits_t &b, int width, int num_words)
+{
+	std::vector<uint64_t> carry(num_words, ~uint64_t(0));
+	msb.resize(num_words);
+	for (int i = 0; i < width; i++) {
+		uint64_t *yi = y ? y->at(i) : msb.data();
+		const uint64_t *ai = a[i], *bi = b[i];
+		for (int w = 0; w < num_words; w++) {
+			uint64_t x = ai[w], z = ~bi[w], c = carry[w];
+			yi[w] = x ^ z ^ c;
+			carry[w] = (x & z) | (c & (x ^ z));
+		}
+	}
+	if (y && width > 0)
+		std::copy(y->at(width-1), y->at(width-1) + num_words, msb.begin());
+}
+
+ConstEvalVec::ConstEvalVec(RTLIL::Module *module, int num_words) : module(module), assign_map(module), num_words(num_words)
+{
+	CellTypes ct;
+	ct.setup_internals();
+	ct.setup_stdcells();
+
+	for (auto cell : module->cells()) {
+		if (!ct.cell_known(cell->type))
+			continue;
+		for (auto &conn : cell->connections())
+			if (ct.cell_output(cell->type, conn.first))
+				for (auto bit : assign_map(conn.second))
+					if (bit.wire != nullptr)
+						sig2driver[bit] = cell;
+	}
+
+	zeros.assign(num_words, 0);
+	ones.assign(num_words, ~uint64_t(0));
+}
+
+void ConstEvalVec::clear()
+{
+	bit_index.clear();
+	values.clear();
+}
+
+const uint64_t *ConstEvalVec::get(RTLIL::SigBit bit) const
+{
+	if (bit.wire == nullptr)
+		return bit == State::S1 ? ones.data() : zeros.data();
+	auto it = bit_index.find(bit);
+	if (it == bit_index.end())
+		return nullptr;
+	return values.data() + it->second * num_words;
+}
+
+uint64_t *ConstEvalVec::put(RTLIL::SigBit bit)
+{
+	auto it = bit_index.find(bit);
+	if (it != bit_index.end())
+		return values.data() + it->second * num_words;
+	int idx = GetSize(values) / num_words;
+	bit_index[bit] = idx;
+	values.resize(values.size() + num_words, 0);
+	return values.data() + idx * num_words;
+}
+
+void ConstEvalVec::set(RTLIL::SigSpec sig, const std::vector<uint64_t> &words)
+{
+	log_assert(GetSize(words) == GetSize(sig) * num_words);
+	assign_map.apply(sig);
+	for (int i = 0; i < GetSize(sig); i++)
+		if (sig[i].wire != nullptr)
+			std::copy(words.begin() + i * num_words, words.begin() + (i+1) * num_words, put(sig[i]));
+}
+
+void ConstEvalVec::set_pattern(RTLIL::SigSpec sig, int pattern, const RTLIL::Const &value)
+{
+	log_assert(GetSize(value) == GetSize(sig));
+	log_assert(pattern >= 0 && pattern < 64 * num_words);
+	assign_map.apply(sig);
+	uint64_t mask = uint64_t(1) << (pattern % 64);
+	for (int i = 0; i < GetSize(sig); i++) {
+		if (sig[i].wire == nullptr)
+			continue;
+		uint64_t &word = put(sig[i])[pattern / 64];
+		word = value.bits[i] == State::S1 ? word | mask : word & ~mask;
+	}
+}
+
+RTLIL::Const ConstEvalVec::get_pattern(const std::vector<uint64_t> &result, int pattern) const
+{
+	log_assert(pattern >= 0 && pattern < 64 * num_words);
+	RTLIL::Const value(State::S0, GetSize(result) / num_words);
+	for (int i = 0; i < GetSize(value); i++)
+		if ((result[i * num_words + pattern / 64] >> (pattern % 64)) & 1)
+			value.bits[i] = State::S1;
+	return value;
+}
+
+bool ConstEvalVec::eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result, RTLIL::SigSpec &undef)
+{
+	assign_map.apply(sig);
+
+	bool ok = true;
+	for (auto bit : sig)
+		if (!eval_bit(bit, undef))
+			ok = false;
+	if (!ok)
+		return false;
+
+	result.resize(GetSize(sig) * num_words);
+	for (int i = 0; i < GetSize(sig); i++) {
+		const uint64_t *v = get(sig[i]);
+		std::copy(v, v + num_words, result.begin() + i * num_words);
+	}
+	return true;
+}
+
+bool ConstEvalVec::eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result)
+{
+	RTLIL::SigSpec undef;
+	return eval(sig, result, undef);
+}
+
+bool ConstEvalVec::eval_bit(RTLIL::SigBit bit, RTLIL::SigSpec &undef)
+{
+	if (get(bit) != nullptr)
+		return true;
+
+	auto it = sig2driver.find(bit);
+	if (it == sig2driver.end() || busy.count(it->second)) {
+		undef.append(bit);
+		return false;
+	}
+
+	return eval_cell(it->second, undef);
+}
+
+bool ConstEvalVec::eval_cell(RTLIL::Cell *cell, RTLIL::SigSpec &undef)
+{
+	busy.insert(cell);
+	for (auto &conn : cell->connections())
+		if (cell->input(conn.first))
+			for (auto bit : assign_map(conn.second))
+				if (!eval_bit(bit, undef)) {
+					busy.erase(cell);
+					return false;
+				}
+	busy.erase(cell);
+
+	if (!eval_fast(cell))
+		eval_fallback(cell);
+	return true;
+}
+
+bool ConstEvalVec::eval_fast(RTLIL::Cell *cell)
+{
+	RTLIL::IdString type = cell->type;
+	int nw = num_words;
+
+	bool unary = type.in(ID($not), ID($pos), ID($neg), ID($_NOT_), ID($_BUF_));
+	bool bitwise = type.in(ID($and), ID($or), ID($xor), ID($xnor),
+			ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_), ID($_ANDNOT_), ID($_ORNOT_));
+	bool arith = type.in(ID($add), ID($sub));
+	bool compare = type.in(ID($eq), ID($ne), ID($lt), ID($le), ID($gt), ID($ge));
+	bool reduce = type.in(ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+			ID($logic_not), ID($logic_and), ID($logic_or));
+	bool mux = type.in(ID($mux), ID($_MUX_), ID($_NMUX_), ID($_AOI3_), ID($_OAI3_), ID($_AOI4_), ID($_OAI4_));
+
+	if (!unary && !bitwise && !arith && !compare && !reduce && !mux)
+		return false;
+
+	// all output bits are allocated first, so that no pointer into values
+	// gets invalidated below
+	RTLIL::SigSpec sig_y = assign_map(cell->getPort(ID::Y));
+	int width = GetSize(sig_y);
+	values.reserve(values.size() + width * nw);
+	scratch.resize(width * nw);
+	std::vector<uint64_t*> y;
+	for (int i = 0; i < width; i++)
+		y.push_back(sig_y[i].wire ? put(sig_y[i]) : scratch.data() + i * nw);
+
+	auto input = [&](RTLIL::IdString port, int len, bool is_signed) {
+		RTLIL::SigSpec sig = assign_map(cell->getPort(port));
+		vec_bits_t bits;
+		for (int i = 0; i < len; i++)
+			bits.push_back(i < GetSize(sig) ? get(sig[i]) : is_signed && i > 0 ? bits.back() : zeros.data());
+		return bits;
+	};
+	auto is_signed = [&](RTLIL::IdString param) {
+		return cell->hasParam(param) && cell->getParam(param).as_bool();
+	};
+	bool both_signed = is_signed(ID::A_SIGNED) && is_signed(ID::B_SIGNED);
+
+	if (unary)
+	{
+		vec_bits_t a = input(ID::A, width, is_signed(ID::A_SIGNED));
+		if (type == ID($neg)) {
+			std::vector<uint64_t> msb;
+			vec_sub(&y, msb, vec_bits_t(width, zeros.data()), a, width, nw);
+		} else if (type.in(ID($not), ID($_NOT_)))
+			vec_map(y, a, a, nw, [](uint64_t a, uint64_t) { return ~a; });
+		else
+			vec_map(y, a, a, nw, [](uint64_t a, uint64_t) { return a; });
+		return true;
+	}
+
+	if (bitwise)
+	{
+		vec_bits_t a = input(ID::A, width, both_signed);
+		vec_bits_t b = input(ID::B, width, both_signed);
+		if (type.in(ID($and), ID($_AND_)))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return a & b; });
+		else if (type.in(ID($or), ID($_OR_)))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return a | b; });
+		else if (type.in(ID($xor), ID($_XOR_)))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return a ^ b; });
+		else if (type.in(ID($xnor), ID($_XNOR_)))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return ~(a ^ b); });
+		else if (type == ID($_NAND_))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return ~(a & b); });
+		else if (type == ID($_NOR_))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return ~(a | b); });
+		else if (type == ID($_ANDNOT_))
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return a & ~b; });
+		else
+			vec_map(y, a, b, nw, [](uint64_t a, uint64_t b) { return a | ~b; });
+		return true;
+	}
+
+	if (arith)
+	{
+		vec_bits_t a = input(ID::A, width, both_signed);
+		vec_bits_t b = input(ID::B, width, both_signed);
+		std::vector<uint64_t> msb;
+		if (type == ID($sub)) {
+			vec_sub(&y, msb, a, b, width, nw);
+			return true;
+		}
+		std::vector<uint64_t> carry(nw, 0);
+		for (int i = 0; i < width; i++)
+			for (int w = 0; w < nw; w++) {
+				uint64_t x = a[i][w], z = b[i][w], c = carry[w];
+				y[i][w] = x ^ z ^ c;
+				carry[w] = (x & z) | (c & (x ^ z));
+			}
+		return true;
+	}
+
+	if (type.in(ID($mux), ID($_MUX_), ID($_NMUX_)))
+	{
+		vec_bits_t a = input(ID::A, width, false);
+		vec_bits_t b = input(ID::B, width, false);
+		const uint64_t *s = input(ID::S, 1, false).front();
+		bool invert = type == ID($_NMUX_);
+		for (int i = 0; i < width; i++)
+			for (int w = 0; w < nw; w++) {
+				uint64_t v = (a[i][w] & ~s[w]) | (b[i][w] & s[w]);
+				y[i][w] = invert ? ~v : v;
+			}
+		return true;
+	}
+
+	// the remaining cells only produce a value in bit 0
+	for (int i = 1; i < width; i++)
+		std::fill(y[i], y[i] + nw, 0);
+	if (width == 0)
+		return true;
+	uint64_t *y0 = y[0];
+
+	if (compare)
+	{
+		int len = std::max(GetSize(cell->getPort(ID::A)), GetSize(cell->getPort(ID::B)));
+		if (type.in(ID($eq), ID($ne))) {
+			vec_bits_t a = input(ID::A, len, both_signed);
+			vec_bits_t b = input(ID::B, len, both_signed);
+			std::fill(y0, y0 + nw, 0);
+			for (int i = 0; i < len; i++)
+				for (int w = 0; w < nw; w++)
+					y0[w] |= a[i][w] ^ b[i][w];
+			if (type == ID($eq))
+				for (int w = 0; w < nw; w++)
+					y0[w] = ~y0[w];
+			return true;
+		}
+		// one extra bit of width keeps the sign of the difference
+		bool swap = type.in(ID($gt), ID($le));
+		vec_bits_t a = input(swap ? ID::B : ID::A, len+1, both_signed);
+		vec_bits_t b = input(swap ? ID::A : ID::B, len+1, both_signed);
+		std::vector<uint64_t> msb;
+		vec_sub(nullptr, msb, a, b, len+1, nw);
+		bool invert = type.in(ID($le), ID($ge));
+		for (int w = 0; w < nw; w++)
+			y0[w] = invert ? ~msb[w] : msb[w];
+		return true;
+	}
+
+	if (reduce)
+	{
+		auto reduce_or = [&](RTLIL::IdString port, std::vector<uint64_t> &res) {
+			vec_bits_t a = input(port, GetSize(cell->getPort(port)), false);
+			res.assign(nw, 0);
+			for (auto ai : a)
+				for (int w = 0; w < nw; w++)
+					res[w] |= ai[w];
+		};
+		std::vector<uint64_t> res, res_b;
+
+		if (type.in(ID($reduce_and), ID($reduce_xor), ID($reduce_xnor))) {
+			vec_bits_t a = input(ID::A, GetSize(cell->getPort(ID::A)), false);
+			bool is_and = type == ID($reduce_and);
+			res.assign(nw, is_and ? ~uint64_t(0) : 0);
+			for (auto ai : a)
+				for (int w = 0; w < nw; w++)
+					res[w] = is_and ? res[w] & ai[w] : res[w] ^ ai[w];
+			if (type == ID($reduce_xnor))
+				for (int w = 0; w < nw; w++)
+					res[w] = ~res[w];
+		} else if (type.in(ID($reduce_or), ID($reduce_bool), ID($logic_not))) {
+			reduce_or(ID::A, res);
+			if (type == ID($logic_not))
+				for (int w = 0; w < nw; w++)
+					res[w] = ~res[w];
+		} else {
+			reduce_or(ID::A, res);
+			reduce_or(ID::B, res_b);
+			for (int w = 0; w < nw; w++)
+				res[w] = type == ID($logic_and) ? res[w] & res_b[w] : res[w] | res_b[w];
+		}
+
+		std::copy(res.begin(), res.end(), y0);
+		return true;
+	}
+
+	const uint64_t *a = input(ID::A, 1, false).front();
+	const uint64_t *b = input(ID::B, 1, false).front();
+	const uint64_t *c = input(ID::C, 1, false).front();
+	const uint64_t *d = type.in(ID($_AOI4_), ID($_OAI4_)) ? input(ID::D, 1, false).front() : zeros.data();
+	for (int w = 0; w < nw; w++) {
+		if (type == ID($_AOI3_))
+			y0[w] = ~((a[w] & b[w]) | c[w]);
+		else if (type == ID($_OAI3_))
+			y0[w] = ~((a[w] | b[w]) & c[w]);
+		else if (type == ID($_AOI4_))
+			y0[w] = ~((a[w] & b[w]) | (c[w] & d[w]));
+		else
+			y0[w] = ~((a[w] | b[w]) & (c[w] | d[w]));
+	}
+	return true;
+}
+
+void ConstEvalVec::eval_fallback(RTLIL::Cell *cell)
+{
+	if (fallback == nullptr)
+		fallback.reset(new ConstEval(module));
+
+	std::vector<RTLIL::SigSpec> inputs;
+	RTLIL::SigSpec outputs;
+	for (auto &conn : cell->connections()) {
+		RTLIL::SigSpec sig;
+		for (auto bit : assign_map(conn.second))
+			if (bit.wire != nullptr)
+				sig.append(bit);
+		if (cell->input(conn.first))
+			inputs.push_back(sig);
+		if (cell->output(conn.first))
+			outputs.append(sig);
+	}
+
+	std::vector<uint64_t> result(GetSize(outputs) * num_words, 0);
+	for (int p = 0; p < 64 * num_words; p++)
+	{
+		fallback->clear();
+		for (auto &sig : inputs) {
+			RTLIL::Const value(State::S0, GetSize(sig));
+			for (int i = 0; i < GetSize(sig); i++)
+				if ((get(sig[i])[p / 64] >> (p % 64)) & 1)
+					value.bits[i] = State::S1;
+			fallback->set(sig, value);
+		}
+
+		RTLIL::SigSpec sig = outputs;
+		fallback->eval(sig);
+		for (int i = 0; i < GetSize(sig); i++)
+			if (sig[i] == State::S1)
+				result[i * num_words + p / 64] |= uint64_t(1) << (p % 64);
+	}
+
+	values.reserve(values.size() + GetSize(outputs) * num_words);
+	for (int i = 0; i < GetSize(outputs); i++)
+		std::copy(result.begin() + i * num_words, result.begin() + (i+1) * num_words, put(outputs[i]));
+}
@@ -420,6 +420,51 @@ struct ConstEval
 	}
 };
 
+// Evaluates a module for 64 * num_words input patterns at once, bit i of word
+// w of a signal bit holds its value in pattern 64 * w + i. Values are two-valued:
+// cells without a bit-parallel implementation are evaluated one pattern at a
+// time by ConstEval and undefined result bits read as 0.
+struct ConstEvalVec
+{
+	RTLIL::Module *module;
+	SigMap assign_map;
+	int num_words;
+
+	dict<RTLIL::SigBit, RTLIL::Cell*> sig2driver;
+	dict<RTLIL::SigBit, int> bit_index;
+	std::vector<uint64_t> values;
+	pool<RTLIL::Cell*> busy;
+	std::vector<uint64_t> zeros, ones, scratch;
+	std::unique_ptr<ConstEval> fallback;
+
+	ConstEvalVec(RTLIL::Module *module, int num_words = 1);
+
+	void clear();
+
+	// Sets the values of sig for all patterns, words holds num_words words
+	// for each bit of sig.
+	void set(RTLIL::SigSpec sig, const std::vector<uint64_t> &words);
+
+	// Sets the value of sig in a single pattern, unset patterns are 0.
+	void set_pattern(RTLIL::SigSpec sig, int pattern, const RTLIL::Const &value);
+
+	// Evaluates sig for all patterns into result, which gets num_words words
+	// for each bit of sig. Returns false and adds the bits that were missing
+	// to undef if sig depends on a signal that was not set.
+	bool eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result, RTLIL::SigSpec &undef);
+	bool eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result);
+
+	// Extracts the value of a single pattern from the result of eval().
+	RTLIL::Const get_pattern(const std::vector<uint64_t> &result, int pattern) const;
+
+	const uint64_t *get(RTLIL::SigBit bit) const;
+	uint64_t *put(RTLIL::SigBit bit);
+	bool eval_bit(RTLIL::SigBit bit, RTLIL::SigSpec &undef);
+	bool eval_cell(RTLIL::Cell *cell, RTLIL::SigSpec &undef);
+	bool eval_fast(RTLIL::Cell *cell);
+	void eval_fallback(RTLIL::Cell *cell);
+};
+
 YOSYS_NAMESPACE_END
 
 #endif
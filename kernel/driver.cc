@@ -18,6 +18,8 @@
  */
 
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
 #include "libs/sha1/sha1.h"
 #include <csignal>
 
@@ -249,6 +251,7 @@ int main(int argc, char **argv)
 	std::string depsfile = "";
 	std::string topmodule = "";
 	std::string perffile = "";
+	std::string profilefile = "";
 	bool scriptfile_tcl = false;
 	bool print_banner = true;
 	bool print_stats = true;
@@ -281,9 +284,22 @@ int main(int argc, char **argv)
 		printf("    -t\n");
 		printf("        annotate all log messages with a time stamp\n");
 		printf("\n");
+		printf("    -a\n");
+		printf("        buffer the log output and write it from a background thread instead\n");
+		printf("        of flushing it after every message (output since the last command\n");
+		printf("        may be lost if yosys crashes)\n");
+		printf("\n");
 		printf("    -d\n");
 		printf("        print more detailed timing stats at exit\n");
 		printf("\n");
+		printf("    -k <file>\n");
+		printf("        record the time and memory used by each command and the commands it\n");
+		printf("        calls, and write it to the file at exit (see 'help profile')\n");
+		printf("\n");
+		printf("    -j <N>\n");
+		printf("        use up to <N> threads in passes that support multi-threading\n");
+		printf("        (default: value of YOSYS_MAX_THREADS environment variable, or 1)\n");
+		printf("\n");
 		printf("    -l logfile\n");
 		printf("        write log messages to the specified file\n");
 		printf("\n");
@@ -388,7 +404,7 @@ int main(int argc, char **argv)
 	}
 
 	int opt;
-	while ((opt = getopt(argc, argv, "MXAQTVCSgm:f:Hh:b:o:p:l:L:qv:tds:c:W:w:e:r:D:P:E:x:B:")) != -1)
+	while ((opt = getopt(argc, argv, "MXAQTVCSgm:f:Hh:b:o:p:l:L:qv:tadk:j:s:c:W:w:e:r:D:P:E:x:B:")) != -1)
 	{
 		switch (opt)
 		{
@@ -467,9 +483,19 @@ int main(int argc, char **argv)
 		case 't':
 			log_time = true;
 			break;
+		case 'a':
+			log_set_async(true);
+			break;
 		case 'd':
 			timing_details = true;
 			break;
+		case 'j':
+			yosys_max_threads = atoi(optarg);
+			if (yosys_max_threads < 1) {
+				fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 's':
 			scriptfile = optarg;
 			scriptfile_tcl = false;
@@ -481,13 +507,13 @@ int main(int argc, char **argv)
 			run_shell = false;
 			break;
 		case 'W':
-			log_warn_regexes.push_back(YS_REGEX_COMPILE(optarg));
+			log_warn_regexes.add(optarg);
 			break;
 		case 'w':
-			log_nowarn_regexes.push_back(YS_REGEX_COMPILE(optarg));
+			log_nowarn_regexes.add(optarg);
 			break;
 		case 'e':
-			log_werror_regexes.push_back(YS_REGEX_COMPILE(optarg));
+			log_werror_regexes.add(optarg);
 			break;
 		case 'r':
 			topmodule = optarg;
@@ -526,6 +552,10 @@ int main(int argc, char **argv)
 		case 'B':
 			perffile = optarg;
 			break;
+		case 'k':
+			profilefile = optarg;
+			PassProfiler::enabled = true;
+			break;
 		case 'C':
 			run_tcl_shell = true;
 			break;
@@ -566,7 +596,8 @@ int main(int argc, char **argv)
 		}
 	#endif
 
-	if (!state_dir.empty()) {
+	// batch runs neither read nor write the history file
+	if (run_shell && !state_dir.empty()) {
 		std::string yosys_dir = state_dir + "/yosys";
 		create_directory(yosys_dir);
 
@@ -800,6 +831,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (!profilefile.empty())
+		PassProfiler::write_file(profilefile);
+
 #if defined(YOSYS_ENABLE_COVER) && (defined(__linux__) || defined(__FreeBSD__))
 	if (getenv("YOSYS_COVER_DIR") || getenv("YOSYS_COVER_FILE"))
 	{
@@ -89,20 +89,20 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		is_fine = true;
 		has_gclk = true;
 		sig_d = cell->getPort(ID::D);
-	} else if (type_str.substr(0, 5) == "$_SR_") {
+	} else if (type_str.compare(0, 5, "$_SR_") == 0) {
 		is_fine = true;
 		has_sr = true;
 		pol_set = type_str[5] == 'P';
 		pol_clr = type_str[6] == 'P';
 		sig_set = cell->getPort(ID::S);
 		sig_clr = cell->getPort(ID::R);
-	} else if (type_str.substr(0, 6) == "$_DFF_" && type_str.size() == 8) {
+	} else if (type_str.compare(0, 6, "$_DFF_") == 0 && type_str.size() == 8) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
 		pol_clk = type_str[6] == 'P';
 		sig_clk = cell->getPort(ID::C);
-	} else if (type_str.substr(0, 7) == "$_DFFE_" && type_str.size() == 10) {
+	} else if (type_str.compare(0, 7, "$_DFFE_") == 0 && type_str.size() == 10) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -111,7 +111,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		has_ce = true;
 		pol_ce = type_str[8] == 'P';
 		sig_ce = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 6) == "$_DFF_" && type_str.size() == 10) {
+	} else if (type_str.compare(0, 6, "$_DFF_") == 0 && type_str.size() == 10) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -121,7 +121,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_arst = type_str[7] == 'P';
 		sig_arst = cell->getPort(ID::R);
 		val_arst = type_str[8] == '1' ? State::S1 : State::S0;
-	} else if (type_str.substr(0, 7) == "$_DFFE_" && type_str.size() == 12) {
+	} else if (type_str.compare(0, 7, "$_DFFE_") == 0 && type_str.size() == 12) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -134,7 +134,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		has_ce = true;
 		pol_ce = type_str[10] == 'P';
 		sig_ce = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 8) == "$_ALDFF_" && type_str.size() == 11) {
+	} else if (type_str.compare(0, 8, "$_ALDFF_") == 0 && type_str.size() == 11) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -144,7 +144,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_aload = type_str[9] == 'P';
 		sig_aload = cell->getPort(ID::L);
 		sig_ad = cell->getPort(ID::AD);
-	} else if (type_str.substr(0, 9) == "$_ALDFFE_" && type_str.size() == 13) {
+	} else if (type_str.compare(0, 9, "$_ALDFFE_") == 0 && type_str.size() == 13) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -157,7 +157,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		has_ce = true;
 		pol_ce = type_str[11] == 'P';
 		sig_ce = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 8) == "$_DFFSR_" && type_str.size() == 12) {
+	} else if (type_str.compare(0, 8, "$_DFFSR_") == 0 && type_str.size() == 12) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -168,7 +168,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_clr = type_str[10] == 'P';
 		sig_set = cell->getPort(ID::S);
 		sig_clr = cell->getPort(ID::R);
-	} else if (type_str.substr(0, 9) == "$_DFFSRE_" && type_str.size() == 14) {
+	} else if (type_str.compare(0, 9, "$_DFFSRE_") == 0 && type_str.size() == 14) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -182,7 +182,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		has_ce = true;
 		pol_ce = type_str[12] == 'P';
 		sig_ce = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 7) == "$_SDFF_" && type_str.size() == 11) {
+	} else if (type_str.compare(0, 7, "$_SDFF_") == 0 && type_str.size() == 11) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -192,7 +192,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_srst = type_str[8] == 'P';
 		sig_srst = cell->getPort(ID::R);
 		val_srst = type_str[9] == '1' ? State::S1 : State::S0;
-	} else if (type_str.substr(0, 8) == "$_SDFFE_" && type_str.size() == 13) {
+	} else if (type_str.compare(0, 8, "$_SDFFE_") == 0 && type_str.size() == 13) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -205,7 +205,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		has_ce = true;
 		pol_ce = type_str[11] == 'P';
 		sig_ce = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 9) == "$_SDFFCE_" && type_str.size() == 14) {
+	} else if (type_str.compare(0, 9, "$_SDFFCE_") == 0 && type_str.size() == 14) {
 		is_fine = true;
 		sig_d = cell->getPort(ID::D);
 		has_clk = true;
@@ -219,14 +219,14 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_ce = type_str[12] == 'P';
 		sig_ce = cell->getPort(ID::E);
 		ce_over_srst = true;
-	} else if (type_str.substr(0, 9) == "$_DLATCH_" && type_str.size() == 11) {
+	} else if (type_str.compare(0, 9, "$_DLATCH_") == 0 && type_str.size() == 11) {
 		is_fine = true;
 		has_aload = true;
 		sig_ad = cell->getPort(ID::D);
 		has_aload = true;
 		pol_aload = type_str[9] == 'P';
 		sig_aload = cell->getPort(ID::E);
-	} else if (type_str.substr(0, 9) == "$_DLATCH_" && type_str.size() == 13) {
+	} else if (type_str.compare(0, 9, "$_DLATCH_") == 0 && type_str.size() == 13) {
 		is_fine = true;
 		has_aload = true;
 		sig_ad = cell->getPort(ID::D);
@@ -237,7 +237,7 @@ FfData::FfData(FfInitVals *initvals, Cell *cell_) : FfData(cell_->module, initva
 		pol_arst = type_str[10] == 'P';
 		sig_arst = cell->getPort(ID::R);
 		val_arst = type_str[11] == '1' ? State::S1 : State::S0;
-	} else if (type_str.substr(0, 11) == "$_DLATCHSR_" && type_str.size() == 15) {
+	} else if (type_str.compare(0, 11, "$_DLATCHSR_") == 0 && type_str.size() == 15) {
 		is_fine = true;
 		has_aload = true;
 		sig_ad = cell->getPort(ID::D);
@@ -322,23 +322,40 @@ FfData FfData::slice(const std::vector<int> &bits) {
 	res.pol_clr = pol_clr;
 	res.pol_set = pol_set;
 	res.attributes = attributes;
-	for (int i : bits) {
-		res.sig_q.append(sig_q[i]);
-		if (has_clk || has_gclk)
-			res.sig_d.append(sig_d[i]);
-		if (has_aload)
-			res.sig_ad.append(sig_ad[i]);
-		if (has_sr) {
-			res.sig_clr.append(sig_clr[i]);
-			res.sig_set.append(sig_set[i]);
-		}
-		if (has_arst)
-			res.val_arst.bits.push_back(val_arst[i]);
-		if (has_srst)
-			res.val_srst.bits.push_back(val_srst[i]);
-		if (initvals)
-			res.val_init.bits.push_back(val_init[i]);
+
+	// gather the bits into vectors and build each signal once, appending
+	// bit by bit to a SigSpec repacks it for every bit
+	auto slice_sig = [&](const SigSpec &sig) {
+		const std::vector<SigBit> &sig_bits = sig.bits();
+		std::vector<SigBit> res_bits;
+		res_bits.reserve(bits.size());
+		for (int i : bits)
+			res_bits.push_back(sig_bits.at(i));
+		return SigSpec(res_bits);
+	};
+	auto slice_const = [&](const Const &val) {
+		Const res_val;
+		res_val.bits.reserve(bits.size());
+		for (int i : bits)
+			res_val.bits.push_back(val[i]);
+		return res_val;
+	};
+
+	res.sig_q = slice_sig(sig_q);
+	if (has_clk || has_gclk)
+		res.sig_d = slice_sig(sig_d);
+	if (has_aload)
+		res.sig_ad = slice_sig(sig_ad);
+	if (has_sr) {
+		res.sig_clr = slice_sig(sig_clr);
+		res.sig_set = slice_sig(sig_set);
 	}
+	if (has_arst)
+		res.val_arst = slice_const(val_arst);
+	if (has_srst)
+		res.val_srst = slice_const(val_srst);
+	if (initvals)
+		res.val_init = slice_const(val_init);
 	res.width = GetSize(res.sig_q);
 
 	return res;
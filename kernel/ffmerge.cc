@@ -21,22 +21,43 @@
 
 USING_YOSYS_NAMESPACE
 
+int FfMergeHelper::users(RTLIL::SigBit bit) {
+	int count = index->users(bit);
+	auto it = input_ff_users.find(index->sigmap()(bit));
+	if (it != input_ff_users.end())
+		count += it->second;
+	return count;
+}
+
 bool FfMergeHelper::is_output_unused(RTLIL::SigSpec sig) {
-	for (auto bit : (*sigmap)(sig))
-		if (sigbit_users_count[bit] != 0)
+	for (auto bit : sig)
+		if (users(bit) != 0)
 			return false;
 	return true;
 }
 
+// Multi-bit FFs are visited once per bit, their FfData is built only once
+// per call of find_output_ff or find_input_ff. The cells are not changed
+// during a call, so the cached data stays valid.
+static const FfData &cell_ff(dict<Cell*, FfData> &cell_ffs, FfInitVals *initvals, Cell *cell)
+{
+	auto it = cell_ffs.find(cell);
+	if (it == cell_ffs.end())
+		it = cell_ffs.insert(std::make_pair(cell, FfData(initvals, cell))).first;
+	return it->second;
+}
+
 bool FfMergeHelper::find_output_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pair<Cell *, int>> &bits) {
+	dict<Cell*, FfData> cell_ffs;
 	ff = FfData(module, initvals, NEW_ID);
-	sigmap->apply(sig);
+	const SigMap &sigmap = index->sigmap();
+	sigmap.apply(sig);
 
 	bool found = false;
 
 	for (auto bit : sig)
 	{
-		if (bit.wire == NULL || sigbit_users_count[bit] == 0) {
+		if (bit.wire == NULL || users(bit) == 0) {
 			ff.width++;
 			ff.sig_q.append(bit);
 			ff.sig_d.append(bit);
@@ -48,10 +69,10 @@ bool FfMergeHelper::find_output_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pai
 			continue;
 		}
 
-		if (sigbit_users_count[bit] != 1)
+		if (users(bit) != 1)
 			return false;
 
-		auto &sinks = dff_sink[bit];
+		auto &sinks = index->sinks(bit);
 		if (sinks.size() != 1)
 			return false;
 
@@ -60,13 +81,13 @@ bool FfMergeHelper::find_output_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pai
 		std::tie(cell, idx) = *sinks.begin();
 		bits.insert(std::make_pair(cell, idx));
 
-		FfData cur_ff(initvals, cell);
+		const FfData &cur_ff = cell_ff(cell_ffs, initvals, cell);
 
 		// Reject latches and $ff.
 		if (!cur_ff.has_clk)
 			return false;
 
-		log_assert((*sigmap)(cur_ff.sig_d[idx]) == bit);
+		log_assert(sigmap(cur_ff.sig_d[idx]) == bit);
 
 		if (!found) {
 			ff.sig_clk = cur_ff.sig_clk;
@@ -157,8 +178,10 @@ bool FfMergeHelper::find_output_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pai
 }
 
 bool FfMergeHelper::find_input_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pair<Cell *, int>> &bits) {
+	dict<Cell*, FfData> cell_ffs;
 	ff = FfData(module, initvals, NEW_ID);
-	sigmap->apply(sig);
+	const SigMap &sigmap = index->sigmap();
+	sigmap.apply(sig);
 
 	bool found = false;
 
@@ -180,17 +203,18 @@ bool FfMergeHelper::find_input_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pair
 			continue;
 		}
 
-		if (!dff_driver.count(bit))
+		auto driver = index->driver(bit);
+		if (driver == nullptr)
 			return false;
 
 		Cell *cell;
 		int idx;
-		std::tie(cell, idx) = dff_driver[bit];
+		std::tie(cell, idx) = *driver;
 		bits.insert(std::make_pair(cell, idx));
 
-		FfData cur_ff(initvals, cell);
+		const FfData &cur_ff = cell_ff(cell_ffs, initvals, cell);
 
-		log_assert((*sigmap)(cur_ff.sig_q[idx]) == bit);
+		log_assert(sigmap(cur_ff.sig_q[idx]) == bit);
 
 		if (!found) {
 			ff.sig_clk = cur_ff.sig_clk;
@@ -295,12 +319,12 @@ bool FfMergeHelper::find_input_ff(RTLIL::SigSpec sig, FfData &ff, pool<std::pair
 
 
 void FfMergeHelper::remove_output_ff(const pool<std::pair<Cell *, int>> &bits) {
+	// The index drops the FF bits as drivers when the Q ports are reconnected.
 	for (auto &it : bits) {
 		Cell *cell = it.first;
 		int idx = it.second;
 		SigSpec q = cell->getPort(ID::Q);
 		initvals->remove_init(q[idx]);
-		dff_driver.erase((*sigmap)(q[idx]));
 		q[idx] = module->addWire(stringf("$ffmerge_disconnected$%d", autoidx++));
 		cell->setPort(ID::Q, q);
 	}
@@ -316,7 +340,7 @@ void FfMergeHelper::mark_input_ff(const pool<std::pair<Cell *, int>> &bits) {
 			// (for the D port).  Bump it as it is now connected
 			// to the merged-to cell as well.  This suffices for
 			// it to not be considered for output merging.
-			sigbit_users_count[d[idx]]++;
+			input_ff_users[index->sigmap()(d[idx])]++;
 		}
 	}
 }
@@ -325,35 +349,19 @@ void FfMergeHelper::set(FfInitVals *initvals_, RTLIL::Module *module_)
 {
 	clear();
 	initvals = initvals_;
-	sigmap = initvals->sigmap;
 	module = module_;
 
-	for (auto wire : module->wires()) {
-		if (wire->port_output)
-			for (auto bit : (*sigmap)(wire))
-				sigbit_users_count[bit]++;
-	}
-
-	for (auto cell : module->cells()) {
-		if (RTLIL::builtin_ff_cell_types().count(cell->type)) {
-			if (cell->hasPort(ID::D)) {
-				SigSpec d = (*sigmap)(cell->getPort(ID::D));
-				for (int i = 0; i < GetSize(d); i++)
-					dff_sink[d[i]].insert(std::make_pair(cell, i));
-			}
-			SigSpec q = (*sigmap)(cell->getPort(ID::Q));
-			for (int i = 0; i < GetSize(q); i++)
-				dff_driver[q[i]] = std::make_pair(cell, i);
-		}
-		for (auto &conn : cell->connections())
-			if (!cell->known() || cell->input(conn.first))
-				for (auto bit : (*sigmap)(conn.second))
-					sigbit_users_count[bit]++;
+	ModCache *cache = ModCache::find(module->design);
+	if (cache != nullptr) {
+		index = &cache->ff_index(module);
+	} else {
+		own_index.reset(new ModFfIndex(module));
+		index = own_index.get();
 	}
 }
 
 void FfMergeHelper::clear() {
-	dff_driver.clear();
-	dff_sink.clear();
-	sigbit_users_count.clear();
+	index = nullptr;
+	own_index.reset();
+	input_ff_users.clear();
 }
@@ -22,6 +22,7 @@
 
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
+#include "kernel/modtools.h"
 
 YOSYS_NAMESPACE_BEGIN
 
@@ -55,16 +56,22 @@ YOSYS_NAMESPACE_BEGIN
 // order) because a given FF bit could be eligible for both input and output merge,
 // perhaps in different cells.  For this reason, it may be a good idea to separate
 // input and output merging.
+//
+// The FF bits and bit users are looked up in a ModFfIndex, which follows the
+// changes to the module.  If a ModCache is active, its index of the module
+// is used, so that it is only built once for several passes.
 
 struct FfMergeHelper
 {
-	const SigMap *sigmap;
 	RTLIL::Module *module;
 	FfInitVals *initvals;
+	ModFfIndex *index;
+	std::unique_ptr<ModFfIndex> own_index;
+
+	// Users added by mark_input_ff, on top of the ones in the index.
+	dict<SigBit, int> input_ff_users;
 
-	dict<SigBit, std::pair<Cell*, int>> dff_driver;
-	dict<SigBit, pool<std::pair<Cell*, int>>> dff_sink;
-	dict<SigBit, int> sigbit_users_count;
+	int users(RTLIL::SigBit bit);
 
 	// Returns true if all bits in sig are completely unused.
 	bool is_output_unused(RTLIL::SigSpec sig);
@@ -133,7 +140,7 @@ struct FfMergeHelper
 		set(initvals, module);
 	}
 
-	FfMergeHelper() {}
+	FfMergeHelper() : module(nullptr), initvals(nullptr), index(nullptr) {}
 };
 
 YOSYS_NAMESPACE_END
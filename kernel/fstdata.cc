@@ -197,7 +197,7 @@ static void reconstruct_clb_attimes(void *user_data, uint64_t pnt_time, fstHandl
 
 void FstData::reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t /* plen */)
 {
-	if (pnt_time > end_time || !pnt_value) return;
+	if (pnt_time > end_time || pnt_time < skip_before || !pnt_value) return;
 	// if we are past the timestamp
 	bool is_clock = false;
 	if (!all_samples) {
@@ -233,7 +233,12 @@ void FstData::reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_faci
 	last_data[pnt_facidx] =  std::string((const char *)pnt_value);
 }
 
-void FstData::reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t start, uint64_t end, CallbackFunction cb)
+void FstData::setProcessMask(const std::vector<fstHandle> &signals)
+{
+	process_mask = signals;
+}
+
+void FstData::beginReconstruct(std::vector<fstHandle> &signal, uint64_t start, uint64_t end, CallbackFunction cb)
 {
 	clk_signals = signal;
 	callback = cb;
@@ -244,16 +249,56 @@ void FstData::reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t sta
 	past_data.clear();
 	past_time = start_time;
 	all_samples = clk_signals.empty();
+	window_start = start_time;
+	skip_before = 0;
+	reconstruct_done = false;
+
+	if (process_mask.empty()) {
+		fstReaderSetFacProcessMaskAll(ctx);
+	} else {
+		fstReaderClrFacProcessMaskAll(ctx);
+		for (auto handle : process_mask)
+			fstReaderSetFacProcessMask(ctx, handle);
+		for (auto handle : clk_signals)
+			fstReaderSetFacProcessMask(ctx, handle);
+	}
+}
+
+bool FstData::reconstructWindow(uint64_t window)
+{
+	if (reconstruct_done)
+		return false;
+
+	uint64_t window_end = end_time;
+	if (window != 0 && window - 1 < end_time - window_start)
+		window_end = window_start + window - 1;
 
-	fstReaderSetUnlimitedTimeRange(ctx);
-	fstReaderSetFacProcessMaskAll(ctx);
+	// Blocks ending before the window are skipped by the reader, the values
+	// at the window start come from the frame of the first block read. For
+	// later windows those were already seen at the end of the previous one.
+	fstReaderSetLimitTimeRange(ctx, window_start, window_end);
 	fstReaderIterBlocks2(ctx, reconstruct_clb_attimes, reconstruct_clb_varlen_attimes, this, nullptr);
+
+	if (window_end != end_time) {
+		window_start = window_end + 1;
+		skip_before = window_start;
+		return true;
+	}
+
+	reconstruct_done = true;
 	if (last_time!=end_time) {
 		past_data = last_data;
 		callback(last_time);
 	}
 	past_data = last_data;
 	callback(end_time);
+	return false;
+}
+
+void FstData::reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t start, uint64_t end, CallbackFunction cb)
+{
+	beginReconstruct(signal, start, end, cb);
+	reconstructWindow();
 }
 
 std::string FstData::valueOf(fstHandle signal)
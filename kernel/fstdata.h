@@ -52,6 +52,16 @@ class FstData
 	void reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t plen);
 	void reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t start_time, uint64_t end_time, CallbackFunction cb);
 
+	// Only decode and keep values of the given signals during reconstruction,
+	// an empty list selects all signals again.
+	void setProcessMask(const std::vector<fstHandle> &signals);
+
+	// Streaming variant of reconstructAllAtTimes(): each reconstructWindow()
+	// call reads the value changes of at most 'window' time units (0 for the
+	// rest of the range) and returns false once the end time was reached.
+	void beginReconstruct(std::vector<fstHandle> &signal, uint64_t start_time, uint64_t end_time, CallbackFunction cb);
+	bool reconstructWindow(uint64_t window = 0);
+
 	std::string valueOf(fstHandle signal);
 	fstHandle getHandle(std::string name);
 	dict<int,fstHandle> getMemoryHandles(std::string name);
@@ -76,6 +86,10 @@ private:
 	CallbackFunction callback;
 	std::vector<fstHandle> clk_signals;
 	bool all_samples;
+	std::vector<fstHandle> process_mask;
+	uint64_t window_start;
+	uint64_t skip_before;
+	bool reconstruct_done;
 	std::string tmp_file;
 };
 
@@ -18,6 +18,11 @@
 #include <vector>
 
 #include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 namespace hashlib {
 
@@ -32,10 +37,28 @@ inline unsigned int mkhash(unsigned int a, unsigned int b) {
 // traditionally 5381 is used as starting value for the djb2 hash
 const unsigned int mkhash_init = 5381;
 
-// The ADD version of DJB2
-// (use this version for cache locality in b)
+// Combines two hashes, e.g. of a wire and a bit index or of the elements of
+// a pair. a is spread with a golden ratio multiplier, so that the ranges of
+// small b for different a do not overlap like with 33*a+b of DJB2, and b is
+// added for cache locality in b.
 inline unsigned int mkhash_add(unsigned int a, unsigned int b) {
-	return ((a << 5) + a) + b;
+	return a * 0x9e3779b1u + b;
+}
+
+// Hashes n bytes four at a time with the ADD version of DJB2. The last n%4
+// bytes are hashed per character, so that names which only differ in a
+// trailing number still hash into nearby buckets.
+inline unsigned int mkhash_bytes(const char *p, size_t n) {
+	unsigned int h = mkhash_init;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32_t w;
+		memcpy(&w, p + i, 4);
+		h = ((h << 5) + h) + w;
+	}
+	for (; i < n; i++)
+		h = mkhash(h, p[i]);
+	return h;
 }
 
 inline unsigned int mkhash_xorshift(unsigned int a) {
@@ -104,44 +127,41 @@ template<> struct hash_ops<std::string> {
 		return a == b;
 	}
 	static inline unsigned int hash(const std::string &a) {
-		unsigned int v = 0;
-		for (auto c : a)
-			v = mkhash(v, c);
-		return v;
+		return mkhash_bytes(a.data(), a.size());
 	}
 };
 
 template<typename P, typename Q> struct hash_ops<std::pair<P, Q>> {
-	static inline bool cmp(std::pair<P, Q> a, std::pair<P, Q> b) {
+	static inline bool cmp(const std::pair<P, Q> &a, const std::pair<P, Q> &b) {
 		return a == b;
 	}
-	static inline unsigned int hash(std::pair<P, Q> a) {
-		return mkhash(hash_ops<P>::hash(a.first), hash_ops<Q>::hash(a.second));
+	static inline unsigned int hash(const std::pair<P, Q> &a) {
+		return mkhash_add(hash_ops<P>::hash(a.first), hash_ops<Q>::hash(a.second));
 	}
 };
 
 template<typename... T> struct hash_ops<std::tuple<T...>> {
-	static inline bool cmp(std::tuple<T...> a, std::tuple<T...> b) {
+	static inline bool cmp(const std::tuple<T...> &a, const std::tuple<T...> &b) {
 		return a == b;
 	}
 	template<size_t I = 0>
-	static inline typename std::enable_if<I == sizeof...(T), unsigned int>::type hash(std::tuple<T...>) {
+	static inline typename std::enable_if<I == sizeof...(T), unsigned int>::type hash(const std::tuple<T...> &) {
 		return mkhash_init;
 	}
 	template<size_t I = 0>
-	static inline typename std::enable_if<I != sizeof...(T), unsigned int>::type hash(std::tuple<T...> a) {
+	static inline typename std::enable_if<I != sizeof...(T), unsigned int>::type hash(const std::tuple<T...> &a) {
 		typedef hash_ops<typename std::tuple_element<I, std::tuple<T...>>::type> element_ops_t;
-		return mkhash(hash<I+1>(a), element_ops_t::hash(std::get<I>(a)));
+		return mkhash_add(hash<I+1>(a), element_ops_t::hash(std::get<I>(a)));
 	}
 };
 
 template<typename T> struct hash_ops<std::vector<T>> {
-	static inline bool cmp(std::vector<T> a, std::vector<T> b) {
+	static inline bool cmp(const std::vector<T> &a, const std::vector<T> &b) {
 		return a == b;
 	}
-	static inline unsigned int hash(std::vector<T> a) {
+	static inline unsigned int hash(const std::vector<T> &a) {
 		unsigned int h = mkhash_init;
-		for (auto k : a)
+		for (const auto &k : a)
 			h = mkhash(h, hash_ops<T>::hash(k));
 		return h;
 	}
@@ -155,10 +175,7 @@ struct hash_cstr_ops {
 		return true;
 	}
 	static inline unsigned int hash(const char *a) {
-		unsigned int hash = mkhash_init;
-		while (*a)
-			hash = mkhash(hash, *(a++));
-		return hash;
+		return mkhash_bytes(a, strlen(a));
 	}
 };
 
@@ -211,10 +228,57 @@ inline int hashtable_size(int min_size)
 	throw std::length_error("hash table exceeded maximum size.");
 }
 
+// Bucket statistics of dict, pool and idict, as reported by the hashstat
+// command. stats() returns them for one container, add() sums them up.
+struct hash_stats
+{
+	size_t containers = 0, entries = 0, buckets = 0, used_buckets = 0, max_chain = 0;
+	// number of keys compared in a lookup, summed over all entries, and the
+	// same sum expected for uniformly distributed hashes
+	size_t probes = 0;
+	double uniform_probes = 0;
+
+	template<typename Entry>
+	hash_stats(const std::vector<int> &hashtable, const std::vector<Entry> &entries_vec)
+	{
+		containers = 1;
+		entries = entries_vec.size();
+		buckets = hashtable.size();
+		for (int index : hashtable) {
+			size_t length = 0;
+			for (int i = index; i >= 0; i = entries_vec[i].next)
+				probes += ++length;
+			if (length > 0)
+				used_buckets++;
+			max_chain = std::max(max_chain, length);
+		}
+		if (buckets > 0)
+			uniform_probes = entries * (1 + 0.5 * (entries - 1) / buckets);
+	}
+
+	hash_stats() { }
+
+	void add(const hash_stats &other)
+	{
+		containers += other.containers;
+		entries += other.entries;
+		buckets += other.buckets;
+		used_buckets += other.used_buckets;
+		max_chain = std::max(max_chain, other.max_chain);
+		probes += other.probes;
+		uniform_probes += other.uniform_probes;
+	}
+
+	double load_factor() const { return buckets ? double(entries) / buckets : 0; }
+	double avg_chain() const { return used_buckets ? double(entries) / used_buckets : 0; }
+	double avg_probes() const { return entries ? double(probes) / entries : 0; }
+	double avg_uniform_probes() const { return entries ? uniform_probes / entries : 0; }
+};
+
 template<typename K, typename T, typename OPS = hash_ops<K>> class dict;
 template<typename K, int offset = 0, typename OPS = hash_ops<K>> class idict;
 template<typename K, typename OPS = hash_ops<K>> class pool;
-template<typename K, typename OPS = hash_ops<K>> class mfp;
+template<typename K, typename OPS = hash_ops<K>, typename DB = idict<K, 0, OPS>> class mfp;
 
 template<typename K, typename T, typename OPS>
 class dict
@@ -341,6 +405,10 @@ class dict
 		} else {
 			entries.emplace_back(std::pair<K, T>(key, T()), hashtable[hash]);
 			hashtable[hash] = entries.size() - 1;
+			// keep the load factor below the limit checked by do_lookup(), so
+			// that lookups in an unmodified container never rehash it
+			if (entries.size() * hashtable_size_trigger > hashtable.size())
+				do_rehash();
 		}
 		return entries.size() - 1;
 	}
@@ -354,6 +422,8 @@ class dict
 		} else {
 			entries.emplace_back(value, hashtable[hash]);
 			hashtable[hash] = entries.size() - 1;
+			if (entries.size() * hashtable_size_trigger > hashtable.size())
+				do_rehash();
 		}
 		return entries.size() - 1;
 	}
@@ -368,6 +438,8 @@ class dict
 		} else {
 			entries.emplace_back(std::forward<std::pair<K, T>>(rvalue), hashtable[hash]);
 			hashtable[hash] = entries.size() - 1;
+			if (entries.size() * hashtable_size_trigger > hashtable.size())
+				do_rehash();
 		}
 		return entries.size() - 1;
 	}
@@ -657,6 +729,8 @@ public:
 		return h;
 	}
 
+	hash_stats stats() const { return hash_stats(hashtable, entries); }
+
 	void reserve(size_t n) { entries.reserve(n); }
 	size_t size() const { return entries.size(); }
 	bool empty() const { return entries.empty(); }
@@ -794,6 +868,8 @@ protected:
 		} else {
 			entries.emplace_back(value, hashtable[hash]);
 			hashtable[hash] = entries.size() - 1;
+			if (entries.size() * hashtable_size_trigger > hashtable.size())
+				do_rehash();
 		}
 		return entries.size() - 1;
 	}
@@ -807,6 +883,8 @@ protected:
 		} else {
 			entries.emplace_back(std::forward<K>(rvalue), hashtable[hash]);
 			hashtable[hash] = entries.size() - 1;
+			if (entries.size() * hashtable_size_trigger > hashtable.size())
+				do_rehash();
 		}
 		return entries.size() - 1;
 	}
@@ -1023,6 +1101,8 @@ public:
 		return hashval;
 	}
 
+	hash_stats stats() const { return hash_stats(hashtable, entries); }
+
 	void reserve(size_t n) { entries.reserve(n); }
 	size_t size() const { return entries.size(); }
 	bool empty() const { return entries.empty(); }
@@ -1119,6 +1199,8 @@ public:
 		database.swap(other.database);
 	}
 
+	hash_stats stats() const { return database.stats(); }
+
 	void reserve(size_t n) { database.reserve(n); }
 	size_t size() const { return database.size(); }
 	bool empty() const { return database.empty(); }
@@ -1129,14 +1211,16 @@ public:
 	const_iterator end() const { return const_iterator(*this, offset + size()); }
 };
 
-template<typename K, typename OPS>
+// DB is the container that assigns the indices, idict<K, 0, OPS> or
+// flat_idict<K, 0, OPS>.
+template<typename K, typename OPS, typename DB>
 class mfp
 {
-	mutable idict<K, 0, OPS> database;
+	mutable DB database;
 	mutable std::vector<int> parents;
 
 public:
-	typedef typename idict<K, 0, OPS>::const_iterator const_iterator;
+	typedef typename DB::const_iterator const_iterator;
 
 	constexpr mfp()
 	{
@@ -1163,13 +1247,23 @@ public:
 
 		while (k != p) {
 			int next_k = parents[k];
-			parents[k] = p;
+			if (next_k != p)
+				parents[k] = p;
 			k = next_k;
 		}
 
 		return p;
 	}
 
+	// Points all entries directly to their representative. Lookups do not
+	// modify the mfp after this (until the next merge or promote), so they
+	// can be made from multiple threads.
+	void compress() const
+	{
+		for (int i = 0; i < int(parents.size()); i++)
+			ifind(i);
+	}
+
 	void imerge(int i, int j)
 	{
 		i = ifind(i);
@@ -1233,6 +1327,868 @@ public:
 	const_iterator end() const { return database.end(); }
 };
 
+// -------------------------------------------------------
+// Open addressing variants of dict, pool and idict
+// -------------------------------------------------------
+//
+// flat_dict, flat_pool and flat_idict have the same interface and iteration
+// order as dict, pool and idict: the entries are kept in insertion order in
+// a vector, and erase() moves the last entry into the gap. Instead of
+// chaining entries from a bucket array, the entry indices are stored in an
+// open addressing table with one control byte per slot, holding 7 bits of
+// the hash of a used slot or marking it as empty or deleted. A lookup scans
+// a group of 16 control bytes at once (using SSE2 where available) and
+// usually only touches the entries vector for the key that matches.
+
+class flat_index
+{
+public:
+	enum : int { group_size = 16 };
+
+private:
+	enum : signed char { ctrl_empty = -128, ctrl_deleted = -2 };
+
+	std::vector<signed char> ctrl;
+	std::vector<int> slots;
+	int group_mask = 0;
+	int used = 0;
+
+	static inline uint64_t mix(unsigned int hash)
+	{
+		return (uint64_t(hash) + 1) * 0x9e3779b97f4a7c15ull;
+	}
+
+	static inline signed char h2(uint64_t mixed)
+	{
+		return mixed >> 57;
+	}
+
+	static inline int h1(uint64_t mixed)
+	{
+		return (mixed >> 32) & 0x7fffffff;
+	}
+
+	static inline unsigned int match(const signed char *group, signed char value)
+	{
+#ifdef __SSE2__
+		__m128i data = _mm_loadu_si128((const __m128i*)group);
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_set1_epi8(value)));
+#else
+		unsigned int mask = 0;
+		for (int i = 0; i < group_size; i++)
+			if (group[i] == value)
+				mask |= 1u << i;
+		return mask;
+#endif
+	}
+
+	// empty or deleted slots, i.e. control bytes with the sign bit set
+	static inline unsigned int match_free(const signed char *group)
+	{
+#ifdef __SSE2__
+		return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+		unsigned int mask = 0;
+		for (int i = 0; i < group_size; i++)
+			if (group[i] < 0)
+				mask |= 1u << i;
+		return mask;
+#endif
+	}
+
+	static inline int first_bit(unsigned int mask)
+	{
+#ifdef __GNUC__
+		return __builtin_ctz(mask);
+#else
+		int i = 0;
+		while ((mask & 1) == 0)
+			mask >>= 1, i++;
+		return i;
+#endif
+	}
+
+	int find_slot(unsigned int hash, int index) const
+	{
+		uint64_t mixed = mix(hash);
+		for (int g = h1(mixed) & group_mask, step = 1;; g = (g + step++) & group_mask) {
+			const signed char *group = &ctrl[g * group_size];
+			for (unsigned int m = match(group, h2(mixed)); m; m &= m-1) {
+				int slot = g * group_size + first_bit(m);
+				if (slots[slot] == index)
+					return slot;
+			}
+			if (step > group_mask + 1)
+				throw std::runtime_error("flat_index::find_slot() failed.");
+		}
+	}
+
+public:
+	bool empty() const { return ctrl.empty(); }
+	size_t capacity() const { return ctrl.size(); }
+
+	// true if inserting another entry needs a larger table
+	bool must_grow() const
+	{
+		return (used + 1) * 8 > int(ctrl.size()) * 7;
+	}
+
+	void clear()
+	{
+		ctrl.clear();
+		slots.clear();
+		group_mask = 0;
+		used = 0;
+	}
+
+	// reset to an empty table that fits at least n entries at 50% load
+	void init(size_t n)
+	{
+		size_t groups = 1;
+		while (groups * group_size < 2 * n)
+			groups *= 2;
+		if (groups > (size_t(1) << 26))
+			throw std::length_error("hash table exceeded maximum size.");
+		ctrl.assign(groups * group_size, ctrl_empty);
+		slots.resize(groups * group_size);
+		group_mask = groups - 1;
+		used = 0;
+	}
+
+	// returns the first index for which eq(index) is true, or -1
+	template<typename Eq>
+	int find(unsigned int hash, const Eq &eq) const
+	{
+		if (ctrl.empty())
+			return -1;
+		uint64_t mixed = mix(hash);
+		for (int g = h1(mixed) & group_mask, step = 1;; g = (g + step++) & group_mask) {
+			const signed char *group = &ctrl[g * group_size];
+			for (unsigned int m = match(group, h2(mixed)); m; m &= m-1) {
+				int index = slots[g * group_size + first_bit(m)];
+				if (eq(index))
+					return index;
+			}
+			if (match(group, ctrl_empty))
+				return -1;
+		}
+	}
+
+	// add an index that is known not to be in the table yet
+	void insert(unsigned int hash, int index)
+	{
+		uint64_t mixed = mix(hash);
+		for (int g = h1(mixed) & group_mask, step = 1;; g = (g + step++) & group_mask) {
+			unsigned int m = match_free(&ctrl[g * group_size]);
+			if (m) {
+				int slot = g * group_size + first_bit(m);
+				if (ctrl[slot] == ctrl_empty)
+					used++;
+				ctrl[slot] = h2(mixed);
+				slots[slot] = index;
+				return;
+			}
+		}
+	}
+
+	void erase(unsigned int hash, int index)
+	{
+		int slot = find_slot(hash, index);
+		// A probe sequence never continues past a group that still
+		// has an empty slot, so the slot can be marked as empty again.
+		if (match(&ctrl[slot & ~(group_size-1)], ctrl_empty)) {
+			ctrl[slot] = ctrl_empty;
+			used--;
+		} else
+			ctrl[slot] = ctrl_deleted;
+	}
+
+	void move(unsigned int hash, int old_index, int new_index)
+	{
+		slots[find_slot(hash, old_index)] = new_index;
+	}
+
+	void swap(flat_index &other)
+	{
+		ctrl.swap(other.ctrl);
+		slots.swap(other.slots);
+		std::swap(group_mask, other.group_mask);
+		std::swap(used, other.used);
+	}
+};
+
+template<typename K, typename T, typename OPS = hash_ops<K>> class flat_dict;
+template<typename K, typename OPS = hash_ops<K>> class flat_pool;
+template<typename K, int offset = 0, typename OPS = hash_ops<K>> class flat_idict;
+
+template<typename K, typename T, typename OPS>
+class flat_dict
+{
+	std::vector<std::pair<K, T>> entries;
+	flat_index index;
+	OPS ops;
+
+	void do_rehash()
+	{
+		index.init(std::max(entries.size(), entries.capacity() / 2));
+		for (int i = 0; i < int(entries.size()); i++)
+			index.insert(ops.hash(entries[i].first), i);
+	}
+
+	int do_lookup(const K &key, unsigned int hash) const
+	{
+		return index.find(hash, [&](int i) { return ops.cmp(entries[i].first, key); });
+	}
+
+	template<typename V>
+	int do_insert(V &&value, unsigned int hash)
+	{
+		entries.emplace_back(std::forward<V>(value));
+		if (index.must_grow())
+			do_rehash();
+		else
+			index.insert(hash, entries.size() - 1);
+		return entries.size() - 1;
+	}
+
+	int do_erase(int i, unsigned int hash)
+	{
+		if (i < 0)
+			return 0;
+		index.erase(hash, i);
+		int back_idx = entries.size() - 1;
+		if (i != back_idx) {
+			index.move(ops.hash(entries[back_idx].first), back_idx, i);
+			entries[i] = std::move(entries[back_idx]);
+		}
+		entries.pop_back();
+		if (entries.empty())
+			index.clear();
+		return 1;
+	}
+
+public:
+	class const_iterator
+	{
+		friend class flat_dict;
+	protected:
+		const flat_dict *ptr;
+		int index;
+		const_iterator(const flat_dict *ptr, int index) : ptr(ptr), index(index) { }
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef std::pair<K, T> value_type;
+		typedef ptrdiff_t difference_type;
+		typedef std::pair<K, T>* pointer;
+		typedef std::pair<K, T>& reference;
+		const_iterator() { }
+		const_iterator operator++() { index--; return *this; }
+		const_iterator operator+=(int amt) { index -= amt; return *this; }
+		bool operator<(const const_iterator &other) const { return index > other.index; }
+		bool operator==(const const_iterator &other) const { return index == other.index; }
+		bool operator!=(const const_iterator &other) const { return index != other.index; }
+		const std::pair<K, T> &operator*() const { return ptr->entries[index]; }
+		const std::pair<K, T> *operator->() const { return &ptr->entries[index]; }
+	};
+
+	class iterator
+	{
+		friend class flat_dict;
+	protected:
+		flat_dict *ptr;
+		int index;
+		iterator(flat_dict *ptr, int index) : ptr(ptr), index(index) { }
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef std::pair<K, T> value_type;
+		typedef ptrdiff_t difference_type;
+		typedef std::pair<K, T>* pointer;
+		typedef std::pair<K, T>& reference;
+		iterator() { }
+		iterator operator++() { index--; return *this; }
+		iterator operator+=(int amt) { index -= amt; return *this; }
+		bool operator<(const iterator &other) const { return index > other.index; }
+		bool operator==(const iterator &other) const { return index == other.index; }
+		bool operator!=(const iterator &other) const { return index != other.index; }
+		std::pair<K, T> &operator*() { return ptr->entries[index]; }
+		std::pair<K, T> *operator->() { return &ptr->entries[index]; }
+		const std::pair<K, T> &operator*() const { return ptr->entries[index]; }
+		const std::pair<K, T> *operator->() const { return &ptr->entries[index]; }
+		operator const_iterator() const { return const_iterator(ptr, index); }
+	};
+
+	flat_dict()
+	{
+	}
+
+	flat_dict(const flat_dict &other) : entries(other.entries), index(other.index)
+	{
+	}
+
+	flat_dict(flat_dict &&other)
+	{
+		swap(other);
+	}
+
+	flat_dict &operator=(const flat_dict &other) {
+		entries = other.entries;
+		index = other.index;
+		return *this;
+	}
+
+	flat_dict &operator=(flat_dict &&other) {
+		clear();
+		swap(other);
+		return *this;
+	}
+
+	flat_dict(const std::initializer_list<std::pair<K, T>> &list)
+	{
+		for (auto &it : list)
+			insert(it);
+	}
+
+	template<class InputIterator>
+	flat_dict(InputIterator first, InputIterator last)
+	{
+		insert(first, last);
+	}
+
+	template<class InputIterator>
+	void insert(InputIterator first, InputIterator last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	std::pair<iterator, bool> insert(const K &key)
+	{
+		unsigned int hash = ops.hash(key);
+		int i = do_lookup(key, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(std::pair<K, T>(key, T()), hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	std::pair<iterator, bool> insert(const std::pair<K, T> &value)
+	{
+		unsigned int hash = ops.hash(value.first);
+		int i = do_lookup(value.first, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(value, hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	std::pair<iterator, bool> insert(std::pair<K, T> &&rvalue)
+	{
+		unsigned int hash = ops.hash(rvalue.first);
+		int i = do_lookup(rvalue.first, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(std::move(rvalue), hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	template<typename KK, typename TT>
+	std::pair<iterator, bool> emplace(KK &&key, TT &&value)
+	{
+		unsigned int hash = ops.hash(key);
+		int i = do_lookup(key, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(std::pair<K, T>(std::forward<KK>(key), std::forward<TT>(value)), hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	int erase(const K &key)
+	{
+		unsigned int hash = ops.hash(key);
+		return do_erase(do_lookup(key, hash), hash);
+	}
+
+	iterator erase(iterator it)
+	{
+		do_erase(it.index, ops.hash(it->first));
+		return ++it;
+	}
+
+	int count(const K &key) const
+	{
+		return do_lookup(key, ops.hash(key)) < 0 ? 0 : 1;
+	}
+
+	int count(const K &key, const_iterator it) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		return i < 0 || i > it.index ? 0 : 1;
+	}
+
+	iterator find(const K &key)
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			return end();
+		return iterator(this, i);
+	}
+
+	const_iterator find(const K &key) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			return end();
+		return const_iterator(this, i);
+	}
+
+	T& at(const K &key)
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			throw std::out_of_range("flat_dict::at()");
+		return entries[i].second;
+	}
+
+	const T& at(const K &key) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			throw std::out_of_range("flat_dict::at()");
+		return entries[i].second;
+	}
+
+	const T& at(const K &key, const T &defval) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			return defval;
+		return entries[i].second;
+	}
+
+	T& operator[](const K &key)
+	{
+		unsigned int hash = ops.hash(key);
+		int i = do_lookup(key, hash);
+		if (i < 0)
+			i = do_insert(std::pair<K, T>(key, T()), hash);
+		return entries[i].second;
+	}
+
+	template<typename Compare = std::less<K>>
+	void sort(Compare comp = Compare())
+	{
+		std::sort(entries.begin(), entries.end(), [comp](const std::pair<K, T> &a, const std::pair<K, T> &b){ return comp(b.first, a.first); });
+		do_rehash();
+	}
+
+	void swap(flat_dict &other)
+	{
+		entries.swap(other.entries);
+		index.swap(other.index);
+	}
+
+	bool operator==(const flat_dict &other) const {
+		if (size() != other.size())
+			return false;
+		for (auto &it : entries) {
+			auto oit = other.find(it.first);
+			if (oit == other.end() || !(oit->second == it.second))
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const flat_dict &other) const {
+		return !operator==(other);
+	}
+
+	unsigned int hash() const {
+		unsigned int h = mkhash_init;
+		for (auto &entry : entries) {
+			h ^= hash_ops<K>::hash(entry.first);
+			h ^= hash_ops<T>::hash(entry.second);
+		}
+		return h;
+	}
+
+	void reserve(size_t n)
+	{
+		entries.reserve(n);
+		if (index.capacity() < 2 * n)
+			do_rehash();
+	}
+
+	size_t size() const { return entries.size(); }
+	bool empty() const { return entries.empty(); }
+	void clear() { index.clear(); entries.clear(); }
+
+	iterator begin() { return iterator(this, int(entries.size())-1); }
+	iterator element(int n) { return iterator(this, int(entries.size())-1-n); }
+	iterator end() { return iterator(nullptr, -1); }
+
+	const_iterator begin() const { return const_iterator(this, int(entries.size())-1); }
+	const_iterator element(int n) const { return const_iterator(this, int(entries.size())-1-n); }
+	const_iterator end() const { return const_iterator(nullptr, -1); }
+};
+
+template<typename K, typename OPS>
+class flat_pool
+{
+	template<typename, int, typename> friend class flat_idict;
+
+protected:
+	std::vector<K> entries;
+	flat_index index;
+	OPS ops;
+
+	void do_rehash()
+	{
+		index.init(std::max(entries.size(), entries.capacity() / 2));
+		for (int i = 0; i < int(entries.size()); i++)
+			index.insert(ops.hash(entries[i]), i);
+	}
+
+	int do_lookup(const K &key, unsigned int hash) const
+	{
+		return index.find(hash, [&](int i) { return ops.cmp(entries[i], key); });
+	}
+
+	template<typename V>
+	int do_insert(V &&value, unsigned int hash)
+	{
+		entries.emplace_back(std::forward<V>(value));
+		if (index.must_grow())
+			do_rehash();
+		else
+			index.insert(hash, entries.size() - 1);
+		return entries.size() - 1;
+	}
+
+	int do_erase(int i, unsigned int hash)
+	{
+		if (i < 0)
+			return 0;
+		index.erase(hash, i);
+		int back_idx = entries.size() - 1;
+		if (i != back_idx) {
+			index.move(ops.hash(entries[back_idx]), back_idx, i);
+			entries[i] = std::move(entries[back_idx]);
+		}
+		entries.pop_back();
+		if (entries.empty())
+			index.clear();
+		return 1;
+	}
+
+public:
+	class const_iterator
+	{
+		friend class flat_pool;
+	protected:
+		const flat_pool *ptr;
+		int index;
+		const_iterator(const flat_pool *ptr, int index) : ptr(ptr), index(index) { }
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef K value_type;
+		typedef ptrdiff_t difference_type;
+		typedef K* pointer;
+		typedef K& reference;
+		const_iterator() { }
+		const_iterator operator++() { index--; return *this; }
+		bool operator==(const const_iterator &other) const { return index == other.index; }
+		bool operator!=(const const_iterator &other) const { return index != other.index; }
+		const K &operator*() const { return ptr->entries[index]; }
+		const K *operator->() const { return &ptr->entries[index]; }
+	};
+
+	class iterator
+	{
+		friend class flat_pool;
+	protected:
+		flat_pool *ptr;
+		int index;
+		iterator(flat_pool *ptr, int index) : ptr(ptr), index(index) { }
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef K value_type;
+		typedef ptrdiff_t difference_type;
+		typedef K* pointer;
+		typedef K& reference;
+		iterator() { }
+		iterator operator++() { index--; return *this; }
+		bool operator==(const iterator &other) const { return index == other.index; }
+		bool operator!=(const iterator &other) const { return index != other.index; }
+		K &operator*() { return ptr->entries[index]; }
+		K *operator->() { return &ptr->entries[index]; }
+		const K &operator*() const { return ptr->entries[index]; }
+		const K *operator->() const { return &ptr->entries[index]; }
+		operator const_iterator() const { return const_iterator(ptr, index); }
+	};
+
+	flat_pool()
+	{
+	}
+
+	flat_pool(const flat_pool &other) : entries(other.entries), index(other.index)
+	{
+	}
+
+	flat_pool(flat_pool &&other)
+	{
+		swap(other);
+	}
+
+	flat_pool &operator=(const flat_pool &other) {
+		entries = other.entries;
+		index = other.index;
+		return *this;
+	}
+
+	flat_pool &operator=(flat_pool &&other) {
+		clear();
+		swap(other);
+		return *this;
+	}
+
+	flat_pool(const std::initializer_list<K> &list)
+	{
+		for (auto &it : list)
+			insert(it);
+	}
+
+	template<class InputIterator>
+	flat_pool(InputIterator first, InputIterator last)
+	{
+		insert(first, last);
+	}
+
+	template<class InputIterator>
+	void insert(InputIterator first, InputIterator last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	std::pair<iterator, bool> insert(const K &value)
+	{
+		unsigned int hash = ops.hash(value);
+		int i = do_lookup(value, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(value, hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	std::pair<iterator, bool> insert(K &&rvalue)
+	{
+		unsigned int hash = ops.hash(rvalue);
+		int i = do_lookup(rvalue, hash);
+		if (i >= 0)
+			return std::pair<iterator, bool>(iterator(this, i), false);
+		i = do_insert(std::move(rvalue), hash);
+		return std::pair<iterator, bool>(iterator(this, i), true);
+	}
+
+	template<typename... Args>
+	std::pair<iterator, bool> emplace(Args&&... args)
+	{
+		return insert(K(std::forward<Args>(args)...));
+	}
+
+	int erase(const K &key)
+	{
+		unsigned int hash = ops.hash(key);
+		return do_erase(do_lookup(key, hash), hash);
+	}
+
+	iterator erase(iterator it)
+	{
+		do_erase(it.index, ops.hash(*it));
+		return ++it;
+	}
+
+	int count(const K &key) const
+	{
+		return do_lookup(key, ops.hash(key)) < 0 ? 0 : 1;
+	}
+
+	int count(const K &key, const_iterator it) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		return i < 0 || i > it.index ? 0 : 1;
+	}
+
+	iterator find(const K &key)
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			return end();
+		return iterator(this, i);
+	}
+
+	const_iterator find(const K &key) const
+	{
+		int i = do_lookup(key, ops.hash(key));
+		if (i < 0)
+			return end();
+		return const_iterator(this, i);
+	}
+
+	bool operator[](const K &key) const
+	{
+		return do_lookup(key, ops.hash(key)) >= 0;
+	}
+
+	template<typename Compare = std::less<K>>
+	void sort(Compare comp = Compare())
+	{
+		std::sort(entries.begin(), entries.end(), [comp](const K &a, const K &b){ return comp(b, a); });
+		do_rehash();
+	}
+
+	K pop()
+	{
+		iterator it = begin();
+		K ret = *it;
+		erase(it);
+		return ret;
+	}
+
+	void swap(flat_pool &other)
+	{
+		entries.swap(other.entries);
+		index.swap(other.index);
+	}
+
+	bool operator==(const flat_pool &other) const {
+		if (size() != other.size())
+			return false;
+		for (auto &it : entries)
+			if (!other.count(it))
+				return false;
+		return true;
+	}
+
+	bool operator!=(const flat_pool &other) const {
+		return !operator==(other);
+	}
+
+	unsigned int hash() const {
+		unsigned int hashval = mkhash_init;
+		for (auto &it : entries)
+			hashval ^= ops.hash(it);
+		return hashval;
+	}
+
+	void reserve(size_t n)
+	{
+		entries.reserve(n);
+		if (index.capacity() < 2 * n)
+			do_rehash();
+	}
+
+	size_t size() const { return entries.size(); }
+	bool empty() const { return entries.empty(); }
+	void clear() { index.clear(); entries.clear(); }
+
+	iterator begin() { return iterator(this, int(entries.size())-1); }
+	iterator element(int n) { return iterator(this, int(entries.size())-1-n); }
+	iterator end() { return iterator(nullptr, -1); }
+
+	const_iterator begin() const { return const_iterator(this, int(entries.size())-1); }
+	const_iterator element(int n) const { return const_iterator(this, int(entries.size())-1-n); }
+	const_iterator end() const { return const_iterator(nullptr, -1); }
+};
+
+template<typename K, int offset, typename OPS>
+class flat_idict
+{
+	flat_pool<K, OPS> database;
+
+public:
+	class const_iterator
+	{
+		friend class flat_idict;
+	protected:
+		const flat_idict &container;
+		int index;
+		const_iterator(const flat_idict &container, int index) : container(container), index(index) { }
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef K value_type;
+		typedef ptrdiff_t difference_type;
+		typedef K* pointer;
+		typedef K& reference;
+		const_iterator() { }
+		const_iterator operator++() { index++; return *this; }
+		bool operator==(const const_iterator &other) const { return index == other.index; }
+		bool operator!=(const const_iterator &other) const { return index != other.index; }
+		const K &operator*() const { return container[index]; }
+		const K *operator->() const { return &container[index]; }
+	};
+
+	flat_idict()
+	{
+	}
+
+	int operator()(const K &key)
+	{
+		unsigned int hash = database.ops.hash(key);
+		int i = database.do_lookup(key, hash);
+		if (i < 0)
+			i = database.do_insert(key, hash);
+		return i + offset;
+	}
+
+	int at(const K &key) const
+	{
+		int i = database.do_lookup(key, database.ops.hash(key));
+		if (i < 0)
+			throw std::out_of_range("flat_idict::at()");
+		return i + offset;
+	}
+
+	int at(const K &key, int defval) const
+	{
+		int i = database.do_lookup(key, database.ops.hash(key));
+		if (i < 0)
+			return defval;
+		return i + offset;
+	}
+
+	int count(const K &key) const
+	{
+		return database.count(key);
+	}
+
+	void expect(const K &key, int i)
+	{
+		int j = (*this)(key);
+		if (i != j)
+			throw std::out_of_range("flat_idict::expect()");
+	}
+
+	const K &operator[](int index) const
+	{
+		return database.entries.at(index - offset);
+	}
+
+	void swap(flat_idict &other)
+	{
+		database.swap(other.database);
+	}
+
+	void reserve(size_t n) { database.reserve(n); }
+	size_t size() const { return database.size(); }
+	bool empty() const { return database.empty(); }
+	void clear() { database.clear(); }
+
+	const_iterator begin() const { return const_iterator(*this, offset); }
+	const_iterator element(int n) const { return const_iterator(*this, n); }
+	const_iterator end() const { return const_iterator(*this, offset + size()); }
+};
+
 } /* namespace hashlib */
 
 #endif
@@ -36,13 +36,22 @@
 #include <vector>
 #include <list>
 
+#ifdef YOSYS_ENABLE_THREADS
+#  include <condition_variable>
+#  include <mutex>
+#  include <thread>
+#  ifndef _WIN32
+#    include <pthread.h>
+#  endif
+#endif
+
 YOSYS_NAMESPACE_BEGIN
 
 std::vector<FILE*> log_files;
 std::vector<std::ostream*> log_streams;
 std::vector<std::string> log_scratchpads;
 std::map<std::string, std::set<std::string>> log_hdump;
-std::vector<std::regex> log_warn_regexes, log_nowarn_regexes, log_werror_regexes;
+LogRegexList log_warn_regexes, log_nowarn_regexes, log_werror_regexes;
 dict<std::string, LogExpectedItem> log_expect_log, log_expect_warning, log_expect_error;
 std::set<std::string> log_warnings, log_experimentals, log_experimentals_ignored;
 int log_warnings_count = 0;
@@ -63,17 +72,200 @@ void (*log_verific_callback)(int msg_type, const char *message_id, const char* f
 
 int log_make_debug = 0;
 int log_force_debug = 0;
-int log_debug_suppressed = 0;
+thread_local int log_debug_suppressed = 0;
 
 vector<int> header_count;
-vector<char*> log_id_cache;
-vector<shared_str> string_buf;
-int string_buf_index = -1;
+static thread_local vector<char*> log_id_cache;
+static thread_local vector<shared_str> string_buf;
+static thread_local int string_buf_index = -1;
+static thread_local LogCapture *log_capture = nullptr;
 
 static struct timeval initial_tv = { 0, 0 };
 static bool next_print_log = false;
 static int log_newline_count = 0;
 
+static bool log_async = false;
+
+#ifdef YOSYS_ENABLE_THREADS
+// Background writer for log_files. Consecutive messages for the same set of
+// files are merged into one chunk, and the files are flushed once the queue
+// runs empty, so that the main thread never waits for the terminal or the
+// file system except in log_flush().
+struct LogWriter
+{
+	struct chunk_t {
+		std::vector<FILE*> files;
+		std::string text;
+	};
+
+	std::mutex mutex;
+	std::condition_variable work_cond, idle_cond;
+	std::vector<chunk_t> queue;
+	bool busy = false, stopping = false;
+	std::thread thread;
+
+	LogWriter() : thread([this]() { run(); }) { }
+
+	void write(const std::vector<FILE*> &files, const std::string &text)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bool was_empty = queue.empty();
+		if (was_empty || queue.back().files != files)
+			queue.push_back({files, std::string()});
+		queue.back().text += text;
+		if (was_empty)
+			work_cond.notify_one();
+	}
+
+	void run()
+	{
+		std::vector<chunk_t> chunks;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (1) {
+			work_cond.wait(lock, [this]() { return !queue.empty() || stopping; });
+			if (queue.empty())
+				break;
+			chunks.swap(queue);
+			busy = true;
+			lock.unlock();
+
+			std::vector<FILE*> written;
+			for (auto &chunk : chunks)
+				for (auto f : chunk.files) {
+					fwrite(chunk.text.data(), 1, chunk.text.size(), f);
+					if (std::find(written.begin(), written.end(), f) == written.end())
+						written.push_back(f);
+				}
+			for (auto f : written)
+				fflush(f);
+			chunks.clear();
+
+			lock.lock();
+			busy = false;
+			if (queue.empty())
+				idle_cond.notify_all();
+		}
+	}
+
+	void drain()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle_cond.wait(lock, [this]() { return queue.empty() && !busy; });
+	}
+
+	~LogWriter()
+	{
+		drain();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_cond.notify_one();
+		thread.join();
+	}
+};
+
+// Deliberately leaked while enabled: a process that exits without calling
+// log_set_async(false) must not run into the destructor of a joinable thread.
+static LogWriter *log_writer = nullptr;
+#endif
+
+void log_set_async(bool enable)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	if (enable && log_writer == nullptr) {
+#  ifndef _WIN32
+		// a forked child (see the fork command) has no writer thread
+		static bool atfork_registered = false;
+		if (!atfork_registered)
+			pthread_atfork(nullptr, nullptr, []() { log_writer = nullptr; log_async = false; });
+		atfork_registered = true;
+#  endif
+		log_writer = new LogWriter;
+	}
+	if (!enable && log_writer != nullptr) {
+		delete log_writer;
+		log_writer = nullptr;
+	}
+#endif
+	log_async = enable;
+	if (!enable)
+		log_flush();
+}
+
+static void log_write_files(const std::string &str)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	if (log_writer != nullptr && !log_files.empty()) {
+		log_writer->write(log_files, str);
+		return;
+	}
+#endif
+	for (auto f : log_files)
+		fputs(str.c_str(), f);
+}
+
+void LogRegexList::add(const std::string &pattern)
+{
+	// compiled on its own only to report an invalid pattern right away
+	YS_REGEX_COMPILE(pattern);
+	patterns.push_back(pattern);
+	dirty = true;
+}
+
+void LogRegexList::clear()
+{
+	patterns.clear();
+	combined = std::regex();
+	dirty = false;
+}
+
+bool LogRegexList::search(const std::string &text)
+{
+	if (patterns.empty())
+		return false;
+	if (dirty) {
+		std::string alternation;
+		for (auto &pattern : patterns)
+			alternation += (alternation.empty() ? "(" : "|(") + pattern + ")";
+		combined = YS_REGEX_COMPILE(alternation);
+		dirty = false;
+	}
+	return std::regex_search(text, combined);
+}
+
+// The -expect patterns of one type are first searched as one, so that the
+// messages matching none of them (the common case) are scanned only once.
+// Returns true if any of the patterns matched.
+static bool log_count_expected(dict<std::string, LogExpectedItem> &items, LogRegexList &filter, const std::string &text)
+{
+	if (items.empty())
+		return false;
+
+	bool same = GetSize(filter.get_patterns()) == GetSize(items);
+	int index = 0;
+	for (auto it = items.begin(); same && it != items.end(); ++it)
+		same = filter.get_patterns()[index++] == it->first;
+	if (!same) {
+		filter.clear();
+		for (auto &item : items)
+			filter.add(item.first);
+	}
+
+	if (!filter.search(text))
+		return false;
+
+	bool match = false;
+	for (auto &item : items)
+		if (std::regex_search(text, item.second.pattern)) {
+			item.second.current_count++;
+			match = true;
+		}
+	return match;
+}
+
+static LogRegexList log_expect_log_filter, log_expect_warning_filter, log_expect_error_filter;
+
 static void log_id_cache_clear()
 {
 	for (auto p : log_id_cache)
@@ -111,11 +303,24 @@ void logv(const char *format, va_list ap)
 	if (log_make_debug && !ys_debug(1))
 		return;
 
+	// nothing would see the message, e.g. with "yosys -q" or "tee -q"
+	if (log_capture == nullptr && log_files.empty() && log_streams.empty() && log_scratchpads.empty() &&
+			log_hasher == nullptr && log_warn_regexes.empty() && log_expect_log.empty())
+		return;
+
 	std::string str = vstringf(format, ap);
 
 	if (str.empty())
 		return;
 
+	if (log_capture) {
+		if (!log_capture->entries.empty() && log_capture->entries.back().type == LogCapture::MessageEntry)
+			log_capture->entries.back().text += str;
+		else
+			log_capture->entries.push_back({LogCapture::MessageEntry, std::string(), str});
+		return;
+	}
+
 	size_t nnl_pos = str.find_last_not_of('\n');
 	if (nnl_pos == std::string::npos)
 		log_newline_count += GetSize(str);
@@ -153,15 +358,13 @@ void logv(const char *format, va_list ap)
 		if (!strcmp(format, "%s") && str.back() == '\n')
 			next_print_log = true;
 
-		for (auto f : log_files)
-			fputs(time_str.c_str(), f);
+		log_write_files(time_str);
 
 		for (auto f : log_streams)
 			*f << time_str;
 	}
 
-	for (auto f : log_files)
-		fputs(str.c_str(), f);
+	log_write_files(str);
 
 	for (auto f : log_streams)
 		*f << str;
@@ -187,13 +390,10 @@ void logv(const char *format, va_list ap)
 			linebuffer += str;
 
 			if (!linebuffer.empty() && linebuffer.back() == '\n') {
-				for (auto &re : log_warn_regexes)
-					if (std::regex_search(linebuffer, re))
-						log_warning("Found log message matching -W regex:\n%s", str.c_str());
+				if (log_warn_regexes.search(linebuffer))
+					log_warning("Found log message matching -W regex:\n%s", str.c_str());
 
-				for (auto &item : log_expect_log)
-					if (std::regex_search(linebuffer, item.second.pattern))
-						item.second.current_count++;
+				log_count_expected(log_expect_log, log_expect_log_filter, linebuffer);
 
 				linebuffer.clear();
 			}
@@ -201,11 +401,19 @@ void logv(const char *format, va_list ap)
 
 		log_warn_regex_recusion_guard = false;
 	}
-    log_flush();
+
+	if (!log_async)
+		log_flush();
 }
 
 void logv_header(RTLIL::Design *design, const char *format, va_list ap)
 {
+	// numbered when replayed
+	if (log_capture) {
+		log_capture->entries.push_back({LogCapture::HeaderEntry, std::string(), vstringf(format, ap)});
+		return;
+	}
+
 	bool pop_errfile = false;
 
 	log_spacer();
@@ -247,13 +455,13 @@ static void logv_warning_with_prefix(const char *prefix,
                                      const char *format, va_list ap)
 {
 	std::string message = vstringf(format, ap);
-	bool suppressed = false;
 
-	for (auto &re : log_nowarn_regexes)
-		if (std::regex_search(message, re))
-			suppressed = true;
+	if (log_capture) {
+		log_capture->entries.push_back({LogCapture::WarningEntry, prefix, message});
+		return;
+	}
 
-	if (suppressed)
+	if (log_nowarn_regexes.search(message))
 	{
 		log("Suppressed %s%s", prefix, message.c_str());
 	}
@@ -262,16 +470,10 @@ static void logv_warning_with_prefix(const char *prefix,
 		int bak_log_make_debug = log_make_debug;
 		log_make_debug = 0;
 
-		for (auto &re : log_werror_regexes)
-			if (std::regex_search(message, re))
-				log_error("%s",  message.c_str());
+		if (log_werror_regexes.search(message))
+			log_error("%s",  message.c_str());
 
-		bool warning_match = false;
-		for (auto &item : log_expect_warning)
-			if (std::regex_search(message, item.second.pattern)) {
-				item.second.current_count++;
-				warning_match = true;
-			}
+		bool warning_match = log_count_expected(log_expect_warning, log_expect_warning_filter, message);
 
 		if (log_warnings.count(message))
 		{
@@ -299,6 +501,14 @@ static void logv_warning_with_prefix(const char *prefix,
 	}
 }
 
+static void log_warning_with_prefix(const char *prefix, const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	logv_warning_with_prefix(prefix, format, ap);
+	va_end(ap);
+}
+
 void logv_warning(const char *format, va_list ap)
 {
 	logv_warning_with_prefix("Warning: ", format, ap);
@@ -335,6 +545,11 @@ void log_file_info(const std::string &filename, int lineno,
 static void logv_error_with_prefix(const char *prefix,
                                    const char *format, va_list ap)
 {
+	if (log_capture) {
+		log_capture->entries.push_back({LogCapture::ErrorEntry, prefix, vstringf(format, ap)});
+		throw log_cmd_error_exception();
+	}
+
 #ifdef EMSCRIPTEN
 	auto backup_log_files = log_files;
 #endif
@@ -356,9 +571,7 @@ static void logv_error_with_prefix(const char *prefix,
 
 	log_make_debug = bak_log_make_debug;
 
-	for (auto &item : log_expect_error)
-		if (std::regex_search(log_last_error, item.second.pattern))
-			item.second.current_count++;
+	log_count_expected(log_expect_error, log_expect_error_filter, log_last_error);
 
 	log_check_expected();
 
@@ -380,6 +593,14 @@ static void logv_error_with_prefix(const char *prefix,
 #endif
 }
 
+[[noreturn]]
+static void log_error_with_prefix(const char *prefix, const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	logv_error_with_prefix(prefix, format, ap);
+}
+
 void logv_error(const char *format, va_list ap)
 {
 	logv_error_with_prefix("ERROR: ", format, ap);
@@ -432,6 +653,11 @@ void log_experimental(const char *format, ...)
 	string s = vstringf(format, ap);
 	va_end(ap);
 
+	if (log_capture) {
+		log_capture->entries.push_back({LogCapture::ExperimentalEntry, std::string(), s});
+		return;
+	}
+
 	if (log_experimentals_ignored.count(s) == 0 && log_experimentals.count(s) == 0) {
 		log_warning("Feature '%s' is experimental.\n", s.c_str());
 		log_experimentals.insert(s);
@@ -458,6 +684,12 @@ void log_cmd_error(const char *format, ...)
 	va_list ap;
 	va_start(ap, format);
 
+	if (log_capture) {
+		log_capture->entries.push_back({LogCapture::CmdErrorEntry, std::string(), vstringf(format, ap)});
+		va_end(ap);
+		throw log_cmd_error_exception();
+	}
+
 	if (log_cmd_error_throw) {
 		log_last_error = vstringf(format, ap);
 		log("ERROR: %s", log_last_error.c_str());
@@ -488,6 +720,65 @@ void log_pop()
 	log_flush();
 }
 
+void LogCapture::begin()
+{
+	log_assert(log_capture != this);
+	entries.clear();
+	debug_suppressed = 0;
+	outer = log_capture;
+	outer_debug_suppressed = log_debug_suppressed;
+	log_debug_suppressed = 0;
+	log_capture = this;
+}
+
+void LogCapture::end()
+{
+	log_assert(log_capture == this);
+	log_capture = outer;
+	outer = nullptr;
+	debug_suppressed += log_debug_suppressed;
+	log_debug_suppressed = outer_debug_suppressed;
+	log_id_cache_clear();
+	string_buf.clear();
+	string_buf_index = -1;
+}
+
+void LogCapture::replay()
+{
+	log_assert(log_capture != this);
+	log_debug_suppressed += debug_suppressed;
+	debug_suppressed = 0;
+
+	std::vector<Entry> replay_entries;
+	std::swap(replay_entries, entries);
+
+	for (auto &entry : replay_entries)
+		switch (entry.type)
+		{
+		case MessageEntry:
+			log("%s", entry.text.c_str());
+			break;
+		case HeaderEntry:
+			log_header(nullptr, "%s", entry.text.c_str());
+			break;
+		case WarningEntry:
+			log_warning_with_prefix(entry.prefix.c_str(), "%s", entry.text.c_str());
+			break;
+		case ExperimentalEntry:
+			log_experimental("%s", entry.text.c_str());
+			break;
+		case ErrorEntry:
+			log_error_with_prefix(entry.prefix.c_str(), "%s", entry.text.c_str());
+		case CmdErrorEntry:
+			log_cmd_error("%s", entry.text.c_str());
+		}
+}
+
+bool LogCapture::active()
+{
+	return log_capture != nullptr;
+}
+
 #if (defined(__linux__) || defined(__FreeBSD__)) && defined(YOSYS_ENABLE_PLUGINS)
 void log_backtrace(const char *prefix, int levels)
 {
@@ -597,6 +888,11 @@ void log_reset_stack()
 
 void log_flush()
 {
+#ifdef YOSYS_ENABLE_THREADS
+	if (log_writer != nullptr)
+		log_writer->drain();
+#endif
+
 	for (auto f : log_files)
 		fflush(f);
 
@@ -742,7 +1038,65 @@ void log_check_expected()
 
 dict<std::string, std::pair<std::string, int>> extra_coverage_data;
 
+#ifdef YOSYS_ENABLE_THREADS
+static std::mutex cover_mutex;
+struct cover_lock_t {
+	std::lock_guard<std::mutex> lock;
+	cover_lock_t() : lock(cover_mutex) { }
+};
+#else
+struct cover_lock_t {
+	cover_lock_t() { }
+};
+#endif
+
+thread_local int *cover_thread_counters = nullptr;
+static thread_local bool cover_thread_exited = false;
+
+struct CoverThreadCounters
+{
+	std::vector<int> counters;
+
+	CoverThreadCounters() : counters(__stop_yosys_cover_list - __start_yosys_cover_list)
+	{
+		cover_lock_t lock;
+		all().push_back(this);
+	}
+
+	~CoverThreadCounters()
+	{
+		cover_lock_t lock;
+		for (int i = 0; i < GetSize(counters); i++)
+			__start_yosys_cover_list[i].counter += counters[i];
+		auto &threads = all();
+		threads.erase(std::find(threads.begin(), threads.end(), this));
+		cover_thread_counters = nullptr;
+		cover_thread_exited = true;
+	}
+
+	// the counters of the running threads, guarded by cover_mutex
+	static std::vector<CoverThreadCounters*> &all()
+	{
+		static std::vector<CoverThreadCounters*> *threads = new std::vector<CoverThreadCounters*>;
+		return *threads;
+	}
+};
+
+int *cover_counters_init()
+{
+	// hits in thread-local destructors that run after those of the counters
+	// are dropped
+	if (cover_thread_exited) {
+		static int *dropped = new int[__stop_yosys_cover_list - __start_yosys_cover_list];
+		return dropped;
+	}
+	static thread_local CoverThreadCounters thread_counters;
+	cover_thread_counters = thread_counters.counters.data();
+	return cover_thread_counters;
+}
+
 void cover_extra(std::string parent, std::string id, bool increment) {
+	cover_lock_t lock;
 	if (extra_coverage_data.count(id) == 0) {
 		for (CoverData *p = __start_yosys_cover_list; p != __stop_yosys_cover_list; p++)
 			if (p->id == parent)
@@ -770,11 +1124,21 @@ dict<std::string, std::pair<std::string, int>> get_coverage_data()
 		coverage_data[it.first].second += it.second.second;
 	}
 
+	std::vector<int> counters;
+	{
+		cover_lock_t lock;
+		for (CoverData *p = __start_yosys_cover_list; p != __stop_yosys_cover_list; p++)
+			counters.push_back(p->counter);
+		for (auto thread : CoverThreadCounters::all())
+			for (int i = 0; i < GetSize(counters); i++)
+				counters[i] += thread->counters[i];
+	}
+
 	for (CoverData *p = __start_yosys_cover_list; p != __stop_yosys_cover_list; p++) {
 		if (coverage_data.count(p->id))
 			log_warning("found duplicate coverage id \"%s\".\n", p->id);
 		coverage_data[p->id].first = stringf("%s:%d:%s", p->file, p->line, p->func);
-		coverage_data[p->id].second += p->counter;
+		coverage_data[p->id].second += counters[p - __start_yosys_cover_list];
 	}
 
 	for (auto &it : coverage_data)
@@ -94,11 +94,31 @@ YOSYS_NAMESPACE_BEGIN
 
 struct log_cmd_error_exception { };
 
+// A list of regexes that is matched as a whole: the patterns are compiled
+// into a single alternation on the first search after a change, so that a
+// message is scanned once no matter how many patterns there are.
+struct LogRegexList
+{
+	// Throws std::regex_error for an invalid pattern.
+	void add(const std::string &pattern);
+	void clear();
+	bool empty() const { return patterns.empty(); }
+	const std::vector<std::string> &get_patterns() const { return patterns; }
+
+	// True if any of the patterns matches a part of the text.
+	bool search(const std::string &text);
+
+private:
+	std::vector<std::string> patterns;
+	std::regex combined;
+	bool dirty = false;
+};
+
 extern std::vector<FILE*> log_files;
 extern std::vector<std::ostream*> log_streams;
 extern std::vector<std::string> log_scratchpads;
 extern std::map<std::string, std::set<std::string>> log_hdump;
-extern std::vector<std::regex> log_warn_regexes, log_nowarn_regexes, log_werror_regexes;
+extern LogRegexList log_warn_regexes, log_nowarn_regexes, log_werror_regexes;
 extern std::set<std::string> log_warnings, log_experimentals, log_experimentals_ignored;
 extern int log_warnings_count;
 extern int log_warnings_count_noexpect;
@@ -117,7 +137,7 @@ extern void (*log_error_atexit)();
 
 extern int log_make_debug;
 extern int log_force_debug;
-extern int log_debug_suppressed;
+extern thread_local int log_debug_suppressed;
 
 void logv(const char *format, va_list ap);
 void logv_header(RTLIL::Design *design, const char *format, va_list ap);
@@ -189,6 +209,40 @@ void log_backtrace(const char *prefix, int levels);
 void log_reset_stack();
 void log_flush();
 
+// Buffered logging ("yosys -a"): log_files are no longer flushed after every
+// message. With YOSYS_ENABLE_THREADS they are written by a background thread,
+// which log_flush() waits for. Output still in the buffer is lost if yosys
+// crashes, so this is off by default.
+void log_set_async(bool enable);
+
+// Log output recorded for a job running on a worker thread (see kernel/threading.h).
+// While a capture is active on the calling thread, messages, headers and
+// warnings are recorded instead of printed, and errors are recorded and then
+// raised as log_cmd_error_exception. replay() must be called from the main
+// thread and emits the recorded output (including any recorded error) in
+// order, numbering the headers at that point. When another capture is active
+// during replay(), that capture records the output. Captures may be nested,
+// end() makes the capture that was active before begin() active again.
+struct LogCapture
+{
+	enum EntryType { MessageEntry, HeaderEntry, WarningEntry, ExperimentalEntry, ErrorEntry, CmdErrorEntry };
+	struct Entry {
+		EntryType type;
+		std::string prefix, text;
+	};
+
+	std::vector<Entry> entries;
+	int debug_suppressed = 0;
+	LogCapture *outer = nullptr;
+	int outer_debug_suppressed = 0;
+
+	void begin();
+	void end();
+	void replay();
+
+	static bool active();
+};
+
 struct LogExpectedItem
 {
 	LogExpectedItem(const std::regex &pat, int expected) :
@@ -236,10 +290,21 @@ static inline void log_assert_worker(bool cond, const char *expr, const char *fi
 
 #if defined(YOSYS_ENABLE_COVER) && (defined(__linux__) || defined(__FreeBSD__))
 
+// Each thread counts the hits in its own array, indexed by the position of the
+// CoverData in the section, so that hot code does not write to cache lines
+// shared with other threads. The counts of a thread are added to
+// CoverData::counter when it exits, get_coverage_data() also adds those of
+// the running threads. Translation units compiled with YOSYS_COVER_DISABLE
+// (see COVER_DIRS in the Makefile) have no cover points.
+
+#ifndef YOSYS_COVER_DISABLE
 #define cover(_id) do { \
     static CoverData __d __attribute__((section("yosys_cover_list"), aligned(1), used)) = { __FILE__, __FUNCTION__, _id, __LINE__, 0 }; \
-    __d.counter++; \
+    cover_counters()[&__d - __start_yosys_cover_list]++; \
 } while (0)
+#else
+#  define cover(...) do { } while (0)
+#endif
 
 struct CoverData {
 	const char *file, *func, *id;
@@ -250,15 +315,28 @@ struct CoverData {
 extern "C" struct CoverData __start_yosys_cover_list[];
 extern "C" struct CoverData __stop_yosys_cover_list[];
 
+extern thread_local int *cover_thread_counters;
+int *cover_counters_init();
+
+static inline int *cover_counters()
+{
+	int *counters = cover_thread_counters;
+	return counters != nullptr ? counters : cover_counters_init();
+}
+
 extern dict<std::string, std::pair<std::string, int>> extra_coverage_data;
 
 void cover_extra(std::string parent, std::string id, bool increment = true);
 dict<std::string, std::pair<std::string, int>> get_coverage_data();
 
+#ifndef YOSYS_COVER_DISABLE
 #define cover_list(_id, ...) do { cover(_id); \
 	std::string r = cover_list_worker(_id, __VA_ARGS__); \
 	log_assert(r.empty()); \
 } while (0)
+#else
+#  define cover_list(...) do { } while (0)
+#endif
 
 static inline std::string cover_list_worker(std::string, std::string last) {
 	return last;
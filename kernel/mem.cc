@@ -445,8 +445,17 @@ Const Mem::get_init_data() const {
 		if (init.removed)
 			continue;
 		int offset = (init.addr.as_int() - start_offset) * width;
-		for (int i = 0; i < GetSize(init.data); i++)
-			if (0 <= i+offset && i+offset < GetSize(init_data) && init.en[i % width] == State::S1)
+		int begin = std::max(0, -offset);
+		int end = std::min(GetSize(init.data), GetSize(init_data) - offset);
+		if (begin >= end)
+			continue;
+		// most inits are fully enabled, copy those as a block
+		if (init.en.is_fully_ones()) {
+			std::copy(init.data.bits.begin() + begin, init.data.bits.begin() + end, init_data.bits.begin() + begin + offset);
+			continue;
+		}
+		for (int i = begin; i < end; i++)
+			if (init.en[i % width] == State::S1)
 				init_data.bits[i+offset] = init.data.bits[i];
 	}
 	return init_data;
@@ -704,25 +713,31 @@ namespace {
 		res.packed = true;
 		res.cell = cell;
 		res.attributes = cell->attributes;
-		Const &init = cell->parameters.at(ID::INIT);
+		const Const &init = cell->parameters.at(ID::INIT);
 		if (!init.is_fully_undef()) {
+			// scan the words in place, this runs on every read of the memory
+			auto word_undef = [&](int pos) {
+				int begin = std::min(pos * res.width, GetSize(init));
+				int end = std::min((pos + 1) * res.width, GetSize(init));
+				for (int i = begin; i < end; i++)
+					if (init.bits[i] != State::Sx && init.bits[i] != State::Sz)
+						return false;
+				return true;
+			};
 			int pos = 0;
 			while (pos < res.size) {
-				Const word = init.extract(pos * res.width, res.width, State::Sx);
-				if (word.is_fully_undef()) {
+				if (word_undef(pos)) {
 					pos++;
 				} else {
 					int epos;
-					for (epos = pos; epos < res.size; epos++) {
-						Const eword = init.extract(epos * res.width, res.width, State::Sx);
-						if (eword.is_fully_undef())
+					for (epos = pos + 1; epos < res.size; epos++)
+						if (word_undef(epos))
 							break;
-					}
 					MemInit minit;
 					minit.addr = res.start_offset + pos;
 					minit.data = init.extract(pos * res.width, (epos - pos) * res.width, State::Sx);
 					minit.en = RTLIL::Const(State::S1, res.width);
-					res.inits.push_back(minit);
+					res.inits.push_back(std::move(minit));
 					pos = epos;
 				}
 			}
@@ -0,0 +1,186 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/memlimit.h"
+#include "kernel/threading.h"
+#include <fstream>
+
+#ifdef __linux__
+#  include <unistd.h>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+static int64_t limit_from_env()
+{
+	const char *value = getenv("YOSYS_MEMLIMIT");
+	int64_t kb;
+	if (value == nullptr || *value == 0 || !MemLimit::parse_size(value, kb))
+		return 0;
+	return kb;
+}
+
+int64_t MemLimit::limit_kb = limit_from_env();
+
+// the growth of the resident set size summed over the calls of each pass
+static dict<std::string, int64_t> pass_growth_kb;
+// the passes that already reported their switch to a lower-memory strategy
+static pool<std::string> low_passes;
+
+int64_t MemLimit::rss_kb()
+{
+#ifdef __linux__
+	std::ifstream f("/proc/self/statm");
+	long long pages_total = 0, pages_resident = 0;
+	if (f >> pages_total >> pages_resident)
+		return pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+	return 0;
+}
+
+static int64_t attr_bytes(const RTLIL::AttrObject *obj)
+{
+	int64_t bytes = 0;
+	for (auto &it : obj->attributes)
+		bytes += 64 + it.second.size() / 8;
+	return bytes;
+}
+
+static int64_t sig_bytes(const RTLIL::SigSpec &sig)
+{
+	return sizeof(RTLIL::SigSpec) + GetSize(sig) * sizeof(RTLIL::SigBit);
+}
+
+int64_t MemLimit::module_bytes(const RTLIL::Module *module)
+{
+	int64_t bytes = sizeof(RTLIL::Module) + attr_bytes(module);
+	for (auto &it : module->wires_)
+		bytes += sizeof(RTLIL::Wire) + 64 + attr_bytes(it.second);
+	for (auto &it : module->cells_) {
+		RTLIL::Cell *cell = it.second;
+		bytes += sizeof(RTLIL::Cell) + 64 + attr_bytes(cell);
+		for (auto &conn : cell->connections())
+			bytes += 32 + sig_bytes(conn.second);
+		for (auto &param : cell->parameters)
+			bytes += 64 + param.second.size() / 8;
+	}
+	for (auto &conn : module->connections())
+		bytes += sig_bytes(conn.first) + sig_bytes(conn.second);
+	for (auto &it : module->memories)
+		bytes += sizeof(RTLIL::Memory) + attr_bytes(it.second);
+	for (auto &it : module->processes)
+		bytes += sizeof(RTLIL::Process) + attr_bytes(it.second);
+	return bytes;
+}
+
+bool MemLimit::low(const char *pass_name)
+{
+	if (limit_kb <= 0)
+		return false;
+	int64_t rss = rss_kb();
+	if (rss * 4 <= limit_kb * 3)
+		return false;
+	if (!yosys_in_worker_thread() && !low_passes.count(pass_name)) {
+		low_passes.insert(pass_name);
+		log("Using %lld of %lld MiB of the memory limit, %s switches to its lower-memory strategy.\n",
+				(long long)(rss / 1024), (long long)(limit_kb / 1024), pass_name);
+	}
+	return true;
+}
+
+void MemLimit::check(const char *pass_name, int64_t extra_kb, RTLIL::Design *design)
+{
+	if (limit_kb <= 0 || yosys_in_worker_thread())
+		return;
+	int64_t rss = rss_kb();
+	if (rss == 0 || rss + extra_kb <= limit_kb)
+		return;
+
+	log("\n");
+	if (extra_kb > 0)
+		log("Pass %s would need about %lld MiB more memory than the limit allows.\n", pass_name,
+				(long long)((rss + extra_kb - limit_kb) / 1024));
+	else
+		log("The memory usage exceeded the limit after pass %s.\n", pass_name);
+	log_report(design != nullptr ? design : yosys_design, 10);
+	log_error("Memory limit of %lld MiB exceeded in pass %s.\n", (long long)(limit_kb / 1024), pass_name);
+}
+
+void MemLimit::pass_done(const char *pass_name, int64_t begin_rss_kb, RTLIL::Design *design)
+{
+	if (limit_kb <= 0 || yosys_in_worker_thread())
+		return;
+	int64_t rss = rss_kb();
+	if (rss > begin_rss_kb)
+		pass_growth_kb[pass_name] += rss - begin_rss_kb;
+	check(pass_name, 0, design);
+}
+
+void MemLimit::log_report(RTLIL::Design *design, int count)
+{
+	int64_t rss = rss_kb();
+	log("Resident set size: %lld MiB", (long long)(rss / 1024));
+	if (limit_kb > 0)
+		log(" of a limit of %lld MiB", (long long)(limit_kb / 1024));
+	log("\n");
+
+	if (design != nullptr) {
+		std::vector<std::pair<int64_t, std::string>> modules;
+		int64_t total = 0;
+		for (auto module : design->modules()) {
+			int64_t bytes = module_bytes(module);
+			total += bytes;
+			modules.push_back(std::make_pair(-bytes, module->name.str()));
+		}
+		std::sort(modules.begin(), modules.end());
+		log("Estimated size of the RTLIL objects: %.1f MiB in %d modules\n", total / 1048576.0, GetSize(modules));
+		for (int i = 0; i < GetSize(modules) && i < count; i++)
+			log("  %10.1f MiB  %s\n", -modules[i].first / 1048576.0, log_id(modules[i].second));
+	}
+
+	if (!pass_growth_kb.empty()) {
+		std::vector<std::pair<int64_t, std::string>> passes;
+		for (auto &it : pass_growth_kb)
+			passes.push_back(std::make_pair(-it.second, it.first));
+		std::sort(passes.begin(), passes.end());
+		log("Passes that grew the process the most:\n");
+		for (int i = 0; i < GetSize(passes) && i < count; i++)
+			log("  %10.1f MiB  %s\n", -passes[i].first / 1024.0, passes[i].second.c_str());
+	}
+}
+
+bool MemLimit::parse_size(const std::string &text, int64_t &kb)
+{
+	char *end = nullptr;
+	double value = strtod(text.c_str(), &end);
+	if (end == text.c_str() || value < 0)
+		return false;
+	std::string unit = end;
+	if (unit.empty() || unit == "M" || unit == "m")
+		kb = value * 1024;
+	else if (unit == "K" || unit == "k")
+		kb = value;
+	else if (unit == "G" || unit == "g")
+		kb = value * 1024 * 1024;
+	else
+		return false;
+	return true;
+}
+
+YOSYS_NAMESPACE_END
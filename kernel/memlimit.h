@@ -0,0 +1,70 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+#ifndef MEMLIMIT_H
+#define MEMLIMIT_H
+
+YOSYS_NAMESPACE_BEGIN
+
+// Memory accounting and the optional memory limit, set by the "memlimit"
+// command or the YOSYS_MEMLIMIT environment variable. With a limit set,
+// Pass::post_execute() fails with a report of the largest modules and of the
+// passes that grew the process the most as soon as the resident set size
+// exceeds the limit. Passes with a memory-hungry optional strategy ask low()
+// and switch to a cheaper one when the limit is close.
+struct MemLimit
+{
+	// The limit in KiB, or 0 if there is none.
+	static int64_t limit_kb;
+
+	// The current resident set size of the process in KiB, or 0 where it
+	// can't be determined (which disables the limit).
+	static int64_t rss_kb();
+
+	// An estimate of the memory taken by the RTLIL objects of a module, in
+	// bytes. It counts the objects and the bits of their signals, not the
+	// exact allocations.
+	static int64_t module_bytes(const RTLIL::Module *module);
+
+	// True if a limit is set and more than three quarters of it are in use.
+	// The first switch to the lower-memory strategy of a pass is logged.
+	static bool low(const char *pass_name);
+
+	// Fails with a report if the process, together with the given number of
+	// KiB the caller is about to allocate, exceeds the limit.
+	static void check(const char *pass_name, int64_t extra_kb = 0, RTLIL::Design *design = nullptr);
+
+	// Called by Pass::post_execute(), records the growth of the process
+	// during the pass and then runs check().
+	static void pass_done(const char *pass_name, int64_t begin_rss_kb, RTLIL::Design *design);
+
+	// Logs the usage, the limit, the given number of largest modules and the
+	// passes that grew the process the most.
+	static void log_report(RTLIL::Design *design, int count);
+
+	// Parses sizes like "4096", "512M" or "16G" (KiB, MiB, GiB; plain numbers
+	// are MiB) into KiB.
+	static bool parse_size(const std::string &text, int64_t &kb);
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
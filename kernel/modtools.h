@@ -24,8 +24,81 @@
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
 
+#include <mutex>
+
 YOSYS_NAMESPACE_BEGIN
 
+// A SigMap for a module that follows the changes to the module instead of
+// being rebuilt by every user. Connections added with module->connect()
+// are merged into the map as they are made. Changes that can't be applied
+// to the union-find structure (new_connections(), removing wires, blackout)
+// mark the map as stale, and it is rebuilt on the next call to sigmap().
+//
+// Code that modifies module->connections_ directly bypasses the monitor
+// and must call invalidate() itself.
+struct ModSigMap : public RTLIL::Monitor
+{
+	RTLIL::Module *module;
+
+	ModSigMap(RTLIL::Module *module) : module(module), stale(true), rebuild_count(0)
+	{
+		module->monitors.insert(this);
+	}
+
+	~ModSigMap()
+	{
+		module->monitors.erase(this);
+	}
+
+	const SigMap &sigmap()
+	{
+		if (stale) {
+			map.set(module);
+			stale = false;
+			rebuild_count++;
+		}
+		return map;
+	}
+
+	void invalidate() { stale = true; }
+	int rebuilds() const { return rebuild_count; }
+
+	// only ever notified about changes to its own module
+	bool thread_safe() const override { return true; }
+
+	void notify_connect(RTLIL::Module *mod, const RTLIL::SigSig &sigsig) override
+	{
+		log_assert(module == mod);
+		// Module::connect() drops bits with a constant on the left hand
+		// side and notifies again for the remaining bits.
+		if (!stale && !sigsig.first.has_const())
+			map.add(sigsig.first, sigsig.second);
+	}
+
+	void notify_connect(RTLIL::Module *mod, const std::vector<RTLIL::SigSig>&) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+	void notify_blackout(RTLIL::Module *mod) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+	void notify_remove(RTLIL::Module *mod, const pool<RTLIL::Wire*>&) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+private:
+	SigMap map;
+	bool stale;
+	int rebuild_count;
+};
+
 struct ModIndex : public RTLIL::Monitor
 {
 	struct PortInfo {
@@ -220,12 +293,35 @@ struct ModIndex : public RTLIL::Monitor
 		auto_reload_module = true;
 	}
 
+	void notify_batch(RTLIL::Module *mod, const pool<RTLIL::Cell*> &added_cells,
+			const std::vector<RTLIL::Cell*> &removed_cells, const std::vector<RTLIL::SigSig> &connections) override
+	{
+		log_assert(module == mod);
+
+		if (auto_reload_module)
+			return;
+
+		// reloading is cheaper than updating the index for most of the module
+		if (4 * (GetSize(added_cells) + GetSize(removed_cells)) > GetSize(module->cells_)) {
+			auto_reload_module = true;
+			return;
+		}
+
+		RTLIL::Monitor::notify_batch(mod, added_cells, removed_cells, connections);
+	}
+
 	void notify_blackout(RTLIL::Module *mod) override
 	{
 		log_assert(module == mod);
 		auto_reload_module = true;
 	}
 
+	void notify_remove(RTLIL::Module *mod, const pool<RTLIL::Wire*>&) override
+	{
+		log_assert(module == mod);
+		auto_reload_module = true;
+	}
+
 	ModIndex(RTLIL::Module *_m) : sigmap(_m), module(_m)
 	{
 		auto_reload_counter = 0;
@@ -238,6 +334,8 @@ struct ModIndex : public RTLIL::Monitor
 		module->monitors.erase(this);
 	}
 
+	bool thread_safe() const override { return true; }
+
 	SigBitInfo *query(RTLIL::SigBit bit)
 	{
 		if (auto_reload_module)
@@ -297,6 +395,337 @@ struct ModIndex : public RTLIL::Monitor
 	}
 };
 
+// The FF bits of a module for the passes that merge FFs into other cells
+// (see FfMergeHelper): for every sigmapped bit, the FF bit driving it, the
+// FF bits reading it at their D input and the number of its users (cell
+// inputs and output ports). Follows the changes to the module like
+// ModIndex; changes of a cell's type in place are not seen.
+struct ModFfIndex : public RTLIL::Monitor
+{
+	typedef std::pair<RTLIL::Cell*, int> cell_int_t;
+
+	RTLIL::Module *module;
+
+	ModFfIndex(RTLIL::Module *module) : module(module), stale(true), reload_count(0)
+	{
+		module->monitors.insert(this);
+	}
+
+	~ModFfIndex()
+	{
+		module->monitors.erase(this);
+	}
+
+	const SigMap &sigmap()
+	{
+		if (stale)
+			reload();
+		return map;
+	}
+
+	// Returns the FF bit driving bit, or nullptr.
+	const cell_int_t *driver(RTLIL::SigBit bit)
+	{
+		auto it = dff_driver.find(sigmap()(bit));
+		return it == dff_driver.end() ? nullptr : &it->second;
+	}
+
+	const pool<cell_int_t> &sinks(RTLIL::SigBit bit)
+	{
+		static const pool<cell_int_t> empty_result_set;
+		auto it = dff_sink.find(sigmap()(bit));
+		return it == dff_sink.end() ? empty_result_set : it->second;
+	}
+
+	int users(RTLIL::SigBit bit)
+	{
+		auto it = users_count.find(sigmap()(bit));
+		return it == users_count.end() ? 0 : it->second;
+	}
+
+	void invalidate() { stale = true; }
+	int reloads() const { return reload_count; }
+
+	bool thread_safe() const override { return true; }
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &port, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override
+	{
+		log_assert(module == cell->module);
+		if (stale)
+			return;
+		port_del(cell, port, old_sig);
+		port_add(cell, port, sig);
+	}
+
+	void notify_connect(RTLIL::Module *mod, const RTLIL::SigSig &sigsig) override
+	{
+		log_assert(module == mod);
+		// Module::connect() drops bits with a constant on the left hand
+		// side and notifies again for the remaining bits.
+		if (stale || sigsig.first.has_const())
+			return;
+
+		for (int i = 0; i < GetSize(sigsig.first); i++)
+		{
+			RTLIL::SigBit lhs = map(sigsig.first[i]);
+			RTLIL::SigBit rhs = map(sigsig.second[i]);
+			if (lhs == rhs)
+				continue;
+			map.add(lhs, rhs);
+			RTLIL::SigBit bit = map(lhs);
+			merge_bit(bit, bit == lhs ? rhs : lhs);
+		}
+	}
+
+	void notify_connect(RTLIL::Module *mod, const std::vector<RTLIL::SigSig>&) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+	void notify_batch(RTLIL::Module *mod, const pool<RTLIL::Cell*> &added_cells,
+			const std::vector<RTLIL::Cell*> &removed_cells, const std::vector<RTLIL::SigSig> &connections) override
+	{
+		log_assert(module == mod);
+
+		if (stale)
+			return;
+
+		// reloading is cheaper than updating the index for most of the module
+		if (4 * (GetSize(added_cells) + GetSize(removed_cells)) > GetSize(module->cells_)) {
+			stale = true;
+			return;
+		}
+
+		RTLIL::Monitor::notify_batch(mod, added_cells, removed_cells, connections);
+	}
+
+	void notify_blackout(RTLIL::Module *mod) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+	void notify_remove(RTLIL::Module *mod, const pool<RTLIL::Wire*>&) override
+	{
+		log_assert(module == mod);
+		stale = true;
+	}
+
+private:
+	SigMap map;
+	dict<RTLIL::SigBit, cell_int_t> dff_driver;
+	dict<RTLIL::SigBit, pool<cell_int_t>> dff_sink;
+	dict<RTLIL::SigBit, int> users_count;
+	bool stale;
+	int reload_count;
+
+	void port_add(RTLIL::Cell *cell, RTLIL::IdString port, const RTLIL::SigSpec &sig)
+	{
+		bool is_ff = RTLIL::builtin_ff_cell_types().count(cell->type);
+		bool is_user = !cell->known() || cell->input(port);
+		for (int i = 0; i < GetSize(sig); i++) {
+			RTLIL::SigBit bit = map(sig[i]);
+			if (is_ff && port == ID::D)
+				dff_sink[bit].insert(cell_int_t(cell, i));
+			if (is_ff && port == ID::Q)
+				dff_driver[bit] = cell_int_t(cell, i);
+			if (is_user)
+				users_count[bit]++;
+		}
+	}
+
+	void port_del(RTLIL::Cell *cell, RTLIL::IdString port, const RTLIL::SigSpec &sig)
+	{
+		bool is_ff = RTLIL::builtin_ff_cell_types().count(cell->type);
+		bool is_user = !cell->known() || cell->input(port);
+		for (int i = 0; i < GetSize(sig); i++) {
+			RTLIL::SigBit bit = map(sig[i]);
+			if (is_ff && port == ID::D) {
+				auto it = dff_sink.find(bit);
+				if (it != dff_sink.end()) {
+					it->second.erase(cell_int_t(cell, i));
+					if (it->second.empty())
+						dff_sink.erase(it);
+				}
+			}
+			if (is_ff && port == ID::Q) {
+				auto it = dff_driver.find(bit);
+				if (it != dff_driver.end() && it->second == cell_int_t(cell, i))
+					dff_driver.erase(it);
+			}
+			if (is_user) {
+				auto it = users_count.find(bit);
+				if (it != users_count.end() && --it->second == 0)
+					users_count.erase(it);
+			}
+		}
+	}
+
+	// moves the entries of other, which was just connected to bit, to bit
+	void merge_bit(RTLIL::SigBit bit, RTLIL::SigBit other)
+	{
+		auto driver_it = dff_driver.find(other);
+		if (driver_it != dff_driver.end()) {
+			if (!dff_driver.count(bit))
+				dff_driver[bit] = driver_it->second;
+			dff_driver.erase(other);
+		}
+
+		auto sink_it = dff_sink.find(other);
+		if (sink_it != dff_sink.end()) {
+			pool<cell_int_t> sinks = std::move(sink_it->second);
+			dff_sink.erase(sink_it);
+			for (auto &it : sinks)
+				dff_sink[bit].insert(it);
+		}
+
+		auto users_it = users_count.find(other);
+		if (users_it != users_count.end()) {
+			int count = users_it->second;
+			users_count.erase(users_it);
+			users_count[bit] += count;
+		}
+	}
+
+	void reload()
+	{
+		map.set(module);
+		dff_driver.clear();
+		dff_sink.clear();
+		users_count.clear();
+
+		for (auto wire : module->wires())
+			if (wire->port_output)
+				for (auto bit : map(wire))
+					users_count[bit]++;
+
+		for (auto cell : module->cells())
+			for (auto &conn : cell->connections())
+				port_add(cell, conn.first, conn.second);
+
+		stale = false;
+		reload_count++;
+	}
+};
+
+// Keeps the ModSigMap, ModIndex and ModFfIndex of each module alive across
+// pass invocations, so that a sequence of passes doesn't rebuild them for
+// every module over and over again. They are created on first use and follow
+// the changes to their module as monitors. Modules that are removed from
+// the design are dropped from the cache.
+//
+// The cached data can only be trusted while the design is changed through
+// the interfaces that notify monitors. The cache is therefore only active
+// within the lifetime of a ModCache object, e.g. in the loop of the `opt`
+// pass. Code that rewrites connections in place (like opt_clean) must call
+// invalidate() for the modules it touched.
+struct ModCache : public RTLIL::Monitor
+{
+	RTLIL::Design *design;
+
+	ModCache(RTLIL::Design *design) : design(design)
+	{
+		design->monitors.insert(this);
+	}
+
+	~ModCache()
+	{
+		design->monitors.erase(this);
+	}
+
+	// Returns the active cache of the design, or nullptr.
+	static ModCache *find(RTLIL::Design *design)
+	{
+		if (design == nullptr)
+			return nullptr;
+		for (auto mon : design->monitors) {
+			ModCache *cache = dynamic_cast<ModCache*>(mon);
+			if (cache != nullptr)
+				return cache;
+		}
+		return nullptr;
+	}
+
+	// Returns a SigMap of the module that the caller may extend: a copy of
+	// the cached map if a cache is active, otherwise a newly built one.
+	static SigMap get_sigmap(RTLIL::Module *module)
+	{
+		ModCache *cache = find(module->design);
+		if (cache == nullptr)
+			return SigMap(module);
+		return cache->sigmap(module).sigmap();
+	}
+
+	ModSigMap &sigmap(RTLIL::Module *module)
+	{
+		Entry &entry = lookup(module);
+		if (entry.sigmap == nullptr)
+			entry.sigmap.reset(new ModSigMap(module));
+		return *entry.sigmap;
+	}
+
+	ModIndex &index(RTLIL::Module *module)
+	{
+		Entry &entry = lookup(module);
+		if (entry.index == nullptr)
+			entry.index.reset(new ModIndex(module));
+		return *entry.index;
+	}
+
+	ModFfIndex &ff_index(RTLIL::Module *module)
+	{
+		Entry &entry = lookup(module);
+		if (entry.ff_index == nullptr)
+			entry.ff_index.reset(new ModFfIndex(module));
+		return *entry.ff_index;
+	}
+
+	void invalidate(RTLIL::Module *module)
+	{
+		Entry &entry = lookup(module);
+		if (entry.sigmap != nullptr)
+			entry.sigmap->invalidate();
+		entry.index.reset();
+		if (entry.ff_index != nullptr)
+			entry.ff_index->invalidate();
+	}
+
+	// Entries are only created and used by the thread that works on the
+	// module, the map of entries itself is protected by a mutex.
+	bool thread_safe() const override { return true; }
+
+	void notify_module_del(RTLIL::Module *module) override
+	{
+		lock_t lock(mutex);
+		entries.erase(module);
+	}
+
+private:
+	struct Entry {
+		std::unique_ptr<ModSigMap> sigmap;
+		std::unique_ptr<ModIndex> index;
+		std::unique_ptr<ModFfIndex> ff_index;
+	};
+
+#ifdef YOSYS_ENABLE_THREADS
+	typedef std::mutex mutex_t;
+#else
+	struct mutex_t { void lock() { } void unlock() { } };
+#endif
+	typedef std::lock_guard<mutex_t> lock_t;
+
+	// std::map, because entries must not move while other threads insert
+	std::map<RTLIL::Module*, Entry> entries;
+	mutex_t mutex;
+
+	Entry &lookup(RTLIL::Module *module)
+	{
+		lock_t lock(mutex);
+		return entries[module];
+	}
+};
+
 struct ModWalker
 {
 	struct PortBit
@@ -328,9 +757,9 @@ struct ModWalker
 	CellTypes ct;
 	SigMap sigmap;
 
-	dict<RTLIL::SigBit, pool<PortBit>> signal_drivers;
-	dict<RTLIL::SigBit, pool<PortBit>> signal_consumers;
-	pool<RTLIL::SigBit> signal_inputs, signal_outputs;
+	flat_dict<RTLIL::SigBit, pool<PortBit>> signal_drivers;
+	flat_dict<RTLIL::SigBit, pool<PortBit>> signal_consumers;
+	flat_pool<RTLIL::SigBit> signal_inputs, signal_outputs;
 
 	dict<RTLIL::Cell*, pool<RTLIL::SigBit>> cell_outputs, cell_inputs;
 
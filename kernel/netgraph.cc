@@ -0,0 +1,275 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// [[CITE]] Tarjan's strongly connected components algorithm
+// Tarjan, R. E. (1972), "Depth-first search and linear graph algorithms", SIAM Journal on Computing 1 (2): 146-160, doi:10.1137/0201010
+
+#include "kernel/netgraph.h"
+#include "kernel/celledges.h"
+#include <queue>
+
+YOSYS_NAMESPACE_BEGIN
+
+void NetGraph::add_edge(int from, int to, int label)
+{
+	log_assert(0 <= from && from < num_nodes_);
+	log_assert(0 <= to && to < num_nodes_);
+	pending_.emplace_back(from, to, label);
+}
+
+void NetGraph::build()
+{
+	// merge the new edges with the ones already built
+	for (int n = 0; n+1 < GetSize(edge_begin); n++)
+		for (int e = edge_begin[n]; e < edge_begin[n+1]; e++)
+			pending_.emplace_back(n, edge_to[e], edge_label[e]);
+
+	// stable, so that the first label of parallel edges is kept
+	std::stable_sort(pending_.begin(), pending_.end(), [](const std::tuple<int, int, int> &a, const std::tuple<int, int, int> &b) {
+		return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) < std::get<0>(b) : std::get<1>(a) < std::get<1>(b);
+	});
+
+	edge_begin.assign(num_nodes_ + 1, 0);
+	edge_to.clear();
+	edge_label.clear();
+	edge_to.reserve(pending_.size());
+	edge_label.reserve(pending_.size());
+
+	for (int i = 0; i < GetSize(pending_); i++) {
+		int from = std::get<0>(pending_[i]), to = std::get<1>(pending_[i]);
+		if (i > 0 && std::get<0>(pending_[i-1]) == from && std::get<1>(pending_[i-1]) == to)
+			continue;
+		edge_begin[from+1]++;
+		edge_to.push_back(to);
+		edge_label.push_back(std::get<2>(pending_[i]));
+	}
+
+	for (int n = 0; n < num_nodes_; n++)
+		edge_begin[n+1] += edge_begin[n];
+
+	pending_.clear();
+	pending_.shrink_to_fit();
+}
+
+int NetGraph::edge_source(int edge) const
+{
+	log_assert(0 <= edge && edge < num_edges());
+	return std::upper_bound(edge_begin.begin(), edge_begin.end(), edge) - edge_begin.begin() - 1;
+}
+
+int NetGraph::scc(std::vector<int> &component) const
+{
+	log_assert(GetSize(edge_begin) == num_nodes_ + 1);
+
+	std::vector<int> index(num_nodes_, -1), lowlink(num_nodes_);
+	std::vector<bool> on_stack(num_nodes_);
+	std::vector<int> stack;
+	// the explicit call stack: the node and its next edge
+	std::vector<std::pair<int, int>> calls;
+	int counter = 0, num_components = 0;
+
+	component.assign(num_nodes_, -1);
+
+	for (int root = 0; root < num_nodes_; root++)
+	{
+		if (index[root] >= 0)
+			continue;
+
+		index[root] = lowlink[root] = counter++;
+		stack.push_back(root);
+		on_stack[root] = true;
+		calls.emplace_back(root, edge_begin[root]);
+
+		while (!calls.empty())
+		{
+			int node = calls.back().first;
+			int edge = calls.back().second;
+
+			if (edge < edge_begin[node+1]) {
+				calls.back().second++;
+				int next = edge_to[edge];
+				if (index[next] < 0) {
+					index[next] = lowlink[next] = counter++;
+					stack.push_back(next);
+					on_stack[next] = true;
+					calls.emplace_back(next, edge_begin[next]);
+				} else if (on_stack[next])
+					lowlink[node] = std::min(lowlink[node], index[next]);
+				continue;
+			}
+
+			calls.pop_back();
+			if (!calls.empty()) {
+				int parent = calls.back().first;
+				lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+			}
+
+			if (lowlink[node] == index[node]) {
+				int member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					on_stack[member] = false;
+					component[member] = num_components;
+				} while (member != node);
+				num_components++;
+			}
+		}
+	}
+
+	return num_components;
+}
+
+std::vector<bool> NetGraph::on_cycle(const std::vector<int> &component) const
+{
+	std::vector<int> size(num_nodes_);
+	for (int n = 0; n < num_nodes_; n++)
+		size[component[n]]++;
+
+	std::vector<bool> result(num_nodes_);
+	for (int n = 0; n < num_nodes_; n++) {
+		result[n] = size[component[n]] > 1;
+		for (int e = edge_begin[n]; e < edge_begin[n+1] && !result[n]; e++)
+			if (edge_to[e] == n)
+				result[n] = true;
+	}
+	return result;
+}
+
+bool NetGraph::topo_order(std::vector<int> &order) const
+{
+	log_assert(GetSize(edge_begin) == num_nodes_ + 1);
+
+	std::vector<int> in_degree(num_nodes_);
+	for (int to : edge_to)
+		in_degree[to]++;
+
+	// a min-heap keeps the order independent of the order of the edges
+	std::priority_queue<int, std::vector<int>, std::greater<int>> ready;
+	for (int n = 0; n < num_nodes_; n++)
+		if (in_degree[n] == 0)
+			ready.push(n);
+
+	order.clear();
+	order.reserve(num_nodes_);
+	while (!ready.empty()) {
+		int node = ready.top();
+		ready.pop();
+		order.push_back(node);
+		for (int e = edge_begin[node]; e < edge_begin[node+1]; e++)
+			if (--in_degree[edge_to[e]] == 0)
+				ready.push(edge_to[e]);
+	}
+
+	return GetSize(order) == num_nodes_;
+}
+
+int NetGraph::longest_path(std::vector<int> &level, std::vector<int> &pred_edge) const
+{
+	std::vector<int> component;
+	int num_components = scc(component);
+
+	// visit the nodes by component in topological order, i.e. from the
+	// highest component number to the lowest
+	std::vector<int> start(num_components + 1), nodes(num_nodes_);
+	for (int n = 0; n < num_nodes_; n++)
+		start[num_components - component[n]]++;
+	for (int c = 0; c < num_components; c++)
+		start[c+1] += start[c];
+	for (int n = 0; n < num_nodes_; n++)
+		nodes[start[num_components - 1 - component[n]]++] = n;
+
+	level.assign(num_nodes_, 0);
+	pred_edge.assign(num_nodes_, -1);
+
+	int max_level = num_nodes_ > 0 ? 0 : -1;
+	for (int node : nodes)
+		for (int e = edge_begin[node]; e < edge_begin[node+1]; e++) {
+			int next = edge_to[e];
+			if (component[next] == component[node] || level[node] + 1 <= level[next])
+				continue;
+			level[next] = level[node] + 1;
+			pred_edge[next] = e;
+			max_level = std::max(max_level, level[next]);
+		}
+
+	return max_level;
+}
+
+int SigBitGraph::node(RTLIL::SigBit bit)
+{
+	bit = sigmap(bit);
+	if (bit.wire == nullptr)
+		return -1;
+	int index = bits(bit);
+	while (num_nodes() <= index)
+		add_node();
+	return index;
+}
+
+namespace {
+	struct SigBitGraphEdges : AbstractCellEdgesDatabase
+	{
+		SigBitGraph &graph;
+		int label;
+		SigBitGraphEdges(SigBitGraph &graph, int label) : graph(graph), label(label) { }
+
+		void add_edge(RTLIL::Cell *cell, RTLIL::IdString from_port, int from_bit, RTLIL::IdString to_port, int to_bit, int) override {
+			int from = graph.node(cell->getPort(from_port)[from_bit]);
+			int to = graph.node(cell->getPort(to_port)[to_bit]);
+			if (from >= 0 && to >= 0)
+				graph.add_edge(from, to, label);
+		}
+	};
+}
+
+void SigBitGraph::add_cell(RTLIL::Cell *cell, bool exact)
+{
+	int label = GetSize(cells);
+	cells.push_back(cell);
+
+	if (exact) {
+		SigBitGraphEdges edges(*this, label);
+		if (edges.add_edges_from_cell(cell))
+			return;
+	}
+
+	std::vector<int> src_nodes, dst_nodes;
+	for (auto &conn : cell->connections())
+		for (auto bit : conn.second) {
+			int n = node(bit);
+			if (n < 0)
+				continue;
+			if (cell->input(conn.first))
+				src_nodes.push_back(n);
+			if (cell->output(conn.first))
+				dst_nodes.push_back(n);
+		}
+
+	std::sort(src_nodes.begin(), src_nodes.end());
+	src_nodes.erase(std::unique(src_nodes.begin(), src_nodes.end()), src_nodes.end());
+	std::sort(dst_nodes.begin(), dst_nodes.end());
+	dst_nodes.erase(std::unique(dst_nodes.begin(), dst_nodes.end()), dst_nodes.end());
+
+	for (int s : src_nodes)
+		for (int d : dst_nodes)
+			add_edge(s, d, label);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,104 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef NETGRAPH_H
+#define NETGRAPH_H
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+#include "kernel/celltypes.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// A directed graph over the nodes 0..N-1, with the outgoing edges of each
+// node stored in compressed sparse row form. Edges are collected with
+// add_edge() and arranged by build(), which must be called before the edges
+// are used. Each edge carries an integer label, e.g. the index of the cell
+// it goes through. The algorithms do not recurse, so they work on graphs of
+// any depth.
+struct NetGraph
+{
+	// the edges of node n are edge_to[edge_begin[n]] .. edge_to[edge_begin[n+1]-1]
+	std::vector<int> edge_begin, edge_to, edge_label;
+
+	NetGraph(int num_nodes = 0) : num_nodes_(num_nodes) { }
+
+	int add_node() { return num_nodes_++; }
+	int num_nodes() const { return num_nodes_; }
+	int num_edges() const { return GetSize(edge_to); }
+
+	// Parallel edges are merged by build(), keeping the label of the edge
+	// added first.
+	void add_edge(int from, int to, int label = -1);
+	void build();
+
+	// the node an edge comes from
+	int edge_source(int edge) const;
+
+	// Strongly connected components (Tarjan). Returns the number of
+	// components and sets component[n] for each node. The components are
+	// numbered in reverse topological order: edges between components go
+	// from higher to lower numbers.
+	int scc(std::vector<int> &component) const;
+
+	// Whether a node is on a cycle, i.e. in a component with more than one
+	// node or with an edge to itself.
+	std::vector<bool> on_cycle(const std::vector<int> &component) const;
+
+	// Topological order (Kahn), with ties broken by node id. Returns false
+	// if the graph has cycles, in which case the order only contains the
+	// nodes that are neither on nor behind a cycle.
+	bool topo_order(std::vector<int> &order) const;
+
+	// Longest paths: level[n] is the number of edges on the longest path
+	// ending at n and pred_edge[n] the last edge of that path, or -1. Edges
+	// within a strongly connected component are ignored, so the result is
+	// defined for cyclic graphs too. Returns the maximum level, or -1 for an
+	// empty graph.
+	int longest_path(std::vector<int> &level, std::vector<int> &pred_edge) const;
+
+private:
+	int num_nodes_;
+	std::vector<std::tuple<int, int, int>> pending_;
+};
+
+// The graph of the paths through the cells of a module, with one node per
+// sigmapped bit and the cell index as edge label. The edges go from input to
+// output ports; with exact=true they are taken from the cell edge database
+// in kernel/celledges.h where it knows the cell type, and otherwise every
+// input bit of a cell is connected to every output bit.
+struct SigBitGraph : NetGraph
+{
+	SigMap sigmap;
+	idict<RTLIL::SigBit> bits;
+	std::vector<RTLIL::Cell*> cells;
+
+	SigBitGraph(RTLIL::Module *module) : sigmap(module) { }
+
+	// Returns the node of a bit, adding it if needed, or -1 for constants.
+	int node(RTLIL::SigBit bit);
+	void add_cell(RTLIL::Cell *cell, bool exact = false);
+
+	RTLIL::SigBit bit(int node) const { return bits[node]; }
+	RTLIL::Cell *cell(int edge) const { return edge_label[edge] < 0 ? nullptr : cells[edge_label[edge]]; }
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
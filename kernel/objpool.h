@@ -0,0 +1,124 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+#ifndef OBJPOOL_H
+#define OBJPOOL_H
+
+// Builds with address sanitizer bypass the pools, so that use-after-free
+// of pooled objects is still detected.
+#if defined(__SANITIZE_ADDRESS__)
+#  define YOSYS_NO_OBJPOOL
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define YOSYS_NO_OBJPOOL
+#  endif
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+// ------------------------------------------------
+// Storage for many objects of the same type that share an owner
+// ------------------------------------------------
+//
+// Memory is requested from the system in blocks of growing size. Freed
+// slots go to a free list and are reused by later allocations. Blocks are
+// only returned when the pool is destroyed, so an owner that destroys all
+// its objects (e.g. a module being deleted) can release everything at once.
+//
+// The pool only hands out raw storage: objects are constructed with
+// placement new and must be destroyed explicitly before the slot is passed
+// to deallocate() or the pool goes away. A pool must only be used by one
+// thread at a time.
+
+template<typename T>
+struct ObjectPool
+{
+private:
+	union Slot {
+		Slot *next;
+		alignas(T) char storage[sizeof(T)];
+	};
+
+	enum { min_block_size = 16, max_block_size = 4096 };
+
+	std::vector<Slot*> blocks;
+	Slot *free_list = nullptr;
+	int next_block_size = min_block_size;
+
+	void grow()
+	{
+		Slot *block = static_cast<Slot*>(::operator new(sizeof(Slot) * next_block_size));
+		blocks.push_back(block);
+		for (int i = next_block_size-1; i >= 0; i--) {
+			block[i].next = free_list;
+			free_list = &block[i];
+		}
+		next_block_size = std::min(2 * next_block_size, int(max_block_size));
+	}
+
+public:
+	ObjectPool() { }
+	ObjectPool(const ObjectPool &other) = delete;
+	void operator=(const ObjectPool &other) = delete;
+
+	~ObjectPool()
+	{
+		for (auto block : blocks)
+			::operator delete(block);
+	}
+
+	void *allocate()
+	{
+#ifdef YOSYS_NO_OBJPOOL
+		return ::operator new(sizeof(T));
+#else
+		if (free_list == nullptr)
+			grow();
+		Slot *slot = free_list;
+		free_list = slot->next;
+		return slot;
+#endif
+	}
+
+	void deallocate(void *ptr)
+	{
+#ifdef YOSYS_NO_OBJPOOL
+		::operator delete(ptr);
+#else
+		Slot *slot = static_cast<Slot*>(ptr);
+		slot->next = free_list;
+		free_list = slot;
+#endif
+	}
+
+	// Number of objects that fit into the blocks allocated so far
+	size_t capacity() const
+	{
+		size_t count = 0;
+		for (int i = 0, sz = min_block_size; i < GetSize(blocks); i++, sz = std::min(2 * sz, int(max_block_size)))
+			count += sz;
+		return count;
+	}
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
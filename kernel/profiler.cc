@@ -0,0 +1,513 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/profiler.h"
+#include "kernel/threading.h"
+#include "kernel/json.h"
+#include <chrono>
+#include <fstream>
+#ifdef YOSYS_ENABLE_THREADS
+#  include <mutex>
+#  include <thread>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+// YOSYS_PROFILE_MODULES=1 reports the 10 slowest modules of each pass,
+// larger values report that many modules.
+static int module_top_from_env()
+{
+	const char *value = getenv("YOSYS_PROFILE_MODULES");
+	if (value == nullptr || *value == 0 || !strcmp(value, "0"))
+		return 0;
+	int count = atoi(value);
+	return count > 1 ? count : 10;
+}
+
+// YOSYS_PROFILE_ZONES=1 records trace zones and writes those that take at
+// least 10 us as trace events, larger values set that minimum in us.
+static int64_t zone_min_ns_from_env()
+{
+	const char *value = getenv("YOSYS_PROFILE_ZONES");
+	if (value == nullptr || *value == 0 || !strcmp(value, "0"))
+		return -1;
+	int min_us = atoi(value);
+	return 1000 * int64_t(min_us > 1 ? min_us : 10);
+}
+
+int PassProfiler::module_top = module_top_from_env();
+bool PassProfiler::enabled = PassProfiler::module_top > 0;
+std::vector<PassProfiler::node_t> PassProfiler::nodes;
+int64_t PassProfiler::zone_min_ns = zone_min_ns_from_env();
+bool PassProfiler::zones_enabled = PassProfiler::zone_min_ns >= 0;
+
+// the innermost running pass
+static int current_node = -1;
+
+static int64_t wall_time_ns()
+{
+	static auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int64_t peak_rss_kb()
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		return ru.ru_maxrss;
+#elif defined(__APPLE__)
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		return ru.ru_maxrss / 1024;
+#endif
+	return 0;
+}
+
+static void count_objects(RTLIL::Design *design, int &cells, int &wires)
+{
+	cells = 0, wires = 0;
+	if (design == nullptr)
+		return;
+	for (auto module : design->modules()) {
+		cells += GetSize(module->cells());
+		wires += GetSize(module->wires());
+	}
+}
+
+int PassProfiler::begin(const std::string &name, const std::vector<std::string> &args, RTLIL::Design *design)
+{
+	if (!enabled || yosys_in_worker_thread())
+		return -1;
+
+	node_t node;
+	node.name = name;
+	node.command = name;
+	for (int i = 1; i < GetSize(args); i++)
+		node.command += " " + args[i];
+	node.parent = current_node;
+	node.design = design;
+	node.begin_ns = wall_time_ns();
+	node.wall_ns = -1;
+	node.cpu_ns = 0;
+	node.peak_rss_kb = 0;
+	node.cells_delta = 0;
+	node.wires_delta = 0;
+	node.begin_cpu_ns = PerformanceTimer::query();
+	node.begin_peak_rss_kb = peak_rss_kb();
+	count_objects(design, node.begin_cells, node.begin_wires);
+
+	current_node = GetSize(nodes);
+	nodes.push_back(node);
+	return current_node;
+}
+
+void PassProfiler::end(int index)
+{
+	// the nodes may have been cleared by "profile -start" in the meantime
+	if (index < 0 || index >= GetSize(nodes))
+		return;
+
+	node_t &node = nodes[index];
+	node.wall_ns = wall_time_ns() - node.begin_ns;
+	node.cpu_ns = PerformanceTimer::query() - node.begin_cpu_ns;
+	node.peak_rss_kb = peak_rss_kb() - node.begin_peak_rss_kb;
+	int cells, wires;
+	count_objects(node.design, cells, wires);
+	node.cells_delta = cells - node.begin_cells;
+	node.wires_delta = wires - node.begin_wires;
+	current_node = node.parent;
+
+	if (module_top > 0 && !node.module_ns.empty())
+		log_top_modules(node);
+}
+
+struct zone_event_t
+{
+	const char *name;
+	int tid;
+	int64_t begin_ns, dur_ns;
+};
+
+struct zone_stats_t
+{
+	const char *name;
+	int64_t count, total_ns, max_ns;
+};
+
+struct zone_data_t
+{
+	std::vector<zone_event_t> events;
+	std::vector<zone_stats_t> stats;
+
+	zone_stats_t &find(const char *name)
+	{
+		for (auto &it : stats)
+			if (it.name == name)
+				return it;
+		stats.push_back({name, 0, 0, 0});
+		return stats.back();
+	}
+
+	void add(const zone_stats_t &other)
+	{
+		zone_stats_t &it = find(other.name);
+		it.count += other.count;
+		it.total_ns += other.total_ns;
+		it.max_ns = std::max(it.max_ns, other.max_ns);
+	}
+
+	void clear()
+	{
+		events.clear();
+		stats.clear();
+	}
+};
+
+#ifdef YOSYS_ENABLE_THREADS
+static std::mutex zone_mutex;
+static std::thread::id main_thread_id = std::this_thread::get_id();
+struct zone_lock_t {
+	std::lock_guard<std::mutex> lock;
+	zone_lock_t() : lock(zone_mutex) { }
+};
+#else
+struct zone_lock_t {
+	zone_lock_t() { }
+};
+#endif
+
+// The zones of each thread are recorded without locking in a thread-local
+// ZoneBuffer. The buffers of running threads are in zone_buffers, and are
+// only read while no ThreadPool jobs are running. When a thread exits its
+// zones are moved to zone_finished and its track is reused by the next
+// thread. The main thread is on track 1 with the passes.
+struct ZoneBuffer;
+static std::vector<ZoneBuffer*> zone_buffers;
+static zone_data_t zone_finished;
+static std::vector<int> zone_free_tids;
+static int zone_next_tid = 2;
+static thread_local ZoneBuffer *zone_buffer = nullptr;
+static thread_local bool zone_thread_exited = false;
+
+struct ZoneBuffer
+{
+	int tid;
+	zone_data_t data;
+
+	ZoneBuffer()
+	{
+		zone_lock_t lock;
+		tid = 1;
+#ifdef YOSYS_ENABLE_THREADS
+		if (std::this_thread::get_id() != main_thread_id) {
+			if (zone_free_tids.empty())
+				tid = zone_next_tid++;
+			else {
+				tid = zone_free_tids.back();
+				zone_free_tids.pop_back();
+			}
+		}
+#endif
+		zone_buffers.push_back(this);
+	}
+
+	~ZoneBuffer()
+	{
+		zone_lock_t lock;
+		zone_finished.events.insert(zone_finished.events.end(), data.events.begin(), data.events.end());
+		for (auto &it : data.stats)
+			zone_finished.add(it);
+		zone_buffers.erase(std::find(zone_buffers.begin(), zone_buffers.end(), this));
+		if (tid != 1)
+			zone_free_tids.push_back(tid);
+		zone_buffer = nullptr;
+		zone_thread_exited = true;
+	}
+};
+
+void PassProfiler::add_zone(const char *name, int64_t begin_ns)
+{
+	int64_t dur_ns = wall_time_ns() - begin_ns;
+	if (zone_buffer == nullptr) {
+		// zones in thread-local destructors that run after the one of the
+		// buffer are dropped
+		if (zone_thread_exited)
+			return;
+		static thread_local ZoneBuffer buffer;
+		zone_buffer = &buffer;
+	}
+	zone_stats_t &stats = zone_buffer->data.find(name);
+	stats.count++;
+	stats.total_ns += dur_ns;
+	stats.max_ns = std::max(stats.max_ns, dur_ns);
+	if (dur_ns >= zone_min_ns)
+		zone_buffer->data.events.push_back({name, zone_buffer->tid, begin_ns, dur_ns});
+}
+
+// All zones recorded so far, the events sorted by thread and start time.
+static zone_data_t collect_zones()
+{
+	zone_lock_t lock;
+	zone_data_t result = zone_finished;
+	for (auto buffer : zone_buffers) {
+		result.events.insert(result.events.end(), buffer->data.events.begin(), buffer->data.events.end());
+		for (auto &it : buffer->data.stats)
+			result.add(it);
+	}
+	std::sort(result.events.begin(), result.events.end(), [](const zone_event_t &a, const zone_event_t &b) {
+		return a.tid != b.tid ? a.tid < b.tid : a.begin_ns < b.begin_ns;
+	});
+	return result;
+}
+
+void PassProfiler::clear()
+{
+	nodes.clear();
+	current_node = -1;
+
+	zone_lock_t lock;
+	zone_finished.clear();
+	for (auto buffer : zone_buffers)
+		buffer->data.clear();
+}
+
+bool PassProfiler::timing_modules()
+{
+	return enabled && module_top > 0 && current_node >= 0 && !yosys_in_worker_thread();
+}
+
+int64_t PassProfiler::now_ns()
+{
+	return wall_time_ns();
+}
+
+void PassProfiler::add_module_time(RTLIL::Module *module, int64_t ns)
+{
+	if (!timing_modules())
+		return;
+	nodes[current_node].module_ns[module->name.str()] += ns;
+}
+
+std::vector<std::pair<std::string, int64_t>> PassProfiler::top_modules(const node_t &node, int count)
+{
+	std::vector<std::pair<std::string, int64_t>> result(node.module_ns.begin(), node.module_ns.end());
+	std::sort(result.begin(), result.end(), [](const std::pair<std::string, int64_t> &a, const std::pair<std::string, int64_t> &b) {
+		return a.second != b.second ? a.second > b.second : a.first < b.first;
+	});
+	if (GetSize(result) > count)
+		result.resize(count);
+	return result;
+}
+
+static void log_module_times(const std::vector<std::pair<std::string, int64_t>> &modules, const char *indent)
+{
+	for (auto &it : modules)
+		log("%s%10.1f ms  %s\n", indent, it.second / 1000000.0, log_id(it.first));
+}
+
+void PassProfiler::log_top_modules(const node_t &node)
+{
+	int64_t total_ns = 0;
+	for (auto &it : node.module_ns)
+		total_ns += it.second;
+	auto top = top_modules(node, module_top);
+	log("Slowest modules in %s (%d of %d, %.1f ms in total):\n", node.name.c_str(), GetSize(top),
+			GetSize(node.module_ns), total_ns / 1000000.0);
+	log_module_times(top, "  ");
+}
+
+// The wall time of a node, up to now for passes that are still running.
+static int64_t node_wall_ns(const PassProfiler::node_t &node)
+{
+	return node.wall_ns >= 0 ? node.wall_ns : wall_time_ns() - node.begin_ns;
+}
+
+void PassProfiler::write_trace(std::ostream &f)
+{
+	std::string json;
+	PrettyJson out;
+	out.append_to_string(json);
+	out.begin_object();
+	out.entry("displayTimeUnit", "ms");
+	out.name("traceEvents");
+	out.begin_array();
+	for (auto &node : nodes) {
+		out.begin_object();
+		out.compact();
+		out.entry("name", node.name);
+		out.entry("cat", "pass");
+		out.entry("ph", "X");
+		out.entry("ts", node.begin_ns / 1000.0);
+		out.entry("dur", node_wall_ns(node) / 1000.0);
+		out.entry("pid", 1);
+		out.entry("tid", 1);
+		out.name("args");
+		out.begin_object();
+		out.entry("command", node.command);
+		out.entry("cpu_ms", node.cpu_ns / 1000000.0);
+		out.entry("peak_rss_delta_kb", double(node.peak_rss_kb));
+		out.entry("cells_delta", node.cells_delta);
+		out.entry("wires_delta", node.wires_delta);
+		if (!node.module_ns.empty()) {
+			out.name("module_ms");
+			out.begin_object();
+			for (auto &it : top_modules(node, GetSize(node.module_ns)))
+				out.entry(it.first.c_str(), it.second / 1000000.0);
+			out.end_object();
+		}
+		out.end_object();
+		out.end_object();
+	}
+	zone_data_t zones = collect_zones();
+	pool<int> tids;
+	for (auto &event : zones.events) {
+		if (event.tid != 1 && tids.insert(event.tid).second) {
+			out.begin_object();
+			out.compact();
+			out.entry("name", "thread_name");
+			out.entry("ph", "M");
+			out.entry("pid", 1);
+			out.entry("tid", event.tid);
+			out.name("args");
+			out.begin_object();
+			out.entry("name", stringf("worker %d", event.tid - 1));
+			out.end_object();
+			out.end_object();
+		}
+		out.begin_object();
+		out.compact();
+		out.entry("name", event.name);
+		out.entry("cat", "zone");
+		out.entry("ph", "X");
+		out.entry("ts", event.begin_ns / 1000.0);
+		out.entry("dur", event.dur_ns / 1000.0);
+		out.entry("pid", 1);
+		out.entry("tid", event.tid);
+		out.end_object();
+	}
+	out.end_array();
+	out.end_object();
+	out.flush();
+	f << json << "\n";
+}
+
+void PassProfiler::write_folded(std::ostream &f)
+{
+	std::vector<int64_t> self_ns(GetSize(nodes));
+	for (int i = 0; i < GetSize(nodes); i++) {
+		self_ns[i] += node_wall_ns(nodes[i]);
+		if (nodes[i].parent >= 0)
+			self_ns[nodes[i].parent] -= node_wall_ns(nodes[i]);
+	}
+
+	std::vector<std::string> stacks(GetSize(nodes));
+	dict<std::string, int64_t> self_us;
+	std::vector<std::string> order;
+	for (int i = 0; i < GetSize(nodes); i++) {
+		int parent = nodes[i].parent;
+		stacks[i] = parent >= 0 ? stacks[parent] + ";" + nodes[i].name : nodes[i].name;
+		if (!self_us.count(stacks[i]))
+			order.push_back(stacks[i]);
+		self_us[stacks[i]] += std::max<int64_t>(self_ns[i], 0) / 1000;
+	}
+
+	for (auto &stack : order)
+		f << stack << " " << self_us.at(stack) << "\n";
+}
+
+void PassProfiler::write_file(const std::string &filename)
+{
+	std::ofstream f(filename.c_str());
+	if (f.fail())
+		log_error("Can't open profile file `%s' for writing: %s\n", filename.c_str(), strerror(errno));
+	if (filename.size() > 7 && filename.compare(filename.size() - 7, 7, ".folded") == 0)
+		write_folded(f);
+	else
+		write_trace(f);
+}
+
+void PassProfiler::log_tree()
+{
+	log("%10s %10s %10s %9s %9s  %s\n", "wall [ms]", "cpu [ms]", "rss [KiB]", "cells", "wires", "command");
+	std::vector<int> depth(GetSize(nodes));
+	for (int i = 0; i < GetSize(nodes); i++) {
+		auto &node = nodes[i];
+		depth[i] = node.parent >= 0 ? depth[node.parent] + 1 : 0;
+		log("%10.1f %10.1f %+10lld %+9d %+9d  %*s%s%s\n", node_wall_ns(node) / 1000000.0, node.cpu_ns / 1000000.0,
+				(long long)node.peak_rss_kb, node.cells_delta, node.wires_delta, 2 * depth[i], "",
+				node.command.c_str(), node.wall_ns < 0 ? " (running)" : "");
+		if (module_top > 0) {
+			std::string indent(2 * depth[i] + 56, ' ');
+			log_module_times(top_modules(node, module_top), indent.c_str());
+		}
+	}
+}
+
+void PassProfiler::log_zone_summary()
+{
+	zone_data_t zones = collect_zones();
+	if (zones.stats.empty()) {
+		log("No trace zones recorded.\n");
+		return;
+	}
+
+	std::sort(zones.stats.begin(), zones.stats.end(), [](const zone_stats_t &a, const zone_stats_t &b) {
+		return a.total_ns != b.total_ns ? a.total_ns > b.total_ns : strcmp(a.name, b.name) < 0;
+	});
+	log("%10s %12s %10s %10s  %s\n", "total [ms]", "count", "avg [us]", "max [ms]", "zone");
+	for (auto &it : zones.stats)
+		log("%10.1f %12lld %10.3f %10.1f  %s\n", it.total_ns / 1000000.0, (long long)it.count,
+				it.total_ns / 1000.0 / it.count, it.max_ns / 1000000.0, it.name);
+}
+
+void PassProfiler::log_module_summary()
+{
+	// module times summed over all calls of each pass
+	dict<std::string, node_t> passes;
+	std::vector<std::string> order;
+	for (auto &node : nodes) {
+		if (node.module_ns.empty())
+			continue;
+		if (!passes.count(node.name)) {
+			order.push_back(node.name);
+			passes[node.name].name = node.name;
+		}
+		for (auto &it : node.module_ns)
+			passes[node.name].module_ns[it.first] += it.second;
+	}
+
+	if (order.empty()) {
+		log("No module times recorded.\n");
+		return;
+	}
+
+	int count = module_top > 0 ? module_top : 10;
+	for (auto &name : order) {
+		auto &pass = passes.at(name);
+		int64_t total_ns = 0;
+		for (auto &it : pass.module_ns)
+			total_ns += it.second;
+		log("\n");
+		log("Pass %s: %.1f ms in %d modules\n", name.c_str(), total_ns / 1000000.0, GetSize(pass.module_ns));
+		log_module_times(top_modules(pass, count), "  ");
+	}
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,129 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+YOSYS_NAMESPACE_BEGIN
+
+// Records the tree of pass invocations while enabled ("yosys -k <file>" or
+// the "profile" command). Each pass call made from the main thread becomes a
+// node below the pass that called it, so that the passes run by a script line
+// or by a synth_* script can be told apart.
+struct PassProfiler
+{
+	struct node_t
+	{
+		std::string name, command;
+		int parent;
+		RTLIL::Design *design;
+
+		// wall_ns is -1 while the pass is running
+		int64_t begin_ns, wall_ns;
+		int64_t cpu_ns;
+		// increase of the peak resident set size, in KiB
+		int64_t peak_rss_kb;
+		int cells_delta, wires_delta;
+		// wall time spent on each module, if module timing is enabled
+		dict<std::string, int64_t> module_ns;
+
+		// values at the start of the call
+		int64_t begin_cpu_ns, begin_peak_rss_kb;
+		int begin_cells, begin_wires;
+	};
+
+	static bool enabled;
+	static std::vector<node_t> nodes;
+	// Number of slowest modules reported per pass, or 0 if module-local passes
+	// are not timed per module. Set by the YOSYS_PROFILE_MODULES environment
+	// variable or "profile -modules".
+	static int module_top;
+
+	// Called by Pass::pre_execute() and post_execute(). begin() returns the
+	// index of the new node, or -1 if nothing is recorded.
+	static int begin(const std::string &name, const std::vector<std::string> &args, RTLIL::Design *design);
+	static void end(int node);
+
+	static void clear();
+
+	// Per-module timing. Passes wrap the body of their module loop in a
+	// ModuleScope; Pass::execute_modules() does this for its workers. Times
+	// are charged to the innermost pass running in the main thread.
+	static bool timing_modules();
+	static int64_t now_ns();
+	static void add_module_time(RTLIL::Module *module, int64_t ns);
+
+	struct ModuleScope
+	{
+		RTLIL::Module *module;
+		int64_t begin_ns;
+
+		ModuleScope(RTLIL::Module *module) : module(module), begin_ns(timing_modules() ? now_ns() : -1) { }
+		~ModuleScope() {
+			if (begin_ns >= 0)
+				add_module_time(module, now_ns() - begin_ns);
+		}
+	};
+
+	// Trace zones mark hot code paths of the kernel and of a few passes
+	// (IdString creation, SigMap::set, ABC runs, SAT solves, ...). They are
+	// compiled in but only recorded while zones_enabled is set ("profile
+	// -zones" or the YOSYS_PROFILE_ZONES environment variable), otherwise a
+	// zone costs a load and a branch. Every recorded zone is counted, zones
+	// that take at least zone_min_ns also become events in the Chrome trace,
+	// on one track per thread.
+	static bool zones_enabled;
+	static int64_t zone_min_ns;
+	static void add_zone(const char *name, int64_t begin_ns);
+
+	struct Zone
+	{
+		// must be a string literal, zones are told apart by the pointer
+		const char *name;
+		int64_t begin_ns;
+
+		Zone(const char *name) : name(name), begin_ns(zones_enabled ? now_ns() : -1) { }
+		~Zone() {
+			if (begin_ns >= 0)
+				add_zone(name, begin_ns);
+		}
+	};
+
+	// Returns the slowest modules of a node, slowest first.
+	static std::vector<std::pair<std::string, int64_t>> top_modules(const node_t &node, int count);
+	static void log_top_modules(const node_t &node);
+
+	// Chrome trace event format, for chrome://tracing or ui.perfetto.dev.
+	static void write_trace(std::ostream &f);
+	// One line per call stack with its self time in microseconds, as read by
+	// flamegraph.pl and speedscope.
+	static void write_folded(std::ostream &f);
+	// Writes the folded format if the file name ends with ".folded", and the
+	// Chrome trace otherwise.
+	static void write_file(const std::string &filename);
+	static void log_tree();
+	static void log_module_summary();
+	static void log_zone_summary();
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
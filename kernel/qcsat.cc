@@ -63,15 +63,17 @@ void QuickConeSat::prepare()
 				continue;
 			if (cell_complexity(pbit.cell) > max_cell_complexity)
 				continue;
-			if (max_cell_outs && GetSize(modwalker.cell_outputs[pbit.cell]) > max_cell_outs)
+			if (max_cell_outs && GetSize(modwalker.cell_outputs.at(pbit.cell)) > max_cell_outs)
 				continue;
-			auto &inputs = modwalker.cell_inputs[pbit.cell];
+			// looked up without operator[], so that cones can be imported by
+			// several QuickConeSat instances in parallel
+			auto inputs = modwalker.cell_inputs.find(pbit.cell);
 			/*EDA-2229 Added below check to avoid core dump error due to looping through empty vector,
 			sample test case is main_loop_synth design*/
-			if (inputs.empty()){
+			if (inputs == modwalker.cell_inputs.end() || inputs->second.empty()){
 				continue;
 			}
-			bits_queue.insert(inputs.begin(), inputs.end());
+			bits_queue.insert(inputs->second.begin(), inputs->second.end());
 			satgen.importCell(pbit.cell);
 			imported_cells.insert(pbit.cell);
 		}
@@ -93,7 +95,7 @@ void QuickConeSat::prepare()
 		  as compare to 815.*/
 
 		iter_no++;
-		if (iter_no == 2)
+		if (max_depth && iter_no == max_depth)
 			break;
 	}
 }
@@ -50,6 +50,9 @@ struct QuickConeSat {
 	int max_cell_count = 0;
 	// If non-0, skip importing cells with more than this number of output bits.
 	int max_cell_outs = 0;
+	// The maximum number of cell levels to import in one prepare() call, or 0
+	// for no limit.
+	int max_depth = 2;
 
 	// Internal state.
 	pool<RTLIL::Cell*> imported_cells;
@@ -19,6 +19,15 @@
 
 #include "kernel/yosys.h"
 #include "kernel/satgen.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
+#include "kernel/memlimit.h"
+#include "libs/sha1/sha1.h"
+#include "backends/rtlil/rtlil_backend.h"
+
+#ifdef YOSYS_ENABLE_CADICAL
+#include "libs/ezsat/ezcadical.h"
+#endif
 
 #include <string.h>
 #include <stdlib.h>
@@ -148,12 +157,16 @@ Pass::~Pass()
 {
 }
 
-Pass::pre_post_exec_state_t Pass::pre_execute()
+Pass::pre_post_exec_state_t Pass::pre_execute(const std::vector<std::string> &args, RTLIL::Design *design)
 {
 	pre_post_exec_state_t state;
 	call_counter++;
 	state.begin_ns = PerformanceTimer::query();
 	state.parent_pass = current_pass;
+	state.profile_node = PassProfiler::begin(pass_name, args, design);
+	state.begin_rss_kb = MemLimit::limit_kb > 0 ? MemLimit::rss_kb() : 0;
+	state.design = design;
+	call_args = args;
 	current_pass = this;
 	clear_flags();
 	return state;
@@ -169,6 +182,83 @@ void Pass::post_execute(Pass::pre_post_exec_state_t state)
 	current_pass = state.parent_pass;
 	if (current_pass)
 		current_pass->runtime_ns -= time_ns;
+	PassProfiler::end(state.profile_node);
+	MemLimit::pass_done(pass_name.c_str(), state.begin_rss_kb, state.design);
+}
+
+void Pass::execute_modules(RTLIL::Design *design, const std::vector<RTLIL::Module*> &modules,
+		const std::function<void(RTLIL::Module*)> &worker)
+{
+	int num_modules = GetSize(modules);
+	int base_autoidx = autoidx;
+	std::vector<int> module_autoidx(num_modules, base_autoidx);
+
+	// monitors and the debug facilities below are not thread-safe
+	int num_threads = yosys_thread_count(num_modules);
+	if (yosys_xtrace || memhasher_active)
+		num_threads = 1;
+	for (auto mon : design->monitors)
+		if (!mon->thread_safe())
+			num_threads = 1;
+	for (auto module : modules)
+		for (auto mon : module->monitors)
+			if (!mon->thread_safe())
+				num_threads = 1;
+
+	// the workers may look up any module of the design, e.g. the types of
+	// their cells, so lazy modules are loaded here rather than by a worker
+	if (num_threads > 1)
+		design->load_lazy();
+
+	auto restore_autoidx = [&]() {
+		autoidx = base_autoidx;
+		for (int idx : module_autoidx)
+			autoidx = std::max(autoidx, idx);
+	};
+
+	if (num_threads == 1)
+	{
+		for (int i = 0; i < num_modules; i++) {
+			autoidx = base_autoidx;
+			try {
+				PassProfiler::ModuleScope profile_scope(modules[i]);
+				worker(modules[i]);
+			} catch (...) {
+				module_autoidx[i] = autoidx;
+				restore_autoidx();
+				throw;
+			}
+			module_autoidx[i] = autoidx;
+		}
+		restore_autoidx();
+		return;
+	}
+
+	std::vector<int64_t> module_ns(num_modules, -1);
+	bool timing_modules = PassProfiler::timing_modules();
+
+	try {
+		ThreadPool::run_captured(num_modules, [&](int i) {
+			autoidx = base_autoidx;
+			int64_t begin_ns = timing_modules ? PassProfiler::now_ns() : 0;
+			try {
+				worker(modules[i]);
+			} catch (...) {
+				module_autoidx[i] = autoidx;
+				throw;
+			}
+			module_autoidx[i] = autoidx;
+			if (timing_modules)
+				module_ns[i] = PassProfiler::now_ns() - begin_ns;
+		}, num_threads, nullptr, [&](int i) {
+			if (module_ns[i] >= 0)
+				PassProfiler::add_module_time(modules[i], module_ns[i]);
+		});
+	} catch (...) {
+		restore_autoidx();
+		throw;
+	}
+	restore_autoidx();
 }
 
 void Pass::help()
@@ -294,6 +384,97 @@ void Pass::call(RTLIL::Design *design, std::string command)
 	call(design, args);
 }
 
+// The output of earlier calls of passes that only report on the design,
+// see Pass::result_cacheable(). The key covers the arguments, the selection
+// and the contents of all modules.
+struct pass_cache_entry_t {
+	std::vector<LogCapture::Entry> entries;
+	dict<std::string, std::string> scratchpad_set;
+	pool<std::string> scratchpad_unset;
+};
+static dict<std::string, pass_cache_entry_t> pass_cache;
+
+static void pass_cache_selection(std::ostringstream &buf, const RTLIL::Selection &selection)
+{
+	if (selection.full_selection) {
+		buf << "*\n";
+		return;
+	}
+	std::vector<std::string> lines;
+	for (auto &it : selection.selected_modules)
+		lines.push_back(it.str() + "\n");
+	for (auto &it : selection.selected_members)
+		for (auto &member : it.second)
+			lines.push_back(it.first.str() + " " + member.str() + "\n");
+	std::sort(lines.begin(), lines.end());
+	for (auto &line : lines)
+		buf << line;
+}
+
+static std::string pass_cache_key(const std::vector<std::string> &args, RTLIL::Design *design)
+{
+	std::ostringstream buf;
+	for (auto &arg : args)
+		buf << arg << "\n";
+	buf << "cd " << design->selected_active_module << "\n";
+	pass_cache_selection(buf, design->selection_stack.back());
+	for (auto &it : design->selection_vars) {
+		buf << "@" << it.first.str() << "\n";
+		pass_cache_selection(buf, it.second);
+	}
+	std::vector<std::string> lines;
+	for (auto module : design->modules())
+		lines.push_back(stringf("%s %016llx\n", log_id(module), (unsigned long long)module->content_hash()));
+	std::sort(lines.begin(), lines.end());
+	for (auto &line : lines)
+		buf << line;
+	return sha1(buf.str());
+}
+
+static void execute_cached(Pass *pass, const std::vector<std::string> &args, RTLIL::Design *design)
+{
+	std::string key = pass_cache_key(args, design);
+
+	auto it = pass_cache.find(key);
+	if (it != pass_cache.end()) {
+		log_debug("Replaying the output of an earlier `%s' call on the same design.\n", pass->pass_name.c_str());
+		LogCapture capture;
+		capture.entries = it->second.entries;
+		capture.replay();
+		for (auto &var : it->second.scratchpad_set)
+			design->scratchpad[var.first] = var.second;
+		for (auto &var : it->second.scratchpad_unset)
+			design->scratchpad.erase(var);
+		return;
+	}
+
+	dict<std::string, std::string> scratchpad = design->scratchpad;
+	LogCapture capture;
+	capture.begin();
+	try {
+		pass->execute(args, design);
+	} catch (...) {
+		capture.end();
+		capture.replay();
+		throw;
+	}
+	capture.end();
+
+	// a small cache is enough for repeated reports between design changes
+	if (GetSize(pass_cache) >= 64)
+		pass_cache.clear();
+	pass_cache_entry_t &entry = pass_cache[key];
+	entry.entries = capture.entries;
+	for (auto &var : design->scratchpad)
+		if (!scratchpad.count(var.first) || scratchpad.at(var.first) != var.second)
+			entry.scratchpad_set[var.first] = var.second;
+	for (auto &var : scratchpad)
+		if (!design->scratchpad.count(var.first))
+			entry.scratchpad_unset.insert(var.first);
+
+	capture.replay();
+}
+
 void Pass::call(RTLIL::Design *design, std::vector<std::string> args)
 {
 	if (args.size() == 0 || args[0][0] == '#' || args[0][0] == ':')
@@ -306,16 +487,21 @@ void Pass::call(RTLIL::Design *design, std::vector<std::string> args)
 		log("\n");
 	}
 
-	if (pass_register.count(args[0]) == 0)
+	auto it = pass_register.find(args[0]);
+	if (it == pass_register.end())
 		log_cmd_error("No such command: %s (type 'help' for a command overview)\n", args[0].c_str());
 
-	if (pass_register[args[0]]->experimental_flag)
+	Pass *pass = it->second;
+	if (pass->experimental_flag)
 		log_experimental("%s", args[0].c_str());
 
 	size_t orig_sel_stack_pos = design->selection_stack.size();
-	auto state = pass_register[args[0]]->pre_execute();
-	pass_register[args[0]]->execute(args, design);
-	pass_register[args[0]]->post_execute(state);
+	auto state = pass->pre_execute(args, design);
+	if (design->scratchpad_get_bool("pass.cache") && !LogCapture::active() && pass->result_cacheable(args))
+		execute_cached(pass, args, design);
+	else
+		pass->execute(args, design);
+	pass->post_execute(state);
 	while (design->selection_stack.size() > orig_sel_stack_pos)
 		design->selection_stack.pop_back();
 }
@@ -380,6 +566,9 @@ bool ScriptPass::check_label(std::string label, std::string info)
 			log("    %s:    %s\n", label.c_str(), info.c_str());
 		return true;
 	} else {
+		bool was_active = block_active;
+		if (script_threads > 0)
+			end_label_time();
 		if (!active_run_from.empty() && active_run_from == active_run_to) {
 			block_active = (label == active_run_from);
 		} else {
@@ -388,6 +577,14 @@ bool ScriptPass::check_label(std::string label, std::string info)
 			if (label == active_run_to)
 				block_active = false;
 		}
+		if (!checkpoint_dir.empty()) {
+			if (label == checkpoint_resume)
+				load_checkpoint(label);
+			else if (was_active || block_active)
+				save_checkpoint(label);
+		}
+		if (script_threads > 0 && block_active)
+			label_times.push_back({label, -PassProfiler::now_ns(), -PerformanceTimer::query(), true});
 		return block_active;
 	}
 }
@@ -424,7 +621,163 @@ void ScriptPass::run_script(RTLIL::Design *design, std::string run_from, std::st
 	block_active = run_from.empty();
 	active_run_from = run_from;
 	active_run_to = run_to;
-	script();
+
+	// a nested run of the same pass must not change the checkpoints of the
+	// outer run
+	std::string outer_dir = checkpoint_dir, outer_key = checkpoint_key, outer_resume = checkpoint_resume;
+	checkpoint_dir = design->scratchpad_get_string("checkpoint.dir");
+	checkpoint_key.clear();
+	checkpoint_resume.clear();
+
+	if (!checkpoint_dir.empty())
+	{
+		rewrite_filename(checkpoint_dir);
+		if (!check_file_exists(checkpoint_dir) && !create_directory(checkpoint_dir))
+			log_cmd_error("Can't create checkpoint directory `%s'.\n", checkpoint_dir.c_str());
+
+		// the key covers the arguments except for the labels to run, and the
+		// design. Not the scratchpad, where passes keep flags like
+		// opt.did_something that would make every run look different.
+		std::ostringstream buf;
+		buf << yosys_version_str << "\n";
+		for (size_t i = 0; i < call_args.size(); i++) {
+			if (call_args[i] == "-run" && i+1 < call_args.size()) {
+				i++;
+				continue;
+			}
+			buf << call_args[i] << "\n";
+		}
+		std::vector<std::string> lines;
+		for (auto module : design->modules())
+			lines.push_back(stringf("%s %016llx\n", log_id(module), (unsigned long long)module->content_hash()));
+		std::sort(lines.begin(), lines.end());
+		for (auto &line : lines)
+			buf << line;
+		checkpoint_key = sha1(buf.str());
+
+		// the labels saved by earlier runs, in the order they were reached
+		std::vector<std::string> labels;
+		std::ifstream f(stringf("%s/%s.labels", checkpoint_dir.c_str(), checkpoint_key.c_str()));
+		for (std::string label; std::getline(f, label);)
+			labels.push_back(label);
+
+		// resume from the last label that is not behind the end label
+		if (run_from.empty()) {
+			for (auto &label : labels) {
+				if (check_file_exists(checkpoint_file(label)))
+					checkpoint_resume = label;
+				if (label == run_to)
+					break;
+			}
+		} else if (check_file_exists(checkpoint_file(run_from)))
+			checkpoint_resume = run_from;
+
+		if (!checkpoint_resume.empty()) {
+			log("Resuming from the checkpoint at label `%s'.\n", checkpoint_resume.c_str());
+			block_active = false;
+			active_run_from = checkpoint_resume;
+		}
+	}
+
+	// the thread limit and the label times of a nested run are its own
+	int outer_max_threads = yosys_max_threads;
+	std::vector<label_time_t> outer_label_times;
+	std::swap(outer_label_times, label_times);
+	if (script_threads > 0) {
+		log("Using up to %d threads.\n", script_threads);
+		yosys_max_threads = script_threads;
+	}
+
+	try {
+		script();
+	} catch (...) {
+		yosys_max_threads = outer_max_threads;
+		throw;
+	}
+
+	yosys_max_threads = outer_max_threads;
+	if (script_threads > 0) {
+		end_label_time();
+		log_label_times();
+	}
+	std::swap(outer_label_times, label_times);
+
+	checkpoint_dir = outer_dir;
+	checkpoint_key = outer_key;
+	checkpoint_resume = outer_resume;
+}
+
+void ScriptPass::end_label_time()
+{
+	if (label_times.empty() || !label_times.back().running)
+		return;
+	label_times.back().wall_ns += PassProfiler::now_ns();
+	label_times.back().cpu_ns += PerformanceTimer::query();
+	label_times.back().running = false;
+}
+
+void ScriptPass::log_label_times()
+{
+	if (label_times.empty())
+		return;
+
+	int width = 5;
+	for (auto &it : label_times)
+		width = std::max(width, GetSize(it.label));
+
+	log("\n");
+	log("Time per label with up to %d threads:\n", script_threads);
+	log("  %-*s %10s %10s %8s\n", width, "label", "wall [s]", "cpu [s]", "speedup");
+	int64_t total_wall_ns = 0, total_cpu_ns = 0;
+	for (auto &it : label_times) {
+		log("  %-*s %10.3f %10.3f %7.2fx\n", width, it.label.c_str(), it.wall_ns * 1e-9, it.cpu_ns * 1e-9,
+				it.wall_ns > 0 ? double(it.cpu_ns) / it.wall_ns : 1.0);
+		total_wall_ns += it.wall_ns;
+		total_cpu_ns += it.cpu_ns;
+	}
+	log("  %-*s %10.3f %10.3f %7.2fx\n", width, "total", total_wall_ns * 1e-9, total_cpu_ns * 1e-9,
+			total_wall_ns > 0 ? double(total_cpu_ns) / total_wall_ns : 1.0);
+}
+
+std::string ScriptPass::checkpoint_file(const std::string &label)
+{
+	return stringf("%s/%s.il", checkpoint_dir.c_str(), sha1(checkpoint_key + "\n" + label).c_str());
+}
+
+void ScriptPass::save_checkpoint(const std::string &label)
+{
+	std::string filename = checkpoint_file(label);
+	log("Saving checkpoint for label `%s' to %s.\n", label.c_str(), filename.c_str());
+
+	// write to a temporary file first so that a failed run never leaves a
+	// partially written checkpoint
+	std::string tmp_filename = make_temp_file(filename + ".XXXXXX");
+	std::ofstream out(tmp_filename, std::ios::binary);
+	RTLIL_BACKEND::dump_design_binary(out, active_design);
+	out.close();
+	if (out.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		log_warning("Can't write checkpoint file %s.\n", filename.c_str());
+		remove(tmp_filename.c_str());
+		return;
+	}
+
+	std::ofstream labels(stringf("%s/%s.labels", checkpoint_dir.c_str(), checkpoint_key.c_str()), std::ios::app);
+	labels << label << "\n";
+}
+
+void ScriptPass::load_checkpoint(const std::string &label)
+{
+	std::string filename = checkpoint_file(label);
+	log("Loading checkpoint for label `%s' from %s.\n", label.c_str(), filename.c_str());
+
+	std::ifstream f(filename, std::ios::binary);
+	if (f.fail())
+		log_error("Can't open checkpoint file %s: %s\n", filename.c_str(), strerror(errno));
+
+	for (auto module : active_design->modules().to_vector())
+		active_design->remove(module);
+	Frontend::frontend_call(active_design, &f, filename, "rtlil");
+	checkpoint_resume.clear();
 }
 
 void ScriptPass::help_script()
@@ -465,7 +818,7 @@ void Frontend::execute(std::vector<std::string> args, RTLIL::Design *design)
 	do {
 		std::istream *f = NULL;
 		next_args.clear();
-		auto state = pre_execute();
+		auto state = pre_execute(args, design);
 		execute(f, std::string(), args, design);
 		post_execute(state);
 		args = next_args;
@@ -607,12 +960,12 @@ void Frontend::frontend_call(RTLIL::Design *design, std::istream *f, std::string
 		log_cmd_error("No such frontend: %s\n", args[0].c_str());
 
 	if (f != NULL) {
-		auto state = frontend_register[args[0]]->pre_execute();
+		auto state = frontend_register[args[0]]->pre_execute(args, design);
 		frontend_register[args[0]]->execute(f, filename, args, design);
 		frontend_register[args[0]]->post_execute(state);
 	} else if (filename == "-") {
 		std::istream *f_cin = &std::cin;
-		auto state = frontend_register[args[0]]->pre_execute();
+		auto state = frontend_register[args[0]]->pre_execute(args, design);
 		frontend_register[args[0]]->execute(f_cin, "<stdin>", args, design);
 		frontend_register[args[0]]->post_execute(state);
 	} else {
@@ -646,7 +999,7 @@ Backend::~Backend()
 void Backend::execute(std::vector<std::string> args, RTLIL::Design *design)
 {
 	std::ostream *f = NULL;
-	auto state = pre_execute();
+	auto state = pre_execute(args, design);
 	execute(f, std::string(), args, design);
 	post_execute(state);
 	if (f != &std::cout)
@@ -729,12 +1082,12 @@ void Backend::backend_call(RTLIL::Design *design, std::ostream *f, std::string f
 	size_t orig_sel_stack_pos = design->selection_stack.size();
 
 	if (f != NULL) {
-		auto state = backend_register[args[0]]->pre_execute();
+		auto state = backend_register[args[0]]->pre_execute(args, design);
 		backend_register[args[0]]->execute(f, filename, args, design);
 		backend_register[args[0]]->post_execute(state);
 	} else if (filename == "-") {
 		std::ostream *f_cout = &std::cout;
-		auto state = backend_register[args[0]]->pre_execute();
+		auto state = backend_register[args[0]]->pre_execute(args, design);
 		backend_register[args[0]]->execute(f_cout, "<stdout>", args, design);
 		backend_register[args[0]]->post_execute(state);
 	} else {
@@ -983,13 +1336,55 @@ struct EchoPass : public Pass {
 SatSolver *yosys_satsolver_list;
 SatSolver *yosys_satsolver;
 
+// Records the solver calls as trace zones (see PassProfiler::Zone).
+template<typename T>
+struct ZoneSat : public T
+{
+	bool solver(const std::vector<int> &modelExpressions, std::vector<bool> &modelValues, const std::vector<int> &assumptions) override
+	{
+		PassProfiler::Zone zone("ezSAT::solve");
+		return T::solver(modelExpressions, modelValues, assumptions);
+	}
+};
+
 struct MinisatSatSolver : public SatSolver {
 	MinisatSatSolver() : SatSolver("minisat") {
 		yosys_satsolver = this;
 	}
 	ezSAT *create() override {
-		return new ezMiniSAT();
+		return new ZoneSat<ezMiniSAT>();
 	}
 } MinisatSatSolver;
 
+#ifdef YOSYS_ENABLE_CADICAL
+struct CadicalSatSolver : public SatSolver {
+	CadicalSatSolver() : SatSolver("cadical") { }
+	ezSAT *create() override {
+		return new ZoneSat<ezCaDiCaL>();
+	}
+} CadicalSatSolver;
+#endif
+
+SatSolverSelect::SatSolverSelect(const std::string &name) : old_solver(yosys_satsolver)
+{
+	if (name.empty())
+		return;
+
+	for (auto solver = yosys_satsolver_list; solver != nullptr; solver = solver->next)
+		if (solver->name == name) {
+			yosys_satsolver = solver;
+			return;
+		}
+
+	std::string names;
+	for (auto solver = yosys_satsolver_list; solver != nullptr; solver = solver->next)
+		names += (names.empty() ? "" : ", ") + solver->name;
+	log_cmd_error("SAT solver `%s' is not available (available solvers: %s).\n", name.c_str(), names.c_str());
+}
+
+SatSolverSelect::~SatSolverSelect()
+{
+	yosys_satsolver = old_solver;
+}
+
 YOSYS_NAMESPACE_END
@@ -45,11 +45,35 @@ struct Pass
 	struct pre_post_exec_state_t {
 		Pass *parent_pass;
 		int64_t begin_ns;
+		int profile_node;
+		int64_t begin_rss_kb;
+		RTLIL::Design *design;
 	};
 
-	pre_post_exec_state_t pre_execute();
+	// The arguments of the latest call, set by pre_execute().
+	std::vector<std::string> call_args;
+
+	// The design is only used by the profiler (see kernel/profiler.h).
+	pre_post_exec_state_t pre_execute(const std::vector<std::string> &args = std::vector<std::string>(), RTLIL::Design *design = nullptr);
 	void post_execute(pre_post_exec_state_t state);
 
+	// Module-local passes can hand their per-module work to execute_modules(),
+	// which distributes it over worker threads when multi-threading is enabled
+	// (see kernel/threading.h). The worker may only modify the module it is
+	// given. Log output is buffered per module and printed in module order,
+	// and autoidx is rewound for each module, so that the result does not
+	// depend on the number of threads.
+	void execute_modules(RTLIL::Design *design, const std::vector<RTLIL::Module*> &modules,
+			const std::function<void(RTLIL::Module*)> &worker);
+
+	// Passes that only report on the design return true for the arguments
+	// with which their log output and their changes to the scratchpad only
+	// depend on the arguments, the selection and the modules of the design.
+	// With the scratchpad variable 'pass.cache' set, call() then replays the
+	// output of an earlier call with the same arguments on an identical design
+	// instead of running the pass again.
+	virtual bool result_cacheable(const std::vector<std::string> &args) const { (void)args; return false; }
+
 	void cmd_log_args(const std::vector<std::string> &args);
 	void cmd_error(const std::vector<std::string> &args, size_t argidx, std::string msg);
 	void extra_args(std::vector<std::string> args, size_t argidx, RTLIL::Design *design, bool select = true);
@@ -79,7 +103,24 @@ struct ScriptPass : Pass
 	RTLIL::Design *active_design;
 	std::string active_run_from, active_run_to;
 
-	ScriptPass(std::string name, std::string short_help = "** document me **") : Pass(name, short_help) { }
+	// With the scratchpad variable 'checkpoint.dir' set, run_script() saves
+	// the design at each label it reaches and resumes a run with the same
+	// arguments on the same design from the last saved label.
+	std::string checkpoint_dir, checkpoint_key, checkpoint_resume;
+
+	// With script_threads set, e.g. by a -threads option of the script,
+	// run_script() raises the kernel thread limit (see kernel/threading.h) to
+	// that number for the run and reports the wall clock and CPU time of each
+	// label. The ratio of the two is the speedup from the parallel passes.
+	int script_threads;
+	struct label_time_t {
+		std::string label;
+		int64_t wall_ns, cpu_ns;
+		bool running;
+	};
+	std::vector<label_time_t> label_times;
+
+	ScriptPass(std::string name, std::string short_help = "** document me **") : Pass(name, short_help), script_threads(0) { }
 
 	virtual void script() = 0;
 
@@ -88,6 +129,13 @@ struct ScriptPass : Pass
 	void run_nocheck(std::string command, std::string info = std::string());
 	void run_script(RTLIL::Design *design, std::string run_from = std::string(), std::string run_to = std::string());
 	void help_script();
+
+	std::string checkpoint_file(const std::string &label);
+	void save_checkpoint(const std::string &label);
+	void load_checkpoint(const std::string &label);
+
+	void end_label_time();
+	void log_label_times();
 };
 
 struct Frontend : Pass
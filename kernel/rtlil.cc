@@ -21,6 +21,7 @@
 #include "kernel/macc.h"
 #include "kernel/celltypes.h"
 #include "kernel/binding.h"
+#include "kernel/profiler.h"
 #include "frontends/verilog/verilog_frontend.h"
 #include "frontends/verilog/preproc.h"
 #include "backends/rtlil/rtlil_backend.h"
@@ -32,16 +33,144 @@ YOSYS_NAMESPACE_BEGIN
 
 bool RTLIL::IdString::destruct_guard_ok = false;
 RTLIL::IdString::destruct_guard_t RTLIL::IdString::destruct_guard;
-std::vector<char*> RTLIL::IdString::global_id_storage_;
-dict<char*, int, hash_cstr_ops> RTLIL::IdString::global_id_index_;
+RTLIL::IdString::id_entry_t *RTLIL::IdString::global_id_pages_[RTLIL::IdString::id_max_pages];
+int RTLIL::IdString::global_id_count_;
+RTLIL::IdString::id_shard_t RTLIL::IdString::global_id_shards_[RTLIL::IdString::id_num_shards];
+RTLIL::IdString::id_mutex_t RTLIL::IdString::global_id_alloc_mutex_;
 #ifndef YOSYS_NO_IDS_REFCNT
-std::vector<int> RTLIL::IdString::global_refcount_storage_;
 std::vector<int> RTLIL::IdString::global_free_idx_list_;
+std::vector<int> RTLIL::IdString::global_pending_free_idx_list_;
 #endif
 #ifdef YOSYS_USE_STICKY_IDS
 int RTLIL::IdString::last_created_idx_[8];
 int RTLIL::IdString::last_created_idx_ptr_;
 #endif
+#ifdef YOSYS_ENABLE_THREADS
+bool RTLIL::IdString::concurrent_ = false;
+#endif
+
+int RTLIL::IdString::create_reference(id_shard_t &shard, const char *p)
+{
+	PassProfiler::Zone zone("IdString::create");
+	log_assert(p[0] == '$' || p[0] == '\\');
+	log_assert(p[1] != 0);
+	for (const char *c = p; *c; c++)
+		if ((unsigned)*c <= (unsigned)' ')
+			log_error("Found control character or space (0x%02hhx) in string '%s' which is not allowed in RTLIL identifiers\n", *c, p);
+
+	int idx;
+	{
+		id_lock_t lock(global_id_alloc_mutex_);
+
+		if (global_id_count_ == 0) {
+			global_id_pages_[0] = new id_entry_t[id_page_size]();
+			global_id_pages_[0][0].str = (char*)"";
+		#ifndef YOSYS_NO_IDS_REFCNT
+			global_id_pages_[0][0].refcount.store(id_immortal_refcount);
+		#endif
+			global_id_count_ = 1;
+		}
+
+	#ifndef YOSYS_NO_IDS_REFCNT
+		if (!global_free_idx_list_.empty()) {
+			idx = global_free_idx_list_.back();
+			global_free_idx_list_.pop_back();
+		} else
+	#endif
+		{
+			log_assert(global_id_count_ < 0x40000000);
+			idx = global_id_count_++;
+			if (global_id_pages_[idx >> id_page_bits] == nullptr)
+				global_id_pages_[idx >> id_page_bits] = new id_entry_t[id_page_size]();
+		}
+	}
+
+	id_entry_t &entry = global_id_entry(idx);
+	entry.str = strdup(p);
+#ifndef YOSYS_NO_IDS_REFCNT
+	entry.refcount.store(1, std::memory_order_relaxed);
+#endif
+	shard.index[entry.str] = idx;
+
+	if (yosys_xtrace) {
+		log("#X# New IdString '%s' with index %d.\n", p, idx);
+		log_backtrace("-X- ", yosys_xtrace-1);
+	}
+
+#ifdef YOSYS_XTRACE_GET_PUT
+	if (yosys_xtrace)
+		log("#X# GET-BY-NAME '%s' (index %d, refcount %d)\n", entry.str, idx, global_id_refcount(idx));
+#endif
+
+#ifdef YOSYS_USE_STICKY_IDS
+	// Avoid Create->Delete->Create pattern
+	if (last_created_idx_[last_created_idx_ptr_])
+		put_reference(last_created_idx_[last_created_idx_ptr_]);
+	last_created_idx_[last_created_idx_ptr_] = idx;
+	get_reference(last_created_idx_[last_created_idx_ptr_]);
+	last_created_idx_ptr_ = (last_created_idx_ptr_ + 1) & 7;
+#endif
+
+	return idx;
+}
+
+#ifndef YOSYS_NO_IDS_REFCNT
+void RTLIL::IdString::free_reference(int idx)
+{
+	id_entry_t &entry = global_id_entry(idx);
+
+	if (yosys_xtrace) {
+		log("#X# Removed IdString '%s' with index %d.\n", entry.str, idx);
+		log_backtrace("-X- ", yosys_xtrace-1);
+	}
+
+	global_id_shard(entry.str).index.erase(entry.str);
+	free(entry.str);
+	entry.str = nullptr;
+	global_free_idx_list_.push_back(idx);
+}
+
+void RTLIL::IdString::defer_free_reference(int idx)
+{
+	id_lock_t lock(global_id_alloc_mutex_);
+	global_pending_free_idx_list_.push_back(idx);
+}
+#endif
+
+void RTLIL::IdString::begin_concurrent()
+{
+#ifdef YOSYS_ENABLE_THREADS
+	log_assert(!concurrent_);
+	concurrent_ = true;
+#endif
+}
+
+void RTLIL::IdString::end_concurrent()
+{
+#ifdef YOSYS_ENABLE_THREADS
+	log_assert(concurrent_);
+	concurrent_ = false;
+#endif
+#ifndef YOSYS_NO_IDS_REFCNT
+	// an id may have been resurrected (or queued more than once) after
+	// its refcount dropped to zero, so only free what is still unused
+	std::vector<int> pending;
+	std::swap(pending, global_pending_free_idx_list_);
+	for (int idx : pending)
+		if (global_id_entry(idx).str != nullptr && global_id_refcount(idx) == 0)
+			free_reference(idx);
+#endif
+}
+
+RTLIL::IdString RTLIL::IdString::immortal(const char *str)
+{
+	IdString id(str);
+#ifndef YOSYS_NO_IDS_REFCNT
+	if (id.index_ != 0)
+		global_id_entry(id.index_).refcount.store(id_immortal_refcount, std::memory_order_relaxed);
+#endif
+	return id;
+}
 
 #define X(_id) IdString RTLIL::ID::_id;
 #include "kernel/constids.inc"
@@ -222,19 +351,15 @@ RTLIL::Const::Const(const std::string &str)
 RTLIL::Const::Const(int val, int width)
 {
 	flags = RTLIL::CONST_FLAG_NONE;
-	bits.reserve(width);
-	for (int i = 0; i < width; i++) {
-		bits.push_back((val & 1) != 0 ? State::S1 : State::S0);
-		val = val >> 1;
-	}
+	bits.resize(std::max(width, 0), val < 0 ? State::S1 : State::S0);
+	for (int i = 0; i < width && i < 32; i++)
+		bits[i] = ((val >> i) & 1) != 0 ? State::S1 : State::S0;
 }
 
 RTLIL::Const::Const(RTLIL::State bit, int width)
 {
 	flags = RTLIL::CONST_FLAG_NONE;
-	bits.reserve(width);
-	for (int i = 0; i < width; i++)
-		bits.push_back(bit);
+	bits.assign(std::max(width, 0), bit);
 }
 
 RTLIL::Const::Const(const std::vector<bool> &bits)
@@ -245,32 +370,68 @@ RTLIL::Const::Const(const std::vector<bool> &bits)
 		this->bits.emplace_back(b ? State::S1 : State::S0);
 }
 
+// State is a single byte, so comparisons and the is_fully_*() checks below
+// can work on the raw bytes, eight states at a time.
+static_assert(sizeof(RTLIL::State) == 1, "RTLIL::State must be a single byte");
+
+namespace {
+	const uint64_t const_word_ones = 0x0101010101010101ull;
+
+	inline uint64_t const_load_word(const RTLIL::State *p) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		return w;
+	}
+
+	// true if (word & mask) == value for all eight-state words in the vector,
+	// with the tail handled byte-wise
+	inline bool const_all_words(const std::vector<RTLIL::State> &bits, uint8_t mask, uint8_t value) {
+		const RTLIL::State *p = bits.data();
+		size_t n = bits.size(), i = 0;
+		for (; i + 8 <= n; i += 8)
+			if ((const_load_word(p + i) & (const_word_ones * mask)) != const_word_ones * value)
+				return false;
+		for (; i < n; i++)
+			if ((p[i] & mask) != value)
+				return false;
+		return true;
+	}
+}
+
+unsigned int RTLIL::Const::hash_words(const std::vector<RTLIL::State> &bits)
+{
+	unsigned int h = mkhash_init;
+	const RTLIL::State *p = bits.data();
+	size_t n = bits.size(), i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t w = const_load_word(p + i);
+		h = mkhash(h, mkhash(uint32_t(w), uint32_t(w >> 32)));
+	}
+	for (; i < n; i++)
+		h = mkhash(h, p[i]);
+	return h;
+}
+
 bool RTLIL::Const::operator <(const RTLIL::Const &other) const
 {
 	if (bits.size() != other.bits.size())
 		return bits.size() < other.bits.size();
-	for (size_t i = 0; i < bits.size(); i++)
-		if (bits[i] != other.bits[i])
-			return bits[i] < other.bits[i];
-	return false;
+	return !bits.empty() && memcmp(bits.data(), other.bits.data(), bits.size()) < 0;
 }
 
 bool RTLIL::Const::operator ==(const RTLIL::Const &other) const
 {
-	return bits == other.bits;
+	return bits.size() == other.bits.size() && (bits.empty() || memcmp(bits.data(), other.bits.data(), bits.size()) == 0);
 }
 
 bool RTLIL::Const::operator !=(const RTLIL::Const &other) const
 {
-	return bits != other.bits;
+	return !(*this == other);
 }
 
 bool RTLIL::Const::as_bool() const
 {
-	for (size_t i = 0; i < bits.size(); i++)
-		if (bits[i] == State::S1)
-			return true;
-	return false;
+	return !bits.empty() && memchr(bits.data(), State::S1, bits.size()) != nullptr;
 }
 
 int RTLIL::Const::as_int(bool is_signed) const
@@ -352,55 +513,37 @@ bool RTLIL::Const::is_fully_zero() const
 {
 	cover("kernel.rtlil.const.is_fully_zero");
 
-	for (const auto &bit : bits)
-		if (bit != RTLIL::State::S0)
-			return false;
-
-	return true;
+	return const_all_words(bits, 0xff, RTLIL::State::S0);
 }
 
 bool RTLIL::Const::is_fully_ones() const
 {
 	cover("kernel.rtlil.const.is_fully_ones");
 
-	for (const auto &bit : bits)
-		if (bit != RTLIL::State::S1)
-			return false;
-
-	return true;
+	return const_all_words(bits, 0xff, RTLIL::State::S1);
 }
 
 bool RTLIL::Const::is_fully_def() const
 {
 	cover("kernel.rtlil.const.is_fully_def");
 
-	for (const auto &bit : bits)
-		if (bit != RTLIL::State::S0 && bit != RTLIL::State::S1)
-			return false;
-
-	return true;
+	// S0 and S1 are the only states below 2
+	return const_all_words(bits, 0xfe, 0);
 }
 
 bool RTLIL::Const::is_fully_undef() const
 {
 	cover("kernel.rtlil.const.is_fully_undef");
 
-	for (const auto &bit : bits)
-		if (bit != RTLIL::State::Sx && bit != RTLIL::State::Sz)
-			return false;
-
-	return true;
+	// Sx and Sz are the only states that are 2 or 3
+	return const_all_words(bits, 0xfe, RTLIL::State::Sx);
 }
 
 bool RTLIL::Const::is_fully_undef_x_only() const
 {
 	cover("kernel.rtlil.const.is_fully_undef_x_only");
 
-	for (const auto &bit : bits)
-		if (bit != RTLIL::State::Sx)
-			return false;
-
-	return true;
+	return const_all_words(bits, 0xff, RTLIL::State::Sx);
 }
 
 bool RTLIL::Const::is_onehot(int *pos) const
@@ -489,6 +632,61 @@ pool<string> RTLIL::AttrObject::get_strpool_attribute(const RTLIL::IdString &id)
 	return data;
 }
 
+RTLIL::SrcSet RTLIL::AttrObject::get_src_set() const
+{
+	auto it = attributes.find(ID::src);
+	return it == attributes.end() ? RTLIL::SrcSet() : RTLIL::SrcSet(it->second);
+}
+
+void RTLIL::AttrObject::add_src_attribute(const RTLIL::SrcSet &src)
+{
+	RTLIL::SrcSet union_data = get_src_set();
+	union_data.insert(src);
+	if (!union_data.empty())
+		set_string_attribute(ID::src, union_data.str());
+}
+
+// The locations are never removed from the table, their number is bounded by
+// the size of the sources.
+static idict<std::string> src_locations;
+static RTLIL::IdString::id_mutex_t src_locations_mutex;
+
+RTLIL::SrcSet::SrcSet(const RTLIL::Const &src)
+{
+	std::vector<std::string> tokens = split_tokens(src.decode_string(), "|");
+	RTLIL::IdString::id_lock_t lock(src_locations_mutex);
+	for (auto &token : tokens)
+		locations.insert(src_locations(token));
+}
+
+std::string RTLIL::SrcSet::str() const
+{
+	std::string result;
+	RTLIL::IdString::id_lock_t lock(src_locations_mutex);
+	for (int loc : locations) {
+		if (!result.empty())
+			result += "|";
+		result += src_locations[loc];
+	}
+	return result;
+}
+
+void RTLIL::SrcSet::add_to(RTLIL::AttrObject *obj) const
+{
+	auto it = obj->attributes.find(ID::src);
+	if (it == obj->attributes.end())
+		return;
+
+	auto cached = add_cache_.find(it->second);
+	if (cached == add_cache_.end()) {
+		RTLIL::SrcSet union_data(it->second);
+		union_data.insert(*this);
+		RTLIL::Const value = union_data.empty() ? it->second : RTLIL::Const(union_data.str());
+		cached = add_cache_.emplace(it->second, value).first;
+	}
+	it->second = cached->second;
+}
+
 void RTLIL::AttrObject::set_hdlname_attribute(const vector<string> &hierarchy)
 {
 	string attrval;
@@ -592,6 +790,9 @@ void RTLIL::Selection::optimize(RTLIL::Design *design)
 	for (auto mod_name : del_list)
 		selected_members.erase(mod_name);
 
+	for (auto &it : selected_members)
+		design->load_lazy(it.first);
+
 	for (auto &it : selected_members) {
 		del_list.clear();
 		for (auto memb_name : it.second)
@@ -626,7 +827,7 @@ void RTLIL::Selection::optimize(RTLIL::Design *design)
 RTLIL::Design::Design()
   : verilog_defines (new define_map_t)
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 
@@ -663,19 +864,53 @@ std::map<unsigned int, RTLIL::Design*> *RTLIL::Design::get_all_designs(void)
 
 RTLIL::ObjRange<RTLIL::Module*> RTLIL::Design::modules()
 {
+	load_lazy();
 	return RTLIL::ObjRange<RTLIL::Module*>(&modules_, &refcount_modules_);
 }
 
 RTLIL::Module *RTLIL::Design::module(const RTLIL::IdString& name)
 {
+	load_lazy(name);
 	return modules_.count(name) ? modules_.at(name) : NULL;
 }
 
 const RTLIL::Module *RTLIL::Design::module(const RTLIL::IdString& name) const
 {
+	load_lazy(name);
 	return modules_.count(name) ? modules_.at(name) : NULL;
 }
 
+void RTLIL::Design::add_lazy(RTLIL::Module *module, std::function<void(RTLIL::Module*)> loader)
+{
+	add(module);
+	lazy_modules_[module->name] = std::move(loader);
+}
+
+void RTLIL::Design::load_lazy(const RTLIL::IdString &name) const
+{
+	auto it = lazy_modules_.find(name);
+	if (it == lazy_modules_.end())
+		return;
+
+	// loading modifies the design and logs, which worker threads must not do
+	// (Pass::execute_modules() loads all lazy modules before it starts them)
+	log_assert(!IdString::concurrent_);
+
+	// remove the entry first, the loader may look up other modules
+	std::function<void(RTLIL::Module*)> loader = std::move(it->second);
+	lazy_modules_.erase(it);
+
+	RTLIL::Module *module = modules_.at(name);
+	log("Loading contents of lazy module %s.\n", log_id(module));
+	loader(module);
+}
+
+void RTLIL::Design::load_lazy() const
+{
+	while (!lazy_modules_.empty())
+		load_lazy(lazy_modules_.begin()->first);
+}
+
 RTLIL::Module *RTLIL::Design::top_module()
 {
 	RTLIL::Module *module = nullptr;
@@ -813,11 +1048,13 @@ void RTLIL::Design::remove(RTLIL::Module *module)
 	log_assert(modules_.at(module->name) == module);
 	log_assert(refcount_modules_ == 0);
 	modules_.erase(module->name);
+	lazy_modules_.erase(module->name);
 	delete module;
 }
 
 void RTLIL::Design::rename(RTLIL::Module *module, RTLIL::IdString new_name)
 {
+	load_lazy(module->name);
 	modules_.erase(module->name);
 	module->name = new_name;
 	add(module);
@@ -825,6 +1062,7 @@ void RTLIL::Design::rename(RTLIL::Module *module, RTLIL::IdString new_name)
 
 void RTLIL::Design::sort()
 {
+	load_lazy();
 	scratchpad.sort();
 	modules_.sort(sort_by_id_str());
 	for (auto &it : modules_)
@@ -834,6 +1072,7 @@ void RTLIL::Design::sort()
 void RTLIL::Design::check()
 {
 #ifndef NDEBUG
+	// does not load lazy modules, this runs after every command
 	for (auto &it : modules_) {
 		log_assert(this == it.second->design);
 		log_assert(it.first == it.second->name);
@@ -845,6 +1084,7 @@ void RTLIL::Design::check()
 
 void RTLIL::Design::optimize()
 {
+	load_lazy();
 	for (auto &it : modules_)
 		it.second->optimize();
 	for (auto &it : selection_stack)
@@ -895,8 +1135,10 @@ std::vector<RTLIL::Module*> RTLIL::Design::selected_modules() const
 	std::vector<RTLIL::Module*> result;
 	result.reserve(modules_.size());
 	for (auto &it : modules_)
-		if (selected_module(it.first) && !it.second->get_blackbox_attribute())
+		if (selected_module(it.first) && !it.second->get_blackbox_attribute()) {
+			load_lazy(it.first);
 			result.push_back(it.second);
+		}
 	return result;
 }
 
@@ -905,8 +1147,10 @@ std::vector<RTLIL::Module*> RTLIL::Design::selected_whole_modules() const
 	std::vector<RTLIL::Module*> result;
 	result.reserve(modules_.size());
 	for (auto &it : modules_)
-		if (selected_whole_module(it.first) && !it.second->get_blackbox_attribute())
+		if (selected_whole_module(it.first) && !it.second->get_blackbox_attribute()) {
+			load_lazy(it.first);
 			result.push_back(it.second);
+		}
 	return result;
 }
 
@@ -917,22 +1161,26 @@ std::vector<RTLIL::Module*> RTLIL::Design::selected_whole_modules_warn(bool incl
 	for (auto &it : modules_)
 		if (it.second->get_blackbox_attribute(include_wb))
 			continue;
-		else if (selected_whole_module(it.first))
+		else if (selected_whole_module(it.first)) {
+			load_lazy(it.first);
 			result.push_back(it.second);
-		else if (selected_module(it.first))
+		} else if (selected_module(it.first))
 			log_warning("Ignoring partially selected module %s.\n", log_id(it.first));
 	return result;
 }
 
 RTLIL::Module::Module()
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 
 	design = nullptr;
 	refcount_wires_ = 0;
 	refcount_cells_ = 0;
+	batch_depth_ = 0;
+	batch_monitored_ = false;
+	batch_connections_start_ = 0;
 
 #ifdef WITH_PYTHON
 	RTLIL::Module::get_all_modules()->insert(std::pair<unsigned int, RTLIL::Module*>(hashidx_, this));
@@ -942,11 +1190,13 @@ RTLIL::Module::Module()
 RTLIL::Module::~Module()
 {
 	for (auto &pr : wires_)
-		delete pr.second;
+		destroy(pr.second);
 	for (auto &pr : memories)
 		delete pr.second;
 	for (auto &pr : cells_)
-		delete pr.second;
+		destroy(pr.second);
+	for (auto cell : batch_removed_cells_)
+		destroy(cell);
 	for (auto &pr : processes)
 		delete pr.second;
 	for (auto binding : bindings_)
@@ -977,7 +1227,7 @@ void RTLIL::Module::makeblackbox()
 	memories.clear();
 
 	for (auto it = cells_.begin(); it != cells_.end(); ++it)
-		delete it->second;
+		destroy(it->second);
 	cells_.clear();
 
 	for (auto it = processes.begin(); it != processes.end(); ++it)
@@ -2070,6 +2320,10 @@ void RTLIL::Module::cloneInto(RTLIL::Module *new_mod) const
 	new_mod->avail_parameters = avail_parameters;
 	new_mod->parameter_default_values = parameter_default_values;
 
+	new_mod->connections_.reserve(new_mod->connections_.size() + connections_.size());
+	new_mod->wires_.reserve(new_mod->wires_.size() + wires_.size());
+	new_mod->cells_.reserve(new_mod->cells_.size() + cells_.size());
+
 	for (auto &conn : connections_)
 		new_mod->connect(conn);
 
@@ -2093,6 +2347,11 @@ void RTLIL::Module::cloneInto(RTLIL::Module *new_mod) const
 		RTLIL::Module *mod;
 		void operator()(RTLIL::SigSpec &sig)
 		{
+			if (sig.is_inline()) {
+				if (sig.bit_.wire != NULL)
+					sig.bit_.wire = mod->wires_.at(sig.bit_.wire->name);
+				return;
+			}
 			sig.pack();
 			for (auto &c : sig.chunks_)
 				if (c.wire != NULL)
@@ -2174,6 +2433,20 @@ void RTLIL::Module::add(RTLIL::Cell *cell)
 	log_assert(refcount_cells_ == 0);
 	cells_[cell->name] = cell;
 	cell->module = this;
+	if (batch_monitored_)
+		batch_added_cells_.insert(cell);
+}
+
+void RTLIL::Module::destroy(RTLIL::Wire *wire)
+{
+	wire->~Wire();
+	wire_pool_.deallocate(wire);
+}
+
+void RTLIL::Module::destroy(RTLIL::Cell *cell)
+{
+	cell->~Cell();
+	cell_pool_.deallocate(cell);
 }
 
 void RTLIL::Module::add(RTLIL::Process *process)
@@ -2193,6 +2466,7 @@ void RTLIL::Module::add(RTLIL::Binding *binding)
 void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 {
 	log_assert(refcount_wires_ == 0);
+	log_assert(batch_removed_cells_.empty());
 
 	struct DeleteWireWorker
 	{
@@ -2201,6 +2475,7 @@ void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 
 		void operator()(RTLIL::SigSpec &sig) {
 			sig.pack();
+			sig.hash_ = 0;
 			for (auto &c : sig.chunks_)
 				if (c.wire != NULL && wires_p->count(c.wire)) {
 					c.wire = module->addWire(stringf("$delete_wire$%d", autoidx++), c.width);
@@ -2216,6 +2491,13 @@ void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 		}
 	};
 
+	for (auto mon : monitors)
+		mon->notify_remove(this, wires);
+
+	if (design)
+		for (auto mon : design->monitors)
+			mon->notify_remove(this, wires);
+
 	DeleteWireWorker delete_wire_worker;
 	delete_wire_worker.module = this;
 	delete_wire_worker.wires_p = &wires;
@@ -2224,19 +2506,29 @@ void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 	for (auto &it : wires) {
 		log_assert(wires_.count(it->name) != 0);
 		wires_.erase(it->name);
-		delete it;
+		destroy(it);
 	}
 }
 
 void RTLIL::Module::remove(RTLIL::Cell *cell)
 {
-	while (!cell->connections_.empty())
-		cell->unsetPort(cell->connections_.begin()->first);
+	PassProfiler::Zone zone("Module::remove");
+	if (batch_depth_ == 0) {
+		while (!cell->connections_.empty())
+			cell->unsetPort(cell->connections_.begin()->first);
+	}
 
 	log_assert(cells_.count(cell->name) != 0);
 	log_assert(refcount_cells_ == 0);
 	cells_.erase(cell->name);
-	delete cell;
+
+	// monitors learn about the removal of cells that existed before the
+	// batch in commit_batch(), cells added in the batch were never reported
+	if (batch_monitored_ && !batch_added_cells_.erase(cell)) {
+		batch_removed_cells_.push_back(cell);
+		return;
+	}
+	destroy(cell);
 }
 
 void RTLIL::Module::remove(RTLIL::Process *process)
@@ -2341,13 +2633,15 @@ static bool fixup_ports_compare(const RTLIL::Wire *a, const RTLIL::Wire *b)
 
 void RTLIL::Module::connect(const RTLIL::SigSig &conn)
 {
-	for (auto mon : monitors)
-		mon->notify_connect(this, conn);
-
-	if (design)
-		for (auto mon : design->monitors)
+	if (!batch_monitored_) {
+		for (auto mon : monitors)
 			mon->notify_connect(this, conn);
 
+		if (design)
+			for (auto mon : design->monitors)
+				mon->notify_connect(this, conn);
+	}
+
 	// ignore all attempts to assign constants to other constants
 	if (conn.first.has_const()) {
 		RTLIL::SigSig new_conn;
@@ -2392,6 +2686,7 @@ void RTLIL::Module::new_connections(const std::vector<RTLIL::SigSig> &new_conn)
 	}
 
 	connections_ = new_conn;
+	batch_connections_start_ = GetSize(connections_);
 }
 
 const std::vector<RTLIL::SigSig> &RTLIL::Module::connections() const
@@ -2399,6 +2694,300 @@ const std::vector<RTLIL::SigSig> &RTLIL::Module::connections() const
 	return connections_;
 }
 
+void RTLIL::Monitor::notify_batch(RTLIL::Module *module, const pool<RTLIL::Cell*> &added_cells,
+		const std::vector<RTLIL::Cell*> &removed_cells, const std::vector<RTLIL::SigSig> &connections)
+{
+	for (auto cell : removed_cells)
+		for (auto &conn : cell->connections_)
+			notify_connect(cell, conn.first, conn.second, RTLIL::SigSpec());
+	for (auto cell : added_cells)
+		for (auto &conn : cell->connections_)
+			notify_connect(cell, conn.first, RTLIL::SigSpec(), conn.second);
+	for (auto &conn : connections)
+		notify_connect(module, conn);
+}
+
+void RTLIL::Module::begin_batch(int num_cells, int num_wires, int num_connections)
+{
+	if (batch_depth_++ > 0)
+		return;
+
+	batch_monitored_ = !monitors.empty() || (design && !design->monitors.empty());
+	batch_connections_start_ = GetSize(connections_);
+
+	if (num_cells > 0)
+		cells_.reserve(cells_.size() + num_cells);
+	if (num_wires > 0)
+		wires_.reserve(wires_.size() + num_wires);
+	if (num_connections > 0)
+		connections_.reserve(connections_.size() + num_connections);
+}
+
+void RTLIL::Module::commit_batch()
+{
+	log_assert(batch_depth_ > 0);
+	if (--batch_depth_ > 0)
+		return;
+
+	if (batch_monitored_)
+	{
+		int start = std::min(batch_connections_start_, GetSize(connections_));
+		std::vector<RTLIL::SigSig> new_conns(connections_.begin() + start, connections_.end());
+
+		for (auto mon : monitors)
+			mon->notify_batch(this, batch_added_cells_, batch_removed_cells_, new_conns);
+
+		if (design)
+			for (auto mon : design->monitors)
+				mon->notify_batch(this, batch_added_cells_, batch_removed_cells_, new_conns);
+
+		for (auto cell : batch_removed_cells_)
+			destroy(cell);
+	}
+
+	batch_monitored_ = false;
+	batch_added_cells_.clear();
+	batch_removed_cells_.clear();
+}
+
+// The content hash is built from 64-bit hashes of the individual objects
+// that are combined by addition where the order should not matter. Names
+// are hashed by their string, never by their IdString index.
+
+static uint64_t content_hash_mix(uint64_t h)
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebull;
+	h ^= h >> 31;
+	return h;
+}
+
+static uint64_t content_hash(uint64_t a, uint64_t b)
+{
+	return content_hash_mix(a * 0x9e3779b97f4a7c15ull + b);
+}
+
+static uint64_t content_hash_id(RTLIL::IdString id)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (const char *p = id.c_str(); *p; p++)
+		h = (h ^ (unsigned char)*p) * 0x100000001b3ull;
+	return content_hash_mix(h);
+}
+
+static uint64_t content_hash_bits(const std::vector<RTLIL::State> &bits)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (auto bit : bits)
+		h = (h ^ (uint64_t)bit) * 0x100000001b3ull;
+	return content_hash(GetSize(bits), h);
+}
+
+static uint64_t content_hash_attrs(const dict<RTLIL::IdString, RTLIL::Const> &attrs)
+{
+	uint64_t sum = 0;
+	for (auto &it : attrs)
+		sum += content_hash(content_hash_id(it.first), content_hash(it.second.flags, content_hash_bits(it.second.bits)));
+	return sum;
+}
+
+RTLIL::ModuleHash::ModuleHash(RTLIL::Module *module, bool incremental) :
+		module(module), incremental(incremental), dirty(true), conn_sum(0)
+{
+	if (incremental)
+		module->monitors.insert(this);
+}
+
+RTLIL::ModuleHash::~ModuleHash()
+{
+	if (incremental)
+		module->monitors.erase(this);
+}
+
+uint64_t RTLIL::ModuleHash::wire_hash(RTLIL::Wire *wire)
+{
+	auto it = wire_names.find(wire);
+	if (it != wire_names.end())
+		return it->second.second;
+	uint64_t h = content_hash_id(wire->name);
+	wire_names[wire] = std::make_pair(wire->name, h);
+	return h;
+}
+
+uint64_t RTLIL::ModuleHash::sig_hash(const RTLIL::SigSpec &sig)
+{
+	uint64_t h = content_hash(1, sig.size());
+	for (auto &chunk : sig.chunks())
+		if (chunk.wire)
+			h = content_hash(h, content_hash(wire_hash(chunk.wire), (uint64_t)chunk.offset << 32 | chunk.width));
+		else
+			h = content_hash(h, content_hash_bits(chunk.data));
+	return h;
+}
+
+uint64_t RTLIL::ModuleHash::port_hash(RTLIL::IdString cell_name, RTLIL::IdString port, const RTLIL::SigSpec &sig)
+{
+	if (sig.empty())
+		return 0;
+	return content_hash(content_hash(content_hash_id(cell_name), content_hash_id(port)), sig_hash(sig));
+}
+
+uint64_t RTLIL::ModuleHash::conn_hash(const RTLIL::SigSig &conn)
+{
+	// hashed bit by bit, so that splitting or merging connections does
+	// not change the hash
+	std::vector<RTLIL::SigBit> lhs = conn.first.to_sigbit_vector();
+	std::vector<RTLIL::SigBit> rhs = conn.second.to_sigbit_vector();
+	uint64_t sum = 0;
+	for (int i = 0; i < GetSize(lhs) && i < GetSize(rhs); i++) {
+		uint64_t l = lhs[i].wire ? content_hash(wire_hash(lhs[i].wire), lhs[i].offset) : content_hash(2, lhs[i].data);
+		uint64_t r = rhs[i].wire ? content_hash(wire_hash(rhs[i].wire), rhs[i].offset) : content_hash(2, rhs[i].data);
+		sum += content_hash(l, r);
+	}
+	return sum;
+}
+
+uint64_t RTLIL::ModuleHash::case_hash(const RTLIL::CaseRule *cs)
+{
+	uint64_t h = content_hash(3, content_hash_attrs(cs->attributes));
+	for (auto &sig : cs->compare)
+		h = content_hash(h, sig_hash(sig));
+	h = content_hash(h, GetSize(cs->compare));
+	for (auto &action : cs->actions)
+		h = content_hash(h, content_hash(sig_hash(action.first), sig_hash(action.second)));
+	for (auto sw : cs->switches) {
+		uint64_t sw_h = content_hash(content_hash_attrs(sw->attributes), sig_hash(sw->signal));
+		for (auto c : sw->cases)
+			sw_h = content_hash(sw_h, case_hash(c));
+		h = content_hash(h, sw_h);
+	}
+	return h;
+}
+
+uint64_t RTLIL::ModuleHash::hash()
+{
+	if (!incremental)
+		dirty = true;
+
+	// renamed wires are not reported to monitors, the hashes of all
+	// signals using them would need to be updated
+	if (!dirty)
+		for (auto &it : wire_names)
+			if (it.first->name != it.second.first) {
+				dirty = true;
+				break;
+			}
+
+	if (dirty) {
+		cell_names.clear();
+		wire_names.clear();
+		conn_sum = 0;
+		for (auto cell : module->cells()) {
+			cell_names[cell] = cell->name;
+			for (auto &conn : cell->connections())
+				conn_sum += port_hash(cell->name, conn.first, conn.second);
+		}
+		for (auto &conn : module->connections())
+			conn_sum += conn_hash(conn);
+		dirty = false;
+	} else {
+		// rehash the ports of renamed cells and forget removed cells
+		dict<RTLIL::Cell*, RTLIL::IdString> new_cell_names;
+		for (auto cell : module->cells()) {
+			auto it = cell_names.find(cell);
+			if (it == cell_names.end())
+				continue;
+			if (it->second != cell->name)
+				for (auto &conn : cell->connections())
+					conn_sum += port_hash(cell->name, conn.first, conn.second) - port_hash(it->second, conn.first, conn.second);
+			new_cell_names[cell] = cell->name;
+		}
+		cell_names.swap(new_cell_names);
+	}
+
+	uint64_t h = content_hash(4, conn_sum);
+
+	uint64_t sum = 0;
+	for (auto wire : module->wires()) {
+		uint64_t flags = wire->port_id << 4 | wire->port_input << 3 | wire->port_output << 2 | wire->upto << 1 | wire->is_signed;
+		sum += content_hash(content_hash(wire_hash(wire), content_hash(wire->width, wire->start_offset)),
+				content_hash(flags, content_hash_attrs(wire->attributes)));
+	}
+	h = content_hash(h, sum);
+
+	sum = 0;
+	for (auto cell : module->cells()) {
+		uint64_t params = 0;
+		for (auto &it : cell->parameters)
+			params += content_hash(content_hash_id(it.first), content_hash(it.second.flags, content_hash_bits(it.second.bits)));
+		sum += content_hash(content_hash(content_hash_id(cell->name), content_hash_id(cell->type)),
+				content_hash(params, content_hash_attrs(cell->attributes)));
+	}
+	h = content_hash(h, sum);
+
+	sum = 0;
+	for (auto &it : module->memories) {
+		RTLIL::Memory *mem = it.second;
+		sum += content_hash(content_hash(content_hash_id(mem->name), content_hash(mem->width, mem->start_offset)),
+				content_hash(mem->size, content_hash_attrs(mem->attributes)));
+	}
+	h = content_hash(h, sum);
+
+	sum = 0;
+	for (auto &it : module->processes) {
+		RTLIL::Process *proc = it.second;
+		uint64_t proc_h = content_hash(content_hash_id(proc->name), content_hash_attrs(proc->attributes));
+		proc_h = content_hash(proc_h, case_hash(&proc->root_case));
+		for (auto sync : proc->syncs) {
+			uint64_t sync_h = content_hash(sync->type, sig_hash(sync->signal));
+			for (auto &action : sync->actions)
+				sync_h = content_hash(sync_h, content_hash(sig_hash(action.first), sig_hash(action.second)));
+			for (auto &mwa : sync->mem_write_actions) {
+				uint64_t mwa_h = content_hash(content_hash_id(mwa.memid), content_hash_attrs(mwa.attributes));
+				mwa_h = content_hash(mwa_h, content_hash(sig_hash(mwa.address), sig_hash(mwa.data)));
+				mwa_h = content_hash(mwa_h, content_hash(sig_hash(mwa.enable), content_hash_bits(mwa.priority_mask.bits)));
+				sync_h = content_hash(sync_h, mwa_h);
+			}
+			proc_h = content_hash(proc_h, sync_h);
+		}
+		sum += proc_h;
+	}
+	h = content_hash(h, sum);
+
+	sum = 0;
+	for (auto &it : module->parameter_default_values)
+		sum += content_hash(content_hash_id(it.first), content_hash(it.second.flags, content_hash_bits(it.second.bits)));
+	for (auto param : module->avail_parameters)
+		sum += content_hash(5, content_hash_id(param));
+	h = content_hash(h, sum);
+
+	return content_hash(h, content_hash_attrs(module->attributes));
+}
+
+void RTLIL::ModuleHash::notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &port, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig)
+{
+	if (dirty)
+		return;
+	auto it = cell_names.find(cell);
+	if (it == cell_names.end())
+		it = cell_names.emplace(cell, cell->name).first;
+	conn_sum += port_hash(it->second, port, sig) - port_hash(it->second, port, old_sig);
+}
+
+void RTLIL::ModuleHash::notify_connect(RTLIL::Module*, const RTLIL::SigSig &conn)
+{
+	if (!dirty)
+		conn_sum += conn_hash(conn);
+}
+
+uint64_t RTLIL::Module::content_hash() const
+{
+	RTLIL::ModuleHash module_hash(const_cast<RTLIL::Module*>(this), false);
+	return module_hash.hash();
+}
+
 void RTLIL::Module::fixup_ports()
 {
 	std::vector<RTLIL::Wire*> all_ports;
@@ -2420,7 +3009,7 @@ void RTLIL::Module::fixup_ports()
 
 RTLIL::Wire *RTLIL::Module::addWire(RTLIL::IdString name, int width)
 {
-	RTLIL::Wire *wire = new RTLIL::Wire;
+	RTLIL::Wire *wire = new (wire_pool_.allocate()) RTLIL::Wire;
 	wire->name = name;
 	wire->width = width;
 	add(wire);
@@ -2443,7 +3032,8 @@ RTLIL::Wire *RTLIL::Module::addWire(RTLIL::IdString name, const RTLIL::Wire *oth
 
 RTLIL::Cell *RTLIL::Module::addCell(RTLIL::IdString name, RTLIL::IdString type)
 {
-	RTLIL::Cell *cell = new RTLIL::Cell;
+	PassProfiler::Zone zone("Module::addCell");
+	RTLIL::Cell *cell = new (cell_pool_.allocate()) RTLIL::Cell;
 	cell->name = name;
 	cell->type = type;
 	add(cell);
@@ -3439,7 +4029,7 @@ RTLIL::SigSpec RTLIL::Module::FutureFF(RTLIL::IdString name, const RTLIL::SigSpe
 
 RTLIL::Wire::Wire()
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 
@@ -3474,7 +4064,7 @@ std::map<unsigned int, RTLIL::Wire*> *RTLIL::Wire::get_all_wires(void)
 
 RTLIL::Memory::Memory()
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 
@@ -3488,14 +4078,14 @@ RTLIL::Memory::Memory()
 
 RTLIL::Process::Process() : module(nullptr)
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 }
 
 RTLIL::Cell::Cell() : module(nullptr)
 {
-	static unsigned int hashidx_count = 123456789;
+	static thread_local unsigned int hashidx_count = 123456789;
 	hashidx_count = mkhash_xorshift(hashidx_count);
 	hashidx_ = hashidx_count;
 
@@ -3534,13 +4124,15 @@ void RTLIL::Cell::unsetPort(const RTLIL::IdString& portname)
 
 	if (conn_it != connections_.end())
 	{
-		for (auto mon : module->monitors)
-			mon->notify_connect(this, conn_it->first, conn_it->second, signal);
-
-		if (module->design)
-			for (auto mon : module->design->monitors)
+		if (!module->batch_monitored_ || !module->batch_added_cells_.count(this)) {
+			for (auto mon : module->monitors)
 				mon->notify_connect(this, conn_it->first, conn_it->second, signal);
 
+			if (module->design)
+				for (auto mon : module->design->monitors)
+					mon->notify_connect(this, conn_it->first, conn_it->second, signal);
+		}
+
 		if (yosys_xtrace) {
 			log("#X# Unconnect %s.%s.%s\n", log_id(this->module), log_id(this), log_id(portname));
 			log_backtrace("-X- ", yosys_xtrace-1);
@@ -3557,13 +4149,15 @@ void RTLIL::Cell::setPort(const RTLIL::IdString& portname, RTLIL::SigSpec signal
 	if (!r.second && conn_it->second == signal)
 		return;
 
-	for (auto mon : module->monitors)
-		mon->notify_connect(this, conn_it->first, conn_it->second, signal);
-
-	if (module->design)
-		for (auto mon : module->design->monitors)
+	if (!module->batch_monitored_ || !module->batch_added_cells_.count(this)) {
+		for (auto mon : module->monitors)
 			mon->notify_connect(this, conn_it->first, conn_it->second, signal);
 
+		if (module->design)
+			for (auto mon : module->design->monitors)
+				mon->notify_connect(this, conn_it->first, conn_it->second, signal);
+	}
+
 	if (yosys_xtrace) {
 		log("#X# Connect %s.%s.%s = %s (%d)\n", log_id(this->module), log_id(this), log_id(portname), log_signal(signal), GetSize(signal));
 		log_backtrace("-X- ", yosys_xtrace-1);
@@ -3814,7 +4408,10 @@ RTLIL::SigSpec::SigSpec(const RTLIL::Const &value)
 {
 	cover("kernel.rtlil.sigspec.init.const");
 
-	if (GetSize(value) != 0) {
+	if (GetSize(value) == 1) {
+		bit_ = value.bits[0];
+		width_ = 1;
+	} else if (GetSize(value) != 0) {
 		chunks_.emplace_back(value);
 		width_ = chunks_.back().width;
 	} else {
@@ -3828,7 +4425,10 @@ RTLIL::SigSpec::SigSpec(RTLIL::Const &&value)
 {
 	cover("kernel.rtlil.sigspec.init.const.move");
 
-	if (GetSize(value) != 0) {
+	if (GetSize(value) == 1) {
+		bit_ = value.bits[0];
+		width_ = 1;
+	} else if (GetSize(value) != 0) {
 		chunks_.emplace_back(std::move(value));
 		width_ = chunks_.back().width;
 	} else {
@@ -3842,7 +4442,10 @@ RTLIL::SigSpec::SigSpec(const RTLIL::SigChunk &chunk)
 {
 	cover("kernel.rtlil.sigspec.init.chunk");
 
-	if (chunk.width != 0) {
+	if (chunk.width == 1) {
+		bit_ = chunk;
+		width_ = 1;
+	} else if (chunk.width != 0) {
 		chunks_.emplace_back(chunk);
 		width_ = chunks_.back().width;
 	} else {
@@ -3856,7 +4459,10 @@ RTLIL::SigSpec::SigSpec(RTLIL::SigChunk &&chunk)
 {
 	cover("kernel.rtlil.sigspec.init.chunk.move");
 
-	if (chunk.width != 0) {
+	if (chunk.width == 1) {
+		bit_ = chunk;
+		width_ = 1;
+	} else if (chunk.width != 0) {
 		chunks_.emplace_back(std::move(chunk));
 		width_ = chunks_.back().width;
 	} else {
@@ -3870,7 +4476,10 @@ RTLIL::SigSpec::SigSpec(RTLIL::Wire *wire)
 {
 	cover("kernel.rtlil.sigspec.init.wire");
 
-	if (wire->width != 0) {
+	if (wire->width == 1) {
+		bit_ = RTLIL::SigBit(wire, 0);
+		width_ = 1;
+	} else if (wire->width != 0) {
 		chunks_.emplace_back(wire);
 		width_ = chunks_.back().width;
 	} else {
@@ -3884,7 +4493,10 @@ RTLIL::SigSpec::SigSpec(RTLIL::Wire *wire, int offset, int width)
 {
 	cover("kernel.rtlil.sigspec.init.wire_part");
 
-	if (width != 0) {
+	if (width == 1) {
+		bit_ = RTLIL::SigBit(wire, offset);
+		width_ = 1;
+	} else if (width != 0) {
 		chunks_.emplace_back(wire, offset, width);
 		width_ = chunks_.back().width;
 	} else {
@@ -3912,7 +4524,9 @@ RTLIL::SigSpec::SigSpec(int val, int width)
 {
 	cover("kernel.rtlil.sigspec.init.int");
 
-	if (width != 0)
+	if (width == 1)
+		bit_ = (val & 1) != 0 ? RTLIL::State::S1 : RTLIL::State::S0;
+	else if (width != 0)
 		chunks_.emplace_back(val, width);
 	width_ = width;
 	hash_ = 0;
@@ -3923,7 +4537,9 @@ RTLIL::SigSpec::SigSpec(RTLIL::State bit, int width)
 {
 	cover("kernel.rtlil.sigspec.init.state");
 
-	if (width != 0)
+	if (width == 1)
+		bit_ = bit;
+	else if (width != 0)
 		chunks_.emplace_back(bit, width);
 	width_ = width;
 	hash_ = 0;
@@ -3934,7 +4550,9 @@ RTLIL::SigSpec::SigSpec(const RTLIL::SigBit &bit, int width)
 {
 	cover("kernel.rtlil.sigspec.init.bit");
 
-	if (width != 0) {
+	if (width == 1) {
+		bit_ = bit;
+	} else if (width != 0) {
 		if (bit.wire == NULL)
 			chunks_.emplace_back(bit.data, width);
 		else
@@ -4004,8 +4622,13 @@ void RTLIL::SigSpec::pack() const
 {
 	RTLIL::SigSpec *that = (RTLIL::SigSpec*)this;
 
-	if (that->bits_.empty())
+	if (that->bits_.empty()) {
+		if (is_inline()) {
+			cover("kernel.rtlil.sigspec.convert.pack_inline");
+			that->chunks_.emplace_back(bit_);
+		}
 		return;
+	}
 
 	cover("kernel.rtlil.sigspec.convert.pack");
 	log_assert(that->chunks_.empty());
@@ -4040,8 +4663,13 @@ void RTLIL::SigSpec::unpack() const
 {
 	RTLIL::SigSpec *that = (RTLIL::SigSpec*)this;
 
-	if (that->chunks_.empty())
+	if (that->chunks_.empty()) {
+		if (is_inline()) {
+			cover("kernel.rtlil.sigspec.convert.unpack_inline");
+			that->bits_.push_back(bit_);
+		}
 		return;
+	}
 
 	cover("kernel.rtlil.sigspec.convert.unpack");
 	log_assert(that->bits_.empty());
@@ -4051,8 +4679,9 @@ void RTLIL::SigSpec::unpack() const
 		for (int i = 0; i < c.width; i++)
 			that->bits_.emplace_back(c, i);
 
+	// the hash does not depend on the representation, all functions
+	// that modify the signal reset it
 	that->chunks_.clear();
-	that->hash_ = 0;
 }
 
 void RTLIL::SigSpec::updhash() const
@@ -4063,13 +4692,28 @@ void RTLIL::SigSpec::updhash() const
 		return;
 
 	cover("kernel.rtlil.sigspec.hash");
+
+	if (is_inline()) {
+		// same value as for the equivalent single chunk
+		that->hash_ = mkhash_init;
+		if (bit_.wire == NULL) {
+			that->hash_ = mkhash(that->hash_, bit_.data);
+		} else {
+			that->hash_ = mkhash(that->hash_, bit_.wire->name.index_);
+			that->hash_ = mkhash(that->hash_, bit_.offset);
+			that->hash_ = mkhash(that->hash_, 1);
+		}
+		if (that->hash_ == 0)
+			that->hash_ = 1;
+		return;
+	}
+
 	that->pack();
 
 	that->hash_ = mkhash_init;
 	for (auto &c : that->chunks_)
 		if (c.wire == NULL) {
-			for (auto &v : c.data)
-				that->hash_ = mkhash(that->hash_, v);
+			that->hash_ = mkhash(that->hash_, RTLIL::Const::hash_words(c.data));
 		} else {
 			that->hash_ = mkhash(that->hash_, c.wire->name.index_);
 			that->hash_ = mkhash(that->hash_, c.offset);
@@ -4084,6 +4728,7 @@ void RTLIL::SigSpec::sort()
 {
 	unpack();
 	cover("kernel.rtlil.sigspec.sort");
+	hash_ = 0;
 	std::sort(bits_.begin(), bits_.end());
 }
 
@@ -4118,6 +4763,7 @@ void RTLIL::SigSpec::replace(const RTLIL::SigSpec &pattern, const RTLIL::SigSpec
 	with.unpack();
 	unpack();
 	other->unpack();
+	other->hash_ = 0;
 
 	dict<RTLIL::SigBit, int> pattern_to_with;
 	for (int i = 0; i < GetSize(pattern.bits_); i++) {
@@ -4151,6 +4797,7 @@ void RTLIL::SigSpec::replace(const dict<RTLIL::SigBit, RTLIL::SigBit> &rules, RT
 	if (rules.empty()) return;
 	unpack();
 	other->unpack();
+	other->hash_ = 0;
 
 	for (int i = 0; i < GetSize(bits_); i++) {
 		auto it = rules.find(bits_[i]);
@@ -4176,6 +4823,7 @@ void RTLIL::SigSpec::replace(const std::map<RTLIL::SigBit, RTLIL::SigBit> &rules
 	if (rules.empty()) return;
 	unpack();
 	other->unpack();
+	other->hash_ = 0;
 
 	for (int i = 0; i < GetSize(bits_); i++) {
 		auto it = rules.find(bits_[i]);
@@ -4205,9 +4853,11 @@ void RTLIL::SigSpec::remove2(const RTLIL::SigSpec &pattern, RTLIL::SigSpec *othe
 		cover("kernel.rtlil.sigspec.remove");
 
 	unpack();
+	hash_ = 0;
 	if (other != NULL) {
 		log_assert(width_ == other->width_);
 		other->unpack();
+		other->hash_ = 0;
 	}
 
 	for (int i = GetSize(bits_) - 1; i >= 0; i--)
@@ -4250,10 +4900,12 @@ void RTLIL::SigSpec::remove2(const pool<RTLIL::SigBit> &pattern, RTLIL::SigSpec
 		cover("kernel.rtlil.sigspec.remove");
 
 	unpack();
+	hash_ = 0;
 
 	if (other != NULL) {
 		log_assert(width_ == other->width_);
 		other->unpack();
+		other->hash_ = 0;
 	}
 
 	for (int i = GetSize(bits_) - 1; i >= 0; i--) {
@@ -4278,10 +4930,12 @@ void RTLIL::SigSpec::remove2(const std::set<RTLIL::SigBit> &pattern, RTLIL::SigS
 		cover("kernel.rtlil.sigspec.remove");
 
 	unpack();
+	hash_ = 0;
 
 	if (other != NULL) {
 		log_assert(width_ == other->width_);
 		other->unpack();
+		other->hash_ = 0;
 	}
 
 	for (int i = GetSize(bits_) - 1; i >= 0; i--) {
@@ -4306,10 +4960,12 @@ void RTLIL::SigSpec::remove2(const pool<RTLIL::Wire*> &pattern, RTLIL::SigSpec *
 		cover("kernel.rtlil.sigspec.remove");
 
 	unpack();
+	hash_ = 0;
 
 	if (other != NULL) {
 		log_assert(width_ == other->width_);
 		other->unpack();
+		other->hash_ = 0;
 	}
 
 	for (int i = GetSize(bits_) - 1; i >= 0; i--) {
@@ -4394,6 +5050,7 @@ void RTLIL::SigSpec::replace(int offset, const RTLIL::SigSpec &with)
 
 	unpack();
 	with.unpack();
+	hash_ = 0;
 
 	log_assert(offset >= 0);
 	log_assert(with.width_ >= 0);
@@ -4407,6 +5064,10 @@ void RTLIL::SigSpec::replace(int offset, const RTLIL::SigSpec &with)
 
 void RTLIL::SigSpec::remove_const()
 {
+	if (is_inline())
+		pack();
+
+	hash_ = 0;
 	if (packed())
 	{
 		cover("kernel.rtlil.sigspec.remove_const.packed");
@@ -4452,6 +5113,7 @@ void RTLIL::SigSpec::remove(int offset, int length)
 	cover("kernel.rtlil.sigspec.remove_pos");
 
 	unpack();
+	hash_ = 0;
 
 	log_assert(offset >= 0);
 	log_assert(length >= 0);
@@ -4468,6 +5130,8 @@ RTLIL::SigSpec RTLIL::SigSpec::extract(int offset, int length) const
 	log_assert(offset >= 0);
 	log_assert(length >= 0);
 	log_assert(offset + length <= width_);
+	if (length == 1)
+		return (*this)[offset];
 	unpack();
 	cover("kernel.rtlil.sigspec.extract_pos");
 	return std::vector<RTLIL::SigBit>(bits_.begin() + offset, bits_.begin() + offset + length);
@@ -4485,6 +5149,12 @@ void RTLIL::SigSpec::append(const RTLIL::SigSpec &signal)
 
 	cover("kernel.rtlil.sigspec.append");
 
+	hash_ = 0;
+	if (is_inline())
+		pack();
+	if (signal.is_inline())
+		signal.pack();
+
 	if (packed() != signal.packed()) {
 		pack();
 		signal.pack();
@@ -4514,6 +5184,21 @@ void RTLIL::SigSpec::append(const RTLIL::SigSpec &signal)
 
 void RTLIL::SigSpec::append(const RTLIL::SigBit &bit)
 {
+	hash_ = 0;
+	if (width_ == 0)
+	{
+		cover("kernel.rtlil.sigspec.append_bit.inline");
+
+		chunks_.clear();
+		bits_.clear();
+		bit_ = bit;
+		width_ = 1;
+		return;
+	}
+
+	if (is_inline())
+		pack();
+
 	if (packed())
 	{
 		cover("kernel.rtlil.sigspec.append_bit.packed");
@@ -4579,6 +5264,16 @@ void RTLIL::SigSpec::check(Module *mod) const
 	{
 		cover("kernel.rtlil.sigspec.check.skip");
 	}
+	else if (is_inline())
+	{
+		cover("kernel.rtlil.sigspec.check.inline");
+
+		if (bit_.wire != NULL) {
+			log_assert(bit_.offset >= 0 && bit_.offset < bit_.wire->width);
+			if (mod != nullptr)
+				log_assert(bit_.wire->module == mod);
+		}
+	}
 	else if (packed())
 	{
 		cover("kernel.rtlil.sigspec.check.packed");
@@ -4633,6 +5328,24 @@ bool RTLIL::SigSpec::operator <(const RTLIL::SigSpec &other) const
 	if (width_ != other.width_)
 		return width_ < other.width_;
 
+	if (width_ == 1 && (is_inline() || other.is_inline()))
+	{
+		// same order as for the equivalent single chunks, without packing
+		const RTLIL::SigBit &a = (*this)[0], &b = other[0];
+
+		updhash();
+		other.updhash();
+
+		if (hash_ != other.hash_)
+			return hash_ < other.hash_;
+
+		if (a.wire && b.wire && a.wire->name != b.wire->name)
+			return a.wire->name < b.wire->name;
+		if (a.wire != b.wire)
+			return a.wire < b.wire;
+		return a.wire ? a.offset < b.offset : a.data < b.data;
+	}
+
 	pack();
 	other.pack();
 
@@ -4671,6 +5384,11 @@ bool RTLIL::SigSpec::operator ==(const RTLIL::SigSpec &other) const
 	if (width_ == 0)
 		return true;
 
+	if (width_ == 1 && (is_inline() || other.is_inline())) {
+		cover("kernel.rtlil.sigspec.comp_eq.bit");
+		return (*this)[0] == other[0];
+	}
+
 	pack();
 	other.pack();
 
@@ -4697,6 +5415,9 @@ bool RTLIL::SigSpec::is_wire() const
 {
 	cover("kernel.rtlil.sigspec.is_wire");
 
+	if (is_inline())
+		return bit_.wire && bit_.wire->width == 1;
+
 	pack();
 	return GetSize(chunks_) == 1 && chunks_[0].wire && chunks_[0].wire->width == width_;
 }
@@ -4705,6 +5426,9 @@ bool RTLIL::SigSpec::is_chunk() const
 {
 	cover("kernel.rtlil.sigspec.is_chunk");
 
+	if (is_inline())
+		return true;
+
 	pack();
 	return GetSize(chunks_) == 1;
 }
@@ -4713,6 +5437,9 @@ bool RTLIL::SigSpec::is_fully_const() const
 {
 	cover("kernel.rtlil.sigspec.is_fully_const");
 
+	if (is_inline())
+		return bit_.wire == NULL;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++)
 		if (it->width > 0 && it->wire != NULL)
@@ -4724,6 +5451,9 @@ bool RTLIL::SigSpec::is_fully_zero() const
 {
 	cover("kernel.rtlil.sigspec.is_fully_zero");
 
+	if (is_inline())
+		return bit_ == RTLIL::State::S0;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
 		if (it->width > 0 && it->wire != NULL)
@@ -4739,6 +5469,9 @@ bool RTLIL::SigSpec::is_fully_ones() const
 {
 	cover("kernel.rtlil.sigspec.is_fully_ones");
 
+	if (is_inline())
+		return bit_ == RTLIL::State::S1;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
 		if (it->width > 0 && it->wire != NULL)
@@ -4754,6 +5487,9 @@ bool RTLIL::SigSpec::is_fully_def() const
 {
 	cover("kernel.rtlil.sigspec.is_fully_def");
 
+	if (is_inline())
+		return bit_ == RTLIL::State::S0 || bit_ == RTLIL::State::S1;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
 		if (it->width > 0 && it->wire != NULL)
@@ -4769,6 +5505,9 @@ bool RTLIL::SigSpec::is_fully_undef() const
 {
 	cover("kernel.rtlil.sigspec.is_fully_undef");
 
+	if (is_inline())
+		return bit_ == RTLIL::State::Sx || bit_ == RTLIL::State::Sz;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
 		if (it->width > 0 && it->wire != NULL)
@@ -4784,6 +5523,9 @@ bool RTLIL::SigSpec::has_const() const
 {
 	cover("kernel.rtlil.sigspec.has_const");
 
+	if (is_inline())
+		return bit_.wire == NULL;
+
 	pack();
 	for (auto it = chunks_.begin(); it != chunks_.end(); it++)
 		if (it->width > 0 && it->wire == NULL)
@@ -4891,6 +5633,8 @@ RTLIL::SigBit RTLIL::SigSpec::as_bit() const
 	cover("kernel.rtlil.sigspec.as_bit");
 
 	log_assert(width_ == 1);
+	if (is_inline())
+		return bit_;
 	if (packed())
 		return RTLIL::SigBit(*chunks_.begin());
 	else
@@ -5129,7 +5873,7 @@ bool RTLIL::SigSpec::parse_rhs(const RTLIL::SigSpec &lhs, RTLIL::SigSpec &sig, R
 		return true;
 	}
 
-	if (lhs.chunks_.size() == 1) {
+	if (lhs.is_chunk()) {
 		char *p = (char*)str.c_str(), *endptr;
 		long int val = strtol(p, &endptr, 10);
 		if (endptr && endptr != p && *endptr == 0) {
@@ -22,6 +22,8 @@
 #ifndef RTLIL_H
 #define RTLIL_H
 
+#include "kernel/objpool.h"
+
 YOSYS_NAMESPACE_BEGIN
 
 namespace RTLIL
@@ -55,8 +57,10 @@ namespace RTLIL
 
 	struct Const;
 	struct AttrObject;
+	struct SrcSet;
 	struct Selection;
 	struct Monitor;
+	struct ModuleHash;
 	struct Design;
 	struct Module;
 	struct Wire;
@@ -91,11 +95,54 @@ namespace RTLIL
 			~destruct_guard_t() { destruct_guard_ok = false; }
 		} destruct_guard;
 
-		static std::vector<char*> global_id_storage_;
-		static dict<char*, int, hash_cstr_ops> global_id_index_;
+		// Id strings are stored in fixed-size pages that are never moved, so that
+		// c_str() does not need any locking while other threads create new ids.
+		// The index from string to id is split into shards with separate locks.
+		// A negative reference count marks an immortal id (see immortal()).
+
+		enum : int {
+			id_page_bits = 16,
+			id_page_size = 1 << id_page_bits,
+			id_max_pages = 1 << 14,
+			id_num_shards = 64,
+			id_immortal_refcount = INT_MIN / 2
+		};
+
+	#ifdef YOSYS_ENABLE_THREADS
+		// Set while worker threads may create, copy or destroy ids (see
+		// begin_concurrent() and end_concurrent()).
+		static bool concurrent_;
+		typedef std::mutex id_mutex_t;
+	#else
+		static constexpr bool concurrent_ = false;
+		struct id_mutex_t { void lock() { } void unlock() { } };
+	#endif
+
+		struct id_lock_t {
+			id_mutex_t *mutex;
+			id_lock_t(id_mutex_t &m) : mutex(concurrent_ ? &m : nullptr) { if (mutex) mutex->lock(); }
+			~id_lock_t() { if (mutex) mutex->unlock(); }
+		};
+
+		struct id_entry_t {
+			char *str;
+		#ifndef YOSYS_NO_IDS_REFCNT
+			std::atomic<int> refcount;
+		#endif
+		};
+
+		struct id_shard_t {
+			dict<char*, int, hash_cstr_ops> index;
+			id_mutex_t mutex;
+		};
+
+		static id_entry_t *global_id_pages_[id_max_pages];
+		static int global_id_count_;
+		static id_shard_t global_id_shards_[id_num_shards];
+		static id_mutex_t global_id_alloc_mutex_;
 	#ifndef YOSYS_NO_IDS_REFCNT
-		static std::vector<int> global_refcount_storage_;
 		static std::vector<int> global_free_idx_list_;
+		static std::vector<int> global_pending_free_idx_list_;
 	#endif
 
 	#ifdef YOSYS_USE_STICKY_IDS
@@ -103,15 +150,38 @@ namespace RTLIL
 		static int last_created_idx_[8];
 	#endif
 
+		static inline id_entry_t &global_id_entry(int idx) {
+			return global_id_pages_[idx >> id_page_bits][idx & (id_page_size - 1)];
+		}
+
+		static inline id_shard_t &global_id_shard(const char *p) {
+			return global_id_shards_[hash_cstr_ops::hash(p) % id_num_shards];
+		}
+
+		static inline int global_id_refcount(int idx) {
+		#ifndef YOSYS_NO_IDS_REFCNT
+			return global_id_entry(idx).refcount.load(std::memory_order_relaxed);
+		#else
+			(void)idx;
+			return 0;
+		#endif
+		}
+
+		// Called by the kernel before and after running worker threads. Ids
+		// that lose their last reference while in concurrent mode are kept
+		// alive until end_concurrent() is called.
+		static void begin_concurrent();
+		static void end_concurrent();
+
 		static inline void xtrace_db_dump()
 		{
 		#ifdef YOSYS_XTRACE_GET_PUT
-			for (int idx = 0; idx < GetSize(global_id_storage_); idx++)
+			for (int idx = 0; idx < global_id_count_; idx++)
 			{
-				if (global_id_storage_.at(idx) == nullptr)
+				if (global_id_entry(idx).str == nullptr)
 					log("#X# DB-DUMP index %d: FREE\n", idx);
 				else
-					log("#X# DB-DUMP index %d: '%s' (ref %d)\n", idx, global_id_storage_.at(idx), global_refcount_storage_.at(idx));
+					log("#X# DB-DUMP index %d: '%s' (ref %d)\n", idx, global_id_entry(idx).str, global_id_refcount(idx));
 			}
 		#endif
 		}
@@ -135,11 +205,18 @@ namespace RTLIL
 		{
 			if (idx) {
 		#ifndef YOSYS_NO_IDS_REFCNT
-				global_refcount_storage_[idx]++;
+				std::atomic<int> &refcount = global_id_entry(idx).refcount;
+				int count = refcount.load(std::memory_order_relaxed);
+				if (count >= 0) {
+					if (concurrent_)
+						refcount.fetch_add(1, std::memory_order_relaxed);
+					else
+						refcount.store(count + 1, std::memory_order_relaxed);
+				}
 		#endif
 		#ifdef YOSYS_XTRACE_GET_PUT
 				if (yosys_xtrace)
-					log("#X# GET-BY-INDEX '%s' (index %d, refcount %d)\n", global_id_storage_.at(idx), idx, global_refcount_storage_.at(idx));
+					log("#X# GET-BY-INDEX '%s' (index %d, refcount %d)\n", global_id_entry(idx).str, idx, global_id_refcount(idx));
 		#endif
 			}
 			return idx;
@@ -152,112 +229,71 @@ namespace RTLIL
 			if (!p[0])
 				return 0;
 
-			auto it = global_id_index_.find((char*)p);
-			if (it != global_id_index_.end()) {
-		#ifndef YOSYS_NO_IDS_REFCNT
-				global_refcount_storage_.at(it->second)++;
-		#endif
+			id_shard_t &shard = global_id_shard(p);
+			id_lock_t lock(shard.mutex);
+
+			auto it = shard.index.find((char*)p);
+			if (it != shard.index.end()) {
+				get_reference(it->second);
 		#ifdef YOSYS_XTRACE_GET_PUT
 				if (yosys_xtrace)
-					log("#X# GET-BY-NAME '%s' (index %d, refcount %d)\n", global_id_storage_.at(it->second), it->second, global_refcount_storage_.at(it->second));
+					log("#X# GET-BY-NAME '%s' (index %d, refcount %d)\n", global_id_entry(it->second).str, it->second, global_id_refcount(it->second));
 		#endif
 				return it->second;
 			}
 
-			log_assert(p[0] == '$' || p[0] == '\\');
-			log_assert(p[1] != 0);
-			for (const char *c = p; *c; c++)
-				if ((unsigned)*c <= (unsigned)' ')
-					log_error("Found control character or space (0x%02hhx) in string '%s' which is not allowed in RTLIL identifiers\n", *c, p);
-
-		#ifndef YOSYS_NO_IDS_REFCNT
-			if (global_free_idx_list_.empty()) {
-				if (global_id_storage_.empty()) {
-					global_refcount_storage_.push_back(0);
-					global_id_storage_.push_back((char*)"");
-					global_id_index_[global_id_storage_.back()] = 0;
-				}
-				log_assert(global_id_storage_.size() < 0x40000000);
-				global_free_idx_list_.push_back(global_id_storage_.size());
-				global_id_storage_.push_back(nullptr);
-				global_refcount_storage_.push_back(0);
-			}
-
-			int idx = global_free_idx_list_.back();
-			global_free_idx_list_.pop_back();
-			global_id_storage_.at(idx) = strdup(p);
-			global_id_index_[global_id_storage_.at(idx)] = idx;
-			global_refcount_storage_.at(idx)++;
-		#else
-			if (global_id_storage_.empty()) {
-				global_id_storage_.push_back((char*)"");
-				global_id_index_[global_id_storage_.back()] = 0;
-			}
-			int idx = global_id_storage_.size();
-			global_id_storage_.push_back(strdup(p));
-			global_id_index_[global_id_storage_.back()] = idx;
-		#endif
-
-			if (yosys_xtrace) {
-				log("#X# New IdString '%s' with index %d.\n", p, idx);
-				log_backtrace("-X- ", yosys_xtrace-1);
-			}
-
-		#ifdef YOSYS_XTRACE_GET_PUT
-			if (yosys_xtrace)
-				log("#X# GET-BY-NAME '%s' (index %d, refcount %d)\n", global_id_storage_.at(idx), idx, global_refcount_storage_.at(idx));
-		#endif
-
-		#ifdef YOSYS_USE_STICKY_IDS
-			// Avoid Create->Delete->Create pattern
-			if (last_created_idx_[last_created_idx_ptr_])
-				put_reference(last_created_idx_[last_created_idx_ptr_]);
-			last_created_idx_[last_created_idx_ptr_] = idx;
-			get_reference(last_created_idx_[last_created_idx_ptr_]);
-			last_created_idx_ptr_ = (last_created_idx_ptr_ + 1) & 7;
-		#endif
-
-			return idx;
+			return create_reference(shard, p);
 		}
 
+		// creates a new entry in the (locked) shard, implemented in rtlil.cc
+		static int create_reference(id_shard_t &shard, const char *p);
+
 	#ifndef YOSYS_NO_IDS_REFCNT
 		static inline void put_reference(int idx)
 		{
-			// put_reference() may be called from destructors after the destructor of
-			// global_refcount_storage_ has been run. in this case we simply do nothing.
+			// put_reference() may be called from destructors after the destructors of
+			// the global id tables have been run. in this case we simply do nothing.
 			if (!destruct_guard_ok || !idx)
 				return;
 
 		#ifdef YOSYS_XTRACE_GET_PUT
 			if (yosys_xtrace) {
-				log("#X# PUT '%s' (index %d, refcount %d)\n", global_id_storage_.at(idx), idx, global_refcount_storage_.at(idx));
+				log("#X# PUT '%s' (index %d, refcount %d)\n", global_id_entry(idx).str, idx, global_id_refcount(idx));
 			}
 		#endif
 
-			int &refcount = global_refcount_storage_[idx];
+			std::atomic<int> &refcount = global_id_entry(idx).refcount;
+			int count = refcount.load(std::memory_order_relaxed);
 
-			if (--refcount > 0)
+			if (count < 0)
 				return;
 
-			log_assert(refcount == 0);
-			free_reference(idx);
-		}
-		static inline void free_reference(int idx)
-		{
-			if (yosys_xtrace) {
-				log("#X# Removed IdString '%s' with index %d.\n", global_id_storage_.at(idx), idx);
-				log_backtrace("-X- ", yosys_xtrace-1);
+			if (concurrent_) {
+				if (refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					defer_free_reference(idx);
+				return;
 			}
 
-			global_id_index_.erase(global_id_storage_.at(idx));
-			free(global_id_storage_.at(idx));
-			global_id_storage_.at(idx) = nullptr;
-			global_free_idx_list_.push_back(idx);
+			refcount.store(--count, std::memory_order_relaxed);
+			if (count > 0)
+				return;
+
+			log_assert(count == 0);
+			free_reference(idx);
 		}
+
+		// implemented in rtlil.cc
+		static void free_reference(int idx);
+		static void defer_free_reference(int idx);
 	#else
 		static inline void put_reference(int) { }
 	#endif
 
+		// Returns the id for the given string and marks it as immortal, i.e. it is
+		// never reference counted or freed. This is used for the ids in RTLIL::ID
+		// and the ID() macro, avoiding refcount traffic on the most common ids.
+		static IdString immortal(const char *str);
+
 		// the actual IdString object is just is a single int
 
 		int index_;
@@ -285,11 +321,11 @@ namespace RTLIL
 		}
 
 		inline const char *c_str() const {
-			return global_id_storage_.at(index_);
+			return global_id_entry(index_).str;
 		}
 
 		inline std::string str() const {
-			return std::string(global_id_storage_.at(index_));
+			return std::string(c_str());
 		}
 
 		inline bool operator<(const IdString &rhs) const {
@@ -657,6 +693,10 @@ namespace RTLIL
 struct RTLIL::Const
 {
 	int flags;
+	// One byte per bit, also for fully defined values. bits is a public
+	// member that is read, indexed, resized and passed by reference in about
+	// 600 places, so a packed representation of defined values would need an
+	// accessor at all of them first.
 	std::vector<RTLIL::State> bits;
 
 	Const();
@@ -696,8 +736,9 @@ struct RTLIL::Const
 	inline RTLIL::Const extract(int offset, int len = 1, RTLIL::State padding = RTLIL::State::S0) const {
 		RTLIL::Const ret;
 		ret.bits.reserve(len);
-		for (int i = offset; i < offset + len; i++)
-			ret.bits.push_back(i < GetSize(bits) ? bits[i] : padding);
+		if (offset < GetSize(bits))
+			ret.bits.insert(ret.bits.end(), bits.begin() + offset, bits.begin() + std::min(offset + len, GetSize(bits)));
+		ret.bits.resize(len, padding);
 		return ret;
 	}
 
@@ -710,11 +751,11 @@ struct RTLIL::Const
 	}
 
 	inline unsigned int hash() const {
-		unsigned int h = mkhash_init;
-		for (auto b : bits)
-			mkhash(h, b);
-		return h;
+		return hash_words(bits);
 	}
+
+	// hashes the states eight at a time, implemented in rtlil.cc
+	static unsigned int hash_words(const std::vector<RTLIL::State> &bits);
 };
 
 struct RTLIL::AttrObject
@@ -744,6 +785,10 @@ struct RTLIL::AttrObject
 		return get_string_attribute(ID::src);
 	}
 
+	// the src attribute as a set of locations, see RTLIL::SrcSet
+	RTLIL::SrcSet get_src_set() const;
+	void add_src_attribute(const RTLIL::SrcSet &src);
+
 	void set_hdlname_attribute(const vector<string> &hierarchy);
 	vector<string> get_hdlname_attribute() const;
 
@@ -751,6 +796,32 @@ struct RTLIL::AttrObject
 	vector<int> get_intvec_attribute(const RTLIL::IdString &id) const;
 };
 
+// A set of source locations, as stored in the "|"-separated src attribute.
+// The locations are interned in a global table, so that sets are merged
+// without comparing strings, and rendered to the attribute value when it is
+// written. Merging and rendering give the same attribute values as
+// add_strpool_attribute(ID::src, ...).
+struct RTLIL::SrcSet
+{
+	pool<int> locations;
+
+	SrcSet() { }
+	SrcSet(const RTLIL::Const &src);
+
+	bool empty() const { return locations.empty(); }
+	void insert(const SrcSet &other) { locations.insert(other.locations.begin(), other.locations.end()); }
+
+	std::string str() const;
+
+	// Adds the locations to the src attribute of an object, if it has one.
+	// The results are memoized by the previous value of the attribute, which
+	// is shared by many objects when a cell is flattened or mapped.
+	void add_to(RTLIL::AttrObject *obj) const;
+
+private:
+	mutable dict<RTLIL::Const, RTLIL::Const> add_cache_;
+};
+
 struct RTLIL::SigChunk
 {
 	RTLIL::Wire *wire;
@@ -845,6 +916,11 @@ private:
 	std::vector<RTLIL::SigChunk> chunks_; // LSB at index 0
 	std::vector<RTLIL::SigBit> bits_; // LSB at index 0
 
+	// Single-bit signals are kept in bit_ with both vectors empty, so that
+	// creating, copying, hashing and comparing them does not allocate.
+	// pack() and unpack() convert them to the vector representations.
+	RTLIL::SigBit bit_;
+
 	void pack() const;
 	void unpack() const;
 	void updhash() const;
@@ -853,8 +929,12 @@ private:
 		return bits_.empty();
 	}
 
+	inline bool is_inline() const {
+		return width_ == 1 && chunks_.empty() && bits_.empty();
+	}
+
 	inline void inline_unpack() const {
-		if (!chunks_.empty())
+		if (!chunks_.empty() || is_inline())
 			unpack();
 	}
 
@@ -893,8 +973,19 @@ public:
 	inline int size() const { return width_; }
 	inline bool empty() const { return width_ == 0; }
 
-	inline RTLIL::SigBit &operator[](int index) { inline_unpack(); return bits_.at(index); }
-	inline const RTLIL::SigBit &operator[](int index) const { inline_unpack(); return bits_.at(index); }
+	inline RTLIL::SigBit &operator[](int index) {
+		hash_ = 0;
+		if (index == 0 && is_inline())
+			return bit_;
+		inline_unpack();
+		return bits_.at(index);
+	}
+	inline const RTLIL::SigBit &operator[](int index) const {
+		if (index == 0 && is_inline())
+			return bit_;
+		inline_unpack();
+		return bits_.at(index);
+	}
 
 	inline RTLIL::SigSpecIterator begin() { RTLIL::SigSpecIterator it; it.sig_p = this; it.index = 0; return it; }
 	inline RTLIL::SigSpecIterator end() { RTLIL::SigSpecIterator it; it.sig_p = this; it.index = width_; return it; }
@@ -950,7 +1041,7 @@ public:
 
 	RTLIL::SigSpec repeat(int num) const;
 
-	void reverse() { inline_unpack(); std::reverse(bits_.begin(), bits_.end()); }
+	void reverse() { if (width_ <= 1) return; inline_unpack(); hash_ = 0; std::reverse(bits_.begin(), bits_.end()); }
 
 	bool operator <(const RTLIL::SigSpec &other) const;
 	bool operator ==(const RTLIL::SigSpec &other) const;
@@ -1038,7 +1129,7 @@ struct RTLIL::Monitor
 	unsigned int hash() const { return hashidx_; }
 
 	Monitor() {
-		static unsigned int hashidx_count = 123456789;
+		static thread_local unsigned int hashidx_count = 123456789;
 		hashidx_count = mkhash_xorshift(hashidx_count);
 		hashidx_ = hashidx_count;
 	}
@@ -1050,6 +1141,61 @@ struct RTLIL::Monitor
 	virtual void notify_connect(RTLIL::Module*, const RTLIL::SigSig&) { }
 	virtual void notify_connect(RTLIL::Module*, const std::vector<RTLIL::SigSig>&) { }
 	virtual void notify_blackout(RTLIL::Module*) { }
+	virtual void notify_remove(RTLIL::Module*, const pool<RTLIL::Wire*>&) { }
+
+	// Called by Module::commit_batch() instead of the notifications for the
+	// individual edits of the batch. The removed cells still have their
+	// connections and are freed after this returns. The default
+	// implementation replays the batch as notify_connect() calls.
+	virtual void notify_batch(RTLIL::Module *module, const pool<RTLIL::Cell*> &added_cells,
+			const std::vector<RTLIL::Cell*> &removed_cells, const std::vector<RTLIL::SigSig> &connections);
+
+	// Return true if the monitor can handle notifications about different
+	// modules arriving concurrently from different threads. Otherwise
+	// Pass::execute_modules() falls back to processing modules one by one
+	// while the monitor is attached.
+	virtual bool thread_safe() const { return false; }
+};
+
+// Stable structural hash of the contents of a module, see
+// Module::content_hash(). The hash does not depend on the order of wires,
+// cells, connections, processes or memories, on the name of the module, or
+// on the platform, and can be stored between runs. When created with
+// incremental=true, the object attaches itself to the module as a monitor
+// and keeps the hash of the cell ports and module connections up to date,
+// so that hash() only needs to rehash the remaining properties. Edits that
+// are not reported to monitors (e.g. renaming wires or rewriting
+// connections in place) are detected where possible and cause a full
+// rehash; call reset() after other unreported connection changes.
+struct RTLIL::ModuleHash : public RTLIL::Monitor
+{
+	RTLIL::Module *module;
+	bool incremental, dirty;
+
+	// sum of the hashes of all cell ports and module connection bits
+	uint64_t conn_sum;
+
+	// names as they were when their hashes were last used
+	dict<RTLIL::Cell*, RTLIL::IdString> cell_names;
+	dict<RTLIL::Wire*, std::pair<RTLIL::IdString, uint64_t>> wire_names;
+
+	ModuleHash(RTLIL::Module *module, bool incremental = true);
+	~ModuleHash();
+
+	uint64_t hash();
+	void reset() { dirty = true; }
+
+	uint64_t wire_hash(RTLIL::Wire *wire);
+	uint64_t sig_hash(const RTLIL::SigSpec &sig);
+	uint64_t port_hash(RTLIL::IdString cell_name, RTLIL::IdString port, const RTLIL::SigSpec &sig);
+	uint64_t conn_hash(const RTLIL::SigSig &conn);
+	uint64_t case_hash(const RTLIL::CaseRule *cs);
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &port, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override;
+	void notify_connect(RTLIL::Module *module, const RTLIL::SigSig &conn) override;
+	void notify_connect(RTLIL::Module*, const std::vector<RTLIL::SigSig>&) override { dirty = true; }
+	void notify_blackout(RTLIL::Module*) override { dirty = true; }
+	void notify_remove(RTLIL::Module*, const pool<RTLIL::Wire*>&) override { dirty = true; }
 };
 
 // Forward declaration; defined in preproc.h.
@@ -1084,6 +1230,14 @@ struct RTLIL::Design
 	const RTLIL::Module *module(const RTLIL::IdString &name) const;
 	RTLIL::Module *top_module();
 
+	// modules added with add_lazy() are stubs that only have their attributes,
+	// parameters and ports until load_lazy() is called for them, which
+	// module(), modules() and the selected_*modules() functions do for the
+	// modules they return
+	void add_lazy(RTLIL::Module *module, std::function<void(RTLIL::Module*)> loader);
+	void load_lazy(const RTLIL::IdString &name) const;
+	void load_lazy() const;
+
 	bool has(const RTLIL::IdString &id) const {
 		return modules_.count(id) != 0;
 	}
@@ -1168,6 +1322,8 @@ struct RTLIL::Design
         std::map<std::string, unsigned int> rtlFiles;
         std::vector<std::string> rtlFilesNames;
         // (Thierry)
+
+	mutable dict<RTLIL::IdString, std::function<void(RTLIL::Module*)>> lazy_modules_;
 };
 
 struct RTLIL::Module : public RTLIL::AttrObject
@@ -1180,6 +1336,14 @@ protected:
 	void add(RTLIL::Cell *cell);
 	void add(RTLIL::Process *process);
 
+	// storage for the wires and cells of this module, released in bulk
+	// when the module is destroyed
+	ObjectPool<RTLIL::Wire> wire_pool_;
+	ObjectPool<RTLIL::Cell> cell_pool_;
+
+	void destroy(RTLIL::Wire *wire);
+	void destroy(RTLIL::Cell *cell);
+
 public:
 	RTLIL::Design *design;
 	pool<RTLIL::Monitor*> monitors;
@@ -1193,6 +1357,13 @@ public:
 	std::vector<RTLIL::SigSig>   connections_;
 	std::vector<RTLIL::Binding*> bindings_;
 
+	// state of the batch opened with begin_batch()
+	int batch_depth_;
+	bool batch_monitored_;
+	int batch_connections_start_;
+	pool<RTLIL::Cell*> batch_added_cells_;
+	std::vector<RTLIL::Cell*> batch_removed_cells_;
+
 	RTLIL::IdString name;
 	RTLIL::IdString context_name;
 	idict<RTLIL::IdString> avail_parameters;
@@ -1218,6 +1389,18 @@ public:
 	void new_connections(const std::vector<RTLIL::SigSig> &new_conn);
 	const std::vector<RTLIL::SigSig> &connections() const;
 
+	// Batched netlist edits for passes that rewrite large parts of a module.
+	// Until the matching commit_batch(), monitors are not notified about
+	// connect() calls, about removed cells, or about port changes of cells
+	// added in the batch. Removed cells are kept alive until the commit, at
+	// which point every monitor receives a single notify_batch() call. The
+	// counts are used to reserve capacity for the objects added in the
+	// batch. Batches can be nested, only the outermost commit_batch() takes
+	// effect. Monitors must not be attached or detached and wires must not
+	// be removed while a batch is open.
+	void begin_batch(int num_cells = 0, int num_wires = 0, int num_connections = 0);
+	void commit_batch();
+
 	std::vector<RTLIL::IdString> ports;
 	void fixup_ports();
 
@@ -1226,6 +1409,9 @@ public:
 	void cloneInto(RTLIL::Module *new_mod) const;
 	virtual RTLIL::Module *clone() const;
 
+	// Stable structural hash of the module contents, see RTLIL::ModuleHash.
+	uint64_t content_hash() const;
+
 	bool has_memories() const;
 	bool has_processes() const;
 
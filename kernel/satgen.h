@@ -57,6 +57,16 @@ struct SatSolver
 	}
 };
 
+// Makes ezSatPtr use the named SAT solver until the object is destroyed, this
+// is used by passes with a -solver option. An empty name keeps the current
+// solver. Defined in kernel/register.cc.
+struct SatSolverSelect
+{
+	SatSolver *old_solver;
+	SatSolverSelect(const std::string &name);
+	~SatSolverSelect();
+};
+
 struct ezSatPtr : public std::unique_ptr<ezSAT> {
 	ezSatPtr() : unique_ptr<ezSAT>(yosys_satsolver->create()) { }
 };
@@ -21,6 +21,7 @@
 #define SIGTOOLS_H
 
 #include "kernel/yosys.h"
+#include "kernel/profiler.h"
 
 YOSYS_NAMESPACE_BEGIN
 
@@ -231,7 +232,7 @@ class SigSet<T, sort_by_name_id_guard<T>> : public SigSet<T, RTLIL::sort_by_name
 
 struct SigMap
 {
-	mfp<SigBit> database;
+	mfp<SigBit, hash_ops<SigBit>, flat_idict<SigBit>> database;
 
 	SigMap(RTLIL::Module *module = NULL)
 	{
@@ -251,6 +252,7 @@ struct SigMap
 
 	void set(RTLIL::Module *module)
 	{
+		PassProfiler::Zone zone("SigMap::set");
 		int bitcount = 0;
 		for (auto &it : module->connections())
 			bitcount += it.first.size();
@@ -332,6 +334,13 @@ struct SigMap
 		return sig;
 	}
 
+	// See mfp::compress(). After this, the SigMap can be used from multiple
+	// threads until it is modified again.
+	void compress() const
+	{
+		database.compress();
+	}
+
 	RTLIL::SigSpec allbits() const
 	{
 		RTLIL::SigSpec sig;
@@ -342,6 +351,126 @@ struct SigMap
 	}
 };
 
+// A read-only copy of a SigMap for the bits of the wires of one module, for
+// code that maps signals very often and doesn't add connections. Each wire
+// gets a base index, so that its bits have dense ids, and the representative
+// of a bit is found with two array loads instead of hashing the bit and
+// walking the union-find structure. The wire is looked up once per chunk
+// when mapping a SigSpec. Bits of wires that were added to the module later
+// map to themselves. Safe to use from multiple threads.
+struct FlatSigMap
+{
+	FlatSigMap() { }
+
+	FlatSigMap(RTLIL::Module *module)
+	{
+		set(module);
+	}
+
+	FlatSigMap(const SigMap &sigmap, RTLIL::Module *module)
+	{
+		set(sigmap, module);
+	}
+
+	void clear()
+	{
+		wire_base.clear();
+		rep_index.clear();
+		reps.clear();
+	}
+
+	void set(RTLIL::Module *module)
+	{
+		set(SigMap(module), module);
+	}
+
+	void set(const SigMap &sigmap, RTLIL::Module *module)
+	{
+		clear();
+
+		int num_bits = 0;
+		for (auto wire : module->wires()) {
+			wire_base[wire] = num_bits;
+			num_bits += wire->width;
+		}
+
+		rep_index.assign(num_bits, -1);
+		dict<RTLIL::SigBit, int> rep_ids;
+		for (auto &it : wire_base)
+			for (int i = 0; i < it.first->width; i++) {
+				RTLIL::SigBit bit(it.first, i);
+				RTLIL::SigBit rep = sigmap(bit);
+				if (rep == bit)
+					continue;
+				auto ins = rep_ids.emplace(rep, GetSize(reps));
+				if (ins.second)
+					reps.push_back(rep);
+				rep_index[it.second + i] = ins.first->second;
+			}
+	}
+
+	// The dense id of a bit of a wire of the module (not of its
+	// representative), or -1.
+	int id(RTLIL::SigBit bit) const
+	{
+		if (bit.wire == nullptr)
+			return -1;
+		int base = wire_base.at(bit.wire, -1);
+		return base < 0 ? -1 : base + bit.offset;
+	}
+
+	int num_bits() const { return GetSize(rep_index); }
+
+	void apply(RTLIL::SigBit &bit) const
+	{
+		int idx = id(bit);
+		if (idx >= 0 && rep_index[idx] >= 0)
+			bit = reps[rep_index[idx]];
+	}
+
+	void apply(RTLIL::SigSpec &sig) const
+	{
+		RTLIL::Wire *last_wire = nullptr;
+		int base = -1;
+		for (auto &bit : sig) {
+			if (bit.wire == nullptr)
+				continue;
+			if (bit.wire != last_wire) {
+				last_wire = bit.wire;
+				base = wire_base.at(bit.wire, -1);
+			}
+			if (base >= 0 && rep_index[base + bit.offset] >= 0)
+				bit = reps[rep_index[base + bit.offset]];
+		}
+	}
+
+	RTLIL::SigBit operator()(RTLIL::SigBit bit) const
+	{
+		apply(bit);
+		return bit;
+	}
+
+	RTLIL::SigSpec operator()(RTLIL::SigSpec sig) const
+	{
+		apply(sig);
+		return sig;
+	}
+
+	RTLIL::SigSpec operator()(RTLIL::Wire *wire) const
+	{
+		SigSpec sig(wire);
+		apply(sig);
+		return sig;
+	}
+
+private:
+	flat_dict<RTLIL::Wire*, int> wire_base;
+	// per bit id: the index of its representative in reps, or -1 if the
+	// bit is its own representative
+	std::vector<int> rep_index;
+	std::vector<RTLIL::SigBit> reps;
+};
+
 YOSYS_NAMESPACE_END
 
 #endif /* SIGTOOLS_H */
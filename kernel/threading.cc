@@ -0,0 +1,196 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/threading.h"
+
+#include <limits>
+#ifdef YOSYS_ENABLE_THREADS
+#  include <thread>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+static int init_max_threads()
+{
+	const char *e = getenv("YOSYS_MAX_THREADS");
+	if (e && atoi(e) > 0)
+		return atoi(e);
+	return 1;
+}
+
+int yosys_max_threads = init_max_threads();
+
+static thread_local bool in_worker_thread = false;
+
+int yosys_thread_count(int work_items)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	if (in_worker_thread)
+		return 1;
+	return std::max(1, std::min(yosys_max_threads, work_items));
+#else
+	(void)work_items;
+	return 1;
+#endif
+}
+
+bool yosys_in_worker_thread()
+{
+	return in_worker_thread;
+}
+
+void ThreadPool::run(int num_jobs, const std::function<void(int)> &fn, int num_threads)
+{
+	std::vector<std::exception_ptr> errors(num_jobs);
+	std::atomic<int> next_job(0);
+	std::atomic<bool> failed(false);
+
+#ifdef YOSYS_ENABLE_THREADS
+	int thread_count = std::min(num_threads, num_jobs);
+#else
+	(void)num_threads;
+	int thread_count = 1;
+#endif
+
+	// jobs on fresh threads would start at autoidx 1, so every job gets its
+	// own range after the value of the caller instead
+	int base_autoidx = autoidx;
+	int job_range = 0;
+	if (thread_count > 1)
+		job_range = std::min(autoidx_job_range, (std::numeric_limits<int>::max() - base_autoidx) / num_jobs);
+	std::vector<int> job_autoidx(num_jobs, base_autoidx);
+
+	auto worker = [&]() {
+		bool bak_in_worker_thread = in_worker_thread;
+		int bak_autoidx = autoidx;
+		in_worker_thread = true;
+		while (!failed) {
+			int idx = next_job++;
+			if (idx >= num_jobs)
+				break;
+			if (thread_count > 1)
+				autoidx = base_autoidx + idx * job_range;
+			try {
+				fn(idx);
+			} catch (...) {
+				errors[idx] = std::current_exception();
+				failed = true;
+			}
+			job_autoidx[idx] = autoidx;
+		}
+		in_worker_thread = bak_in_worker_thread;
+		if (thread_count > 1)
+			autoidx = bak_autoidx;
+	};
+
+	if (thread_count <= 1) {
+		worker();
+	} else {
+#ifdef YOSYS_ENABLE_THREADS
+		// joins the threads that were started and leaves concurrent mode,
+		// also when starting a thread fails
+		struct Workers {
+			std::vector<std::thread> threads;
+			bool concurrent = false;
+			~Workers() {
+				for (auto &t : threads)
+					t.join();
+				if (concurrent)
+					IdString::end_concurrent();
+			}
+		} workers;
+
+		// the jobs may copy and destroy ids, so the workers always run in
+		// concurrent mode, unless the caller already enabled it
+		if (!IdString::concurrent_) {
+			IdString::begin_concurrent();
+			workers.concurrent = true;
+		}
+		try {
+			for (int i = 1; i < thread_count; i++)
+				workers.threads.emplace_back(worker);
+		} catch (...) {
+			failed = true;
+			throw;
+		}
+		worker();
+#endif
+	}
+
+	if (thread_count > 1) {
+		autoidx = base_autoidx;
+		for (int idx = 0; idx < num_jobs; idx++)
+			if (job_autoidx[idx] > base_autoidx + idx * job_range)
+				autoidx = std::max(autoidx, job_autoidx[idx]);
+	}
+
+	for (auto &e : errors)
+		if (e)
+			std::rethrow_exception(e);
+}
+
+void ThreadPool::run_captured(int num_jobs, const std::function<void(int)> &fn, int num_threads,
+		const std::function<void(int)> &before_replay, const std::function<void(int)> &after_replay)
+{
+	if (std::min(num_threads, num_jobs) <= 1) {
+		for (int i = 0; i < num_jobs; i++) {
+			if (before_replay)
+				before_replay(i);
+			fn(i);
+			if (after_replay)
+				after_replay(i);
+		}
+		return;
+	}
+
+	std::vector<LogCapture> captures(num_jobs);
+	std::vector<char> failed(num_jobs);
+	std::exception_ptr error;
+
+	try {
+		run(num_jobs, [&](int i) {
+			captures[i].begin();
+			try {
+				fn(i);
+			} catch (...) {
+				captures[i].end();
+				failed[i] = true;
+				throw;
+			}
+			captures[i].end();
+		}, num_threads);
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	// replaying a capture re-raises errors that were recorded by log_error() and friends
+	for (int i = 0; i < num_jobs; i++) {
+		if (before_replay)
+			before_replay(i);
+		captures[i].replay();
+		if (failed[i])
+			std::rethrow_exception(error);
+		if (after_replay)
+			after_replay(i);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+YOSYS_NAMESPACE_END
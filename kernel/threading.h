@@ -0,0 +1,129 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+#ifndef THREADING_H
+#define THREADING_H
+
+#include <atomic>
+#ifdef YOSYS_ENABLE_THREADS
+#  include <thread>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+// Upper limit for the number of threads used by the kernel. This is set
+// using "yosys -j <N>" or the YOSYS_MAX_THREADS environment variable. The
+// default of 1 disables all multi-threading.
+extern int yosys_max_threads;
+
+// Number of threads that should be used for the given number of independent
+// work items. Returns 1 when yosys is built without YOSYS_ENABLE_THREADS or
+// when called from within a worker thread (nested parallelism is serialized).
+int yosys_thread_count(int work_items);
+
+// True if the calling thread is currently running a ThreadPool job.
+bool yosys_in_worker_thread();
+
+struct ThreadPool
+{
+	// Calls fn(0) .. fn(num_jobs-1), distributing the jobs over up to
+	// num_threads threads (including the calling thread). Jobs are started
+	// in index order. When a job throws, jobs that have not been started yet
+	// are skipped and the exception of the failed job with the lowest index
+	// is rethrown in the calling thread after all workers have finished.
+	// When more than one thread is used, the jobs run in concurrent IdString
+	// mode (see IdString::begin_concurrent()), and job i starts with autoidx
+	// at the value of the caller plus i * autoidx_job_range, so that the ids
+	// created by different jobs never collide. The caller continues after the
+	// highest autoidx value used by a job.
+	static void run(int num_jobs, const std::function<void(int)> &fn, int num_threads);
+
+	// Like run(), but the log output of each job is recorded (see LogCapture)
+	// and replayed in the calling thread in job order after all jobs have
+	// finished. before_replay(i) and after_replay(i), if given, are called in
+	// the calling thread around the replay of job i. When a job failed, its
+	// exception is rethrown after its output has been replayed. With a single
+	// thread, the jobs and the hooks run in order without recording the output.
+	static void run_captured(int num_jobs, const std::function<void(int)> &fn, int num_threads,
+			const std::function<void(int)> &before_replay = nullptr,
+			const std::function<void(int)> &after_replay = nullptr);
+
+	static const int autoidx_job_range = 1 << 16;
+};
+
+// Bounded lock-free queue for handing items from one producer thread to one
+// consumer thread. push() waits while the queue is full and pop() waits while
+// it is empty. After close() push() drops its item and returns false, pop()
+// returns false once the remaining items have been consumed.
+template<typename T>
+struct SpscQueue
+{
+	SpscQueue(int capacity = 4096) : buffer(capacity), head(0), tail(0), closed(false) { }
+
+	bool push(T &&item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		while (t - head.load(std::memory_order_acquire) == buffer.size()) {
+			if (closed.load(std::memory_order_acquire))
+				return false;
+			wait();
+		}
+		if (closed.load(std::memory_order_acquire))
+			return false;
+		buffer[t % buffer.size()] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		while (tail.load(std::memory_order_acquire) == h) {
+			if (closed.load(std::memory_order_acquire) && tail.load(std::memory_order_acquire) == h)
+				return false;
+			wait();
+		}
+		item = std::move(buffer[h % buffer.size()]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	void close()
+	{
+		closed.store(true, std::memory_order_release);
+	}
+
+private:
+	static void wait()
+	{
+#ifdef YOSYS_ENABLE_THREADS
+		std::this_thread::yield();
+#endif
+	}
+
+	std::vector<T> buffer;
+	std::atomic<size_t> head, tail;
+	std::atomic<bool> closed;
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -72,6 +72,7 @@
 
 #include <limits.h>
 #include <errno.h>
+#include <mutex>
 
 #include "libs/json11/json11.hpp"
 
@@ -82,7 +83,7 @@
 
 YOSYS_NAMESPACE_BEGIN
 
-int autoidx = 1;
+thread_local int autoidx = 1;
 int yosys_xtrace = 0;
 RTLIL::Design *yosys_design = NULL;
 CellTypes yosys_celltypes;
@@ -106,6 +107,9 @@ void init_share_dirname();
 void init_abc_executable_name();
 void remove_shared_tmp_dir();
 
+// the section numbers of log_header(), in log.cc
+extern std::vector<int> header_count;
+
 void memhasher_on()
 {
 #if defined(__linux__) || defined(__FreeBSD__)
@@ -577,7 +581,7 @@ void yosys_setup()
 	init_abc_executable_name();
 	if (0 != access(yosys_abc_executable.c_str(), F_OK))
 		log_error("ERROR: couldn't find ABC executable");
-#define X(_id) RTLIL::ID::_id = "\\" # _id;
+#define X(_id) RTLIL::ID::_id = RTLIL::IdString::immortal("\\" # _id);
 #include "kernel/constids.inc"
 #undef X
 
@@ -613,6 +617,7 @@ void yosys_shutdown()
 	delete yosys_design;
 	yosys_design = NULL;
 
+	log_set_async(false);
 	for (auto f : log_files)
 		if (f != stderr)
 			fclose(f);
@@ -664,6 +669,25 @@ RTLIL::IdString new_id(std::string file, int line, std::string func)
 	return stringf("$auto$%s:%d:%s$%d", file.c_str(), line, func.c_str(), autoidx++);
 }
 
+// The variant used by NEW_ID, which doesn't copy the file and function names
+// as it is called for most objects created by the mapping passes.
+RTLIL::IdString new_id(const char *file, int line, const char *func)
+{
+	for (const char *p = file; *p; p++)
+#ifdef _WIN32
+		if (*p == '/' || *p == '\\')
+#else
+		if (*p == '/')
+#endif
+			file = p + 1;
+
+	const char *pos = strrchr(func, ':');
+	if (pos != nullptr)
+		func = pos + 1;
+
+	return stringf("$auto$%s:%d:%s$%d", file, line, func, autoidx++);
+}
+
 RTLIL::IdString new_id_suffix(std::string file, int line, std::string func, std::string suffix)
 {
 #ifdef _WIN32
@@ -705,6 +729,9 @@ RTLIL::Design *yosys_get_design()
 
 const char *create_prompt(RTLIL::Design *design, int recursion_counter)
 {
+	// the prompt is printed directly to stdout
+	log_flush();
+
 	static char buffer[100];
 	std::string str = "\n";
 	if (recursion_counter > 1)
@@ -1353,6 +1380,61 @@ void run_backend(std::string filename, std::string command, RTLIL::Design *desig
 	Backend::backend_call(design, NULL, filename, command);
 }
 
+static std::mutex yosys_context_mutex;
+
+YosysContext::YosysContext() : design(new RTLIL::Design)
+{
+	header_count.push_back(0);
+}
+
+YosysContext::~YosysContext()
+{
+	delete design;
+}
+
+template<typename F> void YosysContext::run(F fn)
+{
+	std::lock_guard<std::mutex> lock(yosys_context_mutex);
+
+	std::swap(yosys_design, design);
+	std::swap(Yosys::log_files, log_files);
+	std::swap(Yosys::log_streams, log_streams);
+	std::swap(Yosys::header_count, header_count);
+
+	auto restore = [&]() {
+		log_flush();
+		std::swap(yosys_design, design);
+		std::swap(Yosys::log_files, log_files);
+		std::swap(Yosys::log_streams, log_streams);
+		std::swap(Yosys::header_count, header_count);
+	};
+
+	try {
+		fn(yosys_design);
+	} catch (...) {
+		restore();
+		throw;
+	}
+	restore();
+}
+
+void YosysContext::run_pass(const std::string &command)
+{
+	run([&](RTLIL::Design *design) { Yosys::run_pass(command, design); });
+}
+
+bool YosysContext::run_frontend(const std::string &filename, const std::string &command)
+{
+	bool result = false;
+	run([&](RTLIL::Design *design) { result = Yosys::run_frontend(filename, command, design); });
+	return result;
+}
+
+void YosysContext::run_backend(const std::string &filename, const std::string &command)
+{
+	run([&](RTLIL::Design *design) { Yosys::run_backend(filename, command, design); });
+}
+
 #if defined(YOSYS_ENABLE_READLINE) || defined(YOSYS_ENABLE_EDITLINE)
 static char *readline_cmd_generator(const char *text, int state)
 {
@@ -51,9 +51,14 @@
 #include <initializer_list>
 #include <stdexcept>
 #include <memory>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
 
+#ifdef YOSYS_ENABLE_THREADS
+#  include <mutex>
+#endif
+
 #include <sstream>
 #include <fstream>
 #include <istream>
@@ -69,6 +74,10 @@
 #include <sys/stat.h>
 #include <errno.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #ifdef WITH_PYTHON
 #include <Python.h>
 #endif
@@ -212,10 +221,14 @@ using hashlib::hash_ops;
 using hashlib::hash_cstr_ops;
 using hashlib::hash_ptr_ops;
 using hashlib::hash_obj_ops;
+using hashlib::hash_stats;
 using hashlib::dict;
 using hashlib::idict;
 using hashlib::pool;
 using hashlib::mfp;
+using hashlib::flat_dict;
+using hashlib::flat_pool;
+using hashlib::flat_idict;
 
 namespace RTLIL {
 	struct IdString;
@@ -352,7 +365,7 @@ std::string escape_filename_spaces(const std::string& filename);
 template<typename T> int GetSize(const T &obj) { return obj.size(); }
 inline int GetSize(RTLIL::Wire *wire);
 
-extern int autoidx;
+extern thread_local int autoidx;
 extern int yosys_xtrace;
 
 YOSYS_NAMESPACE_END
@@ -386,6 +399,7 @@ Tcl_Interp *yosys_get_tcl_interp();
 extern RTLIL::Design *yosys_design;
 
 RTLIL::IdString new_id(std::string file, int line, std::string func);
+RTLIL::IdString new_id(const char *file, int line, const char *func);
 RTLIL::IdString new_id_suffix(std::string file, int line, std::string func, std::string suffix);
 RTLIL::IdString new_id_no_prefix(std::string file, std::string func, std::string suffix);
 
@@ -405,7 +419,7 @@ RTLIL::IdString new_id_no_prefix(std::string file, std::string func, std::string
 //  sed -i.orig -r 's/"\\\\([a-zA-Z0-9_]+)"/ID(\1)/g; s/"(\$[a-zA-Z0-9_]+)"/ID(\1)/g;' <filename>
 //
 #define ID(_id) ([]() { const char *p = "\\" #_id, *q = p[1] == '$' ? p+1 : p; \
-        static const YOSYS_NAMESPACE_PREFIX RTLIL::IdString id(q); return id; })()
+        static const YOSYS_NAMESPACE_PREFIX RTLIL::IdString id = YOSYS_NAMESPACE_PREFIX RTLIL::IdString::immortal(q); return id; })()
 namespace ID = RTLIL::ID;
 
 RTLIL::Design *yosys_get_design();
@@ -422,6 +436,35 @@ bool run_frontend(std::string filename, std::string command, RTLIL::Design *desi
 void run_backend(std::string filename, std::string command, RTLIL::Design *design = nullptr);
 void shell(RTLIL::Design *design);
 
+// An independent job for hosts that use libyosys from several threads. Each
+// context has its own design and log output, and its commands may be called
+// from any thread. Contexts are NOT processed concurrently: passes keep the
+// state of a call in their global pass objects, so a global mutex runs the
+// commands of all contexts one at a time, and a call blocks while another
+// context runs a command. A command can still use up to yosys_max_threads
+// worker threads. While a command runs, yosys_design, log_files and
+// log_streams are the ones of its context.
+struct YosysContext
+{
+	// owned by the context
+	RTLIL::Design *design;
+	std::vector<FILE*> log_files;
+	std::vector<std::ostream*> log_streams;
+
+	YosysContext();
+	~YosysContext();
+	YosysContext(const YosysContext &) = delete;
+	YosysContext &operator=(const YosysContext &) = delete;
+
+	void run_pass(const std::string &command);
+	bool run_frontend(const std::string &filename, const std::string &command);
+	void run_backend(const std::string &filename, const std::string &command);
+
+private:
+	std::vector<int> header_count;
+	template<typename F> void run(F fn);
+};
+
 // journal of all input and output files read (for "yosys -E")
 extern std::set<std::string> yosys_input_files, yosys_output_files;
 
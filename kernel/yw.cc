@@ -19,6 +19,14 @@
 
 #include "kernel/yw.h"
 #include "libs/json11/json11.hpp"
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 USING_YOSYS_NAMESPACE
 
@@ -103,16 +111,230 @@ static std::vector<IdString> get_path(const json11::Json &json)
 	return result;
 }
 
+namespace {
+	// A minimal scanner for the JSON text of a witness file. It only checks
+	// the structure, the values of the header members are parsed by json11
+	// and the steps are indexed without being copied.
+	struct WitnessScanner
+	{
+		const std::string &filename;
+		const char *begin, *p, *end;
+
+		WitnessScanner(const std::string &filename, const char *begin, const char *end) :
+				filename(filename), begin(begin), p(begin), end(end) { }
+
+		[[noreturn]] void error(const char *what)
+		{
+			log_error("Failed to parse `%s`: %s at offset %zu\n", filename.c_str(), what, (size_t)(p - begin));
+		}
+
+		void skip_ws()
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+				p++;
+		}
+
+		bool peek(char c)
+		{
+			skip_ws();
+			return p < end && *p == c;
+		}
+
+		void expect(char c)
+		{
+			if (!peek(c))
+				error(stringf("expected `%c'", c).c_str());
+			p++;
+		}
+
+		// Returns the contents of a string without the quotes, escape
+		// sequences are not decoded.
+		std::pair<const char*, const char*> string()
+		{
+			expect('"');
+			const char *str_begin = p;
+			while (p < end && *p != '"')
+				p += *p == '\\' ? 2 : 1;
+			if (p >= end)
+				error("unterminated string");
+			return {str_begin, p++};
+		}
+
+		bool is_key(std::pair<const char*, const char*> key, const char *name)
+		{
+			size_t len = strlen(name);
+			return size_t(key.second - key.first) == len && memcmp(key.first, name, len) == 0;
+		}
+
+		void skip_value(int depth = 0)
+		{
+			if (depth > 256)
+				error("too deeply nested");
+			if (peek('"')) {
+				string();
+				return;
+			}
+			if (p < end && (*p == '[' || *p == '{')) {
+				bool object = *p++ == '{';
+				char close = object ? '}' : ']';
+				if (peek(close)) {
+					p++;
+					return;
+				}
+				while (1) {
+					if (object) {
+						string();
+						expect(':');
+					}
+					skip_value(depth + 1);
+					if (!peek(','))
+						break;
+					p++;
+				}
+				expect(close);
+				return;
+			}
+			const char *value_begin = p;
+			while (p < end && (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.'))
+				p++;
+			if (p == value_begin)
+				error(p < end ? "unexpected character" : "unexpected end of file");
+		}
+	};
+}
+
+// Indexes the steps array, checking the bits of each step. Like json11's
+// array_items(), a steps value that isn't an array has no steps.
+static void parse_steps(WitnessScanner &scan, std::vector<ReadWitness::Step> &steps)
+{
+	const std::string &filename = scan.filename;
+
+	if (!scan.peek('[')) {
+		scan.skip_value();
+		return;
+	}
+	scan.p++;
+	if (scan.peek(']')) {
+		scan.p++;
+		return;
+	}
+
+	while (1) {
+		ReadWitness::Step step = {0, -1};
+		if (scan.peek('{')) {
+			scan.p++;
+			if (!scan.peek('}'))
+				while (1) {
+					auto key = scan.string();
+					scan.expect(':');
+					if (scan.is_key(key, "bits") && scan.peek('"')) {
+						auto bits = scan.string();
+						step.offset = bits.first - scan.begin;
+						step.size = bits.second - bits.first;
+					} else {
+						if (scan.is_key(key, "bits"))
+							step.size = -1;
+						scan.skip_value();
+					}
+					if (!scan.peek(','))
+						break;
+					scan.p++;
+				}
+			scan.expect('}');
+		} else
+			scan.skip_value();
+
+		if (step.size < 0)
+			log_error("Failed to parse `%s`: Expected string as bits value for step %d\n", filename.c_str(), GetSize(steps));
+		const char *bits = scan.begin + step.offset;
+		for (int i = 0; i < step.size; i++) {
+			char c = bits[i];
+			if (c != '0' && c != '1' && c != 'x' && c != '?')
+				log_error("Failed to parse `%s`: Invalid bit '%c' value for step %d\n", filename.c_str(), c, GetSize(steps));
+		}
+		steps.push_back(step);
+
+		if (!scan.peek(','))
+			break;
+		scan.p++;
+	}
+	scan.expect(']');
+}
+
+void ReadWitness::read_file()
+{
+	struct stat st;
+	if (GetSize(filename) == 0 || stat(filename.c_str(), &st) != 0)
+		log_error("Cannot open file `%s`\n", filename.c_str());
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		log_error("Cannot open file `%s`\n", filename.c_str());
+	if (st.st_size > 0) {
+		void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			data = (const char*)p;
+			size = st.st_size;
+			mapped = true;
+		}
+	}
+	close(fd);
+	if (mapped)
+		return;
+#endif
+	std::ifstream f(filename.c_str(), std::ios::binary);
+	if (f.fail())
+		log_error("Cannot open file `%s`\n", filename.c_str());
+	buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	data = buffer.data();
+	size = buffer.size();
+}
+
+ReadWitness::~ReadWitness()
+{
+#ifndef _WIN32
+	if (mapped)
+		munmap((void*)data, size);
+#endif
+}
+
 ReadWitness::ReadWitness(const std::string &filename) :
 	filename(filename)
 {
-	std::ifstream f(filename.c_str());
-	if (f.fail() || GetSize(filename) == 0)
-		log_error("Cannot open file `%s`\n", filename.c_str());
-	std::stringstream buf;
-	buf << f.rdbuf();
+	read_file();
+
+	// The members other than the steps are copied into a separate object
+	// that is parsed by json11, the steps are indexed in place.
+	WitnessScanner scan(filename, data, data + size);
+	std::string header = "{";
+	scan.expect('{');
+	if (!scan.peek('}'))
+		while (1) {
+			scan.skip_ws();
+			const char *member_begin = scan.p;
+			auto key = scan.string();
+			scan.expect(':');
+			if (scan.is_key(key, "steps")) {
+				steps.clear();
+				parse_steps(scan, steps);
+			} else {
+				scan.skip_value();
+				if (GetSize(header) > 1)
+					header += ',';
+				header.append(member_begin, scan.p);
+			}
+			if (!scan.peek(','))
+				break;
+			scan.p++;
+		}
+	scan.expect('}');
+	scan.skip_ws();
+	if (scan.p != scan.end)
+		scan.error("unexpected trailing characters");
+	header += '}';
+
 	std::string err;
-	json11::Json json = json11::Json::parse(buf.str(), err);
+	json11::Json json = json11::Json::parse(header, err);
 	if (!err.empty())
 		log_error("Failed to parse `%s`: %s\n", filename.c_str(), err.c_str());
 
@@ -164,30 +386,18 @@ ReadWitness::ReadWitness(const std::string &filename) :
 		signal.init_only = signal_json["init_only"].bool_value();
 		signals.push_back(signal);
 	}
-
-	for (auto &step_json : json["steps"].array_items()) {
-		Step step;
-		if (!step_json["bits"].is_string())
-			log_error("Failed to parse `%s`: Expected string as bits value for step %d\n", filename.c_str(), GetSize(steps));
-		step.bits = step_json["bits"].string_value();
-		for (char c : step.bits) {
-			if (c != '0' && c != '1' && c != 'x' && c != '?')
-				log_error("Failed to parse `%s`: Invalid bit '%c' value for step %d\n", filename.c_str(), c, GetSize(steps));
-		}
-		steps.push_back(step);
-	}
 }
 
 RTLIL::Const ReadWitness::get_bits(int t, int bits_offset, int width) const
 {
 	log_assert(t >= 0 && t < GetSize(steps));
 
-	const std::string &bits = steps[t].bits;
+	const char *bits = data + steps[t].offset;
 
 	RTLIL::Const result(State::Sa, width);
 	result.bits.reserve(width);
 
-	int read_begin = GetSize(bits) - 1 - bits_offset;
+	int read_begin = steps[t].size - 1 - bits_offset;
 	int read_end = max(-1, read_begin - width);
 
 	for (int i = read_begin, j = 0; i > read_end; i--, j++) {
@@ -82,8 +82,13 @@ struct ReadWitness
 		int bits_offset;
 	};
 
+	// The bits string of a step, which is only decoded by get_bits(). The
+	// file is kept in memory (mapped where possible) and indexed by the
+	// offsets of the steps, so that a long trace doesn't have to be
+	// converted up front.
 	struct Step {
-		std::string bits;
+		size_t offset;
+		int size;
 	};
 
 	std::string filename;
@@ -92,8 +97,20 @@ struct ReadWitness
 	std::vector<Step> steps;
 
 	ReadWitness(const std::string &filename);
+	~ReadWitness();
+
+	ReadWitness(const ReadWitness &) = delete;
+	ReadWitness &operator=(const ReadWitness &) = delete;
 
 	RTLIL::Const get_bits(int t, int bits_offset, int width) const;
+
+private:
+	std::string buffer;
+	const char *data = nullptr;
+	size_t size = 0;
+	bool mapped = false;
+
+	void read_file();
 };
 
 template<typename D, typename T>
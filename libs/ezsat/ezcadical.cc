@@ -0,0 +1,118 @@
+/*
+ *  ezSAT -- A simple and easy to use CNF generator for SAT solvers
+ *
+ *  Copyright (C) 2013  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "ezcadical.h"
+
+#include <cadical.hpp>
+#include <time.h>
+
+// The ezSAT CNF variables are used as CaDiCaL variables as they are. CaDiCaL
+// restores eliminated variables by itself when they are used again in a new
+// clause or assumption, so unlike with MiniSAT nothing needs to be frozen.
+
+namespace {
+	struct ezCaDiCaLTerminator : public CaDiCaL::Terminator
+	{
+		const std::atomic<bool> &interrupted;
+		clock_t deadline;
+		bool terminated = false;
+
+		ezCaDiCaLTerminator(const std::atomic<bool> &interrupted, int timeout) :
+				interrupted(interrupted), deadline(timeout > 0 ? clock() + timeout*CLOCKS_PER_SEC : 0) { }
+
+		bool terminate() override {
+			if (interrupted || (deadline != 0 && clock() > deadline))
+				terminated = true;
+			return terminated;
+		}
+	};
+}
+
+ezCaDiCaL::ezCaDiCaL() : cadicalSolver(NULL), interruptRequested(false)
+{
+}
+
+ezCaDiCaL::~ezCaDiCaL()
+{
+	delete cadicalSolver;
+}
+
+void ezCaDiCaL::interrupt()
+{
+	// polled by the terminator, so there is no race with solver()
+	interruptRequested = true;
+}
+
+void ezCaDiCaL::clear()
+{
+	delete cadicalSolver;
+	cadicalSolver = NULL;
+	ezSAT::clear();
+}
+
+bool ezCaDiCaL::solver(const std::vector<int> &modelExpressions, std::vector<bool> &modelValues, const std::vector<int> &assumptions)
+{
+	preSolverCallback();
+
+	solverTimoutStatus = false;
+
+	std::vector<int> extraClauses, modelIdx;
+
+	for (auto id : assumptions)
+		extraClauses.push_back(bind(id));
+	for (auto id : modelExpressions)
+		modelIdx.push_back(bind(id));
+
+	if (cadicalSolver == NULL) {
+		cadicalSolver = new CaDiCaL::Solver;
+		cadicalSolver->set("quiet", 1);
+	}
+
+	std::vector<std::vector<int>> cnf;
+	consumeCnf(cnf);
+
+	cadicalSolver->reserve(numCnfVariables());
+
+	for (auto &clause : cnf) {
+		for (auto idx : clause)
+			cadicalSolver->add(idx);
+		cadicalSolver->add(0);
+	}
+
+	for (auto idx : extraClauses)
+		cadicalSolver->assume(idx);
+
+	ezCaDiCaLTerminator terminator(interruptRequested, solverTimeout);
+	cadicalSolver->connect_terminator(&terminator);
+	int result = cadicalSolver->solve();
+	cadicalSolver->disconnect_terminator();
+	solverTimoutStatus = terminator.terminated;
+
+	// 10 is satisfiable, 20 is unsatisfiable and 0 means interrupted
+	if (result != 10)
+		return false;
+
+	modelValues.clear();
+	modelValues.resize(modelIdx.size());
+
+	for (size_t i = 0; i < modelIdx.size(); i++)
+		modelValues[i] = cadicalSolver->val(modelIdx[i]) > 0;
+
+	return true;
+}
@@ -40,7 +40,7 @@
 #include "../minisat/Solver.h"
 #include "../minisat/SimpSolver.h"
 
-ezMiniSAT::ezMiniSAT() : minisatSolver(NULL)
+ezMiniSAT::ezMiniSAT() : minisatSolver(NULL), interruptRequested(false)
 {
 	minisatSolver = NULL;
 	foundContradiction = false;
@@ -55,12 +55,24 @@ ezMiniSAT::~ezMiniSAT()
 		delete minisatSolver;
 }
 
+void ezMiniSAT::deleteSolver()
+{
+	std::lock_guard<std::mutex> lock(solverMutex);
+	delete minisatSolver;
+	minisatSolver = NULL;
+}
+
+void ezMiniSAT::interrupt()
+{
+	interruptRequested = true;
+	std::lock_guard<std::mutex> lock(solverMutex);
+	if (minisatSolver != NULL)
+		minisatSolver->interrupt();
+}
+
 void ezMiniSAT::clear()
 {
-	if (minisatSolver != NULL) {
-		delete minisatSolver;
-		minisatSolver = NULL;
-	}
+	deleteSolver();
 	foundContradiction = false;
 	minisatVars.clear();
 #if EZMINISAT_SIMPSOLVER && EZMINISAT_INCREMENTAL
@@ -105,10 +117,14 @@ bool ezMiniSAT::solver(const std::vector<int> &modelExpressions, std::vector<boo
 
 	solverTimoutStatus = false;
 
+	if (interruptRequested) {
+		solverTimoutStatus = true;
+		return false;
+	}
+
 	if (0) {
 contradiction:
-		delete minisatSolver;
-		minisatSolver = NULL;
+		deleteSolver();
 		minisatVars.clear();
 		foundContradiction = true;
 		return false;
@@ -127,8 +143,11 @@ contradiction:
 		modelIdx.push_back(bind(id));
 
 	if (minisatSolver == NULL) {
+		std::lock_guard<std::mutex> lock(solverMutex);
 		minisatSolver = new Solver;
 		minisatSolver->verbosity = EZMINISAT_VERBOSITY;
+		if (interruptRequested)
+			minisatSolver->interrupt();
 	}
 
 #if EZMINISAT_INCREMENTAL
@@ -214,9 +233,10 @@ contradiction:
 #endif
 
 	if (!foundSolution) {
+		if (interruptRequested)
+			solverTimoutStatus = true;
 #if !EZMINISAT_INCREMENTAL
-		delete minisatSolver;
-		minisatSolver = NULL;
+		deleteSolver();
 		minisatVars.clear();
 #endif
 		return false;
@@ -239,8 +259,7 @@ contradiction:
 	}
 
 #if !EZMINISAT_INCREMENTAL
-	delete minisatSolver;
-	minisatSolver = NULL;
+	deleteSolver();
 	minisatVars.clear();
 #endif
 	return true;
@@ -26,6 +26,8 @@
 
 #include "ezsat.h"
 #include <time.h>
+#include <atomic>
+#include <mutex>
 
 // minisat is using limit macros and format macros in their headers that
 // can be the source of some troubles when used from c++11. therefore we
@@ -47,6 +49,11 @@ private:
 	std::vector<int> minisatVars;
 	bool foundContradiction;
 
+	// guards minisatSolver against interrupt() from other threads
+	std::mutex solverMutex;
+	std::atomic<bool> interruptRequested;
+	void deleteSolver();
+
 #if EZMINISAT_SIMPSOLVER && EZMINISAT_INCREMENTAL
 	std::set<int> cnfFrozenVars;
 #endif
@@ -66,6 +73,7 @@ public:
 	virtual bool eliminated(int idx);
 #endif
 	virtual bool solver(const std::vector<int> &modelExpressions, std::vector<bool> &modelValues, const std::vector<int> &assumptions);
+	virtual void interrupt();
 };
 
 #endif
@@ -152,6 +152,19 @@ int ezSAT::expression(OpId op, const std::vector<int> &args)
 		myArgs.resize(j+1);
 	}
 
+	if (op == OpAnd || op == OpOr)
+	{
+		int dominant = op == OpAnd ? CONST_FALSE : CONST_TRUE;
+		for (auto arg : myArgs) {
+			if (arg == dominant)
+				return dominant;
+			// x AND NOT x, x OR NOT x
+			if (arg < 0 && expressions[-arg-1].first == OpNot &&
+					std::binary_search(myArgs.begin(), myArgs.end(), expressions[-arg-1].second.at(0)))
+				return dominant;
+		}
+	}
+
 	switch (op)
 	{
 	case OpNot:
@@ -160,6 +173,8 @@ int ezSAT::expression(OpId op, const std::vector<int> &args)
 			return CONST_FALSE;
 		if (myArgs[0] == CONST_FALSE)
 			return CONST_TRUE;
+		if (myArgs[0] < 0 && expressions[-myArgs[0]-1].first == OpNot)
+			return expressions[-myArgs[0]-1].second.at(0);
 		break;
 
 	case OpAnd:
@@ -187,7 +202,14 @@ int ezSAT::expression(OpId op, const std::vector<int> &args)
 		assert(myArgs.size() >= 1);
 		if (myArgs.size() == 1)
 			return CONST_TRUE;
-		// FIXME: Add proper const folding
+		if (myArgs.size() == 2)
+			for (int i = 0; i < 2; i++) {
+				if (myArgs[i] == CONST_TRUE)
+					return myArgs[1-i];
+				if (myArgs[i] == CONST_FALSE)
+					return NOT(myArgs[1-i]);
+			}
+		// FIXME: Add const folding for more than two arguments
 		break;
 
 	case OpITE:
@@ -196,6 +218,12 @@ int ezSAT::expression(OpId op, const std::vector<int> &args)
 			return myArgs[1];
 		if (myArgs[0] == CONST_FALSE)
 			return myArgs[2];
+		if (myArgs[1] == myArgs[2])
+			return myArgs[1];
+		if (myArgs[1] == CONST_TRUE && myArgs[2] == CONST_FALSE)
+			return myArgs[0];
+		if (myArgs[1] == CONST_FALSE && myArgs[2] == CONST_TRUE)
+			return NOT(myArgs[0]);
 		break;
 
 	default:
@@ -157,6 +157,11 @@ public:
 		return solverTimoutStatus;
 	}
 
+	// Stops a solver() call that is running in another thread. The interrupted
+	// call and all later calls return false and set the timeout status. Solver
+	// backends without support for this ignore it.
+	virtual void interrupt() { }
+
 	// manage CNF (usually only accessed by SAT solvers)
 
 	virtual void clear();
@@ -21,6 +21,10 @@
 #undef HAVE_LIBPTHREAD
 #undef HAVE_FSEEKO
 #endif
+/* Compress value change blocks on a separate thread, see fstWriterSetParallelMode(). */
+#if defined(YOSYS_ENABLE_THREADS) && defined(HAVE_LIBPTHREAD)
+#define FST_WRITER_PARALLEL 1
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 #undef HAVE_ALLOCA_H
 #endif
@@ -27,6 +27,7 @@
 
 #ifdef _YOSYS_
 #  include "kernel/yosys.h"
+#  include "kernel/threading.h"
 #  define my_printf YOSYS_NAMESPACE_PREFIX log
 #else
 #  define my_printf printf
@@ -295,8 +296,19 @@ class SubCircuit::SolverWorker
 		Graph graph;
 		adjMatrix_t adjMatrix;
 		std::vector<bool> usedNodes;
+		std::vector<std::map<std::string, int>> neighbourTypes;
 	};
 
+	// counts the neighbours of each type for every node, see matchSignatures()
+	static void findNeighbourTypes(GraphData &gd)
+	{
+		gd.neighbourTypes.clear();
+		gd.neighbourTypes.resize(gd.graph.nodes.size());
+		for (int i = 0; i < int(gd.graph.nodes.size()); i++)
+			for (const auto &it : gd.adjMatrix[i])
+				gd.neighbourTypes[i][gd.graph.nodes[it.first].typeId]++;
+	}
+
 	static void printAdjMatrix(const adjMatrix_t &matrix)
 	{
 		my_printf("%7s", "");
@@ -680,13 +692,14 @@ class SubCircuit::SolverWorker
 			}
 		}
 
-		bool compare(int needleEdge, int haystackEdge, const std::map<std::string, std::set<std::set<std::string>>> &swapPorts,
-				const std::map<std::string, std::set<std::map<std::string, std::string>>> &swapPermutations)
+		bool compare(std::map<std::pair<int, int>, bool> &cache, int needleEdge, int haystackEdge, const std::map<std::string, std::set<std::set<std::string>>> &swapPorts,
+				const std::map<std::string, std::set<std::map<std::string, std::string>>> &swapPermutations) const
 		{
 			std::pair<int, int> key(needleEdge, haystackEdge);
-			if (!compareCache.count(key))
-				compareCache[key] = edgeTypes.at(needleEdge).compare(edgeTypes.at(haystackEdge), swapPorts, swapPermutations);
-			return compareCache[key];
+			auto it = cache.find(key);
+			if (it == cache.end())
+				it = cache.insert(std::make_pair(key, edgeTypes.at(needleEdge).compare(edgeTypes.at(haystackEdge), swapPorts, swapPermutations))).first;
+			return it->second;
 		}
 
 		bool compare(int needleEdge, int haystackEdge, const std::map<std::string, std::string> &mapFromPorts, const std::map<std::string, std::set<std::set<std::string>>> &swapPorts,
@@ -718,6 +731,18 @@ class SubCircuit::SolverWorker
 	DiCache diCache;
 	bool verbose;
 
+	// limits the memory used for remembering failed partial matches
+	static const size_t maxFailedMatrices = 4096;
+
+	// State of a single search. Searches in different haystacks may run at
+	// the same time, each with its own cache for comparing edge types.
+	struct SearchState {
+		std::map<std::pair<int, int>, bool> &compareCache;
+		// enumeration matrices that are known to have no solution
+		std::set<std::vector<std::set<int>>> failedMatrices;
+		SearchState(std::map<std::pair<int, int>, bool> &compareCache) : compareCache(compareCache) { }
+	};
+
 	// main solver functions
 
 	bool matchNodePorts(const Graph &needle, int needleNodeIdx, const Graph &haystack, int haystackNodeIdx, const std::map<std::string, std::string> &swaps) const
@@ -846,6 +871,32 @@ class SubCircuit::SolverWorker
 		return false;
 	}
 
+	bool matchSignatures(const GraphData &needle, int needleNodeIdx, const GraphData &haystack, int haystackNodeIdx) const
+	{
+		// The neighbours of a needle node are mapped to distinct neighbours of
+		// the haystack node, so the haystack node must have at least as many
+		// neighbours, and at least as many of each type (or compatible types).
+
+		if (needle.adjMatrix[needleNodeIdx].size() > haystack.adjMatrix[haystackNodeIdx].size())
+			return false;
+
+		const std::map<std::string, int> &haystackTypes = haystack.neighbourTypes[haystackNodeIdx];
+		for (const auto &it : needle.neighbourTypes[needleNodeIdx])
+		{
+			int count = 0;
+			if (haystackTypes.count(it.first) > 0)
+				count += haystackTypes.at(it.first);
+			if (compatibleTypes.count(it.first) > 0)
+				for (const std::string &compatibleTypeId : compatibleTypes.at(it.first))
+					if (haystackTypes.count(compatibleTypeId) > 0)
+						count += haystackTypes.at(compatibleTypeId);
+			if (count < it.second)
+				return false;
+		}
+
+		return true;
+	}
+
 	void generateEnumerationMatrix(std::vector<std::set<int>> &enumerationMatrix, const GraphData &needle, const GraphData &haystack, const std::map<std::string, std::set<std::string>> &initialMappings) const
 	{
 		std::map<std::string, std::set<int>> haystackNodesByTypeId;
@@ -862,7 +913,7 @@ class SubCircuit::SolverWorker
 				const Graph::Node &hn = haystack.graph.nodes[j];
 				if (initialMappings.count(nn.nodeId) > 0 && initialMappings.at(nn.nodeId).count(hn.nodeId) == 0)
 					continue;
-				if (!matchNodes(needle, i, haystack, j))
+				if (!matchSignatures(needle, i, haystack, j) || !matchNodes(needle, i, haystack, j))
 					continue;
 				enumerationMatrix[i].insert(j);
 			}
@@ -873,14 +924,14 @@ class SubCircuit::SolverWorker
 						const Graph::Node &hn = haystack.graph.nodes[j];
 						if (initialMappings.count(nn.nodeId) > 0 && initialMappings.at(nn.nodeId).count(hn.nodeId) == 0)
 							continue;
-						if (!matchNodes(needle, i, haystack, j))
+						if (!matchSignatures(needle, i, haystack, j) || !matchNodes(needle, i, haystack, j))
 							continue;
 						enumerationMatrix[i].insert(j);
 					}
 		}
 	}
 
-	bool checkEnumerationMatrix(std::vector<std::set<int>> &enumerationMatrix, int i, int j, const GraphData &needle, const GraphData &haystack)
+	bool checkEnumerationMatrix(SearchState &state, std::vector<std::set<int>> &enumerationMatrix, int i, int j, const GraphData &needle, const GraphData &haystack)
 	{
 		for (const auto &it_needle : needle.adjMatrix.at(i))
 		{
@@ -890,7 +941,7 @@ class SubCircuit::SolverWorker
 			for (int haystackNeighbour : enumerationMatrix[needleNeighbour])
 				if (haystack.adjMatrix.at(j).count(haystackNeighbour) > 0) {
 					int haystackEdgeType = haystack.adjMatrix.at(j).at(haystackNeighbour);
-					if (diCache.compare(needleEdgeType, haystackEdgeType, swapPorts, swapPermutations)) {
+					if (diCache.compare(state.compareCache, needleEdgeType, haystackEdgeType, swapPorts, swapPermutations)) {
 						const Graph::Node &needleFromNode = needle.graph.nodes[i];
 						const Graph::Node &needleToNode = needle.graph.nodes[needleNeighbour];
 						const Graph::Node &haystackFromNode = haystack.graph.nodes[j];
@@ -908,7 +959,7 @@ class SubCircuit::SolverWorker
 		return true;
 	}
 
-	bool pruneEnumerationMatrix(std::vector<std::set<int>> &enumerationMatrix, const GraphData &needle, const GraphData &haystack, int &nextRow, bool allowOverlap)
+	bool pruneEnumerationMatrix(SearchState &state, std::vector<std::set<int>> &enumerationMatrix, const GraphData &needle, const GraphData &haystack, int &nextRow, bool allowOverlap)
 	{
 		bool didSomething = true;
 		while (didSomething)
@@ -918,7 +969,7 @@ class SubCircuit::SolverWorker
 			for (int i = 0; i < int(enumerationMatrix.size()); i++) {
 				std::set<int> newRow;
 				for (int j : enumerationMatrix[i]) {
-					if (!checkEnumerationMatrix(enumerationMatrix, i, j, needle, haystack))
+					if (!checkEnumerationMatrix(state, enumerationMatrix, i, j, needle, haystack))
 						didSomething = true;
 					else if (!allowOverlap && haystack.usedNodes[j])
 						didSomething = true;
@@ -1102,10 +1153,10 @@ class SubCircuit::SolverWorker
 		return false;
 	}
 
-	void ullmannRecursion(std::vector<Solver::Result> &results, std::vector<std::set<int>> &enumerationMatrix, int iter, const GraphData &needle, GraphData &haystack, bool allowOverlap, int limitResults)
+	void ullmannRecursion(std::vector<Solver::Result> &results, SearchState &state, std::vector<std::set<int>> &enumerationMatrix, int iter, const GraphData &needle, GraphData &haystack, bool allowOverlap, int limitResults)
 	{
 		int i = -1;
-		if (!pruneEnumerationMatrix(enumerationMatrix, needle, haystack, i, allowOverlap))
+		if (!pruneEnumerationMatrix(state, enumerationMatrix, needle, haystack, i, allowOverlap))
 			return;
 
 		if (i < 0)
@@ -1176,12 +1227,23 @@ class SubCircuit::SolverWorker
 			return;
 		}
 
+		// The same matrix can be reached on different paths through the
+		// recursion tree. Nodes only ever become used, so a matrix without
+		// solution stays without solution for the rest of the search.
+		if (state.failedMatrices.count(enumerationMatrix) > 0)
+			return;
+
 		if (verbose) {
 			my_printf("\n");
 			my_printf("Enumeration Matrix at recursion level %d (%d):\n", iter, i);
 			printEnumerationMatrix(enumerationMatrix, haystack.graph.nodes.size());
 		}
 
+		size_t numResults = results.size();
+		std::vector<std::set<int>> thisEnumerationMatrix;
+		if (state.failedMatrices.size() < maxFailedMatrices)
+			thisEnumerationMatrix = enumerationMatrix;
+
 		std::set<int> activeRow;
 		enumerationMatrix[i].swap(activeRow);
 
@@ -1202,12 +1264,15 @@ class SubCircuit::SolverWorker
 			nextEnumerationMatrix[i].insert(j);
 
 			// recursion
-			ullmannRecursion(results, nextEnumerationMatrix, iter+1, needle, haystack, allowOverlap, limitResults);
+			ullmannRecursion(results, state, nextEnumerationMatrix, iter+1, needle, haystack, allowOverlap, limitResults);
 
 			// we just have found something -> unroll to top recursion level
 			if (!allowOverlap && haystack.usedNodes[j] && iter > 0)
 				return;
 		}
+
+		if (results.size() == numResults && !thisEnumerationMatrix.empty())
+			state.failedMatrices.insert(thisEnumerationMatrix);
 	}
 
 	// additional data structes and functions for mining
@@ -1272,7 +1337,8 @@ class SubCircuit::SolverWorker
 			generateEnumerationMatrix(enumerationMatrix, needle, haystack, initialMappings);
 
 			haystack.usedNodes.resize(haystack.graph.nodes.size());
-			ullmannRecursion(results, enumerationMatrix, 0, needle, haystack, true, -1);
+			SearchState state(diCache.compareCache);
+			ullmannRecursion(results, state, enumerationMatrix, 0, needle, haystack, true, -1);
 		}
 
 		verbose = backupVerbose;
@@ -1290,6 +1356,7 @@ class SubCircuit::SolverWorker
 		needle.graph = Graph(graph, needle_nodes);
 		needle.graph.markAllExtern();
 		diCache.add(needle.graph, needle.adjMatrix, graphId, userSolver);
+		findNeighbourTypes(needle);
 
 		std::vector<Solver::Result> ullmannResults;
 		solveForMining(ullmannResults, needle);
@@ -1486,6 +1553,7 @@ protected:
 		gd.graphId = graphId;
 		gd.graph = graph;
 		diCache.add(gd.graph, gd.adjMatrix, graphId, userSolver);
+		findNeighbourTypes(gd);
 	}
 
 	void addCompatibleTypes(std::string needleTypeId, std::string haystackTypeId)
@@ -1516,9 +1584,13 @@ protected:
 		assert(graphData.count(needleGraphId) > 0);
 		assert(graphData.count(haystackGraphId) > 0);
 
-		const GraphData &needle = graphData[needleGraphId];
-		GraphData &haystack = graphData[haystackGraphId];
+		SearchState state(diCache.compareCache);
+		solve(results, state, graphData.at(needleGraphId), graphData.at(haystackGraphId), initialMappings, allowOverlap, maxSolutions);
+	}
 
+	void solve(std::vector<Solver::Result> &results, SearchState &state, const GraphData &needle, GraphData &haystack,
+			const std::map<std::string, std::set<std::string>> &initialMappings, bool allowOverlap, int maxSolutions)
+	{
 		std::vector<std::set<int>> enumerationMatrix;
 		generateEnumerationMatrix(enumerationMatrix, needle, haystack, initialMappings);
 
@@ -1552,7 +1624,53 @@ protected:
 		}
 
 		haystack.usedNodes.resize(haystack.graph.nodes.size());
-		ullmannRecursion(results, enumerationMatrix, 0, needle, haystack, allowOverlap, maxSolutions > 0 ? results.size() + maxSolutions : -1);
+		ullmannRecursion(results, state, enumerationMatrix, 0, needle, haystack, allowOverlap, maxSolutions > 0 ? results.size() + maxSolutions : -1);
+	}
+
+	void solve(std::vector<Solver::Result> &results, const std::vector<std::string> &needleGraphIds, const std::vector<std::string> &haystackGraphIds,
+			bool allowOverlap, int maxSolutions)
+	{
+		for (const auto &graphId : needleGraphIds)
+			assert(graphData.count(graphId) > 0);
+		for (const auto &graphId : haystackGraphIds)
+			assert(graphData.count(graphId) > 0);
+
+		int numThreads = 1;
+#ifdef _YOSYS_
+		if (!verbose)
+			numThreads = YOSYS_NAMESPACE_PREFIX yosys_thread_count(haystackGraphIds.size());
+#endif
+
+		// The needles are solved one after another in each haystack, as the
+		// nodes used by one solution are not available to the next one.
+		// Different haystacks are independent and are solved in parallel,
+		// each with its own edge compare cache.
+		std::map<std::string, std::set<std::string>> emptyInitialMapping;
+		std::vector<std::vector<std::vector<Solver::Result>>> haystackResults(haystackGraphIds.size());
+		auto solveHaystack = [&](int j) {
+			std::map<std::pair<int, int>, bool> compareCache;
+			GraphData &haystack = graphData.at(haystackGraphIds[j]);
+			haystackResults[j].resize(needleGraphIds.size());
+			for (int i = 0; i < int(needleGraphIds.size()); i++) {
+				SearchState state(numThreads > 1 ? compareCache : diCache.compareCache);
+				solve(haystackResults[j][i], state, graphData.at(needleGraphIds[i]), haystack, emptyInitialMapping, allowOverlap, maxSolutions);
+			}
+		};
+
+		if (numThreads > 1) {
+#ifdef _YOSYS_
+			YOSYS_NAMESPACE_PREFIX ThreadPool::run(haystackGraphIds.size(), solveHaystack, numThreads);
+#endif
+		} else {
+			for (int j = 0; j < int(haystackGraphIds.size()); j++)
+				solveHaystack(j);
+		}
+
+		// same order as calling solve() for each needle and haystack
+		for (int i = 0; i < int(needleGraphIds.size()); i++)
+			for (int j = 0; j < int(haystackGraphIds.size()); j++)
+				for (auto &result : haystackResults[j][i])
+					results.push_back(result);
 	}
 
 	void mine(std::vector<Solver::MineResult> &results, int minNodes, int maxNodes, int minMatches, int limitMatchesPerGraph)
@@ -1675,6 +1793,12 @@ void SubCircuit::Solver::solve(std::vector<Result> &results, std::string needleG
 	worker->solve(results, needleGraphId, haystackGraphId, initialMappings, allowOverlap, maxSolutions);
 }
 
+void SubCircuit::Solver::solve(std::vector<Result> &results, const std::vector<std::string> &needleGraphIds, const std::vector<std::string> &haystackGraphIds,
+		bool allowOverlap, int maxSolutions)
+{
+	worker->solve(results, needleGraphIds, haystackGraphIds, allowOverlap, maxSolutions);
+}
+
 void SubCircuit::Solver::mine(std::vector<MineResult> &results, int minNodes, int maxNodes, int minMatches, int limitMatchesPerGraph)
 {
 	worker->mine(results, minNodes, maxNodes, minMatches, limitMatchesPerGraph);
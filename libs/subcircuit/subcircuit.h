@@ -145,6 +145,11 @@ namespace SubCircuit
 		void solve(std::vector<Result> &results, std::string needleGraphId, std::string haystackGraphId,
 				const std::map<std::string, std::set<std::string>> &initialMapping, bool allowOverlap = true, int maxSolutions = -1);
 
+		// Same results as calling solve() for each needle (outer loop) and haystack (inner loop). Within Yosys the
+		// haystacks are solved in parallel, so the user callbacks must be thread-safe unless setVerbose() was used.
+		void solve(std::vector<Result> &results, const std::vector<std::string> &needleGraphIds, const std::vector<std::string> &haystackGraphIds,
+				bool allowOverlap = true, int maxSolutions = -1);
+
 		void mine(std::vector<MineResult> &results, int minNodes, int maxNodes, int minMatches, int limitMatchesPerGraph = -1);
 
 		void clearOverlapHistory();
@@ -2432,6 +2432,100 @@ namespace YOSYS_PYTHON {
 		Yosys::log_streams.insert(Yosys::log_streams.begin(), output);
 	};
 
+	/// @brief An int array as a memoryview with format 'i', e.g. for numpy.asarray().
+	boost::python::object int_array(const std::vector<int> &data)
+	{
+		using namespace boost::python;
+		object bytes(handle<>(PyBytes_FromStringAndSize((const char*)data.data(), data.size() * sizeof(int))));
+		object view(handle<>(PyMemoryView_FromObject(bytes.ptr())));
+		return view.attr("cast")("i");
+	}
+
+	boost::python::list str_list(const std::vector<std::string> &data)
+	{
+		boost::python::list result;
+		for (auto &str : data)
+			result.append(str);
+		return result;
+	}
+
+	/// @brief The netlist of a module as flat arrays over dense ids, without a
+	///        Python object for each cell, wire or connection.
+	///
+	/// Wire bits are numbered consecutively, wire by wire, starting at
+	/// wire_offsets[wire]. Constant bits are encoded as -1 - State, i.e. -1 for
+	/// 0, -2 for 1, -3 for x and -4 for z. Each connected cell port bit is one
+	/// entry in the conn_* arrays, and each bit of a module level connection
+	/// one entry in alias_lhs and alias_rhs.
+	boost::python::dict module_netlist(Module *module_py)
+	{
+		Yosys::RTLIL::Module *module = module_py->get_cpp_obj();
+
+		Yosys::dict<Yosys::RTLIL::Wire*, int> first_bit;
+		std::vector<std::string> wire_names;
+		std::vector<int> wire_offsets, wire_widths;
+		int num_bits = 0;
+		for (auto wire : module->wires()) {
+			first_bit[wire] = num_bits;
+			wire_names.push_back(wire->name.str());
+			wire_offsets.push_back(num_bits);
+			wire_widths.push_back(wire->width);
+			num_bits += wire->width;
+		}
+
+		auto bit_id = [&](const Yosys::RTLIL::SigBit &bit) {
+			return bit.wire ? first_bit.at(bit.wire) + bit.offset : -1 - int(bit.data);
+		};
+
+		Yosys::idict<Yosys::RTLIL::IdString> types, ports;
+		std::vector<std::string> cell_names;
+		std::vector<int> cell_types, conn_cell, conn_port, conn_index, conn_bit;
+		for (auto cell : module->cells()) {
+			int cell_id = Yosys::GetSize(cell_names);
+			cell_names.push_back(cell->name.str());
+			cell_types.push_back(types(cell->type));
+			for (auto &conn : cell->connections()) {
+				int port_id = ports(conn.first);
+				for (int i = 0; i < Yosys::GetSize(conn.second); i++) {
+					conn_cell.push_back(cell_id);
+					conn_port.push_back(port_id);
+					conn_index.push_back(i);
+					conn_bit.push_back(bit_id(conn.second[i]));
+				}
+			}
+		}
+
+		std::vector<int> alias_lhs, alias_rhs;
+		for (auto &conn : module->connections())
+			for (int i = 0; i < Yosys::GetSize(conn.first); i++) {
+				alias_lhs.push_back(bit_id(conn.first[i]));
+				alias_rhs.push_back(bit_id(conn.second[i]));
+			}
+
+		std::vector<std::string> type_names, port_names;
+		for (auto &type : types)
+			type_names.push_back(type.str());
+		for (auto &port : ports)
+			port_names.push_back(port.str());
+
+		boost::python::dict result;
+		result["num_bits"] = num_bits;
+		result["wire_names"] = str_list(wire_names);
+		result["wire_offsets"] = int_array(wire_offsets);
+		result["wire_widths"] = int_array(wire_widths);
+		result["cell_names"] = str_list(cell_names);
+		result["type_names"] = str_list(type_names);
+		result["cell_types"] = int_array(cell_types);
+		result["port_names"] = str_list(port_names);
+		result["conn_cell"] = int_array(conn_cell);
+		result["conn_port"] = int_array(conn_port);
+		result["conn_index"] = int_array(conn_index);
+		result["conn_bit"] = int_array(conn_bit);
+		result["alias_lhs"] = int_array(alias_lhs);
+		result["alias_rhs"] = int_array(alias_rhs);
+		return result;
+	}
+
 
 	BOOST_PYTHON_MODULE(libyosys)
 	{
@@ -2441,6 +2535,7 @@ namespace YOSYS_PYTHON {
 		scope().attr("_hidden") = new Initializer();
 
 		def("log_to_stream", &log_to_stream);
+		def("module_netlist", &module_netlist);
 """)
 
 	for enum in enums:
@@ -18,73 +18,107 @@
  */
 
 #include "kernel/yosys.h"
+#include <queue>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// Names the private objects from their named neighbours, starting with the
+// best proposals: private cells get a name from a public wire connected to
+// them, private wires one from a public cell. Objects that get a name this
+// way propose names for their own private neighbours in turn, so every
+// object is renamed at most once and proposed names only along the
+// connections of newly named objects.
 int autoname_worker(Module *module, const dict<Wire*, int>& wire_score)
 {
-	dict<Cell*, pair<int, string>> proposed_cell_names;
-	dict<Wire*, pair<int, string>> proposed_wire_names;
-	int best_score = -1;
-
-	for (auto cell : module->selected_cells()) {
-		if (cell->name[0] == '$') {
-			for (auto &conn : cell->connections()) {
-				string suffix;
-				for (auto bit : conn.second)
-					if (bit.wire != nullptr && bit.wire->name[0] != '$') {
-						if (suffix.empty())
-							suffix = stringf("_%s_%s", log_id(cell->type), log_id(conn.first));
-						string new_name(bit.wire->name.str() + suffix);
-						int score = wire_score.at(bit.wire);
-						if (cell->output(conn.first)) score = 0;
-						score = 10000*score + new_name.size();
-						if (!proposed_cell_names.count(cell) || score < proposed_cell_names.at(cell).first) {
-							if (best_score < 0 || score < best_score)
-								best_score = score;
-							proposed_cell_names[cell] = make_pair(score, new_name);
-						}
-					}
-			}
-		} else {
-			for (auto &conn : cell->connections()) {
-				string suffix;
-				for (auto bit : conn.second)
-					if (bit.wire != nullptr && bit.wire->name[0] == '$' && !bit.wire->port_id) {
-						if (suffix.empty())
-							suffix = stringf("_%s", log_id(conn.first));
-						string new_name(cell->name.str() + suffix);
-						int score = wire_score.at(bit.wire);
-						if (cell->output(conn.first)) score = 0;
-						score = 10000*score + new_name.size();
-						if (!proposed_wire_names.count(bit.wire) || score < proposed_wire_names.at(bit.wire).first) {
-							if (best_score < 0 || score < best_score)
-								best_score = score;
-							proposed_wire_names[bit.wire] = make_pair(score, new_name);
-						}
-					}
-			}
+	struct proposal_t {
+		int64_t score;
+		int order;
+		Cell *cell;
+		Wire *wire;
+		bool name_cell;
+		std::string name;
+
+		// std::priority_queue pops the largest element, i.e. the
+		// lowest score proposed first
+		bool operator<(const proposal_t &other) const {
+			return std::tie(score, order) > std::tie(other.score, other.order);
 		}
-	}
+	};
 
-	for (auto &it : proposed_cell_names) {
-		if (best_score*2 < it.second.first)
-			continue;
-		IdString n = module->uniquify(IdString(it.second.second));
-		log_debug("Rename cell %s in %s to %s.\n", log_id(it.first), log_id(module), log_id(n));
-		module->rename(it.first, n);
-	}
+	std::priority_queue<proposal_t> queue;
+	dict<Cell*, int64_t> proposed_cell_scores;
+	dict<Wire*, int64_t> proposed_wire_scores;
+	dict<Wire*, std::vector<std::pair<Cell*, IdString>>> wire_ports;
+	int order = 0;
+
+	auto propose_cell = [&](Cell *cell, IdString port, Wire *wire) {
+		string new_name(wire->name.str() + stringf("_%s_%s", log_id(cell->type), log_id(port)));
+		int64_t score = cell->output(port) ? 0 : wire_score.at(wire);
+		score = 10000*score + new_name.size();
+		auto it = proposed_cell_scores.find(cell);
+		if (it != proposed_cell_scores.end() && it->second <= score)
+			return;
+		proposed_cell_scores[cell] = score;
+		queue.push(proposal_t{score, order++, cell, wire, true, new_name});
+	};
 
-	for (auto &it : proposed_wire_names) {
-		if (best_score*2 < it.second.first)
-			continue;
-		IdString n = module->uniquify(IdString(it.second.second));
-		log_debug("Rename wire %s in %s to %s.\n", log_id(it.first), log_id(module), log_id(n));
-		module->rename(it.first, n);
+	auto propose_wire = [&](Wire *wire, Cell *cell, IdString port) {
+		string new_name(cell->name.str() + stringf("_%s", log_id(port)));
+		int64_t score = cell->output(port) ? 0 : wire_score.at(wire);
+		score = 10000*score + new_name.size();
+		auto it = proposed_wire_scores.find(wire);
+		if (it != proposed_wire_scores.end() && it->second <= score)
+			return;
+		proposed_wire_scores[wire] = score;
+		queue.push(proposal_t{score, order++, cell, wire, false, new_name});
+	};
+
+	for (auto cell : module->selected_cells())
+		for (auto &conn : cell->connections())
+			for (auto bit : conn.second) {
+				if (bit.wire == nullptr)
+					continue;
+				auto &ports = wire_ports[bit.wire];
+				if (ports.empty() || ports.back() != std::make_pair(cell, conn.first))
+					ports.push_back(std::make_pair(cell, conn.first));
+				if (cell->name[0] == '$' && bit.wire->name[0] != '$')
+					propose_cell(cell, conn.first, bit.wire);
+				if (cell->name[0] != '$' && bit.wire->name[0] == '$' && !bit.wire->port_id)
+					propose_wire(bit.wire, cell, conn.first);
+			}
+
+	int count = 0;
+	while (!queue.empty())
+	{
+		proposal_t p = queue.top();
+		queue.pop();
+
+		if (p.name_cell) {
+			if (p.cell->name[0] != '$')
+				continue;
+			IdString n = module->uniquify(IdString(p.name));
+			log_debug("Rename cell %s in %s to %s.\n", log_id(p.cell), log_id(module), log_id(n));
+			module->rename(p.cell, n);
+			count++;
+			for (auto &conn : p.cell->connections())
+				for (auto bit : conn.second)
+					if (bit.wire != nullptr && bit.wire->name[0] == '$' && !bit.wire->port_id)
+						propose_wire(bit.wire, p.cell, conn.first);
+		} else {
+			if (p.wire->name[0] != '$')
+				continue;
+			IdString n = module->uniquify(IdString(p.name));
+			log_debug("Rename wire %s in %s to %s.\n", log_id(p.wire), log_id(module), log_id(n));
+			module->rename(p.wire, n);
+			count++;
+			for (auto &it : wire_ports[p.wire])
+				if (it.first->name[0] == '$')
+					propose_cell(it.first, it.second, p.wire);
+		}
 	}
 
-	return proposed_cell_names.size() + proposed_wire_names.size();
+	return count;
 }
 
 struct AutonamePass : public Pass {
@@ -122,15 +156,9 @@ struct AutonamePass : public Pass {
 				if (bit.wire != nullptr)
 					wire_score[bit.wire]++;
 
-			int count = 0, iter = 0;
-			while (1) {
-				iter++;
-				int n = autoname_worker(module, wire_score);
-				if (!n) break;
-				count += n;
-			}
+			int count = autoname_worker(module, wire_score);
 			if (count > 0)
-				log("Renamed %d objects in module %s (%d iterations).\n", count, log_id(module), iter);
+				log("Renamed %d objects in module %s.\n", count, log_id(module));
 		}
 	}
 } AutonamePass;
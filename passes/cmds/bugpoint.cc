@@ -18,6 +18,7 @@
  */
 
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
 #include "backends/rtlil/rtlil_backend.h"
 
 USING_YOSYS_NAMESPACE
@@ -92,21 +93,52 @@ struct BugpointPass : public Pass {
 		log("    -runner \"<prefix>\"\n");
 		log("        child process wrapping command, e.g., \"timeout 30\", or valgrind.\n");
 		log("\n");
+		log("    -j <N>\n");
+		log("        test up to N candidates at the same time, in separate Yosys processes.\n");
+		log("        the candidates are written to bugpoint-case-<i>.il and their logs to\n");
+		log("        bugpoint-case-<i>.log. the resulting testcase does not depend on N.\n");
+		log("\n");
+		log("    -bisect\n");
+		log("        first try to remove large batches of parts at once, halving the batch\n");
+		log("        size after each pass, before removing parts one at a time. this needs\n");
+		log("        far fewer steps if most of the design is not related to the crash.\n");
+		log("\n");
 	}
 
-	bool run_yosys(RTLIL::Design *design, string runner, string yosys_cmd, string yosys_arg)
+	// number of parts considered for removal, set by remove_something()
+	// when it does not find the part with the given index
+	int num_parts = 0;
+	bool quiet = false;
+
+	void log_try(RTLIL::Design *design, const char *format, ...) YS_ATTRIBUTE(format(printf, 3, 4))
+	{
+		if (quiet)
+			return;
+		va_list ap;
+		va_start(ap, format);
+		logv_header(design, format, ap);
+		va_end(ap);
+	}
+
+	// Writes the design to <name>.il and returns the command that runs the
+	// script on it with the log going to <name>.log.
+	string write_case(RTLIL::Design *design, string runner, string yosys_cmd, string yosys_arg, string name)
 	{
 		design->sort();
 
-		std::ofstream f("bugpoint-case.il");
+		std::ofstream f(name + ".il");
 		RTLIL_BACKEND::dump_design(f, design, /*only_selected=*/false, /*flag_m=*/true, /*flag_n=*/false);
 		f.close();
 
-		string yosys_cmdline = stringf("%s %s -qq -L bugpoint-case.log %s bugpoint-case.il", runner.c_str(), yosys_cmd.c_str(), yosys_arg.c_str());
-		return run_command(yosys_cmdline) == 0;
+		return stringf("%s %s -qq -L %s.log %s %s.il", runner.c_str(), yosys_cmd.c_str(), name.c_str(), yosys_arg.c_str(), name.c_str());
+	}
+
+	bool run_yosys(RTLIL::Design *design, string runner, string yosys_cmd, string yosys_arg)
+	{
+		return run_command(write_case(design, runner, yosys_cmd, yosys_arg, "bugpoint-case")) == 0;
 	}
 
-	bool check_logfile(string grep)
+	bool check_logfile(string grep, string name = "bugpoint-case")
 	{
 		if (grep.empty())
 			return true;
@@ -114,7 +146,7 @@ struct BugpointPass : public Pass {
 		if (grep.size() > 2 && grep.front() == '"' && grep.back() == '"')
 			grep = grep.substr(1, grep.size() - 2);
 
-		std::ifstream f("bugpoint-case.log");
+		std::ifstream f(name + ".log");
 		while (!f.eof())
 		{
 			string line;
@@ -141,17 +173,15 @@ struct BugpointPass : public Pass {
 		return design_copy;
 	}
 
-	RTLIL::Design *simplify_something(RTLIL::Design *design, int &seed, bool stage2, bool modules, bool ports, bool cells, bool connections, bool processes, bool assigns, bool updates, bool wires)
+	// Removes the part with the given index from the design, returns false if
+	// there is no such part.
+	bool remove_something(RTLIL::Design *design, int seed, bool stage2, bool modules, bool ports, bool cells, bool connections, bool processes, bool assigns, bool updates, bool wires)
 	{
-		RTLIL::Design *design_copy = new RTLIL::Design;
-		for (auto module : design->modules())
-			design_copy->add(module->clone());
-
 		int index = 0;
 		if (modules)
 		{
 			Module *removed_module = nullptr;
-			for (auto module : design_copy->modules())
+			for (auto module : design->modules())
 			{
 				if (module->get_blackbox_attribute())
 					continue;
@@ -161,19 +191,19 @@ struct BugpointPass : public Pass {
 
 				if (index++ == seed)
 				{
-					log_header(design, "Trying to remove module %s.\n", log_id(module));
+					log_try(design, "Trying to remove module %s.\n", log_id(module));
 					removed_module = module;
 					break;
 				}
 			}
 			if (removed_module) {
-				design_copy->remove(removed_module);
-				return design_copy;
+				design->remove(removed_module);
+				return true;
 			}
 		}
 		if (ports)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -191,17 +221,17 @@ struct BugpointPass : public Pass {
 
 					if (index++ == seed)
 					{
-						log_header(design, "Trying to remove module port %s.\n", log_id(wire));
+						log_try(design, "Trying to remove module port %s.\n", log_id(wire));
 						wire->port_input = wire->port_output = false;
 						mod->fixup_ports();
-						return design_copy;
+						return true;
 					}
 				}
 			}
 		}
 		if (cells)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -214,20 +244,20 @@ struct BugpointPass : public Pass {
 
 					if (index++ == seed)
 					{
-						log_header(design, "Trying to remove cell %s.%s.\n", log_id(mod), log_id(cell));
+						log_try(design, "Trying to remove cell %s.%s.\n", log_id(mod), log_id(cell));
 						removed_cell = cell;
 						break;
 					}
 				}
 				if (removed_cell) {
 					mod->remove(removed_cell);
-					return design_copy;
+					return true;
 				}
 			}
 		}
 		if (connections)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -245,16 +275,16 @@ struct BugpointPass : public Pass {
 
 						if (index++ == seed)
 						{
-							log_header(design, "Trying to remove cell port %s.%s.%s.\n", log_id(mod), log_id(cell), log_id(it.first));
+							log_try(design, "Trying to remove cell port %s.%s.%s.\n", log_id(mod), log_id(cell), log_id(it.first));
 							RTLIL::SigSpec port_x(State::Sx, port.size());
 							cell->unsetPort(it.first);
 							cell->setPort(it.first, port_x);
-							return design_copy;
+							return true;
 						}
 
 						if (!stage2 && (cell->input(it.first) || cell->output(it.first)) && index++ == seed)
 						{
-							log_header(design, "Trying to expose cell port %s.%s.%s as module port.\n", log_id(mod), log_id(cell), log_id(it.first));
+							log_try(design, "Trying to expose cell port %s.%s.%s as module port.\n", log_id(mod), log_id(cell), log_id(it.first));
 							RTLIL::Wire *wire = mod->addWire(NEW_ID, port.size());
 							wire->set_bool_attribute(ID($bugpoint));
 							wire->port_input = cell->input(it.first);
@@ -262,7 +292,7 @@ struct BugpointPass : public Pass {
 							cell->unsetPort(it.first);
 							cell->setPort(it.first, wire);
 							mod->fixup_ports();
-							return design_copy;
+							return true;
 						}
 					}
 				}
@@ -270,7 +300,7 @@ struct BugpointPass : public Pass {
 		}
 		if (processes)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -283,20 +313,20 @@ struct BugpointPass : public Pass {
 
 					if (index++ == seed)
 					{
-						log_header(design, "Trying to remove process %s.%s.\n", log_id(mod), log_id(process.first));
+						log_try(design, "Trying to remove process %s.%s.\n", log_id(mod), log_id(process.first));
 						removed_process = process.second;
 						break;
 					}
 				}
 				if (removed_process) {
 					mod->remove(removed_process);
-					return design_copy;
+					return true;
 				}
 			}
 		}
 		if (assigns)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -312,9 +342,9 @@ struct BugpointPass : public Pass {
 						{
 							if (index++ == seed)
 							{
-								log_header(design, "Trying to remove assign %s %s in %s.%s.\n", log_signal(it->first), log_signal(it->second), log_id(mod), log_id(pr.first));
+								log_try(design, "Trying to remove assign %s %s in %s.%s.\n", log_signal(it->first), log_signal(it->second), log_id(mod), log_id(pr.first));
 								cs->actions.erase(it);
-								return design_copy;
+								return true;
 							}
 						}
 						for (auto &sw : cs->switches)
@@ -325,7 +355,7 @@ struct BugpointPass : public Pass {
 		}
 		if (updates)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -338,9 +368,9 @@ struct BugpointPass : public Pass {
 						{
 							if (index++ == seed)
 							{
-								log_header(design, "Trying to remove sync %s update %s %s in %s.%s.\n", log_signal(sy->signal), log_signal(it->first), log_signal(it->second), log_id(mod), log_id(pr.first));
+								log_try(design, "Trying to remove sync %s update %s %s in %s.%s.\n", log_signal(sy->signal), log_signal(it->first), log_signal(it->second), log_id(mod), log_id(pr.first));
 								sy->actions.erase(it);
-								return design_copy;
+								return true;
 							}
 						}
 						int i = 0;
@@ -348,7 +378,7 @@ struct BugpointPass : public Pass {
 						{
 							if (index++ == seed)
 							{
-								log_header(design, "Trying to remove sync %s memwr %s %s %s %s in %s.%s.\n", log_signal(sy->signal), log_id(it->memid), log_signal(it->address), log_signal(it->data), log_signal(it->enable), log_id(mod), log_id(pr.first));
+								log_try(design, "Trying to remove sync %s memwr %s %s %s %s in %s.%s.\n", log_signal(sy->signal), log_id(it->memid), log_signal(it->address), log_signal(it->data), log_signal(it->enable), log_id(mod), log_id(pr.first));
 								sy->mem_write_actions.erase(it);
 								// Remove the bit for removed action from other actions' priority masks.
 								for (auto it2 = sy->mem_write_actions.begin(); it2 != sy->mem_write_actions.end(); ++it2) {
@@ -357,7 +387,7 @@ struct BugpointPass : public Pass {
 										mask.bits.erase(mask.bits.begin() + i);
 									}
 								}
-								return design_copy;
+								return true;
 							}
 						}
 					}
@@ -366,7 +396,7 @@ struct BugpointPass : public Pass {
 		}
 		if (wires)
 		{
-			for (auto mod : design_copy->modules())
+			for (auto mod : design->modules())
 			{
 				if (mod->get_blackbox_attribute())
 					continue;
@@ -382,25 +412,57 @@ struct BugpointPass : public Pass {
 
 					if (index++ == seed)
 					{
-						log_header(design, "Trying to remove wire %s.%s.\n", log_id(mod), log_id(wire));
+						log_try(design, "Trying to remove wire %s.%s.\n", log_id(mod), log_id(wire));
 						removed_wire = wire;
 						break;
 					}
 				}
 				if (removed_wire) {
 					mod->remove({removed_wire});
-					return design_copy;
+					return true;
 				}
 			}
 		}
-		delete design_copy;
-		return nullptr;
+		num_parts = index;
+		return false;
+	}
+
+	// Returns a copy of the design with up to `count` parts removed, starting
+	// with the one with the given index. Removing a part moves the next one to
+	// its index, so the parts removed are mostly consecutive.
+	RTLIL::Design *simplify_something(RTLIL::Design *design, int seed, int count, bool stage2, bool modules, bool ports, bool cells, bool connections, bool processes, bool assigns, bool updates, bool wires)
+	{
+		RTLIL::Design *design_copy = new RTLIL::Design;
+		for (auto module : design->modules())
+			design_copy->add(module->clone());
+
+		if (count > 1) {
+			log_header(design, "Trying to remove up to %d parts starting with part %d.\n", count, seed);
+			quiet = true;
+		}
+		int removed = 0;
+		while (removed < count && remove_something(design_copy, seed, stage2, modules, ports, cells, connections, processes, assigns, updates, wires))
+			removed++;
+		quiet = false;
+
+		if (removed == 0) {
+			delete design_copy;
+			return nullptr;
+		}
+		return design_copy;
+	}
+
+	int count_parts(RTLIL::Design *design, bool stage2, bool modules, bool ports, bool cells, bool connections, bool processes, bool assigns, bool updates, bool wires)
+	{
+		remove_something(design, -1, stage2, modules, ports, cells, connections, processes, assigns, updates, wires);
+		return num_parts;
 	}
 
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		string yosys_cmd = "yosys", yosys_arg, grep, runner;
-		bool fast = false, clean = false;
+		bool fast = false, clean = false, bisect = false;
+		int max_jobs = 1;
 		bool modules = false, ports = false, cells = false, connections = false, processes = false, assigns = false, updates = false, wires = false, has_part = false;
 
 		log_header(design, "Executing BUGPOINT pass (minimize testcases).\n");
@@ -477,6 +539,14 @@ struct BugpointPass : public Pass {
 				has_part = true;
 				continue;
 			}
+			if (args[argidx] == "-j" && argidx + 1 < args.size()) {
+				max_jobs = std::max(1, atoi(args[++argidx].c_str()));
+				continue;
+			}
+			if (args[argidx] == "-bisect") {
+				bisect = true;
+				continue;
+			}
 			if (args[argidx] == "-runner" && argidx + 1 < args.size()) {
 				runner = args[++argidx];
 				if (runner.size() && runner.at(0) == '"') {
@@ -513,41 +583,81 @@ struct BugpointPass : public Pass {
 		if (!check_logfile(grep))
 			log_cmd_error("The provided grep string is not found in the log file!\n");
 
-		int seed = 0;
+		int seed = 0, batch = 1;
 		bool found_something = false, stage2 = false;
+		if (bisect) {
+			batch = count_parts(crashing_design, stage2, modules, ports, cells, connections, processes, assigns, updates, wires) / 2;
+			batch = std::max(batch, 1);
+		}
 		while (true)
 		{
-			if (RTLIL::Design *simplified = simplify_something(crashing_design, seed, stage2, modules, ports, cells, connections, processes, assigns, updates, wires))
+			// The candidates remove the parts starting at seed, seed+batch, ...
+			// from the current testcase. The first one that crashes is taken,
+			// which is the one that testing them one at a time would find.
+			std::vector<RTLIL::Design*> candidates;
+			while (GetSize(candidates) < max_jobs)
 			{
-				simplified = clean_design(simplified, fast, /*do_delete=*/true);
+				RTLIL::Design *simplified = simplify_something(crashing_design, seed + GetSize(candidates) * batch, batch, stage2, modules, ports, cells, connections, processes, assigns, updates, wires);
+				if (simplified == nullptr)
+					break;
+				candidates.push_back(clean_design(simplified, fast, /*do_delete=*/true));
+			}
 
-				bool crashes;
-				if (clean)
-				{
-					RTLIL::Design *testcase = clean_design(simplified);
-					crashes = !run_yosys(testcase, runner, yosys_cmd, yosys_arg);
-					delete testcase;
+			if (!candidates.empty())
+			{
+				int num_cases = GetSize(candidates);
+				std::vector<string> names(num_cases), cmdlines(num_cases);
+				for (int i = 0; i < num_cases; i++) {
+					names[i] = max_jobs > 1 ? stringf("bugpoint-case-%d", i) : string("bugpoint-case");
+					if (clean) {
+						RTLIL::Design *testcase = clean_design(candidates[i]);
+						cmdlines[i] = write_case(testcase, runner, yosys_cmd, yosys_arg, names[i]);
+						delete testcase;
+					} else {
+						cmdlines[i] = write_case(candidates[i], runner, yosys_cmd, yosys_arg, names[i]);
+					}
 				}
-				else
-				{
-					crashes = !run_yosys(simplified, runner, yosys_cmd, yosys_arg);
+
+				std::vector<int> ret(num_cases);
+				ThreadPool::run(num_cases, [&](int i) {
+					ret[i] = run_command(cmdlines[i]);
+				}, num_cases);
+
+				int crashing = -1;
+				for (int i = 0; i < num_cases && crashing < 0; i++) {
+					if (ret[i] != 0 && check_logfile(grep, names[i])) {
+						log("Testcase crashes.\n");
+						crashing = i;
+					} else {
+						log("Testcase does not crash.\n");
+					}
 				}
 
-				if (crashes && check_logfile(grep))
+				for (int i = 0; i < num_cases; i++)
+					if (i != crashing)
+						delete candidates[i];
+
+				if (crashing >= 0)
 				{
-					log("Testcase crashes.\n");
 					if (crashing_design != design)
 						delete crashing_design;
-					crashing_design = simplified;
+					crashing_design = candidates[crashing];
 					found_something = true;
+					seed += crashing * batch;
 				}
 				else
 				{
-					log("Testcase does not crash.\n");
-					delete simplified;
-					seed++;
+					seed += num_cases * batch;
 				}
 			}
+			else if (batch > 1)
+			{
+				seed = 0;
+				found_something = false;
+				batch = std::min(batch / 2, count_parts(crashing_design, stage2, modules, ports, cells, connections, processes, assigns, updates, wires) / 2);
+				batch = std::max(batch, 1);
+				log("Trying to remove batches of %d parts.\n", batch);
+			}
 			else
 			{
 				seed = 0;
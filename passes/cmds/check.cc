@@ -20,11 +20,356 @@
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
-#include "kernel/utils.h"
+#include "kernel/netgraph.h"
+
+#include <atomic>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+struct CheckOptions
+{
+	bool noinit = false;
+	bool initdrv = false;
+	bool mapped = false;
+	bool allow_tbuf = false;
+};
+
+struct CheckWorker
+{
+	const CheckOptions &opt;
+	RTLIL::Module *module;
+	FlatSigMap sigmap;
+	int counter = 0;
+
+	// Dense ids for the sigmapped bits, and the per-bit data indexed by them.
+	// The order vectors hold the bits in the order in which they were first
+	// driven or used, which is the order in which they are reported.
+	idict<RTLIL::SigBit> bits;
+	std::vector<int> driver_count;
+	std::vector<char> driven, used;
+	std::vector<int> driven_order, used_order;
+
+	// The names of the drivers are only collected for the bits that are
+	// reported, by a second scan of the module.
+	bool describing = false;
+	std::vector<char> reported;
+	dict<int, std::vector<std::string>> driver_names;
+
+	// The graph of the logic cells and the bits they read and drive, for
+	// finding combinational loops. Only bits connected to logic cells get a
+	// node; node_bit and node_cell tell what a node stands for.
+	NetGraph graph;
+	std::vector<int> bit_node, node_bit;
+	std::vector<RTLIL::Cell*> node_cell;
+
+	CheckWorker(const CheckOptions &opt, RTLIL::Module *module) : opt(opt), module(module), sigmap(module) { }
+
+	int bit_id(RTLIL::SigBit bit)
+	{
+		int id = bits(bit);
+		if (id == GetSize(driver_count)) {
+			driver_count.push_back(0);
+			driven.push_back(false);
+			used.push_back(false);
+			bit_node.push_back(-1);
+		}
+		return id;
+	}
+
+	int add_node(int bit, RTLIL::Cell *cell)
+	{
+		node_bit.push_back(bit);
+		node_cell.push_back(cell);
+		return graph.add_node();
+	}
+
+	int wire_node(RTLIL::SigBit bit)
+	{
+		int id = bit_id(bit);
+		if (bit_node[id] < 0)
+			bit_node[id] = add_node(id, nullptr);
+		return bit_node[id];
+	}
+
+	template<typename F>
+	void add_driver(RTLIL::SigBit bit, F describe)
+	{
+		int id = bit_id(bit);
+		if (describing) {
+			if (reported[id])
+				driver_names[id].push_back(describe());
+			return;
+		}
+		if (!driven[id]) {
+			driven[id] = true;
+			driven_order.push_back(id);
+		}
+	}
+
+	void add_user(RTLIL::SigBit bit)
+	{
+		if (describing || !bit.wire)
+			return;
+		int id = bit_id(bit);
+		if (!used[id]) {
+			used[id] = true;
+			used_order.push_back(id);
+		}
+	}
+
+	void count_driver(RTLIL::SigBit bit)
+	{
+		if (!describing && bit.wire)
+			driver_count[bit_id(bit)]++;
+	}
+
+	void scan_processes()
+	{
+		for (auto &proc_it : module->processes)
+		{
+			std::vector<RTLIL::CaseRule*> all_cases = {&proc_it.second->root_case};
+			for (size_t i = 0; i < all_cases.size(); i++) {
+				for (auto &action : all_cases[i]->actions) {
+					for (auto bit : sigmap(action.first))
+						add_driver(bit, [&]() {
+							return stringf("action %s <= %s (case rule) in process %s",
+									log_signal(action.first), log_signal(action.second), log_id(proc_it.first));
+						});
+					for (auto bit : sigmap(action.second))
+						add_user(bit);
+				}
+				for (auto switch_ : all_cases[i]->switches) {
+					for (auto case_ : switch_->cases) {
+						all_cases.push_back(case_);
+						for (auto &compare : case_->compare)
+							for (auto bit : sigmap(compare))
+								add_user(bit);
+					}
+				}
+			}
+			for (auto &sync : proc_it.second->syncs) {
+				for (auto bit : sigmap(sync->signal))
+					add_user(bit);
+				for (auto &action : sync->actions) {
+					for (auto bit : sigmap(action.first))
+						add_driver(bit, [&]() {
+							return stringf("action %s <= %s (sync rule) in process %s",
+									log_signal(action.first), log_signal(action.second), log_id(proc_it.first));
+						});
+					for (auto bit : sigmap(action.second))
+						add_user(bit);
+				}
+				for (auto &memwr : sync->mem_write_actions) {
+					for (auto bit : sigmap(memwr.address))
+						add_user(bit);
+					for (auto bit : sigmap(memwr.data))
+						add_user(bit);
+					for (auto bit : sigmap(memwr.enable))
+						add_user(bit);
+				}
+			}
+		}
+	}
+
+	void scan_cells()
+	{
+		for (auto cell : module->cells())
+		{
+			bool logic_cell = !describing && yosys_celltypes.cell_evaluable(cell->type);
+			int cell_node = logic_cell ? add_node(-1, cell) : -1;
+
+			for (auto &conn : cell->connections()) {
+				SigSpec sig = sigmap(conn.second);
+				bool is_input = cell->input(conn.first);
+				bool is_output = cell->output(conn.first);
+				if (is_input)
+					for (auto bit : sig) {
+						if (logic_cell && bit.wire)
+							graph.add_edge(wire_node(bit), cell_node);
+						add_user(bit);
+					}
+				if (is_output)
+					for (int i = 0; i < GetSize(sig); i++) {
+						if (logic_cell && sig[i].wire)
+							graph.add_edge(cell_node, wire_node(sig[i]));
+						if (sig[i].wire || !is_input)
+							add_driver(sig[i], [&]() {
+								return stringf("port %s[%d] of cell %s (%s)",
+										log_id(conn.first), i, log_id(cell), log_id(cell->type));
+							});
+					}
+				if (!is_input && is_output)
+					for (auto bit : sig)
+						count_driver(bit);
+			}
+		}
+	}
+
+	void scan_ports()
+	{
+		for (auto wire : module->wires()) {
+			if (wire->port_input) {
+				SigSpec sig = sigmap(wire);
+				for (int i = 0; i < GetSize(sig); i++)
+					if (sig[i].wire || !wire->port_output)
+						add_driver(sig[i], [&]() {
+							return stringf("module input %s[%d]", log_id(wire), i);
+						});
+			}
+			if (wire->port_output)
+				for (auto bit : sigmap(wire))
+					add_user(bit);
+			if (wire->port_input && !wire->port_output)
+				for (auto bit : sigmap(wire))
+					count_driver(bit);
+		}
+	}
+
+	void scan()
+	{
+		scan_processes();
+		scan_cells();
+		scan_ports();
+	}
+
+	void warning(const std::string &message)
+	{
+		log_warning("%s", message.c_str());
+		counter++;
+	}
+
+	void report_drivers()
+	{
+		std::vector<int> const_bits, conflict_bits;
+		for (auto state : {State::S0, State::S1, State::Sx}) {
+			int id = bits.at(state, -1);
+			if (id >= 0 && driven[id])
+				const_bits.push_back(id);
+		}
+		for (int id : driven_order)
+			if (driver_count[id] > 1)
+				conflict_bits.push_back(id);
+
+		if (const_bits.empty() && conflict_bits.empty())
+			return;
+
+		reported.assign(GetSize(driver_count), false);
+		for (int id : const_bits)
+			reported[id] = true;
+		for (int id : conflict_bits)
+			reported[id] = true;
+		describing = true;
+		scan();
+		describing = false;
+
+		for (int id : const_bits) {
+			string message = stringf("Drivers conflicting with a constant %s driver:\n", log_signal(bits[id]));
+			for (auto &str : driver_names[id])
+				message += stringf("    %s\n", str.c_str());
+			warning(message);
+		}
+
+		for (int id : conflict_bits) {
+			string message = stringf("multiple conflicting drivers for %s.%s:\n", log_id(module), log_signal(bits[id]));
+			for (auto &str : driver_names[id])
+				message += stringf("    %s\n", str.c_str());
+			warning(message);
+		}
+	}
+
+	void report_loops()
+	{
+		graph.build();
+		std::vector<int> component;
+		int num_components = graph.scc(component);
+
+		std::vector<int> component_size(num_components);
+		for (int c : component)
+			component_size[c]++;
+
+		// one loop per strongly connected component, with the nodes and
+		// loops sorted by name for a stable output
+		dict<int, std::vector<std::string>> loop_nodes;
+		for (int n = 0; n < graph.num_nodes(); n++) {
+			if (component_size[component[n]] < 2)
+				continue;
+			if (node_cell[n] != nullptr)
+				loop_nodes[component[n]].push_back(stringf("cell %s (%s)", log_id(node_cell[n]), log_id(node_cell[n]->type)));
+			else
+				loop_nodes[component[n]].push_back(stringf("wire %s", log_signal(bits[node_bit[n]])));
+		}
+
+		std::vector<std::vector<std::string>> loops;
+		for (auto &it : loop_nodes) {
+			std::sort(it.second.begin(), it.second.end());
+			loops.push_back(std::move(it.second));
+		}
+		std::sort(loops.begin(), loops.end());
+
+		for (auto &loop : loops) {
+			string message = stringf("found logic loop in module %s:\n", log_id(module));
+			for (auto &str : loop)
+				message += stringf("    %s\n", str.c_str());
+			warning(message);
+		}
+	}
+
+	void run()
+	{
+		log("Checking module %s...\n", log_id(module));
+
+		if (opt.mapped)
+			for (auto cell : module->cells())
+				if (cell->type.begins_with("$") && module->design->module(cell->type) == nullptr) {
+					if (opt.allow_tbuf && cell->type == ID($_TBUF_))
+						continue;
+					warning(stringf("Cell %s.%s is an unmapped internal cell of type %s.\n", log_id(module), log_id(cell), log_id(cell->type)));
+				}
+
+		scan();
+
+		pool<SigBit> init_bits;
+
+		for (auto wire : module->wires()) {
+			if (wire->attributes.count(ID::init)) {
+				Const initval = wire->attributes.at(ID::init);
+				for (int i = 0; i < GetSize(initval) && i < GetSize(wire); i++)
+					if (initval[i] == State::S0 || initval[i] == State::S1)
+						init_bits.insert(sigmap(SigBit(wire, i)));
+				if (opt.noinit)
+					warning(stringf("Wire %s.%s has an unprocessed 'init' attribute.\n", log_id(module), log_id(wire)));
+			}
+		}
+
+		report_drivers();
+
+		for (int id : used_order)
+			if (!driven[id])
+				warning(stringf("Wire %s.%s is used but has no driver.\n", log_id(module), log_signal(bits[id])));
+
+		report_loops();
+
+		if (opt.initdrv)
+		{
+			for (auto cell : module->cells())
+			{
+				if (RTLIL::builtin_ff_cell_types().count(cell->type) == 0)
+					continue;
+
+				for (auto bit : sigmap(cell->getPort(ID::Q)))
+					init_bits.erase(bit);
+			}
+
+			SigSpec init_sig(init_bits);
+			init_sig.sort_and_unify();
+
+			for (auto chunk : init_sig.chunks())
+				warning(stringf("Wire %s.%s has 'init' attribute and is not driven by an FF cell.\n", log_id(module), log_signal(chunk)));
+		}
+	}
+};
+
 struct CheckPass : public Pass {
 	CheckPass() : Pass("check", "check for obvious problems in the design") { }
 	void help() override
@@ -39,6 +384,10 @@ struct CheckPass : public Pass {
 		log("  - two or more conflicting drivers for one wire\n");
 		log("  - used wires that do not have a driver\n");
 		log("\n");
+		log("Each combinatorial loop is reported once, with all the cells and wires of the\n");
+		log("strongly connected component it is part of. The modules are checked in\n");
+		log("parallel when multi-threading is enabled.\n");
+		log("\n");
 		log("Options:\n");
 		log("\n");
 		log("    -noinit\n");
@@ -59,31 +408,31 @@ struct CheckPass : public Pass {
 		log("        produce a runtime error if any problems are found in the current design\n");
 		log("\n");
 	}
+	bool result_cacheable(const std::vector<std::string> &) const override
+	{
+		return true;
+	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
-		int counter = 0;
-		bool noinit = false;
-		bool initdrv = false;
-		bool mapped = false;
-		bool allow_tbuf = false;
+		CheckOptions opt;
 		bool assert_mode = false;
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			if (args[argidx] == "-noinit") {
-				noinit = true;
+				opt.noinit = true;
 				continue;
 			}
 			if (args[argidx] == "-initdrv") {
-				initdrv = true;
+				opt.initdrv = true;
 				continue;
 			}
 			if (args[argidx] == "-mapped") {
-				mapped = true;
+				opt.mapped = true;
 				continue;
 			}
 			if (args[argidx] == "-allow-tbuf") {
-				allow_tbuf = true;
+				opt.allow_tbuf = true;
 				continue;
 			}
 			if (args[argidx] == "-assert") {
@@ -96,180 +445,18 @@ struct CheckPass : public Pass {
 
 		log_header(design, "Executing CHECK pass (checking for obvious problems).\n");
 
-		for (auto module : design->selected_whole_modules_warn())
-		{
-			log("Checking module %s...\n", log_id(module));
-
-			SigMap sigmap(module);
-			dict<SigBit, vector<string>> wire_drivers;
-			dict<SigBit, int> wire_drivers_count;
-			pool<SigBit> used_wires;
-			TopoSort<string> topo;
-
-			for (auto &proc_it : module->processes)
-			{
-				std::vector<RTLIL::CaseRule*> all_cases = {&proc_it.second->root_case};
-				for (size_t i = 0; i < all_cases.size(); i++) {
-					for (auto action : all_cases[i]->actions) {
-						for (auto bit : sigmap(action.first))
-							wire_drivers[bit].push_back(
-								stringf("action %s <= %s (case rule) in process %s",
-										log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
-
-						for (auto bit : sigmap(action.second))
-							if (bit.wire) used_wires.insert(bit);
-					}
-					for (auto switch_ : all_cases[i]->switches) {
-						for (auto case_ : switch_->cases) {
-							all_cases.push_back(case_);
-							for (auto compare : case_->compare)
-								for (auto bit : sigmap(compare))
-									if (bit.wire) used_wires.insert(bit);
-						}
-					}
-				}
-				for (auto &sync : proc_it.second->syncs) {
-					for (auto bit : sigmap(sync->signal))
-						if (bit.wire) used_wires.insert(bit);
-					for (auto action : sync->actions) {
-						for (auto bit : sigmap(action.first))
-							wire_drivers[bit].push_back(
-								stringf("action %s <= %s (sync rule) in process %s",
-										log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
-						for (auto bit : sigmap(action.second))
-							if (bit.wire) used_wires.insert(bit);
-					}
-					for (auto memwr : sync->mem_write_actions) {
-						for (auto bit : sigmap(memwr.address))
-							if (bit.wire) used_wires.insert(bit);
-						for (auto bit : sigmap(memwr.data))
-							if (bit.wire) used_wires.insert(bit);
-						for (auto bit : sigmap(memwr.enable))
-							if (bit.wire) used_wires.insert(bit);
-					}
-				}
-			}
-
-			for (auto cell : module->cells())
-			{
-				if (mapped && cell->type.begins_with("$") && design->module(cell->type) == nullptr) {
-					if (allow_tbuf && cell->type == ID($_TBUF_)) goto cell_allowed;
-					log_warning("Cell %s.%s is an unmapped internal cell of type %s.\n", log_id(module), log_id(cell), log_id(cell->type));
-					counter++;
-				cell_allowed:;
-				}
-				for (auto &conn : cell->connections()) {
-					SigSpec sig = sigmap(conn.second);
-					bool logic_cell = yosys_celltypes.cell_evaluable(cell->type);
-					if (cell->input(conn.first))
-						for (auto bit : sig)
-							if (bit.wire) {
-								if (logic_cell)
-									topo.edge(stringf("wire %s", log_signal(bit)),
-											stringf("cell %s (%s)", log_id(cell), log_id(cell->type)));
-								used_wires.insert(bit);
-							}
-					if (cell->output(conn.first))
-						for (int i = 0; i < GetSize(sig); i++) {
-							if (logic_cell)
-								topo.edge(stringf("cell %s (%s)", log_id(cell), log_id(cell->type)),
-										stringf("wire %s", log_signal(sig[i])));
-
-							if (sig[i].wire || !cell->input(conn.first))
-								wire_drivers[sig[i]].push_back(stringf("port %s[%d] of cell %s (%s)",
-										log_id(conn.first), i, log_id(cell), log_id(cell->type)));
-						}
-					if (!cell->input(conn.first) && cell->output(conn.first))
-						for (auto bit : sig)
-							if (bit.wire) wire_drivers_count[bit]++;
-				}
-			}
-
-			pool<SigBit> init_bits;
-
-			for (auto wire : module->wires()) {
-				if (wire->port_input) {
-					SigSpec sig = sigmap(wire);
-					for (int i = 0; i < GetSize(sig); i++)
-						if (sig[i].wire || !wire->port_output)
-							wire_drivers[sig[i]].push_back(stringf("module input %s[%d]", log_id(wire), i));
-				}
-				if (wire->port_output)
-					for (auto bit : sigmap(wire))
-						if (bit.wire) used_wires.insert(bit);
-				if (wire->port_input && !wire->port_output)
-					for (auto bit : sigmap(wire))
-						if (bit.wire) wire_drivers_count[bit]++;
-				if (wire->attributes.count(ID::init)) {
-					Const initval = wire->attributes.at(ID::init);
-					for (int i = 0; i < GetSize(initval) && i < GetSize(wire); i++)
-						if (initval[i] == State::S0 || initval[i] == State::S1)
-							init_bits.insert(sigmap(SigBit(wire, i)));
-					if (noinit) {
-						log_warning("Wire %s.%s has an unprocessed 'init' attribute.\n", log_id(module), log_id(wire));
-						counter++;
-					}
-				}
-			}
-
-			for (auto state : {State::S0, State::S1, State::Sx})
-				if (wire_drivers.count(state)) {
-					string message = stringf("Drivers conflicting with a constant %s driver:\n", log_signal(state));
-					for (auto str : wire_drivers[state])
-						message += stringf("    %s\n", str.c_str());
-					log_warning("%s", message.c_str());
-					counter++;
-				}
-
-			for (auto it : wire_drivers)
-				if (wire_drivers_count[it.first] > 1) {
-					string message = stringf("multiple conflicting drivers for %s.%s:\n", log_id(module), log_signal(it.first));
-					for (auto str : it.second)
-						message += stringf("    %s\n", str.c_str());
-					log_warning("%s", message.c_str());
-					counter++;
-				}
-
-			for (auto bit : used_wires)
-				if (!wire_drivers.count(bit)) {
-					log_warning("Wire %s.%s is used but has no driver.\n", log_id(module), log_signal(bit));
-					counter++;
-				}
-
-			topo.sort();
-			for (auto &loop : topo.loops) {
-				string message = stringf("found logic loop in module %s:\n", log_id(module));
-				for (auto &str : loop)
-					message += stringf("    %s\n", str.c_str());
-				log_warning("%s", message.c_str());
-				counter++;
-			}
-
-			if (initdrv)
-			{
-				for (auto cell : module->cells())
-				{
-					if (RTLIL::builtin_ff_cell_types().count(cell->type) == 0)
-						continue;
-
-					for (auto bit : sigmap(cell->getPort(ID::Q)))
-						init_bits.erase(bit);
-				}
-
-				SigSpec init_sig(init_bits);
-				init_sig.sort_and_unify();
-
-				for (auto chunk : init_sig.chunks()) {
-					log_warning("Wire %s.%s has 'init' attribute and is not driven by an FF cell.\n", log_id(module), log_signal(chunk));
-					counter++;
-				}
-			}
-		}
+		// the modules are checked independently, and in parallel
+		std::atomic<int> counter(0);
+		execute_modules(design, design->selected_whole_modules_warn(), [&](RTLIL::Module *module) {
+			CheckWorker worker(opt, module);
+			worker.run();
+			counter += worker.counter;
+		});
 
-		log("Found and reported %d problems.\n", counter);
+		log("Found and reported %d problems.\n", counter.load());
 
 		if (assert_mode && counter > 0)
-			log_error("Found %d problems in 'check -assert'.\n", counter);
+			log_error("Found %d problems in 'check -assert'.\n", counter.load());
 	}
 } CheckPass;
 
@@ -18,14 +18,51 @@
  */
 
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
 #include "frontends/verilog/preproc.h"
 #include "frontends/ast/ast.h"
+#include <typeinfo>
 
 YOSYS_NAMESPACE_BEGIN
 
 std::map<std::string, RTLIL::Design*> saved_designs;
 std::vector<RTLIL::Design*> pushed_designs;
 
+// Clones the given modules, on worker threads when multi-threading is
+// enabled. Modules of derived types (such as AST modules, whose clone also
+// copies the AST) are cloned by the calling thread.
+static std::vector<RTLIL::Module*> clone_modules(const std::vector<RTLIL::Module*> &modules)
+{
+	std::vector<RTLIL::Module*> clones(GetSize(modules));
+	std::vector<int> parallel;
+
+	for (int i = 0; i < GetSize(modules); i++) {
+		if (typeid(*modules[i]) == typeid(RTLIL::Module))
+			parallel.push_back(i);
+		else
+			clones[i] = modules[i]->clone();
+	}
+
+	int num_threads = yosys_xtrace ? 1 : yosys_thread_count(GetSize(parallel));
+	ThreadPool::run(GetSize(parallel), [&](int i) {
+		clones[parallel[i]] = modules[parallel[i]]->clone();
+	}, num_threads);
+
+	return clones;
+}
+
+// Moves all modules from one design to another without copying them, for
+// modes that clear the source design afterwards anyway.
+static void move_modules(RTLIL::Design *from, RTLIL::Design *to)
+{
+	for (auto mod : from->modules().to_vector()) {
+		for (auto mon : from->monitors)
+			mon->notify_module_del(mod);
+		from->modules_.erase(mod->name);
+		to->add(mod);
+	}
+}
+
 struct DesignPass : public Pass {
 	DesignPass() : Pass("design", "save, restore and reset current design") { }
 	~DesignPass() override {
@@ -325,14 +362,14 @@ struct DesignPass : public Pass {
 			if (!as_name.empty() && copy_src_modules.size() > 1)
 				log_cmd_error("Only one module can be selected in combination with -as.\n");
 
-			for (auto mod : copy_src_modules)
+			std::vector<RTLIL::Module*> clones = clone_modules(copy_src_modules);
+			for (auto t : clones)
 			{
-				std::string trg_name = as_name.empty() ? mod->name.str() : RTLIL::escape_id(as_name);
+				std::string trg_name = as_name.empty() ? t->name.str() : RTLIL::escape_id(as_name);
 
 				if (copy_to_design->module(trg_name) != nullptr)
 					copy_to_design->remove(copy_to_design->module(trg_name));
 
-				RTLIL::Module *t = mod->clone();
 				t->name = trg_name;
 				t->design = copy_to_design;
 				copy_to_design->add(t);
@@ -343,8 +380,12 @@ struct DesignPass : public Pass {
 		{
 			RTLIL::Design *design_copy = new RTLIL::Design;
 
-			for (auto mod : design->modules())
-				design_copy->add(mod->clone());
+			// -push and -stash clear the current design below
+			if (push_mode || reset_mode)
+				move_modules(design, design_copy);
+			else
+				for (auto mod : clone_modules(design->modules().to_vector()))
+					design_copy->add(mod);
 
 			design_copy->selection_stack = design->selection_stack;
 			design_copy->selection_vars = design->selection_vars;
@@ -388,8 +429,11 @@ struct DesignPass : public Pass {
 		{
 			RTLIL::Design *saved_design = pop_mode ? pushed_designs.back() : saved_designs.at(load_name);
 
-			for (auto mod : saved_design->modules())
-				design->add(mod->clone());
+			if (pop_mode)
+				move_modules(saved_design, design);
+			else
+				for (auto mod : clone_modules(saved_design->modules().to_vector()))
+					design->add(mod);
 
 			design->selection_stack = saved_design->selection_stack;
 			design->selection_vars = saved_design->selection_vars;
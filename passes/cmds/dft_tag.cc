@@ -20,9 +20,10 @@
 #include "kernel/celltypes.h"
 #include "kernel/ff.h"
 #include "kernel/modtools.h"
+#include "kernel/netgraph.h"
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
-#include <deque>
+#include <queue>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -52,19 +53,36 @@ struct DftTagWorker {
 		bool empty() const { return index == 0; }
 	};
 
-	idict<pool<IdString>> tag_sets;
+	// Tags are interned as small ids and a tag set is a bitset over these
+	// ids, without trailing zero words so that equal sets are stored the
+	// same way. Index 0 is the empty set.
+	idict<IdString> tag_ids;
+	idict<std::vector<uint64_t>> tag_sets;
 
-	pool<IdString> tmp_tag_set;
+	std::vector<uint64_t> tmp_tag_set;
 	dict<std::pair<tag_set, tag_set>, tag_set> tag_set_union_cache;
 
-	dict<SigBit, tag_set> tagged_signals;
+	// The tags of each bit, by the FlatSigMap id of its representative.
+	// Constants and the wires added for the tagging logic have no tags.
+	FlatSigMap flatmap;
+	std::vector<tag_set> bit_tags;
 
 	dict<IdString, pool<IdString>> tag_groups;
 	dict<IdString, IdString> group_of_tag;
-	pool<IdString> all_tags;
 
+	// The cells and the bits they read and drive, with node n < num_bits for
+	// the bit with FlatSigMap id n and num_bits + i for cells[i]. The tags of
+	// all tag groups are propagated together in the order of the cell levels,
+	// so that most cells are visited only once.
+	NetGraph graph;
+	int num_bits = 0;
+	std::vector<Cell *> cells;
+	std::vector<int> cell_level;
+	std::vector<bool> pending;
+	std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> pending_queue;
+
+	// Cells whose tag signals are being emitted, to detect cycles
 	pool<Cell *> pending_cells;
-	std::deque<Cell *> pending_cell_queue;
 
 	dict<std::pair<IdString, SigBit>, SigBit> tag_signals;
 
@@ -153,12 +171,31 @@ struct DftTagWorker {
 		}
 	}
 
-	const pool<IdString> &tag_pool(tag_set set) { return tag_sets[set.index]; }
+	bool has_tag(tag_set set, IdString tag)
+	{
+		int id = tag_ids.at(tag, -1);
+		if (id < 0)
+			return false;
+		auto &words = tag_sets[set.index];
+		return id / 64 < GetSize(words) && ((words[id / 64] >> (id % 64)) & 1);
+	}
+
+	std::vector<IdString> tag_list(tag_set set)
+	{
+		std::vector<IdString> result;
+		auto &words = tag_sets[set.index];
+		for (int i = 0; i < GetSize(words); i++)
+			for (int j = 0; j < 64; j++)
+				if ((words[i] >> j) & 1)
+					result.push_back(tag_ids[64 * i + j]);
+		return result;
+	}
 
 	tag_set singleton(IdString tag)
 	{
-		tmp_tag_set.clear();
-		tmp_tag_set.emplace(tag);
+		int id = tag_ids(tag);
+		tmp_tag_set.assign(id / 64 + 1, 0);
+		tmp_tag_set.back() |= uint64_t(1) << (id % 64);
 		return tag_sets(tmp_tag_set);
 	}
 
@@ -170,11 +207,13 @@ struct DftTagWorker {
 			return b;
 		auto found = tag_set_union_cache.find(std::make_pair(a, b));
 		if (found == tag_set_union_cache.end()) {
-			tmp_tag_set.clear();
-			auto &a_tags = tag_pool(a);
-			auto &b_tags = tag_pool(b);
-			tmp_tag_set.insert(a_tags.begin(), a_tags.end());
-			tmp_tag_set.insert(b_tags.begin(), b_tags.end());
+			auto &a_words = tag_sets[a.index];
+			auto &b_words = tag_sets[b.index];
+			tmp_tag_set.assign(std::max(GetSize(a_words), GetSize(b_words)), 0);
+			for (int i = 0; i < GetSize(a_words); i++)
+				tmp_tag_set[i] |= a_words[i];
+			for (int i = 0; i < GetSize(b_words); i++)
+				tmp_tag_set[i] |= b_words[i];
 			tag_set result = tag_sets(tmp_tag_set);
 			tag_set_union_cache.emplace(std::make_pair(a, b), result);
 			return result;
@@ -184,11 +223,8 @@ struct DftTagWorker {
 
 	tag_set tags(SigBit bit)
 	{
-		sigmap.apply(bit);
-		auto found = tagged_signals.find(bit);
-		if (found != tagged_signals.end())
-			return found->second;
-		return tag_set();
+		int id = flatmap.id(flatmap(bit));
+		return id < 0 ? tag_set() : bit_tags[id];
 	}
 
 	tag_set tags(SigSpec sig)
@@ -211,23 +247,26 @@ struct DftTagWorker {
 
 	void add_tags(SigBit bit, tag_set new_tags)
 	{
-		sigmap.apply(bit);
-		auto &tags = tagged_signals[bit];
+		int id = flatmap.id(flatmap(bit));
+		if (id < 0)
+			return;
+		tag_set &tags = bit_tags[id];
 		tag_set merged_tags = merge(tags, new_tags);
 		if (merged_tags == tags)
 			return;
 		tags = merged_tags;
-		auto it = modwalker.signal_consumers.find(bit);
-		if (it == modwalker.signal_consumers.end())
-			return;
-		for (auto &consumer : it->second)
-			if (pending_cells.insert(consumer.cell).second)
-				pending_cell_queue.push_back(consumer.cell);
+		for (int e = graph.edge_begin[id]; e < graph.edge_begin[id + 1]; e++) {
+			int i = graph.edge_to[e] - num_bits;
+			if (!pending[i]) {
+				pending[i] = true;
+				pending_queue.emplace(cell_level[i], i);
+			}
+		}
 	}
 
 	void add_tags(SigSpec sig, tag_set new_tags)
 	{
-		for (auto bit : sigmap(sig))
+		for (auto bit : sig)
 			add_tags(bit, new_tags);
 	}
 
@@ -247,19 +286,54 @@ struct DftTagWorker {
 
 	void propagate_tags()
 	{
+		flatmap.set(sigmap, module);
+		num_bits = flatmap.num_bits();
+		bit_tags.assign(num_bits, tag_set());
+
 		for (auto cell : module->cells()) {
-			if (cell->type == ID($set_tag)) {
-				pending_cells.insert(cell);
-				pending_cell_queue.push_back(cell);
+			int node = num_bits + GetSize(cells);
+			cells.push_back(cell);
+			bool known = cell->known();
+			// cut the paths at FFs, so that they don't form loops
+			bool is_ff = RTLIL::builtin_ff_cell_types().count(cell->type) || cell->type == ID($anyinit);
+			for (auto &conn : cell->connections()) {
+				bool is_input = !known || cell->input(conn.first);
+				bool is_output = !known || cell->output(conn.first);
+				for (auto bit : flatmap(conn.second)) {
+					int id = flatmap.id(bit);
+					if (id < 0)
+						continue;
+					if (is_input)
+						graph.add_edge(id, node);
+					if (is_output && !is_ff)
+						graph.add_edge(node, id);
+				}
+			}
+		}
+		while (graph.num_nodes() < num_bits + GetSize(cells))
+			graph.add_node();
+		graph.build();
+
+		std::vector<int> level, pred_edge;
+		graph.longest_path(level, pred_edge);
+
+		pending.assign(GetSize(cells), false);
+		for (int i = 0; i < GetSize(cells); i++) {
+			cell_level.push_back(level[num_bits + i]);
+			if (cells[i]->type == ID($set_tag)) {
+				pending[i] = true;
+				pending_queue.emplace(cell_level[i], i);
 			}
 		}
 
-		while (!pending_cell_queue.empty()) {
-			Cell *cell = pending_cell_queue.front();
-			pending_cell_queue.pop_front();
-			pending_cells.erase(cell);
+		while (!pending_queue.empty()) {
+			int i = pending_queue.top().second;
+			pending_queue.pop();
+			if (!pending[i])
+				continue;
+			pending[i] = false;
 
-			propagate_tags(cell);
+			propagate_tags(cells[i]);
 		}
 	}
 
@@ -273,7 +347,7 @@ struct DftTagWorker {
 		if (found != tag_signals.end())
 			return found->second;
 
-		if (!tag_pool(tags(bit)).count(tag))
+		if (!has_tag(tags(bit), tag))
 			return State::S0; // Statically known to not have this tag
 
 		// TODO handle module inputs
@@ -332,7 +406,7 @@ struct DftTagWorker {
 		sigmap.apply(bit);
 		sigmap.apply(tag_bit);
 
-		if (!tag_pool(tags(bit)).count(tag))
+		if (!has_tag(tags(bit), tag))
 			return;
 
 		auto key = std::make_pair(tag, bit);
@@ -372,7 +446,7 @@ struct DftTagWorker {
 	{
 		if (cell->type == ID($set_tag)) {
 			IdString tag = stringf("\\%s", cell->getParam(ID::TAG).decode_string().c_str());
-			if (all_tags.insert(tag).second) {
+			if (!group_of_tag.count(tag)) {
 				auto group_sep = tag.str().find(':');
 				IdString tag_group = group_sep != std::string::npos ? tag.str().substr(0, group_sep) : tag;
 				tag_groups[tag_group].insert(tag);
@@ -765,7 +839,7 @@ struct DftTagWorker {
 					public_wires.push_back(wire);
 
 			for (auto wire : public_wires) {
-				for (auto tag : tag_pool(tags(SigSpec(wire)))) {
+				for (auto tag : tag_list(tags(SigSpec(wire)))) {
 					auto tag_sig = tag_signal(tag, SigSpec(wire));
 					if (tag_sig.is_fully_zero())
 						continue;
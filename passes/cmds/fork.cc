@@ -0,0 +1,355 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/log.h"
+#include <chrono>
+#include <fstream>
+
+#if !defined(_WIN32) && !defined(__wasm)
+#  define YOSYS_HAVE_FORK
+#  include <sys/stat.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct ForkBranch
+{
+	std::string name, script, dir;
+	int pid = -1;
+	bool ok = false;
+	std::chrono::steady_clock::time_point begin;
+	double seconds = 0;
+	// the stat.* scratchpad values of the branch, without the prefix
+	dict<std::string, std::string> metrics;
+
+	double metric(const std::string &key) const {
+		auto it = metrics.find(key);
+		return it == metrics.end() ? 0 : atof(it->second.c_str());
+	}
+};
+
+#ifdef YOSYS_HAVE_FORK
+[[noreturn]] static void branch_exit(int status)
+{
+	log_flush();
+	_exit(status);
+}
+
+// Runs in the forked child, which has a private copy of the design.
+[[noreturn]] static void run_branch(RTLIL::Design *design, const ForkBranch &branch, const std::string &stat_args, bool write_design)
+{
+	FILE *f = fopen((branch.dir + "/log").c_str(), "w");
+	if (f == nullptr)
+		_exit(1);
+	log_files = {f};
+	log_streams.clear();
+	log_errfile = nullptr;
+	log_cmd_error_throw = true;
+	log_error_atexit = []() { branch_exit(1); };
+
+	try {
+		Pass::call(design, branch.script);
+
+		std::string stat_cmd = "stat" + stat_args;
+		RTLIL::Module *top = design->top_module();
+		if (top != nullptr)
+			stat_cmd += " -top " + std::string(log_id(top));
+		for (auto &it : design->scratchpad)
+			if (it.first.compare(0, 5, "stat.") == 0)
+				design->scratchpad[it.first].clear();
+		Pass::call(design, stat_cmd);
+
+		std::ofstream metrics(branch.dir + "/metrics");
+		bool found = false;
+		for (auto &it : design->scratchpad)
+			if (it.first.compare(0, 5, "stat.") == 0 && !it.second.empty()) {
+				metrics << it.first.substr(5) << " " << it.second << "\n";
+				found = true;
+			}
+		if (!found) {
+			// no top module, sum up over all modules
+			int num_cells = 0, num_wires = 0;
+			for (auto module : design->modules()) {
+				num_cells += GetSize(module->cells());
+				num_wires += GetSize(module->wires());
+			}
+			metrics << "num_cells " << num_cells << "\n";
+			metrics << "num_wires " << num_wires << "\n";
+		}
+		metrics.close();
+
+		if (write_design)
+			Pass::call(design, "write_rtlil " + branch.dir + "/design.il");
+	} catch (log_cmd_error_exception) {
+		branch_exit(1);
+	}
+
+	branch_exit(0);
+}
+
+static void read_metrics(ForkBranch &branch)
+{
+	std::ifstream f(branch.dir + "/metrics");
+	std::string key, value;
+	while (f >> key >> value)
+		branch.metrics[key] = value;
+}
+
+static void log_branch_log(const ForkBranch &branch, int tail)
+{
+	std::ifstream f(branch.dir + "/log");
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(f, line))
+		lines.push_back(line);
+	int first = tail > 0 ? std::max(0, GetSize(lines) - tail) : 0;
+	for (int i = first; i < GetSize(lines); i++)
+		log("  | %s\n", lines[i].c_str());
+}
+#endif
+
+struct ForkPass : public Pass {
+	ForkPass() : Pass("fork", "run alternative scripts on copies of the design in parallel") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    fork [options] -branch <name> <commands> [-branch <name> <commands> ...]\n");
+		log("\n");
+		log("This command runs each branch on its own copy of the current design, in forked\n");
+		log("child processes that run in parallel, and reports the statistics of the result\n");
+		log("of each branch as computed by 'stat'. The commands of a branch are given as one\n");
+		log("argument and separated by semicolons, e.g.\n");
+		log("\n");
+		log("    fork -keep-best area -stat-args \"-liberty cells.lib\" \\\n");
+		log("        -branch plain \"synth -top top; abc -liberty cells.lib\" \\\n");
+		log("        -branch retime \"synth -top top -retime; abc -liberty cells.lib\"\n");
+		log("\n");
+		log("The current design is not modified unless -keep or -keep-best is used. The\n");
+		log("statistics of each branch are stored in the scratchpad as fork.<name>.<metric>,\n");
+		log("e.g. fork.plain.num_cells, and the name of the kept branch as fork.kept.\n");
+		log("\n");
+		log("    -branch <name> <commands>\n");
+		log("        add a branch.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        run at most N branches at the same time. (default: all)\n");
+		log("\n");
+		log("    -stat-args <args>\n");
+		log("        additional arguments for the 'stat' call at the end of each branch,\n");
+		log("        e.g. \"-liberty <file>\" to get the area.\n");
+		log("\n");
+		log("    -keep <name>\n");
+		log("        replace the current design with the result of the given branch.\n");
+		log("\n");
+		log("    -keep-best <metric>\n");
+		log("        replace the current design with the result of the successful branch\n");
+		log("        with the smallest value of the given 'stat' metric, such as num_cells\n");
+		log("        or area. Ties are broken by the order of the branches.\n");
+		log("\n");
+		log("    -v\n");
+		log("        print the log of each branch. By default only the end of the log of\n");
+		log("        failed branches is printed.\n");
+		log("\n");
+		log("This command is not available on Windows and in WebAssembly builds.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		std::vector<ForkBranch> branches;
+		std::string stat_args, keep_name, keep_metric;
+		int max_jobs = 0;
+		bool verbose = false;
+
+		auto unquote = [](std::string str) {
+			if (GetSize(str) >= 2 && str.front() == '"' && str.back() == '"')
+				str = str.substr(1, GetSize(str) - 2);
+			return str;
+		};
+
+		log_header(design, "Executing FORK pass (running alternative scripts).\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++)
+		{
+			if (args[argidx] == "-branch" && argidx+2 < args.size()) {
+				ForkBranch branch;
+				branch.name = args[++argidx];
+				branch.script = unquote(args[++argidx]);
+				for (auto &other : branches)
+					if (other.name == branch.name)
+						log_cmd_error("Duplicate branch name `%s'.\n", branch.name.c_str());
+				branches.push_back(branch);
+				continue;
+			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				max_jobs = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-stat-args" && argidx+1 < args.size()) {
+				stat_args = " " + unquote(args[++argidx]);
+				continue;
+			}
+			if (args[argidx] == "-keep" && argidx+1 < args.size()) {
+				keep_name = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-keep-best" && argidx+1 < args.size()) {
+				keep_metric = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-v") {
+				verbose = true;
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design, false);
+
+		if (branches.empty())
+			log_cmd_error("No branches given.\n");
+		if (!keep_name.empty() && !keep_metric.empty())
+			log_cmd_error("The options -keep and -keep-best are exclusive.\n");
+		if (!keep_name.empty()) {
+			bool found = false;
+			for (auto &branch : branches)
+				found |= branch.name == keep_name;
+			if (!found)
+				log_cmd_error("No branch named `%s'.\n", keep_name.c_str());
+		}
+
+#ifndef YOSYS_HAVE_FORK
+		log_cmd_error("The fork command is not available on this platform.\n");
+#else
+		bool write_design = !keep_name.empty() || !keep_metric.empty();
+		if (max_jobs <= 0)
+			max_jobs = GetSize(branches);
+
+		std::string tempdir = make_temp_dir(get_base_tmpdir() + "/yosys-fork-XXXXXX");
+		for (int i = 0; i < GetSize(branches); i++) {
+			branches[i].dir = stringf("%s/%d", tempdir.c_str(), i);
+			if (mkdir(branches[i].dir.c_str(), 0700) != 0)
+				log_cmd_error("Can't create directory `%s': %s\n", branches[i].dir.c_str(), strerror(errno));
+		}
+
+		// the children inherit all open stdio buffers
+		log_flush();
+		fflush(stdout);
+		fflush(stderr);
+
+		int next_branch = 0, running = 0;
+		while (next_branch < GetSize(branches) || running > 0)
+		{
+			while (next_branch < GetSize(branches) && running < max_jobs) {
+				ForkBranch &branch = branches[next_branch++];
+				log("Starting branch %s: %s\n", branch.name.c_str(), branch.script.c_str());
+				log_flush();
+				branch.begin = std::chrono::steady_clock::now();
+				branch.pid = fork();
+				if (branch.pid < 0)
+					log_cmd_error("Can't fork: %s\n", strerror(errno));
+				if (branch.pid == 0)
+					run_branch(design, branch, stat_args, write_design);
+				running++;
+			}
+
+			int status;
+			int pid = waitpid(-1, &status, 0);
+			if (pid < 0) {
+				if (errno == EINTR)
+					continue;
+				log_cmd_error("waitpid failed: %s\n", strerror(errno));
+			}
+			for (auto &branch : branches) {
+				if (branch.pid != pid)
+					continue;
+				branch.pid = -1;
+				branch.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - branch.begin).count();
+				branch.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+				running--;
+				if (branch.ok)
+					read_metrics(branch);
+				log("Branch %s %s after %.1f seconds.\n", branch.name.c_str(), branch.ok ? "finished" : "failed", branch.seconds);
+				if (verbose)
+					log_branch_log(branch, 0);
+				else if (!branch.ok)
+					log_branch_log(branch, 20);
+			}
+		}
+
+		log("\n");
+		log("%-20s %10s %12s %12s %14s\n", "branch", "seconds", "cells", "wires", "area");
+		for (auto &branch : branches) {
+			if (!branch.ok) {
+				log("%-20s %10.1f %12s\n", branch.name.c_str(), branch.seconds, "failed");
+				continue;
+			}
+			log("%-20s %10.1f %12s %12s %14s\n", branch.name.c_str(), branch.seconds,
+					branch.metrics.count("num_cells") ? branch.metrics.at("num_cells").c_str() : "-",
+					branch.metrics.count("num_wires") ? branch.metrics.at("num_wires").c_str() : "-",
+					branch.metrics.count("area") ? branch.metrics.at("area").c_str() : "-");
+			for (auto &it : branch.metrics)
+				design->scratchpad_set_string("fork." + branch.name + "." + it.first, it.second);
+		}
+
+		const ForkBranch *kept = nullptr;
+		if (!keep_name.empty()) {
+			for (auto &branch : branches)
+				if (branch.name == keep_name)
+					kept = &branch;
+			if (!kept->ok) {
+				remove_directory(tempdir);
+				log_cmd_error("Branch %s failed, keeping the current design.\n", keep_name.c_str());
+			}
+		}
+		if (!keep_metric.empty()) {
+			for (auto &branch : branches) {
+				if (!branch.ok || !branch.metrics.count(keep_metric))
+					continue;
+				if (kept == nullptr || branch.metric(keep_metric) < kept->metric(keep_metric))
+					kept = &branch;
+			}
+			if (kept == nullptr) {
+				remove_directory(tempdir);
+				log_cmd_error("No successful branch reported the metric `%s'.\n", keep_metric.c_str());
+			}
+		}
+
+		if (kept != nullptr) {
+			log("\nKeeping the result of branch %s.\n", kept->name.c_str());
+			for (auto mod : design->modules().to_vector())
+				design->remove(mod);
+			design->selection_stack.clear();
+			design->selection_stack.push_back(RTLIL::Selection());
+			design->selection_vars.clear();
+			design->selected_active_module.clear();
+			Pass::call(design, "read_rtlil " + kept->dir + "/design.il");
+			design->scratchpad_set_string("fork.kept", kept->name);
+		}
+
+		remove_directory(tempdir);
+#endif
+	}
+} ForkPass;
+
+PRIVATE_NAMESPACE_END
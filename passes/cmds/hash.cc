@@ -0,0 +1,83 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+#include "libs/sha1/sha1.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct HashPass : public Pass {
+	HashPass() : Pass("hash", "print content hashes of modules") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    hash [options] [selection]\n");
+		log("\n");
+		log("This command prints a structural hash of the contents of each selected module.\n");
+		log("The hash covers wires, cells, parameters, attributes, connections, processes\n");
+		log("and memories, but not the name of the module. It does not depend on the order\n");
+		log("in which the objects were created and is the same on all platforms, so it can\n");
+		log("be used to check if a module has changed since an earlier run. Note that\n");
+		log("renaming objects, including private ones, changes the hash.\n");
+		log("\n");
+		log("A hash of all selected modules together with their names is printed as well.\n");
+		log("\n");
+		log("    -set <identifier>\n");
+		log("        store the hash of all selected modules in the given scratchpad\n");
+		log("        variable, e.g. for use with 'scratchpad -assert'.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		std::string set_var;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-set" && argidx+1 < args.size()) {
+				set_var = args[++argidx];
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
+
+		log_header(design, "Executing HASH pass.\n");
+
+		std::vector<std::string> lines;
+		for (auto module : design->selected_whole_modules_warn()) {
+			std::string line = stringf("%016llx  %s", (unsigned long long)module->content_hash(), log_id(module));
+			log("  %s\n", line.c_str());
+			lines.push_back(line.substr(18) + "\n" + line.substr(0, 16) + "\n");
+		}
+
+		std::sort(lines.begin(), lines.end());
+		std::string str;
+		for (auto &line : lines)
+			str += line;
+		str = sha1(str);
+		log("Hash of all selected modules: %s\n", str.c_str());
+
+		if (!set_var.empty())
+			design->scratchpad_set_string(set_var, str);
+	}
+} HashPass;
+
+PRIVATE_NAMESPACE_END
@@ -0,0 +1,109 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct HashstatPass : public Pass {
+	HashstatPass() : Pass("hashstat", "print hash table statistics") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    hashstat [selection]\n");
+		log("\n");
+		log("This command prints the bucket statistics of the hash tables of the selected\n");
+		log("modules and of the global IdString index, summed up per container type. To\n");
+		log("also cover the key types that passes commonly build their own dict and pool\n");
+		log("containers of, it fills temporary pools with all wire bits, cell port\n");
+		log("connections, parameter values and (cell, port) pairs of each module.\n");
+		log("\n");
+		log("For each container type it reports the number of containers and entries,\n");
+		log("the load factor, the average length of the used bucket chains, the longest\n");
+		log("chain and the average number of keys compared when looking up an existing\n");
+		log("entry, next to the number expected with uniformly distributed hashes. A much\n");
+		log("larger number of compares than expected points to a weak hash function for\n");
+		log("that key type.\n");
+		log("\n");
+		log("The open addressing containers (flat_dict etc.) are not covered.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		extra_args(args, 1, design);
+
+		log_header(design, "Executing HASHSTAT pass.\n");
+
+		dict<std::string, hash_stats> table;
+		auto add = [&](const char *name, const hash_stats &stats) {
+			table[name].add(stats);
+		};
+
+		for (auto &shard : RTLIL::IdString::global_id_shards_)
+			add("IdString index", shard.index.stats());
+
+		for (auto module : design->selected_modules())
+		{
+			add("Module::wires_", module->wires_.stats());
+			add("Module::cells_", module->cells_.stats());
+			add("attributes", module->attributes.stats());
+
+			pool<RTLIL::SigBit> bits;
+			pool<RTLIL::SigSpec> sigs;
+			pool<RTLIL::Const> consts;
+			pool<std::pair<RTLIL::IdString, RTLIL::IdString>> ports;
+
+			for (auto wire : module->selected_wires()) {
+				add("attributes", wire->attributes.stats());
+				for (auto bit : RTLIL::SigSpec(wire))
+					bits.insert(bit);
+			}
+
+			for (auto cell : module->selected_cells()) {
+				add("attributes", cell->attributes.stats());
+				add("Cell::connections_", cell->connections().stats());
+				add("Cell::parameters", cell->parameters.stats());
+				for (auto &conn : cell->connections()) {
+					sigs.insert(conn.second);
+					ports.insert(std::make_pair(cell->name, conn.first));
+				}
+				for (auto &param : cell->parameters)
+					consts.insert(param.second);
+			}
+
+			add("pool<SigBit> (wire bits)", bits.stats());
+			add("pool<SigSpec> (cell ports)", sigs.stats());
+			add("pool<Const> (parameters)", consts.stats());
+			add("pool<pair<IdString, IdString>>", ports.stats());
+		}
+
+		log("\n");
+		log("  %-32s %8s %10s %6s %6s %6s %8s %8s\n", "container", "count", "entries",
+				"load", "chain", "max", "compares", "uniform");
+		for (auto &it : table) {
+			const hash_stats &stats = it.second;
+			log("  %-32s %8zu %10zu %6.2f %6.2f %6zu %8.3f %8.3f\n", it.first.c_str(), stats.containers, stats.entries,
+					stats.load_factor(), stats.avg_chain(), stats.max_chain, stats.avg_probes(), stats.avg_uniform_probes());
+		}
+	}
+} HashstatPass;
+
+PRIVATE_NAMESPACE_END
@@ -20,6 +20,7 @@
 #include "kernel/yosys.h"
 #include "kernel/celltypes.h"
 #include "kernel/sigtools.h"
+#include "kernel/netgraph.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -28,17 +29,11 @@ struct LtpWorker
 {
 	RTLIL::Design *design;
 	RTLIL::Module *module;
-	SigMap sigmap;
+	SigBitGraph graph;
 
-	dict<SigBit, tuple<int, SigBit, Cell*>> bits;
-	dict<SigBit, dict<SigBit, Cell*>> bit2bits;
 	dict<SigBit, tuple<SigBit, Cell*>> bit2ff;
 
-	int maxlvl;
-	SigBit maxbit;
-	pool<SigBit> busy;
-
-	LtpWorker(RTLIL::Module *module, bool noff) : design(module->design), module(module), sigmap(module)
+	LtpWorker(RTLIL::Module *module, bool noff, bool exact) : design(module->design), module(module), graph(module)
 	{
 		CellTypes ff_celltypes;
 
@@ -48,22 +43,20 @@ struct LtpWorker
 		}
 
 		for (auto wire : module->selected_wires())
-			for (auto bit : sigmap(wire))
-				bits[bit] = tuple<int, SigBit, Cell*>(-1, State::Sx, nullptr);
+			for (auto bit : SigSpec(wire))
+				graph.node(bit);
 
 		for (auto cell : module->selected_cells())
 		{
-			pool<SigBit> src_bits, dst_bits;
-
-			for (auto &conn : cell->connections())
-				for (auto bit : sigmap(conn.second)) {
-					if (cell->input(conn.first))
-						src_bits.insert(bit);
-					if (cell->output(conn.first))
-						dst_bits.insert(bit);
-				}
-
 			if (noff && ff_celltypes.cell_known(cell->type)) {
+				pool<SigBit> src_bits, dst_bits;
+				for (auto &conn : cell->connections())
+					for (auto bit : graph.sigmap(conn.second)) {
+						if (cell->input(conn.first))
+							src_bits.insert(bit);
+						if (cell->output(conn.first))
+							dst_bits.insert(bit);
+					}
 				for (auto s : src_bits)
 					for (auto d : dst_bits) {
 						bit2ff[s] = tuple<SigBit, Cell*>(d, cell);
@@ -72,68 +65,48 @@ struct LtpWorker
 				continue;
 			}
 
-			for (auto s : src_bits)
-				for (auto d : dst_bits)
-					bit2bits[s][d] = cell;
+			graph.add_cell(cell, exact);
 		}
 
-		maxlvl = -1;
-		maxbit = State::Sx;
+		graph.build();
 	}
 
-	void runner(SigBit bit, int level, SigBit from, Cell *via)
+	void run()
 	{
-		auto &bitinfo = bits.at(bit);
+		std::vector<int> component;
+		graph.scc(component);
+		std::vector<bool> on_cycle = graph.on_cycle(component);
+		pool<int> reported;
+		for (int n = 0; n < graph.num_nodes(); n++)
+			if (on_cycle[n] && reported.insert(component[n]).second)
+				log_warning("Detected loop at %s in %s\n", log_signal(graph.bit(n)), log_id(module));
 
-		if (get<0>(bitinfo) >= level)
-			return;
+		std::vector<int> level, pred_edge;
+		int maxlvl = graph.longest_path(level, pred_edge);
 
-		if (busy.count(bit) > 0) {
-			log_warning("Detected loop at %s in %s\n", log_signal(bit), log_id(module));
-			return;
-		}
-
-		busy.insert(bit);
-		get<0>(bitinfo) = level;
-		get<1>(bitinfo) = from;
-		get<2>(bitinfo) = via;
+		log("\n");
+		log("Longest topological path in %s (length=%d):\n", log_id(module), maxlvl);
 
-		if (level > maxlvl) {
-			maxlvl = level;
-			maxbit = bit;
-		}
+		if (maxlvl < 0)
+			return;
 
-		if (bit2bits.count(bit)) {
-			for (auto &it : bit2bits.at(bit))
-				runner(it.first, level+1, bit, it.second);
-		}
+		int maxnode = 0;
+		while (level[maxnode] < maxlvl)
+			maxnode++;
 
-		busy.erase(bit);
-	}
+		std::vector<int> path;
+		for (int n = maxnode; n >= 0; n = pred_edge[n] < 0 ? -1 : graph.edge_source(pred_edge[n]))
+			path.push_back(n);
 
-	void printpath(SigBit bit)
-	{
-		auto &bitinfo = bits.at(bit);
-		if (get<2>(bitinfo)) {
-			printpath(get<1>(bitinfo));
-			log("%5d: %s (via %s)\n", get<0>(bitinfo), log_signal(bit), log_id(get<2>(bitinfo)));
-		} else {
-			log("%5d: %s\n", get<0>(bitinfo), log_signal(bit));
+		for (int i = GetSize(path)-1; i >= 0; i--) {
+			int n = path[i];
+			if (pred_edge[n] >= 0)
+				log("%5d: %s (via %s)\n", level[n], log_signal(graph.bit(n)), log_id(graph.cell(pred_edge[n])));
+			else
+				log("%5d: %s\n", level[n], log_signal(graph.bit(n)));
 		}
-	}
-
-	void run()
-	{
-		for (auto &it : bits)
-			if (get<0>(it.second) < 0)
-				runner(it.first, 0, State::Sx, nullptr);
-
-		log("\n");
-		log("Longest topological path in %s (length=%d):\n", log_id(module), maxlvl);
-
-		if (maxlvl >= 0)
-			printpath(maxbit);
 
+		SigBit maxbit = graph.bit(maxnode);
 		if (bit2ff.count(maxbit))
 			log("%5s: %s (via %s)\n", "ff", log_signal(get<0>(bit2ff.at(maxbit))), log_id(get<1>(bit2ff.at(maxbit))));
 	}
@@ -153,10 +126,21 @@ struct LtpPass : public Pass {
 		log("    -noff\n");
 		log("        automatically exclude FF cell types\n");
 		log("\n");
+		log("    -exact\n");
+		log("        follow the paths through the bits of internal cells, instead of assuming\n");
+		log("        a path from each input bit of a cell to each output bit\n");
+		log("\n");
+		log("Edges within combinational loops are ignored, a warning is printed for each\n");
+		log("loop.\n");
+		log("\n");
+	}
+	bool result_cacheable(const std::vector<std::string> &) const override
+	{
+		return true;
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
-		bool noff = false;
+		bool noff = false, exact = false;
 
 		log_header(design, "Executing LTP pass (find longest path).\n");
 
@@ -166,6 +150,10 @@ struct LtpPass : public Pass {
 				noff = true;
 				continue;
 			}
+			if (args[argidx] == "-exact") {
+				exact = true;
+				continue;
+			}
 			break;
 		}
 
@@ -176,7 +164,7 @@ struct LtpPass : public Pass {
 			if (module->has_processes_warn())
 				continue;
 
-			LtpWorker worker(module, noff);
+			LtpWorker worker(module, noff, exact);
 			worker.run();
 		}
 	}
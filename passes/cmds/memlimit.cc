@@ -0,0 +1,96 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/memlimit.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct MemlimitPass : public Pass {
+	MemlimitPass() : Pass("memlimit", "set a memory limit and report memory usage") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    memlimit [options]\n");
+		log("\n");
+		log("Without -set or -off this command reports the resident set size of the\n");
+		log("process, the estimated size of the RTLIL objects of the largest modules and,\n");
+		log("while a limit is set, the passes that grew the process the most.\n");
+		log("\n");
+		log("    -set <size>\n");
+		log("        set the memory limit. The size is given in MiB or with one of the\n");
+		log("        suffixes K, M or G. The limit can also be set with the YOSYS_MEMLIMIT\n");
+		log("        environment variable.\n");
+		log("\n");
+		log("    -off\n");
+		log("        remove the memory limit.\n");
+		log("\n");
+		log("    -top <N>\n");
+		log("        number of modules and passes to report. (default: 10)\n");
+		log("\n");
+		log("With a limit set, every command checks the memory usage when it is done and\n");
+		log("fails with the report above if the limit is exceeded, instead of letting the\n");
+		log("process run into swapping or the OOM killer. Some commands also check before\n");
+		log("a large allocation (e.g. flatten), and some switch to a slower strategy that\n");
+		log("needs less memory when three quarters of the limit are used:\n");
+		log("\n");
+		log("    opt_merge   rehashes all cells after merging instead of keeping an index\n");
+		log("                of the readers of each signal\n");
+		log("    share       uses the smaller SAT problems of share -fast\n");
+		log("\n");
+		log("The memory usage is only known on Linux, elsewhere the limit has no effect.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		int top = 10;
+		bool report = true;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-set" && argidx+1 < args.size()) {
+				int64_t kb;
+				if (!MemLimit::parse_size(args[++argidx], kb) || kb <= 0)
+					log_cmd_error("Invalid memory size `%s'.\n", args[argidx].c_str());
+				MemLimit::limit_kb = kb;
+				report = false;
+				log("Memory limit set to %lld MiB.\n", (long long)(kb / 1024));
+				continue;
+			}
+			if (args[argidx] == "-off") {
+				MemLimit::limit_kb = 0;
+				report = false;
+				continue;
+			}
+			if (args[argidx] == "-top" && argidx+1 < args.size()) {
+				top = atoi(args[++argidx].c_str());
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design, false);
+
+		if (report)
+			MemLimit::log_report(design, top);
+	}
+} MemlimitPass;
+
+PRIVATE_NAMESPACE_END
@@ -0,0 +1,186 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/profiler.h"
+#include "kernel/log.h"
+#include <fstream>
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct ProfilePass : public Pass {
+	ProfilePass() : Pass("profile", "record and write a profile of pass invocations") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    profile [options]\n");
+		log("\n");
+		log("This command controls the pass profiler. While it is enabled, every pass call\n");
+		log("is recorded with its wall time, CPU time, the increase of the peak resident set\n");
+		log("size and the change in the number of cells and wires, as a tree of calls (e.g.\n");
+		log("the passes run by a synth script below the synth call). The profiler can also\n");
+		log("be enabled for a whole run with 'yosys -k <file>'.\n");
+		log("\n");
+		log("CPU time is measured for the whole process including child processes (such as\n");
+		log("ABC), so it may exceed the wall time for passes that use several threads.\n");
+		log("Passes called from worker threads are not recorded.\n");
+		log("\n");
+		log("    -start\n");
+		log("        discard the data recorded so far and enable the profiler.\n");
+		log("\n");
+		log("    -modules <N>\n");
+		log("        also time each module processed by the module loops of the major\n");
+		log("        module-local passes (opt_*, techmap, share, ...) and report the N\n");
+		log("        slowest modules after each pass and in the call tree. 0 disables the\n");
+		log("        module timing. The environment variable YOSYS_PROFILE_MODULES has the\n");
+		log("        same effect for a whole run, with N=10 if it is set to 1.\n");
+		log("\n");
+		log("    -zones <min_us>\n");
+		log("        also record the trace zones placed in hot code paths (IdString\n");
+		log("        creation, SigMap::set, Module::addCell and remove, techmap template\n");
+		log("        elaboration, ABC runs and SAT solves). All zones are counted, those\n");
+		log("        that take at least min_us microseconds are written as events to the\n");
+		log("        trace, on one track per thread. The environment variable\n");
+		log("        YOSYS_PROFILE_ZONES has the same effect for a whole run, with\n");
+		log("        min_us=10 if it is set to 1.\n");
+		log("\n");
+		log("    -stop\n");
+		log("        disable the profiler and the trace zones. The recorded data is kept.\n");
+		log("\n");
+		log("    -tree\n");
+		log("        print the recorded call tree to the log.\n");
+		log("\n");
+		log("    -module-summary\n");
+		log("        print the slowest modules of each pass, summed over all calls of the\n");
+		log("        pass.\n");
+		log("\n");
+		log("    -zone-summary\n");
+		log("        print the number of calls and the time spent in each trace zone.\n");
+		log("\n");
+		log("    -trace <file>\n");
+		log("        write the recorded calls in the Chrome trace event format, as read by\n");
+		log("        chrome://tracing and ui.perfetto.dev.\n");
+		log("\n");
+		log("    -folded <file>\n");
+		log("        write the self time of each call stack in microseconds in the folded\n");
+		log("        stack format, as read by flamegraph.pl and speedscope.\n");
+		log("\n");
+		log("The options are processed in the order given above. Without options, -tree is\n");
+		log("assumed.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *) override
+	{
+		bool start = false, stop = false, tree = false, module_summary = false, zone_summary = false;
+		int module_top = -1, zone_min_us = -1;
+		std::string trace_file, folded_file;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++)
+		{
+			if (args[argidx] == "-start") {
+				start = true;
+				continue;
+			}
+			if (args[argidx] == "-modules" && argidx+1 < args.size()) {
+				module_top = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-module-summary") {
+				module_summary = true;
+				continue;
+			}
+			if (args[argidx] == "-zones" && argidx+1 < args.size()) {
+				zone_min_us = std::max(atoi(args[++argidx].c_str()), 0);
+				continue;
+			}
+			if (args[argidx] == "-zone-summary") {
+				zone_summary = true;
+				continue;
+			}
+			if (args[argidx] == "-stop") {
+				stop = true;
+				continue;
+			}
+			if (args[argidx] == "-tree") {
+				tree = true;
+				continue;
+			}
+			if (args[argidx] == "-trace" && argidx+1 < args.size()) {
+				trace_file = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-folded" && argidx+1 < args.size()) {
+				folded_file = args[++argidx];
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, nullptr, false);
+
+		if (!start && !stop && module_top < 0 && zone_min_us < 0 && !module_summary && !zone_summary &&
+				trace_file.empty() && folded_file.empty())
+			tree = true;
+
+		if (start) {
+			PassProfiler::clear();
+			PassProfiler::enabled = true;
+		}
+
+		if (module_top >= 0)
+			PassProfiler::module_top = module_top;
+
+		if (zone_min_us >= 0) {
+			PassProfiler::zone_min_ns = 1000 * int64_t(zone_min_us);
+			PassProfiler::zones_enabled = true;
+		}
+
+		if (stop) {
+			PassProfiler::enabled = false;
+			PassProfiler::zones_enabled = false;
+		}
+
+		if (tree)
+			PassProfiler::log_tree();
+
+		if (module_summary)
+			PassProfiler::log_module_summary();
+
+		if (zone_summary)
+			PassProfiler::log_zone_summary();
+
+		if (!trace_file.empty()) {
+			std::ofstream f(trace_file.c_str());
+			if (f.fail())
+				log_cmd_error("Can't open file `%s' for writing: %s\n", trace_file.c_str(), strerror(errno));
+			PassProfiler::write_trace(f);
+		}
+
+		if (!folded_file.empty()) {
+			std::ofstream f(folded_file.c_str());
+			if (f.fail())
+				log_cmd_error("Can't open file `%s' for writing: %s\n", folded_file.c_str(), strerror(errno));
+			PassProfiler::write_folded(f);
+		}
+	}
+} ProfilePass;
+
+PRIVATE_NAMESPACE_END
@@ -19,8 +19,8 @@
 
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
+#include "kernel/threading.h"
 
-#undef LOG_MATRICES
 #undef PYPLOT_EDGES
 
 USING_YOSYS_NAMESPACE
@@ -36,6 +36,15 @@ static double xorshift32()
 	return (xorshift32_state % 1000000) / 1e6;
 }
 
+// Same as log_id(), but without the global cache, for use in worker threads.
+static std::string qwp_id(const RTLIL::IdString &id)
+{
+	const char *p = id.c_str();
+	if (p[0] == '\\' && p[1] != '$' && p[1] != '\\' && p[1] != 0 && !(p[1] >= '0' && p[1] <= '9'))
+		return p+1;
+	return p;
+}
+
 struct QwpConfig
 {
 	bool ltr;
@@ -111,6 +120,45 @@ struct QwpWorker
 	double alt_midpos;
 	double alt_radius;
 
+	// Random numbers for the solver. Each worker has its own generator,
+	// seeded by its parent, so that the result does not depend on the order
+	// in which the workers run.
+	uint32_t rng_state = 123456789;
+
+	double rng()
+	{
+		rng_state ^= rng_state << 13;
+		rng_state ^= rng_state >> 17;
+		rng_state ^= rng_state << 5;
+		return (rng_state % 1000000) / 1e6;
+	}
+
+	// the halves of the placement area, see split()
+	std::unique_ptr<QwpWorker> left_child, right_child;
+	dict<int, int> left_nodes, right_nodes;
+
+	// The log output of a worker, printed by flush_log() in the order of
+	// the recursion, as workers may run in parallel.
+	std::string log_buffer;
+
+	void wlog(const char *format, ...) YS_ATTRIBUTE(format(printf, 2, 3))
+	{
+		va_list ap;
+		va_start(ap, format);
+		log_buffer += vstringf(format, ap);
+		va_end(ap);
+	}
+
+	void flush_log()
+	{
+		log("%s", log_buffer.c_str());
+		log_buffer.clear();
+		if (left_child)
+			left_child->flush_log();
+		if (right_child)
+			right_child->flush_log();
+	}
+
 	QwpWorker(QwpConfig &config, Module *module, char direction = 'x') : config(config), module(module), direction(direction)
 	{
 		log_assert(direction == 'x' || direction == 'y');
@@ -211,37 +259,56 @@ struct QwpWorker
 		// AA = A' * A
 		// Ay = A' * y
 		//
-		// M := [AA Ay]
+		// AA is symmetric positive definite and sparse, with one off-diagonal
+		// entry per edge, and is stored in CSR form.
 
 		if (config.verbose)
-			log("> System size: %d^2\n", GetSize(nodes));
+			wlog("> System size: %d^2\n", GetSize(nodes));
 
-		// Row major order
-		int N = GetSize(nodes), N1 = N+1;
-		vector<double> M(N * N1);
+		int N = GetSize(nodes);
+		vector<double> diag(N), rhs(N);
 
 		if (config.verbose)
-			log("> Edge constraints: %d\n", GetSize(edges));
+			wlog("> Edge constraints: %d\n", GetSize(edges));
 
 		// Edge constraints:
 		//   A[i,:] := [ 0 0 .... 0 weight 0 ... 0 -weight 0 ... 0 0], y[i] := 0
 		//
 		// i.e. nonzero columns in A[i,:] at the two node indices.
+		vector<int> row_begin(N+1);
+		vector<double> edge_weights;
+		edge_weights.reserve(GetSize(edges));
 		for (auto &edge : edges)
 		{
 			int idx1 = edge.first.first;
 			int idx2 = edge.first.second;
-			double weight = edge.second * (1.0 + xorshift32() * 1e-3);
+			double weight = edge.second * (1.0 + rng() * 1e-3);
+			edge_weights.push_back(weight * weight);
 
-			M[idx1 + idx1*N1] += weight * weight;
-			M[idx2 + idx2*N1] += weight * weight;
+			diag[idx1] += weight * weight;
+			diag[idx2] += weight * weight;
+			row_begin[idx1+1]++;
+			row_begin[idx2+1]++;
+		}
 
-			M[idx1 + idx2*N1] += -weight * weight;
-			M[idx2 + idx1*N1] += -weight * weight;
+		for (int i = 0; i < N; i++)
+			row_begin[i+1] += row_begin[i];
+
+		vector<int> col(row_begin[N]);
+		vector<double> val(row_begin[N]);
+		vector<int> fill(row_begin.begin(), row_begin.end()-1);
+		int edge_idx = 0;
+		for (auto &edge : edges)
+		{
+			int idx1 = edge.first.first;
+			int idx2 = edge.first.second;
+			double w2 = edge_weights[edge_idx++];
+			col[fill[idx1]] = idx2, val[fill[idx1]++] = -w2;
+			col[fill[idx2]] = idx1, val[fill[idx2]++] = -w2;
 		}
 
 		if (config.verbose)
-			log("> Node constraints: %d\n", GetSize(nodes));
+			wlog("> Node constraints: %d\n", GetSize(nodes));
 
 		// Node constraints:
 		//   A[i,:] := [ 0 0 .... 0 weight 0 ... 0 0], y[i] := weight * pos
@@ -254,113 +321,86 @@ struct QwpWorker
 		for (int idx = 0; idx < GetSize(nodes); idx++)
 		{
 			auto &node = nodes[idx];
-			double rhs = (alt_mode ? node.alt_pos : node.pos);
+			double pos = (alt_mode ? node.alt_pos : node.pos);
 
 			double weight = 1e-3;
 			if (alt_mode ? node.alt_tied : node.tied)
 				weight = 1e3;
-			weight *= (1.0 + xorshift32() * 1e-3);
+			weight *= (1.0 + rng() * 1e-3);
 
-			M[idx + idx*N1] += weight * weight;
-			M[N + idx*N1] += rhs * weight * weight;
+			diag[idx] += weight * weight;
+			rhs[idx] += pos * weight * weight;
 		}
 
-#ifdef LOG_MATRICES
-		log("\n");
+		if (config.verbose)
+			wlog("> Solving\n");
+
+		// Solve "AA*x = Ay" (least squares fit for "A*x = y") with the
+		// conjugate gradient method, preconditioned with the diagonal of AA
+		// and starting from the current positions.
+
+		auto multiply = [&](const vector<double> &in, vector<double> &out) {
+			for (int i = 0; i < N; i++) {
+				double sum = diag[i] * in[i];
+				for (int k = row_begin[i]; k < row_begin[i+1]; k++)
+					sum += val[k] * in[col[k]];
+				out[i] = sum;
+			}
+		};
+		auto dot = [&](const vector<double> &a, const vector<double> &b) {
+			double sum = 0;
+			for (int i = 0; i < N; i++)
+				sum += a[i] * b[i];
+			return sum;
+		};
+
+		vector<double> x(N), r(N), z(N), p(N), q(N);
 		for (int i = 0; i < N; i++) {
-			for (int j = 0; j < N+1; j++)
-				log(" %10.2e", M[(N+1)*i + j]);
-			log("\n");
+			x[i] = alt_mode ? nodes[i].alt_pos : nodes[i].pos;
+			if (!std::isfinite(x[i]))
+				x[i] = alt_mode ? alt_midpos : midpos;
 		}
-#endif
 
-		if (config.verbose)
-			log("> Solving\n");
-
-		// Solve "AA*x = Ay"
-		// (least squares fit for "A*x = y")
-		//
-		// Using gaussian elimination to get M := [Id x]
-
-		vector<int> pivot_cache;
-		vector<int> queue;
+		multiply(x, q);
+		for (int i = 0; i < N; i++) {
+			r[i] = rhs[i] - q[i];
+			z[i] = r[i] / diag[i];
+			p[i] = z[i];
+		}
 
-		for (int i = 0; i < N; i++)
-			queue.push_back(i);
+		double rz = dot(r, z);
+		double limit = 1e-20 * std::max(dot(rhs, rhs), 1e-30);
+		int max_iter = 100 + 10 * N, iter = 0;
 
-		// gaussian elimination
-		for (int i = 0; i < N; i++)
+		for (; iter < max_iter && dot(r, r) > limit; iter++)
 		{
-			if (config.verbose && N > 15 && ((i+1) % (N/15)) == 0)
-				log("> Solved %d%%: %d/%d\n", (100*(i+1))/N, i+1, N);
-
-			// find best row
-			int best_row = queue.front();
-			int best_row_queue_idx = 0;
-			double best_row_absval = 0;
-
-			for (int k = 0; k < GetSize(queue); k++) {
-				int row = queue[k];
-				double absval = fabs(M[i + row*N1]);
-				if (absval > best_row_absval) {
-					best_row = row;
-					best_row_queue_idx = k;
-					best_row_absval = absval;
-				}
-			}
-
-			int row = best_row;
-			pivot_cache.push_back(row);
-
-			queue[best_row_queue_idx] = queue.back();
-			queue.pop_back();
-
-			// normalize row
-			for (int k = i+1; k < N1; k++)
-				M[k + row*N1] /= M[i + row*N1];
-			M[i + row*N1] = 1.0;
-
-			// elimination
-			for (int other_row : queue) {
-				double d = M[i + other_row*N1];
-				for (int k = i+1; k < N1; k++)
-					M[k + other_row*N1] -= d*M[k + row*N1];
-				M[i + other_row*N1] = 0.0;
+			multiply(p, q);
+			double pq = dot(p, q);
+			if (!(pq > 0))
+				break;
+			double alpha = rz / pq;
+			for (int i = 0; i < N; i++) {
+				x[i] += alpha * p[i];
+				r[i] -= alpha * q[i];
+				z[i] = r[i] / diag[i];
 			}
+			double rz_new = dot(r, z);
+			double beta = rz_new / rz;
+			rz = rz_new;
+			for (int i = 0; i < N; i++)
+				p[i] = z[i] + beta * p[i];
 		}
 
 		if (config.verbose)
-			log("> Solved\n");
-
-		log_assert(queue.empty());
-		log_assert(GetSize(pivot_cache) == N);
-
-		// back substitution
-		for (int i = N-1; i >= 0; i--)
-		for (int j = i+1; j < N; j++)
-		{
-			int row = pivot_cache[i];
-			int other_row = pivot_cache[j];
-			M[N + row*N1] -= M[j + row*N1] * M[N + other_row*N1];
-			M[j + row*N1] = 0.0;
-		}
-
-#ifdef LOG_MATRICES
-		log("\n");
-		for (int i = 0; i < N; i++) {
-			for (int j = 0; j < N+1; j++)
-				log(" %10.2e", M[(N+1)*i + j]);
-			log("\n");
-		}
-#endif
+			wlog("> Solved after %d iterations, residual %.2e\n", iter, sqrt(dot(r, r)));
 
 		if (config.verbose)
-			log("> Update nodes\n");
+			wlog("> Update nodes\n");
 
 		// update node positions
 		for (int i = 0; i < N; i++)
 		{
-			double v = M[(N+1)*i + N];
+			double v = x[i];
 			double c = alt_mode ? alt_midpos : midpos;
 			double r = alt_mode ? alt_radius : radius;
 
@@ -389,25 +429,25 @@ struct QwpWorker
 				continue;
 
 			for (int i = 0; i < indent; i++)
-				log("  ");
+				wlog("  ");
 
 			if (direction == 'x')
-				log("X=%.2f, Y=%.2f", node.pos, node.alt_pos);
+				wlog("X=%.2f, Y=%.2f", node.pos, node.alt_pos);
 			else
-				log("X=%.2f, Y=%.2f", node.alt_pos, node.pos);
+				wlog("X=%.2f, Y=%.2f", node.alt_pos, node.pos);
 
 			if (node.tied)
-				log(" [%c-tied]", direction);
+				wlog(" [%c-tied]", direction);
 
 			if (node.alt_tied)
-				log(" [%c-tied]", direction == 'x' ? 'y' : 'x');
+				wlog(" [%c-tied]", direction == 'x' ? 'y' : 'x');
 
 			if (node.cell != nullptr)
-				log(" %s (%s)", log_id(node.cell), log_id(node.cell->type));
+				wlog(" %s (%s)", qwp_id(node.cell->name).c_str(), qwp_id(node.cell->type).c_str());
 			else
-				log(" (none)");
+				wlog(" (none)");
 
-			log("\n");
+			wlog("\n");
 		}
 	}
 
@@ -488,7 +528,21 @@ struct QwpWorker
 		config.dump_file << stringf("</svg>\n");
 	}
 
-	void run_worker(int indent)
+	string range_str() const
+	{
+		if (direction == 'x')
+			return stringf("X=%.2f:%.2f, Y=%.2f:%.2f",
+					midpos - radius, midpos + radius,
+					alt_midpos - alt_radius, alt_midpos + alt_radius);
+		return stringf("X=%.2f:%.2f, Y=%.2f:%.2f",
+				alt_midpos - alt_radius, alt_midpos + alt_radius,
+				midpos - radius, midpos + radius);
+	}
+
+	// Solves the placement in the area of this worker and, unless it is small
+	// enough, creates the child workers for its two halves. Returns false if
+	// there are no children.
+	bool split(int indent)
 	{
 		int count_cells = 0;
 
@@ -497,21 +551,10 @@ struct QwpWorker
 				count_cells++;
 
 		for (int i = 0; i < indent; i++)
-			log("  ");
+			wlog("  ");
 
-		string range_str;
-
-		if (direction == 'x')
-			range_str = stringf("X=%.2f:%.2f, Y=%.2f:%.2f",
-					midpos - radius, midpos + radius,
-					alt_midpos - alt_radius, alt_midpos + alt_radius);
-		else
-			range_str = stringf("X=%.2f:%.2f, Y=%.2f:%.2f",
-					alt_midpos - alt_radius, alt_midpos + alt_radius,
-					midpos - radius, midpos + radius);
-
-		log("%c-qwp on %s with %d cells, %d nodes, and %d edges.\n", direction,
-				range_str.c_str(), count_cells, GetSize(nodes), GetSize(edges));
+		wlog("%c-qwp on %s with %d cells, %d nodes, and %d edges.\n", direction,
+				range_str().c_str(), count_cells, GetSize(nodes), GetSize(edges));
 
 		solve();
 		solve(true);
@@ -532,7 +575,7 @@ struct QwpWorker
 
 		if (config.dump_file.is_open())
 		{
-			config.dump_file << stringf("<h4>LSQ %c-Solution for %s:</h4>\n", direction, range_str.c_str());
+			config.dump_file << stringf("<h4>LSQ %c-Solution for %s:</h4>\n", direction, range_str().c_str());
 
 			pool<int> green_nodes;
 			for (int i = 0; i < median_sidx; i++)
@@ -563,19 +606,20 @@ struct QwpWorker
 
 		if (GetSize(sorted_pos) < 2 || (2*radius <= config.grid && 2*alt_radius <= config.grid)) {
 			log_cell_coordinates(indent + 1);
-			return;
+			return false;
 		}
 
 		// create child workers
 
 		char child_direction = direction == 'x' ? 'y' : 'x';
 
-		QwpWorker left_worker(config, module, child_direction);
-		QwpWorker right_worker(config, module, child_direction);
+		left_child.reset(new QwpWorker(config, module, child_direction));
+		right_child.reset(new QwpWorker(config, module, child_direction));
 
-		// duplicate nodes into child workers
+		QwpWorker &left_worker = *left_child;
+		QwpWorker &right_worker = *right_child;
 
-		dict<int, int> left_nodes, right_nodes;
+		// duplicate nodes into child workers
 
 		for (int k = 0; k < GetSize(sorted_pos); k++)
 		{
@@ -646,7 +690,7 @@ struct QwpWorker
 				right_worker.edges[pair<int, int>(right_idx1, right_idx2)] += weight;
 		}
 
-		// run child workers
+		// set up child workers
 
 		left_worker.midpos = right_worker.midpos = alt_midpos;
 		left_worker.radius = right_worker.radius = alt_radius;
@@ -655,10 +699,17 @@ struct QwpWorker
 		right_worker.alt_midpos = midpos + radius/2;
 		left_worker.alt_radius = right_worker.alt_radius = radius/2;
 
-		left_worker.run_worker(indent+1);
-		right_worker.run_worker(indent+1);
+		left_worker.rng_state = (rng_state ^ 0x5bd1e995) | 1;
+		right_worker.rng_state = (rng_state ^ 0x1b873593) | 1;
+
+		return true;
+	}
 
-		// re-integrate results
+	// Re-integrates the results of the child workers.
+	void integrate()
+	{
+		QwpWorker &left_worker = *left_child;
+		QwpWorker &right_worker = *right_child;
 
 		for (auto &it : left_nodes)
 			if (left_worker.nodes[it.second].cell != nullptr) {
@@ -673,11 +724,52 @@ struct QwpWorker
 			}
 
 		if (config.dump_file.is_open()) {
-			config.dump_file << stringf("<h4>Final %c-Solution for %s:</h4>\n", direction, range_str.c_str());
+			config.dump_file << stringf("<h4>Final %c-Solution for %s:</h4>\n", direction, range_str().c_str());
 			dump_svg();
 		}
 	}
 
+	void run_worker(int indent)
+	{
+		if (!split(indent))
+			return;
+
+		left_child->run_worker(indent+1);
+		right_child->run_worker(indent+1);
+		integrate();
+	}
+
+	// The same as run_worker(), but runs the workers of each level of the
+	// recursion in parallel.
+	void run_levels(int indent)
+	{
+		vector<vector<QwpWorker*>> levels;
+		levels.push_back({this});
+
+		while (!levels.back().empty())
+		{
+			vector<QwpWorker*> &level = levels.back();
+			vector<char> has_children(GetSize(level));
+
+			ThreadPool::run(GetSize(level), [&](int i) {
+				has_children[i] = level[i]->split(indent + GetSize(levels) - 1);
+			}, yosys_thread_count(GetSize(level)));
+
+			vector<QwpWorker*> next_level;
+			for (int i = 0; i < GetSize(level); i++)
+				if (has_children[i]) {
+					next_level.push_back(level[i]->left_child.get());
+					next_level.push_back(level[i]->right_child.get());
+				}
+			levels.push_back(next_level);
+		}
+
+		for (int k = GetSize(levels)-1; k >= 0; k--)
+			for (auto worker : levels[k])
+				if (worker->left_child)
+					worker->integrate();
+	}
+
 	void histogram(const vector<double> &values)
 	{
 		if (values.empty()) {
@@ -733,7 +825,14 @@ struct QwpWorker
 		radius = 0.5;
 		alt_midpos = 0.5;
 		alt_radius = 0.5;
-		run_worker(1);
+		rng_state = xorshift32_state | 1;
+
+		// The dump file is written in the order of the recursion.
+		if (config.dump_file.is_open())
+			run_worker(1);
+		else
+			run_levels(1);
+		flush_log();
 
 		for (auto &node : nodes)
 			if (node.cell != nullptr)
@@ -804,8 +903,9 @@ struct QwpPass : public Pass {
 		log("    -v\n");
 		log("        Verbose solver output for profiling or debugging\n");
 		log("\n");
-		log("Note: This implementation of a quadratic wirelength placer uses exact\n");
-		log("dense matrix operations. It is only a toy-placer for small circuits.\n");
+		log("Note: This implementation of a quadratic wirelength placer solves the\n");
+		log("sparse least squares systems with a preconditioned conjugate gradient\n");
+		log("method. It is only a toy-placer and does not legalize the placement.\n");
 		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
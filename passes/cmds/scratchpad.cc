@@ -62,6 +62,16 @@ struct ScratchpadPass : public Pass {
 		log("by the name of the pass that uses it, e.g. 'opt.did_something'. If the value\n");
 		log("contains whitespace, it must be enclosed in double quotes.\n");
 		log("\n");
+		log("The following entries change the behavior of other commands:\n");
+		log("\n");
+		log("    checkpoint.dir\n");
+		log("        a directory in which script commands with labels (synth, synth_*,\n");
+		log("        prep, ...) save the design at each label they reach, in the binary\n");
+		log("        RTLIL format. When the command is run again with the same arguments\n");
+		log("        (apart from -run) on the same design, it resumes at the last saved\n");
+		log("        label, or at the from label given with -run if it was saved. The\n");
+		log("        scratchpad is not considered in the comparison.\n");
+		log("\n");
 	}
 
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -54,91 +54,146 @@ static bool match_ids(RTLIL::IdString id, const std::string &pattern)
 	return false;
 }
 
-static bool match_attr_val(const RTLIL::Const &value, const std::string &pattern, char match_op)
-{
-	if (match_op == 0)
-		return true;
-
-	if ((value.flags & RTLIL::CONST_FLAG_STRING) == 0)
+namespace {
+	// An attribute or parameter filter (the argument of a:, r: and A:), parsed
+	// once and then matched against the attributes of many objects.
+	struct attr_matcher_t
 	{
-		RTLIL::SigSpec sig_value;
+		std::string name_pat, value_pat;
+		char match_op = 0;
+		bool name_wildcard = false;
+		std::vector<RTLIL::IdString> names;
+		bool value_parsed = false;
+		RTLIL::Const value_const;
+
+		attr_matcher_t(const std::string &match_expr)
+		{
+			size_t pos = match_expr.find_first_of("<!=>");
+			name_pat = match_expr.substr(0, pos);
+			if (pos != std::string::npos) {
+				if (match_expr.compare(pos, 2, "!=") == 0)
+					match_op = '!', value_pat = match_expr.substr(pos+2);
+				else if (match_expr.compare(pos, 2, "<=") == 0)
+					match_op = '[', value_pat = match_expr.substr(pos+2);
+				else if (match_expr.compare(pos, 2, ">=") == 0)
+					match_op = ']', value_pat = match_expr.substr(pos+2);
+				else
+					match_op = match_expr[pos], value_pat = match_expr.substr(pos+1);
+			}
 
-		if (!RTLIL::SigSpec::parse(sig_value, nullptr, pattern))
-			return false;
+			name_wildcard = name_pat.find_first_of("*?[") != std::string::npos;
+			if (!name_wildcard) {
+				if (name_pat.size() > 0 && (name_pat[0] == '\\' || name_pat[0] == '$'))
+					names.push_back(name_pat);
+				names.push_back("\\" + name_pat);
+			}
 
-		RTLIL::Const pattern_value = sig_value.as_const();
-
-		if (match_op == '=')
-			return value == pattern_value;
-		if (match_op == '!')
-			return value != pattern_value;
-		if (match_op == '<')
-			return value.as_int() < pattern_value.as_int();
-		if (match_op == '>')
-			return value.as_int() > pattern_value.as_int();
-		if (match_op == '[')
-			return value.as_int() <= pattern_value.as_int();
-		if (match_op == ']')
-			return value.as_int() >= pattern_value.as_int();
-	}
-	else
-	{
-		std::string value_str = value.decode_string();
+			RTLIL::SigSpec sig_value;
+			if (match_op != 0 && RTLIL::SigSpec::parse(sig_value, nullptr, value_pat)) {
+				value_parsed = true;
+				value_const = sig_value.as_const();
+			}
+		}
 
-		if (match_op == '=')
-			if (patmatch(pattern.c_str(), value.decode_string().c_str()))
+		bool match_value(const RTLIL::Const &value) const
+		{
+			if (match_op == 0)
 				return true;
 
-		if (match_op == '=')
-			return value_str == pattern;
-		if (match_op == '!')
-			return value_str != pattern;
-		if (match_op == '<')
-			return value_str < pattern;
-		if (match_op == '>')
-			return value_str > pattern;
-		if (match_op == '[')
-			return value_str <= pattern;
-		if (match_op == ']')
-			return value_str >= pattern;
-	}
+			if ((value.flags & RTLIL::CONST_FLAG_STRING) == 0)
+			{
+				if (!value_parsed)
+					return false;
+
+				if (match_op == '=')
+					return value == value_const;
+				if (match_op == '!')
+					return value != value_const;
+				if (match_op == '<')
+					return value.as_int() < value_const.as_int();
+				if (match_op == '>')
+					return value.as_int() > value_const.as_int();
+				if (match_op == '[')
+					return value.as_int() <= value_const.as_int();
+				if (match_op == ']')
+					return value.as_int() >= value_const.as_int();
+			}
+			else
+			{
+				std::string value_str = value.decode_string();
+
+				if (match_op == '=')
+					if (patmatch(value_pat.c_str(), value_str.c_str()))
+						return true;
+
+				if (match_op == '=')
+					return value_str == value_pat;
+				if (match_op == '!')
+					return value_str != value_pat;
+				if (match_op == '<')
+					return value_str < value_pat;
+				if (match_op == '>')
+					return value_str > value_pat;
+				if (match_op == '[')
+					return value_str <= value_pat;
+				if (match_op == ']')
+					return value_str >= value_pat;
+			}
 
-	log_abort();
-}
+			log_abort();
+		}
 
-static bool match_attr(const dict<RTLIL::IdString, RTLIL::Const> &attributes, const std::string &name_pat, const std::string &value_pat, char match_op)
-{
-	if (name_pat.find('*') != std::string::npos || name_pat.find('?') != std::string::npos || name_pat.find('[') != std::string::npos) {
-		for (auto &it : attributes) {
-			if (patmatch(name_pat.c_str(), it.first.c_str()) && match_attr_val(it.second, value_pat, match_op))
-				return true;
-			if (it.first.size() > 0 && it.first[0] == '\\' && patmatch(name_pat.c_str(), it.first.substr(1).c_str()) && match_attr_val(it.second, value_pat, match_op))
-				return true;
+		bool operator()(const dict<RTLIL::IdString, RTLIL::Const> &attributes) const
+		{
+			if (name_wildcard) {
+				for (auto &it : attributes) {
+					if (patmatch(name_pat.c_str(), it.first.c_str()) && match_value(it.second))
+						return true;
+					if (it.first.size() > 0 && it.first[0] == '\\' && patmatch(name_pat.c_str(), it.first.c_str() + 1) && match_value(it.second))
+						return true;
+				}
+			} else {
+				for (auto &name : names) {
+					auto it = attributes.find(name);
+					if (it != attributes.end() && match_value(it->second))
+						return true;
+				}
+			}
+			return false;
 		}
-	} else {
-		if (name_pat.size() > 0 && (name_pat[0] == '\\' || name_pat[0] == '$') && attributes.count(name_pat) && match_attr_val(attributes.at(name_pat), value_pat, match_op))
-			return true;
-		if (attributes.count("\\" + name_pat) && match_attr_val(attributes.at("\\" + name_pat), value_pat, match_op))
-			return true;
-	}
-	return false;
-}
+	};
 
-static bool match_attr(const dict<RTLIL::IdString, RTLIL::Const> &attributes, const std::string &match_expr)
-{
-	size_t pos = match_expr.find_first_of("<!=>");
-
-	if (pos != std::string::npos) {
-		if (match_expr.compare(pos, 2, "!=") == 0)
-			return match_attr(attributes, match_expr.substr(0, pos), match_expr.substr(pos+2), '!');
-		if (match_expr.compare(pos, 2, "<=") == 0)
-			return match_attr(attributes, match_expr.substr(0, pos), match_expr.substr(pos+2), '[');
-		if (match_expr.compare(pos, 2, ">=") == 0)
-			return match_attr(attributes, match_expr.substr(0, pos), match_expr.substr(pos+2), ']');
-		return match_attr(attributes, match_expr.substr(0, pos), match_expr.substr(pos+1), match_expr[pos]);
-	}
+	// A name pattern as matched by match_ids(). Plain names without wildcards
+	// or escapes can only match one id, which is looked up directly instead
+	// of matching the pattern against every object.
+	struct id_matcher_t
+	{
+		std::string pattern;
+		bool literal;
+		RTLIL::IdString id;
+		mutable dict<RTLIL::IdString, bool> cache;
+
+		id_matcher_t(const std::string &pattern) : pattern(pattern)
+		{
+			literal = !pattern.empty() && pattern[0] != '$' && pattern.find_first_of("*?[\\") == std::string::npos;
+			if (literal)
+				id = "\\" + pattern;
+		}
 
-	return match_attr(attributes, match_expr, std::string(), 0);
+		bool operator()(RTLIL::IdString name) const {
+			return literal ? name == id : match_ids(name, pattern);
+		}
+
+		// for matching the same ids many times, such as cell types
+		bool cached(RTLIL::IdString name) const {
+			if (literal)
+				return name == id;
+			auto it = cache.find(name);
+			if (it == cache.end())
+				it = cache.emplace(name, match_ids(name, pattern)).first;
+			return it->second;
+		}
+	};
 }
 
 static void select_op_neg(RTLIL::Design *design, RTLIL::Selection &lhs)
@@ -500,6 +555,120 @@ static int select_op_expand(RTLIL::Design *design, RTLIL::Selection &lhs, std::v
 	return sel_objects;
 }
 
+static bool expand_rules_match(const std::vector<expand_rule_t> &rules, RTLIL::Cell *cell, RTLIL::IdString port, bool eval_only)
+{
+	if (eval_only && !yosys_celltypes.cell_evaluable(cell->type))
+		return false;
+	char last_mode = '-';
+	for (auto &rule : rules) {
+		last_mode = rule.mode;
+		if (rule.cell_types.size() > 0 && rule.cell_types.count(cell->type) == 0)
+			continue;
+		if (rule.port_names.size() > 0 && rule.port_names.count(port) == 0)
+			continue;
+		return rule.mode == '+';
+	}
+	return last_mode != '+';
+}
+
+// Same result as calling select_op_expand() above once per level without an
+// object limit, but the connectivity of each module is indexed once and each
+// level only expands from the objects added by the previous level, instead of
+// scanning all connections of the module on every level.
+static void select_op_expand_frontier(RTLIL::Design *design, RTLIL::Selection &lhs, const std::vector<expand_rule_t> &rules,
+		const std::set<RTLIL::IdString> &limits, int levels, char mode, CellTypes &ct, bool eval_only)
+{
+	for (auto mod : design->modules())
+	{
+		if (lhs.selected_whole_module(mod->name) || !lhs.selected_module(mod->name))
+			continue;
+
+		// cell ports connected to each wire, and the wires connected to each
+		// wire by module connections, towards the lhs and towards the rhs
+		dict<RTLIL::Wire*, std::vector<std::pair<RTLIL::Cell*, RTLIL::IdString>>> wire_ports;
+		dict<RTLIL::Wire*, pool<RTLIL::Wire*>> conn_to_lhs, conn_to_rhs;
+
+		for (auto &conn : mod->connections()) {
+			std::vector<RTLIL::SigBit> conn_lhs = conn.first.to_sigbit_vector();
+			std::vector<RTLIL::SigBit> conn_rhs = conn.second.to_sigbit_vector();
+			for (size_t i = 0; i < conn_lhs.size(); i++) {
+				if (conn_lhs[i].wire == nullptr || conn_rhs[i].wire == nullptr)
+					continue;
+				if (mode != 'i')
+					conn_to_lhs[conn_rhs[i].wire].insert(conn_lhs[i].wire);
+				if (mode != 'o')
+					conn_to_rhs[conn_lhs[i].wire].insert(conn_rhs[i].wire);
+			}
+		}
+
+		for (auto cell : mod->cells())
+		for (auto &conn : cell->connections()) {
+			if (!expand_rules_match(rules, cell, conn.first, eval_only))
+				continue;
+			pool<RTLIL::Wire*> port_wires;
+			for (auto &chunk : conn.second.chunks())
+				if (chunk.wire != nullptr && port_wires.insert(chunk.wire).second)
+					wire_ports[chunk.wire].push_back(std::make_pair(cell, conn.first));
+		}
+
+		auto &members = lhs.selected_members[mod->name];
+		std::vector<RTLIL::IdString> frontier(members.begin(), members.end());
+
+		for (int level = 0; level < levels && !frontier.empty(); level++)
+		{
+			std::vector<RTLIL::IdString> added;
+			auto add = [&](RTLIL::IdString name) {
+				if (members.insert(name).second)
+					added.push_back(name);
+			};
+
+			for (auto name : frontier)
+			{
+				if (limits.count(name))
+					continue;
+
+				RTLIL::Wire *wire = mod->wire(name);
+				if (wire != nullptr) {
+					auto it = conn_to_lhs.find(wire);
+					if (it != conn_to_lhs.end())
+						for (auto w : it->second)
+							add(w->name);
+					it = conn_to_rhs.find(wire);
+					if (it != conn_to_rhs.end())
+						for (auto w : it->second)
+							add(w->name);
+					auto pit = wire_ports.find(wire);
+					if (pit != wire_ports.end())
+						for (auto &port : pit->second) {
+							if (members.count(port.first->name))
+								continue;
+							bool is_input = mode == 'x' || ct.cell_input(port.first->type, port.second);
+							bool is_output = mode == 'x' || ct.cell_output(port.first->type, port.second);
+							if (mode == 'x' || (mode == 'i' && is_output) || (mode == 'o' && is_input))
+								add(port.first->name);
+						}
+					continue;
+				}
+
+				RTLIL::Cell *cell = mod->cell(name);
+				if (cell != nullptr)
+					for (auto &conn : cell->connections()) {
+						if (!expand_rules_match(rules, cell, conn.first, eval_only))
+							continue;
+						bool is_input = mode == 'x' || ct.cell_input(cell->type, conn.first);
+						bool is_output = mode == 'x' || ct.cell_output(cell->type, conn.first);
+						if (mode == 'x' || (mode == 'i' && is_input) || (mode == 'o' && is_output))
+							for (auto &chunk : conn.second.chunks())
+								if (chunk.wire != nullptr)
+									add(chunk.wire->name);
+					}
+			}
+
+			frontier.swap(added);
+		}
+	}
+}
+
 static void select_op_expand(RTLIL::Design *design, const std::string &arg, char mode, bool eval_only)
 {
 	int pos = (mode == 'x' ? 2 : 3) + (eval_only ? 1 : 0);
@@ -593,6 +762,11 @@ static void select_op_expand(RTLIL::Design *design, const std::string &arg, char
 	}
 #endif
 
+	if (rem_objects < 0) {
+		select_op_expand_frontier(design, work_stack.back(), rules, limits, levels, mode, ct, eval_only);
+		return;
+	}
+
 	while (levels-- > 0 && rem_objects != 0) {
 		int num_objects = select_op_expand(design, work_stack.back(), rules, limits, rem_objects, mode, ct, eval_only);
 		if (num_objects == 0)
@@ -805,20 +979,32 @@ static void select_stmt(RTLIL::Design *design, std::string arg, bool disable_emp
 	}
 
 	sel.full_selection = false;
-	for (auto mod : design->modules())
+
+	// the patterns are compiled once for all modules
+	bool memb_prefixed = arg_memb.size() >= 2 && arg_memb[1] == ':' && strchr("wioxsmctparn", arg_memb[0]) != nullptr;
+	id_matcher_t mod_ids(arg_mod.compare(0, 2, "N:") == 0 ? arg_mod.substr(2) : arg_mod);
+	attr_matcher_t mod_attrs(arg_mod.compare(0, 2, "A:") == 0 ? arg_mod.substr(2) : std::string());
+	id_matcher_t memb_ids(memb_prefixed ? arg_memb.substr(2) : arg_memb);
+	attr_matcher_t memb_attrs(arg_memb.compare(0, 2, "a:") == 0 || arg_memb.compare(0, 2, "r:") == 0 ? arg_memb.substr(2) : std::string());
+
+	// module names and attributes are available without loading lazy
+	// modules, their contents are only loaded when members are matched
+	for (auto &mod_it : design->modules_)
 	{
+		RTLIL::Module *mod = mod_it.second;
+
 		if (!select_blackboxes && mod->get_blackbox_attribute())
 			continue;
 
 		if (arg_mod.compare(0, 2, "A:") == 0) {
-			if (!match_attr(mod->attributes, arg_mod.substr(2)))
+			if (!mod_attrs(mod->attributes))
 				continue;
 		} else
 		if (arg_mod.compare(0, 2, "N:") == 0) {
-			if (!match_ids(mod->name, arg_mod.substr(2)))
+			if (!mod_ids(mod->name))
 				continue;
 		} else
-		if (!match_ids(mod->name, arg_mod))
+		if (!mod_ids(mod->name))
 			continue;
 		else
 			arg_mod_found[arg_mod] = true;
@@ -828,25 +1014,34 @@ static void select_stmt(RTLIL::Design *design, std::string arg, bool disable_emp
 			continue;
 		}
 
-		if (arg_memb.compare(0, 2, "w:") == 0) {
-			for (auto wire : mod->wires())
-				if (match_ids(wire->name, arg_memb.substr(2)))
+		design->load_lazy(mod->name);
+
+		// name patterns without wildcards select at most one object of each
+		// kind, which is looked up instead of matched against all objects
+		auto select_wires = [&](std::function<bool(RTLIL::Wire*)> filter) {
+			if (memb_ids.literal) {
+				RTLIL::Wire *wire = mod->wire(memb_ids.id);
+				if (wire != nullptr && filter(wire))
 					sel.selected_members[mod->name].insert(wire->name);
+			} else {
+				for (auto wire : mod->wires())
+					if (filter(wire) && memb_ids(wire->name))
+						sel.selected_members[mod->name].insert(wire->name);
+			}
+		};
+		auto all_wires = [](RTLIL::Wire*) { return true; };
+
+		if (arg_memb.compare(0, 2, "w:") == 0) {
+			select_wires(all_wires);
 		} else
 		if (arg_memb.compare(0, 2, "i:") == 0) {
-			for (auto wire : mod->wires())
-				if (wire->port_input && match_ids(wire->name, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(wire->name);
+			select_wires([](RTLIL::Wire *wire) { return wire->port_input; });
 		} else
 		if (arg_memb.compare(0, 2, "o:") == 0) {
-			for (auto wire : mod->wires())
-				if (wire->port_output && match_ids(wire->name, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(wire->name);
+			select_wires([](RTLIL::Wire *wire) { return wire->port_output; });
 		} else
 		if (arg_memb.compare(0, 2, "x:") == 0) {
-			for (auto wire : mod->wires())
-				if ((wire->port_input || wire->port_output) && match_ids(wire->name, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(wire->name);
+			select_wires([](RTLIL::Wire *wire) { return wire->port_input || wire->port_output; });
 		} else
 		if (arg_memb.compare(0, 2, "s:") == 0) {
 			size_t delim = arg_memb.substr(2).find(':');
@@ -866,67 +1061,80 @@ static void select_stmt(RTLIL::Design *design, std::string arg, bool disable_emp
 			}
 		} else
 		if (arg_memb.compare(0, 2, "m:") == 0) {
-			for (auto &it : mod->memories)
-				if (match_ids(it.first, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(it.first);
+			if (memb_ids.literal) {
+				if (mod->memories.count(memb_ids.id))
+					sel.selected_members[mod->name].insert(memb_ids.id);
+			} else {
+				for (auto &it : mod->memories)
+					if (memb_ids(it.first))
+						sel.selected_members[mod->name].insert(it.first);
+			}
 		} else
 		if (arg_memb.compare(0, 2, "c:") == 0) {
-			for (auto cell : mod->cells())
-				if (match_ids(cell->name, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(cell->name);
+			if (memb_ids.literal) {
+				if (mod->cell(memb_ids.id) != nullptr)
+					sel.selected_members[mod->name].insert(memb_ids.id);
+			} else {
+				for (auto cell : mod->cells())
+					if (memb_ids(cell->name))
+						sel.selected_members[mod->name].insert(cell->name);
+			}
 		} else
 		if (arg_memb.compare(0, 2, "t:") == 0) {
 			for (auto cell : mod->cells())
-				if (match_ids(cell->type, arg_memb.substr(2)))
+				if (memb_ids.cached(cell->type))
 					sel.selected_members[mod->name].insert(cell->name);
 		} else
 		if (arg_memb.compare(0, 2, "p:") == 0) {
-			for (auto &it : mod->processes)
-				if (match_ids(it.first, arg_memb.substr(2)))
-					sel.selected_members[mod->name].insert(it.first);
+			if (memb_ids.literal) {
+				if (mod->processes.count(memb_ids.id))
+					sel.selected_members[mod->name].insert(memb_ids.id);
+			} else {
+				for (auto &it : mod->processes)
+					if (memb_ids(it.first))
+						sel.selected_members[mod->name].insert(it.first);
+			}
 		} else
 		if (arg_memb.compare(0, 2, "a:") == 0) {
 			for (auto wire : mod->wires())
-				if (match_attr(wire->attributes, arg_memb.substr(2)))
+				if (memb_attrs(wire->attributes))
 					sel.selected_members[mod->name].insert(wire->name);
 			for (auto &it : mod->memories)
-				if (match_attr(it.second->attributes, arg_memb.substr(2)))
+				if (memb_attrs(it.second->attributes))
 					sel.selected_members[mod->name].insert(it.first);
 			for (auto cell : mod->cells())
-				if (match_attr(cell->attributes, arg_memb.substr(2)))
+				if (memb_attrs(cell->attributes))
 					sel.selected_members[mod->name].insert(cell->name);
 			for (auto &it : mod->processes)
-				if (match_attr(it.second->attributes, arg_memb.substr(2)))
+				if (memb_attrs(it.second->attributes))
 					sel.selected_members[mod->name].insert(it.first);
 		} else
 		if (arg_memb.compare(0, 2, "r:") == 0) {
 			for (auto cell : mod->cells())
-				if (match_attr(cell->parameters, arg_memb.substr(2)))
+				if (memb_attrs(cell->parameters))
 					sel.selected_members[mod->name].insert(cell->name);
 		} else {
-			std::string orig_arg_memb = arg_memb;
-			if (arg_memb.compare(0, 2, "n:") == 0)
-				arg_memb = arg_memb.substr(2);
-			for (auto wire : mod->wires())
-				if (match_ids(wire->name, arg_memb)) {
-					sel.selected_members[mod->name].insert(wire->name);
-					arg_memb_found[orig_arg_memb] = true;
-				}
-			for (auto &it : mod->memories)
-				if (match_ids(it.first, arg_memb)) {
-					sel.selected_members[mod->name].insert(it.first);
-					arg_memb_found[orig_arg_memb] = true;
-				}
-			for (auto cell : mod->cells())
-				if (match_ids(cell->name, arg_memb)) {
-					sel.selected_members[mod->name].insert(cell->name);
-					arg_memb_found[orig_arg_memb] = true;
-				}
-			for (auto &it : mod->processes)
-				if (match_ids(it.first, arg_memb)) {
-					sel.selected_members[mod->name].insert(it.first);
-					arg_memb_found[orig_arg_memb] = true;
-				}
+			bool found = false;
+			if (memb_ids.literal) {
+				if (mod->wire(memb_ids.id) != nullptr || mod->memories.count(memb_ids.id) ||
+						mod->cell(memb_ids.id) != nullptr || mod->processes.count(memb_ids.id))
+					sel.selected_members[mod->name].insert(memb_ids.id), found = true;
+			} else {
+				for (auto wire : mod->wires())
+					if (memb_ids(wire->name))
+						sel.selected_members[mod->name].insert(wire->name), found = true;
+				for (auto &it : mod->memories)
+					if (memb_ids(it.first))
+						sel.selected_members[mod->name].insert(it.first), found = true;
+				for (auto cell : mod->cells())
+					if (memb_ids(cell->name))
+						sel.selected_members[mod->name].insert(cell->name), found = true;
+				for (auto &it : mod->processes)
+					if (memb_ids(it.first))
+						sel.selected_members[mod->name].insert(it.first), found = true;
+			}
+			if (found)
+				arg_memb_found[arg_memb] = true;
 		}
 	}
 
@@ -1252,6 +1460,22 @@ struct SelectPass : public Pass {
 		log("    select */t:SWITCH %%x:+[GATE] */t:SWITCH %%d\n");
 		log("\n");
 	}
+	bool result_cacheable(const std::vector<std::string> &args) const override
+	{
+		// only the reports, not the commands that change the selection, and
+		// not %R, which advances the random number generator
+		bool report = false;
+		for (auto &arg : args) {
+			if (arg.compare(0, 2, "%R") == 0)
+				return false;
+			if (arg == "-count" || arg == "-list")
+				report = true;
+			if (arg == "-add" || arg == "-del" || arg == "-clear" || arg == "-none" || arg == "-module" ||
+					arg == "-set" || arg == "-unset" || arg == "-write" || arg == "-read")
+				return false;
+		}
+		return report;
+	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		bool add_mode = false;
@@ -0,0 +1,410 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/log.h"
+#include <fstream>
+
+#if !defined(_WIN32) && !defined(__wasm)
+#  define YOSYS_HAVE_SERVER
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <signal.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+// the last line of the output of each job
+static const char *job_ok_line = "-- yosys server: job succeeded --";
+static const char *job_failed_line = "-- yosys server: job failed --";
+
+#ifdef YOSYS_HAVE_SERVER
+static bool make_address(const std::string &path, struct sockaddr_un &addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		return false;
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+static bool write_all(int fd, const std::string &data)
+{
+	size_t pos = 0;
+	while (pos < data.size()) {
+		ssize_t n = write(fd, data.data() + pos, data.size() - pos);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		pos += n;
+	}
+	return true;
+}
+
+// SIGCHLD wakes up the server through this pipe, so that finished jobs are
+// reaped while the server waits for a connection
+static int sigchld_pipe[2] = {-1, -1};
+
+static void sigchld_handler(int)
+{
+	int saved_errno = errno;
+	char c = 0;
+	if (write(sigchld_pipe[1], &c, 1) < 0) {
+		// the pipe is full, the server wakes up anyway
+	}
+	errno = saved_errno;
+}
+
+// the connection of the job running in this process
+static FILE *job_file = nullptr;
+
+[[noreturn]] static void job_exit(bool ok)
+{
+	log_flush();
+	fprintf(job_file, "%s\n", ok ? job_ok_line : job_failed_line);
+	fclose(job_file);
+	_exit(ok ? 0 : 1);
+}
+
+// Runs in the forked child, which has a private copy of the warm process:
+// the registered passes, loaded plugins, caches and the current design.
+[[noreturn]] static void run_job(RTLIL::Design *design, int fd, bool fresh, const std::string &tempdir, int job)
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	// the script is everything the client sends before shutting down its
+	// side of the connection
+	std::string script;
+	char buffer[4096];
+	while (true) {
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		script.append(buffer, n);
+	}
+
+	job_file = fdopen(fd, "w");
+	if (job_file == nullptr)
+		_exit(1);
+	log_files = {job_file};
+	log_streams.clear();
+	log_errfile = nullptr;
+	log_cmd_error_throw = true;
+	log_error_atexit = []() { job_exit(false); };
+
+	std::string filename = stringf("%s/job%d.ys", tempdir.c_str(), job);
+	std::ofstream out(filename);
+	out << script;
+	out.close();
+
+	try {
+		if (fresh)
+			Pass::call(design, "design -reset");
+		run_frontend(filename, "script", design);
+	} catch (log_cmd_error_exception) {
+		remove(filename.c_str());
+		job_exit(false);
+	}
+
+	remove(filename.c_str());
+	job_exit(true);
+}
+
+static void connect_server(const std::string &path, const std::string &script_file)
+{
+	std::ifstream in(script_file);
+	if (in.fail())
+		log_cmd_error("Can't open script file `%s' for reading: %s\n", script_file.c_str(), strerror(errno));
+	std::string script((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	struct sockaddr_un addr;
+	if (!make_address(path, addr))
+		log_cmd_error("Socket path `%s' is too long.\n", path.c_str());
+
+	// give a server that is just starting up some time to listen
+	int fd = -1;
+	for (int retry = 0; fd < 0; retry++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			log_cmd_error("Can't create socket: %s\n", strerror(errno));
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+			break;
+		int err = errno;
+		close(fd);
+		fd = -1;
+		if (retry == 50)
+			log_cmd_error("Can't connect to `%s': %s\n", path.c_str(), strerror(err));
+		usleep(100000);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!write_all(fd, script) || shutdown(fd, SHUT_WR) != 0) {
+		close(fd);
+		log_cmd_error("Can't send the script to `%s': %s\n", path.c_str(), strerror(errno));
+	}
+
+	std::string output, line;
+	char buffer[4096];
+	while (true) {
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		output.append(buffer, n);
+		size_t pos;
+		while ((pos = output.find('\n')) != std::string::npos) {
+			line = output.substr(0, pos);
+			output.erase(0, pos + 1);
+			log("%s\n", line.c_str());
+		}
+	}
+	close(fd);
+
+	if (line != job_ok_line)
+		log_cmd_error("The job failed.\n");
+}
+#endif
+
+struct ServerPass : public Pass {
+	ServerPass() : Pass("server", "run scripts sent over a socket") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    server [options] <socket>\n");
+		log("\n");
+		log("This command turns the running yosys process into a server that listens on the\n");
+		log("given Unix domain socket and runs the scripts sent to it, e.g.\n");
+		log("\n");
+		log("    yosys -m plugin.so -p 'read_verilog -lib cells.v; server /tmp/yosys.sock'\n");
+		log("\n");
+		log("Each job runs in a forked child process, which inherits the state of the\n");
+		log("server: the loaded plugins, the libraries read before and the current design.\n");
+		log("This avoids the start-up cost of a new process for each small job. A job does\n");
+		log("not change the state of the server. Only the user running the server can\n");
+		log("connect to the socket.\n");
+		log("\n");
+		log("A client connects, sends the script and shuts down the sending side of the\n");
+		log("connection. The server then sends back the log of the job as it runs. The last\n");
+		log("line of the log tells whether the script succeeded:\n");
+		log("\n");
+		log("    %s\n", job_ok_line);
+		log("    %s\n", job_failed_line);
+		log("\n");
+		log("The server runs until it is killed or has run the number of jobs given by\n");
+		log("-jobs.\n");
+		log("\n");
+		log("    -fresh\n");
+		log("        run each job on an empty design instead of a copy of the current one.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        run at most N jobs at the same time. (default: 1)\n");
+		log("\n");
+		log("    -jobs <N>\n");
+		log("        stop after N jobs.\n");
+		log("\n");
+		log("\n");
+		log("    server -connect <socket> <script_file>\n");
+		log("\n");
+		log("Sends the script to a server, prints its log and fails if the job failed.\n");
+		log("\n");
+		log("This command is not available on Windows and in WebAssembly builds.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		std::string connect_path;
+		bool fresh = false;
+		int max_running = 1, max_jobs = 0;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++)
+		{
+			if (args[argidx] == "-connect" && argidx+1 < args.size()) {
+				connect_path = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-fresh") {
+				fresh = true;
+				continue;
+			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				max_running = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-jobs" && argidx+1 < args.size()) {
+				max_jobs = atoi(args[++argidx].c_str());
+				continue;
+			}
+			break;
+		}
+		if (argidx+1 != args.size())
+			cmd_error(args, argidx, "Expected a single socket path or script file.");
+
+#ifndef YOSYS_HAVE_SERVER
+		log_cmd_error("The server command is not available on this platform.\n");
+#else
+		if (!connect_path.empty()) {
+			log_header(design, "Executing SERVER pass (sending script to %s).\n", connect_path.c_str());
+			std::string script_file = args[argidx];
+			rewrite_filename(script_file);
+			connect_server(connect_path, script_file);
+			return;
+		}
+
+		std::string path = args[argidx];
+		log_header(design, "Executing SERVER pass (listening on %s).\n", path.c_str());
+		if (max_running < 1)
+			max_running = 1;
+
+		struct sockaddr_un addr;
+		if (!make_address(path, addr))
+			log_cmd_error("Socket path `%s' is too long.\n", path.c_str());
+
+		// replace the socket left behind by an earlier server, but no other file
+		struct stat st;
+		if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(path.c_str());
+
+		int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server_fd < 0)
+			log_cmd_error("Can't create socket: %s\n", strerror(errno));
+		// jobs run arbitrary commands, only the owner may connect
+		mode_t old_umask = umask(0077);
+		int bind_ret = bind(server_fd, (struct sockaddr*)&addr, sizeof(addr));
+		umask(old_umask);
+		if (bind_ret != 0 || listen(server_fd, 16) != 0) {
+			close(server_fd);
+			log_cmd_error("Can't listen on `%s': %s\n", path.c_str(), strerror(errno));
+		}
+
+		if (pipe(sigchld_pipe) != 0) {
+			close(server_fd);
+			unlink(path.c_str());
+			log_cmd_error("Can't create pipe: %s\n", strerror(errno));
+		}
+		for (int pipe_fd : sigchld_pipe)
+			fcntl(pipe_fd, F_SETFL, fcntl(pipe_fd, F_GETFL) | O_NONBLOCK);
+		struct sigaction sigchld_action, old_sigchld_action;
+		memset(&sigchld_action, 0, sizeof(sigchld_action));
+		sigchld_action.sa_handler = sigchld_handler;
+		sigchld_action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+		sigemptyset(&sigchld_action.sa_mask);
+		sigaction(SIGCHLD, &sigchld_action, &old_sigchld_action);
+
+		auto stop_server = [&]() {
+			sigaction(SIGCHLD, &old_sigchld_action, nullptr);
+			close(sigchld_pipe[0]);
+			close(sigchld_pipe[1]);
+			close(server_fd);
+			unlink(path.c_str());
+		};
+
+		std::string tempdir = make_temp_dir(get_base_tmpdir() + "/yosys-server-XXXXXX");
+		log("Listening on %s.\n", path.c_str());
+
+		// the children inherit all open stdio buffers
+		log_flush();
+		fflush(stdout);
+		fflush(stderr);
+
+		int job = 0, running = 0;
+		while (max_jobs <= 0 || job < max_jobs || running > 0)
+		{
+			int status, pid;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				running--;
+				log("Job with process %d %s.\n", pid, WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "succeeded" : "failed");
+				log_flush();
+			}
+			if (max_jobs > 0 && job >= max_jobs && running == 0)
+				break;
+
+			// only wait for a connection while another job may be started,
+			// otherwise only for a job to finish
+			bool may_start = running < max_running && (max_jobs <= 0 || job < max_jobs);
+			struct pollfd fds[2];
+			fds[0].fd = sigchld_pipe[0];
+			fds[0].events = POLLIN;
+			fds[1].fd = server_fd;
+			fds[1].events = POLLIN;
+			fds[0].revents = fds[1].revents = 0;
+			if (poll(fds, may_start ? 2 : 1, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				stop_server();
+				remove_directory(tempdir);
+				log_cmd_error("Can't wait for connections: %s\n", strerror(errno));
+			}
+			if (fds[0].revents) {
+				char buffer[64];
+				while (read(sigchld_pipe[0], buffer, sizeof(buffer)) > 0) { }
+				continue;
+			}
+			if (!may_start || !fds[1].revents)
+				continue;
+
+			int fd = accept(server_fd, nullptr, nullptr);
+			if (fd < 0) {
+				if (errno == EINTR)
+					continue;
+				stop_server();
+				remove_directory(tempdir);
+				log_cmd_error("Can't accept connection: %s\n", strerror(errno));
+			}
+
+			job++;
+			pid = fork();
+			if (pid < 0) {
+				close(fd);
+				log_warning("Can't fork for job %d: %s\n", job, strerror(errno));
+				continue;
+			}
+			if (pid == 0) {
+				sigaction(SIGCHLD, &old_sigchld_action, nullptr);
+				close(sigchld_pipe[0]);
+				close(sigchld_pipe[1]);
+				close(server_fd);
+				run_job(design, fd, fresh, tempdir, job);
+			}
+			close(fd);
+			running++;
+			log("Started job %d in process %d.\n", job, pid);
+			log_flush();
+		}
+
+		stop_server();
+		remove_directory(tempdir);
+		log("Stopped after %d jobs.\n", job);
+#endif
+	}
+} ServerPass;
+
+PRIVATE_NAMESPACE_END
@@ -20,6 +20,8 @@
 #include "kernel/register.h"
 #include "kernel/celltypes.h"
 #include "kernel/log.h"
+#include "kernel/netgraph.h"
+#include "libs/json11/json11.hpp"
 #include <string.h>
 
 #ifndef _WIN32
@@ -647,6 +649,305 @@ struct ShowWorker
 	}
 };
 
+// Writes a reduced graph of the selected modules that Graphviz can still lay
+// out for large designs: cells are collapsed into clusters (bits of the same
+// bus, strongly connected components) and only the edges between clusters are
+// written, annotated with the number of bits they carry. With -cluster module
+// the graph has one node per module and one edge per instantiated submodule.
+// The output is either a DOT file or a JSON Lines stream for web viewers.
+struct ShowClusterWorker
+{
+	CellTypes ct;
+	FILE *f;
+	RTLIL::Design *design;
+	bool json, cluster_bus, cluster_scc;
+	int page_counter = 0;
+	std::string buf;
+
+	// initial nodes: module ports and selected cells
+	std::vector<std::string> node_label, node_kind;
+	std::vector<RTLIL::IdString> node_name;
+	std::vector<int> node_parent;
+
+	// output graph: clusters and edges between them
+	std::vector<int> cluster_of;
+	std::vector<std::vector<int>> cluster_members;
+	dict<std::pair<int, int>, int> cluster_edges;
+
+	static std::string dot_escape(const std::string &str)
+	{
+		std::string res;
+		for (char ch : str) {
+			if (ch == '"' || ch == '\\')
+				res += '\\';
+			res += ch;
+		}
+		return res;
+	}
+
+	static std::string json_string(const std::string &str)
+	{
+		return json11::Json(str).dump();
+	}
+
+	int find(int node)
+	{
+		while (node_parent[node] != node)
+			node = node_parent[node] = node_parent[node_parent[node]];
+		return node;
+	}
+
+	void merge(int a, int b)
+	{
+		a = find(a), b = find(b);
+		if (a != b)
+			node_parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	int add_node(RTLIL::IdString name, const std::string &label, const char *kind)
+	{
+		node_name.push_back(name);
+		node_label.push_back(label);
+		node_kind.push_back(kind);
+		node_parent.push_back(GetSize(node_parent));
+		return GetSize(node_parent) - 1;
+	}
+
+	void clear_graph()
+	{
+		node_label.clear();
+		node_kind.clear();
+		node_name.clear();
+		node_parent.clear();
+		cluster_of.clear();
+		cluster_members.clear();
+		cluster_edges.clear();
+	}
+
+	// Numbers the clusters in the order of their first member and adds up the
+	// widths of the edges between different clusters.
+	void build_clusters(const std::vector<std::pair<int, int>> &bit_edges)
+	{
+		std::vector<int> index(GetSize(node_parent), -1);
+		cluster_of.resize(GetSize(node_parent));
+		for (int node = 0; node < GetSize(node_parent); node++) {
+			int root = find(node);
+			if (index[root] < 0) {
+				index[root] = GetSize(cluster_members);
+				cluster_members.emplace_back();
+			}
+			cluster_of[node] = index[root];
+			cluster_members[index[root]].push_back(node);
+		}
+		for (auto &edge : bit_edges) {
+			int from = cluster_of[edge.first], to = cluster_of[edge.second];
+			if (from != to)
+				cluster_edges[std::make_pair(from, to)]++;
+		}
+	}
+
+	std::string cluster_label(int cluster)
+	{
+		auto &members = cluster_members[cluster];
+		if (GetSize(members) == 1)
+			return node_label[members.front()];
+		// the most common kind of node in the cluster
+		dict<std::string, int> counts;
+		for (int node : members)
+			counts[node_kind[node]]++;
+		auto best = counts.begin();
+		for (auto it = counts.begin(); it != counts.end(); ++it)
+			if (it->second > best->second)
+				best = it;
+		return stringf("%s\n%d cells, %d %s", log_id(node_name[members.front()]), GetSize(members), best->second, best->first.c_str());
+	}
+
+	void write_graph(const std::string &title, const char *edge_unit)
+	{
+		if (json) {
+			buf += stringf("{\"type\": \"graph\", \"name\": %s, \"nodes\": %d, \"edges\": %d}\n",
+					json_string(title).c_str(), GetSize(cluster_members), GetSize(cluster_edges));
+			for (int cluster = 0; cluster < GetSize(cluster_members); cluster++) {
+				auto &members = cluster_members[cluster];
+				buf += stringf("{\"type\": \"node\", \"graph\": %d, \"id\": %d, \"label\": %s, \"kind\": %s, \"size\": %d}\n",
+						page_counter, cluster, json_string(cluster_label(cluster)).c_str(),
+						json_string(GetSize(members) == 1 ? node_kind[members.front()] : "cluster").c_str(), GetSize(members));
+			}
+			for (auto &it : cluster_edges)
+				buf += stringf("{\"type\": \"edge\", \"graph\": %d, \"from\": %d, \"to\": %d, \"%s\": %d}\n",
+						page_counter, it.first.first, it.first.second, edge_unit, it.second);
+			// member lists last, so that a viewer can show the graph before
+			// reading them
+			for (int cluster = 0; cluster < GetSize(cluster_members); cluster++) {
+				auto &members = cluster_members[cluster];
+				if (GetSize(members) == 1)
+					continue;
+				buf += stringf("{\"type\": \"members\", \"graph\": %d, \"id\": %d, \"names\": [", page_counter, cluster);
+				for (int i = 0; i < GetSize(members); i++) {
+					if (i > 0)
+						buf += ", ";
+					buf += json_string(node_name[members[i]].str());
+				}
+				buf += "]}\n";
+			}
+		} else {
+			buf += stringf("digraph \"%s\" {\n", dot_escape(title).c_str());
+			buf += stringf("label=\"%s\";\nrankdir=\"LR\";\nremincross=true;\n", dot_escape(title).c_str());
+			for (int cluster = 0; cluster < GetSize(cluster_members); cluster++) {
+				auto &members = cluster_members[cluster];
+				const char *shape = GetSize(members) > 1 ? "box3d" : node_kind[members.front()] == "port" ? "octagon" : "box";
+				buf += stringf("n%d [ shape=%s, label=\"%s\" ];\n", cluster, shape, dot_escape(cluster_label(cluster)).c_str());
+			}
+			for (auto &it : cluster_edges) {
+				if (it.second > 1)
+					buf += stringf("n%d -> n%d [ label=\"%d\", style=\"setlinewidth(3)\" ];\n", it.first.first, it.first.second, it.second);
+				else
+					buf += stringf("n%d -> n%d;\n", it.first.first, it.first.second);
+			}
+			buf += "}\n";
+		}
+		fwrite(buf.data(), 1, buf.size(), f);
+		buf.clear();
+	}
+
+	void handle_module(RTLIL::Module *module)
+	{
+		clear_graph();
+		SigMap sigmap(module);
+		dict<RTLIL::SigBit, int> driver;
+		std::vector<std::pair<RTLIL::SigBit, int>> readers;
+
+		for (auto wire : module->selected_wires()) {
+			if (!wire->port_id)
+				continue;
+			int node = add_node(wire->name, log_id(wire->name), "port");
+			for (auto bit : sigmap(wire)) {
+				if (wire->port_input)
+					driver[bit] = node;
+				else
+					readers.push_back(std::make_pair(bit, node));
+			}
+		}
+
+		for (auto cell : module->selected_cells()) {
+			int node = add_node(cell->name, stringf("%s\n%s", log_id(cell->name), log_id(cell->type)), log_id(cell->type));
+			for (auto &conn : cell->connections()) {
+				bool output = ct.cell_known(cell->type) ? ct.cell_output(cell->type, conn.first) : cell->output(conn.first);
+				for (auto bit : sigmap(conn.second)) {
+					if (!bit.wire)
+						continue;
+					if (output)
+						driver[bit] = node;
+					else
+						readers.push_back(std::make_pair(bit, node));
+				}
+			}
+		}
+
+		std::vector<std::pair<int, int>> bit_edges;
+		for (auto &it : readers) {
+			auto found = driver.find(it.first);
+			if (found != driver.end())
+				bit_edges.push_back(std::make_pair(found->second, it.second));
+		}
+
+		if (cluster_bus) {
+			// cells that drive bits of the same multi-bit wire
+			for (auto wire : module->selected_wires()) {
+				if (wire->width < 2 || wire->port_input)
+					continue;
+				int first = -1;
+				for (auto bit : sigmap(wire)) {
+					auto found = driver.find(bit);
+					if (found == driver.end() || node_kind[found->second] == "port")
+						continue;
+					if (first < 0)
+						first = found->second;
+					else
+						merge(first, found->second);
+				}
+			}
+		}
+
+		if (cluster_scc) {
+			NetGraph graph(GetSize(node_parent));
+			for (auto &edge : bit_edges) {
+				int from = find(edge.first), to = find(edge.second);
+				if (from != to)
+					graph.add_edge(from, to);
+			}
+			graph.build();
+			std::vector<int> component;
+			graph.scc(component);
+			dict<int, int> first_of_component;
+			for (int node = 0; node < GetSize(node_parent); node++) {
+				if (find(node) != node)
+					continue;
+				auto it = first_of_component.find(component[node]);
+				if (it == first_of_component.end())
+					first_of_component[component[node]] = node;
+				else
+					merge(it->second, node);
+			}
+		}
+
+		build_clusters(bit_edges);
+		log("Dumping %d nodes and %d edges of module %s to page %d.\n", GetSize(cluster_members),
+				GetSize(cluster_edges), log_id(module->name), ++page_counter);
+		write_graph(module->name.str(), "width");
+	}
+
+	void handle_hierarchy()
+	{
+		clear_graph();
+		dict<RTLIL::IdString, int> module_nodes;
+		for (auto module : design->selected_modules())
+			module_nodes[module->name] = add_node(module->name, stringf("%s\n%d cells", log_id(module->name), GetSize(module->cells())), "module");
+
+		std::vector<std::pair<int, int>> instances;
+		for (auto module : design->selected_modules())
+			for (auto cell : module->cells()) {
+				auto it = module_nodes.find(cell->type);
+				if (it != module_nodes.end())
+					instances.push_back(std::make_pair(module_nodes.at(module->name), it->second));
+			}
+
+		build_clusters(instances);
+		log("Dumping hierarchy of %d modules to page %d.\n", GetSize(cluster_members), ++page_counter);
+		write_graph("hierarchy", "instances");
+	}
+
+	ShowClusterWorker(FILE *f, RTLIL::Design *design, std::vector<RTLIL::Design*> &libs, bool json,
+			bool cluster_module, bool cluster_bus, bool cluster_scc) :
+			f(f), design(design), json(json), cluster_bus(cluster_bus), cluster_scc(cluster_scc)
+	{
+		ct.setup_internals();
+		ct.setup_internals_mem();
+		ct.setup_internals_anyinit();
+		ct.setup_stdcells();
+		ct.setup_stdcells_mem();
+		ct.setup_design(design);
+
+		for (auto lib : libs)
+			ct.setup_design(lib);
+
+		if (cluster_module) {
+			handle_hierarchy();
+			return;
+		}
+
+		for (auto module : design->selected_modules()) {
+			if (module->get_blackbox_attribute())
+				continue;
+			if (module->cells().size() == 0 && module->connections().empty()) {
+				log("Skipping empty module %s.\n", log_id(module->name));
+				continue;
+			}
+			handle_module(module);
+		}
+	}
+};
+
 struct ShowPass : public Pass {
 	ShowPass() : Pass("show", "generate schematics using graphviz") { }
 	void help() override
@@ -667,6 +968,22 @@ struct ShowPass : public Pass {
 		log("        Generate a graphics file in the specified format. Use 'dot' to just\n");
 		log("        generate a .dot file, or other <format> strings such as 'svg' or 'ps'\n");
 		log("        to generate files in other formats (this calls the 'dot' command).\n");
+		log("        Use 'json' to write the (possibly clustered, see -cluster) graph of\n");
+		log("        all selected modules to <prefix>.json in the JSON Lines format, one\n");
+		log("        object per line: a \"graph\" header for each module, followed by its\n");
+		log("        \"node\" and \"edge\" objects, followed by \"members\" objects with the\n");
+		log("        names of the cells in each cluster. No viewer is run by default.\n");
+		log("\n");
+		log("    -cluster <mode>\n");
+		log("        Write a reduced graph with one node per cluster of cells and one edge\n");
+		log("        per connected pair of clusters, labeled with the number of bits. This\n");
+		log("        keeps large designs within what graphviz can lay out. The modes are:\n");
+		log("            bus     cells driving bits of the same multi-bit wire\n");
+		log("            scc     strongly connected components (after bus, if both given)\n");
+		log("            module  one node per selected module, with an edge for each\n");
+		log("                    instantiated submodule labeled with the instance count\n");
+		log("        This option can be used multiple times. Options that change the\n");
+		log("        appearance of the full schematic (-color, -width, ...) are ignored.\n");
 		log("\n");
 		log("    -lib <verilog_or_rtlil_file>\n");
 		log("        Use the specified library file for determining whether cell ports are\n");
@@ -764,6 +1081,9 @@ struct ShowPass : public Pass {
 		bool flag_abbreviate = true;
 		bool flag_notitle = false;
 		bool custom_prefix = false;
+		bool cluster_module = false;
+		bool cluster_bus = false;
+		bool cluster_scc = false;
 		std::string background = "&";
 		RTLIL::IdString colorattr;
 
@@ -816,6 +1136,18 @@ struct ShowPass : public Pass {
 				format = args[++argidx];
 				continue;
 			}
+			if (arg == "-cluster" && argidx+1 < args.size()) {
+				std::string mode = args[++argidx];
+				if (mode == "module")
+					cluster_module = true;
+				else if (mode == "bus")
+					cluster_bus = true;
+				else if (mode == "scc")
+					cluster_scc = true;
+				else
+					log_cmd_error("Unknown cluster mode `%s'.\n", mode.c_str());
+				continue;
+			}
 			if (arg == "-width") {
 				flag_width= true;
 				continue;
@@ -854,7 +1186,8 @@ struct ShowPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		if (format != "ps" && format != "dot") {
+		bool clustered = format == "json" || cluster_module || cluster_bus || cluster_scc;
+		if (format != "ps" && format != "dot" && format != "json" && !cluster_module) {
 			int modcount = 0;
 			for (auto module : design->selected_modules()) {
 				if (module->get_blackbox_attribute())
@@ -882,10 +1215,10 @@ struct ShowPass : public Pass {
 		if (libs.size() > 0)
 			log_header(design, "Continuing show pass.\n");
 
-		std::string dot_file = stringf("%s.dot", prefix.c_str());
+		std::string dot_file = stringf("%s.%s", prefix.c_str(), format == "json" ? "json" : "dot");
 		std::string out_file = stringf("%s.%s", prefix.c_str(), format.empty() ? "svg" : format.c_str());
 
-		log("Writing dot description to `%s'.\n", dot_file.c_str());
+		log("Writing %s description to `%s'.\n", format == "json" ? "json" : "dot", dot_file.c_str());
 		FILE *f = fopen(dot_file.c_str(), "w");
 		if (custom_prefix)
 			yosys_output_files.insert(dot_file);
@@ -894,16 +1227,23 @@ struct ShowPass : public Pass {
 				delete lib;
 			log_cmd_error("Can't open dot file `%s' for writing.\n", dot_file.c_str());
 		}
-		ShowWorker worker(f, design, libs, colorSeed, flag_width, flag_signed, flag_stretch, flag_enum, flag_abbreviate, flag_notitle, color_selections, label_selections, colorattr);
+		int page_counter;
+		if (clustered) {
+			ShowClusterWorker worker(f, design, libs, format == "json", cluster_module, cluster_bus, cluster_scc);
+			page_counter = worker.page_counter;
+		} else {
+			ShowWorker worker(f, design, libs, colorSeed, flag_width, flag_signed, flag_stretch, flag_enum, flag_abbreviate, flag_notitle, color_selections, label_selections, colorattr);
+			page_counter = worker.page_counter;
+		}
 		fclose(f);
 
 		for (auto lib : libs)
 			delete lib;
 
-		if (worker.page_counter == 0)
+		if (page_counter == 0)
 			log_cmd_error("Nothing there to show.\n");
 
-		if (format != "dot" && !format.empty()) {
+		if (format != "dot" && format != "json" && !format.empty()) {
 			#ifdef _WIN32
 				// system()/cmd.exe does not understand single quotes on Windows.
 				#define DOT_CMD "dot -T%s \"%s\" > \"%s.new\" && move \"%s.new\" \"%s\""
@@ -21,7 +21,8 @@
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
 #include "kernel/timinginfo.h"
-#include <deque>
+#include "kernel/netgraph.h"
+#include "kernel/threading.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -30,31 +31,60 @@ struct StaWorker
 {
 	Design *design;
 	Module *module;
-	SigMap sigmap;
-
-	struct t_data {
-		Cell* driver;
-		IdString dst_port, src_port;
-		vector<tuple<SigBit,int,IdString>> fanouts;
-		SigBit backtrack;
-		t_data() : driver(nullptr) {}
+	// one node per bit, with an edge for each timing arc
+	SigBitGraph graph;
+	SigMap &sigmap;
+
+	struct t_arc {
+		int delay;
+		IdString src_port;
+	};
+	// the arc of each edge; parallel arcs are merged into the slowest one
+	std::vector<t_arc> arcs;
+	dict<std::pair<int, int>, int> arc_index;
+
+	struct t_node {
+		Cell *driver;
+		IdString dst_port;
+		bool driven, input;
+		t_node() : driver(nullptr), driven(false), input(false) {}
 	};
-	dict<SigBit, t_data> data;
-	std::deque<SigBit> queue;
+	std::vector<t_node> nodes;
+
 	struct t_endpoint {
 		Cell *sink;
 		IdString port;
 		int required;
 		t_endpoint() : sink(nullptr), required(0) {}
 	};
-	dict<SigBit, t_endpoint> endpoints;
+	dict<int, t_endpoint> endpoints;
+
+	// results of propagate(): the arrival time of each node (-1 if no path
+	// reaches it) and the node and arc it was reached through
+	std::vector<int> arrival, back_node, back_arc;
 
 	int maxarrival;
-	SigBit maxbit;
+	int maxnode;
 
-	pool<SigBit> driven;
+	int node(SigBit bit)
+	{
+		int n = graph.node(bit);
+		if (n >= GetSize(nodes))
+			nodes.resize(n+1);
+		return n;
+	}
 
-	StaWorker(RTLIL::Module *module) : design(module->design), module(module), sigmap(module), maxarrival(0)
+	void add_arc(int from, int to, int delay, IdString src_port)
+	{
+		auto r = arc_index.insert(std::make_pair(std::make_pair(from, to), GetSize(arcs)));
+		if (r.second) {
+			arcs.push_back(t_arc{delay, src_port});
+			graph.add_edge(from, to, r.first->second);
+		} else if (arcs[r.first->second].delay < delay)
+			arcs[r.first->second] = t_arc{delay, src_port};
+	}
+
+	StaWorker(RTLIL::Module *module) : design(module->design), module(module), graph(module), sigmap(graph.sigmap), maxarrival(0), maxnode(-1)
 	{
 		TimingInfo timing;
 
@@ -88,7 +118,7 @@ struct StaWorker
 			if (t.comb.empty() && t.arrival.empty() && t.required.empty())
 				continue;
 
-			pool<std::pair<SigBit,TimingInfo::NameBit>> src_bits, dst_bits;
+			pool<std::pair<int,TimingInfo::NameBit>> src_bits, dst_bits;
 
 			for (auto &conn : cell->connections()) {
 				auto rhs = sigmap(conn.second);
@@ -96,14 +126,15 @@ struct StaWorker
 					const auto &bit = rhs[i];
 					if (!bit.wire)
 						continue;
+					int n = node(bit);
 					TimingInfo::NameBit namebit(conn.first,i);
 					if (cell->input(conn.first)) {
-						src_bits.insert(std::make_pair(bit,namebit));
+						src_bits.insert(std::make_pair(n,namebit));
 
 						auto it = t.required.find(namebit);
 						if (it == t.required.end())
 							continue;
-						auto r = endpoints.insert(bit);
+						auto r = endpoints.insert(n);
 						if (r.second || r.first->second.required < it->second.first) {
 							r.first->second.sink = cell;
 							r.first->second.port = conn.first;
@@ -111,11 +142,10 @@ struct StaWorker
 						}
 					}
 					if (cell->output(conn.first)) {
-						dst_bits.insert(std::make_pair(bit,namebit));
-						auto &d = data[bit];
-						d.driver = cell;
-						d.dst_port = conn.first;
-						driven.insert(bit);
+						dst_bits.insert(std::make_pair(n,namebit));
+						nodes[n].driver = cell;
+						nodes[n].dst_port = conn.first;
+						nodes[n].driven = true;
 
 						auto it = t.arrival.find(namebit);
 						if (it == t.arrival.end())
@@ -124,7 +154,7 @@ struct StaWorker
 						if (cell->hasPort(s.name)) {
 							auto s_bit = sigmap(cell->getPort(s.name)[s.offset]);
 							if (s_bit.wire)
-								data[s_bit].fanouts.emplace_back(bit,it->second.first,s.name);
+								add_arc(node(s_bit), n, it->second.first, s.name);
 						}
 					}
 				}
@@ -135,7 +165,7 @@ struct StaWorker
 					auto it = t.comb.find(TimingInfo::BitBit(s.second,d.second));
 					if (it == t.comb.end())
 						continue;
-					data[s.first].fanouts.emplace_back(d.first,it->second,s.second.name);
+					add_arc(s.first, d.first, it->second, s.second.name);
 				}
 		}
 
@@ -143,8 +173,11 @@ struct StaWorker
 			auto wire = module->wire(port_name);
 			if (wire->port_input) {
 				for (const auto &b : sigmap(wire)) {
-					queue.emplace_back(b);
-					driven.insert(b);
+					if (!b.wire)
+						continue;
+					int n = node(b);
+					nodes[n].input = true;
+					nodes[n].driven = true;
 				}
 				// All primary inputs to arrive at time zero
 				wire->set_intvec_attribute(ID::sta_arrival, std::vector<int>(GetSize(wire), 0));
@@ -152,99 +185,180 @@ struct StaWorker
 			if (wire->port_output)
 				for (const auto &b : sigmap(wire))
 					if (b.wire)
-						endpoints.insert(b);
+						endpoints.insert(node(b));
 		}
+
+		graph.build();
 	}
 
-	void run()
+	// Computes the arrival times level by level, from the inputs towards the
+	// outputs. The nodes of a level only depend on earlier levels, so each
+	// level is processed in parallel. Arcs within combinational loops are
+	// ignored.
+	void propagate()
 	{
-		while (!queue.empty()) {
-			auto b = queue.front();
-			queue.pop_front();
-			auto it = data.find(b);
-			if (it == data.end())
-				continue;
-			const auto& src_arrivals = b.wire->get_intvec_attribute(ID::sta_arrival);
-			log_assert(GetSize(src_arrivals) == GetSize(b.wire));
-			auto src_arrival = src_arrivals[b.offset];
-			for (const auto &d : it->second.fanouts) {
-				const auto &dst_bit = std::get<0>(d);
-				auto dst_arrivals = dst_bit.wire->get_intvec_attribute(ID::sta_arrival);
-				if (dst_arrivals.empty())
-					dst_arrivals = std::vector<int>(GetSize(dst_bit.wire), -1);
-				else
-					log_assert(GetSize(dst_arrivals) == GetSize(dst_bit.wire));
-				auto &dst_arrival = dst_arrivals[dst_bit.offset];
-				auto new_arrival = src_arrival + std::get<1>(d);
-				if (dst_arrival < new_arrival) {
-					auto dst_wire = dst_bit.wire;
-					dst_arrival = std::max(dst_arrival, new_arrival);
-					dst_wire->set_intvec_attribute(ID::sta_arrival, dst_arrivals);
-					queue.emplace_back(dst_bit);
-
-					data[dst_bit].backtrack = b;
-					data[dst_bit].src_port = std::get<2>(d);
-
-					auto it = endpoints.find(dst_bit);
-					if (it != endpoints.end())
-						new_arrival += it->second.required;
-					if (new_arrival > maxarrival && driven.count(b)) {
-						maxarrival = new_arrival;
-						maxbit = dst_bit;
-					}
+		int num_nodes = graph.num_nodes();
+
+		std::vector<int> component;
+		graph.scc(component);
+		std::vector<bool> on_cycle = graph.on_cycle(component);
+		pool<int> reported;
+		for (int n = 0; n < num_nodes; n++)
+			if (on_cycle[n] && reported.insert(component[n]).second)
+				log_warning("Ignoring timing arcs within the loop at %s in %s.\n", log_signal(graph.bit(n)), log_id(module));
+
+		// the arcs into each node
+		NetGraph fanin(num_nodes);
+		for (int n = 0; n < num_nodes; n++)
+			for (int e = graph.edge_begin[n]; e < graph.edge_begin[n+1]; e++)
+				if (component[graph.edge_to[e]] != component[n])
+					fanin.add_edge(graph.edge_to[e], n, graph.edge_label[e]);
+		fanin.build();
+
+		std::vector<int> level, pred_edge;
+		int max_level = graph.longest_path(level, pred_edge);
+		std::vector<std::vector<int>> levels(max_level + 1);
+		for (int n = 0; n < num_nodes; n++)
+			levels[level[n]].push_back(n);
+
+		arrival.assign(num_nodes, -1);
+		back_node.assign(num_nodes, -1);
+		back_arc.assign(num_nodes, -1);
+
+		auto update = [&](int n) {
+			int best = nodes[n].input ? 0 : -1;
+			for (int e = fanin.edge_begin[n]; e < fanin.edge_begin[n+1]; e++) {
+				int from = fanin.edge_to[e];
+				if (arrival[from] < 0)
+					continue;
+				int new_arrival = arrival[from] + arcs[fanin.edge_label[e]].delay;
+				if (best < new_arrival) {
+					best = new_arrival;
+					back_node[n] = from;
+					back_arc[n] = fanin.edge_label[e];
 				}
 			}
+			arrival[n] = best;
+		};
+
+		const int chunk = 4096;
+		for (auto &lvl : levels) {
+			int num_jobs = (GetSize(lvl) + chunk - 1) / chunk;
+			int num_threads = yosys_thread_count(num_jobs);
+			if (num_threads > 1)
+				ThreadPool::run(num_jobs, [&](int i) {
+					int end = std::min(GetSize(lvl), (i+1) * chunk);
+					for (int k = i * chunk; k < end; k++)
+						update(lvl[k]);
+				}, num_threads);
+			else
+				for (int n : lvl)
+					update(n);
 		}
 
-		auto b = maxbit;
-		if (b == SigBit()) {
-			log("No timing paths found.\n");
-			return;
+		for (int n = 0; n < num_nodes; n++) {
+			if (back_node[n] < 0 || !nodes[back_node[n]].driven)
+				continue;
+			int total = arrival[n];
+			auto it = endpoints.find(n);
+			if (it != endpoints.end())
+				total += it->second.required;
+			if (total > maxarrival) {
+				maxarrival = total;
+				maxnode = n;
+			}
 		}
 
-		log("Latest arrival time in '%s' is %d:\n", log_id(module), maxarrival);
-		auto it = endpoints.find(maxbit);
+		// the arrival times are also stored as (* sta_arrival *) attributes
+		dict<Wire*, std::vector<int>> wire_arrivals;
+		for (int n = 0; n < num_nodes; n++) {
+			SigBit b = graph.bit(n);
+			if (arrival[n] < 0 || nodes[n].input)
+				continue;
+			auto &arrivals = wire_arrivals[b.wire];
+			if (arrivals.empty())
+				arrivals = std::vector<int>(GetSize(b.wire), -1);
+			arrivals[b.offset] = arrival[n];
+		}
+		for (auto &it : wire_arrivals)
+			it.first->set_intvec_attribute(ID::sta_arrival, it.second);
+	}
+
+	void log_endpoint(int n, int total)
+	{
+		SigBit b = graph.bit(n);
+		auto it = endpoints.find(n);
 		if (it != endpoints.end() && it->second.sink)
-			log("  %6d %s (%s.%s)\n", maxarrival, log_id(it->second.sink), log_id(it->second.sink->type), log_id(it->second.port));
+			log("  %6d %s (%s.%s)\n", total, log_id(it->second.sink), log_id(it->second.sink->type), log_id(it->second.port));
 		else {
-			log("  %6d (%s)\n", maxarrival, b.wire->port_output ? "<primary output>" : "<unknown>");
+			log("  %6d (%s)\n", total, b.wire->port_output ? "<primary output>" : "<unknown>");
 			if (!b.wire->port_output)
 				log_warning("Critical-path does not terminate in a recognised endpoint.\n");
 		}
-		auto jt = data.find(b);
-		while (jt != data.end()) {
-			int arrival = b.wire->get_intvec_attribute(ID::sta_arrival)[b.offset];
-			if (jt->second.driver) {
+	}
+
+	void log_path(int n)
+	{
+		while (n >= 0) {
+			SigBit b = graph.bit(n);
+			if (nodes[n].driver && back_arc[n] >= 0) {
 				log("           %s\n", log_signal(b));
-				log("  %6d %s (%s.%s->%s)\n", arrival, log_id(jt->second.driver), log_id(jt->second.driver->type), log_id(jt->second.src_port), log_id(jt->second.dst_port));
+				log("  %6d %s (%s.%s->%s)\n", arrival[n], log_id(nodes[n].driver), log_id(nodes[n].driver->type),
+						log_id(arcs[back_arc[n]].src_port), log_id(nodes[n].dst_port));
 			}
 			else if (b.wire->port_input)
-				log("  %6d   %s (%s)\n", arrival, log_signal(b), "<primary input>");
+				log("  %6d   %s (%s)\n", arrival[n], log_signal(b), "<primary input>");
 			else
 				log_abort();
-			b = jt->second.backtrack;
-			jt = data.find(b);
+			n = back_node[n];
+		}
+	}
+
+	void run(int top_paths)
+	{
+		propagate();
+
+		if (maxnode < 0) {
+			log("No timing paths found.\n");
+			return;
 		}
 
+		log("Latest arrival time in '%s' is %d:\n", log_id(module), maxarrival);
+		log_endpoint(maxnode, maxarrival);
+		log_path(maxnode);
+
+		std::vector<std::pair<int, int>> endpoint_arrivals;
 		std::map<int, unsigned> arrival_histogram;
 		for (const auto &i : endpoints) {
-			const auto &b = i.first;
-			if (!driven.count(b))
+			int n = i.first;
+			if (!nodes[n].driven)
 				continue;
 
-			if (!b.wire->attributes.count(ID::sta_arrival)) {
-				log_warning("Endpoint %s.%s has no (* sta_arrival *) value.\n", log_id(module), log_signal(b));
+			if (arrival[n] < 0) {
+				log_warning("Endpoint %s.%s has no (* sta_arrival *) value.\n", log_id(module), log_signal(graph.bit(n)));
 				continue;
 			}
+			int total = arrival[n] + i.second.required;
+			arrival_histogram[total]++;
+			endpoint_arrivals.push_back(std::make_pair(total, n));
+		}
 
-			auto arrival = b.wire->get_intvec_attribute(ID::sta_arrival)[b.offset];
-			if (arrival < 0) {
-				log_warning("Endpoint %s.%s has no (* sta_arrival *) value.\n", log_id(module), log_signal(b));
-				continue;
+		if (top_paths > 0) {
+			int count = std::min(top_paths, GetSize(endpoint_arrivals));
+			std::partial_sort(endpoint_arrivals.begin(), endpoint_arrivals.begin() + count, endpoint_arrivals.end(),
+					[](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+						return a.first != b.first ? a.first > b.first : a.second < b.second;
+					});
+			log("\n");
+			log("Top %d endpoints in '%s':\n", count, log_id(module));
+			for (int i = 0; i < count; i++) {
+				log("\n");
+				log("Path %d:\n", i+1);
+				log_endpoint(endpoint_arrivals[i].second, endpoint_arrivals[i].first);
+				log_path(endpoint_arrivals[i].second);
 			}
-			arrival += i.second.required;
-			arrival_histogram[arrival]++;
 		}
+
 		// Adapted from https://github.com/YosysHQ/nextpnr/blob/affb12cc27ebf409eade062c4c59bb98569d8147/common/timing.cc#L946-L969
 		if (arrival_histogram.size() > 0) {
 			unsigned num_bins = 20;
@@ -284,22 +398,29 @@ struct StaPass : public Pass {
 		log("This command performs static timing analysis on the design. (Only considers\n");
 		log("paths within a single module, so the design must be flattened.)\n");
 		log("\n");
+		log("The arrival times are propagated level by level, using up to the number of\n");
+		log("threads set with 'yosys -j'. Timing arcs within combinational loops are\n");
+		log("ignored.\n");
+		log("\n");
+		log("    -top <K>\n");
+		log("        also print the paths to the K endpoints with the latest arrival times\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		log_header(design, "Executing STA pass (static timing analysis).\n");
 
-		/*
+		int top_paths = 0;
+
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
-			if (args[argidx] == "-TODO") {
+			if (args[argidx] == "-top" && argidx+1 < args.size()) {
+				top_paths = atoi(args[++argidx].c_str());
 				continue;
 			}
 			break;
 		}
-		*/
-
-		extra_args(args, 1, design);
+		extra_args(args, argidx, design);
 
 		for (Module *module : design->selected_modules())
 		{
@@ -307,7 +428,7 @@ struct StaPass : public Pass {
 				continue;
 
 			StaWorker worker(module);
-			worker.run();
+			worker.run(top_paths);
 		}
 	}
 } StaPass;
@@ -18,6 +18,7 @@
  */
 
 #include <iterator>
+#include <fstream>
 
 #include "kernel/yosys.h"
 #include "kernel/celltypes.h"
@@ -100,47 +101,10 @@ struct statdata_t
 			num_memory_bits += it.second->width * it.second->size;
 		}
 
+		dict<RTLIL::IdString, unsigned int> counts;
 		for (auto cell : mod->selected_cells())
-		{
-			RTLIL::IdString cell_type = cell->type;
-
-			if (width_mode)
-			{
-				if (cell_type.in(ID($not), ID($pos), ID($neg),
-						ID($logic_not), ID($logic_and), ID($logic_or),
-						ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
-						ID($lut), ID($and), ID($or), ID($xor), ID($xnor),
-						ID($shl), ID($shr), ID($sshl), ID($sshr), ID($shift), ID($shiftx),
-						ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
-						ID($add), ID($sub), ID($mul), ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow), ID($alu))) {
-					int width_a = cell->hasPort(ID::A) ? GetSize(cell->getPort(ID::A)) : 0;
-					int width_b = cell->hasPort(ID::B) ? GetSize(cell->getPort(ID::B)) : 0;
-					int width_y = cell->hasPort(ID::Y) ? GetSize(cell->getPort(ID::Y)) : 0;
-					cell_type = stringf("%s_%d", cell_type.c_str(), max<int>({width_a, width_b, width_y}));
-				}
-				else if (cell_type.in(ID($mux), ID($pmux)))
-					cell_type = stringf("%s_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Y)));
-				else if (cell_type == ID($bmux))
-					cell_type = stringf("%s_%d_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Y)), GetSize(cell->getPort(ID::S)));
-				else if (cell_type == ID($demux))
-					cell_type = stringf("%s_%d_%d", cell_type.c_str(), GetSize(cell->getPort(ID::A)), GetSize(cell->getPort(ID::S)));
-				else if (cell_type.in(
-						ID($sr), ID($ff), ID($dff), ID($dffe), ID($dffsr), ID($dffsre),
-						ID($adff), ID($adffe), ID($sdff), ID($sdffe), ID($sdffce),
-						ID($aldff), ID($aldffe), ID($dlatch), ID($adlatch), ID($dlatchsr)))
-					cell_type = stringf("%s_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Q)));
-			}
-
-			if (!cell_area.empty()) {
-				if (cell_area.count(cell_type))
-					area += cell_area.at(cell_type);
-				else
-					unknown_cell_area.insert(cell_type);
-			}
-
-			num_cells++;
-			num_cells_by_type[cell_type]++;
-		}
+			add_cell(cell, counts, width_mode, cell_area);
+		num_cells_by_type.insert(counts.begin(), counts.end());
 
 		for (auto &it : mod->processes) {
 			if (!design->selected(mod, it.second))
@@ -149,6 +113,48 @@ struct statdata_t
 		}
 	}
 
+	void add_cell(RTLIL::Cell *cell, dict<RTLIL::IdString, unsigned int> &counts, bool width_mode, const dict<IdString, double> &cell_area)
+	{
+		RTLIL::IdString cell_type = cell->type;
+
+		if (width_mode)
+		{
+			if (cell_type.in(ID($not), ID($pos), ID($neg),
+					ID($logic_not), ID($logic_and), ID($logic_or),
+					ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+					ID($lut), ID($and), ID($or), ID($xor), ID($xnor),
+					ID($shl), ID($shr), ID($sshl), ID($sshr), ID($shift), ID($shiftx),
+					ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
+					ID($add), ID($sub), ID($mul), ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow), ID($alu))) {
+				int width_a = cell->hasPort(ID::A) ? GetSize(cell->getPort(ID::A)) : 0;
+				int width_b = cell->hasPort(ID::B) ? GetSize(cell->getPort(ID::B)) : 0;
+				int width_y = cell->hasPort(ID::Y) ? GetSize(cell->getPort(ID::Y)) : 0;
+				cell_type = stringf("%s_%d", cell_type.c_str(), max<int>({width_a, width_b, width_y}));
+			}
+			else if (cell_type.in(ID($mux), ID($pmux)))
+				cell_type = stringf("%s_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Y)));
+			else if (cell_type == ID($bmux))
+				cell_type = stringf("%s_%d_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Y)), GetSize(cell->getPort(ID::S)));
+			else if (cell_type == ID($demux))
+				cell_type = stringf("%s_%d_%d", cell_type.c_str(), GetSize(cell->getPort(ID::A)), GetSize(cell->getPort(ID::S)));
+			else if (cell_type.in(
+					ID($sr), ID($ff), ID($dff), ID($dffe), ID($dffsr), ID($dffsre),
+					ID($adff), ID($adffe), ID($sdff), ID($sdffe), ID($sdffce),
+					ID($aldff), ID($aldffe), ID($dlatch), ID($adlatch), ID($dlatchsr)))
+				cell_type = stringf("%s_%d", cell_type.c_str(), GetSize(cell->getPort(ID::Q)));
+		}
+
+		if (!cell_area.empty()) {
+			if (cell_area.count(cell_type))
+				area += cell_area.at(cell_type);
+			else
+				unknown_cell_area.insert(cell_type);
+		}
+
+		num_cells++;
+		counts[cell_type]++;
+	}
+
 	unsigned int estimate_xilinx_lc()
 	{
 		unsigned int lut6_cnt = num_cells_by_type[ID(LUT6)];
@@ -262,6 +268,29 @@ struct statdata_t
 		}
 	}
 
+	json11::Json to_json()
+	{
+		json11::Json::object obj;
+	#define X(_name) obj[#_name] = int(_name);
+		STAT_INT_MEMBERS
+	#undef X
+		if (area != 0)
+			obj["area"] = area;
+		json11::Json::object by_type;
+		for (auto &it : num_cells_by_type)
+			if (it.second)
+				by_type[log_id(it.first)] = int(it.second);
+		obj["num_cells_by_type"] = by_type;
+		if (tech == "xilinx")
+			obj["estimated_num_lc"] = int(estimate_xilinx_lc());
+		if (tech == "cmos") {
+			bool tran_cnt_exact = true;
+			unsigned int tran_cnt = cmos_transistor_count(&tran_cnt_exact);
+			obj["estimated_num_transistors"] = stringf("%u%s", tran_cnt, tran_cnt_exact ? "" : "+");
+		}
+		return obj;
+	}
+
 	void log_data_json(const char *mod_name, bool first_module)
 	{
 		if (!first_module)
@@ -306,36 +335,46 @@ struct statdata_t
 	}
 };
 
-statdata_t hierarchy_worker(std::map<RTLIL::IdString, statdata_t> &mod_stat, RTLIL::IdString mod, int level, bool quiet = false)
+// The totals of a module including all submodules. Each module is only
+// rolled up once, however often it is instantiated.
+const statdata_t &hierarchy_rollup(std::map<RTLIL::IdString, statdata_t> &mod_stat, std::map<RTLIL::IdString, statdata_t> &memo, RTLIL::IdString mod)
 {
+	auto it = memo.find(mod);
+	if (it != memo.end())
+		return it->second;
+
 	statdata_t mod_data = mod_stat.at(mod);
 	std::map<RTLIL::IdString, unsigned int, RTLIL::sort_by_id_str> num_cells_by_type;
 	num_cells_by_type.swap(mod_data.num_cells_by_type);
 
 	for (auto &it : num_cells_by_type)
 		if (mod_stat.count(it.first) > 0) {
-			if (!quiet)
-				log("     %*s%-*s %6u\n", 2*level, "", 26-2*level, log_id(it.first), it.second);
-			mod_data = mod_data + hierarchy_worker(mod_stat, it.first, level+1, quiet) * it.second;
+			mod_data = mod_data + hierarchy_rollup(mod_stat, memo, it.first) * it.second;
 			mod_data.num_cells -= it.second;
 		} else {
 			mod_data.num_cells_by_type[it.first] += it.second;
 		}
 
-	return mod_data;
+	return memo[mod] = mod_data;
+}
+
+void log_hierarchy(std::map<RTLIL::IdString, statdata_t> &mod_stat, RTLIL::IdString mod, int level)
+{
+	for (auto &it : mod_stat.at(mod).num_cells_by_type)
+		if (mod_stat.count(it.first) > 0) {
+			log("     %*s%-*s %6u\n", 2*level, "", 26-2*level, log_id(it.first), it.second);
+			log_hierarchy(mod_stat, it.first, level+1);
+		}
 }
 
 void read_liberty_cellarea(dict<IdString, double> &cell_area, string liberty_file)
 {
-	std::ifstream f;
-	f.open(liberty_file.c_str());
 	yosys_input_files.insert(liberty_file);
-	if (f.fail())
+	std::shared_ptr<const LibertyAst> ast = liberty_parse_file(liberty_file, liberty_timing_groups);
+	if (ast == nullptr)
 		log_cmd_error("Can't open liberty file `%s': %s\n", liberty_file.c_str(), strerror(errno));
-	LibertyParser libparser(f);
-	f.close();
 
-	for (auto cell : libparser.ast->children)
+	for (auto cell : ast->children)
 	{
 		if (cell->id != "cell" || cell->args.size() != 1)
 			continue;
@@ -377,6 +416,21 @@ struct StatPass : public Pass {
 		log("        output the statistics in a machine-readable JSON format.\n");
 		log("        this is output to the console; use \"tee\" to output to a file.\n");
 		log("\n");
+		log("    -jsonl <file>\n");
+		log("        append one line of JSON to the file with the statistics of the selected\n");
+		log("        modules and, if a top module is known, of the whole design, in addition\n");
+		log("        to the normal output. Calling 'stat -jsonl' between the steps of a\n");
+		log("        script gives a stream of statistics for tracking the design. Each line\n");
+		log("        has a \"step\" field counting the stat calls writing such lines.\n");
+		log("\n");
+	}
+	bool result_cacheable(const std::vector<std::string> &args) const override
+	{
+		// the liberty files may change between calls, -jsonl writes a file
+		for (auto &arg : args)
+			if (arg == "-liberty" || arg == "-jsonl")
+				return false;
+		return true;
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -384,7 +438,7 @@ struct StatPass : public Pass {
 		RTLIL::Module *top_mod = nullptr;
 		std::map<RTLIL::IdString, statdata_t> mod_stat;
 		dict<IdString, double> cell_area;
-		string techname;
+		string techname, jsonl_file;
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++)
@@ -413,6 +467,11 @@ struct StatPass : public Pass {
 				json_mode = true;
 				continue;
 			}
+			if (args[argidx] == "-jsonl" && argidx+1 < args.size()) {
+				jsonl_file = args[++argidx];
+				rewrite_filename(jsonl_file);
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
@@ -432,6 +491,8 @@ struct StatPass : public Pass {
 			log("   \"modules\": {\n");
 		}
 
+		json11::Json::object jsonl_modules;
+
 		bool first_module = true;
 		for (auto mod : design->selected_modules())
 		{
@@ -442,6 +503,9 @@ struct StatPass : public Pass {
 			statdata_t data(design, mod, width_mode, cell_area, techname);
 			mod_stat[mod->name] = data;
 
+			if (!jsonl_file.empty())
+				jsonl_modules[mod->name.str()] = data.to_json();
+
 			if (json_mode) {
 				data.log_data_json(mod->name.c_str(), first_module);
 				first_module = false;
@@ -458,6 +522,9 @@ struct StatPass : public Pass {
 			log(top_mod == nullptr ? "   }\n" : "   },\n");
 		}
 
+		json11::Json::object jsonl;
+		jsonl["modules"] = jsonl_modules;
+
 		if (top_mod != nullptr)
 		{
 			if (!json_mode && GetSize(mod_stat) > 1) {
@@ -465,9 +532,16 @@ struct StatPass : public Pass {
 				log("=== design hierarchy ===\n");
 				log("\n");
 				log("   %-28s %6d\n", log_id(top_mod->name), 1);
+				log_hierarchy(mod_stat, top_mod->name, 0);
 			}
 
-			statdata_t data = hierarchy_worker(mod_stat, top_mod->name, 0, /*quiet=*/json_mode);
+			std::map<RTLIL::IdString, statdata_t> memo;
+			statdata_t data = hierarchy_rollup(mod_stat, memo, top_mod->name);
+
+			if (!jsonl_file.empty()) {
+				jsonl["top"] = top_mod->name.str();
+				jsonl["design"] = data.to_json();
+			}
 
 			if (json_mode)
 				data.log_data_json("design", true);
@@ -492,6 +566,19 @@ struct StatPass : public Pass {
 			log("}\n");
 		}
 
+		if (!jsonl_file.empty()) {
+			static int jsonl_step = 0;
+			std::stringstream invocation;
+			std::copy(args.begin(), args.end(), std::ostream_iterator<std::string>(invocation, " "));
+			jsonl["step"] = jsonl_step++;
+			jsonl["invocation"] = invocation.str();
+
+			std::ofstream f(jsonl_file.c_str(), std::ofstream::app);
+			if (f.fail())
+				log_cmd_error("Can't open file `%s' for writing: %s\n", jsonl_file.c_str(), strerror(errno));
+			f << json11::Json(jsonl).dump() << "\n";
+		}
+
 		log("\n");
 	}
 } StatPass;
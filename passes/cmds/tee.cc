@@ -100,6 +100,7 @@ struct TeePass : public Pass {
 			std::vector<std::string> new_args(args.begin() + argidx, args.end());
 			Pass::call(design, new_args);
 		} catch (...) {
+			log_flush();
 			for (auto cf : files_to_close)
 				fclose(cf);
 			log_files = backup_log_files;
@@ -108,6 +109,7 @@ struct TeePass : public Pass {
 			throw;
 		}
 
+		log_flush();
 		for (auto cf : files_to_close)
 			fclose(cf);
 
@@ -20,11 +20,11 @@
 #include "kernel/celltypes.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
-#include "kernel/modtools.h"
+#include "kernel/netgraph.h"
 #include "kernel/sigtools.h"
 #include "kernel/utils.h"
 #include "kernel/yosys.h"
-#include <deque>
+#include <queue>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -84,28 +84,100 @@ struct XpropWorker
 
 	Module *module;
 	XpropOptions options;
-	ModWalker modwalker;
-	SigMap &sigmap;
+	SigMap sigmap;
 	FfInitVals initvals;
 
-	pool<SigBit> maybe_x_bits;
-	dict<SigBit, EncodedBit> encoded_bits;
+	// The maybe-x flags of the bits of the module's wires, indexed by their
+	// FlatSigMap id, so that the flags of a whole chunk are tested and
+	// gathered word by word. All bits of a sigmap class share one flag: the
+	// members of each class are chained in class_next, starting at the
+	// representative, or at const_first for the bits tied to a constant.
+	// Modules without any x sources don't get these, nothing is maybe-x.
+	FlatSigMap flatmap;
+	std::vector<uint64_t> x_words;
+	std::vector<int> class_next, const_first;
+	std::vector<bool> const_x;
+
+	// The cells and the bits they read and drive, with node n < num_bits for
+	// the bit with FlatSigMap id n and num_bits + i for cells[i]. The cells
+	// are propagated in the order of their level, so that most of them are
+	// processed only once, after all of their inputs are known.
+	NetGraph graph;
+	int num_bits = 0;
+	std::vector<Cell *> cells;
+	std::vector<int> cell_level;
+	std::vector<bool> pending;
+	std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> pending_queue;
 
-	pool<Cell *> pending_cells;
-	std::deque<Cell *> pending_cell_queue;
+	dict<SigBit, EncodedBit> encoded_bits;
 
 	XpropWorker(Module *module, XpropOptions options) :
-		module(module), options(options),
-		modwalker(module->design), sigmap(modwalker.sigmap)
+		module(module), options(options), sigmap(module)
 	{
-		modwalker.setup(module);
-		initvals.set(&modwalker.sigmap, module);
+		initvals.set(&sigmap, module);
+
+		const_x.assign(int(State::Sm) + 1, false);
+		const_x[State::Sx] = true;
 
-		maybe_x_bits.insert(State::Sx);
+		if (!has_x_sources()) {
+			log_debug("No x sources in module %s.\n", log_id(module));
+			return;
+		}
+
+		flatmap.set(sigmap, module);
+		num_bits = flatmap.num_bits();
+		x_words.assign((num_bits + 63) / 64, 0);
+		class_next.assign(num_bits, -1);
+		const_first.assign(int(State::Sm) + 1, -1);
+
+		for (auto wire : module->wires())
+			for (int i = 0; i < GetSize(wire); i++) {
+				SigBit bit(wire, i);
+				int id = flatmap.id(bit);
+				SigBit rep = flatmap(bit);
+				if (rep.wire == nullptr) {
+					class_next[id] = const_first[rep.data];
+					const_first[rep.data] = id;
+					if (const_x[rep.data])
+						set_x(id);
+				} else if (rep != bit) {
+					int rep_id = flatmap.id(rep);
+					class_next[id] = class_next[rep_id];
+					class_next[rep_id] = id;
+				}
+			}
 
 		for (auto cell : module->cells()) {
-			pending_cells.insert(cell);
-			pending_cell_queue.push_back(cell);
+			int node = num_bits + GetSize(cells);
+			cells.push_back(cell);
+			bool known = cell->known();
+			// cut the paths at FFs, so that they don't form loops
+			bool is_ff = RTLIL::builtin_ff_cell_types().count(cell->type) || cell->type == ID($anyinit);
+			for (auto &conn : cell->connections()) {
+				bool is_input = !known || cell->input(conn.first);
+				bool is_output = !known || cell->output(conn.first);
+				for (auto bit : flatmap(conn.second)) {
+					int id = flatmap.id(bit);
+					if (id < 0)
+						continue;
+					if (is_input)
+						graph.add_edge(id, node);
+					if (is_output && !is_ff)
+						graph.add_edge(node, id);
+				}
+			}
+		}
+		while (graph.num_nodes() < num_bits + GetSize(cells))
+			graph.add_node();
+		graph.build();
+
+		std::vector<int> level, pred_edge;
+		graph.longest_path(level, pred_edge);
+
+		pending.assign(GetSize(cells), true);
+		for (int i = 0; i < GetSize(cells); i++) {
+			cell_level.push_back(level[num_bits + i]);
+			pending_queue.emplace(cell_level[i], i);
 		}
 
 		if (!options.assume_def_inputs) {
@@ -117,18 +189,150 @@ struct XpropWorker
 		}
 	}
 
+	// Whether any bit of the module may be x without x values on the
+	// inputs of its cells, i.e. if anything would be marked at all.
+	bool has_x_sources()
+	{
+		if (!options.assume_def_inputs)
+			for (auto port : module->ports)
+				if (module->wire(port)->port_input)
+					return true;
+
+		for (auto &conn : module->connections())
+			if (has_x_const(conn.second))
+				return true;
+
+		for (auto cell : module->cells()) {
+			for (auto &conn : cell->connections())
+				if (has_x_const(conn.second))
+					return true;
+			if (cell_creates_x(cell))
+				return true;
+		}
+
+		return false;
+	}
+
+	static bool has_x_const(const SigSpec &sig)
+	{
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire == nullptr)
+				for (auto state : chunk.data)
+					if (state == State::Sx)
+						return true;
+		return false;
+	}
+
+	// Whether mark_maybe_x(cell) may mark outputs of a cell without any
+	// maybe-x inputs.
+	bool cell_creates_x(Cell *cell)
+	{
+		if (cell->type.in(ID($bweqx), ID($eqx), ID($nex), ID($initstate), ID($assert), ID($assume), ID($cover), ID($anyseq), ID($anyconst)))
+			return false;
+
+		if (RTLIL::builtin_ff_cell_types().count(cell->type) || cell->type == ID($anyinit)) {
+			FfData ff(&initvals, cell);
+			if (cell->type != ID($anyinit))
+				for (int i = 0; i < ff.width; i++)
+					if (ff.val_init[i] == State::Sx)
+						return true;
+			// the other FFs are handled as unhandled cells
+			return !((ff.has_clk || ff.has_gclk) && !ff.has_ce && !ff.has_aload && !ff.has_srst && !ff.has_arst && !ff.has_sr);
+		}
+
+		return !cell->type.in(
+			ID($not), ID($and), ID($or), ID($xor), ID($xnor), ID($bwmux),
+			ID($_MUX_), ID($mux), ID($bmux), ID($demux),
+			ID($shl), ID($shr), ID($sshl), ID($sshr), ID($shift),
+			ID($add), ID($sub), ID($mul), ID($neg),
+			ID($le), ID($lt), ID($ge), ID($gt),
+			ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor),
+			ID($reduce_bool), ID($logic_not), ID($logic_or), ID($logic_and),
+			ID($eq), ID($ne),
+			ID($_NOT_), ID($_AND_), ID($_NAND_), ID($_ANDNOT_), ID($_OR_), ID($_NOR_), ID($_ORNOT_), ID($_XOR_), ID($_XNOR_));
+	}
+
+	bool get_x(int id) const { return (x_words[id / 64] >> (id % 64)) & 1; }
+	void set_x(int id) { x_words[id / 64] |= uint64_t(1) << (id % 64); }
+
+	// Whether any of the width bits starting at id is maybe-x.
+	bool any_x(int id, int width) const
+	{
+		while (width > 0) {
+			int shift = id % 64;
+			int n = std::min(width, 64 - shift);
+			uint64_t mask = n == 64 ? ~uint64_t(0) : ((uint64_t(1) << n) - 1) << shift;
+			if (x_words[id / 64] & mask)
+				return true;
+			id += n;
+			width -= n;
+		}
+		return false;
+	}
+
 	bool maybe_x(SigBit bit)
 	{
-		return maybe_x_bits.count(sigmap(bit));
+		if (bit.wire == nullptr)
+			return const_x[bit.data];
+		int id = flatmap.id(bit);
+		return id >= 0 && get_x(id);
 	}
 
 	bool maybe_x(const SigSpec &sig)
 	{
-		for (auto bit : sig)
-			if (maybe_x(bit)) return true;
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire == nullptr) {
+				for (auto state : chunk.data)
+					if (const_x[state])
+						return true;
+				continue;
+			}
+			int id = flatmap.id(SigBit(chunk.wire, chunk.offset));
+			if (id >= 0 && any_x(id, chunk.width))
+				return true;
+		}
 		return false;
 	}
 
+	// The maybe-x flags of the bits of sig, packed into words.
+	std::vector<uint64_t> x_mask(const SigSpec &sig)
+	{
+		std::vector<uint64_t> mask((GetSize(sig) + 63) / 64);
+		int pos = 0;
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire == nullptr) {
+				for (int i = 0; i < chunk.width; i++)
+					if (const_x[chunk.data[i]])
+						mask[(pos + i) / 64] |= uint64_t(1) << ((pos + i) % 64);
+				pos += chunk.width;
+				continue;
+			}
+			int id = flatmap.id(SigBit(chunk.wire, chunk.offset));
+			for (int i = 0; id >= 0 && i < chunk.width;) {
+				// copy the flags up to the end of the source word at once
+				int src = id + i, dst = pos + i;
+				int n = std::min(64 - src % 64, chunk.width - i);
+				uint64_t bits = x_words[src / 64] >> (src % 64);
+				if (n < 64)
+					bits &= (uint64_t(1) << n) - 1;
+				if (bits) {
+					mask[dst / 64] |= bits << (dst % 64);
+					if (dst % 64 + n > 64)
+						mask[dst / 64 + 1] |= bits >> (64 - dst % 64);
+				}
+				i += n;
+			}
+			pos += chunk.width;
+		}
+		return mask;
+	}
+
+	static void or_mask(std::vector<uint64_t> &mask, const std::vector<uint64_t> &other)
+	{
+		for (int i = 0; i < GetSize(mask) && i < GetSize(other); i++)
+			mask[i] |= other[i];
+	}
+
 	bool ports_maybe_x(Cell *cell)
 	{
 		for (auto &conn : cell->connections())
@@ -147,15 +351,32 @@ struct XpropWorker
 
 	void mark_maybe_x(SigBit bit)
 	{
-		sigmap.apply(bit);
-		if (!maybe_x_bits.insert(bit).second)
+		bit = flatmap(bit);
+
+		if (bit.wire == nullptr) {
+			// bits tied to constants have no consumers in the graph
+			if (const_x[bit.data])
+				return;
+			const_x[bit.data] = true;
+			for (int id = const_first[bit.data]; id >= 0; id = class_next[id])
+				set_x(id);
 			return;
-		auto it = modwalker.signal_consumers.find(bit);
-		if (it == modwalker.signal_consumers.end())
+		}
+
+		int rep_id = flatmap.id(bit);
+		log_assert(rep_id >= 0);
+		if (get_x(rep_id))
 			return;
-		for (auto &consumer : it->second)
-			if (pending_cells.insert(consumer.cell).second)
-				pending_cell_queue.push_back(consumer.cell);
+		for (int id = rep_id; id >= 0; id = class_next[id])
+			set_x(id);
+
+		for (int e = graph.edge_begin[rep_id]; e < graph.edge_begin[rep_id + 1]; e++) {
+			int i = graph.edge_to[e] - num_bits;
+			if (!pending[i]) {
+				pending[i] = true;
+				pending_queue.emplace(cell_level[i], i);
+			}
+		}
 	}
 
 	void mark_maybe_x(const SigSpec &sig)
@@ -164,6 +385,16 @@ struct XpropWorker
 			mark_maybe_x(bit);
 	}
 
+	// Marks the bits of sig that are set in mask.
+	void mark_maybe_x(const SigSpec &sig, const std::vector<uint64_t> &mask)
+	{
+		for (int w = 0; w < GetSize(mask); w++)
+			if (mask[w] != 0)
+				for (int i = 0; i < 64; i++)
+					if (((mask[w] >> i) & 1) && 64 * w + i < GetSize(sig))
+						mark_maybe_x(sig[64 * w + i]);
+	}
+
 	void mark_outputs_maybe_x(Cell *cell)
 	{
 		for (auto &conn : cell->connections())
@@ -283,12 +514,14 @@ struct XpropWorker
 
 	void mark_all_maybe_x()
 	{
-		while (!pending_cell_queue.empty()) {
-			Cell *cell = pending_cell_queue.front();
-			pending_cell_queue.pop_front();
-			pending_cells.erase(cell);
+		while (!pending_queue.empty()) {
+			int i = pending_queue.top().second;
+			pending_queue.pop();
+			if (!pending[i])
+				continue;
+			pending[i] = false;
 
-			mark_maybe_x(cell);
+			mark_maybe_x(cells[i]);
 		}
 	}
 
@@ -309,9 +542,7 @@ struct XpropWorker
 					if (ff.val_init[i] == State::Sx)
 						mark_maybe_x(ff.sig_q[i]);
 
-			for (int i = 0; i < ff.width; i++)
-				if (maybe_x(ff.sig_d[i]))
-					mark_maybe_x(ff.sig_q[i]);
+			mark_maybe_x(ff.sig_q, x_mask(ff.sig_d));
 
 			if ((ff.has_clk || ff.has_gclk) && !ff.has_ce && !ff.has_aload && !ff.has_srst && !ff.has_arst && !ff.has_sr)
 				return;
@@ -320,9 +551,7 @@ struct XpropWorker
 		if (cell->type == ID($not)) {
 			auto &sig_y = cell->getPort(ID::Y);
 			auto sig_a = cell->getPort(ID::A); sig_a.extend_u0(GetSize(sig_y), cell->getParam(ID::A_SIGNED).as_bool());
-			for (int i = 0; i < GetSize(sig_y); i++)
-				if (maybe_x(sig_a[i]))
-					mark_maybe_x(sig_y[i]);
+			mark_maybe_x(sig_y, x_mask(sig_a));
 			return;
 		}
 
@@ -330,9 +559,9 @@ struct XpropWorker
 			auto &sig_y = cell->getPort(ID::Y);
 			auto sig_a = cell->getPort(ID::A); sig_a.extend_u0(GetSize(sig_y), cell->getParam(ID::A_SIGNED).as_bool());
 			auto sig_b = cell->getPort(ID::B); sig_b.extend_u0(GetSize(sig_y), cell->getParam(ID::B_SIGNED).as_bool());
-			for (int i = 0; i < GetSize(sig_y); i++)
-				if (maybe_x(sig_a[i]) || maybe_x(sig_b[i]))
-					mark_maybe_x(sig_y[i]);
+			auto mask = x_mask(sig_a);
+			or_mask(mask, x_mask(sig_b));
+			mark_maybe_x(sig_y, mask);
 			return;
 		}
 
@@ -341,9 +570,10 @@ struct XpropWorker
 			auto &sig_a = cell->getPort(ID::A);
 			auto &sig_b = cell->getPort(ID::B);
 			auto &sig_s = cell->getPort(ID::S);
-			for (int i = 0; i < GetSize(sig_y); i++)
-				if (maybe_x(sig_a[i]) || maybe_x(sig_b[i]) || maybe_x(sig_s[i]))
-					mark_maybe_x(sig_y[i]);
+			auto mask = x_mask(sig_a);
+			or_mask(mask, x_mask(sig_b));
+			or_mask(mask, x_mask(sig_s));
+			mark_maybe_x(sig_y, mask);
 			return;
 		}
 
@@ -356,18 +586,12 @@ struct XpropWorker
 				mark_maybe_x(sig_y);
 				return;
 			}
-			for (int i = 0; i < GetSize(sig_y); i++) {
-				if (maybe_x(sig_a[i])) {
-					mark_maybe_x(sig_y[i]);
-					continue;
-				}
-				for (int j = i; j < GetSize(sig_b); j += GetSize(sig_y)) {
-					if (maybe_x(sig_b[j])) {
-						mark_maybe_x(sig_y[i]);
-						break;
-					}
-				}
-			}
+			// each bit of y is maybe-x if the bit of a or of any slice of b is
+			int width = GetSize(sig_y);
+			auto mask = x_mask(sig_a.extract(0, std::min(width, GetSize(sig_a))));
+			for (int j = 0; width > 0 && j < GetSize(sig_b); j += width)
+				or_mask(mask, x_mask(sig_b.extract(j, std::min(width, GetSize(sig_b) - j))));
+			mark_maybe_x(sig_y, mask);
 			return;
 		}
 
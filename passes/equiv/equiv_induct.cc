@@ -20,6 +20,7 @@
 #include "kernel/yosys.h"
 #include "kernel/satgen.h"
 #include "kernel/sigtools.h"
+#include "passes/equiv/equiv_sim.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -37,14 +38,16 @@ struct EquivInductWorker
 
 	int max_seq;
 	int success_counter;
+	bool use_sim;
 
 	dict<int, int> ez_step_is_consistent;
 	pool<Cell*> cell_warn_cache;
 	SigPool undriven_signals;
+	pool<Cell*> sim_disproven;
 
-	EquivInductWorker(Module *module, const pool<Cell*> &unproven_equiv_cells, bool model_undef, int max_seq) : module(module), sigmap(module),
+	EquivInductWorker(Module *module, const pool<Cell*> &unproven_equiv_cells, bool model_undef, int max_seq, bool use_sim) : module(module), sigmap(module),
 			cells(module->selected_cells()), workset(unproven_equiv_cells),
-			satgen(ez.get(), &sigmap), max_seq(max_seq), success_counter(0)
+			satgen(ez.get(), &sigmap), max_seq(max_seq), success_counter(0), use_sim(use_sim)
 	{
 		satgen.model_undef = model_undef;
 	}
@@ -86,10 +89,41 @@ struct EquivInductWorker
 		ez_step_is_consistent[step] = ez->expression(ez->OpAnd, ez_equal_terms);
 	}
 
+	void simulate()
+	{
+		EquivSim sim(module, cells);
+
+		// these are the $equiv cells that are assumed to hold in the steps
+		// before the last one, see create_timestep()
+		vector<Cell*> assumed;
+		for (auto cell : cells)
+			if (cell->type == ID($equiv) && sigmap(cell->getPort(ID::A)) != sigmap(cell->getPort(ID::B)))
+				assumed.push_back(cell);
+
+		vector<Cell*> candidates(workset.begin(), workset.end());
+		for (auto cell : assumed)
+			if (!sim.check(cell)) {
+				log("  Skipping simulation, cell %s is not in a cone that can be simulated.\n", log_id(cell));
+				return;
+			}
+		for (auto cell : candidates)
+			if (!sim.check(cell)) {
+				log("  Skipping simulation, cell %s is not in a cone that can be simulated.\n", log_id(cell));
+				return;
+			}
+
+		sim_disproven = sim.disprove(candidates, max_seq+1, assumed);
+		log("  Simulated %d steps with %d random patterns, found counterexamples for %d cells.\n",
+				max_seq+1, 64 * sim.num_words, GetSize(sim_disproven));
+	}
+
 	void run()
 	{
 		log("Found %d unproven $equiv cells in module %s:\n", GetSize(workset), log_id(module));
 
+		if (use_sim)
+			simulate();
+
 		if (satgen.model_undef) {
 			for (auto cell : cells)
 				if (yosys_celltypes.cell_known(cell->type))
@@ -126,13 +160,19 @@ struct EquivInductWorker
 			int new_step_not_consistent = ez->NOT(ez_step_is_consistent[step+1]);
 			ez->bind(new_step_not_consistent);
 
-			log("  Proving induction step %d. (%d clauses over %d variables)\n", step, ez->numCnfClauses(), ez->numCnfVariables());
-			if (!ez->solve(new_step_not_consistent)) {
-				log("  Proof for induction step holds. Entire workset of %d cells proven!\n", GetSize(workset));
-				for (auto cell : workset)
-					cell->setPort(ID::B, cell->getPort(ID::A));
-				success_counter += GetSize(workset);
-				return;
+			// a simulated counterexample for step max_seq also is one for all
+			// earlier steps, as the initial state is not constrained
+			if (!sim_disproven.empty()) {
+				log("  Skipping induction step %d, simulation found a counterexample.\n", step);
+			} else {
+				log("  Proving induction step %d. (%d clauses over %d variables)\n", step, ez->numCnfClauses(), ez->numCnfVariables());
+				if (!ez->solve(new_step_not_consistent)) {
+					log("  Proof for induction step holds. Entire workset of %d cells proven!\n", GetSize(workset));
+					for (auto cell : workset)
+						cell->setPort(ID::B, cell->getPort(ID::A));
+					success_counter += GetSize(workset);
+					return;
+				}
 			}
 
 			log("  Proof for induction step failed. %s\n", step != max_seq ? "Extending to next time step." : "Trying to prove individual $equiv from workset.");
@@ -140,13 +180,24 @@ struct EquivInductWorker
 
 		workset.sort();
 
+		// All remaining cells are proven together with a single incremental
+		// solver: each cell gets an activation literal, and every model of
+		// "some active cell is violated" is a counterexample for the cells it
+		// violates, which are then retracted. Once the problem is unsat, all
+		// cells that are still active are proven.
+		vector<Cell*> active_cells;
+		vector<int> ez_conds, ez_terms;
+		dict<Cell*, int> ez_act;
+		pool<Cell*> failed_cells;
+
 		for (auto cell : workset)
 		{
+			if (sim_disproven.count(cell))
+				continue;
+
 			SigBit bit_a = sigmap(cell->getPort(ID::A)).as_bit();
 			SigBit bit_b = sigmap(cell->getPort(ID::B)).as_bit();
 
-			log("  Trying to prove $equiv for %s:", log_signal(sigmap(cell->getPort(ID::Y))));
-
 			int ez_a = satgen.importSigBit(bit_a, max_seq+1);
 			int ez_b = satgen.importSigBit(bit_b, max_seq+1);
 			int cond = ez->XOR(ez_a, ez_b);
@@ -154,12 +205,54 @@ struct EquivInductWorker
 			if (satgen.model_undef)
 				cond = ez->AND(cond, ez->NOT(satgen.importUndefSigBit(bit_a, max_seq+1)));
 
-			if (!ez->solve(cond)) {
+			int act = ez->frozen_literal();
+			active_cells.push_back(cell);
+			ez_conds.push_back(cond);
+			ez_terms.push_back(ez->AND(act, cond));
+			ez_act[cell] = act;
+		}
+
+		int ez_any_violated = ez->expression(ezSAT::OpOr, ez_terms);
+		if (!active_cells.empty())
+			ez->bind(ez_any_violated);
+
+		while (!active_cells.empty())
+		{
+			log("  Trying to prove %d remaining $equiv cells. (%d clauses over %d variables)\n",
+					GetSize(active_cells), ez->numCnfClauses(), ez->numCnfVariables());
+
+			vector<bool> model;
+			if (!ez->solve(ez_conds, model, ez_any_violated))
+				break;
+
+			vector<Cell*> next_active_cells;
+			vector<int> next_ez_conds;
+			for (int i = 0; i < GetSize(active_cells); i++) {
+				if (model[i]) {
+					failed_cells.insert(active_cells[i]);
+					ez->assume(ez->NOT(ez_act.at(active_cells[i])));
+				} else {
+					next_active_cells.push_back(active_cells[i]);
+					next_ez_conds.push_back(ez_conds[i]);
+				}
+			}
+			log_assert(GetSize(next_active_cells) < GetSize(active_cells));
+			active_cells.swap(next_active_cells);
+			ez_conds.swap(next_ez_conds);
+		}
+
+		for (auto cell : workset)
+		{
+			log("  Trying to prove $equiv for %s:", log_signal(sigmap(cell->getPort(ID::Y))));
+
+			if (sim_disproven.count(cell)) {
+				log(" failed (simulation).\n");
+			} else if (failed_cells.count(cell)) {
+				log(" failed.\n");
+			} else {
 				log(" success!\n");
 				cell->setPort(ID::B, cell->getPort(ID::A));
 				success_counter++;
-			} else {
-				log(" failed.\n");
 			}
 		}
 	}
@@ -184,6 +277,16 @@ struct EquivInductPass : public Pass {
 		log("    -seq <N>\n");
 		log("        the max. number of time steps to be considered (default = 4)\n");
 		log("\n");
+		log("    -solver <name>\n");
+		log("        use the named SAT solver instead of the default (minisat). The\n");
+		log("        cadical solver is available when yosys is built with ENABLE_CADICAL=1.\n");
+		log("\n");
+		log("    -nosim\n");
+		log("        do not simulate random input patterns before running the SAT solver.\n");
+		log("        By default, cells for which simulation finds a counterexample to the\n");
+		log("        induction step are reported as failed without calling the SAT solver\n");
+		log("        for them. This never changes which cells are proven.\n");
+		log("\n");
 		log("This command is very effective in proving complex sequential circuits, when\n");
 		log("the internal state of the circuit quickly propagates to $equiv cells.\n");
 		log("\n");
@@ -200,8 +303,9 @@ struct EquivInductPass : public Pass {
 	void execute(std::vector<std::string> args, Design *design) override
 	{
 		int success_counter = 0;
-		bool model_undef = false;
+		bool model_undef = false, nosim = false;
 		int max_seq = 4;
+		std::string solver_name;
 
 		log_header(design, "Executing EQUIV_INDUCT pass.\n");
 
@@ -211,6 +315,14 @@ struct EquivInductPass : public Pass {
 				model_undef = true;
 				continue;
 			}
+			if (args[argidx] == "-nosim") {
+				nosim = true;
+				continue;
+			}
+			if (args[argidx] == "-solver" && argidx+1 < args.size()) {
+				solver_name = args[++argidx];
+				continue;
+			}
 			if (args[argidx] == "-seq" && argidx+1 < args.size()) {
 				max_seq = atoi(args[++argidx].c_str());
 				continue;
@@ -219,6 +331,8 @@ struct EquivInductPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		SatSolverSelect solver_select(solver_name);
+
 		for (auto module : design->selected_modules())
 		{
 			pool<Cell*> unproven_equiv_cells;
@@ -234,7 +348,7 @@ struct EquivInductPass : public Pass {
 				continue;
 			}
 
-			EquivInductWorker worker(module, unproven_equiv_cells, model_undef, max_seq);
+			EquivInductWorker worker(module, unproven_equiv_cells, model_undef, max_seq, !nosim);
 			worker.run();
 			success_counter += worker.success_counter;
 		}
@@ -27,16 +27,29 @@ PRIVATE_NAMESPACE_BEGIN
 struct EquivMakeWorker
 {
 	Module *gold_mod, *gate_mod, *equiv_mod;
-	pool<IdString> wire_names, cell_names;
 	CellTypes ct;
 
+	// The names that can be matched, with their copies in equiv_mod on the
+	// gold and the gate side (nullptr where a side has no such object).
+	dict<IdString, std::pair<Wire*, Wire*>> wire_index;
+	dict<IdString, std::pair<Cell*, Cell*>> cell_index;
+
 	bool inames;
 	vector<string> blacklists;
 	vector<string> encfiles;
 	bool make_assert;
 
 	pool<IdString> blacklist_names;
-	dict<IdString, dict<Const, Const>> encdata;
+
+	// An entry of an encfile, with the bits that are 0 or 1 in the gold and
+	// gate patterns and the patterns with the remaining bits set to 0.
+	struct encmap_t {
+		Const gold_pat, gate_pat;
+		std::vector<int> gold_defined, gate_defined;
+		Const gold_defined_pat, gate_defined_pat;
+		Const gold_result, gate_result;
+	};
+	dict<IdString, std::vector<encmap_t>> encdata;
 
 	pool<SigBit> undriven_bits;
 	SigMap assign_map;
@@ -69,6 +82,7 @@ struct EquivMakeWorker
 			if (f.fail())
 				log_cmd_error("Can't open encfile '%s'!\n", fn.c_str());
 
+			dict<IdString, dict<Const, Const>> filedata;
 			dict<Const, Const> *ed = nullptr;
 			string line, token;
 			while (std::getline(f, line))
@@ -80,10 +94,9 @@ struct EquivMakeWorker
 				if (token == ".fsm") {
 					IdString modname = RTLIL::escape_id(next_token(line));
 					IdString signame = RTLIL::escape_id(next_token(line));
-					if (encdata.count(signame))
+					if (encdata.count(signame) || filedata.count(signame))
 						log_cmd_error("Re-definition of signal '%s' in encfile '%s'!\n", signame.c_str(), fn.c_str());
-					encdata[signame] = dict<Const, Const>();
-					ed = &encdata[signame];
+					ed = &filedata[signame];
 					continue;
 				}
 
@@ -96,42 +109,79 @@ struct EquivMakeWorker
 
 				log_cmd_error("Syntax error in encfile '%s'!\n", fn.c_str());
 			}
+
+			for (auto &it : filedata) {
+				std::vector<encmap_t> &maps = encdata[it.first];
+				for (auto &pats : it.second) {
+					encmap_t m;
+					m.gold_pat = pats.first;
+					m.gate_pat = pats.second;
+					m.gold_result = m.gold_pat;
+					m.gate_result = m.gate_pat;
+					for (int i = 0; i < GetSize(m.gold_pat); i++) {
+						if (m.gold_pat[i] == State::S0 || m.gold_pat[i] == State::S1) {
+							m.gold_defined.push_back(i);
+							m.gold_defined_pat.bits.push_back(m.gold_pat[i]);
+						}
+						if (m.gold_result[i] != State::S1)
+							m.gold_result.bits[i] = State::S0;
+					}
+					for (int i = 0; i < GetSize(m.gate_pat); i++) {
+						if (m.gate_pat[i] == State::S0 || m.gate_pat[i] == State::S1) {
+							m.gate_defined.push_back(i);
+							m.gate_defined_pat.bits.push_back(m.gate_pat[i]);
+						}
+						if (m.gate_result[i] != State::S1)
+							m.gate_result.bits[i] = State::S0;
+					}
+					maps.push_back(m);
+				}
+			}
 		}
 	}
 
-	void copy_to_equiv()
+	bool matchable(IdString name)
 	{
-		Module *gold_clone = gold_mod->clone();
-		Module *gate_clone = gate_mod->clone();
+		return (name.isPublic() || inames) && blacklist_names.count(name) == 0;
+	}
 
-		for (auto it : gold_clone->wires().to_vector()) {
-			if ((it->name.isPublic() || inames) && blacklist_names.count(it->name) == 0)
-				wire_names.insert(it->name);
-			gold_clone->rename(it, it->name.str() + "_gold");
+	// Copies mod into equiv_mod with the suffix appended to all names
+	void copy_to_equiv(Module *mod, const std::string &suffix, bool gold)
+	{
+		dict<Wire*, Wire*> wire_map;
+		for (auto wire : mod->wires()) {
+			Wire *copy = equiv_mod->addWire(wire->name.str() + suffix, wire);
+			wire_map[wire] = copy;
+			if (matchable(wire->name)) {
+				auto &entry = wire_index[wire->name];
+				(gold ? entry.first : entry.second) = copy;
+			}
 		}
 
-		for (auto it : gold_clone->cells().to_vector()) {
-			if ((it->name.isPublic() || inames) && blacklist_names.count(it->name) == 0)
-				cell_names.insert(it->name);
-			gold_clone->rename(it, it->name.str() + "_gold");
-		}
+		auto map_sig = [&](const SigSpec &sig) {
+			SigSpec mapped;
+			for (auto chunk : sig.chunks()) {
+				if (chunk.wire)
+					chunk.wire = wire_map.at(chunk.wire);
+				mapped.append(chunk);
+			}
+			return mapped;
+		};
 
-		for (auto it : gate_clone->wires().to_vector()) {
-			if ((it->name.isPublic() || inames) && blacklist_names.count(it->name) == 0)
-				wire_names.insert(it->name);
-			gate_clone->rename(it, it->name.str() + "_gate");
-		}
+		for (auto &conn : mod->connections())
+			equiv_mod->connect(map_sig(conn.first), map_sig(conn.second));
 
-		for (auto it : gate_clone->cells().to_vector()) {
-			if ((it->name.isPublic() || inames) && blacklist_names.count(it->name) == 0)
-				cell_names.insert(it->name);
-			gate_clone->rename(it, it->name.str() + "_gate");
+		for (auto cell : mod->cells()) {
+			Cell *copy = equiv_mod->addCell(cell->name.str() + suffix, cell->type);
+			copy->parameters = cell->parameters;
+			copy->attributes = cell->attributes;
+			for (auto &conn : cell->connections())
+				copy->setPort(conn.first, map_sig(conn.second));
+			if (matchable(cell->name)) {
+				auto &entry = cell_index[cell->name];
+				(gold ? entry.first : entry.second) = copy;
+			}
 		}
-
-		gold_clone->cloneInto(equiv_mod);
-		gate_clone->cloneInto(equiv_mod);
-		delete gold_clone;
-		delete gate_clone;
 	}
 
 	void add_eq_assertion(const SigSpec &gold_sig, const SigSpec &gate_sig)
@@ -149,15 +199,13 @@ struct EquivMakeWorker
 		// list of cells without added $equiv cells
 		auto cells_list = equiv_mod->cells().to_vector();
 
-		for (auto id : wire_names)
+		for (auto &it : wire_index)
 		{
-			IdString gold_id = id.str() + "_gold";
-			IdString gate_id = id.str() + "_gate";
+			IdString id = it.first;
+			Wire *gold_wire = it.second.first;
+			Wire *gate_wire = it.second.second;
 
-			Wire *gold_wire = equiv_mod->wire(gold_id);
-			Wire *gate_wire = equiv_mod->wire(gate_id);
-
-			if (encdata.count(id))
+			if (gold_wire != nullptr && gate_wire != nullptr && encdata.count(id))
 			{
 				log("Creating encoder/decoder for signal %s.\n", log_id(id));
 
@@ -170,51 +218,32 @@ struct EquivMakeWorker
 				dec_a = SigSpec(State::Sx, dec_wire->width);
 				enc_a = SigSpec(State::Sx, enc_wire->width);
 
-				for (auto &it : encdata.at(id))
+				for (auto &m : encdata.at(id))
 				{
-					SigSpec dec_sig = gate_wire, dec_pat = it.second;
-					SigSpec enc_sig = dec_wire, enc_pat = it.first;
-
-					if (GetSize(dec_sig) != GetSize(dec_pat))
+					if (GetSize(gate_wire) != GetSize(m.gate_pat))
 						log_error("Invalid pattern %s for signal %s of size %d!\n",
-								log_signal(dec_pat), log_signal(dec_sig), GetSize(dec_sig));
+								log_signal(m.gate_pat), log_signal(gate_wire), GetSize(gate_wire));
 
-					if (GetSize(enc_sig) != GetSize(enc_pat))
+					if (GetSize(dec_wire) != GetSize(m.gold_pat))
 						log_error("Invalid pattern %s for signal %s of size %d!\n",
-								log_signal(enc_pat), log_signal(enc_sig), GetSize(enc_sig));
+								log_signal(m.gold_pat), log_signal(dec_wire), GetSize(dec_wire));
 
-					SigSpec reduced_dec_sig, reduced_dec_pat;
-					for (int i = 0; i < GetSize(dec_sig); i++)
-						if (dec_pat[i] == State::S0 || dec_pat[i] == State::S1) {
-							reduced_dec_sig.append(dec_sig[i]);
-							reduced_dec_pat.append(dec_pat[i]);
-						}
-
-					SigSpec reduced_enc_sig, reduced_enc_pat;
-					for (int i = 0; i < GetSize(enc_sig); i++)
-						if (enc_pat[i] == State::S0 || enc_pat[i] == State::S1) {
-							reduced_enc_sig.append(enc_sig[i]);
-							reduced_enc_pat.append(enc_pat[i]);
-						}
-
-					SigSpec dec_result = it.first;
-					for (auto &bit : dec_result)
-						if (bit != State::S1) bit = State::S0;
-
-					SigSpec enc_result = it.second;
-					for (auto &bit : enc_result)
-						if (bit != State::S1) bit = State::S0;
+					SigSpec reduced_dec_sig, reduced_enc_sig;
+					for (int i : m.gate_defined)
+						reduced_dec_sig.append(SigBit(gate_wire, i));
+					for (int i : m.gold_defined)
+						reduced_enc_sig.append(SigBit(dec_wire, i));
 
 					SigSpec dec_eq = equiv_mod->addWire(NEW_ID);
 					SigSpec enc_eq = equiv_mod->addWire(NEW_ID);
 
-					equiv_mod->addEq(NEW_ID, reduced_dec_sig, reduced_dec_pat, dec_eq);
-					cells_list.push_back(equiv_mod->addEq(NEW_ID, reduced_enc_sig, reduced_enc_pat, enc_eq));
+					equiv_mod->addEq(NEW_ID, reduced_dec_sig, m.gate_defined_pat, dec_eq);
+					cells_list.push_back(equiv_mod->addEq(NEW_ID, reduced_enc_sig, m.gold_defined_pat, enc_eq));
 
 					dec_s.append(dec_eq);
 					enc_s.append(enc_eq);
-					dec_b.append(dec_result);
-					enc_b.append(enc_result);
+					dec_b.append(m.gold_result);
+					enc_b.append(m.gate_result);
 				}
 
 				equiv_mod->addPmux(NEW_ID, dec_a, dec_b, dec_s, dec_wire);
@@ -326,13 +355,11 @@ struct EquivMakeWorker
 	{
 		SigMap assign_map(equiv_mod);
 
-		for (auto id : cell_names)
+		for (auto &it : cell_index)
 		{
-			IdString gold_id = id.str() + "_gold";
-			IdString gate_id = id.str() + "_gate";
-
-			Cell *gold_cell = equiv_mod->cell(gold_id);
-			Cell *gate_cell = equiv_mod->cell(gate_id);
+			IdString id = it.first;
+			Cell *gold_cell = it.second.first;
+			Cell *gate_cell = it.second.second;
 
 			if (gold_cell == nullptr || gate_cell == nullptr || gold_cell->type != gate_cell->type || !ct.cell_known(gold_cell->type) ||
 					gold_cell->parameters != gate_cell->parameters || GetSize(gold_cell->connections()) != GetSize(gate_cell->connections()))
@@ -416,11 +443,18 @@ struct EquivMakeWorker
 
 	void run()
 	{
-		copy_to_equiv();
+		// the $equiv cells are added to equiv_mod in a single batch
+		equiv_mod->begin_batch(2 * (GetSize(gold_mod->cells()) + GetSize(gate_mod->cells())),
+				2 * (GetSize(gold_mod->wires()) + GetSize(gate_mod->wires())),
+				GetSize(gold_mod->connections()) + GetSize(gate_mod->connections()));
+		copy_to_equiv(gold_mod, "_gold", true);
+		copy_to_equiv(gate_mod, "_gate", false);
+		equiv_mod->fixup_ports();
 		find_undriven_nets(false);
 		find_same_wires();
 		find_same_cells();
 		find_undriven_nets(true);
+		equiv_mod->commit_batch();
 	}
 };
 
@@ -0,0 +1,268 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "passes/equiv/equiv_sim.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+bool EquivSim::cell_supported(RTLIL::IdString type)
+{
+	// the cell types ConstEvalVec evaluates natively, these have the same
+	// two-valued semantics in SatGen and never produce undef from defined
+	// inputs
+	return type.in(ID($not), ID($pos), ID($neg), ID($_NOT_), ID($_BUF_),
+			ID($and), ID($or), ID($xor), ID($xnor),
+			ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_), ID($_ANDNOT_), ID($_ORNOT_),
+			ID($add), ID($sub), ID($eq), ID($ne), ID($lt), ID($le), ID($gt), ID($ge),
+			ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+			ID($logic_not), ID($logic_and), ID($logic_or),
+			ID($mux), ID($_MUX_), ID($_NMUX_), ID($_AOI3_), ID($_OAI3_), ID($_AOI4_), ID($_OAI4_));
+}
+
+EquivSim::EquivSim(RTLIL::Module *module, const std::vector<RTLIL::Cell*> &cells, int num_words) : ce(module, num_words), num_words(num_words)
+{
+	ce.sig2driver.clear();
+
+	pool<RTLIL::SigBit> driven_bits;
+	for (auto cell : cells)
+	{
+		bool bad = false, unconstrained = false;
+		if (cell->type == ID($equiv)) {
+			for (auto bit : ce.assign_map(cell->getPort(ID::Y)))
+				equiv_driver[bit] = cell;
+		} else if (RTLIL::builtin_ff_cell_types().count(cell->type)) {
+			FfData ff(nullptr, cell);
+			if (ff.has_aload || ff.has_arst || ff.has_sr || (!ff.has_clk && !ff.has_gclk) || ff.is_anyinit ||
+					(ff.has_srst && !ff.val_srst.is_fully_def())) {
+				bad = true;
+			} else {
+				for (auto bit : ce.assign_map(ff.sig_q))
+					ff_driver[bit] = GetSize(ffs);
+				ffs.push_back(ff);
+			}
+		} else if (cell_supported(cell->type)) {
+			for (auto bit : ce.assign_map(cell->getPort(ID::Y)))
+				if (bit.wire != nullptr)
+					ce.sig2driver[bit] = cell;
+		} else if (cell->type == ID($anyseq) || !yosys_celltypes.cell_known(cell->type)) {
+			// not constrained by the SAT model at all
+			unconstrained = true;
+		} else {
+			bad = true;
+		}
+
+		for (auto &conn : cell->connections()) {
+			if (!cell->output(conn.first))
+				continue;
+			for (auto bit : ce.assign_map(conn.second)) {
+				if (bit.wire == nullptr || unconstrained)
+					continue;
+				// a bit with more than one driver can not be simulated
+				if (bad || !driven_bits.insert(bit).second)
+					bad_bits.insert(bit);
+			}
+		}
+	}
+}
+
+bool EquivSim::check_bit(RTLIL::SigBit bit)
+{
+	if (bit.wire == nullptr)
+		return bit == State::S0 || bit == State::S1;
+
+	auto it = checked_bits.find(bit);
+	if (it != checked_bits.end())
+		return it->second;
+
+	if (bad_bits.count(bit))
+		return checked_bits[bit] = false;
+
+	// marked as failed while visiting, so that logic loops are rejected
+	checked_bits[bit] = false;
+	new_bits.push_back(bit);
+
+	std::vector<RTLIL::SigSpec> inputs;
+	if (equiv_driver.count(bit)) {
+		RTLIL::Cell *cell = equiv_driver.at(bit);
+		inputs.push_back(cell->getPort(ID::A));
+		inputs.push_back(cell->getPort(ID::B));
+	} else if (ce.sig2driver.count(bit)) {
+		RTLIL::Cell *cell = ce.sig2driver.at(bit);
+		for (auto &conn : cell->connections())
+			if (cell->input(conn.first))
+				inputs.push_back(conn.second);
+	} else if (ff_driver.count(bit)) {
+		// the state is an input in the current cycle, but its next value
+		// must be simulated as well
+		int idx = ff_driver.at(bit);
+		const FfData &ff = ffs.at(idx);
+		inputs.push_back(ff.sig_d);
+		if (ff.has_ce)
+			inputs.push_back(ff.sig_ce);
+		if (ff.has_srst)
+			inputs.push_back(ff.sig_srst);
+		// loops through FFs are fine, so the bit is assumed to be good
+		// until the check is complete
+		checked_bits[bit] = true;
+		if (used_ffs.insert(idx).second)
+			new_ffs.push_back(idx);
+	} else {
+		source_bits.insert(bit);
+	}
+
+	for (auto &sig : inputs)
+		for (auto input_bit : ce.assign_map(sig))
+			if (!check_bit(input_bit))
+				return checked_bits[bit] = false;
+	return checked_bits[bit] = true;
+}
+
+bool EquivSim::check(RTLIL::Cell *equiv_cell)
+{
+	new_bits.clear();
+	new_ffs.clear();
+
+	if (check_bit(ce.assign_map(equiv_cell->getPort(ID::A)).as_bit()) &&
+			check_bit(ce.assign_map(equiv_cell->getPort(ID::B)).as_bit()))
+		return true;
+
+	// bits that were checked while a FF was still assumed to be good might
+	// be wrong, so everything from this check is forgotten
+	if (!new_ffs.empty()) {
+		for (auto bit : new_bits)
+			checked_bits.erase(bit);
+		for (auto idx : new_ffs)
+			used_ffs.erase(idx);
+	}
+	return false;
+}
+
+std::vector<uint64_t> EquivSim::random_words(int width)
+{
+	std::vector<uint64_t> words(width * num_words);
+	for (auto &word : words) {
+		// xorshift64
+		rng_state ^= rng_state << 13;
+		rng_state ^= rng_state >> 7;
+		rng_state ^= rng_state << 17;
+		word = rng_state;
+	}
+	return words;
+}
+
+bool EquivSim::eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result)
+{
+	RTLIL::SigSpec undef;
+	while (!ce.eval(sig, result, undef)) {
+		// ConstEvalVec has no model for $equiv, so these are evaluated here
+		// as Y = A, which is what SatGen does
+		for (auto bit : undef) {
+			if (!equiv_driver.count(bit))
+				return false;
+			std::vector<uint64_t> value;
+			if (!eval(equiv_driver.at(bit)->getPort(ID::A), value))
+				return false;
+			ce.set(bit, value);
+		}
+		undef = RTLIL::SigSpec();
+	}
+	return true;
+}
+
+pool<RTLIL::Cell*> EquivSim::disprove(const std::vector<RTLIL::Cell*> &candidates, int num_steps, const std::vector<RTLIL::Cell*> &assumed)
+{
+	pool<RTLIL::Cell*> disproven;
+	std::vector<uint64_t> valid(num_words, ~uint64_t(0));
+	std::vector<std::vector<uint64_t>> state(GetSize(ffs));
+
+	RTLIL::SigSpec sources;
+	for (auto bit : source_bits)
+		sources.append(bit);
+
+	auto diff = [&](RTLIL::Cell *cell, std::vector<uint64_t> &result) {
+		std::vector<uint64_t> a, b;
+		if (!eval(cell->getPort(ID::A), a) || !eval(cell->getPort(ID::B), b))
+			return false;
+		result.resize(num_words);
+		for (int i = 0; i < num_words; i++)
+			result[i] = a[i] ^ b[i];
+		return true;
+	};
+
+	for (int step = 0; step < num_steps; step++)
+	{
+		ce.clear();
+		ce.set(sources, random_words(GetSize(sources)));
+		for (auto i : used_ffs) {
+			if (step == 0)
+				state[i] = random_words(ffs[i].width);
+			ce.set(ffs[i].sig_q, state[i]);
+		}
+
+		std::vector<uint64_t> result;
+		if (step == num_steps-1) {
+			for (auto cell : candidates) {
+				if (!diff(cell, result))
+					return pool<RTLIL::Cell*>();
+				for (int i = 0; i < num_words; i++)
+					if (result[i] & valid[i]) {
+						disproven.insert(cell);
+						break;
+					}
+			}
+			break;
+		}
+
+		for (auto cell : assumed) {
+			if (!diff(cell, result))
+				return pool<RTLIL::Cell*>();
+			for (int i = 0; i < num_words; i++)
+				valid[i] &= ~result[i];
+		}
+
+		// the FFs are updated in the same way SatGen models them
+		for (auto i : used_ffs) {
+			const FfData &ff = ffs[i];
+			std::vector<uint64_t> next, ce_value, srst_value;
+			if (!eval(ff.sig_d, next))
+				return pool<RTLIL::Cell*>();
+			if (ff.has_ce && !eval(ff.sig_ce, ce_value))
+				return pool<RTLIL::Cell*>();
+			if (ff.has_srst && !eval(ff.sig_srst, srst_value))
+				return pool<RTLIL::Cell*>();
+			for (int k = 0; k < ff.width; k++)
+				for (int j = 0; j < num_words; j++) {
+					uint64_t &d = next[k * num_words + j];
+					uint64_t rval = ff.val_srst.bits.at(k) == State::S1 ? ~uint64_t(0) : 0;
+					uint64_t srst = ff.has_srst ? (ff.pol_srst ? srst_value[j] : ~srst_value[j]) : 0;
+					uint64_t en = ff.has_ce ? (ff.pol_ce ? ce_value[j] : ~ce_value[j]) : ~uint64_t(0);
+					if (ff.has_srst && ff.has_ce && ff.ce_over_srst)
+						d = (d & ~srst) | (rval & srst);
+					d = (d & en) | (state[i][k * num_words + j] & ~en);
+					if (ff.has_srst && !(ff.has_ce && ff.ce_over_srst))
+						d = (d & ~srst) | (rval & srst);
+				}
+			state[i].swap(next);
+		}
+	}
+
+	return disproven;
+}
+
+YOSYS_NAMESPACE_END
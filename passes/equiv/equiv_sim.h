@@ -0,0 +1,80 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef EQUIV_SIM_H
+#define EQUIV_SIM_H
+
+#include "kernel/yosys.h"
+#include "kernel/consteval.h"
+#include "kernel/ff.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Bit-parallel random simulation of $equiv cells, used by equiv_simple and
+// equiv_induct to find cells that can not be proven before building a SAT
+// problem for them. Simulation never proves a $equiv cell. A cell is only
+// reported as disproven when one of the simulated patterns is a satisfying
+// assignment for the SAT problem the pass would solve for it, so the result
+// of the pass does not change.
+struct EquivSim
+{
+	ConstEvalVec ce;
+	int num_words;
+
+	dict<RTLIL::SigBit, RTLIL::Cell*> equiv_driver;
+	dict<RTLIL::SigBit, int> ff_driver;
+	pool<RTLIL::SigBit> bad_bits;
+	std::vector<FfData> ffs;
+
+	dict<RTLIL::SigBit, bool> checked_bits;
+	pool<RTLIL::SigBit> source_bits;
+	pool<int> used_ffs;
+	std::vector<RTLIL::SigBit> new_bits;
+	std::vector<int> new_ffs;
+
+	uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+	// Only the given cells are simulated, the outputs of all other cells are
+	// free inputs. These must be the cells the SAT model of the pass imports.
+	EquivSim(RTLIL::Module *module, const std::vector<RTLIL::Cell*> &cells, int num_words = 4);
+
+	// Returns true if the input cones of A and B of the $equiv cell can be
+	// simulated exactly like the SAT model, i.e. if they only contain
+	// supported cell types, FFs without async inputs and no x constants.
+	bool check(RTLIL::Cell *equiv_cell);
+
+	// Simulates num_steps cycles starting from a random state with random
+	// inputs. Patterns in which any of the assumed $equiv cells does not
+	// hold in one of the first num_steps-1 cycles are dropped. Returns the
+	// candidate cells for which A and B differ in the last cycle of one of
+	// the remaining patterns. All cells must have passed check().
+	pool<RTLIL::Cell*> disprove(const std::vector<RTLIL::Cell*> &candidates, int num_steps,
+			const std::vector<RTLIL::Cell*> &assumed = std::vector<RTLIL::Cell*>());
+
+	static bool cell_supported(RTLIL::IdString type);
+
+private:
+	bool check_bit(RTLIL::SigBit bit);
+	bool eval(RTLIL::SigSpec sig, std::vector<uint64_t> &result);
+	std::vector<uint64_t> random_words(int width);
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -19,6 +19,8 @@
 
 #include "kernel/yosys.h"
 #include "kernel/satgen.h"
+#include "kernel/threading.h"
+#include "passes/equiv/equiv_sim.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -38,6 +40,15 @@ struct EquivSimpleWorker
 	bool short_cones;
 	bool verbose;
 
+	// When set, proven cells are collected in proven_cells instead of being
+	// updated right away, so that the module is not modified by workers.
+	bool defer_updates = false;
+	vector<Cell*> proven_cells;
+
+	// Cells for which simulation found a counterexample, these are not
+	// passed to the SAT solver.
+	const pool<Cell*> *sim_disproven = nullptr;
+
 	pool<pair<Cell*, int>> imported_cells_cache;
 
 	EquivSimpleWorker(const vector<Cell*> &equiv_cells, SigMap &sigmap, dict<SigBit, Cell*> &bit2driver, int max_seq, bool short_cones, bool verbose, bool model_undef) :
@@ -92,6 +103,19 @@ struct EquivSimpleWorker
 	{
 		SigBit bit_a = sigmap(equiv_cell->getPort(ID::A)).as_bit();
 		SigBit bit_b = sigmap(equiv_cell->getPort(ID::B)).as_bit();
+
+		if (verbose) {
+			log("  Trying to prove $equiv cell %s:\n", log_id(equiv_cell));
+			log("    A = %s, B = %s, Y = %s\n", log_signal(bit_a), log_signal(bit_b), log_signal(equiv_cell->getPort(ID::Y)));
+		} else {
+			log("  Trying to prove $equiv for %s:", log_signal(equiv_cell->getPort(ID::Y)));
+		}
+
+		if (sim_disproven != nullptr && sim_disproven->count(equiv_cell)) {
+			log(verbose ? "    Found counterexample in simulation.\n" : " failed (simulation).\n");
+			return false;
+		}
+
 		int ez_context = ez->frozen_literal();
 
 		if (satgen.model_undef)
@@ -113,13 +137,6 @@ struct EquivSimpleWorker
 		pool<SigBit> seed_a = { bit_a };
 		pool<SigBit> seed_b = { bit_b };
 
-		if (verbose) {
-			log("  Trying to prove $equiv cell %s:\n", log_id(equiv_cell));
-			log("    A = %s, B = %s, Y = %s\n", log_signal(bit_a), log_signal(bit_b), log_signal(equiv_cell->getPort(ID::Y)));
-		} else {
-			log("  Trying to prove $equiv for %s:", log_signal(equiv_cell->getPort(ID::Y)));
-		}
-
 		int step = max_seq;
 		while (1)
 		{
@@ -203,7 +220,10 @@ struct EquivSimpleWorker
 
 			if (!ez->solve(ez_context)) {
 				log(verbose ? "    Proved equivalence! Marking $equiv cell as proven.\n" : " success!\n");
-				equiv_cell->setPort(ID::B, equiv_cell->getPort(ID::A));
+				if (defer_updates)
+					proven_cells.push_back(equiv_cell);
+				else
+					equiv_cell->setPort(ID::B, equiv_cell->getPort(ID::A));
 				ez->assume(ez->NOT(ez_context));
 				return true;
 			}
@@ -301,12 +321,33 @@ struct EquivSimplePass : public Pass {
 		log("    -seq <N>\n");
 		log("        the max. number of time steps to be considered (default = 1)\n");
 		log("\n");
+		log("    -solver <name>\n");
+		log("        use the named SAT solver instead of the default (minisat). The\n");
+		log("        cadical solver is available when yosys is built with ENABLE_CADICAL=1.\n");
+		log("\n");
+		log("    -nosim\n");
+		log("        do not simulate random input patterns before running the SAT solver.\n");
+		log("        By default, cells for which simulation finds a counterexample are\n");
+		log("        reported as failed without building a SAT problem for them. This\n");
+		log("        never changes which cells are proven.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        prove up to N groups of $equiv cells at the same time, each with its\n");
+		log("        own SAT solver. The default is the number of threads set with\n");
+		log("        'yosys -j'. The log output is in the same order for any N. When more\n");
+		log("        than one thread is used, groups are proven in batches, and cells\n");
+		log("        proven in a batch only shorten the input cones of later batches; in\n");
+		log("        rare cases (with -short or -seq) this proves fewer cells than running\n");
+		log("        with a single thread.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, Design *design) override
 	{
-		bool verbose = false, short_cones = false, model_undef = false, nogroup = false;
+		bool verbose = false, short_cones = false, model_undef = false, nogroup = false, nosim = false;
 		int success_counter = 0;
 		int max_seq = 1;
+		int max_jobs = 0;
+		std::string solver_name;
 
 		log_header(design, "Executing EQUIV_SIMPLE pass.\n");
 
@@ -328,14 +369,28 @@ struct EquivSimplePass : public Pass {
 				nogroup = true;
 				continue;
 			}
+			if (args[argidx] == "-nosim") {
+				nosim = true;
+				continue;
+			}
 			if (args[argidx] == "-seq" && argidx+1 < args.size()) {
 				max_seq = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-solver" && argidx+1 < args.size()) {
+				solver_name = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				max_jobs = atoi(args[++argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		SatSolverSelect solver_select(solver_name);
+
 		CellTypes ct;
 		ct.setup_internals();
 		ct.setup_stdcells();
@@ -373,6 +428,7 @@ struct EquivSimplePass : public Pass {
 			}
 
 			unproven_equiv_cells.sort();
+			vector<vector<Cell*>> groups;
 			for (auto it : unproven_equiv_cells)
 			{
 				it.second.sort();
@@ -380,9 +436,61 @@ struct EquivSimplePass : public Pass {
 				vector<Cell*> cells;
 				for (auto it2 : it.second)
 					cells.push_back(it2.second);
+				groups.push_back(std::move(cells));
+			}
 
-				EquivSimpleWorker worker(cells, sigmap, bit2driver, max_seq, short_cones, verbose, model_undef);
-				success_counter += worker.run();
+			pool<Cell*> sim_disproven;
+			if (!nosim)
+			{
+				vector<Cell*> sim_cells;
+				for (auto cell : module->cells())
+					if (ct.cell_known(cell->type))
+						sim_cells.push_back(cell);
+
+				EquivSim sim(module, sim_cells);
+				vector<Cell*> candidates;
+				for (auto &cells : groups)
+					for (auto cell : cells)
+						if (sim.check(cell))
+							candidates.push_back(cell);
+
+				sim_disproven = sim.disprove(candidates, 1);
+				log("Simulated %d $equiv cells with %d random patterns, found counterexamples for %d cells.\n",
+						GetSize(candidates), 64 * sim.num_words, GetSize(sim_disproven));
+			}
+
+			int num_threads = max_jobs > 0 && !yosys_in_worker_thread() ? std::min(max_jobs, GetSize(groups)) : yosys_thread_count(GetSize(groups));
+
+			if (num_threads <= 1) {
+				for (auto &cells : groups) {
+					EquivSimpleWorker worker(cells, sigmap, bit2driver, max_seq, short_cones, verbose, model_undef);
+					worker.sim_disproven = &sim_disproven;
+					success_counter += worker.run();
+				}
+				continue;
+			}
+
+			// The batch size does not depend on the number of threads, so that
+			// the results don't either.
+			const int batch_size = 256;
+			sigmap.compress();
+
+			for (int batch_start = 0; batch_start < GetSize(groups); batch_start += batch_size)
+			{
+				int num_jobs = std::min(batch_size, GetSize(groups) - batch_start);
+				vector<vector<Cell*>> proven_cells(num_jobs);
+				vector<int> counters(num_jobs);
+				ThreadPool::run_captured(num_jobs, [&](int i) {
+					EquivSimpleWorker worker(groups[batch_start + i], sigmap, bit2driver, max_seq, short_cones, verbose, model_undef);
+					worker.defer_updates = true;
+					worker.sim_disproven = &sim_disproven;
+					counters[i] = worker.run();
+					proven_cells[i].swap(worker.proven_cells);
+				}, std::min(num_threads, num_jobs), nullptr, [&](int i) {
+					for (auto cell : proven_cells[i])
+						cell->setPort(ID::B, cell->getPort(ID::A));
+					success_counter += counters[i];
+				});
 			}
 		}
 
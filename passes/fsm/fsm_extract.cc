@@ -28,6 +28,7 @@
 #include "kernel/consteval.h"
 #include "kernel/celltypes.h"
 #include "fsmdata.h"
+#include <chrono>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -38,6 +39,30 @@ typedef std::pair<RTLIL::IdString, RTLIL::IdString> sig2driver_entry_t;
 static SigSet<sig2driver_entry_t> sig2driver, sig2trigger;
 static std::map<RTLIL::SigBit, std::set<RTLIL::SigBit>> exclusive_ctrls;
 
+// The enumeration of the transitions branches on each ctrl input the next
+// state depends on, which is exponential in the number of such inputs. It
+// is cut off after a number of steps (calls of find_transitions) or a time
+// per FSM, and the FSM is then left alone.
+static int max_transition_steps, transition_steps;
+static double transition_timeout;
+static std::chrono::steady_clock::time_point transition_start;
+static bool transition_budget_exceeded;
+
+static bool check_transition_budget()
+{
+	if (transition_budget_exceeded)
+		return false;
+	transition_steps++;
+	if (max_transition_steps > 0 && transition_steps > max_transition_steps)
+		transition_budget_exceeded = true;
+	if (transition_timeout > 0 && (transition_steps & 255) == 0) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - transition_start;
+		if (elapsed.count() > transition_timeout)
+			transition_budget_exceeded = true;
+	}
+	return !transition_budget_exceeded;
+}
+
 static bool find_states(RTLIL::SigSpec sig, const RTLIL::SigSpec &dff_out, RTLIL::SigSpec &ctrl, std::map<RTLIL::Const, int> &states, RTLIL::Const *reset_state = NULL)
 {
 	sig.extend_u0(dff_out.size(), false);
@@ -146,6 +171,9 @@ static void find_transitions(ConstEval &ce, ConstEval &ce_nostop, FsmData &fsm_d
 	bool undef_bit_in_next_state_mode = false;
 	RTLIL::SigSpec undef, constval;
 
+	if (!check_transition_budget())
+		return;
+
 	if (ce.eval(ctrl_out, undef) && ce.eval(dff_in, undef))
 	{
 		if (0) {
@@ -358,6 +386,9 @@ static void extract_fsm(RTLIL::Wire *wire)
 
 	ConstEval ce(module), ce_nostop(module);
 	ce.stop(ctrl_in);
+	transition_steps = 0;
+	transition_start = std::chrono::steady_clock::now();
+	transition_budget_exceeded = false;
 	for (int state_idx = 0; state_idx < int(fsm_data.state_table.size()); state_idx++) {
 		ce.push(), ce_nostop.push();
 		ce.set(dff_out, fsm_data.state_table[state_idx]);
@@ -366,6 +397,11 @@ static void extract_fsm(RTLIL::Wire *wire)
 		ce.pop(), ce_nostop.pop();
 	}
 
+	if (transition_budget_exceeded) {
+		log("  fsm extraction failed: transition table not complete after %d steps.\n", transition_steps);
+		return;
+	}
+
 	// create fsm cell
 
 	RTLIL::Cell *fsm_cell = module->addCell(stringf("$fsm$%s$%d", wire->name.c_str(), autoidx++), ID($fsm));
@@ -400,12 +436,14 @@ static void extract_fsm(RTLIL::Wire *wire)
 }
 
 struct FsmExtractPass : public Pass {
+	static const int default_max_steps = 1000000;
+
 	FsmExtractPass() : Pass("fsm_extract", "extracting FSMs in design") { }
 	void help() override
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
 		log("\n");
-		log("    fsm_extract [selection]\n");
+		log("    fsm_extract [options] [selection]\n");
 		log("\n");
 		log("This pass operates on all signals marked as FSM state signals using the\n");
 		log("'fsm_encoding' attribute. It consumes the logic that creates the state signal\n");
@@ -416,11 +454,40 @@ struct FsmExtractPass : public Pass {
 		log("original encoding. The 'fsm_opt' pass can be used in combination with the\n");
 		log("'opt_clean' pass to eliminate this signal.\n");
 		log("\n");
+		log("The transition table is found by evaluating the next state logic for each\n");
+		log("state, branching on every ctrl input the next state depends on. FSMs whose\n");
+		log("table is not complete within the following limits are not extracted:\n");
+		log("\n");
+		log("    -max-steps <N>\n");
+		log("        the maximum number of evaluation steps per FSM (default: %d).\n", default_max_steps);
+		log("        0 disables the limit.\n");
+		log("\n");
+		log("    -timeout <seconds>\n");
+		log("        the maximum time spent on the transition table of one FSM. This\n");
+		log("        limit depends on the speed of the machine, so the result may vary\n");
+		log("        between runs. Disabled by default.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		log_header(design, "Executing FSM_EXTRACT pass (extracting FSM from design).\n");
-		extra_args(args, 1, design);
+
+		max_transition_steps = default_max_steps;
+		transition_timeout = 0;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-max-steps" && argidx+1 < args.size()) {
+				max_transition_steps = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-timeout" && argidx+1 < args.size()) {
+				transition_timeout = atof(args[++argidx].c_str());
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
 
 		CellTypes ct(design);
 
@@ -0,0 +1,270 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+#include "libs/sha1/sha1.h"
+#include "backends/rtlil/rtlil_backend.h"
+#include <stdio.h>
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct HierCacheWorker
+{
+	RTLIL::Design *design;
+	std::string cache_dir;
+	std::vector<std::string> command;
+	bool nocache = false;
+	int hits = 0, misses = 0;
+
+	// Creates a design with a copy of the module and the submodules it
+	// instantiates. Submodules that are not black boxes are replaced by a
+	// black box with the same interface, so that the result only depends on
+	// the module itself. Private names are replaced by names that depend on
+	// the order of the objects in the module, not on autoidx.
+	RTLIL::Design *make_scratch(RTLIL::Module *module, pool<RTLIL::IdString> &stubs)
+	{
+		RTLIL::Design *scratch = new RTLIL::Design;
+		scratch->scratchpad = design->scratchpad;
+		RTLIL::Module *copy = module->clone();
+		scratch->add(copy);
+
+		int index = 0;
+		for (auto wire : copy->wires().to_vector())
+			if (wire->name[0] == '$' && wire->port_id == 0)
+				copy->rename(wire, stringf("$hiercache$wire$%d", index++));
+		for (auto cell : copy->cells().to_vector())
+			if (cell->name[0] == '$')
+				copy->rename(cell, stringf("$hiercache$cell$%d", index++));
+
+		dict<RTLIL::IdString, RTLIL::Process*> processes;
+		for (auto &it : copy->processes) {
+			RTLIL::IdString name = it.first;
+			if (name[0] == '$')
+				name = stringf("$hiercache$proc$%d", index++);
+			it.second->name = name;
+			processes[name] = it.second;
+		}
+		copy->processes.swap(processes);
+
+		for (auto cell : module->cells())
+		{
+			RTLIL::Module *sub = design->module(cell->type);
+			if (sub == nullptr || stubs.count(sub->name))
+				continue;
+			stubs.insert(sub->name);
+
+			if (sub->get_blackbox_attribute()) {
+				scratch->add(sub->clone());
+				continue;
+			}
+
+			// only the port directions and sizes, so that attributes the
+			// command adds to the ports of a submodule do not change the key
+			RTLIL::Module *stub = scratch->addModule(sub->name);
+			stub->avail_parameters = sub->avail_parameters;
+			stub->parameter_default_values = sub->parameter_default_values;
+			for (auto port : sub->ports) {
+				RTLIL::Wire *w = sub->wire(port);
+				RTLIL::Wire *stub_w = stub->addWire(port, w->width);
+				stub_w->start_offset = w->start_offset;
+				stub_w->upto = w->upto;
+				stub_w->is_signed = w->is_signed;
+				stub_w->port_input = w->port_input;
+				stub_w->port_output = w->port_output;
+				stub_w->port_id = w->port_id;
+			}
+			stub->fixup_ports();
+			stub->set_bool_attribute(ID::blackbox);
+		}
+
+		return scratch;
+	}
+
+	// Adds the module with the given name from the result design to the
+	// design in place of the original module, together with any new modules
+	// the command created.
+	void apply(RTLIL::Design *result, RTLIL::IdString name, const pool<RTLIL::IdString> &stubs)
+	{
+		RTLIL::Module *mod = result->module(name);
+		if (mod == nullptr)
+			log_error("Module %s disappeared while running `%s'.\n", log_id(name), join_command().c_str());
+
+		design->remove(design->module(name));
+		design->add(mod->clone());
+
+		for (auto other : result->modules())
+			if (other->name != name && !stubs.count(other->name) && design->module(other->name) == nullptr)
+				design->add(other->clone());
+	}
+
+	std::string join_command()
+	{
+		std::string str;
+		for (auto &arg : command)
+			str += (str.empty() ? "" : " ") + arg;
+		return str;
+	}
+
+	void run(RTLIL::Module *module)
+	{
+		RTLIL::IdString name = module->name;
+		pool<RTLIL::IdString> stubs;
+		RTLIL::Design *scratch = make_scratch(module, stubs);
+
+		std::ostringstream buf;
+		buf << yosys_version_str << "\n" << join_command() << "\n";
+		std::vector<std::string> scratchpad;
+		for (auto &it : design->scratchpad)
+			scratchpad.push_back(it.first + "=" + it.second);
+		std::sort(scratchpad.begin(), scratchpad.end());
+		for (auto &str : scratchpad)
+			buf << str << "\n";
+		// not dump_design(), which would add the current autoidx to the key
+		for (auto mod : scratch->modules())
+			RTLIL_BACKEND::dump_module(buf, "", mod, scratch, false);
+		std::string filename = stringf("%s/%s.il", cache_dir.c_str(), sha1(buf.str()).c_str());
+
+		if (!nocache) {
+			std::ifstream f(filename);
+			if (f.is_open()) {
+				RTLIL::Design cached;
+				Frontend::frontend_call(&cached, &f, filename, "rtlil");
+				if (cached.module(name) != nullptr) {
+					log("Using cached result for module %s from %s.\n", log_id(name), filename.c_str());
+					apply(&cached, name, stubs);
+					delete scratch;
+					hits++;
+					return;
+				}
+				log_warning("Ignoring invalid cache file %s for module %s.\n", filename.c_str(), log_id(name));
+			}
+		}
+
+		log_header(design, "Running `%s' on module %s.\n", join_command().c_str(), log_id(name));
+		log_push();
+		Pass::call(scratch, command);
+		log_pop();
+
+		apply(scratch, name, stubs);
+		misses++;
+
+		// write to a temporary file first so concurrent runs never see a
+		// partially written result
+		std::string tmp_filename = make_temp_file(filename + ".XXXXXX");
+		std::ofstream out(tmp_filename);
+		out << stringf("autoidx %d\n", autoidx);
+		for (auto mod : scratch->modules())
+			if (!stubs.count(mod->name))
+				RTLIL_BACKEND::dump_module(out, "", mod, scratch, false);
+		out.close();
+		if (out.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+			log_warning("Can't write cache file %s.\n", filename.c_str());
+			remove(tmp_filename.c_str());
+		}
+
+		delete scratch;
+	}
+};
+
+struct HierCachePass : public Pass {
+	HierCachePass() : Pass("hiercache", "run a command on each module with result caching") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    hiercache [options] <command>\n");
+		log("\n");
+		log("This command runs the given command separately on each selected module of a\n");
+		log("hierarchical design and stores the resulting module in a cache directory. The\n");
+		log("cache key is a hash of the command and of the RTLIL of the module and the\n");
+		log("interfaces of the submodules it instantiates. When the key is found in the\n");
+		log("cache, the module is replaced by the cached result without running the\n");
+		log("command. Unchanged modules can therefore be reused across runs and designs,\n");
+		log("e.g. for incremental synthesis of large hierarchical designs.\n");
+		log("\n");
+		log("The command is run on a separate design that only contains the module and\n");
+		log("black box versions of its submodules. It must only modify this module, and\n");
+		log("it must not rely on the contents of the submodules. The names of private\n");
+		log("wires, cells and processes are normalized before running the command.\n");
+		log("Modules that were created by the command are added to the design unless a\n");
+		log("module of the same name already exists.\n");
+		log("\n");
+		log("    -dir <directory>\n");
+		log("        the cache directory, created if it does not exist. The default is\n");
+		log("        taken from the scratchpad variable 'hiercache.dir'.\n");
+		log("\n");
+		log("    -nocache\n");
+		log("        do not use existing cache entries, but still write the results to\n");
+		log("        the cache directory.\n");
+		log("\n");
+		log("Example:\n");
+		log("\n");
+		log("    hierarchy -top top\n");
+		log("    hiercache -dir synth.cache synth -run coarse:check\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		HierCacheWorker worker;
+		worker.design = design;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-dir" && argidx+1 < args.size()) {
+				worker.cache_dir = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-nocache") {
+				worker.nocache = true;
+				continue;
+			}
+			break;
+		}
+
+		if (argidx >= args.size())
+			log_cmd_error("No command given.\n");
+		worker.command.assign(args.begin() + argidx, args.end());
+
+		log_header(design, "Executing HIERCACHE pass (running `%s' on each module).\n", worker.join_command().c_str());
+		log_push();
+
+		if (worker.cache_dir.empty())
+			worker.cache_dir = design->scratchpad_get_string("hiercache.dir");
+		if (worker.cache_dir.empty())
+			log_cmd_error("No cache directory given.\n");
+		rewrite_filename(worker.cache_dir);
+		if (!check_file_exists(worker.cache_dir) && !create_directory(worker.cache_dir))
+			log_cmd_error("Can't create cache directory `%s'.\n", worker.cache_dir.c_str());
+
+		std::vector<RTLIL::IdString> names;
+		for (auto module : design->selected_whole_modules_warn())
+			if (!module->get_blackbox_attribute())
+				names.push_back(module->name);
+		std::sort(names.begin(), names.end(), RTLIL::sort_by_id_str());
+
+		for (auto name : names)
+			worker.run(design->module(name));
+
+		log("Reused %d of %d modules from the cache.\n", worker.hits, worker.hits + worker.misses);
+		log_pop();
+	}
+} HierCachePass;
+
+PRIVATE_NAMESPACE_END
@@ -21,6 +21,7 @@
 #include "kernel/celltypes.h"
 #include "kernel/log.h"
 #include "kernel/sigtools.h"
+#include "kernel/threading.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <set>
@@ -39,93 +40,125 @@ struct SubmodWorker
 	bool hidden_mode;
 	std::string opt_name;
 
+	struct wire_flags_t {
+		RTLIL::Wire *new_wire;
+		RTLIL::Const is_int_driven;
+		bool is_int_used, is_ext_driven, is_ext_used;
+		wire_flags_t(RTLIL::Wire* wire) : new_wire(nullptr), is_int_driven(State::S0, GetSize(wire)), is_int_used(false), is_ext_driven(false), is_ext_used(false) { }
+	};
+
 	struct SubModule
 	{
 		std::string name, full_name;
 		pool<RTLIL::Cell*> cells;
+		std::map<RTLIL::Wire*, wire_flags_t> wire_flags;
+		RTLIL::Module *new_mod = nullptr;
+		// init bits of the source module that moved to the new module
+		std::vector<RTLIL::SigBit> moved_init;
 	};
 
 	std::map<std::string, SubModule> submodules;
 
-	struct wire_flags_t {
-		RTLIL::Wire *new_wire;
-		RTLIL::Const is_int_driven;
-		bool is_int_used, is_ext_driven, is_ext_used;
-		wire_flags_t(RTLIL::Wire* wire) : new_wire(nullptr), is_int_driven(State::S0, GetSize(wire)), is_int_used(false), is_ext_driven(false), is_ext_used(false) { }
+	// The submodules driving and using a wire: the first one seen, -1 for
+	// cells that stay in the module, and whether there are several.
+	struct wire_access_t {
+		int driver = -2, user = -2;
+		bool multi_driver = false, multi_user = false;
+		bool internal = false;
 	};
-	std::map<RTLIL::Wire*, wire_flags_t> wire_flags;
-	bool flag_found_something;
 
-	void flag_wire(RTLIL::Wire *wire, bool create, bool set_int_used, bool set_ext_driven, bool set_ext_used)
+	static void add_access(int &first, bool &multi, int part)
 	{
-		if (wire_flags.count(wire) == 0) {
-			if (!create)
-				return;
-			wire_flags.emplace(wire, wire);
-		}
-		if (set_int_used)
-			wire_flags.at(wire).is_int_used = true;
-		if (set_ext_driven)
-			wire_flags.at(wire).is_ext_driven = true;
-		if (set_ext_used)
-			wire_flags.at(wire).is_ext_used = true;
-		flag_found_something = true;
+		if (first == -2)
+			first = part;
+		else if (first != part)
+			multi = true;
 	}
 
-	void flag_signal(const RTLIL::SigSpec &sig, bool create, bool set_int_driven, bool set_int_used, bool set_ext_driven, bool set_ext_used)
+	// Computes the wire flags of all submodules in one pass over the cells
+	// of the module.
+	void flag_wires(std::vector<SubModule*> &parts)
 	{
-		for (auto &c : sig.chunks())
-			if (c.wire != nullptr) {
-				flag_wire(c.wire, create, set_int_used, set_ext_driven, set_ext_used);
-				if (set_int_driven)
-					for (int i = c.offset; i < c.offset+c.width; i++) {
-						wire_flags.at(c.wire).is_int_driven[i] = State::S1;
-						flag_found_something = true;
-					}
+		dict<RTLIL::Cell*, int> cell_part;
+		for (int i = 0; i < GetSize(parts); i++)
+			for (auto cell : parts[i]->cells)
+				cell_part[cell] = i;
+
+		dict<RTLIL::Wire*, wire_access_t> wire_access;
+		std::vector<RTLIL::Cell*> unknown_cells;
+
+		for (auto cell : module->cells())
+		{
+			int part = cell_part.at(cell, -1);
+			bool known = ct.cell_known(cell->type);
+			if (!known) {
+				if (part >= 0)
+					log_warning("Port directions for cell %s (%s) are unknown. Assuming inout for all ports.\n", cell->name.c_str(), cell->type.c_str());
+				else
+					unknown_cells.push_back(cell);
 			}
-	}
 
-	void handle_submodule(SubModule &submod)
-	{
-		log("Creating submodule %s (%s) of module %s.\n", submod.name.c_str(), submod.full_name.c_str(), module->name.c_str());
+			for (auto &conn : cell->connections())
+			{
+				bool driven = !known || ct.cell_output(cell->type, conn.first);
+				bool used = !known || ct.cell_input(cell->type, conn.first);
+				for (auto &c : conn.second.chunks())
+				{
+					if (c.wire == nullptr)
+						continue;
+					wire_access_t &access = wire_access[c.wire];
+					if (driven)
+						add_access(access.driver, access.multi_driver, part);
+					if (used)
+						add_access(access.user, access.multi_user, part);
+					if (part < 0)
+						continue;
+					access.internal = true;
+					wire_flags_t &flags = parts[part]->wire_flags.emplace(c.wire, c.wire).first->second;
+					if (used)
+						flags.is_int_used = true;
+					if (driven)
+						for (int i = c.offset; i < c.offset+c.width; i++)
+							flags.is_int_driven[i] = State::S1;
+				}
+			}
+		}
 
-		wire_flags.clear();
-		for (RTLIL::Cell *cell : submod.cells) {
-			if (ct.cell_known(cell->type)) {
-				for (auto &conn : cell->connections())
-					flag_signal(conn.second, true, ct.cell_output(cell->type, conn.first), ct.cell_input(cell->type, conn.first), false, false);
-			} else {
+		for (auto cell : unknown_cells) {
+			bool found_something = false;
+			for (auto &conn : cell->connections())
+				for (auto &c : conn.second.chunks())
+					if (c.wire != nullptr && wire_access.at(c.wire).internal)
+						found_something = true;
+			if (found_something)
 				log_warning("Port directions for cell %s (%s) are unknown. Assuming inout for all ports.\n", cell->name.c_str(), cell->type.c_str());
-				for (auto &conn : cell->connections())
-					flag_signal(conn.second, true, true, true, false, false);
-			}
 		}
-		for (auto cell : module->cells()) {
-			if (submod.cells.count(cell) > 0)
-				continue;
-			if (ct.cell_known(cell->type)) {
-				for (auto &conn : cell->connections())
-					flag_signal(conn.second, false, false, false, ct.cell_output(cell->type, conn.first), ct.cell_input(cell->type, conn.first));
-			} else {
-				flag_found_something = false;
-				for (auto &conn : cell->connections())
-					flag_signal(conn.second, false, false, false, true, true);
-				if (flag_found_something)
-					log_warning("Port directions for cell %s (%s) are unknown. Assuming inout for all ports.\n", cell->name.c_str(), cell->type.c_str());
+
+		for (int i = 0; i < GetSize(parts); i++)
+			for (auto &it : parts[i]->wire_flags) {
+				const wire_access_t &access = wire_access.at(it.first);
+				it.second.is_ext_driven = access.multi_driver || (access.driver != -2 && access.driver != i);
+				it.second.is_ext_used = access.multi_user || (access.user != -2 && access.user != i);
 			}
-		}
+	}
+
+	// Creates the new module of a submodule. Only reads the source module,
+	// so that the submodules can be built in parallel.
+	void build_submodule(SubModule &submod, const FlatSigMap &sigmap)
+	{
+		log("Creating submodule %s (%s) of module %s.\n", submod.name.c_str(), submod.full_name.c_str(), module->name.c_str());
 
 		RTLIL::Module *new_mod = new RTLIL::Module;
 		new_mod->name = submod.full_name;
-		design->add(new_mod);
+		submod.new_mod = new_mod;
 		int auto_name_counter = 1;
 
 		std::set<RTLIL::IdString> all_wire_names;
-		for (auto &it : wire_flags) {
+		for (auto &it : submod.wire_flags) {
 			all_wire_names.insert(it.first->name);
 		}
 
-		for (auto &it : wire_flags)
+		for (auto &it : submod.wire_flags)
 		{
 			RTLIL::Wire *wire = it.first;
 			wire_flags_t &flags = it.second;
@@ -186,7 +219,7 @@ struct SubmodWorker
 					if (it != sig[i].wire->attributes.end()) {
 						auto jt = new_wire->attributes.insert(std::make_pair(ID::init, Const(State::Sx, GetSize(sig)))).first;
 						jt->second[i] = it->second[sig[i].offset];
-						it->second[sig[i].offset] = State::Sx;
+						submod.moved_init.push_back(sig[i]);
 					}
 				}
 			}
@@ -204,45 +237,77 @@ struct SubmodWorker
 		}
 
 		new_mod->fixup_ports();
-		ct.setup_module(new_mod);
 
 		for (RTLIL::Cell *cell : submod.cells) {
 			RTLIL::Cell *new_cell = new_mod->addCell(cell->name, cell);
 			for (auto &conn : new_cell->connections_)
 				for (auto &bit : conn.second)
 					if (bit.wire != nullptr) {
-						log_assert(wire_flags.count(bit.wire) > 0);
-						bit.wire = wire_flags.at(bit.wire).new_wire;
+						log_assert(submod.wire_flags.count(bit.wire) > 0);
+						bit.wire = submod.wire_flags.at(bit.wire).new_wire;
 					}
 			log("  cell %s (%s)\n", new_cell->name.c_str(), new_cell->type.c_str());
-			if (!copy_mode)
-				module->remove(cell);
 		}
-		submod.cells.clear();
+	}
 
-		if (!copy_mode) {
-			RTLIL::Cell *new_cell = module->addCell(submod.full_name, submod.full_name);
-			for (auto &it : wire_flags)
-			{
-				RTLIL::SigSpec old_sig = sigmap(it.first);
-				RTLIL::Wire *new_wire = it.second.new_wire;
-				if (new_wire->port_id > 0) {
-					if (new_wire->port_output)
-						for (int i = 0; i < GetSize(old_sig); i++) {
-							auto &b = old_sig[i];
-							// Prevents "ERROR: Mismatch in directionality ..." when flattening
-							if (!b.wire)
-								b = module->addWire(NEW_ID);
-							// Prevents "Warning: multiple conflicting drivers ..."
-							else if (!it.second.is_int_driven[i])
-								b = module->addWire(NEW_ID);
-						}
-					new_cell->setPort(new_wire->name, old_sig);
-				}
+	// Replaces the cells of a submodule in the source module with an
+	// instance of the new module.
+	void replace_submodule(SubModule &submod)
+	{
+		for (auto &bit : submod.moved_init)
+			bit.wire->attributes.at(ID::init)[bit.offset] = State::Sx;
+
+		if (copy_mode)
+			return;
+
+		for (RTLIL::Cell *cell : submod.cells)
+			module->remove(cell);
+
+		RTLIL::Cell *new_cell = module->addCell(submod.full_name, submod.full_name);
+		for (auto &it : submod.wire_flags)
+		{
+			RTLIL::SigSpec old_sig = sigmap(it.first);
+			RTLIL::Wire *new_wire = it.second.new_wire;
+			if (new_wire->port_id > 0) {
+				if (new_wire->port_output)
+					for (int i = 0; i < GetSize(old_sig); i++) {
+						auto &b = old_sig[i];
+						// Prevents "ERROR: Mismatch in directionality ..." when flattening
+						if (!b.wire)
+							b = module->addWire(NEW_ID);
+						// Prevents "Warning: multiple conflicting drivers ..."
+						else if (!it.second.is_int_driven[i])
+							b = module->addWire(NEW_ID);
+					}
+				new_cell->setPort(new_wire->name, old_sig);
 			}
 		}
 	}
 
+	// Assigns the cells to submodules in one pass, builds the new modules in
+	// parallel and then rewires the source module in one batch.
+	void handle_submodules()
+	{
+		std::vector<SubModule*> parts;
+		for (auto &it : submodules)
+			parts.push_back(&it.second);
+		flag_wires(parts);
+
+		FlatSigMap flat_sigmap(sigmap, module);
+		ThreadPool::run_captured(GetSize(parts), [&](int i) {
+			build_submodule(*parts[i], flat_sigmap);
+		}, yosys_thread_count(GetSize(parts)));
+
+		for (auto part : parts)
+			design->add(part->new_mod);
+
+		module->begin_batch(GetSize(parts));
+		for (auto part : parts)
+			replace_submodule(*part);
+		module->commit_batch();
+		submodules.clear();
+	}
+
 	SubmodWorker(RTLIL::Design *design, RTLIL::Module *module, bool copy_mode = false, bool hidden_mode = false, std::string opt_name = std::string()) :
 			design(design), module(module), sigmap(module), copy_mode(copy_mode), hidden_mode(hidden_mode), opt_name(opt_name)
 	{
@@ -313,8 +378,8 @@ struct SubmodWorker
 				log("Nothing selected -> do nothing.\n");
 		}
 
-		for (auto &it : submodules)
-			handle_submodule(it.second);
+		if (!submodules.empty())
+			handle_submodules();
 	}
 };
 
@@ -18,6 +18,8 @@
  */
 
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
+#include <typeinfo>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -56,18 +58,20 @@ struct UniquifyPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		bool did_something = true;
-		int count = 0;
+		// Modules whose cells still have to be made unique. The copies are
+		// added to the list in turn, so that every module is visited once.
+		std::vector<Module*> worklist;
+		for (auto module : design->selected_modules())
+			if (module->get_bool_attribute(ID::unique) || module->get_bool_attribute(ID::top))
+				worklist.push_back(module);
 
-		while (did_something)
+		int count = 0;
+		while (!worklist.empty())
 		{
-			did_something = false;
-
-			for (auto module : design->selected_modules())
-			{
-				if (!module->get_bool_attribute(ID::unique) && !module->get_bool_attribute(ID::top))
-					continue;
+			std::vector<Cell*> cells;
+			std::vector<Module*> templates;
 
+			for (auto module : worklist)
 				for (auto cell : module->selected_cells())
 				{
 					Module *tmod = design->module(cell->type);
@@ -82,23 +86,43 @@ struct UniquifyPass : public Pass {
 					if (tmod->get_bool_attribute(ID::unique) && newname == tmod->name)
 						continue;
 
-					log("Creating module %s from %s.\n", log_id(newname), log_id(tmod));
+					cells.push_back(cell);
+					templates.push_back(tmod);
+				}
+			worklist.clear();
+
+			// Clone the modules of one level of the hierarchy in parallel.
+			// Modules of derived types (such as AST modules, whose clone also
+			// copies the AST) are cloned by the calling thread.
+			std::vector<Module*> copies(GetSize(templates));
+			std::vector<int> parallel;
+			for (int i = 0; i < GetSize(templates); i++) {
+				if (typeid(*templates[i]) == typeid(RTLIL::Module))
+					parallel.push_back(i);
+				else
+					copies[i] = templates[i]->clone();
+			}
 
-					auto smod = tmod->clone();
-					smod->name = newname;
-					cell->type = newname;
-					smod->set_bool_attribute(ID::unique);
-					if (smod->attributes.count(ID::hdlname) == 0)
-						smod->attributes[ID::hdlname] = string(log_id(tmod->name));
-					design->add(smod);
+			ThreadPool::run(GetSize(parallel), [&](int i) {
+				copies[parallel[i]] = templates[parallel[i]]->clone();
+			}, yosys_thread_count(GetSize(parallel)));
 
-					did_something = true;
-					count++;
-				}
+			for (int i = 0; i < GetSize(cells); i++)
+			{
+				Module *smod = copies[i];
+				IdString newname = cells[i]->module->name.str() + "." + log_id(cells[i]->name);
+				smod->name = newname;
+				cells[i]->type = newname;
+				smod->set_bool_attribute(ID::unique);
+				if (smod->attributes.count(ID::hdlname) == 0)
+					smod->attributes[ID::hdlname] = string(log_id(templates[i]->name));
+				design->add(smod);
+
+				if (design->selected_module(smod->name))
+					worklist.push_back(smod);
+				count++;
 			}
 		}
-
-		log("Created %d unique modules.\n", count);
 	}
 } UniquifyPass;
 
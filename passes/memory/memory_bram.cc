@@ -398,10 +398,299 @@ struct rules_t
 	}
 };
 
-bool replace_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals, const rules_t::bram_t &bram, const rules_t::match_t &match, dict<string, int> &match_properties, int mode)
+// The result of assigning the ports of a memory to the ports of a bram. It
+// only refers to ports by index, so that it can be applied to other memories
+// with the same structure.
+struct mapping_t {
+	vector<rules_t::portinfo_t> portinfos;
+	vector<int> shuffle_map;
+	int dup_count;
+};
+
+void apply_mapping(Mem &mem, const rules_t &rules, FfInitVals *initvals, const rules_t::bram_t &bram, const mapping_t &mapping)
 {
 	Module *module = mem.module;
 
+	auto &portinfos = mapping.portinfos;
+	auto &shuffle_map = mapping.shuffle_map;
+	int dup_count = mapping.dup_count;
+
+	int clocks_max = 0;
+	int clkpol_max = 0;
+	int transp_max = 0;
+	for (auto &pi : bram.make_portinfos()) {
+		clocks_max = max(clocks_max, pi.clocks);
+		clkpol_max = max(clkpol_max, pi.clkpol);
+		transp_max = max(transp_max, pi.transp);
+	}
+
+	// recover the clock and transparency configuration from the ports
+	// assigned to the bram ports
+
+	dict<int, pair<SigBit, bool>> clock_domains;
+	dict<int, bool> clock_polarities;
+	dict<int, bool> read_transp;
+
+	clock_polarities[0] = false;
+	clock_polarities[1] = true;
+	read_transp[0] = false;
+	read_transp[1] = true;
+
+	for (auto &pi : portinfos) {
+		if (pi.mapped_port == -1 || pi.clocks == 0)
+			continue;
+		if (pi.wrmode) {
+			auto &port = mem.wr_ports[pi.mapped_port];
+			clock_domains[pi.clocks] = pair<SigBit, bool>(port.clk, port.clk_polarity);
+			clock_polarities[pi.clkpol] = port.clk_polarity;
+		} else {
+			auto &port = mem.rd_ports[pi.mapped_port];
+			clock_domains[pi.clocks] = pair<SigBit, bool>(port.clk, port.clk_polarity);
+			clock_polarities[pi.clkpol] = port.clk_polarity;
+			bool transp = false;
+			bool non_transp = false;
+			for (int i = 0; i < GetSize(mem.wr_ports); i++)
+				if (port.transparency_mask[i])
+					transp = true;
+				else if (!port.collision_x_mask[i])
+					non_transp = true;
+			if (non_transp)
+				read_transp[pi.transp] = false;
+			if (transp && !pi.make_transp)
+				read_transp[pi.transp] = true;
+		}
+	}
+
+	int dcells = GetSize(shuffle_map) / bram.dbits;
+	int acells = (mem.size + (1 << bram.abits) - 1) / (1 << bram.abits);
+
+	// Apply make_outreg and make_transp where necessary.
+	for (auto &pi : portinfos) {
+		if (pi.mapped_port == -1 || pi.wrmode)
+			continue;
+		auto &port = mem.rd_ports[pi.mapped_port];
+		if (pi.make_outreg) {
+			mem.extract_rdff(pi.mapped_port, initvals);
+		} else if (port.clk_enable) {
+			if (!pi.enable && port.en != State::S1)
+				mem.emulate_rden(pi.mapped_port, initvals);
+			else
+				mem.emulate_reset(pi.mapped_port, true, true, true, initvals);
+		}
+		if (pi.make_transp) {
+			for (int i = 0; i < GetSize(mem.wr_ports); i++)
+				if (port.transparency_mask[i])
+					mem.emulate_transparency(i, pi.mapped_port, initvals);
+		}
+	}
+
+	// We don't really support priorities, emulate them.
+	for (int i = 0; i < GetSize(mem.wr_ports); i++)
+		for (int j = 0; j < i; j++)
+			mem.emulate_priority(j, i, initvals);
+
+	// Swizzle the init data.  Do this before changing mem.width, so that get_init_data works.
+	bool cell_init = !mem.inits.empty();
+	vector<Const> initdata;
+	if (cell_init) {
+		Const initparam = mem.get_init_data();
+		initdata.reserve(mem.size);
+		for (int i = 0; i < mem.size; i++) {
+			std::vector<State> val;
+			for (auto idx : shuffle_map) {
+				if (idx == -1)
+					val.push_back(State::Sx);
+				else
+					val.push_back(initparam[mem.width * i + idx]);
+			}
+			initdata.push_back(Const(val));
+		}
+	}
+
+	// Now the big swizzle.
+	mem.width = GetSize(shuffle_map);
+
+	// Swizzle write ports.
+	for (auto &port : mem.wr_ports) {
+		SigSpec new_en, new_data;
+		SigBit en_bit = State::S1;
+		for (auto idx : shuffle_map) {
+			if (idx == -1) {
+				new_data.append(State::Sx);
+			} else {
+				new_data.append(port.data[idx]);
+				en_bit = port.en[idx];
+			}
+			new_en.append(en_bit);
+		}
+		port.en = new_en;
+		port.data = new_data;
+	}
+
+	// Swizzle read ports.
+	for (auto &port : mem.rd_ports) {
+		SigSpec new_data = module->addWire(NEW_ID, mem.width);
+		Const new_init_value = Const(State::Sx, mem.width);
+		Const new_arst_value = Const(State::Sx, mem.width);
+		Const new_srst_value = Const(State::Sx, mem.width);
+		for (int i = 0; i < mem.width; i++)
+			if (shuffle_map[i] != -1) {
+				module->connect(port.data[shuffle_map[i]], new_data[i]);
+				new_init_value[i] = port.init_value[shuffle_map[i]];
+				new_arst_value[i] = port.arst_value[shuffle_map[i]];
+				new_srst_value[i] = port.srst_value[shuffle_map[i]];
+			}
+		port.data = new_data;
+		port.init_value = new_init_value;
+		port.arst_value = new_arst_value;
+		port.srst_value = new_srst_value;
+	}
+
+	// prepare variant parameters
+
+	dict<IdString, Const> variant_params;
+	for (auto &other_bram : rules.brams.at(bram.name))
+		bram.find_variant_params(variant_params, other_bram);
+
+	// actually replace that memory cell
+
+	dict<SigSpec, pair<SigSpec, SigSpec>> dout_cache;
+
+	for (int grid_d = 0; grid_d < dcells; grid_d++)
+	{
+		for (int grid_a = 0; grid_a < acells; grid_a++)
+		for (int dupidx = 0; dupidx < dup_count; dupidx++)
+		{
+			Cell *c = module->addCell(module->uniquify(stringf("%s.%d.%d.%d", mem.memid.c_str(), grid_d, grid_a, dupidx)), bram.name);
+			log("      Creating %s cell at grid position <%d %d %d>: %s\n", log_id(bram.name), grid_d, grid_a, dupidx, log_id(c));
+
+			for (auto &vp : variant_params)
+				c->setParam(vp.first, vp.second);
+
+			if (cell_init) {
+				int init_offset = grid_a*(1 << bram.abits) - mem.start_offset;
+				int init_shift = grid_d*bram.dbits;
+				int init_size = (1 << bram.abits);
+				Const initparam(State::Sx, init_size*bram.dbits);
+				for (int i = 0; i < init_size; i++)
+					for (int j = 0; j < bram.dbits; j++)
+						if (init_offset+i < GetSize(initdata) && init_offset+i >= 0)
+							initparam[i*bram.dbits+j] = initdata[init_offset+i][init_shift+j];
+						else
+							initparam[i*bram.dbits+j] = State::Sx;
+				c->setParam(ID::INIT, initparam);
+			}
+
+			for (auto &pi : portinfos)
+			{
+				if (pi.dupidx != dupidx)
+					continue;
+
+				string prefix = stringf("%c%d", pi.group + 'A', pi.index + 1);
+				const char *pf = prefix.c_str();
+
+				if (pi.clocks && clock_domains.count(pi.clocks))
+					c->setPort(stringf("\\CLK%d", (pi.clocks-1) % clocks_max + 1), clock_domains.at(pi.clocks).first);
+				if (pi.clkpol > 1 && clock_polarities.count(pi.clkpol))
+					c->setParam(stringf("\\CLKPOL%d", (pi.clkpol-1) % clkpol_max + 1), clock_polarities.at(pi.clkpol));
+				if (pi.transp > 1 && read_transp.count(pi.transp))
+					c->setParam(stringf("\\TRANSP%d", (pi.transp-1) % transp_max + 1), read_transp.at(pi.transp));
+
+				SigSpec addr_ok;
+				SigSpec sig_addr;
+				if (pi.mapped_port >= 0) {
+					if (pi.wrmode == 1)
+						sig_addr = mem.wr_ports[pi.mapped_port].addr;
+					else
+						sig_addr = mem.rd_ports[pi.mapped_port].addr;
+				}
+
+				if (GetSize(sig_addr) > bram.abits) {
+					SigSpec extra_addr = sig_addr.extract(bram.abits, GetSize(sig_addr) - bram.abits);
+					SigSpec extra_addr_sel = SigSpec(grid_a, GetSize(extra_addr));
+					addr_ok = module->Eq(NEW_ID, extra_addr, extra_addr_sel);
+				}
+
+				sig_addr.extend_u0(bram.abits);
+				c->setPort(stringf("\\%sADDR", pf), sig_addr);
+
+				if (pi.wrmode == 1) {
+					if (pi.mapped_port == -1)
+					{
+						if (pi.enable)
+							c->setPort(stringf("\\%sEN", pf), Const(State::S0, pi.enable));
+						continue;
+					}
+
+					auto &port = mem.wr_ports[pi.mapped_port];
+					SigSpec sig_data = port.data.extract(grid_d * bram.dbits, bram.dbits);
+					c->setPort(stringf("\\%sDATA", pf), sig_data);
+
+					if (pi.enable)
+					{
+						SigSpec sig_en;
+						int stride = bram.dbits / pi.enable;
+						for (int i = 0; i < pi.enable; i++)
+							sig_en.append(port.en[stride * i + grid_d * bram.dbits]);
+
+						if (!addr_ok.empty())
+							sig_en = module->Mux(NEW_ID, SigSpec(0, GetSize(sig_en)), sig_en, addr_ok);
+
+						c->setPort(stringf("\\%sEN", pf), sig_en);
+
+					}
+				} else {
+					if (pi.mapped_port == -1)
+					{
+						if (pi.enable)
+							c->setPort(stringf("\\%sEN", pf), State::S0);
+						continue;
+					}
+					auto &port = mem.rd_ports[pi.mapped_port];
+					SigSpec sig_data = port.data.extract(grid_d * bram.dbits, bram.dbits);
+
+					SigSpec bram_dout = module->addWire(NEW_ID, bram.dbits);
+					c->setPort(stringf("\\%sDATA", pf), bram_dout);
+
+					SigSpec addr_ok_q = addr_ok;
+					if (port.clk_enable && !addr_ok.empty()) {
+						addr_ok_q = module->addWire(NEW_ID);
+						module->addDffe(NEW_ID, port.clk, port.en, addr_ok, addr_ok_q, port.clk_polarity);
+					}
+
+					dout_cache[sig_data].first.append(addr_ok_q);
+					dout_cache[sig_data].second.append(bram_dout);
+
+					if (pi.enable) {
+						SigSpec sig_en = port.en;
+						if (!addr_ok.empty())
+							sig_en = module->And(NEW_ID, sig_en, addr_ok);
+						c->setPort(stringf("\\%sEN", pf), sig_en);
+					}
+				}
+			}
+		}
+	}
+
+	for (auto &it : dout_cache)
+	{
+		if (it.second.first.empty())
+		{
+			log_assert(GetSize(it.first) == GetSize(it.second.second));
+			module->connect(it.first, it.second.second);
+		}
+		else
+		{
+			log_assert(GetSize(it.first)*GetSize(it.second.first) == GetSize(it.second.second));
+			module->addPmux(NEW_ID, SigSpec(State::Sx, GetSize(it.first)), it.second.second, it.second.first, it.first);
+		}
+	}
+
+	mem.remove();
+}
+
+bool replace_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals, const rules_t::bram_t &bram, const rules_t::match_t &match, dict<string, int> &match_properties, int mode, mapping_t *mapping_out = nullptr)
+{
 	auto portinfos = bram.make_portinfos();
 	int dup_count = 1;
 
@@ -774,239 +1063,125 @@ grow_read_ports:;
 			return true;
 	}
 
-	// At this point we are commited to replacing the RAM, and can mutate mem.
-
-	// Apply make_outreg and make_transp where necessary.
-	for (auto &pi : portinfos) {
-		if (pi.mapped_port == -1 || pi.wrmode)
-			continue;
-		auto &port = mem.rd_ports[pi.mapped_port];
-		if (pi.make_outreg) {
-			mem.extract_rdff(pi.mapped_port, initvals);
-		} else if (port.clk_enable) {
-			if (!pi.enable && port.en != State::S1)
-				mem.emulate_rden(pi.mapped_port, initvals);
-			else
-				mem.emulate_reset(pi.mapped_port, true, true, true, initvals);
-		}
-		if (pi.make_transp) {
-			for (int i = 0; i < GetSize(mem.wr_ports); i++)
-				if (port.transparency_mask[i])
-					mem.emulate_transparency(i, pi.mapped_port, initvals);
-		}
-	}
-
-	// We don't really support priorities, emulate them.
-	for (int i = 0; i < GetSize(mem.wr_ports); i++)
-		for (int j = 0; j < i; j++)
-			mem.emulate_priority(j, i, initvals);
-
-	// Swizzle the init data.  Do this before changing mem.width, so that get_init_data works.
-	bool cell_init = !mem.inits.empty();
-	vector<Const> initdata;
-	if (cell_init) {
-		Const initparam = mem.get_init_data();
-		initdata.reserve(mem.size);
-		for (int i = 0; i < mem.size; i++) {
-			std::vector<State> val;
-			for (auto idx : shuffle_map) {
-				if (idx == -1)
-					val.push_back(State::Sx);
-				else
-					val.push_back(initparam[mem.width * i + idx]);
-			}
-			initdata.push_back(Const(val));
-		}
-	}
-
-	// Now the big swizzle.
-	mem.width = GetSize(shuffle_map);
-
-	// Swizzle write ports.
-	for (auto &port : mem.wr_ports) {
-		SigSpec new_en, new_data;
-		SigBit en_bit = State::S1;
-		for (auto idx : shuffle_map) {
-			if (idx == -1) {
-				new_data.append(State::Sx);
-			} else {
-				new_data.append(port.data[idx]);
-				en_bit = port.en[idx];
-			}
-			new_en.append(en_bit);
-		}
-		port.en = new_en;
-		port.data = new_data;
-	}
-
-	// Swizzle read ports.
-	for (auto &port : mem.rd_ports) {
-		SigSpec new_data = module->addWire(NEW_ID, mem.width);
-		Const new_init_value = Const(State::Sx, mem.width);
-		Const new_arst_value = Const(State::Sx, mem.width);
-		Const new_srst_value = Const(State::Sx, mem.width);
-		for (int i = 0; i < mem.width; i++)
-			if (shuffle_map[i] != -1) {
-				module->connect(port.data[shuffle_map[i]], new_data[i]);
-				new_init_value[i] = port.init_value[shuffle_map[i]];
-				new_arst_value[i] = port.arst_value[shuffle_map[i]];
-				new_srst_value[i] = port.srst_value[shuffle_map[i]];
-			}
-		port.data = new_data;
-		port.init_value = new_init_value;
-		port.arst_value = new_arst_value;
-		port.srst_value = new_srst_value;
-	}
-
-	// prepare variant parameters
-
-	dict<IdString, Const> variant_params;
-	for (auto &other_bram : rules.brams.at(bram.name))
-		bram.find_variant_params(variant_params, other_bram);
-
-	// actually replace that memory cell
+	// At this point we are commited to replacing the RAM.
 
-	dict<SigSpec, pair<SigSpec, SigSpec>> dout_cache;
+	mapping_t mapping;
+	mapping.portinfos = portinfos;
+	mapping.shuffle_map = shuffle_map;
+	mapping.dup_count = dup_count;
+	if (mapping_out)
+		*mapping_out = mapping;
 
-	for (int grid_d = 0; grid_d < dcells; grid_d++)
-	{
-		for (int grid_a = 0; grid_a < acells; grid_a++)
-		for (int dupidx = 0; dupidx < dup_count; dupidx++)
-		{
-			Cell *c = module->addCell(module->uniquify(stringf("%s.%d.%d.%d", mem.memid.c_str(), grid_d, grid_a, dupidx)), bram.name);
-			log("      Creating %s cell at grid position <%d %d %d>: %s\n", log_id(bram.name), grid_d, grid_a, dupidx, log_id(c));
-
-			for (auto &vp : variant_params)
-				c->setParam(vp.first, vp.second);
-
-			if (cell_init) {
-				int init_offset = grid_a*(1 << bram.abits) - mem.start_offset;
-				int init_shift = grid_d*bram.dbits;
-				int init_size = (1 << bram.abits);
-				Const initparam(State::Sx, init_size*bram.dbits);
-				for (int i = 0; i < init_size; i++)
-					for (int j = 0; j < bram.dbits; j++)
-						if (init_offset+i < GetSize(initdata) && init_offset+i >= 0)
-							initparam[i*bram.dbits+j] = initdata[init_offset+i][init_shift+j];
-						else
-							initparam[i*bram.dbits+j] = State::Sx;
-				c->setParam(ID::INIT, initparam);
-			}
-
-			for (auto &pi : portinfos)
-			{
-				if (pi.dupidx != dupidx)
-					continue;
-
-				string prefix = stringf("%c%d", pi.group + 'A', pi.index + 1);
-				const char *pf = prefix.c_str();
-
-				if (pi.clocks && clock_domains.count(pi.clocks))
-					c->setPort(stringf("\\CLK%d", (pi.clocks-1) % clocks_max + 1), clock_domains.at(pi.clocks).first);
-				if (pi.clkpol > 1 && clock_polarities.count(pi.clkpol))
-					c->setParam(stringf("\\CLKPOL%d", (pi.clkpol-1) % clkpol_max + 1), clock_polarities.at(pi.clkpol));
-				if (pi.transp > 1 && read_transp.count(pi.transp))
-					c->setParam(stringf("\\TRANSP%d", (pi.transp-1) % transp_max + 1), read_transp.at(pi.transp));
-
-				SigSpec addr_ok;
-				SigSpec sig_addr;
-				if (pi.mapped_port >= 0) {
-					if (pi.wrmode == 1)
-						sig_addr = mem.wr_ports[pi.mapped_port].addr;
-					else
-						sig_addr = mem.rd_ports[pi.mapped_port].addr;
-				}
-
-				if (GetSize(sig_addr) > bram.abits) {
-					SigSpec extra_addr = sig_addr.extract(bram.abits, GetSize(sig_addr) - bram.abits);
-					SigSpec extra_addr_sel = SigSpec(grid_a, GetSize(extra_addr));
-					addr_ok = module->Eq(NEW_ID, extra_addr, extra_addr_sel);
-				}
-
-				sig_addr.extend_u0(bram.abits);
-				c->setPort(stringf("\\%sADDR", pf), sig_addr);
-
-				if (pi.wrmode == 1) {
-					if (pi.mapped_port == -1)
-					{
-						if (pi.enable)
-							c->setPort(stringf("\\%sEN", pf), Const(State::S0, pi.enable));
-						continue;
-					}
-
-					auto &port = mem.wr_ports[pi.mapped_port];
-					SigSpec sig_data = port.data.extract(grid_d * bram.dbits, bram.dbits);
-					c->setPort(stringf("\\%sDATA", pf), sig_data);
+	apply_mapping(mem, rules, initvals, bram, mapping);
+	return true;
+}
 
-					if (pi.enable)
-					{
-						SigSpec sig_en;
-						int stride = bram.dbits / pi.enable;
-						for (int i = 0; i < pi.enable; i++)
-							sig_en.append(port.en[stride * i + grid_d * bram.dbits]);
+struct match_cache_t
+{
+	struct entry_t {
+		// rule and variant selected for a memory, or -1 if none was found
+		int rule, variant;
+		mapping_t mapping;
+	};
 
-						if (!addr_ok.empty())
-							sig_en = module->Mux(NEW_ID, SigSpec(0, GetSize(sig_en)), sig_en, addr_ok);
+	dict<std::string, entry_t> entries;
+	dict<pair<int, int>, int64_t> rule_time;
+	dict<pair<int, int>, int> rule_checks;
+	int hits = 0;
+};
 
-						c->setPort(stringf("\\%sEN", pf), sig_en);
+struct rule_timer_t
+{
+	int64_t &total;
+	int64_t begin;
 
-					}
-				} else {
-					if (pi.mapped_port == -1)
-					{
-						if (pi.enable)
-							c->setPort(stringf("\\%sEN", pf), State::S0);
-						continue;
-					}
-					auto &port = mem.rd_ports[pi.mapped_port];
-					SigSpec sig_data = port.data.extract(grid_d * bram.dbits, bram.dbits);
+	rule_timer_t(int64_t &total) : total(total), begin(PerformanceTimer::query()) { }
+	~rule_timer_t() { total += PerformanceTimer::query() - begin; }
+};
 
-					SigSpec bram_dout = module->addWire(NEW_ID, bram.dbits);
-					c->setPort(stringf("\\%sDATA", pf), bram_dout);
+// Creates a string that contains everything about the memory that the rule
+// selection and the port assignment depend on. Signals are replaced by the
+// index of their first occurrence, so that memories that only differ in their
+// clock and enable signals get the same signature.
+std::string memory_signature(const Mem &mem, const rules_t &rules)
+{
+	dict<SigBit, int> ids;
+	auto id = [&](SigBit bit) -> int {
+		auto it = ids.find(bit);
+		if (it != ids.end())
+			return it->second;
+		int index = GetSize(ids);
+		ids[bit] = index;
+		return index;
+	};
 
-					SigSpec addr_ok_q = addr_ok;
-					if (port.clk_enable && !addr_ok.empty()) {
-						addr_ok_q = module->addWire(NEW_ID);
-						module->addDffe(NEW_ID, port.clk, port.en, addr_ok, addr_ok_q, port.clk_polarity);
-					}
+	std::stringstream ss;
+	ss << mem.size << " " << mem.width << " " << !mem.inits.empty();
 
-					dout_cache[sig_data].first.append(addr_ok_q);
-					dout_cache[sig_data].second.append(bram_dout);
+	for (auto &port : mem.wr_ports) {
+		ss << " w";
+		if (port.clk_enable)
+			ss << port.clk_polarity << "@" << id(port.clk);
+		ss << " en";
+		for (auto bit : port.en)
+			ss << " " << id(bit);
+		ss << " p";
+		for (bool prio : port.priority_mask)
+			ss << prio;
+	}
 
-					if (pi.enable) {
-						SigSpec sig_en = port.en;
-						if (!addr_ok.empty())
-							sig_en = module->And(NEW_ID, sig_en, addr_ok);
-						c->setPort(stringf("\\%sEN", pf), sig_en);
-					}
-				}
-			}
-		}
+	for (auto &port : mem.rd_ports) {
+		ss << " r";
+		if (port.clk_enable)
+			ss << port.clk_polarity << "@" << id(port.clk);
+		ss << " t";
+		for (bool transp : port.transparency_mask)
+			ss << transp;
+		ss << " x";
+		for (bool collision_x : port.collision_x_mask)
+			ss << collision_x;
 	}
 
-	for (auto &it : dout_cache)
-	{
-		if (it.second.first.empty())
-		{
-			log_assert(GetSize(it.first) == GetSize(it.second.second));
-			module->connect(it.first, it.second.second);
-		}
-		else
-		{
-			log_assert(GetSize(it.first)*GetSize(it.second.first) == GetSize(it.second.second));
-			module->addPmux(NEW_ID, SigSpec(State::Sx, GetSize(it.first)), it.second.second, it.second.first, it.first);
-		}
+	pool<IdString> attributes;
+	for (auto &match : rules.matches)
+		for (auto &sums : match.attributes)
+			for (auto &term : sums)
+				attributes.insert(std::get<1>(term));
+	for (auto key : attributes) {
+		auto it = mem.attributes.find(key);
+		if (it != mem.attributes.end())
+			ss << " " << key.str() << "=" << rules.map_case(it->second).as_string();
 	}
 
-	mem.remove();
-	return true;
+	return ss.str();
 }
 
-void handle_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals)
+void handle_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals, match_cache_t &cache)
 {
 	log("Processing %s.%s:\n", log_id(mem.module), log_id(mem.memid));
 	mem.narrow();
 
+	std::string signature = memory_signature(mem, rules);
+	auto cached = cache.entries.find(signature);
+	if (cached != cache.entries.end())
+	{
+		auto &entry = cached->second;
+		cache.hits++;
+		if (entry.rule < 0) {
+			log("  No acceptable bram resources found (same structure as an earlier memory).\n");
+			return;
+		}
+		auto &bram = rules.brams.at(rules.matches.at(entry.rule).name).at(entry.variant);
+		log("  Reusing rule #%d for bram type %s (variant %d) from an earlier memory with the same structure.\n",
+				entry.rule+1, log_id(bram.name), bram.variant);
+		apply_mapping(mem, rules, initvals, bram, entry.mapping);
+		return;
+	}
+
+	match_cache_t::entry_t &entry = cache.entries[signature];
+	entry.rule = -1;
+	entry.variant = -1;
+
 	bool cell_init = !mem.inits.empty();
 
 	dict<string, int> match_properties;
@@ -1037,6 +1212,8 @@ void handle_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals)
 		{
 			auto &bram = rules.brams.at(match.name).at(vi);
 			bool or_next_if_better = match.or_next_if_better || vi+1 < GetSize(rules.brams.at(match.name));
+			rule_timer_t timer(cache.rule_time[pair<int, int>(i, vi)]);
+			cache.rule_checks[pair<int, int>(i, vi)]++;
 
 			int avail_rd_ports = 0;
 			int avail_wr_ports = 0;
@@ -1182,16 +1359,20 @@ void handle_memory(Mem &mem, const rules_t &rules, FfInitVals *initvals)
 				best_rule_cache.clear();
 
 				auto &best_bram = rules.brams.at(rules.matches.at(best_rule.first).name).at(best_rule.second);
-				if (!replace_memory(mem, rules, initvals, best_bram, rules.matches.at(best_rule.first), match_properties, 2))
+				if (!replace_memory(mem, rules, initvals, best_bram, rules.matches.at(best_rule.first), match_properties, 2, &entry.mapping))
 					log_error("Mapping to bram type %s (variant %d) after pre-selection failed.\n", log_id(best_bram.name), best_bram.variant);
+				entry.rule = best_rule.first;
+				entry.variant = best_rule.second;
 				return;
 			}
 
-			if (!replace_memory(mem, rules, initvals, bram, match, match_properties, 0)) {
+			if (!replace_memory(mem, rules, initvals, bram, match, match_properties, 0, &entry.mapping)) {
 				log("    Mapping to bram type %s failed.\n", log_id(match.name));
 				failed_brams.insert(pair<IdString, int>(bram.name, bram.variant));
 				goto next_match_rule;
 			}
+			entry.rule = i;
+			entry.variant = vi;
 			return;
 		}
 	}
@@ -1320,11 +1501,27 @@ struct MemoryBramPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		match_cache_t cache;
 		for (auto mod : design->selected_modules()) {
 			SigMap sigmap(mod);
 			FfInitVals initvals(&sigmap, mod);
 			for (auto &mem : Mem::get_selected_memories(mod))
-				handle_memory(mem, rules, &initvals);
+				handle_memory(mem, rules, &initvals, cache);
+		}
+
+		if (cache.hits)
+			log("Reused the result for %d memories with the same structure as an earlier memory.\n", cache.hits);
+
+		if (!cache.rule_checks.empty()) {
+			log("Time spent per rule:\n");
+			for (int i = 0; i < GetSize(rules.matches); i++)
+			for (int vi = 0; vi < GetSize(rules.brams.at(rules.matches[i].name)); vi++) {
+				pair<int, int> key(i, vi);
+				if (!cache.rule_checks.count(key))
+					continue;
+				log("  rule #%d for bram type %s (variant %d): %d checks, %.3f ms\n", i+1, log_id(rules.matches[i].name),
+						rules.brams.at(rules.matches[i].name)[vi].variant, cache.rule_checks.at(key), cache.rule_time.at(key) * 1e-6);
+			}
 		}
 	}
 } MemoryBramPass;
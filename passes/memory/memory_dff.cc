@@ -25,6 +25,7 @@
 #include "kernel/mem.h"
 #include "kernel/ff.h"
 #include "kernel/ffmerge.h"
+#include "kernel/profiler.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -226,6 +227,12 @@ struct MemoryDffWorker
 	bool no_out_ff = false;
 
 	bool recognized = false;
+
+	// The $mux and $pmux cells by their Y signal, for handle_rd_port_addr().
+	// Built once for all memories instead of scanning the module for every
+	// write port of every read port.
+	dict<SigSpec, std::vector<Cell*>> mux_by_y;
+
 	MemoryDffWorker(Module *module, bool flag_no_rw_check) : module(module), modwalker(module->design), flag_no_rw_check(flag_no_rw_check)
 	{
 		modwalker.setup(module);
@@ -526,32 +533,63 @@ struct MemoryDffWorker
 				if (cell->type == RTLIL::escape_id("$mux"))
 					mux_cells.push_back(cell);
 			}
-			
+
+			// Only muxes driving the D input of the output FF, or a chunk of
+			// it, can match below. The other muxes are skipped, except that
+			// ff_chunk has to evolve as if they had been visited.
+			pool<SigSpec> ff_d_sigs;
+			for (auto bit_pair : bits) {
+				SigSpec sig_d = bit_pair.first->getPort(ID::D);
+				ff_d_sigs.insert(sig_d);
+				for (auto &chunk : sig_d.chunks())
+					ff_d_sigs.insert(chunk);
+			}
+			auto update_ff_chunk = [&](Cell *ff_cell) {
+				if (!ff_cell->getPort(ID::D).is_chunk()){
+					std::vector<SigChunk> chunks_ = (ff_cell->getPort(ID::D));
+					for (auto chunk : chunks_)
+						ff_chunk.push_back(chunk);
+				}
+				else{
+					ff_chunk.clear();
+					ff_chunk.push_back(ff_cell->getPort(ID::D));
+				}
+			};
+			bool visited_mux = false;
+
 			for (auto mux : mux_cells){
+				if (!ff_d_sigs.count(mux->getPort(ID::Y))) {
+					// after the first visited mux, ff_chunk holds the same
+					// bits at the start of each visit
+					if (!visited_mux)
+						for (auto bit_pair : bits)
+							update_ff_chunk(bit_pair.first);
+					visited_mux = true;
+					continue;
+				}
+				visited_mux = true;
 				for (auto bit_pair: bits){
+					update_ff_chunk(bit_pair.first);
+
+					bool match_din = (mux->getPort(ID::A) == s_din_ || mux->getPort(ID::B) == s_din_) \
+						&& (mux->getPort(ID::Y) == bit_pair.first->getPort(ID::D));
+					bool match_chunk = !match_din && ((std::find(ff_chunk.begin(), ff_chunk.end(), mux->getPort(ID::Y)) != ff_chunk.end()) \
+						||(mux->getPort(ID::Y) == bit_pair.first->getPort(ID::D))) \
+						&& (std::find(mux_din.begin(), mux_din.end(), mux->getPort(ID::B)) != mux_din.end()  \
+						|| std::find(mux_din.begin(), mux_din.end(), mux->getPort(ID::A)) != mux_din.end()) \
+						&& GetSize(bit_pair.first->getPort(ID::D))>1;
+					if (!match_din && !match_chunk)
+						continue;
+
 					FfData _ff_(&initvals, bit_pair.first);
-					if (!bit_pair.first->getPort(ID::D).is_chunk()){
-						std::vector<SigChunk> chunks_ = (bit_pair.first->getPort(ID::D));
-						for (auto chunk : chunks_){
-							SigSpec chunk_D = chunk;
-							ff_chunk.push_back(chunk);
-						}
-						
-					}
-					else{
-						ff_chunk.clear();
-						ff_chunk.push_back(bit_pair.first->getPort(ID::D));
-					}
 					SigSpec di_reg = module->addWire(NEW_ID,GetSize(s_din_));
 					SigSpec sel_mux = module->addWire(NEW_ID,GetSize(mux->getPort(ID::S))); 
 					SigSpec ce_mux = module->addWire(NEW_ID,GetSize(_ff_.sig_ce)); 
 					SigSpec rst_mux = module->addWire(NEW_ID,GetSize(_ff_.sig_srst)); 
-					SigSpec mux_b = module->addWire(NEW_ID,GetSize(_ff_.sig_q)); 
 					SigSpec mux_y = module->addWire(NEW_ID,GetSize(_ff_.sig_d)); 
 					SigSpec feedback_q = module->addWire(NEW_ID,GetSize(_ff_.sig_q));
 					
-					if ((mux->getPort(ID::A) == s_din_ || mux->getPort(ID::B) == s_din_) \
-						&& (mux->getPort(ID::Y) == bit_pair.first->getPort(ID::D))){
+					if (match_din){
 						
 						matched = true;
 						module->addDff(NEW_ID,ff.sig_clk,mux->getPort(ID::S),sel_mux,ff.pol_clk);
@@ -592,11 +630,7 @@ struct MemoryDffWorker
 							}
 						}
 					}
-					else if (((std::find(ff_chunk.begin(), ff_chunk.end(), mux->getPort(ID::Y)) != ff_chunk.end()) \
-						||(mux->getPort(ID::Y) == bit_pair.first->getPort(ID::D))) \
-						&& (std::find(mux_din.begin(), mux_din.end(), mux->getPort(ID::B)) != mux_din.end()  \
-						|| std::find(mux_din.begin(), mux_din.end(), mux->getPort(ID::A)) != mux_din.end()) \
-						&& GetSize(bit_pair.first->getPort(ID::D))>1){
+					else{
 						
 						matched = true;
 						bool is_dina = false;
@@ -762,9 +796,10 @@ struct MemoryDffWorker
 				SigBit we_en1;
 				auto &wport = mem.wr_ports[i];
 				bool add_logic =false;
-				for (auto cell : module->cells()){
-					if ((cell->type == ID($mux) || cell->type == ID($pmux))){
-						if ((cell->getPort(ID::Y)==wport.addr) && (cell->getPort(ID::B) == ff.sig_d)){ // if (wport.addr == rdport.addr)?
+				auto muxes = mux_by_y.find(wport.addr);
+				if (muxes != mux_by_y.end()){
+					for (auto cell : muxes->second){
+						if (cell->getPort(ID::B) == ff.sig_d){ // if (wport.addr == rdport.addr)?
 							add_logic=true;
 							log_debug("\nvalue of write port id = %d , value of read port id =%d, MUX B port  :%s , MUX A port addres : %s  Read port : %s",i,idx,log_signal(cell->getPort(ID::B)),log_signal(cell->getPort(ID::A)),log_signal(ff.sig_d));
 							log_debug("\nMUX SELECT = %s",log_signal(cell->getPort(ID::S)));
@@ -784,7 +819,8 @@ struct MemoryDffWorker
 					SigSpec Mux_A 		= module->addWire(NEW_ID,GetSize(port.data));
 					Mux_Y = port.data;
 					port.data = Mux_A;
-					module->addMux(NEW_ID,port.data, di_reg, we_en_reg, Mux_Y); //MUX dout=we_reg?din_reg:dout_mem
+					Cell *mux = module->addMux(NEW_ID,port.data, di_reg, we_en_reg, Mux_Y); //MUX dout=we_reg?din_reg:dout_mem
+					mux_by_y[Mux_Y].push_back(mux);
 					add_logic=false;
 				}
 			}
@@ -857,6 +893,10 @@ struct MemoryDffWorker
 					handle_rd_port(mem, qcsat, i);
 			}
 		}
+		if (new_primitive == "NEW")
+			for (auto cell : module->cells())
+				if (cell->type.in(ID($mux), ID($pmux)))
+					mux_by_y[cell->getPort(ID::Y)].push_back(cell);
 		for (auto &mem : memories) {
 			for (int i = 0; i < GetSize(mem.rd_ports); i++) {
 				if (!mem.rd_ports[i].clk_enable)
@@ -901,6 +941,7 @@ struct MemoryDffPass : public Pass {
 
 		new_primitive = design->scratchpad_get_string("synth_rs.tech_rs");
 		for (auto mod : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(mod);
 			MemoryDffWorker worker(mod, flag_no_rw_check);
 			worker.run();
 		}
@@ -28,6 +28,8 @@
 #include "kernel/qcsat.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
+#include "kernel/threading.h"
+#include <mutex>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -134,14 +136,32 @@ struct MemConfig {
 
 typedef std::vector<MemConfig> MemConfigs;
 
+// The part of a MemConfig chosen by MemMapping::handle_geom().
+struct GeomResult {
+	int base_width_log2;
+	int unit_width_log2;
+	std::vector<int> swizzle;
+	int hard_wide_mask;
+	int emu_wide_mask;
+	int repl_d;
+	int score_demux;
+	int score_mux;
+	double cost;
+};
+
+// Geometry results keyed by the shape of the memory and the port assignment,
+// shared by all memories mapped with the same MapWorker cache.
+typedef dict<std::string, GeomResult> GeomCache;
+
 struct MapWorker {
 	Module *module;
 	ModWalker modwalker;
 	SigMap sigmap;
 	SigMap sigmap_xmux;
 	FfInitVals initvals;
+	GeomCache &geom_cache;
 
-	MapWorker(Module *module) : module(module), modwalker(module->design, module), sigmap(module), sigmap_xmux(module), initvals(&sigmap, module) {
+	MapWorker(Module *module, GeomCache &geom_cache) : module(module), modwalker(module->design, module), sigmap(module), sigmap_xmux(module), initvals(&sigmap, module), geom_cache(geom_cache) {
 		for (auto cell : module->cells())
 		{
 			if (cell->type == ID($mux))
@@ -174,7 +194,9 @@ struct Swizzle {
 };
 
 struct MemMapping {
-	MapWorker &worker;
+	// the worker used for emitting, may differ from the one that was used
+	// for the search (see MemoryLibMapPass::execute())
+	MapWorker *worker;
 	QuickConeSat qcsat;
 	Mem &mem;
 	const Library &lib;
@@ -190,7 +212,7 @@ struct MemMapping {
 	dict<std::pair<int, int>, bool> wr_excludes_srst_cache;
 	std::string rejected_cfg_debug_msgs;
 
-	MemMapping(MapWorker &worker, Mem &mem, const Library &lib, const PassOptions &opts) : worker(worker), qcsat(worker.modwalker), mem(mem), lib(lib), opts(opts) {
+	MemMapping(MapWorker &worker, Mem &mem, const Library &lib, const PassOptions &opts) : worker(&worker), qcsat(worker.modwalker), mem(mem), lib(lib), opts(opts) {
 		determine_style();
 		logic_ok = determine_logic_ok();
 		if (GetSize(mem.wr_ports) == 0)
@@ -245,7 +267,7 @@ struct MemMapping {
 		int abits = std::max(GetSize(raddr), GetSize(waddr));
 		raddr.extend_u0(abits);
 		waddr.extend_u0(abits);
-		return worker.sigmap_xmux(raddr) == worker.sigmap_xmux(waddr);
+		return worker->sigmap_xmux(raddr) == worker->sigmap_xmux(waddr);
 	}
 
 	int get_wr_en(int wpidx) {
@@ -314,6 +336,7 @@ struct MemMapping {
 	void handle_rd_rst();
 	void score_emu_ports();
 	void handle_geom();
+	void handle_geom_cfg(MemConfig &cfg, const std::vector<int> &wren_size);
 	void prune_post_geom();
 	void emit_port(const MemConfig &cfg, std::vector<Cell*> &cells, const PortVariant &pdef, const char *name, int wpidx, int rpidx, const std::vector<int> &hw_addr_swizzle);
 	void emit(const MemConfig &cfg);
@@ -1201,6 +1224,28 @@ void MemMapping::score_emu_ports() {
 	}
 }
 
+// Configurations of the same resource compete in prune_post_geom(), only the
+// cheapest one survives.
+static std::string resource_key(const Ram &def) {
+	std::string key = def.resource_name;
+	if (key.empty()) {
+		switch (def.kind) {
+			case RamKind::Distributed:
+				key = "[distributed]";
+				break;
+			case RamKind::Block:
+				key = "[block]";
+				break;
+			case RamKind::Huge:
+				key = "[huge]";
+				break;
+			default:
+				break;
+		}
+	}
+	return key;
+}
+
 void MemMapping::handle_geom() {
 	std::vector<int> wren_size;
 	for (auto &port: mem.wr_ports) {
@@ -1208,307 +1253,386 @@ void MemMapping::handle_geom() {
 		en.sort_and_unify();
 		wren_size.push_back(GetSize(en));
 	}
-	for (auto &cfg: cfgs) {
-		// First, create a set of "byte boundaries": the bit positions in source memory word
-		// that have write enable different from the previous bit in any write port.
-		// Bit 0 is considered to be a byte boundary as well.
-		// Likewise, create a set of "word boundaries" that are like above, but only for write ports
-		// with the "force uniform" flag set.
-		std::vector<bool> byte_boundary(mem.width, false);
-		std::vector<bool> word_boundary(mem.width, false);
-		byte_boundary[0] = true;
-		for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
-			auto &port = mem.wr_ports[pidx];
-			auto &pcfg = cfg.wr_ports[pidx];
-			if (pcfg.force_uniform)
-				word_boundary[0] = true;
-			for (int sub = 0; sub < (1 << port.wide_log2); sub++) {
-				for (int i = 1; i < mem.width; i++) {
-					int pos = sub * mem.width + i;
-					if (port.en[pos] != port.en[pos-1]) {
-						byte_boundary[i] = true;
-						if (pcfg.force_uniform)
-							word_boundary[i] = true;
-					}
-				}
+
+	// The geometry only depends on the shape of the memory, on which write
+	// enable bits are equal, and on the port assignment of the config, so
+	// the result can be reused for all memories of the same shape.
+	std::string mem_key = stringf("%d %d %d", mem.width, mem.size, mem.start_offset);
+	for (auto &port: mem.rd_ports)
+		mem_key += stringf(" r%d,%d", port.wide_log2, GetSize(port.data));
+	for (auto &port: mem.wr_ports) {
+		mem_key += stringf(" w%d:", port.wide_log2);
+		dict<SigBit, int> en_ids;
+		for (auto bit : port.en) {
+			auto it = en_ids.find(bit);
+			if (it == en_ids.end())
+				it = en_ids.emplace(bit, GetSize(en_ids)).first;
+			mem_key += stringf("%d,", it->second);
+		}
+	}
+
+	// Branch and bound: every config costs at least its fixed block cost
+	// plus the emulation score. A config whose lower bound is not below the
+	// cheapest earlier config of the same resource would be dropped by
+	// prune_post_geom() anyway, so its geometry is not searched.
+	dict<std::string, double> best_cost;
+	std::vector<bool> pruned(GetSize(cfgs));
+	for (int ci = 0; ci < GetSize(cfgs); ci++) {
+		auto &cfg = cfgs[ci];
+		std::string rkey = resource_key(*cfg.def);
+		auto best_it = best_cost.find(rkey);
+		if (best_it != best_cost.end() && cfg.def->widthscale >= 0 && cfg.def->cost >= cfg.def->widthscale) {
+			double lower_bound = (cfg.def->cost - cfg.def->widthscale) * cfg.repl_port + cfg.score_emu * FACTOR_EMU;
+			if (lower_bound >= best_it->second) {
+				pruned[ci] = true;
+				continue;
 			}
 		}
-		bool got_config = false;
-		int best_cost = 0;
-		int byte_width_log2 = 0;
-		for (int i = 0; i < GetSize(cfg.def->dbits); i++)
-			if (cfg.def->byte >= cfg.def->dbits[i])
-				byte_width_log2 = i;
-		if (cfg.def->byte == 0)
-			byte_width_log2 = GetSize(cfg.def->dbits) - 1;
-		pool<int> no_wide_bits;
-		// Determine which of the source address bits involved in wide ports
-		// are "uniform".  Bits are considered uniform if, when a port is widened through
-		// them, the write enables are the same for both values of the bit.
-		int max_wr_wide_log2 = 0;
-		for (auto &port: mem.wr_ports)
-			if (port.wide_log2 > max_wr_wide_log2)
-				max_wr_wide_log2 = port.wide_log2;
-		int max_wide_log2 = max_wr_wide_log2;
-		for (auto &port: mem.rd_ports)
-			if (port.wide_log2 > max_wide_log2)
-				max_wide_log2 = port.wide_log2;
-		int wide_nu_start = max_wide_log2;
-		int wide_nu_end = max_wr_wide_log2;
-		for (int i = 0; i < GetSize(mem.wr_ports); i++) {
-			auto &port = mem.wr_ports[i];
-			auto &pcfg = cfg.wr_ports[i];
-			for (int j = 0; j < port.wide_log2; j++) {
-				bool uniform = true;
-				// If write enables don't match, mark bit as non-uniform.
-				for (int k = 0; k < (1 << port.wide_log2); k += 2 << j)
-					if (port.en.extract(k * mem.width, mem.width << j) != port.en.extract((k + (1 << j)) * mem.width, mem.width << j))
-						uniform = false;
-				if (!uniform) {
-					if (pcfg.force_uniform) {
-						for (int k = j; k < port.wide_log2; k++)
-							no_wide_bits.insert(k);
-					}
-					if (j < wide_nu_start)
-						wide_nu_start = j;
-					break;
+
+		std::string key = stringf("%p %d %d", cfg.def, cfg.repl_port, cfg.score_emu);
+		for (auto &pcfg: cfg.wr_ports)
+			key += stringf(" w%p,%d,%d", pcfg.def, pcfg.force_uniform, pcfg.rd_port);
+		for (auto &pcfg: cfg.rd_ports)
+			key += stringf(" r%p", pcfg.def);
+		key += " " + mem_key;
+
+		auto it = worker->geom_cache.find(key);
+		if (it != worker->geom_cache.end()) {
+			const GeomResult &res = it->second;
+			cfg.base_width_log2 = res.base_width_log2;
+			cfg.unit_width_log2 = res.unit_width_log2;
+			cfg.swizzle = res.swizzle;
+			cfg.hard_wide_mask = res.hard_wide_mask;
+			cfg.emu_wide_mask = res.emu_wide_mask;
+			cfg.repl_d = res.repl_d;
+			cfg.score_demux = res.score_demux;
+			cfg.score_mux = res.score_mux;
+			cfg.cost = res.cost;
+		} else {
+			handle_geom_cfg(cfg, wren_size);
+			GeomResult &res = worker->geom_cache[key];
+			res.base_width_log2 = cfg.base_width_log2;
+			res.unit_width_log2 = cfg.unit_width_log2;
+			res.swizzle = cfg.swizzle;
+			res.hard_wide_mask = cfg.hard_wide_mask;
+			res.emu_wide_mask = cfg.emu_wide_mask;
+			res.repl_d = cfg.repl_d;
+			res.score_demux = cfg.score_demux;
+			res.score_mux = cfg.score_mux;
+			res.cost = cfg.cost;
+		}
+
+		if (best_it == best_cost.end() || cfg.cost < best_it->second)
+			best_cost[rkey] = cfg.cost;
+	}
+
+	MemConfigs new_cfgs;
+	for (int ci = 0; ci < GetSize(cfgs); ci++)
+		if (!pruned[ci])
+			new_cfgs.push_back(cfgs[ci]);
+	cfgs.swap(new_cfgs);
+}
+
+void MemMapping::handle_geom_cfg(MemConfig &cfg, const std::vector<int> &wren_size) {
+	// First, create a set of "byte boundaries": the bit positions in source memory word
+	// that have write enable different from the previous bit in any write port.
+	// Bit 0 is considered to be a byte boundary as well.
+	// Likewise, create a set of "word boundaries" that are like above, but only for write ports
+	// with the "force uniform" flag set.
+	std::vector<bool> byte_boundary(mem.width, false);
+	std::vector<bool> word_boundary(mem.width, false);
+	byte_boundary[0] = true;
+	for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
+		auto &port = mem.wr_ports[pidx];
+		auto &pcfg = cfg.wr_ports[pidx];
+		if (pcfg.force_uniform)
+			word_boundary[0] = true;
+		for (int sub = 0; sub < (1 << port.wide_log2); sub++) {
+			for (int i = 1; i < mem.width; i++) {
+				int pos = sub * mem.width + i;
+				if (port.en[pos] != port.en[pos-1]) {
+					byte_boundary[i] = true;
+					if (pcfg.force_uniform)
+						word_boundary[i] = true;
 				}
 			}
-			if (pcfg.def->width_tied && pcfg.rd_port != -1) {
-				// If:
-				//
-				// - the write port is merged with a read port
-				// - the read port is wider than the write port
-				// - read and write widths are tied
-				//
-				// then we will have to artificially widen the write
-				// port to the width of the read port, and emulate
-				// a narrower write path by use of write enables,
-				// which will definitely be non-uniform over the added
-				// bits.
-				auto &rport = mem.rd_ports[pcfg.rd_port];
-				if (rport.wide_log2 > port.wide_log2) {
-					if (port.wide_log2 < wide_nu_start)
-						wide_nu_start = port.wide_log2;
-					if (rport.wide_log2 > wide_nu_end)
-						wide_nu_end = rport.wide_log2;
-					if (pcfg.force_uniform) {
-						for (int k = port.wide_log2; k < rport.wide_log2; k++)
-							no_wide_bits.insert(k);
-					}
+		}
+	}
+	bool got_config = false;
+	int best_cost = 0;
+	int byte_width_log2 = 0;
+	for (int i = 0; i < GetSize(cfg.def->dbits); i++)
+		if (cfg.def->byte >= cfg.def->dbits[i])
+			byte_width_log2 = i;
+	if (cfg.def->byte == 0)
+		byte_width_log2 = GetSize(cfg.def->dbits) - 1;
+	pool<int> no_wide_bits;
+	// Determine which of the source address bits involved in wide ports
+	// are "uniform".  Bits are considered uniform if, when a port is widened through
+	// them, the write enables are the same for both values of the bit.
+	int max_wr_wide_log2 = 0;
+	for (auto &port: mem.wr_ports)
+		if (port.wide_log2 > max_wr_wide_log2)
+			max_wr_wide_log2 = port.wide_log2;
+	int max_wide_log2 = max_wr_wide_log2;
+	for (auto &port: mem.rd_ports)
+		if (port.wide_log2 > max_wide_log2)
+			max_wide_log2 = port.wide_log2;
+	int wide_nu_start = max_wide_log2;
+	int wide_nu_end = max_wr_wide_log2;
+	for (int i = 0; i < GetSize(mem.wr_ports); i++) {
+		auto &port = mem.wr_ports[i];
+		auto &pcfg = cfg.wr_ports[i];
+		for (int j = 0; j < port.wide_log2; j++) {
+			bool uniform = true;
+			// If write enables don't match, mark bit as non-uniform.
+			for (int k = 0; k < (1 << port.wide_log2); k += 2 << j)
+				if (port.en.extract(k * mem.width, mem.width << j) != port.en.extract((k + (1 << j)) * mem.width, mem.width << j))
+					uniform = false;
+			if (!uniform) {
+				if (pcfg.force_uniform) {
+					for (int k = j; k < port.wide_log2; k++)
+						no_wide_bits.insert(k);
 				}
+				if (j < wide_nu_start)
+					wide_nu_start = j;
+				break;
 			}
 		}
-		// Iterate over base widths.
-		for (int base_width_log2 = 0; base_width_log2 < GetSize(cfg.def->dbits); base_width_log2++) {
-			// Now, see how many data bits we actually have available.
-			// This is usually dbits[base_width_log2], but could be smaller if we
-			// ran afoul of a max width limitation.  Configurations where this
-			// happens are not useful, unless we need it to satisfy a *minimum*
-			// width limitation.
-			int unit_width_log2 = base_width_log2;
-			for (auto &pcfg: cfg.wr_ports)
-				if (unit_width_log2 > pcfg.def->max_wr_wide_log2)
-					unit_width_log2 = pcfg.def->max_wr_wide_log2;
-			for (auto &pcfg: cfg.rd_ports)
-				if (unit_width_log2 > pcfg.def->max_rd_wide_log2)
-					unit_width_log2 = pcfg.def->max_rd_wide_log2;
-			if (unit_width_log2 != base_width_log2 && got_config)
-				break;
-			int unit_width = cfg.def->dbits[unit_width_log2];
-			// Also determine effective byte width (the granularity of write enables).
-			int effective_byte = cfg.def->byte;
-			if (effective_byte == 0 || effective_byte > unit_width)
-				effective_byte = unit_width;
-			if (mem.wr_ports.empty())
-				effective_byte = 1;
-			log_assert(unit_width % effective_byte == 0);
-			// Create the swizzle pattern.
-			std::vector<int> swizzle;
-			for (int i = 0; i < mem.width; i++) {
-				if (word_boundary[i])
-					while (GetSize(swizzle) % unit_width)
-						swizzle.push_back(-1);
-				else if (byte_boundary[i])
-					while (GetSize(swizzle) % effective_byte)
-						swizzle.push_back(-1);
-				swizzle.push_back(i);
+		if (pcfg.def->width_tied && pcfg.rd_port != -1) {
+			// If:
+			//
+			// - the write port is merged with a read port
+			// - the read port is wider than the write port
+			// - read and write widths are tied
+			//
+			// then we will have to artificially widen the write
+			// port to the width of the read port, and emulate
+			// a narrower write path by use of write enables,
+			// which will definitely be non-uniform over the added
+			// bits.
+			auto &rport = mem.rd_ports[pcfg.rd_port];
+			if (rport.wide_log2 > port.wide_log2) {
+				if (port.wide_log2 < wide_nu_start)
+					wide_nu_start = port.wide_log2;
+				if (rport.wide_log2 > wide_nu_end)
+					wide_nu_end = rport.wide_log2;
+				if (pcfg.force_uniform) {
+					for (int k = port.wide_log2; k < rport.wide_log2; k++)
+						no_wide_bits.insert(k);
+				}
 			}
-			if (word_boundary[0])
+		}
+	}
+	// Iterate over base widths.
+	for (int base_width_log2 = 0; base_width_log2 < GetSize(cfg.def->dbits); base_width_log2++) {
+		// Now, see how many data bits we actually have available.
+		// This is usually dbits[base_width_log2], but could be smaller if we
+		// ran afoul of a max width limitation.  Configurations where this
+		// happens are not useful, unless we need it to satisfy a *minimum*
+		// width limitation.
+		int unit_width_log2 = base_width_log2;
+		for (auto &pcfg: cfg.wr_ports)
+			if (unit_width_log2 > pcfg.def->max_wr_wide_log2)
+				unit_width_log2 = pcfg.def->max_wr_wide_log2;
+		for (auto &pcfg: cfg.rd_ports)
+			if (unit_width_log2 > pcfg.def->max_rd_wide_log2)
+				unit_width_log2 = pcfg.def->max_rd_wide_log2;
+		if (unit_width_log2 != base_width_log2 && got_config)
+			break;
+		int unit_width = cfg.def->dbits[unit_width_log2];
+		// Also determine effective byte width (the granularity of write enables).
+		int effective_byte = cfg.def->byte;
+		if (effective_byte == 0 || effective_byte > unit_width)
+			effective_byte = unit_width;
+		if (mem.wr_ports.empty())
+			effective_byte = 1;
+		log_assert(unit_width % effective_byte == 0);
+		// Create the swizzle pattern.
+		std::vector<int> swizzle;
+		for (int i = 0; i < mem.width; i++) {
+			if (word_boundary[i])
 				while (GetSize(swizzle) % unit_width)
 					swizzle.push_back(-1);
-			else
+			else if (byte_boundary[i])
 				while (GetSize(swizzle) % effective_byte)
 					swizzle.push_back(-1);
+			swizzle.push_back(i);
+		}
+		if (word_boundary[0])
+			while (GetSize(swizzle) % unit_width)
+				swizzle.push_back(-1);
+		else
+			while (GetSize(swizzle) % effective_byte)
+				swizzle.push_back(-1);
 
 #if 0		//Ayyaz: It is disabled because, it is handled in BRAM technology mapping files under EDA-1776 & EDA-1777 fix	
-			// Correct the swizzles for specific case when BRAM will work on MODE_36
-			// Special handling of parity bit for RapidSilicon BRAM architecture
-			if(technology != ""){
-				if(unit_width == 36 && mem.width > 18){
-					int curr_bit = 0;
-					for (int i = 0; i < 2; ++i){
-						int left = (swizzle.size()/2)*i;
-						int right = left+swizzle.size()/2-1;
-						while(right >= left && curr_bit < mem.width){
-							if(swizzle[right] == -1)
-								--right;
-							if(swizzle[left] == -1){
-								swizzle[left] = curr_bit;
-								swizzle[right] = -1;
-							}else{
-								swizzle[left] = curr_bit;
-							}
-							++left;
-							++curr_bit;
+		// Correct the swizzles for specific case when BRAM will work on MODE_36
+		// Special handling of parity bit for RapidSilicon BRAM architecture
+		if(technology != ""){
+			if(unit_width == 36 && mem.width > 18){
+				int curr_bit = 0;
+				for (int i = 0; i < 2; ++i){
+					int left = (swizzle.size()/2)*i;
+					int right = left+swizzle.size()/2-1;
+					while(right >= left && curr_bit < mem.width){
+						if(swizzle[right] == -1)
+							--right;
+						if(swizzle[left] == -1){
+							swizzle[left] = curr_bit;
+							swizzle[right] = -1;
+						}else{
+							swizzle[left] = curr_bit;
 						}
+						++left;
+						++curr_bit;
 					}
 				}
 			}
+		}
 #endif
-			// Now evaluate the configuration, then keep adding more hard wide bits
-			// and evaluating.
-			int hard_wide_mask = 0;
-			int hard_wide_num = 0;
-			bool byte_failed = false;
-			while (1) {
-				// Check if all min width constraints are satisfied.
-				// Only check these constraints for write ports with width below
-				// byte width — for other ports, we can emulate narrow width with
-				// a larger one.
-				bool min_width_ok = true;
-				int min_width_bit = wide_nu_start;
-				for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
-					auto &port = mem.wr_ports[pidx];
-					int w = base_width_log2;
+		// Now evaluate the configuration, then keep adding more hard wide bits
+		// and evaluating.
+		int hard_wide_mask = 0;
+		int hard_wide_num = 0;
+		bool byte_failed = false;
+		while (1) {
+			// Check if all min width constraints are satisfied.
+			// Only check these constraints for write ports with width below
+			// byte width — for other ports, we can emulate narrow width with
+			// a larger one.
+			bool min_width_ok = true;
+			int min_width_bit = wide_nu_start;
+			for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
+				auto &port = mem.wr_ports[pidx];
+				int w = base_width_log2;
+				for (int i = 0; i < port.wide_log2; i++)
+					if (hard_wide_mask & 1 << i)
+						w++;
+				if (w < cfg.wr_ports[pidx].def->min_wr_wide_log2 && w < byte_width_log2) {
+					min_width_ok = false;
+					if (min_width_bit > port.wide_log2)
+						min_width_bit = port.wide_log2;
+				}
+			}
+			if (min_width_ok) {
+				int emu_wide_bits = max_wide_log2 - hard_wide_num;
+				int mult_wide = 1 << emu_wide_bits;
+				int addrs = 1 << (cfg.def->abits - base_width_log2 + emu_wide_bits);
+				int min_addr = mem.start_offset / addrs;
+				int max_addr = (mem.start_offset + mem.size - 1) / addrs;
+				int mult_a = max_addr - min_addr + 1;
+				int bits = mult_a * mult_wide * GetSize(swizzle);
+				int repl = (bits + unit_width - 1) / unit_width;
+				int score_demux = 0;
+				for (int i = 0; i < GetSize(mem.wr_ports); i++) {
+					auto &port = mem.wr_ports[i];
+					int w = emu_wide_bits;
 					for (int i = 0; i < port.wide_log2; i++)
-						if (hard_wide_mask & 1 << i)
-							w++;
-					if (w < cfg.wr_ports[pidx].def->min_wr_wide_log2 && w < byte_width_log2) {
-						min_width_ok = false;
-						if (min_width_bit > port.wide_log2)
-							min_width_bit = port.wide_log2;
-					}
+						if (!(hard_wide_mask & 1 << i))
+							w--;
+					if (w || mult_a != 1)
+						score_demux += (mult_a << w) * wren_size[i];
 				}
-				if (min_width_ok) {
-					int emu_wide_bits = max_wide_log2 - hard_wide_num;
-					int mult_wide = 1 << emu_wide_bits;
-					int addrs = 1 << (cfg.def->abits - base_width_log2 + emu_wide_bits);
-					int min_addr = mem.start_offset / addrs;
-					int max_addr = (mem.start_offset + mem.size - 1) / addrs;
-					int mult_a = max_addr - min_addr + 1;
-					int bits = mult_a * mult_wide * GetSize(swizzle);
-					int repl = (bits + unit_width - 1) / unit_width;
-					int score_demux = 0;
-					for (int i = 0; i < GetSize(mem.wr_ports); i++) {
-						auto &port = mem.wr_ports[i];
-						int w = emu_wide_bits;
-						for (int i = 0; i < port.wide_log2; i++)
-							if (!(hard_wide_mask & 1 << i))
-								w--;
-						if (w || mult_a != 1)
-							score_demux += (mult_a << w) * wren_size[i];
-					}
-					int score_mux = 0;
-					for (auto &port: mem.rd_ports) {
-						int w = emu_wide_bits;
-						for (int i = 0; i < port.wide_log2; i++)
-							if (!(hard_wide_mask & 1 << i))
-								w--;
-						score_mux += ((mult_a << w) - 1) * GetSize(port.data);
-					}
-					double cost = (cfg.def->cost - cfg.def->widthscale) * repl * cfg.repl_port;
-					cost += cfg.def->widthscale * mult_a * mult_wide * mem.width / unit_width * cfg.repl_port;
-					cost += score_mux * FACTOR_MUX;
-					cost += score_demux * FACTOR_DEMUX;
-					cost += cfg.score_emu * FACTOR_EMU;
-					if (!got_config || cost < best_cost) {
-						cfg.base_width_log2 = base_width_log2;
-						cfg.unit_width_log2 = unit_width_log2;
-						cfg.swizzle = swizzle;
-						cfg.hard_wide_mask = hard_wide_mask;
-						cfg.emu_wide_mask = ((1 << max_wide_log2) - 1) & ~hard_wide_mask;
-						cfg.repl_d = repl;
-						cfg.score_demux = score_demux;
-						cfg.score_mux = score_mux;
-						cfg.cost = cost;
-						best_cost = cost;
-						got_config = true;
-					}
+				int score_mux = 0;
+				for (auto &port: mem.rd_ports) {
+					int w = emu_wide_bits;
+					for (int i = 0; i < port.wide_log2; i++)
+						if (!(hard_wide_mask & 1 << i))
+							w--;
+					score_mux += ((mult_a << w) - 1) * GetSize(port.data);
 				}
-				if (cfg.def->width_mode != WidthMode::PerPort)
-					break;
-				// Now, pick the next bit to add to the hard wide mask.
-next_hw:
-				int scan_from;
-				int scan_to;
-				bool retry = false;
-				if (!min_width_ok) {
-					// If we still haven't met the minimum width limits,
-					// add the highest one that will be useful for working
-					// towards all unmet limits.
-					scan_from = min_width_bit;
-					scan_to = 0;
-					// If the relevant write port is not wide, it's impossible.
-				} else if (byte_failed) {
-					// If we already failed with uniformly-written bits only,
-					// go with uniform bits that are only involved in reads.
-					scan_from = max_wide_log2;
-					scan_to = wide_nu_end;
-				} else if (base_width_log2 + hard_wide_num < byte_width_log2) {
-					// If we still need uniform bits, prefer the low ones.
-					scan_from = wide_nu_start;
-					scan_to = 0;
-					retry = true;
-				} else {
-					scan_from = max_wide_log2;
-					scan_to = 0;
+				double cost = (cfg.def->cost - cfg.def->widthscale) * repl * cfg.repl_port;
+				cost += cfg.def->widthscale * mult_a * mult_wide * mem.width / unit_width * cfg.repl_port;
+				cost += score_mux * FACTOR_MUX;
+				cost += score_demux * FACTOR_DEMUX;
+				cost += cfg.score_emu * FACTOR_EMU;
+				if (!got_config || cost < best_cost) {
+					cfg.base_width_log2 = base_width_log2;
+					cfg.unit_width_log2 = unit_width_log2;
+					cfg.swizzle = swizzle;
+					cfg.hard_wide_mask = hard_wide_mask;
+					cfg.emu_wide_mask = ((1 << max_wide_log2) - 1) & ~hard_wide_mask;
+					cfg.repl_d = repl;
+					cfg.score_demux = score_demux;
+					cfg.score_mux = score_mux;
+					cfg.cost = cost;
+					best_cost = cost;
+					got_config = true;
 				}
-				int bit = scan_from - 1;
-				while (1) {
-					if (bit < scan_to) {
+			}
+			if (cfg.def->width_mode != WidthMode::PerPort)
+				break;
+			// Now, pick the next bit to add to the hard wide mask.
+next_hw:
+			int scan_from;
+			int scan_to;
+			bool retry = false;
+			if (!min_width_ok) {
+				// If we still haven't met the minimum width limits,
+				// add the highest one that will be useful for working
+				// towards all unmet limits.
+				scan_from = min_width_bit;
+				scan_to = 0;
+				// If the relevant write port is not wide, it's impossible.
+			} else if (byte_failed) {
+				// If we already failed with uniformly-written bits only,
+				// go with uniform bits that are only involved in reads.
+				scan_from = max_wide_log2;
+				scan_to = wide_nu_end;
+			} else if (base_width_log2 + hard_wide_num < byte_width_log2) {
+				// If we still need uniform bits, prefer the low ones.
+				scan_from = wide_nu_start;
+				scan_to = 0;
+				retry = true;
+			} else {
+				scan_from = max_wide_log2;
+				scan_to = 0;
+			}
+			int bit = scan_from - 1;
+			while (1) {
+				if (bit < scan_to) {
 hw_bit_failed:
-						if (retry) {
-							byte_failed = true;
-							goto next_hw;
-						} else {
-							goto bw_done;
-						}
+					if (retry) {
+						byte_failed = true;
+						goto next_hw;
+					} else {
+						goto bw_done;
 					}
-					if (!(hard_wide_mask & 1 << bit) && !no_wide_bits.count(bit))
-						break;
-					bit--;
 				}
-				int new_hw_mask = hard_wide_mask | 1 << bit;
-				// Check if all max width constraints are satisfied.
-				for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
-					auto &port = mem.wr_ports[pidx];
-					int w = base_width_log2;
-					for (int i = 0; i < port.wide_log2; i++)
-						if (new_hw_mask & 1 << i)
-							w++;
-					if (w > cfg.wr_ports[pidx].def->max_wr_wide_log2) {
-						goto hw_bit_failed;
-					}
+				if (!(hard_wide_mask & 1 << bit) && !no_wide_bits.count(bit))
+					break;
+				bit--;
+			}
+			int new_hw_mask = hard_wide_mask | 1 << bit;
+			// Check if all max width constraints are satisfied.
+			for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
+				auto &port = mem.wr_ports[pidx];
+				int w = base_width_log2;
+				for (int i = 0; i < port.wide_log2; i++)
+					if (new_hw_mask & 1 << i)
+						w++;
+				if (w > cfg.wr_ports[pidx].def->max_wr_wide_log2) {
+					goto hw_bit_failed;
 				}
-				for (int pidx = 0; pidx < GetSize(mem.rd_ports); pidx++) {
-					auto &port = mem.rd_ports[pidx];
-					int w = base_width_log2;
-					for (int i = 0; i < port.wide_log2; i++)
-						if (new_hw_mask & 1 << i)
-							w++;
-					if (w > cfg.rd_ports[pidx].def->max_rd_wide_log2) {
-						goto hw_bit_failed;
-					}
+			}
+			for (int pidx = 0; pidx < GetSize(mem.rd_ports); pidx++) {
+				auto &port = mem.rd_ports[pidx];
+				int w = base_width_log2;
+				for (int i = 0; i < port.wide_log2; i++)
+					if (new_hw_mask & 1 << i)
+						w++;
+				if (w > cfg.rd_ports[pidx].def->max_rd_wide_log2) {
+					goto hw_bit_failed;
 				}
-				// Bit ok, commit.
-				hard_wide_mask = new_hw_mask;
-				hard_wide_num++;
 			}
-bw_done:;
+			// Bit ok, commit.
+			hard_wide_mask = new_hw_mask;
+			hard_wide_num++;
 		}
-		log_assert(got_config);
+bw_done:;
 	}
+	log_assert(got_config);
 }
 
 void MemMapping::prune_post_geom() {
@@ -1516,22 +1640,7 @@ void MemMapping::prune_post_geom() {
 	dict<std::string, int> rsrc;
 	for (int i = 0; i < GetSize(cfgs); i++) {
 		auto &cfg = cfgs[i];
-		std::string key = cfg.def->resource_name;
-		if (key.empty()) {
-			switch (cfg.def->kind) {
-				case RamKind::Distributed:
-					key = "[distributed]";
-					break;
-				case RamKind::Block:
-					key = "[block]";
-					break;
-				case RamKind::Huge:
-					key = "[huge]";
-					break;
-				default:
-					break;
-			}
-		}
+		std::string key = resource_key(*cfg.def);
 		auto it = rsrc.find(key);
 		if (it == rsrc.end()) {
 			rsrc[key] = i;
@@ -1783,7 +1892,7 @@ void MemMapping::emit_port(const MemConfig &cfg, std::vector<Cell*> &cells, cons
 		}
 
 	}
-	addr = worker.sigmap_xmux(addr);
+	addr = worker->sigmap_xmux(addr);
 	if (pdef.kind != PortKind::Ar) {
 		switch (pdef.clk_pol) {
 			case ClkPolKind::Posedge:
@@ -2090,14 +2199,14 @@ void MemMapping::emit(const MemConfig &cfg) {
 	log("mapping memory %s.%s via %s\n", log_id(mem.module->name), log_id(mem.memid), log_id(cfg.def->id));
 	// First, handle emulations.
 	if (cfg.emu_read_first)
-		mem.emulate_read_first(&worker.initvals);
+		mem.emulate_read_first(&worker->initvals);
 	for (int pidx = 0; pidx < GetSize(mem.rd_ports); pidx++) {
 		auto &pcfg = cfg.rd_ports[pidx];
 		auto &port = mem.rd_ports[pidx];
 		if (pcfg.emu_sync)
-			mem.extract_rdff(pidx, &worker.initvals);
+			mem.extract_rdff(pidx, &worker->initvals);
 		else if (pcfg.emu_en)
-			mem.emulate_rden(pidx, &worker.initvals);
+			mem.emulate_rden(pidx, &worker->initvals);
 		else {
 			if (pcfg.emu_srst_en_prio) {
 				if (port.ce_over_srst)
@@ -2105,13 +2214,13 @@ void MemMapping::emit(const MemConfig &cfg) {
 				else
 					mem.emulate_rd_srst_over_ce(pidx);
 			}
-			mem.emulate_reset(pidx, pcfg.emu_init, pcfg.emu_arst, pcfg.emu_srst, &worker.initvals);
+			mem.emulate_reset(pidx, pcfg.emu_init, pcfg.emu_arst, pcfg.emu_srst, &worker->initvals);
 		}
 	}
 	for (int pidx = 0; pidx < GetSize(mem.wr_ports); pidx++) {
 		auto &pcfg = cfg.wr_ports[pidx];
 		for (int opidx: pcfg.emu_prio) {
-			mem.emulate_priority(opidx, pidx, &worker.initvals);
+			mem.emulate_priority(opidx, pidx, &worker->initvals);
 		}
 	}
 	for (int pidx = 0; pidx < GetSize(mem.rd_ports); pidx++) {
@@ -2121,7 +2230,7 @@ void MemMapping::emit(const MemConfig &cfg) {
 			// The port may no longer be transparent due to transparency being
 			// nuked as part of emu_sync or emu_prio.
 			if (port.transparency_mask[opidx])
-				mem.emulate_transparency(opidx, pidx, &worker.initvals);
+				mem.emulate_transparency(opidx, pidx, &worker->initvals);
 		}
 	}
 
@@ -2361,13 +2470,52 @@ struct MemoryLibMapPass : public Pass {
 
 		Library lib = parse_library(lib_files, defines);
 		float counter = 0;
+		std::vector<GeomCache> geom_caches(1);
 		for (auto module : design->selected_modules()) {
-			MapWorker worker(module);
 			auto mems = Mem::get_selected_memories(module);
-			for (auto &mem : mems)
+
+			// The mappings of all memories are searched up front, in parallel
+			// with several threads, so that the log does not depend on the
+			// number of threads. Memories are still emitted one by one in order.
+			int num_threads = yosys_thread_count(GetSize(mems));
+			if (GetSize(geom_caches) < num_threads)
+				geom_caches.resize(num_threads);
+			std::vector<std::unique_ptr<MapWorker>> workers;
+			for (int t = 0; t < num_threads; t++)
+				workers.emplace_back(new MapWorker(module, geom_caches[t]));
+
+			// each running job takes a MapWorker of its own
+			std::vector<std::unique_ptr<MemMapping>> maps(GetSize(mems));
+			std::vector<MapWorker*> idle_workers;
+			for (auto &worker : workers)
+				idle_workers.push_back(worker.get());
+			std::mutex idle_workers_mutex;
+			ThreadPool::run_captured(GetSize(mems), [&](int i) {
+				MapWorker *worker;
+				{
+					std::lock_guard<std::mutex> lock(idle_workers_mutex);
+					worker = idle_workers.back();
+					idle_workers.pop_back();
+				}
+				try {
+					maps[i].reset(new MemMapping(*worker, mems[i], lib, opts));
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(idle_workers_mutex);
+					idle_workers.push_back(worker);
+					throw;
+				}
+				std::lock_guard<std::mutex> lock(idle_workers_mutex);
+				idle_workers.push_back(worker);
+			}, num_threads);
+
+			for (int mem_idx = 0; mem_idx < GetSize(mems); mem_idx++)
 			{
+				auto &mem = mems[mem_idx];
 				bool wtrans_new = false;
-				MemMapping map(worker, mem, lib, opts);
+				MemMapping &map = *maps[mem_idx];
+				map.worker = workers[0].get();
+				if (mem_idx > 0)
+					maps[mem_idx - 1].reset();
 				int idx = -1;
 				int best = map.logic_cost;
 				if (!map.logic_ok) {
@@ -33,6 +33,7 @@ struct MemoryMapWorker
 	bool rom_only = false;
 	bool keepdc = false;
 	bool formal = false;
+	bool wide = false;
 	dict<RTLIL::IdString, std::vector<RTLIL::Const>> attributes;
 
 	RTLIL::Design *design;
@@ -42,6 +43,9 @@ struct MemoryMapWorker
 
 	std::map<std::pair<RTLIL::SigSpec, RTLIL::SigSpec>, RTLIL::SigBit> decoder_cache;
 
+	// one-hot decoded addresses for -wide, shared by all write ports of the module
+	dict<RTLIL::SigSpec, RTLIL::SigSpec> demux_cache;
+
 	MemoryMapWorker(RTLIL::Design *design, RTLIL::Module *module) : design(design), module(module), sigmap(module), initvals(&sigmap, module) {}
 
 	std::string map_case(std::string value) const
@@ -103,6 +107,32 @@ struct MemoryMapWorker
 		return bit.wire;
 	}
 
+	// Returns a signal that is high when addr_sig is addr_val. With -wide, the low sel_width
+	// address bits are decoded with a single $demux cell for all addresses.
+	RTLIL::SigBit addr_select(RTLIL::SigSpec addr_sig, int addr_val, int sel_width)
+	{
+		if (!wide)
+			return addr_decode(addr_sig, RTLIL::SigSpec(addr_val, GetSize(addr_sig)));
+
+		int lo_width = std::min(GetSize(addr_sig), sel_width);
+		RTLIL::SigSpec addr_lo = sigmap(addr_sig.extract(0, lo_width));
+		auto it = demux_cache.find(addr_lo);
+		if (it == demux_cache.end()) {
+			RTLIL::SigSpec sel = lo_width == 0 ? RTLIL::SigSpec(State::S1) : module->Demux(NEW_ID, State::S1, addr_lo);
+			it = demux_cache.emplace(addr_lo, sel).first;
+		}
+		RTLIL::SigBit bit = it->second[addr_val & ((1 << lo_width) - 1)];
+
+		if (lo_width < GetSize(addr_sig)) {
+			RTLIL::SigSpec addr_hi = addr_sig.extract(lo_width, GetSize(addr_sig) - lo_width);
+			std::pair<RTLIL::SigSpec, RTLIL::SigSpec> key(addr_sig, RTLIL::SigSpec(addr_val, GetSize(addr_sig)));
+			if (decoder_cache.count(key) == 0)
+				decoder_cache[key] = module->And(NEW_ID, bit, addr_decode(addr_hi, RTLIL::SigSpec(addr_val >> lo_width, GetSize(addr_hi))));
+			bit = decoder_cache.at(key);
+		}
+		return bit;
+	}
+
 	void handle_memory(Mem &mem)
 	{
 		std::set<int> static_ports;
@@ -272,7 +302,10 @@ struct MemoryMapWorker
 		log("  created %d %s cells and %d static cells of width %d.\n",
 				mem.size-count_static, formal && (static_only || async_wr) ? "$ff" : "$dff", count_static, mem.width);
 
-		int count_dff = 0, count_mux = 0, count_wrmux = 0;
+		int count_dff = 0, count_mux = 0, count_shared = 0, count_wrmux = 0;
+
+		// read ports with the same address and width return the same data
+		dict<std::pair<RTLIL::SigSpec, int>, RTLIL::SigSpec> read_cache;
 
 		for (int i = 0; i < GetSize(mem.rd_ports); i++)
 		{
@@ -282,6 +315,30 @@ struct MemoryMapWorker
 			RTLIL::SigSpec rd_addr = port.addr;
 			rd_addr.extend_u0(abits, false);
 
+			auto key = std::make_pair(sigmap(rd_addr), port.wide_log2);
+			if (read_cache.count(key)) {
+				module->connect(port.data, read_cache.at(key));
+				count_shared++;
+				continue;
+			}
+			read_cache[key] = port.data;
+
+			if (wide)
+			{
+				RTLIL::SigSpec words;
+				for (int j = 0; j < (1 << abits); j++)
+					words.append(data_read[j] != SigSpec() ? data_read[j] : RTLIL::SigSpec(State::Sx, mem.width));
+
+				RTLIL::SigSpec sel = rd_addr.extract(port.wide_log2, abits - port.wide_log2);
+				if (GetSize(sel) == 0) {
+					module->connect(port.data, words);
+				} else {
+					module->addBmux(genid(mem.memid, "$rdmux", i), words, sel, port.data);
+					count_mux++;
+				}
+				continue;
+			}
+
 			std::vector<RTLIL::SigSpec> rd_signals;
 			rd_signals.push_back(port.data);
 
@@ -312,7 +369,9 @@ struct MemoryMapWorker
 					module->connect(RTLIL::SigSig(rd_signals[j >> port.wide_log2].extract((j & ((1 << port.wide_log2) - 1)) * mem.width, mem.width), data_read[j]));
 		}
 
-		log("  read interface: %d $dff and %d $mux cells.\n", count_dff, count_mux);
+		log("  read interface: %d $dff and %d %s cells.\n", count_dff, count_mux, wide ? "$bmux" : "$mux");
+		if (count_shared > 0)
+			log("  %d read ports share the data of another port with the same address.\n", count_shared);
 
 		if (!static_only)
 		{
@@ -329,7 +388,7 @@ struct MemoryMapWorker
 				{
 					auto &port = mem.wr_ports[j];
 					RTLIL::SigSpec wr_addr = port.addr.extract_end(port.wide_log2);
-					RTLIL::Wire *w_seladdr = addr_decode(wr_addr, RTLIL::SigSpec(addr >> port.wide_log2, GetSize(wr_addr)));
+					RTLIL::SigBit w_seladdr = addr_select(wr_addr, addr >> port.wide_log2, abits - port.wide_log2);
 
 					int sub = addr & ((1 << port.wide_log2) - 1);
 
@@ -346,7 +405,7 @@ struct MemoryMapWorker
 							wr_width++;
 						}
 
-						RTLIL::Wire *w = w_seladdr;
+						RTLIL::SigBit w = w_seladdr;
 
 						if (wr_bit != State::S1)
 						{
@@ -429,6 +488,12 @@ struct MemoryMapPass : public Pass {
 		log("        attributes. It also has limited support for async write ports\n");
 		log("        as generated by clk2fflogic.\n");
 		log("\n");
+		log("    -wide\n");
+		log("        use a $bmux cell for each read port and share one $demux cell per write\n");
+		log("        address for the write enables, instead of building trees of $mux and\n");
+		log("        $eq/$and cells. This keeps the netlist small for very large memories,\n");
+		log("        the wide cells are lowered later by techmap.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -436,6 +501,7 @@ struct MemoryMapPass : public Pass {
 		bool rom_only = false;
 		bool keepdc = false;
 		bool formal = false;
+		bool wide = false;
 		dict<RTLIL::IdString, std::vector<RTLIL::Const>> attributes;
 
 		log_header(design, "Executing MEMORY_MAP pass (converting memories to logic and flip-flops).\n");
@@ -488,6 +554,11 @@ struct MemoryMapPass : public Pass {
 				keepdc = true;
 				continue;
 			}
+			if (args[argidx] == "-wide")
+			{
+				wide = true;
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
@@ -499,6 +570,7 @@ struct MemoryMapPass : public Pass {
 			worker.rom_only = rom_only;
 			worker.keepdc = keepdc;
 			worker.formal = formal;
+			worker.wide = wide;
 			worker.run();
 		}
 	}
@@ -23,6 +23,8 @@
 #include "kernel/modtools.h"
 #include "kernel/mem.h"
 #include "kernel/ffinit.h"
+#include "kernel/profiler.h"
+#include "kernel/threading.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -293,10 +295,104 @@ struct MemoryShareWorker
 	// Consolidate write ports using sat-based resource sharing
 	// --------------------------------------------------------
 
-	void consolidate_wr_using_sat(Mem &mem)
+	// The outcome of the SAT based merging of a group of write ports. It only
+	// depends on the EN signals of the ports, so it is computed once for all
+	// groups with the same EN signals, e.g. in memories split by byte lanes.
+	struct WrMergePlan {
+		int num_cells = 0, num_vars = 0, num_clauses = 0;
+		// the checked pairs as positions in the group, and whether the
+		// second port is merged into the first
+		std::vector<std::tuple<int, int, bool>> steps;
+	};
+
+	// the sigmapped EN signals of the ports of a group
+	typedef std::vector<RTLIL::SigSpec> wr_group_key_t;
+
+	wr_group_key_t wr_group_key(Mem &mem, const std::vector<int> &group)
+	{
+		wr_group_key_t key;
+		for (auto idx : group)
+			key.push_back(modwalker.sigmap(mem.wr_ports[idx].en));
+		return key;
+	}
+
+	// Only reads the ModWalker, so that the plans of several groups can be
+	// computed in parallel.
+	WrMergePlan plan_wr_merge(const wr_group_key_t &ens)
+	{
+		WrMergePlan plan;
+		int n = GetSize(ens);
+
+		QuickConeSat qcsat(modwalker);
+
+		// create SAT representation of common input cone of all considered EN signals
+
+		std::vector<int> port_to_sat_variable;
+		std::vector<pool<RTLIL::SigBit>> port_en_bits(n);
+
+		for (int i = 0; i < n; i++) {
+			port_to_sat_variable.push_back(qcsat.ez->expression(qcsat.ez->OpOr, qcsat.importSig(ens[i])));
+			for (auto bit : ens[i])
+				if (bit.wire != nullptr)
+					port_en_bits[i].insert(bit);
+		}
+
+		qcsat.prepare();
+
+		plan.num_cells = GetSize(qcsat.imported_cells);
+		plan.num_vars = qcsat.ez->numCnfVariables();
+		plan.num_clauses = qcsat.ez->numCnfClauses();
+
+		// Two ports with a common EN bit that can be 1 can be active at the
+		// same time, which takes one query per bit instead of one per pair.
+		dict<RTLIL::SigBit, bool> bit_can_be_active;
+		auto can_be_active = [&](RTLIL::SigBit bit) {
+			auto it = bit_can_be_active.find(bit);
+			if (it != bit_can_be_active.end())
+				return it->second;
+			bool active = qcsat.ez->solve(qcsat.satgen.importSigBit(bit));
+			bit_can_be_active[bit] = active;
+			return active;
+		};
+
+		// now try merging the ports.
+
+		std::vector<bool> removed(n);
+		for (int ii = 0; ii < n; ii++) {
+			if (removed[ii])
+				continue;
+			for (int jj = ii + 1; jj < n; jj++) {
+				if (removed[jj])
+					continue;
+
+				bool can_collide = false;
+				for (auto bit : port_en_bits[jj])
+					if (port_en_bits[ii].count(bit)) {
+						can_collide = can_be_active(bit);
+						break;
+					}
+				if (!can_collide)
+					can_collide = qcsat.ez->solve(port_to_sat_variable[ii], port_to_sat_variable[jj]);
+
+				plan.steps.emplace_back(ii, jj, !can_collide);
+				if (can_collide)
+					continue;
+
+				port_to_sat_variable[ii] = qcsat.ez->OR(port_to_sat_variable[ii], port_to_sat_variable[jj]);
+				port_en_bits[ii].insert(port_en_bits[jj].begin(), port_en_bits[jj].end());
+				removed[jj] = true;
+			}
+		}
+
+		return plan;
+	}
+
+	// Returns false if the memory has no two write ports that could be
+	// merged, otherwise sets the groups of ports to check.
+	bool find_wr_groups(Mem &mem, std::vector<std::vector<int>> &groups)
 	{
 		if (GetSize(mem.wr_ports) <= 1)
-			return;
+			return false;
 
 		// Get a list of ports that have any chance of being mergeable.
 
@@ -313,14 +409,11 @@ struct MemoryShareWorker
 		}
 
 		if (eligible_ports.size() <= 1)
-			return;
-
-		log("Consolidating write ports of memory %s.%s using sat-based resource sharing:\n", log_id(module), log_id(mem.memid));
+			return false;
 
 		// Group eligible ports by clock domain and width.
 
 		pool<int> checked_ports;
-		std::vector<std::vector<int>> groups;
 		for (int i = 0; i < GetSize(mem.wr_ports); i++)
 		{
 			auto &port1 = mem.wr_ports[i];
@@ -361,6 +454,14 @@ struct MemoryShareWorker
 			groups.push_back(group);
 		}
 
+		return true;
+	}
+
+	void consolidate_wr_using_sat(Mem &mem, const std::vector<std::vector<int>> &groups,
+			const std::map<wr_group_key_t, int> &plan_index, const std::vector<WrMergePlan> &plans)
+	{
+		log("Consolidating write ports of memory %s.%s using sat-based resource sharing:\n", log_id(module), log_id(mem.memid));
+
 		bool changed = false;
 		for (auto &group : groups) {
 			auto &some_port = mem.wr_ports[group[0]];
@@ -376,86 +477,80 @@ struct MemoryShareWorker
 				log("  Checking group clocked with %sedge %s, width %d: ports %s.\n", some_port.clk_polarity ? "pos" : "neg", log_signal(some_port.clk), mem.width << some_port.wide_log2, ports.c_str());
 			}
 
-			// Okay, time to actually run the SAT solver.
-
-			QuickConeSat qcsat(modwalker);
-
-			// create SAT representation of common input cone of all considered EN signals
-
-			dict<int, int> port_to_sat_variable;
-
-			for (auto idx : group)
-				port_to_sat_variable[idx] = qcsat.ez->expression(qcsat.ez->OpOr, qcsat.importSig(mem.wr_ports[idx].en));
-
-			qcsat.prepare();
-
-			log("  Common input cone for all EN signals: %d cells.\n", GetSize(qcsat.imported_cells));
+			// Okay, time to actually run the SAT solver. The plans were
+			// computed upfront from the EN signals before any merge; merging
+			// an earlier group may have changed them (when emulating port
+			// priorities), and then the plan is computed here.
+
+			WrMergePlan local_plan;
+			const WrMergePlan *plan = nullptr;
+			wr_group_key_t group_key = wr_group_key(mem, group);
+			auto it = plan_index.find(group_key);
+			if (it != plan_index.end()) {
+				plan = &plans[it->second];
+			} else {
+				local_plan = plan_wr_merge(group_key);
+				plan = &local_plan;
+			}
 
-			log("  Size of unconstrained SAT problem: %d variables, %d clauses\n", qcsat.ez->numCnfVariables(), qcsat.ez->numCnfClauses());
+			log("  Common input cone for all EN signals: %d cells.\n", plan->num_cells);
 
-			// now try merging the ports.
+			log("  Size of unconstrained SAT problem: %d variables, %d clauses\n", plan->num_vars, plan->num_clauses);
 
-			for (int ii = 0; ii < GetSize(group); ii++) {
-				int idx1 = group[ii];
+			for (auto &step : plan->steps) {
+				int idx1 = group[std::get<0>(step)];
+				int idx2 = group[std::get<1>(step)];
 				auto &port1 = mem.wr_ports[idx1];
-				if (port1.removed)
-					continue;
-				for (int jj = ii + 1; jj < GetSize(group); jj++) {
-					int idx2 = group[jj];
-					auto &port2 = mem.wr_ports[idx2];
-					if (port2.removed)
-						continue;
+				auto &port2 = mem.wr_ports[idx2];
 
-					if (qcsat.ez->solve(port_to_sat_variable.at(idx1), port_to_sat_variable.at(idx2))) {
-						log("  According to SAT solver sharing of port %d with port %d is not possible.\n", idx1, idx2);
-						continue;
-					}
+				if (!std::get<2>(step)) {
+					log("  According to SAT solver sharing of port %d with port %d is not possible.\n", idx1, idx2);
+					continue;
+				}
 
-					log("  Merging port %d into port %d.\n", idx2, idx1);
-					mem.prepare_wr_merge(idx1, idx2, &initvals);
-					port_to_sat_variable.at(idx1) = qcsat.ez->OR(port_to_sat_variable.at(idx1), port_to_sat_variable.at(idx2));
+				log("  Merging port %d into port %d.\n", idx2, idx1);
+				mem.prepare_wr_merge(idx1, idx2, &initvals);
 
-					RTLIL::SigSpec last_addr = port1.addr;
-					RTLIL::SigSpec last_data = port1.data;
-					std::vector<RTLIL::SigBit> last_en = modwalker.sigmap(port1.en);
+				RTLIL::SigSpec last_addr = port1.addr;
+				RTLIL::SigSpec last_data = port1.data;
+				std::vector<RTLIL::SigBit> last_en = modwalker.sigmap(port1.en);
 
-					RTLIL::SigSpec this_addr = port2.addr;
-					RTLIL::SigSpec this_data = port2.data;
-					std::vector<RTLIL::SigBit> this_en = modwalker.sigmap(port2.en);
+				RTLIL::SigSpec this_addr = port2.addr;
+				RTLIL::SigSpec this_data = port2.data;
+				std::vector<RTLIL::SigBit> this_en = modwalker.sigmap(port2.en);
 
-					RTLIL::SigBit this_en_active = module->ReduceOr(NEW_ID, this_en);
+				RTLIL::SigBit this_en_active = module->ReduceOr(NEW_ID, this_en);
 
-					if (GetSize(last_addr) < GetSize(this_addr))
-						last_addr.extend_u0(GetSize(this_addr));
-					else
-						this_addr.extend_u0(GetSize(last_addr));
+				if (GetSize(last_addr) < GetSize(this_addr))
+					last_addr.extend_u0(GetSize(this_addr));
+				else
+					this_addr.extend_u0(GetSize(last_addr));
 
-					SigSpec new_addr = module->Mux(NEW_ID, last_addr.extract_end(port1.wide_log2), this_addr.extract_end(port1.wide_log2), this_en_active);
+				SigSpec new_addr = module->Mux(NEW_ID, last_addr.extract_end(port1.wide_log2), this_addr.extract_end(port1.wide_log2), this_en_active);
 
-					port1.addr = SigSpec({new_addr, port1.addr.extract(0, port1.wide_log2)});
-					port1.data = module->Mux(NEW_ID, last_data, this_data, this_en_active);
+				port1.addr = SigSpec({new_addr, port1.addr.extract(0, port1.wide_log2)});
+				port1.data = module->Mux(NEW_ID, last_data, this_data, this_en_active);
 
-					std::map<std::pair<RTLIL::SigBit, RTLIL::SigBit>, int> groups_en;
-					RTLIL::SigSpec grouped_last_en, grouped_this_en, en;
-					RTLIL::Wire *grouped_en = module->addWire(NEW_ID, 0);
+				std::map<std::pair<RTLIL::SigBit, RTLIL::SigBit>, int> groups_en;
+				RTLIL::SigSpec grouped_last_en, grouped_this_en, en;
+				RTLIL::Wire *grouped_en = module->addWire(NEW_ID, 0);
 
-					for (int j = 0; j < int(this_en.size()); j++) {
-						std::pair<RTLIL::SigBit, RTLIL::SigBit> key(last_en[j], this_en[j]);
-						if (!groups_en.count(key)) {
-							grouped_last_en.append(last_en[j]);
-							grouped_this_en.append(this_en[j]);
-							groups_en[key] = grouped_en->width;
-							grouped_en->width++;
-						}
-						en.append(RTLIL::SigSpec(grouped_en, groups_en[key]));
+				for (int j = 0; j < int(this_en.size()); j++) {
+					std::pair<RTLIL::SigBit, RTLIL::SigBit> key(last_en[j], this_en[j]);
+					if (!groups_en.count(key)) {
+						grouped_last_en.append(last_en[j]);
+						grouped_this_en.append(this_en[j]);
+						groups_en[key] = grouped_en->width;
+						grouped_en->width++;
 					}
+					en.append(RTLIL::SigSpec(grouped_en, groups_en[key]));
+				}
 
-					module->addMux(NEW_ID, grouped_last_en, grouped_this_en, this_en_active, grouped_en);
-					port1.en = en;
+				module->addMux(NEW_ID, grouped_last_en, grouped_this_en, this_en_active, grouped_en);
+				port1.en = en;
 
-					port2.removed = true;
-					changed = true;
-				}
+				port2.removed = true;
+				changed = true;
 			}
 		}
 
@@ -503,8 +598,36 @@ struct MemoryShareWorker
 
 		modwalker.setup(module);
 
-		for (auto &mem : memories)
-			consolidate_wr_using_sat(mem);
+		// The SAT queries of all groups only read the module, so they are
+		// run upfront, in parallel and once per distinct set of EN signals.
+		// The ports are merged afterwards in the original order.
+		std::vector<bool> mem_eligible;
+		std::vector<std::vector<std::vector<int>>> mem_groups(GetSize(memories));
+		std::map<wr_group_key_t, int> plan_index;
+		std::vector<wr_group_key_t> plan_keys;
+
+		for (int i = 0; i < GetSize(memories); i++) {
+			mem_eligible.push_back(find_wr_groups(memories[i], mem_groups[i]));
+			for (auto &group : mem_groups[i]) {
+				wr_group_key_t key = wr_group_key(memories[i], group);
+				if (plan_index.count(key))
+					continue;
+				plan_index[key] = GetSize(plan_keys);
+				plan_keys.push_back(key);
+			}
+		}
+
+		std::vector<WrMergePlan> plans(GetSize(plan_keys));
+		int num_threads = yosys_thread_count(GetSize(plan_keys));
+		if (num_threads > 1)
+			modwalker.sigmap.compress();
+		ThreadPool::run(GetSize(plan_keys), [&](int i) {
+			plans[i] = plan_wr_merge(plan_keys[i]);
+		}, num_threads);
+
+		for (int i = 0; i < GetSize(memories); i++)
+			if (mem_eligible[i])
+				consolidate_wr_using_sat(memories[i], mem_groups[i], plan_index, plans);
 	}
 };
 
@@ -558,8 +681,10 @@ struct MemorySharePass : public Pass {
 		extra_args(args, argidx, design);
 		MemoryShareWorker msw(design, flag_widen, flag_sat);
 
-		for (auto module : design->selected_modules())
+		for (auto module : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(module);
 			msw(module);
+		}
 	}
 } MemorySharePass;
 
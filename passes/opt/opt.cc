@@ -18,13 +18,223 @@
  */
 
 #include "kernel/register.h"
+#include "kernel/modtools.h"
+#include "kernel/sigtools.h"
 #include "kernel/log.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <atomic>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// Records which cells and signals are changed by the opt_* passes, for
+// "opt -incremental". Objects are recorded by name, as they may be removed
+// before the changes are collected.
+struct OptChangeMonitor : public RTLIL::Monitor
+{
+	struct PendingChanges {
+		bool whole_module = false;
+		pool<RTLIL::IdString> cells;
+		pool<std::pair<RTLIL::IdString, int>> bits;
+	};
+
+	RTLIL::Design *design;
+
+	// One entry per module, created by reset(), so that passes processing
+	// different modules in parallel never modify the map itself.
+	std::map<RTLIL::Module*, PendingChanges> pending;
+	std::atomic<bool> modules_added;
+
+	// Collected changes: modules that changed at all, and the cells that
+	// are connected to a changed cell or signal
+	pool<RTLIL::IdString> changed_modules, whole_modules;
+	dict<RTLIL::IdString, pool<RTLIL::IdString>> changed_cells;
+
+	OptChangeMonitor(RTLIL::Design *design) : design(design), modules_added(false)
+	{
+		design->monitors.insert(this);
+	}
+
+	~OptChangeMonitor()
+	{
+		design->monitors.erase(this);
+	}
+
+	bool thread_safe() const override { return true; }
+
+	void reset()
+	{
+		pending.clear();
+		for (auto module : design->modules())
+			pending[module];
+		modules_added = false;
+		changed_modules.clear();
+		whole_modules.clear();
+		changed_cells.clear();
+	}
+
+	PendingChanges *lookup(RTLIL::Module *module)
+	{
+		auto it = pending.find(module);
+		if (it == pending.end() || it->second.whole_module)
+			return nullptr;
+		return &it->second;
+	}
+
+	void add_bits(PendingChanges *pc, const RTLIL::SigSpec &sig)
+	{
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire != nullptr)
+				for (int i = 0; i < chunk.width; i++)
+					pc->bits.insert(std::make_pair(chunk.wire->name, chunk.offset + i));
+	}
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString&, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override
+	{
+		PendingChanges *pc = lookup(cell->module);
+		if (pc == nullptr)
+			return;
+		pc->cells.insert(cell->name);
+		add_bits(pc, old_sig);
+		add_bits(pc, sig);
+	}
+
+	void notify_connect(RTLIL::Module *module, const RTLIL::SigSig &sigsig) override
+	{
+		PendingChanges *pc = lookup(module);
+		if (pc == nullptr)
+			return;
+		add_bits(pc, sigsig.first);
+		add_bits(pc, sigsig.second);
+	}
+
+	void notify_connect(RTLIL::Module *module, const std::vector<RTLIL::SigSig>&) override
+	{
+		auto it = pending.find(module);
+		if (it != pending.end())
+			it->second.whole_module = true;
+	}
+
+	void notify_blackout(RTLIL::Module *module) override
+	{
+		auto it = pending.find(module);
+		if (it != pending.end())
+			it->second.whole_module = true;
+	}
+
+	void notify_module_add(RTLIL::Module*) override
+	{
+		modules_added = true;
+	}
+
+	// Resolves the pending changes to the cells affected by them. This is
+	// called before opt_clean removes and renames wires, and at the end of
+	// each iteration.
+	void collect()
+	{
+		for (auto module : design->modules())
+		{
+			auto it = pending.find(module);
+			if (it == pending.end()) {
+				if (modules_added) {
+					changed_modules.insert(module->name);
+					whole_modules.insert(module->name);
+				}
+				continue;
+			}
+
+			PendingChanges &pc = it->second;
+			if (pc.whole_module) {
+				changed_modules.insert(module->name);
+				whole_modules.insert(module->name);
+				pc = PendingChanges();
+				continue;
+			}
+			if (pc.cells.empty() && pc.bits.empty())
+				continue;
+
+			changed_modules.insert(module->name);
+			SigMap sigmap(module);
+			pool<RTLIL::SigBit> bits;
+
+			auto add_bit = [&](RTLIL::SigBit bit) {
+				bits.insert(bit);
+				bits.insert(sigmap(bit));
+			};
+
+			for (auto &it : pc.bits) {
+				RTLIL::Wire *wire = module->wire(it.first);
+				if (wire != nullptr && it.second < wire->width)
+					add_bit(RTLIL::SigBit(wire, it.second));
+			}
+			for (auto &name : pc.cells) {
+				RTLIL::Cell *cell = module->cell(name);
+				if (cell != nullptr)
+					for (auto &conn : cell->connections())
+						for (auto bit : conn.second)
+							if (bit.wire != nullptr)
+								add_bit(bit);
+			}
+
+			pool<RTLIL::IdString> &cells = changed_cells[module->name];
+			for (auto cell : module->cells()) {
+				bool found = pc.cells.count(cell->name) != 0;
+				for (auto &conn : cell->connections()) {
+					if (found)
+						break;
+					for (auto bit : conn.second)
+						if (bit.wire != nullptr && (bits.count(bit) || bits.count(sigmap(bit)))) {
+							found = true;
+							break;
+						}
+				}
+				if (found)
+					cells.insert(cell->name);
+			}
+
+			pc = PendingChanges();
+		}
+	}
+
+	// Creates the selections for the next iteration from the collected
+	// changes, restricted to the given selection. Passes that only work on
+	// whole modules get all changed modules.
+	int make_selections(const RTLIL::Selection &orig, RTLIL::Selection &cell_sel, RTLIL::Selection &module_sel)
+	{
+		int num_cells = 0;
+		cell_sel = RTLIL::Selection(false);
+		module_sel = RTLIL::Selection(false);
+
+		for (auto module : design->modules())
+		{
+			if (!changed_modules.count(module->name) || !orig.selected_module(module->name))
+				continue;
+
+			bool orig_whole = orig.selected_whole_module(module->name);
+			if (orig_whole)
+				module_sel.selected_modules.insert(module->name);
+
+			if (whole_modules.count(module->name)) {
+				if (orig_whole)
+					cell_sel.selected_modules.insert(module->name);
+				else
+					cell_sel.selected_members[module->name] = orig.selected_members.at(module->name);
+				num_cells += GetSize(module->cells());
+				continue;
+			}
+
+			for (auto &name : changed_cells[module->name])
+				if (orig.selected_member(module->name, name)) {
+					cell_sel.selected_members[module->name].insert(name);
+					num_cells++;
+				}
+		}
+
+		return num_cells;
+	}
+};
+
 struct OptPass : public Pass {
 	OptPass() : Pass("opt", "perform simple optimizations") { }
 	void help() override
@@ -62,6 +272,13 @@ struct OptPass : public Pass {
 		log("Note: Options in square brackets (such as [-keepdc]) are passed through to\n");
 		log("the opt_* commands when given to 'opt'.\n");
 		log("\n");
+		log("When called with -incremental, the passes in the loop only look at the cells\n");
+		log("that are connected to a cell or signal changed in the previous iteration. The\n");
+		log("passes that only work on whole modules (opt_muxtree and opt_clean) look at the\n");
+		log("changed modules. Once such an iteration does not change anything, the loop\n");
+		log("continues with an iteration on the whole selection, so that it still only\n");
+		log("ends when there is nothing left to do.\n");
+		log("\n");
 		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -74,6 +291,7 @@ struct OptPass : public Pass {
 		bool opt_share = false;
 		bool fast_mode = false;
 		bool noff_mode = false;
+		bool incremental = false;
 
 		log_header(design, "Executing OPT pass (performing simple optimizations).\n");
 		log_push();
@@ -141,22 +359,65 @@ struct OptPass : public Pass {
 				noff_mode = true;
 				continue;
 			}
+			if (args[argidx] == "-incremental") {
+				incremental = true;
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		// share the SigMap of each module between the opt_* passes below
+		ModCache modcache(design);
+
+		// with -incremental, the passes of an iteration are restricted to
+		// the cells around the changes of the previous one
+		std::unique_ptr<OptChangeMonitor> changes;
+		if (incremental)
+			changes.reset(new OptChangeMonitor(design));
+		RTLIL::Selection orig_sel = design->selection();
+		RTLIL::Selection cell_sel, module_sel;
+		bool scoped = false;
+
+		auto call = [&](std::string command, bool whole_modules) {
+			if (scoped)
+				design->selection_stack.push_back(whole_modules ? module_sel : cell_sel);
+			Pass::call(design, command);
+			if (scoped)
+				design->selection_stack.pop_back();
+		};
+
+		auto next_iteration = [&]() {
+			if (!changes)
+				return;
+			changes->collect();
+			int num_cells = changes->make_selections(orig_sel, cell_sel, module_sel);
+			scoped = true;
+			log("Restricting the next iteration to %d cells around the changes.\n", num_cells);
+		};
+
 		if (fast_mode)
 		{
 			while (1) {
-				Pass::call(design, "opt_expr" + opt_expr_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
+				if (changes)
+					changes->reset();
+				call("opt_expr" + opt_expr_args, false);
+				call("opt_merge" + opt_merge_args, false);
 				design->scratchpad_unset("opt.did_something");
 				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
-				if (design->scratchpad_get_bool("opt.did_something") == false)
-					break;
-				Pass::call(design, "opt_clean" + opt_clean_args);
+					call("opt_dff" + opt_dff_args, false);
+				if (design->scratchpad_get_bool("opt.did_something") == false) {
+					if (!scoped)
+						break;
+					scoped = false;
+					log_header(design, "Rerunning OPT passes on the whole selection.\n");
+					continue;
+				}
+				if (changes)
+					changes->collect();
+				call("opt_clean" + opt_clean_args, true);
 				log_header(design, "Rerunning OPT passes. (Removed registers in this run.)\n");
+				next_iteration();
 			}
 			Pass::call(design, "opt_clean" + opt_clean_args);
 		}
@@ -165,19 +426,29 @@ struct OptPass : public Pass {
 			Pass::call(design, "opt_expr" + opt_expr_args);
 			Pass::call(design, "opt_merge -nomux" + opt_merge_args);
 			while (1) {
+				if (changes)
+					changes->reset();
 				design->scratchpad_unset("opt.did_something");
-				Pass::call(design, "opt_muxtree");
-				Pass::call(design, "opt_reduce" + opt_reduce_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
+				call("opt_muxtree", true);
+				call("opt_reduce" + opt_reduce_args, false);
+				call("opt_merge" + opt_merge_args, false);
 				if (opt_share)
-					Pass::call(design, "opt_share");
+					call("opt_share", false);
 				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
-				Pass::call(design, "opt_clean" + opt_clean_args);
-				Pass::call(design, "opt_expr" + opt_expr_args);
-				if (design->scratchpad_get_bool("opt.did_something") == false)
-					break;
+					call("opt_dff" + opt_dff_args, false);
+				if (changes)
+					changes->collect();
+				call("opt_clean" + opt_clean_args, true);
+				call("opt_expr" + opt_expr_args, false);
+				if (design->scratchpad_get_bool("opt.did_something") == false) {
+					if (!scoped)
+						break;
+					scoped = false;
+					log_header(design, "Rerunning OPT passes on the whole selection.\n");
+					continue;
+				}
 				log_header(design, "Rerunning OPT passes. (Maybe there is more to do..)\n");
+				next_iteration();
 			}
 		}
 
@@ -19,12 +19,14 @@
 
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
+#include "kernel/modtools.h"
 #include "kernel/log.h"
 #include "kernel/celltypes.h"
 #include "kernel/ffinit.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <set>
+#include <atomic>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -36,16 +38,58 @@ struct keep_cache_t
 	Design *design;
 	dict<Module*, bool> cache;
 
+	// The cache is filled here for the selected modules and the modules
+	// they instantiate, so that queries from multiple threads only read it.
+	// Other modules are not visited, so that lazy modules stay unloaded.
 	void reset(Design *design = nullptr)
 	{
 		this->design = design;
 		cache.clear();
+		if (design == nullptr)
+			return;
+		cache.reserve(GetSize(design->modules_));
+		for (auto module : design->selected_modules())
+			compute(module);
 	}
 
-	bool query(Module *module)
+	bool query(Module *module) const
 	{
 		log_assert(design != nullptr);
 
+		if (module == nullptr)
+			return false;
+
+		auto it = cache.find(module);
+		log_assert(it != cache.end());
+		return it->second;
+	}
+
+	bool query(Cell *cell, bool ignore_specify = false) const
+	{
+		if (cell->type.in(ID($assert), ID($assume), ID($live), ID($fair), ID($cover)))
+			return true;
+
+		if (cell->type.in(ID($overwrite_tag)))
+			return true;
+
+		if (!ignore_specify && cell->type.in(ID($specify2), ID($specify3), ID($specrule)))
+			return true;
+
+		if (cell->type == ID($print) || cell->type == ID($check))
+			return true;
+
+		if (cell->has_keep_attr())
+			return true;
+
+		if (cell->module && cell->module->design)
+			return query(cell->module->design->module(cell->type));
+
+		return false;
+	}
+
+private:
+	bool compute(Module *module)
+	{
 		if (module == nullptr)
 			return false;
 
@@ -56,7 +100,7 @@ struct keep_cache_t
 		if (!module->get_bool_attribute(ID::keep)) {
 		    bool found_keep = false;
 		    for (auto cell : module->cells())
-			if (query(cell, true /* ignore_specify */)) {
+			if (compute(cell)) {
 			    found_keep = true;
 			    break;
 			}
@@ -71,7 +115,9 @@ struct keep_cache_t
 		return cache[module];
 	}
 
-	bool query(Cell *cell, bool ignore_specify = false)
+	// same as query(cell, true), but computes the result for the module
+	// of the cell type if needed
+	bool compute(Cell *cell)
 	{
 		if (cell->type.in(ID($assert), ID($assume), ID($live), ID($fair), ID($cover)))
 			return true;
@@ -79,9 +125,6 @@ struct keep_cache_t
 		if (cell->type.in(ID($overwrite_tag)))
 			return true;
 
-		if (!ignore_specify && cell->type.in(ID($specify2), ID($specify3), ID($specrule)))
-			return true;
-
 		if (cell->type == ID($print) || cell->type == ID($check))
 			return true;
 
@@ -89,48 +132,111 @@ struct keep_cache_t
 			return true;
 
 		if (cell->module && cell->module->design)
-			return query(cell->module->design->module(cell->type));
+			return compute(cell->module->design->module(cell->type));
 
 		return false;
 	}
 };
 
+// Dense numbering of the wire bits of a module, so that sets of signals can
+// be kept in bit vectors instead of pools.
+struct WireBitIndex
+{
+	dict<RTLIL::Wire*, int> offsets;
+	int size = 0;
+
+	WireBitIndex(RTLIL::Module *module)
+	{
+		offsets.reserve(GetSize(module->wires_));
+		for (auto wire : module->wires()) {
+			offsets[wire] = size;
+			size += wire->width;
+		}
+	}
+};
+
+// A set of wire bits of a module. Like SigPool, constant bits are never in
+// the set.
+struct WireBitSet
+{
+	const WireBitIndex *index;
+	std::vector<bool> bits;
+
+	WireBitSet(const WireBitIndex &index) : index(&index), bits(index.size) { }
+
+	void add(const RTLIL::SigSpec &sig)
+	{
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire != nullptr) {
+				int base = index->offsets.at(chunk.wire) + chunk.offset;
+				for (int i = 0; i < chunk.width; i++)
+					bits[base + i] = true;
+			}
+	}
+
+	bool check(const RTLIL::SigBit &bit) const
+	{
+		return bit.wire != nullptr && bits[index->offsets.at(bit.wire) + bit.offset];
+	}
+
+	bool check_any(const RTLIL::SigSpec &sig) const
+	{
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire != nullptr) {
+				int base = index->offsets.at(chunk.wire) + chunk.offset;
+				for (int i = 0; i < chunk.width; i++)
+					if (bits[base + i])
+						return true;
+			}
+		return false;
+	}
+
+	bool check_all(const RTLIL::SigSpec &sig) const
+	{
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire != nullptr) {
+				int base = index->offsets.at(chunk.wire) + chunk.offset;
+				for (int i = 0; i < chunk.width; i++)
+					if (!bits[base + i])
+						return false;
+			}
+		return true;
+	}
+};
+
 keep_cache_t keep_cache;
 CellTypes ct_reg, ct_all;
-int count_rm_cells, count_rm_wires;
+std::atomic<int> count_rm_cells, count_rm_wires;
 
-void rmunused_module_cells(Module *module, bool verbose)
+bool rmunused_module_cells(Module *module, bool verbose)
 {
-	SigMap sigmap(module);
-	dict<IdString, pool<Cell*>> mem2cells;
-	pool<IdString> mem_unused;
-	pool<Cell*> queue, unused;
-	pool<SigBit> used_raw_bits;
-	dict<SigBit, pool<Cell*>> wire2driver;
-	dict<SigBit, vector<string>> driver_driver_logs;
+	SigMap sigmap = ModCache::get_sigmap(module);
 	FfInitVals ffinit(&sigmap, module);
 
-	SigMap raw_sigmap;
-	for (auto &it : module->connections_) {
-		for (int i = 0; i < GetSize(it.second); i++) {
-			if (it.second[i].wire != nullptr)
-				raw_sigmap.add(it.first[i], it.second[i]);
-		}
-	}
+	// Cells and driven signal bits get dense ids, so that the liveness of
+	// cells is tracked in a bit vector and the traversal below does not need
+	// any hash lookups.
+	std::vector<Cell*> cells;
+	cells.reserve(GetSize(module->cells_));
+	for (auto &it : module->cells_)
+		cells.push_back(it.second);
+
+	dict<SigBit, int> driven_bits;
+	std::vector<std::vector<int>> bit_drivers;
+	dict<SigBit, vector<string>> driver_driver_logs;
+	dict<IdString, std::vector<int>> mem2cells;
+	pool<IdString> mem_unused;
 
 	for (auto &it : module->memories) {
 		mem_unused.insert(it.first);
 	}
 
-	for (Cell *cell : module->cells()) {
+	for (int i = 0; i < GetSize(cells); i++) {
+		Cell *cell = cells[i];
 		if (cell->type.in(ID($memwr), ID($memwr_v2), ID($meminit), ID($meminit_v2))) {
 			IdString mem_id = cell->getParam(ID::MEMID).decode_string();
-			mem2cells[mem_id].insert(cell);
+			mem2cells[mem_id].push_back(i);
 		}
-	}
-
-	for (auto &it : module->cells_) {
-		Cell *cell = it.second;
 		for (auto &it2 : cell->connections()) {
 			if (ct_all.cell_known(cell->type) && !ct_all.cell_output(cell->type, it2.first))
 				continue;
@@ -139,68 +245,96 @@ void rmunused_module_cells(Module *module, bool verbose)
 					continue;
 				auto bit = sigmap(raw_bit);
 				if (bit.wire == nullptr && ct_all.cell_known(cell->type))
-					driver_driver_logs[raw_sigmap(raw_bit)].push_back(stringf("Driver-driver conflict "
+					driver_driver_logs[raw_bit].push_back(stringf("Driver-driver conflict "
 							"for %s between cell %s.%s and constant %s in %s: Resolved using constant.",
 							log_signal(raw_bit), log_id(cell), log_id(it2.first), log_signal(bit), log_id(module)));
-				if (bit.wire != nullptr)
-					wire2driver[bit].insert(cell);
+				if (bit.wire != nullptr) {
+					auto r = driven_bits.insert(std::make_pair(bit, GetSize(bit_drivers)));
+					if (r.second)
+						bit_drivers.emplace_back();
+					auto &drivers = bit_drivers[r.first->second];
+					if (drivers.empty() || drivers.back() != i)
+						drivers.push_back(i);
+				}
 			}
 		}
-		if (keep_cache.query(cell))
-			queue.insert(cell);
-		else
-			unused.insert(cell);
 	}
 
+	// the driven bits read by each cell
+	std::vector<int> cell_inputs, cell_inputs_start;
+	cell_inputs_start.reserve(GetSize(cells) + 1);
+	for (auto cell : cells) {
+		cell_inputs_start.push_back(GetSize(cell_inputs));
+		for (auto &it : cell->connections())
+			if (!ct_all.cell_known(cell->type) || ct_all.cell_input(cell->type, it.first))
+				for (auto bit : sigmap(it.second)) {
+					auto it2 = driven_bits.find(bit);
+					if (it2 != driven_bits.end())
+						cell_inputs.push_back(it2->second);
+				}
+	}
+	cell_inputs_start.push_back(GetSize(cell_inputs));
+
+	std::vector<bool> live_cells(GetSize(cells)), live_bits(GetSize(bit_drivers));
+	std::vector<int> queue;
+
+	auto mark_cell = [&](int i) {
+		if (!live_cells[i]) {
+			live_cells[i] = true;
+			queue.push_back(i);
+		}
+	};
+
+	auto mark_bit = [&](int b) {
+		if (!live_bits[b]) {
+			live_bits[b] = true;
+			for (int i : bit_drivers[b])
+				mark_cell(i);
+		}
+	};
+
+	for (int i = 0; i < GetSize(cells); i++)
+		if (keep_cache.query(cells[i]))
+			mark_cell(i);
+
 	for (auto &it : module->wires_) {
 		Wire *wire = it.second;
-		if (wire->port_output || wire->get_bool_attribute(ID::keep)) {
-			for (auto bit : sigmap(wire))
-			for (auto c : wire2driver[bit])
-				queue.insert(c), unused.erase(c);
-			for (auto raw_bit : SigSpec(wire))
-				used_raw_bits.insert(raw_sigmap(raw_bit));
-		}
+		if (wire->port_output || wire->get_bool_attribute(ID::keep))
+			for (auto bit : sigmap(wire)) {
+				auto it2 = driven_bits.find(bit);
+				if (it2 != driven_bits.end())
+					mark_bit(it2->second);
+			}
 	}
 
 	while (!queue.empty())
 	{
-		pool<SigBit> bits;
-		pool<IdString> mems;
-		for (auto cell : queue) {
-			for (auto &it : cell->connections())
-				if (!ct_all.cell_known(cell->type) || ct_all.cell_input(cell->type, it.first))
-					for (auto bit : sigmap(it.second))
-						bits.insert(bit);
-
-			if (cell->type.in(ID($memrd), ID($memrd_v2))) {
-				IdString mem_id = cell->getParam(ID::MEMID).decode_string();
-				if (mem_unused.count(mem_id)) {
-					mem_unused.erase(mem_id);
-					mems.insert(mem_id);
-				}
-			}
-		}
+		int i = queue.back();
+		queue.pop_back();
 
-		queue.clear();
+		for (int k = cell_inputs_start[i]; k < cell_inputs_start[i+1]; k++)
+			mark_bit(cell_inputs[k]);
 
-		for (auto bit : bits)
-		for (auto c : wire2driver[bit])
-			if (unused.count(c))
-				queue.insert(c), unused.erase(c);
-
-		for (auto mem : mems)
-		for (auto c : mem2cells[mem])
-			if (unused.count(c))
-				queue.insert(c), unused.erase(c);
+		Cell *cell = cells[i];
+		if (cell->type.in(ID($memrd), ID($memrd_v2))) {
+			IdString mem_id = cell->getParam(ID::MEMID).decode_string();
+			if (mem_unused.count(mem_id)) {
+				mem_unused.erase(mem_id);
+				for (int c : mem2cells[mem_id])
+					mark_cell(c);
+			}
+		}
 	}
 
-	unused.sort(RTLIL::sort_by_name_id<RTLIL::Cell>());
+	std::vector<Cell*> unused;
+	for (int i = 0; i < GetSize(cells); i++)
+		if (!live_cells[i])
+			unused.push_back(cells[i]);
+	std::sort(unused.begin(), unused.end(), RTLIL::sort_by_name_id<RTLIL::Cell>());
 
 	for (auto cell : unused) {
 		if (verbose)
 			log_debug("  removing unused `%s' cell `%s'.\n", cell->type.c_str(), cell->name.c_str());
-		module->design->scratchpad_set_bool("opt.did_something", true);
 		if (RTLIL::builtin_ff_cell_types().count(cell->type))
 			ffinit.remove_init(cell->getPort(ID::Q));
 		module->remove(cell);
@@ -215,21 +349,43 @@ void rmunused_module_cells(Module *module, bool verbose)
 		module->memories.erase(it);
 	}
 
-	for (auto &it : module->cells_) {
-		Cell *cell = it.second;
-		for (auto &it2 : cell->connections()) {
-			if (ct_all.cell_known(cell->type) && !ct_all.cell_input(cell->type, it2.first))
-				continue;
-			for (auto raw_bit : raw_sigmap(it2.second))
-				used_raw_bits.insert(raw_bit);
+	// driver-driver conflicts are only reported for signals that are used
+	if (!driver_driver_logs.empty())
+	{
+		SigMap raw_sigmap;
+		for (auto &it : module->connections_) {
+			for (int i = 0; i < GetSize(it.second); i++) {
+				if (it.second[i].wire != nullptr)
+					raw_sigmap.add(it.first[i], it.second[i]);
+			}
+		}
+
+		pool<SigBit> used_raw_bits;
+		for (auto &it : module->wires_) {
+			Wire *wire = it.second;
+			if (wire->port_output || wire->get_bool_attribute(ID::keep))
+				for (auto raw_bit : SigSpec(wire))
+					used_raw_bits.insert(raw_sigmap(raw_bit));
+		}
+
+		for (auto &it : module->cells_) {
+			Cell *cell = it.second;
+			for (auto &it2 : cell->connections()) {
+				if (ct_all.cell_known(cell->type) && !ct_all.cell_input(cell->type, it2.first))
+					continue;
+				for (auto raw_bit : raw_sigmap(it2.second))
+					used_raw_bits.insert(raw_bit);
+			}
 		}
-	}
 
-	for (auto it : driver_driver_logs) {
-		if (used_raw_bits.count(it.first))
-			for (auto msg : it.second)
-				log_warning("%s\n", msg.c_str());
+		for (auto it : driver_driver_logs) {
+			if (used_raw_bits.count(raw_sigmap(it.first)))
+				for (auto msg : it.second)
+					log_warning("%s\n", msg.c_str());
+		}
 	}
+
+	return !unused.empty();
 }
 
 int count_nontrivial_wire_attrs(RTLIL::Wire *w)
@@ -241,7 +397,7 @@ int count_nontrivial_wire_attrs(RTLIL::Wire *w)
 }
 
 // Should we pick `s2` over `s1` to represent a signal?
-bool compare_signals(RTLIL::SigBit &s1, RTLIL::SigBit &s2, SigPool &regs, SigPool &conns, pool<RTLIL::Wire*> &direct_wires)
+bool compare_signals(RTLIL::SigBit &s1, RTLIL::SigBit &s2, const WireBitSet &regs, const WireBitSet &conns, pool<RTLIL::Wire*> &direct_wires)
 {
 	RTLIL::Wire *w1 = s1.wire;
 	RTLIL::Wire *w2 = s2.wire;
@@ -260,8 +416,8 @@ bool compare_signals(RTLIL::SigBit &s1, RTLIL::SigBit &s2, SigPool &regs, SigPoo
 			return regs.check(s2);
 		if (direct_wires.count(w1) != direct_wires.count(w2))
 			return direct_wires.count(w2) != 0;
-		if (conns.check_any(s1) != conns.check_any(s2))
-			return conns.check_any(s2);
+		if (conns.check(s1) != conns.check(s2))
+			return conns.check(s2);
 	}
 
 	if (w1->port_output != w2->port_output)
@@ -293,10 +449,12 @@ bool check_public_name(RTLIL::IdString id)
 
 bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbose)
 {
+	WireBitIndex index(module);
+
 	// `register_signals` and `connected_signals` will help us decide later on
 	// on picking representatives out of groups of connected signals
-	SigPool register_signals;
-	SigPool connected_signals;
+	WireBitSet register_signals(index);
+	WireBitSet connected_signals(index);
 	if (!purge_mode)
 		for (auto &it : module->cells_) {
 			RTLIL::Cell *cell = it.second;
@@ -310,7 +468,7 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 				connected_signals.add(it2.second);
 		}
 
-	SigMap assign_map(module);
+	SigMap assign_map = ModCache::get_sigmap(module);
 
 	// construct a pool of wires which are directly driven by a known celltype,
 	// this will influence our choice of representatives
@@ -344,12 +502,17 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 	// we are removing all connections
 	module->connections_.clear();
 
+	// the connections and cell ports are rewritten below without notifying monitors
+	ModCache *modcache = ModCache::find(module->design);
+	if (modcache != nullptr)
+		modcache->invalidate(module);
+
 	// used signals sigmapped
-	SigPool used_signals;
+	WireBitSet used_signals(index);
 	// used signals pre-sigmapped
-	SigPool raw_used_signals;
+	WireBitSet raw_used_signals(index);
 	// used signals sigmapped, ignoring drivers (we keep track of this to set `unused_bits`)
-	SigPool used_signals_nodrivers;
+	WireBitSet used_signals_nodrivers(index);
 
 	// gather the usage information for cells
 	for (auto &it : module->cells_) {
@@ -507,9 +670,6 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 	if (verbose && del_temp_wires_count)
 		log_debug("  removed %d unused temporary wires.\n", del_temp_wires_count);
 
-	if (!del_wires_queue.empty())
-		module->design->scratchpad_set_bool("opt.did_something", true);
-
 	return !del_wires_queue.empty();
 }
 
@@ -588,13 +748,10 @@ bool rmunused_module_init(RTLIL::Module *module, bool verbose)
 	next_wire:;
 	}
 
-	if (did_something)
-		module->design->scratchpad_set_bool("opt.did_something", true);
-
 	return did_something;
 }
 
-void rmunused_module(RTLIL::Module *module, bool purge_mode, bool verbose, bool rminit)
+bool rmunused_module(RTLIL::Module *module, bool purge_mode, bool verbose, bool rminit)
 {
 	if (verbose)
 		log("Finding unused cells or wires in module %s..\n", module->name.c_str());
@@ -615,14 +772,19 @@ void rmunused_module(RTLIL::Module *module, bool purge_mode, bool verbose, bool
 					log_signal(cell->getPort(ID::Y)), log_signal(cell->getPort(ID::A)));
 		module->remove(cell);
 	}
-	if (!delcells.empty())
-		module->design->scratchpad_set_bool("opt.did_something", true);
+	bool did_something = !delcells.empty();
 
-	rmunused_module_cells(module, verbose);
-	while (rmunused_module_signals(module, purge_mode, verbose)) { }
+	if (rmunused_module_cells(module, verbose))
+		did_something = true;
+	while (rmunused_module_signals(module, purge_mode, verbose))
+		did_something = true;
 
-	if (rminit && rmunused_module_init(module, verbose))
+	if (rminit && rmunused_module_init(module, verbose)) {
+		did_something = true;
 		while (rmunused_module_signals(module, purge_mode, verbose)) { }
+	}
+
+	return did_something;
 }
 
 struct OptCleanPass : public Pass {
@@ -672,14 +834,23 @@ struct OptCleanPass : public Pass {
 		count_rm_cells = 0;
 		count_rm_wires = 0;
 
+		std::vector<RTLIL::Module*> modules;
 		for (auto module : design->selected_whole_modules_warn()) {
 			if (module->has_processes_warn())
 				continue;
-			rmunused_module(module, purge_mode, true, true);
+			modules.push_back(module);
 		}
 
+		std::atomic<bool> did_something(false);
+		execute_modules(design, modules, [&](RTLIL::Module *module) {
+			if (rmunused_module(module, purge_mode, true, true))
+				did_something = true;
+		});
+		if (did_something)
+			design->scratchpad_set_bool("opt.did_something", true);
+
 		if (count_rm_cells > 0 || count_rm_wires > 0)
-			log("Removed %d unused cells and %d unused wires.\n", count_rm_cells, count_rm_wires);
+			log("Removed %d unused cells and %d unused wires.\n", count_rm_cells.load(), count_rm_wires.load());
 
 		design->optimize();
 		design->sort();
@@ -734,15 +905,24 @@ struct CleanPass : public Pass {
 		count_rm_cells = 0;
 		count_rm_wires = 0;
 
+		std::vector<RTLIL::Module*> modules;
 		for (auto module : design->selected_whole_modules()) {
 			if (module->has_processes())
 				continue;
-			rmunused_module(module, purge_mode, ys_debug(), true);
+			modules.push_back(module);
 		}
 
+		std::atomic<bool> did_something(false);
+		execute_modules(design, modules, [&](RTLIL::Module *module) {
+			if (rmunused_module(module, purge_mode, ys_debug(), true))
+				did_something = true;
+		});
+		if (did_something)
+			design->scratchpad_set_bool("opt.did_something", true);
+
 		log_suppressed();
 		if (count_rm_cells > 0 || count_rm_wires > 0)
-			log("Removed %d unused cells and %d unused wires.\n", count_rm_cells, count_rm_wires);
+			log("Removed %d unused cells and %d unused wires.\n", count_rm_cells.load(), count_rm_wires.load());
 
 		design->optimize();
 		design->sort();
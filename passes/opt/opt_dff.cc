@@ -26,6 +26,8 @@
 #include "kernel/sigtools.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
+#include "kernel/profiler.h"
+#include "kernel/threading.h"
 #include "passes/techmap/simplemap.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -43,6 +45,22 @@ struct OptDffOptions
 	bool keepdc;
 };
 
+static uint64_t constbit_hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// The results of the SAT queries of the previous opt_dff -sat call on each
+// module, keyed by the hashidx_ of the module and the fingerprint of the
+// query (see OptDffWorker::constbit_key()). Each call replaces the entry of
+// the module with the queries it asked.
+static dict<unsigned int, dict<uint64_t, bool>> constbit_cache;
+
 struct OptDffWorker
 {
 	const OptDffOptions &opt;
@@ -62,7 +80,7 @@ struct OptDffWorker
 	// Used as a queue.
 	std::vector<Cell *> dff_cells;
 
-	OptDffWorker(const OptDffOptions &opt, Module *mod) : opt(opt), module(mod), sigmap(mod), initvals(&sigmap, mod) {
+	OptDffWorker(const OptDffOptions &opt, Module *mod) : opt(opt), module(mod), sigmap(ModCache::get_sigmap(mod)), initvals(&sigmap, mod) {
 		// Gathering two kinds of information here for every sigmapped SigBit:
 		//
 		// - bitusers: how many users it has (muxes will only be merged into FFs if this is 1, making the FF the only user)
@@ -735,18 +753,70 @@ struct OptDffWorker
 		return did_something;
 	}
 
+	// A SAT query of run_constbits(): whether the FF output bit q can change
+	// from the value val through the data input d.
+	struct ConstBitQuery {
+		SigBit q, d;
+		State val;
+		uint64_t key = 0;
+		bool cached = false;
+		bool can_change = true;
+	};
+
+	// A bit of an FF that is replaced with val if none of its queries can
+	// change it.
+	struct ConstBit {
+		int index;
+		State val;
+		std::vector<int> queries;
+	};
+
+	// A fingerprint of the SAT model of a query, i.e. of the queried bits and
+	// of the cells and one-hot wires imported by qcsat. Bits are identified by
+	// wire name and offset, so edits elsewhere in the module (and renumbering
+	// the cells) keep the fingerprint.
+	static uint64_t constbit_key(const QuickConeSat &qcsat, const ConstBitQuery &query)
+	{
+		const SigMap &sigmap = qcsat.modwalker.sigmap;
+		auto bit_key = [&](SigBit bit) -> uint64_t {
+			bit = sigmap(bit);
+			if (bit.wire == nullptr)
+				return bit.data;
+			return (uint64_t)bit.wire->name.index_ << 32 | bit.offset;
+		};
+
+		uint64_t sum = 0, sum_sq = 0;
+		for (auto cell : qcsat.imported_cells) {
+			uint64_t h = constbit_hash_mix(cell->type.index_);
+			for (auto &it : cell->parameters)
+				h += constbit_hash_mix(constbit_hash_mix(it.first.index_) + it.second.hash());
+			for (auto &conn : cell->connections()) {
+				uint64_t c = conn.first.index_;
+				for (auto bit : conn.second)
+					c = constbit_hash_mix(c) + bit_key(bit);
+				h += constbit_hash_mix(c);
+			}
+			h = constbit_hash_mix(h);
+			sum += h;
+			sum_sq += h * h;
+		}
+		for (auto wire : qcsat.imported_onehot) {
+			uint64_t h = constbit_hash_mix((uint64_t)wire->name.index_ << 32 | wire->width);
+			sum += h;
+			sum_sq += h * h;
+		}
+
+		uint64_t key = constbit_hash_mix(bit_key(query.q)) + bit_key(query.d);
+		key = constbit_hash_mix(key) + query.val;
+		key = constbit_hash_mix(key) + sum;
+		return constbit_hash_mix(key) + sum_sq;
+	}
+
 	bool run_constbits() {
 
                 auto startTime = std::chrono::high_resolution_clock::now();
 
 		ModWalker modwalker(module->design, module);
-		/*EDA-2101/Thierry: Creating a global "qcsat" solver will store on and on clauses created
-		  within the two for loops below. And we will get a huge number of clauses in the SAT solver
-		  and eventaully it will cause a huge amount of time for it to find a solution. So to avaoid 
-		  huge runtime we are commenting  below global "qcsat" and will create a local "qcsat" object
-		  instead (see below).
- 		*/
-		//QuickConeSat qcsat(modwalker);
 
 		// Run as a separate sub-pass, so that we don't mutate (non-FF) cells under ModWalker.
 		bool did_something = false;
@@ -754,9 +824,25 @@ struct OptDffWorker
         	// numbers to control below loop exit
         	//
         	int nbSolve = 0;
+        	int nbCached = 0;
         	int nbRemove = 0;
         	int nbVisited = 0;
 
+		// First find the bits that can be replaced by a constant, and the SAT
+		// queries that have to be UNSAT for that.
+		std::vector<Cell*> ff_cells;
+		std::vector<std::vector<ConstBit>> ff_constbits;
+		std::vector<ConstBitQuery> queries;
+
+		auto add_query = [&](ConstBit &cb, SigBit q, SigBit d) {
+			ConstBitQuery query;
+			query.q = q;
+			query.d = d;
+			query.val = cb.val;
+			cb.queries.push_back(GetSize(queries));
+			queries.push_back(query);
+		};
+
 		for (auto cell : module->selected_cells()) {
 			if (!RTLIL::builtin_ff_cell_types().count(cell->type))
 				continue;
@@ -764,13 +850,7 @@ struct OptDffWorker
 
             		 nbVisited++;
 
-#if 0
-log("Nb visited = %d\n", nbVisited);
-log("Nb solve = %d\n", nbSolve);
-#endif
-
-			// Now check if any bit can be replaced by a constant.
-			pool<int> removed_sigbits;
+			std::vector<ConstBit> constbits;
 			for (int i = 0; i < ff.width; i++) {
 				State val = ff.val_init[i];
 				if (ff.has_arst)
@@ -785,6 +865,8 @@ log("Nb solve = %d\n", nbSolve);
 				}
 				if (val == State::Sm)
 					continue;
+				ConstBit cb;
+				cb.index = i;
 				if (ff.has_clk || ff.has_gclk) {
 					if (!ff.sig_d[i].wire) {
 						val = combine_const(val, ff.sig_d[i].data);
@@ -798,22 +880,8 @@ log("Nb solve = %d\n", nbSolve);
 							continue;
 						if (val != State::S0 && val != State::S1)
 							continue;
-
-						/* EDA-2101/Thierry: Created a local SAT solver object. It is disposed at the end of "else" body.*/
-						QuickConeSat qcsat(modwalker);
-						int init_sat_pi = qcsat.importSigBit(val);
-						int q_sat_pi = qcsat.importSigBit(ff.sig_q[i]);
-						int d_sat_pi = qcsat.importSigBit(ff.sig_d[i]);
-
-						qcsat.prepare();
-
-						// Try to find out whether the register bit can change under some circumstances
-                                                nbSolve++;
-						bool counter_example_found = qcsat.ez->solve(qcsat.ez->IFF(q_sat_pi, init_sat_pi), qcsat.ez->NOT(qcsat.ez->IFF(d_sat_pi, init_sat_pi)));
-
-						// If the register bit cannot change, we can replace it with a constant
-						if (counter_example_found)
-							continue;
+						cb.val = val;
+						add_query(cb, ff.sig_q[i], ff.sig_d[i]);
 					}
 				}
 				if (ff.has_aload) {
@@ -829,32 +897,99 @@ log("Nb solve = %d\n", nbSolve);
 							continue;
 						if (val != State::S0 && val != State::S1)
 							continue;
+						cb.val = val;
+						add_query(cb, ff.sig_q[i], ff.sig_ad[i]);
+					}
+				}
+				cb.val = val;
+				constbits.push_back(cb);
+			}
+			if (constbits.empty())
+				continue;
+			ff_cells.push_back(cell);
+			ff_constbits.push_back(std::move(constbits));
+		}
 
-						/* EDA-2101/Thierry: Created a local SAT solver object. It is disposed at the end of "else" body.*/
-						QuickConeSat qcsat(modwalker);
-						int init_sat_pi = qcsat.importSigBit(val);
-						int q_sat_pi = qcsat.importSigBit(ff.sig_q[i]);
-						int d_sat_pi = qcsat.importSigBit(ff.sig_ad[i]);
+		// The queries only read the module, so they are solved in parallel.
+		// Results of the previous call on this module are reused for queries
+		// with the same fingerprint, which is what the repeated opt_dff -sat
+		// calls of an opt loop mostly ask.
+		const dict<uint64_t, bool> *prev_results = nullptr;
+		if (constbit_cache.count(module->hashidx_))
+			prev_results = &constbit_cache.at(module->hashidx_);
+
+		auto solve_query = [&](int k) {
+			ConstBitQuery &query = queries[k];
+
+			/*EDA-2101/Thierry: Creating a global "qcsat" solver will store on and on clauses created
+			  for all the queries, and eventually it will cause a huge amount of time for it to find
+			  a solution. So to avoid huge runtime we create a local "qcsat" object per query instead.
+			*/
+			QuickConeSat qcsat(modwalker);
+			int init_sat_pi = qcsat.importSigBit(query.val);
+			int q_sat_pi = qcsat.importSigBit(query.q);
+			int d_sat_pi = qcsat.importSigBit(query.d);
+
+			qcsat.prepare();
+
+			query.key = constbit_key(qcsat, query);
+			if (prev_results != nullptr) {
+				auto it = prev_results->find(query.key);
+				if (it != prev_results->end()) {
+					query.cached = true;
+					query.can_change = it->second;
+					return;
+				}
+			}
 
-						qcsat.prepare();
+			// Try to find out whether the register bit can change under some circumstances
+			query.can_change = qcsat.ez->solve(qcsat.ez->IFF(q_sat_pi, init_sat_pi), qcsat.ez->NOT(qcsat.ez->IFF(d_sat_pi, init_sat_pi)));
+		};
+
+		const int job_size = 16;
+		int num_jobs = (GetSize(queries) + job_size - 1) / job_size;
+		auto query_job = [&](int i) {
+			for (int k = i * job_size; k < std::min((i + 1) * job_size, GetSize(queries)); k++)
+				solve_query(k);
+		};
+
+		int num_threads = yosys_thread_count(num_jobs);
+		if (num_threads > 1)
+			modwalker.sigmap.compress();
+		ThreadPool::run(num_jobs, query_job, num_threads);
+
+		dict<uint64_t, bool> results;
+		for (auto &query : queries) {
+			if (query.cached)
+				nbCached++;
+			else
+				nbSolve++;
+			results[query.key] = query.can_change;
+		}
+		constbit_cache[module->hashidx_] = std::move(results);
 
-						// Try to find out whether the register bit can change under some circumstances
-                        			nbSolve++;
-						bool counter_example_found = qcsat.ez->solve(qcsat.ez->IFF(q_sat_pi, init_sat_pi), qcsat.ez->NOT(qcsat.ez->IFF(d_sat_pi, init_sat_pi)));
+		// Then replace the bits that cannot change, in the order of the cells.
+		for (int k = 0; k < GetSize(ff_cells); k++) {
+			Cell *cell = ff_cells[k];
+			FfData ff(&initvals, cell);
 
-						// If the register bit cannot change, we can replace it with a constant
-						if (counter_example_found)
-							continue;
-					}
-				}
+			pool<int> removed_sigbits;
+			for (auto &cb : ff_constbits[k]) {
+				// If the register bit cannot change, we can replace it with a constant
+				bool can_change = false;
+				for (int q : cb.queries)
+					if (queries[q].can_change)
+						can_change = true;
+				if (can_change)
+					continue;
 
                 		nbRemove++;
-				log("Setting constant %d-bit at position %d on %s (%s) from module %s.\n", val ? 1 : 0,
-						i, log_id(cell), log_id(cell->type), log_id(module));
+				log("Setting constant %d-bit at position %d on %s (%s) from module %s.\n", cb.val ? 1 : 0,
+						cb.index, log_id(cell), log_id(cell->type), log_id(module));
 
-				initvals.remove_init(ff.sig_q[i]);
-				module->connect(ff.sig_q[i], val);
-				removed_sigbits.insert(i);
+				initvals.remove_init(ff.sig_q[cb.index]);
+				module->connect(ff.sig_q[cb.index], cb.val);
+				removed_sigbits.insert(cb.index);
 			}
 			if (!removed_sigbits.empty()) {
 				std::vector<int> keep_bits;
@@ -871,17 +1006,6 @@ log("Nb solve = %d\n", nbSolve);
 				ff.emit();
 				did_something = true;
 			}
-
-                   // Hard coded limit when SAT mode is used. Limit based on design EDA-1041/rsnoc which 
-                   // blows up with opt_dff -sat (> 10 hours).
-                   // This is a safety guard break till we revisit the SAT solver runtime issues
-                   // EDA-2101/(Thierry): Added a fix in (yosys/kernel/qcsat.cc) that avoids runtime  
-                   // blowup for rsnoc, so adding "#if 0" for below limit.
-#if 0				   
-                   if (nbSolve > 30000) {
-                     break;
-                   }
-#endif
 		}
 
                 auto endTime = std::chrono::high_resolution_clock::now();
@@ -889,7 +1013,7 @@ log("Nb solve = %d\n", nbSolve);
 
                 float totalTime = elapsed.count() * 1e-9; 
 
-                log("[#visit=%d, #solve=%d, #remove=%d, time=%.2f sec.]\n", nbVisited, nbSolve, nbRemove, totalTime);
+                log("[#visit=%d, #solve=%d, #cached=%d, #remove=%d, time=%.2f sec.]\n", nbVisited, nbSolve, nbCached, nbRemove, totalTime);
 
 		return did_something;
 	}
@@ -969,6 +1093,7 @@ struct OptDffPass : public Pass {
 
 		bool did_something = false;
 		for (auto mod : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(mod);
 			OptDffWorker worker(opt, mod);
 			if (worker.run())
 				did_something = true;
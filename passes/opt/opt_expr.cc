@@ -19,9 +19,11 @@
 
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
+#include "kernel/modtools.h"
 #include "kernel/celltypes.h"
 #include "kernel/utils.h"
 #include "kernel/log.h"
+#include "kernel/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <algorithm>
@@ -403,21 +405,118 @@ void remove_mul_param(RTLIL::Cell *cell){
 	cell->parameters.erase(ID::REG_OUT);
 }
 
-void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool consume_x, bool mux_undef, bool mux_bool, bool do_fine, bool keepdc, bool noclkinv)
+// Cell types replace_const_cells() has rules for, all other cells are skipped
+bool has_const_cell_rules(RTLIL::IdString type, bool noclkinv)
 {
-	CellTypes ct_combinational;
-	ct_combinational.setup_internals();
-	ct_combinational.setup_stdcells();
+	static const pool<RTLIL::IdString> types = {
+		ID($not), ID($pos), ID($neg), ID($and), ID($or), ID($xor), ID($xnor),
+		ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+		ID($logic_not), ID($logic_and), ID($logic_or),
+		ID($shl), ID($shr), ID($sshl), ID($sshr), ID($shift), ID($shiftx),
+		ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
+		ID($add), ID($sub), ID($mul), ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow), ID($alu),
+		ID($mux), ID($pmux), ID($bmux), ID($demux), ID($bweqx), ID($bwmux), ID($tribuf),
+		ID($_NOT_), ID($_AND_), ID($_OR_), ID($_XOR_), ID($_XNOR_), ID($_MUX_), ID($_TBUF_),
+		ID($fsm), ID($memrd), ID($memrd_v2), ID($memwr), ID($memwr_v2)
+	};
+
+	if (types.count(type))
+		return true;
+
+	// the clock and enable polarity of all flip-flops and latches is optimized
+	return !noclkinv && RTLIL::builtin_ff_cell_types().count(type);
+}
+
+// The cells and signals changed since the last call of replace_const_cells()
+// with the same consume_x. Only these cells and the cells reading these
+// signals are looked at again.
+struct ConstCellsWorklist
+{
+	bool all = true;
+	pool<RTLIL::IdString> cells;
+	pool<RTLIL::SigBit> bits;
+};
+
+// Records all changes made to a module while opt_expr runs on it.
+struct ConstCellsMonitor : public RTLIL::Monitor
+{
+	RTLIL::Module *module;
+	ConstCellsWorklist worklists[2];
+
+	ConstCellsMonitor(RTLIL::Module *module) : module(module)
+	{
+		module->monitors.insert(this);
+	}
+
+	~ConstCellsMonitor()
+	{
+		module->monitors.erase(this);
+	}
+
+	void add_cell(RTLIL::IdString name)
+	{
+		for (auto &worklist : worklists)
+			worklist.cells.insert(name);
+	}
+
+	void add_bits(const RTLIL::SigSpec &sig)
+	{
+		for (auto bit : sig)
+			if (bit.wire != nullptr)
+				for (auto &worklist : worklists)
+					worklist.bits.insert(bit);
+	}
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString&, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override
+	{
+		add_cell(cell->name);
+		add_bits(old_sig);
+		add_bits(sig);
+	}
+
+	void notify_connect(RTLIL::Module*, const RTLIL::SigSig &sigsig) override
+	{
+		add_bits(sigsig.first);
+		add_bits(sigsig.second);
+	}
 
-	SigMap assign_map(module);
+	void notify_connect(RTLIL::Module*, const std::vector<RTLIL::SigSig>&) override
+	{
+		for (auto &worklist : worklists)
+			worklist.all = true;
+	}
+
+	void notify_blackout(RTLIL::Module*) override
+	{
+		for (auto &worklist : worklists)
+			worklist.all = true;
+	}
+};
+
+void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, ModSigMap &modmap, ConstCellsMonitor &changes, bool consume_x, bool mux_undef, bool mux_bool, bool do_fine, bool keepdc, bool noclkinv)
+{
+	// local copy, only updated by the rewrites below that need it
+	SigMap assign_map = modmap.sigmap();
 	dict<RTLIL::SigSpec, RTLIL::SigSpec> invert_map;
 
-	TopoSort<RTLIL::Cell*, RTLIL::IdString::compare_ptr_by_name<RTLIL::Cell>> cells;
-	dict<RTLIL::IdString, Cell*> dcells;
+	// changes made from here on are looked at by the next call
+	ConstCellsWorklist worklist;
+	std::swap(worklist, changes.worklists[consume_x]);
+	changes.worklists[consume_x].all = false;
 
-	dict<RTLIL::Cell*, std::set<RTLIL::SigBit>> cell_to_inbit;
+	pool<RTLIL::SigBit> changed_bits;
+	for (auto bit : worklist.bits)
+		changed_bits.insert(assign_map(bit));
 
-	dict<RTLIL::SigBit, std::set<RTLIL::Cell*>> outbit_to_cell;
+	auto reads_changed_bits = [&](RTLIL::Cell *cell) {
+		for (auto &conn : cell->connections())
+			for (auto bit : conn.second)
+				if (bit.wire != nullptr && changed_bits.count(assign_map(bit)))
+					return true;
+		return false;
+	};
+
+	dict<RTLIL::IdString, Cell*> dcells;
 
 	for (auto cell : module->cells())
 		if (design->selected(module, cell) && cell->type[0] == '$') {
@@ -427,37 +526,18 @@ void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool cons
 			if (cell->type.in(ID($mux), ID($_MUX_)) &&
 					cell->getPort(ID::A) == SigSpec(State::S1) && cell->getPort(ID::B) == SigSpec(State::S0))
 				invert_map[assign_map(cell->getPort(ID::Y))] = assign_map(cell->getPort(ID::S));
-			if (ct_combinational.cell_known(cell->type))
-				for (auto &conn : cell->connections()) {
-					RTLIL::SigSpec sig = assign_map(conn.second);
-					sig.remove_const();
-					if (ct_combinational.cell_input(cell->type, conn.first))
-						cell_to_inbit[cell].insert(sig.begin(), sig.end());
-					if (ct_combinational.cell_output(cell->type, conn.first))
-						for (auto &bit : sig)
-							outbit_to_cell[bit].insert(cell);
-				}
-                        cells.node(cell);
-                        dcells[cell->name] = cell;
+			if (!has_const_cell_rules(cell->type, noclkinv))
+				continue;
+			if (worklist.all || worklist.cells.count(cell->name) || reads_changed_bits(cell))
+				dcells[cell->name] = cell;
 		}
 
-        // Build the graph for the topological sort.
-	for (auto &it_right : cell_to_inbit) {
-          const int r_index = cells.node(it_right.first);
-          for (auto &it_sigbit : it_right.second) {
-            for (auto &it_left : outbit_to_cell[it_sigbit]) {
-              const int l_index = cells.node(it_left);
-              cells.edge(l_index, r_index);
-            }
-          }
-        }
-
-	//cells.sort();
-
-	//for (auto cell : cells.sorted)
 	for (auto p : dcells)
 	{
-          Cell* cell = p.second;
+		Cell* cell = p.second;
+		bool did_something_before = did_something;
+		did_something = false;
+
 #define ACTION_DO(_p_, _s_) do { cover("opt.opt_expr.action_" S__LINE__); replace_cell(assign_map, module, cell, input.as_string(), _p_, _s_); goto next_cell; } while (0)
 #define ACTION_DO_Y(_v_) ACTION_DO(ID::Y, RTLIL::SigSpec(RTLIL::State::S ## _v_))
 
@@ -2211,7 +2291,11 @@ skip_alu_split:
 			}
 		}
 
-	next_cell:;
+	next_cell:
+		// changes only to the parameters or type are not seen by the monitor
+		if (did_something)
+			changes.add_cell(p.first);
+		did_something = did_something || did_something_before;
 #undef ACTION_DO
 #undef ACTION_DO_Y
 #undef FOLD_1ARG_CELL
@@ -2219,8 +2303,8 @@ skip_alu_split:
 	}
 }
 
-void replace_const_connections(RTLIL::Module *module) {
-	SigMap assign_map(module);
+void replace_const_connections(RTLIL::Module *module, ModSigMap &modmap) {
+	const SigMap &assign_map = modmap.sigmap();
 	for (auto cell : module->selected_cells())
 	{
 		std::vector<std::pair<RTLIL::IdString, SigSpec>> changes;
@@ -2324,6 +2408,7 @@ struct OptExprPass : public Pass {
 		CellTypes ct(design);
 		for (auto module : design->selected_modules())
 		{
+			PassProfiler::ModuleScope profile_scope(module);
 			log("Optimizing module %s.\n", log_id(module));
 
 			if (undriven) {
@@ -2333,21 +2418,28 @@ struct OptExprPass : public Pass {
 					design->scratchpad_set_bool("opt.did_something", true);
 			}
 
+			std::unique_ptr<ModSigMap> local_modmap;
+			ModCache *modcache = ModCache::find(design);
+			if (modcache == nullptr)
+				local_modmap.reset(new ModSigMap(module));
+			ModSigMap &modmap = modcache ? modcache->sigmap(module) : *local_modmap;
+			ConstCellsMonitor changes(module);
+
 			do {
 				do {
 					did_something = false;
-					replace_const_cells(design, module, false /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
+					replace_const_cells(design, module, modmap, changes, false /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
 					if (did_something)
 						design->scratchpad_set_bool("opt.did_something", true);
 				} while (did_something);
 				if (!keepdc)
-					replace_const_cells(design, module, true /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
+					replace_const_cells(design, module, modmap, changes, true /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
 				if (did_something)
 					design->scratchpad_set_bool("opt.did_something", true);
 			} while (did_something);
 
 			did_something = false;
-			replace_const_connections(module);
+			replace_const_connections(module, modmap);
 			if (did_something)
 				design->scratchpad_set_bool("opt.did_something", true);
 
@@ -48,27 +48,58 @@ struct OptLutWorker
 
 	int eliminated_count = 0, combined_count = 0;
 
-	bool evaluate_lut(RTLIL::Cell *lut, dict<SigBit, bool> inputs)
+	// Truth tables are packed into 64-bit words, with the value for the input
+	// assignment i in bit i. Tables of fewer than 6 variables repeat within
+	// the word, so that all tables can be combined and compared word-wise.
+	typedef std::vector<uint64_t> truth_table_t;
+
+	static int table_words(int vars)
+	{
+		return vars > 6 ? 1 << (vars-6) : 1;
+	}
+
+	static truth_table_t table_const(int words, bool value)
+	{
+		return truth_table_t(words, value ? ~uint64_t(0) : 0);
+	}
+
+	static truth_table_t table_var(int words, int var)
+	{
+		static const uint64_t patterns[6] = {
+			0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL,
+			0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL,
+		};
+		truth_table_t table(words);
+		for (int w = 0; w < words; w++)
+			table[w] = var < 6 ? patterns[var] : ((w >> (var-6)) & 1) ? ~uint64_t(0) : 0;
+		return table;
+	}
+
+	// The function of a LUT given the truth tables of its inputs, as a tree of
+	// multiplexers with the LUT contents as leaves and one level per input.
+	// Inputs without a table are evaluated as constants.
+	truth_table_t evaluate_lut(RTLIL::Cell *lut, const dict<SigBit, truth_table_t> &inputs, int words)
 	{
 		SigSpec lut_input = sigmap(lut->getPort(ID::A));
 		int lut_width = lut->getParam(ID::WIDTH).as_int();
-		Const lut_table = lut->getParam(ID::LUT);
-		int lut_index = 0;
+		const Const &lut_table = lut->getParam(ID::LUT);
+
+		std::vector<truth_table_t> level;
+		level.reserve(1 << lut_width);
+		for (int i = 0; i < 1 << lut_width; i++)
+			level.push_back(table_const(words, i < GetSize(lut_table) && lut_table[i] == State::S1));
 
 		for (int i = 0; i < lut_width; i++)
 		{
-			SigBit input = sigmap(lut_input[i]);
-			if (inputs.count(input))
-			{
-				lut_index |= inputs[input] << i;
-			}
-			else
-			{
-				lut_index |= SigSpec(lut_input[i]).as_bool() << i;
-			}
+			auto it = inputs.find(lut_input[i]);
+			truth_table_t select = it != inputs.end() ? it->second : table_const(words, lut_input[i] == SigBit(State::S1));
+			for (int j = 0; j < GetSize(level) / 2; j++)
+				for (int w = 0; w < words; w++)
+					level[j][w] = (select[w] & level[2*j+1][w]) | (~select[w] & level[2*j][w]);
+			level.resize(GetSize(level) / 2);
 		}
 
-		return lut_table.extract(lut_index).as_bool();
+		return level[0];
 	}
 
 	void show_stats_by_arity()
@@ -228,32 +259,18 @@ struct OptLutWorker
 					lut_inputs.push_back(sigmap(bit));
 			}
 
-			bool const0_match = true;
-			bool const1_match = true;
-			vector<bool> input_matches;
-			for (size_t i = 0; i < lut_inputs.size(); i++)
-				input_matches.push_back(true);
+			int words = table_words(GetSize(lut_inputs));
+			dict<SigBit, truth_table_t> eval_inputs;
+			for (int i = 0; i < GetSize(lut_inputs); i++)
+				eval_inputs[lut_inputs[i]] = table_var(words, i);
+			truth_table_t value = evaluate_lut(lut, eval_inputs, words);
 
-			for (int eval = 0; eval < 1 << lut_inputs.size(); eval++)
-			{
-				dict<SigBit, bool> eval_inputs;
-				for (size_t i = 0; i < lut_inputs.size(); i++)
-					eval_inputs[lut_inputs[i]] = (eval >> i) & 1;
-				bool value = evaluate_lut(lut, eval_inputs);
-				if (value != 0)
-					const0_match = false;
-				if (value != 1)
-					const1_match = false;
-				for (size_t i = 0; i < lut_inputs.size(); i++)
-				{
-					if (value != eval_inputs[lut_inputs[i]])
-						input_matches[i] = false;
-				}
-			}
+			bool const0_match = value == table_const(words, false);
+			bool const1_match = value == table_const(words, true);
 
 			int input_match = -1;
-			for (size_t i = 0; i < lut_inputs.size(); i++)
-				if (input_matches[i])
+			for (int i = 0; i < GetSize(lut_inputs); i++)
+				if (value == eval_inputs.at(lut_inputs[i]))
 					input_match = i;
 
 			if (const0_match || const1_match || input_match != -1)
@@ -484,17 +501,16 @@ struct OptLutWorker
 					}
 					log_assert(lutR_unique.size() == 0);
 
+					int words = table_words(lutM_width);
+					dict<SigBit, truth_table_t> eval_inputs;
+					for (int i = 0; i < GetSize(lutM_new_inputs); i++)
+						eval_inputs[lutM_new_inputs[i]] = table_var(words, i);
+					eval_inputs[lutA_output] = evaluate_lut(lutA, eval_inputs, words);
+					truth_table_t lutM_value = evaluate_lut(lutB, eval_inputs, words);
+
 					RTLIL::Const lutM_new_table(State::Sx, 1 << lutM_width);
 					for (int eval = 0; eval < 1 << lutM_width; eval++)
-					{
-						dict<SigBit, bool> eval_inputs;
-						for (size_t i = 0; i < lutM_new_inputs.size(); i++)
-						{
-							eval_inputs[lutM_new_inputs[i]] = (eval >> i) & 1;
-						}
-						eval_inputs[lutA_output] = evaluate_lut(lutA, eval_inputs);
-						lutM_new_table[eval] = (RTLIL::State) evaluate_lut(lutB, eval_inputs);
-					}
+						lutM_new_table[eval] = (RTLIL::State) ((lutM_value[eval >> 6] >> (eval & 63)) & 1);
 
 					log_debug("  Cell A truth table: %s.\n", lutA->getParam(ID::LUT).as_string().c_str());
 					log_debug("  Cell B truth table: %s.\n", lutB->getParam(ID::LUT).as_string().c_str());
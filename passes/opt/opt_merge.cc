@@ -20,9 +20,11 @@
 #include "kernel/register.h"
 #include "kernel/ffinit.h"
 #include "kernel/sigtools.h"
+#include "kernel/modtools.h"
 #include "kernel/log.h"
 #include "kernel/celltypes.h"
-#include "libs/sha1/sha1.h"
+#include "kernel/threading.h"
+#include "kernel/memlimit.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <set>
@@ -42,6 +44,13 @@ struct OptMergeWorker
 	CellTypes ct;
 	int total_count;
 
+	// cells reading each (mapped) signal bit, these need to be hashed
+	// again when the signal is redirected to another cell. Close to the
+	// memory limit this index is not built and all cells are hashed again
+	// after each round of merges instead.
+	bool track_consumers;
+	dict<RTLIL::SigBit, std::vector<int>> consumers;
+
 
 	static void sort_pmux_conn(dict<RTLIL::IdString, RTLIL::SigSpec> &conn)
 	{
@@ -66,23 +75,11 @@ struct OptMergeWorker
 		}
 	}
 
-	std::string int_to_hash_string(unsigned int v)
-	{
-		if (v == 0)
-			return "0";
-		std::string str = "";
-		while (v > 0) {
-			str += 'a' + (v & 15);
-			v = v >> 4;
-		}
-		return str;
-	}
-
-        uint64_t hash_cell_parameters_and_connections(const RTLIL::Cell *cell)
+	// Hash over the type, parameters and inputs of a cell, using the same
+	// normalization as compare_cell_parameters_and_connections(). Ports and
+	// parameters are combined independent of their order.
+	unsigned int hash_cell_parameters_and_connections(const RTLIL::Cell *cell) const
 	{
-		vector<string> hash_conn_strings;
-		std::string hash_string = cell->type.str() + "\n";
-
 		const dict<RTLIL::IdString, RTLIL::SigSpec> *conn = &cell->connections();
 		dict<RTLIL::IdString, RTLIL::SigSpec> alt_conn;
 
@@ -116,6 +113,7 @@ struct OptMergeWorker
 			conn = &alt_conn;
 		}
 
+		unsigned int conn_hash = 0;
 		for (auto &it : *conn) {
 			RTLIL::SigSpec sig;
 			if (cell->output(it.first)) {
@@ -129,30 +127,17 @@ struct OptMergeWorker
 			}
 			else
 				sig = assign_map(it.second);
-			string s = "C " + it.first.str() + "=";
-			for (auto &chunk : sig.chunks()) {
-				if (chunk.wire)
-					s += "{" + chunk.wire->name.str() + " " +
-							int_to_hash_string(chunk.offset) + " " +
-							int_to_hash_string(chunk.width) + "}";
-				else
-					s += RTLIL::Const(chunk.data).as_string();
-			}
-			hash_conn_strings.push_back(s + "\n");
+			conn_hash += mkhash_xorshift(mkhash(it.first.hash(), sig.hash()));
 		}
 
+		unsigned int param_hash = 0;
 		for (auto &it : cell->parameters)
-			hash_conn_strings.push_back("P " + it.first.str() + "=" + it.second.as_string() + "\n");
-
-		std::sort(hash_conn_strings.begin(), hash_conn_strings.end());
+			param_hash += mkhash_xorshift(mkhash(it.first.hash(), it.second.hash()));
 
-		for (auto it : hash_conn_strings)
-			hash_string += it;
-
-		return std::hash<std::string>{}(hash_string);
+		return mkhash(mkhash(cell->type.hash(), conn_hash), param_hash);
 	}
 
-	bool compare_cell_parameters_and_connections(const RTLIL::Cell *cell1, const RTLIL::Cell *cell2)
+	bool compare_cell_parameters_and_connections(const RTLIL::Cell *cell1, const RTLIL::Cell *cell2) const
 	{
 		log_assert(cell1 != cell2);
 		if (cell1->type != cell2->type) return false;
@@ -218,7 +203,7 @@ struct OptMergeWorker
 		return conn1 == conn2;
 	}
 
-	bool has_dont_care_initval(const RTLIL::Cell *cell)
+	bool has_dont_care_initval(const RTLIL::Cell *cell) const
 	{
 		if (!RTLIL::builtin_ff_cell_types().count(cell->type))
 			return false;
@@ -226,8 +211,39 @@ struct OptMergeWorker
 		return !initvals(cell->getPort(ID::Q)).is_fully_def();
 	}
 
-	OptMergeWorker(RTLIL::Design *design, RTLIL::Module *module, bool mode_nomux, bool mode_share_all, bool mode_keepdc) :
-		design(design), module(module), assign_map(module), mode_share_all(mode_share_all)
+	// Lookups in assign_map are made from multiple threads while hashing
+	// and comparing cells. It is not modified by a lookup after this, until
+	// the next merge.
+	void prepare_parallel_lookups()
+	{
+		assign_map.compress();
+	}
+
+	// Called after merging signals, with the bits they were mapped to before.
+	// Moves the cells reading bits that are now mapped to a different bit to
+	// that bit, and queues them for hashing again.
+	void redirect_consumers(const RTLIL::SigSpec &sig, std::vector<int> &worklist)
+	{
+		for (auto bit : sig) {
+			auto it = consumers.find(bit);
+			if (it == consumers.end())
+				continue;
+			RTLIL::SigBit new_bit = assign_map(bit);
+			if (new_bit == bit)
+				continue;
+			worklist.insert(worklist.end(), it->second.begin(), it->second.end());
+			std::vector<int> users;
+			users.swap(it->second);
+			consumers.erase(it);
+			if (new_bit.wire != nullptr) {
+				auto &new_users = consumers[new_bit];
+				new_users.insert(new_users.end(), users.begin(), users.end());
+			}
+		}
+	}
+
+	OptMergeWorker(RTLIL::Design *design, RTLIL::Module *module, bool mode_nomux, bool mode_share_all, bool mode_keepdc, bool low_memory) :
+		design(design), module(module), assign_map(module), mode_share_all(mode_share_all), track_consumers(!low_memory)
 	{
 		total_count = 0;
 		ct.setup_internals();
@@ -236,77 +252,169 @@ struct OptMergeWorker
 		ct.setup_stdcells_mem();
 
 		if (mode_nomux) {
-			ct.cell_types.erase(ID($mux));
-			ct.cell_types.erase(ID($pmux));
+			ct.erase_type(ID($mux));
+			ct.erase_type(ID($pmux));
 		}
 
-		ct.cell_types.erase(ID($tribuf));
-		ct.cell_types.erase(ID($_TBUF_));
-		ct.cell_types.erase(ID($anyseq));
-		ct.cell_types.erase(ID($anyconst));
-		ct.cell_types.erase(ID($allseq));
-		ct.cell_types.erase(ID($allconst));
+		ct.erase_type(ID($tribuf));
+		ct.erase_type(ID($_TBUF_));
+		ct.erase_type(ID($anyseq));
+		ct.erase_type(ID($anyconst));
+		ct.erase_type(ID($allseq));
+		ct.erase_type(ID($allconst));
 
 		log("Finding identical cells in module `%s'.\n", module->name.c_str());
-		assign_map.set(module);
+		assign_map = ModCache::get_sigmap(module);
 
 		initvals.set(&assign_map, module);
 
-		bool did_something = true;
-		while (did_something)
+		std::vector<RTLIL::Cell*> cells;
+		cells.reserve(module->cells_.size());
+		for (auto &it : module->cells_) {
+			if (!design->selected(module, it.second))
+				continue;
+			if (mode_keepdc && has_dont_care_initval(it.second))
+				continue;
+			if (!it.second->known())
+				continue;
+			if (ct.cell_known(it.second->type) || mode_share_all)
+				cells.push_back(it.second);
+		}
+
+		if (track_consumers) {
+			for (int i = 0; i < GetSize(cells); i++)
+				for (auto &it : cells[i]->connections())
+					if (!cells[i]->output(it.first))
+						for (auto bit : assign_map(it.second))
+							if (bit.wire != nullptr)
+								consumers[bit].push_back(i);
+		}
+
+		std::vector<unsigned int> cell_hash(GetSize(cells));
+		std::vector<bool> in_bucket(GetSize(cells)), removed(GetSize(cells)), pending(GetSize(cells));
+		dict<unsigned int, std::vector<int>> buckets;
+
+		std::vector<int> worklist(GetSize(cells));
+		for (int i = 0; i < GetSize(cells); i++)
+			worklist[i] = i;
+
+		std::vector<RTLIL::Cell*> removed_cells;
+		while (!worklist.empty())
 		{
-			std::vector<RTLIL::Cell*> cells;
-			cells.reserve(module->cells_.size());
-			for (auto &it : module->cells_) {
-				if (!design->selected(module, it.second))
-					continue;
-				if (mode_keepdc && has_dont_care_initval(it.second))
+			for (int i : worklist) {
+				if (!in_bucket[i])
 					continue;
-				if (ct.cell_known(it.second->type) || (mode_share_all && it.second->known()))
-					cells.push_back(it.second);
+				auto &bucket = buckets.at(cell_hash[i]);
+				bucket.erase(std::find(bucket.begin(), bucket.end(), i));
 			}
 
-			did_something = false;
-                        dict<uint64_t, RTLIL::Cell*> sharemap;
-			for (auto cell : cells)
-			{
-				if ((!mode_share_all && !ct.cell_known(cell->type)) || !cell->known())
-					continue;
+			// Hash the cells and compare them with the other cells in their
+			// bucket in parallel. Nothing is modified before all buckets have
+			// been compared, so that the result does not depend on the number
+			// of threads.
+			prepare_parallel_lookups();
+
+			const int block_size = 1024;
+			int num_blocks = (GetSize(worklist) + block_size - 1) / block_size;
+			ThreadPool::run(num_blocks, [&](int block) {
+				int end = std::min(GetSize(worklist), (block + 1) * block_size);
+				for (int k = block * block_size; k < end; k++)
+					cell_hash[worklist[k]] = hash_cell_parameters_and_connections(cells[worklist[k]]);
+			}, yosys_thread_count(num_blocks));
+
+			std::vector<unsigned int> touched;
+			for (int i : worklist) {
+				auto &bucket = buckets[cell_hash[i]];
+				if (bucket.empty() || !pending[bucket.back()])
+					touched.push_back(cell_hash[i]);
+				bucket.push_back(i);
+				in_bucket[i] = true;
+				pending[i] = true;
+			}
 
-				uint64_t hash = hash_cell_parameters_and_connections(cell);
-				auto r = sharemap.insert(std::make_pair(hash, cell));
-				if (!r.second) {
-					if (compare_cell_parameters_and_connections(cell, r.first->second)) {
-						if (cell->has_keep_attr()) {
-							if (r.first->second->has_keep_attr())
+			std::vector<const std::vector<int>*> touched_buckets;
+			for (auto hash : touched)
+				touched_buckets.push_back(&buckets.at(hash));
+
+			// pairs of (cell, cell it is merged into) for each touched bucket
+			std::vector<std::vector<std::pair<int, int>>> merges(GetSize(touched));
+			ThreadPool::run(GetSize(touched), [&](int t) {
+				std::vector<int> reps;
+				for (int i : *touched_buckets[t]) {
+					if (removed[i])
+						continue;
+					if (!pending[i]) {
+						reps.push_back(i);
+						continue;
+					}
+					bool merged = false;
+					for (auto &r : reps) {
+						if (!compare_cell_parameters_and_connections(cells[i], cells[r]))
+							continue;
+						if (cells[i]->has_keep_attr()) {
+							if (cells[r]->has_keep_attr())
 								continue;
-							std::swap(r.first->second, cell);
-						}
-
-
-						did_something = true;
-						log_debug("  Cell `%s' is identical to cell `%s'.\n", cell->name.c_str(), r.first->second->name.c_str());
-						for (auto &it : cell->connections()) {
-							if (cell->output(it.first)) {
-								RTLIL::SigSpec other_sig = r.first->second->getPort(it.first);
-								log_debug("    Redirecting output %s: %s = %s\n", it.first.c_str(),
-										log_signal(it.second), log_signal(other_sig));
-								Const init = initvals(other_sig);
-								initvals.remove_init(it.second);
-								initvals.remove_init(other_sig);
-								module->connect(RTLIL::SigSig(it.second, other_sig));
-								assign_map.add(it.second, other_sig);
-								initvals.set_init(other_sig, init);
-							}
-						}
-						log_debug("    Removing %s cell `%s' from module `%s'.\n", cell->type.c_str(), cell->name.c_str(), module->name.c_str());
-						module->remove(cell);
-						total_count++;
+							merges[t].push_back(std::make_pair(r, i));
+							r = i;
+						} else
+							merges[t].push_back(std::make_pair(i, r));
+						merged = true;
+						break;
+					}
+					if (!merged)
+						reps.push_back(i);
+				}
+			}, yosys_thread_count(GetSize(touched)));
+
+			for (int i : worklist)
+				pending[i] = false;
+			worklist.clear();
+
+			int merged_before = total_count;
+			for (auto &bucket_merges : merges)
+			for (auto &it : bucket_merges)
+			{
+				RTLIL::Cell *cell = cells[it.first];
+				RTLIL::Cell *other = cells[it.second];
+
+				log_debug("  Cell `%s' is identical to cell `%s'.\n", cell->name.c_str(), other->name.c_str());
+				for (auto &conn : cell->connections()) {
+					if (cell->output(conn.first)) {
+						RTLIL::SigSpec other_sig = other->getPort(conn.first);
+						log_debug("    Redirecting output %s: %s = %s\n", conn.first.c_str(),
+								log_signal(conn.second), log_signal(other_sig));
+						RTLIL::SigSpec old_sig = assign_map(conn.second);
+						RTLIL::SigSpec old_other_sig = assign_map(other_sig);
+						Const init = initvals(other_sig);
+						initvals.remove_init(conn.second);
+						initvals.remove_init(other_sig);
+						module->connect(RTLIL::SigSig(conn.second, other_sig));
+						assign_map.add(conn.second, other_sig);
+						initvals.set_init(other_sig, init);
+						redirect_consumers(old_sig, worklist);
+						redirect_consumers(old_other_sig, worklist);
 					}
 				}
+				log_debug("    Removing %s cell `%s' from module `%s'.\n", cell->type.c_str(), cell->name.c_str(), module->name.c_str());
+				removed[it.first] = true;
+				removed_cells.push_back(cell);
+				total_count++;
 			}
+
+			if (!track_consumers && total_count != merged_before)
+				for (int i = 0; i < GetSize(cells); i++)
+					worklist.push_back(i);
+
+			std::sort(worklist.begin(), worklist.end());
+			worklist.erase(std::unique(worklist.begin(), worklist.end()), worklist.end());
+			worklist.erase(std::remove_if(worklist.begin(), worklist.end(), [&](int i) { return bool(removed[i]); }), worklist.end());
 		}
 
+		// cells are only removed here, so that the cell pointers used above
+		// stay valid
+		for (auto cell : removed_cells)
+			module->remove(cell);
+
 		log_suppressed();
 	}
 };
@@ -359,15 +467,17 @@ struct OptMergePass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		int total_count = 0;
-		for (auto module : design->selected_modules()) {
-			OptMergeWorker worker(design, module, mode_nomux, mode_share_all, mode_keepdc);
+		bool low_memory = MemLimit::low(pass_name.c_str());
+
+		std::atomic<int> total_count(0);
+		execute_modules(design, design->selected_modules(), [&](RTLIL::Module *module) {
+			OptMergeWorker worker(design, module, mode_nomux, mode_share_all, mode_keepdc, low_memory);
 			total_count += worker.total_count;
-		}
+		});
 
 		if (total_count)
 			design->scratchpad_set_bool("opt.did_something", true);
-		log("Removed a total of %d cells.\n", total_count);
+		log("Removed a total of %d cells.\n", total_count.load());
 	}
 } OptMergePass;
 
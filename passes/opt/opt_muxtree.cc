@@ -19,8 +19,10 @@
 
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
+#include "kernel/modtools.h"
 #include "kernel/log.h"
 #include "kernel/celltypes.h"
+#include "kernel/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <set>
@@ -40,8 +42,9 @@ struct OptMuxtreeWorker
 
 	struct bitinfo_t {
 		bool seen_non_mux;
-		pool<int> mux_users;
-		pool<int> mux_drivers;
+		// (mux, port) pairs reading the bit
+		vector<pair<int, int>> mux_users;
+		vector<int> mux_drivers;
 	};
 
 	idict<SigBit> bit2num;
@@ -49,7 +52,6 @@ struct OptMuxtreeWorker
 
 	struct portinfo_t {
 		int ctrl_sig;
-		pool<int> input_sigs;
 		pool<int> input_muxes;
 		bool const_activated;
 		bool const_deactivated;
@@ -66,8 +68,11 @@ struct OptMuxtreeWorker
 	vector<bool> root_enable_muxes;
 	pool<int> root_mux_rerun;
 
+	// (mux, flags, knowledge hash) of the mux evaluations done so far
+	pool<std::tuple<int, int, uint64_t>> evaluated;
+
 	OptMuxtreeWorker(RTLIL::Design *design, RTLIL::Module *module) :
-			design(design), module(module), assign_map(module), removed_count(0)
+			design(design), module(module), assign_map(ModCache::get_sigmap(module)), removed_count(0)
 	{
 		log("Running muxtree optimizer on module %s..\n", module->name.c_str());
 
@@ -99,10 +104,8 @@ struct OptMuxtreeWorker
 					RTLIL::SigSpec ctrl_sig = assign_map(sig_s.extract(i, 1));
 					portinfo_t portinfo;
 					portinfo.ctrl_sig = sig2bits(ctrl_sig, false).front();
-					for (int idx : sig2bits(sig)) {
-						bit2info[idx].mux_users.insert(GetSize(mux2info));
-						portinfo.input_sigs.insert(idx);
-					}
+					for (int idx : sig2bits(sig))
+						add_mux_user(idx, GetSize(mux2info), i);
 					portinfo.const_activated = ctrl_sig.is_fully_const() && ctrl_sig.as_bool();
 					portinfo.const_deactivated = ctrl_sig.is_fully_const() && !ctrl_sig.as_bool();
 					portinfo.enabled = false;
@@ -110,10 +113,8 @@ struct OptMuxtreeWorker
 				}
 
 				portinfo_t portinfo;
-				for (int idx : sig2bits(sig_a)) {
-					bit2info[idx].mux_users.insert(GetSize(mux2info));
-					portinfo.input_sigs.insert(idx);
-				}
+				for (int idx : sig2bits(sig_a))
+					add_mux_user(idx, GetSize(mux2info), GetSize(sig_s));
 				portinfo.ctrl_sig = -1;
 				portinfo.const_activated = false;
 				portinfo.const_deactivated = false;
@@ -121,7 +122,7 @@ struct OptMuxtreeWorker
 				muxinfo.ports.push_back(portinfo);
 
 				for (int idx : sig2bits(sig_y))
-					bit2info[idx].mux_drivers.insert(GetSize(mux2info));
+					bit2info[idx].mux_drivers.push_back(GetSize(mux2info));
 
 				for (int idx : sig2bits(sig_s))
 					bit2info[idx].seen_non_mux = true;
@@ -149,13 +150,10 @@ struct OptMuxtreeWorker
 
 		// Populate mux2info[].ports[]:
 		//	.input_muxes
-		for (int i = 0; i < GetSize(bit2info); i++)
-		for (int j : bit2info[i].mux_users)
-		for (auto &p : mux2info[j].ports) {
-			if (p.input_sigs.count(i))
-				for (int k : bit2info[i].mux_drivers)
-					p.input_muxes.insert(k);
-		}
+		for (auto &bi : bit2info)
+		for (auto &user : bi.mux_users)
+		for (int k : bi.mux_drivers)
+			mux2info[user.first].ports[user.second].input_muxes.insert(k);
 
 		log("  Evaluating internal representation of mux trees.\n");
 
@@ -165,8 +163,8 @@ struct OptMuxtreeWorker
 
 		for (auto &bi : bit2info) {
 			for (int i : bi.mux_drivers)
-				for (int j : bi.mux_users)
-					mux_to_users[i].insert(j);
+				for (auto &user : bi.mux_users)
+					mux_to_users[i].insert(user.first);
 			if (!bi.seen_non_mux)
 				continue;
 			for (int mux_idx : bi.mux_drivers) {
@@ -179,6 +177,10 @@ struct OptMuxtreeWorker
 			if (GetSize(it.second) > 1)
 				root_muxes.at(it.first) = true;
 
+		knowledge.known_inactive.resize(GetSize(bit2info));
+		knowledge.known_active.resize(GetSize(bit2info));
+		knowledge.visited_muxes.resize(GetSize(mux2info));
+
 		for (int mux_idx = 0; mux_idx < GetSize(root_muxes); mux_idx++)
 			if (root_muxes.at(mux_idx)) {
 				log_debug("    Root of a mux tree: %s%s\n", log_id(mux2info[mux_idx].cell), root_enable_muxes.at(mux_idx) ? " (pure)" : "");
@@ -268,6 +270,13 @@ struct OptMuxtreeWorker
 		}
 	}
 
+	void add_mux_user(int bit, int mux_idx, int port_idx)
+	{
+		auto &users = bit2info[bit].mux_users;
+		if (users.empty() || users.back() != make_pair(mux_idx, port_idx))
+			users.push_back(make_pair(mux_idx, port_idx));
+	}
+
 	vector<int> sig2bits(RTLIL::SigSpec sig, bool skip_non_wires = true)
 	{
 		vector<int> results;
@@ -299,8 +308,36 @@ struct OptMuxtreeWorker
 		// this is just used to keep track of visited muxes in order to prohibit
 		// endless recursion in mux loops
 		vector<bool> visited_muxes;
+
+		// Zobrist hash of the known inactive and active signals and the
+		// visited muxes, used to skip repeated evaluations of a mux
+		uint64_t hash = 0;
+
+		static uint64_t key(int kind, int idx)
+		{
+			uint64_t h = 3 * (uint64_t)idx + kind + 1;
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+			return h ^ (h >> 31);
+		}
+
+		void add_inactive(int bit) { if (known_inactive.at(bit)++ == 0) hash ^= key(0, bit); }
+		void remove_inactive(int bit) { if (--known_inactive.at(bit) == 0) hash ^= key(0, bit); }
+		void add_active(int bit) { if (known_active.at(bit)++ == 0) hash ^= key(1, bit); }
+		void remove_active(int bit) { if (--known_active.at(bit) == 0) hash ^= key(1, bit); }
+
+		void set_visited(int mux_idx, bool value)
+		{
+			if (visited_muxes[mux_idx] != value)
+				hash ^= key(2, mux_idx);
+			visited_muxes[mux_idx] = value;
+		}
 	};
 
+	// shared by all mux trees, all entries are back to zero after evaluating
+	// a tree (unless the evaluation is aborted)
+	knowledge_t knowledge;
+
 	void eval_mux_port(knowledge_t &knowledge, int mux_idx, int port_idx, bool do_replace_known, bool do_enable_ports, int abort_count)
 	{
 		if (glob_abort_cnt == 0)
@@ -315,17 +352,17 @@ struct OptMuxtreeWorker
 			if (i == port_idx)
 				continue;
 			if (muxinfo.ports[i].ctrl_sig >= 0)
-				knowledge.known_inactive.at(muxinfo.ports[i].ctrl_sig)++;
+				knowledge.add_inactive(muxinfo.ports[i].ctrl_sig);
 		}
 
 		if (port_idx < GetSize(muxinfo.ports)-1 && !muxinfo.ports[port_idx].const_activated)
-			knowledge.known_active.at(muxinfo.ports[port_idx].ctrl_sig)++;
+			knowledge.add_active(muxinfo.ports[port_idx].ctrl_sig);
 
 		vector<int> parent_muxes;
 		for (int m : muxinfo.ports[port_idx].input_muxes) {
 			if (knowledge.visited_muxes[m])
 				continue;
-			knowledge.visited_muxes[m] = true;
+			knowledge.set_visited(m, true);
 			parent_muxes.push_back(m);
 		}
 		for (int m : parent_muxes) {
@@ -344,16 +381,16 @@ struct OptMuxtreeWorker
 				return;
 		}
 		for (int m : parent_muxes)
-			knowledge.visited_muxes[m] = false;
+			knowledge.set_visited(m, false);
 
 		if (port_idx < GetSize(muxinfo.ports)-1 && !muxinfo.ports[port_idx].const_activated)
-			knowledge.known_active.at(muxinfo.ports[port_idx].ctrl_sig)--;
+			knowledge.remove_active(muxinfo.ports[port_idx].ctrl_sig);
 
 		for (int i = 0; i < GetSize(muxinfo.ports); i++) {
 			if (i == port_idx)
 				continue;
 			if (muxinfo.ports[i].ctrl_sig >= 0)
-				knowledge.known_inactive.at(muxinfo.ports[i].ctrl_sig)--;
+				knowledge.remove_inactive(muxinfo.ports[i].ctrl_sig);
 		}
 	}
 
@@ -407,6 +444,12 @@ struct OptMuxtreeWorker
 	{
 		if (glob_abort_cnt == 0)
 			return;
+
+		// the result of evaluating a mux only depends on the knowledge and
+		// the flags, repeating an evaluation has no further effect
+		int flags = abort_count << 2 | do_replace_known << 1 | do_enable_ports;
+		if (!evaluated.insert(std::make_tuple(mux_idx, flags, knowledge.hash)).second)
+			return;
 		glob_abort_cnt--;
 
 		muxinfo_t &muxinfo = mux2info[mux_idx];
@@ -461,12 +504,9 @@ struct OptMuxtreeWorker
 	void eval_root_mux(int mux_idx)
 	{
 		log_assert(glob_abort_cnt > 0);
-		knowledge_t knowledge;
-		knowledge.known_inactive.resize(GetSize(bit2info));
-		knowledge.known_active.resize(GetSize(bit2info));
-		knowledge.visited_muxes.resize(GetSize(mux2info));
-		knowledge.visited_muxes[mux_idx] = true;
+		knowledge.set_visited(mux_idx, true);
 		eval_mux(knowledge, mux_idx, true, root_enable_muxes.at(mux_idx), 3);
+		knowledge.set_visited(mux_idx, false);
 	}
 };
 
@@ -494,6 +534,7 @@ struct OptMuxtreePass : public Pass {
 		for (auto module : design->selected_whole_modules_warn()) {
 			if (module->has_processes_warn())
 				continue;
+			PassProfiler::ModuleScope profile_scope(module);
 			OptMuxtreeWorker worker(design, module);
 			total_count += worker.removed_count;
 		}
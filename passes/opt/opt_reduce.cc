@@ -19,8 +19,10 @@
 
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
+#include "kernel/modtools.h"
 #include "kernel/log.h"
 #include "kernel/celltypes.h"
+#include "kernel/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <set>
@@ -45,28 +47,30 @@ struct OptReduceWorker
 
 		RTLIL::SigSpec sig_a = assign_map(cell->getPort(ID::A));
 		sig_a.sort_and_unify();
-		pool<RTLIL::SigBit> new_sig_a_bits;
+
+		// the bits are collected with duplicates, which are removed when
+		// they are put into canonical order at the end
+		std::vector<RTLIL::SigBit> new_sig_a_bits;
+		new_sig_a_bits.reserve(sig_a.size());
 
 		for (auto &bit : sig_a)
 		{
 			if (bit == RTLIL::State::S0) {
 				if (cell->type == ID($reduce_and)) {
-					new_sig_a_bits.clear();
-					new_sig_a_bits.insert(RTLIL::State::S0);
+					new_sig_a_bits.assign(1, RTLIL::State::S0);
 					break;
 				}
 				continue;
 			}
 			if (bit == RTLIL::State::S1) {
 				if (cell->type == ID($reduce_or)) {
-					new_sig_a_bits.clear();
-					new_sig_a_bits.insert(RTLIL::State::S1);
+					new_sig_a_bits.assign(1, RTLIL::State::S1);
 					break;
 				}
 				continue;
 			}
 			if (bit.wire == NULL) {
-				new_sig_a_bits.insert(bit);
+				new_sig_a_bits.push_back(bit);
 				continue;
 			}
 
@@ -75,19 +79,20 @@ struct OptReduceWorker
 				if (child_cell->type == cell->type) {
 					opt_reduce(cells, drivers, child_cell);
 					if (child_cell->getPort(ID::Y)[0] == bit) {
-						pool<RTLIL::SigBit> child_sig_a_bits = assign_map(child_cell->getPort(ID::A)).to_sigbit_pool();
-						new_sig_a_bits.insert(child_sig_a_bits.begin(), child_sig_a_bits.end());
+						for (auto child_bit : assign_map(child_cell->getPort(ID::A)))
+							new_sig_a_bits.push_back(child_bit);
 					} else
-						new_sig_a_bits.insert(RTLIL::State::S0);
+						new_sig_a_bits.push_back(RTLIL::State::S0);
 					imported_children = true;
 				}
 			}
 			if (!imported_children)
-				new_sig_a_bits.insert(bit);
+				new_sig_a_bits.push_back(bit);
 		}
 
+		std::sort(new_sig_a_bits.begin(), new_sig_a_bits.end());
+		new_sig_a_bits.erase(std::unique(new_sig_a_bits.begin(), new_sig_a_bits.end()), new_sig_a_bits.end());
 		RTLIL::SigSpec new_sig_a(new_sig_a_bits);
-		new_sig_a.sort_and_unify();
 
 		if (new_sig_a != sig_a || sig_a.size() != cell->getPort(ID::A).size()) {
 			log("    New input vector for %s cell %s: %s\n", cell->type.c_str(), cell->name.c_str(), log_signal(new_sig_a));
@@ -107,21 +112,32 @@ struct OptReduceWorker
 		RTLIL::SigSpec sig_s = assign_map(cell->getPort(ID::S));
 
 		RTLIL::SigSpec new_sig_b, new_sig_s;
-		pool<RTLIL::SigSpec> handled_sig;
 
-		handled_sig.insert(sig_a);
+		// group the cases by their B value in one pass, in the order of
+		// their first occurrence; cases equal to A are dropped
+		dict<RTLIL::SigSpec, int> case_groups;
+		std::vector<RTLIL::SigSpec> group_b, group_s;
+
 		for (int i = 0; i < sig_s.size(); i++)
 		{
 			RTLIL::SigSpec this_b = sig_b.extract(i*sig_a.size(), sig_a.size());
-			if (handled_sig.count(this_b) > 0)
+			if (this_b == sig_a)
 				continue;
 
-			RTLIL::SigSpec this_s = sig_s.extract(i, 1);
-			for (int j = i+1; j < sig_s.size(); j++) {
-				RTLIL::SigSpec that_b = sig_b.extract(j*sig_a.size(), sig_a.size());
-				if (this_b == that_b)
-					this_s.append(sig_s.extract(j, 1));
+			auto it = case_groups.find(this_b);
+			if (it != case_groups.end()) {
+				group_s[it->second].append(sig_s[i]);
+				continue;
 			}
+			case_groups[this_b] = GetSize(group_b);
+			group_b.push_back(this_b);
+			group_s.push_back(sig_s[i]);
+		}
+
+		for (int i = 0; i < GetSize(group_b); i++)
+		{
+			const RTLIL::SigSpec &this_b = group_b[i];
+			RTLIL::SigSpec &this_s = group_s[i];
 
 			if (this_s.size() > 1)
 			{
@@ -138,7 +154,6 @@ struct OptReduceWorker
 
 			new_sig_b.append(this_b);
 			new_sig_s.append(this_s);
-			handled_sig.insert(this_b);
 		}
 
 		if (new_sig_s.size() == 0)
@@ -510,7 +525,7 @@ struct OptReduceWorker
 	}
 
 	OptReduceWorker(RTLIL::Design *design, RTLIL::Module *module, bool do_fine) :
-			design(design), module(module), assign_map(module)
+			design(design), module(module), assign_map(ModCache::get_sigmap(module))
 	{
 		log("  Optimizing cells in module %s.\n", module->name.c_str());
 
@@ -649,13 +664,15 @@ struct OptReducePass : public Pass {
 		extra_args(args, argidx, design);
 
 		int total_count = 0;
-		for (auto module : design->selected_modules())
+		for (auto module : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(module);
 			while (1) {
 				OptReduceWorker worker(design, module, do_fine);
 				total_count += worker.total_count;
 				if (worker.total_count == 0)
 					break;
 			}
+		}
 
 		if (total_count)
 			design->scratchpad_set_bool("opt.did_something", true);
@@ -22,6 +22,7 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
+#include "kernel/profiler.h"
 #include <algorithm>
 
 #include <stdio.h>
@@ -359,6 +360,7 @@ struct OptSharePass : public Pass {
 
 		extra_args(args, 1, design);
 		for (auto module : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(module);
 			SigMap sigmap(module);
 
 			dict<RTLIL::SigBit, int> bit_users;
@@ -0,0 +1,773 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// [[CITE]] Retiming synchronous circuitry
+// Leiserson, C. E. and Saxe, J. B. (1991), "Retiming synchronous circuitry", Algorithmica 6: 5-35, doi:10.1007/BF01759032
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+#include "kernel/celltypes.h"
+#include "kernel/ff.h"
+#include "kernel/ffinit.h"
+#include "kernel/timinginfo.h"
+#include "kernel/threading.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+// The inputs of the gates that flip-flops can be moved across, in the order
+// CellTypes::eval() expects them. Empty for all other cell types.
+static const std::vector<IdString> &gate_inputs(IdString type)
+{
+	static const std::vector<IdString> none;
+	static const std::vector<IdString> a = {ID::A};
+	static const std::vector<IdString> ab = {ID::A, ID::B};
+	static const std::vector<IdString> abs = {ID::A, ID::B, ID::S};
+	static const std::vector<IdString> abc = {ID::A, ID::B, ID::C};
+	static const std::vector<IdString> abcd = {ID::A, ID::B, ID::C, ID::D};
+
+	if (type.in(ID($_BUF_), ID($_NOT_)))
+		return a;
+	if (type.in(ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_), ID($_ANDNOT_), ID($_ORNOT_)))
+		return ab;
+	if (type.in(ID($_MUX_), ID($_NMUX_)))
+		return abs;
+	if (type.in(ID($_AOI3_), ID($_OAI3_)))
+		return abc;
+	if (type.in(ID($_AOI4_), ID($_OAI4_)))
+		return abcd;
+	return none;
+}
+
+// The retiming graph of one region: the gates and timed cells connected
+// through flip-flops of one clock domain, with the logic around the region
+// as source and sink nodes. Each edge carries the flip-flops on the path
+// between two nodes. The flip-flops are only moved forward, from the inputs
+// of a node to its output, so that their new init values can be computed
+// from the old ones. shift[n] is the number of flip-flops moved across node
+// n, the new number of flip-flops on an edge is
+// GetSize(regs) + shift[from] - shift[to].
+struct RetimeRegion
+{
+	struct node_t {
+		Cell *cell = nullptr;
+		// gates and timed cells: the output; sources: the source bit;
+		// sinks: the bit read by the logic around the region
+		SigBit bit;
+		int delay = 0;
+		bool fixed = true, sink = false;
+		// the input edges, -1 for constant gate inputs
+		std::vector<int> in_edges;
+		std::vector<State> in_consts;
+		std::vector<int> out_edges;
+	};
+
+	struct edge_t {
+		int from, to;
+		// the reading port of a gate or timed cell
+		IdString port;
+		int offset;
+		// from the driver to the reader
+		std::vector<Cell*> regs;
+	};
+
+	std::vector<node_t> nodes;
+	std::vector<edge_t> edges;
+	SigBit clk;
+	bool pol_clk = true;
+	int num_regs = 0;
+
+	std::vector<int> shift;
+	int old_period = -1, new_period = -1;
+
+	int weight(const std::vector<int> &s, int e) const
+	{
+		return GetSize(edges[e].regs) + s[edges[e].from] - s[edges[e].to];
+	}
+
+	// Computes for each node the longest delay from its input to the next
+	// flip-flop or sink and returns the longest one, or -1 if the shift is
+	// not legal or leaves a combinational loop.
+	int period(const std::vector<int> &s, std::vector<int> &delta) const
+	{
+		int num_nodes = GetSize(nodes);
+		std::vector<int> pending(num_nodes);
+		for (int e = 0; e < GetSize(edges); e++) {
+			int w = weight(s, e);
+			if (w < 0)
+				return -1;
+			if (w == 0)
+				pending[edges[e].from]++;
+		}
+
+		std::vector<int> queue;
+		for (int n = 0; n < num_nodes; n++)
+			if (pending[n] == 0)
+				queue.push_back(n);
+
+		delta.assign(num_nodes, 0);
+		int max_delta = 0;
+		for (int i = 0; i < GetSize(queue); i++) {
+			int n = queue[i];
+			int d = 0;
+			for (int e : nodes[n].out_edges)
+				if (weight(s, e) == 0)
+					d = std::max(d, delta[edges[e].to]);
+			delta[n] = d + nodes[n].delay;
+			max_delta = std::max(max_delta, delta[n]);
+			for (int e : nodes[n].in_edges)
+				if (e >= 0 && weight(s, e) == 0 && --pending[edges[e].from] == 0)
+					queue.push_back(edges[e].from);
+		}
+
+		if (GetSize(queue) < num_nodes)
+			return -1;
+		return max_delta;
+	}
+
+	// The FEAS algorithm of Leiserson and Saxe on the reversed graph: shifts
+	// flip-flops across every node whose path to the next flip-flop is
+	// too long until the period is met, or fails after |V| rounds.
+	bool feasible(int target, std::vector<int> &s) const
+	{
+		std::vector<int> delta;
+		s.assign(GetSize(nodes), 0);
+		for (int round = 0; round <= GetSize(nodes); round++) {
+			int p = period(s, delta);
+			if (p < 0)
+				return false;
+			if (p <= target)
+				return true;
+			bool changed = false;
+			for (int n = 0; n < GetSize(nodes); n++)
+				if (delta[n] > target && !nodes[n].fixed) {
+					s[n]++;
+					changed = true;
+				}
+			if (!changed)
+				return false;
+		}
+		return false;
+	}
+
+	// Finds the smallest period that can be met (or the target period, if
+	// given) by binary search over the FEAS results.
+	void solve(int target)
+	{
+		std::vector<int> delta, s;
+		shift.assign(GetSize(nodes), 0);
+		old_period = new_period = period(shift, delta);
+		if (old_period < 0)
+			return;
+
+		int lo = 0;
+		for (auto &node : nodes)
+			lo = std::max(lo, node.delay);
+
+		if (target > 0) {
+			if (old_period > target && feasible(target, s))
+				shift = s;
+		} else {
+			int hi = old_period;
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				if (feasible(mid, s)) {
+					shift = s;
+					hi = mid;
+				} else
+					lo = mid + 1;
+			}
+		}
+		new_period = period(shift, delta);
+	}
+
+	bool changed() const
+	{
+		for (int s : shift)
+			if (s != 0)
+				return true;
+		return false;
+	}
+};
+
+struct RetimeWorker
+{
+	Module *module;
+	SigMap sigmap;
+	FfInitVals initvals;
+	CellTypes ct;
+	TimingInfo &timing;
+
+	enum item_kind_t { GATE, TIMED, REG };
+
+	// the cells that can be part of a region
+	struct item_t {
+		Cell *cell;
+		item_kind_t kind;
+		SigBit out, d;
+		int delay = 1;
+		bool fixed = false;
+		int domain = -1;
+		State init = State::Sx;
+	};
+	std::vector<item_t> items;
+	dict<Cell*, int> item_index;
+	dict<SigBit, int> item_driver;
+	idict<std::pair<SigBit, bool>> domains;
+
+	std::vector<int> parent;
+
+	int find(int i)
+	{
+		while (parent[i] != i)
+			i = parent[i] = parent[parent[i]];
+		return i;
+	}
+
+	void merge(int a, int b)
+	{
+		a = find(a), b = find(b);
+		if (a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	bool keep_bit(SigBit bit)
+	{
+		return bit.wire && bit.wire->get_bool_attribute(ID::keep);
+	}
+
+	// The delay of a cell with specify arcs and a single output bit, or -1.
+	int timed_delay(Cell *cell, SigBit &out)
+	{
+		Design *design = module->design;
+		Module *inst_module = design->module(cell->type);
+		if (inst_module == nullptr || !inst_module->get_blackbox_attribute())
+			return -1;
+
+		IdString derived_type = inst_module->derive(design, cell->parameters);
+		inst_module = design->module(derived_type);
+		if (!timing.data.count(derived_type))
+			timing.setup_module(inst_module);
+		auto &t = timing.data.at(derived_type);
+		if (t.comb.empty())
+			return -1;
+
+		int num_outputs = 0;
+		for (auto &conn : cell->connections())
+			if (cell->output(conn.first))
+				for (auto bit : sigmap(conn.second)) {
+					out = bit;
+					num_outputs++;
+				}
+		if (num_outputs != 1 || !out.wire)
+			return -1;
+
+		int delay = 0;
+		for (auto &it : t.comb)
+			delay = std::max(delay, it.second);
+		return delay;
+	}
+
+	void add_items()
+	{
+		for (auto cell : module->cells())
+		{
+			item_t item;
+			item.cell = cell;
+
+			if (!gate_inputs(cell->type).empty()) {
+				item.kind = GATE;
+				item.out = sigmap(cell->getPort(ID::Y));
+				item.fixed = cell->has_keep_attr() || keep_bit(cell->getPort(ID::Y)) || keep_bit(item.out);
+			} else if (RTLIL::builtin_ff_cell_types().count(cell->type)) {
+				FfData ff(&initvals, cell);
+				if (ff.width != 1 || !ff.has_clk || ff.has_gclk || ff.has_ce || ff.has_srst || ff.has_arst || ff.has_sr || ff.has_aload || ff.is_anyinit)
+					continue;
+				if (cell->has_keep_attr() || keep_bit(ff.sig_q[0]) || !ff.sig_clk[0].wire)
+					continue;
+				item.kind = REG;
+				item.out = sigmap(ff.sig_q[0]);
+				item.d = sigmap(ff.sig_d[0]);
+				item.domain = domains(std::make_pair(sigmap(ff.sig_clk[0]), ff.pol_clk));
+				item.init = ff.val_init[0];
+			} else {
+				item.delay = timed_delay(cell, item.out);
+				if (item.delay < 0)
+					continue;
+				item.kind = TIMED;
+				item.fixed = true;
+			}
+
+			if (!item.out.wire || item_driver.count(item.out))
+				continue;
+			item_index[cell] = GetSize(items);
+			item_driver[item.out] = GetSize(items);
+			items.push_back(item);
+		}
+	}
+
+	// Calls fn(port, offset, bit) for the inputs of an item that the retiming
+	// graph covers: the gate inputs, all inputs of timed cells and the D
+	// input of flip-flops.
+	template<typename F>
+	void item_inputs(const item_t &item, F fn)
+	{
+		if (item.kind == REG) {
+			fn(ID::D, 0, item.d);
+			return;
+		}
+		if (item.kind == GATE) {
+			for (auto port : gate_inputs(item.cell->type))
+				fn(port, 0, sigmap(item.cell->getPort(port)[0]));
+			return;
+		}
+		for (auto &conn : item.cell->connections())
+			if (item.cell->input(conn.first)) {
+				SigSpec sig = sigmap(conn.second);
+				for (int i = 0; i < GetSize(sig); i++)
+					fn(conn.first, i, sig[i]);
+			}
+	}
+
+	// Splits the items into regions of logic connected through gates and
+	// flip-flops, and returns the regions that have gates and flip-flops of
+	// a single clock domain.
+	std::vector<RetimeRegion> build_regions(int &num_skipped)
+	{
+		parent.resize(GetSize(items));
+		for (int i = 0; i < GetSize(items); i++)
+			parent[i] = i;
+		for (int i = 0; i < GetSize(items); i++)
+			item_inputs(items[i], [&](IdString, int, SigBit bit) {
+				auto it = item_driver.find(bit);
+				if (it != item_driver.end())
+					merge(i, it->second);
+			});
+
+		// the bits of each region that are read by other logic
+		dict<int, pool<SigBit>> region_sinks;
+		auto add_sink = [&](SigBit bit) {
+			auto it = item_driver.find(bit);
+			if (it != item_driver.end())
+				region_sinks[find(it->second)].insert(bit);
+		};
+		for (auto cell : module->cells()) {
+			auto it = item_index.find(cell);
+			if (it != item_index.end()) {
+				// the clock of a flip-flop is not part of the graph
+				if (items[it->second].kind == REG)
+					add_sink(domains[items[it->second].domain].first);
+				continue;
+			}
+			for (auto &conn : cell->connections())
+				if (!ct.cell_known(cell->type) || ct.cell_input(cell->type, conn.first))
+					for (auto bit : sigmap(conn.second))
+						add_sink(bit);
+		}
+		for (auto wire : module->wires())
+			if (wire->port_output || wire->get_bool_attribute(ID::keep))
+				for (auto bit : sigmap(wire))
+					add_sink(bit);
+
+		dict<int, std::vector<int>> region_items;
+		for (int i = 0; i < GetSize(items); i++)
+			region_items[find(i)].push_back(i);
+
+		std::vector<RetimeRegion> regions;
+		num_skipped = 0;
+		for (auto &it : region_items)
+		{
+			int num_gates = 0, domain = -1;
+			bool mixed = false;
+			for (int i : it.second) {
+				if (items[i].kind == GATE && !items[i].fixed)
+					num_gates++;
+				if (items[i].kind == REG) {
+					if (domain >= 0 && domain != items[i].domain)
+						mixed = true;
+					domain = items[i].domain;
+				}
+			}
+			if (num_gates == 0 || domain < 0)
+				continue;
+			if (mixed) {
+				num_skipped++;
+				continue;
+			}
+
+			regions.emplace_back();
+			if (!build_region(regions.back(), it.second, region_sinks[it.first], domains[domain])) {
+				regions.pop_back();
+				num_skipped++;
+			}
+		}
+		return regions;
+	}
+
+	bool build_region(RetimeRegion &region, const std::vector<int> &region_items, const pool<SigBit> &sinks,
+			const std::pair<SigBit, bool> &domain)
+	{
+		region.clk = domain.first;
+		region.pol_clk = domain.second;
+
+		dict<int, int> item_node;
+		dict<SigBit, int> source_node;
+		for (int i : region_items) {
+			if (items[i].kind == REG) {
+				region.num_regs++;
+				continue;
+			}
+			item_node[i] = GetSize(region.nodes);
+			region.nodes.emplace_back();
+			auto &node = region.nodes.back();
+			node.cell = items[i].cell;
+			node.bit = items[i].out;
+			node.delay = items[i].delay;
+			node.fixed = items[i].fixed;
+		}
+
+		// Adds the edge to a reader of bit, following the flip-flops back
+		// to the node that drives it.
+		auto add_edge = [&](int to, IdString port, int offset, SigBit bit) {
+			RetimeRegion::edge_t edge;
+			edge.to = to;
+			edge.port = port;
+			edge.offset = offset;
+			while (1) {
+				if (!bit.wire) {
+					region.nodes[to].in_edges.push_back(-1);
+					region.nodes[to].in_consts.push_back(bit.data);
+					return true;
+				}
+				auto it = item_driver.find(bit);
+				if (it != item_driver.end() && items[it->second].kind == REG && find(it->second) == find(region_items.front())) {
+					// flip-flop loops without gates
+					if (GetSize(edge.regs) > region.num_regs)
+						return false;
+					edge.regs.push_back(items[it->second].cell);
+					bit = items[it->second].d;
+					continue;
+				}
+				if (it != item_driver.end() && item_node.count(it->second)) {
+					edge.from = item_node.at(it->second);
+				} else {
+					auto r = source_node.insert(std::make_pair(bit, GetSize(region.nodes)));
+					if (r.second) {
+						region.nodes.emplace_back();
+						region.nodes.back().bit = bit;
+						region.nodes.back().delay = 0;
+					}
+					edge.from = r.first->second;
+				}
+				break;
+			}
+			std::reverse(edge.regs.begin(), edge.regs.end());
+			int e = GetSize(region.edges);
+			region.nodes[to].in_edges.push_back(e);
+			region.nodes[to].in_consts.push_back(State::Sx);
+			region.nodes[edge.from].out_edges.push_back(e);
+			region.edges.push_back(edge);
+			return true;
+		};
+
+		bool ok = true;
+		for (int i : region_items)
+			if (items[i].kind != REG)
+				item_inputs(items[i], [&](IdString port, int offset, SigBit bit) {
+					ok = ok && add_edge(item_node.at(i), port, offset, bit);
+				});
+		for (auto bit : sinks) {
+			int n = GetSize(region.nodes);
+			region.nodes.emplace_back();
+			region.nodes.back().bit = bit;
+			region.nodes.back().sink = true;
+			ok = ok && add_edge(n, IdString(), 0, bit);
+		}
+		return ok;
+	}
+
+	// Rebuilds the flip-flops of a region for the shift found by solve().
+	struct Rebuild
+	{
+		RetimeWorker &worker;
+		RetimeRegion &region;
+		Module *module;
+
+		// the signal of each node output, and for each edge the index of
+		// the flip-flop chain it is connected to
+		std::vector<SigBit> node_sig;
+		std::vector<int> edge_chain;
+		// per chain: the driving node, the old init values by stage and
+		// the flip-flop outputs built so far
+		struct chain_t {
+			int node;
+			std::vector<State> inits;
+			std::vector<SigBit> taps;
+		};
+		std::vector<chain_t> chains;
+		dict<std::pair<int, int>, State> values;
+		int num_regs = 0, num_old_regs = 0;
+
+		Rebuild(RetimeWorker &worker, RetimeRegion &region) : worker(worker), region(region), module(worker.module) { }
+
+		int weight(int e) { return region.weight(region.shift, e); }
+
+		// The value of a node output at time t >= 0 of the old netlist, where
+		// all inputs of the node can be traced back to initialized
+		// flip-flops.
+		State value(int n, int t)
+		{
+			auto it = values.find(std::make_pair(n, t));
+			if (it != values.end())
+				return it->second;
+
+			auto &node = region.nodes[n];
+			log_assert(node.cell != nullptr && t < region.shift[n]);
+			Const args[4];
+			for (int i = 0; i < GetSize(node.in_edges); i++) {
+				int e = node.in_edges[i];
+				if (e < 0) {
+					args[i] = node.in_consts[i];
+					continue;
+				}
+				auto &edge = region.edges[e];
+				int w = GetSize(edge.regs);
+				if (t < w)
+					args[i] = worker.reg_init.at(edge.regs[w - t - 1]);
+				else
+					args[i] = value(edge.from, t - w);
+			}
+
+			State result;
+			if (node.cell->type == ID($_NMUX_))
+				result = CellTypes::eval_not(const_mux(args[0], args[1], args[2]))[0];
+			else
+				result = CellTypes::eval(node.cell, args[0], args[1], args[2], args[3])[0];
+			values[std::make_pair(n, t)] = result;
+			return result;
+		}
+
+		// The output of stage k of a chain, building the flip-flops up to it.
+		// Stage k holds the value of the node at time shift - k of the old
+		// netlist: computed from the old init values for shift - k >= 0 and
+		// the old flip-flop at stage k - shift of the node otherwise.
+		SigBit tap(int c, int k)
+		{
+			auto &chain = chains[c];
+			while (GetSize(chain.taps) <= k) {
+				int stage = GetSize(chain.taps);
+				int t = region.shift[chain.node] - stage;
+				State init = t >= 0 ? value(chain.node, t) : -t - 1 < GetSize(chain.inits) ? chain.inits[-t - 1] : State::Sx;
+				Wire *q = module->addWire(NEW_ID);
+				if (init != State::Sx)
+					q->attributes[ID::init] = Const(init);
+				module->addDffGate(NEW_ID, region.clk, chain.taps.back(), q, region.pol_clk);
+				chain.taps.push_back(q);
+				num_regs++;
+			}
+			return chain.taps[k];
+		}
+
+		void run()
+		{
+			auto &nodes = region.nodes;
+			auto &edges = region.edges;
+
+			// Edges share a chain if their old flip-flops have compatible
+			// init values, longest edges first.
+			edge_chain.assign(GetSize(edges), -1);
+			for (int n = 0; n < GetSize(nodes); n++) {
+				std::vector<int> out_edges = nodes[n].out_edges;
+				std::stable_sort(out_edges.begin(), out_edges.end(), [&](int a, int b) {
+					return GetSize(edges[a].regs) > GetSize(edges[b].regs);
+				});
+				int first_chain = GetSize(chains);
+				for (int e : out_edges) {
+					std::vector<State> inits;
+					for (auto cell : edges[e].regs)
+						inits.push_back(worker.reg_init.at(cell));
+					for (int c = first_chain; c < GetSize(chains) && edge_chain[e] < 0; c++)
+						if (std::equal(inits.begin(), inits.end(), chains[c].inits.begin()))
+							edge_chain[e] = c;
+					if (edge_chain[e] < 0) {
+						edge_chain[e] = GetSize(chains);
+						chains.push_back(chain_t{n, inits, {}});
+					}
+				}
+			}
+
+			// Gates that drive a sink directly and have to drive it
+			// through flip-flops now get a new output wire.
+			node_sig.resize(GetSize(nodes));
+			for (int n = 0; n < GetSize(nodes); n++) {
+				node_sig[n] = nodes[n].bit;
+				if (nodes[n].cell == nullptr || gate_inputs(nodes[n].cell->type).empty())
+					continue;
+				node_sig[n] = nodes[n].cell->getPort(ID::Y)[0];
+				for (int e : nodes[n].out_edges)
+					if (nodes[edges[e].to].sink && edges[e].regs.empty() && weight(e) > 0) {
+						Wire *y = module->addWire(NEW_ID);
+						nodes[n].cell->setPort(ID::Y, y);
+						node_sig[n] = y;
+						break;
+					}
+			}
+			for (auto &chain : chains)
+				chain.taps.push_back(node_sig[chain.node]);
+
+			for (int e = 0; e < GetSize(edges); e++) {
+				auto &edge = edges[e];
+				SigBit sig = tap(edge_chain[e], weight(e));
+				if (nodes[edge.to].sink) {
+					if (worker.sigmap(sig) != nodes[edge.to].bit)
+						module->connect(nodes[edge.to].bit, sig);
+				} else {
+					Cell *cell = nodes[edge.to].cell;
+					SigSpec port = cell->getPort(edge.port);
+					port[edge.offset] = sig;
+					cell->setPort(edge.port, port);
+				}
+			}
+
+			pool<Cell*> old_regs;
+			for (auto &edge : edges)
+				for (auto cell : edge.regs)
+					old_regs.insert(cell);
+			for (auto cell : old_regs) {
+				worker.initvals.remove_init(cell->getPort(ID::Q));
+				module->remove(cell);
+			}
+			num_old_regs = GetSize(old_regs);
+		}
+	};
+
+	dict<Cell*, State> reg_init;
+
+	RetimeWorker(Module *module, TimingInfo &timing) : module(module), sigmap(module), initvals(&sigmap, module), timing(timing)
+	{
+		ct.setup_internals();
+		ct.setup_internals_mem();
+		ct.setup_stdcells();
+		ct.setup_stdcells_mem();
+		ct.setup_design(module->design);
+	}
+
+	void run(int target)
+	{
+		add_items();
+		for (auto &item : items)
+			if (item.kind == REG)
+				reg_init[item.cell] = item.init;
+
+		int num_skipped;
+		std::vector<RetimeRegion> regions = build_regions(num_skipped);
+
+		// the regions are independent, solve them in parallel
+		int num_threads = yosys_thread_count(GetSize(regions));
+		ThreadPool::run(GetSize(regions), [&](int i) {
+			regions[i].solve(target);
+		}, num_threads);
+
+		int num_changed = 0, old_regs = 0, new_regs = 0;
+		int num_cells = 0;
+		for (auto &region : regions)
+			if (region.changed())
+				num_cells += region.num_regs;
+
+		module->begin_batch(num_cells, num_cells);
+		for (auto &region : regions) {
+			if (!region.changed())
+				continue;
+			Rebuild rebuild(*this, region);
+			rebuild.run();
+			log("  Retimed region with %d nodes: period %d -> %d, %d -> %d flip-flops.\n",
+					GetSize(region.nodes), region.old_period, region.new_period, rebuild.num_old_regs, rebuild.num_regs);
+			num_changed++;
+			old_regs += rebuild.num_old_regs;
+			new_regs += rebuild.num_regs;
+		}
+		module->commit_batch();
+
+		if (num_skipped > 0)
+			log("  Skipped %d regions with flip-flops of several clock domains or flip-flop loops.\n", num_skipped);
+		log("Retimed %d of %d regions in module %s, %d -> %d flip-flops.\n", num_changed, GetSize(regions), log_id(module), old_regs, new_regs);
+	}
+};
+
+struct RetimePass : public Pass {
+	RetimePass() : Pass("retime", "move flip-flops to reduce the clock period") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    retime [options] [selection]\n");
+		log("\n");
+		log("This pass moves flip-flops across combinational gates to reduce the longest\n");
+		log("path between flip-flops, using the retiming algorithm of Leiserson and Saxe.\n");
+		log("It works on fine-grained netlists (after techmap or abc) and only moves\n");
+		log("plain flip-flops with a clock and no enable or reset, of any init value.\n");
+		log("\n");
+		log("The logic is split into regions of gates connected through flip-flops of a\n");
+		log("single clock domain, which are retimed independently (in parallel when\n");
+		log("multi-threading is enabled). Regions with flip-flops of several clock domains\n");
+		log("are left unchanged.\n");
+		log("\n");
+		log("Flip-flops are only moved forward, from the inputs of a gate to its output.\n");
+		log("The init values of the new flip-flops are computed from the old ones, so the\n");
+		log("retimed design behaves the same from the first clock cycle on. Flip-flops\n");
+		log("and gates with the 'keep' attribute, or driving a wire with the 'keep'\n");
+		log("attribute, are not moved.\n");
+		log("\n");
+		log("Each gate of the internal library ($_AND_, $_MUX_, ...) counts as one unit\n");
+		log("of delay. Blackbox cells with a single output bit and specify timing arcs\n");
+		log("count with their longest arc, but flip-flops are not moved across them.\n");
+		log("\n");
+		log("    -period <n>\n");
+		log("        only retime regions whose period is longer than <n> units, and only\n");
+		log("        if that period can be met. By default each region is retimed to the\n");
+		log("        shortest period that can be reached.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		int target = 0;
+
+		log_header(design, "Executing RETIME pass (moving flip-flops to reduce the clock period).\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-period" && argidx+1 < args.size()) {
+				target = atoi(args[++argidx].c_str());
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
+
+		TimingInfo timing;
+		for (auto module : design->selected_whole_modules_warn()) {
+			if (module->has_processes_warn())
+				continue;
+			RetimeWorker worker(module, timing);
+			worker.run(target);
+		}
+	}
+} RetimePass;
+
+PRIVATE_NAMESPACE_END
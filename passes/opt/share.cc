@@ -23,6 +23,10 @@
 #include "kernel/modtools.h"
 #include "kernel/utils.h"
 #include "kernel/macc.h"
+#include "kernel/celltypes.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
+#include "kernel/memlimit.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -36,6 +40,7 @@ struct ShareWorkerConfig
 	bool opt_force;
 	bool opt_aggressive;
 	bool opt_fast;
+	int timeout;
 	pool<RTLIL::IdString> generic_uni_ops, generic_bin_ops, generic_cbin_ops, generic_other_ops;
 };
 
@@ -492,11 +497,42 @@ struct ShareWorker
 		return true;
 	}
 
+	dict<RTLIL::Cell*, int> share_buckets;
+	dict<std::string, int> share_bucket_ids;
+
+	// Cells in different buckets are never a shareable pair. The bucket holds
+	// what is_shareable_pair() requires to be equal, so that most cells are
+	// rejected with an integer comparison.
+	int share_bucket(RTLIL::Cell *cell)
+	{
+		auto it = share_buckets.find(cell);
+		if (it != share_buckets.end())
+			return it->second;
+
+		std::string key = cell->type.str();
+		if (cell->type.in(ID($memrd), ID($memrd_v2))) {
+			key += " " + cell->parameters.at(ID::MEMID).decode_string();
+			key += " " + cell->parameters.at(ID::WIDTH).as_string();
+		} else if (!generic_ops.count(cell->type)) {
+			std::vector<std::string> params;
+			for (auto &it : cell->parameters)
+				params.push_back(it.first.str() + "=" + it.second.as_string());
+			std::sort(params.begin(), params.end());
+			for (auto &param : params)
+				key += " " + param;
+		}
+
+		auto id = share_bucket_ids.emplace(key, GetSize(share_bucket_ids));
+		share_buckets[cell] = id.first->second;
+		return id.first->second;
+	}
+
 	void find_shareable_partners(std::vector<RTLIL::Cell*> &results, RTLIL::Cell *cell)
 	{
 		results.clear();
+		int bucket = share_bucket(cell);
 		for (auto c : shareable_cells)
-			if (c != cell && is_shareable_pair(c, cell))
+			if (c != cell && share_bucket(c) == bucket && is_shareable_pair(c, cell))
 				results.push_back(c);
 	}
 
@@ -990,6 +1026,343 @@ struct ShareWorker
 	}
 
 
+	// ----------------------------------------------------------
+	// Checking if a pair of cells can be active at the same time
+	// ----------------------------------------------------------
+
+	enum pair_result_t {
+		PAIR_NOT_SHAREABLE,
+		PAIR_SHAREABLE,
+		PAIR_TIMEOUT,
+		PAIR_CELL_NEVER_ACTIVE,
+		PAIR_OTHER_NEVER_ACTIVE,
+		PAIR_OTHER_ALWAYS_ACTIVE
+	};
+
+	struct pair_check_t
+	{
+		RTLIL::Cell *other_cell;
+		pool<ssc_pair_t> filtered_cell_activation_patterns;
+		pool<ssc_pair_t> filtered_other_cell_activation_patterns;
+		RTLIL::SigSpec all_ctrl_signals;
+		pair_result_t result;
+		bool prepared;
+		LogCapture prepare_log, check_log;
+	};
+
+	// Computes the filtered activation patterns for sharing cell with
+	// check.other_cell. Returns false if the other cell is never or always
+	// active, the result then says which.
+	bool prepare_pair(RTLIL::Cell *cell, const pool<ssc_pair_t> &cell_activation_patterns, pair_check_t &check)
+	{
+		RTLIL::Cell *other_cell = check.other_cell;
+
+		log("    Analyzing resource sharing with %s (%s):\n", log_id(other_cell), log_id(other_cell->type));
+
+		const pool<ssc_pair_t> &other_cell_activation_patterns = find_cell_activation_patterns(other_cell, "      ");
+		RTLIL::SigSpec other_cell_activation_signals = bits_from_activation_patterns(other_cell_activation_patterns);
+
+		if (other_cell_activation_patterns.empty()) {
+			log("      Cell is never active. Sharing is pointless, we simply remove it.\n");
+			check.result = PAIR_OTHER_NEVER_ACTIVE;
+			return false;
+		}
+
+		if (other_cell_activation_patterns.count(ssc_pair_t())) {
+			log("      Cell is always active. Therefore no sharing is possible.\n");
+			check.result = PAIR_OTHER_ALWAYS_ACTIVE;
+			return false;
+		}
+
+		log("      Found %d activation_patterns using ctrl signal %s.\n",
+				GetSize(other_cell_activation_patterns), log_signal(other_cell_activation_signals));
+
+		const pool<RTLIL::SigBit> &cell_forbidden_controls = find_forbidden_controls(cell);
+		const pool<RTLIL::SigBit> &other_cell_forbidden_controls = find_forbidden_controls(other_cell);
+
+		std::set<RTLIL::SigBit> union_forbidden_controls;
+		union_forbidden_controls.insert(cell_forbidden_controls.begin(), cell_forbidden_controls.end());
+		union_forbidden_controls.insert(other_cell_forbidden_controls.begin(), other_cell_forbidden_controls.end());
+
+		if (!union_forbidden_controls.empty())
+			log("      Forbidden control signals for this pair of cells: %s\n", log_signal(union_forbidden_controls));
+
+		filter_activation_patterns(check.filtered_cell_activation_patterns, cell_activation_patterns, union_forbidden_controls);
+		filter_activation_patterns(check.filtered_other_cell_activation_patterns, other_cell_activation_patterns, union_forbidden_controls);
+
+		optimize_activation_patterns(check.filtered_cell_activation_patterns);
+		optimize_activation_patterns(check.filtered_other_cell_activation_patterns);
+
+		for (auto &p : check.filtered_cell_activation_patterns)
+			check.all_ctrl_signals.append(p.first);
+		for (auto &p : check.filtered_other_cell_activation_patterns)
+			check.all_ctrl_signals.append(p.first);
+		check.all_ctrl_signals.sort_and_unify();
+
+		return true;
+	}
+
+	struct share_sim_t
+	{
+		int max_cell_complexity;
+		int cell_budget;
+		uint32_t rng = 123456789;
+		dict<RTLIL::SigBit, RTLIL::State> values;
+		pool<RTLIL::Cell*> active_cells;
+	};
+
+	// Evaluates the cell that drives a bit for simulate_bit(). Returns false
+	// for cells that are not simulated.
+	bool simulate_cell(share_sim_t &sim, RTLIL::Cell *cell)
+	{
+		if (cell->type.in(ID($alu), ID($lcu), ID($fa), ID($_NMUX_), ID($_MUX4_), ID($_MUX8_), ID($_MUX16_)) || !cell->hasPort(ID::Y))
+			return false;
+
+		std::vector<RTLIL::IdString> ports;
+		if (cell->type.in(ID($mux), ID($_MUX_), ID($pmux)))
+			ports = {ID::A, ID::B, ID::S};
+		else if (cell->type.in(ID($_AOI3_), ID($_OAI3_)))
+			ports = {ID::A, ID::B, ID::C};
+		else if (cell->type.in(ID($_AOI4_), ID($_OAI4_)))
+			ports = {ID::A, ID::B, ID::C, ID::D};
+		else if (cell->type.in(ID($bmux), ID($demux)))
+			ports = {ID::A, ID::S};
+		else if (cell->hasPort(ID::B))
+			ports = {ID::A, ID::B};
+		else
+			ports = {ID::A};
+
+		sim.active_cells.insert(cell);
+
+		std::vector<RTLIL::Const> args;
+		for (auto port : ports) {
+			if (!cell->hasPort(port))
+				return false;
+			RTLIL::Const arg;
+			for (auto bit : cell->getPort(port)) {
+				RTLIL::State value;
+				if (!simulate_bit(sim, bit, value))
+					return false;
+				arg.bits.push_back(value);
+			}
+			args.push_back(arg);
+		}
+
+		bool err = false;
+		RTLIL::Const y;
+		if (GetSize(args) == 4)
+			y = CellTypes::eval(cell, args[0], args[1], args[2], args[3], &err);
+		else if (GetSize(args) == 3)
+			y = CellTypes::eval(cell, args[0], args[1], args[2], &err);
+		else
+			y = CellTypes::eval(cell, args[0], GetSize(args) > 1 ? args[1] : RTLIL::Const(), &err);
+
+		RTLIL::SigSpec sig_y = modwalker.sigmap(cell->getPort(ID::Y));
+		if (err || GetSize(y) != GetSize(sig_y))
+			return false;
+
+		for (int i = 0; i < GetSize(sig_y); i++) {
+			if (y.bits[i] != State::S0 && y.bits[i] != State::S1)
+				return false;
+			if (sig_y[i].wire)
+				sim.values[sig_y[i]] = y.bits[i];
+		}
+
+		sim.active_cells.erase(cell);
+		return true;
+	}
+
+	// Gets the value of a bit in one round of simulate_pair(). Bits that the
+	// SAT model in check_pair() leaves unconstrained get random values, all
+	// others are computed from their driver. Returns false if the bit can
+	// not be simulated that way.
+	bool simulate_bit(share_sim_t &sim, RTLIL::SigBit bit, RTLIL::State &value)
+	{
+		bit = modwalker.sigmap(bit);
+
+		if (bit.wire == nullptr) {
+			value = bit.data;
+			return value == State::S0 || value == State::S1;
+		}
+
+		auto it = sim.values.find(bit);
+		if (it != sim.values.end()) {
+			value = it->second;
+			return true;
+		}
+
+		RTLIL::Cell *driver = nullptr;
+		auto drivers = modwalker.signal_drivers.find(bit);
+		if (drivers != modwalker.signal_drivers.end()) {
+			if (GetSize(drivers->second) != 1)
+				return false;
+			driver = drivers->second.begin()->cell;
+			if (QuickConeSat::cell_complexity(driver) > sim.max_cell_complexity)
+				driver = nullptr;
+		}
+
+		if (driver == nullptr) {
+			if (bit.wire->get_bool_attribute(ID::onehot))
+				return false;
+			sim.rng ^= sim.rng << 13;
+			sim.rng ^= sim.rng >> 17;
+			sim.rng ^= sim.rng << 5;
+			value = (sim.rng & 1) ? State::S1 : State::S0;
+			sim.values[bit] = value;
+			return true;
+		}
+
+		if (sim.active_cells.count(driver) || --sim.cell_budget < 0)
+			return false;
+		if (!simulate_cell(sim, driver))
+			return false;
+
+		it = sim.values.find(bit);
+		if (it == sim.values.end())
+			return false;
+		value = it->second;
+		return true;
+	}
+
+	// Returns 1 if one of the patterns matches the simulated values, 0 if
+	// none does and -1 if the simulation failed.
+	int simulate_patterns(share_sim_t &sim, const pool<ssc_pair_t> &patterns)
+	{
+		for (auto &p : patterns) {
+			bool match = true;
+			for (int i = 0; i < GetSize(p.first) && match; i++) {
+				RTLIL::State value;
+				if (!simulate_bit(sim, p.first[i], value))
+					return -1;
+				match = value == p.second.bits[i];
+			}
+			if (match)
+				return 1;
+		}
+		return 0;
+	}
+
+	// Looks for a case where both cells of the pair are active with a few
+	// rounds of random simulation. The simulated circuit is at least as
+	// constrained as the SAT model, so a hit means that the SAT solver would
+	// find a model too.
+	bool simulate_pair(pair_check_t &check, int max_cell_complexity)
+	{
+		share_sim_t sim;
+		sim.max_cell_complexity = max_cell_complexity;
+
+		for (int round = 0; round < 16; round++)
+		{
+			sim.values.clear();
+			sim.active_cells.clear();
+			sim.cell_budget = 1000;
+
+			int cell_active = simulate_patterns(sim, check.filtered_cell_activation_patterns);
+			if (cell_active < 0)
+				return false;
+			if (cell_active == 0)
+				continue;
+
+			int other_cell_active = simulate_patterns(sim, check.filtered_other_cell_activation_patterns);
+			if (other_cell_active < 0)
+				return false;
+			if (other_cell_active > 0)
+				return true;
+		}
+
+		return false;
+	}
+
+	bool sat_timed_out(QuickConeSat &qcsat, pair_check_t &check)
+	{
+		if (!qcsat.ez->getSolverTimoutStatus())
+			return false;
+		log("      SAT solver timed out. Not sharing this pair of cells.\n");
+		check.result = PAIR_TIMEOUT;
+		return true;
+	}
+
+	// Decides if the two cells can be active at the same time. This only
+	// reads the module, so pairs are checked in parallel.
+	void check_pair(RTLIL::Cell *cell, pair_check_t &check)
+	{
+		RTLIL::Cell *other_cell = check.other_cell;
+
+		QuickConeSat qcsat(modwalker);
+		if (config.opt_fast) {
+			qcsat.max_cell_outs = 3;
+			qcsat.max_cell_count = 100;
+		}
+		if (config.timeout > 0)
+			qcsat.ez->setSolverTimeout(config.timeout);
+
+		pool<RTLIL::Cell*> sat_cells;
+		std::vector<int> cell_active, other_cell_active;
+
+		for (auto &p : check.filtered_cell_activation_patterns) {
+			log("      Activation pattern for cell %s: %s = %s\n", log_id(cell), log_signal(p.first), log_signal(p.second));
+			cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
+		}
+
+		for (auto &p : check.filtered_other_cell_activation_patterns) {
+			log("      Activation pattern for cell %s: %s = %s\n", log_id(other_cell), log_signal(p.first), log_signal(p.second));
+			other_cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
+		}
+
+		if (simulate_pair(check, qcsat.max_cell_complexity)) {
+			log("      Simulation found both cells active at the same time. This pair of cells can not be shared.\n");
+			check.result = PAIR_NOT_SHAREABLE;
+			return;
+		}
+
+		qcsat.prepare();
+
+		int sub1 = qcsat.ez->expression(qcsat.ez->OpOr, cell_active);
+		if (!qcsat.ez->solve(sub1)) {
+			if (sat_timed_out(qcsat, check))
+				return;
+			log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(cell));
+			check.result = PAIR_CELL_NEVER_ACTIVE;
+			return;
+		}
+
+		int sub2 = qcsat.ez->expression(qcsat.ez->OpOr, other_cell_active);
+		if (!qcsat.ez->solve(sub2)) {
+			if (sat_timed_out(qcsat, check))
+				return;
+			log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(other_cell));
+			check.result = PAIR_OTHER_NEVER_ACTIVE;
+			return;
+		}
+
+		qcsat.ez->non_incremental();
+
+		std::vector<int> sat_model = qcsat.importSig(check.all_ctrl_signals);
+		std::vector<bool> sat_model_values;
+
+		qcsat.ez->assume(qcsat.ez->AND(sub1, sub2));
+
+		log("      Size of SAT problem: %d cells, %d variables, %d clauses\n",
+				GetSize(sat_cells), qcsat.ez->numCnfVariables(), qcsat.ez->numCnfClauses());
+
+		if (qcsat.ez->solve(sat_model, sat_model_values)) {
+			log("      According to the SAT solver this pair of cells can not be shared.\n");
+			log("      Model from SAT solver: %s = %d'", log_signal(check.all_ctrl_signals), GetSize(sat_model_values));
+			for (int i = GetSize(sat_model_values)-1; i >= 0; i--)
+				log("%c", sat_model_values[i] ? '1' : '0');
+			log("\n");
+			check.result = PAIR_NOT_SHAREABLE;
+			return;
+		}
+
+		if (sat_timed_out(qcsat, check))
+			return;
+
+		log("      According to the SAT solver this pair of cells can be shared.\n");
+		check.result = PAIR_SHAREABLE;
+	}
+
+
 	// -------------------------------------------------------------------------------------
 	// Helper functions used to make sure that this pass does not introduce new logic loops.
 	// -------------------------------------------------------------------------------------
@@ -1115,6 +1488,7 @@ struct ShareWorker
 	void remove_cell(Cell *cell)
 	{
 		shareable_cells.erase(cell);
+		share_buckets.erase(cell);
 		forbidden_controls_cache.erase(cell);
 		activation_patterns_cache.erase(cell);
 		module->remove(cell);
@@ -1131,16 +1505,16 @@ struct ShareWorker
 		fwd_ct.setup_internals();
 
 		cone_ct.setup_internals();
-		cone_ct.cell_types.erase(ID($mul));
-		cone_ct.cell_types.erase(ID($mod));
-		cone_ct.cell_types.erase(ID($div));
-		cone_ct.cell_types.erase(ID($modfloor));
-		cone_ct.cell_types.erase(ID($divfloor));
-		cone_ct.cell_types.erase(ID($pow));
-		cone_ct.cell_types.erase(ID($shl));
-		cone_ct.cell_types.erase(ID($shr));
-		cone_ct.cell_types.erase(ID($sshl));
-		cone_ct.cell_types.erase(ID($sshr));
+		cone_ct.erase_type(ID($mul));
+		cone_ct.erase_type(ID($mod));
+		cone_ct.erase_type(ID($div));
+		cone_ct.erase_type(ID($modfloor));
+		cone_ct.erase_type(ID($divfloor));
+		cone_ct.erase_type(ID($pow));
+		cone_ct.erase_type(ID($shl));
+		cone_ct.erase_type(ID($shr));
+		cone_ct.erase_type(ID($sshl));
+		cone_ct.erase_type(ID($sshr));
 	}
 
 	void operator()(RTLIL::Module *module) {
@@ -1152,6 +1526,8 @@ struct ShareWorker
 
 		limit = config.limit;
 		modwalker.setup(module);
+		// pairs of cells are checked in parallel with lookups in this SigMap
+		modwalker.sigmap.compress();
 
 		cells_to_remove.clear();
 		recursion_state.clear();
@@ -1159,6 +1535,8 @@ struct ShareWorker
 		topo_bit_drivers.clear();
 		terminal_bits.clear();
 		shareable_cells.clear();
+		share_buckets.clear();
+		share_bucket_ids.clear();
 		forbidden_controls_cache.clear();
 		activation_patterns_cache.clear();
 
@@ -1207,185 +1585,156 @@ struct ShareWorker
 				log(" %s", log_id(c));
 			log("\n");
 
-			for (auto other_cell : candidates)
-			{
-				log("    Analyzing resource sharing with %s (%s):\n", log_id(other_cell), log_id(other_cell->type));
-
-				const pool<ssc_pair_t> &other_cell_activation_patterns = find_cell_activation_patterns(other_cell, "      ");
-				RTLIL::SigSpec other_cell_activation_signals = bits_from_activation_patterns(other_cell_activation_patterns);
-
-				if (other_cell_activation_patterns.empty()) {
-					log("      Cell is never active. Sharing is pointless, we simply remove it.\n");
-					shareable_cells.erase(other_cell);
-					cells_to_remove.insert(other_cell);
-					continue;
-				}
+			// The pairs are checked in chunks of one candidate per thread. The
+			// checks of a chunk run in parallel and are then handled in order,
+			// so the result is the same as when checking one after the other.
+			// A minisat timeout uses a process-wide alarm, so -timeout keeps
+			// the checks serial.
+			int chunk_size = config.timeout > 0 ? 1 : yosys_thread_count(GetSize(candidates));
+			bool done = false;
 
-				if (other_cell_activation_patterns.count(ssc_pair_t())) {
-					log("      Cell is always active. Therefore no sharing is possible.\n");
-					shareable_cells.erase(other_cell);
-					continue;
+			for (int chunk_start = 0; chunk_start < GetSize(candidates) && !done; chunk_start += chunk_size)
+			{
+				std::vector<pair_check_t> checks(min(chunk_size, GetSize(candidates) - chunk_start));
+				bool parallel = GetSize(checks) > 1;
+
+				for (int i = 0; i < GetSize(checks); i++) {
+					pair_check_t &check = checks[i];
+					check.other_cell = candidates[chunk_start + i];
+					check.result = PAIR_NOT_SHAREABLE;
+					if (parallel)
+						check.prepare_log.begin();
+					check.prepared = prepare_pair(cell, cell_activation_patterns, check);
+					if (parallel)
+						check.prepare_log.end();
+					if (check.prepared && !parallel)
+						check_pair(cell, check);
 				}
 
-				log("      Found %d activation_patterns using ctrl signal %s.\n",
-						GetSize(other_cell_activation_patterns), log_signal(other_cell_activation_signals));
-
-				const pool<RTLIL::SigBit> &cell_forbidden_controls = find_forbidden_controls(cell);
-				const pool<RTLIL::SigBit> &other_cell_forbidden_controls = find_forbidden_controls(other_cell);
-
-				std::set<RTLIL::SigBit> union_forbidden_controls;
-				union_forbidden_controls.insert(cell_forbidden_controls.begin(), cell_forbidden_controls.end());
-				union_forbidden_controls.insert(other_cell_forbidden_controls.begin(), other_cell_forbidden_controls.end());
-
-				if (!union_forbidden_controls.empty())
-					log("      Forbidden control signals for this pair of cells: %s\n", log_signal(union_forbidden_controls));
-
-				pool<ssc_pair_t> filtered_cell_activation_patterns;
-				pool<ssc_pair_t> filtered_other_cell_activation_patterns;
-
-				filter_activation_patterns(filtered_cell_activation_patterns, cell_activation_patterns, union_forbidden_controls);
-				filter_activation_patterns(filtered_other_cell_activation_patterns, other_cell_activation_patterns, union_forbidden_controls);
+				if (parallel)
+					ThreadPool::run(GetSize(checks), [&](int i) {
+						pair_check_t &check = checks[i];
+						if (!check.prepared)
+							return;
+						check.check_log.begin();
+						try {
+							check_pair(cell, check);
+						} catch (...) {
+							check.check_log.end();
+							throw;
+						}
+						check.check_log.end();
+					}, GetSize(checks));
 
-				optimize_activation_patterns(filtered_cell_activation_patterns);
-				optimize_activation_patterns(filtered_other_cell_activation_patterns);
+				for (auto &check : checks)
+				{
+					RTLIL::Cell *other_cell = check.other_cell;
+
+					if (parallel) {
+						check.prepare_log.replay();
+						check.check_log.replay();
+					}
+
+					if (check.result == PAIR_CELL_NEVER_ACTIVE) {
+						cells_to_remove.insert(cell);
+						done = true;
+						break;
+					}
+
+					if (check.result == PAIR_OTHER_NEVER_ACTIVE) {
+						shareable_cells.erase(other_cell);
+						cells_to_remove.insert(other_cell);
+						continue;
+					}
+
+					if (check.result == PAIR_OTHER_ALWAYS_ACTIVE) {
+						shareable_cells.erase(other_cell);
+						continue;
+					}
+
+					if (check.result != PAIR_SHAREABLE)
+						continue;
+
+					const pool<ssc_pair_t> &filtered_cell_activation_patterns = check.filtered_cell_activation_patterns;
+					const pool<ssc_pair_t> &filtered_other_cell_activation_patterns = check.filtered_other_cell_activation_patterns;
+					const RTLIL::SigSpec &all_ctrl_signals = check.all_ctrl_signals;
+
+					if (find_in_input_cone(cell, other_cell)) {
+						log("      Sharing not possible: %s is in input cone of %s.\n", log_id(other_cell), log_id(cell));
+						continue;
+					}
+
+					if (find_in_input_cone(other_cell, cell)) {
+						log("      Sharing not possible: %s is in input cone of %s.\n", log_id(cell), log_id(other_cell));
+						continue;
+					}
 
-				QuickConeSat qcsat(modwalker);
-				if (config.opt_fast) {
-					qcsat.max_cell_outs = 3;
-					qcsat.max_cell_count = 100;
-				}
+					shareable_cells.erase(other_cell);
 
-				pool<RTLIL::Cell*> sat_cells;
-				std::set<RTLIL::SigBit> bits_queue;
+					int cell_select_score = 0;
+					int other_cell_select_score = 0;
 
-				std::vector<int> cell_active, other_cell_active;
-				RTLIL::SigSpec all_ctrl_signals;
+					for (auto &p : filtered_cell_activation_patterns)
+						cell_select_score += p.first.size();
 
-				for (auto &p : filtered_cell_activation_patterns) {
-					log("      Activation pattern for cell %s: %s = %s\n", log_id(cell), log_signal(p.first), log_signal(p.second));
-					cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
-					all_ctrl_signals.append(p.first);
-				}
+					for (auto &p : filtered_other_cell_activation_patterns)
+						other_cell_select_score += p.first.size();
 
-				for (auto &p : filtered_other_cell_activation_patterns) {
-					log("      Activation pattern for cell %s: %s = %s\n", log_id(other_cell), log_signal(p.first), log_signal(p.second));
-					other_cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
-					all_ctrl_signals.append(p.first);
-				}
+					RTLIL::Cell *supercell;
+					pool<RTLIL::Cell*> supercell_aux;
+					if (cell_select_score <= other_cell_select_score) {
+						RTLIL::SigSpec act = make_cell_activation_logic(filtered_cell_activation_patterns, supercell_aux);
+						supercell = make_supercell(cell, other_cell, act, supercell_aux);
+						log("      Activation signal for %s: %s\n", log_id(cell), log_signal(act));
+					} else {
+						RTLIL::SigSpec act = make_cell_activation_logic(filtered_other_cell_activation_patterns, supercell_aux);
+						supercell = make_supercell(other_cell, cell, act, supercell_aux);
+						log("      Activation signal for %s: %s\n", log_id(other_cell), log_signal(act));
+					}
 
-				qcsat.prepare();
+					log("      New cell: %s (%s)\n", log_id(supercell), log_id(supercell->type));
 
-				int sub1 = qcsat.ez->expression(qcsat.ez->OpOr, cell_active);
-				if (!qcsat.ez->solve(sub1)) {
-					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(cell));
 					cells_to_remove.insert(cell);
-					break;
-				}
-
-				int sub2 = qcsat.ez->expression(qcsat.ez->OpOr, other_cell_active);
-				if (!qcsat.ez->solve(sub2)) {
-					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(other_cell));
 					cells_to_remove.insert(other_cell);
-					shareable_cells.erase(other_cell);
-					continue;
-				}
-
-				qcsat.ez->non_incremental();
-
-				all_ctrl_signals.sort_and_unify();
-				std::vector<int> sat_model = qcsat.importSig(all_ctrl_signals);
-				std::vector<bool> sat_model_values;
-
-				qcsat.ez->assume(qcsat.ez->AND(sub1, sub2));
-
-				log("      Size of SAT problem: %d cells, %d variables, %d clauses\n",
-						GetSize(sat_cells), qcsat.ez->numCnfVariables(), qcsat.ez->numCnfClauses());
-
-				if (qcsat.ez->solve(sat_model, sat_model_values)) {
-					log("      According to the SAT solver this pair of cells can not be shared.\n");
-					log("      Model from SAT solver: %s = %d'", log_signal(all_ctrl_signals), GetSize(sat_model_values));
-					for (int i = GetSize(sat_model_values)-1; i >= 0; i--)
-						log("%c", sat_model_values[i] ? '1' : '0');
-					log("\n");
-					continue;
-				}
-
-				log("      According to the SAT solver this pair of cells can be shared.\n");
-
-				if (find_in_input_cone(cell, other_cell)) {
-					log("      Sharing not possible: %s is in input cone of %s.\n", log_id(other_cell), log_id(cell));
-					continue;
-				}
-
-				if (find_in_input_cone(other_cell, cell)) {
-					log("      Sharing not possible: %s is in input cone of %s.\n", log_id(cell), log_id(other_cell));
-					continue;
-				}
-
-				shareable_cells.erase(other_cell);
-
-				int cell_select_score = 0;
-				int other_cell_select_score = 0;
-
-				for (auto &p : filtered_cell_activation_patterns)
-					cell_select_score += p.first.size();
-
-				for (auto &p : filtered_other_cell_activation_patterns)
-					other_cell_select_score += p.first.size();
 
-				RTLIL::Cell *supercell;
-				pool<RTLIL::Cell*> supercell_aux;
-				if (cell_select_score <= other_cell_select_score) {
-					RTLIL::SigSpec act = make_cell_activation_logic(filtered_cell_activation_patterns, supercell_aux);
-					supercell = make_supercell(cell, other_cell, act, supercell_aux);
-					log("      Activation signal for %s: %s\n", log_id(cell), log_signal(act));
-				} else {
-					RTLIL::SigSpec act = make_cell_activation_logic(filtered_other_cell_activation_patterns, supercell_aux);
-					supercell = make_supercell(other_cell, cell, act, supercell_aux);
-					log("      Activation signal for %s: %s\n", log_id(other_cell), log_signal(act));
-				}
-
-				log("      New cell: %s (%s)\n", log_id(supercell), log_id(supercell->type));
-
-				cells_to_remove.insert(cell);
-				cells_to_remove.insert(other_cell);
-
-				for (auto c : supercell_aux)
-					if (is_part_of_scc(c))
-						goto do_rollback;
-
-				if (0) {
-			do_rollback:
-					log("      New topology contains loops! Rolling back..\n");
-					cells_to_remove.erase(cell);
-					cells_to_remove.erase(other_cell);
-					shareable_cells.insert(other_cell);
-					for (auto cc : supercell_aux)
-						remove_cell(cc);
-					continue;
+					for (auto c : supercell_aux)
+						if (is_part_of_scc(c))
+							goto do_rollback;
+
+					if (0) {
+				do_rollback:
+						log("      New topology contains loops! Rolling back..\n");
+						cells_to_remove.erase(cell);
+						cells_to_remove.erase(other_cell);
+						shareable_cells.insert(other_cell);
+						for (auto cc : supercell_aux)
+							remove_cell(cc);
+						continue;
+					}
+
+					pool<ssc_pair_t> supercell_activation_patterns;
+					supercell_activation_patterns.insert(filtered_cell_activation_patterns.begin(), filtered_cell_activation_patterns.end());
+					supercell_activation_patterns.insert(filtered_other_cell_activation_patterns.begin(), filtered_other_cell_activation_patterns.end());
+					optimize_activation_patterns(supercell_activation_patterns);
+					activation_patterns_cache[supercell] = supercell_activation_patterns;
+					shareable_cells.insert(supercell);
+
+					for (auto bit : topo_sigmap(all_ctrl_signals))
+						for (auto c : topo_bit_drivers[bit])
+							topo_cell_drivers[supercell].insert(c);
+
+					topo_cell_drivers[supercell].insert(topo_cell_drivers[cell].begin(), topo_cell_drivers[cell].end());
+					topo_cell_drivers[supercell].insert(topo_cell_drivers[other_cell].begin(), topo_cell_drivers[other_cell].end());
+
+					topo_cell_drivers[cell] = { supercell };
+					topo_cell_drivers[other_cell] = { supercell };
+
+					if (limit > 0)
+						limit--;
+
+					done = true;
+					break;
 				}
-
-				pool<ssc_pair_t> supercell_activation_patterns;
-				supercell_activation_patterns.insert(filtered_cell_activation_patterns.begin(), filtered_cell_activation_patterns.end());
-				supercell_activation_patterns.insert(filtered_other_cell_activation_patterns.begin(), filtered_other_cell_activation_patterns.end());
-				optimize_activation_patterns(supercell_activation_patterns);
-				activation_patterns_cache[supercell] = supercell_activation_patterns;
-				shareable_cells.insert(supercell);
-
-				for (auto bit : topo_sigmap(all_ctrl_signals))
-					for (auto c : topo_bit_drivers[bit])
-						topo_cell_drivers[supercell].insert(c);
-
-				topo_cell_drivers[supercell].insert(topo_cell_drivers[cell].begin(), topo_cell_drivers[cell].end());
-				topo_cell_drivers[supercell].insert(topo_cell_drivers[other_cell].begin(), topo_cell_drivers[other_cell].end());
-
-				topo_cell_drivers[cell] = { supercell };
-				topo_cell_drivers[other_cell] = { supercell };
-
-				if (limit > 0)
-					limit--;
-
-				break;
 			}
 		}
 
@@ -1439,6 +1788,15 @@ struct SharePass : public Pass {
 		log("  -limit N\n");
 		log("    Only perform the first N merges, then stop. This is useful for debugging.\n");
 		log("\n");
+		log("  -timeout <seconds>\n");
+		log("    Give up on a pair of cells when a SAT query for it takes longer than\n");
+		log("    this, and do not share them. With this option the pairs are checked\n");
+		log("    one after the other, without multi-threading.\n");
+		log("\n");
+		log("  -solver <name>\n");
+		log("    Use the named SAT solver instead of the default (minisat). The cadical\n");
+		log("    solver is available when yosys is built with ENABLE_CADICAL=1.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -1448,6 +1806,9 @@ struct SharePass : public Pass {
 		config.opt_force = false;
 		config.opt_aggressive = false;
 		config.opt_fast = false;
+		config.timeout = 0;
+
+		std::string solver_name;
 
 		config.generic_uni_ops.insert(ID($not));
 		// config.generic_uni_ops.insert(ID($pos));
@@ -1505,18 +1866,33 @@ struct SharePass : public Pass {
 				config.opt_fast = true;
 				continue;
 			}
+			if (args[argidx] == "-solver" && argidx+1 < args.size()) {
+				solver_name = args[++argidx];
+				continue;
+			}
 			if (args[argidx] == "-limit" && argidx+1 < args.size()) {
 				config.limit = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-timeout" && argidx+1 < args.size()) {
+				config.timeout = atoi(args[++argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		if (!config.opt_fast && MemLimit::low(pass_name.c_str()))
+			config.opt_fast = true;
+
+		SatSolverSelect solver_select(solver_name);
+
 		ShareWorker sw(config, design);
 
-		for (auto module : design->selected_modules())
+		for (auto module : design->selected_modules()) {
+			PassProfiler::ModuleScope profile_scope(module);
 			sw(module);
+		}
 	}
 } SharePass;
 
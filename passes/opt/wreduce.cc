@@ -67,13 +67,24 @@ struct WreduceWorker
         // Use a dictionnary/map and use IdString as key to get always same order.
         //
         dict<RTLIL::IdString, Cell*> work_queue_cells;
-	std::set<SigBit> work_queue_bits;
+	// The cells to run again in the next round: the cells connected to the
+	// bits changed in this round. Kept by name, as cells may be removed.
+	pool<RTLIL::IdString> next_cells;
 	pool<SigBit> keep_bits;
 	FfInitVals initvals;
 
 	WreduceWorker(WreduceConfig *config, Module *module) :
 			config(config), module(module), mi(module) { }
 
+	// Must be called before the bits are connected to something else, as
+	// their users are looked up through the current sigmap.
+	void queue_bits(const SigSpec &sig)
+	{
+		for (auto bit : sig)
+			for (auto &port : mi.query_ports(bit))
+				next_cells.insert(port.cell->name);
+	}
+
 	int run_cell_mux(Cell *cell)
 	{
 		// Reduce size of MUX if inputs agree on a value for a bit or a output bit is unused
@@ -117,6 +128,9 @@ struct WreduceWorker
 
 		if (GetSize(bits_removed) == GetSize(sig_y)) {
 			log("Removed cell %s.%s (%s).\n", log_id(module), log_id(cell), log_id(cell->type));
+			queue_bits(sig_a);
+			queue_bits(sig_b);
+			queue_bits(sig_y);
 			module->connect(sig_y, sig_removed);
 			module->remove(cell);
 			return 1;
@@ -141,8 +155,7 @@ struct WreduceWorker
 			new_work_queue_bits.append(sig_b.extract(k*GetSize(sig_a) + n_kept, n_removed));
 		}
 
-		for (auto bit : new_work_queue_bits)
-			work_queue_bits.insert(bit);
+		queue_bits(new_work_queue_bits);
 
 		cell->setPort(ID::A, new_sig_a);
 		cell->setPort(ID::B, new_sig_b);
@@ -185,6 +198,7 @@ struct WreduceWorker
 		{
 			if (zero_ext && sig_d[i] == State::S0 && (initval[i] == State::S0 || (!config->keepdc && initval[i] == State::Sx)) &&
 					(!has_reset || i >= GetSize(rst_value) || rst_value[i] == State::S0 || (!config->keepdc && rst_value[i] == State::Sx))) {
+				queue_bits(sig_q[i]);
 				module->connect(sig_q[i], State::S0);
 				initvals.remove_init(sig_q[i]);
 				sig_d.remove(i);
@@ -195,6 +209,7 @@ struct WreduceWorker
 
 			if (sign_ext && i > 0 && sig_d[i] == sig_d[i-1] && initval[i] == initval[i-1] && (!config->keepdc || initval[i] != State::Sx) &&
 					(!has_reset || i >= GetSize(rst_value) || (rst_value[i] == rst_value[i-1] && (!config->keepdc || rst_value[i] != State::Sx)))) {
+				queue_bits(sig_q[i]);
 				module->connect(sig_q[i], sig_q[i-1]);
 				initvals.remove_init(sig_q[i]);
 				sig_d.remove(i);
@@ -207,6 +222,7 @@ struct WreduceWorker
 			if (info == nullptr)
 				return remove;
 			if (!info->is_output && GetSize(info->ports) == 1 && !keep_bits.count(mi.sigmap(sig_q[i]))) {
+				queue_bits(sig_d[i]);
 				initvals.remove_init(sig_q[i]);
 				sig_d.remove(i);
 				sig_q.remove(i);
@@ -231,12 +247,6 @@ struct WreduceWorker
 		log("Removed top %d bits (of %d) from FF cell %s.%s (%s).\n", width_before - GetSize(sig_q), width_before,
 				log_id(module), log_id(cell), log_id(cell->type));
 
-		for (auto bit : sig_d)
-			work_queue_bits.insert(bit);
-
-		for (auto bit : sig_q)
-			work_queue_bits.insert(bit);
-
 		// Narrow ARST_VALUE parameter to new size.
 		if (cell->parameters.count(ID::ARST_VALUE)) {
 			rst_value.bits.resize(GetSize(sig_q));
@@ -264,17 +274,16 @@ struct WreduceWorker
 		int bits_removed = 0;
 		if (GetSize(sig) > max_port_size) {
 			bits_removed = GetSize(sig) - max_port_size;
-			for (auto bit : sig.extract(max_port_size, bits_removed))
-				work_queue_bits.insert(bit);
+			queue_bits(sig.extract(max_port_size, bits_removed));
 			sig = sig.extract(0, max_port_size);
 		}
 
 		if (port_signed) {
 			while (GetSize(sig) > 1 && sig[GetSize(sig)-1] == sig[GetSize(sig)-2])
-				work_queue_bits.insert(sig[GetSize(sig)-1]), sig.remove(GetSize(sig)-1), bits_removed++;
+				queue_bits(sig[GetSize(sig)-1]), sig.remove(GetSize(sig)-1), bits_removed++;
 		} else {
 			while (GetSize(sig) > 1 && sig[GetSize(sig)-1] == State::S0)
-				work_queue_bits.insert(sig[GetSize(sig)-1]), sig.remove(GetSize(sig)-1), bits_removed++;
+				queue_bits(sig[GetSize(sig)-1]), sig.remove(GetSize(sig)-1), bits_removed++;
 		}
 
 		if (bits_removed) {
@@ -396,12 +405,16 @@ struct WreduceWorker
 				sig.remove(max_y_size, GetSize(extra_bits));
 
 				SigBit padbit = is_signed ? sig[GetSize(sig)-1] : State::S0;
+				queue_bits(extra_bits);
 				module->connect(extra_bits, SigSpec(padbit, GetSize(extra_bits)));
 			}
 		}
 
 		if (GetSize(sig) == 0) {
 			log("Removed cell %s.%s (%s).\n", log_id(module), log_id(cell), log_id(cell->type));
+			for (auto &conn : cell->connections())
+				if (cell->input(conn.first))
+					queue_bits(conn.second);
 			module->remove(cell);
 			return 1;
 		}
@@ -432,15 +445,13 @@ struct WreduceWorker
 
 	void run_on_cells()
 	{
-           int change = 1;
-
-           while (change) {
+		for (auto c : module->selected_cells())
+			next_cells.insert(c->name);
 
-                change = 0;
+           while (!next_cells.empty()) {
 
                 keep_bits.clear();
                 work_queue_cells.clear();
-                work_queue_bits.clear();
 
 		// create a copy as mi.sigmap will be updated as we process the module
 		SigMap init_attr_sigmap = mi.sigmap;
@@ -452,24 +463,28 @@ struct WreduceWorker
 					keep_bits.insert(bit);
 		}
 
+		// Only the cells next to a change of the previous round can be
+		// reduced further, so a round only runs these, in the order of the
+		// module like the first round.
 		for (auto c : module->selected_cells()) {
                     // Thierry
 		    //work_queue_cells.insert(c); // using the original std::set of 
 		                                  // pointers leads to non-determinism
-                    work_queue_cells[c->name] = c;
+                    if (next_cells.count(c->name))
+                        work_queue_cells[c->name] = c;
                 }
+                next_cells.clear();
 
 		for (auto p : work_queue_cells) {
                     //log("Process cell '%s'\n", (p.first).c_str());
-                    change += run_cell(p.second);
+                    if (run_cell(p.second) && module->cell(p.first) != nullptr)
+                        next_cells.insert(p.first);
                 }
 
                 // Thierry:
                 // we can work safely on the 'work_queue_cells' but at the end of
                 // processing all the cells we need to restart from fresh data
                 // if there was any change.
-
-                //log("Change = %d\n", change);
            }
 
 	}
@@ -481,6 +496,13 @@ struct WreduceWorker
 		for (auto w : module->wires())
 			complete_wires.insert(mi.sigmap(w));
 
+		// Thierry : we cannot loop on 'wires' and create wires at the same
+		// time, this leads to non-determinism (ex: EDA-2875
+		// canny_edge_detector_02_24 design). So the wires are decided first
+		// and replaced afterwards. Shrinking a wire does not change which
+		// bits of the other wires are used, so one pass is enough.
+		std::vector<std::pair<Wire*, int>> shrink_wires;
+
 		for (auto w : module->selected_wires())
 		{
 			int unused_top_bits = 0;
@@ -499,23 +521,27 @@ struct WreduceWorker
 			if (unused_top_bits == 0 || unused_top_bits == GetSize(w))
 				continue;
 
-			if (complete_wires[mi.sigmap(w).extract(0, GetSize(w) - unused_top_bits)])
+			SigSpec kept_bits = mi.sigmap(w).extract(0, GetSize(w) - unused_top_bits);
+			if (complete_wires[kept_bits])
 				continue;
 
+			// the new wire makes the kept bits complete for the wires after it
+			complete_wires.insert(kept_bits);
+			shrink_wires.push_back(std::make_pair(w, unused_top_bits));
+		}
+
+		for (auto &it : shrink_wires)
+		{
+			Wire *w = it.first;
+			int unused_top_bits = it.second;
+
 			log("Removed top %d bits (of %d) from wire %s.%s.\n", unused_top_bits, GetSize(w), log_id(module), log_id(w));
 			Wire *nw = module->addWire(NEW_ID, GetSize(w) - unused_top_bits);
 			module->connect(nw, SigSpec(w).extract(0, GetSize(nw)));
 			module->swap_names(w, nw);
-
-                        // Thierry : as soon as we add a new wire we need to exit the 'for w:' loop
-                        // otherwise we will have non determinism. We need to come back from fresh
-                        // data. We cannot loop at the same time on 'wires' and create wires. This 
-                        // looks to lead to non-determinism (ex: EDA-2875 canny_edge_detector_02_24 design)
-                        //
-                        return 1;
 		}
 
-                return 0; // case of no change
+		return GetSize(shrink_wires);
 	}
 };
 
@@ -572,10 +598,10 @@ struct WreducePass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		for (auto module : design->selected_modules())
+		execute_modules(design, design->selected_modules(), [&](Module *module)
 		{
 			if (module->has_processes_warn())
-				continue;
+				return;
 
 			for (auto c : module->selected_cells())
 			{
@@ -662,21 +688,12 @@ struct WreducePass : public Pass {
 
                         // Process wreduce on wires
                         //
-                        int change = 1;
-
-                        while (change) {
-
-                           change = 0;
-
-			   WreduceWorker worker2(&config, module);
-
-			   change = worker2.run_on_wires();
-                        }
+			worker1.run_on_wires();
 
 #if 0
 			Pass::call(design, stringf("write_rtlil after_run_on_wires.rtlil"));
 #endif
-		}
+		});
 	}
 } WreducePass;
 
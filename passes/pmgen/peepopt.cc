@@ -65,20 +65,25 @@ struct PeepoptPass : public Pass {
 
 		for (auto module : design->selected_modules())
 		{
+			peepopt_pm pm(module);
+
+			pm.track_changes();
+			pm.setup(module->selected_cells());
+
 			did_something = true;
 
 			while (did_something)
 			{
 				did_something = false;
 
-				peepopt_pm pm(module);
-
-				pm.setup(module->selected_cells());
-
 				pm.run_shiftadd();
 				pm.run_shiftmul_right();
 				pm.run_shiftmul_left();
 				pm.run_muldiv();
+
+				// shiftmul_left matches shift, neg and mul, so a change can
+				// enable a match starting two cells away
+				pm.update(2);
 			}
 		}
 	}
@@ -107,6 +107,11 @@ def rewrite_cpp(s):
 
     return "".join(t)
 
+def index_key_field(block, field):
+    if len(block["index"]) == 1:
+        return "key"
+    return "std::get<{}>(key)".format(field)
+
 def process_pmgfile(f, filename):
     linenr = 0
     global current_pattern
@@ -390,9 +395,15 @@ with open(outfile, "w") as f:
                     value_types.append(entry[1])
                 if entry[0] == "define":
                     value_types.append(entry[1])
-            print("  typedef std::tuple<{}> index_{}_key_type;".format(", ".join(index_types), index), file=f)
+            # a single index is used as key directly, so that e.g. the hash of
+            # a SigSpec key is computed only once
+            if len(index_types) == 1:
+                print("  typedef {} index_{}_key_type;".format(index_types[0], index), file=f)
+            else:
+                print("  typedef std::tuple<{}> index_{}_key_type;".format(", ".join(index_types), index), file=f)
             print("  typedef std::tuple<{}> index_{}_value_type;".format(", ".join(value_types), index), file=f)
             print("  dict<index_{}_key_type, vector<index_{}_value_type>> index_{};".format(index, index, index), file=f)
+            print("  dict<Cell*, vector<index_{}_key_type>> index_{}_keys;".format(index, index), file=f)
     print("  dict<SigBit, pool<Cell*>> sigusers;", file=f)
     print("  pool<Cell*> blacklist_cells;", file=f)
     print("  pool<Cell*> autoremove_cells;", file=f)
@@ -400,6 +411,45 @@ with open(outfile, "w") as f:
     print("  int rollback;", file=f)
     print("", file=f)
 
+    print("  struct monitor_t : RTLIL::Monitor {", file=f)
+    print("    {}_pm *pm;".format(prefix), file=f)
+    print("    monitor_t({}_pm *pm) : pm(pm) {{ }}".format(prefix), file=f)
+    print("    void notify_connect(Cell *cell, const IdString &port, const SigSpec&, const SigSpec &sig) override {", file=f)
+    print("      pm->dirty_cells.insert(cell);", file=f)
+    print("      // Module::remove() disconnects the ports of a cell one by one", file=f)
+    print("      if (sig.empty() && GetSize(cell->connections_) == 1 && cell->connections_.count(port))", file=f)
+    print("        pm->detached_cells.insert(cell);", file=f)
+    print("      else if (pm->detached_cells.erase(cell))", file=f)
+    print("        pm->setup_cells.erase(cell);", file=f)
+    print("    }", file=f)
+    print("    void notify_connect(Module*, const SigSig &conn) override {", file=f)
+    print("      // Module::connect() drops bits with a constant on the left hand", file=f)
+    print("      // side and notifies again for the remaining bits.", file=f)
+    print("      if (!conn.first.has_const())", file=f)
+    print("        pm->pending_connections.push_back(conn);", file=f)
+    print("    }", file=f)
+    print("    void notify_connect(Module*, const std::vector<SigSig>&) override { pm->reload_pending = true; }", file=f)
+    print("    void notify_blackout(Module*) override { pm->reload_pending = true; }", file=f)
+    print("    void notify_remove(Module*, const pool<Wire*>&) override { pm->reload_pending = true; }", file=f)
+    print("    void notify_batch(Module *module, const pool<Cell*> &added_cells, const std::vector<Cell*> &removed_cells,", file=f)
+    print("        const std::vector<SigSig> &connections) override {", file=f)
+    print("      RTLIL::Monitor::notify_batch(module, added_cells, removed_cells, connections);", file=f)
+    print("      for (auto cell : removed_cells)", file=f)
+    print("        pm->detached_cells.insert(cell);", file=f)
+    print("    }", file=f)
+    print("  };", file=f)
+    print("", file=f)
+    print("  monitor_t *monitor;", file=f)
+    print("  bool reload_pending;", file=f)
+    print("  bool rematch_only;", file=f)
+    print("  pool<Cell*> setup_cells;", file=f)
+    print("  pool<Cell*> dirty_cells;", file=f)
+    print("  pool<Cell*> detached_cells;", file=f)
+    print("  pool<Cell*> rematch_cells;", file=f)
+    print("  vector<SigSig> pending_connections;", file=f)
+    print("  dict<Cell*, vector<SigBit>> cell_sigbits;", file=f)
+    print("", file=f)
+
     for current_pattern in sorted(patterns.keys()):
         print("  struct state_{}_t {{".format(current_pattern), file=f)
         for s, t in sorted(state_types[current_pattern].items()):
@@ -425,6 +475,8 @@ with open(outfile, "w") as f:
     print("    for (auto bit : sigmap(sig)) {", file=f)
     print("      if (bit.wire == nullptr) continue;", file=f)
     print("      sigusers[bit].insert(cell);", file=f)
+    print("      if (monitor != nullptr && cell != nullptr)", file=f)
+    print("        cell_sigbits[cell].push_back(bit);", file=f)
     print("    }", file=f)
     print("  }", file=f)
     print("", file=f)
@@ -482,13 +534,15 @@ with open(outfile, "w") as f:
     print("", file=f)
 
     print("  {}_pm(Module *module, const vector<Cell*> &cells) :".format(prefix), file=f)
-    print("      module(module), sigmap(module), setup_done(false), generate_mode(false), rngseed(12345678) {", file=f)
+    print("      module(module), sigmap(module), setup_done(false), generate_mode(false), rngseed(12345678),", file=f)
+    print("      monitor(nullptr), reload_pending(false), rematch_only(false) {", file=f)
     print("    setup(cells);", file=f)
     print("  }", file=f)
     print("", file=f)
 
     print("  {}_pm(Module *module) :".format(prefix), file=f)
-    print("      module(module), sigmap(module), setup_done(false), generate_mode(false), rngseed(12345678) {", file=f)
+    print("      module(module), sigmap(module), setup_done(false), generate_mode(false), rngseed(12345678),", file=f)
+    print("      monitor(nullptr), reload_pending(false), rematch_only(false) {", file=f)
     print("  }", file=f)
     print("", file=f)
 
@@ -502,53 +556,199 @@ with open(outfile, "w") as f:
     current_pattern = None
     print("    log_assert(!setup_done);", file=f)
     print("    setup_done = true;", file=f)
+    print("    index_module(cells);", file=f)
+    print("  }", file=f)
+    print("", file=f)
+
+    print("  void index_module(const vector<Cell*> &cells) {", file=f)
     print("    for (auto port : module->ports)", file=f)
     print("      add_siguser(module->wire(port), nullptr);", file=f)
-    print("    for (auto cell : module->cells())", file=f)
+    print("    for (auto cell : module->cells()) {", file=f)
+    print("      if (monitor != nullptr)", file=f)
+    print("        cell_sigbits[cell];", file=f)
     print("      for (auto &conn : cell->connections())", file=f)
     print("        add_siguser(conn.second, cell);", file=f)
-    print("    for (auto cell : cells) {", file=f)
+    print("    }", file=f)
+    print("    for (auto cell : cells)", file=f)
+    print("      index_cell(cell);", file=f)
+    print("  }", file=f)
+    print("", file=f)
+
+    print("  void index_cell(Cell *cell) {", file=f)
+    print("    if (monitor != nullptr)", file=f)
+    print("      setup_cells.insert(cell);", file=f)
 
     for index in range(len(blocks)):
         block = blocks[index]
         if block["type"] == "match":
-            print("      do {", file=f)
-            print("        Cell *{} = cell;".format(block["cell"]), file=f)
-            print("        index_{}_value_type value;".format(index), file=f)
-            print("        std::get<0>(value) = cell;", file=f)
+            print("    do {", file=f)
+            print("      Cell *{} = cell;".format(block["cell"]), file=f)
+            print("      index_{}_value_type value;".format(index), file=f)
+            print("      std::get<0>(value) = cell;", file=f)
             loopcnt = 0
             valueidx = 1
             for item in block["setup"]:
                 if item[0] == "select":
-                    print("        if (!({})) continue;".format(item[1]), file=f)
+                    print("      if (!({})) continue;".format(item[1]), file=f)
                 if item[0] == "slice":
-                    print("        int &{} = std::get<{}>(value);".format(item[1], valueidx), file=f)
-                    print("        for ({} = 0; {} < {}; {}++) {{".format(item[1], item[1], item[2], item[1]), file=f)
+                    print("      int &{} = std::get<{}>(value);".format(item[1], valueidx), file=f)
+                    print("      for ({} = 0; {} < {}; {}++) {{".format(item[1], item[1], item[2], item[1]), file=f)
                     valueidx += 1
                     loopcnt += 1
                 if item[0] == "choice":
-                    print("        vector<{}> _pmg_choices_{} = {};".format(item[1], item[2], item[3]), file=f)
-                    print("        for (const {} &{} : _pmg_choices_{}) {{".format(item[1], item[2], item[2]), file=f)
-                    print("        std::get<{}>(value) = {};".format(valueidx, item[2]), file=f)
+                    print("      vector<{}> _pmg_choices_{} = {};".format(item[1], item[2], item[3]), file=f)
+                    print("      for (const {} &{} : _pmg_choices_{}) {{".format(item[1], item[2], item[2]), file=f)
+                    print("      std::get<{}>(value) = {};".format(valueidx, item[2]), file=f)
                     valueidx += 1
                     loopcnt += 1
                 if item[0] == "define":
-                    print("        {} &{} = std::get<{}>(value);".format(item[1], item[2], valueidx), file=f)
-                    print("        {} = {};".format(item[2], item[3]), file=f)
+                    print("      {} &{} = std::get<{}>(value);".format(item[1], item[2], valueidx), file=f)
+                    print("      {} = {};".format(item[2], item[3]), file=f)
                     valueidx += 1
-            print("        index_{}_key_type key;".format(index), file=f)
+            print("      index_{}_key_type key;".format(index), file=f)
             for field, entry in enumerate(block["index"]):
-                print("        std::get<{}>(key) = {};".format(field, entry[1]), file=f)
-            print("        index_{}[key].push_back(value);".format(index), file=f)
+                print("      {} = {};".format(index_key_field(block, field), entry[1]), file=f)
+            print("      index_{}[key].push_back(value);".format(index), file=f)
+            print("      if (monitor != nullptr)", file=f)
+            print("        index_{}_keys[cell].push_back(key);".format(index), file=f)
             for i in range(loopcnt):
-                print("        }", file=f)
-            print("      } while (0);", file=f)
+                print("      }", file=f)
+            print("    } while (0);", file=f)
+
+    print("  }", file=f)
+    print("", file=f)
 
+    print("  void unindex_cell(Cell *cell) {", file=f)
+    print("    auto bits_ptr = cell_sigbits.find(cell);", file=f)
+    print("    if (bits_ptr != cell_sigbits.end()) {", file=f)
+    print("      for (auto bit : bits_ptr->second) {", file=f)
+    print("        auto users_ptr = sigusers.find(bit);", file=f)
+    print("        if (users_ptr == sigusers.end()) continue;", file=f)
+    print("        users_ptr->second.erase(cell);", file=f)
+    print("        if (users_ptr->second.empty())", file=f)
+    print("          sigusers.erase(users_ptr);", file=f)
+    print("      }", file=f)
+    print("      cell_sigbits.erase(bits_ptr);", file=f)
     print("    }", file=f)
+    for index in range(len(blocks)):
+        block = blocks[index]
+        if block["type"] == "match":
+            print("    auto keys_{}_ptr = index_{}_keys.find(cell);".format(index, index), file=f)
+            print("    if (keys_{}_ptr != index_{}_keys.end()) {{".format(index, index), file=f)
+            print("      for (auto &key : keys_{}_ptr->second) {{".format(index), file=f)
+            print("        auto cells_ptr = index_{}.find(key);".format(index), file=f)
+            print("        if (cells_ptr == index_{}.end()) continue;".format(index), file=f)
+            print("        auto &cells = cells_ptr->second;", file=f)
+            print("        cells.erase(std::remove_if(cells.begin(), cells.end(),", file=f)
+            print("            [&](const index_{}_value_type &value) {{ return std::get<0>(value) == cell; }}), cells.end());".format(index), file=f)
+            print("        if (cells.empty())", file=f)
+            print("          index_{}.erase(cells_ptr);".format(index), file=f)
+            print("      }", file=f)
+            print("      index_{}_keys.erase(keys_{}_ptr);".format(index, index), file=f)
+            print("    }", file=f)
+    print("  }", file=f)
+    print("", file=f)
+
+    print("  void track_changes() {", file=f)
+    print("    log_assert(!setup_done && monitor == nullptr);", file=f)
+    print("    monitor = new monitor_t(this);", file=f)
+    print("    module->monitors.insert(monitor);", file=f)
+    print("  }", file=f)
+    print("", file=f)
+
+    print("  int update(int depth = 1) {", file=f)
+    print("    log_assert(setup_done && monitor != nullptr);", file=f)
+    print("    for (auto cell : autoremove_cells)", file=f)
+    print("      module->remove(cell);", file=f)
+    print("    autoremove_cells.clear();", file=f)
+    print("    blacklist_cells.clear();", file=f)
+    print("    rematch_cells.clear();", file=f)
+    print("", file=f)
+    print("    if (reload_pending) {", file=f)
+    print("      vector<Cell*> cells;", file=f)
+    print("      for (auto cell : module->cells())", file=f)
+    print("        if (setup_cells.count(cell) ? !detached_cells.count(cell) : (dirty_cells.count(cell) && module->selected(cell)))", file=f)
+    print("          cells.push_back(cell);", file=f)
+    for index in range(len(blocks)):
+        block = blocks[index]
+        if block["type"] == "match":
+            print("      index_{}.clear();".format(index), file=f)
+            print("      index_{}_keys.clear();".format(index), file=f)
+    print("      sigusers.clear();", file=f)
+    print("      cell_sigbits.clear();", file=f)
+    print("      setup_cells.clear();", file=f)
+    print("      dirty_cells.clear();", file=f)
+    print("      detached_cells.clear();", file=f)
+    print("      pending_connections.clear();", file=f)
+    print("      sigmap.set(module);", file=f)
+    print("      index_module(cells);", file=f)
+    print("      reload_pending = false;", file=f)
+    print("      rematch_only = false;", file=f)
+    print("      return GetSize(cells);", file=f)
+    print("    }", file=f)
+    print("", file=f)
+    print("    // the users of connected bits are indexed under the old sigmap", file=f)
+    print("    for (auto &conn : pending_connections)", file=f)
+    print("      for (auto bit : sigmap(SigSpec({conn.first, conn.second}))) {", file=f)
+    print("        auto users_ptr = sigusers.find(bit);", file=f)
+    print("        if (users_ptr == sigusers.end()) continue;", file=f)
+    print("        for (auto user : users_ptr->second)", file=f)
+    print("          if (user != nullptr)", file=f)
+    print("            dirty_cells.insert(user);", file=f)
+    print("      }", file=f)
+    print("    for (auto cell : dirty_cells)", file=f)
+    print("      unindex_cell(cell);", file=f)
+    print("    for (auto &conn : pending_connections) {", file=f)
+    print("      SigSpec old_sig = sigmap(SigSpec({conn.first, conn.second}));", file=f)
+    print("      sigmap.add(conn.first, conn.second);", file=f)
+    print("      // only the module ports are left as users of the old bits", file=f)
+    print("      for (auto bit : old_sig) {", file=f)
+    print("        auto users_ptr = sigusers.find(bit);", file=f)
+    print("        if (users_ptr == sigusers.end() || sigmap(bit) == bit) continue;", file=f)
+    print("        pool<Cell*> users = std::move(users_ptr->second);", file=f)
+    print("        sigusers.erase(users_ptr);", file=f)
+    print("        if (sigmap(bit).wire != nullptr)", file=f)
+    print("          sigusers[sigmap(bit)].insert(users.begin(), users.end());", file=f)
+    print("      }", file=f)
+    print("    }", file=f)
+    print("    pending_connections.clear();", file=f)
+    print("", file=f)
+    print("    for (auto cell : dirty_cells) {", file=f)
+    print("      if (detached_cells.count(cell)) {", file=f)
+    print("        setup_cells.erase(cell);", file=f)
+    print("        continue;", file=f)
+    print("      }", file=f)
+    print("      cell_sigbits[cell];", file=f)
+    print("      for (auto &conn : cell->connections())", file=f)
+    print("        add_siguser(conn.second, cell);", file=f)
+    print("      if (setup_cells.count(cell) || module->selected(cell))", file=f)
+    print("        index_cell(cell);", file=f)
+    print("      rematch_cells.insert(cell);", file=f)
+    print("    }", file=f)
+    print("    dirty_cells.clear();", file=f)
+    print("    detached_cells.clear();", file=f)
+    print("", file=f)
+    print("    int changed = GetSize(rematch_cells);", file=f)
+    print("    pool<Cell*> frontier = rematch_cells;", file=f)
+    print("    for (int i = 0; i < depth && !frontier.empty(); i++) {", file=f)
+    print("      pool<Cell*> next;", file=f)
+    print("      for (auto cell : frontier)", file=f)
+    print("        for (auto bit : cell_sigbits.at(cell))", file=f)
+    print("          for (auto user : sigusers.at(bit))", file=f)
+    print("            if (user != nullptr && rematch_cells.insert(user).second)", file=f)
+    print("              next.insert(user);", file=f)
+    print("      frontier.swap(next);", file=f)
+    print("    }", file=f)
+    print("    rematch_only = true;", file=f)
+    print("    return changed;", file=f)
     print("  }", file=f)
     print("", file=f)
 
     print("  ~{}_pm() {{".format(prefix), file=f)
+    print("    if (monitor != nullptr) {", file=f)
+    print("      module->monitors.erase(monitor);", file=f)
+    print("      delete monitor;", file=f)
+    print("    }", file=f)
     print("    for (auto cell : autoremove_cells)", file=f)
     print("      module->remove(cell);", file=f)
     print("  }", file=f)
@@ -587,6 +787,16 @@ with open(outfile, "w") as f:
     current_pattern = None
     current_subpattern = None
 
+    # after update() matches only start at cells near the changes
+    root_blocks = set()
+    for current_pattern in patterns.keys():
+        index = patterns[current_pattern]
+        while blocks[index]["type"] not in ("match", "final"):
+            index += 1
+        if blocks[index]["type"] == "match":
+            root_blocks.add(index)
+    current_pattern = None
+
     for index in range(len(blocks)):
         block = blocks[index]
 
@@ -723,7 +933,7 @@ with open(outfile, "w") as f:
             print("", file=f)
             print("    index_{}_key_type key;".format(index), file=f)
             for field, entry in enumerate(block["index"]):
-                print("    std::get<{}>(key) = {};".format(field, entry[2]), file=f)
+                print("    {} = {};".format(index_key_field(block, field), entry[2]), file=f)
             print("    auto cells_ptr = index_{}.find(key);".format(index), file=f)
 
             if block["semioptional"] or block["genargs"] is not None:
@@ -746,6 +956,8 @@ with open(outfile, "w") as f:
                     print("        const {} &{} YS_MAYBE_UNUSED = std::get<{}>(cells[_pmg_idx]);".format(item[1], item[2], valueidx), file=f)
                     valueidx += 1
             print("        if (blacklist_cells.count({})) continue;".format(block["cell"]), file=f)
+            if index in root_blocks:
+                print("        if (rematch_only && !rematch_cells.count({})) continue;".format(block["cell"]), file=f)
             for expr in block["filter"]:
                 print("        if (!({})) continue;".format(expr), file=f)
             if block["semioptional"] or block["genargs"] is not None:
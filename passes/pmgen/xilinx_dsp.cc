@@ -64,7 +64,9 @@ static Cell* addDsp(Module *module) {
 	return cell;
 }
 
-void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells)
+// The new DSP cells are returned in simd_cells instead of being selected, as
+// the design selection must not be modified while other modules are packed.
+void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells, std::vector<IdString> &simd_cells)
 {
 	std::deque<Cell*> simd12_add, simd12_sub;
 	std::deque<Cell*> simd24_add, simd24_sub;
@@ -120,7 +122,7 @@ void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells)
 		P.append(Y.extract(0, 12));
 		CARRYOUT.append(Y[12]);
 	};
-	auto g12 = [&f12,module](std::deque<Cell*> &simd12) {
+	auto g12 = [&f12,&simd_cells,module](std::deque<Cell*> &simd12) {
 		while (simd12.size() > 1) {
 			SigSpec AB, C, P, CARRYOUT;
 
@@ -187,7 +189,7 @@ void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells)
 			if (lane3) module->remove(lane3);
 			if (lane4) module->remove(lane4);
 
-			module->design->select(module, cell);
+			simd_cells.push_back(cell->name);
 		}
 	};
 	g12(simd12_add);
@@ -209,7 +211,7 @@ void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells)
 		CARRYOUT.append(module->addWire(NEW_ID)); // TWO24 uses every other bit
 		CARRYOUT.append(Y[24]);
 	};
-	auto g24 = [&f24,module](std::deque<Cell*> &simd24) {
+	auto g24 = [&f24,&simd_cells,module](std::deque<Cell*> &simd24) {
 		while (simd24.size() > 1) {
 			SigSpec AB;
 			SigSpec C;
@@ -249,7 +251,7 @@ void xilinx_simd_pack(Module *module, const std::vector<Cell*> &selected_cells)
 			module->remove(lane1);
 			module->remove(lane2);
 
-			module->design->select(module, cell);
+			simd_cells.push_back(cell->name);
 		}
 	};
 	g24(simd24_add);
@@ -790,24 +792,45 @@ struct XilinxDspPass : public Pass {
 		if (family == "xcup")
 			family = "xcu";
 
-		for (auto module : design->selected_modules()) {
-
-			if (design->scratchpad_get_bool("xilinx_dsp.multonly"))
-				continue;
+		if (design->scratchpad_get_bool("xilinx_dsp.multonly"))
+			return;
+
+		// DSP packing is local to each module, so the modules are packed in
+		// parallel
+		std::vector<RTLIL::Module*> modules = design->selected_modules();
+		dict<RTLIL::Module*, int> module_index;
+		for (auto module : modules)
+			module_index[module] = GetSize(module_index);
+		std::vector<std::vector<IdString>> simd_cells(GetSize(modules));
+
+		execute_modules(design, modules, [&](RTLIL::Module *module) {
+			std::vector<IdString> &module_simd_cells = simd_cells[module_index.at(module)];
+
+			// the selected cells, including the SIMD DSPs that are only
+			// selected after all modules are done
+			auto selected_cells = [&]() {
+				std::vector<Cell*> cells = module->selected_cells();
+				for (auto name : module_simd_cells) {
+					Cell *cell = module->cell(name);
+					if (cell != nullptr && !module->selected(cell))
+						cells.push_back(cell);
+				}
+				return cells;
+			};
 
 			// Experimental feature: pack $add/$sub cells with
 			//   (* use_dsp48="simd" *) into DSP48E1's using its
 			//   SIMD feature
 			if (family == "xc7")
-				xilinx_simd_pack(module, module->selected_cells());
+				xilinx_simd_pack(module, module->selected_cells(), module_simd_cells);
 
 			// Match for all features ([ABDMP][12]?REG, pre-adder,
 			// post-adder, pattern detector, etc.) except for CREG
 			if (family == "xc7") {
-				xilinx_dsp_pm pm(module, module->selected_cells());
+				xilinx_dsp_pm pm(module, selected_cells());
 				pm.run_xilinx_dsp_pack(xilinx_dsp_pack);
 			} else if (family == "xc6s" || family == "xc3sda") {
-				xilinx_dsp48a_pm pm(module, module->selected_cells());
+				xilinx_dsp48a_pm pm(module, selected_cells());
 				pm.run_xilinx_dsp48a_pack(xilinx_dsp48a_pack);
 			}
 			// Separating out CREG packing is necessary since there
@@ -819,17 +842,24 @@ struct XilinxDspPass : public Pass {
 			//   PREG of an upstream DSP that had not been visited
 			//   yet
 			{
-				xilinx_dsp_CREG_pm pm(module, module->selected_cells());
+				xilinx_dsp_CREG_pm pm(module, selected_cells());
 				pm.run_xilinx_dsp_packC(xilinx_dsp_packC);
 			}
 			// Lastly, identify and utilise PCOUT -> PCIN,
 			//   ACOUT -> ACIN, and BCOUT-> BCIN dedicated cascade
 			//   chains
 			{
-				xilinx_dsp_cascade_pm pm(module, module->selected_cells());
+				xilinx_dsp_cascade_pm pm(module, selected_cells());
 				pm.run_xilinx_dsp_cascade();
 			}
-		}
+		});
+
+		for (int i = 0; i < GetSize(modules); i++)
+			for (auto name : simd_cells[i]) {
+				Cell *cell = modules[i]->cell(name);
+				if (cell != nullptr)
+					design->select(modules[i], cell);
+			}
 	}
 } XilinxDspPass;
 
@@ -26,14 +26,113 @@ PRIVATE_NAMESPACE_BEGIN
 
 #include "passes/pmgen/xilinx_srl_pm.h"
 
-void run_fixed(xilinx_srl_pm &pm)
+// Fixed chains are found without the matcher, which recurses once per flop
+// and overflows the stack on long chains. The rules are those of the "fixed"
+// pattern in xilinx_srl.pmg, which is kept for test_pmgen.
+
+bool fixed_flop(const SigMap &sigmap, Cell *cell)
+{
+	if (!cell->type.in(ID($_DFF_N_), ID($_DFF_P_), ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_), ID(FDRE), ID(FDRE_1)))
+		return false;
+	if (cell->has_keep_attr())
+		return false;
+	if (cell->type == ID(FDRE) && (cell->getParam(ID(IS_R_INVERTED)).as_bool() || cell->getParam(ID(IS_D_INVERTED)).as_bool()))
+		return false;
+	if (cell->type.in(ID(FDRE), ID(FDRE_1)) && cell->hasPort(ID::R) && !sigmap(cell->getPort(ID::R)).is_fully_zero())
+		return false;
+	return true;
+}
+
+// whether prev, whose Q drives the D input of cell, can precede it in a chain
+bool fixed_link(const SigMap &sigmap, Cell *prev, Cell *cell)
+{
+	if (prev->type != cell->type)
+		return false;
+	if (sigmap(prev->getPort(ID::C)) != sigmap(cell->getPort(ID::C)))
+		return false;
+	IdString en_port = cell->type.in(ID(FDRE), ID(FDRE_1)) ? ID(CE) : cell->type.begins_with("$_DFFE_") ? ID::E : IdString();
+	if (en_port != IdString() && sigmap(prev->getPort(en_port)) != sigmap(cell->getPort(en_port)))
+		return false;
+	if (cell->type == ID(FDRE))
+		for (auto param : {ID(IS_C_INVERTED), ID(IS_D_INVERTED), ID(IS_R_INVERTED)})
+			if (prev->getParam(param).as_bool() != cell->getParam(param).as_bool())
+				return false;
+	return true;
+}
+
+// Links each flop to the flop driving its D input in one pass over the
+// cells. A flop can only be linked to by the single other user of its Q
+// output, so the links form disjoint lists, which are walked from the
+// output end. The chains are in the order of the matcher: output end first.
+std::vector<std::vector<Cell*>> find_fixed_chains(Module *module, const std::vector<Cell*> &cells, int minlen)
+{
+	SigMap sigmap(module);
+	std::vector<Cell*> flops;
+	dict<SigBit, int> q_users;
+	for (auto cell : cells)
+		if (fixed_flop(sigmap, cell)) {
+			flops.push_back(cell);
+			q_users[sigmap(cell->getPort(ID::Q)[0])] = 0;
+		}
+
+	// nusers() of the matcher, for the Q outputs only
+	dict<SigBit, Cell*> last_user;
+	for (auto port : module->ports)
+		for (auto bit : sigmap(module->wire(port)))
+			if (q_users.count(bit) && !last_user.count(bit)) {
+				q_users[bit]++;
+				last_user[bit] = nullptr;
+			}
+	for (auto cell : module->cells())
+		for (auto &conn : cell->connections())
+			for (auto bit : sigmap(conn.second)) {
+				auto it = q_users.find(bit);
+				if (it == q_users.end())
+					continue;
+				auto last_it = last_user.find(bit);
+				if (last_it != last_user.end() && last_it->second == cell)
+					continue;
+				it->second++;
+				last_user[bit] = cell;
+			}
+
+	dict<SigBit, Cell*> drivers;
+	for (auto cell : flops) {
+		SigBit d = cell->getPort(ID::D)[0];
+		SigBit q = sigmap(cell->getPort(ID::Q)[0]);
+		if (d.wire && !d.wire->get_bool_attribute(ID::keep) && q_users.at(q) == 2)
+			drivers[q] = cell;
+	}
+
+	dict<Cell*, Cell*> prev;
+	pool<Cell*> has_next;
+	for (auto cell : flops) {
+		auto it = drivers.find(sigmap(cell->getPort(ID::D)[0]));
+		if (it != drivers.end() && fixed_link(sigmap, it->second, cell)) {
+			prev[cell] = it->second;
+			has_next.insert(it->second);
+		}
+	}
+
+	std::vector<std::vector<Cell*>> chains;
+	for (auto cell : flops) {
+		if (has_next.count(cell))
+			continue;
+		std::vector<Cell*> chain = {cell};
+		for (auto it = prev.find(cell); it != prev.end(); it = prev.find(it->second))
+			chain.push_back(it->second);
+		if (GetSize(chain) >= minlen)
+			chains.push_back(std::move(chain));
+	}
+	return chains;
+}
+
+void run_fixed(Module *module, const std::vector<Cell*> &chain)
 {
-	auto &st = pm.st_fixed;
-	auto &ud = pm.ud_fixed;
-	log("Found fixed chain of length %d (%s):\n", GetSize(ud.longest_chain), log_id(st.first->type));
+	log("Found fixed chain of length %d (%s):\n", GetSize(chain), log_id(chain.front()->type));
 
 	SigSpec initval;
-	for (auto cell : ud.longest_chain) {
+	for (auto cell : chain) {
 		log_debug("    %s\n", log_id(cell));
 		if (cell->type.in(ID($_DFF_N_), ID($_DFF_P_), ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_))) {
 			SigBit Q = cell->getPort(ID::Q);
@@ -55,16 +154,15 @@ void run_fixed(xilinx_srl_pm &pm)
 		}
 		else
 			log_abort();
-		pm.autoremove(cell);
 	}
 
-	auto first_cell = ud.longest_chain.back();
-	auto last_cell = ud.longest_chain.front();
-	Cell *c = pm.module->addCell(NEW_ID, ID($__XILINX_SHREG_));
-	pm.module->swap_names(c, first_cell);
+	auto first_cell = chain.back();
+	auto last_cell = chain.front();
+	Cell *c = module->addCell(NEW_ID, ID($__XILINX_SHREG_));
+	module->swap_names(c, first_cell);
 
 	if (first_cell->type.in(ID($_DFF_N_), ID($_DFF_P_), ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_), ID(FDRE), ID(FDRE_1))) {
-		c->setParam(ID::DEPTH, GetSize(ud.longest_chain));
+		c->setParam(ID::DEPTH, GetSize(chain));
 		c->setParam(ID::INIT, initval.as_const());
 		if (first_cell->type.in(ID($_DFF_P_), ID($_DFFE_PN_), ID($_DFFE_PP_)))
 			c->setParam(ID(CLKPOL), 1);
@@ -88,7 +186,7 @@ void run_fixed(xilinx_srl_pm &pm)
 		c->setPort(ID::C, first_cell->getPort(ID::C));
 		c->setPort(ID::D, first_cell->getPort(ID::D));
 		c->setPort(ID::Q, last_cell->getPort(ID::Q));
-		c->setPort(ID::L, GetSize(ud.longest_chain)-1);
+		c->setPort(ID::L, GetSize(chain)-1);
 		if (first_cell->type.in(ID($_DFF_N_), ID($_DFF_P_)))
 			c->setPort(ID::E, State::S1);
 		else if (first_cell->type.in(ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_)))
@@ -102,6 +200,9 @@ void run_fixed(xilinx_srl_pm &pm)
 		log_abort();
 
 	log("    -> %s (%s)\n", log_id(c), log_id(c->type));
+
+	for (auto cell : chain)
+		module->remove(cell);
 }
 
 void run_variable(xilinx_srl_pm &pm)
@@ -242,16 +343,17 @@ struct XilinxSrlPass : public Pass {
 		if (!fixed && !variable)
 			log_cmd_error("'-fixed' and/or '-variable' must be specified.\n");
 
-		for (auto module : design->selected_modules()) {
-			auto pm = xilinx_srl_pm(module, module->selected_cells());
-			pm.ud_fixed.minlen = minlen;
-			pm.ud_variable.minlen = minlen;
-
+		execute_modules(design, design->selected_modules(), [&](RTLIL::Module *module) {
 			if (fixed)
-				pm.run_fixed(run_fixed);
-			if (variable)
+				for (auto &chain : find_fixed_chains(module, module->selected_cells(), minlen))
+					run_fixed(module, chain);
+
+			if (variable) {
+				auto pm = xilinx_srl_pm(module, module->selected_cells());
+				pm.ud_variable.minlen = minlen;
 				pm.run_variable(run_variable);
-		}
+			}
+		});
 	}
 } XilinxSrlPass;
 
@@ -110,37 +110,70 @@ struct SnippetSwCache
 {
 	dict<RTLIL::SwitchRule*, pool<RTLIL::SigBit>, hash_ptr_ops> full_case_bits_cache;
 	dict<RTLIL::SwitchRule*, pool<int>, hash_ptr_ops> cache;
+	// the snippets assigned in a case or in the switches below it, and for
+	// each snippet the indices of the actions of the case that assign to it
+	dict<const RTLIL::CaseRule*, pool<int>, hash_ptr_ops> case_cache;
+	dict<const RTLIL::CaseRule*, dict<int, std::vector<int>>, hash_ptr_ops> action_cache;
+	// the compare logic of each case, shared by the muxes of all snippets
+	dict<const RTLIL::CaseRule*, RTLIL::SigSpec, hash_ptr_ops> cmp_cache;
 	const SigSnippets *snippets;
 	int current_snippet;
 
 	bool check(RTLIL::SwitchRule *sw)
 	{
-		return cache[sw].count(current_snippet) != 0;
+		auto it = cache.find(sw);
+		return it != cache.end() && it->second.count(current_snippet) != 0;
 	}
 
-	void insert(const RTLIL::CaseRule *cs, vector<RTLIL::SwitchRule*> &sw_stack)
+	bool check(const RTLIL::CaseRule *cs)
 	{
-		for (auto &action : cs->actions)
-		for (auto bit : action.first) {
+		auto it = case_cache.find(cs);
+		return it != case_cache.end() && it->second.count(current_snippet) != 0;
+	}
+
+	const std::vector<int> *actions(const RTLIL::CaseRule *cs)
+	{
+		auto it = action_cache.find(cs);
+		if (it == action_cache.end())
+			return nullptr;
+		auto it2 = it->second.find(current_snippet);
+		return it2 == it->second.end() ? nullptr : &it2->second;
+	}
+
+	void insert(const RTLIL::CaseRule *cs, vector<RTLIL::SwitchRule*> &sw_stack, vector<const RTLIL::CaseRule*> &cs_stack)
+	{
+		cs_stack.push_back(cs);
+
+		for (int i = 0; i < GetSize(cs->actions); i++)
+		for (auto bit : cs->actions[i].first) {
 			int sn = snippets->bit2snippet.at(bit, -1);
 			if (sn < 0)
 				continue;
+			std::vector<int> &indices = action_cache[cs][sn];
+			if (!indices.empty() && indices.back() == i)
+				continue;
+			indices.push_back(i);
 			for (auto sw : sw_stack)
 				cache[sw].insert(sn);
+			for (auto cs2 : cs_stack)
+				case_cache[cs2].insert(sn);
 		}
 
 		for (auto sw : cs->switches) {
 			sw_stack.push_back(sw);
 			for (auto cs2 : sw->cases)
-				insert(cs2, sw_stack);
+				insert(cs2, sw_stack, cs_stack);
 			sw_stack.pop_back();
 		}
+
+		cs_stack.pop_back();
 	}
 
 	void insert(const RTLIL::CaseRule *cs)
 	{
 		vector<RTLIL::SwitchRule*> sw_stack;
-		insert(cs, sw_stack);
+		vector<const RTLIL::CaseRule*> cs_stack;
+		insert(cs, sw_stack, cs_stack);
 	}
 };
 
@@ -218,28 +251,39 @@ RTLIL::SigSpec gen_cmp(RTLIL::Module *mod, const RTLIL::SigSpec &signal, const s
 	return RTLIL::SigSpec(ctrl_wire);
 }
 
-RTLIL::SigSpec gen_mux(RTLIL::Module *mod, const RTLIL::SigSpec &signal, const std::vector<RTLIL::SigSpec> &compare, RTLIL::SigSpec when_signal, RTLIL::SigSpec else_signal, RTLIL::Cell *&last_mux_cell, RTLIL::SwitchRule *sw, RTLIL::CaseRule *cs, bool ifxmode)
+// The compare logic only depends on the case, so it is created once and used
+// for the muxes of all snippets assigned in the case.
+RTLIL::SigSpec get_cmp(SnippetSwCache &swcache, RTLIL::Module *mod, const RTLIL::SigSpec &signal, const std::vector<RTLIL::SigSpec> &compare, RTLIL::SwitchRule *sw, RTLIL::CaseRule *cs, bool ifxmode)
+{
+	auto it = swcache.cmp_cache.find(cs);
+	if (it == swcache.cmp_cache.end())
+		it = swcache.cmp_cache.emplace(cs, gen_cmp(mod, signal, compare, sw, cs, ifxmode)).first;
+	return it->second;
+}
+
+RTLIL::SigSpec gen_mux(RTLIL::Module *mod, SnippetSwCache &swcache, const RTLIL::SigSpec &signal, const std::vector<RTLIL::SigSpec> &compare, RTLIL::SigSpec when_signal, RTLIL::SigSpec else_signal, RTLIL::Cell *&last_mux_cell, RTLIL::SwitchRule *sw, RTLIL::CaseRule *cs, bool ifxmode)
 {
 	log_assert(when_signal.size() == else_signal.size());
 
-	std::stringstream sstr;
-	sstr << "$procmux$" << (autoidx++);
+	int mux_idx = autoidx++;
 
 	// the trivial cases
 	if (compare.size() == 0 || when_signal == else_signal)
 		return when_signal;
 
 	// compare results
-	RTLIL::SigSpec ctrl_sig = gen_cmp(mod, signal, compare, sw, cs, ifxmode);
+	RTLIL::SigSpec ctrl_sig = get_cmp(swcache, mod, signal, compare, sw, cs, ifxmode);
 	if (ctrl_sig.size() == 0)
 		return when_signal;
 	log_assert(ctrl_sig.size() == 1);
 
+	std::string mux_name = stringf("$procmux$%d", mux_idx);
+
 	// prepare multiplexer output signal
-	RTLIL::Wire *result_wire = mod->addWire(sstr.str() + "_Y", when_signal.size());
+	RTLIL::Wire *result_wire = mod->addWire(mux_name + "_Y", when_signal.size());
 
 	// create the multiplexer itself
-	RTLIL::Cell *mux_cell = mod->addCell(sstr.str(), ID($mux));
+	RTLIL::Cell *mux_cell = mod->addCell(mux_name, ID($mux));
 	apply_attrs(mux_cell, sw, cs);
 
 	mux_cell->parameters[ID::WIDTH] = RTLIL::Const(when_signal.size());
@@ -252,7 +296,7 @@ RTLIL::SigSpec gen_mux(RTLIL::Module *mod, const RTLIL::SigSpec &signal, const s
 	return RTLIL::SigSpec(result_wire);
 }
 
-void append_pmux(RTLIL::Module *mod, const RTLIL::SigSpec &signal, const std::vector<RTLIL::SigSpec> &compare, RTLIL::SigSpec when_signal, RTLIL::Cell *last_mux_cell, RTLIL::SwitchRule *sw, RTLIL::CaseRule *cs, bool ifxmode)
+void append_pmux(RTLIL::Module *mod, SnippetSwCache &swcache, const RTLIL::SigSpec &signal, const std::vector<RTLIL::SigSpec> &compare, RTLIL::SigSpec when_signal, RTLIL::Cell *last_mux_cell, RTLIL::SwitchRule *sw, RTLIL::CaseRule *cs, bool ifxmode)
 {
 	log_assert(last_mux_cell != NULL);
 	log_assert(when_signal.size() == last_mux_cell->getPort(ID::A).size());
@@ -260,7 +304,7 @@ void append_pmux(RTLIL::Module *mod, const RTLIL::SigSpec &signal, const std::ve
 	if (when_signal == last_mux_cell->getPort(ID::A))
 		return;
 
-	RTLIL::SigSpec ctrl_sig = gen_cmp(mod, signal, compare, sw, cs, ifxmode);
+	RTLIL::SigSpec ctrl_sig = get_cmp(swcache, mod, signal, compare, sw, cs, ifxmode);
 	log_assert(ctrl_sig.size() == 1);
 	last_mux_cell->type = ID($pmux);
 
@@ -323,10 +367,13 @@ RTLIL::SigSpec signal_to_mux_tree(RTLIL::Module *mod, SnippetSwCache &swcache, d
 {
 	RTLIL::SigSpec result = defval;
 
-	for (auto &action : cs->actions) {
-		sig.replace(action.first, action.second, &result);
-		action.first.remove2(sig, &action.second);
-	}
+	// only the actions that assign to the snippet, in their original order
+	if (const std::vector<int> *indices = swcache.actions(cs))
+		for (int i : *indices) {
+			auto &action = cs->actions[i];
+			sig.replace(action.first, action.second, &result);
+			action.first.remove2(sig, &action.second);
+		}
 
 	for (auto sw : cs->switches)
 	{
@@ -399,11 +446,12 @@ RTLIL::SigSpec signal_to_mux_tree(RTLIL::Module *mod, SnippetSwCache &swcache, d
 		for (size_t i = 0; i < sw->cases.size(); i++) {
 			int case_idx = sw->cases.size() - i - 1;
 			RTLIL::CaseRule *cs2 = sw->cases[case_idx];
-			RTLIL::SigSpec value = signal_to_mux_tree(mod, swcache, swpara, cs2, sig, initial_val, ifxmode);
+			// a case that does not assign to the snippet keeps the initial value
+			RTLIL::SigSpec value = swcache.check(cs2) ? signal_to_mux_tree(mod, swcache, swpara, cs2, sig, initial_val, ifxmode) : initial_val;
 			if (last_mux_cell && pgroups[case_idx] == pgroups[case_idx+1])
-				append_pmux(mod, sw->signal, cs2->compare, value, last_mux_cell, sw, cs2, ifxmode);
+				append_pmux(mod, swcache, sw->signal, cs2->compare, value, last_mux_cell, sw, cs2, ifxmode);
 			else
-				result = gen_mux(mod, sw->signal, cs2->compare, value, result, last_mux_cell, sw, cs2, ifxmode);
+				result = gen_mux(mod, swcache, sw->signal, cs2->compare, value, result, last_mux_cell, sw, cs2, ifxmode);
 		}
 	}
 
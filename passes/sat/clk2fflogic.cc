@@ -118,6 +118,168 @@ struct Clk2fflogicPass : public Pass {
 		else
 			return module->And(NEW_ID, module->Or(NEW_ID, a, s), module->Not(NEW_ID, r));
 	}
+	// Number of cells added for the replacement of an FF, used to reserve
+	// space for the batch. Each of the cells drives a new wire.
+	static int ff_cell_estimate(const FfData &ff) {
+		int count = 1;
+		if (ff.has_clk)
+			count += 6;
+		if (ff.has_aload)
+			count += 5;
+		if (ff.has_sr)
+			count += 10;
+		if (ff.has_arst)
+			count += 4;
+		return count;
+	}
+	void handle_trg_cell(Module *module, Cell *cell, SigBit &initstate) {
+		int trg_width = cell->getParam(ID(TRG_WIDTH)).as_int();
+
+		if (trg_width == 0) {
+			if (initstate == State::S0)
+				initstate = module->Initstate(NEW_ID);
+
+			SigBit sig_en = cell->getPort(ID::EN);
+			cell->setPort(ID::EN, module->And(NEW_ID, sig_en, initstate));
+		} else {
+			SigBit sig_en = cell->getPort(ID::EN);
+			SigSpec sig_args = cell->getPort(ID::ARGS);
+			Const trg_polarity = cell->getParam(ID(TRG_POLARITY));
+			SigSpec sig_trg = cell->getPort(ID::TRG);
+
+			SigSpec sig_trg_sampled;
+
+			for (auto const &bit : sig_trg)
+				sig_trg_sampled.append(sample_control_edge(module, bit, trg_polarity[GetSize(sig_trg_sampled)] == State::S1, false));
+			SigSpec sig_args_sampled = sample_data(module, sig_args, Const(State::S0, GetSize(sig_args)), false, false).sampled;
+			SigBit sig_en_sampled = sample_data(module, sig_en, State::S0, false, false).sampled;
+
+			SigBit sig_trg_combined = module->ReduceOr(NEW_ID, sig_trg_sampled);
+
+			cell->setPort(ID::EN, module->And(NEW_ID, sig_en_sampled, sig_trg_combined));
+			cell->setPort(ID::ARGS, sig_args_sampled);
+			if (cell->type == ID($check)) {
+				SigBit sig_a_sampled = sample_data(module, sig_en, State::S1, false, false).sampled;
+				cell->setPort(ID::A, sig_a_sampled);
+			}
+		}
+
+		cell->setPort(ID::TRG, SigSpec());
+
+		cell->setParam(ID::TRG_ENABLE, false);
+		cell->setParam(ID::TRG_WIDTH, 0);
+		cell->setParam(ID::TRG_POLARITY, false);
+		cell->set_bool_attribute(ID(trg_on_gclk));
+	}
+	void handle_mem(Module *module, Mem &mem) {
+		for (int i = 0; i < GetSize(mem.wr_ports); i++)
+		{
+			auto &port = mem.wr_ports[i];
+
+			if (!port.clk_enable)
+				continue;
+
+			log("Modifying write port %d on memory %s.%s: CLK=%s, A=%s, D=%s\n",
+					i, log_id(module), log_id(mem.memid), log_signal(port.clk),
+					log_signal(port.addr), log_signal(port.data));
+
+			Wire *past_clk = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#past_clk#%s", log_id(mem.memid), i, log_signal(port.clk))));
+			past_clk->attributes[ID::init] = port.clk_polarity ? State::S1 : State::S0;
+			module->addFf(NEW_ID, port.clk, past_clk);
+
+			SigSpec clock_edge_pattern;
+
+			if (port.clk_polarity) {
+				clock_edge_pattern.append(State::S0);
+				clock_edge_pattern.append(State::S1);
+			} else {
+				clock_edge_pattern.append(State::S1);
+				clock_edge_pattern.append(State::S0);
+			}
+
+			SigSpec clock_edge = module->Eqx(NEW_ID, {port.clk, SigSpec(past_clk)}, clock_edge_pattern);
+
+			SigSpec en_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#en_q", log_id(mem.memid), i)), GetSize(port.en));
+			module->addFf(NEW_ID, port.en, en_q);
+
+			SigSpec addr_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#addr_q", log_id(mem.memid), i)), GetSize(port.addr));
+			module->addFf(NEW_ID, port.addr, addr_q);
+
+			SigSpec data_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#data_q", log_id(mem.memid), i)), GetSize(port.data));
+			module->addFf(NEW_ID, port.data, data_q);
+
+			port.clk = State::S0;
+			port.en = module->Mux(NEW_ID, Const(0, GetSize(en_q)), en_q, clock_edge);
+			port.addr = addr_q;
+			port.data = data_q;
+
+			port.clk_enable = false;
+			port.clk_polarity = false;
+		}
+
+		mem.emit();
+	}
+	void handle_ff(Module *module, FfData &ff) {
+		Cell *cell = ff.cell;
+		if (ff.has_clk) {
+			log("Replacing %s.%s (%s): CLK=%s, D=%s, Q=%s\n",
+					log_id(module), log_id(cell), log_id(cell->type),
+					log_signal(ff.sig_clk), log_signal(ff.sig_d), log_signal(ff.sig_q));
+		} else if (ff.has_aload) {
+			log("Replacing %s.%s (%s): EN=%s, D=%s, Q=%s\n",
+					log_id(module), log_id(cell), log_id(cell->type),
+					log_signal(ff.sig_aload), log_signal(ff.sig_ad), log_signal(ff.sig_q));
+		} else {
+			// $sr.
+			log("Replacing %s.%s (%s): SET=%s, CLR=%s, Q=%s\n",
+					log_id(module), log_id(cell), log_id(cell->type),
+					log_signal(ff.sig_set), log_signal(ff.sig_clr), log_signal(ff.sig_q));
+		}
+
+		ff.remove();
+
+		if (ff.has_clk)
+			ff.unmap_ce_srst();
+
+		auto next_q = sample_data(module, ff.sig_q, ff.val_init, ff.is_fine, true).sampled;
+
+		if (ff.has_clk) {
+			// The init value for the sampled d is never used, so we can set it to fixed zero, reducing uninit'd FFs
+			auto sampled_d = sample_data(module, ff.sig_d, RTLIL::Const(State::S0, ff.width), ff.is_fine);
+			auto clk_edge = sample_control_edge(module, ff.sig_clk, ff.pol_clk, ff.is_fine);
+			next_q = mux(module, next_q, sampled_d.sampled, clk_edge, ff.is_fine);
+		}
+
+		SampledSig sampled_aload, sampled_ad, sampled_set, sampled_clr, sampled_arst;
+		// The check for a constant sig_aload is also done by opt_dff, but when using verific and running
+		// clk2fflogic before opt_dff (which does more and possibly unwanted optimizations) this check avoids
+		// generating a lot of extra logic.
+		bool has_nonconst_aload = ff.has_aload && ff.sig_aload != (ff.pol_aload ? State::S0 : State::S1);
+		if (has_nonconst_aload) {
+			sampled_aload = sample_control(module, ff.sig_aload, ff.pol_aload, ff.is_fine);
+			// The init value for the sampled ad is never used, so we can set it to fixed zero, reducing uninit'd FFs
+			sampled_ad = sample_data(module, ff.sig_ad, RTLIL::Const(State::S0, ff.width), ff.is_fine);
+		}
+		if (ff.has_sr) {
+			sampled_set = sample_control(module, ff.sig_set, ff.pol_set, ff.is_fine);
+			sampled_clr = sample_control(module, ff.sig_clr, ff.pol_clr, ff.is_fine);
+		}
+		if (ff.has_arst)
+			sampled_arst = sample_control(module, ff.sig_arst, ff.pol_arst, ff.is_fine);
+
+		// First perform updates using _only_ sampled values, then again using _only_ current values. Unlike the previous
+		// implementation, this approach correctly handles all the cases of multiple signals changing simultaneously.
+		for (int current = 0; current < 2; current++) {
+			if (has_nonconst_aload)
+				next_q = mux(module, next_q, sampled_ad[current], sampled_aload[current], ff.is_fine);
+			if (ff.has_sr)
+				next_q = bitwise_sr(module, next_q, sampled_set[current], sampled_clr[current], ff.is_fine);
+			if (ff.has_arst)
+				next_q = mux(module, next_q, ff.val_arst, sampled_arst[current], ff.is_fine);
+		}
+
+		module->connect(ff.sig_q, next_q);
+	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		bool flag_nolower = false;
@@ -135,14 +297,19 @@ struct Clk2fflogicPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		bool have_check_cells = false;
+		std::atomic<bool> have_check_cells(false);
 
-		for (auto module : design->selected_modules())
+		execute_modules(design, design->selected_modules(), [&](Module *module)
 		{
 			SigMap sigmap(module);
 			FfInitVals initvals(&sigmap, module);
 
-			for (auto &mem : Mem::get_selected_memories(module))
+			// Collect everything that is rewritten first, so that the new cells
+			// and wires can be added in one batch.
+			std::vector<Mem> mems = Mem::get_selected_memories(module);
+			int num_cells = 0;
+
+			for (auto &mem : mems)
 			{
 				for (int i = 0; i < GetSize(mem.rd_ports); i++) {
 					auto &port = mem.rd_ports[i];
@@ -151,105 +318,25 @@ struct Clk2fflogicPass : public Pass {
 								"Call \"memory\" with -nordff to avoid this error.\n", i, log_id(mem.memid), log_id(module));
 				}
 
-				for (int i = 0; i < GetSize(mem.wr_ports); i++)
-				{
-					auto &port = mem.wr_ports[i];
-
-					if (!port.clk_enable)
-						continue;
-
-					log("Modifying write port %d on memory %s.%s: CLK=%s, A=%s, D=%s\n",
-							i, log_id(module), log_id(mem.memid), log_signal(port.clk),
-							log_signal(port.addr), log_signal(port.data));
-
-					Wire *past_clk = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#past_clk#%s", log_id(mem.memid), i, log_signal(port.clk))));
-					past_clk->attributes[ID::init] = port.clk_polarity ? State::S1 : State::S0;
-					module->addFf(NEW_ID, port.clk, past_clk);
-
-					SigSpec clock_edge_pattern;
-
-					if (port.clk_polarity) {
-						clock_edge_pattern.append(State::S0);
-						clock_edge_pattern.append(State::S1);
-					} else {
-						clock_edge_pattern.append(State::S1);
-						clock_edge_pattern.append(State::S0);
-					}
-
-					SigSpec clock_edge = module->Eqx(NEW_ID, {port.clk, SigSpec(past_clk)}, clock_edge_pattern);
-
-					SigSpec en_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#en_q", log_id(mem.memid), i)), GetSize(port.en));
-					module->addFf(NEW_ID, port.en, en_q);
-
-					SigSpec addr_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#addr_q", log_id(mem.memid), i)), GetSize(port.addr));
-					module->addFf(NEW_ID, port.addr, addr_q);
-
-					SigSpec data_q = module->addWire(NEW_ID_SUFFIX(stringf("%s#%d#data_q", log_id(mem.memid), i)), GetSize(port.data));
-					module->addFf(NEW_ID, port.data, data_q);
-
-					port.clk = State::S0;
-					port.en = module->Mux(NEW_ID, Const(0, GetSize(en_q)), en_q, clock_edge);
-					port.addr = addr_q;
-					port.data = data_q;
-
-					port.clk_enable = false;
-					port.clk_polarity = false;
-				}
-
-				mem.emit();
+				for (auto &port : mem.wr_ports)
+					if (port.clk_enable)
+						num_cells += 6;
 			}
 
-			SigBit initstate;
+			std::vector<Cell*> trg_cells;
+			std::vector<FfData> ffs;
 
-			for (auto cell : vector<Cell*>(module->selected_cells()))
+			for (auto cell : module->selected_cells())
 			{
 				if (cell->type.in(ID($print), ID($check)))
 				{
 					if (cell->type == ID($check))
 						have_check_cells = true;
 
-					bool trg_enable = cell->getParam(ID(TRG_ENABLE)).as_bool();
-					if (!trg_enable)
-						continue;
-
-					int trg_width = cell->getParam(ID(TRG_WIDTH)).as_int();
-
-					if (trg_width == 0) {
-						if (initstate == State::S0)
-							initstate = module->Initstate(NEW_ID);
-
-						SigBit sig_en = cell->getPort(ID::EN);
-						cell->setPort(ID::EN, module->And(NEW_ID, sig_en, initstate));
-					} else {
-						SigBit sig_en = cell->getPort(ID::EN);
-						SigSpec sig_args = cell->getPort(ID::ARGS);
-						Const trg_polarity = cell->getParam(ID(TRG_POLARITY));
-						SigSpec sig_trg = cell->getPort(ID::TRG);
-
-						SigSpec sig_trg_sampled;
-
-						for (auto const &bit : sig_trg)
-							sig_trg_sampled.append(sample_control_edge(module, bit, trg_polarity[GetSize(sig_trg_sampled)] == State::S1, false));
-						SigSpec sig_args_sampled = sample_data(module, sig_args, Const(State::S0, GetSize(sig_args)), false, false).sampled;
-						SigBit sig_en_sampled = sample_data(module, sig_en, State::S0, false, false).sampled;
-
-						SigBit sig_trg_combined = module->ReduceOr(NEW_ID, sig_trg_sampled);
-
-						cell->setPort(ID::EN, module->And(NEW_ID, sig_en_sampled, sig_trg_combined));
-						cell->setPort(ID::ARGS, sig_args_sampled);
-						if (cell->type == ID($check)) {
-							SigBit sig_a_sampled = sample_data(module, sig_en, State::S1, false, false).sampled;
-							cell->setPort(ID::A, sig_a_sampled);
-						}
+					if (cell->getParam(ID(TRG_ENABLE)).as_bool()) {
+						trg_cells.push_back(cell);
+						num_cells += 2 * cell->getParam(ID(TRG_WIDTH)).as_int() + 5;
 					}
-
-					cell->setPort(ID::TRG, SigSpec());
-
-					cell->setParam(ID::TRG_ENABLE, false);
-					cell->setParam(ID::TRG_WIDTH, 0);
-					cell->setParam(ID::TRG_POLARITY, false);
-					cell->set_bool_attribute(ID(trg_on_gclk));
-
 					continue;
 				}
 
@@ -263,67 +350,24 @@ struct Clk2fflogicPass : public Pass {
 					continue;
 				}
 
-				if (ff.has_clk) {
-					log("Replacing %s.%s (%s): CLK=%s, D=%s, Q=%s\n",
-							log_id(module), log_id(cell), log_id(cell->type),
-							log_signal(ff.sig_clk), log_signal(ff.sig_d), log_signal(ff.sig_q));
-				} else if (ff.has_aload) {
-					log("Replacing %s.%s (%s): EN=%s, D=%s, Q=%s\n",
-							log_id(module), log_id(cell), log_id(cell->type),
-							log_signal(ff.sig_aload), log_signal(ff.sig_ad), log_signal(ff.sig_q));
-				} else {
-					// $sr.
-					log("Replacing %s.%s (%s): SET=%s, CLR=%s, Q=%s\n",
-							log_id(module), log_id(cell), log_id(cell->type),
-							log_signal(ff.sig_set), log_signal(ff.sig_clr), log_signal(ff.sig_q));
-				}
-
-				ff.remove();
-
-				if (ff.has_clk)
-					ff.unmap_ce_srst();
+				num_cells += ff_cell_estimate(ff);
+				ffs.push_back(ff);
+			}
 
-				auto next_q = sample_data(module, ff.sig_q, ff.val_init, ff.is_fine, true).sampled;
+			module->begin_batch(num_cells, num_cells, GetSize(ffs));
 
-				if (ff.has_clk) {
-					// The init value for the sampled d is never used, so we can set it to fixed zero, reducing uninit'd FFs
-					auto sampled_d = sample_data(module, ff.sig_d, RTLIL::Const(State::S0, ff.width), ff.is_fine);
-					auto clk_edge = sample_control_edge(module, ff.sig_clk, ff.pol_clk, ff.is_fine);
-					next_q = mux(module, next_q, sampled_d.sampled, clk_edge, ff.is_fine);
-				}
+			for (auto &mem : mems)
+				handle_mem(module, mem);
 
-				SampledSig sampled_aload, sampled_ad, sampled_set, sampled_clr, sampled_arst;
-				// The check for a constant sig_aload is also done by opt_dff, but when using verific and running
-				// clk2fflogic before opt_dff (which does more and possibly unwanted optimizations) this check avoids
-				// generating a lot of extra logic.
-				bool has_nonconst_aload = ff.has_aload && ff.sig_aload != (ff.pol_aload ? State::S0 : State::S1);
-				if (has_nonconst_aload) {
-					sampled_aload = sample_control(module, ff.sig_aload, ff.pol_aload, ff.is_fine);
-					// The init value for the sampled ad is never used, so we can set it to fixed zero, reducing uninit'd FFs
-					sampled_ad = sample_data(module, ff.sig_ad, RTLIL::Const(State::S0, ff.width), ff.is_fine);
-				}
-				if (ff.has_sr) {
-					sampled_set = sample_control(module, ff.sig_set, ff.pol_set, ff.is_fine);
-					sampled_clr = sample_control(module, ff.sig_clr, ff.pol_clr, ff.is_fine);
-				}
-				if (ff.has_arst)
-					sampled_arst = sample_control(module, ff.sig_arst, ff.pol_arst, ff.is_fine);
-
-				// First perform updates using _only_ sampled values, then again using _only_ current values. Unlike the previous
-				// implementation, this approach correctly handles all the cases of multiple signals changing simultaneously.
-				for (int current = 0; current < 2; current++) {
-					if (has_nonconst_aload)
-						next_q = mux(module, next_q, sampled_ad[current], sampled_aload[current], ff.is_fine);
-					if (ff.has_sr)
-						next_q = bitwise_sr(module, next_q, sampled_set[current], sampled_clr[current], ff.is_fine);
-					if (ff.has_arst)
-						next_q = mux(module, next_q, ff.val_arst, sampled_arst[current], ff.is_fine);
-				}
+			SigBit initstate;
+			for (auto cell : trg_cells)
+				handle_trg_cell(module, cell, initstate);
 
-				module->connect(ff.sig_q, next_q);
+			for (auto &ff : ffs)
+				handle_ff(module, ff);
 
-			}
-		}
+			module->commit_batch();
+		});
 
 		if (have_check_cells && !flag_nolower) {
 			log_push();
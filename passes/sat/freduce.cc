@@ -785,6 +785,10 @@ struct FreducePass : public Pass {
 		log("        dump the design to <prefix>_<module>_<num>.il after each reduction\n");
 		log("        operation. this is mostly used for debugging the freduce command.\n");
 		log("\n");
+		log("    -solver <name>\n");
+		log("        use the named SAT solver instead of the default (minisat). the\n");
+		log("        cadical solver is available when yosys is built with ENABLE_CADICAL=1.\n");
+		log("\n");
 		log("This pass is undef-aware, i.e. it considers don't-care values for detecting\n");
 		log("equivalent nodes.\n");
 		log("\n");
@@ -799,6 +803,7 @@ struct FreducePass : public Pass {
 		verbose_level = 0;
 		inv_mode = false;
 		dump_prefix = std::string();
+		std::string solver_name;
 
 		log_header(design, "Executing FREDUCE pass (perform functional reduction).\n");
 
@@ -820,6 +825,10 @@ struct FreducePass : public Pass {
 				reduce_stop_at = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-solver" && argidx+1 < args.size()) {
+				solver_name = args[++argidx];
+				continue;
+			}
 			if (args[argidx] == "-dump" && argidx+1 < args.size()) {
 				dump_prefix = args[++argidx];
 				continue;
@@ -828,6 +837,8 @@ struct FreducePass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		SatSolverSelect solver_select(solver_name);
+
 		int bitcount = 0;
 		for (auto module : design->selected_modules()) {
 			bitcount += FreduceWorker(design, module).run();
@@ -19,6 +19,11 @@
 
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
+#include "kernel/consteval.h"
+#include "kernel/celltypes.h"
+#include "kernel/satgen.h"
+#include "kernel/threading.h"
+#include <chrono>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -424,12 +429,8 @@ void database_reduce(std::vector<mutate_t> &database, const mutate_opts_t &opts,
 	log("Covered %d/%d wire bits (%.2f%%).\n", covered_wirebit_cnt, GetSize(coverdb.wirebit_db), 100.0 * covered_wirebit_cnt / GetSize(coverdb.wirebit_db));
 }
 
-void mutate_list(Design *design, const mutate_opts_t &opts, const string &filename, const string &srcsfile, int N)
+void database_create(Design *design, const mutate_opts_t &opts, int N, xs128_t &rng, std::vector<mutate_t> &database, pool<string> *sources)
 {
-	pool<string> sources;
-	std::vector<mutate_t> database;
-	xs128_t rng(opts.seed);
-
 	for (auto module : design->selected_modules())
 	{
 		if (!opts.module.empty() && module->name != opts.module)
@@ -500,8 +501,8 @@ void mutate_list(Design *design, const mutate_opts_t &opts, const string &filena
 						entry.wirebit = bit.offset;
 					}
 
-					if (!srcsfile.empty())
-						sources.insert(entry.src.begin(), entry.src.end());
+					if (sources != nullptr)
+						sources->insert(entry.src.begin(), entry.src.end());
 
 					entry.mode = "inv";
 					database_add(database, opts, entry);
@@ -533,6 +534,37 @@ void mutate_list(Design *design, const mutate_opts_t &opts, const string &filena
 		database_reduce(database, opts, opts.none ? N-1 : N, rng);
 		log("Reduced database size: %d\n", GetSize(database));
 	}
+}
+
+string mutate_args(const mutate_t &entry)
+{
+	string str = stringf(" -mode %s", entry.mode.c_str());
+	if (!entry.module.empty())
+		str += stringf(" -module %s", log_id(entry.module));
+	if (!entry.cell.empty())
+		str += stringf(" -cell %s", log_id(entry.cell));
+	if (!entry.port.empty())
+		str += stringf(" -port %s", log_id(entry.port));
+	if (entry.portbit >= 0)
+		str += stringf(" -portbit %d", entry.portbit);
+	if (entry.ctrlbit >= 0)
+		str += stringf(" -ctrlbit %d", entry.ctrlbit);
+	if (!entry.wire.empty())
+		str += stringf(" -wire %s", log_id(entry.wire));
+	if (entry.wirebit >= 0)
+		str += stringf(" -wirebit %d", entry.wirebit);
+	for (auto &s : entry.src)
+		str += stringf(" -src %s", s.c_str());
+	return str;
+}
+
+void mutate_list(Design *design, const mutate_opts_t &opts, const string &filename, const string &srcsfile, int N)
+{
+	pool<string> sources;
+	std::vector<mutate_t> database;
+	xs128_t rng(opts.seed);
+
+	database_create(design, opts, N, rng, database, srcsfile.empty() ? nullptr : &sources);
 
 	if (!srcsfile.empty()) {
 		std::ofstream sout;
@@ -569,23 +601,7 @@ void mutate_list(Design *design, const mutate_opts_t &opts, const string &filena
 		string str = "mutate";
 		if (!opts.ctrl_name.empty())
 			str += stringf(" -ctrl %s %d %d", log_id(opts.ctrl_name), opts.ctrl_width, ctrl_value++);
-		str += stringf(" -mode %s", entry.mode.c_str());
-		if (!entry.module.empty())
-			str += stringf(" -module %s", log_id(entry.module));
-		if (!entry.cell.empty())
-			str += stringf(" -cell %s", log_id(entry.cell));
-		if (!entry.port.empty())
-			str += stringf(" -port %s", log_id(entry.port));
-		if (entry.portbit >= 0)
-			str += stringf(" -portbit %d", entry.portbit);
-		if (entry.ctrlbit >= 0)
-			str += stringf(" -ctrlbit %d", entry.ctrlbit);
-		if (!entry.wire.empty())
-			str += stringf(" -wire %s", log_id(entry.wire));
-		if (entry.wirebit >= 0)
-			str += stringf(" -wirebit %d", entry.wirebit);
-		for (auto &s : entry.src)
-			str += stringf(" -src %s", s.c_str());
+		str += mutate_args(entry);
 		if (filename.empty())
 			log("%s\n", str.c_str());
 		else
@@ -641,15 +657,14 @@ SigSpec mutate_ctrl_mux(Module *module, const mutate_opts_t &opts, SigSpec uncha
 	return module->Mux(NEW_ID, unchanged_sig, changed_sig, ctrl_bit);
 }
 
-void mutate_inv(Design *design, const mutate_opts_t &opts)
+void mutate_inv(Module *module, const mutate_opts_t &opts, bool is_input)
 {
-	Module *module = design->module(opts.module);
 	Cell *cell = module->cell(opts.cell);
 
 	SigBit bit = cell->getPort(opts.port)[opts.portbit];
 	SigBit inbit, outbit;
 
-	if (cell->input(opts.port))
+	if (is_input)
 	{
 		log("Add input inverter at %s.%s.%s[%d].\n", log_id(module), log_id(cell), log_id(opts.port), opts.portbit);
 		SigBit outbit = module->Not(NEW_ID, bit);
@@ -669,15 +684,14 @@ void mutate_inv(Design *design, const mutate_opts_t &opts)
 	cell->setPort(opts.port, s);
 }
 
-void mutate_const(Design *design, const mutate_opts_t &opts, bool one)
+void mutate_const(Module *module, const mutate_opts_t &opts, bool is_input, bool one)
 {
-	Module *module = design->module(opts.module);
 	Cell *cell = module->cell(opts.cell);
 
 	SigBit bit = cell->getPort(opts.port)[opts.portbit];
 	SigBit inbit, outbit;
 
-	if (cell->input(opts.port))
+	if (is_input)
 	{
 		log("Add input constant %d at %s.%s.%s[%d].\n", one ? 1 : 0, log_id(module), log_id(cell), log_id(opts.port), opts.portbit);
 		SigBit outbit = one ? State::S1 : State::S0;
@@ -697,16 +711,15 @@ void mutate_const(Design *design, const mutate_opts_t &opts, bool one)
 	cell->setPort(opts.port, s);
 }
 
-void mutate_cnot(Design *design, const mutate_opts_t &opts, bool one)
+void mutate_cnot(Module *module, const mutate_opts_t &opts, bool is_input, bool one)
 {
-	Module *module = design->module(opts.module);
 	Cell *cell = module->cell(opts.cell);
 
 	SigBit bit = cell->getPort(opts.port)[opts.portbit];
 	SigBit ctrl = cell->getPort(opts.port)[opts.ctrlbit];
 	SigBit inbit, outbit;
 
-	if (cell->input(opts.port))
+	if (is_input)
 	{
 		log("Add input cnot%d at %s.%s.%s[%d,%d].\n", one ? 1 : 0, log_id(module), log_id(cell), log_id(opts.port), opts.portbit, opts.ctrlbit);
 		SigBit outbit = one ? module->Xor(NEW_ID, bit, ctrl) : module->Xnor(NEW_ID, bit, ctrl);
@@ -726,6 +739,231 @@ void mutate_cnot(Design *design, const mutate_opts_t &opts, bool one)
 	cell->setPort(opts.port, s);
 }
 
+// The direction of the port is passed in, because it can't be looked up for
+// submodule instances in a module that is not part of the design.
+void mutate_apply(Module *module, const mutate_t &entry, bool is_input)
+{
+	mutate_opts_t opts;
+	opts.mode = entry.mode;
+	opts.module = entry.module;
+	opts.cell = entry.cell;
+	opts.port = entry.port;
+	opts.portbit = entry.portbit;
+	opts.ctrlbit = entry.ctrlbit;
+
+	if (opts.mode == "inv")
+		mutate_inv(module, opts, is_input);
+	else if (opts.mode == "const0" || opts.mode == "const1")
+		mutate_const(module, opts, is_input, opts.mode == "const1");
+	else
+		mutate_cnot(module, opts, is_input, opts.mode == "cnot1");
+}
+
+// A bit of a module that exists in all its mutants: a bit of a wire, or a bit
+// of a cell port when cell is set.
+struct campaign_point_t
+{
+	IdString cell, name;
+	int bit;
+
+	SigBit get(Module *module) const
+	{
+		if (cell.empty())
+			return SigBit(module->wire(name), bit);
+		return module->cell(cell)->getPort(name)[bit];
+	}
+};
+
+// Compares the mutants of a module with the module. The outputs of the module
+// and the inputs of the cells that are not combinational (FFs, memories,
+// submodule instances, ...) are compared, with the inputs of the module, the
+// outputs of these cells and undriven bits as free inputs.
+struct campaign_worker_t
+{
+	enum result_t { DETECTED_SIM, DETECTED_SAT, EQUIVALENT, UNDETECTED };
+
+	Module *module;
+	int num_words;
+	CellTypes ct;
+	SigMap sigmap;
+	std::vector<campaign_point_t> inputs, outputs;
+	std::vector<uint64_t> input_words;
+	std::vector<std::vector<uint64_t>> output_words;
+
+	campaign_worker_t(Module *module, int num_words, xs128_t &rng) : module(module), num_words(num_words), sigmap(module)
+	{
+		ct.setup_internals_eval();
+		ct.setup_stdcells();
+
+		pool<SigBit> driven, used;
+		for (auto wire : module->wires())
+			for (int i = 0; i < GetSize(wire); i++) {
+				if (wire->port_input) {
+					inputs.push_back({IdString(), wire->name, i});
+					driven.insert(sigmap(SigBit(wire, i)));
+				}
+				if (wire->port_output) {
+					outputs.push_back({IdString(), wire->name, i});
+					used.insert(sigmap(SigBit(wire, i)));
+				}
+			}
+
+		for (auto cell : module->cells()) {
+			bool comb = ct.cell_known(cell->type);
+			for (auto &conn : cell->connections()) {
+				bool is_output = cell->output(conn.first);
+				for (int i = 0; i < GetSize(conn.second); i++) {
+					(is_output ? driven : used).insert(sigmap(conn.second[i]));
+					if (!comb)
+						(is_output ? inputs : outputs).push_back({cell->name, conn.first, i});
+				}
+			}
+		}
+
+		for (auto bit : used)
+			if (bit.wire != nullptr && !driven.count(bit))
+				inputs.push_back({IdString(), bit.wire->name, bit.offset});
+
+		for (int i = 0; i < GetSize(inputs) * num_words; i++)
+			input_words.push_back(uint64_t(rng()) | uint64_t(rng()) << 30 | uint64_t(rng()) << 60);
+
+		simulate(module, output_words);
+		sigmap.compress();
+	}
+
+	// Output values that depend on a signal that is not set are left empty.
+	void simulate(Module *mod, std::vector<std::vector<uint64_t>> &values)
+	{
+		ConstEvalVec ce(mod, num_words);
+		for (int i = 0; i < GetSize(inputs); i++)
+			ce.set(inputs[i].get(mod), std::vector<uint64_t>(input_words.begin() + i * num_words,
+					input_words.begin() + (i+1) * num_words));
+		values.resize(GetSize(outputs));
+		for (int i = 0; i < GetSize(outputs); i++)
+			if (!ce.eval(outputs[i].get(mod), values[i]))
+				values[i].clear();
+	}
+
+	// Returns the SAT variables of the points, or false if a cell can't be imported.
+	bool import(SatGen &satgen, Module *mod, std::vector<int> &input_vars, std::vector<int> &output_vars)
+	{
+		for (auto cell : mod->cells())
+			if (ct.cell_known(cell->type) && !satgen.importCell(cell))
+				return false;
+		for (auto &point : inputs)
+			input_vars.push_back(satgen.importSigBit(point.get(mod)));
+		for (auto &point : outputs)
+			output_vars.push_back(satgen.importSigBit(point.get(mod)));
+		return true;
+	}
+
+	result_t check(const mutate_t &entry, bool use_sat)
+	{
+		std::unique_ptr<Module> mutant(module->clone());
+		mutate_apply(mutant.get(), entry, module->cell(entry.cell)->input(entry.port));
+
+		std::vector<std::vector<uint64_t>> values;
+		simulate(mutant.get(), values);
+		for (int i = 0; i < GetSize(outputs); i++)
+			if (!output_words[i].empty() && !values[i].empty() && values[i] != output_words[i])
+				return DETECTED_SIM;
+
+		if (!use_sat)
+			return UNDETECTED;
+
+		SigMap mutant_sigmap(mutant.get());
+		ezSatPtr ez;
+		SatGen satgen(ez.get(), &sigmap, "orig");
+		std::vector<int> orig_inputs, orig_outputs, mutant_inputs, mutant_outputs;
+		if (!import(satgen, module, orig_inputs, orig_outputs))
+			return UNDETECTED;
+		satgen.setContext(&mutant_sigmap, "mutant");
+		if (!import(satgen, mutant.get(), mutant_inputs, mutant_outputs))
+			return UNDETECTED;
+
+		std::vector<int> diff;
+		for (int i = 0; i < GetSize(inputs); i++)
+			ez->assume(ez->IFF(orig_inputs[i], mutant_inputs[i]));
+		for (int i = 0; i < GetSize(outputs); i++)
+			diff.push_back(ez->XOR(orig_outputs[i], mutant_outputs[i]));
+		return ez->solve(ez->expression(ezSAT::OpOr, diff)) ? DETECTED_SAT : EQUIVALENT;
+	}
+};
+
+void mutate_campaign(Design *design, const mutate_opts_t &opts, const string &filename, int N, int num_patterns, bool use_sat)
+{
+	std::vector<mutate_t> database;
+	xs128_t rng(opts.seed);
+
+	database_create(design, opts, N, rng, database, nullptr);
+
+	std::ofstream fout;
+	if (!filename.empty()) {
+		fout.open(filename, std::ios::out | std::ios::trunc);
+		if (!fout.is_open())
+			log_error("Could not open file \"%s\" with write access.\n", filename.c_str());
+	}
+
+	// the random patterns are created in module order, before any mutation is evaluated
+	int num_words = std::max(1, (num_patterns + 63) / 64);
+	std::vector<std::unique_ptr<campaign_worker_t>> workers;
+	dict<IdString, int> worker_index;
+	for (auto &entry : database)
+		if (!worker_index.count(entry.module)) {
+			worker_index[entry.module] = GetSize(workers);
+			workers.emplace_back(new campaign_worker_t(design->module(entry.module), num_words, rng));
+		}
+
+	auto start = std::chrono::steady_clock::now();
+	int num_jobs = GetSize(database);
+	std::vector<campaign_worker_t::result_t> results(num_jobs);
+	int base_autoidx = autoidx;
+
+	// the log output of the mutations is dropped unless they fail
+	auto job = [&](int i) {
+		LogCapture capture;
+		capture.begin();
+		autoidx = base_autoidx;
+		try {
+			results[i] = workers[worker_index.at(database[i].module)]->check(database[i], use_sat);
+		} catch (...) {
+			capture.end();
+			capture.replay();
+			throw;
+		}
+		capture.end();
+	};
+
+	int num_threads = yosys_thread_count(num_jobs);
+	try {
+		ThreadPool::run_captured(num_jobs, job, num_threads);
+	} catch (...) {
+		autoidx = base_autoidx;
+		throw;
+	}
+	autoidx = base_autoidx;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	static const char *result_names[] = { "sim", "sat", "equiv", "undetected" };
+	int counts[4] = { };
+	for (int i = 0; i < num_jobs; i++) {
+		counts[results[i]]++;
+		string str = "mutate" + mutate_args(database[i]) + " # " + result_names[results[i]];
+		if (filename.empty())
+			log("%s\n", str.c_str());
+		else
+			fout << str << std::endl;
+	}
+
+	log("Detected %d of %d mutations (%d by simulation of %d patterns, %d by SAT).\n", counts[0] + counts[1],
+			num_jobs, counts[0], 64 * num_words, counts[1]);
+	if (use_sat)
+		log("Proved %d mutations equivalent, %d could not be checked.\n", counts[2], counts[3]);
+	log("Evaluated %d mutations in %.2f seconds with %d threads (%.1f mutations per second).\n", num_jobs,
+			seconds, num_threads, seconds > 0 ? num_jobs / seconds : 0.0);
+}
+
 struct MutatePass : public Pass {
 	MutatePass() : Pass("mutate", "generate or apply design mutations") { }
 	void help() override
@@ -771,6 +1009,29 @@ struct MutatePass : public Pass {
 		log("          weight_cover pick_cover_prcnt\n");
 		log("\n");
 		log("\n");
+		log("    mutate -campaign N [options] [selection]\n");
+		log("\n");
+		log("Create a list of N mutations as with -list and evaluate them in-process. Each\n");
+		log("mutation is applied to a copy of its module, which is compared with the\n");
+		log("original module: the outputs of the module and the inputs of cells that are\n");
+		log("not combinational (FFs, memories, submodule instances, ...) are compared, with\n");
+		log("the inputs of the module and the outputs of these cells as free inputs. The\n");
+		log("list is written with the result appended to each line as a comment: 'sim' or\n");
+		log("'sat' for mutations detected by simulation or SAT, 'equiv' for mutations\n");
+		log("proven equivalent and 'undetected' for the rest.\n");
+		log("\n");
+		log("The mutations are evaluated in parallel with the number of threads set with\n");
+		log("'yosys -j'. The results do not depend on the number of threads. The options\n");
+		log("of -list apply, except for -s, -none and -ctrl.\n");
+		log("\n");
+		log("    -sim N\n");
+		log("        Number of random patterns to simulate, rounded up to a multiple of\n");
+		log("        64 (default: 256)\n");
+		log("\n");
+		log("    -sat\n");
+		log("        Use SAT to check the mutations that the simulation did not detect.\n");
+		log("\n");
+		log("\n");
 		log("    mutate -mode MODE [options]\n");
 		log("\n");
 		log("Apply the given mutation.\n");
@@ -798,6 +1059,9 @@ struct MutatePass : public Pass {
 		string filename;
 		string srcsfile;
 		int N = -1;
+		int campaign_N = -1;
+		int num_patterns = 256;
+		bool use_sat = false;
 
 		log_header(design, "Executing MUTATE pass.\n");
 
@@ -808,6 +1072,18 @@ struct MutatePass : public Pass {
 				N = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-campaign" && argidx+1 < args.size()) {
+				campaign_N = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-sim" && argidx+1 < args.size()) {
+				num_patterns = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-sat") {
+				use_sat = true;
+				continue;
+			}
 			if (args[argidx] == "-o" && argidx+1 < args.size()) {
 				filename = args[++argidx];
 				continue;
@@ -927,6 +1203,13 @@ struct MutatePass : public Pass {
 			return;
 		}
 
+		if (campaign_N >= 0) {
+			if (!opts.ctrl_name.empty() || opts.none || !srcsfile.empty())
+				log_cmd_error("Options -ctrl, -none and -s are not supported with -campaign.\n");
+			mutate_campaign(design, opts, filename, campaign_N, num_patterns, use_sat);
+			return;
+		}
+
 		if (opts.mode == "none") {
 			if (!opts.ctrl_name.empty()) {
 				Module *topmod = opts.module.empty() ? design->top_module() : design->module(opts.module);
@@ -963,12 +1246,12 @@ struct MutatePass : public Pass {
 			log_cmd_error("Out-of-range -portbit argument for port %s on cell %s.%s.\n", log_id(opts.port), log_id(opts.module), log_id(opts.cell));
 
 		if (opts.mode == "inv") {
-			mutate_inv(design, opts);
+			mutate_inv(module, opts, cell->input(opts.port));
 			return;
 		}
 
 		if (opts.mode == "const0" || opts.mode == "const1") {
-			mutate_const(design, opts, opts.mode == "const1");
+			mutate_const(module, opts, cell->input(opts.port), opts.mode == "const1");
 			return;
 		}
 
@@ -979,7 +1262,7 @@ struct MutatePass : public Pass {
 			log_cmd_error("Out-of-range -ctrlbit argument for port %s on cell %s.%s.\n", log_id(opts.port), log_id(opts.module), log_id(opts.cell));
 
 		if (opts.mode == "cnot0" || opts.mode == "cnot1") {
-			mutate_cnot(design, opts, opts.mode == "cnot1");
+			mutate_cnot(module, opts, cell->input(opts.port), opts.mode == "cnot1");
 			return;
 		}
 
@@ -211,14 +211,15 @@ void assume_miter_outputs(RTLIL::Module *module, bool assume_neg) {
 	module->addAssume("$assume_qbfsat_miter_outputs", wires_to_assume[0], RTLIL::S1);
 }
 
-QbfSolutionType call_qbf_solver(RTLIL::Module *mod, const QbfSolveOptions &opt, const std::string &tempdir_name, const bool quiet = false, const int iter_num = 0) {
-	//Execute and capture stdout from `yosys-smtbmc -s z3 -t 1 -g --binary [--dump-smt2 <file>]`
+QbfSolutionType call_qbf_solver(RTLIL::Module *mod, const QbfSolveOptions &opt, const std::string &tempdir_name, const bool quiet = false, const int iter_num = 0, const bool bisect = false) {
+	//Execute and capture stdout from `yosys-smtbmc -s z3 -t 1 -g --binary [--bisect] [--dump-smt2 <file>]`
 	QbfSolutionType ret;
 	const std::string yosys_smtbmc_exe = proc_self_dirname() + "yosys-smtbmc";
 	const std::string smtbmc_warning = "z3: WARNING:";
-	const std::string smtbmc_cmd = stringf("\"%s\" -s %s %s -t 1 -g --binary %s %s/problem%d.smt2 2>&1",
+	const std::string smtbmc_cmd = stringf("\"%s\" -s %s %s -t 1 -g --binary %s%s %s/problem%d.smt2 2>&1",
 			yosys_smtbmc_exe.c_str(), opt.get_solver_name().c_str(),
 			(opt.timeout != 0? stringf("--timeout %d", opt.timeout) : "").c_str(),
+			(bisect? "--bisect " : ""),
 			(opt.dump_final_smt2? "--dump-smt2 " + opt.dump_final_smt2_file : "").c_str(),
 			tempdir_name.c_str(), iter_num);
 
@@ -293,6 +294,14 @@ QbfSolutionType qbf_solve(RTLIL::Module *mod, const QbfSolveOptions &opt) {
 
 	if (opt.nobisection || opt.nooptimize || wire_to_optimize_name == "") {
 		ret = call_qbf_solver(module, opt, tempdir_name, false, 0);
+	} else if (opt.incremental) {
+		//Let yosys-smtbmc do the iterated bisection in a single solver session:
+		log("%s wire \"%s\".\n", (maximize? "Maximizing" : "Minimizing"), wire_to_optimize_name.c_str());
+		ret = call_qbf_solver(module, opt, tempdir_name, false, 0, true);
+		if (!ret.unknown && ret.sat && ret.optimum >= 0)
+			log("Wire %s is %s at %d.\n", wire_to_optimize_name.c_str(), (maximize? "maximized" : "minimized"), ret.optimum);
+		else
+			log("Problem is NOT satisfiable.\n");
 	} else {
 		//Do the iterated bisection method:
 		unsigned int iter_num = 1;
@@ -406,6 +415,10 @@ QbfSolveOptions parse_args(const std::vector<std::string> &args) {
 			opt.nobisection = true;
 			continue;
 		}
+		else if (args[opt.argidx] == "-incremental") {
+			opt.incremental = true;
+			continue;
+		}
 		else if (args[opt.argidx] == "-solver") {
 			if (args.size() <= opt.argidx + 1)
 				log_cmd_error("solver not specified.\n");
@@ -543,6 +556,15 @@ struct QbfSatPass : public Pass {
 		log("        \"(minimize)\" or \"(maximize)\" command in the SMT-LIBv2 output and\n");
 		log("        hope that the solver supports optimizing quantified bitvector problems.\n");
 		log("\n");
+		log("    -incremental\n");
+		log("        When optimizing a wire with the iterated solving and threshold bisection\n");
+		log("        approach, write the problem only once and run all iterations in a single\n");
+		log("        yosys-smtbmc session. Between iterations only the threshold constraint\n");
+		log("        is pushed and popped, the solver keeps the rest of the problem. Note\n");
+		log("        that yices solves exists-forall problems non-incrementally, so it is\n");
+		log("        restarted for each iteration, and that -timeout then applies to each\n");
+		log("        check with yices and to the whole session with the other solvers.\n");
+		log("\n");
 		log("    -solver <solver>\n");
 		log("        Use a particular solver. Choose one of: \"z3\", \"yices\", \"cvc4\"\n");
 		log("        and \"cvc5\". (default: yices)\n");
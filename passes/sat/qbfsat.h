@@ -28,7 +28,7 @@ YOSYS_NAMESPACE_BEGIN
 struct QbfSolveOptions {
 	bool specialize = false, specialize_from_file = false, write_solution = false, nocleanup = false;
 	bool dump_final_smt2 = false, assume_outputs = false, assume_neg = false, nooptimize = false;
-	bool nobisection = false, sat = false, unsat = false, show_smtbmc = false;
+	bool nobisection = false, sat = false, unsat = false, show_smtbmc = false, incremental = false;
 	enum Solver{Z3, Yices, CVC4, CVC5} solver = Yices;
 	enum OptimizationLevel{O0, O1, O2} oflag = O0;
 	dict<std::string, std::string> solver_options;
@@ -57,6 +57,7 @@ struct QbfSolutionType {
 	std::vector<std::string> stdout_lines = {};
 	dict<pool<std::string>, std::string> hole_to_value = {};
 	double solver_time = 0;
+	int optimum = -1; //value found by yosys-smtbmc --bisect
 	bool sat = false;
 	bool unknown = true; //true if neither 'sat' nor 'unsat'
 
@@ -163,6 +164,7 @@ struct QbfSolutionType {
 		std::regex unknown_regex2 = YS_REGEX_COMPILE("Unexpected EOF response from solver");
 		std::regex memout_regex = YS_REGEX_COMPILE("Solver Error:.*error \"out of memory\"");
 		std::regex hole_value_regex = YS_REGEX_COMPILE_WITH_SUBS("Value for anyconst in [a-zA-Z0-9_]* \\(([^:]*:[^\\)]*)\\): (.*)");
+		std::regex optimum_regex = YS_REGEX_COMPILE_WITH_SUBS("Bisection finished with optimum ([0-9]+)\\.");
 #ifndef NDEBUG
 		std::regex hole_loc_regex = YS_REGEX_COMPILE("[^:]*:[0-9]+.[0-9]+-[0-9]+.[0-9]+");
 		std::regex hole_val_regex = YS_REGEX_COMPILE("[0-9]+");
@@ -183,6 +185,9 @@ struct QbfSolutionType {
 				pool<std::string> loc_pool(locs.begin(), locs.end());
 				hole_to_value[loc_pool] = val;
 			}
+			else if (std::regex_search(x, m, optimum_regex)) {
+				optimum = atoi(m[1].str().c_str());
+			}
 			else if (std::regex_search(x, sat_regex)) {
 				sat_regex_found = true;
 				sat = true;
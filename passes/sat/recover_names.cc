@@ -23,6 +23,7 @@
 #include "kernel/celltypes.h"
 #include "kernel/utils.h"
 #include "kernel/satgen.h"
+#include "kernel/threading.h"
 
 #include <algorithm>
 #include <queue>
@@ -38,6 +39,23 @@ PRIVATE_NAMESPACE_BEGIN
 #define INIT_Z 521288629
 #define INIT_W  88675123
 
+struct Xorshift128 {
+    uint32_t x = INIT_X, y = INIT_Y, z = INIT_Z, w = INIT_W;
+
+    uint32_t next()
+    {
+        uint32_t t = x ^ (x << 11);
+        x = y; y = z; z = w;
+        w ^= (w >> 19) ^ t ^ (t >> 8);
+        return w;
+    }
+
+    uint64_t next_word()
+    {
+        uint64_t hi = next();
+        return (hi << 32) | next();
+    }
+};
 
 // Similar to a SigBit; but module-independent
 struct IdBit {
@@ -79,7 +97,7 @@ struct RecoverModuleWorker {
     Module *mod, *flat = nullptr;
     RecoverModuleWorker(Module *mod) : design(mod->design), mod(mod) {};
 
-    ConstEval *ce = nullptr;
+    ConstEvalVec *ce = nullptr;
     SigMap *sigmap = nullptr;
 
     dict<IdBit, SigBit> flat2orig;
@@ -93,7 +111,7 @@ struct RecoverModuleWorker {
         flat = design->addModule(NEW_ID);
         mod->cloneInto(flat);
         Pass::call_on_module(design, flat, "flatten -wb");
-        ce = new ConstEval(flat);
+        ce = new ConstEvalVec(flat);
         sigmap = new SigMap(flat);
         // Create a mapping from primary name-bit in the box-flattened module to original sigbit
         SigMap orig_sigmap(mod);
@@ -150,30 +168,23 @@ struct RecoverModuleWorker {
 
     // Mapping from bit to (candidate) equivalence classes
     dict<IdBit, equiv_cls_t> bit2cls;
-    void sim_cycle(int t, const dict<IdBit, RTLIL::State> &anchors)
+
+    // Simulates all sim_length patterns at once, bit t of an anchor value is
+    // its value in pattern t
+    void simulate(const dict<IdBit, equiv_cls_t> &anchors)
     {
         ce->clear();
-        for (auto anchor : anchors) {
-            SigBit bit = (*sigmap)(SigBit(flat->wire(anchor.first.name), anchor.first.bit));
-            // Ignore in the rare case that it's already determined
-            SigSpec res(bit);
-            if (ce->eval(res))
-                continue;
-            ce->set(bit, anchor.second);
-        }
+        for (auto &anchor : anchors)
+            ce->set(id2bit(anchor.first), std::vector<uint64_t>{anchor.second});
         // Only evaluate IdBits that exist in the non-flat design; as they are all we care about
-        for (auto idbit : flat2orig) {
+        std::vector<uint64_t> res;
+        for (auto &idbit : flat2orig) {
             if (anchors.count(idbit.first))
                 continue;
-            SigBit bit = (*sigmap)(SigBit(flat->wire(idbit.first.name), idbit.first.bit));
-            SigSpec res(bit);
-            if (!ce->eval(res))
-                continue;
-            if (res != State::S0 && res != State::S1)
+            if (!ce->eval(id2bit(idbit.first), res))
                 continue;
-            // Update equivalence classes
-            if (res == State::S1)
-                bit2cls[idbit.first] = bit2cls[idbit.first] | (equiv_cls_t(1) << t);
+            if (res[0] != 0)
+                bit2cls[idbit.first] = res[0];
         }
     }
 
@@ -440,9 +451,10 @@ struct RecoverModuleWorker {
 };
 
 struct RecoverNamesWorker {
+    Pass *pass;
     Design *design, *gold_design = nullptr;
     CellTypes ct_all;
-    RecoverNamesWorker(Design *design) : design(design) {}
+    RecoverNamesWorker(Pass *pass, Design *design) : pass(pass), design(design) {}
 
     pool<IdString> comb_whiteboxes, buffer_types;
 
@@ -500,32 +512,6 @@ struct RecoverNamesWorker {
         log_debug("Found %d combinational cells and %d buffer whiteboxes.\n", GetSize(comb_whiteboxes), GetSize(buffer_types));
     }
 
-    uint32_t x, y, z, w, rng_val;
-    int rng_bit;
-    void rng_init()
-    {
-        x = INIT_X;
-        y = INIT_Y;
-        z = INIT_Z;
-        w = INIT_W;
-        rng_bit = 32;
-    }
-    uint32_t xorshift128()
-    {
-        uint32_t t = x ^ (x << 11);
-        x = y; y = z; z = w;
-        w ^= (w >> 19) ^ t ^ (t >> 8);
-        return w;
-    }
-    RTLIL::State next_randbit()
-    {
-        if (rng_bit >= 32) {
-            rng_bit = 0;
-            rng_val = xorshift128();
-        }
-        return ((rng_val >> (rng_bit++)) & 0x1) ? RTLIL::State::S1 : RTLIL::State::S0;
-    }
-
     int popcount(equiv_cls_t cls) {
     	int result = 0;
     	for (unsigned i = 0; i < 8*sizeof(equiv_cls_t); i++)
@@ -557,17 +543,36 @@ struct RecoverNamesWorker {
         return !ez->solve(ez->NOT(ez->IFF(gold_var, invert ? ez->NOT(gate_var) : gate_var)));
     }
 
-    void analyse_mod(Module *gate_mod)
+    // Tries to match the gate bits of an equivalence class with its gold bits
+    void solve_class(RecoverModuleWorker &gold_worker, RecoverModuleWorker &gate_worker,
+            const dict<IdBit, IdBit> &gold_anchors, const dict<IdBit, IdBit> &gate_anchors,
+            equiv_cls_t cls, const pool<IdBit> &gold_bits, const pool<InvBit> &gate_bits,
+            std::vector<std::pair<IdBit, InvBit>> &matches)
     {
-        Module *gold_mod = gold_design->module(gate_mod->name);
-        if (!gold_mod)
-            return;
-
-        RecoverModuleWorker gold_worker(gold_mod);
-        RecoverModuleWorker gate_worker(gate_mod);
+        log_debug("equivalence class: %016" PRIx64 "\n", cls);
+        pool<IdBit> solved_gate;
+        for (IdBit gold_bit : gold_bits) {
+            for (auto gate_bit : gate_bits) {
+                if (solved_gate.count(gate_bit.bit))
+                    continue;
+                log_debug("   attempting to prove %s[%d] == %s%s[%d]\n", log_id(gold_bit.name), gold_bit.bit,
+                    gate_bit.inverted ? "" : "!", log_id(gate_bit.bit.name), gate_bit.bit.bit);
+                if (!prove_equiv(gold_worker, gate_worker, gold_anchors, gate_anchors, gold_bit, gate_bit.bit, gate_bit.inverted))
+                    continue;
+                log_debug("       success!\n");
+                // Success!
+                matches.emplace_back(gate_bit.bit, InvBit(gold_bit, gate_bit.inverted));
+                solved_gate.insert(gate_bit.bit);
+            }
+            // All solved...
+            if (GetSize(solved_gate) == GetSize(gate_bits))
+                break;
+        }
+    }
 
-        gold_worker.prepare();
-        gate_worker.prepare();
+    void analyse_mod(RecoverModuleWorker &gold_worker, RecoverModuleWorker &gate_worker)
+    {
+        Module *gold_mod = gold_worker.mod, *gate_mod = gate_worker.mod;
 
         // Find anchors (same-name wire-bits driven in both gold and gate)
         dict<IdBit, IdBit> gold_anchors, gate_anchors;
@@ -582,16 +587,14 @@ struct RecoverNamesWorker {
             }
         }
         // Run a random-value combinational simulation to find candidate equivalence classes
-        dict<IdBit, RTLIL::State> gold_anchor_vals, gate_anchor_vals;
-        rng_init();
-        for (int t = 0; t < sim_length; t++) {
-            for (auto anchor : gold_anchors) {
-                gold_anchor_vals[anchor.first] = next_randbit();
-                gate_anchor_vals[anchor.second] = gold_anchor_vals[anchor.first];
-            }
-            gold_worker.sim_cycle(t, gold_anchor_vals);
-            gate_worker.sim_cycle(t, gate_anchor_vals);
+        dict<IdBit, equiv_cls_t> gold_anchor_vals, gate_anchor_vals;
+        Xorshift128 rng;
+        for (auto anchor : gold_anchors) {
+            gold_anchor_vals[anchor.first] = rng.next_word();
+            gate_anchor_vals[anchor.second] = gold_anchor_vals[anchor.first];
         }
+        gold_worker.simulate(gold_anchor_vals);
+        gate_worker.simulate(gate_anchor_vals);
         log_debug("%d candidate equiv classes in gold; %d in gate\n", GetSize(gold_worker.bit2cls), GetSize(gate_worker.bit2cls));
         // Group bits by equivalence classes together
         dict<equiv_cls_t, std::pair<pool<IdBit>, pool<InvBit>>> cls2bits;
@@ -601,10 +604,18 @@ struct RecoverNamesWorker {
         // Sort equivalence classes by shallowest first (so we have as many anchors as possible when reaching deeper bits)
         std::vector<std::pair<equiv_cls_t, int>> cls_depth;
         for (auto &cls : cls2bits) {
-            if (cls.second.second.empty())
+            const pool<IdBit> &gold_bits = cls.second.first;
+            const pool<InvBit> &gate_bits = cls.second.second;
+            if (gold_bits.empty() || gate_bits.empty())
+                continue;
+            if (GetSize(gold_bits) > 10)
+                continue; // large equivalence classes are not very interesting; skip
+            int pop = popcount(cls.first);
+            // Equivalence classes with only one set bit are invariably a waste of SAT time
+            if (pop == 1 || pop == (8*sizeof(equiv_cls_t) - 1))
                 continue;
             int depth = 0;
-            for (auto gate_bit : cls.second.second) {
+            for (auto gate_bit : gate_bits) {
                 if (!gate_worker.bit2depth.count(gate_bit.bit))
                     continue;
                 depth = std::max(depth, gate_worker.bit2depth.at(gate_bit.bit));
@@ -617,43 +628,35 @@ struct RecoverNamesWorker {
             });
         // The magic result we've worked hard for....
         dict<IdBit, InvBit> gate2gold;
-        // Solve starting from shallowest
-        for (auto cls : cls_depth) {
-        	int pop = popcount(cls.first);
-        	// Equivalence classes with only one set bit are invariably a waste of SAT time
-        	if (pop == 1 || pop == (8*sizeof(equiv_cls_t) - 1))
-        		continue;
-
-        	log_debug("equivalence class: %016" PRIx64 "\n", cls.first);
-            const pool<IdBit> &gold_bits = cls2bits.at(cls.first).first;
-            const pool<InvBit> &gate_bits = cls2bits.at(cls.first).second;
-            if (gold_bits.empty() || gate_bits.empty())
-                continue;
-            pool<IdBit> solved_gate;
-            if (GetSize(gold_bits) > 10)
-                continue; // large equivalence classes are not very interesting; skip
-            for (IdBit gold_bit : gold_bits) {
-                for (auto gate_bit : gate_bits) {
-                    if (solved_gate.count(gate_bit.bit))
-                        continue;
-                    log_debug("   attempting to prove %s[%d] == %s%s[%d]\n", log_id(gold_bit.name), gold_bit.bit,
-                        gate_bit.inverted ? "" : "!", log_id(gate_bit.bit.name), gate_bit.bit.bit);
-                    if (!prove_equiv(gold_worker, gate_worker, gold_anchors, gate_anchors, gold_bit, gate_bit.bit, gate_bit.inverted))
-                        continue;
-                    log_debug("       success!\n");
-                    // Success!
-                    gate2gold[gate_bit.bit] = InvBit(gold_bit, gate_bit.inverted);
-                    if (!gate_bit.inverted) {
+        // Solve starting from shallowest. The classes of one depth are solved
+        // in parallel against the anchors found in the shallower ones, and
+        // their matches are added in class order, so that the result does not
+        // depend on the number of threads.
+        gold_worker.sigmap->compress();
+        gate_worker.sigmap->compress();
+        for (int begin = 0, end = 0; begin < GetSize(cls_depth); begin = end)
+        {
+            while (end < GetSize(cls_depth) && cls_depth[end].second == cls_depth[begin].second)
+                end++;
+            int num_jobs = end - begin;
+            std::vector<std::vector<std::pair<IdBit, InvBit>>> matches(num_jobs);
+            auto solve_job = [&](int i) {
+                equiv_cls_t cls = cls_depth[begin + i].first;
+                const auto &bits = cls2bits.at(cls);
+                solve_class(gold_worker, gate_worker, gold_anchors, gate_anchors, cls, bits.first, bits.second, matches[i]);
+            };
+
+            ThreadPool::run_captured(num_jobs, solve_job, yosys_thread_count(num_jobs));
+
+            for (auto &job_matches : matches)
+                for (auto &match : job_matches) {
+                    gate2gold[match.first] = match.second;
+                    if (!match.second.inverted) {
                         // Only add as anchor if not inverted
-                        gold_anchors[gold_bit] = gate_bit.bit;
-                        gate_anchors[gate_bit.bit] = gold_bit;
+                        gold_anchors[match.second.bit] = match.first;
+                        gate_anchors[match.first] = match.second.bit;
                     }
-                    solved_gate.insert(gate_bit.bit);
                 }
-                // All solved...
-                if (GetSize(solved_gate) == GetSize(gate_bits))
-                    break;
-            }
         }
         log("Recovered %d net name pairs in module `%s' out.\n", GetSize(gate2gold), log_id(gate_mod));
         gate_worker.do_rename(gold_mod, gate2gold, buffer_types);
@@ -671,13 +674,31 @@ struct RecoverNamesWorker {
 
         analyse_boxes();
 
-        // keeping our own std::vector here avoids modify-while-iterating issues
+        // Flattening the whiteboxes adds modules to the designs, so all
+        // modules are prepared first and then analysed in parallel
         std::vector<Module *> to_analyse;
-        for (auto mod : design->modules())
-            if (!mod->get_blackbox_attribute())
-                to_analyse.push_back(mod);
-        for (auto mod : to_analyse)
-            analyse_mod(mod);
+        std::vector<std::unique_ptr<RecoverModuleWorker>> gold_workers, gate_workers;
+        dict<Module *, int> mod_index;
+        for (auto mod : design->modules()) {
+            if (mod->get_blackbox_attribute())
+                continue;
+            Module *gold_mod = gold_design->module(mod->name);
+            if (!gold_mod)
+                continue;
+            mod_index[mod] = GetSize(to_analyse);
+            to_analyse.push_back(mod);
+            gold_workers.emplace_back(new RecoverModuleWorker(gold_mod));
+            gate_workers.emplace_back(new RecoverModuleWorker(mod));
+        }
+        for (int i = 0; i < GetSize(to_analyse); i++) {
+            gold_workers[i]->prepare();
+            gate_workers[i]->prepare();
+        }
+
+        pass->execute_modules(design, to_analyse, [&](Module *mod) {
+            int i = mod_index.at(mod);
+            analyse_mod(*gold_workers[i], *gate_workers[i]);
+        });
     }
     ~RecoverNamesWorker() {
         delete gold_design;
@@ -695,6 +716,11 @@ struct RecoverNamesPass : public Pass {
         log("This pass executes a lossy mapping command and uses a combination of simulation\n");
         log(" to find candidate equivalences and SAT to recover exact original net names.\n");
         log("\n");
+        log("The candidates are found with a bit-parallel simulation of 64 random patterns.\n");
+        log("The modules, and the candidate classes of equal logic depth within a module,\n");
+        log("are processed in parallel with the number of threads set with 'yosys -j'.\n");
+        log("The results do not depend on the number of threads.\n");
+        log("\n");
     }
     void execute(std::vector<std::string> args, RTLIL::Design *design) override
     {
@@ -715,7 +741,7 @@ struct RecoverNamesPass : public Pass {
         if (command.empty())
             log_cmd_error("No mapping pass specified!\n");
 
-        RecoverNamesWorker worker(design);
+        RecoverNamesWorker worker(this, design);
         worker(command);
 
     }
@@ -27,6 +27,7 @@
 #include "kernel/sigtools.h"
 #include "kernel/log.h"
 #include "kernel/satgen.h"
+#include "kernel/threading.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <algorithm>
@@ -65,6 +66,11 @@ struct SatHelper
 	int max_timestep, timeout;
 	bool gotTimeout;
 
+	// cone of influence, only these cells are imported when use_coi is set
+	bool use_coi, coi_done;
+	pool<RTLIL::Cell*> coi_cells;
+	SigPool coi_skipped_bits;
+
 	SatHelper(RTLIL::Design *design, RTLIL::Module *module, bool enable_undef, bool set_def_formal) :
 		design(design), module(module), sigmap(module), ct(design), satgen(ez.get(), &sigmap)
 	{
@@ -78,6 +84,8 @@ struct SatHelper
 		max_timestep = -1;
 		timeout = 0;
 		gotTimeout = false;
+		use_coi = false;
+		coi_done = false;
 	}
 
 	void check_undef_enabled(const RTLIL::SigSpec &sig)
@@ -91,6 +99,108 @@ struct SatHelper
 				log_cmd_error("Bit %d of %s is undef but option -enable_undef is missing!\n", int(i), log_signal(sig));
 	}
 
+	void compute_coi()
+	{
+		pool<RTLIL::SigBit> queued_bits, handled_bits;
+		std::vector<RTLIL::Cell*> queued_cells;
+
+		auto add_sig = [&](const RTLIL::SigSpec &sig) {
+			for (auto bit : sigmap(sig))
+				if (bit.wire != nullptr)
+					queued_bits.insert(bit);
+		};
+		auto add_sel = [&](const std::string &str) {
+			RTLIL::SigSpec sig;
+			if (RTLIL::SigSpec::parse_sel(sig, design, module, str))
+				add_sig(sig);
+		};
+		auto add_set = [&](const std::pair<std::string, std::string> &s) {
+			RTLIL::SigSpec lhs, rhs;
+			if (!RTLIL::SigSpec::parse_sel(lhs, design, module, s.first))
+				return;
+			add_sig(lhs);
+			if (RTLIL::SigSpec::parse_rhs(lhs, rhs, module, s.second))
+				add_sig(rhs);
+		};
+
+		for (auto &s : sets) add_set(s);
+		for (auto &s : sets_init) add_set(s);
+		for (auto &s : prove) add_set(s);
+		for (auto &s : prove_x) add_set(s);
+		for (auto &it : sets_at) for (auto &s : it.second) add_set(s);
+		for (auto &it : unsets_at) for (auto &s : it.second) add_sel(s);
+		for (auto &s : sets_def) add_sel(s);
+		for (auto &s : sets_any_undef) add_sel(s);
+		for (auto &s : sets_all_undef) add_sel(s);
+		for (auto &it : sets_def_at) for (auto &s : it.second) add_sel(s);
+		for (auto &it : sets_any_undef_at) for (auto &s : it.second) add_sel(s);
+		for (auto &it : sets_all_undef_at) for (auto &s : it.second) add_sel(s);
+		for (auto &s : shows) add_sel(s);
+
+		// Cells of unknown type are treated as driving all their ports, so
+		// that they still cause an error when they are in the cone. Cells
+		// that add constraints on their own are always imported.
+		dict<RTLIL::SigBit, std::vector<RTLIL::Cell*>> bit_drivers;
+		for (auto cell : module->cells()) {
+			if (!design->selected(module, cell))
+				continue;
+			if ((prove_asserts && cell->type == ID($assert)) || (set_assumes && cell->type == ID($assume)))
+				queued_cells.push_back(cell);
+			for (auto &conn : cell->connections())
+				if (!ct.cell_known(cell->type) || ct.cell_output(cell->type, conn.first))
+					for (auto bit : sigmap(conn.second)) {
+						if (bit.wire == nullptr) {
+							queued_cells.push_back(cell);
+							continue;
+						}
+						auto &drivers = bit_drivers[bit];
+						drivers.push_back(cell);
+						// conflicting drivers constrain each other
+						if (GetSize(drivers) == 2)
+							queued_bits.insert(bit);
+					}
+		}
+
+		while (1)
+		{
+			for (auto bit : queued_bits) {
+				if (!handled_bits.insert(bit).second)
+					continue;
+				auto it = bit_drivers.find(bit);
+				if (it != bit_drivers.end())
+					for (auto cell : it->second)
+						queued_cells.push_back(cell);
+			}
+			queued_bits.clear();
+
+			if (queued_cells.empty())
+				break;
+
+			for (auto cell : queued_cells) {
+				if (!coi_cells.insert(cell).second)
+					continue;
+				for (auto &conn : cell->connections())
+					if (!ct.cell_known(cell->type) || ct.cell_input(cell->type, conn.first))
+						add_sig(conn.second);
+			}
+			queued_cells.clear();
+		}
+
+		int num_cells = 0;
+		for (auto cell : module->cells()) {
+			if (!design->selected(module, cell))
+				continue;
+			num_cells++;
+			if (!coi_cells.count(cell))
+				for (auto &conn : cell->connections())
+					if (ct.cell_output(cell->type, conn.first))
+						coi_skipped_bits.add(sigmap(conn.second));
+		}
+
+		log("Cone of influence contains %d of %d cells.\n", GetSize(coi_cells), num_cells);
+		coi_done = true;
+	}
+
 	void setup(int timestep = -1, bool initstate = false)
 	{
 		if (timestep > 0)
@@ -101,6 +211,9 @@ struct SatHelper
 		if (initstate)
 			satgen.setInitState(timestep);
 
+		if (use_coi && !coi_done)
+			compute_coi();
+
 		if (timestep > max_timestep)
 			max_timestep = timestep;
 
@@ -231,7 +344,7 @@ struct SatHelper
 
 		int import_cell_counter = 0;
 		for (auto cell : module->cells())
-			if (design->selected(module, cell)) {
+			if (design->selected(module, cell) && (!use_coi || coi_cells.count(cell))) {
 				// log("Import cell: %s\n", RTLIL::id2cstr(cell->name));
 				if (satgen.importCell(cell, timestep)) {
 					for (auto &p : cell->connections())
@@ -276,7 +389,7 @@ struct SatHelper
 				for (int i = 0; i < lhs.size(); i++) {
 					RTLIL::SigSpec bit = lhs.extract(i, 1);
 					if (rhs[i] == State::Sx || !satgen.initial_state.check_all(bit)) {
-						if (rhs[i] != State::Sx)
+						if (rhs[i] != State::Sx && !coi_skipped_bits.check_all(bit))
 							removed_bits.append(bit);
 						lhs.remove(i, 1);
 						rhs.remove(i, 1);
@@ -960,6 +1073,12 @@ struct SatPass : public Pass {
 		log("    -ignore_unknown_cells\n");
 		log("        ignore all cells that can not be matched to a SAT model\n");
 		log("\n");
+		log("    -nocoi\n");
+		log("        import all selected cells. By default only the cells in the cone of\n");
+		log("        influence of the signals used in -set, -prove, -show, etc. options (and\n");
+		log("        the $assert and $assume cells for -prove-asserts and -set-assumes)\n");
+		log("        are imported into the SAT problem.\n");
+		log("\n");
 		log("The following options can be used to set up a sequential problem:\n");
 		log("\n");
 		log("    -seq <N>\n");
@@ -1030,6 +1149,13 @@ struct SatPass : public Pass {
 		log("        -maxsteps <N>\". Use -initsteps if you just want to set a\n");
 		log("        minimal induction length.\n");
 		log("\n");
+		log("    -portfolio <N>\n");
+		log("        Run the temporal induction proof on <N> threads. One thread proves\n");
+		log("        the base case for increasing lengths while the other threads try\n");
+		log("        the induction step for different induction lengths. The proof stops\n");
+		log("        at the first conclusive result. Can not be combined with -timeout,\n");
+		log("        -tempinduct-baseonly, -tempinduct-inductonly and -dump_cnf.\n");
+		log("\n");
 		log("    -prove <signal> <value>\n");
 		log("        Attempt to proof that <signal> is always <value>.\n");
 		log("\n");
@@ -1059,6 +1185,10 @@ struct SatPass : public Pass {
 		log("    -timeout <N>\n");
 		log("        Maximum number of seconds a single SAT instance may take.\n");
 		log("\n");
+		log("    -solver <name>\n");
+		log("        Use the named SAT solver instead of the default (minisat). The\n");
+		log("        cadical solver is available when yosys is built with ENABLE_CADICAL=1.\n");
+		log("\n");
 		log("    -verify\n");
 		log("        Return an error and stop the synthesis script if the proof fails.\n");
 		log("\n");
@@ -1083,10 +1213,10 @@ struct SatPass : public Pass {
 		bool ignore_div_by_zero = false, set_init_undef = false, set_init_zero = false, max_undef = false;
 		bool tempinduct = false, prove_asserts = false, show_inputs = false, show_outputs = false;
 		bool show_regs = false, show_public = false, show_all = false;
-		bool ignore_unknown_cells = false, falsify = false, tempinduct_def = false, set_init_def = false;
+		bool ignore_unknown_cells = false, falsify = false, tempinduct_def = false, set_init_def = false, nocoi = false;
 		bool tempinduct_baseonly = false, tempinduct_inductonly = false, set_assumes = false;
-		int tempinduct_skip = 0, stepsize = 1;
-		std::string vcd_file_name, json_file_name, cnf_file_name;
+		int tempinduct_skip = 0, stepsize = 1, portfolio = 0;
+		std::string vcd_file_name, json_file_name, cnf_file_name, solver_name;
 
 		log_header(design, "Executing SAT pass (solving SAT problems in the circuit).\n");
 
@@ -1114,6 +1244,10 @@ struct SatPass : public Pass {
 				falsify = true;
 				continue;
 			}
+			if (args[argidx] == "-solver" && argidx+1 < args.size()) {
+				solver_name = args[++argidx];
+				continue;
+			}
 			if (args[argidx] == "-timeout" && argidx+1 < args.size()) {
 				timeout = atoi(args[++argidx].c_str());
 				continue;
@@ -1130,6 +1264,10 @@ struct SatPass : public Pass {
 				initsteps = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-portfolio" && argidx+1 < args.size()) {
+				portfolio = atoi(args[++argidx].c_str());
+				continue;
+			}
 			if (args[argidx] == "-stepsize" && argidx+1 < args.size()) {
 				stepsize = max(1, atoi(args[++argidx].c_str()));
 				continue;
@@ -1313,6 +1451,10 @@ struct SatPass : public Pass {
 				ignore_unknown_cells = true;
 				continue;
 			}
+			if (args[argidx] == "-nocoi") {
+				nocoi = true;
+				continue;
+			}
 			if (args[argidx] == "-dump_vcd" && argidx+1 < args.size()) {
 				vcd_file_name = args[++argidx];
 				continue;
@@ -1329,6 +1471,8 @@ struct SatPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		SatSolverSelect solver_select(solver_name);
+
 		RTLIL::Module *module = NULL;
 		for (auto mod : design->selected_modules()) {
 			if (module)
@@ -1344,6 +1488,24 @@ struct SatPass : public Pass {
 		if (prove_skip && tempinduct)
 			log_cmd_error("Options -prove-skip and -tempinduct don't work with each other. Use -seq instead of -prove-skip.\n");
 
+		if (portfolio != 0) {
+			if (portfolio < 2)
+				log_cmd_error("The value of -portfolio must be at least 2.\n");
+			if (!tempinduct || tempinduct_baseonly || tempinduct_inductonly)
+				log_cmd_error("Option -portfolio is only supported for full temporal induction proofs.\n");
+			if (timeout)
+				log_cmd_error("Options -portfolio and -timeout don't work with each other.\n");
+			if (!cnf_file_name.empty())
+				log_cmd_error("Options -portfolio and -dump_cnf don't work with each other.\n");
+#ifndef YOSYS_ENABLE_THREADS
+			log_warning("Yosys was built without thread support, ignoring -portfolio.\n");
+			portfolio = 0;
+#else
+			if (yosys_in_worker_thread())
+				portfolio = 0;
+#endif
+		}
+
 		if (prove_skip >= seq_len && prove_skip > 0)
 			log_cmd_error("The value of -prove-skip must be smaller than the one of -seq.\n");
 
@@ -1420,34 +1582,195 @@ struct SatPass : public Pass {
 			basecase.set_init_zero = set_init_zero;
 			basecase.satgen.ignore_div_by_zero = ignore_div_by_zero;
 			basecase.ignore_unknown_cells = ignore_unknown_cells;
+			basecase.use_coi = !nocoi;
 
 			for (int timestep = 1; timestep <= seq_len; timestep++)
 				if (!tempinduct_inductonly)
 					basecase.setup(timestep, timestep == 1);
 
-			inductstep.sets = sets;
-			inductstep.set_assumes = set_assumes;
-			inductstep.prove = prove;
-			inductstep.prove_x = prove_x;
-			inductstep.prove_asserts = prove_asserts;
-			inductstep.shows = shows;
-			inductstep.timeout = timeout;
-			inductstep.sets_def = sets_def;
-			inductstep.sets_any_undef = sets_any_undef;
-			inductstep.sets_all_undef = sets_all_undef;
-			inductstep.satgen.ignore_div_by_zero = ignore_div_by_zero;
-			inductstep.ignore_unknown_cells = ignore_unknown_cells;
-
-			if (!tempinduct_baseonly) {
+			auto setup_inductstep = [&](SatHelper &inductstep) {
+				inductstep.sets = sets;
+				inductstep.set_assumes = set_assumes;
+				inductstep.prove = prove;
+				inductstep.prove_x = prove_x;
+				inductstep.prove_asserts = prove_asserts;
+				inductstep.shows = shows;
+				inductstep.timeout = timeout;
+				inductstep.sets_def = sets_def;
+				inductstep.sets_any_undef = sets_any_undef;
+				inductstep.sets_all_undef = sets_all_undef;
+				inductstep.satgen.ignore_div_by_zero = ignore_div_by_zero;
+				inductstep.ignore_unknown_cells = ignore_unknown_cells;
+				inductstep.use_coi = !nocoi;
+			};
+
+			auto init_inductstep = [&](SatHelper &inductstep) {
 				inductstep.setup(1);
 				inductstep.ez->assume(inductstep.setup_proof(1));
-			}
 
-			if (tempinduct_def) {
-				std::vector<int> undef_state = inductstep.satgen.importUndefSigSpec(inductstep.satgen.initial_state.export_all(), 1);
-				inductstep.ez->assume(inductstep.ez->NOT(inductstep.ez->expression(ezSAT::OpOr, undef_state)));
+				if (tempinduct_def) {
+					std::vector<int> undef_state = inductstep.satgen.importUndefSigSpec(inductstep.satgen.initial_state.export_all(), 1);
+					inductstep.ez->assume(inductstep.ez->NOT(inductstep.ez->expression(ezSAT::OpOr, undef_state)));
+				}
+			};
+
+			setup_inductstep(inductstep);
+
+			if (portfolio > 1)
+			{
+				// Thread 0 proves the base case, the other threads share the
+				// induction lengths that would be tried one after another, so
+				// that thread i tries every (portfolio-1)-th of them. The proof
+				// is done when the base case fails or when the induction step
+				// is proven for a length the base case already covers.
+				int num_induct = portfolio - 1;
+				std::vector<std::unique_ptr<SatHelper>> extra_inductsteps;
+				std::vector<SatHelper*> inductsteps = { &inductstep };
+				for (int i = 1; i < num_induct; i++) {
+					extra_inductsteps.emplace_back(new SatHelper(design, module, enable_undef, set_def_formal));
+					setup_inductstep(*extra_inductsteps.back());
+					inductsteps.push_back(extra_inductsteps.back().get());
+				}
+
+				std::mutex result_mutex;
+				int base_proven = 0, base_failed = 0, induct_proven = 0;
+
+				auto stop_inductsteps = [&]() {
+					for (auto helper : inductsteps)
+						helper->ez->interrupt();
+				};
+
+				// must be called with result_mutex held
+				auto check_done = [&]() {
+					if (base_failed > 0 || (induct_proven > 0 && base_proven >= induct_proven)) {
+						basecase.ez->interrupt();
+						stop_inductsteps();
+					}
+				};
+
+				auto run_basecase = [&]() {
+					for (int inductlen = 1; inductlen <= maxsteps || maxsteps == 0; inductlen++)
+					{
+						basecase.setup(seq_len + inductlen, seq_len + inductlen == 1);
+						int property = basecase.setup_proof(seq_len + inductlen);
+						basecase.generate_model();
+
+						if (inductlen > 1)
+							basecase.force_unique_state(seq_len + 1, seq_len + inductlen);
+
+						if (tempinduct_skip < inductlen)
+						{
+							log("\n[base case %d] Solving problem with %d variables and %d clauses..\n",
+									inductlen, basecase.ez->numCnfVariables(), basecase.ez->numCnfClauses());
+
+							if (basecase.solve(basecase.ez->NOT(property))) {
+								std::lock_guard<std::mutex> lock(result_mutex);
+								base_failed = inductlen;
+								check_done();
+								return;
+							}
+
+							if (basecase.gotTimeout)
+								return;
+
+							log("Base case for induction length %d proven.\n", inductlen);
+						}
+						basecase.ez->assume(property);
+
+						std::lock_guard<std::mutex> lock(result_mutex);
+						base_proven = inductlen;
+						check_done();
+						if (induct_proven > 0 && base_proven >= induct_proven)
+							return;
+					}
+				};
+
+				auto run_inductstep = [&](int index) {
+					SatHelper &helper = *inductsteps[index];
+					init_inductstep(helper);
+
+					for (int inductlen = 1, solve_count = 0; inductlen <= maxsteps || maxsteps == 0; inductlen++)
+					{
+						{
+							std::lock_guard<std::mutex> lock(result_mutex);
+							if (base_failed > 0 || (induct_proven > 0 && induct_proven <= inductlen))
+								return;
+						}
+
+						helper.setup(inductlen + 1);
+						int property = helper.setup_proof(inductlen + 1);
+						helper.generate_model();
+
+						if (inductlen > 1)
+							helper.force_unique_state(1, inductlen + 1);
+
+						if (inductlen > tempinduct_skip && inductlen > initsteps && inductlen % stepsize == 0 && solve_count++ % num_induct == index)
+						{
+							log("\n[induction step %d] Solving problem with %d variables and %d clauses..\n",
+									inductlen, helper.ez->numCnfVariables(), helper.ez->numCnfClauses());
+
+							if (!helper.solve(helper.ez->NOT(property))) {
+								if (helper.gotTimeout)
+									return;
+								log("Induction step for length %d proven.\n", inductlen);
+								std::lock_guard<std::mutex> lock(result_mutex);
+								if (induct_proven == 0 || inductlen < induct_proven)
+									induct_proven = inductlen;
+								// longer induction lengths are not needed anymore
+								stop_inductsteps();
+								check_done();
+								return;
+							}
+
+							log("Induction step for length %d failed.\n", inductlen);
+						}
+						helper.ez->assume(property);
+					}
+				};
+
+				log("\nRunning temporal induction proof on %d threads.\n", portfolio);
+				log_flush();
+
+				ThreadPool::run_captured(portfolio, [&](int i) {
+					try {
+						if (i == 0)
+							run_basecase();
+						else
+							run_inductstep(i - 1);
+					} catch (...) {
+						// don't leave the other threads running
+						std::lock_guard<std::mutex> lock(result_mutex);
+						basecase.ez->interrupt();
+						stop_inductsteps();
+						throw;
+					}
+				}, portfolio);
+
+				if (base_failed > 0) {
+					log("\nSAT temporal induction proof finished - model found for base case %d: FAIL!\n", base_failed);
+					print_proof_failed();
+					basecase.print_model();
+					if(!vcd_file_name.empty())
+						basecase.dump_model_to_vcd(vcd_file_name);
+					if(!json_file_name.empty())
+						basecase.dump_model_to_json(json_file_name);
+					goto tip_failed;
+				}
+
+				if (induct_proven > 0 && base_proven >= induct_proven) {
+					log("\nInduction step for length %d and base case proven: SUCCESS!\n", induct_proven);
+					print_qed();
+					goto tip_success;
+				}
+
+				log("\nReached maximum number of time steps -> proof failed.\n");
+				print_proof_failed();
+				goto tip_failed;
 			}
 
+			if (!tempinduct_baseonly)
+				init_inductstep(inductstep);
+
 			for (int inductlen = 1; inductlen <= maxsteps || maxsteps == 0; inductlen++)
 			{
 				log("\n** Trying induction with length %d **\n", inductlen);
@@ -1609,6 +1932,7 @@ struct SatPass : public Pass {
 			sathelper.set_init_zero = set_init_zero;
 			sathelper.satgen.ignore_div_by_zero = ignore_div_by_zero;
 			sathelper.ignore_unknown_cells = ignore_unknown_cells;
+			sathelper.use_coi = !nocoi;
 
 			if (seq_len == 0) {
 				sathelper.setup();
@@ -0,0 +1,449 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+#include "kernel/qcsat.h"
+#include <algorithm>
+#include <queue>
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct SatSweepWorker
+{
+	enum NodeType {
+		FREE, CONST0, CONST1, BUF, NOT, AND, NAND, OR, NOR, XOR, XNOR,
+		ANDNOT, ORNOT, MUX, NMUX, AOI3, OAI3, AOI4, OAI4
+	};
+
+	// Nodes are created in topological order, so the inputs of a gate node
+	// always have smaller indices than the gate itself.
+	struct Node {
+		NodeType type;
+		int inputs[4];
+		// the driver of a node that may be replaced by an equivalent node
+		RTLIL::Cell *cell;
+	};
+
+	RTLIL::Design *design;
+	RTLIL::Module *module;
+	ModWalker modwalker;
+	SigMap &sigmap;
+	uint64_t rng_state;
+
+	std::vector<Node> nodes;
+	std::vector<RTLIL::SigBit> node_bits;
+	dict<RTLIL::SigBit, int> node_index;
+	std::vector<int> free_nodes;
+
+	// simulation results, one vector over all nodes per 64 patterns
+	std::vector<std::vector<uint64_t>> words;
+
+	// counterexamples are collected here until there are 64 of them
+	std::vector<uint64_t> cex_word;
+	int cex_count = 0;
+
+	std::vector<int> merged;
+	pool<std::pair<int, int>> disproved;
+
+	int count_queries = 0;
+	int count_cex = 0;
+	int count_merged = 0;
+
+	SatSweepWorker(RTLIL::Design *design, RTLIL::Module *module, uint64_t seed) :
+			design(design), module(module), modwalker(design, module), sigmap(modwalker.sigmap), rng_state(seed)
+	{
+	}
+
+	uint64_t rng()
+	{
+		rng_state ^= rng_state << 13;
+		rng_state ^= rng_state >> 7;
+		rng_state ^= rng_state << 17;
+		return rng_state;
+	}
+
+	static int gate_type(RTLIL::IdString type)
+	{
+		static dict<RTLIL::IdString, int> types = {
+			{ID($_BUF_), BUF}, {ID($_NOT_), NOT},
+			{ID($_AND_), AND}, {ID($_NAND_), NAND}, {ID($_OR_), OR}, {ID($_NOR_), NOR},
+			{ID($_XOR_), XOR}, {ID($_XNOR_), XNOR}, {ID($_ANDNOT_), ANDNOT}, {ID($_ORNOT_), ORNOT},
+			{ID($_MUX_), MUX}, {ID($_NMUX_), NMUX},
+			{ID($_AOI3_), AOI3}, {ID($_OAI3_), OAI3}, {ID($_AOI4_), AOI4}, {ID($_OAI4_), OAI4},
+		};
+		auto it = types.find(type);
+		return it == types.end() ? FREE : it->second;
+	}
+
+	int add_node(RTLIL::SigBit bit, NodeType type)
+	{
+		int idx = GetSize(nodes);
+		nodes.push_back(Node{type, {0, 0, 0, 0}, nullptr});
+		node_bits.push_back(bit);
+		if (type == FREE)
+			free_nodes.push_back(idx);
+		return idx;
+	}
+
+	int get_node(RTLIL::SigBit bit)
+	{
+		bit = sigmap(bit);
+		if (bit.wire == nullptr)
+			return bit == State::S1 ? 1 : 0;
+		auto it = node_index.find(bit);
+		if (it != node_index.end())
+			return it->second;
+		int idx = add_node(bit, FREE);
+		node_index[bit] = idx;
+		return idx;
+	}
+
+	void build_nodes()
+	{
+		// non-1 constants are modelled as 0, just like SatGen does
+		add_node(State::S0, CONST0);
+		add_node(State::S1, CONST1);
+
+		// Every cell except the storage cells is ordered as if it was
+		// combinational, so that a node can never be replaced with a node
+		// from its own output cone. Cells on (or behind) a combinational loop
+		// are left out.
+		std::vector<RTLIL::Cell*> cells;
+		dict<RTLIL::SigBit, int> bit_driver;
+		for (auto cell : module->cells()) {
+			if (RTLIL::builtin_ff_cell_types().count(cell->type) || cell->is_mem_cell())
+				continue;
+			int idx = GetSize(cells);
+			cells.push_back(cell);
+			for (auto &conn : cell->connections())
+				if (cell->output(conn.first))
+					for (auto bit : sigmap(conn.second)) {
+						if (bit.wire == nullptr)
+							continue;
+						auto it = bit_driver.find(bit);
+						if (it == bit_driver.end())
+							bit_driver[bit] = idx;
+						else
+							it->second = -1;
+					}
+		}
+
+		std::vector<std::vector<int>> fanout(GetSize(cells));
+		std::vector<int> pending(GetSize(cells));
+		for (int i = 0; i < GetSize(cells); i++)
+			for (auto &conn : cells[i]->connections())
+				if (cells[i]->input(conn.first))
+					for (auto bit : sigmap(conn.second)) {
+						auto it = bit_driver.find(bit);
+						if (it == bit_driver.end() || it->second < 0)
+							continue;
+						fanout[it->second].push_back(i);
+						pending[i]++;
+					}
+
+		std::queue<int> ready;
+		for (int i = 0; i < GetSize(cells); i++)
+			if (pending[i] == 0)
+				ready.push(i);
+
+		while (!ready.empty())
+		{
+			int i = ready.front();
+			ready.pop();
+			for (int j : fanout[i])
+				if (--pending[j] == 0)
+					ready.push(j);
+
+			RTLIL::Cell *cell = cells[i];
+			int type = gate_type(cell->type);
+			SigBit y = type != FREE ? sigmap(cell->getPort(ID::Y)).as_bit() : SigBit();
+
+			if (type != FREE && y.wire && bit_driver.at(y) == i && !node_index.count(y)) {
+				Node node{NodeType(type), {0, 0, 0, 0}, nullptr};
+				int k = 0;
+				for (auto port : {ID::A, ID::B, ID::C, ID::D, ID::S})
+					if (cell->hasPort(port))
+						node.inputs[k++] = get_node(cell->getPort(port));
+				if (design->selected(module, cell) && !cell->has_keep_attr() && !y.wire->port_input)
+					node.cell = cell;
+				int idx = GetSize(nodes);
+				nodes.push_back(node);
+				node_bits.push_back(y);
+				node_index[y] = idx;
+				continue;
+			}
+
+			for (auto &conn : cell->connections())
+				if (cell->input(conn.first))
+					for (auto bit : conn.second)
+						get_node(bit);
+			for (auto &conn : cell->connections())
+				if (cell->output(conn.first))
+					for (auto bit : conn.second)
+						get_node(bit);
+		}
+
+		merged.assign(GetSize(nodes), -1);
+		cex_word.resize(GetSize(nodes));
+	}
+
+	// Evaluates all gate nodes for 64 patterns, the entries for the free
+	// nodes already have to be filled in.
+	void simulate(std::vector<uint64_t> &v)
+	{
+		v[0] = 0;
+		v[1] = ~uint64_t(0);
+		for (int i = 2; i < GetSize(nodes); i++)
+		{
+			const Node &n = nodes[i];
+			uint64_t a = v[n.inputs[0]], b = v[n.inputs[1]], c = v[n.inputs[2]], d = v[n.inputs[3]];
+			switch (n.type)
+			{
+			case FREE: break;
+			case CONST0: v[i] = 0; break;
+			case CONST1: v[i] = ~uint64_t(0); break;
+			case BUF: v[i] = a; break;
+			case NOT: v[i] = ~a; break;
+			case AND: v[i] = a & b; break;
+			case NAND: v[i] = ~(a & b); break;
+			case OR: v[i] = a | b; break;
+			case NOR: v[i] = ~(a | b); break;
+			case XOR: v[i] = a ^ b; break;
+			case XNOR: v[i] = ~(a ^ b); break;
+			case ANDNOT: v[i] = a & ~b; break;
+			case ORNOT: v[i] = a | ~b; break;
+			case MUX: v[i] = (a & ~c) | (b & c); break;
+			case NMUX: v[i] = ~((a & ~c) | (b & c)); break;
+			case AOI3: v[i] = ~((a & b) | c); break;
+			case OAI3: v[i] = ~((a | b) & c); break;
+			case AOI4: v[i] = ~((a & b) | (c & d)); break;
+			case OAI4: v[i] = ~((a | b) & (c | d)); break;
+			}
+		}
+	}
+
+	void add_random_word()
+	{
+		std::vector<uint64_t> v(GetSize(nodes));
+		for (int i : free_nodes)
+			v[i] = rng();
+		simulate(v);
+		words.push_back(std::move(v));
+	}
+
+	void flush_cex()
+	{
+		if (cex_count == 0)
+			return;
+		simulate(cex_word);
+		words.push_back(std::move(cex_word));
+		cex_word.assign(GetSize(nodes), 0);
+		cex_count = 0;
+	}
+
+	// Groups all nodes that are not merged yet by their simulation results,
+	// each group is sorted in topological order.
+	std::vector<std::vector<int>> find_classes()
+	{
+		std::vector<int> order;
+		for (int i = 0; i < GetSize(nodes); i++)
+			if (merged[i] < 0)
+				order.push_back(i);
+
+		const std::vector<std::vector<uint64_t>> &w = words;
+		auto signature_less = [&w](int a, int b) {
+			for (auto &v : w)
+				if (v[a] != v[b])
+					return v[a] < v[b];
+			return a < b;
+		};
+		std::sort(order.begin(), order.end(), signature_less);
+
+		std::vector<std::vector<int>> classes;
+		for (int i = 0; i < GetSize(order); i++) {
+			bool same = i > 0;
+			for (auto &v : w)
+				if (same && v[order[i]] != v[order[i-1]])
+					same = false;
+			if (!same)
+				classes.emplace_back();
+			classes.back().push_back(order[i]);
+		}
+		return classes;
+	}
+
+	int run(int num_words)
+	{
+		build_nodes();
+		for (int i = 0; i < num_words; i++)
+			add_random_word();
+
+		int count_candidates = 0;
+		for (auto &n : nodes)
+			if (n.cell)
+				count_candidates++;
+		log("Sweeping module %s with %d nodes (%d candidates).\n", log_id(module), GetSize(nodes), count_candidates);
+
+		QuickConeSat qcsat(modwalker);
+		qcsat.max_depth = 0;
+		ezSAT *ez = qcsat.ez.get();
+
+		// the free nodes with a SAT literal, their values make up the counterexamples
+		std::vector<int> unimported_free = free_nodes;
+		std::vector<int> imported_free, imported_free_lits;
+
+		while (1)
+		{
+			bool did_query = false;
+
+			std::vector<std::vector<int>> classes = find_classes();
+			for (auto &cls : classes)
+			{
+				int rep = cls.front();
+				for (int i = 1; i < GetSize(cls); i++)
+				{
+					int m = cls[i];
+					if (nodes[m].cell == nullptr || disproved.count(std::make_pair(m, rep)))
+						continue;
+
+					int lit_m = qcsat.importSigBit(node_bits[m]);
+					int lit_rep = qcsat.importSigBit(node_bits[rep]);
+					qcsat.prepare();
+
+					for (int j = 0; j < GetSize(unimported_free); j++) {
+						int n = unimported_free[j];
+						if (!qcsat.satgen.importedSigBit(node_bits[n]))
+							continue;
+						imported_free.push_back(n);
+						imported_free_lits.push_back(qcsat.importSigBit(node_bits[n]));
+						unimported_free[j--] = unimported_free.back();
+						unimported_free.pop_back();
+					}
+
+					did_query = true;
+					count_queries++;
+
+					std::vector<bool> model;
+					if (!ez->solve(imported_free_lits, model, ez->XOR(lit_m, lit_rep))) {
+						// the equivalence helps proving the nodes further down
+						ez->assume(ez->IFF(lit_m, lit_rep));
+						merged[m] = rep;
+						count_merged++;
+						continue;
+					}
+
+					disproved.insert(std::make_pair(m, rep));
+					if (cex_count == 0)
+						for (int n : free_nodes)
+							cex_word[n] = rng();
+					uint64_t mask = uint64_t(1) << cex_count;
+					for (int j = 0; j < GetSize(imported_free); j++)
+						cex_word[imported_free[j]] = model[j] ? cex_word[imported_free[j]] | mask : cex_word[imported_free[j]] & ~mask;
+					count_cex++;
+					if (++cex_count == 64)
+						flush_cex();
+				}
+			}
+
+			flush_cex();
+			if (!did_query)
+				break;
+		}
+
+		log("  Ran %d SAT queries, simulated %d patterns (%d counterexamples).\n", count_queries, 64 * GetSize(words), count_cex);
+
+		for (int m = 0; m < GetSize(nodes); m++)
+		{
+			if (merged[m] < 0)
+				continue;
+			int rep = merged[m];
+			while (merged[rep] >= 0)
+				rep = merged[rep];
+			nodes[m].cell->setPort(ID::Y, module->addWire(NEW_ID));
+			module->connect(node_bits[m], node_bits[rep]);
+		}
+
+		log("  Merged %d signal bits with equivalent signals.\n", count_merged);
+		return count_merged;
+	}
+};
+
+struct SatSweepPass : public Pass {
+	SatSweepPass() : Pass("satsweep", "merge equivalent signals using simulation and SAT") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    satsweep [options] [selection]\n");
+		log("\n");
+		log("This pass finds signals with the same function in the gate-level cells\n");
+		log("($_AND_, $_MUX_, ...) of a module and merges them. Candidates are found by\n");
+		log("bit-parallel simulation of random patterns and each candidate is proven with a\n");
+		log("SAT query on its input cone. Patterns that disprove a candidate are used to\n");
+		log("refine the remaining candidates. The cells whose outputs were replaced are\n");
+		log("left unconnected, a subsequent call to 'clean' removes them.\n");
+		log("\n");
+		log("The outputs of all other cells are treated as free variables during\n");
+		log("simulation, and in the SAT queries if they are too complex.\n");
+		log("\n");
+		log("    -words <n>\n");
+		log("        number of 64-bit words of random patterns to simulate before the\n");
+		log("        first SAT query (default: 4)\n");
+		log("\n");
+		log("    -seed <n>\n");
+		log("        seed for the random patterns\n");
+		log("\n");
+		log("Only outputs of selected cells are replaced, all cells of the selected modules\n");
+		log("are analyzed.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		int num_words = 4;
+		uint64_t seed = 88172645463325252ULL;
+
+		log_header(design, "Executing SATSWEEP pass (merge equivalent signals).\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-words" && argidx+1 < args.size()) {
+				num_words = std::max(1, atoi(args[++argidx].c_str()));
+				continue;
+			}
+			if (args[argidx] == "-seed" && argidx+1 < args.size()) {
+				seed = strtoull(args[++argidx].c_str(), nullptr, 0) | 1;
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
+
+		int count = 0;
+		for (auto module : design->selected_modules()) {
+			if (module->has_processes_warn())
+				continue;
+			count += SatSweepWorker(design, module, seed).run(num_words);
+		}
+
+		log("Merged a total of %d signal bits.\n", count);
+	}
+} SatSweepPass;
+
+PRIVATE_NAMESPACE_END
@@ -26,8 +26,12 @@
 #include "kernel/yw.h"
 #include "kernel/json.h"
 #include "kernel/fmt.h"
+#include "kernel/threading.h"
+#include "kernel/consteval.h"
+#include "kernel/ffinit.h"
 
 #include <ctime>
+#include <chrono>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -73,10 +77,112 @@ struct OutputWriter
 {
 	OutputWriter(SimWorker *w) { worker = w;};
 	virtual ~OutputWriter() {};
-	virtual void write(std::map<int, bool> &use_signal) = 0;
+	// use_signal is indexed by output id
+	virtual void write(const std::vector<bool> &use_signal) = 0;
+	void write_values(const std::vector<bool> &use_signal, const std::function<void(int)> &time_change,
+			const std::function<void(int, const std::string &)> &value_change);
 	SimWorker *worker;
 };
 
+// Values of the output signals recorded at each step of a simulation. Only
+// the changes are recorded: the ids of the signals that changed in a step
+// are kept in one flat array, the values in one column per signal with the
+// states packed into two bits each. Sa and Sm are recorded as Sz.
+struct OutputTrace
+{
+	struct Column {
+		int width = -1;
+		std::vector<uint8_t> data;
+	};
+
+	// time of each step and the start of its changes in change_ids
+	std::vector<int> times;
+	std::vector<size_t> step_begin;
+	std::vector<int> change_ids;
+	// ids registered after the first step, recorded as changes in it
+	std::vector<int> first_step_ids;
+	std::vector<Column> columns;
+
+	int num_steps() const { return GetSize(times); }
+
+	void begin_step(int time)
+	{
+		times.push_back(time);
+		step_begin.push_back(change_ids.size());
+	}
+
+	void end_step()
+	{
+		std::sort(change_ids.begin() + step_begin.back(), change_ids.end());
+	}
+
+	void append(int id, const Const &value)
+	{
+		if (id >= GetSize(columns))
+			columns.resize(id + 1);
+		Column &column = columns[id];
+		if (column.width < 0)
+			column.width = GetSize(value);
+		log_assert(column.width == GetSize(value));
+		for (int i = 0; i < column.width; i += 4) {
+			uint8_t byte = 0;
+			for (int k = i; k < i + 4 && k < column.width; k++)
+				byte |= std::min<uint8_t>(value.bits[k], State::Sz) << (2 * (k - i));
+			column.data.push_back(byte);
+		}
+	}
+
+	// records a change in the current step
+	void add(int id, const Const &value)
+	{
+		change_ids.push_back(id);
+		append(id, value);
+	}
+
+	// records a change in the first step of a signal that is registered later,
+	// ids are handed out in increasing order so they stay sorted
+	void add_first(int id, const Const &value)
+	{
+		log_assert(first_step_ids.empty() || first_step_ids.back() < id);
+		first_step_ids.push_back(id);
+		append(id, value);
+	}
+
+	// Reads the steps of a trace in order.
+	struct Reader
+	{
+		const OutputTrace &trace;
+		std::vector<size_t> offsets;
+		Const value;
+
+		Reader(const OutputTrace &trace) : trace(trace), offsets(trace.columns.size()) { }
+
+		const Const &read(int id)
+		{
+			const Column &column = trace.columns[id];
+			size_t &offset = offsets[id];
+			value.bits.resize(column.width);
+			for (int i = 0; i < column.width; i++)
+				value.bits[i] = State((column.data[offset + i / 4] >> (2 * (i % 4))) & 3);
+			offset += (column.width + 3) / 4;
+			return value;
+		}
+
+		// calls fn(id, value) for each signal that changed in the given step
+		template<typename F> void read_step(int step, F fn)
+		{
+			size_t end = step + 1 < trace.num_steps() ? trace.step_begin[step + 1] : trace.change_ids.size();
+			for (size_t i = trace.step_begin[step]; i < end; i++) {
+				int id = trace.change_ids[i];
+				fn(id, read(id));
+			}
+			if (step == 0)
+				for (int id : trace.first_step_ids)
+					fn(id, read(id));
+		}
+	};
+};
+
 struct SimInstance;
 struct TriggeredAssertion {
 	int step;
@@ -111,10 +217,11 @@ struct SimShared
 	FstData *fst = nullptr;
 	double start_time = 0;
 	double stop_time = -1;
+	double window_time = 0;
 	SimulationMode sim_mode = SimulationMode::sim;
 	bool cycles_set = false;
 	std::vector<std::unique_ptr<OutputWriter>> outputfiles;
-	std::vector<std::pair<int,std::map<int,Const>>> output_data;
+	OutputTrace output_trace;
 	bool ignore_x = false;
 	bool date = false;
 	bool multiclock = false;
@@ -124,6 +231,8 @@ struct SimShared
 	std::vector<DisplayOutput> display_output;
 	bool serious_asserts = false;
 	bool initstate = true;
+	bool compiled = false;
+	int threads = 1;
 };
 
 void zinit(State &v)
@@ -138,6 +247,35 @@ void zinit(Const &v)
 		zinit(bit);
 }
 
+// These match the results of CellTypes::eval() for the simple gate types.
+static State sim_not(State a)
+{
+	return a == State::S0 ? State::S1 : a == State::S1 ? State::S0 : a;
+}
+
+static State sim_and(State a, State b)
+{
+	if (a == State::S0 || b == State::S0)
+		return State::S0;
+	return a == State::S1 && b == State::S1 ? State::S1 : State::Sx;
+}
+
+static State sim_or(State a, State b)
+{
+	if (a == State::S1 || b == State::S1)
+		return State::S1;
+	return a == State::S0 && b == State::S0 ? State::S0 : State::Sx;
+}
+
+static State sim_xor(State a, State b)
+{
+	if ((a != State::S0 && a != State::S1) || (b != State::S0 && b != State::S1))
+		return State::Sx;
+	return a != b ? State::S1 : State::S0;
+}
+
+static const State sim_const_states[] = { State::S0, State::S1, State::Sx, State::Sz, State::Sa, State::Sm };
+
 struct SimInstance
 {
 	SimShared *shared;
@@ -162,6 +300,12 @@ struct SimInstance
 	pool<IdString> dirty_memories;
 	pool<SimInstance*, hash_ptr_ops> dirty_children;
 
+	// Updates of the parent's nets by update_ph1(), applied by the parent once
+	// all of its children are done so that the children can run in parallel.
+	std::vector<std::pair<SigSpec, Const>> parent_updates;
+	// memory addresses seen in a worker thread, see register_memory_addr()
+	std::vector<std::pair<IdString, int>> pending_memory_addrs;
+
 	struct ff_state_t
 	{
 		Const past_d;
@@ -219,6 +363,35 @@ struct SimInstance
 
 	std::vector<Mem> memories;
 
+	// For "sim -compiled", the combinational cells in topological order. Their
+	// ports point directly into state_nets, which never gets new entries after
+	// the constructor.
+	enum compiled_op_type_t { OP_BUF, OP_NOT, OP_AND, OP_NAND, OP_OR, OP_NOR, OP_XOR, OP_XNOR,
+			OP_ANDNOT, OP_ORNOT, OP_MUX, OP_EVAL_AB, OP_EVAL_ABC, OP_EVAL_AS, OP_EVAL_ABS };
+
+	struct compiled_op_t
+	{
+		Cell *cell;
+		compiled_op_type_t type;
+		int args_begin, len_a, len_b, len_c, len_s;
+		int outs_begin, outs_end;
+	};
+
+	struct compiled_out_t
+	{
+		State *state;
+		SigBit bit;
+		int offset;
+		// set if the bit is read by anything but another compiled cell
+		bool notify;
+	};
+
+	std::vector<compiled_op_t> compiled_ops;
+	std::vector<const State*> compiled_args;
+	std::vector<compiled_out_t> compiled_outs;
+	pool<SigBit> compiled_inputs;
+	bool compiled_dirty = false;
+
 	dict<Wire*, pair<int, Const>> signal_database;
 	dict<IdString, std::map<int, pair<int, Const>>> trace_mem_database;
 	dict<std::pair<IdString, int>, Const> trace_mem_init_database;
@@ -378,6 +551,207 @@ struct SimInstance
 				zinit(mem.data);
 			}
 		}
+
+		if (shared->compiled)
+			compile();
+	}
+
+	// Returns how a cell is evaluated in compiled mode, or -1 if it is left
+	// to update_cell().
+	int compiled_op_type(Cell *cell)
+	{
+		if (ff_database.count(cell) || formal_database.count(cell) || mem_cells.count(cell) || children.count(cell))
+			return -1;
+		if (!yosys_celltypes.cell_evaluable(cell->type))
+			return -1;
+
+		static dict<IdString, int> gate_types = {
+			{ID($_BUF_), OP_BUF}, {ID($_NOT_), OP_NOT}, {ID($_AND_), OP_AND}, {ID($_NAND_), OP_NAND},
+			{ID($_OR_), OP_OR}, {ID($_NOR_), OP_NOR}, {ID($_XOR_), OP_XOR}, {ID($_XNOR_), OP_XNOR},
+			{ID($_ANDNOT_), OP_ANDNOT}, {ID($_ORNOT_), OP_ORNOT}, {ID($_MUX_), OP_MUX},
+		};
+		auto it = gate_types.find(cell->type);
+		if (it != gate_types.end())
+			return it->second;
+
+		// the same port patterns as in update_cell()
+		bool has_a = cell->hasPort(ID::A), has_b = cell->hasPort(ID::B), has_c = cell->hasPort(ID::C);
+		bool has_d = cell->hasPort(ID::D), has_s = cell->hasPort(ID::S), has_y = cell->hasPort(ID::Y);
+		if (!has_a || has_d || !has_y)
+			return -1;
+		if (!has_c && !has_s)
+			return OP_EVAL_AB;
+		if (has_b && has_c && !has_s)
+			return OP_EVAL_ABC;
+		if (!has_b && !has_c && has_s)
+			return OP_EVAL_AS;
+		if (has_b && !has_c && has_s)
+			return OP_EVAL_ABS;
+		return -1;
+	}
+
+	void compile()
+	{
+		std::vector<Cell*> cells;
+		std::vector<int> types;
+		dict<SigBit, int> bit_driver;
+		for (auto cell : module->cells()) {
+			int type = compiled_op_type(cell);
+			if (type < 0)
+				continue;
+			for (auto bit : sigmap(cell->getPort(ID::Y)))
+				if (bit.wire != nullptr)
+					bit_driver[bit] = GetSize(cells);
+			cells.push_back(cell);
+			types.push_back(type);
+		}
+
+		std::vector<std::vector<int>> fanout(GetSize(cells));
+		std::vector<int> pending(GetSize(cells));
+		for (int i = 0; i < GetSize(cells); i++)
+			for (auto &conn : cells[i]->connections())
+				if (cells[i]->input(conn.first))
+					for (auto bit : sigmap(conn.second)) {
+						auto it = bit_driver.find(bit);
+						if (it != bit_driver.end()) {
+							fanout[it->second].push_back(i);
+							pending[i]++;
+						}
+					}
+
+		// cells on or behind combinational loops are never ready and stay
+		// event driven
+		std::vector<int> order;
+		for (int i = 0; i < GetSize(cells); i++)
+			if (pending[i] == 0)
+				order.push_back(i);
+		for (int k = 0; k < GetSize(order); k++)
+			for (int j : fanout[order[k]])
+				if (--pending[j] == 0)
+					order.push_back(j);
+
+		pool<SigBit> compiled_outputs;
+		for (int i : order)
+		{
+			Cell *cell = cells[i];
+			compiled_op_t op;
+			op.cell = cell;
+			op.type = compiled_op_type_t(types[i]);
+			op.args_begin = GetSize(compiled_args);
+
+			auto add_args = [&](IdString port) {
+				if (!cell->hasPort(port))
+					return 0;
+				SigSpec sig = sigmap(cell->getPort(port));
+				for (auto bit : sig) {
+					if (bit.wire == nullptr) {
+						compiled_args.push_back(&sim_const_states[bit.data]);
+						continue;
+					}
+					compiled_args.push_back(&state_nets.at(bit));
+					compiled_inputs.insert(bit);
+					if (upd_cells.count(bit)) {
+						upd_cells.at(bit).erase(cell);
+						if (upd_cells.at(bit).empty())
+							upd_cells.erase(bit);
+					}
+				}
+				return GetSize(sig);
+			};
+			op.len_a = add_args(ID::A);
+			op.len_b = add_args(ID::B);
+			op.len_c = add_args(ID::C);
+			op.len_s = add_args(ID::S);
+
+			op.outs_begin = GetSize(compiled_outs);
+			SigSpec sig_y = sigmap(cell->getPort(ID::Y));
+			for (int k = 0; k < GetSize(sig_y); k++)
+				if (sig_y[k].wire != nullptr) {
+					compiled_outs.push_back(compiled_out_t{&state_nets.at(sig_y[k]), sig_y[k], k, false});
+					compiled_outputs.insert(sig_y[k]);
+				}
+			op.outs_end = GetSize(compiled_outs);
+			compiled_ops.push_back(op);
+		}
+
+		for (auto bit : compiled_outputs)
+			compiled_inputs.erase(bit);
+		for (auto &out : compiled_outs)
+			out.notify = upd_cells.count(out.bit) || upd_outports.count(out.bit);
+
+		compiled_dirty = !compiled_ops.empty();
+		if (shared->debug)
+			log("[%s] compiled %d of %d cells\n", hiername().c_str(), GetSize(compiled_ops), GetSize(module->cells()));
+	}
+
+	void run_compiled()
+	{
+		Const a, b, c, s, y;
+		for (auto &op : compiled_ops)
+		{
+			const State *const *arg = compiled_args.data() + op.args_begin;
+			compiled_out_t *out = compiled_outs.data() + op.outs_begin;
+			compiled_out_t *out_end = compiled_outs.data() + op.outs_end;
+
+			if (op.type <= OP_MUX)
+			{
+				State v;
+				switch (op.type)
+				{
+				case OP_BUF: v = *arg[0]; break;
+				case OP_NOT: v = sim_not(*arg[0]); break;
+				case OP_AND: v = sim_and(*arg[0], *arg[1]); break;
+				case OP_NAND: v = sim_not(sim_and(*arg[0], *arg[1])); break;
+				case OP_OR: v = sim_or(*arg[0], *arg[1]); break;
+				case OP_NOR: v = sim_not(sim_or(*arg[0], *arg[1])); break;
+				case OP_XOR: v = sim_xor(*arg[0], *arg[1]); break;
+				case OP_XNOR: v = sim_not(sim_xor(*arg[0], *arg[1])); break;
+				case OP_ANDNOT: v = sim_and(*arg[0], sim_not(*arg[1])); break;
+				case OP_ORNOT: v = sim_or(*arg[0], sim_not(*arg[1])); break;
+				default:
+					v = *arg[2] == State::S0 ? *arg[0] : *arg[2] == State::S1 ? *arg[1] :
+							*arg[0] == *arg[1] ? *arg[0] : State::Sx;
+					break;
+				}
+				if (out != out_end && *out->state != v) {
+					*out->state = v;
+					if (out->notify)
+						dirty_bits.insert(out->bit);
+				}
+				continue;
+			}
+
+			auto load = [&](Const &value, int len) {
+				value.bits.resize(len);
+				for (int i = 0; i < len; i++)
+					value.bits[i] = *arg[i];
+				arg += len;
+			};
+			load(a, op.len_a);
+			load(b, op.len_b);
+			load(c, op.len_c);
+			load(s, op.len_s);
+
+			if (shared->debug)
+				log("[%s] eval %s (%s)\n", hiername().c_str(), log_id(op.cell), log_id(op.cell->type));
+
+			switch (op.type)
+			{
+			case OP_EVAL_AB: y = CellTypes::eval(op.cell, a, b); break;
+			case OP_EVAL_ABC: y = CellTypes::eval(op.cell, a, b, c); break;
+			case OP_EVAL_AS: y = CellTypes::eval(op.cell, a, s); break;
+			default: y = CellTypes::eval(op.cell, a, b, s); break;
+			}
+
+			for (; out != out_end; out++) {
+				State v = y.bits[out->offset];
+				if (v != State::Sa && *out->state != v) {
+					*out->state = v;
+					if (out->notify)
+						dirty_bits.insert(out->bit);
+				}
+			}
+		}
 	}
 
 	~SimInstance()
@@ -632,10 +1006,20 @@ struct SimInstance
 				if (upd_outports.count(bit) && parent != nullptr)
 					for (auto wire : upd_outports.at(bit))
 						queue_outports.insert(wire);
+
+				if (!compiled_inputs.empty() && compiled_inputs.count(bit))
+					compiled_dirty = true;
 			}
 
 			dirty_bits.clear();
 
+			if (compiled_dirty)
+			{
+				compiled_dirty = false;
+				run_compiled();
+				continue;
+			}
+
 			if (!queue_cells.empty())
 			{
 				for (auto cell : queue_cells)
@@ -650,18 +1034,21 @@ struct SimInstance
 			dirty_memories.clear();
 
 			for (auto wire : queue_outports)
-				if (instance->hasPort(wire->name)) {
-					Const value = get_state(wire);
-					parent->set_state(instance->getPort(wire->name), value);
-				}
+				if (instance->hasPort(wire->name))
+					parent_updates.emplace_back(instance->getPort(wire->name), get_state(wire));
 
 			queue_outports.clear();
 
-			for (auto child : dirty_children)
-				child->update_ph1();
-
+			std::vector<SimInstance*> queue_children(dirty_children.begin(), dirty_children.end());
 			dirty_children.clear();
 
+			run_children(queue_children, [&](int i) { queue_children[i]->update_ph1(); });
+			for (auto child : queue_children) {
+				for (auto &it : child->parent_updates)
+					set_state(it.first, it.second);
+				child->parent_updates.clear();
+			}
+
 			if (dirty_bits.empty())
 				break;
 		}
@@ -780,15 +1167,42 @@ struct SimInstance
 			}
 		}
 
-		for (auto it : children)
-			if (it.second->update_ph2(gclk, stable_past_update)) {
-				dirty_children.insert(it.second);
+		std::vector<SimInstance*> all_children = children_list();
+		std::vector<char> child_changed(GetSize(all_children));
+		run_children(all_children, [&](int i) { child_changed[i] = all_children[i]->update_ph2(gclk, stable_past_update); });
+		for (int i = 0; i < GetSize(all_children); i++)
+			if (child_changed[i]) {
+				dirty_children.insert(all_children[i]);
 				did_something = true;
 			}
 
 		return did_something;
 	}
 
+	std::vector<SimInstance*> children_list()
+	{
+		std::vector<SimInstance*> result;
+		for (auto &it : children)
+			result.push_back(it.second);
+		return result;
+	}
+
+	// Calls fn for each child in the list, on up to "sim -threads" threads.
+	// The log output of the children is replayed in order afterwards.
+	void run_children(const std::vector<SimInstance*> &list, const std::function<void(int)> &fn)
+	{
+		int num_threads = yosys_in_worker_thread() ? 1 : std::min(shared->threads, GetSize(list));
+		if (num_threads <= 1) {
+			for (int i = 0; i < GetSize(list); i++)
+				fn(i);
+			return;
+		}
+
+		ThreadPool::run_captured(GetSize(list), fn, num_threads, [&](int i) {
+			list[i]->flush_memory_addrs();
+		});
+	}
+
 	static void log_source(RTLIL::AttrObject *src)
 	{
 		for (auto src : src->get_strpool_attribute(ID::src))
@@ -814,6 +1228,14 @@ struct SimInstance
 	}
 
 	void update_ph3(bool gclk_trigger)
+	{
+		update_ph3_past();
+		update_ph3_checks(gclk_trigger);
+	}
+
+	// Samples the values for the next edge detection. This only writes the
+	// state of the instance itself, so the children can run in parallel.
+	void update_ph3_past()
 	{
 		for (auto &it : ff_database)
 		{
@@ -848,6 +1270,13 @@ struct SimInstance
 			}
 		}
 
+		std::vector<SimInstance*> all_children = children_list();
+		run_children(all_children, [&](int i) { all_children[i]->update_ph3_past(); });
+	}
+
+	// Runs the prints and formal cells, always in hierarchy order.
+	void update_ph3_checks(bool gclk_trigger)
+	{
 		// Do prints *before* assertions
 		for (auto &print : print_database) {
 			Cell *cell = print.cell;
@@ -936,7 +1365,7 @@ struct SimInstance
 		}
 
 		for (auto it : children)
-			it.second->update_ph3(gclk_trigger);
+			it.second->update_ph3_checks(gclk_trigger);
 	}
 
 	void set_initstate_outputs(State state)
@@ -1088,6 +1517,13 @@ struct SimInstance
 
 	void register_memory_addr(IdString memid, int addr)
 	{
+		// output ids are shared by all instances, they are assigned once the
+		// worker threads are done
+		if (yosys_in_worker_thread()) {
+			pending_memory_addrs.emplace_back(memid, addr);
+			return;
+		}
+
 		auto &mdb = mem_database.at(memid);
 		auto &mem = *mdb.mem;
 		int index = addr - mem.start_offset;
@@ -1098,19 +1534,29 @@ struct SimInstance
 			return;
 		int output_id = shared->next_output_id++;
 		Const data;
-		if (!shared->output_data.empty()) {
+		if (shared->output_trace.num_steps() > 0) {
 			auto init_it = trace_mem_init_database.find(std::make_pair(memid, addr));
 			if (init_it != trace_mem_init_database.end())
 				data = init_it->second;
 			else
 				data = mem.get_init_data().extract(index * mem.width, mem.width);
-			shared->output_data.front().second.emplace(output_id, data);
+			shared->output_trace.add_first(output_id, data);
 		}
 		trace_mem_database[memid].emplace(index, make_pair(output_id, data));
 
 	}
 
-	void register_output_step_values(std::map<int,Const> *data)
+	void flush_memory_addrs()
+	{
+		std::vector<std::pair<IdString, int>> pending;
+		pending.swap(pending_memory_addrs);
+		for (auto &it : pending)
+			register_memory_addr(it.first, it.second);
+		for (auto child : children)
+			child.second->flush_memory_addrs();
+	}
+
+	void register_output_step_values(OutputTrace *trace)
 	{
 		for (auto &it : signal_database)
 		{
@@ -1121,8 +1567,8 @@ struct SimInstance
 			if (it.second.second == value)
 				continue;
 
-			it.second.second = value;
-			data->emplace(id, value);
+			trace->add(id, value);
+			it.second.second = std::move(value);
 		}
 
 		for (auto &trace_mem : trace_mem_database)
@@ -1140,13 +1586,13 @@ struct SimInstance
 				if (trace_index.second.second == value)
 					continue;
 
-				trace_index.second.second = value;
-				data->emplace(output_id, value);
+				trace->add(output_id, value);
+				trace_index.second.second = std::move(value);
 			}
 		}
 
 		for (auto child : children)
-			child.second->register_output_step_values(data);
+			child.second->register_output_step_values(trace);
 	}
 
 	bool setInitState()
@@ -1199,6 +1645,21 @@ struct SimInstance
 			child.second->addAdditionalInputs();
 	}
 
+	void getFstHandles(std::vector<fstHandle> &handles)
+	{
+		for (auto &item : fst_handles)
+			if (item.second != 0)
+				handles.push_back(item.second);
+		for (auto &item : fst_inputs)
+			handles.push_back(item.second);
+		for (auto &mem : fst_memories)
+			for (auto &item : mem.second)
+				handles.push_back(item.second);
+
+		for (auto child : children)
+			child.second->getFstHandles(handles);
+	}
+
 	bool setInputs()
 	{
 		bool did_something = false;
@@ -1290,6 +1751,9 @@ struct SimWorker : SimShared
 	std::string map_filename;
 	std::string summary_filename;
 	std::string scope;
+	// If set, run() calls this at the falling clock edge of each cycle to
+	// set the other inputs (used to replay a stream of "sim -streams").
+	std::function<void(int)> stimulus;
 
 	~SimWorker()
 	{
@@ -1305,24 +1769,21 @@ struct SimWorker : SimShared
 
 	void register_output_step(int t)
 	{
-		std::map<int,Const> data;
-		top->register_output_step_values(&data);
-		output_data.emplace_back(t, data);
+		output_trace.begin_step(t);
+		top->register_output_step_values(&output_trace);
+		output_trace.end_step();
 	}
 
 	void write_output_files()
 	{
-		std::map<int, bool> use_signal;
-		bool first = ignore_x;
-		for(auto& d : output_data)
+		std::vector<bool> use_signal(next_output_id);
+		OutputTrace::Reader reader(output_trace);
+		for (int step = 0; step < output_trace.num_steps(); step++)
 		{
-			if (first) {
-				for (auto &data : d.second)
-					use_signal[data.first] = !data.second.is_fully_undef();
-				first = false;
+			if (step == 0 && ignore_x) {
+				reader.read_step(step, [&](int id, const Const &value) { use_signal[id] = !value.is_fully_undef(); });
 			} else {
-				for (auto &data : d.second)
-					use_signal[data.first] = true;
+				reader.read_step(step, [&](int id, const Const &) { use_signal[id] = true; });
 			}
 			if (!ignore_x) break;
 		}
@@ -1427,6 +1888,9 @@ struct SimWorker : SimShared
 			set_inports(clock, State::S0);
 			set_inports(clockn, State::S1);
 
+			if (stimulus)
+				stimulus(cycle);
+
 			update(true);
 			register_output_step(10*cycle + 5);
 
@@ -1546,8 +2010,17 @@ struct SimWorker : SimShared
 		log("\n");
 		bool all_samples = fst_clock.empty();
 
+		// only the signals compared or driven by the simulation are decoded
+		std::vector<fstHandle> fst_signals;
+		top->getFstHandles(fst_signals);
+		fst->setProcessMask(fst_signals);
+
+		uint64_t window = window_time / fst->getTimescale();
+		if (window_time != 0 && window == 0)
+			window = 1;
+
 		try {
-			fst->reconstructAllAtTimes(fst_clock, startCount, stopCount, [&](uint64_t time) {
+			fst->beginReconstruct(fst_clock, startCount, stopCount, [&](uint64_t time) {
 				if (verbose)
 					log("Co-simulating %s %d [%lu%s].\n", (all_samples ? "sample" : "cycle"), cycle, (unsigned long)time, fst->getTimescaleString());
 				bool did_something = top->setInputs();
@@ -1572,6 +2045,7 @@ struct SimWorker : SimShared
 				if (time==stopCount)
 					throw fst_end_of_data_exception();
 			});
+			while (fst->reconstructWindow(window)) { }
 		} catch(fst_end_of_data_exception) {
 			// end of data detected
 		}
@@ -2317,13 +2791,85 @@ struct SimWorker : SimShared
 	}
 };
 
+static void append_value_string(std::string &str, const Const &value)
+{
+	for (int i = GetSize(value)-1; i >= 0; i--) {
+		switch (value[i]) {
+			case State::S0: str += '0'; break;
+			case State::S1: str += '1'; break;
+			case State::Sx: str += 'x'; break;
+			default: str += 'z';
+		}
+	}
+}
+
+static std::string output_value_string(const Const &value)
+{
+	std::string str;
+	str.reserve(GetSize(value));
+	append_value_string(str, value);
+	return str;
+}
+
+void OutputWriter::write_values(const std::vector<bool> &use_signal, const std::function<void(int)> &time_change,
+		const std::function<void(int, const std::string &)> &value_change)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	if (worker->threads > 1 && !yosys_in_worker_thread()) {
+		// The values are formatted on one thread and handed to the writer
+		// on the other one, an id of -1 marks a time change.
+		struct item_t { int id, time; std::string value; };
+		SpscQueue<item_t> queue;
+		ThreadPool::run(2, [&](int job) {
+			try {
+				if (job == 0) {
+					const OutputTrace &trace = worker->output_trace;
+					OutputTrace::Reader reader(trace);
+					bool closed = false;
+					for (int step = 0; step < trace.num_steps() && !closed; step++) {
+						closed = !queue.push(item_t{-1, trace.times[step], std::string()});
+						reader.read_step(step, [&](int id, const Const &value) {
+							if (!closed && use_signal.at(id))
+								closed = !queue.push(item_t{id, 0, output_value_string(value)});
+						});
+					}
+					queue.close();
+				} else {
+					item_t item;
+					while (queue.pop(item)) {
+						if (item.id < 0)
+							time_change(item.time);
+						else
+							value_change(item.id, item.value);
+					}
+				}
+			} catch (...) {
+				queue.close();
+				throw;
+			}
+		}, 2);
+		return;
+	}
+#endif
+
+	const OutputTrace &trace = worker->output_trace;
+	OutputTrace::Reader reader(trace);
+	for (int step = 0; step < trace.num_steps(); step++) {
+		time_change(trace.times[step]);
+		reader.read_step(step, [&](int id, const Const &value) {
+			if (use_signal.at(id))
+				value_change(id, output_value_string(value));
+		});
+	}
+}
+
 struct VCDWriter : public OutputWriter
 {
 	VCDWriter(SimWorker *worker, std::string filename) : OutputWriter(worker) {
 		vcdfile.open(filename.c_str());
 	}
 
-	void write(std::map<int, bool> &use_signal) override
+	void write(const std::vector<bool> &use_signal) override
 	{
 		if (!vcdfile.is_open()) return;
 		vcdfile << stringf("$version %s $end\n", worker->date ? yosys_version_str : "Yosys");
@@ -2339,10 +2885,16 @@ struct VCDWriter : public OutputWriter
 		if (!worker->timescale.empty())
 			vcdfile << stringf("$timescale %s $end\n", worker->timescale.c_str());
 
+		// " n<id>\n", the end of each value change line of a signal
+		std::vector<std::string> id_codes(GetSize(use_signal));
+		for (int id = 0; id < GetSize(use_signal); id++)
+			if (use_signal[id])
+				id_codes[id] = " n" + std::to_string(id) + "\n";
+
 		worker->top->write_output_header(
 			[this](IdString name) { vcdfile << stringf("$scope module %s $end\n", log_id(name)); },
 			[this]() { vcdfile << stringf("$upscope $end\n");},
-			[this,use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
+			[this,&use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
 				if (use_signal.at(id)) {
 					// Works around gtkwave trying to parse everything past the last [ in a signal
 					// name. While the emitted range doesn't necessarily match the wire's range,
@@ -2357,25 +2909,28 @@ struct VCDWriter : public OutputWriter
 
 		vcdfile << stringf("$enddefinitions $end\n");
 
-		for(auto& d : worker->output_data)
-		{
-			vcdfile << stringf("#%d\n", d.first);
-			for (auto &data : d.second)
-			{
-				if (!use_signal.at(data.first)) continue;
-				Const value = data.second;
-				vcdfile << "b";
-				for (int i = GetSize(value)-1; i >= 0; i--) {
-					switch (value[i]) {
-						case State::S0: vcdfile << "0"; break;
-						case State::S1: vcdfile << "1"; break;
-						case State::Sx: vcdfile << "x"; break;
-						default: vcdfile << "z";
-					}
-				}
-				vcdfile << stringf(" n%d\n", data.first);
-			}
+		// The value changes are collected in a buffer that is written out
+		// between time steps once it has grown large enough.
+		std::string buf;
+		const OutputTrace &trace = worker->output_trace;
+		OutputTrace::Reader reader(trace);
+		for (int step = 0; step < trace.num_steps(); step++) {
+			if (buf.size() >= 1 << 16) {
+				vcdfile.write(buf.data(), buf.size());
+				buf.clear();
+			}
+			buf += '#';
+			buf += std::to_string(trace.times[step]);
+			buf += '\n';
+			reader.read_step(step, [&](int id, const Const &value) {
+				if (!use_signal[id])
+					return;
+				buf += 'b';
+				append_value_string(buf, value);
+				buf += id_codes[id];
+			});
 		}
+		vcdfile.write(buf.data(), buf.size());
 	}
 
 	std::ofstream vcdfile;
@@ -2392,7 +2947,7 @@ struct FSTWriter : public OutputWriter
 		fstWriterClose(fstfile);
 	}
 
-	void write(std::map<int, bool> &use_signal) override
+	void write(const std::vector<bool> &use_signal) override
 	{
 		if (!fstfile) return;
 		std::time_t t = std::time(nullptr);
@@ -2406,41 +2961,32 @@ struct FSTWriter : public OutputWriter
 
 		fstWriterSetPackType(fstfile, FST_WR_PT_FASTLZ);
 		fstWriterSetRepackOnClose(fstfile, 1);
-	   
-	   	worker->top->write_output_header(
+#if defined(YOSYS_ENABLE_THREADS) && !defined(_MSC_VER)
+		// same condition as FST_WRITER_PARALLEL in libs/fst/config.h
+		if (worker->threads > 1)
+			fstWriterSetParallelMode(fstfile, 1);
+#endif
+
+		mapping.resize(GetSize(use_signal));
+		worker->top->write_output_header(
 			[this](IdString name) { fstWriterSetScope(fstfile, FST_ST_VCD_MODULE, stringf("%s",log_id(name)).c_str(), nullptr); },
 			[this]() { fstWriterSetUpscope(fstfile); },
-			[this,use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
+			[this,&use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
 				if (!use_signal.at(id)) return;
 				fstHandle fst_id = fstWriterCreateVar(fstfile, is_reg ? FST_VT_VCD_REG : FST_VT_VCD_WIRE, FST_VD_IMPLICIT, size,
 												name, 0);
-				mapping.emplace(id, fst_id);
+				mapping[id] = fst_id;
 			}
 		);
 
-		for(auto& d : worker->output_data)
-		{
-			fstWriterEmitTimeChange(fstfile, d.first);
-			for (auto &data : d.second)
-			{
-				if (!use_signal.at(data.first)) continue;
-				Const value = data.second;
-				std::stringstream ss;
-				for (int i = GetSize(value)-1; i >= 0; i--) {
-					switch (value[i]) {
-						case State::S0: ss << "0"; break;
-						case State::S1: ss << "1"; break;
-						case State::Sx: ss << "x"; break;
-						default: ss << "z";
-					}
-				}
-				fstWriterEmitValueChange(fstfile, mapping[data.first], ss.str().c_str());
-			}
-		}
+		write_values(use_signal,
+			[this](int time) { fstWriterEmitTimeChange(fstfile, time); },
+			[this](int id, const std::string &value) { fstWriterEmitValueChange(fstfile, mapping[id], value.c_str()); }
+		);
 	}
 
 	struct fstContext *fstfile = nullptr;
-	std::map<int,fstHandle> mapping;
+	std::vector<fstHandle> mapping;
 };
 
 struct AIWWriter : public OutputWriter
@@ -2454,7 +3000,7 @@ struct AIWWriter : public OutputWriter
 		aiwfile << '.' << '\n';
 	}
 
-	void write(std::map<int, bool> &) override
+	void write(const std::vector<bool> &) override
 	{
 		if (!aiwfile.is_open()) return;
 		if (worker->map_filename.empty())
@@ -2500,13 +3046,13 @@ struct AIWWriter : public OutputWriter
 
 		std::map<int, Yosys::RTLIL::Const> current;
 		bool first = true;
-		for (auto iter = worker->output_data.begin(); iter != std::prev(worker->output_data.end()); ++iter)
+		const OutputTrace &trace = worker->output_trace;
+		OutputTrace::Reader reader(trace);
+		for (int step = 0; step + 1 < trace.num_steps(); step++)
 		{
-			auto& d = *iter;
-			for (auto &data : d.second)
-			{
-				current[data.first] = data.second;
-			}
+			reader.read_step(step, [&](int id, const Const &value) {
+				current[id] = value;
+			});
 			if (first) {
 				for (int i = 0;; i++)
 				{
@@ -2564,6 +3110,369 @@ struct AIWWriter : public OutputWriter
 	std::map<Wire*,int> mapping;
 };
 
+// Generates the input values of the streams of one word for "sim -streams",
+// a xorshift64* generator seeded with splitmix64 so that the sequence of
+// each word only depends on the seed and the word index.
+struct stream_rng_t
+{
+	uint64_t state;
+
+	stream_rng_t(uint64_t seed, int word)
+	{
+		uint64_t z = seed + uint64_t(word + 1) * 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z ^= z >> 31;
+		state = z != 0 ? z : 1;
+	}
+
+	uint64_t next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545f4914f6cdd1dull;
+	}
+};
+
+// Simulates many independent streams of random input values at once for
+// "sim -streams". Each stream is a bit position in the machine words of
+// a ConstEvalVec, so that a word of 64 streams is evaluated with the same
+// operations as a single stream, and groups of words are simulated on the
+// "sim -threads" threads. A cycle is evaluated like in SimWorker::run():
+// the inputs are set at the falling clock edge and the flip-flops of the
+// -clock and -clockn ports are updated at the rising edge, the assertions
+// are checked after both edges. Only the first failure of each stream is
+// kept, replay() simulates a single stream with the regular engine.
+struct SimStreams
+{
+	struct failure_t
+	{
+		int stream, cycle;
+		Cell *cell;
+
+		bool operator<(const failure_t &other) const { return stream < other.stream; }
+	};
+
+	struct ff_t
+	{
+		FfData data;
+		// offsets of the bits in q_sig and next_sig, -1 if not used
+		int q, d, ce, srst;
+	};
+
+	SimWorker *worker;
+	Module *module;
+	SigMap sigmap;
+	int num_cycles;
+	uint64_t seed;
+
+	// the input bits set to random values, in the order the values are drawn
+	std::vector<Wire*> stim_wires;
+	SigSpec stim_sig;
+	SigSpec reset_sig, reset_off, clock_sig, clock_low, initstate_sig, undriven_sig;
+	std::vector<ff_t> ffs;
+	SigSpec q_sig, next_sig;
+	std::vector<uint64_t> q_init;
+	std::vector<Cell*> asserts;
+	// the A and EN inputs of each assertion
+	SigSpec check_sig;
+
+	SimStreams(SimWorker *worker, Module *module, int num_cycles, uint64_t seed) :
+			worker(worker), module(module), sigmap(module), num_cycles(num_cycles), seed(seed)
+	{
+		for (auto cell : module->cells())
+			if (module->design->module(cell->type) != nullptr)
+				log_cmd_error("sim -streams requires a flattened design, found instance %s of module %s.\n",
+						log_id(cell), log_id(cell->type));
+
+		pool<IdString> clock_ports, reset_ports;
+		pool<SigBit> rising_clocks, falling_clocks;
+		auto port_wire = [&](IdString name) {
+			Wire *wire = module->wire(name);
+			if (wire == nullptr || !wire->port_input)
+				log_error("Can't find input port %s on module %s.\n", log_id(name), log_id(module));
+			return wire;
+		};
+		for (auto name : worker->clock) {
+			Wire *wire = port_wire(name);
+			clock_sig.append(wire);
+			clock_low.append(Const(State::S0, wire->width));
+			for (auto bit : sigmap(wire))
+				rising_clocks.insert(bit);
+			clock_ports.insert(name);
+		}
+		for (auto name : worker->clockn) {
+			Wire *wire = port_wire(name);
+			clock_sig.append(wire);
+			clock_low.append(Const(State::S1, wire->width));
+			for (auto bit : sigmap(wire))
+				falling_clocks.insert(bit);
+			clock_ports.insert(name);
+		}
+		for (auto name : worker->reset) {
+			Wire *wire = port_wire(name);
+			reset_sig.append(wire);
+			reset_off.append(Const(State::S0, wire->width));
+			reset_ports.insert(name);
+		}
+		for (auto name : worker->resetn) {
+			Wire *wire = port_wire(name);
+			reset_sig.append(wire);
+			reset_off.append(Const(State::S1, wire->width));
+			reset_ports.insert(name);
+		}
+
+		for (auto port : module->ports) {
+			Wire *wire = module->wire(port);
+			if (wire->port_input && !clock_ports.count(port) && !reset_ports.count(port)) {
+				stim_wires.push_back(wire);
+				stim_sig.append(wire);
+			}
+		}
+
+		FfInitVals initvals(&sigmap, module);
+		for (auto cell : module->cells())
+		{
+			if (cell->type.in(ID($assert), ID($assume), ID($cover), ID($print), ID($scopeinfo))) {
+				if (cell->type == ID($assert)) {
+					asserts.push_back(cell);
+					check_sig.append(cell->getPort(ID::A));
+					check_sig.append(cell->getPort(ID::EN));
+				}
+				continue;
+			}
+			if (cell->type == ID($initstate)) {
+				initstate_sig.append(cell->getPort(ID::Y));
+				continue;
+			}
+			if (cell->is_mem_cell() || cell->type.in(ID($anyconst), ID($anyseq), ID($allconst), ID($allseq), ID($anyinit)))
+				log_cmd_error("sim -streams does not support cell %s of type %s.\n", log_id(cell), log_id(cell->type));
+			if (!RTLIL::builtin_ff_cell_types().count(cell->type))
+				continue;
+
+			ff_t ff;
+			ff.data = FfData(&initvals, cell);
+			bool clocked = ff.data.has_clk && (ff.data.pol_clk ? rising_clocks : falling_clocks).count(sigmap(ff.data.sig_clk));
+			if (!clocked || ff.data.has_aload || ff.data.has_arst || ff.data.has_sr || ff.data.has_gclk)
+				log_cmd_error("sim -streams only supports flip-flops that are clocked by the rising edge of a -clock port or the falling edge of a -clockn port and that have no asynchronous (re)set, cell %s is not.\n",
+						log_id(cell));
+
+			ff.q = GetSize(q_sig);
+			q_sig.append(ff.data.sig_q);
+			for (auto bit : ff.data.val_init.bits)
+				q_init.push_back(bit == State::S1 ? ~uint64_t(0) : 0);
+			ff.d = GetSize(next_sig);
+			next_sig.append(ff.data.sig_d);
+			ff.ce = ff.data.has_ce ? GetSize(next_sig) : -1;
+			if (ff.data.has_ce)
+				next_sig.append(ff.data.sig_ce);
+			ff.srst = ff.data.has_srst ? GetSize(next_sig) : -1;
+			if (ff.data.has_srst)
+				next_sig.append(ff.data.sig_srst);
+			ffs.push_back(ff);
+		}
+
+		find_undriven();
+	}
+
+	// Nets that are not driven by a cell or an input are undefined in the
+	// regular simulation, they are 0 in all streams.
+	void find_undriven()
+	{
+		ConstEvalVec ce(module, 1);
+		SigSpec sig = check_sig;
+		sig.append(next_sig);
+		for (int iter = 0;; iter++)
+		{
+			ce.clear();
+			set_values(ce, 0, std::vector<uint64_t>(GetSize(stim_sig)), std::vector<uint64_t>(GetSize(q_sig)), false, false);
+			std::vector<uint64_t> result;
+			SigSpec undef;
+			if (ce.eval(sig, result, undef))
+				break;
+			if (iter > GetSize(sig))
+				log_cmd_error("sim -streams can't evaluate %s, is there a combinational loop?\n", log_signal(undef));
+			undef.sort_and_unify();
+			undriven_sig.append(undef);
+		}
+		if (!undriven_sig.empty())
+			log_warning("sim -streams: %d undriven bits are 0 in all streams: %s\n", GetSize(undriven_sig), log_signal(undriven_sig));
+	}
+
+	// Sets the inputs, the flip-flop outputs and the special signals of
+	// a cycle, the values hold num_words words for each bit.
+	void set_values(ConstEvalVec &ce, int cycle, const std::vector<uint64_t> &stim, const std::vector<uint64_t> &q, bool rising, bool initstate)
+	{
+		int nw = ce.num_words;
+		if (!stim_sig.empty())
+			ce.set(stim_sig, stim);
+		if (!q_sig.empty())
+			ce.set(q_sig, q);
+		if (!undriven_sig.empty())
+			ce.set(undriven_sig, std::vector<uint64_t>(GetSize(undriven_sig) * nw));
+		if (!initstate_sig.empty())
+			ce.set(initstate_sig, std::vector<uint64_t>(GetSize(initstate_sig) * nw, initstate ? ~uint64_t(0) : 0));
+
+		// the reset is released together with the rising clock edge at the
+		// end of cycle rstlen-1
+		bool reset = cycle + (rising ? 1 : 0) < worker->rstlen;
+		std::vector<uint64_t> words;
+		for (int i = 0; i < GetSize(reset_sig); i++)
+			words.insert(words.end(), nw, (reset_off[i] == State::S1) != reset ? ~uint64_t(0) : 0);
+		if (!reset_sig.empty())
+			ce.set(reset_sig, words);
+		words.clear();
+		for (int i = 0; i < GetSize(clock_sig); i++)
+			words.insert(words.end(), nw, (clock_low[i] == State::S1) != rising ? ~uint64_t(0) : 0);
+		if (!clock_sig.empty())
+			ce.set(clock_sig, words);
+	}
+
+	// Adds the first failing assertion of the streams in failed_mask.
+	void check(ConstEvalVec &ce, int first_word, int cycle, std::vector<uint64_t> &failed_mask, std::vector<failure_t> &failures)
+	{
+		if (asserts.empty())
+			return;
+		int nw = ce.num_words;
+		std::vector<uint64_t> result;
+		ce.eval(check_sig, result);
+		for (int i = 0; i < GetSize(asserts); i++) {
+			const uint64_t *a = result.data() + 2 * i * nw, *en = a + nw;
+			for (int w = 0; w < nw; w++) {
+				uint64_t fail = en[w] & ~a[w] & ~failed_mask[w];
+				if (fail == 0)
+					continue;
+				failed_mask[w] |= fail;
+				for (int bit = 0; bit < 64; bit++)
+					if ((fail >> bit) & 1)
+						failures.push_back({64 * (first_word + w) + bit, cycle, asserts[i]});
+			}
+		}
+	}
+
+	// Simulates the streams of the words first_word .. first_word+num_words-1,
+	// the bits of the streams past num_streams are set in failed_mask.
+	void run_words(int first_word, std::vector<uint64_t> failed_mask, std::vector<failure_t> &failures)
+	{
+		int nw = GetSize(failed_mask);
+		ConstEvalVec ce(module, nw);
+		std::vector<stream_rng_t> rngs;
+		for (int w = 0; w < nw; w++)
+			rngs.emplace_back(seed, first_word + w);
+
+		std::vector<uint64_t> q(GetSize(q_sig) * nw), next_q(GetSize(q_sig) * nw), stim(GetSize(stim_sig) * nw), result;
+		for (int i = 0; i < GetSize(q_sig); i++)
+			std::fill(q.begin() + i * nw, q.begin() + (i+1) * nw, q_init[i]);
+
+		for (int cycle = 0; cycle < num_cycles; cycle++)
+		{
+			bool done = true;
+			for (auto mask : failed_mask)
+				if (mask != ~uint64_t(0))
+					done = false;
+			if (done)
+				break;
+
+			for (int i = 0; i < GetSize(stim_sig); i++)
+				for (int w = 0; w < nw; w++)
+					stim[i * nw + w] = rngs[w].next();
+
+			// falling edge
+			ce.clear();
+			set_values(ce, cycle, stim, q, false, cycle == 0 && worker->initstate);
+			check(ce, first_word, cycle, failed_mask, failures);
+			if (!next_sig.empty())
+				ce.eval(next_sig, result);
+
+			for (auto &ff : ffs)
+			for (int i = 0; i < ff.data.width; i++)
+			for (int w = 0; w < nw; w++) {
+				uint64_t value = result[(ff.d + i) * nw + w];
+				uint64_t old = q[(ff.q + i) * nw + w];
+				uint64_t en = ~uint64_t(0);
+				if (ff.ce >= 0) {
+					en = result[ff.ce * nw + w];
+					if (!ff.data.pol_ce)
+						en = ~en;
+				}
+				value = (value & en) | (old & ~en);
+				if (ff.srst >= 0) {
+					uint64_t rst = result[ff.srst * nw + w];
+					if (!ff.data.pol_srst)
+						rst = ~rst;
+					if (ff.data.ce_over_srst)
+						rst &= en;
+					uint64_t rst_value = ff.data.val_srst.bits[i] == State::S1 ? ~uint64_t(0) : 0;
+					value = (rst_value & rst) | (value & ~rst);
+				}
+				next_q[(ff.q + i) * nw + w] = value;
+			}
+			q.swap(next_q);
+
+			// rising edge
+			if (!asserts.empty()) {
+				ce.clear();
+				set_values(ce, cycle, stim, q, true, false);
+				check(ce, first_word, cycle, failed_mask, failures);
+			}
+		}
+	}
+
+	std::vector<failure_t> run(int num_streams)
+	{
+		int num_words = (num_streams + 63) / 64;
+		int num_threads = yosys_in_worker_thread() ? 1 : std::min(worker->threads, num_words);
+		// at most 8 words per ConstEvalVec, more only add to its working set
+		int job_words = std::min(8, (num_words + num_threads - 1) / num_threads);
+		int num_jobs = (num_words + job_words - 1) / job_words;
+
+		std::vector<std::vector<failure_t>> job_failures(num_jobs);
+		auto job = [&](int j) {
+			int first_word = j * job_words;
+			std::vector<uint64_t> failed_mask(std::min(job_words, num_words - first_word));
+			for (int w = 0; w < GetSize(failed_mask); w++) {
+				int valid = std::min(64, num_streams - 64 * (first_word + w));
+				if (valid < 64)
+					failed_mask[w] = ~uint64_t(0) << valid;
+			}
+			run_words(first_word, failed_mask, job_failures[j]);
+		};
+
+		ThreadPool::run(num_jobs, job, num_threads);
+
+		std::vector<failure_t> failures;
+		for (auto &it : job_failures)
+			failures.insert(failures.end(), it.begin(), it.end());
+		std::sort(failures.begin(), failures.end());
+		return failures;
+	}
+
+	// Simulates a stream with the regular engine of the worker, writing the
+	// usual output files.
+	void replay(int stream)
+	{
+		stream_rng_t rng(seed, stream / 64);
+		std::vector<std::vector<Const>> values(num_cycles);
+		for (int cycle = 0; cycle < num_cycles; cycle++)
+			for (auto wire : stim_wires) {
+				Const value(State::S0, wire->width);
+				for (auto &bit : value.bits)
+					if ((rng.next() >> (stream % 64)) & 1)
+						bit = State::S1;
+				values[cycle].push_back(value);
+			}
+
+		worker->zinit = true;
+		worker->stimulus = [&](int cycle) {
+			for (int i = 0; i < GetSize(stim_wires); i++)
+				worker->top->set_state(stim_wires[i], values[cycle][i]);
+		};
+		worker->run(module, num_cycles);
+		worker->stimulus = nullptr;
+	}
+};
+
 struct SimPass : public Pass {
 	SimPass() : Pass("sim", "simulate the circuit") { }
 	void help() override
@@ -2656,6 +3565,10 @@ struct SimPass : public Pass {
 		log("    -stop <time>\n");
 		log("        stop co-simulation in arbitary time (default END)\n");
 		log("\n");
+		log("    -window <time>\n");
+		log("        read the FST input file in slices of the given duration instead\n");
+		log("        of a single pass, to limit memory use on long traces\n");
+		log("\n");
 		log("    -sim\n");
 		log("        simulation with stimulus from FST (default)\n");
 		log("\n");
@@ -2678,6 +3591,36 @@ struct SimPass : public Pass {
 		log("    -d\n");
 		log("        enable debug output\n");
 		log("\n");
+		log("    -threads <N>\n");
+		log("        update independent instances of the hierarchy on up to N threads\n");
+		log("        in parallel. all instances finish a simulation phase before the\n");
+		log("        next one starts. the log output is the same as with a single thread.\n");
+		log("\n");
+		log("    -compiled\n");
+		log("        evaluate the combinational cells of each module in topological order\n");
+		log("        on a precomputed list of operations instead of scheduling them one\n");
+		log("        by one as their inputs change. recommended for larger designs.\n");
+		log("\n");
+		log("    -streams <N>\n");
+		log("        simulate N independent streams of random values on the inputs other\n");
+		log("        than the -clock and -reset ports for -n cycles, and report the streams\n");
+		log("        in which an assertion fails. the streams are evaluated bit-parallel,\n");
+		log("        64 in each machine word, on up to -threads threads. only the first\n");
+		log("        failing stream is then simulated with the regular engine, which writes\n");
+		log("        the -vcd/-fst/-summary files and fails with -assert. this requires a\n");
+		log("        flattened design without memories whose flip-flops are clocked by the\n");
+		log("        -clock/-clockn ports and have no asynchronous (re)set. all streams are\n");
+		log("        two-valued, registers without init value start at 0 as with -zinit\n");
+		log("        and undriven nets are 0.\n");
+		log("\n");
+		log("    -seed <N>\n");
+		log("        seed of the random values of -streams (default: 1)\n");
+		log("\n");
+		log("    -replay <index>\n");
+		log("        simulate only the stream with the given index of -streams (using the\n");
+		log("        same -seed) with the regular engine, e.g. to write the trace of\n");
+		log("        another failing stream.\n");
+		log("\n");
 	}
 
 
@@ -2692,6 +3635,8 @@ struct SimPass : public Pass {
 		int numcycles = 20;
 		int append = 0;
 		bool start_set = false, stop_set = false, at_set = false;
+		int num_streams = 0, replay_stream = -1;
+		uint64_t seed = 1;
 
 		log_header(design, "Executing SIM pass (simulate the circuit).\n");
 
@@ -2814,6 +3759,30 @@ struct SimPass : public Pass {
 				at_set = true;
 				continue;
 			}
+			if (args[argidx] == "-window" && argidx+1 < args.size()) {
+				worker.window_time = stringToTime(args[++argidx]);
+				continue;
+			}
+			if (args[argidx] == "-threads" && argidx+1 < args.size()) {
+				worker.threads = std::max(1, atoi(args[++argidx].c_str()));
+				continue;
+			}
+			if (args[argidx] == "-compiled") {
+				worker.compiled = true;
+				continue;
+			}
+			if (args[argidx] == "-streams" && argidx+1 < args.size()) {
+				num_streams = std::max(1, atoi(args[++argidx].c_str()));
+				continue;
+			}
+			if (args[argidx] == "-seed" && argidx+1 < args.size()) {
+				seed = strtoull(args[++argidx].c_str(), nullptr, 0);
+				continue;
+			}
+			if (args[argidx] == "-replay" && argidx+1 < args.size()) {
+				replay_stream = std::max(0, atoi(args[++argidx].c_str()));
+				continue;
+			}
 			if (args[argidx] == "-sim") {
 				worker.sim_mode = SimulationMode::sim;
 				continue;
@@ -2868,7 +3837,40 @@ struct SimPass : public Pass {
 			top_mod = mods.front();
 		}
 
-		if (worker.sim_filename.empty())
+		if (num_streams > 0 || replay_stream >= 0)
+		{
+			if (!worker.sim_filename.empty())
+				log_cmd_error("The -streams and -replay options can't be used with -r.\n");
+
+			SimStreams streams(&worker, top_mod, numcycles, seed);
+			if (num_streams > 0)
+			{
+				auto start = std::chrono::steady_clock::now();
+				auto failures = streams.run(num_streams);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				log("Simulated %d streams for %d cycles in %.2f seconds (%.0f stream cycles per second).\n",
+						num_streams, numcycles, seconds, double(num_streams) * numcycles / std::max(seconds, 1e-9));
+
+				for (int i = 0; i < GetSize(failures) && i < 10; i++) {
+					Cell *cell = failures[i].cell;
+					string label = log_id(cell);
+					if (cell->attributes.count(ID::src))
+						label = cell->attributes.at(ID::src).decode_string();
+					log("Stream %d failed assertion %s (%s) in cycle %d.\n", failures[i].stream, log_id(cell), label.c_str(), failures[i].cycle);
+				}
+				if (GetSize(failures) > 10)
+					log("... and %d more failing streams.\n", GetSize(failures) - 10);
+				log("%d of %d streams failed.\n", GetSize(failures), num_streams);
+
+				if (replay_stream < 0 && !failures.empty())
+					replay_stream = failures.front().stream;
+			}
+			if (replay_stream >= 0) {
+				log("Simulating stream %d.\n", replay_stream);
+				streams.replay(replay_stream);
+			}
+		}
+		else if (worker.sim_filename.empty())
 			worker.run(top_mod, numcycles);
 		else {
 			std::string filename_trim = file_base_name(worker.sim_filename);
@@ -65,6 +65,8 @@
 #include "kernel/ff.h"
 #include "kernel/cost.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -82,6 +84,8 @@
 #endif
 
 #include "frontends/blif/blifparse.h"
+#include "backends/blif/blif.h"
+#include "passes/techmap/abc_cache.h"
 
 #ifdef YOSYS_LINK_ABC
 namespace abc {
@@ -127,6 +131,30 @@ struct gate_t
 	RTLIL::State init;
 };
 
+// Returns the BLIF cover of a combinational gate, the inputs are in1 .. in4
+const char *gate_cover(gate_type_t type, int &num_inputs)
+{
+	switch (type) {
+	case G(BUF):    num_inputs = 1; return "1 1\n";
+	case G(NOT):    num_inputs = 1; return "0 1\n";
+	case G(AND):    num_inputs = 2; return "11 1\n";
+	case G(NAND):   num_inputs = 2; return "0- 1\n-0 1\n";
+	case G(OR):     num_inputs = 2; return "-1 1\n1- 1\n";
+	case G(NOR):    num_inputs = 2; return "00 1\n";
+	case G(XOR):    num_inputs = 2; return "01 1\n10 1\n";
+	case G(XNOR):   num_inputs = 2; return "00 1\n11 1\n";
+	case G(ANDNOT): num_inputs = 2; return "10 1\n";
+	case G(ORNOT):  num_inputs = 2; return "1- 1\n-0 1\n";
+	case G(MUX):    num_inputs = 3; return "1-0 1\n-11 1\n";
+	case G(NMUX):   num_inputs = 3; return "0-0 1\n-01 1\n";
+	case G(AOI3):   num_inputs = 3; return "-00 1\n0-0 1\n";
+	case G(OAI3):   num_inputs = 3; return "00- 1\n--0 1\n";
+	case G(AOI4):   num_inputs = 4; return "-0-0 1\n-00- 1\n0--0 1\n0-0- 1\n";
+	case G(OAI4):   num_inputs = 4; return "00-- 1\n--00 1\n";
+	default:        log_abort();
+	}
+}
+
 bool map_mux4;
 bool map_mux8;
 bool map_mux16;
@@ -142,12 +170,63 @@ pool<std::string> enabled_gates;
 bool cmos_cost;
 bool had_init;
 
+// -cache and -dispatch, only read by abc_module_run()
+std::string cache_dir, dispatch_cmd;
+
 bool clk_polarity, en_polarity, arst_polarity, srst_polarity,en_over_srst;
 RTLIL::SigSpec clk_sig, en_sig, arst_sig, srst_sig;
 dict<int, std::string> pi_map, po_map;
 
 int undef_bits_lost;
 
+// port bits of the partitions of the current module that were extracted
+// before, their cells are no longer in the module when the next one is
+pool<RTLIL::SigBit> partition_port_bits;
+
+// The per-partition part of the state above, saved between netlist
+// extraction and re-integration so that ABC can run for several
+// partitions at the same time.
+struct abc_job_t
+{
+	RTLIL::Module *module = nullptr;
+	int map_autoidx = 0;
+	std::vector<gate_t> signal_list;
+	dict<RTLIL::SigBit, int> signal_map;
+	dict<int, std::string> pi_map, po_map;
+	bool clk_polarity = true, en_polarity = true, arst_polarity = true, srst_polarity = true;
+	bool en_over_srst = false, had_init = false;
+	RTLIL::SigSpec clk_sig, en_sig, arst_sig, srst_sig;
+
+	std::string tempdir_name;
+	std::string abc_command; // empty if there is nothing to map
+	std::vector<std::string> cache_files; // everything ABC reads, for -cache
+	bool cache_hit = false;
+	int abc_ret = 0;
+	float abc_time = 0;
+	LogCapture abc_log;
+};
+
+// exchanges the job with the global state
+void swap_job_state(abc_job_t &job)
+{
+	std::swap(module, job.module);
+	std::swap(map_autoidx, job.map_autoidx);
+	signal_list.swap(job.signal_list);
+	signal_map.swap(job.signal_map);
+	pi_map.swap(job.pi_map);
+	po_map.swap(job.po_map);
+	std::swap(clk_polarity, job.clk_polarity);
+	std::swap(en_polarity, job.en_polarity);
+	std::swap(arst_polarity, job.arst_polarity);
+	std::swap(srst_polarity, job.srst_polarity);
+	std::swap(en_over_srst, job.en_over_srst);
+	std::swap(had_init, job.had_init);
+	std::swap(clk_sig, job.clk_sig);
+	std::swap(en_sig, job.en_sig);
+	std::swap(arst_sig, job.arst_sig);
+	std::swap(srst_sig, job.srst_sig);
+}
+
 int map_signal(RTLIL::SigBit bit, gate_type_t gate_type = G(NONE), int in1 = -1, int in2 = -1, int in3 = -1, int in4 = -1)
 {
 	assign_map.apply(bit);
@@ -674,8 +753,10 @@ struct abc_output_filter
 	std::string linebuf;
 	std::string tempdir_name;
 	bool show_tempdir;
+	const dict<int, std::string> &pi_map, &po_map;
 
-	abc_output_filter(std::string tempdir_name, bool show_tempdir) : tempdir_name(tempdir_name), show_tempdir(show_tempdir)
+	abc_output_filter(std::string tempdir_name, bool show_tempdir, const dict<int, std::string> &pi_map, const dict<int, std::string> &po_map) :
+			tempdir_name(tempdir_name), show_tempdir(show_tempdir), pi_map(pi_map), po_map(po_map)
 	{
 		got_cr = false;
 		escape_seq_state = 0;
@@ -735,11 +816,77 @@ struct abc_output_filter
 	}
 };
 
-void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::string script_file, std::string exe_file,
-		std::vector<std::string> &liberty_files, std::vector<std::string> &genlib_files, std::string constr_file,
-		bool cleanup, vector<int> lut_costs, bool dff_mode, std::string clk_str, bool keepff, std::string delay_target,
+void write_input_blif(std::string filename)
+{
+	FILE *f = fopen(filename.c_str(), "wt");
+	if (f == nullptr)
+		log_error("Opening %s for writing failed: %s\n", filename.c_str(), strerror(errno));
+
+	BlifWriter w;
+	w.number_nets("ys__n", GetSize(signal_list));
+	w << ".model netlist\n";
+
+	int count_input = 0;
+	w << ".inputs";
+	for (auto &si : signal_list) {
+		if (!si.is_port || si.type != G(NONE))
+			continue;
+		w << ' ' << w.net(si.id);
+		count_input++;
+	}
+	if (count_input == 0)
+		w << " dummy_input\n";
+	w << '\n';
+
+	w << ".outputs";
+	for (auto &si : signal_list) {
+		if (!si.is_port || si.type == G(NONE))
+			continue;
+		w << ' ' << w.net(si.id);
+	}
+	w << '\n';
+
+	for (auto &si : signal_list)
+		w << stringf("# ys__n%-5d %s\n", si.id, log_signal(si.bit));
+
+	for (auto &si : signal_list) {
+		if (si.bit.wire == nullptr) {
+			w << ".names " << w.net(si.id) << '\n';
+			if (si.bit == RTLIL::State::S1)
+				w << "1\n";
+		}
+	}
+
+	for (auto &si : signal_list) {
+		if (si.type == G(NONE))
+			continue;
+		if (si.type == G(FF)) {
+			w << ".latch " << w.net(si.in1) << ' ' << w.net(si.id) << " 2\n";
+		} else if (si.type == G(FF0)) {
+			w << ".latch " << w.net(si.in1) << ' ' << w.net(si.id) << " 0\n";
+		} else if (si.type == G(FF1)) {
+			w << ".latch " << w.net(si.in1) << ' ' << w.net(si.id) << " 1\n";
+		} else {
+			int num_inputs;
+			const char *cover = gate_cover(si.type, num_inputs);
+			int inputs[4] = {si.in1, si.in2, si.in3, si.in4};
+			w.names(inputs, num_inputs, si.id, cover);
+		}
+	}
+
+	w << ".end\n";
+	w.write(f);
+	fclose(f);
+}
+
+// Extracts the netlist of the given cells and prepares the files and the
+// command for ABC. The state needed for re-integration is saved in the job.
+void abc_module_extract(RTLIL::Design *design, RTLIL::Module *current_module, std::string script_file, std::string exe_file,
+		std::vector<std::string> &liberty_files, std::vector<std::string> &genlib_files, std::string constr_file, bool cleanup,
+		vector<int> lut_costs, bool dff_mode, std::string clk_str, bool keepff, std::string delay_target,
 		std::string sop_inputs, std::string sop_products, std::string lutin_shared, bool fast_mode, std::string dfl_arg,
-		const std::vector<RTLIL::Cell*> &cells, bool show_tempdir, bool sop_mode, bool abc_dress, std::vector<std::string> &dont_use_cells)
+		const std::vector<RTLIL::Cell*> &cells, bool show_tempdir, bool sop_mode, bool abc_dress, std::vector<std::string> &dont_use_cells,
+		abc_job_t &job)
 {
 	module = current_module;
 	map_autoidx = autoidx++;
@@ -960,137 +1107,36 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
 	if (srst_sig.size() != 0)
 		mark_port(srst_sig);
 
-	handle_loops();
-
-	buffer = stringf("%s/input.blif", tempdir_name.c_str());
-	f = fopen(buffer.c_str(), "wt");
-	if (f == nullptr)
-		log_error("Opening %s for writing failed: %s\n", buffer.c_str(), strerror(errno));
-
-	fprintf(f, ".model netlist\n");
-
-	int count_input = 0;
-	fprintf(f, ".inputs");
-	for (auto &si : signal_list) {
-		if (!si.is_port || si.type != G(NONE))
-			continue;
-		fprintf(f, " ys__n%d", si.id);
-		pi_map[count_input++] = log_signal(si.bit);
-	}
-	if (count_input == 0)
-		fprintf(f, " dummy_input\n");
-	fprintf(f, "\n");
+	for (auto &si : signal_list)
+		if (partition_port_bits.count(si.bit))
+			si.is_port = true;
 
-	int count_output = 0;
-	fprintf(f, ".outputs");
-	for (auto &si : signal_list) {
-		if (!si.is_port || si.type == G(NONE))
-			continue;
-		fprintf(f, " ys__n%d", si.id);
-		po_map[count_output++] = log_signal(si.bit);
-	}
-	fprintf(f, "\n");
+	handle_loops();
 
 	for (auto &si : signal_list)
-		fprintf(f, "# ys__n%-5d %s\n", si.id, log_signal(si.bit));
+		if (si.is_port && si.bit.wire != nullptr)
+			partition_port_bits.insert(si.bit);
 
+	int count_input = 0, count_output = 0, count_gates = 0;
 	for (auto &si : signal_list) {
-		if (si.bit.wire == nullptr) {
-			fprintf(f, ".names ys__n%d\n", si.id);
-			if (si.bit == RTLIL::State::S1)
-				fprintf(f, "1\n");
-		}
-	}
-
-	int count_gates = 0;
-	for (auto &si : signal_list) {
-		if (si.type == G(BUF)) {
-			fprintf(f, ".names ys__n%d ys__n%d\n", si.in1, si.id);
-			fprintf(f, "1 1\n");
-		} else if (si.type == G(NOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d\n", si.in1, si.id);
-			fprintf(f, "0 1\n");
-		} else if (si.type == G(AND)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "11 1\n");
-		} else if (si.type == G(NAND)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "0- 1\n");
-			fprintf(f, "-0 1\n");
-		} else if (si.type == G(OR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "-1 1\n");
-			fprintf(f, "1- 1\n");
-		} else if (si.type == G(NOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "00 1\n");
-		} else if (si.type == G(XOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "01 1\n");
-			fprintf(f, "10 1\n");
-		} else if (si.type == G(XNOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "00 1\n");
-			fprintf(f, "11 1\n");
-		} else if (si.type == G(ANDNOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "10 1\n");
-		} else if (si.type == G(ORNOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "1- 1\n");
-			fprintf(f, "-0 1\n");
-		} else if (si.type == G(MUX)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "1-0 1\n");
-			fprintf(f, "-11 1\n");
-		} else if (si.type == G(NMUX)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "0-0 1\n");
-			fprintf(f, "-01 1\n");
-		} else if (si.type == G(AOI3)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "-00 1\n");
-			fprintf(f, "0-0 1\n");
-		} else if (si.type == G(OAI3)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "00- 1\n");
-			fprintf(f, "--0 1\n");
-		} else if (si.type == G(AOI4)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.in4, si.id);
-			fprintf(f, "-0-0 1\n");
-			fprintf(f, "-00- 1\n");
-			fprintf(f, "0--0 1\n");
-			fprintf(f, "0-0- 1\n");
-		} else if (si.type == G(OAI4)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.in4, si.id);
-			fprintf(f, "00-- 1\n");
-			fprintf(f, "--00 1\n");
-		} else if (si.type == G(FF)) {
-			fprintf(f, ".latch ys__n%d ys__n%d 2\n", si.in1, si.id);
-		} else if (si.type == G(FF0)) {
-			fprintf(f, ".latch ys__n%d ys__n%d 0\n", si.in1, si.id);
-		} else if (si.type == G(FF1)) {
-			fprintf(f, ".latch ys__n%d ys__n%d 1\n", si.in1, si.id);
-		} else if (si.type != G(NONE))
-			log_abort();
+		if (si.is_port && si.type == G(NONE))
+			pi_map[count_input++] = log_signal(si.bit);
+		if (si.is_port && si.type != G(NONE))
+			po_map[count_output++] = log_signal(si.bit);
 		if (si.type != G(NONE))
 			count_gates++;
 	}
 
-	fprintf(f, ".end\n");
-	fclose(f);
+	write_input_blif(stringf("%s/input.blif", tempdir_name.c_str()));
 
 	log("Extracted %d gates and %d wires to a netlist network with %d inputs and %d outputs (dfl=%s).\n",
 			count_gates, GetSize(signal_list), count_input, count_output, dfl_arg.c_str());
-	log_push();
+
+	job.tempdir_name = tempdir_name;
 	if (count_output > 0)
 	{
-		log_header(design, "Executing ABC.\n");
-
 		auto &cell_cost = cmos_cost ? CellCosts::cmos_gate_cost() : CellCosts::default_gate_cost();
 
-                auto startTime = std::chrono::high_resolution_clock::now();
-
 		buffer = stringf("%s/stdcells.genlib", tempdir_name.c_str());
 		f = fopen(buffer.c_str(), "wt");
 		if (f == nullptr)
@@ -1145,14 +1191,57 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
 			fclose(f);
 		}
 
-		buffer = stringf("\"%s\" -s -f %s/abc.script 2>&1", exe_file.c_str(), tempdir_name.c_str());
-#ifdef NO_RAPID_SILICON		
-		log("Running ABC command: %s\n", replace_tempdir(buffer, tempdir_name, show_tempdir).c_str());
+		job.abc_command = stringf("\"%s\" -s -f %s/abc.script 2>&1", exe_file.c_str(), tempdir_name.c_str());
+
+		if (!cache_dir.empty()) {
+			for (auto name : {"abc.script", "input.blif", "stdcells.genlib", "lutdefs.txt"})
+				job.cache_files.push_back(stringf("%s/%s", tempdir_name.c_str(), name));
+			if (!script_file.empty() && script_file[0] != '+')
+				job.cache_files.push_back(script_file);
+			job.cache_files.insert(job.cache_files.end(), liberty_files.begin(), liberty_files.end());
+			job.cache_files.insert(job.cache_files.end(), genlib_files.begin(), genlib_files.end());
+			if (!constr_file.empty())
+				job.cache_files.push_back(constr_file);
+		}
+	}
+
+	swap_job_state(job);
+}
+
+// Runs ABC for a job. This does not touch the design or any global state
+// and may be called from a worker thread, the log output is captured and
+// replayed by abc_module_reintegrate().
+void abc_module_run(abc_job_t &job, std::string exe_file, bool show_tempdir)
+{
+	if (job.abc_command.empty())
+		return;
+
+	job.abc_log.begin();
+	try
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		const std::string &tempdir_name = job.tempdir_name;
+#ifdef NO_RAPID_SILICON
+		log("Running ABC command: %s\n", replace_tempdir(job.abc_command, tempdir_name, show_tempdir).c_str());
 #endif
 
 #ifndef YOSYS_LINK_ABC
-		abc_output_filter filt(tempdir_name, show_tempdir);
-		int ret = run_command(buffer, std::bind(&abc_output_filter::next_line, filt, std::placeholders::_1));
+		std::string output_file = stringf("%s/output.blif", tempdir_name.c_str());
+		std::string cache_key;
+		if (!cache_dir.empty())
+			cache_key = AbcCache::key(exe_file, tempdir_name, job.cache_files);
+		int ret = 0;
+		if (!cache_key.empty() && AbcCache::fetch(cache_dir, cache_key, output_file)) {
+			log("Reusing cached ABC result %s.\n", cache_key.c_str());
+			job.cache_hit = true;
+		} else {
+			std::string command = dispatch_cmd.empty() ? job.abc_command : dispatch_cmd + " " + job.abc_command;
+			abc_output_filter filt(tempdir_name, show_tempdir, job.pi_map, job.po_map);
+			PassProfiler::Zone zone("abc::run");
+			ret = run_command(command, std::bind(&abc_output_filter::next_line, filt, std::placeholders::_1));
+			if (ret == 0 && !cache_key.empty())
+				AbcCache::store(cache_dir, cache_key, output_file);
+		}
 #else
 		string temp_stdouterr_name = stringf("%s/stdouterr.txt", tempdir_name.c_str());
 		FILE *temp_stdouterr_w = fopen(temp_stdouterr_name.c_str(), "w");
@@ -1172,6 +1261,7 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
 		fd_renumber(fileno(temp_stdouterr_w), fileno(stdout));
 		fd_renumber(fileno(temp_stdouterr_w), fileno(stderr));
 		fclose(temp_stdouterr_w);
+		PassProfiler::Zone zone("abc::run");
 		// These needs to be mutable, supposedly due to getopt
 		char *abc_argv[5];
 		string tmp_script_name = stringf("%s/abc.script", tempdir_name.c_str());
@@ -1192,25 +1282,48 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
 		fclose(old_stdout);
 		fclose(old_stderr);
 		std::ifstream temp_stdouterr_r(temp_stdouterr_name);
-		abc_output_filter filt(tempdir_name, show_tempdir);
+		abc_output_filter filt(tempdir_name, show_tempdir, job.pi_map, job.po_map);
 		for (std::string line; std::getline(temp_stdouterr_r, line); )
 			filt.next_line(line + "\n");
 		temp_stdouterr_r.close();
 #endif
-		if (ret != 0)
-			log_error("ABC: execution of command \"%s\" failed: return code %d.\n", buffer.c_str(), ret);
+		job.abc_ret = ret;
 
-		buffer = stringf("%s/%s", tempdir_name.c_str(), "output.blif");
-		std::ifstream ifs;
-		ifs.open(buffer);
-		if (ifs.fail())
-			log_error("Something went wrong in DE LUT mapper.\n");
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - startTime);
+		job.abc_time = elapsed.count() * 1e-9;
+	}
+	catch (...)
+	{
+		job.abc_log.end();
+		throw;
+	}
+	job.abc_log.end();
+}
+
+// Replaces the extracted cells with the cells mapped by ABC.
+void abc_module_reintegrate(RTLIL::Design *design, abc_job_t &job, std::vector<std::string> &liberty_files,
+		std::vector<std::string> &genlib_files, bool cleanup, bool sop_mode)
+{
+	swap_job_state(job);
+	const std::string &tempdir_name = job.tempdir_name;
+
+	log_push();
+	if (!job.abc_command.empty())
+	{
+		log_header(design, "Executing ABC.\n");
+		job.abc_log.replay();
+
+		if (job.abc_ret != 0)
+			log_error("ABC: execution of command \"%s\" failed: return code %d.\n", job.abc_command.c_str(), job.abc_ret);
+
+                auto startTime = std::chrono::high_resolution_clock::now();
 
 		bool builtin_lib = liberty_files.empty() && genlib_files.empty();
 		RTLIL::Design *mapped_design = new RTLIL::Design;
-		parse_blif(mapped_design, ifs, builtin_lib ? ID(DFF) : ID(_dff_), false, sop_mode);
 
-		ifs.close();
+		std::string buffer = stringf("%s/%s", tempdir_name.c_str(), "output.blif");
+		if (!parse_blif_file(mapped_design, buffer, builtin_lib ? ID(DFF) : ID(_dff_), false, sop_mode))
+			log_error("Something went wrong in DE LUT mapper.\n");
 
 #ifdef NO_RAPID_SILICON
 		log_header(design, "Re-integrating ABC results.\n");
@@ -1485,7 +1598,7 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
                 auto endTime = std::chrono::high_resolution_clock::now();
                 auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime);
 
-                float totalTime = elapsed.count() * 1e-9;
+                float totalTime = job.abc_time + elapsed.count() * 1e-9;
 
                 log("[Time = %.2f sec.]\n", totalTime);
 
@@ -1506,6 +1619,7 @@ void abc_module(RTLIL::Design *design, RTLIL::Module *current_module, std::strin
 	}
 
 	log_pop();
+	swap_job_state(job);
 }
 
 typedef tuple<bool, RTLIL::SigSpec, bool, RTLIL::SigSpec, bool, RTLIL::SigSpec, bool, RTLIL::SigSpec> clkdomain_t;
@@ -1518,6 +1632,135 @@ bool cmpPartitionSize (pair<clkdomain_t, std::vector<RTLIL::Cell*>>* a, pair<clk
    return false;
 }
 
+// Nets with more readers than this are cut when partitioning, so that a
+// shared enable or select net doesn't pull everything into one cone.
+static const int partition_max_fanout = 32;
+
+// Splits the cells into up to num_parts partitions of similar size for -partition.
+// The cells are collected cone by cone in depth-first order, starting at the
+// cells driving FFs, ports, cells outside of the list and high-fanout nets,
+// and a partition is closed after a cone once it has reached its share of the
+// cells. Cones that are larger than two shares are split in the middle.
+std::vector<std::vector<RTLIL::Cell*>> partition_cells(RTLIL::Design *design, RTLIL::Module *mod,
+		const std::vector<RTLIL::Cell*> &cells, int num_parts)
+{
+	std::vector<std::vector<RTLIL::Cell*>> parts;
+	if (num_parts <= 1 || GetSize(cells) < 2 * num_parts) {
+		parts.push_back(cells);
+		return parts;
+	}
+
+	CellTypes ct(design);
+	dict<RTLIL::Cell*, int> cell_index;
+	for (int i = 0; i < GetSize(cells); i++)
+		cell_index[cells[i]] = i;
+
+	// the readers of each net: the number of cell inputs, or -1 if the net
+	// is used by a port or a cell outside of the list
+	dict<RTLIL::SigBit, int> readers;
+	dict<RTLIL::SigBit, int> driver;
+	for (auto wire : mod->wires())
+		if (wire->port_id > 0 || wire->get_bool_attribute(ID::keep))
+			for (auto bit : assign_map(wire))
+				readers[bit] = -1;
+	for (auto cell : mod->cells()) {
+		auto it = cell_index.find(cell);
+		for (auto &conn : cell->connections()) {
+			bool is_input = ct.cell_input(cell->type, conn.first);
+			bool is_output = ct.cell_output(cell->type, conn.first);
+			for (auto bit : assign_map(conn.second)) {
+				if (bit.wire == nullptr)
+					continue;
+				if (is_output && it != cell_index.end())
+					driver[bit] = it->second;
+				if (!is_input && !is_output)
+					readers[bit] = -1;
+				else if (is_input) {
+					int &count = readers[bit];
+					if (it == cell_index.end())
+						count = -1;
+					else if (count >= 0)
+						count++;
+				}
+			}
+		}
+	}
+
+	// the cells driving the inputs of each cell, without the nets that are cut
+	std::vector<std::vector<int>> fanin(GetSize(cells));
+	std::vector<bool> is_root(GetSize(cells));
+	for (int i = 0; i < GetSize(cells); i++) {
+		RTLIL::Cell *cell = cells[i];
+		bool is_ff = RTLIL::builtin_ff_cell_types().count(cell->type) != 0;
+		if (is_ff)
+			is_root[i] = true;
+		for (auto &conn : cell->connections()) {
+			if (ct.cell_output(cell->type, conn.first)) {
+				for (auto bit : assign_map(conn.second)) {
+					auto it = readers.find(bit);
+					if (it != readers.end() && (it->second < 0 || it->second > partition_max_fanout))
+						is_root[i] = true;
+				}
+				continue;
+			}
+			if (!ct.cell_input(cell->type, conn.first))
+				continue;
+			for (auto bit : assign_map(conn.second)) {
+				auto it = driver.find(bit);
+				if (it == driver.end() || RTLIL::builtin_ff_cell_types().count(cells[it->second]->type))
+					continue;
+				if (readers.at(bit) > partition_max_fanout)
+					continue;
+				fanin[i].push_back(it->second);
+			}
+		}
+	}
+
+	int share = (GetSize(cells) + num_parts - 1) / num_parts;
+	std::vector<bool> visited(GetSize(cells));
+	std::vector<RTLIL::Cell*> current;
+	std::vector<pair<int, int>> stack;
+
+	auto add_cone = [&](int root) {
+		if (visited[root])
+			return;
+		visited[root] = true;
+		stack.push_back(pair<int, int>(root, 0));
+		while (!stack.empty()) {
+			auto &top = stack.back();
+			if (top.second < GetSize(fanin[top.first])) {
+				int next = fanin[top.first][top.second++];
+				if (!visited[next]) {
+					visited[next] = true;
+					stack.push_back(pair<int, int>(next, 0));
+				}
+				continue;
+			}
+			current.push_back(cells[top.first]);
+			stack.pop_back();
+			if (GetSize(current) >= 2 * share) {
+				parts.push_back(std::move(current));
+				current.clear();
+			}
+		}
+		if (GetSize(current) >= share) {
+			parts.push_back(std::move(current));
+			current.clear();
+		}
+	};
+
+	for (int i = 0; i < GetSize(cells); i++)
+		if (is_root[i])
+			add_cone(i);
+	for (int i = 0; i < GetSize(cells); i++)
+		add_cone(i);
+	if (!current.empty())
+		parts.push_back(std::move(current));
+
+	log("Splitting %d cells of module %s into %d partitions.\n", GetSize(cells), log_id(mod), GetSize(parts));
+	return parts;
+}
+
 struct AbcPass : public Pass {
 	AbcPass() : Pass("abc", "use ABC for technology mapping") { }
 	void help() override
@@ -1698,6 +1941,36 @@ struct AbcPass : public Pass {
 		log("        this attribute is a unique integer for each ABC process started. This\n");
 		log("        is useful for debugging the partitioning of clock domains.\n");
 		log("\n");
+		log("    -j <N>\n");
+		log("        run up to N ABC processes at the same time, for different modules,\n");
+		log("        clock domains (with -dff) or partitions (with -partition). The default\n");
+		log("        is the number of threads set with 'yosys -j'. The results do not\n");
+		log("        depend on this setting.\n");
+		log("\n");
+		log("    -partition <N>\n");
+		log("        split the logic of each module (or each clock domain with -dff) into up\n");
+		log("        to N partitions of similar size and map them with separate ABC\n");
+		log("        processes, which can run at the same time (see -j). The logic is cut\n");
+		log("        at FFs and high-fanout nets. This is faster for very large modules,\n");
+		log("        at the cost of some optimization across the partition boundaries.\n");
+		log("\n");
+		log("    -cache <dir>\n");
+		log("        keep the netlists mapped by ABC in the given directory, under a hash of\n");
+		log("        the ABC input (netlist, script, libraries and executable name). When\n");
+		log("        the same input is mapped again, the result is taken from the directory\n");
+		log("        and ABC is not run. The directory can be shared by several runs and\n");
+		log("        build nodes. The hit rate is printed at the end of the pass. The\n");
+		log("        scratchpad variable abc.cache sets a default, e.g. for the abc calls\n");
+		log("        in synth scripts. Not available when ABC is linked into Yosys.\n");
+		log("\n");
+		log("    -dispatch <command>\n");
+		log("        run ABC through the given command prefix, e.g. \"ssh node\" or \"srun\"\n");
+		log("        to run the ABC processes on other build nodes. Together with -j and\n");
+		log("        -partition this distributes the mapping of a large design. The temp dir\n");
+		log("        must be visible to the remote nodes under the same path, e.g. by\n");
+		log("        pointing the TMPDIR environment variable to a shared file system. Not\n");
+		log("        available when ABC is linked into Yosys.\n");
+		log("\n");
 		log("    -dress\n");
 		log("        run the 'dress' command after all other ABC commands. This aims to\n");
 		log("        preserve naming by an equivalence check between the original and\n");
@@ -1737,6 +2010,7 @@ struct AbcPass : public Pass {
                 std::string dfl_arg = "1";
 		bool show_tempdir = false, sop_mode = false;
 		bool abc_dress = false;
+		int max_jobs = 0, num_partitions = 1;
 		vector<int> lut_costs;
 		markgroups = false;
 
@@ -1745,6 +2019,8 @@ struct AbcPass : public Pass {
 		map_mux16 = false;
 		enabled_gates.clear();
 		cmos_cost = false;
+		cache_dir.clear();
+		dispatch_cmd.clear();
 
 		// get arguments from scratchpad first, then override by command arguments
 		std::string lut_arg, luts_arg, g_arg;
@@ -1752,6 +2028,7 @@ struct AbcPass : public Pass {
 		script_file = design->scratchpad_get_string("abc.script", script_file);
 		default_liberty_file = design->scratchpad_get_string("abc.liberty", default_liberty_file);
 		constr_file = design->scratchpad_get_string("abc.constr", constr_file);
+		cache_dir = design->scratchpad_get_string("abc.cache", cache_dir);
 		if (design->scratchpad.count("abc.D")) {
 			delay_target = "-D " + design->scratchpad_get_string("abc.D");
 		}
@@ -1913,10 +2190,35 @@ struct AbcPass : public Pass {
 				markgroups = true;
 				continue;
 			}
+			if (arg == "-j" && argidx+1 < args.size()) {
+				max_jobs = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-partition" && argidx+1 < args.size()) {
+				num_partitions = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-cache" && argidx+1 < args.size()) {
+				cache_dir = args[++argidx];
+				continue;
+			}
+			if (arg == "-dispatch" && argidx+1 < args.size()) {
+				dispatch_cmd = args[++argidx];
+				if (GetSize(dispatch_cmd) >= 2 && dispatch_cmd.front() == '"' && dispatch_cmd.back() == '"')
+					dispatch_cmd = dispatch_cmd.substr(1, GetSize(dispatch_cmd) - 2);
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+#ifdef YOSYS_LINK_ABC
+		if (!cache_dir.empty() || !dispatch_cmd.empty())
+			log_cmd_error("The -cache and -dispatch options need an external ABC executable.\n");
+#endif
+		if (!cache_dir.empty() && !check_directory_exists(cache_dir) && !create_directory(cache_dir))
+			log_cmd_error("Could not create the ABC cache directory `%s'.\n", cache_dir.c_str());
+
 		if (genlib_files.empty() && liberty_files.empty() && !default_liberty_file.empty())
 			liberty_files.push_back(default_liberty_file);
 
@@ -2119,6 +2421,15 @@ struct AbcPass : public Pass {
 		}
 
 
+		// The netlists of all modules and partitions are extracted first, then
+		// ABC is run for them (concurrently if multiple threads are enabled),
+		// and finally the results are re-integrated in the order of extraction.
+		std::vector<std::unique_ptr<abc_job_t>> jobs;
+		auto new_job = [&]() -> abc_job_t& {
+			jobs.emplace_back(new abc_job_t);
+			return *jobs.back();
+		};
+
 		for (auto mod : design->selected_modules())
 		{
 			if (mod->processes.size() > 0) {
@@ -2127,10 +2438,13 @@ struct AbcPass : public Pass {
 			}
 			assign_map.set(mod);
 			initvals.set(&assign_map, mod);
+			partition_port_bits.clear();
 
 			if (!dff_mode || !clk_str.empty()) {
-				abc_module(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, dff_mode, clk_str, keepff,
-						delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, dfl_arg, mod->selected_cells(), show_tempdir, sop_mode, abc_dress, dont_use_cells);
+				for (auto &cells : partition_cells(design, mod, mod->selected_cells(), num_partitions))
+					abc_module_extract(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, dff_mode, clk_str, keepff,
+							delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, dfl_arg, cells, show_tempdir, sop_mode, abc_dress, dont_use_cells,
+							new_job());
 				continue;
 			}
 
@@ -2349,26 +2663,74 @@ struct AbcPass : public Pass {
                                 nb++;
 #endif
 
-				clk_polarity = std::get<0>(it.first);
-				clk_sig = assign_map(std::get<1>(it.first));
-				en_polarity = std::get<2>(it.first);
-				en_sig = assign_map(std::get<3>(it.first));
-				arst_polarity = std::get<4>(it.first);
-				arst_sig = assign_map(std::get<5>(it.first));
-				srst_polarity = std::get<6>(it.first);
-				srst_sig = assign_map(std::get<7>(it.first));
-				abc_module(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, !clk_sig.empty(), "$",
-						keepff, delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, dfl_arg, it.second, show_tempdir, sop_mode, abc_dress, dont_use_cells);
-				assign_map.set(mod);
+				for (auto &cells : partition_cells(design, mod, it.second, num_partitions)) {
+					clk_polarity = std::get<0>(it.first);
+					clk_sig = assign_map(std::get<1>(it.first));
+					en_polarity = std::get<2>(it.first);
+					en_sig = assign_map(std::get<3>(it.first));
+					arst_polarity = std::get<4>(it.first);
+					arst_sig = assign_map(std::get<5>(it.first));
+					srst_polarity = std::get<6>(it.first);
+					srst_sig = assign_map(std::get<7>(it.first));
+					abc_module_extract(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, !clk_sig.empty(), "$",
+							keepff, delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, dfl_arg, cells, show_tempdir, sop_mode, abc_dress, dont_use_cells,
+							new_job());
+				}
 			}
 		}
 
+		int num_threads = max_jobs > 0 && !yosys_in_worker_thread() ? max_jobs : yosys_thread_count(GetSize(jobs));
+#ifdef YOSYS_LINK_ABC
+		// the linked ABC redirects stdout/stderr of the process
+		num_threads = 1;
+#endif
+		num_threads = std::min(num_threads, GetSize(jobs));
+		if (num_threads > 1)
+			log("Running %d ABC processes with up to %d at a time.\n", GetSize(jobs), num_threads);
+
+		std::exception_ptr error;
+		try {
+			ThreadPool::run(GetSize(jobs), [&](int i) {
+				abc_module_run(*jobs[i], exe_file, show_tempdir);
+			}, num_threads);
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		int cache_lookups = 0, cache_hits = 0;
+		RTLIL::Module *reintegrate_module = nullptr;
+		for (auto &job : jobs) {
+			if (!job->cache_files.empty()) {
+				cache_lookups++;
+				cache_hits += job->cache_hit;
+			}
+			if (error) {
+				// show the output up to the failed run
+				job->abc_log.replay();
+				continue;
+			}
+			if (job->module != reintegrate_module) {
+				reintegrate_module = job->module;
+				assign_map.set(reintegrate_module);
+				initvals.set(&assign_map, reintegrate_module);
+			}
+			abc_module_reintegrate(design, *job, liberty_files, genlib_files, cleanup, sop_mode);
+			job.reset();
+		}
+		if (error)
+			std::rethrow_exception(error);
+
+		if (cache_lookups > 0)
+			log("ABC result cache: reused %d of %d mapped netlists (%.1f%% hit rate).\n",
+					cache_hits, cache_lookups, 100.0 * cache_hits / cache_lookups);
+
 		assign_map.clear();
 		signal_list.clear();
 		signal_map.clear();
 		initvals.clear();
 		pi_map.clear();
 		po_map.clear();
+		partition_port_bits.clear();
 
 		log_pop();
 	}
@@ -26,6 +26,8 @@
 #include "kernel/celltypes.h"
 #include "kernel/rtlil.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
+#include "backends/aiger/xaiger.h"
 
 // abc9_exe.cc
 std::string fold_abc9_cmd(std::string str);
@@ -171,6 +173,17 @@ struct Abc9Pass : public ScriptPass
 		log("    -box <file>\n");
 		log("        pass this file with box library to ABC.\n");
 		log("\n");
+		log("    -j <N>\n");
+		log("        run ABC for up to N modules at the same time. The default is the number\n");
+		log("        of threads set with 'yosys -j'. The results do not depend on this\n");
+		log("        setting.\n");
+		log("\n");
+		log("    -cache <dir>\n");
+		log("    -dispatch <command>\n");
+		log("        passed to abc9_exe, keep the ABC results in a directory that can be\n");
+		log("        shared by several runs, and run ABC on other build nodes through a\n");
+		log("        command prefix. See 'help abc9_exe' for details.\n");
+		log("\n");
 		log("Note that this is a logic optimization pass within Yosys that is calling ABC\n");
 		log("internally. This is not going to \"run ABC on your design\". It will instead run\n");
 		log("ABC on logic snippets extracted from your design. You will not get any useful\n");
@@ -220,13 +233,20 @@ struct Abc9Pass : public ScriptPass
 			std::string arg = args[argidx];
 			if ((arg == "-exe" || arg == "-script" || arg == "-D" ||
 						/*arg == "-S" ||*/ arg == "-lut" || arg == "-luts" ||
-						/*arg == "-box" ||*/ arg == "-W") &&
+						/*arg == "-box" ||*/ arg == "-W" || arg == "-j" || arg == "-cache") &&
 					argidx+1 < args.size()) {
 				if (arg == "-lut" || arg == "-luts")
 					lut_mode = true;
 				exe_cmd << " " << arg << " " << args[++argidx];
 				continue;
 			}
+			if (arg == "-dispatch" && argidx+1 < args.size()) {
+				std::string dispatch_cmd = args[++argidx];
+				if (dispatch_cmd.front() != '"')
+					dispatch_cmd = "\"" + dispatch_cmd + "\"";
+				exe_cmd << " " << arg << " " << dispatch_cmd;
+				continue;
+			}
 			if (arg == "-fast" || /* arg == "-dff" || */
 					/* arg == "-nocleanup" || */ arg == "-showtmp") {
 				exe_cmd << " " << arg;
@@ -380,11 +400,12 @@ struct Abc9Pass : public ScriptPass
 		if (check_label("exe")) {
 			run("aigmap");
 			if (help_mode) {
+				run("abc9_ops -write_lut <abc-temp-dir>/input.lut", "(skip if '-lut' or '-luts')");
+				run("abc9_ops -write_box <abc-temp-dir>/input.box", "(skip if '-box')");
+				run("foreach module in selection");
+				run("    write_xaiger -map <abc-temp-dir>/input.sym [-dff] <abc-temp-dir>/input.xaig", "(in parallel for all modules)");
+				run("abc9_exe [options] -cwd <abc-temp-dir> [-cwd ...] -lut [<abc-temp-dir>/input.lut] -box [<abc-temp-dir>/input.box]");
 				run("foreach module in selection");
-				run("    abc9_ops -write_lut <abc-temp-dir>/input.lut", "(skip if '-lut' or '-luts')");
-				run("    abc9_ops -write_box <abc-temp-dir>/input.box", "(skip if '-box')");
-				run("    write_xaiger -map <abc-temp-dir>/input.sym [-dff] <abc-temp-dir>/input.xaig");
-				run("    abc9_exe [options] -cwd <abc-temp-dir> -lut [<abc-temp-dir>/input.lut] -box [<abc-temp-dir>/input.box]");
 				run("    read_aiger -xaiger -wideports -module_name <module-name>$abc9 -map <abc-temp-dir>/input.sym <abc-temp-dir>/output.aig");
 				run("    abc9_ops -reintegrate [-dff]");
 			}
@@ -392,62 +413,116 @@ struct Abc9Pass : public ScriptPass
 				auto selected_modules = active_design->selected_modules();
 				active_design->selection_stack.emplace_back(false);
 
+				// All modules are extracted first, so that a single abc9_exe call
+				// can run ABC for them concurrently. The LUT and box libraries are
+				// the same for all modules and only written to the first temp dir.
+				std::vector<std::pair<RTLIL::Module*, std::string>> jobs;
+				std::vector<std::pair<RTLIL::Module*, std::string>> extract;
+				std::vector<std::string> tempdirs;
+				std::string lut_box_dir;
+
 				for (auto mod : selected_modules) {
 					if (mod->processes.size() > 0) {
 						log("Skipping module %s as it contains processes.\n", log_id(mod));
 						continue;
 					}
 
-					log_push();
 					active_design->selection().select(mod);
-
 					if (!active_design->selected_whole_module(mod))
 						log_error("Can't handle partially selected module %s!\n", log_id(mod));
+					if (!mod->memories.empty())
+						log_error("Found unmapped memories in module %s: unmapped memories are not supported in XAIGER backend!\n", log_id(mod));
 
 					std::string tempdir_name = get_base_tmpdir() + "/" + proc_program_prefix() + "yosys-abc-XXXXXX";
 					if (!cleanup)
 						tempdir_name[0] = tempdir_name[4] = '_';
 					tempdir_name = make_temp_dir(tempdir_name);
+					tempdirs.push_back(tempdir_name);
+					extract.push_back(std::make_pair(mod, tempdir_name));
 
-					if (!lut_mode)
-						run_nocheck(stringf("abc9_ops -write_lut %s/input.lut", tempdir_name.c_str()));
-					if (box_file.empty())
-						run_nocheck(stringf("abc9_ops -write_box %s/input.box", tempdir_name.c_str()));
-					run_nocheck(stringf("write_xaiger -map %s/input.sym %s %s/input.xaig", tempdir_name.c_str(), dff_mode ? "-dff" : "", tempdir_name.c_str()));
-
-					int num_outputs = active_design->scratchpad_get_int("write_xaiger.num_outputs");
-
-					log("Extracted %d AND gates and %d wires from module `%s' to a netlist network with %d inputs and %d outputs.\n",
-							active_design->scratchpad_get_int("write_xaiger.num_ands"),
-							active_design->scratchpad_get_int("write_xaiger.num_wires"),
-							log_id(mod),
-							active_design->scratchpad_get_int("write_xaiger.num_inputs"),
-							num_outputs);
-					if (num_outputs) {
-						std::string abc9_exe_cmd;
-						abc9_exe_cmd += stringf("%s -cwd %s", exe_cmd.str().c_str(), tempdir_name.c_str());
+					if (lut_box_dir.empty()) {
+						lut_box_dir = tempdir_name;
 						if (!lut_mode)
-							abc9_exe_cmd += stringf(" -lut %s/input.lut", tempdir_name.c_str());
+							run_nocheck(stringf("abc9_ops -write_lut %s/input.lut", lut_box_dir.c_str()));
 						if (box_file.empty())
-							abc9_exe_cmd += stringf(" -box %s/input.box", tempdir_name.c_str());
-						else
-							abc9_exe_cmd += stringf(" -box %s", box_file.c_str());
-						run_nocheck(abc9_exe_cmd);
-						run_nocheck(stringf("read_aiger -xaiger -wideports -module_name %s$abc9 -map %s/input.sym %s/output.aig", log_id(mod), tempdir_name.c_str(), tempdir_name.c_str()));
-						run_nocheck(stringf("abc9_ops -reintegrate %s", dff_mode ? "-dff" : ""));
+							run_nocheck(stringf("abc9_ops -write_box %s/input.box", lut_box_dir.c_str()));
 					}
+					active_design->selection().selected_modules.clear();
+				}
+
+				// The modules are only read while they are converted, so this is
+				// done for all of them in parallel instead of calling write_xaiger
+				// for one module after the other.
+				struct extract_stats_t {
+					int num_ands = 0, num_wires = 0, num_inputs = 0, num_outputs = 0;
+				};
+				std::vector<extract_stats_t> stats(GetSize(extract));
+				ThreadPool::run_captured(GetSize(extract), [&](int i) {
+					RTLIL::Module *mod = extract[i].first;
+					const std::string &tempdir_name = extract[i].second;
+					XAigerWriter writer(mod, dff_mode);
+
+					std::ofstream f;
+					f.open(stringf("%s/input.xaig", tempdir_name.c_str()), std::ofstream::trunc | std::ofstream::binary);
+					if (f.fail())
+						log_error("Can't open file `%s/input.xaig' for writing: %s\n", tempdir_name.c_str(), strerror(errno));
+					writer.write_aiger(f, false /* ascii_mode */);
+					f.close();
+
+					f.open(stringf("%s/input.sym", tempdir_name.c_str()), std::ofstream::trunc);
+					if (f.fail())
+						log_error("Can't open file `%s/input.sym' for writing: %s\n", tempdir_name.c_str(), strerror(errno));
+					writer.write_map(f);
+
+					stats[i].num_ands = writer.num_ands();
+					stats[i].num_wires = writer.num_wires();
+					stats[i].num_inputs = writer.num_inputs();
+					stats[i].num_outputs = writer.num_outputs();
+				}, yosys_thread_count(GetSize(extract)), [&](int) {
+					log_push();
+					log_header(active_design, "Executing XAIGER backend.\n");
+				}, [&](int i) {
+					log("Extracted %d AND gates and %d wires from module `%s' to a netlist network with %d inputs and %d outputs.\n",
+							stats[i].num_ands, stats[i].num_wires, log_id(extract[i].first), stats[i].num_inputs, stats[i].num_outputs);
+					if (stats[i].num_outputs)
+						jobs.push_back(extract[i]);
 					else
 						log("Don't call ABC as there is nothing to map.\n");
+					log_pop();
+				});
 
-					if (cleanup) {
-						log("Removing temp directory.\n");
-						remove_directory(tempdir_name);
-					}
+				if (!jobs.empty()) {
+					std::string abc9_exe_cmd = exe_cmd.str();
+					for (auto &job : jobs)
+						abc9_exe_cmd += stringf(" -cwd %s", job.second.c_str());
+					if (!lut_mode)
+						abc9_exe_cmd += stringf(" -lut %s/input.lut", lut_box_dir.c_str());
+					if (box_file.empty())
+						abc9_exe_cmd += stringf(" -box %s/input.box", lut_box_dir.c_str());
+					else
+						abc9_exe_cmd += stringf(" -box %s", box_file.c_str());
+					run_nocheck(abc9_exe_cmd);
+				}
+
+				for (auto &job : jobs) {
+					RTLIL::Module *mod = job.first;
+					const std::string &tempdir_name = job.second;
+
+					log_push();
+					active_design->selection().select(mod);
+					run_nocheck(stringf("read_aiger -xaiger -wideports -module_name %s$abc9 -map %s/input.sym %s/output.aig", log_id(mod), tempdir_name.c_str(), tempdir_name.c_str()));
+					run_nocheck(stringf("abc9_ops -reintegrate %s", dff_mode ? "-dff" : ""));
 					mod->check();
 					active_design->selection().selected_modules.clear();
 					log_pop();
 				}
 
+				if (cleanup && !tempdirs.empty()) {
+					log("Removing temp directories.\n");
+					for (auto &tempdir_name : tempdirs)
+						remove_directory(tempdir_name);
+				}
+
 				active_design->selection_stack.pop_back();
 			}
 		}
@@ -24,6 +24,9 @@
 
 #include "kernel/register.h"
 #include "kernel/log.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
+#include "passes/techmap/abc_cache.h"
 
 #ifndef _WIN32
 #  include <unistd.h>
@@ -164,12 +167,25 @@ struct abc9_output_filter
 	}
 };
 
-void abc9_module(RTLIL::Design *design, std::string script_file, std::string exe_file,
+struct abc9_job_t
+{
+	std::string tempdir_name;
+	std::string abc9_command;
+	std::vector<std::string> cache_files; // everything ABC reads, for -cache
+	bool cache_hit = false;
+	int abc9_ret = 0;
+	bool started = false;
+	LogCapture abc9_log;
+};
+
+// Writes the ABC script (and LUT library) for one temp dir
+void abc9_module_prepare(RTLIL::Design *design, std::string script_file, std::string exe_file,
 		vector<int> lut_costs, bool dff_mode, std::string delay_target, std::string /*lutin_shared*/, bool fast_mode,
-		bool show_tempdir, std::string box_file, std::string lut_file,
-		std::string wire_delay, std::string tempdir_name
+		std::string box_file, std::string lut_file,
+		std::string wire_delay, abc9_job_t &job
 )
 {
+	const std::string &tempdir_name = job.tempdir_name;
 	std::string abc9_script;
 
 	if (!lut_costs.empty())
@@ -252,8 +268,6 @@ void abc9_module(RTLIL::Design *design, std::string script_file, std::string exe
 
 	std::string buffer;
 
-	log_header(design, "Executing ABC9.\n");
-
 	if (!lut_costs.empty()) {
 		buffer = stringf("%s/lutdefs.txt", tempdir_name.c_str());
 		f = fopen(buffer.c_str(), "wt");
@@ -264,13 +278,43 @@ void abc9_module(RTLIL::Design *design, std::string script_file, std::string exe
 		fclose(f);
 	}
 
-	buffer = stringf("\"%s\" -s -f %s/abc.script 2>&1", exe_file.c_str(), tempdir_name.c_str());
+	job.abc9_command = stringf("\"%s\" -s -f %s/abc.script 2>&1", exe_file.c_str(), tempdir_name.c_str());
+
+	for (auto name : {"abc.script", "input.xaig", "lutdefs.txt"})
+		job.cache_files.push_back(stringf("%s/%s", tempdir_name.c_str(), name));
+	for (auto &file : {script_file, box_file, lut_file})
+		if (!file.empty() && file[0] != '+')
+			job.cache_files.push_back(file);
+}
+
+// Runs ABC for one temp dir. This may be called from a worker thread, the
+// log output is captured in job.abc9_log.
+void abc9_module_run(std::string exe_file, bool show_tempdir, const std::string &cache_dir, const std::string &dispatch_cmd, abc9_job_t &job)
+{
+	const std::string &tempdir_name = job.tempdir_name;
+	const std::string &buffer = job.abc9_command;
 	log("Running ABC command: %s\n", replace_tempdir(buffer, tempdir_name, show_tempdir).c_str());
 
 #ifndef YOSYS_LINK_ABC
-	abc9_output_filter filt(tempdir_name, show_tempdir);
-	int ret = run_command(buffer, std::bind(&abc9_output_filter::next_line, filt, std::placeholders::_1));
+	std::string output_file = stringf("%s/output.aig", tempdir_name.c_str());
+	std::string cache_key;
+	if (!cache_dir.empty())
+		cache_key = AbcCache::key(exe_file, tempdir_name, job.cache_files);
+	int ret = 0;
+	if (!cache_key.empty() && AbcCache::fetch(cache_dir, cache_key, output_file)) {
+		log("Reusing cached ABC result %s.\n", cache_key.c_str());
+		job.cache_hit = true;
+	} else {
+		abc9_output_filter filt(tempdir_name, show_tempdir);
+		PassProfiler::Zone zone("abc9::run");
+		ret = run_command(dispatch_cmd.empty() ? buffer : dispatch_cmd + " " + buffer,
+				std::bind(&abc9_output_filter::next_line, filt, std::placeholders::_1));
+		if (ret == 0 && !cache_key.empty())
+			AbcCache::store(cache_dir, cache_key, output_file);
+	}
 #else
+	(void)cache_dir;
+	(void)dispatch_cmd;
 	string temp_stdouterr_name = stringf("%s/stdouterr.txt", tempdir_name.c_str());
 	FILE *temp_stdouterr_w = fopen(temp_stdouterr_name.c_str(), "w");
 	if (temp_stdouterr_w == NULL)
@@ -297,7 +341,11 @@ void abc9_module(RTLIL::Design *design, std::string script_file, std::string exe
 	abc9_argv[2] = strdup("-f");
 	abc9_argv[3] = strdup(tmp_script_name.c_str());
 	abc9_argv[4] = 0;
-	int ret = abc::Abc_RealMain(4, abc9_argv);
+	int ret;
+	{
+		PassProfiler::Zone zone("abc9::run");
+		ret = abc::Abc_RealMain(4, abc9_argv);
+	}
 	free(abc9_argv[0]);
 	free(abc9_argv[1]);
 	free(abc9_argv[2]);
@@ -314,11 +362,18 @@ void abc9_module(RTLIL::Design *design, std::string script_file, std::string exe
 		filt.next_line(line + "\n");
 	temp_stdouterr_r.close();
 #endif
-	if (ret != 0) {
-		if (check_file_exists(stringf("%s/output.aig", tempdir_name.c_str())))
-			log_warning("ABC: execution of command \"%s\" failed: return code %d.\n", buffer.c_str(), ret);
+	job.abc9_ret = ret;
+}
+
+void abc9_module_finish(abc9_job_t &job)
+{
+	job.abc9_log.replay();
+
+	if (job.abc9_ret != 0) {
+		if (check_file_exists(stringf("%s/output.aig", job.tempdir_name.c_str())))
+			log_warning("ABC: execution of command \"%s\" failed: return code %d.\n", job.abc9_command.c_str(), job.abc9_ret);
 		else
-			log_error("ABC: execution of command \"%s\" failed: return code %d.\n", buffer.c_str(), ret);
+			log_error("ABC: execution of command \"%s\" failed: return code %d.\n", job.abc9_command.c_str(), job.abc9_ret);
 	}
 }
 
@@ -394,7 +449,27 @@ struct Abc9ExePass : public Pass {
 		log("    -cwd <dir>\n");
 		log("        use this as the current working directory, inside which the 'input.xaig'\n");
 		log("        file is expected. temporary files will be created in this directory, and\n");
-		log("        the mapped result will be written to 'output.aig'.\n");
+		log("        the mapped result will be written to 'output.aig'. this option can be\n");
+		log("        used multiple times to run ABC for multiple directories.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        run up to N ABC processes at the same time when multiple directories\n");
+		log("        are given. The default is the number of threads set with 'yosys -j'.\n");
+		log("\n");
+		log("    -cache <dir>\n");
+		log("        keep the results of ABC in the given directory, under a hash of the\n");
+		log("        ABC input (netlist, script, box and LUT libraries and executable name).\n");
+		log("        When the same input is mapped again, 'output.aig' is taken from the\n");
+		log("        directory and ABC is not run. The directory can be shared by several\n");
+		log("        runs and build nodes. The hit rate is printed at the end of the pass.\n");
+		log("        The scratchpad variable abc9.cache sets a default, e.g. for the abc9\n");
+		log("        calls in synth scripts. Not available when ABC is linked into Yosys.\n");
+		log("\n");
+		log("    -dispatch <command>\n");
+		log("        run ABC through the given command prefix, e.g. \"ssh node\" or \"srun\"\n");
+		log("        to run the ABC processes on other build nodes. The -cwd directories\n");
+		log("        must be visible to the remote nodes under the same path. Not available\n");
+		log("        when ABC is linked into Yosys.\n");
 		log("\n");
 		log("Note that this is a logic optimization pass within Yosys that is calling ABC\n");
 		log("internally. This is not going to \"run ABC on your design\". It will instead run\n");
@@ -413,9 +488,11 @@ struct Abc9ExePass : public Pass {
 		std::string exe_file = yosys_abc_executable;
 		std::string script_file, clk_str, box_file, lut_file;
 		std::string delay_target, lutin_shared = "-S 1", wire_delay;
-		std::string tempdir_name;
+		std::vector<std::string> tempdir_names;
+		std::string cache_dir, dispatch_cmd;
 		bool fast_mode = false, dff_mode = false;
 		bool show_tempdir = false;
+		int max_jobs = 0;
 		vector<int> lut_costs;
 
 #if 0
@@ -426,6 +503,7 @@ struct Abc9ExePass : public Pass {
 		std::string lut_arg, luts_arg;
 		exe_file = design->scratchpad_get_string("abc9.exe", exe_file /* inherit default value if not set */);
 		script_file = design->scratchpad_get_string("abc9.script", script_file);
+		cache_dir = design->scratchpad_get_string("abc9.cache", cache_dir);
 		if (design->scratchpad.count("abc9.D")) {
 			delay_target = "-D " + design->scratchpad_get_string("abc9.D");
 		}
@@ -496,13 +574,34 @@ struct Abc9ExePass : public Pass {
 				continue;
 			}
 			if (arg == "-cwd" && argidx+1 < args.size()) {
-				tempdir_name = args[++argidx];
+				tempdir_names.push_back(args[++argidx]);
+				continue;
+			}
+			if (arg == "-j" && argidx+1 < args.size()) {
+				max_jobs = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-cache" && argidx+1 < args.size()) {
+				cache_dir = args[++argidx];
+				continue;
+			}
+			if (arg == "-dispatch" && argidx+1 < args.size()) {
+				dispatch_cmd = args[++argidx];
+				if (GetSize(dispatch_cmd) >= 2 && dispatch_cmd.front() == '"' && dispatch_cmd.back() == '"')
+					dispatch_cmd = dispatch_cmd.substr(1, GetSize(dispatch_cmd) - 2);
 				continue;
 			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+#ifdef YOSYS_LINK_ABC
+		if (!cache_dir.empty() || !dispatch_cmd.empty())
+			log_cmd_error("The -cache and -dispatch options need an external ABC executable.\n");
+#endif
+		if (!cache_dir.empty() && !check_directory_exists(cache_dir) && !create_directory(cache_dir))
+			log_cmd_error("Could not create the ABC cache directory `%s'.\n", cache_dir.c_str());
+
 		rewrite_filename(script_file);
 		if (!script_file.empty() && !is_absolute_path(script_file) && script_file[0] != '+')
 			script_file = std::string(pwd) + "/" + script_file;
@@ -556,13 +655,57 @@ struct Abc9ExePass : public Pass {
 		if (!box_file.empty() && !is_absolute_path(box_file) && box_file[0] != '+')
 			box_file = std::string(pwd) + "/" + box_file;
 
-		if (tempdir_name.empty())
+		if (tempdir_names.empty())
 			log_cmd_error("abc9_exe '-cwd' option is mandatory.\n");
 
+		std::vector<abc9_job_t> jobs(GetSize(tempdir_names));
+		for (int i = 0; i < GetSize(jobs); i++) {
+			jobs[i].tempdir_name = tempdir_names[i];
+			abc9_module_prepare(design, script_file, exe_file, lut_costs, dff_mode,
+					delay_target, lutin_shared, fast_mode,
+					box_file, lut_file, wire_delay, jobs[i]);
+		}
 
-		abc9_module(design, script_file, exe_file, lut_costs, dff_mode,
-				delay_target, lutin_shared, fast_mode, show_tempdir,
-				box_file, lut_file, wire_delay, tempdir_name);
+		int num_threads = max_jobs > 0 && !yosys_in_worker_thread() ? max_jobs : yosys_thread_count(GetSize(jobs));
+#ifdef YOSYS_LINK_ABC
+		// the linked ABC redirects stdout/stderr of the process
+		num_threads = 1;
+#endif
+
+		std::exception_ptr error;
+		try {
+			ThreadPool::run(GetSize(jobs), [&](int i) {
+				jobs[i].started = true;
+				jobs[i].abc9_log.begin();
+				try {
+					abc9_module_run(exe_file, show_tempdir, cache_dir, dispatch_cmd, jobs[i]);
+				} catch (...) {
+					jobs[i].abc9_log.end();
+					throw;
+				}
+				jobs[i].abc9_log.end();
+			}, num_threads);
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		// replaying a capture re-raises errors that were recorded by log_error()
+		for (auto &job : jobs) {
+			if (!job.started)
+				break;
+			log_header(design, "Executing ABC9.\n");
+			abc9_module_finish(job);
+		}
+		if (error)
+			std::rethrow_exception(error);
+
+		if (!cache_dir.empty()) {
+			int cache_hits = 0;
+			for (auto &job : jobs)
+				cache_hits += job.cache_hit;
+			log("ABC result cache: reused %d of %d mapped netlists (%.1f%% hit rate).\n",
+					cache_hits, GetSize(jobs), 100.0 * cache_hits / GetSize(jobs));
+		}
 	}
 } Abc9ExePass;
 
@@ -0,0 +1,100 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef ABC_CACHE_H
+#define ABC_CACHE_H
+
+#include "kernel/yosys.h"
+#include "libs/sha1/sha1.h"
+#include <fstream>
+
+YOSYS_NAMESPACE_BEGIN
+
+// A directory of ABC results shared by abc and abc9_exe (-cache). A result is
+// stored under the SHA1 of everything ABC reads: the executable name and the
+// contents of the script, the netlist and the libraries. The netlists use
+// generated net names only, and the paths of the temp dir and of the input
+// files are replaced by placeholders before hashing, so that a structurally
+// identical netlist hits the cache in later runs and in other designs.
+struct AbcCache
+{
+	static std::string key(const std::string &exe_file, const std::string &tempdir_name, const std::vector<std::string> &files)
+	{
+		std::vector<std::pair<std::string, std::string>> paths;
+		paths.emplace_back(tempdir_name, "<abc-temp-dir>");
+		for (auto &filename : files)
+			if (filename.compare(0, GetSize(tempdir_name), tempdir_name) != 0)
+				paths.emplace_back(filename, stringf("<input-%d>", GetSize(paths)));
+
+		SHA1 sha1;
+		sha1.update(exe_file);
+		for (auto &filename : files) {
+			std::ifstream f(filename, std::ios::binary);
+			if (f.fail())
+				continue;
+			std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+			std::string name = filename;
+			for (auto &it : paths) {
+				replace_all(content, it.first, it.second);
+				replace_all(name, it.first, it.second);
+			}
+			sha1.update(stringf("%s %zu\n", name.c_str(), content.size()));
+			sha1.update(content);
+		}
+		return sha1.final();
+	}
+
+	static void replace_all(std::string &str, const std::string &from, const std::string &to)
+	{
+		for (size_t pos = str.find(from); pos != std::string::npos; pos = str.find(from, pos + GetSize(to)))
+			str.replace(pos, GetSize(from), to);
+	}
+
+	static bool copy_file(const std::string &from, const std::string &to)
+	{
+		std::ifstream in(from, std::ios::binary);
+		if (in.fail())
+			return false;
+		std::ofstream out(to, std::ios::binary);
+		out << in.rdbuf();
+		return !out.fail();
+	}
+
+	// Copies a cached result to output_file, returns false on a miss.
+	static bool fetch(const std::string &cache_dir, const std::string &key, const std::string &output_file)
+	{
+		return copy_file(stringf("%s/%s", cache_dir.c_str(), key.c_str()), output_file);
+	}
+
+	// Adds a result to the cache. The file is written under a temporary name
+	// and then renamed, so that concurrent runs never read a partial result.
+	static void store(const std::string &cache_dir, const std::string &key, const std::string &output_file)
+	{
+		std::string cached_file = stringf("%s/%s", cache_dir.c_str(), key.c_str());
+		std::string temp_file = make_temp_file(cached_file + "-XXXXXX");
+		if (!copy_file(output_file, temp_file) || rename(temp_file.c_str(), cached_file.c_str()) != 0) {
+			remove(temp_file.c_str());
+			log_warning("ABC: failed to add result to cache `%s'.\n", cached_file.c_str());
+		}
+	}
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -75,15 +75,10 @@ struct AigmapPass : public Pass {
 			pool<IdString> new_sel;
 			for (auto cell : module->selected_cells())
 			{
-				Aig aig(cell);
+				const Aig &aig = Aig::cached(cell);
 
-				if (cell->type.in(ID($_AND_), ID($_NOT_)))
-					aig.name.clear();
-
-				if (nand_mode && cell->type == ID($_NAND_))
-					aig.name.clear();
-
-				if (aig.name.empty()) {
+				if (aig.name.empty() || cell->type.in(ID($_AND_), ID($_NOT_)) ||
+						(nand_mode && cell->type == ID($_NAND_))) {
 					not_replaced_count++;
 					stat_not_replaced[cell->type]++;
 					if (select_mode)
@@ -20,6 +20,7 @@
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
 #include "kernel/macc.h"
+#include "kernel/profiler.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -34,6 +35,7 @@ struct AlumaccWorker
 		RTLIL::Cell *cell;
 		RTLIL::SigSpec y;
 		int users;
+		int id;
 	};
 
 	struct alunode_t
@@ -114,6 +116,9 @@ struct AlumaccWorker
 	dict<RTLIL::SigSig, pool<alunode_t*, hash_ptr_ops>> sig_alu;
 	int macc_counter, alu_counter;
 
+	// replaced cells, removed at the end of run()
+	std::vector<RTLIL::Cell*> removed_cells;
+
 	AlumaccWorker(RTLIL::Module *module) : module(module), sigmap(module)
 	{
 		macc_counter = 0;
@@ -222,58 +227,85 @@ struct AlumaccWorker
 		return acc_shift > width;
 	}
 
+	// Merges each node into the node that uses its output, if that is the
+	// only user. The nodes are merged bottom-up (depth-first over the ports,
+	// without recursion) so that the overflow check sees the complete macc of
+	// a node, and every port is looked at once.
 	void merge_macc()
 	{
-		while (1)
-		{
-			pool<maccnode_t*, hash_ptr_ops> delete_nodes;
+		struct frame_t {
+			maccnode_t *node;
+			int port;
+			std::vector<Macc::port_t> ports;
+		};
+
+		std::vector<maccnode_t*> nodes;
+		for (auto &it : sig_macc) {
+			it.second->id = GetSize(nodes);
+			nodes.push_back(it.second);
+		}
 
-			for (auto &it : sig_macc)
-			{
-				auto n = it.second;
+		// 0: not visited, 1: on the stack, 2: merged with its inputs
+		std::vector<int> state(GetSize(nodes));
+		std::vector<bool> merged(GetSize(nodes));
 
-				if (delete_nodes.count(n))
-					continue;
+		for (auto root : nodes)
+		{
+			if (state[root->id])
+				continue;
 
-				for (int i = 0; i < GetSize(n->macc.ports); i++)
-				{
-					auto &port = n->macc.ports[i];
+			std::vector<frame_t> stack;
+			stack.push_back(frame_t{root, 0, {}});
+			state[root->id] = 1;
 
-					if (GetSize(port.in_b) > 0 || sig_macc.count(port.in_a) == 0)
-						continue;
+			while (!stack.empty())
+			{
+				frame_t &f = stack.back();
+				maccnode_t *n = f.node;
 
-					auto other_n = sig_macc.at(port.in_a);
+				if (f.port == GetSize(n->macc.ports)) {
+					n->macc.ports.swap(f.ports);
+					state[n->id] = 2;
+					stack.pop_back();
+					continue;
+				}
 
-					if (other_n->users > 1)
-						continue;
+				auto &port = n->macc.ports[f.port];
+				maccnode_t *other_n = nullptr;
+				if (GetSize(port.in_b) == 0) {
+					auto it = sig_macc.find(port.in_a);
+					if (it != sig_macc.end() && it->second->users <= 1 && state[it->second->id] != 1 && !merged[it->second->id])
+						other_n = it->second;
+				}
 
-					if (GetSize(other_n->y) != GetSize(n->y) && macc_may_overflow(other_n->macc, GetSize(other_n->y), port.is_signed))
-						continue;
+				if (other_n != nullptr && state[other_n->id] == 0) {
+					state[other_n->id] = 1;
+					stack.push_back(frame_t{other_n, 0, {}});
+					continue;
+				}
 
-					log("  merging $macc model for %s into %s.\n", log_id(other_n->cell), log_id(n->cell));
+				f.port++;
+				if (other_n == nullptr || (GetSize(other_n->y) != GetSize(n->y) && macc_may_overflow(other_n->macc, GetSize(other_n->y), port.is_signed))) {
+					f.ports.push_back(port);
+					continue;
+				}
 
-					bool do_subtract = port.do_subtract;
-					for (int j = 0; j < GetSize(other_n->macc.ports); j++) {
-						if (do_subtract)
-							other_n->macc.ports[j].do_subtract = !other_n->macc.ports[j].do_subtract;
-						if (j == 0)
-							n->macc.ports[i--] = other_n->macc.ports[j];
-						else
-							n->macc.ports.push_back(other_n->macc.ports[j]);
-					}
+				log("  merging $macc model for %s into %s.\n", log_id(other_n->cell), log_id(n->cell));
 
-					delete_nodes.insert(other_n);
+				for (auto other_port : other_n->macc.ports) {
+					if (port.do_subtract)
+						other_port.do_subtract = !other_port.do_subtract;
+					f.ports.push_back(other_port);
 				}
+				merged[other_n->id] = true;
 			}
+		}
 
-			if (delete_nodes.empty())
-				break;
-
-			for (auto n : delete_nodes) {
+		for (auto n : nodes)
+			if (merged[n->id]) {
 				sig_macc.erase(n->y);
 				delete n;
 			}
-		}
 	}
 
 	void macc_to_alu()
@@ -376,7 +408,7 @@ struct AlumaccWorker
 			n->macc.to_cell(cell);
 			cell->setPort(ID::Y, n->y);
 			cell->fixup_parameters();
-			module->remove(n->cell);
+			removed_cells.push_back(n->cell);
 			delete n;
 		}
 
@@ -531,7 +563,7 @@ struct AlumaccWorker
 
 		delete_node:
 			for (auto c : n->cells)
-				module->remove(c);
+				removed_cells.push_back(c);
 			delete n;
 		}
 
@@ -550,6 +582,9 @@ struct AlumaccWorker
 		extract_cmp_alu();
 		replace_alu();
 
+		for (auto cell : removed_cells)
+			module->remove(cell);
+
 		log("  created %d $alu and %d $macc cells.\n", alu_counter, macc_counter);
 	}
 };
@@ -582,6 +617,7 @@ struct AlumaccPass : public Pass {
 
 		for (auto mod : design->selected_modules())
 			if (!mod->has_processes_warn()) {
+				PassProfiler::ModuleScope profile_scope(mod);
 				AlumaccWorker worker(mod);
 				worker.run();
 			}
@@ -61,6 +61,24 @@ synth -top my_design -booth
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// The multiplier for one combination of operand width, result width and
+// signedness. It is built once in a scratch module and then copied for each
+// $mul cell of that shape. Signals are stored as bit indices, numbering the
+// bits of A, B, Y and then the internal wires, or as -1 - state for constants.
+struct BoothStamp {
+	struct StampCell {
+		IdString type;
+		dict<IdString, Const> parameters, attributes;
+		std::vector<std::pair<IdString, std::vector<int>>> connections;
+	};
+
+	int num_internal = 0;
+	std::vector<StampCell> cells;
+	std::vector<std::pair<std::vector<int>, std::vector<int>>> connections;
+};
+
+typedef dict<std::tuple<int, int, bool>, BoothStamp> BoothStamps;
+
 struct BoothPassWorker {
 
 	RTLIL::Module *module;
@@ -69,6 +87,11 @@ struct BoothPassWorker {
 	bool lowpower = false;
 	bool mapped_cpa = false;
 
+	// the multipliers built so far and the design that holds the scratch
+	// modules they are built in, shared by the workers of one pass run
+	BoothStamps *stamps = nullptr;
+	RTLIL::Design *scratch = nullptr;
+
 	BoothPassWorker(RTLIL::Module *module) : module(module), sigmap(module) { booth_counter = 0; }
 
 	// Booth unsigned decoder lsb
@@ -278,26 +301,116 @@ struct BoothPassWorker {
 			}
 			log_assert(GetSize(Y) == required_op_size);
 
-			if (!lowpower)
-				CreateBoothMult(module,
-					A, // multiplicand
-					B, // multiplier(scanned)
-					Y, // result
-					is_signed
-				);
-			else
-				CreateBoothLowpowerMult(module,
-					A, // multiplicand
-					B, // multiplier(scanned)
-					Y, // result
-					is_signed
-				);
+			StampMult(GetStamp(x_sz_revised, required_op_size, is_signed), A, B, Y);
 
 			module->remove(cell);
 			booth_counter++;
 		}
 	}
 
+	const BoothStamp &GetStamp(int width, int y_width, bool is_signed)
+	{
+		auto key = std::make_tuple(width, y_width, is_signed);
+		auto it = stamps->find(key);
+		if (it != stamps->end())
+			return it->second;
+
+		RTLIL::Module *tpl = scratch->addModule(NEW_ID);
+		RTLIL::Wire *a = tpl->addWire(ID::A, width);
+		RTLIL::Wire *b = tpl->addWire(ID::B, width);
+		RTLIL::Wire *y = tpl->addWire(ID::Y, y_width);
+
+		BoothPassWorker worker(tpl);
+		worker.lowpower = lowpower;
+		worker.mapped_cpa = mapped_cpa;
+		if (!lowpower)
+			worker.CreateBoothMult(tpl,
+				a, // multiplicand
+				b, // multiplier(scanned)
+				y, // result
+				is_signed
+			);
+		else
+			worker.CreateBoothLowpowerMult(tpl,
+				a, // multiplicand
+				b, // multiplier(scanned)
+				y, // result
+				is_signed
+			);
+
+		dict<SigBit, int> index;
+		int num_bits = 0;
+		for (auto wire : {a, b, y})
+			for (int i = 0; i < wire->width; i++)
+				index[SigBit(wire, i)] = num_bits++;
+		int num_ports = num_bits;
+		for (auto wire : tpl->wires())
+			if (wire != a && wire != b && wire != y)
+				for (int i = 0; i < wire->width; i++)
+					index[SigBit(wire, i)] = num_bits++;
+
+		auto encode = [&](const SigSpec &sig) {
+			std::vector<int> bits;
+			bits.reserve(GetSize(sig));
+			for (auto bit : sig)
+				bits.push_back(bit.wire ? index.at(bit) : -1 - int(bit.data));
+			return bits;
+		};
+
+		BoothStamp &stamp = (*stamps)[key];
+		stamp.num_internal = num_bits - num_ports;
+		for (auto cell : tpl->cells()) {
+			stamp.cells.emplace_back();
+			BoothStamp::StampCell &c = stamp.cells.back();
+			c.type = cell->type;
+			c.parameters = cell->parameters;
+			c.attributes = cell->attributes;
+			for (auto &conn : cell->connections())
+				c.connections.emplace_back(conn.first, encode(conn.second));
+		}
+		for (auto &conn : tpl->connections())
+			stamp.connections.emplace_back(encode(conn.first), encode(conn.second));
+
+		scratch->remove(tpl);
+		return stamp;
+	}
+
+	void StampMult(const BoothStamp &stamp, SigSpec X, SigSpec Y, SigSpec Z)
+	{
+		std::vector<SigBit> bits;
+		bits.reserve(GetSize(X) + GetSize(Y) + GetSize(Z) + stamp.num_internal);
+		for (auto sig : {&X, &Y, &Z})
+			for (auto bit : *sig)
+				bits.push_back(bit);
+		if (stamp.num_internal > 0) {
+			RTLIL::Wire *internal = module->addWire(NEW_ID, stamp.num_internal);
+			for (int i = 0; i < stamp.num_internal; i++)
+				bits.push_back(SigBit(internal, i));
+		}
+
+		auto decode = [&](const std::vector<int> &indices) {
+			std::vector<SigBit> sig;
+			sig.reserve(GetSize(indices));
+			for (int i : indices)
+				sig.push_back(i >= 0 ? bits[i] : SigBit(State(-1 - i)));
+			return SigSpec(sig);
+		};
+
+		std::string prefix = NEW_ID.str();
+		module->begin_batch(GetSize(stamp.cells), 1, GetSize(stamp.connections));
+		for (int i = 0; i < GetSize(stamp.cells); i++) {
+			const BoothStamp::StampCell &c = stamp.cells[i];
+			RTLIL::Cell *cell = module->addCell(stringf("%s$%d", prefix.c_str(), i), c.type);
+			cell->parameters = c.parameters;
+			cell->attributes = c.attributes;
+			for (auto &conn : c.connections)
+				cell->setPort(conn.first, decode(conn.second));
+		}
+		for (auto &conn : stamp.connections)
+			module->connect(decode(conn.first), decode(conn.second));
+		module->commit_batch();
+	}
+
 	SigSig WallaceSum(int width, std::vector<SigSpec> summands)
 	{
 		for (auto &s : summands)
@@ -1173,12 +1286,16 @@ struct BoothPass : public Pass {
 		extra_args(args, argidx, design);
 
 		int total = 0;
+		BoothStamps stamps;
+		RTLIL::Design scratch;
 
 		for (auto mod : design->selected_modules()) {
 			if (!mod->has_processes_warn()) {
 				BoothPassWorker worker(mod);
 				worker.mapped_cpa = mapped_cpa;
 				worker.lowpower = lowpower;
+				worker.stamps = &stamps;
+				worker.scratch = &scratch;
 				worker.run();
 				total += worker.booth_counter;
 			}
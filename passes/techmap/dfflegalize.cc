@@ -21,6 +21,8 @@
 #include "kernel/sigtools.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -240,7 +242,7 @@ struct DffLegalizePass : public Pass {
 		}
 	}
 
-	int get_initmask(FfData &ff) {
+	int get_initmask(const FfData &ff) {
 		int res = 0;
 		if (ff.val_init[0] == State::S0)
 			res = INIT_0;
@@ -945,10 +947,7 @@ struct DffLegalizePass : public Pass {
 		pol = !pol;
 	}
 
-	void legalize_finish(FfData &ff) {
-		int ff_type = get_ff_type(ff);
-		int initmask = get_initmask(ff);
-		log_assert(supported_cells[ff_type] & initmask);
+	int get_ff_neg(const FfData &ff) {
 		int ff_neg = 0;
 		if (ff.has_sr) {
 			if (!ff.pol_clr)
@@ -976,6 +975,31 @@ struct DffLegalizePass : public Pass {
 			if (!ff.pol_ce)
 				ff_neg |= NEG_CE;
 		}
+		return ff_neg;
+	}
+
+	// Returns true if legalize_ff() would leave the FF as it is, i.e. if the
+	// cell is supported with its polarities and init value, and no enable or
+	// reset has to be unmapped. This only reads the module.
+	bool is_legal(const FfData &ff) {
+		if (ff.has_gclk || !ff.is_fine)
+			return true;
+		if (mince && ff.has_ce && ff.sig_ce[0].wire && ce_used.at(ff.sig_ce[0], 0) < mince)
+			return false;
+		if (minsrst && ff.has_srst && ff.sig_srst[0].wire && srst_used.at(ff.sig_srst[0], 0) < minsrst)
+			return false;
+		if ((ff.has_arst && !ff.val_arst.is_fully_def()) || (ff.has_srst && !ff.val_srst.is_fully_def()))
+			return false;
+		if (!ff.has_clk && !ff.has_aload && !ff.has_sr)
+			return false;
+		return supported_cells_neg[get_ff_type(ff)][get_ff_neg(ff)] & get_initmask(ff);
+	}
+
+	void legalize_finish(FfData &ff) {
+		int ff_type = get_ff_type(ff);
+		int initmask = get_initmask(ff);
+		log_assert(supported_cells[ff_type] & initmask);
+		int ff_neg = get_ff_neg(ff);
 		if (!(supported_cells_neg[ff_type][ff_neg] & initmask)) {
 			// Cell is supported, but not with those polarities.
 			// Will need to add some inverters.
@@ -1188,6 +1212,7 @@ unrecognized:
 
 		for (auto module : design->selected_modules())
 		{
+			PassProfiler::ModuleScope profile_scope(module);
 			sigmap.set(module);
 			initvals.set(&sigmap, module);
 
@@ -1206,11 +1231,35 @@ unrecognized:
 						srst_used[ff.sig_srst[0]] += ff.width;
 				}
 			}
+
+			std::vector<Cell*> ff_cells;
 			for (auto cell : module->selected_cells())
-			{
-				if (!RTLIL::builtin_ff_cell_types().count(cell->type))
+				if (RTLIL::builtin_ff_cell_types().count(cell->type))
+					ff_cells.push_back(cell);
+
+			// Legalizing one FF does not change whether another one is legal,
+			// so this is decided upfront for all FFs in parallel. FFs that are
+			// already legal are not rebuilt by FfData::emit().
+			std::vector<char> needs_legalize(GetSize(ff_cells));
+			const int job_size = 1024;
+			int num_jobs = (GetSize(ff_cells) + job_size - 1) / job_size;
+			auto check_job = [&](int i) {
+				for (int k = i * job_size; k < std::min((i + 1) * job_size, GetSize(ff_cells)); k++) {
+					FfData ff(&initvals, ff_cells[k]);
+					needs_legalize[k] = !is_legal(ff);
+				}
+			};
+
+			int num_threads = yosys_thread_count(num_jobs);
+			// FfInitVals lookups go through the SigMap
+			if (num_threads > 1)
+				sigmap.compress();
+			ThreadPool::run(num_jobs, check_job, num_threads);
+
+			for (int k = 0; k < GetSize(ff_cells); k++) {
+				if (!needs_legalize[k])
 					continue;
-				FfData ff(&initvals, cell);
+				FfData ff(&initvals, ff_cells[k]);
 				legalize_ff(ff);
 			}
 		}
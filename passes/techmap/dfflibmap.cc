@@ -76,7 +76,7 @@ static void logmap_all()
 	logmap(ID($_DFFSR_PPP_));
 }
 
-static bool parse_pin(LibertyAst *cell, LibertyAst *attr, std::string &pin_name, bool &pin_pol)
+static bool parse_pin(const LibertyAst *cell, const LibertyAst *attr, std::string &pin_name, bool &pin_pol)
 {
 	if (cell == nullptr || attr == nullptr || attr->value.empty())
 		return false;
@@ -115,9 +115,9 @@ static bool parse_pin(LibertyAst *cell, LibertyAst *attr, std::string &pin_name,
 	return false;
 }
 
-static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has_reset, bool rstpol, bool rstval)
+static void find_cell(const LibertyAst *ast, IdString cell_type, bool clkpol, bool has_reset, bool rstpol, bool rstval)
 {
-	LibertyAst *best_cell = nullptr;
+	const LibertyAst *best_cell = nullptr;
 	std::map<std::string, char> best_cell_ports;
 	int best_cell_pins = 0;
 	bool best_cell_noninv = false;
@@ -131,11 +131,11 @@ static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has
 		if (cell->id != "cell" || cell->args.size() != 1)
 			continue;
 
-		LibertyAst *dn = cell->find("dont_use");
+		const LibertyAst *dn = cell->find("dont_use");
 		if (dn != nullptr && dn->value == "true")
 			continue;
 
-		LibertyAst *ff = cell->find("ff");
+		const LibertyAst *ff = cell->find("ff");
 		if (ff == nullptr)
 			continue;
 
@@ -162,7 +162,7 @@ static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has
 		this_cell_ports[cell_next_pin] = 'D';
 
 		double area = 0;
-		LibertyAst *ar = cell->find("area");
+		const LibertyAst *ar = cell->find("area");
 		if (ar != nullptr && !ar->value.empty())
 			area = atof(ar->value.c_str());
 
@@ -174,7 +174,7 @@ static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has
 			if (pin->id != "pin" || pin->args.size() != 1)
 				continue;
 
-			LibertyAst *dir = pin->find("direction");
+			const LibertyAst *dir = pin->find("direction");
 			if (dir == nullptr || dir->value == "internal")
 				continue;
 			num_pins++;
@@ -182,7 +182,7 @@ static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has
 			if (dir->value == "input" && this_cell_ports.count(pin->args[0]) == 0)
 				goto continue_cell_loop;
 
-			LibertyAst *func = pin->find("function");
+			const LibertyAst *func = pin->find("function");
 			if (dir->value == "output" && func != nullptr) {
 				std::string value = func->value;
 				for (size_t pos = value.find_first_of("\" \t"); pos != std::string::npos; pos = value.find_first_of("\" \t"))
@@ -227,9 +227,9 @@ static void find_cell(LibertyAst *ast, IdString cell_type, bool clkpol, bool has
 	}
 }
 
-static void find_cell_sr(LibertyAst *ast, IdString cell_type, bool clkpol, bool setpol, bool clrpol)
+static void find_cell_sr(const LibertyAst *ast, IdString cell_type, bool clkpol, bool setpol, bool clrpol)
 {
-	LibertyAst *best_cell = nullptr;
+	const LibertyAst *best_cell = nullptr;
 	std::map<std::string, char> best_cell_ports;
 	int best_cell_pins = 0;
 	bool best_cell_noninv = false;
@@ -243,11 +243,11 @@ static void find_cell_sr(LibertyAst *ast, IdString cell_type, bool clkpol, bool
 		if (cell->id != "cell" || cell->args.size() != 1)
 			continue;
 
-		LibertyAst *dn = cell->find("dont_use");
+		const LibertyAst *dn = cell->find("dont_use");
 		if (dn != nullptr && dn->value == "true")
 			continue;
 
-		LibertyAst *ff = cell->find("ff");
+		const LibertyAst *ff = cell->find("ff");
 		if (ff == nullptr)
 			continue;
 
@@ -270,7 +270,7 @@ static void find_cell_sr(LibertyAst *ast, IdString cell_type, bool clkpol, bool
 		this_cell_ports[cell_next_pin] = 'D';
 
 		double area = 0;
-		LibertyAst *ar = cell->find("area");
+		const LibertyAst *ar = cell->find("area");
 		if (ar != nullptr && !ar->value.empty())
 			area = atof(ar->value.c_str());
 
@@ -282,7 +282,7 @@ static void find_cell_sr(LibertyAst *ast, IdString cell_type, bool clkpol, bool
 			if (pin->id != "pin" || pin->args.size() != 1)
 				continue;
 
-			LibertyAst *dir = pin->find("direction");
+			const LibertyAst *dir = pin->find("direction");
 			if (dir == nullptr || dir->value == "internal")
 				continue;
 			num_pins++;
@@ -290,7 +290,7 @@ static void find_cell_sr(LibertyAst *ast, IdString cell_type, bool clkpol, bool
 			if (dir->value == "input" && this_cell_ports.count(pin->args[0]) == 0)
 				goto continue_cell_loop;
 
-			LibertyAst *func = pin->find("function");
+			const LibertyAst *func = pin->find("function");
 			if (dir->value == "output" && func != nullptr) {
 				std::string value = func->value;
 				for (size_t pos = value.find_first_of("\" \t"); pos != std::string::npos; pos = value.find_first_of("\" \t"))
@@ -484,33 +484,30 @@ struct DfflibmapPass : public Pass {
 		if (liberty_file.empty())
 			log_cmd_error("Missing `-liberty liberty_file' option!\n");
 
-		std::ifstream f;
-		f.open(liberty_file.c_str());
-		if (f.fail())
+		std::shared_ptr<const LibertyAst> ast = liberty_parse_file(liberty_file, liberty_timing_groups);
+		if (ast == nullptr)
 			log_cmd_error("Can't open liberty file `%s': %s\n", liberty_file.c_str(), strerror(errno));
-		LibertyParser libparser(f);
-		f.close();
-
-		find_cell(libparser.ast, ID($_DFF_N_), false, false, false, false);
-		find_cell(libparser.ast, ID($_DFF_P_), true, false, false, false);
-
-		find_cell(libparser.ast, ID($_DFF_NN0_), false, true, false, false);
-		find_cell(libparser.ast, ID($_DFF_NN1_), false, true, false, true);
-		find_cell(libparser.ast, ID($_DFF_NP0_), false, true, true, false);
-		find_cell(libparser.ast, ID($_DFF_NP1_), false, true, true, true);
-		find_cell(libparser.ast, ID($_DFF_PN0_), true, true, false, false);
-		find_cell(libparser.ast, ID($_DFF_PN1_), true, true, false, true);
-		find_cell(libparser.ast, ID($_DFF_PP0_), true, true, true, false);
-		find_cell(libparser.ast, ID($_DFF_PP1_), true, true, true, true);
-
-		find_cell_sr(libparser.ast, ID($_DFFSR_NNN_), false, false, false);
-		find_cell_sr(libparser.ast, ID($_DFFSR_NNP_), false, false, true);
-		find_cell_sr(libparser.ast, ID($_DFFSR_NPN_), false, true, false);
-		find_cell_sr(libparser.ast, ID($_DFFSR_NPP_), false, true, true);
-		find_cell_sr(libparser.ast, ID($_DFFSR_PNN_), true, false, false);
-		find_cell_sr(libparser.ast, ID($_DFFSR_PNP_), true, false, true);
-		find_cell_sr(libparser.ast, ID($_DFFSR_PPN_), true, true, false);
-		find_cell_sr(libparser.ast, ID($_DFFSR_PPP_), true, true, true);
+
+		find_cell(ast.get(), ID($_DFF_N_), false, false, false, false);
+		find_cell(ast.get(), ID($_DFF_P_), true, false, false, false);
+
+		find_cell(ast.get(), ID($_DFF_NN0_), false, true, false, false);
+		find_cell(ast.get(), ID($_DFF_NN1_), false, true, false, true);
+		find_cell(ast.get(), ID($_DFF_NP0_), false, true, true, false);
+		find_cell(ast.get(), ID($_DFF_NP1_), false, true, true, true);
+		find_cell(ast.get(), ID($_DFF_PN0_), true, true, false, false);
+		find_cell(ast.get(), ID($_DFF_PN1_), true, true, false, true);
+		find_cell(ast.get(), ID($_DFF_PP0_), true, true, true, false);
+		find_cell(ast.get(), ID($_DFF_PP1_), true, true, true, true);
+
+		find_cell_sr(ast.get(), ID($_DFFSR_NNN_), false, false, false);
+		find_cell_sr(ast.get(), ID($_DFFSR_NNP_), false, false, true);
+		find_cell_sr(ast.get(), ID($_DFFSR_NPN_), false, true, false);
+		find_cell_sr(ast.get(), ID($_DFFSR_NPP_), false, true, true);
+		find_cell_sr(ast.get(), ID($_DFFSR_PNN_), true, false, false);
+		find_cell_sr(ast.get(), ID($_DFFSR_PNP_), true, false, true);
+		find_cell_sr(ast.get(), ID($_DFFSR_PPN_), true, true, false);
+		find_cell_sr(ast.get(), ID($_DFFSR_PPP_), true, true, true);
 
 		log("  final dff cell mappings:\n");
 		logmap_all();
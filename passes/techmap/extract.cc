@@ -652,11 +652,16 @@ struct ExtractPass : public Pass {
 
 			std::sort(needle_list.begin(), needle_list.end(), compareSortNeedleList);
 
+			std::vector<std::string> needle_ids, haystack_ids;
 			for (auto needle : needle_list)
-			for (auto &haystack_it : haystack_map) {
-				log("Solving for %s in %s.\n", ("needle_" + RTLIL::unescape_id(needle->name)).c_str(), haystack_it.first.c_str());
-				solver.solve(results, "needle_" + RTLIL::unescape_id(needle->name), haystack_it.first, false);
-			}
+				needle_ids.push_back("needle_" + RTLIL::unescape_id(needle->name));
+			for (auto &haystack_it : haystack_map)
+				haystack_ids.push_back(haystack_it.first);
+
+			for (auto &needle_id : needle_ids)
+			for (auto &haystack_id : haystack_ids)
+				log("Solving for %s in %s.\n", needle_id.c_str(), haystack_id.c_str());
+			solver.solve(results, needle_ids, haystack_ids, false);
 			log("Found %d matches.\n", GetSize(results));
 
 			if (results.size() > 0)
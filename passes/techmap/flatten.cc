@@ -20,6 +20,7 @@
 #include "kernel/yosys.h"
 #include "kernel/utils.h"
 #include "kernel/sigtools.h"
+#include "kernel/memlimit.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,41 +29,64 @@
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
-IdString concat_name(RTLIL::Cell *cell, IdString object_name)
+// Builds the names of the objects copied into the parent module from the
+// instance name and the object names in the flattened module. The instance
+// specific parts are prepared once instead of for every object.
+struct FlattenNames
 {
-	if (object_name[0] == '\\')
-		return stringf("%s.%s", cell->name.c_str(), object_name.c_str() + 1);
-	else {
-		std::string object_name_str = object_name.str();
-		if (object_name_str.substr(0, 8) == "$flatten")
-			object_name_str.erase(0, 8);
-		return stringf("$flatten%s.%s", cell->name.c_str(), object_name_str.c_str());
+	RTLIL::Cell *cell;
+	std::string public_prefix, private_prefix, hdlname_prefix, buffer;
+	RTLIL::SrcSet cell_src;
+
+	FlattenNames(RTLIL::Cell *cell) : cell(cell)
+	{
+		public_prefix = cell->name.str() + ".";
+		private_prefix = "$flatten" + public_prefix;
+		if (cell->name[0] == '\\')
+			hdlname_prefix = cell->name.str().substr(1);
+		cell_src = cell->get_src_set();
 	}
-}
 
-template<class T>
-IdString map_name(RTLIL::Cell *cell, T *object)
-{
-	return cell->module->uniquify(concat_name(cell, object->name));
-}
+	IdString concat(IdString object_name)
+	{
+		const char *p = object_name.c_str();
+		if (*p == '\\') {
+			buffer = public_prefix;
+			buffer += p + 1;
+		} else {
+			buffer = private_prefix;
+			buffer += strncmp(p, "$flatten", 8) ? p : p + 8;
+		}
+		return buffer;
+	}
 
-template<class T>
-void map_attributes(RTLIL::Cell *cell, T *object, IdString orig_object_name)
-{
-	if (object->has_attribute(ID::src))
-		object->add_strpool_attribute(ID::src, cell->get_strpool_attribute(ID::src));
-
-	// Preserve original names via the hdlname attribute, but only for objects with a fully public name.
-	if (cell->name[0] == '\\' && (object->has_attribute(ID::hdlname) || orig_object_name[0] == '\\')) {
-		std::vector<std::string> hierarchy;
-		if (object->has_attribute(ID::hdlname))
-			hierarchy = object->get_hdlname_attribute();
-		else
-			hierarchy.push_back(orig_object_name.str().substr(1));
-		hierarchy.insert(hierarchy.begin(), cell->name.str().substr(1));
-		object->set_hdlname_attribute(hierarchy);
+	template<class T>
+	IdString map(T *object)
+	{
+		return cell->module->uniquify(concat(object->name));
 	}
-}
+
+	template<class T>
+	void map_attributes(T *object, IdString orig_object_name)
+	{
+		cell_src.add_to(object);
+
+		// Preserve original names via the hdlname attribute, but only for objects with a fully public name.
+		if (!hdlname_prefix.empty()) {
+			auto it = object->attributes.find(ID::hdlname);
+			if (it != object->attributes.end()) {
+				std::string hdlname = it->second.decode_string();
+				if (hdlname.empty() || hdlname.front() == ' ' || hdlname.back() == ' ' || hdlname.find("  ") != std::string::npos) {
+					std::vector<std::string> hierarchy = object->get_hdlname_attribute();
+					hierarchy.insert(hierarchy.begin(), hdlname_prefix);
+					object->set_hdlname_attribute(hierarchy);
+				} else
+					it->second = RTLIL::Const(hdlname_prefix + " " + hdlname);
+			} else if (orig_object_name[0] == '\\')
+				object->set_string_attribute(ID::hdlname, hdlname_prefix + " " + orig_object_name.str().substr(1));
+		}
+	}
+};
 
 void map_sigspec(const dict<RTLIL::Wire*, RTLIL::Wire*> &map, RTLIL::SigSpec &sig, RTLIL::Module *into = nullptr)
 {
@@ -77,27 +101,57 @@ struct FlattenWorker
 {
 	bool ignore_wb = false;
 
+	// Data of a flattened module that is the same for all of its instances.
+	struct FlattenTemplate
+	{
+		dict<IdString, IdString> positional_ports;
+		pool<SigBit> driven;
+	};
+
+	dict<RTLIL::Module*, FlattenTemplate> templates;
+
+	const FlattenTemplate &flatten_template(RTLIL::Module *tpl)
+	{
+		auto it = templates.find(tpl);
+		if (it != templates.end())
+			return it->second;
+
+		FlattenTemplate &t = templates[tpl];
+		for (auto tpl_wire : tpl->wires())
+			if (tpl_wire->port_id > 0)
+				t.positional_ports.emplace(stringf("$%d", tpl_wire->port_id), tpl_wire->name);
+		for (auto tpl_cell : tpl->cells())
+			for (auto &tpl_conn : tpl_cell->connections())
+				if (tpl_cell->output(tpl_conn.first))
+					for (auto bit : tpl_conn.second)
+						t.driven.insert(bit);
+		for (auto &tpl_conn : tpl->connections())
+			for (auto bit : tpl_conn.first)
+				t.driven.insert(bit);
+		return t;
+	}
+
 	void flatten_cell(RTLIL::Design *design, RTLIL::Module *module, RTLIL::Cell *cell, RTLIL::Module *tpl, SigMap &sigmap, std::vector<RTLIL::Cell*> &new_cells)
 	{
+		const FlattenTemplate &t = flatten_template(tpl);
+		FlattenNames names(cell);
+
 		// Copy the contents of the flattened cell
 
 		dict<IdString, IdString> memory_map;
 		for (auto &tpl_memory_it : tpl->memories) {
-			RTLIL::Memory *new_memory = module->addMemory(map_name(cell, tpl_memory_it.second), tpl_memory_it.second);
-			map_attributes(cell, new_memory, tpl_memory_it.second->name);
+			RTLIL::Memory *new_memory = module->addMemory(names.map(tpl_memory_it.second), tpl_memory_it.second);
+			names.map_attributes(new_memory, tpl_memory_it.second->name);
 			memory_map[tpl_memory_it.first] = new_memory->name;
 			design->select(module, new_memory);
 		}
 
 		dict<RTLIL::Wire*, RTLIL::Wire*> wire_map;
-		dict<IdString, IdString> positional_ports;
+		wire_map.reserve(GetSize(tpl->wires_));
 		for (auto tpl_wire : tpl->wires()) {
-			if (tpl_wire->port_id > 0)
-				positional_ports.emplace(stringf("$%d", tpl_wire->port_id), tpl_wire->name);
-
 			RTLIL::Wire *new_wire = nullptr;
 			if (tpl_wire->name[0] == '\\') {
-				RTLIL::Wire *hier_wire = module->wire(concat_name(cell, tpl_wire->name));
+				RTLIL::Wire *hier_wire = module->wire(names.concat(tpl_wire->name));
 				if (hier_wire != nullptr && hier_wire->get_bool_attribute(ID::hierconn)) {
 					hier_wire->attributes.erase(ID::hierconn);
 					if (GetSize(hier_wire) < GetSize(tpl_wire)) {
@@ -109,19 +163,19 @@ struct FlattenWorker
 				}
 			}
 			if (new_wire == nullptr) {
-				new_wire = module->addWire(map_name(cell, tpl_wire), tpl_wire);
+				new_wire = module->addWire(names.map(tpl_wire), tpl_wire);
 				new_wire->port_input = new_wire->port_output = false;
 				new_wire->port_id = false;
 			}
 
-			map_attributes(cell, new_wire, tpl_wire->name);
+			names.map_attributes(new_wire, tpl_wire->name);
 			wire_map[tpl_wire] = new_wire;
 			design->select(module, new_wire);
 		}
 
 		for (auto &tpl_proc_it : tpl->processes) {
-			RTLIL::Process *new_proc = module->addProcess(map_name(cell, tpl_proc_it.second), tpl_proc_it.second);
-			map_attributes(cell, new_proc, tpl_proc_it.second->name);
+			RTLIL::Process *new_proc = module->addProcess(names.map(tpl_proc_it.second), tpl_proc_it.second);
+			names.map_attributes(new_proc, tpl_proc_it.second->name);
 			for (auto new_proc_sync : new_proc->syncs)
 				for (auto &memwr_action : new_proc_sync->mem_write_actions)
 					memwr_action.memid = memory_map.at(memwr_action.memid).str();
@@ -131,14 +185,14 @@ struct FlattenWorker
 		}
 
 		for (auto tpl_cell : tpl->cells()) {
-			RTLIL::Cell *new_cell = module->addCell(map_name(cell, tpl_cell), tpl_cell);
-			map_attributes(cell, new_cell, tpl_cell->name);
+			RTLIL::Cell *new_cell = module->addCell(names.map(tpl_cell), tpl_cell);
+			names.map_attributes(new_cell, tpl_cell->name);
 			if (new_cell->has_memid()) {
 				IdString memid = new_cell->getParam(ID::MEMID).decode_string();
 				new_cell->setParam(ID::MEMID, Const(memory_map.at(memid).str()));
 			} else if (new_cell->is_mem_cell()) {
 				IdString memid = new_cell->getParam(ID::MEMID).decode_string();
-				new_cell->setParam(ID::MEMID, Const(concat_name(cell, memid).str()));
+				new_cell->setParam(ID::MEMID, Const(names.concat(memid).str()));
 			}
 			auto rewriter = [&](RTLIL::SigSpec &sig) { map_sigspec(wire_map, sig); };
 			new_cell->rewrite_sigspecs(rewriter);
@@ -155,21 +209,11 @@ struct FlattenWorker
 
 		// Attach port connections of the flattened cell
 
-		pool<SigBit> tpl_driven;
-		for (auto tpl_cell : tpl->cells())
-			for (auto &tpl_conn : tpl_cell->connections())
-				if (tpl_cell->output(tpl_conn.first))
-					for (auto bit : tpl_conn.second)
-						tpl_driven.insert(bit);
-		for (auto &tpl_conn : tpl->connections())
-			for (auto bit : tpl_conn.first)
-				tpl_driven.insert(bit);
-
 		for (auto &port_it : cell->connections())
 		{
 			IdString port_name = port_it.first;
-			if (positional_ports.count(port_name) > 0)
-				port_name = positional_ports.at(port_name);
+			if (t.positional_ports.count(port_name) > 0)
+				port_name = t.positional_ports.at(port_name);
 			if (tpl->wire(port_name) == nullptr || tpl->wire(port_name)->port_id == 0) {
 				if (port_name.begins_with("$"))
 					log_error("Can't map port `%s' of cell `%s' to template `%s'!\n",
@@ -194,7 +238,7 @@ struct FlattenWorker
 			} else {
 				SigSpec sig_tpl = tpl_wire, sig_mod = port_it.second;
 				for (int i = 0; i < GetSize(sig_tpl) && i < GetSize(sig_mod); i++) {
-					if (tpl_driven.count(sig_tpl[i])) {
+					if (t.driven.count(sig_tpl[i])) {
 						new_conn.first.append(sig_mod[i]);
 						new_conn.second.append(sig_tpl[i]);
 					} else {
@@ -230,6 +274,21 @@ struct FlattenWorker
 
 		SigMap sigmap(module);
 		std::vector<RTLIL::Cell*> worklist = module->selected_cells();
+
+		// reserve space for the contents of the instances in the module
+		int num_cells = 0, num_wires = 0, num_connections = 0;
+		for (auto cell : worklist) {
+			RTLIL::Module *tpl = design->module(cell->type);
+			if (tpl != nullptr) {
+				num_cells += GetSize(tpl->cells_);
+				num_wires += GetSize(tpl->wires_);
+				num_connections += GetSize(tpl->connections_) + GetSize(cell->connections_);
+			}
+		}
+
+		templates.clear();
+		module->begin_batch(num_cells, num_wires, num_connections);
+
 		while (!worklist.empty())
 		{
 			RTLIL::Cell *cell = worklist.back();
@@ -263,6 +322,8 @@ struct FlattenWorker
 			// individual modules, this isn't the case, and the newly added cells might have to be flattened further.
 			flatten_cell(design, module, cell, tpl, sigmap, worklist);
 		}
+
+		module->commit_batch();
 	}
 };
 
@@ -331,6 +392,25 @@ struct FlattenPass : public Pass {
 		if (!topo_modules.sort())
 			log_error("Cannot flatten a design containing recursive instantiations.\n");
 
+		// fail before copying the modules if the result would not fit into
+		// the memory limit
+		if (MemLimit::limit_kb > 0) {
+			dict<RTLIL::Module*, int64_t> flat_bytes;
+			int64_t extra_bytes = 0;
+			for (auto module : topo_modules.sorted) {
+				int64_t own_bytes = MemLimit::module_bytes(module);
+				int64_t bytes = own_bytes;
+				for (auto cell : module->selected_cells()) {
+					auto it = flat_bytes.find(design->module(cell->type));
+					if (it != flat_bytes.end())
+						bytes += it->second;
+				}
+				flat_bytes[module] = bytes;
+				extra_bytes += bytes - own_bytes;
+			}
+			MemLimit::check(pass_name.c_str(), extra_bytes / 1024, design);
+		}
+
 		for (auto module : topo_modules.sorted)
 			worker.flatten_module(design, module, used_modules);
 
@@ -65,11 +65,12 @@
 // Notes on implementation:
 //
 // 1. To compute depth optimal packing, an intermediate representation is used, where each cell with n output bits is split into n graph
-// nodes. Each such graph node is represented directly with the wire bit (RTLIL::SigBit instance) that corresponds to the output bit
-// it is created from. Fan-in and fan-out are represented explicitly by edge lists derived from the RTLIL graph. This IR never changes
-// after it has been computed.
+// nodes. Each such graph node corresponds to the wire bit (RTLIL::SigBit instance) that it is created from, but is identified by a dense
+// integer index, so that all per-node data can be kept in flat arrays; `node_bits` and `node_ids` translate between the two. Fan-in and
+// fan-out are represented explicitly by adjacency lists in compressed sparse row form, derived from the RTLIL graph. This IR never
+// changes after it has been computed.
 //
-// In terms of data, this IR is comprised of `inputs`, `outputs`, `nodes`, `edges_fw` and `edges_bw` fields.
+// In terms of data, this IR is comprised of `inputs`, `outputs`, `node_bits`, `edges_fw` and `edges_bw` fields.
 //
 // We call this IR "gate IR".
 //
@@ -90,10 +91,13 @@
 //   c) The LUT fan-in is exactly the fan-in of its constituent gates minus the fan-out of its constituent gates.
 // The invariants are kept even for derealized LUTs, since the whole point of this IR is ease of packing, unpacking, and repacking LUTs.
 //
-// In terms of data, this IR is comprised of `lut_nodes` (the set of all realized LUTs), `lut_gates` (the map from a LUT to its
-// constituent gates), `lut_edges_fw` and `lut_edges_bw` fields. The `inputs` and `outputs` fields are shared with the gate IR.
+// In terms of data, this IR is comprised of `lut_nodes` (the realized LUTs), `lut_gates` (the constituent gates of each LUT),
+// `lut_edges_fw` and `lut_edges_bw` fields, all indexed by gate IR node. The `inputs` and `outputs` fields are shared with the gate IR.
 //
 // We call this IR "LUT IR".
+//
+// 3. The flow network of each node is built in a FlowGraph that is reused for all nodes, using local indices for the nodes in the cone
+// of the node, so that the buffers are only allocated once.
 
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
@@ -129,19 +133,19 @@ static string dot_escape(string value)
 }
 
 static void dump_dot_graph(string filename,
-                           pool<RTLIL::SigBit> nodes, dict<RTLIL::SigBit, pool<RTLIL::SigBit>> edges,
-                           pool<RTLIL::SigBit> inputs, pool<RTLIL::SigBit> outputs,
-                           std::function<GraphStyle(RTLIL::SigBit)> node_style =
-                                   [](RTLIL::SigBit) { return GraphStyle{}; },
-                           std::function<GraphStyle(RTLIL::SigBit, RTLIL::SigBit)> edge_style =
-                                   [](RTLIL::SigBit, RTLIL::SigBit) { return GraphStyle{}; },
+                           pool<int> nodes, dict<int, pool<int>> edges,
+                           pool<int> inputs, pool<int> outputs,
+                           std::function<GraphStyle(int)> node_style =
+                                   [](int) { return GraphStyle{}; },
+                           std::function<GraphStyle(int, int)> edge_style =
+                                   [](int, int) { return GraphStyle{}; },
                            string name = "")
 {
 	FILE *f = fopen(filename.c_str(), "w");
 	fprintf(f, "digraph \"%s\" {\n", name.c_str());
 	fprintf(f, "  rankdir=\"TB\";\n");
 
-	dict<RTLIL::SigBit, int> ids;
+	dict<int, int> ids;
 	for (auto node : nodes)
 	{
 		ids[node] = ids.size();
@@ -188,37 +192,160 @@ static void dump_dot_graph(string filename,
 	fclose(f);
 }
 
-struct FlowGraph
+// Adjacency lists in compressed sparse row form: the neighbors of node n are adjacent[start[n]] to adjacent[start[n+1]-1].
+struct AdjacencyLists
 {
-	const RTLIL::SigBit source;
-	RTLIL::SigBit sink;
-	pool<RTLIL::SigBit> nodes = {source};
-	dict<RTLIL::SigBit, pool<RTLIL::SigBit>> edges_fw, edges_bw;
+	struct Range
+	{
+		const int *first, *last;
+		const int *begin() const { return first; }
+		const int *end() const { return last; }
+		int size() const { return last - first; }
+	};
+
+	vector<int> start, adjacent;
+
+	// Edges must be sorted and unique.
+	void build(int num_nodes, const vector<pair<int, int>> &edges)
+	{
+		start.assign(num_nodes + 1, 0);
+		for (auto &edge : edges)
+			start[edge.first + 1]++;
+		for (int node = 0; node < num_nodes; node++)
+			start[node + 1] += start[node];
+		adjacent.resize(edges.size());
+		for (int i = 0; i < GetSize(edges); i++)
+			adjacent[i] = edges[i].second;
+	}
+
+	Range operator[](int node) const
+	{
+		return Range{adjacent.data() + start[node], adjacent.data() + start[node + 1]};
+	}
+};
 
+struct FlowGraph
+{
+	// Flow graph nodes are numbered locally. The source and the sink have fixed indices, the gate IR nodes of the network that are
+	// collapsed into the sink share its index, and the remaining gate IR nodes are numbered in the order they are added.
+	static const int SOURCE = 0, SINK = 1;
 	const int MAX_NODE_FLOW = 1;
-	dict<RTLIL::SigBit, int> node_flow;
-	dict<pair<RTLIL::SigBit, RTLIL::SigBit>, int> edge_flow;
 
-	dict<RTLIL::SigBit, pool<RTLIL::SigBit>> collapsed;
+	vector<int> nodes;      // flow graph node -> gate IR node (-1 for the source)
+	vector<int> collapsed;  // gate IR nodes collapsed into the sink
+	vector<int> local;      // gate IR node -> flow graph node (-1 if not in the graph)
+
+	// Edges are sorted by their source, so the forward adjacency of node n is the range of edge indices fw_start[n] to
+	// fw_start[n+1]-1; the backward adjacency lists edge indices in bw_edges.
+	vector<pair<int, int>> edges;
+	vector<int> fw_start, bw_start, bw_edges, bw_fill;
+
+	vector<int> node_flow, edge_flow;
+
+	// Nodes of the Nt'' network, encoded as 2*node+is_bottom.
+	struct PathEntry
+	{
+		int node_prime, next_option, edge;
+	};
+	vector<PathEntry> path;
+	vector<int> worklist;
+	vector<bool> visited;
+
+	void reset(int num_gate_nodes, int sink)
+	{
+		for (int i = SINK; i < GetSize(nodes); i++)
+			local[nodes[i]] = -1;
+		for (auto node : collapsed)
+			local[node] = -1;
+		if (GetSize(local) < num_gate_nodes)
+			local.resize(num_gate_nodes, -1);
+
+		nodes.assign({-1, sink});
+		local[sink] = SINK;
+		collapsed.clear();
+		edges.clear();
+	}
+
+	int add_node(int gate_node, bool collapse)
+	{
+		if (local[gate_node] < 0)
+		{
+			if (collapse)
+			{
+				local[gate_node] = SINK;
+				collapsed.push_back(gate_node);
+			}
+			else
+			{
+				local[gate_node] = GetSize(nodes);
+				nodes.push_back(gate_node);
+			}
+		}
+		return local[gate_node];
+	}
+
+	void add_edge(int pred, int succ)
+	{
+		edges.push_back({pred, succ});
+	}
+
+	void finalize()
+	{
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		int num_nodes = GetSize(nodes);
+		fw_start.assign(num_nodes + 1, 0);
+		bw_start.assign(num_nodes + 1, 0);
+		for (auto &edge : edges)
+		{
+			fw_start[edge.first + 1]++;
+			bw_start[edge.second + 1]++;
+		}
+		for (int node = 0; node < num_nodes; node++)
+		{
+			fw_start[node + 1] += fw_start[node];
+			bw_start[node + 1] += bw_start[node];
+		}
+		bw_fill.assign(bw_start.begin(), bw_start.end() - 1);
+		bw_edges.resize(edges.size());
+		for (int i = 0; i < GetSize(edges); i++)
+			bw_edges[bw_fill[edges[i].second]++] = i;
+
+		node_flow.assign(num_nodes, 0);
+		edge_flow.assign(edges.size(), 0);
+	}
 
-	void dump_dot_graph(string filename)
+	void dump_dot_graph(string filename, const vector<RTLIL::SigBit> &node_bits)
 	{
-		auto node_style = [&](RTLIL::SigBit node) {
-			string label = (node == source) ? "(source)" : log_signal(node);
-			for (auto collapsed_node : collapsed[node])
-				label += stringf(" %s", log_signal(collapsed_node));
+		pool<int> dot_nodes;
+		dict<int, pool<int>> dot_edges;
+		for (int node = 0; node < GetSize(nodes); node++)
+			dot_nodes.insert(node);
+		for (auto &edge : edges)
+			dot_edges[edge.first].insert(edge.second);
+
+		dict<pair<int, int>, int> dot_edge_flow;
+		for (int i = 0; i < GetSize(edges); i++)
+			dot_edge_flow[edges[i]] = edge_flow[i];
+
+		auto node_style = [&](int node) {
+			string label = (node == SOURCE) ? "(source)" : log_signal(node_bits[nodes[node]]);
+			if (node == SINK)
+				for (auto collapsed_node : collapsed)
+					label += stringf(" %s", log_signal(node_bits[collapsed_node]));
 			int flow = node_flow[node];
-			if (node != source && node != sink)
+			if (node != SOURCE && node != SINK)
 				label += stringf("\n%d/%d", flow, MAX_NODE_FLOW);
 			else
 				label += stringf("\n%d/∞", flow);
 			return GraphStyle{label, flow < MAX_NODE_FLOW ? "green" : "black"};
 		};
-		auto edge_style = [&](RTLIL::SigBit source, RTLIL::SigBit sink) {
-			int flow = edge_flow[{source, sink}];
+		auto edge_style = [&](int source, int sink) {
+			int flow = dot_edge_flow[{source, sink}];
 			return GraphStyle{stringf("%d/∞", flow), flow > 0 ? "blue" : "black"};
 		};
-		::dump_dot_graph(filename, nodes, edges_fw, {source}, {sink}, node_style, edge_style);
+		::dump_dot_graph(filename, dot_nodes, dot_edges, {SOURCE}, {SINK}, node_style, edge_style);
 	}
 
 	// Here, we are working on the Nt'' network, but our representation is the Nt' network.
@@ -232,126 +359,86 @@ struct FlowGraph
 	//
 	// To address this, we split each node v into two nodes, v't and v'b. This representation is virtual,
 	// in the sense that nodes v't and v'b are overlaid on top of the original node v, and only exist
-	// in paths and worklists.
+	// in paths and worklists, where v't is encoded as 2*v and v'b as 2*v+1.
 
-	struct NodePrime
+	bool find_augmenting_path(bool commit)
 	{
-		RTLIL::SigBit node;
-		bool is_bottom;
-
-		NodePrime(RTLIL::SigBit node, bool is_bottom) :
-			node(node), is_bottom(is_bottom) {}
-
-		bool operator==(const NodePrime &other) const
-		{
-			return node == other.node && is_bottom == other.is_bottom;
-		}
-		bool operator!=(const NodePrime &other) const
-		{
-			return !(*this == other);
-		}
-		unsigned int hash() const
-		{
-			return hash_ops<pair<RTLIL::SigBit, int>>::hash({node, is_bottom});
-		}
-
-		static NodePrime top(RTLIL::SigBit node)
-		{
-			return NodePrime(node, /*is_bottom=*/false);
-		}
-
-		static NodePrime bottom(RTLIL::SigBit node)
-		{
-			return NodePrime(node, /*is_bottom=*/true);
-		}
-
-		NodePrime as_top() const
+		const int source_prime = 2 * SOURCE + 1;
+		const int sink_prime = 2 * SINK;
+		visited.assign(2 * nodes.size(), false);
+		visited[source_prime] = true;
+		path.assign({PathEntry{source_prime, 0, -1}});
+		while (!path.empty() && path.back().node_prime != sink_prime)
 		{
-			log_assert(is_bottom);
-			return top(node);
-		}
-
-		NodePrime as_bottom() const
-		{
-			log_assert(!is_bottom);
-			return bottom(node);
-		}
-	};
+			PathEntry &entry = path.back();
+			int node = entry.node_prime / 2;
+			int next_prime = -1, next_edge = -1;
 
-	bool find_augmenting_path(bool commit)
-	{
-		NodePrime source_prime = {source, true};
-		NodePrime sink_prime = {sink, false};
-		vector<NodePrime> path = {source_prime};
-		pool<NodePrime> visited = {};
-		bool found;
-		do {
-			found = false;
-
-			auto node_prime = path.back();
-			visited.insert(node_prime);
-
-			if (!node_prime.is_bottom) // vt
+			// Option 0 crosses from v't to v'b or back, the other options follow the edges of v.
+			if (!(entry.node_prime & 1)) // vt
 			{
-				if (!visited[node_prime.as_bottom()] && node_flow[node_prime.node] < MAX_NODE_FLOW)
-				{
-					path.push_back(node_prime.as_bottom());
-					found = true;
-				}
-				else
+				int num_options = 1 + bw_start[node + 1] - bw_start[node];
+				for (; next_prime < 0 && entry.next_option < num_options; entry.next_option++)
 				{
-					for (auto node_pred : edges_bw[node_prime.node])
+					if (entry.next_option == 0)
 					{
-						if (!visited[NodePrime::bottom(node_pred)] && edge_flow[{node_pred, node_prime.node}] > 0)
-						{
-							path.push_back(NodePrime::bottom(node_pred));
-							found = true;
-							break;
-						}
+						if (!visited[2 * node + 1] && node_flow[node] < MAX_NODE_FLOW)
+							next_prime = 2 * node + 1;
+						continue;
+					}
+					int edge = bw_edges[bw_start[node] + entry.next_option - 1];
+					int node_pred = edges[edge].first;
+					if (!visited[2 * node_pred + 1] && edge_flow[edge] > 0)
+					{
+						next_prime = 2 * node_pred + 1;
+						next_edge = edge;
 					}
 				}
 			}
 			else // vb
 			{
-				if (!visited[node_prime.as_top()] && node_flow[node_prime.node] > 0)
+				int num_options = 1 + fw_start[node + 1] - fw_start[node];
+				for (; next_prime < 0 && entry.next_option < num_options; entry.next_option++)
 				{
-					path.push_back(node_prime.as_top());
-					found = true;
-				}
-				else
-				{
-					for (auto node_succ : edges_fw[node_prime.node])
+					if (entry.next_option == 0)
 					{
-						if (!visited[NodePrime::top(node_succ)] /* && edge_flow[...] < ∞ */)
-						{
-							path.push_back(NodePrime::top(node_succ));
-							found = true;
-							break;
-						}
+						if (!visited[2 * node] && node_flow[node] > 0)
+							next_prime = 2 * node;
+						continue;
+					}
+					int edge = fw_start[node] + entry.next_option - 1;
+					int node_succ = edges[edge].second;
+					if (!visited[2 * node_succ] /* && edge_flow[...] < ∞ */)
+					{
+						next_prime = 2 * node_succ;
+						next_edge = edge;
 					}
 				}
 			}
 
-			if (!found && path.size() > 1)
+			if (next_prime >= 0)
 			{
-				path.pop_back();
-				found = true;
+				visited[next_prime] = true;
+				path.push_back(PathEntry{next_prime, 0, next_edge});
 			}
-		} while(path.back() != sink_prime && found);
+			else
+				path.pop_back();
+		}
+
+		if (path.empty())
+			return false;
 
-		if (commit && path.back() == sink_prime)
+		if (commit)
 		{
-			auto prev_prime = path.front();
-			for (auto node_prime : path)
+			for (int i = 1; i < GetSize(path); i++)
 			{
-				if (node_prime == source_prime)
-					continue;
-
-				log_assert(prev_prime.is_bottom ^ node_prime.is_bottom);
-				if (prev_prime.node == node_prime.node)
+				const PathEntry &prev_entry = path[i - 1], &entry = path[i];
+				bool prev_is_bottom = prev_entry.node_prime & 1, is_bottom = entry.node_prime & 1;
+				log_assert(prev_is_bottom ^ is_bottom);
+				if (entry.edge < 0)
 				{
-					auto node = node_prime.node;
-					if (!prev_prime.is_bottom && node_prime.is_bottom)
+					int node = entry.node_prime / 2;
+					if (!prev_is_bottom && is_bottom)
 					{
 						log_assert(node_flow[node] == 0);
 						node_flow[node]++;
@@ -364,24 +451,23 @@ struct FlowGraph
 				}
 				else
 				{
-					if (prev_prime.is_bottom && !node_prime.is_bottom)
+					if (prev_is_bottom && !is_bottom)
 					{
 						log_assert(true /* edge_flow[...] < ∞ */);
-						edge_flow[{prev_prime.node, node_prime.node}]++;
+						edge_flow[entry.edge]++;
 					}
 					else
 					{
-						log_assert((edge_flow[{node_prime.node, prev_prime.node}] > 0));
-						edge_flow[{node_prime.node, prev_prime.node}]--;
+						log_assert(edge_flow[entry.edge] > 0);
+						edge_flow[entry.edge]--;
 					}
 				}
-				prev_prime = node_prime;
 			}
 
-			node_flow[source]++;
-			node_flow[sink]++;
+			node_flow[SOURCE]++;
+			node_flow[SINK]++;
 		}
-		return path.back() == sink_prime;
+		return true;
 	}
 
 	int maximum_flow(int order)
@@ -392,54 +478,48 @@ struct FlowGraph
 		return flow + find_augmenting_path(/*commit=*/false);
 	}
 
-	pair<pool<RTLIL::SigBit>, pool<RTLIL::SigBit>> edge_cut()
+	// Returns the gate IR nodes on the sink side of the cut (X̅ in the paper).
+	void edge_cut(vector<int> &xi)
 	{
-		pool<RTLIL::SigBit> x = {source}, xi; // X and X̅ in the paper
-
-		NodePrime source_prime = {source, true};
-		pool<NodePrime> visited;
-		vector<NodePrime> worklist = {source_prime};
+		const int source_prime = 2 * SOURCE + 1;
+		visited.assign(2 * nodes.size(), false);
+		worklist.assign({source_prime});
 		while (!worklist.empty())
 		{
-			auto node_prime = worklist.back();
+			int node_prime = worklist.back();
 			worklist.pop_back();
 			if (visited[node_prime])
 				continue;
-			visited.insert(node_prime);
-
-			if (!node_prime.is_bottom)
-				x.insert(node_prime.node);
+			visited[node_prime] = true;
 
 			// Mincut is constructed by traversing a graph in an undirected way along forward edges that aren't full, or backward edges
 			// that aren't empty.
-			if (!node_prime.is_bottom) // top
+			int node = node_prime / 2;
+			if (!(node_prime & 1)) // top
 			{
-				if (node_flow[node_prime.node] < MAX_NODE_FLOW)
-					worklist.push_back(node_prime.as_bottom());
-				for (auto node_pred : edges_bw[node_prime.node])
-					if (edge_flow[{node_pred, node_prime.node}] > 0)
-						worklist.push_back(NodePrime::bottom(node_pred));
+				if (node_flow[node] < MAX_NODE_FLOW)
+					worklist.push_back(2 * node + 1);
+				for (int i = bw_start[node]; i < bw_start[node + 1]; i++)
+					if (edge_flow[bw_edges[i]] > 0)
+						worklist.push_back(2 * edges[bw_edges[i]].first + 1);
 			}
 			else // bottom
 			{
-				if (node_flow[node_prime.node] > 0)
-					worklist.push_back(node_prime.as_top());
-				for (auto node_succ : edges_fw[node_prime.node])
+				if (node_flow[node] > 0)
+					worklist.push_back(2 * node);
+				for (int i = fw_start[node]; i < fw_start[node + 1]; i++)
 					if (true /* edge_flow[...] < ∞ */)
-						worklist.push_back(NodePrime::top(node_succ));
+						worklist.push_back(2 * edges[i].second);
 			}
 		}
 
-		for (auto node : nodes)
-			if (!x[node])
-				xi.insert(node);
-
-		for (auto collapsed_node : collapsed[sink])
-			xi.insert(collapsed_node);
+		xi.clear();
+		for (int node = SINK; node < GetSize(nodes); node++)
+			if (!visited[2 * node])
+				xi.push_back(nodes[node]);
+		xi.insert(xi.end(), collapsed.begin(), collapsed.end());
 
-		log_assert(x[source] && !xi[source]);
-		log_assert(!x[sink] && xi[sink]);
-		return {x, xi};
+		log_assert(!visited[2 * SINK]);
 	}
 };
 
@@ -453,22 +533,44 @@ struct FlowmapWorker
 	SigMap sigmap;
 	ModIndex index;
 
-	dict<RTLIL::SigBit, ModIndex::PortInfo> node_origins;
+	vector<RTLIL::SigBit> node_bits;
+	dict<RTLIL::SigBit, int> node_ids;
+	vector<ModIndex::PortInfo> node_origins;
 
 	// Gate IR
-	pool<RTLIL::SigBit> nodes, inputs, outputs;
-	dict<RTLIL::SigBit, pool<RTLIL::SigBit>> edges_fw, edges_bw;
-	dict<RTLIL::SigBit, int> labels;
+	vector<bool> inputs, outputs;
+	vector<int> input_nodes, output_nodes;
+	AdjacencyLists edges_fw, edges_bw;
+	vector<int> labels;
 
 	// LUT IR
-	pool<RTLIL::SigBit> lut_nodes;
-	dict<RTLIL::SigBit, pool<RTLIL::SigBit>> lut_gates;
-	dict<RTLIL::SigBit, pool<RTLIL::SigBit>> lut_edges_fw, lut_edges_bw;
-	dict<RTLIL::SigBit, int> lut_depths, lut_altitudes, lut_slacks;
+	vector<bool> lut_nodes;
+	vector<pool<int>> lut_gates;
+	vector<pool<int>> lut_edges_fw, lut_edges_bw;
+	vector<int> lut_depths, lut_altitudes, lut_slacks;
 
 	int gate_count = 0, lut_count = 0, packed_count = 0;
 	int gate_area = 0, lut_area = 0;
 
+	int num_nodes() const
+	{
+		return GetSize(node_bits);
+	}
+
+	const char *log_node(int node)
+	{
+		return log_signal(node_bits[node]);
+	}
+
+	int count_luts() const
+	{
+		int count = 0;
+		for (int node = 0; node < num_nodes(); node++)
+			if (lut_nodes[node])
+				count++;
+		return count;
+	}
+
 	enum class GraphMode {
 		Label,
 		Cut,
@@ -476,20 +578,24 @@ struct FlowmapWorker
 	};
 
 	void dump_dot_graph(string filename, GraphMode mode,
-	                    pool<RTLIL::SigBit> subgraph_nodes = {}, dict<RTLIL::SigBit, pool<RTLIL::SigBit>> subgraph_edges = {},
-	                    dict<RTLIL::SigBit, pool<RTLIL::SigBit>> collapsed = {},
-	                    pair<pool<RTLIL::SigBit>, pool<RTLIL::SigBit>> cut = {})
+	                    pool<int> subgraph_nodes = {}, dict<int, pool<int>> subgraph_edges = {},
+	                    const vector<pool<int>> *collapsed = nullptr,
+	                    pair<pool<int>, pool<int>> cut = {})
 	{
 		if (subgraph_nodes.empty())
-			subgraph_nodes = nodes;
+			for (int node = 0; node < num_nodes(); node++)
+				subgraph_nodes.insert(node);
 		if (subgraph_edges.empty())
-			subgraph_edges = edges_fw;
-
-		auto node_style = [&](RTLIL::SigBit node) {
-			string label = log_signal(node);
-			for (auto collapsed_node : collapsed[node])
-				if (collapsed_node != node)
-					label += stringf(" %s", log_signal(collapsed_node));
+			for (int node = 0; node < num_nodes(); node++)
+				for (auto node_succ : edges_fw[node])
+					subgraph_edges[node].insert(node_succ);
+
+		auto node_style = [&](int node) {
+			string label = log_node(node);
+			if (collapsed != nullptr)
+				for (auto collapsed_node : (*collapsed)[node])
+					if (collapsed_node != node)
+						label += stringf(" %s", log_node(collapsed_node));
 			switch (mode)
 			{
 				case GraphMode::Label:
@@ -518,78 +624,89 @@ struct FlowmapWorker
 			}
 			return GraphStyle{label};
 		};
-		auto edge_style = [&](RTLIL::SigBit, RTLIL::SigBit) {
+		auto edge_style = [&](int, int) {
 			return GraphStyle{};
 		};
-		::dump_dot_graph(filename, subgraph_nodes, subgraph_edges, inputs, outputs, node_style, edge_style, module->name.str());
+		pool<int> dot_inputs(input_nodes.begin(), input_nodes.end());
+		pool<int> dot_outputs(output_nodes.begin(), output_nodes.end());
+		::dump_dot_graph(filename, subgraph_nodes, subgraph_edges, dot_inputs, dot_outputs, node_style, edge_style, module->name.str());
 	}
 
 	void dump_dot_lut_graph(string filename, GraphMode mode)
 	{
-		pool<RTLIL::SigBit> lut_and_input_nodes;
-		lut_and_input_nodes.insert(lut_nodes.begin(), lut_nodes.end());
-		lut_and_input_nodes.insert(inputs.begin(), inputs.end());
-		dump_dot_graph(filename, mode, lut_and_input_nodes, lut_edges_fw, lut_gates);
+		pool<int> lut_and_input_nodes;
+		dict<int, pool<int>> dot_lut_edges;
+		for (int node = 0; node < num_nodes(); node++)
+		{
+			if (lut_nodes[node] || inputs[node])
+				lut_and_input_nodes.insert(node);
+			if (!lut_edges_fw[node].empty())
+				dot_lut_edges[node] = lut_edges_fw[node];
+		}
+		dump_dot_graph(filename, mode, lut_and_input_nodes, dot_lut_edges, &lut_gates);
 	}
 
-	pool<RTLIL::SigBit> find_subgraph(RTLIL::SigBit sink)
+	// Scratch buffers of label_nodes(), reused for every node.
+	FlowGraph flow_graph;
+	vector<int> cone, xi;
+	vector<bool> in_cone, in_xi;
+
+	void find_cone(int sink)
 	{
-		pool<RTLIL::SigBit> subgraph;
-		pool<RTLIL::SigBit> worklist = {sink};
-		while (!worklist.empty())
+		cone.assign({sink});
+		in_cone[sink] = true;
+		for (int i = 0; i < GetSize(cone); i++)
 		{
-			auto node = worklist.pop();
-			subgraph.insert(node);
-			for (auto source : edges_bw[node])
+			for (auto source : edges_bw[cone[i]])
 			{
-				if (!subgraph[source])
-					worklist.insert(source);
+				if (!in_cone[source])
+				{
+					in_cone[source] = true;
+					cone.push_back(source);
+				}
 			}
 		}
-		return subgraph;
 	}
 
-	FlowGraph build_flow_graph(RTLIL::SigBit sink, int p)
+	void build_flow_graph(int sink, int p)
 	{
-		FlowGraph flow_graph;
-		flow_graph.sink = sink;
-
-		pool<RTLIL::SigBit> worklist = {sink}, visited;
-		while (!worklist.empty())
+		flow_graph.reset(num_nodes(), sink);
+		for (auto node : cone)
 		{
-			auto node = worklist.pop();
-			visited.insert(node);
-
-			auto collapsed_node = labels[node] == p ? sink : node;
-			if (node != collapsed_node)
-				flow_graph.collapsed[collapsed_node].insert(node);
-			flow_graph.nodes.insert(collapsed_node);
-
+			int collapsed_node = flow_graph.add_node(node, labels[node] == p);
 			for (auto node_pred : edges_bw[node])
 			{
-				auto collapsed_node_pred = labels[node_pred] == p ? sink : node_pred;
-				if (node_pred != collapsed_node_pred)
-					flow_graph.collapsed[collapsed_node_pred].insert(node_pred);
+				int collapsed_node_pred = flow_graph.add_node(node_pred, labels[node_pred] == p);
 				if (collapsed_node != collapsed_node_pred)
-				{
-					flow_graph.edges_bw[collapsed_node].insert(collapsed_node_pred);
-					flow_graph.edges_fw[collapsed_node_pred].insert(collapsed_node);
-				}
+					flow_graph.add_edge(collapsed_node_pred, collapsed_node);
 				if (inputs[node_pred])
-				{
-					flow_graph.edges_bw[collapsed_node_pred].insert(flow_graph.source);
-					flow_graph.edges_fw[flow_graph.source].insert(collapsed_node_pred);
-				}
-
-				if (!visited[node_pred])
-					worklist.insert(node_pred);
+					flow_graph.add_edge(FlowGraph::SOURCE, collapsed_node_pred);
 			}
 		}
-		return flow_graph;
+		flow_graph.finalize();
+	}
+
+	void add_node_edge(vector<pair<int, int>> &edges, RTLIL::SigBit pred, int succ)
+	{
+		int node_pred = add_node(pred);
+		edges.push_back({node_pred, succ});
+	}
+
+	int add_node(RTLIL::SigBit bit)
+	{
+		auto it = node_ids.find(bit);
+		if (it != node_ids.end())
+			return it->second;
+		int node = num_nodes();
+		node_ids[bit] = node;
+		node_bits.push_back(bit);
+		node_origins.emplace_back();
+		return node;
 	}
 
 	void discover_nodes(pool<IdString> cell_types)
 	{
+		vector<pair<int, int>> edges;
 		for (auto cell : module->selected_cells())
 		{
 			if (!cell_types[cell->type])
@@ -598,7 +715,7 @@ struct FlowmapWorker
 			if (!cell->known())
 				log_error("Cell %s (%s.%s) is unknown.\n", cell->type.c_str(), log_id(module), log_id(cell));
 
-			pool<RTLIL::SigBit> fanout;
+			pool<int> fanout;
 			for (auto conn : cell->connections())
 			{
 				if (!cell->output(conn.first)) continue;
@@ -608,11 +725,11 @@ struct FlowmapWorker
 					offset++;
 					if (!bit.wire) continue;
 					auto mapped_bit = sigmap(bit);
-					if (nodes[mapped_bit])
+					int node = add_node(mapped_bit);
+					if (node_origins[node].cell != nullptr)
 						log_error("Multiple drivers found for wire %s.\n", log_signal(mapped_bit));
-					nodes.insert(mapped_bit);
-					node_origins[mapped_bit] = ModIndex::PortInfo(cell, conn.first, offset);
-					fanout.insert(mapped_bit);
+					node_origins[node] = ModIndex::PortInfo(cell, conn.first, offset);
+					fanout.insert(node);
 				}
 			}
 
@@ -623,11 +740,8 @@ struct FlowmapWorker
 				for (auto bit : sigmap(conn.second))
 				{
 					if (!bit.wire) continue;
-					for (auto fanout_bit : fanout)
-					{
-						edges_fw[bit].insert(fanout_bit);
-						edges_bw[fanout_bit].insert(bit);
-					}
+					for (auto fanout_node : fanout)
+						add_node_edge(edges, bit, fanout_node);
 					fanin++;
 				}
 			}
@@ -640,25 +754,50 @@ struct FlowmapWorker
 			gate_area += 1 << fanin;
 		}
 
-		for (auto edge : edges_fw)
+		// Every node that is not driven by a mapped cell has been added as the source of an edge.
+		inputs.assign(num_nodes(), false);
+		outputs.assign(num_nodes(), false);
+		for (int node = 0; node < num_nodes(); node++)
 		{
-			if (!nodes[edge.first])
+			if (node_origins[node].cell == nullptr)
 			{
-				inputs.insert(edge.first);
-				nodes.insert(edge.first);
+				inputs[node] = true;
+				input_nodes.push_back(node);
 			}
 		}
 
-		for (auto node : nodes)
+		for (int node = 0; node < num_nodes(); node++)
 		{
-			auto node_info = index.query(node);
-			if (node_info->is_output && !inputs[node])
-				outputs.insert(node);
+			if (inputs[node])
+				continue;
+			auto node_info = index.query(node_bits[node]);
+			bool is_output = node_info->is_output;
 			for (auto port : node_info->ports)
-				if (!cell_types[port.cell->type] && !inputs[node])
-					outputs.insert(node);
+				if (!cell_types[port.cell->type])
+					is_output = true;
+			if (is_output)
+			{
+				outputs[node] = true;
+				output_nodes.push_back(node);
+			}
 		}
 
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		edges_fw.build(num_nodes(), edges);
+		for (auto &edge : edges)
+			std::swap(edge.first, edge.second);
+		std::sort(edges.begin(), edges.end());
+		edges_bw.build(num_nodes(), edges);
+
+		lut_nodes.assign(num_nodes(), false);
+		lut_gates.resize(num_nodes());
+		lut_edges_fw.resize(num_nodes());
+		lut_edges_bw.resize(num_nodes());
+		lut_depths.assign(num_nodes(), -1);
+		lut_altitudes.assign(num_nodes(), -1);
+		lut_slacks.assign(num_nodes(), 0);
+
 		if (debug)
 		{
 			dump_dot_graph("flowmap-initial.dot", GraphMode::Label);
@@ -668,72 +807,72 @@ struct FlowmapWorker
 
 	void label_nodes()
 	{
-		for (auto node : nodes)
-			labels[node] = -1;
-		for (auto input : inputs)
+		labels.assign(num_nodes(), -1);
+		for (auto input : input_nodes)
 		{
-			if (input.wire->attributes.count(ID($flowmap_level)))
-				labels[input] = input.wire->attributes[ID($flowmap_level)].as_int();
+			RTLIL::Wire *wire = node_bits[input].wire;
+			if (wire->attributes.count(ID($flowmap_level)))
+				labels[input] = wire->attributes[ID($flowmap_level)].as_int();
 			else
 				labels[input] = 0;
 		}
 
-		pool<RTLIL::SigBit> worklist = nodes;
-		int debug_num = 0;
-		while (!worklist.empty())
+		// Nodes are labeled in topological order; nodes on combinational loops are never labeled.
+		vector<int> pending_preds(num_nodes()), worklist;
+		for (int node = 0; node < num_nodes(); node++)
 		{
-			auto sink = worklist.pop();
-			if (labels[sink] != -1)
+			if (inputs[node])
 				continue;
+			pending_preds[node] = edges_bw[node].size();
+			for (auto node_pred : edges_bw[node])
+				if (inputs[node_pred])
+					pending_preds[node]--;
+			if (pending_preds[node] == 0)
+				worklist.push_back(node);
+		}
 
-			bool inputs_have_labels = true;
-			for (auto sink_input : edges_bw[sink])
-			{
-				if (labels[sink_input] == -1)
-				{
-					inputs_have_labels = false;
-					break;
-				}
-			}
-			if (!inputs_have_labels)
-				continue;
+		in_cone.assign(num_nodes(), false);
+		in_xi.assign(num_nodes(), false);
+
+		int debug_num = 0;
+		for (int worklist_idx = 0; worklist_idx < GetSize(worklist); worklist_idx++)
+		{
+			int sink = worklist[worklist_idx];
 
 			if (debug)
 			{
 				debug_num++;
-				log("Examining subgraph %d rooted in %s.\n", debug_num, log_signal(sink));
+				log("Examining subgraph %d rooted in %s.\n", debug_num, log_node(sink));
 			}
 
-			pool<RTLIL::SigBit> subgraph = find_subgraph(sink);
+			find_cone(sink);
 
 			int p = 1;
-			for (auto subgraph_node : subgraph)
-				p = max(p, labels[subgraph_node]);
+			for (auto cone_node : cone)
+				p = max(p, labels[cone_node]);
 
-			FlowGraph flow_graph = build_flow_graph(sink, p);
+			build_flow_graph(sink, p);
 			int flow = flow_graph.maximum_flow(order);
-			pool<RTLIL::SigBit> x, xi;
 			if (flow <= order)
 			{
 				labels[sink] = p;
-				auto cut = flow_graph.edge_cut();
-				x = cut.first;
-				xi = cut.second;
+				flow_graph.edge_cut(xi);
 			}
 			else
 			{
 				labels[sink] = p + 1;
-				x = subgraph;
-				x.erase(sink);
-				xi.insert(sink);
+				xi.assign({sink});
 			}
-			lut_gates[sink] = xi;
 
-			pool<RTLIL::SigBit> k;
+			for (auto xi_node : xi)
+				in_xi[xi_node] = true;
+			lut_gates[sink] = pool<int>(xi.begin(), xi.end());
+
+			pool<int> k;
 			for (auto xi_node : xi)
 			{
 				for (auto xi_node_pred : edges_bw[xi_node])
-					if (x[xi_node_pred])
+					if (!in_xi[xi_node_pred])
 						k.insert(xi_node_pred);
 			}
 			log_assert((int)k.size() <= order);
@@ -743,23 +882,33 @@ struct FlowmapWorker
 
 			if (debug)
 			{
+				pool<int> subgraph(cone.begin(), cone.end()), x;
+				for (auto cone_node : cone)
+					if (!in_xi[cone_node])
+						x.insert(cone_node);
 				log("  Maximum flow: %d. Assigned label %d.\n", flow, labels[sink]);
-				dump_dot_graph(stringf("flowmap-%d-sub.dot", debug_num), GraphMode::Cut, subgraph, {}, {}, {x, xi});
+				dump_dot_graph(stringf("flowmap-%d-sub.dot", debug_num), GraphMode::Cut, subgraph, {}, nullptr, {x, lut_gates[sink]});
 				log("  Dumped subgraph to `flowmap-%d-sub.dot`.\n", debug_num);
-				flow_graph.dump_dot_graph(stringf("flowmap-%d-flow.dot", debug_num));
+				flow_graph.dump_dot_graph(stringf("flowmap-%d-flow.dot", debug_num), node_bits);
 				log("  Dumped flow graph to `flowmap-%d-flow.dot`.\n", debug_num);
 				log("    LUT inputs:");
 				for (auto k_node : k)
-					log(" %s", log_signal(k_node));
+					log(" %s", log_node(k_node));
 				log(".\n");
 				log("    LUT packed gates:");
 				for (auto xi_node : xi)
-					log(" %s", log_signal(xi_node));
+					log(" %s", log_node(xi_node));
 				log(".\n");
 			}
 
+			for (auto xi_node : xi)
+				in_xi[xi_node] = false;
+			for (auto cone_node : cone)
+				in_cone[cone_node] = false;
+
 			for (auto sink_succ : edges_fw[sink])
-				worklist.insert(sink_succ);
+				if (--pending_preds[sink_succ] == 0)
+					worklist.push_back(sink_succ);
 		}
 
 		if (debug)
@@ -771,20 +920,25 @@ struct FlowmapWorker
 
 	int map_luts()
 	{
-		pool<RTLIL::SigBit> worklist = outputs;
+		vector<int> worklist = output_nodes;
+		for (auto output : output_nodes)
+			lut_nodes[output] = true;
 		while (!worklist.empty())
 		{
-			auto lut_node = worklist.pop();
-			lut_nodes.insert(lut_node);
+			int lut_node = worklist.back();
+			worklist.pop_back();
 			for (auto input_node : lut_edges_bw[lut_node])
 				if (!lut_nodes[input_node] && !inputs[input_node])
-					worklist.insert(input_node);
+				{
+					lut_nodes[input_node] = true;
+					worklist.push_back(input_node);
+				}
 		}
 
 		int depth = 0;
 		for (auto label : labels)
-			depth = max(depth, label.second);
-		log("Mapped to %d LUTs with maximum depth %d.\n", GetSize(lut_nodes), depth);
+			depth = max(depth, label);
+		log("Mapped to %d LUTs with maximum depth %d.\n", count_luts(), depth);
 
 		if (debug)
 		{
@@ -795,9 +949,9 @@ struct FlowmapWorker
 		return depth;
 	}
 
-	void realize_derealize_lut(RTLIL::SigBit lut, pool<RTLIL::SigBit> *changed = nullptr)
+	void realize_derealize_lut(int lut, pool<int> *changed = nullptr)
 	{
-		pool<RTLIL::SigBit> worklist = {lut};
+		pool<int> worklist = {lut};
 		while (!worklist.empty())
 		{
 			auto lut = worklist.pop();
@@ -810,9 +964,9 @@ struct FlowmapWorker
 					realized_successors = true;
 
 			if (realized_successors && !lut_nodes[lut])
-				lut_nodes.insert(lut);
+				lut_nodes[lut] = true;
 			else if (!realized_successors && lut_nodes[lut])
-				lut_nodes.erase(lut);
+				lut_nodes[lut] = false;
 			else
 				continue;
 
@@ -824,7 +978,7 @@ struct FlowmapWorker
 		}
 	}
 
-	void add_lut_edge(RTLIL::SigBit pred, RTLIL::SigBit succ, pool<RTLIL::SigBit> *changed = nullptr)
+	void add_lut_edge(int pred, int succ, pool<int> *changed = nullptr)
 	{
 		log_assert(!lut_edges_fw[pred][succ] && !lut_edges_bw[succ][pred]);
 		log_assert((int)lut_edges_bw[succ].size() < order);
@@ -840,7 +994,7 @@ struct FlowmapWorker
 		}
 	}
 
-	void remove_lut_edge(RTLIL::SigBit pred, RTLIL::SigBit succ, pool<RTLIL::SigBit> *changed = nullptr)
+	void remove_lut_edge(int pred, int succ, pool<int> *changed = nullptr)
 	{
 		log_assert(lut_edges_fw[pred][succ] && lut_edges_bw[succ][pred]);
 
@@ -856,11 +1010,11 @@ struct FlowmapWorker
 		}
 	}
 
-	pair<pool<RTLIL::SigBit>, pool<RTLIL::SigBit>> cut_lut_at_gate(RTLIL::SigBit lut, RTLIL::SigBit lut_gate)
+	pair<pool<int>, pool<int>> cut_lut_at_gate(int lut, int lut_gate)
 	{
-		pool<RTLIL::SigBit> gate_inputs = lut_edges_bw[lut];
-		pool<RTLIL::SigBit> other_inputs;
-		pool<RTLIL::SigBit> worklist = {lut};
+		pool<int> gate_inputs = lut_edges_bw[lut];
+		pool<int> other_inputs;
+		pool<int> worklist = {lut};
 		while (!worklist.empty())
 		{
 			auto node = worklist.pop();
@@ -880,19 +1034,20 @@ struct FlowmapWorker
 		return {gate_inputs, other_inputs};
 	}
 
-	void compute_lut_distances(dict<RTLIL::SigBit, int> &lut_distances, bool forward,
-	                          pool<RTLIL::SigBit> initial = {}, pool<RTLIL::SigBit> *changed = nullptr)
+	// Distances that have not been computed are -1.
+	void compute_lut_distances(vector<int> &lut_distances, bool forward,
+	                          pool<int> initial = {}, pool<int> *changed = nullptr)
 	{
-		pool<RTLIL::SigBit> terminals = forward ? inputs : outputs;
+		const vector<int> &terminals = forward ? input_nodes : output_nodes;
 		auto &lut_edges_next = forward ? lut_edges_fw : lut_edges_bw;
 		auto &lut_edges_prev = forward ? lut_edges_bw : lut_edges_fw;
 
 		if (initial.empty())
-			initial = terminals;
+			initial = pool<int>(terminals.begin(), terminals.end());
 		for (auto node : initial)
-			lut_distances.erase(node);
+			lut_distances[node] = -1;
 
-		pool<RTLIL::SigBit> worklist = initial;
+		pool<int> worklist = initial;
 		while (!worklist.empty())
 		{
 			auto lut = worklist.pop();
@@ -900,9 +1055,9 @@ struct FlowmapWorker
 			if (forward && inputs[lut])
 				lut_distance = labels[lut]; // to support (* $flowmap_level=n *)
 			for (auto lut_prev : lut_edges_prev[lut])
-				if ((lut_nodes[lut_prev] || inputs[lut_prev]) && lut_distances.count(lut_prev))
+				if ((lut_nodes[lut_prev] || inputs[lut_prev]) && lut_distances[lut_prev] >= 0)
 					lut_distance = max(lut_distance, lut_distances[lut_prev] + 1);
-			if (!lut_distances.count(lut) || lut_distances[lut] != lut_distance)
+			if (lut_distances[lut] != lut_distance)
 			{
 				lut_distances[lut] = lut_distance;
 				if (changed != nullptr && !inputs[lut])
@@ -914,18 +1069,18 @@ struct FlowmapWorker
 		}
 	}
 
-	void check_lut_distances(const dict<RTLIL::SigBit, int> &lut_distances, bool forward)
+	void check_lut_distances(const vector<int> &lut_distances, bool forward)
 	{
-		dict<RTLIL::SigBit, int> gold_lut_distances;
+		vector<int> gold_lut_distances(num_nodes(), -1);
 		compute_lut_distances(gold_lut_distances, forward);
-		for (auto lut_distance : lut_distances)
-			if (lut_nodes[lut_distance.first])
-				log_assert(lut_distance.second == gold_lut_distances[lut_distance.first]);
+		for (int node = 0; node < num_nodes(); node++)
+			if (lut_nodes[node] && lut_distances[node] >= 0)
+				log_assert(lut_distances[node] == max(gold_lut_distances[node], 0));
 	}
 
 	// LUT depth is the length of the longest path from any input in LUT fan-in to LUT.
 	// LUT altitude (for lack of a better term) is the length of the longest path from LUT to any output in LUT fan-out.
-	void update_lut_depths_altitudes(pool<RTLIL::SigBit> worklist = {}, pool<RTLIL::SigBit> *changed = nullptr)
+	void update_lut_depths_altitudes(pool<int> worklist = {}, pool<int> *changed = nullptr)
 	{
 		compute_lut_distances(lut_depths, /*forward=*/true, worklist, changed);
 		compute_lut_distances(lut_altitudes, /*forward=*/false, worklist, changed);
@@ -937,11 +1092,13 @@ struct FlowmapWorker
 
 	// LUT critical output set is the set of outputs whose depth will increase (equivalently, slack will decrease) if the depth of
 	// the LUT increases. (This is referred to as RPOv for LUTv in the paper.)
-	void compute_lut_critical_outputs(dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs,
-	                                  pool<RTLIL::SigBit> worklist = {})
+	void compute_lut_critical_outputs(dict<int, pool<int>> &lut_critical_outputs,
+	                                  pool<int> worklist = {})
 	{
 		if (worklist.empty())
-			worklist = lut_nodes;
+			for (int node = 0; node < num_nodes(); node++)
+				if (lut_nodes[node])
+					worklist.insert(node);
 
 		while (!worklist.empty())
 		{
@@ -983,10 +1140,10 @@ struct FlowmapWorker
 	// Invalidating LUT critical output sets is tricky, because increasing the depth of a LUT may take other, adjacent LUTs off the critical
 	// path to the output. Conservatively, if we increase depth of some LUT, every LUT in its input cone needs to have its critical output
 	// set invalidated, too.
-	pool<RTLIL::SigBit> invalidate_lut_critical_outputs(dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs,
-	                                                    pool<RTLIL::SigBit> worklist)
+	pool<int> invalidate_lut_critical_outputs(dict<int, pool<int>> &lut_critical_outputs,
+	                                          pool<int> worklist)
 	{
-		pool<RTLIL::SigBit> changed;
+		pool<int> changed;
 		while (!worklist.empty())
 		{
 			auto lut = worklist.pop();
@@ -1004,21 +1161,21 @@ struct FlowmapWorker
 		return changed;
 	}
 
-	void check_lut_critical_outputs(const dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs)
+	void check_lut_critical_outputs(const dict<int, pool<int>> &lut_critical_outputs)
 	{
-		dict<RTLIL::SigBit, pool<RTLIL::SigBit>> gold_lut_critical_outputs;
+		dict<int, pool<int>> gold_lut_critical_outputs;
 		compute_lut_critical_outputs(gold_lut_critical_outputs);
 		for (auto lut_critical_output : lut_critical_outputs)
 			if (lut_nodes[lut_critical_output.first])
 				log_assert(lut_critical_output.second == gold_lut_critical_outputs[lut_critical_output.first]);
 	}
 
-	void update_lut_critical_outputs(dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs,
-	                                 pool<RTLIL::SigBit> worklist = {})
+	void update_lut_critical_outputs(dict<int, pool<int>> &lut_critical_outputs,
+	                                 pool<int> worklist = {})
 	{
 		if (!worklist.empty())
 		{
-			pool<RTLIL::SigBit> invalidated = invalidate_lut_critical_outputs(lut_critical_outputs, worklist);
+			pool<int> invalidated = invalidate_lut_critical_outputs(lut_critical_outputs, worklist);
 			compute_lut_critical_outputs(lut_critical_outputs, invalidated);
 			check_lut_critical_outputs(lut_critical_outputs);
 		}
@@ -1026,18 +1183,20 @@ struct FlowmapWorker
 			compute_lut_critical_outputs(lut_critical_outputs);
 	}
 
-	void update_breaking_node_potentials(dict<RTLIL::SigBit, dict<RTLIL::SigBit, int>> &potentials,
-	                                     const dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs)
+	void update_breaking_node_potentials(dict<int, dict<int, int>> &potentials,
+	                                     const dict<int, pool<int>> &lut_critical_outputs)
 	{
-		for (auto lut : lut_nodes)
+		for (int lut = 0; lut < num_nodes(); lut++)
 		{
+			if (!lut_nodes[lut])
+				continue;
 			if (potentials.count(lut))
 				continue;
 			if (lut_gates[lut].size() == 1 || lut_slacks[lut] == 0)
 				continue;
 
 			if (debug_relax)
-				log("  Computing potentials for LUT %s.\n", log_signal(lut));
+				log("  Computing potentials for LUT %s.\n", log_node(lut));
 
 			for (auto lut_gate : lut_gates[lut])
 			{
@@ -1045,12 +1204,12 @@ struct FlowmapWorker
 					continue;
 
 				if (debug_relax)
-					log("    Considering breaking node %s.\n", log_signal(lut_gate));
+					log("    Considering breaking node %s.\n", log_node(lut_gate));
 
 				int r_ex, r_im, r_slk;
 
 				auto cut_inputs = cut_lut_at_gate(lut, lut_gate);
-				pool<RTLIL::SigBit> gate_inputs = cut_inputs.first, other_inputs = cut_inputs.second;
+				pool<int> gate_inputs = cut_inputs.first, other_inputs = cut_inputs.second;
 				if (gate_inputs.empty() && (int)other_inputs.size() >= order)
 				{
 					if (debug_relax)
@@ -1058,7 +1217,7 @@ struct FlowmapWorker
 					continue;
 				}
 
-				pool<RTLIL::SigBit> elim_fanin_luts;
+				pool<int> elim_fanin_luts;
 				for (auto gate_input : gate_inputs)
 				{
 					if (lut_edges_fw[gate_input].size() == 1)
@@ -1075,23 +1234,23 @@ struct FlowmapWorker
 					{
 						log("      Breaking eliminates LUT inputs");
 						for (auto gate_input : gate_inputs)
-							log(" %s", log_signal(gate_input));
+							log(" %s", log_node(gate_input));
 						log(".\n");
 					}
 					if (!elim_fanin_luts.empty())
 					{
 						log("      Breaking eliminates fan-in LUTs");
 						for (auto elim_fanin_lut : elim_fanin_luts)
-							log(" %s", log_signal(elim_fanin_lut));
+							log(" %s", log_node(elim_fanin_lut));
 						log(".\n");
 					}
 				}
 				r_ex = (lut_nodes[lut_gate] ? 0 : -1) + elim_fanin_luts.size();
 
-				pool<pair<RTLIL::SigBit, RTLIL::SigBit>> maybe_mergeable_luts;
+				pool<pair<int, int>> maybe_mergeable_luts;
 
 				// Try to merge LUTv with one of its successors.
-				RTLIL::SigBit last_lut_succ;
+				int last_lut_succ = -1;
 				int fanout = 0;
 				for (auto lut_succ : lut_edges_fw[lut])
 				{
@@ -1130,7 +1289,7 @@ struct FlowmapWorker
 				for (auto maybe_mergeable_pair : maybe_mergeable_luts)
 				{
 					log_assert(lut_edges_fw[maybe_mergeable_pair.first][maybe_mergeable_pair.second]);
-					pool<RTLIL::SigBit> unique_inputs;
+					pool<int> unique_inputs;
 					for (auto fst_lut_pred : lut_edges_bw[maybe_mergeable_pair.first])
 						if (lut_nodes[fst_lut_pred])
 							unique_inputs.insert(fst_lut_pred);
@@ -1142,7 +1301,7 @@ struct FlowmapWorker
 					{
 						if (debug_relax)
 							log("      Breaking may allow merging %s and %s.\n",
-							    log_signal(maybe_mergeable_pair.first), log_signal(maybe_mergeable_pair.second));
+							    log_node(maybe_mergeable_pair.first), log_node(maybe_mergeable_pair.second));
 						r_im++;
 					}
 				}
@@ -1154,7 +1313,7 @@ struct FlowmapWorker
 				{
 					lut_gate_depth = 0;
 					for (auto lut_gate_pred : lut_edges_bw[lut_gate])
-						lut_gate_depth = max(lut_gate_depth, lut_depths[lut_gate_pred] + 1);
+						lut_gate_depth = max(lut_gate_depth, max(lut_depths[lut_gate_pred], 0) + 1);
 				}
 				if (lut_depths[lut] >= lut_gate_depth + 1)
 					r_slk = 0;
@@ -1176,7 +1335,7 @@ struct FlowmapWorker
 							log("      Breaking decreases slack of outputs");
 							for (auto lut_critical_output : lut_critical_outputs.at(lut))
 							{
-								log(" %s", log_signal(lut_critical_output));
+								log(" %s", log_node(lut_critical_output));
 								log_assert(lut_slacks[lut_critical_output] > 0);
 							}
 							log(".\n");
@@ -1188,18 +1347,20 @@ struct FlowmapWorker
 				int p = 100 * (r_alpha * r_ex + r_beta * r_im + r_gamma) / (r_slk + 1);
 				if (debug_relax)
 					log("    Potential for breaking node %s: %d (Rex=%d, Rim=%d, Rslk=%d).\n",
-					    log_signal(lut_gate), p, r_ex, r_im, r_slk);
+					    log_node(lut_gate), p, r_ex, r_im, r_slk);
 				potentials[lut][lut_gate] = p;
 			}
 		}
 	}
 
-	bool relax_depth_for_bound(bool first, int depth_bound, dict<RTLIL::SigBit, pool<RTLIL::SigBit>> &lut_critical_outputs)
+	bool relax_depth_for_bound(bool first, int depth_bound, dict<int, pool<int>> &lut_critical_outputs)
 	{
-		int initial_count = GetSize(lut_nodes);
+		int initial_count = count_luts();
 
-		for (auto node : lut_nodes)
+		for (int node = 0; node < num_nodes(); node++)
 		{
+			if (!lut_nodes[node])
+				continue;
 			lut_slacks[node] = depth_bound - (lut_depths[node] + lut_altitudes[node]);
 			log_assert(lut_slacks[node] >= 0);
 		}
@@ -1209,14 +1370,15 @@ struct FlowmapWorker
 			log("  Dumped initial slack graph to `flowmap-relax-%d-initial.dot`.\n", depth_bound);
 		}
 
-		dict<RTLIL::SigBit, dict<RTLIL::SigBit, int>> potentials;
+		dict<int, dict<int, int>> potentials;
 		for (int break_num = 1; ; break_num++)
 		{
 			update_breaking_node_potentials(potentials, lut_critical_outputs);
 
 			if (potentials.empty())
 			{
-				log("  Relaxed to %d (+%d) LUTs.\n", GetSize(lut_nodes), GetSize(lut_nodes) - initial_count);
+				int final_count = count_luts();
+				log("  Relaxed to %d (+%d) LUTs.\n", final_count, final_count - initial_count);
 				if (!first && break_num == 1)
 				{
 					log("  Design fully relaxed.\n");
@@ -1229,7 +1391,7 @@ struct FlowmapWorker
 				}
 			}
 
-			RTLIL::SigBit breaking_lut, breaking_gate;
+			int breaking_lut = -1, breaking_gate = -1;
 			int best_potential = INT_MIN;
 			for (auto lut_gate_potentials : potentials)
 			{
@@ -1244,17 +1406,17 @@ struct FlowmapWorker
 				}
 			}
 			log("  Breaking LUT %s to %s LUT %s (potential %d).\n",
-			    log_signal(breaking_lut), lut_nodes[breaking_gate] ? "reuse" : "extract", log_signal(breaking_gate), best_potential);
+			    log_node(breaking_lut), lut_nodes[breaking_gate] ? "reuse" : "extract", log_node(breaking_gate), best_potential);
 
 			if (debug_relax)
-				log("    Removing breaking gate %s from LUT.\n", log_signal(breaking_gate));
+				log("    Removing breaking gate %s from LUT.\n", log_node(breaking_gate));
 			lut_gates[breaking_lut].erase(breaking_gate);
 
 			auto cut_inputs = cut_lut_at_gate(breaking_lut, breaking_gate);
-			pool<RTLIL::SigBit> gate_inputs = cut_inputs.first, other_inputs = cut_inputs.second;
+			pool<int> gate_inputs = cut_inputs.first, other_inputs = cut_inputs.second;
 
-			pool<RTLIL::SigBit> worklist = lut_gates[breaking_lut];
-			pool<RTLIL::SigBit> elim_gates = gate_inputs;
+			pool<int> worklist = lut_gates[breaking_lut];
+			pool<int> elim_gates = gate_inputs;
 			while (!worklist.empty())
 			{
 				auto lut_gate = worklist.pop();
@@ -1265,7 +1427,7 @@ struct FlowmapWorker
 				if (all_gate_preds_elim)
 				{
 					if (debug_relax)
-						log("    Removing gate %s from LUT.\n", log_signal(lut_gate));
+						log("    Removing gate %s from LUT.\n", log_node(lut_gate));
 					lut_gates[breaking_lut].erase(lut_gate);
 					for (auto lut_gate_succ : edges_fw[lut_gate])
 						worklist.insert(lut_gate_succ);
@@ -1273,21 +1435,21 @@ struct FlowmapWorker
 			}
 			log_assert(!lut_gates[breaking_lut].empty());
 
-			pool<RTLIL::SigBit> directly_affected_nodes = {breaking_lut};
+			pool<int> directly_affected_nodes = {breaking_lut};
 			for (auto gate_input : gate_inputs)
 			{
 				if (debug_relax)
-					log("    Removing LUT edge %s -> %s.\n", log_signal(gate_input), log_signal(breaking_lut));
+					log("    Removing LUT edge %s -> %s.\n", log_node(gate_input), log_node(breaking_lut));
 				remove_lut_edge(gate_input, breaking_lut, &directly_affected_nodes);
 			}
 			if (debug_relax)
-				log("    Adding LUT edge %s -> %s.\n", log_signal(breaking_gate), log_signal(breaking_lut));
+				log("    Adding LUT edge %s -> %s.\n", log_node(breaking_gate), log_node(breaking_lut));
 			add_lut_edge(breaking_gate, breaking_lut, &directly_affected_nodes);
 
 			if (debug_relax)
 				log("  Updating slack and potentials.\n");
 
-			pool<RTLIL::SigBit> indirectly_affected_nodes = {};
+			pool<int> indirectly_affected_nodes = {};
 			update_lut_depths_altitudes(directly_affected_nodes, &indirectly_affected_nodes);
 			update_lut_critical_outputs(lut_critical_outputs, indirectly_affected_nodes);
 			for (auto node : indirectly_affected_nodes)
@@ -1295,11 +1457,11 @@ struct FlowmapWorker
 				lut_slacks[node] = depth_bound - (lut_depths[node] + lut_altitudes[node]);
 				log_assert(lut_slacks[node] >= 0);
 				if (debug_relax)
-					log("    LUT %s now has depth %d and slack %d.\n", log_signal(node), lut_depths[node], lut_slacks[node]);
+					log("    LUT %s now has depth %d and slack %d.\n", log_node(node), lut_depths[node], lut_slacks[node]);
 			}
 
 			worklist = indirectly_affected_nodes;
-			pool<RTLIL::SigBit> visited;
+			pool<int> visited;
 			while (!worklist.empty())
 			{
 				auto node = worklist.pop();
@@ -1326,7 +1488,7 @@ struct FlowmapWorker
 
 	void optimize_area(int depth, int optarea)
 	{
-		dict<RTLIL::SigBit, pool<RTLIL::SigBit>> lut_critical_outputs;
+		dict<int, pool<int>> lut_critical_outputs;
 		update_lut_depths_altitudes();
 		update_lut_critical_outputs(lut_critical_outputs);
 
@@ -1343,30 +1505,33 @@ struct FlowmapWorker
 	void pack_cells(int minlut)
 	{
 		ConstEval ce(module);
-		for (auto input_node : inputs)
-			ce.stop(input_node);
+		for (auto input_node : input_nodes)
+			ce.stop(node_bits[input_node]);
 
-		pool<RTLIL::SigBit> mapped_nodes;
-		for (auto node : lut_nodes)
+		vector<int> mapped_nodes;
+		for (int node = 0; node < num_nodes(); node++)
 		{
-			if (node_origins.count(node))
+			if (!lut_nodes[node])
+				continue;
+
+			if (node_origins[node].cell != nullptr)
 			{
 				auto origin = node_origins[node];
 				if (origin.cell->getPort(origin.port).size() == 1)
 					log("Packing %s.%s.%s (%s).\n",
-					    log_id(module), log_id(origin.cell), origin.port.c_str(), log_signal(node));
+					    log_id(module), log_id(origin.cell), origin.port.c_str(), log_node(node));
 				else
 					log("Packing %s.%s.%s [%d] (%s).\n",
-					    log_id(module), log_id(origin.cell), origin.port.c_str(), origin.offset, log_signal(node));
+					    log_id(module), log_id(origin.cell), origin.port.c_str(), origin.offset, log_node(node));
 			}
 			else
 			{
-				log("Packing %s.%s.\n", log_id(module), log_signal(node));
+				log("Packing %s.%s.\n", log_id(module), log_node(node));
 			}
 
 			for (auto gate_node : lut_gates[node])
 			{
-				log_assert(node_origins.count(gate_node));
+				log_assert(node_origins[gate_node].cell != nullptr);
 
 				if (gate_node == node)
 					continue;
@@ -1374,43 +1539,45 @@ struct FlowmapWorker
 				auto gate_origin = node_origins[gate_node];
 				if (gate_origin.cell->getPort(gate_origin.port).size() == 1)
 					log("  Packing %s.%s.%s (%s).\n",
-					    log_id(module), log_id(gate_origin.cell), gate_origin.port.c_str(), log_signal(gate_node));
+					    log_id(module), log_id(gate_origin.cell), gate_origin.port.c_str(), log_node(gate_node));
 				else
 					log("  Packing %s.%s.%s [%d] (%s).\n",
-					    log_id(module), log_id(gate_origin.cell), gate_origin.port.c_str(), gate_origin.offset, log_signal(gate_node));
+					    log_id(module), log_id(gate_origin.cell), gate_origin.port.c_str(), gate_origin.offset, log_node(gate_node));
 			}
 
-			vector<RTLIL::SigBit> input_nodes(lut_edges_bw[node].begin(), lut_edges_bw[node].end());
-			RTLIL::Const lut_table(State::Sx, max(1 << input_nodes.size(), 1 << minlut));
-			unsigned const mask = 1 << input_nodes.size();
+			vector<RTLIL::SigBit> input_bits;
+			for (auto input_node : lut_edges_bw[node])
+				input_bits.push_back(node_bits[input_node]);
+			RTLIL::Const lut_table(State::Sx, max(1 << input_bits.size(), 1 << minlut));
+			unsigned const mask = 1 << input_bits.size();
 			for (unsigned i = 0; i < mask; i++)
 			{
 				ce.push();
-				for (size_t n = 0; n < input_nodes.size(); n++)
-					ce.set(input_nodes[n], ((i >> n) & 1) ? State::S1 : State::S0);
+				for (size_t n = 0; n < input_bits.size(); n++)
+					ce.set(input_bits[n], ((i >> n) & 1) ? State::S1 : State::S0);
 
-				RTLIL::SigSpec value = node, undef;
+				RTLIL::SigSpec value = node_bits[node], undef;
 				if (!ce.eval(value, undef))
 				{
 					string env;
-					for (auto input_node : input_nodes)
-						env += stringf("  %s = %s\n", log_signal(input_node), log_signal(ce.values_map(input_node)));
+					for (auto input_bit : input_bits)
+						env += stringf("  %s = %s\n", log_signal(input_bit), log_signal(ce.values_map(input_bit)));
 					log_error("Cannot evaluate %s because %s is not defined.\nEvaluation environment:\n%s",
-					          log_signal(node), log_signal(undef), env.c_str());
+					          log_node(node), log_signal(undef), env.c_str());
 				}
 
 				lut_table[i] = value.as_bool() ? State::S1 : State::S0;
 				ce.pop();
 			}
 
-			RTLIL::SigSpec lut_a, lut_y = node;
-			for (auto input_node : input_nodes)
-				lut_a.append(input_node);
-			if ((int)input_nodes.size() < minlut)
-				lut_a.append(RTLIL::Const(State::Sx, minlut - input_nodes.size()));
+			RTLIL::SigSpec lut_a, lut_y = node_bits[node];
+			for (auto input_bit : input_bits)
+				lut_a.append(input_bit);
+			if ((int)input_bits.size() < minlut)
+				lut_a.append(RTLIL::Const(State::Sx, minlut - input_bits.size()));
 
 			RTLIL::Cell *lut = module->addLut(NEW_ID, lut_a, lut_y, lut_table);
-			mapped_nodes.insert(node);
+			mapped_nodes.push_back(node);
 			for (auto gate_node : lut_gates[node])
 			{
 				auto gate_origin = node_origins[gate_node];
@@ -1420,10 +1587,10 @@ struct FlowmapWorker
 			lut_count++;
 			lut_area += lut_table.size();
 
-			if ((int)input_nodes.size() >= minlut)
-				log("  Packed into a %d-LUT %s.%s.\n", GetSize(input_nodes), log_id(module), log_id(lut));
+			if ((int)input_bits.size() >= minlut)
+				log("  Packed into a %d-LUT %s.%s.\n", GetSize(input_bits), log_id(module), log_id(lut));
 			else
-				log("  Packed into a %d-LUT %s.%s (implemented as %d-LUT).\n", GetSize(input_nodes), log_id(module), log_id(lut), minlut);
+				log("  Packed into a %d-LUT %s.%s (implemented as %d-LUT).\n", GetSize(input_bits), log_id(module), log_id(lut), minlut);
 		}
 
 		for (auto node : mapped_nodes)
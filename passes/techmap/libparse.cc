@@ -25,6 +25,15 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 #ifndef FILTERLIB
 #include "kernel/log.h"
@@ -50,6 +59,14 @@ LibertyAst *LibertyAst::find(std::string name)
 	return NULL;
 }
 
+const LibertyAst *LibertyAst::find(std::string name) const
+{
+	for (auto child : children)
+		if (child->id == name)
+			return child;
+	return NULL;
+}
+
 void LibertyAst::dump(FILE *f, std::string indent, std::string path, bool path_ok)
 {
 	if (whitelist.count(path + "/*") > 0)
@@ -83,26 +100,38 @@ void LibertyAst::dump(FILE *f, std::string indent, std::string path, bool path_o
 		fprintf(f, " ;\n");
 }
 
+LibertyParser::LibertyParser(std::istream &f, const std::set<std::string> &skip_groups) :
+		buffer(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()),
+		pos(buffer.data()), end(buffer.data() + buffer.size()), past_end(0),
+		skip_groups(skip_groups), line(1), ast(parse())
+{
+}
+
+LibertyParser::LibertyParser(const char *begin, const char *end, const std::set<std::string> &skip_groups) :
+		pos(begin), end(end), past_end(0), skip_groups(skip_groups), line(1), ast(parse())
+{
+}
+
 int LibertyParser::lexer(std::string &str)
 {
 	int c;
 
 	// eat whitespace
 	do {
-		c = f.get();
+		c = get();
 	} while (c == ' ' || c == '\t' || c == '\r');
 
 	// search for identifiers, numbers, plus or minus.
 	if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_' || c == '-' || c == '+' || c == '.') {
 		str = static_cast<char>(c);
 		while (1) {
-			c = f.get();
+			c = get();
 			if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_' || c == '-' || c == '+' || c == '.')
 				str += c;
 			else
 				break;
 		}
-		f.unget();
+		unget();
 		if (str == "+" || str == "-") {
 			/* Single operator is not an identifier */
 			// fprintf(stderr, "LEX: char >>%s<<\n", str.c_str());
@@ -119,11 +148,13 @@ int LibertyParser::lexer(std::string &str)
 	if (c == '"') {
 		str = "";
 		while (1) {
-			c = f.get();
+			c = get();
 			if (c == '\n')
 				line++;
 			if (c == '"')
 				break;
+			if (c == EOF)
+				error("Unterminated string.");
 			str += c;
 		}
 		// fprintf(stderr, "LEX: string >>%s<<\n", str.c_str());
@@ -132,37 +163,37 @@ int LibertyParser::lexer(std::string &str)
 
 	// if it wasn't a string, perhaps it's a comment or a forward slash?
 	if (c == '/') {
-		c = f.get();
+		c = get();
 		if (c == '*') {         // start of '/*' block comment
 			int last_c = 0;
 			while (c > 0 && (last_c != '*' || c != '/')) {
 				last_c = c;
-				c = f.get();
+				c = get();
 				if (c == '\n')
 					line++;
 			}
 			return lexer(str);
 		} else if (c == '/') {  // start of '//' line comment
 			while (c > 0 && c != '\n')
-				c = f.get();
+				c = get();
 			line++;
 			return lexer(str);
 		}
-		f.unget();
+		unget();
 		// fprintf(stderr, "LEX: char >>/<<\n");
 		return '/';             // a single '/' charater.
 	}
 
 	// check for a backslash
 	if (c == '\\') {
-		c = f.get();		
+		c = get();		
 		if (c == '\r')
-			c = f.get();
+			c = get();
 		if (c == '\n') {
 			line++;
 			return lexer(str);
 		}
-		f.unget();
+		unget();
 		return '\\';
 	}
 
@@ -336,6 +367,10 @@ LibertyAst *LibertyParser::parse()
 		}
 
 		if (tok == '{') {
+			if (skip_groups.count(ast->id)) {
+				skip_group();
+				break;
+			}
 			while (1) {
 				LibertyAst *child = parse();
 				if (child == NULL)
@@ -351,6 +386,148 @@ LibertyAst *LibertyParser::parse()
 	return ast;
 }
 
+// Skips to the '}' that closes the group whose '{' was just read. This
+// scans the raw characters, as tokenizing the contents is what makes
+// parsing the timing tables slow.
+void LibertyParser::skip_group()
+{
+	int depth = 1;
+	while (pos < end)
+	{
+		char c = *pos++;
+		switch (c)
+		{
+		case '\n':
+			line++;
+			break;
+		case '{':
+			depth++;
+			break;
+		case '}':
+			if (--depth == 0)
+				return;
+			break;
+		case '"':
+			while (pos < end && *pos != '"')
+				if (*pos++ == '\n')
+					line++;
+			if (pos == end)
+				error("Unterminated string.");
+			pos++;
+			break;
+		case '/':
+			if (pos < end && *pos == '*') {
+				for (pos++; pos < end && !(pos[0] == '*' && pos+1 < end && pos[1] == '/'); pos++)
+					if (*pos == '\n')
+						line++;
+				pos = pos < end ? pos + 2 : end;
+			} else if (pos < end && *pos == '/') {
+				while (pos < end && *pos != '\n')
+					pos++;
+			}
+			break;
+		}
+	}
+}
+
+const std::set<std::string> Yosys::liberty_timing_groups = {
+	"timing", "internal_power"
+};
+
+namespace {
+	struct liberty_cache_entry_t
+	{
+		time_t mtime;
+		off_t size;
+		std::set<std::string> skip_groups;
+		std::shared_ptr<const LibertyAst> ast;
+	};
+
+	// The contents of a liberty file, mapped into memory where possible.
+	struct liberty_file_t
+	{
+		std::string buffer;
+		const char *data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+
+		bool read(const std::string &filename, size_t file_size)
+		{
+#ifndef _WIN32
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+			if (file_size > 0) {
+				void *p = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					data = (const char*)p;
+					size = file_size;
+					mapped = true;
+				}
+			}
+			close(fd);
+			if (mapped || file_size == 0)
+				return true;
+#endif
+			std::ifstream f(filename.c_str(), std::ios::binary);
+			if (f.fail())
+				return false;
+			buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			data = buffer.data();
+			size = buffer.size();
+			return true;
+		}
+
+		~liberty_file_t()
+		{
+#ifndef _WIN32
+			if (mapped)
+				munmap((void*)data, size);
+#endif
+		}
+	};
+}
+
+// Parsed liberty files, one entry for each set of skipped groups.
+static std::map<std::string, std::vector<liberty_cache_entry_t>> liberty_cache;
+static std::mutex liberty_cache_mutex;
+
+std::shared_ptr<const LibertyAst> Yosys::liberty_parse_file(const std::string &filename, const std::set<std::string> &skip_groups)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+		return nullptr;
+
+	// Holding the lock while parsing makes concurrent callers wait for the
+	// first one instead of parsing the same file again.
+	std::lock_guard<std::mutex> lock(liberty_cache_mutex);
+	auto &entries = liberty_cache[filename];
+	for (auto &entry : entries)
+		if (entry.skip_groups == skip_groups) {
+			if (entry.mtime == st.st_mtime && entry.size == st.st_size)
+				return entry.ast;
+			std::swap(entry, entries.back());
+			entries.pop_back();
+			break;
+		}
+
+	liberty_file_t file;
+	if (!file.read(filename, st.st_size))
+		return nullptr;
+
+	LibertyParser parser(file.data, file.data + file.size, skip_groups);
+	std::shared_ptr<const LibertyAst> ast(parser.ast ? parser.ast : new LibertyAst);
+	parser.ast = nullptr;
+
+	liberty_cache_entry_t entry;
+	entry.mtime = st.st_mtime;
+	entry.size = st.st_size;
+	entry.skip_groups = skip_groups;
+	entry.ast = ast;
+	entries.push_back(entry);
+	return ast;
+}
+
 #ifndef FILTERLIB
 
 void LibertyParser::error()
@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <memory>
 
 namespace Yosys
 {
@@ -34,6 +35,7 @@ namespace Yosys
 		std::vector<LibertyAst*> children;
 		~LibertyAst();
 		LibertyAst *find(std::string name);
+		const LibertyAst *find(std::string name) const;
 		void dump(FILE *f, std::string indent = "", std::string path = "", bool path_ok = false);
 		static std::set<std::string> blacklist;
 		static std::set<std::string> whitelist;
@@ -41,10 +43,20 @@ namespace Yosys
 
 	struct LibertyParser
 	{
-		std::istream &f;
+		// The input. The istream constructor reads the whole stream into
+		// buffer, liberty_parse_file() maps the file instead.
+		std::string buffer;
+		const char *pos, *end;
+		int past_end;
+
+		// Groups with these ids are kept in the AST without their contents,
+		// for consumers that don't need e.g. the timing tables of each pin.
+		std::set<std::string> skip_groups;
+
 		int line;
 		LibertyAst *ast;
-		LibertyParser(std::istream &f) : f(f), line(1), ast(parse()) {}
+		LibertyParser(std::istream &f, const std::set<std::string> &skip_groups = std::set<std::string>());
+		LibertyParser(const char *begin, const char *end, const std::set<std::string> &skip_groups = std::set<std::string>());
 		~LibertyParser() { if (ast) delete ast; }
         
         /* lexer return values:
@@ -55,9 +67,32 @@ namespace Yosys
 		int lexer(std::string &str);
 		
         LibertyAst *parse();
+		void skip_group();
 		void error();
         void error(const std::string &str);
+
+		int get() {
+			if (pos == end) {
+				past_end++;
+				return EOF;
+			}
+			return (unsigned char)*pos++;
+		}
+		void unget() {
+			if (past_end > 0)
+				past_end--;
+			else
+				pos--;
+		}
 	};
+
+	// The groups that dfflibmap, stat and read_liberty don't look into.
+	extern const std::set<std::string> liberty_timing_groups;
+
+	// Parses the liberty file with the given name, or returns the AST of an
+	// earlier call for the same unchanged file and skip_groups. Returns
+	// nullptr if the file can't be read.
+	std::shared_ptr<const LibertyAst> liberty_parse_file(const std::string &filename, const std::set<std::string> &skip_groups = std::set<std::string>());
 }
 
 #endif
@@ -0,0 +1,800 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// [[CITE]] Priority cuts
+// Alan Mishchenko, Sungmin Cho, Satrajit Chatterjee, Robert Brayton, "Combinational and Sequential Mapping with Priority Cuts,"
+// Proceedings of the International Conference on Computer-Aided Design (ICCAD), 2007.
+
+// [[CITE]] Area flow and exact area recovery
+// Valavan Manohararajah, Stephen D. Brown, Zvonko G. Vranesic, "Heuristics for Area Minimization in LUT-Based FPGA Technology Mapping,"
+// IEEE Transactions on Computer-Aided Design of Integrated Circuits and Systems, Vol. 25, No. 11, 2006.
+
+// Notes on implementation:
+//
+// 1. The gates are converted to an AIG with structural hashing. Nodes are identified by dense integers, node 0 is the constant 0,
+// inputs and AND nodes follow in topological order. Edges are literals (2*node+1 for an inverted edge), inversions are folded into
+// the truth tables of the LUTs.
+//
+// 2. Every AND node keeps at most -cuts K-feasible cuts, sorted by the priority of the current mapping pass. The first pass selects
+// the cut with the smallest depth for each node. The following passes keep the depth of the outputs and select the cut with the
+// smallest area flow and then the smallest exact area (the number of LUTs only used by the cone of the node) for each node, as long
+// as it is not later than the required time of the node in the previous mapping.
+//
+// 3. The cuts of a node only depend on its transitive fan-in, and area flow and exact area only on the mapping of the same cone.
+// Connected components of the AIG are therefore mapped independently, in parallel when multi-threading is enabled, and the result
+// does not depend on the number of threads.
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+#include "kernel/threading.h"
+#include <climits>
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+static const int max_lut_size = 8;
+
+struct LutMapAig
+{
+	// fanin literals of AND nodes, -1 for the constant and the inputs
+	std::vector<int> fanin0, fanin1;
+	std::vector<RTLIL::SigBit> input_bits;
+	dict<std::pair<int, int>, int> strash;
+
+	LutMapAig() : fanin0(1, -1), fanin1(1, -1), input_bits(1) { }
+
+	int num_nodes() const { return GetSize(fanin0); }
+	bool is_and(int node) const { return fanin0[node] >= 0; }
+
+	int add_input(RTLIL::SigBit bit)
+	{
+		fanin0.push_back(-1);
+		fanin1.push_back(-1);
+		input_bits.push_back(bit);
+		return 2 * (num_nodes() - 1);
+	}
+
+	int lit_and(int a, int b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		if (a == 0 || a == (b ^ 1))
+			return 0;
+		if (a == 1 || a == b)
+			return b;
+		auto key = std::make_pair(a, b);
+		auto it = strash.find(key);
+		if (it != strash.end())
+			return it->second;
+		fanin0.push_back(a);
+		fanin1.push_back(b);
+		input_bits.push_back(RTLIL::SigBit());
+		int lit = 2 * (num_nodes() - 1);
+		strash[key] = lit;
+		return lit;
+	}
+
+	int lit_or(int a, int b) { return lit_and(a ^ 1, b ^ 1) ^ 1; }
+	int lit_xor(int a, int b) { return lit_or(lit_and(a, b ^ 1), lit_and(a ^ 1, b)); }
+	int lit_mux(int a, int b, int s) { return lit_or(lit_and(s ^ 1, a), lit_and(s, b)); }
+};
+
+struct LutMapCut
+{
+	int leaves[max_lut_size];
+	int size;
+	uint32_t sign;
+	int depth;
+	float flow;
+	int area;
+
+	bool contains(const LutMapCut &other) const
+	{
+		// true if the leaves of other are a subset of the leaves of this cut
+		if ((sign & other.sign) != other.sign || size < other.size)
+			return false;
+		int i = 0;
+		for (int j = 0; j < other.size; j++) {
+			while (i < size && leaves[i] < other.leaves[j])
+				i++;
+			if (i == size || leaves[i] != other.leaves[j])
+				return false;
+		}
+		return true;
+	}
+};
+
+struct LutMapper
+{
+	enum Mode { DepthMode, FlowMode, AreaMode };
+
+	const LutMapAig &aig;
+	int lut_size, max_cuts;
+
+	std::vector<std::vector<LutMapCut>> cuts;
+	std::vector<LutMapCut> best;
+	std::vector<int> arrival, required, refs;
+	std::vector<float> flow, fanout_est;
+
+	LutMapper(const LutMapAig &aig, int lut_size, int max_cuts) : aig(aig), lut_size(lut_size), max_cuts(max_cuts)
+	{
+		int num_nodes = aig.num_nodes();
+		cuts.resize(num_nodes);
+		best.resize(num_nodes);
+		arrival.assign(num_nodes, 0);
+		required.assign(num_nodes, INT_MAX);
+		refs.assign(num_nodes, 0);
+		flow.assign(num_nodes, 0);
+		fanout_est.assign(num_nodes, 0);
+		for (int node = 0; node < num_nodes; node++)
+			if (aig.is_and(node)) {
+				fanout_est[aig.fanin0[node] / 2] += 1;
+				fanout_est[aig.fanin1[node] / 2] += 1;
+			}
+	}
+
+	void update_cut(LutMapCut &cut) const
+	{
+		cut.depth = 0;
+		cut.flow = 1;
+		for (int i = 0; i < cut.size; i++) {
+			int leaf = cut.leaves[i];
+			cut.depth = std::max(cut.depth, arrival[leaf]);
+			cut.flow += flow[leaf] / std::max(fanout_est[leaf], 1.0f);
+		}
+		cut.depth++;
+	}
+
+	static bool merge_cuts(const LutMapCut &a, const LutMapCut &b, LutMapCut &result, int lut_size)
+	{
+		result.sign = a.sign | b.sign;
+		if (__builtin_popcount(result.sign) > lut_size)
+			return false;
+		int i = 0, j = 0, k = 0;
+		while (i < a.size || j < b.size) {
+			if (k == lut_size)
+				return false;
+			if (j == b.size || (i < a.size && a.leaves[i] < b.leaves[j]))
+				result.leaves[k++] = a.leaves[i++];
+			else if (i == a.size || b.leaves[j] < a.leaves[i])
+				result.leaves[k++] = b.leaves[j++];
+			else
+				result.leaves[k++] = a.leaves[i++], j++;
+		}
+		result.size = k;
+		return true;
+	}
+
+	LutMapCut trivial_cut(int node) const
+	{
+		LutMapCut cut;
+		cut.leaves[0] = node;
+		cut.size = 1;
+		cut.sign = 1u << (node % 32);
+		return cut;
+	}
+
+	static bool cut_less(const LutMapCut &a, const LutMapCut &b, Mode mode)
+	{
+		if (mode == DepthMode) {
+			if (a.depth != b.depth)
+				return a.depth < b.depth;
+			if (a.size != b.size)
+				return a.size < b.size;
+			return a.flow < b.flow - 1e-4f;
+		}
+		if (a.flow < b.flow - 1e-4f || a.flow > b.flow + 1e-4f)
+			return a.flow < b.flow;
+		if (a.depth != b.depth)
+			return a.depth < b.depth;
+		return a.size < b.size;
+	}
+
+	// Returns the number of LUTs that are added to the mapping when the cut
+	// is selected, and references its cone.
+	int cut_ref(const LutMapCut &cut, std::vector<int> &stack)
+	{
+		int area = 1;
+		stack.assign(cut.leaves, cut.leaves + cut.size);
+		while (!stack.empty()) {
+			int node = stack.back();
+			stack.pop_back();
+			if (aig.is_and(node) && refs[node]++ == 0) {
+				area++;
+				stack.insert(stack.end(), best[node].leaves, best[node].leaves + best[node].size);
+			}
+		}
+		return area;
+	}
+
+	int cut_deref(const LutMapCut &cut, std::vector<int> &stack)
+	{
+		int area = 1;
+		stack.assign(cut.leaves, cut.leaves + cut.size);
+		while (!stack.empty()) {
+			int node = stack.back();
+			stack.pop_back();
+			if (aig.is_and(node) && --refs[node] == 0) {
+				area++;
+				stack.insert(stack.end(), best[node].leaves, best[node].leaves + best[node].size);
+			}
+		}
+		return area;
+	}
+
+	void map_node(int node, Mode mode, std::vector<int> &stack)
+	{
+		std::vector<LutMapCut> fanin_cuts[2];
+		for (int k = 0; k < 2; k++) {
+			int fanin = (k ? aig.fanin1[node] : aig.fanin0[node]) / 2;
+			fanin_cuts[k].push_back(trivial_cut(fanin));
+			if (aig.is_and(fanin))
+				fanin_cuts[k].insert(fanin_cuts[k].end(), cuts[fanin].begin(), cuts[fanin].end());
+		}
+
+		std::vector<LutMapCut> candidates;
+		LutMapCut merged;
+		for (auto &a : fanin_cuts[0])
+			for (auto &b : fanin_cuts[1])
+			{
+				if (!merge_cuts(a, b, merged, lut_size))
+					continue;
+				bool dominated = false;
+				for (auto &other : candidates)
+					if (merged.contains(other)) {
+						dominated = true;
+						break;
+					}
+				if (dominated)
+					continue;
+				for (int i = 0; i < GetSize(candidates); i++)
+					if (candidates[i].contains(merged)) {
+						candidates[i] = candidates.back();
+						candidates.pop_back();
+						i--;
+					}
+				update_cut(merged);
+				candidates.push_back(merged);
+			}
+
+		// the previously selected cut stays available, so that the required
+		// time of the node can always be met
+		if (mode != DepthMode) {
+			LutMapCut previous = best[node];
+			update_cut(previous);
+			bool found = false;
+			for (auto &cut : candidates)
+				if (cut.size == previous.size && std::equal(cut.leaves, cut.leaves + cut.size, previous.leaves)) {
+					found = true;
+					break;
+				}
+			if (!found)
+				candidates.push_back(previous);
+		}
+
+		std::stable_sort(candidates.begin(), candidates.end(), [&](const LutMapCut &a, const LutMapCut &b) {
+			return cut_less(a, b, mode);
+		});
+
+		int best_idx = -1;
+		if (mode == AreaMode && refs[node] > 0)
+		{
+			cut_deref(best[node], stack);
+			for (int i = 0; i < GetSize(candidates); i++) {
+				LutMapCut &cut = candidates[i];
+				if (cut.depth > required[node])
+					continue;
+				cut.area = cut_ref(cut, stack);
+				cut_deref(cut, stack);
+				if (best_idx < 0 || cut.area < candidates[best_idx].area ||
+						(cut.area == candidates[best_idx].area && cut.depth < candidates[best_idx].depth))
+					best_idx = i;
+			}
+			log_assert(best_idx >= 0);
+			cut_ref(candidates[best_idx], stack);
+		}
+		else
+		{
+			for (int i = 0; i < GetSize(candidates); i++)
+				if (candidates[i].depth <= required[node]) {
+					best_idx = i;
+					break;
+				}
+			log_assert(best_idx >= 0);
+		}
+
+		best[node] = candidates[best_idx];
+		arrival[node] = best[node].depth;
+		flow[node] = best[node].flow;
+
+		if (best_idx >= max_cuts)
+			candidates[max_cuts - 1] = candidates[best_idx];
+		if (GetSize(candidates) > max_cuts)
+			candidates.resize(max_cuts);
+		cuts[node].swap(candidates);
+	}
+
+	// Runs one mapping pass over the AND nodes of a component, which must be
+	// given in topological order.
+	void map_nodes(const std::vector<int> &nodes, Mode mode)
+	{
+		std::vector<int> stack;
+		for (int node : nodes)
+			map_node(node, mode, stack);
+	}
+
+	// Selects the cuts of the nodes that are needed for the outputs and
+	// computes the required times and the references of the mapping.
+	void update_mapping(const std::vector<int> &nodes, const std::vector<int> &output_nodes, int depth)
+	{
+		for (int node : nodes) {
+			refs[node] = 0;
+			required[node] = INT_MAX;
+		}
+		for (int node : output_nodes) {
+			refs[node]++;
+			required[node] = depth;
+		}
+		for (int i = GetSize(nodes) - 1; i >= 0; i--) {
+			int node = nodes[i];
+			if (refs[node] == 0)
+				continue;
+			for (int k = 0; k < best[node].size; k++) {
+				int leaf = best[node].leaves[k];
+				if (!aig.is_and(leaf))
+					continue;
+				refs[leaf]++;
+				required[leaf] = std::min(required[leaf], required[node] - 1);
+			}
+		}
+		for (int node : nodes)
+			fanout_est[node] = std::max(1.0f, (2 * fanout_est[node] + refs[node]) / 3);
+	}
+};
+
+struct LutMapWorker
+{
+	RTLIL::Module *module;
+	SigMap sigmap;
+	int lut_size, max_cuts, slack;
+	bool noarea;
+
+	LutMapAig aig;
+	std::vector<std::pair<RTLIL::SigBit, int>> outputs;
+	int gate_count = 0, lut_count = 0, depth = 0;
+
+	static bool cell_supported(RTLIL::IdString type)
+	{
+		return type.in(ID($_BUF_), ID($_NOT_), ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_),
+				ID($_ANDNOT_), ID($_ORNOT_), ID($_MUX_), ID($_NMUX_), ID($_AOI3_), ID($_OAI3_), ID($_AOI4_), ID($_OAI4_));
+	}
+
+	int import_cell(RTLIL::Cell *cell, const dict<RTLIL::SigBit, int> &bit_lits)
+	{
+		auto lit = [&](RTLIL::IdString port) {
+			RTLIL::SigBit bit = sigmap(cell->getPort(port));
+			if (bit.wire == nullptr)
+				return bit == State::S1 ? 1 : 0;
+			return bit_lits.at(bit);
+		};
+
+		RTLIL::IdString type = cell->type;
+		if (type == ID($_BUF_))
+			return lit(ID::A);
+		if (type == ID($_NOT_))
+			return lit(ID::A) ^ 1;
+		if (type == ID($_AND_))
+			return aig.lit_and(lit(ID::A), lit(ID::B));
+		if (type == ID($_NAND_))
+			return aig.lit_and(lit(ID::A), lit(ID::B)) ^ 1;
+		if (type == ID($_OR_))
+			return aig.lit_or(lit(ID::A), lit(ID::B));
+		if (type == ID($_NOR_))
+			return aig.lit_or(lit(ID::A), lit(ID::B)) ^ 1;
+		if (type == ID($_XOR_))
+			return aig.lit_xor(lit(ID::A), lit(ID::B));
+		if (type == ID($_XNOR_))
+			return aig.lit_xor(lit(ID::A), lit(ID::B)) ^ 1;
+		if (type == ID($_ANDNOT_))
+			return aig.lit_and(lit(ID::A), lit(ID::B) ^ 1);
+		if (type == ID($_ORNOT_))
+			return aig.lit_or(lit(ID::A), lit(ID::B) ^ 1);
+		if (type == ID($_MUX_))
+			return aig.lit_mux(lit(ID::A), lit(ID::B), lit(ID::S));
+		if (type == ID($_NMUX_))
+			return aig.lit_mux(lit(ID::A), lit(ID::B), lit(ID::S)) ^ 1;
+		if (type == ID($_AOI3_))
+			return aig.lit_or(aig.lit_and(lit(ID::A), lit(ID::B)), lit(ID::C)) ^ 1;
+		if (type == ID($_OAI3_))
+			return aig.lit_and(aig.lit_or(lit(ID::A), lit(ID::B)), lit(ID::C)) ^ 1;
+		if (type == ID($_AOI4_))
+			return aig.lit_or(aig.lit_and(lit(ID::A), lit(ID::B)), aig.lit_and(lit(ID::C), lit(ID::D))) ^ 1;
+		if (type == ID($_OAI4_))
+			return aig.lit_and(aig.lit_or(lit(ID::A), lit(ID::B)), aig.lit_or(lit(ID::C), lit(ID::D))) ^ 1;
+		log_abort();
+	}
+
+	// Returns the cells that are mapped, in topological order. Cells in
+	// logic loops are left alone.
+	std::vector<RTLIL::Cell*> sort_cells()
+	{
+		std::vector<RTLIL::Cell*> cells;
+		dict<RTLIL::SigBit, int> driver;
+		for (auto cell : module->selected_cells())
+			if (cell_supported(cell->type)) {
+				driver[sigmap(cell->getPort(ID::Y))] = GetSize(cells);
+				cells.push_back(cell);
+			}
+
+		std::vector<int> pending(GetSize(cells));
+		std::vector<std::vector<int>> fanouts(GetSize(cells));
+		for (int i = 0; i < GetSize(cells); i++)
+			for (auto &conn : cells[i]->connections()) {
+				if (conn.first == ID::Y)
+					continue;
+				auto it = driver.find(sigmap(conn.second));
+				if (it != driver.end()) {
+					fanouts[it->second].push_back(i);
+					pending[i]++;
+				}
+			}
+
+		std::vector<RTLIL::Cell*> sorted;
+		std::vector<int> queue;
+		for (int i = 0; i < GetSize(cells); i++)
+			if (pending[i] == 0)
+				queue.push_back(i);
+		for (int k = 0; k < GetSize(queue); k++) {
+			sorted.push_back(cells[queue[k]]);
+			for (int j : fanouts[queue[k]])
+				if (--pending[j] == 0)
+					queue.push_back(j);
+		}
+
+		if (GetSize(sorted) < GetSize(cells))
+			log_warning("Not mapping %d cells in logic loops in module %s.\n", GetSize(cells) - GetSize(sorted), log_id(module));
+		return sorted;
+	}
+
+	void import_module(const std::vector<RTLIL::Cell*> &cells)
+	{
+		pool<RTLIL::Cell*> mapped(cells.begin(), cells.end());
+		dict<RTLIL::SigBit, int> bit_lits;
+		pool<RTLIL::SigBit> driven_bits, used_bits;
+
+		for (auto cell : cells)
+			driven_bits.insert(sigmap(cell->getPort(ID::Y)));
+
+		for (auto cell : cells)
+		{
+			for (auto &conn : cell->connections()) {
+				if (conn.first == ID::Y)
+					continue;
+				RTLIL::SigBit bit = sigmap(conn.second);
+				if (bit.wire != nullptr && !driven_bits.count(bit) && !bit_lits.count(bit))
+					bit_lits[bit] = aig.add_input(bit);
+			}
+			bit_lits[sigmap(cell->getPort(ID::Y))] = import_cell(cell, bit_lits);
+		}
+
+		// the bits that are used outside of the mapped logic are the outputs
+		for (auto cell : module->cells()) {
+			if (mapped.count(cell))
+				continue;
+			for (auto &conn : cell->connections())
+				if (!cell->output(conn.first))
+					for (auto bit : sigmap(conn.second))
+						used_bits.insert(bit);
+		}
+		for (auto wire : module->wires())
+			if (wire->port_output || wire->get_bool_attribute(ID::keep))
+				for (auto bit : sigmap(wire))
+					used_bits.insert(bit);
+
+		for (auto cell : cells) {
+			RTLIL::SigBit bit = sigmap(cell->getPort(ID::Y));
+			if (used_bits.count(bit))
+				outputs.emplace_back(bit, bit_lits.at(bit));
+		}
+		gate_count = GetSize(cells);
+	}
+
+	void run_mapper(LutMapper &mapper)
+	{
+		// group the AND nodes into connected components
+		int num_nodes = aig.num_nodes();
+		std::vector<int> parent(num_nodes);
+		for (int node = 0; node < num_nodes; node++)
+			parent[node] = node;
+		auto find = [&](int node) {
+			while (parent[node] != node)
+				node = parent[node] = parent[parent[node]];
+			return node;
+		};
+		for (int node = 0; node < num_nodes; node++)
+			if (aig.is_and(node))
+				for (int fanin : {aig.fanin0[node] / 2, aig.fanin1[node] / 2})
+					if (aig.is_and(fanin))
+						parent[find(fanin)] = find(node);
+
+		// components are packed into jobs of at least 4096 nodes, in the
+		// order of their first node so that the jobs don't depend on the
+		// number of threads
+		dict<int, int> component_job;
+		std::vector<std::vector<int>> job_nodes, job_outputs;
+		std::vector<int> open_jobs;
+		for (int node = 0; node < num_nodes; node++) {
+			if (!aig.is_and(node))
+				continue;
+			int root = find(node);
+			auto it = component_job.find(root);
+			if (it == component_job.end()) {
+				if (job_nodes.empty() || GetSize(job_nodes.back()) >= 4096) {
+					job_nodes.emplace_back();
+					job_outputs.emplace_back();
+				}
+				it = component_job.emplace(root, GetSize(job_nodes) - 1).first;
+			}
+			job_nodes[it->second].push_back(node);
+		}
+		for (auto &it : outputs) {
+			int node = it.second / 2;
+			if (aig.is_and(node))
+				job_outputs[component_job.at(find(node))].push_back(node);
+		}
+
+		int num_jobs = GetSize(job_nodes);
+		int num_threads = yosys_thread_count(num_jobs);
+
+		ThreadPool::run(num_jobs, [&](int i) {
+			mapper.map_nodes(job_nodes[i], LutMapper::DepthMode);
+		}, num_threads);
+
+		for (auto &it : outputs)
+			depth = std::max(depth, mapper.arrival[it.second / 2]);
+		int target = depth + slack;
+
+		ThreadPool::run(num_jobs, [&](int i) {
+			mapper.update_mapping(job_nodes[i], job_outputs[i], target);
+			if (noarea)
+				return;
+			mapper.map_nodes(job_nodes[i], LutMapper::FlowMode);
+			mapper.update_mapping(job_nodes[i], job_outputs[i], target);
+			for (int iter = 0; iter < 2; iter++) {
+				mapper.map_nodes(job_nodes[i], LutMapper::AreaMode);
+				mapper.update_mapping(job_nodes[i], job_outputs[i], target);
+			}
+		}, num_threads);
+
+		depth = 0;
+		for (auto &it : outputs)
+			depth = std::max(depth, mapper.arrival[it.second / 2]);
+	}
+
+	RTLIL::Const cut_truth_table(const LutMapper &mapper, int node, bool invert)
+	{
+		const LutMapCut &cut = mapper.best[node];
+		int num_bits = 1 << cut.size;
+		int num_words = std::max(num_bits / 64, 1);
+
+		dict<int, std::vector<uint64_t>> tables;
+		for (int i = 0; i < cut.size; i++) {
+			std::vector<uint64_t> &table = tables[cut.leaves[i]];
+			table.assign(num_words, 0);
+			for (int b = 0; b < num_bits; b++)
+				if ((b >> i) & 1)
+					table[b / 64] |= uint64_t(1) << (b % 64);
+		}
+
+		std::vector<int> stack = {node};
+		while (!stack.empty()) {
+			int n = stack.back();
+			if (tables.count(n)) {
+				stack.pop_back();
+				continue;
+			}
+			int f0 = aig.fanin0[n], f1 = aig.fanin1[n];
+			if (!tables.count(f0 / 2) || !tables.count(f1 / 2)) {
+				log_assert(aig.is_and(n));
+				if (!tables.count(f0 / 2))
+					stack.push_back(f0 / 2);
+				if (!tables.count(f1 / 2))
+					stack.push_back(f1 / 2);
+				continue;
+			}
+			std::vector<uint64_t> table(num_words);
+			const std::vector<uint64_t> &t0 = tables.at(f0 / 2), &t1 = tables.at(f1 / 2);
+			for (int w = 0; w < num_words; w++)
+				table[w] = ((f0 & 1) ? ~t0[w] : t0[w]) & ((f1 & 1) ? ~t1[w] : t1[w]);
+			tables[n] = table;
+			stack.pop_back();
+		}
+
+		const std::vector<uint64_t> &table = tables.at(node);
+		RTLIL::Const result(State::S0, num_bits);
+		for (int b = 0; b < num_bits; b++)
+			if (((table[b / 64] >> (b % 64)) & 1) != invert)
+				result.bits[b] = State::S1;
+		return result;
+	}
+
+	void create_luts(const LutMapper &mapper, const std::vector<RTLIL::Cell*> &cells)
+	{
+		for (auto cell : cells)
+			module->remove(cell);
+
+		// the first output with a literal drives it, the others are connected
+		dict<int, RTLIL::SigBit> lit_bits;
+		for (auto &it : outputs)
+			if (!lit_bits.count(it.second))
+				lit_bits[it.second] = it.first;
+
+		auto node_bit = [&](int node) {
+			if (!aig.is_and(node))
+				return aig.input_bits[node];
+			auto it = lit_bits.find(2 * node);
+			if (it == lit_bits.end())
+				it = lit_bits.emplace(2 * node, module->addWire(NEW_ID)).first;
+			return it->second;
+		};
+
+		auto add_lut = [&](int node, bool invert, RTLIL::SigBit y) {
+			RTLIL::SigSpec lut_a;
+			const LutMapCut &cut = mapper.best[node];
+			for (int i = 0; i < cut.size; i++)
+				lut_a.append(node_bit(cut.leaves[i]));
+			module->addLut(NEW_ID, lut_a, y, cut_truth_table(mapper, node, invert));
+			lut_count++;
+		};
+
+		// nodes that are only used by inverted outputs don't need a LUT with
+		// the positive function
+		std::vector<bool> needed(aig.num_nodes());
+		for (int node = 0; node < aig.num_nodes(); node++)
+			if (aig.is_and(node) && mapper.refs[node] > 0)
+				for (int i = 0; i < mapper.best[node].size; i++)
+					needed[mapper.best[node].leaves[i]] = true;
+		for (auto &it : outputs)
+			if (!(it.second & 1))
+				needed[it.second / 2] = true;
+
+		for (int node = 0; node < aig.num_nodes(); node++)
+			if (aig.is_and(node) && mapper.refs[node] > 0 && needed[node])
+				add_lut(node, false, node_bit(node));
+
+		for (auto &it : outputs)
+		{
+			int lit = it.second, node = lit / 2;
+			RTLIL::SigBit driver = lit_bits.at(lit);
+			if (driver != it.first) {
+				module->connect(it.first, driver);
+				continue;
+			}
+			if (node == 0)
+				module->connect(it.first, lit ? State::S1 : State::S0);
+			else if (!aig.is_and(node) && !(lit & 1))
+				module->connect(it.first, aig.input_bits[node]);
+			else if (!aig.is_and(node))
+				module->addLut(NEW_ID, aig.input_bits[node], it.first, RTLIL::Const::from_string("01")), lut_count++;
+			else if (lit & 1)
+				add_lut(node, true, it.first);
+		}
+	}
+
+	LutMapWorker(RTLIL::Module *module, int lut_size, int max_cuts, int slack, bool noarea) :
+			module(module), sigmap(module), lut_size(lut_size), max_cuts(max_cuts), slack(slack), noarea(noarea)
+	{
+		std::vector<RTLIL::Cell*> cells = sort_cells();
+		if (cells.empty())
+			return;
+
+		import_module(cells);
+
+		LutMapper mapper(aig, lut_size, max_cuts);
+		for (auto &it : outputs)
+			mapper.fanout_est[it.second / 2] += 1;
+		run_mapper(mapper);
+		create_luts(mapper, cells);
+
+		log("Mapped %d gates in module %s (%d AIG nodes) into %d LUTs with depth %d.\n",
+				gate_count, log_id(module), aig.num_nodes(), lut_count, depth);
+	}
+};
+
+struct LutmapPass : public Pass {
+	LutmapPass() : Pass("lutmap", "map gates to LUTs with priority cuts") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    lutmap [options] [selection]\n");
+		log("\n");
+		log("This pass maps the single-bit gates created by the `simplemap` and `aigmap`\n");
+		log("passes ($_AND_, $_OR_, $_XOR_, $_MUX_, etc.) to $lut cells, without calling\n");
+		log("an external tool. The gates are converted to an AIG and mapped with priority\n");
+		log("cuts: the mapping with the smallest depth is computed first, then the number\n");
+		log("of LUTs is reduced with area flow and exact area recovery without increasing\n");
+		log("the depth.\n");
+		log("\n");
+		log("Independent parts of the logic are mapped in parallel when yosys runs with\n");
+		log("more than one thread. The result does not depend on the number of threads.\n");
+		log("\n");
+		log("    -lut <k>\n");
+		log("        map to LUTs with at most k inputs (default: 4, at most %d).\n", max_lut_size);
+		log("\n");
+		log("    -cuts <n>\n");
+		log("        the number of priority cuts kept for each node (default: 8).\n");
+		log("\n");
+		log("    -slack <n>\n");
+		log("        allow the depth to exceed the smallest possible depth by n LUTs,\n");
+		log("        to save more area (default: 0).\n");
+		log("\n");
+		log("    -noarea\n");
+		log("        only minimize the depth, do not run area recovery.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		int lut_size = 4, max_cuts = 8, slack = 0;
+		bool noarea = false;
+
+		log_header(design, "Executing LUTMAP pass (map gates to LUTs with priority cuts).\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++)
+		{
+			if (args[argidx] == "-lut" && argidx+1 < args.size()) {
+				lut_size = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-cuts" && argidx+1 < args.size()) {
+				max_cuts = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-slack" && argidx+1 < args.size()) {
+				slack = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-noarea") {
+				noarea = true;
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
+
+		if (lut_size < 2 || lut_size > max_lut_size)
+			log_cmd_error("The LUT size must be between 2 and %d.\n", max_lut_size);
+		if (max_cuts < 1)
+			log_cmd_error("At least one cut must be kept per node.\n");
+		if (slack < 0)
+			log_cmd_error("The slack must not be negative.\n");
+
+		std::atomic<int> gate_count(0), lut_count(0);
+		execute_modules(design, design->selected_modules(), [&](RTLIL::Module *module) {
+			LutMapWorker worker(module, lut_size, max_cuts, slack, noarea);
+			gate_count += worker.gate_count;
+			lut_count += worker.lut_count;
+		});
+
+		log("Mapped %d gates into %d LUTs.\n", gate_count.load(), lut_count.load());
+	}
+} LutmapPass;
+
+PRIVATE_NAMESPACE_END
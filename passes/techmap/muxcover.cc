@@ -19,6 +19,7 @@
 
 #include "kernel/yosys.h"
 #include "kernel/sigtools.h"
+#include "kernel/threading.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -41,10 +42,16 @@ struct MuxcoverWorker
 		newmux_t() : cost(0) {}
 	};
 
+	struct muxnode_t
+	{
+		Cell *cell;
+		SigBit ports[3]; // A, B and S
+	};
+
 	struct tree_t
 	{
 		SigBit root;
-		dict<SigBit, Cell*> muxes;
+		dict<SigBit, muxnode_t> muxes;
 		dict<SigBit, newmux_t> newmuxes;
 	};
 
@@ -81,13 +88,12 @@ struct MuxcoverWorker
 		decode_mux_counter = 0;
 	}
 
-	bool xcmp(std::initializer_list<SigBit> list)
+	bool xcmp(const SigBit *bits, int count)
 	{
-		auto cursor = list.begin(), end = list.end();
-		log_assert(cursor != end);
-		SigBit tmp = *(cursor++);
-		while (cursor != end) {
-			SigBit bit = *(cursor++);
+		log_assert(count > 0);
+		SigBit tmp = bits[0];
+		for (int i = 1; i < count; i++) {
+			SigBit bit = bits[i];
 			if (bit == State::Sx)
 				continue;
 			if (tmp == State::Sx)
@@ -140,9 +146,13 @@ struct MuxcoverWorker
 				SigBit bit = wavefront.pop();
 				if (sig_to_mux.count(bit) && (bit == rootsig || !roots.count(bit))) {
 					Cell *c = sig_to_mux.at(bit);
-					tree.muxes[bit] = c;
-					wavefront.insert(sigmap(c->getPort(ID::A)));
-					wavefront.insert(sigmap(c->getPort(ID::B)));
+					auto &node = tree.muxes[bit];
+					node.cell = c;
+					node.ports[0] = sigmap(c->getPort(ID::A));
+					node.ports[1] = sigmap(c->getPort(ID::B));
+					node.ports[2] = sigmap(c->getPort(ID::S));
+					wavefront.insert(node.ports[0]);
+					wavefront.insert(node.ports[1]);
 				}
 			}
 
@@ -155,26 +165,30 @@ struct MuxcoverWorker
 		log("    Finished treeification: Found %d trees.\n", GetSize(tree_list));
 	}
 
-	bool follow_muxtree(SigBit &ret_bit, tree_t &tree, SigBit bit, const char *path, bool first_layer = true)
+	// Follows the tree at bit down by the given number of layers. The bits
+	// are stored in heap order: nodes[0] is bit, the A and B inputs of
+	// nodes[i] are nodes[2*i+1] and nodes[2*i+2], and its S input is
+	// selects[i]. If a bit below the first layer is not a MUX in the tree,
+	// it is used for all inputs below it with undefined selects (a partial
+	// tree), unless -nopartial is set.
+	bool follow_muxtree(SigBit *nodes, SigBit *selects, tree_t &tree, SigBit bit, int depth)
 	{
-		if (*path) {
-			if (tree.muxes.count(bit) == 0) {
-				if (first_layer || nopartial)
+		nodes[0] = bit;
+		for (int i = 0; i < (1 << depth) - 1; i++) {
+			auto it = tree.muxes.find(nodes[i]);
+			if (it == tree.muxes.end()) {
+				if (i == 0 || nopartial)
 					return false;
-				while (path[0] && path[1])
-					path++;
-				if (path[0] == 'S')
-					ret_bit = State::Sx;
-				else
-					ret_bit = bit;
-				return true;
+				nodes[2*i+1] = nodes[i];
+				nodes[2*i+2] = nodes[i];
+				selects[i] = State::Sx;
+			} else {
+				nodes[2*i+1] = it->second.ports[0];
+				nodes[2*i+2] = it->second.ports[1];
+				selects[i] = it->second.ports[2];
 			}
-			char port_name[3] = {'\\', *path, 0};
-			return follow_muxtree(ret_bit, tree, sigmap(tree.muxes.at(bit)->getPort(port_name)), path+1, false);
-		} else {
-			ret_bit = bit;
-			return true;
 		}
+		return true;
 	}
 
 	int prepare_decode_mux(SigBit &A, SigBit B, SigBit sel, SigBit bit)
@@ -248,250 +262,58 @@ struct MuxcoverWorker
 			return tree.newmuxes.at(bit).cost;
 		}
 
-		SigBit A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P;
-		SigBit S1, S2, S3, S4, S5, S6, S7, S8;
-		SigBit T1, T2, T3, T4;
-		SigBit U1, U2;
-		SigBit V1;
+		bool use_mux[4] = {true, use_mux4, use_mux8, use_mux16};
+		int cost_mux[4] = {cost_mux2, cost_mux4, cost_mux8, cost_mux16};
 
 		newmux_t best_mux;
-		bool ok = true;
-
-		// 2-Input MUX
 
-		ok = ok && follow_muxtree(A, tree, bit, "A");
-		ok = ok && follow_muxtree(B, tree, bit, "B");
+		// A MUX2, MUX4, MUX8 or MUX16 covers 1, 2, 3 or 4 layers of the tree.
+		// A wider MUX is only considered if the narrower enabled ones fit.
+		for (int depth = 1; depth <= 4; depth++)
+		{
+			if (!use_mux[depth-1])
+				continue;
 
-		ok = ok && follow_muxtree(S1, tree, bit, "S");
+			SigBit nodes[31], selects[15];
+			if (!follow_muxtree(nodes, selects, tree, bit, depth))
+				break;
+
+			// the selects of layer k start at selects[(1 << k) - 1]
+			if (nodecode) {
+				bool ok = true;
+				for (int k = 1; k < depth; k++)
+					ok = ok && xcmp(selects + (1 << k) - 1, 1 << k);
+				if (!ok)
+					break;
+			}
 
-		if (ok)
-		{
+			int width = 1 << depth;
 			newmux_t mux;
+			mux.inputs.assign(nodes + width - 1, nodes + 2*width - 1);
+
+			// Layers are decoded from the bottom up. Each decoder mux replaces
+			// its first select, so the first select of each layer ends up
+			// driving the wide MUX.
+			for (int k = depth-1; k > 0; k--) {
+				SigBit *layer = selects + (1 << k) - 1;
+				for (int stride = 1, up = k-1; up >= 0; stride *= 2, up--)
+					for (int i = 0; i < (1 << k); i += 2*stride)
+						mux.cost += prepare_decode_mux(layer[i], layer[i+stride], selects[(1 << up) - 1 + i/(2*stride)], bit);
+			}
 
-			mux.inputs.push_back(A);
-			mux.inputs.push_back(B);
-			mux.selects.push_back(S1);
+			for (int k = depth-1; k >= 0; k--)
+				mux.selects.push_back(selects[(1 << k) - 1]);
 
 			find_best_covers(tree, mux.inputs);
-			log_debug("        Decode cost for mux2 at %s: %d\n", log_signal(bit), mux.cost);
+			log_debug("        Decode cost for mux%d at %s: %d\n", width, log_signal(bit), mux.cost);
 
-			mux.cost += cost_mux2;
+			mux.cost += cost_mux[depth-1];
 			mux.cost += sum_best_covers(tree, mux.inputs);
 
-			log_debug("      Cost of mux2 at %s: %d\n", log_signal(bit), mux.cost);
-
-			best_mux = mux;
-		}
-
-		// 4-Input MUX
-
-		if (use_mux4)
-		{
-			ok = ok && follow_muxtree(A, tree, bit, "AA");
-			ok = ok && follow_muxtree(B, tree, bit, "AB");
-			ok = ok && follow_muxtree(C, tree, bit, "BA");
-			ok = ok && follow_muxtree(D, tree, bit, "BB");
-
-			ok = ok && follow_muxtree(S1, tree, bit, "AS");
-			ok = ok && follow_muxtree(S2, tree, bit, "BS");
-
-			if (nodecode)
-				ok = ok && xcmp({S1, S2});
-
-			ok = ok && follow_muxtree(T1, tree, bit, "S");
-
-			if (ok)
-			{
-				newmux_t mux;
-
-				mux.inputs.push_back(A);
-				mux.inputs.push_back(B);
-				mux.inputs.push_back(C);
-				mux.inputs.push_back(D);
-
-				mux.cost += prepare_decode_mux(S1, S2, T1, bit);
-
-				mux.selects.push_back(S1);
-				mux.selects.push_back(T1);
-
-				find_best_covers(tree, mux.inputs);
-				log_debug("        Decode cost for mux4 at %s: %d\n", log_signal(bit), mux.cost);
-
-				mux.cost += cost_mux4;
-				mux.cost += sum_best_covers(tree, mux.inputs);
-
-				log_debug("      Cost of mux4 at %s: %d\n", log_signal(bit), mux.cost);
-
-				if (best_mux.cost >= mux.cost)
-					best_mux = mux;
-			}
-		}
-
-		// 8-Input MUX
-
-		if (use_mux8)
-		{
-			ok = ok && follow_muxtree(A, tree, bit, "AAA");
-			ok = ok && follow_muxtree(B, tree, bit, "AAB");
-			ok = ok && follow_muxtree(C, tree, bit, "ABA");
-			ok = ok && follow_muxtree(D, tree, bit, "ABB");
-			ok = ok && follow_muxtree(E, tree, bit, "BAA");
-			ok = ok && follow_muxtree(F, tree, bit, "BAB");
-			ok = ok && follow_muxtree(G, tree, bit, "BBA");
-			ok = ok && follow_muxtree(H, tree, bit, "BBB");
-
-			ok = ok && follow_muxtree(S1, tree, bit, "AAS");
-			ok = ok && follow_muxtree(S2, tree, bit, "ABS");
-			ok = ok && follow_muxtree(S3, tree, bit, "BAS");
-			ok = ok && follow_muxtree(S4, tree, bit, "BBS");
-
-			if (nodecode)
-				ok = ok && xcmp({S1, S2, S3, S4});
-
-			ok = ok && follow_muxtree(T1, tree, bit, "AS");
-			ok = ok && follow_muxtree(T2, tree, bit, "BS");
-
-			if (nodecode)
-				ok = ok && xcmp({T1, T2});
-
-			ok = ok && follow_muxtree(U1, tree, bit, "S");
-
-			if (ok)
-			{
-				newmux_t mux;
-
-				mux.inputs.push_back(A);
-				mux.inputs.push_back(B);
-				mux.inputs.push_back(C);
-				mux.inputs.push_back(D);
-				mux.inputs.push_back(E);
-				mux.inputs.push_back(F);
-				mux.inputs.push_back(G);
-				mux.inputs.push_back(H);
-
-				mux.cost += prepare_decode_mux(S1, S2, T1, bit);
-				mux.cost += prepare_decode_mux(S3, S4, T2, bit);
-				mux.cost += prepare_decode_mux(S1, S3, U1, bit);
-
-				mux.cost += prepare_decode_mux(T1, T2, U1, bit);
-
-				mux.selects.push_back(S1);
-				mux.selects.push_back(T1);
-				mux.selects.push_back(U1);
-
-				find_best_covers(tree, mux.inputs);
-				log_debug("        Decode cost for mux8 at %s: %d\n", log_signal(bit), mux.cost);
-
-				mux.cost += cost_mux8;
-				mux.cost += sum_best_covers(tree, mux.inputs);
+			log_debug("      Cost of mux%d at %s: %d\n", width, log_signal(bit), mux.cost);
 
-				log_debug("      Cost of mux8 at %s: %d\n", log_signal(bit), mux.cost);
-
-				if (best_mux.cost >= mux.cost)
-					best_mux = mux;
-			}
-		}
-
-		// 16-Input MUX
-
-		if (use_mux16)
-		{
-			ok = ok && follow_muxtree(A, tree, bit, "AAAA");
-			ok = ok && follow_muxtree(B, tree, bit, "AAAB");
-			ok = ok && follow_muxtree(C, tree, bit, "AABA");
-			ok = ok && follow_muxtree(D, tree, bit, "AABB");
-			ok = ok && follow_muxtree(E, tree, bit, "ABAA");
-			ok = ok && follow_muxtree(F, tree, bit, "ABAB");
-			ok = ok && follow_muxtree(G, tree, bit, "ABBA");
-			ok = ok && follow_muxtree(H, tree, bit, "ABBB");
-			ok = ok && follow_muxtree(I, tree, bit, "BAAA");
-			ok = ok && follow_muxtree(J, tree, bit, "BAAB");
-			ok = ok && follow_muxtree(K, tree, bit, "BABA");
-			ok = ok && follow_muxtree(L, tree, bit, "BABB");
-			ok = ok && follow_muxtree(M, tree, bit, "BBAA");
-			ok = ok && follow_muxtree(N, tree, bit, "BBAB");
-			ok = ok && follow_muxtree(O, tree, bit, "BBBA");
-			ok = ok && follow_muxtree(P, tree, bit, "BBBB");
-
-			ok = ok && follow_muxtree(S1, tree, bit, "AAAS");
-			ok = ok && follow_muxtree(S2, tree, bit, "AABS");
-			ok = ok && follow_muxtree(S3, tree, bit, "ABAS");
-			ok = ok && follow_muxtree(S4, tree, bit, "ABBS");
-			ok = ok && follow_muxtree(S5, tree, bit, "BAAS");
-			ok = ok && follow_muxtree(S6, tree, bit, "BABS");
-			ok = ok && follow_muxtree(S7, tree, bit, "BBAS");
-			ok = ok && follow_muxtree(S8, tree, bit, "BBBS");
-
-			if (nodecode)
-				ok = ok && xcmp({S1, S2, S3, S4, S5, S6, S7, S8});
-
-			ok = ok && follow_muxtree(T1, tree, bit, "AAS");
-			ok = ok && follow_muxtree(T2, tree, bit, "ABS");
-			ok = ok && follow_muxtree(T3, tree, bit, "BAS");
-			ok = ok && follow_muxtree(T4, tree, bit, "BBS");
-
-			if (nodecode)
-				ok = ok && xcmp({T1, T2, T3, T4});
-
-			ok = ok && follow_muxtree(U1, tree, bit, "AS");
-			ok = ok && follow_muxtree(U2, tree, bit, "BS");
-
-			if (nodecode)
-				ok = ok && xcmp({U1, U2});
-
-			ok = ok && follow_muxtree(V1, tree, bit, "S");
-
-			if (ok)
-			{
-				newmux_t mux;
-
-				mux.inputs.push_back(A);
-				mux.inputs.push_back(B);
-				mux.inputs.push_back(C);
-				mux.inputs.push_back(D);
-				mux.inputs.push_back(E);
-				mux.inputs.push_back(F);
-				mux.inputs.push_back(G);
-				mux.inputs.push_back(H);
-				mux.inputs.push_back(I);
-				mux.inputs.push_back(J);
-				mux.inputs.push_back(K);
-				mux.inputs.push_back(L);
-				mux.inputs.push_back(M);
-				mux.inputs.push_back(N);
-				mux.inputs.push_back(O);
-				mux.inputs.push_back(P);
-
-				mux.cost += prepare_decode_mux(S1, S2, T1, bit);
-				mux.cost += prepare_decode_mux(S3, S4, T2, bit);
-				mux.cost += prepare_decode_mux(S5, S6, T3, bit);
-				mux.cost += prepare_decode_mux(S7, S8, T4, bit);
-				mux.cost += prepare_decode_mux(S1, S3, U1, bit);
-				mux.cost += prepare_decode_mux(S5, S7, U2, bit);
-				mux.cost += prepare_decode_mux(S1, S5, V1, bit);
-
-				mux.cost += prepare_decode_mux(T1, T2, U1, bit);
-				mux.cost += prepare_decode_mux(T3, T4, U2, bit);
-				mux.cost += prepare_decode_mux(T1, T3, V1, bit);
-
-				mux.cost += prepare_decode_mux(U1, U2, V1, bit);
-
-				mux.selects.push_back(S1);
-				mux.selects.push_back(T1);
-				mux.selects.push_back(U1);
-				mux.selects.push_back(V1);
-
-				find_best_covers(tree, mux.inputs);
-				log_debug("        Decode cost for mux16 at %s: %d\n", log_signal(bit), mux.cost);
-
-				mux.cost += cost_mux16;
-				mux.cost += sum_best_covers(tree, mux.inputs);
-
-				log_debug("      Cost of mux16 at %s: %d\n", log_signal(bit), mux.cost);
-
-				if (best_mux.cost >= mux.cost)
-					best_mux = mux;
-			}
+			if (depth == 1 || best_mux.cost >= mux.cost)
+				best_mux = mux;
 		}
 
 		tree.newmuxes[bit] = best_mux;
@@ -582,16 +404,20 @@ struct MuxcoverWorker
 		log_abort();
 	}
 
-	void treecover(tree_t &tree)
+	void search_cover(tree_t &tree)
 	{
-		int count_muxes_by_type[4] = {0, 0, 0, 0};
 		log_debug("    Searching for best cover for tree at %s.\n", log_signal(tree.root));
 		find_best_cover(tree, tree.root);
+	}
+
+	void treecover(tree_t &tree)
+	{
+		int count_muxes_by_type[4] = {0, 0, 0, 0};
 		implement_best_cover(tree, tree.root, count_muxes_by_type);
 		log("    Replaced tree at %s: %d MUX2, %d MUX4, %d MUX8, %d MUX16\n", log_signal(tree.root),
 				count_muxes_by_type[0], count_muxes_by_type[1], count_muxes_by_type[2], count_muxes_by_type[3]);
 		for (auto &it : tree.muxes)
-			module->remove(it.second);
+			module->remove(it.second.cell);
 	}
 
 	void run()
@@ -610,8 +436,17 @@ struct MuxcoverWorker
 			}
 		}
 
-		for (auto &tree : tree_list)
-			treecover(tree);
+		// Without decoder muxes the cost of a cover only depends on its own
+		// tree, and the search does not modify the module, so the trees are
+		// searched in parallel and then replaced one after the other. With
+		// decoder muxes the costs depend on the decoders that earlier trees
+		// share or have implemented, so the search stays serial.
+		int num_threads = nodecode ? yosys_thread_count(GetSize(tree_list)) : 1;
+		ThreadPool::run_captured(GetSize(tree_list), [&](int i) {
+			search_cover(tree_list[i]);
+		}, num_threads, nullptr, [&](int i) {
+			treecover(tree_list[i]);
+		});
 
 		if (!nodecode)
 			log("  Added a total of %d decoder MUXes.\n", decode_mux_counter);
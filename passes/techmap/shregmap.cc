@@ -153,7 +153,7 @@ struct ShregmapWorker
 				}
 			}
 
-			for (auto conn : cell->connections())
+			for (auto &conn : cell->connections())
 				if (cell->input(conn.first))
 					for (auto bit : sigmap(conn.second))
 						sigbit_with_non_chain_users.insert(bit);
@@ -181,18 +181,18 @@ struct ShregmapWorker
 				IdString d_port = opts.ffcells.at(c1->type).first;
 				IdString q_port = opts.ffcells.at(c1->type).second;
 
-				auto c1_conn = c1->connections();
-				auto c2_conn = c2->connections();
-
-				c1_conn.erase(d_port);
-				c1_conn.erase(q_port);
-
-				c2_conn.erase(d_port);
-				c2_conn.erase(q_port);
-
-				if (c1_conn != c2_conn)
+				// all other ports must be connected alike
+				if (GetSize(c1->connections()) != GetSize(c2->connections()))
 					goto start_cell;
 
+				for (auto &conn : c1->connections()) {
+					if (conn.first == d_port || conn.first == q_port)
+						continue;
+					auto it = c2->connections().find(conn.first);
+					if (it == c2->connections().end() || it->second != conn.second)
+						goto start_cell;
+				}
+
 				continue;
 			}
 
@@ -546,13 +546,23 @@ struct ShregmapPass : public Pass {
 				log_cmd_error("Options -params and -match are exclusive!\n");
 		}
 
-		int dff_count = 0;
-		int shreg_count = 0;
+		std::vector<Module*> modules = design->selected_modules();
+		std::vector<int> module_dff_count(GetSize(modules)), module_shreg_count(GetSize(modules));
+		dict<Module*, int> module_index;
+		for (int i = 0; i < GetSize(modules); i++)
+			module_index[modules[i]] = i;
 
-		for (auto module : design->selected_modules()) {
+		execute_modules(design, modules, [&](Module *module) {
 			ShregmapWorker worker(module, opts);
-			dff_count += worker.dff_count;
-			shreg_count += worker.shreg_count;
+			module_dff_count[module_index.at(module)] = worker.dff_count;
+			module_shreg_count[module_index.at(module)] = worker.shreg_count;
+		});
+
+		int dff_count = 0;
+		int shreg_count = 0;
+		for (int i = 0; i < GetSize(modules); i++) {
+			dff_count += module_dff_count[i];
+			shreg_count += module_shreg_count[i];
 		}
 
 		log("Converted %d dff cells into %d shift registers.\n", dff_count, shreg_count);
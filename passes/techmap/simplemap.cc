@@ -499,16 +499,27 @@ struct SimplemapPass : public Pass {
 		for (auto mod : design->modules()) {
 			if (!design->selected(mod) || mod->get_blackbox_attribute())
 				continue;
-			std::vector<RTLIL::Cell*> cells = mod->cells();
-			for (auto cell : cells) {
+			std::vector<RTLIL::Cell*> cells;
+			int num_bits = 0;
+			for (auto cell : mod->cells()) {
 				if (mappers.count(cell->type) == 0)
 					continue;
 				if (!design->selected(mod, cell))
 					continue;
+				cells.push_back(cell);
+				for (auto &conn : cell->connections())
+					if (cell->output(conn.first))
+						num_bits += GetSize(conn.second);
+			}
+
+			// most mappers create one gate per output bit
+			mod->begin_batch(num_bits);
+			for (auto cell : cells) {
 				log("Mapping %s.%s (%s).\n", log_id(mod), log_id(cell), log_id(cell->type));
 				mappers.at(cell->type)(mod, cell);
 				mod->remove(cell);
 			}
+			mod->commit_batch();
 		}
 	}
 } SimplemapPass;
@@ -21,7 +21,10 @@
 #include "kernel/utils.h"
 #include "kernel/sigtools.h"
 #include "kernel/ffinit.h"
+#include "kernel/threading.h"
+#include "kernel/profiler.h"
 #include "libs/sha1/sha1.h"
+#include "backends/rtlil/rtlil_backend.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -47,19 +50,6 @@ void apply_prefix(IdString prefix, IdString &id)
 		id = stringf("$techmap%s.%s", prefix.c_str(), id.c_str());
 }
 
-void apply_prefix(IdString prefix, RTLIL::SigSpec &sig, RTLIL::Module *module)
-{
-	vector<SigChunk> chunks = sig;
-	for (auto &chunk : chunks)
-		if (chunk.wire != nullptr) {
-			IdString wire_name = chunk.wire->name;
-			apply_prefix(prefix, wire_name);
-			log_assert(module->wire(wire_name) != nullptr);
-			chunk.wire = module->wire(wire_name);
-		}
-	sig = chunks;
-}
-
 struct TechmapWorker
 {
 	dict<IdString, void(*)(RTLIL::Module*, RTLIL::Cell*)> simplemap_mappers;
@@ -83,6 +73,52 @@ struct TechmapWorker
 	bool autoproc_mode = false;
 	bool ignore_wb = false;
 
+	// directory of the on-disk template cache (empty if disabled) and the
+	// hash of the map files and frontend options used in the cache keys
+	std::string cache_dir;
+	std::string cache_map_hash;
+
+	RTLIL::Module *derive_cached(RTLIL::Design *map, RTLIL::Module *tpl, const dict<IdString, RTLIL::Const> &parameters)
+	{
+		std::vector<std::string> param_strs;
+		for (auto &it : parameters)
+			param_strs.push_back(stringf("%s=%d:%s", it.first.c_str(), it.second.flags, it.second.as_string().c_str()));
+		std::sort(param_strs.begin(), param_strs.end());
+
+		std::string key = cache_map_hash + " " + tpl->name.str();
+		for (auto &str : param_strs)
+			key += " " + str;
+		std::string filename = cache_dir + "/" + sha1(key) + ".il";
+
+		std::ifstream f(filename);
+		if (f.is_open()) {
+			RTLIL::Design cached;
+			Frontend::frontend_call(&cached, &f, filename, "rtlil");
+			if (GetSize(cached.modules()) == 1) {
+				RTLIL::Module *mod = *cached.modules().begin();
+				log_debug("Using cached template %s from %s.\n", log_id(mod->name), filename.c_str());
+				if (map->module(mod->name) == nullptr)
+					map->add(mod->clone());
+				return map->module(mod->name);
+			}
+			log_warning("Ignoring invalid techmap cache file %s.\n", filename.c_str());
+		}
+
+		RTLIL::Module *derived = map->module(tpl->derive(map, parameters));
+
+		// write to a temporary file first so concurrent runs never see a
+		// partially written template
+		std::string tmp_filename = make_temp_file(filename + ".XXXXXX");
+		std::ofstream out(tmp_filename);
+		RTLIL_BACKEND::dump_module(out, "", derived, map, false);
+		out.close();
+		if (out.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+			log_warning("Can't write techmap cache file %s.\n", filename.c_str());
+			remove(tmp_filename.c_str());
+		}
+		return derived;
+	}
+
 	std::string constmap_tpl_name(SigMap &sigmap, RTLIL::Module *tpl, RTLIL::Cell *cell, bool verbose)
 	{
 		std::string constmap_info;
@@ -141,7 +177,80 @@ struct TechmapWorker
 		return result;
 	}
 
-	void techmap_module_worker(RTLIL::Design *design, RTLIL::Module *module, RTLIL::Cell *cell, RTLIL::Module *tpl)
+	// Per-template data shared by all cells that are mapped with a template.
+	// This is collected once per techmap_module() run and not modified
+	// afterwards, so that it can be read by concurrent techmap_plan() calls.
+	struct TechmapTemplate
+	{
+		std::vector<RTLIL::Wire*> wires;
+		std::vector<RTLIL::Cell*> cells;
+		dict<RTLIL::Wire*, int> wire_index;
+		dict<IdString, IdString> positional_ports;
+		pool<RTLIL::SigBit> written_bits;
+		bool has_autopurge = false;
+		bool has_replace_cell = false;
+	};
+
+	struct TechmapReplacementCell
+	{
+		IdString name, type, memid;
+		bool replace_cell;
+		std::vector<std::pair<IdString, RTLIL::SigSpec>> connections;
+		std::vector<IdString> purged_ports;
+	};
+
+	// Replacement netlist for a single cell. Signals that are internal to the
+	// template still refer to the template wires, techmap_commit() translates
+	// them to the wires it creates in the module.
+	struct TechmapReplacement
+	{
+		RTLIL::Cell *cell;
+		RTLIL::Module *tpl;
+		IdString orig_cell_name;
+		RTLIL::SrcSet extra_src_attrs;
+		std::vector<IdString> memory_names, wire_names, replace_wire_names;
+		std::vector<TechmapReplacementCell> cells;
+		std::vector<RTLIL::SigSig> connections;
+	};
+
+	const TechmapTemplate &techmap_template(dict<RTLIL::Module*, TechmapTemplate> &templates, RTLIL::Module *tpl)
+	{
+		auto it = templates.find(tpl);
+		if (it != templates.end())
+			return it->second;
+
+		TechmapTemplate &t = templates[tpl];
+
+		for (auto tpl_w : tpl->wires()) {
+			t.wire_index[tpl_w] = GetSize(t.wires);
+			t.wires.push_back(tpl_w);
+			if (tpl_w->port_id > 0) {
+				t.positional_ports.emplace(stringf("$%d", tpl_w->port_id), tpl_w->name);
+				if (tpl_w->get_bool_attribute(ID::techmap_autopurge))
+					t.has_autopurge = true;
+			}
+		}
+
+		for (auto tpl_cell : tpl->cells()) {
+			t.cells.push_back(tpl_cell);
+			if (tpl_cell->name.ends_with("_TECHMAP_REPLACE_"))
+				t.has_replace_cell = true;
+			for (auto &conn : tpl_cell->connections())
+				if (tpl_cell->output(conn.first))
+					for (auto bit : conn.second)
+						t.written_bits.insert(bit);
+		}
+		for (auto &conn : tpl->connections())
+			for (auto bit : conn.first)
+				t.written_bits.insert(bit);
+
+		if (t.has_autopurge && sigmaps.count(tpl) == 0)
+			sigmaps[tpl].set(tpl);
+
+		return t;
+	}
+
+	TechmapReplacement techmap_prepare(RTLIL::Module *module, RTLIL::Cell *cell, RTLIL::Module *tpl, dict<RTLIL::Module*, TechmapTemplate> &templates)
 	{
 		if (tpl->processes.size() != 0) {
 			log("Technology map yielded processes:");
@@ -155,46 +264,48 @@ struct TechmapWorker
 				log_error("Technology map yielded processes -> this is not supported (use -autoproc to run 'proc' automatically).\n");
 		}
 
-		std::string orig_cell_name;
-		pool<string> extra_src_attrs = cell->get_strpool_attribute(ID::src);
+		TechmapReplacement r;
+		r.cell = cell;
+		r.tpl = tpl;
+		r.orig_cell_name = cell->name;
 
-		orig_cell_name = cell->name.str();
-		for (auto tpl_cell : tpl->cells())
-			if (tpl_cell->name.ends_with("_TECHMAP_REPLACE_")) {
-				module->rename(cell, stringf("$techmap%d", autoidx++) + cell->name.str());
-				break;
-			}
+		if (techmap_template(templates, tpl).has_replace_cell)
+			module->rename(cell, stringf("$techmap%d", autoidx++) + cell->name.str());
+
+		return r;
+	}
+
+	// Builds the replacement netlist for a cell. This does not modify the
+	// module or the template, and can run concurrently for different cells
+	// of templates without techmap_autopurge ports.
+	void techmap_plan(TechmapReplacement &r, const TechmapTemplate &t)
+	{
+		PassProfiler::Zone zone("techmap::plan");
+		RTLIL::Cell *cell = r.cell;
+		RTLIL::Module *tpl = r.tpl;
+		std::string orig_cell_name = r.orig_cell_name.str();
+
+		r.extra_src_attrs = cell->get_src_set();
 
 		dict<IdString, IdString> memory_renames;
 
 		for (auto &it : tpl->memories) {
 			IdString m_name = it.first;
 			apply_prefix(cell->name, m_name);
-			RTLIL::Memory *m = module->addMemory(m_name, it.second);
-			if (m->attributes.count(ID::src))
-				m->add_strpool_attribute(ID::src, extra_src_attrs);
-			memory_renames[it.first] = m->name;
-			design->select(module, m);
+			r.memory_names.push_back(m_name);
+			memory_renames[it.first] = m_name;
 		}
 
-		dict<IdString, IdString> positional_ports;
-		dict<Wire*, IdString> temp_renamed_wires;
 		pool<SigBit> autopurge_tpl_bits;
 
-		for (auto tpl_w : tpl->wires())
+		for (auto tpl_w : t.wires)
 		{
-			if (tpl_w->port_id > 0)
+			if (tpl_w->port_id > 0 && tpl_w->get_bool_attribute(ID::techmap_autopurge))
 			{
 				IdString posportname = stringf("$%d", tpl_w->port_id);
-				positional_ports.emplace(posportname, tpl_w->name);
-
-				if (tpl_w->get_bool_attribute(ID::techmap_autopurge) &&
-						(!cell->hasPort(tpl_w->name) || !GetSize(cell->getPort(tpl_w->name))) &&
+				if ((!cell->hasPort(tpl_w->name) || !GetSize(cell->getPort(tpl_w->name))) &&
 						(!cell->hasPort(posportname) || !GetSize(cell->getPort(posportname))))
 				{
-					if (sigmaps.count(tpl) == 0)
-						sigmaps[tpl].set(tpl);
-
 					for (auto bit : sigmaps.at(tpl)(tpl_w))
 						if (bit.wire != nullptr)
 							autopurge_tpl_bits.insert(bit);
@@ -202,49 +313,21 @@ struct TechmapWorker
 			}
 			IdString w_name = tpl_w->name;
 			apply_prefix(cell->name, w_name);
-			RTLIL::Wire *w = module->wire(w_name);
-			if (w != nullptr) {
-				temp_renamed_wires[w] = w->name;
-				module->rename(w, NEW_ID);
-				w = nullptr;
-			}
-			if (w == nullptr) {
-				w = module->addWire(w_name, tpl_w);
-				w->port_input = false;
-				w->port_output = false;
-				w->port_id = 0;
-				w->attributes.erase(ID::techmap_autopurge);
-				if (tpl_w->get_bool_attribute(ID::_techmap_special_))
-					w->attributes.clear();
-				if (w->attributes.count(ID::src))
-					w->add_strpool_attribute(ID::src, extra_src_attrs);
-			}
-			design->select(module, w);
+			r.wire_names.push_back(w_name);
 
-			if (const char *p = strstr(tpl_w->name.c_str(), "_TECHMAP_REPLACE_.")) {
-				IdString replace_name = stringf("%s%s", orig_cell_name.c_str(), p + strlen("_TECHMAP_REPLACE_"));
-				Wire *replace_w = module->addWire(replace_name, tpl_w);
-				module->connect(replace_w, w);
-			}
+			IdString replace_name;
+			if (const char *p = strstr(tpl_w->name.c_str(), "_TECHMAP_REPLACE_."))
+				replace_name = stringf("%s%s", orig_cell_name.c_str(), p + strlen("_TECHMAP_REPLACE_"));
+			r.replace_wire_names.push_back(replace_name);
 		}
 
-		pool<SigBit> tpl_written_bits;
-		for (auto tpl_cell : tpl->cells())
-		for (auto &conn : tpl_cell->connections())
-			if (tpl_cell->output(conn.first))
-				for (auto bit : conn.second)
-					tpl_written_bits.insert(bit);
-		for (auto &conn : tpl->connections())
-			for (auto bit : conn.first)
-				tpl_written_bits.insert(bit);
-
 		SigMap port_signal_map;
 
 		for (auto &it : cell->connections())
 		{
 			IdString portname = it.first;
-			if (positional_ports.count(portname) > 0)
-				portname = positional_ports.at(portname);
+			if (t.positional_ports.count(portname) > 0)
+				portname = t.positional_ports.at(portname);
 			if (tpl->wire(portname) == nullptr || tpl->wire(portname)->port_id == 0) {
 				if (portname.begins_with("$"))
 					log_error("Can't map port `%s' of cell `%s' to template `%s'!\n", portname.c_str(), cell->name.c_str(), tpl->name.c_str());
@@ -260,28 +343,25 @@ struct TechmapWorker
 			if (w->port_output && !w->port_input) {
 				c.first = it.second;
 				c.second = RTLIL::SigSpec(w);
-				apply_prefix(cell->name, c.second, module);
 				extra_connect.first = c.second;
 				extra_connect.second = c.first;
 			} else if (!w->port_output && w->port_input) {
 				c.first = RTLIL::SigSpec(w);
 				c.second = it.second;
-				apply_prefix(cell->name, c.first, module);
 				extra_connect.first = c.first;
 				extra_connect.second = c.second;
 			} else {
-				SigSpec sig_tpl = w, sig_tpl_pf = w, sig_mod = it.second;
-				apply_prefix(cell->name, sig_tpl_pf, module);
+				SigSpec sig_tpl = w, sig_mod = it.second;
 				for (int i = 0; i < GetSize(sig_tpl) && i < GetSize(sig_mod); i++) {
-					if (tpl_written_bits.count(sig_tpl[i])) {
+					if (t.written_bits.count(sig_tpl[i])) {
 						c.first.append(sig_mod[i]);
-						c.second.append(sig_tpl_pf[i]);
+						c.second.append(sig_tpl[i]);
 					} else {
-						c.first.append(sig_tpl_pf[i]);
+						c.first.append(sig_tpl[i]);
 						c.second.append(sig_mod[i]);
 					}
 				}
-				extra_connect.first = sig_tpl_pf;
+				extra_connect.first = sig_tpl;
 				extra_connect.second = sig_mod;
 			}
 
@@ -301,7 +381,7 @@ struct TechmapWorker
 			if (!w->port_output && w->port_input) {
 				port_signal_map.add(c.first, c.second);
 			} else {
-				module->connect(c);
+				r.connections.push_back(c);
 				extra_connect = SigSig();
 			}
 
@@ -314,32 +394,33 @@ struct TechmapWorker
 					extra_connect.first.remove(rhs, lhs-rhs);
 				else if (rhs > lhs)
 					extra_connect.second.remove(lhs, rhs-lhs);
-				module->connect(extra_connect);
+				r.connections.push_back(extra_connect);
 				break;
 			}
 		}
 
-		for (auto tpl_cell : tpl->cells())
+		r.cells.resize(GetSize(t.cells));
+
+		for (int i = 0; i < GetSize(t.cells); i++)
 		{
-			IdString c_name = tpl_cell->name;
-			bool techmap_replace_cell = c_name.ends_with("_TECHMAP_REPLACE_");
+			RTLIL::Cell *tpl_cell = t.cells[i];
+			TechmapReplacementCell &c = r.cells[i];
+
+			c.name = tpl_cell->name;
+			c.replace_cell = c.name.ends_with("_TECHMAP_REPLACE_");
 
-			if (techmap_replace_cell)
-				c_name = orig_cell_name;
+			if (c.replace_cell)
+				c.name = r.orig_cell_name;
 			else if (const char *p = strstr(tpl_cell->name.c_str(), "_TECHMAP_REPLACE_."))
-				c_name = stringf("%s%s", orig_cell_name.c_str(), p + strlen("_TECHMAP_REPLACE_"));
+				c.name = stringf("%s%s", orig_cell_name.c_str(), p + strlen("_TECHMAP_REPLACE_"));
 			else
-				apply_prefix(cell->name, c_name);
-
-			RTLIL::Cell *c = module->addCell(c_name, tpl_cell);
-			design->select(module, c);
+				apply_prefix(cell->name, c.name);
 
-			if (c->type.begins_with("\\$"))
-				c->type = c->type.substr(1);
+			c.type = tpl_cell->type;
+			if (c.type.begins_with("\\$"))
+				c.type = c.type.substr(1);
 
-			vector<IdString> autopurge_ports;
-
-			for (auto &conn : c->connections())
+			for (auto &conn : tpl_cell->connections())
 			{
 				bool autopurge = false;
 				if (!autopurge_tpl_bits.empty()) {
@@ -352,32 +433,105 @@ struct TechmapWorker
 				}
 
 				if (autopurge) {
-					autopurge_ports.push_back(conn.first);
+					c.purged_ports.push_back(conn.first);
 				} else {
 					RTLIL::SigSpec new_conn = conn.second;
-					apply_prefix(cell->name, new_conn, module);
 					port_signal_map.apply(new_conn);
-					c->setPort(conn.first, std::move(new_conn));
+					c.connections.emplace_back(conn.first, std::move(new_conn));
 				}
 			}
 
-			for (auto &it2 : autopurge_ports)
-				c->unsetPort(it2);
-
-			if (c->has_memid()) {
-				IdString memid = c->getParam(ID::MEMID).decode_string();
+			if (c.type.in(ID($memwr), ID($memwr_v2), ID($memrd), ID($memrd_v2), ID($meminit), ID($meminit_v2))) {
+				IdString memid = tpl_cell->getParam(ID::MEMID).decode_string();
 				log_assert(memory_renames.count(memid) != 0);
-				c->setParam(ID::MEMID, Const(memory_renames[memid].str()));
-			} else if (c->is_mem_cell()) {
-				IdString memid = c->getParam(ID::MEMID).decode_string();
-				apply_prefix(cell->name, memid);
-				c->setParam(ID::MEMID, Const(memid.c_str()));
+				c.memid = memory_renames.at(memid);
+			} else if (c.type.in(ID($mem), ID($mem_v2))) {
+				c.memid = tpl_cell->getParam(ID::MEMID).decode_string();
+				apply_prefix(cell->name, c.memid);
 			}
+		}
+
+		for (auto &it : tpl->connections()) {
+			RTLIL::SigSig c = it;
+			port_signal_map.apply(c.first);
+			port_signal_map.apply(c.second);
+			r.connections.push_back(c);
+		}
+	}
+
+	// Inserts a replacement netlist into the module and removes the mapped cell.
+	void techmap_commit(RTLIL::Design *design, RTLIL::Module *module, const TechmapReplacement &r, const TechmapTemplate &t)
+	{
+		PassProfiler::Zone zone("techmap::commit");
+		RTLIL::Cell *cell = r.cell;
+		RTLIL::Module *tpl = r.tpl;
+
+		int mem_idx = 0;
+		for (auto &it : tpl->memories) {
+			RTLIL::Memory *m = module->addMemory(r.memory_names[mem_idx++], it.second);
+			r.extra_src_attrs.add_to(m);
+			design->select(module, m);
+		}
+
+		std::vector<RTLIL::Wire*> new_wires(GetSize(t.wires));
+		dict<Wire*, IdString> temp_renamed_wires;
+
+		for (int i = 0; i < GetSize(t.wires); i++)
+		{
+			RTLIL::Wire *tpl_w = t.wires[i];
+			RTLIL::Wire *w = module->wire(r.wire_names[i]);
+			if (w != nullptr) {
+				temp_renamed_wires[w] = w->name;
+				module->rename(w, NEW_ID);
+			}
+			w = module->addWire(r.wire_names[i], tpl_w);
+			w->port_input = false;
+			w->port_output = false;
+			w->port_id = 0;
+			w->attributes.erase(ID::techmap_autopurge);
+			if (tpl_w->get_bool_attribute(ID::_techmap_special_))
+				w->attributes.clear();
+			r.extra_src_attrs.add_to(w);
+			design->select(module, w);
+			new_wires[i] = w;
+
+			if (!r.replace_wire_names[i].empty()) {
+				Wire *replace_w = module->addWire(r.replace_wire_names[i], tpl_w);
+				module->connect(replace_w, w);
+			}
+		}
+
+		auto map_sig = [&](const RTLIL::SigSpec &sig) {
+			vector<SigChunk> chunks = sig.chunks();
+			for (auto &chunk : chunks)
+				if (chunk.wire != nullptr && chunk.wire->module == tpl)
+					chunk.wire = new_wires[t.wire_index.at(chunk.wire)];
+			return RTLIL::SigSpec(chunks);
+		};
+
+		for (auto &it : r.connections)
+			module->connect(map_sig(it.first), map_sig(it.second));
+
+		for (int i = 0; i < GetSize(t.cells); i++)
+		{
+			const TechmapReplacementCell &rc = r.cells[i];
 
-			if (c->attributes.count(ID::src))
-				c->add_strpool_attribute(ID::src, extra_src_attrs);
+			RTLIL::Cell *c = module->addCell(rc.name, t.cells[i]);
+			design->select(module, c);
+			c->type = rc.type;
+
+			for (auto &conn : rc.connections)
+				c->setPort(conn.first, map_sig(conn.second));
+
+			for (auto &it2 : rc.purged_ports)
+				c->unsetPort(it2);
 
-			if (techmap_replace_cell) {
+			if (!rc.memid.empty())
+				c->setParam(ID::MEMID, Const(rc.memid.str()));
+
+			r.extra_src_attrs.add_to(c);
+
+			if (rc.replace_cell) {
 				for (auto attr : cell->attributes)
 					if (!c->attributes.count(attr.first))
 						c->attributes[attr.first] = attr.second;
@@ -385,15 +539,6 @@ struct TechmapWorker
 			}
 		}
 
-		for (auto &it : tpl->connections()) {
-			RTLIL::SigSig c = it;
-			apply_prefix(cell->name.str(), c.first, module);
-			apply_prefix(cell->name.str(), c.second, module);
-			port_signal_map.apply(c.first);
-			port_signal_map.apply(c.second);
-			module->connect(c);
-		}
-
 		module->remove(cell);
 
 		for (auto &it : temp_renamed_wires)
@@ -407,6 +552,35 @@ struct TechmapWorker
 		}
 	}
 
+	// Builds the queued replacement netlists in parallel and commits them to
+	// the module in queue order, which keeps the result independent of the
+	// number of threads.
+	void techmap_commit_queue(RTLIL::Design *design, RTLIL::Module *module, std::vector<TechmapReplacement> &queue,
+			const dict<RTLIL::Module*, TechmapTemplate> &templates)
+	{
+		const int job_size = 256;
+		int num_jobs = (GetSize(queue) + job_size - 1) / job_size;
+		int num_threads = yosys_thread_count(num_jobs);
+
+		ThreadPool::run_captured(num_jobs, [&](int i) {
+			for (int k = i * job_size; k < std::min((i + 1) * job_size, GetSize(queue)); k++)
+				techmap_plan(queue[k], templates.at(queue[k].tpl));
+		}, num_threads);
+
+		int num_cells = 0, num_wires = 0, num_connections = 0;
+		for (auto &r : queue) {
+			num_cells += GetSize(r.cells);
+			num_wires += GetSize(r.wire_names);
+			num_connections += GetSize(r.connections);
+		}
+
+		module->begin_batch(num_cells, num_wires, num_connections);
+		for (auto &r : queue)
+			techmap_commit(design, module, r, templates.at(r.tpl));
+		module->commit_batch();
+		queue.clear();
+	}
+
 	bool techmap_module(RTLIL::Design *design, RTLIL::Module *module, RTLIL::Design *map, pool<RTLIL::Cell*> &handled_cells,
 			const dict<IdString, pool<IdString>> &celltypeMap, bool in_recursion)
 	{
@@ -473,6 +647,12 @@ struct TechmapWorker
 
 		cells.sort();
 
+		// With multiple threads the replacement netlists of the mapped cells
+		// are queued and built in parallel by techmap_commit_queue().
+		dict<RTLIL::Module*, TechmapTemplate> templates;
+		std::vector<TechmapReplacement> queue;
+		bool queue_cells = yosys_thread_count(GetSize(dcells)) > 1;
+
 		// Thierry (Rapid Silicon) : fix non-determinism. 
 		// 'cells.sort()' does not sort cells in an absolute order and it creates
 		// non determinsim (EDA-2875 on canny_edge_detector) !
@@ -706,9 +886,15 @@ struct TechmapWorker
 						tpl = it->second;
 					} else {
 						if (parameters.size() != 0) {
+							PassProfiler::Zone zone("techmap::derive");
 							mkdebug.on();
-							derived_name = tpl->derive(map, parameters);
-							tpl = map->module(derived_name);
+							if (!cache_dir.empty()) {
+								tpl = derive_cached(map, tpl, parameters);
+								derived_name = tpl->name.str();
+							} else {
+								derived_name = tpl->derive(map, parameters);
+								tpl = map->module(derived_name);
+							}
 							log_continue = true;
 						}
 						techmap_cache.emplace(std::move(key), tpl);
@@ -960,7 +1146,15 @@ struct TechmapWorker
 					}
 #endif
 					log_debug("%s %s.%s (%s) using %s.\n", mapmsg_prefix.c_str(), log_id(module), log_id(cell), log_id(cell->type), log_id(tpl));
-					techmap_module_worker(design, module, cell, tpl);
+					TechmapReplacement r = techmap_prepare(module, cell, tpl, templates);
+					if (queue_cells && !templates.at(tpl).has_autopurge) {
+						queue.push_back(std::move(r));
+						if (GetSize(queue) >= 65536)
+							techmap_commit_queue(design, module, queue, templates);
+					} else {
+						techmap_plan(r, templates.at(tpl));
+						techmap_commit(design, module, r, templates.at(tpl));
+					}
 					cell = nullptr;
 				}
 				did_something = true;
@@ -974,6 +1168,9 @@ struct TechmapWorker
 			handled_cells.insert(cell);
 		}
 
+		if (!queue.empty())
+			techmap_commit_queue(design, module, queue, templates);
+
 		if (log_continue) {
 			log_header(design, "Continuing TECHMAP pass.\n");
 			log_continue = false;
@@ -1029,6 +1226,14 @@ struct TechmapPass : public Pass {
 		log("        a selected cell. only cell types that end on an underscore are accepted\n");
 		log("        as final cell types by this mode.\n");
 		log("\n");
+		log("    -cache <dir>\n");
+		log("        keep the parameterized versions of the map modules in the given\n");
+		log("        directory and reuse them in later techmap runs with the same map\n");
+		log("        files, instead of elaborating them again. The default directory is\n");
+		log("        taken from the scratchpad variable 'techmap.cache_dir'. The cache is\n");
+		log("        keyed on the contents of the map files, so files included from them\n");
+		log("        must not change while the cache is in use.\n");
+		log("\n");
 		log("    -D <define>, -I <incdir>\n");
 		log("        this options are passed as-is to the Verilog frontend for loading the\n");
 		log("        map file. Note that the Verilog frontend is also called with the\n");
@@ -1170,6 +1375,10 @@ struct TechmapPass : public Pass {
 				map_files.push_back(args[++argidx]);
 				continue;
 			}
+			if (args[argidx] == "-cache" && argidx+1 < args.size()) {
+				worker.cache_dir = args[++argidx];
+				continue;
+			}
 			if (args[argidx] == "-max_iter" && argidx+1 < args.size()) {
 				max_iter = atoi(args[++argidx].c_str());
 				continue;
@@ -1206,6 +1415,25 @@ struct TechmapPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		if (worker.cache_dir.empty())
+			worker.cache_dir = design->scratchpad_get_string("techmap.cache_dir");
+		if (!worker.cache_dir.empty()) {
+			rewrite_filename(worker.cache_dir);
+			std::string info = stringf("%s|%s|%d", yosys_version_str, verilog_frontend.c_str(), worker.autoproc_mode);
+			for (auto fn : map_files.empty() ? std::vector<std::string>{"+/techmap.v"} : map_files) {
+				if (fn.compare(0, 1, "%") == 0) {
+					log("Not using the template cache with in-memory map design `%s'.\n", fn.c_str()+1);
+					worker.cache_dir.clear();
+					break;
+				}
+				rewrite_filename(fn);
+				info += "|" + SHA1::from_file(fn);
+			}
+			worker.cache_map_hash = sha1(info);
+			if (!worker.cache_dir.empty() && !check_file_exists(worker.cache_dir) && !create_directory(worker.cache_dir))
+				log_cmd_error("Can't create techmap cache directory `%s'.\n", worker.cache_dir.c_str());
+		}
+
 		RTLIL::Design *map = new RTLIL::Design;
 		if (map_files.empty()) {
 			Frontend::frontend_call(map, nullptr, "+/techmap.v", verilog_frontend);
@@ -1275,6 +1503,7 @@ struct TechmapPass : public Pass {
 		{
 			RTLIL::Module *module = *worker.module_queue.begin();
 			worker.module_queue.erase(module);
+			PassProfiler::ModuleScope profile_scope(module);
 
 			int module_max_iter = max_iter;
 			bool did_something = true;
@@ -23,12 +23,15 @@
 #include "kernel/consteval.h"
 #include "kernel/celledges.h"
 #include "kernel/macc.h"
+#include "kernel/threading.h"
 #include <algorithm>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
-static uint32_t xorshift32_state = 123456789;
+// thread_local so that the checks of each design can run in their own
+// thread with -j, each seeded from the main thread
+static thread_local uint32_t xorshift32_state = 123456789;
 
 static uint32_t xorshift32(uint32_t limit) {
 	xorshift32_state ^= xorshift32_state << 13;
@@ -37,6 +40,12 @@ static uint32_t xorshift32(uint32_t limit) {
 	return xorshift32_state % limit;
 }
 
+static uint64_t xorshift32_word() {
+	uint64_t hi = xorshift32(0xffffffff);
+	uint64_t lo = xorshift32(0xffffffff);
+	return hi << 32 | lo;
+}
+
 static void create_gold_module(RTLIL::Design *design, RTLIL::IdString cell_type, std::string cell_type_flags, bool constmode, bool muxdiv)
 {
 	RTLIL::Module *module = design->addModule(ID(gold));
@@ -467,7 +476,7 @@ static void run_edges_test(RTLIL::Design *design, bool verbose)
 		log_error("SAT-based edge table does not match the database!\n");
 }
 
-static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::string uut_name, std::ofstream &vlog_file)
+static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::string uut_name, std::ostream *vlog_file)
 {
 	log("Eval testing:%c", verbose ? '\n' : ' ');
 
@@ -487,33 +496,33 @@ static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::
 			satgen2.importCell(cell);
 		}
 
-	if (vlog_file.is_open())
+	if (vlog_file != nullptr)
 	{
-		vlog_file << stringf("\nmodule %s;\n", uut_name.c_str());
+		*vlog_file << stringf("\nmodule %s;\n", uut_name.c_str());
 
 		for (auto port : gold_mod->ports) {
 			RTLIL::Wire *wire = gold_mod->wire(port);
 			if (wire->port_input)
-				vlog_file << stringf("  reg [%d:0] %s;\n", GetSize(wire)-1, log_id(wire));
+				*vlog_file << stringf("  reg [%d:0] %s;\n", GetSize(wire)-1, log_id(wire));
 			else
-				vlog_file << stringf("  wire [%d:0] %s_expr, %s_noexpr;\n", GetSize(wire)-1, log_id(wire), log_id(wire));
+				*vlog_file << stringf("  wire [%d:0] %s_expr, %s_noexpr;\n", GetSize(wire)-1, log_id(wire), log_id(wire));
 		}
 
-		vlog_file << stringf("  %s_expr uut_expr(", uut_name.c_str());
+		*vlog_file << stringf("  %s_expr uut_expr(", uut_name.c_str());
 		for (int i = 0; i < GetSize(gold_mod->ports); i++)
-			vlog_file << stringf("%s.%s(%s%s)", i ? ", " : "", log_id(gold_mod->ports[i]), log_id(gold_mod->ports[i]),
+			*vlog_file << stringf("%s.%s(%s%s)", i ? ", " : "", log_id(gold_mod->ports[i]), log_id(gold_mod->ports[i]),
 					gold_mod->wire(gold_mod->ports[i])->port_input ? "" : "_expr");
-		vlog_file << stringf(");\n");
+		*vlog_file << stringf(");\n");
 
-		vlog_file << stringf("  %s_expr uut_noexpr(", uut_name.c_str());
+		*vlog_file << stringf("  %s_expr uut_noexpr(", uut_name.c_str());
 		for (int i = 0; i < GetSize(gold_mod->ports); i++)
-			vlog_file << stringf("%s.%s(%s%s)", i ? ", " : "", log_id(gold_mod->ports[i]), log_id(gold_mod->ports[i]),
+			*vlog_file << stringf("%s.%s(%s%s)", i ? ", " : "", log_id(gold_mod->ports[i]), log_id(gold_mod->ports[i]),
 					gold_mod->wire(gold_mod->ports[i])->port_input ? "" : "_noexpr");
-		vlog_file << stringf(");\n");
+		*vlog_file << stringf(");\n");
 
-		vlog_file << stringf("  task run;\n");
-		vlog_file << stringf("    begin\n");
-		vlog_file << stringf("      $display(\"%s\");\n", uut_name.c_str());
+		*vlog_file << stringf("  task run;\n");
+		*vlog_file << stringf("    begin\n");
+		*vlog_file << stringf("      $display(\"%s\");\n", uut_name.c_str());
 	}
 
 	for (int i = 0; i < 64; i++)
@@ -559,16 +568,16 @@ static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::
 			gold_ce.set(gold_wire, in_value);
 			gate_ce.set(gate_wire, in_value);
 
-			if (vlog_file.is_open() && GetSize(in_value) > 0) {
-				vlog_file << stringf("      %s = 'b%s;\n", log_id(gold_wire), in_value.as_string().c_str());
+			if (vlog_file != nullptr && GetSize(in_value) > 0) {
+				*vlog_file << stringf("      %s = 'b%s;\n", log_id(gold_wire), in_value.as_string().c_str());
 				if (!vlog_pattern_info.empty())
 					vlog_pattern_info += " ";
 				vlog_pattern_info += stringf("%s=%s", log_id(gold_wire), log_signal(in_value));
 			}
 		}
 
-		if (vlog_file.is_open())
-			vlog_file << stringf("      #1;\n");
+		if (vlog_file != nullptr)
+			*vlog_file << stringf("      #1;\n");
 
 		for (auto port : gold_mod->ports)
 		{
@@ -611,11 +620,11 @@ static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::
 			out_sig.append(gold_wire);
 			out_val.append(gold_outval);
 
-			if (vlog_file.is_open()) {
-				vlog_file << stringf("      $display(\"[%s] %s expected: %%b, expr: %%b, noexpr: %%b\", %d'b%s, %s_expr, %s_noexpr);\n",
+			if (vlog_file != nullptr) {
+				*vlog_file << stringf("      $display(\"[%s] %s expected: %%b, expr: %%b, noexpr: %%b\", %d'b%s, %s_expr, %s_noexpr);\n",
 						vlog_pattern_info.c_str(), log_id(gold_wire), GetSize(gold_outval), gold_outval.as_string().c_str(), log_id(gold_wire), log_id(gold_wire));
-				vlog_file << stringf("      if (%s_expr !== %d'b%s) begin $display(\"ERROR\"); $finish; end\n", log_id(gold_wire), GetSize(gold_outval), gold_outval.as_string().c_str());
-				vlog_file << stringf("      if (%s_noexpr !== %d'b%s) begin $display(\"ERROR\"); $finish; end\n", log_id(gold_wire), GetSize(gold_outval), gold_outval.as_string().c_str());
+				*vlog_file << stringf("      if (%s_expr !== %d'b%s) begin $display(\"ERROR\"); $finish; end\n", log_id(gold_wire), GetSize(gold_outval), gold_outval.as_string().c_str());
+				*vlog_file << stringf("      if (%s_noexpr !== %d'b%s) begin $display(\"ERROR\"); $finish; end\n", log_id(gold_wire), GetSize(gold_outval), gold_outval.as_string().c_str());
 			}
 		}
 
@@ -690,16 +699,131 @@ static void run_eval_test(RTLIL::Design *design, bool verbose, bool nosat, std::
 		}
 	}
 
-	if (vlog_file.is_open()) {
-		vlog_file << stringf("    end\n");
-		vlog_file << stringf("  endtask\n");
-		vlog_file << stringf("endmodule\n");
+	if (vlog_file != nullptr) {
+		*vlog_file << stringf("    end\n");
+		*vlog_file << stringf("  endtask\n");
+		*vlog_file << stringf("endmodule\n");
 	}
 
 	if (!verbose)
 		log(" ok.\n");
 }
 
+static void run_sat_test(RTLIL::Design *design)
+{
+	// same proof as "sat -verify -enable_undef -prove trigger 0 miter", but
+	// without calling a pass, so that it can run in a worker thread
+	log("SAT proof: ");
+
+	RTLIL::Module *miter_mod = design->module(ID(miter));
+	ezSatPtr ez;
+	SigMap sigmap(miter_mod);
+	SatGen satgen(ez.get(), &sigmap);
+	satgen.model_undef = true;
+
+	for (auto cell : miter_mod->cells())
+		if (!satgen.importCell(cell))
+			log_error("Failed to import cell %s (type %s) to SAT database.\n", log_id(cell), log_id(cell->type));
+
+	RTLIL::SigSpec in_sig;
+	for (auto port : miter_mod->ports)
+		if (miter_mod->wire(port)->port_input)
+			in_sig.append(miter_mod->wire(port));
+
+	std::vector<int> model = satgen.importSigSpec(in_sig);
+	std::vector<int> model_undef = satgen.importUndefSigSpec(in_sig);
+	model.insert(model.end(), model_undef.begin(), model_undef.end());
+	std::vector<bool> model_value;
+
+	int proof = satgen.signals_eq(miter_mod->wire(ID(trigger)), RTLIL::State::S0);
+	if (!ez->solve(model, model_value, ez->NOT(proof))) {
+		log("ok.\n");
+		return;
+	}
+
+	log("FAIL!\n");
+	int offset = 0;
+	for (auto chunk : in_sig.chunks()) {
+		RTLIL::Const value;
+		for (int i = 0; i < chunk.width; i++, offset++)
+			value.bits.push_back(model_value.at(GetSize(in_sig) + offset) ? RTLIL::Sx : model_value.at(offset) ? RTLIL::S1 : RTLIL::S0);
+		log("  %s = %s\n", log_id(chunk.wire), log_signal(value));
+	}
+	log_error("SAT proof for miter failed!\n");
+}
+
+static void run_vec_test(RTLIL::Design *design, bool verbose, int num_words)
+{
+	RTLIL::Module *gold_mod = design->module(ID(gold));
+	RTLIL::Module *gate_mod = design->module(ID(gate));
+	ConstEvalVec gold_vec(gold_mod, num_words), gate_vec(gate_mod, num_words);
+
+	RTLIL::SigSpec gold_in, gate_in, gold_out, gate_out;
+	for (auto port : gold_mod->ports) {
+		RTLIL::Wire *gold_wire = gold_mod->wire(port);
+		RTLIL::Wire *gate_wire = gate_mod->wire(port);
+		log_assert(gate_wire != nullptr);
+		if (gold_wire->port_input) {
+			gold_in.append(gold_wire);
+			gate_in.append(gate_wire);
+		}
+		if (gold_wire->port_output) {
+			gold_out.append(gold_wire);
+			gate_out.append(gate_wire);
+		}
+	}
+
+	log("Vec testing: %d patterns", 64 * num_words);
+
+	std::vector<uint64_t> in_words(GetSize(gold_in) * num_words);
+	for (auto &word : in_words)
+		word = xorshift32_word();
+
+	gold_vec.set(gold_in, in_words);
+	gate_vec.set(gate_in, in_words);
+
+	std::vector<uint64_t> gold_words, gate_words;
+	if (!gold_vec.eval(gold_out, gold_words))
+		log_error("Failed to eval outputs of gold module.\n");
+	if (!gate_vec.eval(gate_out, gate_words))
+		log_error("Failed to eval outputs of gate module.\n");
+
+	// ConstEvalVec has no x values, so the outputs of a pattern that differ
+	// are checked again with ConstEval, where x bits of gold are don't-care
+	ConstEval gold_ce(gold_mod), gate_ce(gate_mod);
+	int num_rechecked = 0;
+
+	for (int p = 0; p < 64 * num_words; p++)
+	{
+		bool differ = false;
+		for (int i = 0; i < GetSize(gold_out) && !differ; i++)
+			differ = ((gold_words[i * num_words + p / 64] ^ gate_words[i * num_words + p / 64]) >> (p % 64)) & 1;
+		if (!differ)
+			continue;
+
+		RTLIL::Const in_value = gold_vec.get_pattern(in_words, p);
+		gold_ce.clear();
+		gate_ce.clear();
+		gold_ce.set(gold_in, in_value);
+		gate_ce.set(gate_in, in_value);
+
+		RTLIL::SigSpec gold_outval = gold_out, gate_outval = gate_out;
+		if (!gold_ce.eval(gold_outval))
+			log_error("Failed to eval outputs of gold module.\n");
+		if (!gate_ce.eval(gate_outval))
+			log_error("Failed to eval outputs of gate module.\n");
+
+		for (int i = 0; i < GetSize(gold_out); i++)
+			if (gold_outval[i] != RTLIL::Sx && gold_outval[i] != gate_outval[i])
+				log_error("Mismatch for input %s: gold:%s != gate:%s\n", log_signal(in_value), log_signal(gold_outval), log_signal(gate_outval));
+		num_rechecked++;
+	}
+
+	if (verbose && num_rechecked > 0)
+		log(" (%d only differ in undefined gold bits)", num_rechecked);
+	log(" ok.\n");
+}
+
 struct TestCellPass : public Pass {
 	TestCellPass() : Pass("test_cell", "automatically test the implementation of a cell type") { }
 	void help() override
@@ -761,6 +885,21 @@ struct TestCellPass : public Pass {
 		log("    -vlog {filename}\n");
 		log("        create a Verilog test bench to test simlib and write_verilog\n");
 		log("\n");
+		log("    -vec\n");
+		log("        additionally compare gold and gate on 1024 random input patterns\n");
+		log("        using the bit-parallel ConstEvalVec. Patterns for which the outputs\n");
+		log("        differ are checked again with ConstEval, so that undefined gold\n");
+		log("        output bits are ignored like in the other checks.\n");
+		log("\n");
+		log("    -j {integer}\n");
+		log("        run the checks of up to this number of test circuits at the same\n");
+		log("        time. The circuits are created and mapped in batches of 64 in the\n");
+		log("        main thread, then the SAT proof, the eval and the edges tests run in\n");
+		log("        parallel. The SAT proof does not call the 'sat' pass in this mode.\n");
+		log("        The random patterns of each circuit are seeded separately, so the\n");
+		log("        results for a given -s value are the same for any number of threads\n");
+		log("        but differ from a run without -j.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design*) override
 	{
@@ -775,6 +914,8 @@ struct TestCellPass : public Pass {
 		bool nosat = false;
 		bool noeval = false;
 		bool edges = false;
+		int vec_words = 0;
+		int max_jobs = 0;
 
 		int argidx;
 		for (argidx = 1; argidx < GetSize(args); argidx++)
@@ -842,6 +983,14 @@ struct TestCellPass : public Pass {
 					log_cmd_error("Failed to open output file `%s'.\n", args[argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-vec") {
+				vec_words = 16;
+				continue;
+			}
+			if (args[argidx] == "-j" && argidx+1 < GetSize(args)) {
+				max_jobs = std::max(atoi(args[++argidx].c_str()), 1);
+				continue;
+			}
 			break;
 		}
 
@@ -965,9 +1114,45 @@ struct TestCellPass : public Pass {
 
 		std::vector<std::string> uut_names;
 
-		for (auto cell_type : selected_cell_types)
-			for (int i = 0; i < num_iter; i++)
+		struct TestJob {
+			RTLIL::Design *design = nullptr;
+			std::string uut_name;
+			std::ostringstream vlog;
+			uint32_t seed = 0;
+		};
+
+		auto run_checks = [&](TestJob &job, std::ostream *vlog) {
+			if (edges) {
+				run_edges_test(job.design, verbose);
+				return;
+			}
+			if (!nosat && max_jobs > 0)
+				run_sat_test(job.design);
+			if (!noeval)
+				run_eval_test(job.design, verbose, nosat, job.uut_name, vlog);
+			if (vec_words > 0)
+				run_vec_test(job.design, verbose, vec_words);
+		};
+
+		// With -j the passes still run in the main thread, because passes can
+		// not be called from worker threads. The batch size does not depend on
+		// the number of threads, so that the log output does not either.
+		int num_tests = GetSize(selected_cell_types) * num_iter;
+		int batch_size = max_jobs > 0 ? 64 : 1;
+		int num_threads = yosys_in_worker_thread() ? 1 : max_jobs;
+
+		for (int batch_start = 0; batch_start < num_tests; batch_start += batch_size)
+		{
+			int num_jobs = std::min(batch_size, num_tests - batch_start);
+			std::vector<TestJob> jobs(num_jobs);
+
+			for (int k = 0; k < num_jobs; k++)
 			{
+				IdString cell_type = selected_cell_types[(batch_start + k) / num_iter];
+				int i = (batch_start + k) % num_iter;
+				TestJob &job = jobs[k];
+				std::ostream *vlog = vlog_file.is_open() ? max_jobs > 0 ? &job.vlog : static_cast<std::ostream*>(&vlog_file) : nullptr;
+
 				RTLIL::Design *design = new RTLIL::Design;
 				if (cell_type == ID(rtlil))
 					Frontend::frontend_call(design, NULL, std::string(), "rtlil " + rtlil_file);
@@ -975,9 +1160,10 @@ struct TestCellPass : public Pass {
 					create_gold_module(design, cell_type, cell_types.at(cell_type), constmode, muxdiv);
 				if (!write_prefix.empty()) {
 					Pass::call(design, stringf("write_rtlil %s_%s_%05d.il", write_prefix.c_str(), cell_type.c_str()+1, i));
+					delete design;
+					continue;
 				} else if (edges) {
 					Pass::call(design, "dump gold");
-					run_edges_test(design, verbose);
 				} else {
 					Pass::call(design, stringf("copy gold gate; cd gate; %s; cd ..; opt -fast gate", techmap_cmd.c_str()));
 					if (!nosat)
@@ -985,22 +1171,42 @@ struct TestCellPass : public Pass {
 					if (verbose)
 						Pass::call(design, "dump gate");
 					Pass::call(design, "dump gold");
-					if (!nosat)
+					if (!nosat && max_jobs == 0)
 						Pass::call(design, "sat -verify -enable_undef -prove trigger 0 -show-inputs -show-outputs miter");
-					std::string uut_name = stringf("uut_%s_%d", cell_type.substr(1).c_str(), i);
-					if (vlog_file.is_open()) {
-						Pass::call(design, stringf("copy gold %s_expr; select %s_expr", uut_name.c_str(), uut_name.c_str()));
-						Backend::backend_call(design, &vlog_file, "<test_cell -vlog>", "verilog -selected");
-						Pass::call(design, stringf("copy gold %s_noexpr; select %s_noexpr", uut_name.c_str(), uut_name.c_str()));
-						Backend::backend_call(design, &vlog_file, "<test_cell -vlog>", "verilog -selected -noexpr");
-						uut_names.push_back(uut_name);
+					job.uut_name = stringf("uut_%s_%d", cell_type.substr(1).c_str(), i);
+					if (vlog != nullptr) {
+						Pass::call(design, stringf("copy gold %s_expr; select %s_expr", job.uut_name.c_str(), job.uut_name.c_str()));
+						Backend::backend_call(design, vlog, "<test_cell -vlog>", "verilog -selected");
+						Pass::call(design, stringf("copy gold %s_noexpr; select %s_noexpr", job.uut_name.c_str(), job.uut_name.c_str()));
+						Backend::backend_call(design, vlog, "<test_cell -vlog>", "verilog -selected -noexpr");
+						uut_names.push_back(job.uut_name);
 					}
-					if (!noeval)
-						run_eval_test(design, verbose, nosat, uut_name, vlog_file);
 				}
+
+				job.design = design;
+				if (max_jobs > 0) {
+					job.seed = xorshift32(0x7fffffff) + 1;
+					continue;
+				}
+
+				run_checks(job, vlog);
 				delete design;
+				job.design = nullptr;
 			}
 
+			if (max_jobs == 0 || !write_prefix.empty())
+				continue;
+
+			ThreadPool::run_captured(num_jobs, [&](int k) {
+				xorshift32_state = jobs[k].seed;
+				run_checks(jobs[k], vlog_file.is_open() ? &jobs[k].vlog : nullptr);
+			}, std::min(num_threads, num_jobs), nullptr, [&](int k) {
+				if (vlog_file.is_open())
+					vlog_file << jobs[k].vlog.str();
+				delete jobs[k].design;
+			});
+		}
+
 		if (vlog_file.is_open()) {
 			vlog_file << "\nmodule testbench;\n";
 			for (auto &uut : uut_names)
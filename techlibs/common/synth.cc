@@ -88,13 +88,18 @@ struct SynthPass : public ScriptPass {
 		log("        read/write collision\" (same result as setting the no_rw_check\n");
 		log("        attribute on all memories).\n");
 		log("\n");
+		log("    -cache <dir>\n");
+		log("        run the 'coarse' and 'fine' steps separately on each module using\n");
+		log("        'hiercache', reusing the results of unchanged modules from the given\n");
+		log("        cache directory. can not be combined with -flatten.\n");
+		log("\n");
 		log("\n");
 		log("The following commands are executed by this synthesis command:\n");
 		help_script();
 		log("\n");
 	}
 
-	string top_module, fsm_opts, memory_opts, abc;
+	string top_module, fsm_opts, memory_opts, abc, cache_dir, cache_opts;
 	bool autotop, flatten, noalumacc, nofsm, noabc, noshare, flowmap, booth;
 
 	int lut;
@@ -104,6 +109,8 @@ struct SynthPass : public ScriptPass {
 		top_module.clear();
 		fsm_opts.clear();
 		memory_opts.clear();
+		cache_dir.clear();
+		cache_opts.clear();
 
 		autotop = false;
 		flatten = false;
@@ -192,10 +199,29 @@ struct SynthPass : public ScriptPass {
 				memory_opts += " -no-rw-check";
 				continue;
 			}
+			if (args[argidx] == "-cache" && argidx + 1 < args.size()) {
+				cache_dir = args[++argidx];
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		if (!cache_dir.empty()) {
+			if (flatten)
+				log_cmd_error("The -cache option can not be combined with -flatten.\n");
+			// the options passed on to the per-module synth run
+			for (size_t i = 1; i < argidx; i++) {
+				if (args[i] == "-top" || args[i] == "-run" || args[i] == "-cache") {
+					i++;
+					continue;
+				}
+				if (args[i] == "-auto-top")
+					continue;
+				cache_opts += " " + args[i];
+			}
+		}
+
 		if (!design->full_selection())
 			log_cmd_error("This command only operates on fully selected designs!\n");
 
@@ -229,35 +255,54 @@ struct SynthPass : public ScriptPass {
 		}
 
 		if (check_label("coarse")) {
-			run("proc");
-			if (flatten || help_mode)
-				run("flatten", "  (if -flatten)");
-			run("opt_expr");
-			run("opt_clean");
-			run("check");
-			run("opt -nodffe -nosdff");
-			if (!nofsm || help_mode)
-				run("fsm" + fsm_opts, "      (unless -nofsm)");
-			run("opt");
-			run("wreduce");
-			run("peepopt");
-			run("opt_clean");
 			if (help_mode)
-				run("techmap -map +/cmp2lut.v -map +/cmp2lcu.v", " (if -lut)");
-			else if (lut)
-				run(stringf("techmap -map +/cmp2lut.v -map +/cmp2lcu.v -D LUT_WIDTH=%d", lut));
-			if (booth || help_mode)
-				run("booth", "    (if -booth)");
-			if (!noalumacc)
-				run("alumacc", "  (unless -noalumacc)");
-			if (!noshare)
-				run("share", "    (unless -noshare)");
-			run("opt");
-			run("memory -nomap" + memory_opts);
-			run("opt_clean");
+				run("hiercache -dir <dir> synth <options> -run coarse:check", "(if -cache, instead of the coarse and fine steps below)");
+			else if (!cache_dir.empty()) {
+				// hiercache calls this pass again for each module, which
+				// overwrites the state of this run
+				RTLIL::Design *design = active_design;
+				std::string dir = cache_dir, run_from = active_run_from, run_to = active_run_to;
+				bool active = block_active;
+				Pass::call(design, stringf("hiercache -dir %s synth%s -run coarse:check", dir.c_str(), cache_opts.c_str()));
+				help_mode = false;
+				active_design = design;
+				active_run_from = run_from;
+				active_run_to = run_to;
+				block_active = active;
+				cache_dir = dir;
+				design->check();
+			}
+			if (cache_dir.empty()) {
+				run("proc");
+				if (flatten || help_mode)
+					run("flatten", "  (if -flatten)");
+				run("opt_expr");
+				run("opt_clean");
+				run("check");
+				run("opt -nodffe -nosdff");
+				if (!nofsm || help_mode)
+					run("fsm" + fsm_opts, "      (unless -nofsm)");
+				run("opt");
+				run("wreduce");
+				run("peepopt");
+				run("opt_clean");
+				if (help_mode)
+					run("techmap -map +/cmp2lut.v -map +/cmp2lcu.v", " (if -lut)");
+				else if (lut)
+					run(stringf("techmap -map +/cmp2lut.v -map +/cmp2lcu.v -D LUT_WIDTH=%d", lut));
+				if (booth || help_mode)
+					run("booth", "    (if -booth)");
+				if (!noalumacc)
+					run("alumacc", "  (unless -noalumacc)");
+				if (!noshare)
+					run("share", "    (unless -noshare)");
+				run("opt");
+				run("memory -nomap" + memory_opts);
+				run("opt_clean");
+			}
 		}
 
-		if (check_label("fine")) {
+		if (check_label("fine") && cache_dir.empty()) {
 			run("opt -fast -full");
 			run("memory_map");
 			run("opt -full");
@@ -67,6 +67,10 @@ struct SynthIntelALMPass : public ScriptPass {
 		log("        from label is synonymous to 'begin', and empty to label is\n");
 		log("        synonymous to the end of the command list.\n");
 		log("\n");
+		log("    -threads <N>\n");
+		log("        run the passes that can work in parallel with up to N threads and\n");
+		log("        report the wall clock and CPU time spent in each label.\n");
+		log("\n");
 		log("    -nolutram\n");
 		log("        do not use LUT RAM cells in output netlist\n");
 		log("\n");
@@ -104,6 +108,7 @@ struct SynthIntelALMPass : public ScriptPass {
 		nodsp = false;
 		noiopad = false;
 		noclkbuf = false;
+		script_threads = 0;
 	}
 
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -134,6 +139,12 @@ struct SynthIntelALMPass : public ScriptPass {
 				run_to = args[argidx].substr(pos + 1);
 				continue;
 			}
+			if (args[argidx] == "-threads" && argidx + 1 < args.size()) {
+				script_threads = atoi(args[++argidx].c_str());
+				if (script_threads < 1)
+					log_cmd_error("Invalid number of threads: %s\n", args[argidx].c_str());
+				continue;
+			}
 			if (args[argidx] == "-quartus") {
 				quartus = true;
 				continue;
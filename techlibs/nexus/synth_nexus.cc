@@ -62,6 +62,10 @@ struct SynthNexusPass : public ScriptPass
 		log("        from label is synonymous to 'begin', and empty to label is\n");
 		log("        synonymous to the end of the command list.\n");
 		log("\n");
+		log("    -threads <N>\n");
+		log("        run the passes that can work in parallel with up to N threads and\n");
+		log("        report the wall clock and CPU time spent in each label.\n");
+		log("\n");
 		log("    -noflatten\n");
 		log("        do not flatten design before synthesis\n");
 		log("\n");
@@ -125,6 +129,7 @@ struct SynthNexusPass : public ScriptPass
 		flatten = true;
 		dff = false;
 		retime = false;
+		script_threads = 0;
 	}
 
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -155,6 +160,12 @@ struct SynthNexusPass : public ScriptPass
 				run_to = args[argidx].substr(pos+1);
 				continue;
 			}
+			if (args[argidx] == "-threads" && argidx+1 < args.size()) {
+				script_threads = atoi(args[++argidx].c_str());
+				if (script_threads < 1)
+					log_cmd_error("Invalid number of threads: %s\n", args[argidx].c_str());
+				continue;
+			}
 			if ((args[argidx] == "-family") && argidx+1 < args.size()) {
 				family = args[++argidx];
 				continue;
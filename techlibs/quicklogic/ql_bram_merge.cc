@@ -36,6 +36,7 @@ struct QlBramMergeWorker {
 
 	RTLIL::Module *module;
 	dict<MergeableGroupKeyType, pool<RTLIL::Cell*>> mergeable_groups;
+	int merge_count = 0;
 
 	QlBramMergeWorker(RTLIL::Module* module) : module(module)
 	{
@@ -173,6 +174,7 @@ struct QlBramMergeWorker {
 			while (it.second.size() > 1)
 			{
 				merge_brams(it.second.pop(), it.second.pop());
+				merge_count++;
 			}
 		}
 	}
@@ -203,11 +205,14 @@ struct QlBramMergePass : public Pass {
 		size_t argidx = 1;
 		extra_args(args, argidx, design);
 
-		for (RTLIL::Module* module : design->selected_modules())
-		{
+		// the cells are only paired within a module, so the modules are
+		// processed in parallel (and timed by 'profile -modules')
+		execute_modules(design, design->selected_modules(), [](RTLIL::Module *module) {
 			QlBramMergeWorker worker(module);
 			worker.merge_bram_groups();
-		}
+			if (worker.merge_count)
+				log("Merged %d pairs of split BRAM cells in module %s.\n", worker.merge_count, log_id(module));
+		});
 	}
 
 
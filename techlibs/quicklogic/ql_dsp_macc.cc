@@ -205,8 +205,11 @@ struct QlDspMacc : public Pass {
 		}
 		extra_args(a_Args, argidx, a_Design);
 
-		for (auto module : a_Design->selected_modules())
+		// the inference is local to each module, so the modules are
+		// processed in parallel
+		execute_modules(a_Design, a_Design->selected_modules(), [](RTLIL::Module *module) {
 			ql_dsp_macc_pm(module, module->selected_cells()).run_ql_dsp_macc(create_ql_macc_dsp);
+		});
 	}
 
 } QlDspMacc;
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+# Performance benchmarks: runs representative flows on large generated
+# designs, records the wall time and peak RSS of each flow and the time spent
+# in each pass (from the profile written by "yosys -k"), and compares them
+# against the results of an earlier run. Used by "make bench".
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+parser.add_argument('-y', '--yosys', default='../../yosys', help='yosys binary to benchmark')
+parser.add_argument('-o', '--output', default='bench.json', help='file to write the results to')
+parser.add_argument('-b', '--baseline', help='results of an earlier run to compare against')
+parser.add_argument('-r', '--runs', type=int, default=1, help='runs of each flow, the fastest one is recorded')
+parser.add_argument('-s', '--scale', type=int, default=1, help='size factor of the generated designs')
+parser.add_argument('-t', '--threshold', type=float, default=10.0, help='slowdown in percent reported as regression')
+parser.add_argument('-m', '--min-ms', type=float, default=50.0, help='ignore passes faster than this in both runs')
+parser.add_argument('flows', nargs='*', help='flows to run (default: all)')
+args = parser.parse_args()
+
+workdir = Path('work')
+
+
+def gen_datapath(f, stages, width):
+    # a pipeline of multiply-accumulate stages with some muxing, the kind of
+    # logic that dominates the runtime of synth and abc
+    print('module datapath(input clk, input [%d:0] a, b, input [3:0] sel, output reg [%d:0] y);' % (width-1, width-1), file=f)
+    for i in range(stages + 1):
+        print('  reg [%d:0] s%d, t%d;' % (width-1, i, i), file=f)
+    print('  always @(posedge clk) begin', file=f)
+    print('    s0 <= a; t0 <= b;', file=f)
+    for i in range(1, stages + 1):
+        print('    s%d <= sel[%d] ? s%d * t%d + %d : s%d - (t%d >> %d);' % (i, i % 4, i-1, i-1, i, i-1, i-1, i % width), file=f)
+        print('    t%d <= sel[%d] ? t%d ^ s%d : t%d + s%d;' % (i, (i+1) % 4, i-1, i-1, i-1, i-1), file=f)
+    print('    y <= s%d ^ t%d;' % (stages, stages), file=f)
+    print('  end', file=f)
+    print('endmodule', file=f)
+
+
+def gen_regfile(f, words, width):
+    # a register file with two read ports and a small ALU
+    print('module regfile(input clk, input we, input [%d:0] wa, ra, rb, input [%d:0] wd, input [1:0] op, output reg [%d:0] y);' % ((words-1).bit_length()-1, width-1, width-1), file=f)
+    print('  reg [%d:0] rf [0:%d];' % (width-1, words-1), file=f)
+    print('  wire [%d:0] x = rf[ra], z = rf[rb];' % (width-1), file=f)
+    print('  always @(posedge clk) begin', file=f)
+    print('    if (we) rf[wa] <= wd;', file=f)
+    print('    case (op)', file=f)
+    print('      0: y <= x + z;', file=f)
+    print('      1: y <= x - z;', file=f)
+    print('      2: y <= x & z;', file=f)
+    print('      default: y <= x << z[4:0];', file=f)
+    print('    endcase', file=f)
+    print('  end', file=f)
+    print('endmodule', file=f)
+
+
+def gen_top(f, copies, width):
+    # many instances of both modules, for hierarchy and flatten
+    print('module top(input clk, input we, input [%d:0] a, b, input [3:0] sel, output [%d:0] y);' % (width-1, width-1), file=f)
+    print('  wire [%d:0] d [0:%d];' % (width-1, copies), file=f)
+    print('  assign d[0] = a;', file=f)
+    for i in range(copies):
+        print('  wire [%d:0] p%d, q%d;' % (width-1, i, i), file=f)
+        print('  datapath dp%d(clk, d[%d], b, sel, p%d);' % (i, i, i), file=f)
+        print('  regfile rf%d(clk, we, p%d[4:0], q%d[9:5], b[4:0], p%d, sel[1:0], q%d);' % (i, i, i, i, i), file=f)
+        print('  assign d[%d] = p%d ^ q%d;' % (i+1, i, i), file=f)
+    print('  assign y = d[%d];' % copies, file=f)
+    print('endmodule', file=f)
+
+
+def generate():
+    workdir.mkdir(exist_ok=True)
+    with open(workdir / 'design.v', 'w') as f:
+        gen_datapath(f, 8, 16)
+        gen_regfile(f, 32, 16)
+        gen_top(f, 8 * args.scale, 16)
+
+
+# name: script; the design is read from design.v in the work directory
+flows = {
+    'read_verilog': 'read_verilog design.v; hierarchy -top top',
+    'synth_xilinx': 'read_verilog design.v; synth_xilinx -top top -noiopad',
+    'synth_quicklogic': 'read_verilog design.v; synth_quicklogic -top top',
+    'abc9': 'read_verilog design.v; synth -top top -flatten; abc9 -lut 6',
+    'sim': 'read_verilog design.v; hierarchy -top top; proc; flatten; opt_clean; sim -clock clk -n 2000',
+    'write_verilog': 'read_verilog design.v; synth -top top -flatten; write_verilog -noattr out.v',
+}
+
+
+def run_flow(name, script):
+    profile = '%s.trace.json' % name
+    cmd = [os.path.abspath(args.yosys), '-Q', '-q', '-k', profile, '-p', script]
+    begin = time.monotonic()
+    proc = subprocess.Popen(cmd, cwd=workdir, stdout=subprocess.DEVNULL)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall = time.monotonic() - begin
+    if status != 0:
+        sys.exit('Flow %s failed: %s' % (name, ' '.join(cmd)))
+    peak_rss_kb = rusage.ru_maxrss if sys.platform != 'darwin' else rusage.ru_maxrss // 1024
+
+    # times per pass name, including the passes each pass calls
+    passes = {}
+    with open(workdir / profile) as f:
+        for event in json.load(f)['traceEvents']:
+            entry = passes.setdefault(event['name'], {'wall_ms': 0.0, 'calls': 0})
+            entry['wall_ms'] += event['dur'] / 1000.0
+            entry['calls'] += 1
+    return {'wall_s': wall, 'peak_rss_kb': peak_rss_kb, 'passes': passes}
+
+
+def compare(results, baseline):
+    regressions = []
+
+    def check(what, new, old, unit, min_value):
+        if old <= 0 or max(new, old) < min_value:
+            return
+        change = 100.0 * (new - old) / old
+        line = '  %-40s %10.1f %10.1f %s %+7.1f%%' % (what, old, new, unit, change)
+        if change > args.threshold:
+            regressions.append(line)
+        print(line)
+
+    print('\n  %-40s %10s %10s' % ('', 'baseline', 'current'))
+    for name, res in results['flows'].items():
+        old = baseline['flows'].get(name)
+        if old is None:
+            continue
+        check(name, res['wall_s'] * 1000.0, old['wall_s'] * 1000.0, 'ms ', 0.0)
+        check(name + ' peak RSS', res['peak_rss_kb'] / 1024.0, old['peak_rss_kb'] / 1024.0, 'MiB', 0.0)
+        for pass_name, p in sorted(res['passes'].items()):
+            old_pass = old['passes'].get(pass_name)
+            if old_pass is not None:
+                check('%s: %s' % (name, pass_name), p['wall_ms'], old_pass['wall_ms'], 'ms ', args.min_ms)
+
+    if regressions:
+        print('\nRegressions of more than %.0f%%:' % args.threshold)
+        for line in regressions:
+            print(line)
+    return not regressions
+
+
+generate()
+
+results = {'scale': args.scale, 'flows': {}}
+for name in args.flows or flows:
+    if name not in flows:
+        sys.exit('Unknown flow %s, known flows: %s' % (name, ' '.join(flows)))
+    best = None
+    for _ in range(args.runs):
+        res = run_flow(name, flows[name])
+        if best is None or res['wall_s'] < best['wall_s']:
+            best = res
+    results['flows'][name] = best
+    print('%-20s %8.2f s %10.1f MiB' % (name, best['wall_s'], best['peak_rss_kb'] / 1024.0))
+
+with open(args.output, 'w') as f:
+    json.dump(results, f, indent=2, sort_keys=True)
+    f.write('\n')
+
+if args.baseline:
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline.get('scale') != args.scale:
+        sys.exit('The baseline was recorded with -s %s.' % baseline.get('scale'))
+    if not compare(results, baseline):
+        sys.exit(1)
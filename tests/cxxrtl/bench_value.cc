@@ -0,0 +1,57 @@
+// Microbenchmark for arithmetic on wide values. Not run as a part of the test suite; build and run it with e.g.:
+//
+//   g++ -std=c++11 -O2 -march=native -I../../backends/cxxrtl/runtime bench_value.cc -o bench_value && ./bench_value
+//
+// and compare against a build with `-DCXXRTL_NO_SIMD` added.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "cxxrtl/cxxrtl.h"
+
+template<size_t Bits, typename Operation>
+void bench(const char *name, Operation op)
+{
+	constexpr size_t iterations = 1000000;
+
+	cxxrtl::value<Bits> a, b;
+	for (size_t n = 0; n < a.chunks; n++) {
+		a.data[n] = 0x9e3779b9u * (n + 1);
+		b.data[n] = 0x7f4a7c15u * (n + 1);
+	}
+	a.data[a.chunks - 1] &= a.msb_mask;
+	b.data[b.chunks - 1] &= b.msb_mask;
+
+	auto start = std::chrono::steady_clock::now();
+	size_t sink = 0;
+	for (size_t i = 0; i < iterations; i++) {
+		a = op(a, b);
+		sink += a.data[0];
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	std::printf("%-6s %5zu bits: %7.2f ns/op (%zx)\n", name, Bits, ns, sink & 0xf);
+}
+
+template<size_t Bits>
+void bench_width()
+{
+	using value = cxxrtl::value<Bits>;
+	bench<Bits>("and", [](const value &a, const value &b) { return a.bit_and(b).bit_xor(b); });
+	bench<Bits>("or", [](const value &a, const value &b) { return a.bit_or(b).bit_not(); });
+	bench<Bits>("xor", [](const value &a, const value &b) { return a.bit_xor(b); });
+	bench<Bits>("eq", [](const value &a, const value &b) { return a == b ? a : a.bit_xor(b); });
+	bench<Bits>("add", [](const value &a, const value &b) { return a.add(b); });
+	bench<Bits>("sub", [](const value &a, const value &b) { return a.sub(b); });
+	bench<Bits>("ult", [](const value &a, const value &b) { return a.ucmp(b) ? b : a.add(b); });
+	bench<Bits>("shl", [](const value &a, const value &b) { return a.shl(cxxrtl::value<8>{3u}).bit_xor(b); });
+	bench<Bits>("mul", [](const value &a, const value &b) { return a.template mul<Bits>(b); });
+}
+
+int main()
+{
+	bench_width<128>();
+	bench_width<512>();
+	bench_width<2048>();
+}
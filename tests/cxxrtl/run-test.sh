@@ -5,9 +5,29 @@ set -ex
 run_subtest () {
     local subtest=$1; shift
 
-    ${CC:-gcc} -std=c++11 -O2 -o cxxrtl-test-${subtest} -I../../backends/cxxrtl/runtime test_${subtest}.cc -lstdc++
+    ${CC:-gcc} -std=c++11 -O2 -o cxxrtl-test-${subtest} -I../../backends/cxxrtl/runtime test_${subtest}.cc -lstdc++ "$@"
     ./cxxrtl-test-${subtest}
 }
 
 run_subtest value
 run_subtest value_fuzz
+run_subtest replay
+run_subtest vcd
+run_subtest capi
+run_subtest parallel_eval
+CXXRTL_THREADS=4 run_subtest parallel_eval -DCXXRTL_THREADS -pthread
+
+# -activity must not change the simulation of a hierarchical design
+activity_script="read_verilog test_activity.v; hierarchy -top top; design -save orig"
+activity_script+="; write_cxxrtl -noflatten -namespace plain cxxrtl-test-activity-plain.cc"
+activity_script+="; design -load orig; write_cxxrtl -noflatten -activity -namespace active cxxrtl-test-activity-active.cc"
+../../yosys -p "$activity_script"
+run_subtest activity -I.
+
+# -split writes one translation unit per module, all of them have to compile and link together
+rm -f cxxrtl-test-split.h cxxrtl-test-split.cc cxxrtl-test-split.*.cc
+../../yosys -p "read_verilog test_split.v; hierarchy -top top; write_cxxrtl -noflatten -split cxxrtl-test-split.cc"
+test $(ls cxxrtl-test-split.*.cc | wc -l) -eq 3
+${CC:-gcc} -std=c++11 -O2 -o cxxrtl-test-split -I. -I../../backends/cxxrtl/runtime \
+    test_split.cc cxxrtl-test-split.cc cxxrtl-test-split.*.cc -lstdc++
+./cxxrtl-test-split
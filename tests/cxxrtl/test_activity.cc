@@ -0,0 +1,60 @@
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "cxxrtl/cxxrtl_vcd.h"
+
+// the same design, generated without and with -activity
+#include "cxxrtl-test-activity-plain.cc"
+#include "cxxrtl-test-activity-active.cc"
+
+// Runs the same stimulus on either design. The inputs stay unchanged for several cycles at a time, and
+// the submodules are enabled only in some of them, so that -activity skips idle instances.
+template<class TopT>
+void simulate(TopT &top, std::string &outputs, std::string &trace)
+{
+	cxxrtl::debug_items items;
+	top.debug_info(items, "top ");
+	cxxrtl::vcd_writer vcd;
+	vcd.add(items);
+
+	std::ostringstream out;
+	uint32_t rng = 1;
+	for (uint64_t cycle = 0; cycle < 500; cycle++) {
+		if (cycle % 8 == 0)
+			rng = rng * 1103515245 + 12345;
+		top.p_rst.template set<bool>(cycle < 2);
+		top.p_d.template set<uint8_t>(rng >> 16);
+		top.p_en.template set<uint8_t>((cycle / 16) % 4);
+
+		top.p_clk.template set<bool>(false);
+		top.step();
+		vcd.sample(cycle * 2);
+		top.p_clk.template set<bool>(true);
+		top.step();
+		vcd.sample(cycle * 2 + 1);
+
+		out << top.p_q0.template get<uint16_t>() << " " << top.p_q1.template get<uint16_t>() << " "
+		    << top.p_y0.template get<uint16_t>() << " " << top.p_y1.template get<uint16_t>() << "\n";
+	}
+	outputs = out.str();
+	trace = vcd.buffer;
+}
+
+int main()
+{
+	plain::p_top plain_top;
+	active::p_top active_top;
+
+	std::string plain_outputs, plain_trace;
+	simulate(plain_top, plain_outputs, plain_trace);
+	std::string active_outputs, active_trace;
+	simulate(active_top, active_outputs, active_trace);
+
+	assert(!plain_trace.empty());
+	assert(plain_outputs == active_outputs);
+	assert(plain_trace == active_trace);
+
+	return 0;
+}
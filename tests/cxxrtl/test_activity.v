@@ -0,0 +1,25 @@
+module acc(input clk, input rst, input en, input [7:0] d, output reg [15:0] q);
+	always @(posedge clk)
+		if (rst)
+			q <= 0;
+		else if (en)
+			q <= q + d;
+endmodule
+
+module mix(input [15:0] a, input [15:0] b, output [15:0] y);
+	assign y = (a ^ {b[7:0], b[15:8]}) + 16'd3;
+endmodule
+
+// clk is a buffered input of stage and acc, the other inputs are unbuffered
+module stage(input clk, input rst, input en, input [7:0] d, input [15:0] other, output [15:0] q, output [15:0] y);
+	reg [7:0] d_q;
+	always @(posedge clk)
+		d_q <= d;
+	acc u_acc(.clk(clk), .rst(rst), .en(en), .d(d_q), .q(q));
+	mix u_mix(.a(q), .b(other), .y(y));
+endmodule
+
+module top(input clk, input rst, input [1:0] en, input [7:0] d, output [15:0] q0, q1, y0, y1);
+	stage s0(.clk(clk), .rst(rst), .en(en[0]), .d(d), .other(q1), .q(q0), .y(y0));
+	stage s1(.clk(clk), .rst(rst), .en(en[1]), .d(d ^ 8'h5a), .other(q0), .q(q1), .y(y1));
+endmodule
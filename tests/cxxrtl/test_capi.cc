@@ -0,0 +1,82 @@
+#include <cassert>
+#include <cstdint>
+
+#include "cxxrtl/cxxrtl.h"
+#include "cxxrtl/capi/cxxrtl_capi.cc"
+
+// A counter with an input and a memory, so that the objects have different sizes.
+struct counter : cxxrtl::module {
+	cxxrtl::value<1> p_en;
+	cxxrtl::wire<8> p_count;
+	cxxrtl::wire<40> p_wide;
+	cxxrtl::memory<8> m_mem { 3 };
+
+	void reset() override {
+		p_en = {};
+		p_count = {};
+		p_wide = {};
+	}
+
+	bool eval(cxxrtl::performer *performer = nullptr) override {
+		if (p_en)
+			p_count.next = p_count.curr.add(cxxrtl::value<8>{1u});
+		return true;
+	}
+
+	bool commit() override {
+		cxxrtl::observer observer;
+		bool changed = false;
+		if (p_count.commit(observer)) changed = true;
+		if (p_wide.commit(observer)) changed = true;
+		return changed;
+	}
+
+	void debug_info(cxxrtl::debug_items &items, std::string path = "") override {
+		items.add(path + "en", cxxrtl::debug_item(p_en, 0, cxxrtl::debug_item::INPUT | cxxrtl::debug_item::UNDRIVEN));
+		items.add(path + "count", cxxrtl::debug_item(p_count, 0, cxxrtl::debug_item::DRIVEN_SYNC));
+		items.add(path + "wide", cxxrtl::debug_item(p_wide, 0, cxxrtl::debug_item::DRIVEN_SYNC));
+		items.add(path + "mem", cxxrtl::debug_item(m_mem, 0));
+	}
+};
+
+int main()
+{
+	cxxrtl_toplevel toplevel = new _cxxrtl_toplevel { std::unique_ptr<cxxrtl::module>(new counter) };
+	cxxrtl_handle handle = cxxrtl_create(toplevel);
+
+	cxxrtl_object *objects[] = {
+		cxxrtl_get(handle, "en"),
+		cxxrtl_get(handle, "count"),
+		cxxrtl_get(handle, "wide"),
+		cxxrtl_get(handle, "mem"),
+	};
+	const size_t count = sizeof(objects) / sizeof(objects[0]);
+
+	// en, count, and wide (2 chunks) are written, mem is read-only
+	uint32_t input[] = { 1, 10, 0x12345678, 0xab };
+	assert(cxxrtl_write(handle, objects, 3, input) == 4);
+	cxxrtl_commit(handle);
+	cxxrtl_subscription subscription = cxxrtl_subscribe(handle, objects, count);
+	cxxrtl_step(handle);
+
+	uint32_t output[7];
+	assert(cxxrtl_read(handle, objects, count, output) == 7);
+	assert(output[0] == 1);
+	assert(output[1] == 11);
+	assert(output[2] == 0x12345678 && output[3] == 0xab);
+	assert(output[4] == 0 && output[5] == 0 && output[6] == 0);
+
+	size_t changed[count];
+	assert(cxxrtl_poll(subscription, changed) == 1);
+	assert(changed[0] == 1);
+	assert(cxxrtl_poll(subscription, changed) == 0);
+
+	uint32_t disable[] = { 0 };
+	cxxrtl_write(handle, objects, 1, disable);
+	cxxrtl_step(handle);
+	assert(cxxrtl_poll(subscription, changed) == 1);
+	assert(changed[0] == 0);
+
+	cxxrtl_unsubscribe(subscription);
+	cxxrtl_destroy(handle);
+}
@@ -0,0 +1,31 @@
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "cxxrtl/cxxrtl.h"
+
+int main()
+{
+    {
+        // every index should be evaluated exactly once, on every call
+        std::vector<int> counts(17);
+        for (int round = 0; round < 1000; round++)
+            cxxrtl::parallel_eval(counts.size(), [&](size_t index) {
+                counts[index]++;
+            });
+        for (int count : counts)
+            assert(count == 1000);
+    }
+
+    {
+        // nested calls should complete
+        std::vector<int> counts(4 * 4);
+        cxxrtl::parallel_eval(4, [&](size_t outer) {
+            cxxrtl::parallel_eval(4, [&](size_t inner) {
+                counts[outer * 4 + inner]++;
+            });
+        });
+        for (int count : counts)
+            assert(count == 1);
+    }
+}
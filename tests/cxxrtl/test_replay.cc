@@ -0,0 +1,78 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+#include "cxxrtl/cxxrtl.h"
+#include "cxxrtl/cxxrtl_replay.h"
+
+// A wide counter that only increments while enabled, so that most of its chunks don't change between samples.
+struct counter : cxxrtl::module {
+	cxxrtl::value<1> p_en;
+	cxxrtl::wire<160> p_count;
+
+	void reset() override {
+		p_en = {};
+		p_count = {};
+	}
+
+	bool eval(cxxrtl::performer *performer = nullptr) override {
+		if (p_en)
+			p_count.next = p_count.curr.add(cxxrtl::value<160>{1u});
+		return true;
+	}
+
+	template<class ObserverT>
+	bool commit(ObserverT &observer) {
+		return p_count.commit(observer);
+	}
+
+	bool commit() override {
+		cxxrtl::observer observer;
+		return commit<>(observer);
+	}
+
+	void debug_info(cxxrtl::debug_items &items, std::string path = "") override {
+		items.add(path + "en", cxxrtl::debug_item(p_en, 0, cxxrtl::debug_item::INPUT | cxxrtl::debug_item::UNDRIVEN));
+		items.add(path + "count", cxxrtl::debug_item(p_count, 0, cxxrtl::debug_item::DRIVEN_SYNC));
+	}
+};
+
+int main()
+{
+	const char *filename = "cxxrtl-test-replay.spool";
+	const size_t samples = 1000;
+
+	{
+		counter top;
+		cxxrtl::spool spool(filename);
+		cxxrtl::recorder recorder(spool);
+		recorder.set_checkpoint_interval(100);
+		recorder.start(top);
+		recorder.record_complete();
+		for (size_t n = 1; n <= samples; n++) {
+			top.p_en.set<bool>(n % 3 != 0);
+			top.eval();
+			recorder.advance_time(cxxrtl::time(0, 1));
+			recorder.record_incremental(top);
+		}
+		recorder.finish();
+	}
+
+	{
+		counter top;
+		cxxrtl::spool spool(filename);
+		cxxrtl::player player(spool);
+		player.start(top);
+
+		// rewinding forwards to a sample that has not been read yet, and then backwards, should be exact
+		for (size_t n : {samples, (size_t)517, (size_t)0, (size_t)1, (size_t)999, (size_t)250}) {
+			assert(player.rewind_to_or_before(cxxrtl::time(0, n)));
+			assert(player.current_time() == cxxrtl::time(0, n));
+			uint64_t count = top.p_count.curr.slice<63, 0>().val().get<uint64_t>();
+			assert(count == n - n / 3);
+			assert(top.p_en.get<bool>() == (n != 0 && n % 3 != 0));
+		}
+	}
+
+	std::remove(filename);
+}
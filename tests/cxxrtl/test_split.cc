@@ -0,0 +1,28 @@
+#include <cassert>
+#include <cstdint>
+
+#include "cxxrtl-test-split.h"
+
+int main()
+{
+    cxxrtl_design::p_top top;
+
+    auto tick = [&]() {
+        top.p_clk.set(false);
+        top.step();
+        top.p_clk.set(true);
+        top.step();
+    };
+
+    top.p_rst.set(true);
+    tick();
+    assert(top.p_sum.get<uint8_t>() == 0);
+
+    top.p_rst.set(false);
+    for (int cycle = 1; cycle <= 10; cycle++) {
+        tick();
+        assert(top.p_sum.get<uint8_t>() == 3 * cycle);
+    }
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+module counter(input clk, input rst, input [7:0] step, output reg [7:0] count);
+	always @(posedge clk)
+		if (rst)
+			count <= 0;
+		else
+			count <= count + step;
+endmodule
+
+module adder(input [7:0] a, input [7:0] b, output [7:0] y);
+	assign y = a + b;
+endmodule
+
+module top(input clk, input rst, output [7:0] sum);
+	wire [7:0] c1, c2;
+	counter u1(.clk(clk), .rst(rst), .step(8'd1), .count(c1));
+	counter u2(.clk(clk), .rst(rst), .step(8'd2), .count(c2));
+	adder u3(.a(c1), .b(c2), .y(sum));
+endmodule
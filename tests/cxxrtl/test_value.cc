@@ -49,4 +49,42 @@ int main()
         cxxrtl::value<1> sel(0u);
         assert(val.template bmux<4>(sel).get<uint64_t>() == 0xfu);
     }
+
+    {
+        // bitwise operations on wide values should match the per-chunk results, including the tail
+        cxxrtl::value<300> a, b;
+        for (size_t n = 0; n < a.chunks; n++) {
+            a.data[n] = 0x9e3779b9u * (n + 1);
+            b.data[n] = 0x7f4a7c15u * (n + 3);
+        }
+        a.data[a.chunks - 1] &= a.msb_mask;
+        b.data[b.chunks - 1] &= b.msb_mask;
+        cxxrtl::value<300> c_and = a.bit_and(b), c_or = a.bit_or(b), c_xor = a.bit_xor(b), c_not = a.bit_not();
+        for (size_t n = 0; n < a.chunks; n++) {
+            assert(c_and.data[n] == (a.data[n] & b.data[n]));
+            assert(c_or.data[n] == (a.data[n] | b.data[n]));
+            assert(c_xor.data[n] == (a.data[n] ^ b.data[n]));
+            assert(c_not.data[n] == (~a.data[n] & (n == a.chunks - 1 ? a.msb_mask : 0xffffffffu)));
+        }
+        assert(a == a && a != b);
+        assert(a.bit_xor(a).is_zero() && !a.is_zero());
+        cxxrtl::value<300> d = a;
+        d.data[a.chunks - 1] ^= 1;
+        assert(a != d);
+    }
+
+    {
+        // add/sub of wide values should propagate the carry across all chunks
+        cxxrtl::value<300> a, one(1u);
+        for (size_t n = 0; n < 5; n++)
+            a.data[n] = 0xffffffffu;
+        cxxrtl::value<300> b = a.add(one);
+        for (size_t n = 0; n < b.chunks; n++)
+            assert(b.data[n] == (n == 5 ? 1u : 0u));
+        assert(b.sub(one) == a);
+        assert(b.ucmp(a) == false && a.ucmp(b) == true);
+        cxxrtl::value<300> c = cxxrtl::value<300>().bit_not();
+        assert(c.add(one).is_zero());
+        assert(cxxrtl::value<300>().sub(one) == c);
+    }
 }
@@ -0,0 +1,76 @@
+#include <cassert>
+#include <cstdint>
+
+#include "cxxrtl/cxxrtl.h"
+#include "cxxrtl/cxxrtl_vcd.h"
+
+// A counter with a wide register that rarely changes, and a memory that is written at the counter address.
+struct counter : cxxrtl::module {
+	cxxrtl::value<1> p_en;
+	cxxrtl::wire<8> p_count;
+	cxxrtl::wire<100> p_wide;
+	cxxrtl::memory<8> m_mem { 4 };
+
+	void reset() override {
+		p_en = {};
+		p_count = {};
+		p_wide = {};
+	}
+
+	bool eval(cxxrtl::performer *performer = nullptr) override {
+		if (p_en) {
+			p_count.next = p_count.curr.add(cxxrtl::value<8>{1u});
+			if (p_count.curr.slice<3, 0>().val().get<uint8_t>() == 0)
+				p_wide.next = p_wide.curr.add(cxxrtl::value<100>{1u});
+			m_mem.update(p_count.curr.slice<1, 0>().val().get<size_t>(), p_count.curr, cxxrtl::value<8>{0xffu});
+		}
+		return true;
+	}
+
+	template<class ObserverT>
+	bool commit(ObserverT &observer) {
+		bool changed = false;
+		if (p_count.commit(observer)) changed = true;
+		if (p_wide.commit(observer)) changed = true;
+		if (m_mem.commit(observer)) changed = true;
+		return changed;
+	}
+
+	bool commit() override {
+		cxxrtl::observer observer;
+		return commit<>(observer);
+	}
+
+	void debug_info(cxxrtl::debug_items &items, std::string path = "") override {
+		items.add(path + "en", cxxrtl::debug_item(p_en, 0, cxxrtl::debug_item::INPUT | cxxrtl::debug_item::UNDRIVEN));
+		items.add(path + "count", cxxrtl::debug_item(p_count, 0, cxxrtl::debug_item::DRIVEN_SYNC));
+		items.add(path + "wide", cxxrtl::debug_item(p_wide, 0, cxxrtl::debug_item::DRIVEN_SYNC));
+		items.add(path + "mem", cxxrtl::debug_item(m_mem, 0));
+	}
+};
+
+int main()
+{
+	counter top;
+	cxxrtl::debug_items items;
+	top.debug_info(items, "top ");
+
+	// the writer that tracks changes must produce the same output as the one that compares all variables
+	cxxrtl::vcd_writer full, tracked;
+	full.add(items);
+	tracked.add(items);
+	auto observer = tracked.observer();
+
+	full.sample(0);
+	tracked.sample(0);
+	for (uint64_t n = 1; n <= 200; n++) {
+		top.p_en.set<bool>(n % 5 != 0);
+		top.eval();
+		top.commit(observer);
+		full.sample(n);
+		tracked.sample(n);
+	}
+
+	assert(!full.buffer.empty());
+	assert(full.buffer == tracked.buffer);
+}
@@ -1536,6 +1536,39 @@ endmodule
 TESTS.append(Test("rom_case", ROM_CASE.format(attr=""), ["block_sdp"], [], {"RAM_BLOCK_SDP" : 0}))
 TESTS.append(Test("rom_case_block", ROM_CASE.format(attr="(* rom_style = \"block\" *) "), ["block_sdp"], [], {"RAM_BLOCK_SDP" : 1}))
 
+# several memories of the same shape in one module, the mapping of the
+# first one is reused for the others
+MANY_SYNC = """
+module top(clk, ra, wa, rd0, rd1, rd2, rd3, wd, we);
+
+input wire clk;
+input wire [3:0] we;
+input wire [10:0] ra, wa;
+input wire [9:0] wd;
+output reg [9:0] rd0, rd1, rd2;
+output reg [5:0] rd3;
+
+reg [9:0] mem0 [0:2047];
+reg [9:0] mem1 [0:2047];
+reg [9:0] mem2 [0:2047];
+reg [5:0] mem3 [0:63];
+
+always @(posedge clk) begin
+    if (we[0]) mem0[wa] <= wd;
+    if (we[1]) mem1[wa] <= ~wd;
+    if (we[2]) mem2[ra] <= wd;
+    if (we[3]) mem3[wa[5:0]] <= wd[5:0];
+    rd0 <= mem0[ra];
+    rd1 <= mem1[ra];
+    rd2 <= mem2[wa];
+    rd3 <= mem3[ra[5:0]];
+end
+
+endmodule
+"""
+
+TESTS.append(Test("many_sync", MANY_SYNC, ["lut", "block_tdp"], [], {"RAM_BLOCK_TDP": 60, "RAM_LUT": 8}))
+
 with open("run-test.mk", "w") as mf:
     mf.write("ifneq ($(strip $(SEED)),)\n")
     mf.write("SEEDOPT=-S$(SEED)\n")
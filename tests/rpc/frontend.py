@@ -51,22 +51,34 @@ def map_parameter(parameter):
 	if parameter["type"] == "real":
 		return float(parameter["value"])
 
-def call(input_json):
+def call(input_json, binary=False):
 	input = json.loads(input_json)
 	if input["method"] == "modules":
-		return json.dumps({"modules": modules()})
+		return [json.dumps({"modules": modules()})]
 	if input["method"] == "derive":
 		try:
 			frontend, source = derive(input["module"],
 				{name: map_parameter(value) for name, value in input["parameters"].items()})
-			return json.dumps({"frontend": frontend, "source": source})
+			if binary:
+				return [json.dumps({"frontend": frontend}), source]
+			return [json.dumps({"frontend": frontend, "source": source})]
 		except ValueError as e:
-			return json.dumps({"error": str(e)})
+			return [json.dumps({"error": str(e)})]
+
+def read_frame(file):
+	header = file.read(8)
+	if len(header) < 8: return None
+	return file.read(int.from_bytes(header, "little")).decode("utf-8")
+
+def write_frame(file, data):
+	data = data.encode("utf-8")
+	file.write(len(data).to_bytes(8, "little") + data)
 
 def main():
 	parser = argparse.ArgumentParser()
 	modes = parser.add_subparsers(dest="mode")
 	mode_stdio = modes.add_parser("stdio")
+	mode_stdio_binary = modes.add_parser("stdio-binary")
 	if os.name == "posix":
 		mode_path = modes.add_parser("unix-socket")
 	if os.name == "nt":
@@ -78,9 +90,17 @@ def main():
 		while True:
 			input = sys.stdin.readline()
 			if not input: break
-			sys.stdout.write(call(input) + "\n")
+			sys.stdout.write(call(input)[0] + "\n")
 			sys.stdout.flush()
 
+	if args.mode == "stdio-binary":
+		while True:
+			input = read_frame(sys.stdin.buffer)
+			if input is None: break
+			for output in call(input, binary=True):
+				write_frame(sys.stdout.buffer, output)
+			sys.stdout.buffer.flush()
+
 	if args.mode == "unix-socket":
 		sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
 		sock.settimeout(30)
@@ -93,7 +113,7 @@ def main():
 			while True:
 				input = file.readline()
 				if not input: break
-				file.write(call(input) + "\n")
+				file.write(call(input)[0] + "\n")
 				file.flush()
 			ys_proc.wait(timeout=10)
 			if ys_proc.returncode:
@@ -116,7 +136,7 @@ def main():
 					assert result == 0
 					input += data
 					assert not b"\n" in input or input.endswith(b"\n")
-				output = (call(input.decode("utf-8")) + "\n").encode("utf-8")
+				output = (call(input.decode("utf-8"))[0] + "\n").encode("utf-8")
 				length = len(output)
 				while length > 0:
 					result, done = win32file.WriteFile(pipe, output)
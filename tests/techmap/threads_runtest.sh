@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+
+trap 'echo "ERROR in threads_runtest.sh" >&2; exit 1' ERR
+
+cat > techmap_threads.v << "EOT"
+module top(input clk, input [15:0] a, b, input [3:0] s, output reg [15:0] q, output [31:0] p);
+	wire [15:0] x = (a + b) ^ (a >> s);
+	always @(posedge clk)
+		q <= s[0] ? x : a - b;
+	assign p = a * b;
+endmodule
+EOT
+
+cat > techmap_threads_map.v << "EOT"
+module \$_DFF_P_ (input D, C, output Q);
+	\$_DFF_N_ _TECHMAP_REPLACE_ (.D(D), .C(!C), .Q(Q));
+endmodule
+EOT
+
+# the mapped netlist must not depend on the thread count
+for j in 1 4; do
+	../../yosys -q -j $j -p "read_verilog techmap_threads.v; proc; techmap; techmap -map techmap_threads_map.v; \
+		select -assert-count 0 t:\$_DFF_P_; write_rtlil techmap_threads_j$j.il"
+done
+cmp techmap_threads_j1.il techmap_threads_j4.il
+
+rm -f techmap_threads.v techmap_threads_map.v techmap_threads_j1.il techmap_threads_j4.il
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+
+#include "kernel/yosys.h"
+#include "frontends/verilog/preproc.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct FrontendsVerilogPreprocTest : public ::testing::Test
+{
+	static void SetUpTestCase()
+	{
+		yosys_setup();
+	}
+
+	static void TearDownTestCase()
+	{
+		yosys_shutdown();
+	}
+
+	static std::string preproc(const std::string &text, const define_map_t &pre_defines = define_map_t())
+	{
+		std::istringstream f(text);
+		define_map_t global_defines;
+		return frontend_verilog_preproc(f, "t.v", pre_defines, global_defines, {});
+	}
+
+	static void write_file(const std::string &filename, const std::string &text)
+	{
+		std::ofstream f(filename);
+		f << text;
+	}
+};
+
+TEST_F(FrontendsVerilogPreprocTest, plainFileRewritesComments)
+{
+	EXPECT_EQ(preproc("wire a; // c\r\n"), "`file_push \"t.v\"\nwire a; /* c */\n\n`file_pop\n");
+}
+
+// Files without backticks take a fast path, compare it against the regular
+// path, which is used as soon as there is a directive in the file.
+TEST_F(FrontendsVerilogPreprocTest, plainFileMatchesRegularPath)
+{
+	const std::string suffix = "\n`file_pop\n";
+	std::vector<std::string> texts = {
+		"module m; // comment */ with *// stars\r\nwire a; /* multi\nline */ wire b;\nendmodule\n",
+		"x = \"str // not a comment\"; y = \"\"\"triple // \"\"\"; z = \"\";\n",
+		"\\esc//aped id; a/b; c/*d*/e; f/ /g; \"\\\"\" // x\n",
+		"/**/ /*/ */ /* * / */ // /* \n\n",
+		"\n",
+	};
+
+	for (auto &text : texts) {
+		std::string plain = preproc(text);
+		std::string regular = preproc(text + "`resetall\n");
+		ASSERT_GE(plain.size(), suffix.size());
+		EXPECT_EQ(regular, plain.substr(0, plain.size() - suffix.size()) + "\n" + suffix) << text;
+	}
+}
+
+// Include files are cached, the cached result must only be used while the
+// defines the file looks up and the file itself are unchanged.
+TEST_F(FrontendsVerilogPreprocTest, includeCacheChecksDefinesAndFile)
+{
+	std::string header = make_temp_file(get_base_tmpdir() + "/verilogPreprocTest_XXXXXX.vh");
+	write_file(header, "`ifdef WIDE\nwire [7:0] w;\n`else\nwire w;\n`endif\n`define SEEN\n");
+	std::string text = "`include \"" + header + "\"\n`ifdef SEEN\nwire seen;\n`endif\n";
+
+	define_map_t wide;
+	wide.add("WIDE", "");
+	for (int i = 0; i < 2; i++) {
+		std::string narrow_code = preproc(text);
+		std::string wide_code = preproc(text, wide);
+		EXPECT_NE(narrow_code.find("wire w;"), std::string::npos) << narrow_code;
+		EXPECT_NE(wide_code.find("wire [7:0] w;"), std::string::npos) << wide_code;
+		EXPECT_NE(narrow_code.find("wire seen;"), std::string::npos) << narrow_code;
+		EXPECT_NE(wide_code.find("wire seen;"), std::string::npos) << wide_code;
+	}
+
+	write_file(header, "wire [15:0] w;\n");
+	std::string code = preproc(text, wide);
+	EXPECT_NE(code.find("wire [15:0] w;"), std::string::npos) << code;
+	EXPECT_EQ(code.find("wire seen;"), std::string::npos) << code;
+
+	remove(header.c_str());
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Values that take the word-sized fast paths of kernel/calc.cc next to ones
+// that don't, to check that both give the same results at the boundaries.
+
+static RTLIL::Const bits(const std::string &str)
+{
+	return RTLIL::Const::from_string(str);
+}
+
+TEST(KernelCalcTest, addWrapsAtResultWidth)
+{
+	EXPECT_EQ(RTLIL::const_add(RTLIL::Const(255, 8), RTLIL::Const(1, 8), false, false, 8), RTLIL::Const(0, 8));
+	EXPECT_EQ(RTLIL::const_add(RTLIL::Const(255, 8), RTLIL::Const(1, 8), false, false, 9), RTLIL::Const(256, 9));
+	// -1 + -1 for signed operands of different widths
+	EXPECT_EQ(RTLIL::const_add(bits("1"), bits("111"), true, true, 4), bits("1110"));
+	// a 65-bit result does not fit into a word
+	RTLIL::Const ones(RTLIL::State::S1, 64);
+	EXPECT_EQ(RTLIL::const_add(ones, RTLIL::Const(1, 1), false, false, 65), bits("1" + std::string(64, '0')));
+	EXPECT_EQ(RTLIL::const_add(ones, RTLIL::Const(1, 1), false, false, 64), RTLIL::Const(RTLIL::State::S0, 64));
+}
+
+TEST(KernelCalcTest, mulUsesLowBitsOfWideOperands)
+{
+	RTLIL::Const wide = bits("1" + std::string(70, '0') + "11");
+	EXPECT_EQ(RTLIL::const_mul(wide, RTLIL::Const(5, 4), false, false, 8), RTLIL::Const(15, 8));
+	EXPECT_EQ(RTLIL::const_mul(bits("1111"), bits("11"), true, true, 8), RTLIL::Const(1, 8));
+}
+
+TEST(KernelCalcTest, undefBitsGiveUndefResults)
+{
+	EXPECT_EQ(RTLIL::const_add(bits("1x"), RTLIL::Const(1, 2), false, false, 3), RTLIL::Const(RTLIL::State::Sx, 3));
+	EXPECT_EQ(RTLIL::const_lt(bits("x0"), RTLIL::Const(1, 2), false, false, 2), bits("0x"));
+	EXPECT_EQ(RTLIL::const_shl(RTLIL::Const(1, 4), bits("x"), false, false, 4), RTLIL::Const(RTLIL::State::Sx, 4));
+}
+
+TEST(KernelCalcTest, compareMixedSignedness)
+{
+	EXPECT_EQ(RTLIL::const_lt(bits("1111"), RTLIL::Const(0, 4), true, true, 1), RTLIL::Const(1, 1));
+	EXPECT_EQ(RTLIL::const_lt(bits("1111"), RTLIL::Const(0, 4), false, true, 1), RTLIL::Const(0, 1));
+	RTLIL::Const big = bits("1" + std::string(63, '0'));
+	EXPECT_EQ(RTLIL::const_gt(big, RTLIL::Const(1, 2), false, false, 1), RTLIL::Const(1, 1));
+	EXPECT_EQ(RTLIL::const_gt(big, RTLIL::Const(1, 2), true, false, 1), RTLIL::Const(0, 1));
+}
+
+TEST(KernelCalcTest, truncatingDivision)
+{
+	EXPECT_EQ(RTLIL::const_div(bits("1001"), RTLIL::Const(2, 3), true, false, 4), bits("1101"));
+	EXPECT_EQ(RTLIL::const_mod(bits("1001"), RTLIL::Const(2, 3), true, false, 4), bits("1111"));
+	EXPECT_EQ(RTLIL::const_div(RTLIL::Const(7, 4), RTLIL::Const(0, 4), false, false, 4), RTLIL::Const(RTLIL::State::Sx, 4));
+}
+
+TEST(KernelCalcTest, shiftByWideAmount)
+{
+	EXPECT_EQ(RTLIL::const_shr(RTLIL::Const(12, 4), RTLIL::Const(2, 3), false, false, 4), RTLIL::Const(3, 4));
+	EXPECT_EQ(RTLIL::const_sshr(bits("1000"), RTLIL::Const(2, 2), true, false, 4), bits("1110"));
+	EXPECT_EQ(RTLIL::const_shift(bits("0110"), bits("11"), false, true, 4), bits("1100"));
+	RTLIL::Const amount = bits("1" + std::string(64, '0'));
+	EXPECT_EQ(RTLIL::const_shl(RTLIL::Const(1, 4), amount, false, false, 4), RTLIL::Const(0, 4));
+	EXPECT_EQ(RTLIL::const_shiftx(RTLIL::Const(1, 4), amount, false, false, 2), RTLIL::Const(RTLIL::State::Sx, 2));
+}
+
+YOSYS_NAMESPACE_END
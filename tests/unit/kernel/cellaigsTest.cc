@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/cellaigs.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelCellAigsTest, cachedModelsAreSharedPerSignature)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a), 4);
+	Wire *b = module->addWire(ID(b), 4);
+	Wire *y = module->addWire(ID(y), 4);
+	Wire *z = module->addWire(ID(z), 5);
+
+	Cell *add1 = module->addAdd(ID(add1), a, b, y);
+	Cell *add2 = module->addAdd(ID(add2), b, a, y);
+	Cell *add3 = module->addAdd(ID(add3), a, b, z);
+
+	const Aig &aig1 = Aig::cached(add1);
+	EXPECT_EQ(&aig1, &Aig::cached(add2));
+	EXPECT_NE(&aig1, &Aig::cached(add3));
+
+	// same model as building it for the cell
+	Aig fresh(add1);
+	EXPECT_EQ(aig1.name, fresh.name);
+	EXPECT_EQ(aig1.nodes, fresh.nodes);
+	EXPECT_NE(aig1.name, Aig::cached(add3).name);
+
+	// cells without a model share an empty one
+	Cell *mem = module->addCell(ID(mem), ID($mem_v2));
+	EXPECT_TRUE(Aig::cached(mem).name.empty());
+}
+
+YOSYS_NAMESPACE_END
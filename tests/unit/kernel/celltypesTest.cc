@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/celltypes.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// The lookup tables must give the same answers as cell_types.
+static void check_against_dict(const CellTypes &ct, const std::vector<IdString> &types, const pool<IdString> &ports)
+{
+	for (auto type : types) {
+		auto it = ct.cell_types.find(type);
+		bool known = it != ct.cell_types.end();
+		EXPECT_EQ(ct.cell_known(type), known) << type.str();
+		EXPECT_EQ(ct.cell_evaluable(type), known && it->second.is_evaluable) << type.str();
+		for (auto port : ports) {
+			EXPECT_EQ(ct.cell_input(type, port), known && it->second.inputs.count(port) != 0) << type.str() << " " << port.str();
+			EXPECT_EQ(ct.cell_output(type, port), known && it->second.outputs.count(port) != 0) << type.str() << " " << port.str();
+		}
+	}
+}
+
+TEST(KernelCellTypesTest, tablesMatchDict)
+{
+	CellTypes ct;
+	ct.setup();
+
+	std::vector<IdString> types;
+	pool<IdString> ports;
+	for (auto &it : ct.cell_types) {
+		types.push_back(it.first);
+		for (auto port : it.second.inputs)
+			ports.insert(port);
+		for (auto port : it.second.outputs)
+			ports.insert(port);
+	}
+	types.push_back(ID(not_a_cell));
+	ports.insert(ID(not_a_port));
+	check_against_dict(ct, types, ports);
+
+	ct.erase_type(ID($mux));
+	ct.erase_type(ID($_TBUF_));
+	EXPECT_FALSE(ct.cell_known(ID($mux)));
+	EXPECT_FALSE(ct.cell_output(ID($_TBUF_), ID::Y));
+	check_against_dict(ct, types, ports);
+}
+
+TEST(KernelCellTypesTest, typesBeyondTheTables)
+{
+	// with more live ids than the tables cover, some of them have larger
+	// indices, use those for a module and its ports
+	std::vector<IdString> ids, high_ids;
+	for (int i = 0; i <= CellTypes::table_index_limit; i++) {
+		ids.push_back(stringf("\\celltypes_test_%d", i));
+		if (ids.back().index_ >= CellTypes::table_index_limit)
+			high_ids.push_back(ids.back());
+	}
+	ASSERT_GE(GetSize(high_ids), 1);
+
+	Design design;
+	Module *module = design.addModule(high_ids.front());
+	Wire *a = module->addWire(ID(celltypes_test_a));
+	a->port_input = true;
+	Wire *y = module->addWire(ID(celltypes_test_y));
+	y->port_output = true;
+	module->fixup_ports();
+
+	CellTypes ct(&design);
+	EXPECT_TRUE(ct.cell_known(module->name));
+	EXPECT_TRUE(ct.cell_input(module->name, a->name));
+	EXPECT_FALSE(ct.cell_output(module->name, a->name));
+	EXPECT_TRUE(ct.cell_output(module->name, y->name));
+	EXPECT_TRUE(ct.cell_output(ID($add), ID::Y));
+	EXPECT_FALSE(ct.cell_known(high_ids.back() == module->name ? ID(celltypes_test_other) : high_ids.back()));
+}
+
+YOSYS_NAMESPACE_END
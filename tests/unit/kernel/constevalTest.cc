@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#include "kernel/yosys.h"
+#include "kernel/consteval.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct KernelConstEvalTest : public ::testing::Test
+{
+	static void SetUpTestCase()
+	{
+		yosys_setup();
+	}
+
+	static void TearDownTestCase()
+	{
+		yosys_shutdown();
+	}
+};
+
+TEST_F(KernelConstEvalTest, vecMatchesConstEval)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a), 6);
+	Wire *b = module->addWire(ID(b), 4);
+	Wire *s = module->addWire(ID(s));
+
+	std::vector<SigSpec> outputs;
+	auto out = [&](int width) {
+		SigSpec y = module->addWire(NEW_ID, width);
+		outputs.push_back(y);
+		return y;
+	};
+
+	for (bool is_signed : {false, true}) {
+		module->addAdd(NEW_ID, a, b, out(7), is_signed);
+		module->addSub(NEW_ID, b, a, out(8), is_signed);
+		module->addNeg(NEW_ID, b, out(6), is_signed);
+		module->addNot(NEW_ID, b, out(6), is_signed);
+		module->addAnd(NEW_ID, a, b, out(8), is_signed);
+		module->addOr(NEW_ID, b, a, out(3), is_signed);
+		module->addXor(NEW_ID, a, b, out(7), is_signed);
+		module->addXnor(NEW_ID, a, b, out(7), is_signed);
+		module->addEq(NEW_ID, a, b, out(2), is_signed);
+		module->addNe(NEW_ID, a, b, out(1), is_signed);
+		module->addLt(NEW_ID, a, b, out(1), is_signed);
+		module->addLe(NEW_ID, b, a, out(1), is_signed);
+		module->addGt(NEW_ID, a, b, out(1), is_signed);
+		module->addGe(NEW_ID, b, a, out(3), is_signed);
+		// no bit-parallel implementation for these
+		module->addShl(NEW_ID, a, SigSpec(b, 0, 2), out(8), is_signed);
+		module->addMul(NEW_ID, a, b, out(10), is_signed);
+	}
+
+	module->addReduceAnd(NEW_ID, a, out(1));
+	module->addReduceOr(NEW_ID, a, out(1));
+	module->addReduceXor(NEW_ID, a, out(2));
+	module->addReduceXnor(NEW_ID, b, out(1));
+	module->addReduceBool(NEW_ID, b, out(1));
+	module->addLogicNot(NEW_ID, b, out(1));
+	module->addLogicAnd(NEW_ID, a, b, out(1));
+	module->addLogicOr(NEW_ID, a, b, out(1));
+	module->addMux(NEW_ID, a, outputs[0].extract(0, 6), s, out(6));
+
+	SigBit a0(a, 0), a1(a, 1), b0(b, 0), b1(b, 1);
+	module->addAndGate(NEW_ID, a0, b0, out(1));
+	module->addNandGate(NEW_ID, a0, b0, out(1));
+	module->addOrGate(NEW_ID, a0, b0, out(1));
+	module->addNorGate(NEW_ID, a0, b0, out(1));
+	module->addXorGate(NEW_ID, a0, b0, out(1));
+	module->addXnorGate(NEW_ID, a0, b0, out(1));
+	module->addAndnotGate(NEW_ID, a0, b0, out(1));
+	module->addOrnotGate(NEW_ID, a0, b0, out(1));
+	module->addMuxGate(NEW_ID, a0, b0, s, out(1));
+	module->addNmuxGate(NEW_ID, a0, b0, s, out(1));
+	module->addAoi3Gate(NEW_ID, a0, a1, b0, out(1));
+	module->addOai3Gate(NEW_ID, a0, a1, b0, out(1));
+	module->addAoi4Gate(NEW_ID, a0, a1, b0, b1, out(1));
+	module->addOai4Gate(NEW_ID, a0, a1, b0, b1, out(1));
+
+	// cells reading the results of other cells
+	module->addAdd(NEW_ID, outputs[0], outputs[1], out(9));
+	module->addMul(NEW_ID, outputs[2], outputs.back(), out(8));
+
+	std::mt19937 rng(1);
+	ConstEvalVec vec(module, 2);
+	std::vector<Const> patterns;
+	SigSpec inputs({s, b, a});
+	for (int p = 0; p < 128; p++) {
+		patterns.push_back(Const(rng(), GetSize(inputs)));
+		vec.set_pattern(inputs, p, patterns.back());
+	}
+
+	ConstEval ce(module);
+	for (auto &sig : outputs) {
+		std::vector<uint64_t> result;
+		ASSERT_TRUE(vec.eval(sig, result)) << log_signal(sig);
+		for (int p = 0; p < 128; p++) {
+			ce.clear();
+			ce.set(inputs, patterns[p]);
+			SigSpec expected = sig;
+			ASSERT_TRUE(ce.eval(expected));
+			EXPECT_EQ(vec.get_pattern(result, p), expected.as_const())
+					<< log_signal(sig) << " pattern " << p;
+		}
+	}
+
+	std::vector<uint64_t> result;
+	SigSpec undef;
+	ConstEvalVec unset(module);
+	EXPECT_FALSE(unset.eval(outputs[0], result, undef));
+	EXPECT_GT(GetSize(undef), 0);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/ff.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelFfTest, sliceSelectsBitsInOrder)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *clk = module->addWire(ID(clk));
+	Wire *en = module->addWire(ID(en));
+	Wire *rst = module->addWire(ID(rst));
+	Wire *d = module->addWire(ID(d), 4);
+	Wire *q = module->addWire(ID(q), 4);
+	q->attributes[ID::init] = Const::from_string("1010");
+	Cell *cell = module->addAdffe(ID(ff), clk, en, rst, d, q, Const(5, 4));
+
+	SigMap sigmap(module);
+	FfInitVals initvals;
+	initvals.set(&sigmap, module);
+	FfData ff(&initvals, cell);
+
+	FfData res = ff.slice({2, 0});
+	EXPECT_EQ(res.width, 2);
+	EXPECT_EQ(res.sig_q, SigSpec({SigSpec(q, 0, 1), SigSpec(q, 2, 1)}));
+	EXPECT_EQ(res.sig_d, SigSpec({SigSpec(d, 0, 1), SigSpec(d, 2, 1)}));
+	EXPECT_EQ(res.val_arst, Const(3, 2));
+	EXPECT_EQ(res.val_init, Const(0, 2));
+	EXPECT_TRUE(res.has_ce && res.has_arst && res.has_clk);
+	EXPECT_EQ(res.sig_clk, SigSpec(clk));
+	EXPECT_EQ(res.sig_arst, SigSpec(rst));
+
+	res = ff.slice({1, 3});
+	EXPECT_EQ(res.sig_q, SigSpec({SigSpec(q, 3, 1), SigSpec(q, 1, 1)}));
+	EXPECT_EQ(res.val_arst, Const(0, 2));
+	EXPECT_EQ(res.val_init, Const(3, 2));
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,240 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+
+#include "kernel/yosys.h"
+#include "kernel/rtlil.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelHashlibTest, flatDictMatchesDict)
+{
+	std::mt19937 rng(1);
+	dict<int, int> ref;
+	flat_dict<int, int> uut;
+
+	for (int i = 0; i < 20000; i++) {
+		int key = rng() % 2000;
+		switch (rng() % 4) {
+		case 0:
+			EXPECT_EQ(uut.erase(key), ref.erase(key));
+			break;
+		case 1:
+			EXPECT_EQ(uut.count(key), ref.count(key));
+			break;
+		default:
+			uut[key] = i;
+			ref[key] = i;
+		}
+	}
+
+	// same iteration order as dict
+	ASSERT_EQ(uut.size(), ref.size());
+	auto it = ref.begin();
+	for (auto &entry : uut) {
+		EXPECT_EQ(entry, *it);
+		++it;
+	}
+
+	flat_dict<int, int> copy = uut;
+	EXPECT_TRUE(copy == uut);
+	copy.erase(copy.begin()->first);
+	EXPECT_FALSE(copy == uut);
+
+	uut.clear();
+	EXPECT_TRUE(uut.empty());
+	EXPECT_EQ(uut.count(0), 0);
+	EXPECT_EQ(uut.find(0), uut.end());
+}
+
+TEST(KernelHashlibTest, flatPoolAndIdict)
+{
+	flat_pool<std::string> p;
+	EXPECT_TRUE(p.insert("a").second);
+	EXPECT_FALSE(p.insert("a").second);
+	p.emplace("b");
+	EXPECT_EQ(p.size(), 2u);
+	EXPECT_EQ(*p.begin(), "b");
+	EXPECT_EQ(p.pop(), "b");
+	EXPECT_EQ(p.count("b"), 0);
+	EXPECT_EQ(p.count("a"), 1);
+
+	flat_idict<std::string, 10> idx;
+	EXPECT_EQ(idx("x"), 10);
+	EXPECT_EQ(idx("y"), 11);
+	EXPECT_EQ(idx("x"), 10);
+	EXPECT_EQ(idx.at("y"), 11);
+	EXPECT_EQ(idx.at("z", -1), -1);
+	EXPECT_EQ(idx[11], "y");
+
+	std::vector<std::string> order(idx.begin(), idx.end());
+	EXPECT_EQ(order, std::vector<std::string>({"x", "y"}));
+}
+
+TEST(KernelHashlibTest, flatDictManyCollisions)
+{
+	struct bad_ops {
+		static inline bool cmp(int a, int b) { return a == b; }
+		static inline unsigned int hash(int) { return 42; }
+	};
+
+	flat_dict<int, int, bad_ops> d;
+	for (int i = 0; i < 100; i++)
+		d[i] = i;
+	for (int i = 0; i < 100; i += 2)
+		d.erase(i);
+	for (int i = 0; i < 100; i++)
+		EXPECT_EQ(d.count(i), i % 2);
+	for (int i = 0; i < 100; i += 2)
+		d[i] = i;
+	EXPECT_EQ(d.size(), 100u);
+}
+
+TEST(KernelHashlibTest, statsCountChains)
+{
+	struct bad_ops {
+		static inline bool cmp(int a, int b) { return a == b; }
+		static inline unsigned int hash(int a) { return a / 10; }
+	};
+
+	pool<int, bad_ops> p;
+	for (int i = 0; i < 100; i++)
+		p.insert(i);
+	hash_stats stats = p.stats();
+	EXPECT_EQ(stats.entries, 100u);
+	EXPECT_EQ(stats.used_buckets, 10u);
+	EXPECT_EQ(stats.max_chain, 10u);
+	EXPECT_DOUBLE_EQ(stats.avg_probes(), 5.5);
+
+	stats.add(idict<int>().stats());
+	EXPECT_EQ(stats.containers, 2u);
+	EXPECT_EQ(stats.entries, 100u);
+}
+
+TEST(KernelHashlibTest, pairKeysSpreadOverBuckets)
+{
+	// 33*a^b of DJB2 mapped this grid to 34k distinct hashes
+	dict<std::pair<int, int>, int> grid;
+	for (int x = 0; x < 300; x++)
+		for (int y = 0; y < 300; y++)
+			grid[std::make_pair(x, y)] = x + y;
+	hash_stats stats = grid.stats();
+	EXPECT_LE(stats.max_chain, 8u);
+	EXPECT_LT(stats.avg_probes(), 1.25 * stats.avg_uniform_probes());
+}
+
+TEST(KernelHashlibTest, wideWireBitsSpreadOverBuckets)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	pool<SigBit> bits;
+	for (int i = 0; i < 500; i++)
+		for (auto bit : SigSpec(module->addWire(stringf("\\bus%d", i), 256)))
+			bits.insert(bit);
+	hash_stats stats = bits.stats();
+	EXPECT_LT(stats.avg_probes(), 1.25 * stats.avg_uniform_probes());
+}
+
+TEST(KernelHashlibTest, stringHashWordAtATime)
+{
+	std::string str = "$auto$hashlibTest.cc:1:net$12345";
+	for (size_t len = 0; len <= str.size(); len++) {
+		std::string prefix = str.substr(0, len);
+		EXPECT_EQ(hash_ops<std::string>::hash(prefix), hash_cstr_ops::hash(prefix.c_str()));
+	}
+	EXPECT_NE(hash_ops<std::string>::hash("abcd1"), hash_ops<std::string>::hash("abcd2"));
+	EXPECT_NE(hash_ops<std::string>::hash("abcd"), hash_ops<std::string>::hash(std::string("abcd\0", 5)));
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void bench_report(std::string name, size_t n, bench_clock::time_point start)
+{
+	double us = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+	printf("%-32s %10.3f ns/op\n", name.c_str(), 1000.0 * us / n);
+}
+
+template<typename D>
+static size_t bench_dict(const char *name, const std::vector<SigBit> &bits, const std::vector<SigBit> &hits, const std::vector<SigBit> &misses)
+{
+	D d;
+	size_t sum = 0;
+	auto start = bench_clock::now();
+	for (int i = 0; i < GetSize(bits); i++)
+		d[bits[i]] = i;
+	bench_report(stringf("%s insert", name), bits.size(), start);
+
+	start = bench_clock::now();
+	for (int r = 0; r < 5; r++)
+		for (auto &bit : hits)
+			sum += d.at(bit);
+	bench_report(stringf("%s lookup hit", name), 5 * hits.size(), start);
+
+	start = bench_clock::now();
+	for (int r = 0; r < 5; r++)
+		for (auto &bit : misses)
+			sum += d.count(bit);
+	bench_report(stringf("%s lookup miss", name), 5 * misses.size(), start);
+
+	start = bench_clock::now();
+	for (int i = 0; i < GetSize(hits); i += 2)
+		sum += d.erase(hits[i]);
+	bench_report(stringf("%s erase", name), hits.size() / 2, start);
+	return sum;
+}
+
+template<typename D>
+static size_t bench_idict(const char *name, const std::vector<IdString> &names)
+{
+	D d;
+	size_t sum = 0;
+	auto start = bench_clock::now();
+	for (auto &id : names)
+		sum += d(id);
+	bench_report(stringf("%s insert", name), names.size(), start);
+
+	start = bench_clock::now();
+	for (int r = 0; r < 5; r++)
+		for (auto &id : names)
+			sum += d(id);
+	bench_report(stringf("%s lookup", name), 5 * names.size(), start);
+	return sum;
+}
+
+// Compares dict/idict with flat_dict/flat_idict using SigBit and IdString
+// keys of a netlist-like module, not run by default. Use
+// "--gtest_also_run_disabled_tests --gtest_filter=*Bench*" to run it.
+TEST(KernelHashlibTest, DISABLED_Bench)
+{
+	std::mt19937 rng(1);
+
+	Design design;
+	Module *module = design.addModule(ID(top));
+
+	std::vector<SigBit> bits;
+	std::vector<IdString> names;
+	for (int i = 0; i < 50000; i++) {
+		// mostly single-bit auto-generated nets with some wide buses,
+		// similar to the wires found after synthesis
+		int width = rng() % 8 == 0 ? 1 + rng() % 32 : 1;
+		Wire *w = module->addWire(stringf("$auto$bench.cc:%d:net$%d", 100 + i % 50, i), width);
+		names.push_back(w->name);
+		for (int k = 0; k < width; k++)
+			bits.push_back(SigBit(w, k));
+	}
+
+	std::vector<SigBit> hits = bits, misses;
+	std::shuffle(hits.begin(), hits.end(), rng);
+	for (int i = 0; i < 10000; i++)
+		misses.push_back(SigBit(module->addWire(NEW_ID), 0));
+
+	size_t s1 = bench_dict<dict<SigBit, int>>("dict<SigBit>", bits, hits, misses);
+	size_t s2 = bench_dict<flat_dict<SigBit, int>>("flat_dict<SigBit>", bits, hits, misses);
+	EXPECT_EQ(s1, s2);
+
+	s1 = bench_idict<idict<IdString>>("idict<IdString>", names);
+	s2 = bench_idict<flat_idict<IdString>>("flat_idict<IdString>", names);
+	EXPECT_EQ(s1, s2);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/modtools.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+static void expect_same_map(const SigMap &a, Module *module)
+{
+	SigMap ref(module);
+	for (auto wire : module->wires())
+		EXPECT_EQ(a(SigSpec(wire)), ref(SigSpec(wire))) << log_id(wire);
+}
+
+TEST(KernelModtoolsTest, modSigMapIncremental)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a), 4);
+	Wire *b = module->addWire(ID(b), 4);
+	Wire *c = module->addWire(ID(c), 4);
+
+	ModSigMap modmap(module);
+	module->connect(a, b);
+	expect_same_map(modmap.sigmap(), module);
+	EXPECT_EQ(modmap.rebuilds(), 1);
+
+	module->connect(SigSpec(b, 0, 2), SigSpec(State::S0, 2));
+	module->connect(SigSpec({SigSpec(State::S1), SigSpec(c, 0, 1)}), SigSpec(a, 2, 2));
+	expect_same_map(modmap.sigmap(), module);
+	EXPECT_EQ(modmap.rebuilds(), 1);
+
+	module->new_connections({});
+	expect_same_map(modmap.sigmap(), module);
+	EXPECT_EQ(modmap.rebuilds(), 2);
+
+	Wire *d = module->addWire(ID(d), 4);
+	module->connect(c, d);
+	EXPECT_EQ(modmap.sigmap()(SigSpec(c)), modmap.sigmap()(SigSpec(d)));
+	module->remove(pool<Wire*>{d});
+	expect_same_map(modmap.sigmap(), module);
+	EXPECT_EQ(modmap.rebuilds(), 3);
+}
+
+TEST(KernelModtoolsTest, modCache)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a), 4);
+	Wire *b = module->addWire(ID(b), 4);
+	EXPECT_EQ(ModCache::find(&design), nullptr);
+
+	{
+		ModCache cache(&design);
+		EXPECT_EQ(ModCache::find(&design), &cache);
+
+		ModSigMap &modmap = cache.sigmap(module);
+		EXPECT_EQ(&cache.sigmap(module), &modmap);
+		module->connect(a, b);
+		expect_same_map(ModCache::get_sigmap(module), module);
+		EXPECT_EQ(modmap.rebuilds(), 1);
+
+		EXPECT_TRUE(cache.index(module).query_is_output(SigBit(a, 0)) == false);
+		cache.invalidate(module);
+		EXPECT_EQ(modmap.sigmap()(SigSpec(a)), SigSpec(b));
+		EXPECT_EQ(modmap.rebuilds(), 2);
+
+		// monitors are removed with the cached entries
+		EXPECT_EQ(GetSize(module->monitors), 1);
+		design.remove(design.addModule(ID(other)));
+		cache.sigmap(design.addModule(ID(other2)));
+		design.remove(design.module(ID(other2)));
+		EXPECT_EQ(GetSize(module->monitors), 1);
+	}
+
+	EXPECT_EQ(ModCache::find(&design), nullptr);
+	EXPECT_TRUE(module->monitors.empty());
+}
+
+static void expect_same_ff_index(ModFfIndex &index, Module *module)
+{
+	ModFfIndex ref(module);
+	for (auto wire : module->wires())
+		for (auto bit : SigSpec(wire)) {
+			const ModFfIndex::cell_int_t *driver = index.driver(bit), *ref_driver = ref.driver(bit);
+			EXPECT_EQ(driver == nullptr, ref_driver == nullptr) << log_signal(bit);
+			if (driver != nullptr && ref_driver != nullptr) {
+				EXPECT_EQ(*driver, *ref_driver) << log_signal(bit);
+			}
+			EXPECT_EQ(index.sinks(bit), ref.sinks(bit)) << log_signal(bit);
+			EXPECT_EQ(index.users(bit), ref.users(bit)) << log_signal(bit);
+		}
+}
+
+TEST(KernelModtoolsTest, modFfIndexIncremental)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *clk = module->addWire(ID(clk));
+	Wire *a = module->addWire(ID(a), 4);
+	Wire *b = module->addWire(ID(b), 4);
+	Wire *q = module->addWire(ID(q), 4);
+	Wire *y = module->addWire(ID(y), 4);
+	y->port_output = true;
+	module->fixup_ports();
+	Cell *ff1 = module->addDff(NEW_ID, clk, a, q);
+	module->addDff(NEW_ID, clk, SigSpec(b, 0, 2), SigSpec(y, 0, 2));
+	Cell *neg = module->addNot(NEW_ID, q, y);
+
+	ModFfIndex index(module);
+	EXPECT_EQ(*index.driver(SigBit(q, 1)), ModFfIndex::cell_int_t(ff1, 1));
+	EXPECT_EQ(index.sinks(SigBit(a, 2)), pool<ModFfIndex::cell_int_t>({ModFfIndex::cell_int_t(ff1, 2)}));
+	EXPECT_EQ(index.users(SigBit(q, 0)), 1);
+	EXPECT_EQ(index.users(SigBit(y, 0)), 1);
+	EXPECT_EQ(index.users(SigBit(clk, 0)), 2);
+	EXPECT_EQ(index.reloads(), 1);
+
+	ff1->setPort(ID::Q, SigSpec({SigSpec(q, 1, 3), module->addWire(NEW_ID)}));
+	module->connect(SigSpec(b, 2, 2), SigSpec(a, 0, 2));
+	module->connect(SigSpec(b, 0), State::S0);
+	module->addDff(NEW_ID, clk, q, b);
+	module->remove(neg);
+	expect_same_ff_index(index, module);
+	EXPECT_EQ(index.reloads(), 1);
+
+	module->new_connections({});
+	expect_same_ff_index(index, module);
+	EXPECT_EQ(index.reloads(), 2);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/netgraph.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelNetGraphTest, sccAndTopoOrder)
+{
+	// 0 -> 1 -> 2 -> 1, 2 -> 3, 4 -> 4
+	NetGraph graph(5);
+	graph.add_edge(0, 1);
+	graph.add_edge(1, 2);
+	graph.add_edge(2, 1);
+	graph.add_edge(2, 3);
+	graph.add_edge(2, 3);
+	graph.add_edge(4, 4);
+	graph.build();
+	EXPECT_EQ(graph.num_edges(), 5);
+
+	std::vector<int> component;
+	EXPECT_EQ(graph.scc(component), 4);
+	EXPECT_EQ(component[1], component[2]);
+	EXPECT_GT(component[0], component[1]);
+	EXPECT_GT(component[1], component[3]);
+
+	std::vector<bool> on_cycle = graph.on_cycle(component);
+	EXPECT_EQ(on_cycle, std::vector<bool>({false, true, true, false, true}));
+
+	std::vector<int> order;
+	EXPECT_FALSE(graph.topo_order(order));
+	EXPECT_EQ(order, std::vector<int>({0}));
+}
+
+TEST(KernelNetGraphTest, longestPath)
+{
+	// two paths from 0 to 4, of length 2 and 3
+	NetGraph graph(5);
+	graph.add_edge(0, 1, 10);
+	graph.add_edge(1, 4, 11);
+	graph.add_edge(0, 2, 12);
+	graph.add_edge(2, 3, 13);
+	graph.add_edge(3, 4, 14);
+	graph.build();
+
+	std::vector<int> order;
+	EXPECT_TRUE(graph.topo_order(order));
+	EXPECT_EQ(order, std::vector<int>({0, 1, 2, 3, 4}));
+
+	std::vector<int> level, pred_edge;
+	EXPECT_EQ(graph.longest_path(level, pred_edge), 3);
+	EXPECT_EQ(level, std::vector<int>({0, 1, 1, 2, 3}));
+	EXPECT_EQ(graph.edge_label[pred_edge[4]], 14);
+	EXPECT_EQ(graph.edge_source(pred_edge[4]), 3);
+	EXPECT_EQ(pred_edge[0], -1);
+}
+
+TEST(KernelNetGraphTest, deepChain)
+{
+	// deep enough to overflow the stack of a recursive implementation
+	const int depth = 1000000;
+	NetGraph graph(depth);
+	for (int i = 0; i+1 < depth; i++)
+		graph.add_edge(i, i+1);
+	graph.add_edge(depth-1, 0);
+	graph.build();
+
+	std::vector<int> component;
+	EXPECT_EQ(graph.scc(component), 1);
+
+	std::vector<int> level, pred_edge;
+	EXPECT_EQ(graph.longest_path(level, pred_edge), 0);
+}
+
+TEST(KernelNetGraphTest, sigBitGraph)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a), 2);
+	Wire *b = module->addWire(ID(b), 2);
+	Wire *y = module->addWire(ID(y), 2);
+	Wire *z = module->addWire(ID(z), 2);
+	Cell *and_cell = module->addAnd(ID(and), a, b, y);
+	module->addNot(ID(not), y, z);
+
+	SigBitGraph exact(module);
+	for (auto cell : module->cells())
+		exact.add_cell(cell, true);
+	exact.build();
+	EXPECT_EQ(exact.num_nodes(), 8);
+	EXPECT_EQ(exact.num_edges(), 6);
+
+	SigBitGraph coarse(module);
+	coarse.add_cell(and_cell);
+	coarse.build();
+	EXPECT_EQ(coarse.num_edges(), 8);
+	EXPECT_EQ(coarse.cell(0), and_cell);
+
+	std::vector<int> level, pred_edge;
+	EXPECT_EQ(exact.longest_path(level, pred_edge), 2);
+	EXPECT_EQ(level[exact.node(SigBit(z, 1))], 2);
+}
+
+YOSYS_NAMESPACE_END
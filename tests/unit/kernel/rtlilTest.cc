@@ -11,4 +11,254 @@ TEST(KernelRtlilTest, getReferenceValid)
 	EXPECT_EQ(33, 33);
 }
 
+TEST(KernelRtlilTest, idStringRefcount)
+{
+	int idx;
+	{
+		IdString a("\\unit_test_refcount");
+		IdString b = a;
+		idx = a.index_;
+		EXPECT_EQ(a, b);
+		EXPECT_EQ(IdString::global_id_refcount(idx), 2);
+	}
+	EXPECT_EQ(IdString::global_id_entry(idx).str, nullptr);
+}
+
+TEST(KernelRtlilTest, idStringImmortal)
+{
+	int idx;
+	{
+		IdString a = IdString::immortal("\\unit_test_immortal");
+		IdString b = a;
+		idx = b.index_;
+		EXPECT_LT(IdString::global_id_refcount(idx), 0);
+	}
+	EXPECT_STREQ(IdString::global_id_entry(idx).str, "\\unit_test_immortal");
+	EXPECT_EQ(IdString("\\unit_test_immortal").index_, idx);
+}
+
+TEST(KernelRtlilTest, constWordOps)
+{
+	Const a(State::S0, 21), b(State::S0, 21);
+	EXPECT_TRUE(a.is_fully_zero());
+	EXPECT_TRUE(a.is_fully_def());
+	EXPECT_FALSE(a.as_bool());
+	EXPECT_EQ(a, b);
+	EXPECT_EQ(a.hash(), b.hash());
+
+	b.bits[17] = State::S1;
+	EXPECT_NE(a, b);
+	EXPECT_TRUE(a < b);
+	EXPECT_TRUE(b.as_bool());
+	EXPECT_FALSE(b.is_fully_zero());
+
+	b.bits[3] = State::Sz;
+	EXPECT_FALSE(b.is_fully_def());
+	EXPECT_TRUE(Const(State::Sx, 13).is_fully_undef());
+	EXPECT_TRUE(Const(State::Sx, 13).is_fully_undef_x_only());
+	EXPECT_FALSE(Const(State::Sz, 13).is_fully_undef_x_only());
+	EXPECT_TRUE(Const(State::S1, 9).is_fully_ones());
+
+	EXPECT_EQ(Const(-3, 40).as_string(), "1111111111111111111111111111111111111101");
+	EXPECT_EQ(Const(5, 4).extract(1, 6, State::Sx).as_string(), "xxx010");
+}
+
+TEST(KernelRtlilTest, moduleObjectPool)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+
+	std::vector<Cell*> cells;
+	for (int i = 0; i < 100; i++) {
+		Wire *w = module->addWire(stringf("\\w%d", i), i+1);
+		Cell *c = module->addCell(stringf("\\c%d", i), ID($not));
+		c->setPort(ID::A, w);
+		cells.push_back(c);
+	}
+	EXPECT_EQ(GetSize(module->cells()), 100);
+
+	// cells hash by hashidx_, compare the addresses instead
+	std::set<Cell*> removed;
+	for (int i = 0; i < 100; i += 2) {
+		removed.insert(cells[i]);
+		module->remove(cells[i]);
+	}
+
+	for (int i = 0; i < 50; i++) {
+		Cell *c = module->addCell(stringf("\\d%d", i), ID($not));
+		EXPECT_EQ(c->module, module);
+		EXPECT_TRUE(c->connections().empty());
+#ifndef YOSYS_NO_OBJPOOL
+		// slots of removed cells are reused
+		EXPECT_TRUE(removed.count(c) != 0);
+#endif
+	}
+	EXPECT_EQ(GetSize(module->cells()), 100);
+	EXPECT_EQ(GetSize(module->wire(ID(w7))), 8);
+	EXPECT_EQ(module->cell(ID(c7))->getPort(ID::A), SigSpec(module->wire(ID(w7))));
+}
+
+struct CountingMonitor : public RTLIL::Monitor
+{
+	int cell_connects = 0, module_connects = 0, batches = 0;
+	int batch_added = 0, batch_removed = 0, batch_connections = 0;
+
+	void notify_connect(RTLIL::Cell*, const RTLIL::IdString&, const RTLIL::SigSpec&, const RTLIL::SigSpec&) override { cell_connects++; }
+	void notify_connect(RTLIL::Module*, const RTLIL::SigSig&) override { module_connects++; }
+
+	void notify_batch(RTLIL::Module *module, const pool<RTLIL::Cell*> &added_cells,
+			const std::vector<RTLIL::Cell*> &removed_cells, const std::vector<RTLIL::SigSig> &connections) override
+	{
+		batches++;
+		batch_added += GetSize(added_cells);
+		batch_removed += GetSize(removed_cells);
+		batch_connections += GetSize(connections);
+		for (auto cell : removed_cells)
+			EXPECT_EQ(module->cell(cell->name), nullptr);
+		RTLIL::Monitor::notify_batch(module, added_cells, removed_cells, connections);
+	}
+};
+
+TEST(KernelRtlilTest, moduleBatch)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *a = module->addWire(ID(a));
+	Wire *b = module->addWire(ID(b));
+	Cell *old_cell = module->addNotGate(ID(old), a, b);
+
+	CountingMonitor mon;
+	module->monitors.insert(&mon);
+
+	module->begin_batch(10, 10, 10);
+	module->begin_batch();
+	Cell *c1 = module->addNotGate(ID(c1), b, a);
+	c1->setPort(ID(A), a);
+	Cell *c2 = module->addAndGate(ID(c2), a, b, module->addWire(ID(y)));
+	module->remove(c2);
+	module->remove(old_cell);
+	module->connect(a, b);
+	module->commit_batch();
+	EXPECT_EQ(mon.batches, 0);
+	module->commit_batch();
+
+	EXPECT_EQ(mon.batches, 1);
+	EXPECT_EQ(mon.batch_added, 1);
+	EXPECT_EQ(mon.batch_removed, 1);
+	EXPECT_EQ(mon.batch_connections, 1);
+	// replayed: two ports of the removed and the added cell, one connection
+	EXPECT_EQ(mon.cell_connects, 4);
+	EXPECT_EQ(mon.module_connects, 1);
+	EXPECT_EQ(GetSize(module->cells()), 1);
+
+	// outside of a batch every edit is reported on its own
+	module->remove(c1);
+	EXPECT_EQ(mon.cell_connects, 6);
+	EXPECT_EQ(mon.batches, 1);
+
+	module->monitors.erase(&mon);
+}
+
+TEST(KernelRtlilTest, moduleContentHash)
+{
+	Design design;
+	Module *m1 = design.addModule(ID(m1));
+	Wire *a = m1->addWire(ID(a), 4);
+	Wire *b = m1->addWire(ID(b), 4);
+	m1->addAnd(ID(and), a, b, m1->addWire(ID(y), 4));
+	m1->connect(SigSpec(b, 0, 2), SigSpec(a, 2, 2));
+
+	// same contents, created in a different order
+	Module *m2 = design.addModule(ID(m2));
+	Wire *y = m2->addWire(ID(y), 4);
+	b = m2->addWire(ID(b), 4);
+	a = m2->addWire(ID(a), 4);
+	m2->connect(SigSpec(b, 1), SigSpec(a, 3));
+	m2->connect(SigSpec(b, 0), SigSpec(a, 2));
+	m2->addAnd(ID(and), a, b, y);
+	EXPECT_EQ(m1->content_hash(), m2->content_hash());
+
+	RTLIL::ModuleHash mh(m2);
+	uint64_t last = mh.hash();
+	EXPECT_EQ(last, m2->content_hash());
+
+	auto check_changed = [&](const char *what) {
+		uint64_t h = mh.hash();
+		EXPECT_EQ(h, m2->content_hash()) << what;
+		EXPECT_NE(h, last) << what;
+		last = h;
+	};
+
+	Cell *cell = m2->addNot(ID(not), a, m2->addWire(ID(n), 4));
+	check_changed("add cell");
+	cell->setPort(ID::A, b);
+	check_changed("set port");
+	m2->rename(cell, ID(inv));
+	check_changed("rename cell");
+	cell->setParam(ID::A_SIGNED, 1);
+	check_changed("set parameter");
+	m2->connect(y, a);
+	check_changed("connect");
+	m2->rename(a, ID(x));
+	check_changed("rename wire");
+	cell->setPort(ID::A, SigSpec(State::S1, 4));
+	check_changed("constant port");
+	m2->remove(cell);
+	check_changed("remove cell");
+	m2->new_connections({});
+	check_changed("new connections");
+	m2->remove({m2->wire(ID(n))});
+	check_changed("remove wire");
+}
+
+TEST(KernelRtlilTest, srcSetMatchesStrpool)
+{
+	RTLIL::Design design;
+	RTLIL::Module *module = design.addModule(ID(top));
+	RTLIL::Wire *a = module->addWire(ID(a));
+	RTLIL::Wire *b = module->addWire(ID(b));
+	RTLIL::Wire *c = module->addWire(ID(c));
+	a->set_src_attribute("x.v:1.1-1.5|y.v:2.1-2.5");
+	b->set_src_attribute("x.v:1.1-1.5|y.v:2.1-2.5");
+	c->set_src_attribute("file with spaces.v:3.1-3.5|x.v:1.1-1.5");
+
+	pool<string> extra = {"z.v:4.1-4.5", "x.v:1.1-1.5"};
+	RTLIL::SrcSet extra_set(RTLIL::Const("z.v:4.1-4.5|x.v:1.1-1.5"));
+	EXPECT_EQ(extra_set.str(), "z.v:4.1-4.5|x.v:1.1-1.5");
+
+	a->add_strpool_attribute(ID::src, extra);
+	b->add_src_attribute(extra_set);
+	EXPECT_EQ(a->get_src_attribute(), b->get_src_attribute());
+
+	b->set_src_attribute("x.v:1.1-1.5|y.v:2.1-2.5");
+	extra_set.add_to(b);
+	EXPECT_EQ(a->get_src_attribute(), b->get_src_attribute());
+
+	std::string c_src = c->get_src_attribute();
+	extra_set.add_to(c);
+	RTLIL::Wire *d = module->addWire(ID(d));
+	d->set_src_attribute(c_src);
+	d->add_strpool_attribute(ID::src, extra);
+	EXPECT_EQ(c->get_src_attribute(), d->get_src_attribute());
+
+	RTLIL::Wire *e = module->addWire(ID(e));
+	extra_set.add_to(e);
+	EXPECT_FALSE(e->has_attribute(ID::src));
+}
+
+#ifdef YOSYS_ENABLE_THREADS
+TEST(KernelRtlilTest, idStringConcurrentDeferredFree)
+{
+	int idx;
+	IdString::begin_concurrent();
+	{
+		IdString a("\\unit_test_concurrent");
+		idx = a.index_;
+	}
+	EXPECT_STREQ(IdString::global_id_entry(idx).str, "\\unit_test_concurrent");
+	IdString::end_concurrent();
+	EXPECT_EQ(IdString::global_id_entry(idx).str, nullptr);
+}
+#endif
+
 YOSYS_NAMESPACE_END
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <chrono>
+
+#include "kernel/yosys.h"
+#include "kernel/rtlil.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct KernelSigSpecTest : public ::testing::Test
+{
+	RTLIL::Design *design;
+	RTLIL::Module *module;
+	RTLIL::Wire *a, *b, *y;
+
+	void SetUp() override
+	{
+		design = new RTLIL::Design;
+		module = design->addModule(ID(top));
+		a = module->addWire(ID(a), 8);
+		b = module->addWire(ID(b), 1);
+		y = module->addWire(ID(y), 8);
+	}
+
+	void TearDown() override
+	{
+		delete design;
+	}
+};
+
+TEST_F(KernelSigSpecTest, singleBit)
+{
+	SigSpec s1(a, 3), s2 = SigBit(a, 3), s3(b);
+
+	EXPECT_EQ(GetSize(s1), 1);
+	EXPECT_EQ(s1, s2);
+	EXPECT_EQ(s1.hash(), s2.hash());
+	EXPECT_NE(s1, s3);
+	EXPECT_TRUE(s3.is_wire());
+	EXPECT_FALSE(s1.is_wire());
+	EXPECT_TRUE(s1.is_chunk());
+	EXPECT_EQ(s1.as_bit(), SigBit(a, 3));
+	EXPECT_EQ(s1[0], SigBit(a, 3));
+
+	// same hash and order as for the packed representation
+	SigSpec s4 = SigSpec(a).extract(3, 2);
+	s4.remove(1);
+	EXPECT_EQ(s1, s4);
+	EXPECT_EQ(s1.hash(), s4.hash());
+	EXPECT_FALSE(s1 < s4);
+	EXPECT_FALSE(s4 < s1);
+
+	bool lt = s1 < s3;
+	SigSpec p1 = s1, p3 = s3;
+	EXPECT_EQ(GetSize(p1.chunks()), 1);
+	EXPECT_EQ(GetSize(p3.chunks()), 1);
+	EXPECT_EQ(p1 < p3, lt);
+	EXPECT_EQ(p3 < p1, !lt);
+
+	SigSpec c(State::S1);
+	EXPECT_TRUE(c.is_fully_const());
+	EXPECT_TRUE(c.is_fully_ones());
+	EXPECT_EQ(c.as_const(), Const(State::S1));
+
+	SigSpec d(Const(State::S1, 2));
+	d.remove(1);
+	EXPECT_EQ(c, d);
+	EXPECT_EQ(c.hash(), d.hash());
+}
+
+TEST_F(KernelSigSpecTest, singleBitConversion)
+{
+	SigSpec s(b);
+	s.append(SigBit(a, 0));
+	s.append(SigBit(a, 1));
+	EXPECT_EQ(GetSize(s), 3);
+	EXPECT_EQ(GetSize(s.chunks()), 2);
+	EXPECT_EQ(s.extract(1, 2), SigSpec(a, 0, 2));
+
+	SigSpec t;
+	t.append(State::S0);
+	EXPECT_EQ(GetSize(t.bits()), 1);
+	EXPECT_EQ(t, SigSpec(State::S0));
+	t.append(a);
+	EXPECT_EQ(GetSize(t), 9);
+	EXPECT_EQ(t.extract(1, 8), SigSpec(a));
+
+	SigSpec u(a, 2);
+	u.remove_const();
+	EXPECT_EQ(GetSize(u), 1);
+	SigSpec v(State::Sx);
+	v.remove_const();
+	EXPECT_TRUE(v.empty());
+}
+
+TEST_F(KernelSigSpecTest, hashInvalidation)
+{
+	SigSpec s(a);
+	unsigned int h = s.hash();
+
+	// unpacking keeps the cached hash
+	EXPECT_EQ(GetSize(s.bits()), 8);
+	EXPECT_EQ(s.hash(), h);
+
+	s[2] = State::S0;
+	EXPECT_NE(s.hash(), h);
+	EXPECT_EQ(s.hash(), SigSpec({SigSpec(a, 3, 5), SigSpec(State::S0), SigSpec(a, 0, 2)}).hash());
+
+	SigSpec t(b);
+	h = t.hash();
+	t.append(State::S1);
+	EXPECT_NE(t.hash(), h);
+
+	SigSpec p(y);
+	h = p.hash();
+	p.replace(SigSpec(y, 0, 4), SigSpec(a, 0, 4));
+	EXPECT_EQ(p, SigSpec({SigSpec(y, 4, 4), SigSpec(a, 0, 4)}));
+	EXPECT_EQ(p.hash(), SigSpec({SigSpec(y, 4, 4), SigSpec(a, 0, 4)}).hash());
+}
+
+// Microbenchmark for the common SigSpec operations, not run by default.
+// Use "--gtest_also_run_disabled_tests --gtest_filter=*Bench*" to run it.
+TEST_F(KernelSigSpecTest, DISABLED_Bench)
+{
+	const int N = 1000000;
+	typedef std::chrono::steady_clock clock;
+
+	auto report = [](const char *name, clock::time_point start) {
+		double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+		printf("%-24s %10.3f ns/op\n", name, 1000.0 * us / N);
+	};
+
+	auto start = clock::now();
+	size_t sum = 0;
+	for (int i = 0; i < N; i++) {
+		SigSpec s(a, i % 8);
+		sum += GetSize(s);
+	}
+	report("construct bit", start);
+
+	std::vector<SigSpec> sigs;
+	for (int i = 0; i < 8; i++)
+		sigs.push_back(SigSpec(a, i));
+	sigs.push_back(SigSpec(b));
+	sigs.push_back(SigSpec(State::S0));
+
+	start = clock::now();
+	for (int i = 0; i < N; i++) {
+		SigSpec s = sigs[i % GetSize(sigs)];
+		sum += s.is_wire();
+	}
+	report("copy bit", start);
+
+	start = clock::now();
+	for (int i = 0; i < N; i++)
+		sum += sigs[i % GetSize(sigs)] == sigs[(i + 1) % GetSize(sigs)];
+	report("compare bit", start);
+
+	dict<SigSpec, int> db;
+	for (int i = 0; i < GetSize(sigs); i++)
+		db[sigs[i]] = i;
+	start = clock::now();
+	for (int i = 0; i < N; i++)
+		sum += db.at(SigSpec(a, i % 8));
+	report("dict lookup bit", start);
+
+	dict<SigSpec, int> dw;
+	std::vector<SigSpec> wide;
+	for (int i = 0; i < 8; i++) {
+		wide.push_back(SigSpec({SigSpec(y, 0, i), SigSpec(a, i, 8 - i)}));
+		dw[wide.back()] = i;
+	}
+	start = clock::now();
+	for (int i = 0; i < N; i++) {
+		const SigSpec &s = wide[i % 8];
+		sum += GetSize(s.bits());
+		sum += dw.at(s);
+	}
+	report("dict lookup+bits wide", start);
+
+	start = clock::now();
+	for (int i = 0; i < N / 8; i++) {
+		SigSpec s;
+		for (int j = 0; j < 8; j++)
+			s.append(SigBit(j % 2 ? a : y, j));
+		sum += s.hash();
+	}
+	report("append+hash 8 bits", start);
+
+	EXPECT_GT(sum, 0u);
+}
+
+YOSYS_NAMESPACE_END
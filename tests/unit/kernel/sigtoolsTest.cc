@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelSigtoolsTest, flatSigMapMatchesSigMap)
+{
+	std::mt19937 rng(1);
+	Design design;
+	Module *module = design.addModule(ID(top));
+
+	std::vector<SigBit> bits;
+	for (int i = 0; i < 50; i++)
+		for (auto bit : SigSpec(module->addWire(stringf("\\w%d", i), 1 + rng() % 8)))
+			bits.push_back(bit);
+
+	for (int i = 0; i < 100; i++) {
+		SigBit a = bits[rng() % bits.size()];
+		SigBit b = rng() % 10 == 0 ? SigBit(rng() % 2 ? State::S1 : State::S0) : bits[rng() % bits.size()];
+		module->connect(a, b);
+	}
+
+	SigMap sigmap(module);
+	FlatSigMap flatmap(sigmap, module);
+	EXPECT_EQ(flatmap.num_bits(), GetSize(bits));
+
+	SigSpec all;
+	for (auto bit : bits) {
+		EXPECT_EQ(flatmap(bit), sigmap(bit)) << log_signal(bit);
+		EXPECT_GE(flatmap.id(bit), 0);
+		all.append(bit);
+	}
+	all.append(State::Sx);
+	EXPECT_EQ(flatmap(all), sigmap(all));
+	for (auto wire : module->wires())
+		EXPECT_EQ(flatmap(wire), sigmap(wire));
+
+	// wires added later and constants map to themselves
+	Wire *late = module->addWire(ID(late), 2);
+	EXPECT_EQ(flatmap(SigSpec(late)), SigSpec(late));
+	EXPECT_EQ(flatmap.id(SigBit(late, 0)), -1);
+	EXPECT_EQ(flatmap(SigBit(State::S1)), SigBit(State::S1));
+	EXPECT_EQ(flatmap.id(SigBit(State::S1)), -1);
+
+	flatmap.clear();
+	EXPECT_EQ(flatmap(bits[0]), bits[0]);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/threading.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+TEST(KernelThreadingTest, runCapturedReplaysInJobOrder)
+{
+	std::vector<int> order;
+	ThreadPool::run_captured(16, [&](int i) {
+		log("job %d\n", i);
+	}, 4, [&](int i) {
+		order.push_back(i);
+	});
+	ASSERT_EQ(GetSize(order), 16);
+	for (int i = 0; i < 16; i++)
+		EXPECT_EQ(order[i], i);
+}
+
+TEST(KernelThreadingTest, runCapturedRethrowsAfterReplay)
+{
+	std::vector<int> replayed;
+	EXPECT_THROW(ThreadPool::run_captured(4, [&](int i) {
+		if (i == 2)
+			throw std::runtime_error("job failed");
+	}, 4, nullptr, [&](int i) {
+		replayed.push_back(i);
+	}), std::runtime_error);
+	for (int i : replayed)
+		EXPECT_LT(i, 2);
+}
+
+TEST(KernelThreadingTest, newIdsAreUnique)
+{
+	std::vector<std::vector<IdString>> ids(8);
+	ThreadPool::run(8, [&](int i) {
+		for (int k = 0; k < 10; k++)
+			ids[i].push_back(NEW_ID);
+	}, 4);
+	pool<IdString> seen;
+	for (auto &job_ids : ids)
+		for (auto &id : job_ids)
+			EXPECT_TRUE(seen.insert(id).second);
+	IdString next = NEW_ID;
+	EXPECT_EQ(seen.count(next), 0u);
+}
+
+YOSYS_NAMESPACE_END
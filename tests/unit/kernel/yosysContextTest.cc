@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct KernelYosysContextTest : public ::testing::Test
+{
+	static void SetUpTestCase()
+	{
+		yosys_setup();
+	}
+
+	static void TearDownTestCase()
+	{
+		yosys_shutdown();
+	}
+};
+
+TEST_F(KernelYosysContextTest, contextsKeepTheirOwnModules)
+{
+	const int num_modules = 50;
+	RTLIL::Design *global_design = yosys_design;
+	int global_modules = GetSize(global_design->modules());
+
+	YosysContext contexts[2];
+	std::vector<std::thread> threads;
+	for (int k = 0; k < 2; k++)
+		threads.emplace_back([&contexts, k]() {
+			for (int i = 0; i < num_modules; i++)
+				contexts[k].run_pass(stringf("add -mod ctx%d_m%d", k, i));
+		});
+	for (auto &t : threads)
+		t.join();
+
+	EXPECT_EQ(yosys_design, global_design);
+	EXPECT_EQ(GetSize(global_design->modules()), global_modules);
+
+	for (int k = 0; k < 2; k++) {
+		RTLIL::Design *design = contexts[k].design;
+		EXPECT_NE(design, global_design);
+		EXPECT_EQ(GetSize(design->modules()), num_modules);
+		std::string prefix = stringf("\\ctx%d_", k);
+		for (auto module : design->modules())
+			EXPECT_EQ(module->name.str().compare(0, prefix.size(), prefix), 0) << log_id(module);
+	}
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <chrono>
+
+#include "kernel/yosys.h"
+#include "kernel/register.h"
+#include "kernel/consteval.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct PassesFlowmapTest : public ::testing::Test
+{
+	static void SetUpTestCase()
+	{
+		yosys_setup();
+	}
+
+	static void TearDownTestCase()
+	{
+		yosys_shutdown();
+	}
+};
+
+// Adds copies of a width-bit ripple carry adder built from simplemap gates.
+static Module *make_adders(Design *design, int copies, int width)
+{
+	Module *module = design->addModule(ID(top));
+	for (int n = 0; n < copies; n++) {
+		Wire *a = module->addWire(stringf("\\a%d", n), width);
+		Wire *b = module->addWire(stringf("\\b%d", n), width);
+		Wire *y = module->addWire(stringf("\\y%d", n), width + 1);
+		a->port_input = b->port_input = true;
+		y->port_output = true;
+
+		SigBit carry = State::S0;
+		for (int i = 0; i < width; i++) {
+			SigBit ab = module->XorGate(NEW_ID, SigBit(a, i), SigBit(b, i));
+			module->addXorGate(NEW_ID, ab, carry, SigBit(y, i));
+			SigBit gen = module->AndGate(NEW_ID, SigBit(a, i), SigBit(b, i));
+			SigBit prop = module->AndGate(NEW_ID, ab, carry);
+			carry = module->OrGate(NEW_ID, gen, prop);
+		}
+		module->connect(SigBit(y, width), carry);
+	}
+	module->fixup_ports();
+	return module;
+}
+
+TEST_F(PassesFlowmapTest, mapsAndTree)
+{
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *in = module->addWire(ID(in), 16);
+	in->port_input = true;
+	Wire *out = module->addWire(ID(out));
+	out->port_output = true;
+	module->fixup_ports();
+
+	std::vector<SigBit> level;
+	for (int i = 0; i < 16; i++)
+		level.push_back(SigBit(in, i));
+	while (GetSize(level) > 2) {
+		std::vector<SigBit> next;
+		for (int i = 0; i < GetSize(level); i += 2)
+			next.push_back(module->AndGate(NEW_ID, level[i], level[i + 1]));
+		level = next;
+	}
+	module->addAndGate(NEW_ID, level[0], level[1], out);
+
+	Pass::call(&design, "flowmap -maxlut 4");
+	Pass::call(&design, "opt_clean");
+
+	// a 16-input AND needs 4 LUTs in the first level and one in the second
+	EXPECT_EQ(GetSize(module->cells()), 5);
+	for (auto cell : module->cells()) {
+		EXPECT_EQ(cell->type, ID($lut));
+		EXPECT_LE(cell->getParam(ID::WIDTH).as_int(), 4);
+	}
+
+	ConstEval ce(module);
+	for (int i = 0; i < 17; i++) {
+		RTLIL::Const value(State::S1, 16);
+		if (i < 16)
+			value.bits[i] = State::S0;
+		ce.push();
+		ce.set(SigSpec(in), value);
+		SigSpec result = SigSpec(out);
+		ASSERT_TRUE(ce.eval(result));
+		EXPECT_EQ(result.as_const().as_bool(), i == 16);
+		ce.pop();
+	}
+}
+
+TEST_F(PassesFlowmapTest, mapsAdderWithRelax)
+{
+	Design design;
+	Module *module = make_adders(&design, 2, 8);
+	Pass::call(&design, "copy top gold");
+	Pass::call(&design, "flowmap -maxlut 4 -optarea 1 top");
+	Pass::call(&design, "opt_clean top");
+
+	for (auto cell : module->cells())
+		EXPECT_EQ(cell->type, ID($lut));
+
+	Module *gold = design.module(ID(gold));
+	ConstEval ce_gold(gold), ce_gate(module);
+	uint32_t seed = 1;
+	for (int pattern = 0; pattern < 64; pattern++) {
+		for (auto wire : module->wires()) {
+			if (!wire->port_input)
+				continue;
+			seed = seed * 1103515245 + 12345;
+			RTLIL::Const value(int(seed >> 8), wire->width);
+			ce_gold.set(SigSpec(gold->wire(wire->name)), value);
+			ce_gate.set(SigSpec(wire), value);
+		}
+		for (auto wire : module->wires()) {
+			if (!wire->port_output)
+				continue;
+			SigSpec expected = SigSpec(gold->wire(wire->name)), actual = SigSpec(wire);
+			ASSERT_TRUE(ce_gold.eval(expected));
+			ASSERT_TRUE(ce_gate.eval(actual));
+			EXPECT_EQ(expected.as_const(), actual.as_const());
+		}
+		ce_gold.clear();
+		ce_gate.clear();
+	}
+}
+
+// Runs flowmap on many copies of an adder, not run by default. Use
+// "--gtest_also_run_disabled_tests --gtest_filter=*Bench*" to run it.
+TEST_F(PassesFlowmapTest, DISABLED_Bench)
+{
+	typedef std::chrono::steady_clock clock;
+
+	for (auto command : {"flowmap -maxlut 4", "flowmap -maxlut 6 -relax"}) {
+		Design design;
+		Module *module = make_adders(&design, 2000, 32);
+		int num_cells = GetSize(module->cells());
+
+		auto start = clock::now();
+		Pass::call(&design, command);
+		double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		Pass::call(&design, "opt_clean");
+		printf("%s: %d gates into %d LUTs in %.1f ms\n", command, num_cells, GetSize(module->cells()), ms);
+	}
+}
+
+YOSYS_NAMESPACE_END
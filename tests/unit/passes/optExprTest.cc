@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+
+#include "kernel/yosys.h"
+#include "kernel/register.h"
+#include "kernel/sigtools.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct PassesOptExprTest : public ::testing::Test
+{
+	static void SetUpTestCase()
+	{
+		yosys_setup();
+	}
+
+	static void TearDownTestCase()
+	{
+		yosys_shutdown();
+	}
+};
+
+// Builds a module with a chain of length gates where each gate gets a
+// constant input once the gate before it has been folded.
+static Module *make_chain(Design *design, int length)
+{
+	Module *module = design->addModule(ID(top));
+	Wire *in = module->addWire(ID(in), length);
+	in->port_input = true;
+	Wire *out = module->addWire(ID(out));
+	out->port_output = true;
+	module->fixup_ports();
+
+	SigBit prev = State::S1;
+	for (int i = 0; i < length; i++) {
+		SigBit next = i == length-1 ? SigBit(out) : SigBit(module->addWire(NEW_ID));
+		// alternate between gates that fold to 0 and to 1
+		SigBit inv = module->NotGate(NEW_ID, prev);
+		if (i % 2 == 0)
+			module->addAndGate(NEW_ID, SigBit(in, i), inv, next);
+		else
+			module->addOrGate(NEW_ID, SigBit(in, i), inv, next);
+		prev = next;
+	}
+	return module;
+}
+
+TEST_F(PassesOptExprTest, foldsChain)
+{
+	Design design;
+	Module *module = make_chain(&design, 100);
+	Pass::call(&design, "opt_expr");
+
+	for (auto cell : module->cells())
+		ADD_FAILURE() << "cell " << log_id(cell) << " not folded";
+
+	SigMap sigmap(module);
+	EXPECT_EQ(sigmap(SigSpec(module->wire(ID(out)))), SigSpec(State::S1));
+}
+
+// Runs opt_expr on a large generated netlist, not run by default. Use
+// "--gtest_also_run_disabled_tests --gtest_filter=*Bench*" to run it.
+TEST_F(PassesOptExprTest, DISABLED_Bench)
+{
+	typedef std::chrono::steady_clock clock;
+	std::mt19937 rng(1);
+
+	Design design;
+	Module *module = design.addModule(ID(top));
+	Wire *in = module->addWire(ID(in), 64);
+	in->port_input = true;
+
+	// random gate-level logic where a few inputs are constant, most of the
+	// cells are not affected by the constants
+	std::vector<SigBit> nets;
+	for (int i = 0; i < 64; i++)
+		nets.push_back(SigBit(in, i));
+	nets.push_back(State::S0);
+	nets.push_back(State::S1);
+
+	for (int i = 0; i < 500000; i++) {
+		SigBit a = nets[rng() % nets.size()];
+		SigBit b = nets[rng() % nets.size()];
+		if (rng() % 100 != 0) {
+			// keep constants rare
+			while (a.wire == nullptr)
+				a = nets[rng() % nets.size()];
+			while (b.wire == nullptr)
+				b = nets[rng() % nets.size()];
+		}
+		SigBit y = module->addWire(NEW_ID);
+		switch (rng() % 4) {
+		case 0: module->addAndGate(NEW_ID, a, b, y); break;
+		case 1: module->addOrGate(NEW_ID, a, b, y); break;
+		case 2: module->addXorGate(NEW_ID, a, b, y); break;
+		default: module->addMuxGate(NEW_ID, a, b, nets[rng() % 64], y); break;
+		}
+		nets.push_back(y);
+	}
+
+	Wire *out = module->addWire(ID(out), 1024);
+	out->port_output = true;
+	for (int i = 0; i < 1024; i++)
+		module->connect(SigBit(out, i), nets[nets.size() - 1 - i]);
+	module->fixup_ports();
+
+	int num_cells = GetSize(module->cells());
+	auto start = clock::now();
+	Pass::call(&design, "opt_expr");
+	double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	printf("opt_expr: %d -> %d cells in %.1f ms\n", num_cells, GetSize(module->cells()), ms);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+trap 'echo "ERROR in server.sh" >&2; exit 1' ERR
+
+cat > server.v << "EOT"
+module top(input [7:0] a, b, output [7:0] y);
+	assign y = a + b;
+endmodule
+EOT
+
+# the job runs on the design of the server
+cat > server_job.ys << "EOT"
+select -assert-count 1 top/y
+log server-job-done
+EOT
+
+sock=$(mktemp -u /tmp/yosys-server-XXXXXX)
+../../yosys -q -p "read_verilog server.v; server -jobs 1 $sock" &
+server_pid=$!
+
+for i in $(seq 50); do
+	test -S "$sock" && break
+	sleep 0.1
+done
+# only the owner may connect
+test -n "$(find "$sock" -perm 600)"
+
+../../yosys -q -l server_job.log -p "server -connect $sock server_job.ys"
+grep -q "server-job-done" server_job.log
+grep -q -- "-- yosys server: job succeeded --" server_job.log
+
+# the server stops after the job, and removes its socket
+wait $server_pid
+test ! -e "$sock"
+
+rm -f server.v server_job.ys server_job.log
@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+trap 'echo "ERROR in threads.sh" >&2; exit 1' ERR
+
+cat > threads.v << "EOT"
+module sub1(input [7:0] a, b, output [7:0] x, y);
+	assign x = a + b;
+	assign y = a + b;
+endmodule
+
+module sub2(input [7:0] a, b, output [15:0] x);
+	assign x = {8'b0, a & b} * 3;
+endmodule
+
+module top(input [7:0] a, b, output [7:0] x, y, output [15:0] z);
+	sub1 u1 (a, b, x, y);
+	sub2 u2 (a, b, z);
+endmodule
+EOT
+
+# module-local passes must produce the same result regardless of the thread count
+../../yosys -q -j 1 -p 'read_verilog threads.v; proc; opt_merge; wreduce; write_rtlil threads_j1.il'
+../../yosys -q -j 4 -p 'read_verilog threads.v; proc; opt_merge; wreduce; write_rtlil threads_j4.il'
+cmp threads_j1.il threads_j4.il
+
+# write_rtlil dumps the modules in parallel, also for partial selections
+../../yosys -q -j 1 -p 'read_verilog threads.v; proc; select sub1 top/u1 top/x; write_rtlil -selected threads_j1.il'
+../../yosys -q -j 4 -p 'read_verilog threads.v; proc; select sub1 top/u1 top/x; write_rtlil -selected threads_j4.il'
+cmp threads_j1.il threads_j4.il
+
+# modules are dumped in parallel by write_verilog
+../../yosys -q -j 1 -p 'read_verilog threads.v; proc; write_verilog threads_j1.v'
+../../yosys -q -j 4 -p 'read_verilog threads.v; proc; write_verilog threads_j4.v'
+cmp threads_j1.v threads_j4.v
+
+# ... and serialized in parallel by write_json
+../../yosys -q -j 1 -p 'read_verilog threads.v; proc; write_json -aig threads_j1.json'
+../../yosys -q -j 4 -p 'read_verilog threads.v; proc; write_json -aig threads_j4.json'
+cmp threads_j1.json threads_j4.json
+
+# ... and by write_blif
+../../yosys -q -j 1 -p 'read_verilog threads.v; proc; techmap; write_blif -top top threads_j1.blif'
+../../yosys -q -j 4 -p 'read_verilog threads.v; proc; techmap; write_blif -top top threads_j4.blif'
+cmp threads_j1.blif threads_j4.blif
+
+# equiv_simple proves groups of $equiv cells in parallel
+equiv_script='read_verilog threads.v; proc; flatten; copy top gold; rename top gate; opt -full gate; equiv_make gold gate equiv; equiv_simple -undef; equiv_status -assert; write_rtlil'
+../../yosys -q -j 1 -p "$equiv_script threads_j1.il"
+../../yosys -q -j 4 -p "$equiv_script threads_j4.il"
+cmp threads_j1.il threads_j4.il
+
+rm -f threads.v threads_j1.il threads_j4.il threads_j1.v threads_j4.v threads_j1.json threads_j4.json threads_j1.blif threads_j4.blif
@@ -0,0 +1,16 @@
+module cell_a(input a, b, output y);
+  assign y = a & b;
+endmodule
+
+(* whitebox *)
+module cell_wb(input a, output y);
+  assign y = ~a;
+endmodule
+
+module cell_p #(parameter W = 2) (input [W-1:0] a, output y);
+endmodule
+
+`ifdef LIB_IMAGE_EXTRA
+module cell_extra(input a, output y);
+endmodule
+`endif